@@ -52,6 +52,8 @@ LIBADB_SRC_FILES := \
     adb_trace.cpp \
     adb_utils.cpp \
     fdevent.cpp \
+    file_sync_compression.cpp \
+    file_sync_delta.cpp \
     sockets.cpp \
     socket_spec.cpp \
     sysdeps/errno.cpp \
@@ -64,6 +66,8 @@ LIBADB_TEST_SRCS := \
     adb_listeners_test.cpp \
     adb_utils_test.cpp \
     fdevent_test.cpp \
+    file_sync_compression_test.cpp \
+    file_sync_delta_test.cpp \
     socket_spec_test.cpp \
     socket_test.cpp \
     sysdeps_test.cpp \
@@ -139,7 +143,7 @@ LOCAL_SANITIZE := $(adb_target_sanitize)
 
 # Even though we're building a static library (and thus there's no link step for
 # this to take effect), this adds the includes to our path.
-LOCAL_STATIC_LIBRARIES := libcrypto_utils libcrypto libqemu_pipe libbase
+LOCAL_STATIC_LIBRARIES := libcrypto_utils libcrypto libqemu_pipe libbase libz
 
 LOCAL_WHOLE_STATIC_LIBRARIES := libadbd_usb
 
@@ -165,7 +169,7 @@ LOCAL_SANITIZE := $(adb_host_sanitize)
 
 # Even though we're building a static library (and thus there's no link step for
 # this to take effect), this adds the includes to our path.
-LOCAL_STATIC_LIBRARIES := libcrypto_utils libcrypto libbase libmdnssd
+LOCAL_STATIC_LIBRARIES := libcrypto_utils libcrypto libbase libmdnssd libz
 LOCAL_STATIC_LIBRARIES_linux := libusb
 LOCAL_STATIC_LIBRARIES_darwin := libusb
 
@@ -188,7 +192,7 @@ LOCAL_SRC_FILES := \
 
 LOCAL_SANITIZE := $(adb_target_sanitize)
 LOCAL_STATIC_LIBRARIES := libadbd libcrypto_utils libcrypto libusb libmdnssd
-LOCAL_SHARED_LIBRARIES := liblog libbase libcutils
+LOCAL_SHARED_LIBRARIES := liblog libbase libcutils libz
 include $(BUILD_NATIVE_TEST)
 
 # libdiagnose_usb
@@ -236,6 +240,7 @@ LOCAL_STATIC_LIBRARIES := \
     libcutils \
     libdiagnose_usb \
     libmdnssd \
+    libz \
     libgmock_host \
 
 LOCAL_STATIC_LIBRARIES_linux := libusb
@@ -252,6 +257,34 @@ LOCAL_MULTILIB := first
 
 include $(BUILD_HOST_NATIVE_TEST)
 
+# adb_benchmark
+# =========================================================
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := adb_benchmark
+LOCAL_MODULE_HOST_OS := darwin linux
+LOCAL_CFLAGS := -DADB_HOST=1 $(LIBADB_CFLAGS)
+LOCAL_CFLAGS_linux := $(LIBADB_linux_CFLAGS)
+LOCAL_CFLAGS_darwin := $(LIBADB_darwin_CFLAGS)
+LOCAL_SRC_FILES := adb_benchmark.cpp
+LOCAL_STATIC_LIBRARIES := \
+    libadb \
+    libbase \
+    libcrypto_utils \
+    libcrypto \
+    libcutils \
+    libdiagnose_usb \
+    libgoogle-benchmark \
+    libmdnssd \
+    libz \
+
+LOCAL_STATIC_LIBRARIES_linux := libusb
+LOCAL_STATIC_LIBRARIES_darwin := libusb
+LOCAL_LDLIBS_linux := -lrt -ldl -lpthread
+LOCAL_LDLIBS_darwin := -framework CoreFoundation -framework IOKit -lobjc
+LOCAL_MULTILIB := first
+include $(BUILD_HOST_EXECUTABLE)
+
 # adb host tool
 # =========================================================
 include $(CLEAR_VARS)
@@ -305,6 +338,7 @@ LOCAL_STATIC_LIBRARIES := \
     libdiagnose_usb \
     liblog \
     libmdnssd \
+    libz \
 
 # Don't use libcutils on Windows.
 LOCAL_STATIC_LIBRARIES_darwin := libcutils
@@ -391,6 +425,7 @@ LOCAL_STATIC_LIBRARIES := \
     libminijail \
     libmdnssd \
     libdebuggerd_handler \
+    libz \
 
 include $(BUILD_EXECUTABLE)
 
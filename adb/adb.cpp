@@ -116,19 +116,99 @@ uint32_t calculate_apacket_checksum(const apacket* p) {
     return sum;
 }
 
-apacket* get_apacket(void)
+// Payload buffers come in a few size classes and freed ones are kept for reuse, up to a limit per
+// class. Anything larger than the biggest class is allocated to size and never pooled.
+static constexpr size_t kPayloadClassSizes[] = {MAX_PAYLOAD_V1, 64 * 1024, MAX_PAYLOAD};
+static constexpr size_t kPayloadClassLimits[] = {256, 32, 8};
+static constexpr size_t kPayloadClassCount = arraysize(kPayloadClassSizes);
+
+struct PayloadPool {
+    std::mutex lock;
+    std::vector<char*> buffers;
+};
+
+static PayloadPool* payload_pools() {
+    static auto& pools = *new PayloadPool[kPayloadClassCount];
+    return &pools;
+}
+
+static size_t payload_class(size_t size) {
+    size_t i = 0;
+    while (i < kPayloadClassCount && size > kPayloadClassSizes[i]) {
+        ++i;
+    }
+    return i;
+}
+
+static char* alloc_payload(size_t size, size_t* capacity) {
+    size_t cls = payload_class(size);
+    *capacity = cls < kPayloadClassCount ? kPayloadClassSizes[cls] : size;
+
+    if (cls < kPayloadClassCount) {
+        PayloadPool& pool = payload_pools()[cls];
+        std::lock_guard<std::mutex> lock(pool.lock);
+        if (!pool.buffers.empty()) {
+            char* data = pool.buffers.back();
+            pool.buffers.pop_back();
+            return data;
+        }
+    }
+
+    char* data = reinterpret_cast<char*>(malloc(*capacity));
+    if (data == nullptr) {
+        fatal("failed to allocate an apacket payload");
+    }
+    return data;
+}
+
+static void free_payload(char* data, size_t capacity) {
+    if (data == nullptr) {
+        return;
+    }
+
+    size_t cls = payload_class(capacity);
+    if (cls < kPayloadClassCount && capacity == kPayloadClassSizes[cls]) {
+        PayloadPool& pool = payload_pools()[cls];
+        std::lock_guard<std::mutex> lock(pool.lock);
+        if (pool.buffers.size() < kPayloadClassLimits[cls]) {
+            pool.buffers.push_back(data);
+            return;
+        }
+    }
+    free(data);
+}
+
+apacket* get_apacket(size_t payload_size)
 {
     apacket* p = reinterpret_cast<apacket*>(malloc(sizeof(apacket)));
     if (p == nullptr) {
       fatal("failed to allocate an apacket");
     }
 
-    memset(p, 0, sizeof(apacket) - MAX_PAYLOAD);
+    memset(p, 0, sizeof(apacket));
+    apacket_reserve(p, payload_size);
     return p;
 }
 
+void apacket_reserve(apacket* p, size_t payload_size)
+{
+    if (payload_size <= p->capacity) {
+        return;
+    }
+
+    size_t capacity;
+    char* data = alloc_payload(payload_size, &capacity);
+    if (p->capacity) {
+        memcpy(data, p->data, p->capacity);
+    }
+    free_payload(p->data, p->capacity);
+    p->data = data;
+    p->capacity = capacity;
+}
+
 void put_apacket(apacket *p)
 {
+    free_payload(p->data, p->capacity);
     free(p);
 }
 
@@ -238,11 +318,6 @@ std::string get_connection_string() {
 
 void send_connect(atransport* t) {
     D("Calling send_connect");
-    apacket* cp = get_apacket();
-    cp->msg.command = A_CNXN;
-    cp->msg.arg0 = t->get_protocol_version();
-    cp->msg.arg1 = t->get_max_payload();
-
     std::string connection_str = get_connection_string();
     // Connect and auth packets are limited to MAX_PAYLOAD_V1 because we don't
     // yet know how much data the other size is willing to accept.
@@ -251,6 +326,11 @@ void send_connect(atransport* t) {
                    << connection_str.length() << ")";
     }
 
+    apacket* cp = get_apacket(connection_str.length());
+    cp->msg.command = A_CNXN;
+    cp->msg.arg0 = t->get_protocol_version();
+    cp->msg.arg1 = t->get_max_payload();
+
     memcpy(cp->data, connection_str.c_str(), connection_str.length());
     cp->msg.data_length = connection_str.length();
 
@@ -331,6 +411,7 @@ static void handle_new_connection(atransport* t, apacket* p) {
     parse_banner(banner, t);
 
 #if ADB_HOST
+    adb_auth_accepted(t);
     handle_online(t);
 #else
     if (!auth_required) {
@@ -428,6 +509,9 @@ void handle_packet(apacket *p, atransport *t)
                     s->ready(s);
                 } else if (s->peer->id == p->msg.arg0) {
                     /* Other READY messages must use the same local-id */
+                    if (s->peer->writes_in_flight > 0) {
+                        s->peer->writes_in_flight--;
+                    }
                     s->ready(s);
                 } else {
                     D("Invalid A_OKAY(%d,%d), expected A_OKAY(%d,%d) on transport %s",
@@ -473,8 +557,12 @@ void handle_packet(apacket *p, atransport *t)
                 unsigned rid = p->msg.arg0;
                 p->len = p->msg.data_length;
 
+                // Count the OKAY we owe before enqueue() gets a chance to close s. It goes out
+                // either right away or when s calls peer->ready().
+                s->peer->pending_okays++;
                 if (s->enqueue(s, p) == 0) {
                     D("Enqueue the socket");
+                    s->peer->pending_okays--;
                     send_ready(s->id, rid, t);
                 }
                 return;
@@ -54,7 +54,7 @@ constexpr size_t LINUX_MAX_SOCKET_SIZE = 4194304;
 std::string adb_version();
 
 // Increment this when we want to force users to start a new adb server.
-#define ADB_SERVER_VERSION 39
+#define ADB_SERVER_VERSION 43
 
 using TransportId = uint64_t;
 class atransport;
@@ -76,7 +76,11 @@ struct apacket
     char* ptr;
 
     amessage msg;
-    char data[MAX_PAYLOAD];
+
+    // Payload buffer, allocated separately from a pool of size classes so that packets without
+    // data don't carry a MAX_PAYLOAD buffer around. |capacity| is its usable size.
+    char* data;
+    size_t capacity;
 };
 
 uint32_t calculate_apacket_checksum(const apacket* packet);
@@ -165,11 +169,15 @@ int handle_forward_request(const char* service, TransportType type, const char*
 
 #if !ADB_HOST
 void framebuffer_service(int fd, void *cookie);
+void framebuffer_delta_service(int fd, void* cookie);
 void set_verity_enabled_state_service(int fd, void* cookie);
 #endif
 
 /* packet allocator */
-apacket *get_apacket(void);
+// Returns a packet with room for at least |payload_size| bytes of data.
+apacket* get_apacket(size_t payload_size = 0);
+// Grows |p|'s payload buffer to hold at least |payload_size| bytes, keeping its contents.
+void apacket_reserve(apacket* p, size_t payload_size);
 void put_apacket(apacket *p);
 
 // Define it if you want to dump packets.
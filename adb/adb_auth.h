@@ -21,6 +21,7 @@
 
 #include <deque>
 #include <memory>
+#include <string>
 
 #include <openssl/rsa.h>
 
@@ -37,7 +38,10 @@ void adb_auth_init();
 
 int adb_auth_keygen(const char* filename);
 std::string adb_auth_get_userkey();
-std::deque<std::shared_ptr<RSA>> adb_auth_get_private_keys();
+std::deque<std::shared_ptr<RSA>> adb_auth_get_private_keys(const std::string& serial);
+
+// Remembers the key that |t| authenticated with, for the next time it connects.
+void adb_auth_accepted(atransport* t);
 
 void send_auth_response(const char* token, size_t token_size, atransport* t);
 
@@ -52,6 +52,11 @@ static std::map<std::string, std::shared_ptr<RSA>>& g_keys =
     *new std::map<std::string, std::shared_ptr<RSA>>;
 static std::map<int, std::string>& g_monitored_paths = *new std::map<int, std::string>;
 
+// The key each device last accepted, by serial, so that reconnecting tries it first rather than
+// signing the device's token with every other key on the way.
+static std::map<std::string, std::shared_ptr<RSA>>& g_accepted_keys =
+    *new std::map<std::string, std::shared_ptr<RSA>>;
+
 static std::string get_user_info() {
     LOG(INFO) << "get_user_info...";
 
@@ -282,13 +287,18 @@ static std::set<std::string> get_vendor_keys() {
     return result;
 }
 
-std::deque<std::shared_ptr<RSA>> adb_auth_get_private_keys() {
+std::deque<std::shared_ptr<RSA>> adb_auth_get_private_keys(const std::string& serial) {
     std::deque<std::shared_ptr<RSA>> result;
 
-    // Copy all the currently known keys.
+    // Copy all the currently known keys, starting with the one this device accepted last time.
     std::lock_guard<std::mutex> lock(g_keys_mutex);
+    auto accepted = g_accepted_keys.find(serial);
     for (const auto& it : g_keys) {
-        result.push_back(it.second);
+        if (accepted != g_accepted_keys.end() && it.second == accepted->second) {
+            result.push_front(it.second);
+        } else {
+            result.push_back(it.second);
+        }
     }
 
     // Add a sentinel to the list. Our caller uses this to mean "out of private keys,
@@ -445,7 +455,7 @@ static void send_auth_publickey(atransport* t) {
         return;
     }
 
-    apacket* p = get_apacket();
+    apacket* p = get_apacket(key.size() + 1);
     memcpy(p->data, key.c_str(), key.size() + 1);
 
     p->msg.command = A_AUTH;
@@ -456,6 +466,15 @@ static void send_auth_publickey(atransport* t) {
     send_packet(p, t);
 }
 
+void adb_auth_accepted(atransport* t) {
+    if (t->serial == nullptr || t->last_key() == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_keys_mutex);
+    g_accepted_keys[t->serial] = t->last_key();
+}
+
 void send_auth_response(const char* token, size_t token_size, atransport* t) {
     std::shared_ptr<RSA> key = t->NextKey();
     if (key == nullptr) {
@@ -465,7 +484,7 @@ void send_auth_response(const char* token, size_t token_size, atransport* t) {
     }
 
     LOG(INFO) << "Calling send_auth_response";
-    apacket* p = get_apacket();
+    apacket* p = get_apacket(RSA_size(key.get()));
 
     int ret = adb_auth_sign(key.get(), token, token_size, p->data);
     if (!ret) {
@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks for the host side of the adb protocol. Each one talks to a fake device over either a
+// socketpair, which measures adb itself, or a TCP loopback connection, which is the local
+// transport that emulators and `adb connect` use. Pass --benchmark_format=json for results that
+// can be compared across adb versions; `benchmark_device.py` measures push and pull against a
+// real device.
+
+#include <benchmark/benchmark.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include "sysdeps.h"
+
+#include "adb.h"
+#include "adb_io.h"
+#include "fdevent.h"
+#include "socket.h"
+#include "socket_spec.h"
+#include "transport.h"
+
+// How much each iteration of the throughput benchmarks writes to the stream.
+static constexpr size_t kBytesPerIteration = 4 * 1024 * 1024;
+
+enum class TransportKind {
+    kSocketpair,
+    kTcp,
+};
+
+// Runs |fn| on the fdevent thread and waits for it to finish.
+static void RunOnMainThread(std::function<void()> fn) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    fdevent_run_on_main_thread([&]() {
+        fn();
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        cv.notify_one();
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() { return done; });
+}
+
+// The device end of a transport. It accepts the connection and every stream opened on it: streams
+// opened to "echo:" send back whatever is written to them, and any other stream discards it.
+class FakeDevice {
+  public:
+    explicit FakeDevice(int fd) : fd_(fd) {
+        std::thread(&FakeDevice::Run, this).detach();
+    }
+
+    // Blocks until the device has received |bytes| stream bytes in total.
+    void WaitForBytes(uint64_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&]() { return bytes_received_ >= bytes; });
+    }
+
+    uint64_t bytes_received() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_received_;
+    }
+
+    uint64_t packets_received() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return packets_received_;
+    }
+
+  private:
+    void Run() {
+        std::unordered_map<uint32_t, bool> echo_streams;
+        uint32_t next_id = 1;
+        amessage msg;
+        std::string payload;
+        while (ReadFdExactly(fd_, &msg, sizeof(msg))) {
+            payload.resize(msg.data_length);
+            if (msg.data_length != 0 && !ReadFdExactly(fd_, &payload[0], msg.data_length)) {
+                break;
+            }
+
+            switch (msg.command) {
+                case A_CNXN:
+                    Send(A_CNXN, A_VERSION, MAX_PAYLOAD,
+                         "device::features=" + FeatureSetToString(supported_features()));
+                    break;
+
+                case A_OPEN:
+                    echo_streams[next_id] = android::base::StartsWith(payload, "echo:");
+                    Send(A_OKAY, next_id++, msg.arg0, "");
+                    break;
+
+                case A_WRTE: {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        bytes_received_ += payload.size();
+                        ++packets_received_;
+                        cv_.notify_all();
+                    }
+                    if (echo_streams[msg.arg1]) {
+                        Send(A_WRTE, msg.arg1, msg.arg0, payload);
+                    }
+                    Send(A_OKAY, msg.arg1, msg.arg0, "");
+                    break;
+                }
+
+                case A_CLSE:
+                    echo_streams.erase(msg.arg1);
+                    break;
+            }
+        }
+        LOG(FATAL) << "fake device lost its connection";
+    }
+
+    void Send(uint32_t command, uint32_t arg0, uint32_t arg1, const std::string& data) {
+        amessage msg = {command, arg0, arg1, static_cast<uint32_t>(data.size()), 0,
+                        command ^ 0xffffffff};
+        for (unsigned char c : data) {
+            msg.data_check += c;
+        }
+        adb_iovec iov[2] = {{&msg, sizeof(msg)}, {const_cast<char*>(data.data()), data.size()}};
+        if (!WritevFdExactly(fd_, iov, data.empty() ? 1 : 2)) {
+            PLOG(FATAL) << "fake device failed to write";
+        }
+    }
+
+    int fd_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    uint64_t bytes_received_ = 0;
+    uint64_t packets_received_ = 0;
+};
+
+struct BenchmarkTransport {
+    atransport* transport;
+    FakeDevice* device;
+};
+
+// Returns a connected transport of the given kind, creating it the first time it's asked for.
+// Transports are shared by all the benchmarks and live until the process exits.
+static BenchmarkTransport* GetTransport(TransportKind kind) {
+    static auto& transports = *new std::unordered_map<int, BenchmarkTransport>();
+    auto it = transports.find(static_cast<int>(kind));
+    if (it != transports.end()) {
+        return &it->second;
+    }
+
+    int host_fd;
+    int device_fd;
+    std::string serial;
+    std::string error;
+    if (kind == TransportKind::kSocketpair) {
+        int fds[2];
+        if (adb_socketpair(fds) != 0) {
+            PLOG(ERROR) << "failed to create socketpair";
+            return nullptr;
+        }
+        host_fd = fds[0];
+        device_fd = fds[1];
+        serial = "benchmark-socketpair";
+    } else {
+        int port;
+        int server_fd = socket_spec_listen("tcp:0", &error, &port);
+        if (server_fd < 0) {
+            LOG(ERROR) << "failed to listen: " << error;
+            return nullptr;
+        }
+        host_fd = socket_spec_connect(android::base::StringPrintf("tcp:localhost:%d", port),
+                                      &error);
+        device_fd = host_fd < 0 ? -1 : adb_socket_accept(server_fd, nullptr, nullptr);
+        adb_close(server_fd);
+        if (host_fd < 0 || device_fd < 0) {
+            LOG(ERROR) << "failed to connect over loopback: " << error;
+            return nullptr;
+        }
+        disable_tcp_nagle(device_fd);
+        serial = android::base::StringPrintf("localhost:%d", port);
+    }
+
+    FakeDevice* device = new FakeDevice(device_fd);
+    if (register_socket_transport(host_fd, serial.c_str(), 0, 0) != 0) {
+        LOG(ERROR) << "failed to register transport " << serial;
+        return nullptr;
+    }
+
+    // Registration and the CNXN handshake happen asynchronously.
+    atransport* transport = nullptr;
+    for (int i = 0; i < 500 && transport == nullptr; ++i) {
+        RunOnMainThread([&]() {
+            atransport* t = acquire_one_transport(kTransportAny, serial.c_str(), 0, nullptr,
+                                                  &error);
+            if (t != nullptr && t->GetConnectionState() == kCsDevice) {
+                transport = t;
+            }
+        });
+        if (transport == nullptr) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    if (transport == nullptr) {
+        LOG(ERROR) << "transport " << serial << " never came online: " << error;
+        return nullptr;
+    }
+
+    return &(transports[static_cast<int>(kind)] = {transport, device});
+}
+
+// Opens a stream to |service| over |transport|, returning our end of it.
+static int OpenStream(atransport* transport, const char* service) {
+    int fds[2];
+    if (adb_socketpair(fds) != 0) {
+        PLOG(FATAL) << "failed to create socketpair";
+    }
+    int local_fd = fds[1];
+    RunOnMainThread([transport, local_fd, service]() {
+        asocket* s = create_local_socket(local_fd);
+        s->transport = transport;
+        connect_to_remote(s, service);
+    });
+    return fds[0];
+}
+
+// Writes to a stream in chunks of range(0) bytes, and waits for the device to receive all of it.
+// Reports stream bytes and WRTE packets per second.
+static void BM_stream_write(benchmark::State& state, TransportKind kind) {
+    BenchmarkTransport* bt = GetTransport(kind);
+    if (bt == nullptr) {
+        state.SkipWithError("failed to connect to the fake device");
+        return;
+    }
+
+    int fd = OpenStream(bt->transport, "sink:");
+    std::string chunk(state.range(0), 'x');
+    uint64_t total = bt->device->bytes_received();
+    uint64_t packets = bt->device->packets_received();
+    while (state.KeepRunning()) {
+        for (size_t written = 0; written < kBytesPerIteration; written += chunk.size()) {
+            if (!WriteFdExactly(fd, chunk.data(), chunk.size())) {
+                state.SkipWithError("failed to write to stream");
+                break;
+            }
+            total += chunk.size();
+        }
+        bt->device->WaitForBytes(total);
+    }
+    state.SetBytesProcessed(state.iterations() * (kBytesPerIteration / chunk.size()) *
+                            chunk.size());
+    state.SetItemsProcessed(bt->device->packets_received() - packets);
+    adb_close(fd);
+}
+BENCHMARK_CAPTURE(BM_stream_write, socketpair, TransportKind::kSocketpair)
+    ->RangeMultiplier(4)->Range(64, MAX_PAYLOAD)->UseRealTime();
+BENCHMARK_CAPTURE(BM_stream_write, tcp, TransportKind::kTcp)
+    ->RangeMultiplier(4)->Range(64, MAX_PAYLOAD)->UseRealTime();
+
+// Sends range(0) bytes to an echo stream and reads them back, one round trip per iteration.
+static void BM_stream_round_trip(benchmark::State& state, TransportKind kind) {
+    BenchmarkTransport* bt = GetTransport(kind);
+    if (bt == nullptr) {
+        state.SkipWithError("failed to connect to the fake device");
+        return;
+    }
+
+    int fd = OpenStream(bt->transport, "echo:");
+    std::string buf(state.range(0), 'x');
+    while (state.KeepRunning()) {
+        if (!WriteFdExactly(fd, buf.data(), buf.size()) || !ReadFdExactly(fd, &buf[0], buf.size())) {
+            state.SkipWithError("echo stream failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+    adb_close(fd);
+}
+BENCHMARK_CAPTURE(BM_stream_round_trip, socketpair, TransportKind::kSocketpair)
+    ->Arg(1)->Arg(4096)->Arg(MAX_PAYLOAD)->UseRealTime();
+BENCHMARK_CAPTURE(BM_stream_round_trip, tcp, TransportKind::kTcp)
+    ->Arg(1)->Arg(4096)->Arg(MAX_PAYLOAD)->UseRealTime();
+
+// Opens a stream, makes one round trip on it, and closes it again.
+static void BM_stream_open(benchmark::State& state, TransportKind kind) {
+    BenchmarkTransport* bt = GetTransport(kind);
+    if (bt == nullptr) {
+        state.SkipWithError("failed to connect to the fake device");
+        return;
+    }
+
+    while (state.KeepRunning()) {
+        int fd = OpenStream(bt->transport, "echo:");
+        char c = 'x';
+        if (!WriteFdExactly(fd, &c, 1) || !ReadFdExactly(fd, &c, 1)) {
+            state.SkipWithError("echo stream failed");
+        }
+        adb_close(fd);
+    }
+}
+BENCHMARK_CAPTURE(BM_stream_open, socketpair, TransportKind::kSocketpair)->UseRealTime();
+BENCHMARK_CAPTURE(BM_stream_open, tcp, TransportKind::kTcp)->UseRealTime();
+
+int main(int argc, char** argv) {
+    android::base::InitLogging(argv);
+    benchmark::Initialize(&argc, argv);
+
+    init_transport_registration();
+    std::thread([]() { fdevent_loop(); }).detach();
+
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
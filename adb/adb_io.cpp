@@ -123,6 +123,37 @@ bool WriteFdExactly(int fd, const void* buf, size_t len) {
     return true;
 }
 
+bool WritevFdExactly(int fd, adb_iovec* iov, int iovcnt) {
+    VLOG(RWX) << "writevx: fd=" << fd << " iovcnt=" << iovcnt;
+
+    while (iovcnt > 0) {
+        ssize_t r = adb_writev(fd, iov, iovcnt);
+        if (r == -1) {
+            D("writevx: fd=%d error %d: %s", fd, errno, strerror(errno));
+            if (errno == EAGAIN) {
+                std::this_thread::yield();
+                continue;
+            } else if (errno == EPIPE) {
+                D("writevx: fd=%d disconnected", fd);
+                errno = 0;
+            }
+            return false;
+        }
+
+        size_t written = r;
+        while (iovcnt > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = reinterpret_cast<char*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
 bool WriteFdExactly(int fd, const char* str) {
     return WriteFdExactly(fd, str, strlen(str));
 }
@@ -21,6 +21,13 @@
 
 #include <string>
 
+#if defined(_WIN32)
+struct adb_iovec;
+#else
+#include <sys/uio.h>
+typedef struct iovec adb_iovec;
+#endif
+
 // Sends the protocol "OKAY" message.
 bool SendOkay(int fd);
 
@@ -66,6 +73,10 @@ bool ReadOrderlyShutdown(int fd);
 // is closed, errno will be set to 0.
 bool WriteFdExactly(int fd, const void* buf, size_t len);
 
+// Same as above, but gathers the |iovcnt| buffers in |iov| with adb_writev(). |iov| is used to
+// keep track of partial writes, so its contents are undefined afterwards.
+bool WritevFdExactly(int fd, adb_iovec* iov, int iovcnt);
+
 // Same as above, but for strings.
 bool WriteFdExactly(int fd, const char* s);
 bool WriteFdExactly(int fd, const std::string& s);
@@ -129,6 +129,25 @@ POSIX_TEST(io, WriteFdExactly_ENOSPC) {
     ASSERT_EQ(ENOSPC, errno);
 }
 
+POSIX_TEST(io, WritevFdExactly) {
+  char foo[] = "Foo";
+  char bar[] = "bar";
+  TemporaryFile tf;
+  ASSERT_NE(-1, tf.fd);
+
+  adb_iovec iov[2];
+  iov[0].iov_base = foo;
+  iov[0].iov_len = 3;
+  iov[1].iov_base = bar;
+  iov[1].iov_len = 3;
+  ASSERT_TRUE(WritevFdExactly(tf.fd, iov, 2)) << strerror(errno);
+  ASSERT_EQ(0, lseek(tf.fd, 0, SEEK_SET));
+
+  std::string s;
+  ASSERT_TRUE(android::base::ReadFdToString(tf.fd, &s));
+  EXPECT_EQ("Foobar", s);
+}
+
 POSIX_TEST(io, WriteFdExactly_string) {
   const char str[] = "Foobar";
   TemporaryFile tf;
@@ -0,0 +1,153 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2017 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+"""Measures adb push and pull throughput against an attached device.
+
+Files from 1KB to 1GB are pushed to and pulled from the device, and the
+results are printed as JSON in the same layout as adb_benchmark's
+--benchmark_format=json, so that both can be tracked across adb versions.
+
+With --usb-queue-depths, the adb server is restarted with the libusb backend
+at each of the given write queue depths, to compare them.
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+import adb
+
+
+DEVICE_TEMP_FILE = '/data/local/tmp/adb_benchmark_file'
+
+KB = 1024
+MB = 1024 * KB
+GB = 1024 * MB
+
+SIZES = [KB, 64 * KB, MB, 16 * MB, 128 * MB, GB]
+
+
+def size_name(size):
+    for unit, name in ((GB, 'GB'), (MB, 'MB'), (KB, 'KB')):
+        if size >= unit:
+            return '{}{}'.format(size // unit, name)
+    return '{}B'.format(size)
+
+
+def make_file(directory, size):
+    """Creates a file of random data, which keeps compression honest."""
+    path = os.path.join(directory, 'adb_benchmark_' + size_name(size))
+    with open(path, 'wb') as f:
+        remaining = size
+        while remaining > 0:
+            chunk = min(remaining, 4 * MB)
+            f.write(os.urandom(chunk))
+            remaining -= chunk
+    return path
+
+
+def measure(name, size, repetitions, fn):
+    times = []
+    for _ in range(repetitions):
+        start = time.time()
+        fn()
+        times.append(time.time() - start)
+    seconds = min(times)
+    return {
+        'name': name,
+        'iterations': repetitions,
+        'real_time': seconds * 1e9,
+        'time_unit': 'ns',
+        'bytes_per_second': size / seconds,
+    }
+
+
+def restart_server(env):
+    subprocess.check_call(['adb', 'kill-server'])
+    subprocess.check_call(['adb', 'start-server'], env=env)
+    subprocess.check_call(['adb', 'wait-for-device'])
+
+
+def run_transfers(device, host_dir, max_size, repetitions, suffix=''):
+    results = []
+    for size in [s for s in SIZES if s <= max_size]:
+        local = make_file(host_dir, size)
+        pulled = local + '.pulled'
+        results.append(measure(
+            'push/' + size_name(size) + suffix, size, repetitions,
+            lambda: device.push(local=local, remote=DEVICE_TEMP_FILE)))
+        results.append(measure(
+            'pull/' + size_name(size) + suffix, size, repetitions,
+            lambda: device.pull(remote=DEVICE_TEMP_FILE, local=pulled)))
+        os.remove(local)
+        os.remove(pulled)
+        print('finished {}{}'.format(size_name(size), suffix), file=sys.stderr)
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('-s', '--serial', help='device to run against')
+    parser.add_argument('--max-size', type=int, default=GB,
+                        help='largest file to transfer, in bytes')
+    parser.add_argument('--repetitions', type=int, default=3,
+                        help='transfers per size; the fastest is reported')
+    parser.add_argument('--usb-queue-depths',
+                        help='comma-separated libusb write queue depths to compare')
+    args = parser.parse_args()
+
+    device = adb.get_device(args.serial)
+    version = subprocess.check_output(['adb', 'version']).splitlines()[0]
+
+    results = {
+        'context': {
+            'date': time.strftime('%Y-%m-%d %H:%M:%S'),
+            'adb_version': version.decode('utf-8').strip(),
+            'device': device.get_prop('ro.build.fingerprint'),
+        },
+        'benchmarks': [],
+    }
+
+    host_dir = tempfile.mkdtemp()
+    try:
+        if args.usb_queue_depths:
+            for depth in args.usb_queue_depths.split(','):
+                env = dict(os.environ, ADB_LIBUSB='1', ADB_LIBUSB_QUEUE_DEPTH=depth)
+                restart_server(env)
+                results['benchmarks'] += run_transfers(
+                    device, host_dir, args.max_size, args.repetitions,
+                    '/usb_queue_depth:' + depth)
+            restart_server(os.environ)
+        else:
+            results['benchmarks'] += run_transfers(
+                device, host_dir, args.max_size, args.repetitions)
+    finally:
+        shutil.rmtree(host_dir)
+        device.shell(['rm', '-f', DEVICE_TEMP_FILE])
+
+    json.dump(results, sys.stdout, indent=2)
+    print()
+
+
+if __name__ == '__main__':
+    main()
@@ -20,18 +20,22 @@
 
 #include <stdint.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include <libusb/libusb.h>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/quick_exit.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
@@ -88,7 +92,43 @@ struct transfer_info {
     }
 };
 
+// How many bulk writes may be in flight at once, unless overridden by $ADB_LIBUSB_QUEUE_DEPTH.
+// With a single write outstanding, the device sits idle for a round trip between every header
+// and payload, which is what limits throughput on fast links.
+static constexpr size_t kDefaultWriteQueueDepth = 8;
+
+static size_t get_write_queue_depth() {
+    static const size_t depth = []() {
+        size_t result = kDefaultWriteQueueDepth;
+        const char* env = getenv("ADB_LIBUSB_QUEUE_DEPTH");
+        if (env != nullptr && !android::base::ParseUint(env, &result, size_t(64))) {
+            LOG(WARNING) << "ignoring invalid ADB_LIBUSB_QUEUE_DEPTH '" << env << "'";
+            result = kDefaultWriteQueueDepth;
+        }
+        return std::max(result, size_t(1));
+    }();
+    return depth;
+}
+
 namespace libusb {
+struct usb_handle;
+
+// A bulk write that's been submitted without waiting for it. It owns a copy of the data, and
+// is kept for reuse after it completes, along with its buffer.
+struct write_buffer {
+    explicit write_buffer(usb_handle* handle)
+        : handle(handle), transfer(libusb_alloc_transfer(0)) {}
+
+    ~write_buffer() {
+        libusb_free_transfer(transfer);
+    }
+
+    usb_handle* handle;
+    libusb_transfer* transfer;
+    std::vector<unsigned char> data;
+    bool in_flight = false;
+};
+
 struct usb_handle : public ::usb_handle {
     usb_handle(const std::string& device_address, const std::string& serial,
                unique_device_handle&& device_handle, uint8_t interface, uint8_t bulk_in,
@@ -98,14 +138,18 @@ struct usb_handle : public ::usb_handle {
           closing(false),
           device_handle(device_handle.release()),
           read("read", zero_mask, false),
-          write("write", zero_mask, true),
           interface(interface),
           bulk_in(bulk_in),
           bulk_out(bulk_out),
+          zero_mask(zero_mask),
           max_packet_size(max_packet_size) {}
 
     ~usb_handle() {
         Close();
+
+        // The cancelled writes still call back into us.
+        std::unique_lock<std::mutex> lock(write_mutex);
+        write_cv.wait(lock, [this]() { return writes_in_flight == 0; });
     }
 
     void Close() {
@@ -126,7 +170,16 @@ struct usb_handle : public ::usb_handle {
 
         // Cancel already dispatched transfers.
         libusb_cancel_transfer(read.transfer);
-        libusb_cancel_transfer(write.transfer);
+        {
+            std::lock_guard<std::mutex> write_lock(write_mutex);
+            for (const auto& buffer : write_buffers) {
+                if (buffer->in_flight) {
+                    libusb_cancel_transfer(buffer->transfer);
+                }
+            }
+            write_failed = true;
+            write_cv.notify_all();
+        }
 
         libusb_release_interface(handle, interface);
         libusb_close(handle);
@@ -140,11 +193,20 @@ struct usb_handle : public ::usb_handle {
     libusb_device_handle* device_handle;
 
     transfer_info read;
-    transfer_info write;
+
+    // Every write_buffer allocated for this handle, and the ones not in flight.
+    std::mutex write_mutex;
+    std::condition_variable write_cv;
+    std::vector<std::unique_ptr<write_buffer>> write_buffers;
+    std::vector<write_buffer*> free_write_buffers;
+    size_t writes_in_flight = 0;
+    // Set once a write fails or the handle closes. Writes after that fail too.
+    bool write_failed = false;
 
     uint8_t interface;
     uint8_t bulk_in;
     uint8_t bulk_out;
+    uint16_t zero_mask;
 
     size_t max_packet_size;
 };
@@ -569,27 +631,81 @@ static int perform_usb_transfer(usb_handle* h, transfer_info* info,
     return 0;
 }
 
+static void write_callback(libusb_transfer* transfer) {
+    write_buffer* buffer = static_cast<write_buffer*>(transfer->user_data);
+    usb_handle* h = buffer->handle;
+
+    std::lock_guard<std::mutex> lock(h->write_mutex);
+    if (transfer->status != LIBUSB_TRANSFER_COMPLETED ||
+        transfer->actual_length != transfer->length) {
+        LOG(WARNING) << "write transfer failed: " << libusb_error_name(transfer->status);
+        h->write_failed = true;
+    }
+    buffer->in_flight = false;
+    h->free_write_buffers.push_back(buffer);
+    --h->writes_in_flight;
+    h->write_cv.notify_all();
+}
+
+// Submits a copy of |len| bytes of |d| as a bulk write, without waiting for it to complete.
+// Called with |h->device_handle_mutex| held.
+static bool submit_write(usb_handle* h, const void* d, int len) {
+    std::lock_guard<std::mutex> lock(h->write_mutex);
+    if (h->write_failed) {
+        return false;
+    }
+
+    write_buffer* buffer;
+    if (h->free_write_buffers.empty()) {
+        h->write_buffers.emplace_back(new write_buffer(h));
+        buffer = h->write_buffers.back().get();
+    } else {
+        buffer = h->free_write_buffers.back();
+        h->free_write_buffers.pop_back();
+    }
+
+    const unsigned char* data = static_cast<const unsigned char*>(d);
+    buffer->data.assign(data, data + len);
+    libusb_fill_bulk_transfer(buffer->transfer, h->device_handle, h->bulk_out,
+                              buffer->data.data(), len, write_callback, buffer, 0);
+    int rc = libusb_submit_transfer(buffer->transfer);
+    if (rc != 0) {
+        LOG(WARNING) << "failed to submit write transfer: " << libusb_error_name(rc);
+        h->free_write_buffers.push_back(buffer);
+        h->write_failed = true;
+        return false;
+    }
+
+    buffer->in_flight = true;
+    ++h->writes_in_flight;
+    return true;
+}
+
+// Writes are queued rather than waited for, so a failure is reported by a later usb_write.
 int usb_write(usb_handle* h, const void* d, int len) {
     LOG(DEBUG) << "usb_write of length " << len;
 
+    // A zero-length packet marks the end of a write that's a multiple of the packet size. It
+    // has to be queued right behind the write, so make room for both before submitting either.
+    bool zero = should_perform_zero_transfer(h->bulk_out, len, h->zero_mask);
+    size_t needed = zero ? 2 : 1;
+    size_t depth = std::max(get_write_queue_depth(), needed);
+    {
+        std::unique_lock<std::mutex> lock(h->write_mutex);
+        h->write_cv.wait(lock, [h, needed, depth]() {
+            return h->write_failed || h->writes_in_flight + needed <= depth;
+        });
+    }
+
     std::unique_lock<std::mutex> lock(h->device_handle_mutex);
-    if (!h->device_handle) {
+    if (!h->device_handle || !submit_write(h, d, len) || (zero && !submit_write(h, nullptr, 0))) {
+        LOG(DEBUG) << "usb_write(" << len << ") failed";
         errno = EIO;
         return -1;
     }
 
-    transfer_info* info = &h->write;
-    info->transfer->dev_handle = h->device_handle;
-    info->transfer->flags = 0;
-    info->transfer->endpoint = h->bulk_out;
-    info->transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
-    info->transfer->length = len;
-    info->transfer->buffer = reinterpret_cast<unsigned char*>(const_cast<void*>(d));
-    info->transfer->num_iso_packets = 0;
-
-    int rc = perform_usb_transfer(h, info, std::move(lock));
-    LOG(DEBUG) << "usb_write(" << len << ") = " << rc;
-    return rc;
+    LOG(DEBUG) << "usb_write(" << len << ") queued";
+    return 0;
 }
 
 int usb_read(usb_handle* h, void* d, int len) {
@@ -31,6 +31,8 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <thread>
@@ -1932,6 +1934,51 @@ static int install_app(int argc, const char** argv) {
     return 1;
 }
 
+// The most APKs that install-multiple streams to the device at once.
+static constexpr size_t kMaxParallelInstallWrites = 4;
+
+// One APK of an install-multiple session. |error| is set if it couldn't be written.
+struct InstallWrite {
+    const char* file;
+    uint64_t size;
+    int index;
+    std::string error;
+};
+
+// Streams |write->file| into install session |session_id|. This runs on its own thread, so errors
+// are left in |write->error| for the caller to print.
+static bool install_write(const std::string& install_cmd, int session_id, InstallWrite* write) {
+    std::string cmd = android::base::StringPrintf(
+            "%s install-write -S %" PRIu64 " %d %d_%s -",
+            install_cmd.c_str(), write->size, session_id, write->index,
+            android::base::Basename(write->file).c_str());
+
+    unique_fd localFd(adb_open(write->file, O_RDONLY));
+    if (localFd < 0) {
+        write->error = android::base::StringPrintf("adb: failed to open %s: %s\n", write->file,
+                                                   strerror(errno));
+        return false;
+    }
+
+    std::string error;
+    unique_fd remoteFd(adb_connect(cmd, &error));
+    if (remoteFd < 0) {
+        write->error = android::base::StringPrintf("adb: connect error for write: %s\n",
+                                                   error.c_str());
+        return false;
+    }
+
+    char buf[BUFSIZ];
+    copy_to_file(localFd, remoteFd);
+    read_status_line(remoteFd, buf, sizeof(buf));
+
+    if (strncmp("Success", buf, 7)) {
+        write->error = android::base::StringPrintf("adb: failed to write %s\n%s", write->file, buf);
+        return false;
+    }
+    return true;
+}
+
 static int install_multiple_app(int argc, const char** argv) {
     // Find all APK arguments starting at end.
     // All other arguments passed through verbatim.
@@ -1989,7 +2036,9 @@ static int install_multiple_app(int argc, const char** argv) {
         return EXIT_FAILURE;
     }
 
-    // Valid session, now stream the APKs
+    // Valid session, now stream the APKs. Each one goes over its own connection, and several go
+    // at once, so the device can write one split to the session while others are on the wire.
+    std::vector<InstallWrite> writes;
     int success = 1;
     for (int i = first_apk; i < argc; i++) {
         const char* file = argv[i];
@@ -1997,45 +2046,40 @@ static int install_multiple_app(int argc, const char** argv) {
         if (stat(file, &sb) == -1) {
             fprintf(stderr, "adb: failed to stat %s: %s\n", file, strerror(errno));
             success = 0;
-            goto finalize_session;
+            break;
         }
+        writes.push_back({file, static_cast<uint64_t>(sb.st_size), i, ""});
+    }
 
-        std::string cmd = android::base::StringPrintf(
-                "%s install-write -S %" PRIu64 " %d %d_%s -",
-                install_cmd.c_str(), static_cast<uint64_t>(sb.st_size), session_id, i,
-                android::base::Basename(file).c_str());
+    if (success) {
+        std::atomic<size_t> next_write(0);
+        std::atomic<bool> failed(false);
+        auto write_apks = [&]() {
+            for (size_t i = next_write++; i < writes.size() && !failed; i = next_write++) {
+                if (!install_write(install_cmd, session_id, &writes[i])) {
+                    failed = true;
+                }
+            }
+        };
 
-        int localFd = adb_open(file, O_RDONLY);
-        if (localFd < 0) {
-            fprintf(stderr, "adb: failed to open %s: %s\n", file, strerror(errno));
-            success = 0;
-            goto finalize_session;
+        std::vector<std::thread> threads;
+        size_t thread_count = std::min(writes.size(), kMaxParallelInstallWrites);
+        for (size_t i = 1; i < thread_count; i++) {
+            threads.emplace_back(write_apks);
         }
-
-        std::string error;
-        int remoteFd = adb_connect(cmd, &error);
-        if (remoteFd < 0) {
-            fprintf(stderr, "adb: connect error for write: %s\n", error.c_str());
-            adb_close(localFd);
-            success = 0;
-            goto finalize_session;
+        write_apks();
+        for (std::thread& thread : threads) {
+            thread.join();
         }
 
-        copy_to_file(localFd, remoteFd);
-        read_status_line(remoteFd, buf, sizeof(buf));
-
-        adb_close(localFd);
-        adb_close(remoteFd);
-
-        if (strncmp("Success", buf, 7)) {
-            fprintf(stderr, "adb: failed to write %s\n", file);
-            fputs(buf, stderr);
-            success = 0;
-            goto finalize_session;
+        for (const InstallWrite& write : writes) {
+            if (!write.error.empty()) {
+                fputs(write.error.c_str(), stderr);
+                success = 0;
+            }
         }
     }
 
-finalize_session:
     // Commit session if we streamed everything okay; otherwise abandon
     std::string service =
             android::base::StringPrintf("%s install-%s %d",
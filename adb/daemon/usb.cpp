@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -59,6 +60,10 @@ using namespace std::chrono_literals;
 // necessary.
 #define USB_FFS_BULK_SIZE 16384
 
+// With aio, a transfer is split into USB_FFS_BULK_SIZE requests that are all queued at once, so
+// the controller always has the next request ready. This is enough for a MAX_PAYLOAD packet.
+#define USB_FFS_NUM_BUFS ((MAX_PAYLOAD / USB_FFS_BULK_SIZE) + 1)
+
 #define cpu_to_le16(x) htole16(x)
 #define cpu_to_le32(x) htole32(x)
 
@@ -435,6 +440,9 @@ bool init_functionfs(struct usb_handle* h) {
         goto err;
     }
 
+    h->read_aiob.fd = h->bulk_out;
+    h->write_aiob.fd = h->bulk_in;
+
     h->max_rw = MAX_PAYLOAD;
     while (h->max_rw >= USB_FFS_BULK_SIZE && retries < ENDPOINT_ALLOC_RETRIES) {
         int ret_in = ioctl(h->bulk_in, FUNCTIONFS_ENDPOINT_ALLOC, static_cast<__u32>(h->max_rw));
@@ -506,6 +514,127 @@ static void usb_ffs_open_thread(void* x) {
     abort();
 }
 
+// bionic and glibc don't wrap the kernel aio syscalls.
+static int io_setup(unsigned nr, aio_context_t* ctxp) {
+    return syscall(__NR_io_setup, nr, ctxp);
+}
+
+static int io_destroy(aio_context_t ctx) {
+    return syscall(__NR_io_destroy, ctx);
+}
+
+static int io_submit(aio_context_t ctx, long nr, struct iocb** iocbpp) {
+    return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static int io_getevents(aio_context_t ctx, long min_nr, long max_nr, struct io_event* events,
+                        struct timespec* timeout) {
+    return syscall(__NR_io_getevents, ctx, min_nr, max_nr, events, timeout);
+}
+
+static double now() {
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool aio_block_init(aio_block* aiob) {
+    aiob->iocb.resize(USB_FFS_NUM_BUFS);
+    aiob->iocbs.resize(USB_FFS_NUM_BUFS);
+    aiob->events.resize(USB_FFS_NUM_BUFS);
+    for (unsigned i = 0; i < USB_FFS_NUM_BUFS; i++) {
+        aiob->iocbs[i] = &aiob->iocb[i];
+    }
+    if (io_setup(USB_FFS_NUM_BUFS, &aiob->ctx) != 0) {
+        PLOG(WARNING) << "aio: io_setup failed, falling back to blocking usb i/o";
+        aiob->ctx = 0;
+        return false;
+    }
+    return true;
+}
+
+static void io_prep(struct iocb* iocb, int fd, const void* buf, uint64_t nbytes, bool read) {
+    memset(iocb, 0, sizeof(*iocb));
+    iocb->aio_fildes = fd;
+    iocb->aio_lio_opcode = read ? IOCB_CMD_PREAD : IOCB_CMD_PWRITE;
+    iocb->aio_buf = reinterpret_cast<uint64_t>(buf);
+    iocb->aio_nbytes = nbytes;
+}
+
+// Transfers |len| bytes with up to USB_FFS_NUM_BUFS requests in flight, waiting for them all.
+// Returns 0 on success, -1 on failure.
+static int usb_ffs_do_aio(usb_handle* h, const void* data, int len, bool read) {
+    aio_block* aiob = read ? &h->read_aiob : &h->write_aiob;
+    char* buf = static_cast<char*>(const_cast<void*>(data));
+    double start = now();
+    int total = len;
+
+    while (len > 0) {
+        int num_bufs = 0;
+        while (len > 0 && num_bufs < static_cast<int>(USB_FFS_NUM_BUFS)) {
+            int buf_len = std::min(len, USB_FFS_BULK_SIZE);
+            io_prep(&aiob->iocb[num_bufs], aiob->fd, buf, buf_len, read);
+            buf += buf_len;
+            len -= buf_len;
+            num_bufs++;
+        }
+
+        int submitted = TEMP_FAILURE_RETRY(io_submit(aiob->ctx, num_bufs, aiob->iocbs.data()));
+        if (submitted < num_bufs) {
+            PLOG(ERROR) << "aio: got error submitting " << (read ? "read" : "write");
+            // Whatever did get queued still has to finish before its buffer is released.
+            if (submitted > 0) {
+                TEMP_FAILURE_RETRY(io_getevents(aiob->ctx, submitted, submitted,
+                                                aiob->events.data(), nullptr));
+            }
+            return -1;
+        }
+
+        int completed = 0;
+        while (completed < num_bufs) {
+            int n = TEMP_FAILURE_RETRY(io_getevents(aiob->ctx, num_bufs - completed,
+                                                    num_bufs - completed,
+                                                    aiob->events.data() + completed, nullptr));
+            if (n < 0) {
+                PLOG(ERROR) << "aio: got error waiting for " << (read ? "read" : "write");
+                return -1;
+            }
+            completed += n;
+        }
+
+        // Events come back in completion order; match them up with their requests.
+        for (int i = 0; i < num_bufs; i++) {
+            const struct io_event& event = aiob->events[i];
+            const struct iocb* iocb = reinterpret_cast<const struct iocb*>(event.obj);
+            if (event.res < 0) {
+                errno = -event.res;
+                PLOG(ERROR) << "aio: got error event on " << (read ? "read" : "write");
+                return -1;
+            }
+            // Only the last request of a transfer is allowed to end in a short packet.
+            if (static_cast<uint64_t>(event.res) != iocb->aio_nbytes &&
+                (iocb != &aiob->iocb[num_bufs - 1] || len != 0)) {
+                LOG(ERROR) << "aio: short " << (read ? "read" : "write") << " of " << event.res
+                           << " bytes, expected " << iocb->aio_nbytes;
+                return -1;
+            }
+        }
+    }
+
+    aiob->bytes += total;
+    aiob->seconds += now() - start;
+    return 0;
+}
+
+static int usb_ffs_aio_write(usb_handle* h, const void* data, int len) {
+    D("about to write (fd=%d, len=%d)", h->bulk_in, len);
+    return usb_ffs_do_aio(h, data, len, false);
+}
+
+static int usb_ffs_aio_read(usb_handle* h, void* data, int len) {
+    D("about to read (fd=%d, len=%d)", h->bulk_out, len);
+    return usb_ffs_do_aio(h, data, len, true);
+}
+
 static int usb_ffs_write(usb_handle* h, const void* data, int len) {
     D("about to write (fd=%d, len=%d)", h->bulk_in, len);
 
@@ -566,8 +695,21 @@ static void usb_ffs_kick(usb_handle* h) {
     TEMP_FAILURE_RETRY(dup2(dummy_fd, h->bulk_in));
 }
 
+// Logs the sustained rate in each direction, over the time spent transferring.
+static void usb_ffs_report_throughput(usb_handle* h) {
+    for (aio_block* aiob : {&h->read_aiob, &h->write_aiob}) {
+        if (aiob->seconds > 0) {
+            LOG(INFO) << "usb " << (aiob == &h->read_aiob ? "read " : "wrote ") << aiob->bytes
+                      << " bytes at " << aiob->bytes / aiob->seconds / (1024 * 1024) << " MiB/s";
+        }
+        aiob->bytes = 0;
+        aiob->seconds = 0;
+    }
+}
+
 static void usb_ffs_close(usb_handle* h) {
     LOG(INFO) << "closing functionfs transport";
+    usb_ffs_report_throughput(h);
 
     h->kicked = false;
     adb_close(h->bulk_out);
@@ -584,8 +726,18 @@ static void usb_ffs_init() {
 
     usb_handle* h = new usb_handle();
 
-    h->write = usb_ffs_write;
-    h->read = usb_ffs_read;
+    h->use_aio = aio_block_init(&h->read_aiob) && aio_block_init(&h->write_aiob);
+    if (h->use_aio) {
+        h->write = usb_ffs_aio_write;
+        h->read = usb_ffs_aio_read;
+    } else {
+        if (h->read_aiob.ctx) {
+            io_destroy(h->read_aiob.ctx);
+            h->read_aiob.ctx = 0;
+        }
+        h->write = usb_ffs_write;
+        h->read = usb_ffs_read;
+    }
     h->kick = usb_ffs_kick;
     h->close = usb_ffs_close;
 
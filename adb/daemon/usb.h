@@ -16,9 +16,26 @@
  * limitations under the License.
  */
 
+#include <linux/aio_abi.h>
+
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
+#include <vector>
+
+// State for one direction of asynchronous FunctionFS I/O. The iocbs and events are allocated once
+// and reused for every transfer.
+struct aio_block {
+    std::vector<struct iocb> iocb;
+    std::vector<struct iocb*> iocbs;
+    std::vector<struct io_event> events;
+    aio_context_t ctx = 0;
+    int fd = -1;
+
+    // Bytes moved and time spent moving them, for throughput reporting.
+    uint64_t bytes = 0;
+    double seconds = 0;
+};
 
 struct usb_handle {
     usb_handle() : kicked(false) {
@@ -45,6 +62,11 @@ struct usb_handle {
     int bulk_in = -1;  /* "in" from the host's perspective => sink for adbd */
 
     int max_rw;
+
+    // Set when the kernel supports aio on FunctionFS endpoints.
+    bool use_aio = false;
+    struct aio_block read_aiob;
+    struct aio_block write_aiob;
 };
 
 bool init_functionfs(struct usb_handle* h);
@@ -25,11 +25,16 @@
 #include <string.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
 #include <atomic>
 #include <functional>
 #include <list>
 #include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <android-base/logging.h>
@@ -58,6 +63,9 @@ int SHELL_EXIT_NOTIFY_FD = -1;
 struct PollNode {
   fdevent* fde;
   adb_pollfd pollfd;
+#if defined(__linux__)
+  bool in_epoll = false;
+#endif
 
   explicit PollNode(fdevent* fde) : fde(fde) {
       memset(&pollfd, 0, sizeof(pollfd));
@@ -75,6 +83,14 @@ struct PollNode {
 // That's why we don't need a lock for fdevent.
 static auto& g_poll_node_map = *new std::unordered_map<int, PollNode>();
 static auto& g_pending_list = *new std::list<fdevent*>();
+#if defined(__linux__)
+// On Linux the fds are registered with an epoll instance, so each wakeup only costs as much as
+// the events it returns. epoll refuses some fds (regular files, invalid fds); those are checked
+// with poll() on every iteration instead, which also reports POLLNVAL for invalid ones.
+static auto& g_epoll_fd = *new unique_fd();
+static auto& g_poll_fallback = *new std::unordered_set<int>();
+static constexpr int kMaxEpollEvents = 256;
+#endif
 static std::atomic<bool> terminate_loop(false);
 static bool main_thread_valid;
 static unsigned long main_thread_id;
@@ -155,6 +171,23 @@ void fdevent_install(fdevent* fde, int fd, fd_func func, void* arg) {
     }
     auto pair = g_poll_node_map.emplace(fde->fd, PollNode(fde));
     CHECK(pair.second) << "install existing fd " << fd;
+#if defined(__linux__)
+    if (g_epoll_fd == -1) {
+        g_epoll_fd.reset(epoll_create1(EPOLL_CLOEXEC));
+        if (g_epoll_fd == -1) {
+            PLOG(FATAL) << "failed to create epoll fd";
+        }
+    }
+    PollNode& node = pair.first->second;
+    epoll_event ev = {};
+    ev.events = node.pollfd.events;
+    ev.data.fd = fd;
+    if (epoll_ctl(g_epoll_fd.get(), EPOLL_CTL_ADD, fd, &ev) == 0) {
+        node.in_epoll = true;
+    } else {
+        g_poll_fallback.insert(fd);
+    }
+#endif
     D("fdevent_install %s", dump_fde(fde).c_str());
 }
 
@@ -162,6 +195,13 @@ void fdevent_remove(fdevent* fde) {
     check_main_thread();
     D("fdevent_remove %s", dump_fde(fde).c_str());
     if (fde->state & FDE_ACTIVE) {
+#if defined(__linux__)
+        auto it = g_poll_node_map.find(fde->fd);
+        if (it != g_poll_node_map.end() && it->second.in_epoll) {
+            epoll_ctl(g_epoll_fd.get(), EPOLL_CTL_DEL, fde->fd, nullptr);
+        }
+        g_poll_fallback.erase(fde->fd);
+#endif
         g_poll_node_map.erase(fde->fd);
         if (fde->state & FDE_PENDING) {
             g_pending_list.remove(fde);
@@ -190,6 +230,16 @@ static void fdevent_update(fdevent* fde, unsigned events) {
     } else {
         node.pollfd.events &= ~POLLOUT;
     }
+#if defined(__linux__)
+    if (node.in_epoll) {
+        epoll_event ev = {};
+        ev.events = node.pollfd.events;
+        ev.data.fd = fde->fd;
+        if (epoll_ctl(g_epoll_fd.get(), EPOLL_CTL_MOD, fde->fd, &ev) != 0) {
+            PLOG(ERROR) << "failed to update epoll events for fd " << fde->fd;
+        }
+    }
+#endif
     fde->state = (fde->state & FDE_STATEMASK) | events;
 }
 
@@ -238,6 +288,82 @@ static std::string dump_pollfds(const std::vector<adb_pollfd>& pollfds) {
     return result;
 }
 
+// Turns the poll() result for one fd into fdevent events and queues its fdevent.
+static void fdevent_queue_pollfd(const adb_pollfd& pollfd) {
+    if (pollfd.revents != 0) {
+        D("for fd %d, revents = %x", pollfd.fd, pollfd.revents);
+    }
+    unsigned events = 0;
+    if (pollfd.revents & POLLIN) {
+        events |= FDE_READ;
+    }
+    if (pollfd.revents & POLLOUT) {
+        events |= FDE_WRITE;
+    }
+    if (pollfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+        // We fake a read, as the rest of the code assumes that errors will
+        // be detected at that point.
+        events |= FDE_READ | FDE_ERROR;
+    }
+#if defined(__linux__)
+    if (pollfd.revents & POLLRDHUP) {
+        events |= FDE_READ | FDE_ERROR;
+    }
+#endif
+    if (events != 0) {
+        auto it = g_poll_node_map.find(pollfd.fd);
+        CHECK(it != g_poll_node_map.end());
+        fdevent* fde = it->second.fde;
+        CHECK_EQ(fde->fd, pollfd.fd);
+        fde->events |= events;
+        D("%s got events %x", dump_fde(fde).c_str(), events);
+        fde->state |= FDE_PENDING;
+        g_pending_list.push_back(fde);
+    }
+}
+
+#if defined(__linux__)
+
+static void fdevent_process() {
+    int timeout = -1;
+    if (!g_poll_fallback.empty()) {
+        std::vector<adb_pollfd> pollfds;
+        for (int fd : g_poll_fallback) {
+            pollfds.push_back(g_poll_node_map.find(fd)->second.pollfd);
+        }
+        D("poll(), pollfds = %s", dump_pollfds(pollfds).c_str());
+        int ret = adb_poll(&pollfds[0], pollfds.size(), 0);
+        if (ret == -1) {
+            PLOG(ERROR) << "poll(), ret = " << ret;
+            return;
+        }
+        for (const auto& pollfd : pollfds) {
+            fdevent_queue_pollfd(pollfd);
+        }
+        // Collect whatever else is ready, but don't block with events already pending.
+        if (ret > 0) {
+            timeout = 0;
+        }
+    }
+
+    epoll_event events[kMaxEpollEvents];
+    D("epoll_wait(), %zu fds", g_poll_node_map.size() - g_poll_fallback.size());
+    int ret = TEMP_FAILURE_RETRY(epoll_wait(g_epoll_fd.get(), events, kMaxEpollEvents, timeout));
+    if (ret == -1) {
+        PLOG(ERROR) << "epoll_wait(), ret = " << ret;
+        return;
+    }
+    for (int i = 0; i < ret; ++i) {
+        // The epoll and poll event bits have the same values on Linux.
+        adb_pollfd pollfd = {};
+        pollfd.fd = events[i].data.fd;
+        pollfd.revents = events[i].events;
+        fdevent_queue_pollfd(pollfd);
+    }
+}
+
+#else
+
 static void fdevent_process() {
     std::vector<adb_pollfd> pollfds;
     for (const auto& pair : g_poll_node_map) {
@@ -251,39 +377,12 @@ static void fdevent_process() {
         return;
     }
     for (const auto& pollfd : pollfds) {
-        if (pollfd.revents != 0) {
-            D("for fd %d, revents = %x", pollfd.fd, pollfd.revents);
-        }
-        unsigned events = 0;
-        if (pollfd.revents & POLLIN) {
-            events |= FDE_READ;
-        }
-        if (pollfd.revents & POLLOUT) {
-            events |= FDE_WRITE;
-        }
-        if (pollfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
-            // We fake a read, as the rest of the code assumes that errors will
-            // be detected at that point.
-            events |= FDE_READ | FDE_ERROR;
-        }
-#if defined(__linux__)
-        if (pollfd.revents & POLLRDHUP) {
-            events |= FDE_READ | FDE_ERROR;
-        }
-#endif
-        if (events != 0) {
-            auto it = g_poll_node_map.find(pollfd.fd);
-            CHECK(it != g_poll_node_map.end());
-            fdevent* fde = it->second.fde;
-            CHECK_EQ(fde->fd, pollfd.fd);
-            fde->events |= events;
-            D("%s got events %x", dump_fde(fde).c_str(), events);
-            fde->state |= FDE_PENDING;
-            g_pending_list.push_back(fde);
-        }
+        fdevent_queue_pollfd(pollfd);
     }
 }
 
+#endif
+
 static void fdevent_call_fdfunc(fdevent* fde) {
     unsigned events = fde->events;
     fde->events = 0;
@@ -445,6 +544,10 @@ size_t fdevent_installed_count() {
 void fdevent_reset() {
     g_poll_node_map.clear();
     g_pending_list.clear();
+#if defined(__linux__)
+    g_epoll_fd.reset();
+    g_poll_fallback.clear();
+#endif
 
     std::lock_guard<std::mutex> lock(run_queue_mutex);
     run_queue_notify_fd.reset();
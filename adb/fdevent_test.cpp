@@ -18,6 +18,7 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <limits>
 #include <queue>
 #include <string>
@@ -136,6 +137,84 @@ TEST_F(FdeventTest, smoke) {
     ASSERT_EQ(0, adb_close(reader));
 }
 
+struct ScalingArg {
+    int read_fd;
+    int write_fd;
+    size_t idle_count;
+};
+
+static void IdleFdEventCallback(int, unsigned, void*) {
+    FAIL() << "idle fd saw an event";
+}
+
+static void FdEventScalingThreadFunc(ScalingArg* arg) {
+    std::vector<std::unique_ptr<fdevent>> idle_fdes;
+    std::vector<int> idle_peers;
+    for (size_t i = 0; i < arg->idle_count; ++i) {
+        int fds[2];
+        ASSERT_EQ(0, adb_socketpair(fds));
+        idle_fdes.emplace_back(new fdevent);
+        fdevent_install(idle_fdes.back().get(), fds[0], IdleFdEventCallback, nullptr);
+        fdevent_add(idle_fdes.back().get(), FDE_READ);
+        idle_peers.push_back(fds[1]);
+    }
+
+    {
+        FdHandler handler(arg->read_fd, arg->write_fd);
+        fdevent_loop();
+    }
+
+    for (auto& fde : idle_fdes) {
+        fdevent_remove(fde.get());
+    }
+    for (int fd : idle_peers) {
+        adb_close(fd);
+    }
+}
+
+// Measures a one byte round trip through the loop while many other fds are installed but idle.
+// The cost per wakeup should stay flat as the idle count grows.
+TEST_F(FdeventTest, idle_fd_scaling) {
+    const size_t ROUND_TRIP_COUNT = 1000;
+
+    for (size_t idle_count : {0, 16, 128, 256}) {
+        fdevent_reset();
+
+        int fd_pair1[2];
+        int fd_pair2[2];
+        ASSERT_EQ(0, adb_socketpair(fd_pair1));
+        ASSERT_EQ(0, adb_socketpair(fd_pair2));
+        ScalingArg thread_arg;
+        thread_arg.read_fd = fd_pair1[0];
+        thread_arg.write_fd = fd_pair2[1];
+        thread_arg.idle_count = idle_count;
+        int writer = fd_pair1[1];
+        int reader = fd_pair2[0];
+
+        PrepareThread();
+        std::thread thread(FdEventScalingThreadFunc, &thread_arg);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < ROUND_TRIP_COUNT; ++i) {
+            char c = 'x';
+            ASSERT_TRUE(WriteFdExactly(writer, &c, 1));
+            ASSERT_TRUE(ReadFdExactly(reader, &c, 1));
+            ASSERT_EQ('x', c);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        TerminateThread(thread);
+        ASSERT_EQ(0, adb_close(writer));
+        ASSERT_EQ(0, adb_close(reader));
+
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        RecordProperty("round_trip_us_idle_" + std::to_string(idle_count),
+                       std::to_string(us / ROUND_TRIP_COUNT));
+        printf("%zu idle fds: %.1f us per round trip\n", idle_count,
+               static_cast<double>(us) / ROUND_TRIP_COUNT);
+    }
+}
+
 struct InvalidFdArg {
     fdevent fde;
     unsigned expected_events;
@@ -27,10 +27,12 @@
 #include <utime.h>
 
 #include <chrono>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "sysdeps.h"
@@ -39,6 +41,8 @@
 #include "adb_client.h"
 #include "adb_io.h"
 #include "adb_utils.h"
+#include "file_sync_compression.h"
+#include "file_sync_delta.h"
 #include "file_sync_service.h"
 #include "line_printer.h"
 #include "sysdeps/errno.h"
@@ -48,6 +52,15 @@
 #include <android-base/strings.h>
 #include <android-base/stringprintf.h>
 
+// When pushing or pulling a directory, this many files can be in flight before we wait for the
+// device to catch up. Small files are dominated by the round trip, so this is what makes large
+// trees fast.
+static constexpr size_t kMaxPipelinedFiles = 256;
+
+// Bytes of ID_RECV requests that can be written ahead of the data we're reading. The requests
+// sit in socket buffers until adbd gets to them, so writing too many could block us while adbd
+// is blocked writing file data that we haven't read yet.
+static constexpr size_t kMaxPipelinedRequestBytes = 8 * 1024;
 struct syncsendbuf {
     unsigned id;
     unsigned size;
@@ -78,6 +91,8 @@ struct copyinfo {
     uint32_t mode;
     uint64_t size = 0;
     bool skip = false;
+    // The device has an older version, so try sending only what changed.
+    bool delta = false;
 
     copyinfo(const std::string& local_path,
              const std::string& remote_path,
@@ -142,6 +157,16 @@ struct TransferLedger {
                                            bytes_transferred, s);
     }
 
+    // The rate across every file in this transfer so far, for the progress line.
+    std::string ProgressRate() {
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start_time;
+        double s = duration.count();
+        if (bytes_transferred == 0 || s < 1) return "";
+
+        double rate = (static_cast<double>(bytes_transferred) / s) / (1024 * 1024);
+        return android::base::StringPrintf(" (%.1f MB/s)", rate);
+    }
+
     void ReportProgress(LinePrinter& lp, const std::string& file, uint64_t file_copied_bytes,
                         uint64_t file_total_bytes) {
         char overall_percentage_str[5] = "?";
@@ -174,6 +199,7 @@ struct TransferLedger {
                     android::base::StringPrintf("[%4s] %s", overall_percentage_str, file.c_str());
             }
         }
+        output += ProgressRate();
         lp.Print(output, LinePrinter::LineType::INFO);
     }
 
@@ -198,7 +224,7 @@ struct TransferLedger {
 
 class SyncConnection {
   public:
-    SyncConnection() : expect_done_(false) {
+    SyncConnection() {
         max = SYNC_DATA_MAX; // TODO: decide at runtime.
 
         std::string error;
@@ -208,6 +234,8 @@ class SyncConnection {
             Error("failed to get feature set: %s", error.c_str());
         } else {
             have_stat_v2_ = CanUseFeature(features, kFeatureStat2);
+            have_sync_deflate_ = CanUseFeature(features, kFeatureSyncDeflate);
+            have_sync_delta_ = CanUseFeature(features, kFeatureSyncDelta);
             fd = adb_connect("sync:", &error);
             if (fd < 0) {
                 Error("connect failed: %s", error.c_str());
@@ -374,7 +402,8 @@ class SyncConnection {
     bool SendSmallFile(const char* path_and_mode,
                        const char* lpath, const char* rpath,
                        unsigned mtime,
-                       const char* data, size_t data_length) {
+                       const char* data, size_t data_length,
+                       bool compress) {
         size_t path_length = strlen(path_and_mode);
         if (path_length > 1024) {
             Error("SendSmallFile failed: path too long: %zu", path_length);
@@ -382,6 +411,19 @@ class SyncConnection {
             return false;
         }
 
+        // Progress is reported in file bytes, however many end up on the wire.
+        size_t file_length = data_length;
+        unsigned data_id = ID_DATA;
+        if (compress && have_sync_deflate_) {
+            compressor_.Reset();
+            size_t deflated_length = compressor_.Compress(data, data_length, deflate_buf_.data);
+            if (deflated_length != 0) {
+                data_id = ID_DEFLATE;
+                data = deflate_buf_.data;
+                data_length = deflated_length;
+            }
+        }
+
         std::vector<char> buf(sizeof(SyncRequest) + path_length +
                               sizeof(SyncRequest) + data_length +
                               sizeof(SyncRequest));
@@ -395,7 +437,7 @@ class SyncConnection {
         p += path_length;
 
         SyncRequest* req_data = reinterpret_cast<SyncRequest*>(p);
-        req_data->id = ID_DATA;
+        req_data->id = data_id;
         req_data->path_length = data_length;
         p += sizeof(SyncRequest);
         memcpy(p, data, data_length);
@@ -407,17 +449,22 @@ class SyncConnection {
         p += sizeof(SyncRequest);
 
         WriteOrDie(lpath, rpath, &buf[0], (p - &buf[0]));
-        expect_done_ = true;
+        deferred_acknowledgements_.emplace_back(lpath, rpath);
 
         // RecordFilesTransferred gets called in CopyDone.
-        RecordBytesTransferred(data_length);
-        ReportProgress(rpath, data_length, data_length);
+        RecordBytesTransferred(file_length);
+        ReportProgress(rpath, file_length, file_length);
         return true;
     }
 
     bool SendLargeFile(const char* path_and_mode,
                        const char* lpath, const char* rpath,
                        unsigned mtime) {
+        // ReceivedError() can't tell an early failure from the ID_OKAY of an earlier file.
+        if (!ReadAcknowledgements(true)) {
+            return false;
+        }
+
         if (!SendRequest(ID_SEND, path_and_mode)) {
             Error("failed to send ID_SEND message '%s': %s", path_and_mode, strerror(errno));
             return false;
@@ -438,6 +485,10 @@ class SyncConnection {
             return false;
         }
 
+        if (have_sync_deflate_) {
+            compressor_.Reset();
+        }
+
         syncsendbuf sbuf;
         sbuf.id = ID_DATA;
         while (true) {
@@ -451,7 +502,15 @@ class SyncConnection {
             }
 
             sbuf.size = bytes_read;
-            WriteOrDie(lpath, rpath, &sbuf, sizeof(SyncRequest) + bytes_read);
+            const syncsendbuf* out = &sbuf;
+            if (have_sync_deflate_) {
+                deflate_buf_.id = ID_DEFLATE;
+                deflate_buf_.size = compressor_.Compress(sbuf.data, bytes_read, deflate_buf_.data);
+                if (deflate_buf_.size != 0) {
+                    out = &deflate_buf_;
+                }
+            }
+            WriteOrDie(lpath, rpath, out, sizeof(SyncRequest) + out->size);
 
             RecordBytesTransferred(bytes_read);
             bytes_copied += bytes_read;
@@ -469,28 +528,180 @@ class SyncConnection {
         syncmsg msg;
         msg.data.id = ID_DONE;
         msg.data.size = mtime;
-        expect_done_ = true;
+        WriteOrDie(lpath, rpath, &msg.data, sizeof(msg.data));
+        deferred_acknowledgements_.emplace_back(lpath, rpath);
 
         // RecordFilesTransferred gets called in CopyDone.
-        return WriteOrDie(lpath, rpath, &msg.data, sizeof(msg.data));
+        return true;
     }
 
-    bool CopyDone(const char* from, const char* to) {
+    // Fetches the block checksums of the device's copy of |rpath|. A |block_size| of 0 means
+    // there's nothing to reuse.
+    bool ReadBlockChecksums(const char* rpath, size_t* block_size, uint64_t* basis_size,
+                            std::vector<BlockChecksum>* checksums) {
+        // The reply has to be read in order, behind anything still in flight.
+        if (!CopyDone()) return false;
+
+        if (!SendRequest(ID_CHECKSUM, rpath)) {
+            Error("failed to send ID_CHECKSUM message '%s': %s", rpath, strerror(errno));
+            return false;
+        }
+
         syncmsg msg;
-        if (!ReadFdExactly(fd, &msg.status, sizeof(msg.status))) {
-            Error("failed to copy '%s' to '%s': couldn't read from device", from, to);
+        if (!ReadFdExactly(fd, &msg.checksum, sizeof(msg.checksum))) {
+            Error("failed to read checksums for '%s': couldn't read from device", rpath);
             return false;
         }
-        if (msg.status.id == ID_OKAY) {
-            if (expect_done_) {
-                expect_done_ = false;
-                RecordFilesTransferred(1);
+        if (msg.checksum.id != ID_CHECKSUM) {
+            Error("failed to read checksums for '%s': unexpected response %x", rpath,
+                  msg.checksum.id);
+            return false;
+        }
+
+        *block_size = msg.checksum.block_size;
+        *basis_size = msg.checksum.file_size;
+        checksums->clear();
+        if (*block_size == 0) return true;
+        if (*block_size > SYNC_DATA_MAX) {
+            Error("failed to read checksums for '%s': block size %zu too large", rpath,
+                  *block_size);
+            return false;
+        }
+
+        checksums->resize((*basis_size + *block_size - 1) / *block_size);
+        if (!ReadFdExactly(fd, checksums->data(), checksums->size() * sizeof(BlockChecksum))) {
+            Error("failed to read checksums for '%s': couldn't read from device", rpath);
+            return false;
+        }
+        return true;
+    }
+
+    // Sends |lpath| as the changes to the device's copy, whose blocks have |checksums|.
+    bool SendDeltaFile(const char* spec, const char* lpath, const char* rpath, unsigned mtime,
+                       size_t block_size, uint64_t basis_size,
+                       const std::vector<BlockChecksum>& checksums) {
+        if (!SendRequest(ID_SEND_DELTA, spec)) {
+            Error("failed to send ID_SEND_DELTA message '%s': %s", spec, strerror(errno));
+            return false;
+        }
+
+        struct stat st;
+        if (stat(lpath, &st) == -1) {
+            Error("cannot stat '%s': %s", lpath, strerror(errno));
+            return false;
+        }
+
+        int lfd = adb_open(lpath, O_RDONLY);
+        if (lfd < 0) {
+            Error("opening '%s' locally failed: %s", lpath, strerror(errno));
+            return false;
+        }
+
+        if (have_sync_deflate_) {
+            compressor_.Reset();
+        }
+
+        // ID_COPY chunks are tiny, so collect chunks and write them together.
+        std::vector<char> out;
+        uint64_t total_size = st.st_size;
+        uint64_t bytes_copied = 0;
+        auto append = [&](uint32_t id, uint32_t size, const char* data, size_t data_length) {
+            SyncRequest req;
+            req.id = id;
+            req.path_length = size;
+            const char* p = reinterpret_cast<const char*>(&req);
+            out.insert(out.end(), p, p + sizeof(req));
+            out.insert(out.end(), data, data + data_length);
+            if (out.size() >= SYNC_DATA_MAX) {
+                WriteOrDie(lpath, rpath, out.data(), out.size());
+                out.clear();
+                ReportProgress(rpath, bytes_copied, total_size);
+            }
+        };
+
+        bool ok = ComputeDelta(
+            lfd, block_size, basis_size, checksums, max,
+            [&](const char* data, size_t length) {
+                size_t deflated_length = 0;
+                if (have_sync_deflate_) {
+                    deflated_length = compressor_.Compress(data, length, deflate_buf_.data);
+                }
+                if (deflated_length != 0) {
+                    append(ID_DEFLATE, deflated_length, deflate_buf_.data, deflated_length);
+                } else {
+                    append(ID_DATA, length, data, length);
+                }
+                bytes_copied += length;
+                RecordBytesTransferred(length);
                 return true;
-            } else {
-                Error("failed to copy '%s' to '%s': received premature success", from, to);
+            },
+            [&](uint32_t block) {
+                append(ID_COPY, block, nullptr, 0);
+                uint64_t length =
+                    std::min<uint64_t>(block_size, basis_size - uint64_t(block) * block_size);
+                bytes_copied += length;
+                RecordBytesTransferred(length);
                 return true;
+            });
+        if (!ok) {
+            Error("reading '%s' locally failed: %s", lpath, strerror(errno));
+            adb_close(lfd);
+            return false;
+        }
+        adb_close(lfd);
+
+        syncmsg msg;
+        msg.data.id = ID_DONE;
+        msg.data.size = mtime;
+        const char* p = reinterpret_cast<const char*>(&msg.data);
+        out.insert(out.end(), p, p + sizeof(msg.data));
+        WriteOrDie(lpath, rpath, out.data(), out.size());
+        deferred_acknowledgements_.emplace_back(lpath, rpath);
+
+        ReportProgress(rpath, bytes_copied, total_size);
+
+        // RecordFilesTransferred gets called in CopyDone.
+        return true;
+    }
+
+    bool CanSendDelta() {
+        return have_sync_delta_;
+    }
+
+    // Waits for the device to finish with every file sent so far.
+    bool CopyDone() {
+        return ReadAcknowledgements(true);
+    }
+
+    // Only waits if too many files are in flight. Failures may be reported against
+    // an earlier file, so the caller must stop sending when this returns false.
+    bool CopyDoneDeferred() {
+        return ReadAcknowledgements(false);
+    }
+
+    bool ReadAcknowledgements(bool read_all) {
+        while (!deferred_acknowledgements_.empty() &&
+               (read_all || deferred_acknowledgements_.size() > kMaxPipelinedFiles)) {
+            std::pair<std::string, std::string> file =
+                    std::move(deferred_acknowledgements_.front());
+            deferred_acknowledgements_.pop_front();
+            if (!ReadCopyStatus(file.first.c_str(), file.second.c_str())) {
+                return false;
             }
         }
+        return true;
+    }
+
+    bool ReadCopyStatus(const char* from, const char* to) {
+        syncmsg msg;
+        if (!ReadFdExactly(fd, &msg.status, sizeof(msg.status))) {
+            Error("failed to copy '%s' to '%s': couldn't read from device", from, to);
+            return false;
+        }
+        if (msg.status.id == ID_OKAY) {
+            RecordFilesTransferred(1);
+            return true;
+        }
         if (msg.status.id != ID_FAIL) {
             Error("failed to copy '%s' to '%s': unknown reason %d", from, to, msg.status.id);
             return false;
@@ -571,13 +782,29 @@ class SyncConnection {
         current_ledger_.expect_multiple_files = false;
     }
 
+    bool SendRecv(const char* rpath) {
+        return SendRequest(have_sync_deflate_ ? ID_RECV_DEFLATE : ID_RECV, rpath);
+    }
+
+    // Inflates an ID_DEFLATE chunk from the device.
+    ssize_t Inflate(const char* data, size_t length, char* out, size_t out_capacity) {
+        return decompressor_.Decompress(data, length, out, out_capacity);
+    }
+
     // TODO: add a char[max] buffer here, to replace syncsendbuf...
     int fd;
     size_t max;
 
   private:
-    bool expect_done_;
+    // Files we've finished sending whose ID_OKAY hasn't been read yet, oldest first.
+    std::deque<std::pair<std::string, std::string>> deferred_acknowledgements_;
     bool have_stat_v2_;
+    bool have_sync_deflate_ = false;
+    bool have_sync_delta_ = false;
+
+    SyncCompressor compressor_;
+    SyncDecompressor decompressor_;
+    syncsendbuf deflate_buf_;
 
     TransferLedger global_ledger_;
     TransferLedger current_ledger_;
@@ -591,9 +818,12 @@ class SyncConnection {
         if (!WriteFdExactly(fd, data, data_length)) {
             if (errno == ECONNRESET) {
                 // Assume adbd told us why it was closing the connection, and
-                // try to read failure reason from adbd.
+                // try to read failure reason from adbd. Replies for files still
+                // in flight come first, and the failure might be one of them.
                 syncmsg msg;
-                if (!ReadFdExactly(fd, &msg.status, sizeof(msg.status))) {
+                if (!ReadAcknowledgements(true)) {
+                    // ReadAcknowledgements already reported the failure.
+                } else if (!ReadFdExactly(fd, &msg.status, sizeof(msg.status))) {
                     Error("failed to copy '%s' to '%s': no response: %s", from, to, strerror(errno));
                 } else if (msg.status.id != ID_FAIL) {
                     Error("failed to copy '%s' to '%s': not ID_FAIL: %d", from, to, msg.status.id);
@@ -674,8 +904,10 @@ static bool sync_stat_fallback(SyncConnection& sc, const char* path, struct stat
     return true;
 }
 
+// If |pipeline| is set, this doesn't wait for the device to finish with the file, and a failure
+// might be reported for a file sent earlier. Call CopyDone() once everything has been sent.
 static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath, unsigned mtime,
-                      mode_t mode, bool sync) {
+                      mode_t mode, bool sync, bool pipeline = false) {
     std::string path_and_mode = android::base::StringPrintf("%s,%d", rpath, mode);
 
     if (sync) {
@@ -700,10 +932,11 @@ static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath,
         }
         buf[data_length++] = '\0';
 
-        if (!sc.SendSmallFile(path_and_mode.c_str(), lpath, rpath, mtime, buf, data_length)) {
+        if (!sc.SendSmallFile(path_and_mode.c_str(), lpath, rpath, mtime, buf, data_length,
+                              false)) {
             return false;
         }
-        return sc.CopyDone(lpath, rpath);
+        return pipeline ? sc.CopyDoneDeferred() : sc.CopyDone();
 #endif
     }
 
@@ -719,7 +952,7 @@ static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath,
             return false;
         }
         if (!sc.SendSmallFile(path_and_mode.c_str(), lpath, rpath, mtime,
-                              data.data(), data.size())) {
+                              data.data(), data.size(), true)) {
             return false;
         }
     } else {
@@ -727,12 +960,36 @@ static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath,
             return false;
         }
     }
-    return sc.CopyDone(lpath, rpath);
+    return pipeline ? sc.CopyDoneDeferred() : sc.CopyDone();
+}
+
+// Like a pipelined sync_send, but only sends the parts of a regular file that differ from the
+// device's existing copy.
+static bool sync_send_delta(SyncConnection& sc, const char* lpath, const char* rpath,
+                            unsigned mtime, mode_t mode) {
+    size_t block_size;
+    uint64_t basis_size;
+    std::vector<BlockChecksum> checksums;
+    if (!sc.ReadBlockChecksums(rpath, &block_size, &basis_size, &checksums)) {
+        return false;
+    }
+    if (block_size == 0) {
+        // The device couldn't read its copy after all.
+        return sync_send(sc, lpath, rpath, mtime, mode, false, true);
+    }
+
+    std::string spec = android::base::StringPrintf("%s,%d,%zu", rpath, mode, block_size);
+    if (!sc.SendDeltaFile(spec.c_str(), lpath, rpath, mtime, block_size, basis_size,
+                          checksums)) {
+        return false;
+    }
+    return sc.CopyDoneDeferred();
 }
 
+// If |requested| is set, the caller has already sent the ID_RECV request for |rpath|.
 static bool sync_recv(SyncConnection& sc, const char* rpath, const char* lpath,
-                      const char* name, uint64_t expected_size) {
-    if (!sc.SendRequest(ID_RECV, rpath)) return false;
+                      const char* name, uint64_t expected_size, bool requested = false) {
+    if (!requested && !sc.SendRecv(rpath)) return false;
 
     adb_unlink(lpath);
     int lfd = adb_creat(lpath, 0644);
@@ -752,7 +1009,7 @@ static bool sync_recv(SyncConnection& sc, const char* rpath, const char* lpath,
 
         if (msg.data.id == ID_DONE) break;
 
-        if (msg.data.id != ID_DATA) {
+        if (msg.data.id != ID_DATA && msg.data.id != ID_DEFLATE) {
             adb_close(lfd);
             adb_unlink(lpath);
             sc.ReportCopyFailure(rpath, lpath, msg);
@@ -773,16 +1030,31 @@ static bool sync_recv(SyncConnection& sc, const char* rpath, const char* lpath,
             return false;
         }
 
-        if (!WriteFdExactly(lfd, buffer, msg.data.size)) {
+        const char* data = buffer;
+        size_t length = msg.data.size;
+        char inflated[SYNC_DATA_MAX];
+        if (msg.data.id == ID_DEFLATE) {
+            ssize_t inflated_length = sc.Inflate(buffer, length, inflated, sizeof(inflated));
+            if (inflated_length < 0) {
+                sc.Error("failed to inflate data for '%s'", rpath);
+                adb_close(lfd);
+                adb_unlink(lpath);
+                return false;
+            }
+            data = inflated;
+            length = inflated_length;
+        }
+
+        if (!WriteFdExactly(lfd, data, length)) {
             sc.Error("cannot write '%s': %s", lpath, strerror(errno));
             adb_close(lfd);
             adb_unlink(lpath);
             return false;
         }
 
-        bytes_copied += msg.data.size;
+        bytes_copied += length;
 
-        sc.RecordBytesTransferred(msg.data.size);
+        sc.RecordBytesTransferred(length);
         sc.ReportProgress(name != nullptr ? name : rpath, bytes_copied, expected_size);
     }
 
@@ -902,6 +1174,11 @@ static bool copy_local_dir_remote(SyncConnection& sc, std::string lpath,
                         ci.skip = true;
                     }
                 }
+                if (!ci.skip && sc.CanSendDelta() && S_ISREG(ci.mode) && S_ISREG(st.st_mode) &&
+                    ci.size >= kMinDeltaFileSize &&
+                    static_cast<uint64_t>(st.st_size) >= kMinDeltaFileSize) {
+                    ci.delta = true;
+                }
             }
         }
     }
@@ -913,7 +1190,13 @@ static bool copy_local_dir_remote(SyncConnection& sc, std::string lpath,
             if (list_only) {
                 sc.Println("would push: %s -> %s", ci.lpath.c_str(), ci.rpath.c_str());
             } else {
-                if (!sync_send(sc, ci.lpath.c_str(), ci.rpath.c_str(), ci.time, ci.mode, false)) {
+                bool sent = ci.delta ? sync_send_delta(sc, ci.lpath.c_str(), ci.rpath.c_str(),
+                                                       ci.time, ci.mode)
+                                     : sync_send(sc, ci.lpath.c_str(), ci.rpath.c_str(), ci.time,
+                                                 ci.mode, false, true);
+                if (!sent) {
+                    // Don't leave replies for the files in flight to confuse the next request.
+                    sc.CopyDone();
                     return false;
                 }
             }
@@ -922,6 +1205,10 @@ static bool copy_local_dir_remote(SyncConnection& sc, std::string lpath,
         }
     }
 
+    if (!list_only && !sc.CopyDone()) {
+        return false;
+    }
+
     sc.RecordFilesSkipped(skipped);
     sc.ReportTransferRate(lpath, TransferDirection::push);
     return true;
@@ -1114,6 +1401,32 @@ static bool copy_remote_dir_local(SyncConnection& sc, std::string rpath,
 
     sc.ComputeExpectedTotalBytes(file_list);
 
+    // Ask for files ahead of the one we're reading, so adbd can start on the next file as soon
+    // as it has sent the current one. adbd answers requests in order.
+    std::vector<const copyinfo*> pulls;
+    for (const copyinfo& ci : file_list) {
+        if (!ci.skip && !S_ISDIR(ci.mode)) {
+            pulls.push_back(&ci);
+        }
+    }
+    size_t requested = 0;
+    size_t received = 0;
+    size_t request_bytes = 0;
+    auto send_requests = [&]() {
+        while (requested < pulls.size() && requested - received < kMaxPipelinedFiles) {
+            size_t size = sizeof(SyncRequest) + pulls[requested]->rpath.size();
+            if (requested > received && request_bytes + size > kMaxPipelinedRequestBytes) {
+                break;
+            }
+            if (!sc.SendRecv(pulls[requested]->rpath.c_str())) {
+                return false;
+            }
+            request_bytes += size;
+            requested++;
+        }
+        return true;
+    };
+
     int skipped = 0;
     for (const copyinfo &ci : file_list) {
         if (!ci.skip) {
@@ -1128,7 +1441,14 @@ static bool copy_remote_dir_local(SyncConnection& sc, std::string rpath,
                 continue;
             }
 
-            if (!sync_recv(sc, ci.rpath.c_str(), ci.lpath.c_str(), nullptr, ci.size)) {
+            if (!send_requests()) {
+                sc.Error("failed to request '%s': %s", ci.rpath.c_str(), strerror(errno));
+                return false;
+            }
+            bool ok = sync_recv(sc, ci.rpath.c_str(), ci.lpath.c_str(), nullptr, ci.size, true);
+            request_bytes -= sizeof(SyncRequest) + ci.rpath.size();
+            received++;
+            if (!ok) {
                 return false;
             }
 
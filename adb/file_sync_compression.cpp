@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG SYNC
+
+#include "sysdeps.h"
+#include "file_sync_compression.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "adb_trace.h"
+
+// Below this there's too little to gain to be worth a round through zlib.
+static constexpr size_t kMinCompressLength = 512;
+
+// A chunk must shrink to at most 7/8 of its size to be sent compressed.
+static size_t MaxCompressedLength(size_t length) {
+    return length - length / 8;
+}
+
+// Upper bound on the chunks sent raw after repeated failures to compress.
+static constexpr size_t kMaxBackoff = 64;
+
+SyncCompressor::~SyncCompressor() {
+    if (stream_) {
+        deflateEnd(stream_.get());
+    }
+}
+
+void SyncCompressor::Reset() {
+    skip_chunks_ = 0;
+    backoff_ = 1;
+}
+
+size_t SyncCompressor::Compress(const char* data, size_t length, char* out) {
+    size_t compressed_length = CompressChunk(data, length, out);
+    bytes_in_ += length;
+    bytes_out_ += compressed_length ? compressed_length : length;
+    return compressed_length;
+}
+
+size_t SyncCompressor::CompressChunk(const char* data, size_t length, char* out) {
+    if (length < kMinCompressLength) {
+        return 0;
+    }
+    if (skip_chunks_ > 0) {
+        --skip_chunks_;
+        return 0;
+    }
+
+    if (!stream_) {
+        stream_.reset(new z_stream());
+        // Level 1: on USB 2 the link, not the compressor, should stay the bottleneck.
+        if (deflateInit(stream_.get(), 1) != Z_OK) {
+            D("deflateInit failed");
+            stream_.reset();
+            return 0;
+        }
+    } else {
+        deflateReset(stream_.get());
+    }
+
+    // Only give deflate as much room as we'd accept: if it runs out, the chunk isn't worth it.
+    size_t limit = MaxCompressedLength(length);
+    stream_->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream_->avail_in = length;
+    stream_->next_out = reinterpret_cast<Bytef*>(out);
+    stream_->avail_out = limit;
+    if (deflate(stream_.get(), Z_FINISH) != Z_STREAM_END) {
+        skip_chunks_ = backoff_;
+        backoff_ = std::min(backoff_ * 2, kMaxBackoff);
+        return 0;
+    }
+
+    backoff_ = 1;
+    return limit - stream_->avail_out;
+}
+
+SyncDecompressor::~SyncDecompressor() {
+    if (stream_) {
+        inflateEnd(stream_.get());
+    }
+}
+
+ssize_t SyncDecompressor::Decompress(const char* data, size_t length, char* out,
+                                     size_t out_capacity) {
+    if (!stream_) {
+        stream_.reset(new z_stream());
+        if (inflateInit(stream_.get()) != Z_OK) {
+            D("inflateInit failed");
+            stream_.reset();
+            return -1;
+        }
+    } else {
+        inflateReset(stream_.get());
+    }
+
+    stream_->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream_->avail_in = length;
+    stream_->next_out = reinterpret_cast<Bytef*>(out);
+    stream_->avail_out = out_capacity;
+    if (inflate(stream_.get(), Z_FINISH) != Z_STREAM_END || stream_->avail_in != 0) {
+        return -1;
+    }
+    return out_capacity - stream_->avail_out;
+}
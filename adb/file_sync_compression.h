@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FILE_SYNC_COMPRESSION_H_
+#define _FILE_SYNC_COMPRESSION_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <memory>
+
+#include <zlib.h>
+
+// Compresses sync DATA chunks for the sync_deflate feature. Each chunk is a complete zlib
+// stream, so the receiver can decode it without any other state.
+//
+// Already-compressed data (APK resources, media) won't shrink, and compressing it just burns
+// CPU on both ends. When a chunk doesn't save enough, the compressor sends the next few chunks
+// raw, doubling the number each time it fails again.
+class SyncCompressor {
+  public:
+    SyncCompressor() = default;
+    ~SyncCompressor();
+
+    // Starts a new file, forgetting what was learned about the previous one.
+    void Reset();
+
+    // Compresses |length| bytes of |data| into |out|, which must hold at least |length| bytes.
+    // Returns the compressed size, or 0 if the chunk should be sent uncompressed.
+    size_t Compress(const char* data, size_t length, char* out);
+
+    // Totals across every chunk offered to Compress, for reporting the ratio.
+    size_t bytes_in() const { return bytes_in_; }
+    size_t bytes_out() const { return bytes_out_; }
+
+  private:
+    size_t CompressChunk(const char* data, size_t length, char* out);
+
+    std::unique_ptr<z_stream> stream_;
+
+    size_t skip_chunks_ = 0;
+    size_t backoff_ = 1;
+
+    size_t bytes_in_ = 0;
+    size_t bytes_out_ = 0;
+
+    SyncCompressor(const SyncCompressor&) = delete;
+    SyncCompressor& operator=(const SyncCompressor&) = delete;
+};
+
+class SyncDecompressor {
+  public:
+    SyncDecompressor() = default;
+    ~SyncDecompressor();
+
+    // Decompresses the chunk in |data| into |out|, which holds |out_capacity| bytes.
+    // Returns the decompressed size, or -1 if the chunk is corrupt or too large.
+    ssize_t Decompress(const char* data, size_t length, char* out, size_t out_capacity);
+
+  private:
+    std::unique_ptr<z_stream> stream_;
+
+    SyncDecompressor(const SyncDecompressor&) = delete;
+    SyncDecompressor& operator=(const SyncDecompressor&) = delete;
+};
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "file_sync_compression.h"
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "file_sync_service.h"
+
+static std::string CompressibleChunk() {
+    std::string data;
+    while (data.size() < SYNC_DATA_MAX) {
+        data += "I/ActivityManager: Start proc 1234:com.android.settings/1000 for activity\n";
+    }
+    data.resize(SYNC_DATA_MAX);
+    return data;
+}
+
+static std::string RandomChunk() {
+    std::string data(SYNC_DATA_MAX, '\0');
+    srand(1);
+    for (char& c : data) {
+        c = rand();
+    }
+    return data;
+}
+
+TEST(file_sync_compression, round_trip) {
+    SyncCompressor compressor;
+    SyncDecompressor decompressor;
+    std::string data = CompressibleChunk();
+    std::vector<char> deflated(data.size());
+    std::vector<char> inflated(SYNC_DATA_MAX);
+
+    // Reuse both streams, as the sync service does for every chunk.
+    for (int i = 0; i < 3; ++i) {
+        size_t deflated_length = compressor.Compress(data.data(), data.size(), deflated.data());
+        ASSERT_NE(0U, deflated_length);
+        ASSERT_LT(deflated_length, data.size() / 4);
+
+        ssize_t inflated_length = decompressor.Decompress(deflated.data(), deflated_length,
+                                                          inflated.data(), inflated.size());
+        ASSERT_EQ(static_cast<ssize_t>(data.size()), inflated_length);
+        ASSERT_EQ(data, std::string(inflated.data(), inflated_length));
+    }
+    ASSERT_EQ(3 * data.size(), compressor.bytes_in());
+    ASSERT_GT(compressor.bytes_in(), compressor.bytes_out());
+}
+
+TEST(file_sync_compression, small_chunks_sent_raw) {
+    SyncCompressor compressor;
+    std::string data(64, 'a');
+    std::vector<char> deflated(data.size());
+    ASSERT_EQ(0U, compressor.Compress(data.data(), data.size(), deflated.data()));
+    ASSERT_EQ(compressor.bytes_in(), compressor.bytes_out());
+}
+
+TEST(file_sync_compression, backoff) {
+    SyncCompressor compressor;
+    std::string random = RandomChunk();
+    std::string text = CompressibleChunk();
+    std::vector<char> deflated(SYNC_DATA_MAX);
+
+    // The first failure skips one chunk, even a compressible one.
+    ASSERT_EQ(0U, compressor.Compress(random.data(), random.size(), deflated.data()));
+    ASSERT_EQ(0U, compressor.Compress(text.data(), text.size(), deflated.data()));
+    ASSERT_NE(0U, compressor.Compress(text.data(), text.size(), deflated.data()));
+
+    // Consecutive failures double the number of chunks skipped.
+    ASSERT_EQ(0U, compressor.Compress(random.data(), random.size(), deflated.data()));
+    ASSERT_EQ(0U, compressor.Compress(random.data(), random.size(), deflated.data()));
+    ASSERT_EQ(0U, compressor.Compress(random.data(), random.size(), deflated.data()));
+    ASSERT_EQ(0U, compressor.Compress(text.data(), text.size(), deflated.data()));
+    ASSERT_EQ(0U, compressor.Compress(text.data(), text.size(), deflated.data()));
+    ASSERT_NE(0U, compressor.Compress(text.data(), text.size(), deflated.data()));
+
+    // A new file starts over.
+    ASSERT_EQ(0U, compressor.Compress(random.data(), random.size(), deflated.data()));
+    compressor.Reset();
+    ASSERT_NE(0U, compressor.Compress(text.data(), text.size(), deflated.data()));
+}
+
+TEST(file_sync_compression, corrupt_input) {
+    SyncCompressor compressor;
+    SyncDecompressor decompressor;
+    std::string data = CompressibleChunk();
+    std::vector<char> deflated(data.size());
+    std::vector<char> inflated(SYNC_DATA_MAX);
+
+    size_t deflated_length = compressor.Compress(data.data(), data.size(), deflated.data());
+    ASSERT_NE(0U, deflated_length);
+
+    // Truncated.
+    ASSERT_EQ(-1, decompressor.Decompress(deflated.data(), deflated_length / 2, inflated.data(),
+                                          inflated.size()));
+    // Inflates to more than the receiver allows.
+    ASSERT_EQ(-1, decompressor.Decompress(deflated.data(), deflated_length, inflated.data(),
+                                          inflated.size() / 2));
+    // Garbage.
+    std::string garbage(128, 'x');
+    ASSERT_EQ(-1, decompressor.Decompress(garbage.data(), garbage.size(), inflated.data(),
+                                          inflated.size()));
+
+    // The decompressor still works after a failure.
+    ASSERT_EQ(static_cast<ssize_t>(data.size()),
+              decompressor.Decompress(deflated.data(), deflated_length, inflated.data(),
+                                      inflated.size()));
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TRACE_TAG SYNC
+
+#include "sysdeps.h"
+#include "file_sync_delta.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+#include <openssl/sha.h>
+
+#include "adb_trace.h"
+
+static constexpr size_t kMinBlockSize = 2 * 1024;
+static constexpr size_t kMaxBlockSize = 64 * 1024;
+
+size_t DeltaBlockSize(uint64_t file_size) {
+    size_t block_size = static_cast<size_t>(sqrt(static_cast<double>(file_size)));
+    // Keep blocks a multiple of 1KiB so reads stay aligned.
+    block_size = (block_size + 1023) & ~static_cast<size_t>(1023);
+    return std::max(kMinBlockSize, std::min(kMaxBlockSize, block_size));
+}
+
+// The rsync weak checksum, which can be rolled forward one byte at a time.
+class RollingChecksum {
+  public:
+    void Init(const uint8_t* data, size_t length) {
+        a_ = b_ = 0;
+        length_ = length;
+        for (size_t i = 0; i < length; ++i) {
+            a_ += data[i];
+            b_ += (length - i) * data[i];
+        }
+    }
+
+    void Roll(uint8_t out, uint8_t in) {
+        a_ += in - out;
+        b_ += a_ - length_ * out;
+    }
+
+    uint32_t value() const { return (a_ & 0xffff) | (b_ << 16); }
+
+  private:
+    uint32_t a_ = 0;
+    uint32_t b_ = 0;
+    uint32_t length_ = 0;
+};
+
+static void StrongChecksum(const uint8_t* data, size_t length, uint8_t* out) {
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(data, length, digest);
+    memcpy(out, digest, sizeof(BlockChecksum::strong));
+}
+
+static bool ReadFully(int fd, uint8_t* buf, size_t length, size_t* bytes_read) {
+    *bytes_read = 0;
+    while (*bytes_read < length) {
+        int n = adb_read(fd, buf + *bytes_read, length - *bytes_read);
+        if (n < 0) return false;
+        if (n == 0) break;
+        *bytes_read += n;
+    }
+    return true;
+}
+
+bool ComputeBlockChecksums(int fd, size_t block_size, std::vector<BlockChecksum>* checksums) {
+    std::vector<uint8_t> block(block_size);
+    while (true) {
+        size_t length;
+        if (!ReadFully(fd, block.data(), block_size, &length)) return false;
+        if (length == 0) return true;
+
+        RollingChecksum weak;
+        weak.Init(block.data(), length);
+
+        BlockChecksum checksum;
+        checksum.weak = weak.value();
+        StrongChecksum(block.data(), length, checksum.strong);
+        checksums->push_back(checksum);
+
+        if (length < block_size) return true;
+    }
+}
+
+namespace {
+
+// Finds blocks of the basis file by checksum.
+class BlockIndex {
+  public:
+    BlockIndex(const std::vector<BlockChecksum>& checksums, size_t full_blocks)
+        : checksums_(checksums) {
+        // The last block is only looked up at the end of the file, since it may be short.
+        for (size_t i = 0; i < full_blocks; ++i) {
+            blocks_.emplace(checksums[i].weak, i);
+        }
+    }
+
+    // Returns the index of a full block matching |data|, or -1.
+    int64_t Find(uint32_t weak, const uint8_t* data, size_t length) {
+        auto range = blocks_.equal_range(weak);
+        if (range.first == range.second) return -1;
+
+        uint8_t strong[sizeof(BlockChecksum::strong)];
+        StrongChecksum(data, length, strong);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (memcmp(checksums_[it->second].strong, strong, sizeof(strong)) == 0) {
+                return it->second;
+            }
+        }
+        return -1;
+    }
+
+  private:
+    const std::vector<BlockChecksum>& checksums_;
+    std::unordered_multimap<uint32_t, uint32_t> blocks_;
+};
+
+}  // namespace
+
+bool ComputeDelta(int fd, size_t block_size, uint64_t basis_size,
+                  const std::vector<BlockChecksum>& checksums, size_t max_literal,
+                  const std::function<bool(const char* data, size_t length)>& literal,
+                  const std::function<bool(uint32_t block)>& copy) {
+    size_t full_blocks = std::min<uint64_t>(basis_size / block_size, checksums.size());
+    BlockIndex index(checksums, full_blocks);
+
+    // buf[start, pos) is literal data not yet sent, and buf[pos, pos + block_size) is the
+    // window being matched. Everything up to end has been read from fd.
+    std::vector<uint8_t> buf(max_literal + 2 * block_size + 64 * 1024);
+    size_t start = 0;
+    size_t pos = 0;
+    size_t end = 0;
+    bool eof = false;
+
+    auto fill = [&](size_t want) {
+        while (!eof && end - pos < want) {
+            if (end == buf.size()) {
+                memmove(buf.data(), buf.data() + start, end - start);
+                pos -= start;
+                end -= start;
+                start = 0;
+            }
+            int n = adb_read(fd, buf.data() + end, buf.size() - end);
+            if (n < 0) return false;
+            if (n == 0) eof = true;
+            end += n;
+        }
+        return true;
+    };
+
+    auto flush_literal = [&]() {
+        while (start < pos) {
+            size_t length = std::min(pos - start, max_literal);
+            if (!literal(reinterpret_cast<const char*>(buf.data() + start), length)) {
+                return false;
+            }
+            start += length;
+        }
+        return true;
+    };
+
+    RollingChecksum weak;
+    bool have_weak = false;
+    while (true) {
+        // One byte beyond the window, so we can roll forward.
+        if (!fill(block_size + 1)) return false;
+        if (end - pos < block_size) break;
+
+        if (!have_weak) {
+            weak.Init(buf.data() + pos, block_size);
+            have_weak = true;
+        }
+
+        int64_t block = index.Find(weak.value(), buf.data() + pos, block_size);
+        if (block >= 0) {
+            if (!flush_literal() || !copy(block)) return false;
+            pos += block_size;
+            start = pos;
+            have_weak = false;
+            continue;
+        }
+
+        if (end - pos == block_size) break;
+        weak.Roll(buf[pos], buf[pos + block_size]);
+        ++pos;
+        if (pos - start == max_literal && !flush_literal()) return false;
+    }
+
+    // The rest is too short to hold a full block, but it might be the basis file's last block.
+    size_t tail = end - pos;
+    if (checksums.size() > full_blocks && tail > 0 && tail < block_size &&
+        tail == basis_size - full_blocks * block_size) {
+        const uint8_t* data = buf.data() + pos;
+        RollingChecksum tail_weak;
+        tail_weak.Init(data, tail);
+        uint8_t strong[sizeof(BlockChecksum::strong)];
+        StrongChecksum(data, tail, strong);
+        const BlockChecksum& last = checksums[full_blocks];
+        if (tail_weak.value() == last.weak && memcmp(last.strong, strong, sizeof(strong)) == 0) {
+            return flush_literal() && copy(full_blocks);
+        }
+    }
+    pos = end;
+    return flush_literal();
+}
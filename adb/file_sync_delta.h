@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FILE_SYNC_DELTA_H_
+#define _FILE_SYNC_DELTA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+// Block matching for the sync_delta feature, in the style of rsync. The device checksums each
+// block of the file it already has, and the client walks its new version of the file with a
+// rolling checksum, so it finds those blocks wherever they've moved to.
+
+// The wire format of a block checksum. The weak checksum finds candidates cheaply at every byte
+// offset; the truncated SHA-256 confirms them.
+struct BlockChecksum {
+    uint32_t weak;
+    uint8_t strong[16];
+} __attribute__((packed));
+
+// Files smaller than this aren't worth the extra round trip.
+static constexpr uint64_t kMinDeltaFileSize = 1024 * 1024;
+
+// Returns the block size the device uses for a file of |file_size| bytes. Following rsync, this
+// grows with the square root of the size, to balance checksum traffic against match granularity.
+size_t DeltaBlockSize(uint64_t file_size);
+
+// Reads |fd| to the end and appends the checksum of each |block_size| block, the last of which
+// may be short. Returns false on a read error.
+bool ComputeBlockChecksums(int fd, size_t block_size, std::vector<BlockChecksum>* checksums);
+
+// Reads |fd| to the end and describes it in terms of a basis file of |basis_size| bytes, whose
+// blocks have the given |checksums|. The description is a sequence of calls, in file order, to
+// |literal| for data that must be sent (at most |max_literal| bytes per call) and to |copy| for a
+// block of the basis file. Returns false on a read error or if a callback returns false.
+bool ComputeDelta(int fd, size_t block_size, uint64_t basis_size,
+                  const std::vector<BlockChecksum>& checksums, size_t max_literal,
+                  const std::function<bool(const char* data, size_t length)>& literal,
+                  const std::function<bool(uint32_t block)>& copy);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "file_sync_delta.h"
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+
+#include "sysdeps.h"
+
+static std::string RandomData(size_t length, unsigned seed) {
+    std::string data(length, '\0');
+    srand(seed);
+    for (char& c : data) {
+        c = rand();
+    }
+    return data;
+}
+
+static std::vector<BlockChecksum> Checksums(const std::string& basis, size_t block_size) {
+    TemporaryFile tf;
+    EXPECT_TRUE(android::base::WriteStringToFd(basis, tf.fd));
+    EXPECT_EQ(0, adb_lseek(tf.fd, 0, SEEK_SET));
+    std::vector<BlockChecksum> checksums;
+    EXPECT_TRUE(ComputeBlockChecksums(tf.fd, block_size, &checksums));
+    return checksums;
+}
+
+// Rebuilds |target| from |basis| the way adbd would, and returns how many literal bytes it took.
+static size_t CheckDelta(const std::string& basis, const std::string& target, size_t block_size) {
+    std::vector<BlockChecksum> checksums = Checksums(basis, block_size);
+    EXPECT_EQ((basis.size() + block_size - 1) / block_size, checksums.size());
+
+    TemporaryFile tf;
+    EXPECT_TRUE(android::base::WriteStringToFd(target, tf.fd));
+    EXPECT_EQ(0, adb_lseek(tf.fd, 0, SEEK_SET));
+
+    const size_t kMaxLiteral = 4096;
+    std::string result;
+    size_t literal_bytes = 0;
+    EXPECT_TRUE(ComputeDelta(
+        tf.fd, block_size, basis.size(), checksums, kMaxLiteral,
+        [&](const char* data, size_t length) {
+            EXPECT_LE(length, kMaxLiteral);
+            result.append(data, length);
+            literal_bytes += length;
+            return true;
+        },
+        [&](uint32_t block) {
+            EXPECT_LT(block, checksums.size());
+            result.append(basis.substr(block * block_size, block_size));
+            return true;
+        }));
+    EXPECT_EQ(target, result);
+    return literal_bytes;
+}
+
+TEST(file_sync_delta, block_size) {
+    ASSERT_EQ(2048U, DeltaBlockSize(0));
+    ASSERT_EQ(2048U, DeltaBlockSize(1024 * 1024));
+    ASSERT_EQ(10240U, DeltaBlockSize(100 * 1024 * 1024));
+    ASSERT_EQ(65536U, DeltaBlockSize(1ULL << 40));
+}
+
+TEST(file_sync_delta, identical) {
+    std::string basis = RandomData(100 * 1024 + 123, 1);
+    ASSERT_EQ(0U, CheckDelta(basis, basis, 2048));
+}
+
+TEST(file_sync_delta, empty) {
+    ASSERT_EQ(0U, CheckDelta("", "", 2048));
+    ASSERT_EQ(5000U, CheckDelta("", RandomData(5000, 1), 2048));
+    ASSERT_EQ(0U, CheckDelta(RandomData(5000, 1), "", 2048));
+}
+
+TEST(file_sync_delta, modified_block) {
+    std::string basis = RandomData(64 * 1024, 1);
+    std::string target = basis;
+    target[10000] ^= 0xff;
+    size_t literal = CheckDelta(basis, target, 2048);
+    ASSERT_GT(literal, 0U);
+    ASSERT_LE(literal, 2048U);
+}
+
+TEST(file_sync_delta, shifted) {
+    // An insertion near the start moves every later block off its original alignment.
+    std::string basis = RandomData(64 * 1024 + 100, 1);
+    std::string target = basis.substr(0, 1000) + RandomData(37, 2) + basis.substr(1000);
+    size_t literal = CheckDelta(basis, target, 2048);
+    ASSERT_LE(literal, 2048U + 37);
+
+    // And a deletion.
+    target = basis.substr(0, 5000) + basis.substr(5100);
+    literal = CheckDelta(basis, target, 2048);
+    ASSERT_LE(literal, 2048U);
+}
+
+TEST(file_sync_delta, unrelated) {
+    std::string basis = RandomData(20000, 1);
+    // Big enough to cycle through the read buffer several times.
+    std::string target = RandomData(300000, 2);
+    ASSERT_EQ(target.size(), CheckDelta(basis, target, 2048));
+}
+
+TEST(file_sync_delta, repeated_blocks) {
+    std::string block = RandomData(2048, 1);
+    std::string basis = block + block + block;
+    std::string target = block + RandomData(10, 2) + block + block + block;
+    ASSERT_EQ(10U, CheckDelta(basis, target, 2048));
+}
@@ -42,6 +42,9 @@
 #include "adb_io.h"
 #include "adb_trace.h"
 #include "adb_utils.h"
+#include "adb_unique_fd.h"
+#include "file_sync_compression.h"
+#include "file_sync_delta.h"
 #include "security_log_tags.h"
 #include "sysdeps/errno.h"
 
@@ -198,10 +201,41 @@ static bool SendSyncFailErrno(int fd, const std::string& reason) {
     return SendSyncFail(fd, StringPrintf("%s: %s", reason.c_str(), strerror(errno)));
 }
 
+// The previous version of a file being replaced by ID_SEND_DELTA, which ID_COPY reads from.
+struct DeltaBasis {
+    unique_fd fd;
+    uint64_t size = 0;
+    size_t block_size = 0;
+};
+
+// Reads |block| of |basis| into |buf|, returning its length or -1 if there's no such block.
+static ssize_t read_basis_block(const DeltaBasis& basis, uint32_t block, char* buf) {
+    uint64_t offset = static_cast<uint64_t>(block) * basis.block_size;
+    if (offset >= basis.size) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t length = std::min<uint64_t>(basis.block_size, basis.size - offset);
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = TEMP_FAILURE_RETRY(pread(basis.fd.get(), buf + done, length - done,
+                                             offset + done));
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            return -1;
+        }
+        done += n;
+    }
+    return length;
+}
+
+// If |basis| is non-null, the data can include ID_COPY chunks.
 static bool handle_send_file(int s, const char* path, uid_t uid, gid_t gid, uint64_t capabilities,
-                             mode_t mode, std::vector<char>& buffer, bool do_unlink) {
+                             mode_t mode, std::vector<char>& buffer, bool do_unlink,
+                             SyncDecompressor& decompressor, const DeltaBasis* basis) {
     syncmsg msg;
     unsigned int timestamp = 0;
+    std::vector<char> inflated;
 
     __android_log_security_bswrite(SEC_TAG_ADB_SEND_FILE, path);
 
@@ -237,7 +271,20 @@ static bool handle_send_file(int s, const char* path, uid_t uid, gid_t gid, uint
     while (true) {
         if (!ReadFdExactly(s, &msg.data, sizeof(msg.data))) goto fail;
 
-        if (msg.data.id != ID_DATA) {
+        if (msg.data.id == ID_COPY && basis) {
+            ssize_t length = read_basis_block(*basis, msg.data.size, &buffer[0]);
+            if (length < 0) {
+                SendSyncFailErrno(s, "reading block to copy failed");
+                goto fail;
+            }
+            if (!WriteFdExactly(fd, &buffer[0], length)) {
+                SendSyncFailErrno(s, "write failed");
+                goto fail;
+            }
+            continue;
+        }
+
+        if (msg.data.id != ID_DATA && msg.data.id != ID_DEFLATE) {
             if (msg.data.id == ID_DONE) {
                 timestamp = msg.data.size;
                 break;
@@ -253,7 +300,21 @@ static bool handle_send_file(int s, const char* path, uid_t uid, gid_t gid, uint
 
         if (!ReadFdExactly(s, &buffer[0], msg.data.size)) goto abort;
 
-        if (!WriteFdExactly(fd, &buffer[0], msg.data.size)) {
+        const char* data = &buffer[0];
+        size_t length = msg.data.size;
+        if (msg.data.id == ID_DEFLATE) {
+            inflated.resize(SYNC_DATA_MAX);
+            ssize_t inflated_length =
+                decompressor.Decompress(&buffer[0], msg.data.size, &inflated[0], inflated.size());
+            if (inflated_length < 0) {
+                SendSyncFail(s, "corrupt compressed data message");
+                goto abort;
+            }
+            data = &inflated[0];
+            length = inflated_length;
+        }
+
+        if (!WriteFdExactly(fd, data, length)) {
             SendSyncFailErrno(s, "write failed");
             goto fail;
         }
@@ -287,7 +348,9 @@ fail:
 
         if (msg.data.id == ID_DONE) {
             break;
-        } else if (msg.data.id != ID_DATA) {
+        } else if (msg.data.id == ID_COPY && basis) {
+            continue;
+        } else if (msg.data.id != ID_DATA && msg.data.id != ID_DEFLATE) {
             char id[5];
             memcpy(id, &msg.data.id, sizeof(msg.data.id));
             id[4] = '\0';
@@ -360,7 +423,8 @@ static bool handle_send_link(int s, const std::string& path, std::vector<char>&
 }
 #endif
 
-static bool do_send(int s, const std::string& spec, std::vector<char>& buffer) {
+static bool do_send(int s, const std::string& spec, std::vector<char>& buffer,
+                    SyncDecompressor& decompressor, const DeltaBasis* basis = nullptr) {
     // 'spec' is of the form "/some/path,0755". Break it up.
     size_t comma = spec.find_last_of(',');
     if (comma == std::string::npos) {
@@ -401,10 +465,80 @@ static bool do_send(int s, const std::string& spec, std::vector<char>& buffer) {
         fs_config(path.c_str(), 0, nullptr, &uid, &gid, &broken_api_hack, &capabilities);
         mode = broken_api_hack;
     }
-    return handle_send_file(s, path.c_str(), uid, gid, capabilities, mode, buffer, do_unlink);
+    return handle_send_file(s, path.c_str(), uid, gid, capabilities, mode, buffer, do_unlink,
+                            decompressor, basis);
+}
+
+static bool do_checksum(int s, const char* path) {
+    syncmsg msg;
+    msg.checksum.id = ID_CHECKSUM;
+    msg.checksum.block_size = 0;
+    msg.checksum.file_size = 0;
+
+    // Anything we can't checksum just means the client has to send the whole file.
+    std::vector<BlockChecksum> checksums;
+    unique_fd fd(adb_open(path, O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (fd != -1 && fstat(fd.get(), &st) == 0 && S_ISREG(st.st_mode)) {
+        size_t block_size = DeltaBlockSize(st.st_size);
+        size_t block_count = (st.st_size + block_size - 1) / block_size;
+        if (ComputeBlockChecksums(fd.get(), block_size, &checksums) &&
+            checksums.size() == block_count) {
+            msg.checksum.block_size = block_size;
+            msg.checksum.file_size = st.st_size;
+        } else {
+            D("sync: couldn't checksum '%s', or it changed size", path);
+            checksums.clear();
+        }
+    }
+
+    return WriteFdExactly(s, &msg.checksum, sizeof(msg.checksum)) &&
+           WriteFdExactly(s, checksums.data(), checksums.size() * sizeof(BlockChecksum));
+}
+
+static bool do_send_delta(int s, const std::string& spec, std::vector<char>& buffer,
+                          SyncDecompressor& decompressor) {
+    // 'spec' is of the form "/some/path,0755,4096", with the block size the client was given.
+    size_t comma = spec.find_last_of(',');
+    if (comma == std::string::npos) {
+        SendSyncFail(s, "missing , in ID_SEND_DELTA");
+        return false;
+    }
+    std::string send_spec = spec.substr(0, comma);
+
+    DeltaBasis basis;
+    errno = 0;
+    basis.block_size = strtoul(spec.substr(comma + 1).c_str(), nullptr, 0);
+    if (errno != 0 || basis.block_size == 0 || basis.block_size > buffer.size()) {
+        SendSyncFail(s, "bad block size");
+        return false;
+    }
+
+    // do_send unlinks the old file, so open it first. It stays readable until we close it.
+    comma = send_spec.find_last_of(',');
+    if (comma == std::string::npos) {
+        SendSyncFail(s, "missing , in ID_SEND_DELTA");
+        return false;
+    }
+    std::string path = send_spec.substr(0, comma);
+    basis.fd.reset(adb_open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (basis.fd == -1 || fstat(basis.fd.get(), &st) == -1) {
+        SendSyncFailErrno(s, "open of file to update failed");
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        SendSyncFail(s, "file to update is not a regular file");
+        return false;
+    }
+    basis.size = st.st_size;
+
+    return do_send(s, send_spec, buffer, decompressor, &basis);
 }
 
-static bool do_recv(int s, const char* path, std::vector<char>& buffer) {
+// If |compressor| is non-null, the client accepts ID_DEFLATE chunks.
+static bool do_recv(int s, const char* path, std::vector<char>& buffer,
+                    SyncCompressor* compressor) {
     __android_log_security_bswrite(SEC_TAG_ADB_RECV_FILE, path);
 
     int fd = adb_open(path, O_RDONLY | O_CLOEXEC);
@@ -413,8 +547,13 @@ static bool do_recv(int s, const char* path, std::vector<char>& buffer) {
         return false;
     }
 
+    std::vector<char> deflated;
+    if (compressor) {
+        compressor->Reset();
+        deflated.resize(buffer.size());
+    }
+
     syncmsg msg;
-    msg.data.id = ID_DATA;
     while (true) {
         int r = adb_read(fd, &buffer[0], buffer.size());
         if (r <= 0) {
@@ -423,8 +562,21 @@ static bool do_recv(int s, const char* path, std::vector<char>& buffer) {
             adb_close(fd);
             return false;
         }
+
+        const char* data = &buffer[0];
+        msg.data.id = ID_DATA;
         msg.data.size = r;
-        if (!WriteFdExactly(s, &msg.data, sizeof(msg.data)) || !WriteFdExactly(s, &buffer[0], r)) {
+        if (compressor) {
+            size_t deflated_length = compressor->Compress(&buffer[0], r, &deflated[0]);
+            if (deflated_length != 0) {
+                data = &deflated[0];
+                msg.data.id = ID_DEFLATE;
+                msg.data.size = deflated_length;
+            }
+        }
+
+        if (!WriteFdExactly(s, &msg.data, sizeof(msg.data)) ||
+            !WriteFdExactly(s, data, msg.data.size)) {
             adb_close(fd);
             return false;
         }
@@ -451,6 +603,12 @@ static const char* sync_id_to_name(uint32_t id) {
       return "send";
     case ID_RECV:
       return "recv";
+    case ID_RECV_DEFLATE:
+      return "recv_deflate";
+    case ID_CHECKSUM:
+      return "checksum";
+    case ID_SEND_DELTA:
+      return "send_delta";
     case ID_QUIT:
         return "quit";
     default:
@@ -458,7 +616,8 @@ static const char* sync_id_to_name(uint32_t id) {
   }
 }
 
-static bool handle_sync_command(int fd, std::vector<char>& buffer) {
+static bool handle_sync_command(int fd, std::vector<char>& buffer, SyncCompressor& compressor,
+                                SyncDecompressor& decompressor) {
     D("sync: waiting for request");
 
     ATRACE_CALL();
@@ -496,10 +655,19 @@ static bool handle_sync_command(int fd, std::vector<char>& buffer) {
             if (!do_list(fd, name)) return false;
             break;
         case ID_SEND:
-            if (!do_send(fd, name, buffer)) return false;
+            if (!do_send(fd, name, buffer, decompressor)) return false;
             break;
         case ID_RECV:
-            if (!do_recv(fd, name, buffer)) return false;
+            if (!do_recv(fd, name, buffer, nullptr)) return false;
+            break;
+        case ID_RECV_DEFLATE:
+            if (!do_recv(fd, name, buffer, &compressor)) return false;
+            break;
+        case ID_CHECKSUM:
+            if (!do_checksum(fd, name)) return false;
+            break;
+        case ID_SEND_DELTA:
+            if (!do_send_delta(fd, name, buffer, decompressor)) return false;
             break;
         case ID_QUIT:
             return false;
@@ -513,8 +681,10 @@ static bool handle_sync_command(int fd, std::vector<char>& buffer) {
 
 void file_sync_service(int fd, void*) {
     std::vector<char> buffer(SYNC_DATA_MAX);
+    SyncCompressor compressor;
+    SyncDecompressor decompressor;
 
-    while (handle_sync_command(fd, buffer)) {
+    while (handle_sync_command(fd, buffer, compressor, decompressor)) {
     }
 
     D("sync: done");
@@ -35,6 +35,19 @@
 #define ID_FAIL MKID('F','A','I','L')
 #define ID_QUIT MKID('Q','U','I','T')
 
+// Only used with kFeatureSyncDeflate. ID_DEFLATE can be sent in place of ID_DATA, and its
+// payload is a zlib stream that inflates to at most SYNC_DATA_MAX bytes. ID_RECV_DEFLATE is
+// ID_RECV, but tells the device it may reply with ID_DEFLATE chunks.
+#define ID_DEFLATE MKID('D','E','F','L')
+#define ID_RECV_DEFLATE MKID('R','C','V','Z')
+
+// Only used with kFeatureSyncDelta. ID_CHECKSUM asks for the block checksums of a remote file.
+// ID_SEND_DELTA is ID_SEND with the block size appended to the spec, and its data can include
+// ID_COPY chunks, which have no payload and take block 'size' of the file being replaced.
+#define ID_CHECKSUM MKID('C','S','U','M')
+#define ID_SEND_DELTA MKID('S','N','D','D')
+#define ID_COPY MKID('C','O','P','Y')
+
 struct SyncRequest {
     uint32_t id;  // ID_STAT, et cetera.
     uint32_t path_length;  // <= 1024
@@ -77,6 +90,12 @@ union syncmsg {
         uint32_t id;
         uint32_t msglen;
     } status;
+    struct __attribute__((packed)) {
+        uint32_t id;
+        uint32_t block_size;  // 0 if there's nothing to reuse.
+        uint64_t file_size;
+        // Followed by one BlockChecksum per block.
+    } checksum;
 };
 
 void file_sync_service(int fd, void* cookie);
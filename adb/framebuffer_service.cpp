@@ -26,11 +26,17 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "sysdeps.h"
 
 #include "adb.h"
 #include "adb_io.h"
 #include "fdevent.h"
+#include "file_sync_compression.h"
 
 /* TODO:
 ** - sync with vsync to avoid tearing
@@ -55,22 +61,35 @@ struct fbinfo {
     unsigned int alpha_length;
 } __attribute__((packed));
 
-void framebuffer_service(int fd, void *cookie)
-{
-    struct fbinfo fbinfo;
-    unsigned int i, bsize;
-    char buf[640];
-    int fd_screencap;
-    int w, h, f, c;
-    int fds[2];
-    pid_t pid;
+// framebuffer-delta: sends frames as tiles of up to kTileSize pixels square, and only the tiles
+// that changed since the last frame.
+static constexpr unsigned int kTileSize = 64;
+
+static constexpr uint32_t kTileRaw = 0;
+static constexpr uint32_t kTileDeflate = 1;
 
-    if (pipe2(fds, O_CLOEXEC) < 0) goto pipefail;
+struct fbtile {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint32_t encoding;
+    uint32_t length;
+} __attribute__((packed));
+
+// Runs screencap with its output on a pipe. Returns the read end of the pipe, or -1.
+static int start_screencap(pid_t* pid) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) return -1;
 
-    pid = fork();
-    if (pid < 0) goto done;
+    *pid = fork();
+    if (*pid < 0) {
+        adb_close(fds[0]);
+        adb_close(fds[1]);
+        return -1;
+    }
 
-    if (pid == 0) {
+    if (*pid == 0) {
         dup2(fds[1], STDOUT_FILENO);
         adb_close(fds[0]);
         adb_close(fds[1]);
@@ -81,92 +100,117 @@ void framebuffer_service(int fd, void *cookie)
     }
 
     adb_close(fds[1]);
-    fd_screencap = fds[0];
+    return fds[0];
+}
+
+static void finish_screencap(int fd_screencap, pid_t pid) {
+    adb_close(fd_screencap);
+    TEMP_FAILURE_RETRY(waitpid(pid, NULL, 0));
+}
+
+// Reads screencap's header and describes the pixels that follow it in |fbinfo|.
+static bool read_screencap_header(int fd_screencap, struct fbinfo* fbinfo) {
+    int w, h, f, c;
 
     /* read w, h, format & color space */
-    if(!ReadFdExactly(fd_screencap, &w, 4)) goto done;
-    if(!ReadFdExactly(fd_screencap, &h, 4)) goto done;
-    if(!ReadFdExactly(fd_screencap, &f, 4)) goto done;
-    if(!ReadFdExactly(fd_screencap, &c, 4)) goto done;
+    if(!ReadFdExactly(fd_screencap, &w, 4)) return false;
+    if(!ReadFdExactly(fd_screencap, &h, 4)) return false;
+    if(!ReadFdExactly(fd_screencap, &f, 4)) return false;
+    if(!ReadFdExactly(fd_screencap, &c, 4)) return false;
 
-    fbinfo.version = DDMS_RAWIMAGE_VERSION;
-    fbinfo.colorSpace = c;
+    fbinfo->version = DDMS_RAWIMAGE_VERSION;
+    fbinfo->colorSpace = c;
     /* see hardware/hardware.h */
     switch (f) {
         case 1: /* RGBA_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 8;
+            fbinfo->bpp = 32;
+            fbinfo->size = w * h * 4;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 0;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 16;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 8;
             break;
         case 2: /* RGBX_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 0;
+            fbinfo->bpp = 32;
+            fbinfo->size = w * h * 4;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 0;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 16;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 0;
             break;
         case 3: /* RGB_888 */
-            fbinfo.bpp = 24;
-            fbinfo.size = w * h * 3;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 0;
+            fbinfo->bpp = 24;
+            fbinfo->size = w * h * 3;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 0;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 16;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 0;
             break;
         case 4: /* RGB_565 */
-            fbinfo.bpp = 16;
-            fbinfo.size = w * h * 2;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 11;
-            fbinfo.red_length = 5;
-            fbinfo.green_offset = 5;
-            fbinfo.green_length = 6;
-            fbinfo.blue_offset = 0;
-            fbinfo.blue_length = 5;
-            fbinfo.alpha_offset = 0;
-            fbinfo.alpha_length = 0;
+            fbinfo->bpp = 16;
+            fbinfo->size = w * h * 2;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 11;
+            fbinfo->red_length = 5;
+            fbinfo->green_offset = 5;
+            fbinfo->green_length = 6;
+            fbinfo->blue_offset = 0;
+            fbinfo->blue_length = 5;
+            fbinfo->alpha_offset = 0;
+            fbinfo->alpha_length = 0;
             break;
         case 5: /* BGRA_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 16;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 0;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 8;
+            fbinfo->bpp = 32;
+            fbinfo->size = w * h * 4;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 16;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 0;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 8;
            break;
         default:
-            goto done;
+            return false;
     }
 
+    return true;
+}
+
+void framebuffer_service(int fd, void *cookie)
+{
+    struct fbinfo fbinfo;
+    unsigned int i, bsize;
+    char buf[640];
+    pid_t pid;
+
+    int fd_screencap = start_screencap(&pid);
+    if (fd_screencap < 0) goto pipefail;
+
+    if (!read_screencap_header(fd_screencap, &fbinfo)) goto done;
+
     /* write header */
     if(!WriteFdExactly(fd, &fbinfo, sizeof(fbinfo))) goto done;
 
@@ -180,9 +224,101 @@ void framebuffer_service(int fd, void *cookie)
     }
 
 done:
-    adb_close(fds[0]);
-
-    TEMP_FAILURE_RETRY(waitpid(pid, NULL, 0));
+    finish_screencap(fd_screencap, pid);
 pipefail:
     adb_close(fd);
 }
+
+// Appends to |out| each tile of |frame| that differs from |previous|, or every tile if |previous|
+// is empty, and returns how many there were.
+static uint32_t encode_changed_tiles(const struct fbinfo& fbinfo, const std::vector<char>& frame,
+                                     const std::vector<char>& previous,
+                                     SyncCompressor* compressor, std::string* out) {
+    const size_t pixel_size = fbinfo.bpp / 8;
+    const size_t stride = fbinfo.width * pixel_size;
+    std::vector<char> tile(kTileSize * kTileSize * pixel_size);
+    std::vector<char> compressed(tile.size());
+    uint32_t count = 0;
+
+    for (unsigned int y = 0; y < fbinfo.height; y += kTileSize) {
+        unsigned int height = std::min(kTileSize, fbinfo.height - y);
+        for (unsigned int x = 0; x < fbinfo.width; x += kTileSize) {
+            unsigned int width = std::min(kTileSize, fbinfo.width - x);
+            size_t row_size = width * pixel_size;
+
+            bool changed = previous.empty();
+            for (unsigned int row = 0; row < height && !changed; ++row) {
+                size_t offset = (y + row) * stride + x * pixel_size;
+                changed = memcmp(&frame[offset], &previous[offset], row_size) != 0;
+            }
+            if (!changed) continue;
+
+            for (unsigned int row = 0; row < height; ++row) {
+                size_t offset = (y + row) * stride + x * pixel_size;
+                memcpy(&tile[row * row_size], &frame[offset], row_size);
+            }
+
+            size_t length = row_size * height;
+            const char* data = tile.data();
+            struct fbtile header = {static_cast<uint16_t>(x), static_cast<uint16_t>(y),
+                                    static_cast<uint16_t>(width), static_cast<uint16_t>(height),
+                                    kTileRaw, static_cast<uint32_t>(length)};
+            if (compressor != nullptr) {
+                size_t compressed_length = compressor->Compress(data, length, compressed.data());
+                if (compressed_length != 0) {
+                    header.encoding = kTileDeflate;
+                    header.length = compressed_length;
+                    data = compressed.data();
+                }
+            }
+
+            out->append(reinterpret_cast<const char*>(&header), sizeof(header));
+            out->append(data, header.length);
+            ++count;
+        }
+    }
+    return count;
+}
+
+void framebuffer_delta_service(int fd, void* cookie) {
+    std::unique_ptr<SyncCompressor> compressor;
+    if (cookie != nullptr) {
+        compressor.reset(new SyncCompressor());
+    }
+
+    struct fbinfo fbinfo = {};
+    std::vector<char> frame;
+    std::vector<char> previous;
+    std::string out;
+    char request;
+    while (ReadFdExactly(fd, &request, 1)) {
+        pid_t pid;
+        int fd_screencap = start_screencap(&pid);
+        if (fd_screencap < 0) break;
+
+        // The client only gets the header once, so a change of size or format ends the stream.
+        struct fbinfo current;
+        bool ok = read_screencap_header(fd_screencap, &current) &&
+                  (previous.empty() || memcmp(&current, &fbinfo, sizeof(fbinfo)) == 0);
+        if (ok) {
+            frame.resize(current.size);
+            ok = ReadFdExactly(fd_screencap, frame.data(), frame.size());
+        }
+        finish_screencap(fd_screencap, pid);
+        if (!ok) break;
+
+        out.clear();
+        if (previous.empty()) {
+            fbinfo = current;
+            out.append(reinterpret_cast<const char*>(&fbinfo), sizeof(fbinfo));
+        }
+        size_t count_offset = out.size();
+        out.append(sizeof(uint32_t), '\0');
+        uint32_t count = encode_changed_tiles(fbinfo, frame, previous, compressor.get(), &out);
+        memcpy(&out[count_offset], &count, sizeof(count));
+        if (!WriteFdExactly(fd, out.data(), out.size())) break;
+
+        previous.swap(frame);
+    }
+    adb_close(fd);
+}
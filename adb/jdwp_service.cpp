@@ -486,7 +486,7 @@ static void jdwp_socket_ready(asocket* s) {
      * on the second one, close the connection
      */
     if (!jdwp->pass) {
-        apacket* p = get_apacket();
+        apacket* p = get_apacket(s->get_max_payload());
         p->len = jdwp_process_list((char*)p->data, s->get_max_payload());
         peer->enqueue(peer, p);
         jdwp->pass = true;
@@ -528,7 +528,7 @@ static void jdwp_process_list_updated(void) {
     int len = jdwp_process_list_msg(buffer, sizeof(buffer));
 
     for (auto& t : _jdwp_trackers) {
-        apacket* p = get_apacket();
+        apacket* p = get_apacket(len);
         memcpy(p->data, buffer, len);
         p->len = len;
 
@@ -560,7 +560,7 @@ static void jdwp_tracker_ready(asocket* s) {
     JdwpTracker* t = (JdwpTracker*)s;
 
     if (t->need_initial) {
-        apacket* p = get_apacket();
+        apacket* p = get_apacket(s->get_max_payload());
         t->need_initial = false;
         p->len = jdwp_process_list_msg((char*)p->data, s->get_max_payload());
         s->peer->enqueue(s->peer, p);
@@ -288,6 +288,10 @@ int service_to_fd(const char* name, const atransport* transport) {
         ret = unix_open(name + 4, O_RDWR | O_CLOEXEC);
     } else if(!strncmp(name, "framebuffer:", 12)) {
         ret = create_service_thread("fb", framebuffer_service, nullptr);
+    } else if (!strncmp(name, "framebuffer-delta:", 18)) {
+        bool deflate = !strcmp(name + 18, "deflate");
+        ret = create_service_thread("fb-delta", framebuffer_delta_service,
+                                    reinterpret_cast<void*>(deflate));
     } else if (!strncmp(name, "jdwp:", 5)) {
         ret = create_jdwp_connection_fd(atoi(name+5));
     } else if(!strncmp(name, "shell", 5)) {
@@ -89,6 +89,7 @@
 #include <sys/stat.h>
 #include <termios.h>
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <thread>
@@ -187,9 +188,11 @@ class Subprocess {
                           fd_set* master_write_set_ptr);
 
     // Input/output stream handlers. Success returns nullptr, failure returns
-    // a pointer to the failed FD.
+    // a pointer to the failed FD. PassOutput() only buffers the data; FlushOutput() sends
+    // everything it buffered in one write.
     unique_fd* PassInput();
     unique_fd* PassOutput(unique_fd* sfd, ShellProtocol::Id id);
+    unique_fd* FlushOutput();
 
     const std::string command_;
     const std::string terminal_type_;
@@ -201,8 +204,9 @@ class Subprocess {
 
     // Shell protocol variables.
     unique_fd stdinout_sfd_, stderr_sfd_, protocol_sfd_;
-    std::unique_ptr<ShellProtocol> input_, output_;
+    std::unique_ptr<ShellProtocol> input_, output_, stderr_output_;
     size_t input_bytes_left_ = 0;
+    std::vector<ShellProtocol::PendingWrite> pending_output_;
 
     DISALLOW_COPY_AND_ASSIGN(Subprocess);
 };
@@ -387,7 +391,8 @@ bool Subprocess::ForkAndExec(std::string* error) {
 
         input_.reset(new ShellProtocol(protocol_sfd_));
         output_.reset(new ShellProtocol(protocol_sfd_));
-        if (!input_ || !output_) {
+        stderr_output_.reset(new ShellProtocol(protocol_sfd_));
+        if (!input_ || !output_ || !stderr_output_) {
             *error = "failed to allocate shell protocol objects";
             kill(pid_, SIGKILL);
             return false;
@@ -510,6 +515,11 @@ void Subprocess::PassDataStreams() {
 
 namespace {
 
+// Once PassOutput() has this much, it waits up to kOutputCoalesceTimeout for more output
+// before sending a packet.
+constexpr size_t kOutputCoalesceThreshold = 2048;
+constexpr auto kOutputCoalesceTimeout = std::chrono::milliseconds(2);
+
 inline bool ValidAndInSet(const unique_fd& sfd, fd_set* set) {
     return sfd != -1 && FD_ISSET(sfd, set);
 }
@@ -547,6 +557,11 @@ unique_fd* Subprocess::SelectLoop(fd_set* master_read_set_ptr,
             dead_sfd = PassOutput(&stderr_sfd_, ShellProtocol::kIdStderr);
         }
 
+        // Send what stdout and stderr produced, even if one of them just closed.
+        if (unique_fd* dead_protocol_sfd = FlushOutput()) {
+            dead_sfd = dead_protocol_sfd;
+        }
+
         // Read protocol FD, write to stdin.
         if (!dead_sfd && ValidAndInSet(protocol_sfd_, &read_set)) {
             dead_sfd = PassInput();
@@ -641,17 +656,59 @@ unique_fd* Subprocess::PassInput() {
 }
 
 unique_fd* Subprocess::PassOutput(unique_fd* sfd, ShellProtocol::Id id) {
-    int bytes = adb_read(*sfd, output_->data(), output_->data_capacity());
-    if (bytes == 0 || (bytes < 0 && errno != EAGAIN)) {
-        // read() returns EIO if a PTY closes; don't report this as an error,
-        // it just means the subprocess completed.
-        if (bytes < 0 && !(type_ == SubprocessType::kPty && errno == EIO)) {
-            PLOG(ERROR) << "error reading output FD " << *sfd;
+    ShellProtocol* output = (id == ShellProtocol::kIdStderr) ? stderr_output_.get() : output_.get();
+    char* data = output->data();
+    size_t capacity = output->data_capacity();
+    size_t length = 0;
+    unique_fd* dead_sfd = nullptr;
+    auto deadline = std::chrono::steady_clock::now() + kOutputCoalesceTimeout;
+
+    // A PTY hands out at most a few KiB per read, so keep reading until the buffer is full or
+    // the subprocess has nothing more for us.
+    while (length < capacity) {
+        int bytes = adb_read(*sfd, data + length, capacity - length);
+        if (bytes > 0) {
+            length += bytes;
+            continue;
+        }
+
+        if (bytes == 0 || errno != EAGAIN) {
+            // read() returns EIO if a PTY closes; don't report this as an error,
+            // it just means the subprocess completed.
+            if (bytes < 0 && !(type_ == SubprocessType::kPty && errno == EIO)) {
+                PLOG(ERROR) << "error reading output FD " << *sfd;
+            }
+            dead_sfd = sfd;
+            break;
+        }
+
+        // Interactive output goes out right away. A subprocess that is streaming will refill
+        // the pipe almost immediately, so wait for it a little to send fewer, larger packets.
+        if (length < kOutputCoalesceThreshold) {
+            break;
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            break;
+        }
+        adb_pollfd pfd = {.fd = sfd->get(), .events = POLLIN};
+        if (adb_poll(&pfd, 1, remaining.count()) <= 0) {
+            break;
         }
-        return sfd;
     }
 
-    if (bytes > 0 && !output_->Write(id, bytes)) {
+    if (length > 0) {
+        pending_output_.push_back({output, id, length});
+    }
+
+    return dead_sfd;
+}
+
+unique_fd* Subprocess::FlushOutput() {
+    bool ok = ShellProtocol::WriteMultiple(pending_output_.data(), pending_output_.size());
+    pending_output_.clear();
+    if (!ok) {
         if (errno != 0) {
             PLOG(ERROR) << "error reading protocol FD " << protocol_sfd_;
         }
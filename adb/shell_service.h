@@ -99,6 +99,19 @@ class ShellProtocol {
     // Returns false if the FD closed or errored.
     bool Write(Id id, size_t length);
 
+    // A packet waiting in the buffer of a ShellProtocol, as it would be passed to Write().
+    struct PendingWrite {
+        ShellProtocol* protocol;
+        Id id;
+        size_t length;
+    };
+
+    // Writes several packets with a single vectored write. All of the ShellProtocols must use
+    // the same FD.
+    //
+    // Returns false if the FD closed or errored.
+    static bool WriteMultiple(const PendingWrite* writes, size_t count);
+
   private:
     // Packets support 4-byte lengths.
     typedef uint32_t length_t;
@@ -112,6 +125,9 @@ class ShellProtocol {
         kHeaderSize = sizeof(Id) + sizeof(length_t)
     };
 
+    // Fills in the packet header in front of the data buffer.
+    void SetHeader(Id id, size_t length);
+
     int fd_;
     char buffer_[kBufferSize];
     size_t data_length_ = 0, bytes_left_ = 0;
@@ -19,8 +19,10 @@
 #include <string.h>
 
 #include <algorithm>
+#include <vector>
 
 #include "adb_io.h"
+#include "sysdeps.h"
 
 ShellProtocol::ShellProtocol(int fd) : fd_(fd) {
     buffer_[0] = kIdInvalid;
@@ -53,10 +55,28 @@ bool ShellProtocol::Read() {
     return true;
 }
 
-bool ShellProtocol::Write(Id id, size_t length) {
+void ShellProtocol::SetHeader(Id id, size_t length) {
     buffer_[0] = id;
     length_t typed_length = length;
     memcpy(&buffer_[1], &typed_length, sizeof(typed_length));
+}
 
+bool ShellProtocol::Write(Id id, size_t length) {
+    SetHeader(id, length);
     return WriteFdExactly(fd_, buffer_, kHeaderSize + length);
 }
+
+bool ShellProtocol::WriteMultiple(const PendingWrite* writes, size_t count) {
+    if (count == 0) {
+        return true;
+    }
+
+    std::vector<adb_iovec> iov(count);
+    for (size_t i = 0; i < count; ++i) {
+        ShellProtocol* protocol = writes[i].protocol;
+        protocol->SetHeader(writes[i].id, writes[i].length);
+        iov[i].iov_base = protocol->buffer_;
+        iov[i].iov_len = kHeaderSize + writes[i].length;
+    }
+    return WritevFdExactly(writes[0].protocol->fd_, iov.data(), count);
+}
@@ -145,6 +145,29 @@ TEST_F(ShellProtocolTest, ExitCodePacket) {
     ASSERT_EQ(20, read_protocol_->data()[0]);
 }
 
+// Tests writing packets from two buffers at once.
+TEST_F(ShellProtocolTest, WriteMultiple) {
+    ShellProtocol stderr_protocol(write_fd_);
+    memcpy(write_protocol_->data(), "out", 3);
+    memcpy(stderr_protocol.data(), "error", 5);
+
+    ShellProtocol::PendingWrite writes[] = {
+        {write_protocol_, ShellProtocol::kIdStdout, 3},
+        {&stderr_protocol, ShellProtocol::kIdStderr, 5},
+    };
+    ASSERT_TRUE(ShellProtocol::WriteMultiple(writes, 2));
+
+    ASSERT_TRUE(read_protocol_->Read());
+    ASSERT_EQ(ShellProtocol::kIdStdout, read_protocol_->id());
+    ASSERT_EQ(3u, read_protocol_->data_length());
+    ASSERT_EQ(0, memcmp(read_protocol_->data(), "out", 3));
+
+    ASSERT_TRUE(read_protocol_->Read());
+    ASSERT_EQ(ShellProtocol::kIdStderr, read_protocol_->id());
+    ASSERT_EQ(5u, read_protocol_->data_length());
+    ASSERT_EQ(0, memcmp(read_protocol_->data(), "error", 5));
+}
+
 // Tests writing to a closed pipe.
 TEST_F(ShellProtocolTest, WriteToClosedPipeFail) {
     adb_close(read_fd_);
@@ -97,6 +97,13 @@ struct asocket {
     /* A socket is bound to atransport */
     atransport* transport;
 
+    // Flow control, used by remote sockets only. |window| is how many WRTE packets may await
+    // their OKAY at once: 1 unless both ends support kFeatureStreamWindow. |writes_in_flight|
+    // is how many do. |pending_okays| counts the WRTEs we've received but not yet acknowledged.
+    size_t window;
+    size_t writes_in_flight;
+    size_t pending_okays;
+
     size_t get_max_payload() const;
 };
 
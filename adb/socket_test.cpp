@@ -114,8 +114,8 @@ static void CloseWithPacketThreadFunc(CloseWithPacketArg* arg) {
     ASSERT_TRUE(s != nullptr);
     arg->bytes_written = 0;
     while (true) {
-        apacket* p = get_apacket();
-        p->len = sizeof(p->data);
+        apacket* p = get_apacket(MAX_PAYLOAD);
+        p->len = MAX_PAYLOAD;
         arg->bytes_written += p->len;
         int ret = s->enqueue(s, p);
         if (ret == 1) {
@@ -39,6 +39,13 @@
 #include "adb_io.h"
 #include "transport.h"
 
+// How many WRTE packets a stream may have in flight when both ends support kFeatureStreamWindow.
+// The receiver may have to buffer this many payloads per stream.
+static constexpr size_t kStreamWindowPackets = 8;
+
+// The most queued packets a local socket writes to its fd with a single writev.
+static constexpr int kMaxLocalSocketIovecs = 16;
+
 static std::recursive_mutex& local_socket_list_lock = *new std::recursive_mutex();
 static unsigned local_socket_next_id = 1;
 
@@ -255,36 +262,51 @@ static void local_socket_event_func(int fd, unsigned ev, void* _s) {
     ** in order to simplify the code.
     */
     if (ev & FDE_WRITE) {
-        apacket* p;
-        while ((p = s->pkt_first) != nullptr) {
-            while (p->len > 0) {
-                int r = adb_write(fd, p->ptr, p->len);
-                if (r == -1) {
-                    /* returning here is ok because FDE_READ will
-                    ** be processed in the next iteration loop
-                    */
-                    if (errno == EAGAIN) {
-                        return;
-                    }
-                } else if (r > 0) {
-                    p->ptr += r;
-                    p->len -= r;
-                    continue;
+        while (s->pkt_first != nullptr) {
+            // Hand as many queued packets to the kernel as we can in one call, straight from
+            // their payload buffers.
+            adb_iovec iov[kMaxLocalSocketIovecs];
+            int count = 0;
+            for (apacket* p = s->pkt_first; p != nullptr && count < kMaxLocalSocketIovecs;
+                 p = p->next) {
+                if (p->len > 0) {
+                    iov[count].iov_base = p->ptr;
+                    iov[count].iov_len = p->len;
+                    ++count;
                 }
+            }
 
-                D(" closing after write because r=%d and errno is %d", r, errno);
+            ssize_t r = count ? adb_writev(fd, iov, count) : 0;
+            if (r == -1) {
+                /* returning here is ok because FDE_READ will
+                ** be processed in the next iteration loop
+                */
+                if (errno == EAGAIN) {
+                    return;
+                }
+            }
+            if (r <= 0 && count > 0) {
+                D(" closing after write because r=%zd and errno is %d", r, errno);
                 s->has_write_error = true;
                 s->close(s);
                 return;
             }
 
-            if (p->len == 0) {
+            // Retire the packets that were written completely.
+            size_t written = r;
+            apacket* p;
+            while ((p = s->pkt_first) != nullptr && written >= p->len) {
+                written -= p->len;
                 s->pkt_first = p->next;
                 if (s->pkt_first == 0) {
                     s->pkt_last = 0;
                 }
                 put_apacket(p);
             }
+            if (p != nullptr) {
+                p->ptr += written;
+                p->len -= written;
+            }
         }
 
         /* if we sent the last packet of a closing socket,
@@ -305,9 +327,9 @@ static void local_socket_event_func(int fd, unsigned ev, void* _s) {
     }
 
     if (ev & FDE_READ) {
-        apacket* p = get_apacket();
-        char* x = p->data;
         const size_t max_payload = s->get_max_payload();
+        apacket* p = get_apacket(max_payload);
+        char* x = p->data;
         size_t avail = max_payload;
         int r = 0;
         int is_eof = 0;
@@ -452,16 +474,26 @@ static int remote_socket_enqueue(asocket* s, apacket* p) {
     p->msg.arg1 = s->id;
     p->msg.data_length = p->len;
     send_packet(p, s->transport);
-    return 1;
+
+    // Keep the local side reading until the peer's window is full.
+    ++s->writes_in_flight;
+    return s->writes_in_flight < s->window ? 0 : 1;
 }
 
 static void remote_socket_ready(asocket* s) {
     D("entered remote_socket_ready RS(%d) OKAY fd=%d peer.fd=%d", s->id, s->fd, s->peer->fd);
-    apacket* p = get_apacket();
-    p->msg.command = A_OKAY;
-    p->msg.arg0 = s->peer->id;
-    p->msg.arg1 = s->id;
-    send_packet(p, s->transport);
+
+    // Acknowledge every WRTE that was held back while our peer was busy, so that the sender gets
+    // its whole window back.
+    size_t count = std::max<size_t>(s->pending_okays, 1);
+    s->pending_okays = 0;
+    for (size_t i = 0; i < count; ++i) {
+        apacket* p = get_apacket();
+        p->msg.command = A_OKAY;
+        p->msg.arg0 = s->peer->id;
+        p->msg.arg1 = s->id;
+        send_packet(p, s->transport);
+    }
 }
 
 static void remote_socket_shutdown(asocket* s) {
@@ -507,6 +539,7 @@ asocket* create_remote_socket(unsigned id, atransport* t) {
     s->shutdown = remote_socket_shutdown;
     s->close = remote_socket_close;
     s->transport = t;
+    s->window = t->has_feature(kFeatureStreamWindow) ? kStreamWindowPackets : 1;
 
     D("RS(%d): created", s->id);
     return s;
@@ -514,8 +547,8 @@ asocket* create_remote_socket(unsigned id, atransport* t) {
 
 void connect_to_remote(asocket* s, const char* destination) {
     D("Connect_to_remote call RS(%d) fd=%d", s->id, s->fd);
-    apacket* p = get_apacket();
     size_t len = strlen(destination) + 1;
+    apacket* p = get_apacket(len);
 
     if (len > (s->get_max_payload() - 1)) {
         fatal("destination oversized");
@@ -675,6 +708,7 @@ static int smart_socket_enqueue(asocket* s, apacket* p) {
             goto fail;
         }
 
+        apacket_reserve(s->pkt_first, s->pkt_first->len + p->len);
         memcpy(s->pkt_first->data + s->pkt_first->len, p->data, p->len);
         s->pkt_first->len += p->len;
         put_apacket(p);
@@ -700,6 +734,7 @@ static int smart_socket_enqueue(asocket* s, apacket* p) {
         return 0;
     }
 
+    apacket_reserve(p, len + 5);
     p->data[len + 4] = 0;
 
     D("SS(%d): '%s'", s->id, (char*)(p->data + 4));
@@ -134,6 +134,13 @@ extern int  adb_shutdown(int  fd);
 extern int  adb_close(int  fd);
 extern int  adb_register_socket(SOCKET s);
 
+// Windows has no writev(), so adb_writev() writes the buffers one at a time.
+struct adb_iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+extern ssize_t adb_writev(int fd, const adb_iovec* iov, int iovcnt);
+
 // See the comments for the !defined(_WIN32) version of unix_close().
 static __inline__ int  unix_close(int fd)
 {
@@ -353,6 +360,7 @@ size_t ParseCompleteUTF8(const char* first, const char* last, std::vector<char>*
 #include <poll.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 
 #include <pthread.h>
@@ -480,6 +488,14 @@ static __inline__  int  adb_write(int  fd, const void*  buf, size_t  len)
 #undef   write
 #define  write  ___xxx_write
 
+typedef struct iovec adb_iovec;
+
+static __inline__ ssize_t adb_writev(int fd, const adb_iovec* iov, int iovcnt) {
+    return TEMP_FAILURE_RETRY(writev(fd, iov, iovcnt));
+}
+#undef   writev
+#define  writev  ___xxx_writev
+
 static __inline__ int   adb_lseek(int  fd, int  pos, int  where)
 {
     return lseek(fd, pos, where);
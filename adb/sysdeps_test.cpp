@@ -40,6 +40,26 @@ TEST(sysdeps_socketpair, smoke) {
     ASSERT_EQ(0, adb_close(fds[1]));
 }
 
+TEST(sysdeps_writev, smoke) {
+    int fds[2];
+    ASSERT_EQ(0, adb_socketpair(fds)) << strerror(errno);
+
+    char foo[] = "foo";
+    char bar[] = "bar";
+    adb_iovec iov[2];
+    iov[0].iov_base = foo;
+    iov[0].iov_len = 3;
+    iov[1].iov_base = bar;
+    iov[1].iov_len = 4;
+    ASSERT_EQ(7, adb_writev(fds[0], iov, 2)) << strerror(errno);
+
+    char buf[7];
+    ASSERT_TRUE(ReadFdExactly(fds[1], buf, 7));
+    ASSERT_STREQ(buf, "foobar");
+    ASSERT_EQ(0, adb_close(fds[0]));
+    ASSERT_EQ(0, adb_close(fds[1]));
+}
+
 TEST(sysdeps_fd, exhaustion) {
     std::vector<int> fds;
     int socketpair[2];
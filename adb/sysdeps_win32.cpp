@@ -449,6 +449,24 @@ int  adb_write(int  fd, const void*  buf, int  len)
 }
 
 
+ssize_t adb_writev(int fd, const adb_iovec* iov, int iovcnt) {
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        int len = static_cast<int>(iov[i].iov_len);
+        int r = adb_write(fd, iov[i].iov_base, len);
+        if (r == -1) {
+            // Report what was already written; the caller will see the error on its next write.
+            return total ? total : -1;
+        }
+        total += r;
+        if (r != len) {
+            break;
+        }
+    }
+    return total;
+}
+
+
 int  adb_lseek(int  fd, int  pos, int  where)
 {
     FH     f = _fh_from_int(fd, __func__);
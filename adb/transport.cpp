@@ -59,6 +59,10 @@ const char* const kFeatureCmd = "cmd";
 const char* const kFeatureStat2 = "stat_v2";
 const char* const kFeatureLibusb = "libusb";
 const char* const kFeaturePushSync = "push_sync";
+const char* const kFeatureSyncDeflate = "sync_deflate";
+const char* const kFeatureSyncDelta = "sync_delta";
+const char* const kFeatureStreamWindow = "stream_window";
+const char* const kFeatureFramebufferDelta = "framebuffer_delta";
 
 TransportId NextTransportId() {
     static std::atomic<TransportId> next(1);
@@ -171,9 +175,8 @@ void send_packet(apacket* p, atransport* t) {
         fatal("Transport is null");
     }
 
-    if (write_packet(t->transport_socket, t->serial, &p)) {
-        fatal_errno("cannot enqueue packet on transport socket");
-    }
+    VLOG(TRANSPORT) << dump_packet(t->serial, "to remote", p);
+    t->EnqueueWrite(p);
 }
 
 // The transport is opened by transport_register_func before
@@ -253,54 +256,77 @@ oops:
 }
 
 // write_transport thread gets packets sent by the main thread (through send_packet()),
-// and writes to a transport (representing a usb/tcp connection).
+// and writes to a transport (representing a usb/tcp connection). It takes everything that
+// has been queued at once, so that transports that can will send it with a single write.
 static void write_transport_thread(void* _t) {
     atransport* t = reinterpret_cast<atransport*>(_t);
-    apacket* p;
-    int active = 0;
+    std::vector<apacket*> packets;
+    std::vector<apacket*> batch;
+    bool active = false;
+    bool done = false;
 
     adb_thread_setname(
         android::base::StringPrintf("->%s", (t->serial != nullptr ? t->serial : "transport")));
-    D("%s: starting write_transport thread, reading from fd %d", t->serial, t->fd);
+    D("%s: starting write_transport thread", t->serial);
 
-    for (;;) {
-        ATRACE_NAME("write_transport loop");
-        if (read_packet(t->fd, t->serial, &p)) {
-            D("%s: failed to read apacket from transport on fd %d", t->serial, t->fd);
-            break;
+    auto flush = [t, &batch]() {
+        if (batch.empty()) {
+            return true;
         }
+        D("%s: transport got %zu packets, sending to remote", t->serial, batch.size());
+        ATRACE_NAME("write_transport write_remote");
+        int rc = t->WriteBatch(batch.data(), batch.size());
+        for (apacket* p : batch) {
+            put_apacket(p);
+        }
+        batch.clear();
+        if (rc != 0) {
+            D("%s: remote write failed for transport", t->serial);
+            return false;
+        }
+        return true;
+    };
 
-        if (p->msg.command == A_SYNC) {
-            if (p->msg.arg0 == 0) {
-                D("%s: transport SYNC offline", t->serial);
+    while (!done) {
+        ATRACE_NAME("write_transport loop");
+        t->DequeueWrites(&packets);
+
+        for (apacket* p : packets) {
+            if (done) {
                 put_apacket(p);
-                break;
-            } else {
-                if (p->msg.arg1 == t->sync_token) {
-                    D("%s: transport SYNC online", t->serial);
-                    active = 1;
-                } else {
-                    D("%s: transport ignoring SYNC %d != %d", t->serial, p->msg.arg1, t->sync_token);
-                }
+                continue;
             }
-        } else {
-            if (active) {
-                D("%s: transport got packet, sending to remote", t->serial);
-                ATRACE_NAME("write_transport write_remote");
-                if (t->Write(p) != 0) {
-                    D("%s: remote write failed for transport", t->serial);
+
+            if (p->msg.command != A_SYNC) {
+                if (active) {
+                    batch.push_back(p);
+                } else {
+                    D("%s: transport ignoring packet while offline", t->serial);
                     put_apacket(p);
-                    break;
                 }
+                continue;
+            }
+
+            if (!flush()) {
+                done = true;
+            } else if (p->msg.arg0 == 0) {
+                D("%s: transport SYNC offline", t->serial);
+                done = true;
+            } else if (p->msg.arg1 == t->sync_token) {
+                D("%s: transport SYNC online", t->serial);
+                active = true;
             } else {
-                D("%s: transport ignoring packet while offline", t->serial);
+                D("%s: transport ignoring SYNC %d != %d", t->serial, p->msg.arg1, t->sync_token);
             }
+            put_apacket(p);
         }
 
-        put_apacket(p);
+        if (!done && !flush()) {
+            done = true;
+        }
     }
 
-    D("%s: write_transport thread is exiting, fd %d", t->serial, t->fd);
+    D("%s: write_transport thread is exiting", t->serial);
     kick_transport(t);
     transport_unref(t);
 }
@@ -372,7 +398,7 @@ static int device_tracker_enqueue(asocket* socket, apacket* p) {
 }
 
 static int device_tracker_send(device_tracker* tracker, const std::string& string) {
-    apacket* p = get_apacket();
+    apacket* p = get_apacket(4 + string.size());
     asocket* peer = tracker->socket.peer;
 
     snprintf(reinterpret_cast<char*>(p->data), 5, "%04x", static_cast<int>(string.size()));
@@ -515,6 +541,7 @@ static void transport_registration_func(int _fd, unsigned ev, void* data) {
         */
         fdevent_remove(&(t->transport_fde));
         adb_close(t->fd);
+        t->DiscardWrites();
 
         {
             std::lock_guard<std::recursive_mutex> lock(transport_lock);
@@ -749,6 +776,41 @@ int atransport::Write(apacket* p) {
     return write_func_(p, this);
 }
 
+int atransport::WriteBatch(apacket* const* packets, size_t count) {
+    if (write_batch_func_ != nullptr) {
+        return write_batch_func_(packets, count, this);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (write_func_(packets[i], this) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void atransport::EnqueueWrite(apacket* p) {
+    std::lock_guard<std::mutex> lock(write_queue_mutex_);
+    write_queue_.push_back(p);
+    if (write_queue_.size() == 1) {
+        write_queue_cv_.notify_one();
+    }
+}
+
+void atransport::DequeueWrites(std::vector<apacket*>* packets) {
+    packets->clear();
+    std::unique_lock<std::mutex> lock(write_queue_mutex_);
+    write_queue_cv_.wait(lock, [this]() { return !write_queue_.empty(); });
+    packets->swap(write_queue_);
+}
+
+void atransport::DiscardWrites() {
+    std::lock_guard<std::mutex> lock(write_queue_mutex_);
+    for (apacket* p : write_queue_) {
+        put_apacket(p);
+    }
+    write_queue_.clear();
+}
+
 void atransport::Kick() {
     if (!kicked_) {
         kicked_ = true;
@@ -812,7 +874,8 @@ constexpr char kFeatureStringDelimiter = ',';
 const FeatureSet& supported_features() {
     // Local static allocation to avoid global non-POD variables.
     static const FeatureSet* features = new FeatureSet{
-        kFeatureShell2, kFeatureCmd, kFeatureStat2,
+        kFeatureShell2, kFeatureCmd, kFeatureStat2, kFeatureSyncDeflate, kFeatureSyncDelta,
+        kFeatureStreamWindow, kFeatureFramebufferDelta,
         // Increment ADB_SERVER_VERSION whenever the feature list changes to
         // make sure that the adb client and server features stay in sync
         // (http://b/24370690).
@@ -1093,10 +1156,11 @@ bool check_data(apacket* p) {
 
 #if ADB_HOST
 std::shared_ptr<RSA> atransport::NextKey() {
-    if (keys_.empty()) keys_ = adb_auth_get_private_keys();
+    if (keys_.empty()) keys_ = adb_auth_get_private_keys(serial_name());
 
     std::shared_ptr<RSA> result = keys_[0];
     keys_.pop_front();
+    last_key_ = result;
     return result;
 }
 #endif
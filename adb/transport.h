@@ -20,6 +20,7 @@
 #include <sys/types.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <functional>
 #include <list>
@@ -27,6 +28,7 @@
 #include <mutex>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #include "adb.h"
 
@@ -53,6 +55,14 @@ extern const char* const kFeatureStat2;
 extern const char* const kFeatureLibusb;
 // The server supports `push --sync`.
 extern const char* const kFeaturePushSync;
+// The sync service accepts and can send deflate-compressed data chunks.
+extern const char* const kFeatureSyncDeflate;
+// The sync service can send only the blocks of a file that changed.
+extern const char* const kFeatureSyncDelta;
+// A stream may have several WRTE packets awaiting their OKAY.
+extern const char* const kFeatureStreamWindow;
+// The framebuffer-delta: service is available.
+extern const char* const kFeatureFramebufferDelta;
 
 TransportId NextTransportId();
 
@@ -75,11 +85,23 @@ class atransport {
     void (*close)(atransport* t) = nullptr;
 
     void SetWriteFunction(int (*write_func)(apacket*, atransport*)) { write_func_ = write_func; }
+    // Optional. Transports that can put several packets in one write set this.
+    void SetWriteBatchFunction(int (*write_batch_func)(apacket* const*, size_t, atransport*)) {
+        write_batch_func_ = write_batch_func;
+    }
     void SetKickFunction(void (*kick_func)(atransport*)) { kick_func_ = kick_func; }
     bool IsKicked() { return kicked_; }
     int Write(apacket* p);
+    int WriteBatch(apacket* const* packets, size_t count);
     void Kick();
 
+    // The queue between send_packet() and the write_transport thread. DequeueWrites() waits for
+    // at least one packet and then takes everything that is queued.
+    void EnqueueWrite(apacket* p);
+    void DequeueWrites(std::vector<apacket*>* packets);
+    // Frees whatever the write_transport thread left behind.
+    void DiscardWrites();
+
     // ConnectionState can be read by all threads, but can only be written in the main thread.
     ConnectionState GetConnectionState() const;
     void SetConnectionState(ConnectionState state);
@@ -122,6 +144,9 @@ class atransport {
 
 #if ADB_HOST
     std::shared_ptr<RSA> NextKey();
+
+    // The key that NextKey() last returned, or null if it hasn't been called.
+    const std::shared_ptr<RSA>& last_key() const { return last_key_; }
 #endif
 
     char token[TOKEN_SIZE] = {};
@@ -167,6 +192,11 @@ private:
     bool kicked_ = false;
     void (*kick_func_)(atransport*) = nullptr;
     int (*write_func_)(apacket*, atransport*) = nullptr;
+    int (*write_batch_func_)(apacket* const*, size_t, atransport*) = nullptr;
+
+    std::mutex write_queue_mutex_;
+    std::condition_variable write_queue_cv_;
+    std::vector<apacket*> write_queue_;
 
     // A set of features transmitted in the banner with the initial connection.
     // This is stored in the banner as 'features=feature0,feature1,etc'.
@@ -180,6 +210,7 @@ private:
     std::atomic<ConnectionState> connection_state_;
 #if ADB_HOST
     std::deque<std::shared_ptr<RSA>> keys_;
+    std::shared_ptr<RSA> last_key_;
 #endif
 
     DISALLOW_COPY_AND_ASSIGN(atransport);
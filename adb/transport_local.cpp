@@ -25,6 +25,7 @@
 #include <string.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
@@ -72,6 +73,7 @@ static int remote_read(apacket *p, atransport *t)
         return -1;
     }
 
+    apacket_reserve(p, p->msg.data_length);
     if (!ReadFdExactly(t->sfd, p->data, p->msg.data_length)) {
         D("remote local: terminated (data)");
         return -1;
@@ -85,11 +87,31 @@ static int remote_read(apacket *p, atransport *t)
     return 0;
 }
 
+// The most packets remote_write_batch() puts into one writev.
+static constexpr size_t kMaxWriteBatch = 32;
+
+// Writes the headers and payloads of |packets| with writev, so the payloads go straight from the
+// packets into the socket without being copied next to their headers first.
+static bool write_packets_gathered(int fd, apacket* const* packets, size_t count) {
+    adb_iovec iov[kMaxWriteBatch * 2];
+    int iovcnt = 0;
+    for (size_t i = 0; i < count; ++i) {
+        apacket* p = packets[i];
+        iov[iovcnt].iov_base = &p->msg;
+        iov[iovcnt].iov_len = sizeof(amessage);
+        ++iovcnt;
+        if (p->msg.data_length) {
+            iov[iovcnt].iov_base = p->data;
+            iov[iovcnt].iov_len = p->msg.data_length;
+            ++iovcnt;
+        }
+    }
+    return WritevFdExactly(fd, iov, iovcnt);
+}
+
 static int remote_write(apacket *p, atransport *t)
 {
-    int   length = p->msg.data_length;
-
-    if(!WriteFdExactly(t->sfd, &p->msg, sizeof(amessage) + length)) {
+    if (!write_packets_gathered(t->sfd, &p, 1)) {
         D("remote local: write terminated");
         return -1;
     }
@@ -97,6 +119,21 @@ static int remote_write(apacket *p, atransport *t)
     return 0;
 }
 
+// Small packets, such as the OKAYs for a busy stream, go out together in one segment.
+static int remote_write_batch(apacket* const* packets, size_t count, atransport* t) {
+    while (count > 0) {
+        size_t n = std::min(count, kMaxWriteBatch);
+        if (!write_packets_gathered(t->sfd, packets, n)) {
+            D("remote local: write terminated");
+            return -1;
+        }
+        packets += n;
+        count -= n;
+    }
+
+    return 0;
+}
+
 bool local_connect(int port) {
     std::string dummy;
     return local_connect_arbitrary_ports(port-1, port, &dummy) == 0;
@@ -529,6 +566,7 @@ int init_socket_transport(atransport *t, int s, int adb_port, int local)
 
     t->SetKickFunction(remote_kick);
     t->SetWriteFunction(remote_write);
+    t->SetWriteBatchFunction(remote_write_batch);
     t->close = remote_close;
     t->read_from_remote = remote_read;
     t->sfd = s;
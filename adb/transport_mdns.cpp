@@ -24,13 +24,23 @@
 #include <arpa/inet.h>
 #endif
 
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <vector>
 
+#include <android-base/file.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/thread_annotations.h>
 #include <dns_sd.h>
 
 #include "adb_mdns.h"
 #include "adb_trace.h"
+#include "adb_utils.h"
 #include "fdevent.h"
 #include "sysdeps.h"
 
@@ -45,6 +55,125 @@ static inline int adb_DNSServiceRefSockFD(DNSServiceRef ref) {
 }
 #define DNSServiceRefSockFD ___xxx_DNSServiceRefSockFD
 
+// The most connections that discovery makes at once. A connection to a device that has gone away
+// can take the whole connect timeout, so with a large pool these must not be made one at a time.
+static constexpr size_t kMaxParallelConnects = 16;
+
+// Services that we've connected to, by name, are remembered in a file so that a restarted server
+// can reconnect to them straight away instead of waiting for every device to be resolved again.
+// Each line is the service name and its address, separated by a tab.
+static std::mutex& connect_mutex = *new std::mutex();
+static auto& service_cache GUARDED_BY(connect_mutex) = *new std::map<std::string, std::string>();
+
+struct PendingConnect {
+    std::string name;
+    // Run on the main thread if the connection fails.
+    std::function<void()> on_failure;
+};
+
+static auto& pending_connects GUARDED_BY(connect_mutex) = *new std::map<std::string, PendingConnect>();
+static auto& connect_queue GUARDED_BY(connect_mutex) = *new std::deque<std::string>();
+static size_t connect_threads GUARDED_BY(connect_mutex) = 0;
+
+static std::string service_cache_path() {
+    return adb_get_android_dir_path() + OS_PATH_SEPARATOR + "adb_mdns_cache";
+}
+
+static void load_service_cache() {
+    std::string content;
+    if (!android::base::ReadFileToString(service_cache_path(), &content)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(connect_mutex);
+    for (const auto& line : android::base::Split(content, "\n")) {
+        std::vector<std::string> fields = android::base::Split(line, "\t");
+        if (fields.size() == 2 && !fields[0].empty() && !fields[1].empty()) {
+            service_cache[fields[0]] = fields[1];
+        }
+    }
+}
+
+static void save_service_cache() REQUIRES(connect_mutex) {
+    std::string content;
+    for (const auto& it : service_cache) {
+        content += it.first + "\t" + it.second + "\n";
+    }
+    if (!android::base::WriteStringToFile(content, service_cache_path())) {
+        D("Could not write mDNS service cache: %s", strerror(errno));
+    }
+}
+
+static void connect_thread() {
+    std::unique_lock<std::mutex> lock(connect_mutex);
+    while (!connect_queue.empty()) {
+        std::string address = std::move(connect_queue.front());
+        connect_queue.pop_front();
+        std::string name = pending_connects[address].name;
+        lock.unlock();
+
+        // Discovery keeps reporting devices that we're already connected to.
+        std::string response;
+        bool connected = find_transport(address.c_str()) != nullptr;
+        if (!connected) {
+            connect_device(address, &response);
+            connected = android::base::StartsWith(response, "connected to") ||
+                        android::base::StartsWith(response, "already connected");
+            D("Connect to %s (%s) : %s", name.c_str(), address.c_str(), response.c_str());
+        }
+
+        lock.lock();
+        PendingConnect pending = std::move(pending_connects[address]);
+        pending_connects.erase(address);
+        auto cached = service_cache.find(name);
+        if (connected) {
+            if (cached == service_cache.end() || cached->second != address) {
+                service_cache[name] = address;
+                save_service_cache();
+            }
+        } else {
+            if (cached != service_cache.end() && cached->second == address) {
+                service_cache.erase(cached);
+                save_service_cache();
+            }
+            if (pending.on_failure) {
+                fdevent_run_on_main_thread(std::move(pending.on_failure));
+            }
+        }
+    }
+    --connect_threads;
+}
+
+// Connects to |address| on a connection thread. Connections already in progress aren't repeated.
+static void queue_connect(const std::string& name, const std::string& address,
+                          std::function<void()> on_failure) {
+    std::lock_guard<std::mutex> lock(connect_mutex);
+    auto it = pending_connects.find(address);
+    if (it != pending_connects.end()) {
+        if (on_failure && !it->second.on_failure) {
+            it->second.on_failure = std::move(on_failure);
+        }
+        return;
+    }
+
+    pending_connects[address] = PendingConnect{name, std::move(on_failure)};
+    connect_queue.push_back(address);
+    if (connect_threads < kMaxParallelConnects) {
+        ++connect_threads;
+        std::thread(connect_thread).detach();
+    }
+}
+
+static bool get_cached_address(const std::string& name, std::string* address) {
+    std::lock_guard<std::mutex> lock(connect_mutex);
+    auto it = service_cache.find(name);
+    if (it == service_cache.end()) {
+        return false;
+    }
+    *address = it->second;
+    return true;
+}
+
 static void DNSSD_API register_service_ip(DNSServiceRef sdRef,
                                           DNSServiceFlags flags,
                                           uint32_t interfaceIndex,
@@ -144,11 +273,7 @@ class ResolvedService : public AsyncServiceRef {
             return;
         }
 
-        std::string response;
-        connect_device(android::base::StringPrintf(addr_format, ip_addr, port_),
-                       &response);
-        D("Connect to %s (%s:%hu) : %s", name_.c_str(), ip_addr, port_,
-          response.c_str());
+        queue_connect(name_, android::base::StringPrintf(addr_format, ip_addr, port_), nullptr);
     }
 
   private:
@@ -240,6 +365,16 @@ static void DNSSD_API register_resolved_mdns_service(DNSServiceRef sdRef,
     }
 }
 
+static void resolve_service(uint32_t interfaceIndex, const char* serviceName,
+                            const char* regtype, const char* domain) {
+    auto discovered = new DiscoveredService(interfaceIndex, serviceName,
+                                            regtype, domain);
+
+    if (! discovered->Initialized()) {
+        delete discovered;
+    }
+}
+
 static void DNSSD_API register_mdns_transport(DNSServiceRef sdRef,
                                               DNSServiceFlags flags,
                                               uint32_t interfaceIndex,
@@ -256,15 +391,34 @@ static void DNSSD_API register_mdns_transport(DNSServiceRef sdRef,
         return;
     }
 
-    auto discovered = new DiscoveredService(interfaceIndex, serviceName,
-                                            regtype, domain);
-
-    if (! discovered->Initialized()) {
-        delete discovered;
+    // A service we've connected to before is tried at its old address first, and only resolved
+    // again if that no longer works.
+    std::string address;
+    if (get_cached_address(serviceName, &address)) {
+        std::string name(serviceName);
+        std::string type(regtype);
+        std::string dom(domain);
+        queue_connect(name, address, [interfaceIndex, name, type, dom]() {
+            resolve_service(interfaceIndex, name.c_str(), type.c_str(), dom.c_str());
+        });
+        return;
     }
+
+    resolve_service(interfaceIndex, serviceName, regtype, domain);
 }
 
 void init_mdns_transport_discovery_thread(void) {
+    // Reconnect to the devices we knew about without waiting for them to be rediscovered.
+    load_service_cache();
+    std::vector<std::pair<std::string, std::string>> cached;
+    {
+        std::lock_guard<std::mutex> lock(connect_mutex);
+        cached.assign(service_cache.begin(), service_cache.end());
+    }
+    for (const auto& it : cached) {
+        queue_connect(it.first, it.second, nullptr);
+    }
+
     DNSServiceErrorType errorCode = DNSServiceBrowse(&service_ref, 0, 0, kADBServiceType, nullptr,
                                                      register_mdns_transport, nullptr);
 
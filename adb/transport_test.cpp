@@ -36,6 +36,44 @@ TEST(transport, kick_transport) {
   ASSERT_EQ(1u, kick_count);
 }
 
+TEST(transport, write_queue) {
+    atransport t;
+    apacket* p1 = get_apacket();
+    apacket* p2 = get_apacket();
+    t.EnqueueWrite(p1);
+    t.EnqueueWrite(p2);
+
+    // Everything queued comes out at once, in order.
+    std::vector<apacket*> packets;
+    t.DequeueWrites(&packets);
+    ASSERT_EQ(2u, packets.size());
+    ASSERT_EQ(p1, packets[0]);
+    ASSERT_EQ(p2, packets[1]);
+
+    static size_t write_count;
+    write_count = 0;
+    t.SetWriteFunction([](apacket*, atransport*) {
+        write_count++;
+        return 0;
+    });
+    ASSERT_EQ(0, t.WriteBatch(packets.data(), packets.size()));
+    ASSERT_EQ(2u, write_count);
+
+    static size_t batch_count;
+    batch_count = 0;
+    t.SetWriteBatchFunction([](apacket* const*, size_t count, atransport*) {
+        batch_count += count;
+        return 0;
+    });
+    ASSERT_EQ(0, t.WriteBatch(packets.data(), packets.size()));
+    ASSERT_EQ(2u, write_count);
+    ASSERT_EQ(2u, batch_count);
+
+    t.EnqueueWrite(p1);
+    t.EnqueueWrite(p2);
+    t.DiscardWrites();
+}
+
 static void DisconnectFunc(void* arg, atransport*) {
     int* count = reinterpret_cast<int*>(arg);
     ++*count;
@@ -52,7 +52,6 @@ static int UsbReadPayload(usb_handle* h, apacket* p) {
     D("UsbReadPayload(%d)", p->msg.data_length);
 
     size_t usb_packet_size = usb_get_max_packet_size(h);
-    CHECK(sizeof(p->data) % usb_packet_size == 0);
 
     // Round the data length up to the nearest packet size boundary.
     // The device won't send a zero packet for packet size aligned payloads,
@@ -62,8 +61,8 @@ static int UsbReadPayload(usb_handle* h, apacket* p) {
     if (rem_size) {
         len += usb_packet_size - rem_size;
     }
-    CHECK(len <= sizeof(p->data));
-    return usb_read(h, &p->data, len);
+    apacket_reserve(p, len);
+    return usb_read(h, p->data, len);
 }
 
 static int remote_read(apacket* p, atransport* t) {
@@ -123,6 +122,7 @@ static int remote_read(apacket *p, atransport *t)
     }
 
     if (p->msg.data_length) {
+        apacket_reserve(p, p->msg.data_length);
         if (usb_read(t->usb, p->data, p->msg.data_length)) {
             PLOG(ERROR) << "remote usb: terminated (data)";
             return -1;
@@ -147,7 +147,7 @@ static int remote_write(apacket *p, atransport *t)
         return -1;
     }
     if (p->msg.data_length == 0) return 0;
-    if (usb_write(t->usb, &p->data, size)) {
+    if (usb_write(t->usb, p->data, size)) {
         PLOG(ERROR) << "remote usb: 2 - write terminated";
         return -1;
     }
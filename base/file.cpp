@@ -78,6 +78,66 @@ bool ReadFileToString(const std::string& path, std::string* content, bool follow
   return ReadFdToString(fd, content);
 }
 
+ssize_t ReadFileToBuffer(const std::string& path, char* buffer, size_t size,
+                         bool follow_symlinks) {
+  int flags = O_RDONLY | O_CLOEXEC | O_BINARY | (follow_symlinks ? 0 : O_NOFOLLOW);
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), flags)));
+  if (fd == -1) {
+    return -1;
+  }
+
+  size_t length = 0;
+  while (true) {
+    // Read one byte more than fits, to tell a full buffer from a file that doesn't fit.
+    char extra;
+    bool full = (length == size);
+    ssize_t n = TEMP_FAILURE_RETRY(full ? read(fd, &extra, 1)
+                                        : read(fd, buffer + length, size - length));
+    if (n == -1) return -1;
+    if (n == 0) return length;
+    if (full) {
+      errno = EFBIG;
+      return -1;
+    }
+    length += n;
+  }
+}
+
+#if !defined(_WIN32)
+CachedFileReader::CachedFileReader(const std::string& path, bool follow_symlinks)
+    : path_(path), flags_(O_RDONLY | O_CLOEXEC | (follow_symlinks ? 0 : O_NOFOLLOW)) {
+}
+
+bool CachedFileReader::Read(std::string_view* content) {
+  if (fd_ == -1) {
+    fd_.reset(TEMP_FAILURE_RETRY(open(path_.c_str(), flags_)));
+    if (fd_ == -1) return false;
+  }
+  if (buffer_.empty()) {
+    // Most /proc and /sys files fit in a page.
+    buffer_.resize(4096);
+  }
+
+  size_t length = 0;
+  while (true) {
+    if (length == buffer_.size()) {
+      buffer_.resize(buffer_.size() * 2);
+    }
+    ssize_t n = TEMP_FAILURE_RETRY(
+        pread(fd_, buffer_.data() + length, buffer_.size() - length, length));
+    if (n == -1) {
+      // The file may have gone away, as sysfs files do with their device.
+      fd_.reset();
+      return false;
+    }
+    if (n == 0) break;
+    length += n;
+  }
+  *content = std::string_view(buffer_.data(), length);
+  return true;
+}
+#endif
+
 bool WriteStringToFd(const std::string& content, int fd) {
   const char* p = content.data();
   size_t left = content.size();
@@ -23,6 +23,7 @@
 #include <unistd.h>
 
 #include <string>
+#include <string_view>
 
 #include "android-base/test_utils.h"
 
@@ -66,6 +67,60 @@ TEST(file, ReadFileToString_WriteStringToFile_symlink) {
 // WriteStringToFile2 is explicitly for setting Unix permissions, which make no
 // sense on Windows.
 #if !defined(_WIN32)
+TEST(file, ReadFileToBuffer) {
+  TemporaryFile tf;
+  ASSERT_TRUE(tf.fd != -1);
+  ASSERT_TRUE(android::base::WriteStringToFile("abc", tf.path));
+
+  char buffer[4];
+  ASSERT_EQ(3, android::base::ReadFileToBuffer(tf.path, buffer, sizeof(buffer)));
+  EXPECT_EQ("abc", std::string(buffer, 3));
+  ASSERT_EQ(3, android::base::ReadFileToBuffer(tf.path, buffer, 3));
+
+  errno = 0;
+  ASSERT_EQ(-1, android::base::ReadFileToBuffer(tf.path, buffer, 2));
+  EXPECT_EQ(EFBIG, errno);
+
+  errno = 0;
+  ASSERT_EQ(-1, android::base::ReadFileToBuffer("/proc/does-not-exist", buffer, sizeof(buffer)));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+TEST(file, CachedFileReader) {
+  TemporaryFile tf;
+  ASSERT_TRUE(tf.fd != -1);
+  ASSERT_TRUE(android::base::WriteStringToFd("abc", tf.fd));
+
+  android::base::CachedFileReader reader(tf.path);
+  std::string_view content;
+  ASSERT_TRUE(reader.Read(&content));
+  EXPECT_EQ("abc", content);
+
+  // Rewritten in place, and grown past the initial buffer.
+  std::string big(10000, 'x');
+  ASSERT_EQ(0, ftruncate(tf.fd, 0));
+  ASSERT_EQ(0, lseek(tf.fd, 0, SEEK_SET));
+  ASSERT_TRUE(android::base::WriteStringToFd(big, tf.fd));
+  ASSERT_TRUE(reader.Read(&content));
+  EXPECT_EQ(big, content);
+
+  ASSERT_EQ(0, ftruncate(tf.fd, 1));
+  ASSERT_TRUE(reader.Read(&content));
+  EXPECT_EQ("x", content);
+}
+
+TEST(file, CachedFileReader_proc) {
+  android::base::CachedFileReader reader("/proc/self/stat");
+  std::string_view content;
+  ASSERT_TRUE(reader.Read(&content));
+  std::string expected;
+  ASSERT_TRUE(android::base::ReadFileToString("/proc/self/stat", &expected));
+  EXPECT_EQ(expected.substr(0, expected.find(' ')), content.substr(0, content.find(' ')));
+
+  android::base::CachedFileReader missing("/proc/does-not-exist");
+  ASSERT_FALSE(missing.Read(&content));
+}
+
 TEST(file, WriteStringToFile2) {
   TemporaryFile tf;
   ASSERT_TRUE(tf.fd != -1);
@@ -18,7 +18,14 @@
 #define ANDROID_BASE_FILE_H
 
 #include <sys/stat.h>
+#include <sys/types.h>
+
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "android-base/macros.h"
+#include "android-base/unique_fd.h"
 
 #if !defined(_WIN32) && !defined(O_BINARY)
 #define O_BINARY 0
@@ -31,6 +38,12 @@ bool ReadFdToString(int fd, std::string* content);
 bool ReadFileToString(const std::string& path, std::string* content,
                       bool follow_symlinks = false);
 
+// Reads the whole of a file into the caller's `buffer` of `size` bytes, without allocating.
+// Returns the number of bytes read, or -1 on failure, with errno set to EFBIG if the file
+// doesn't fit.
+ssize_t ReadFileToBuffer(const std::string& path, char* buffer, size_t size,
+                         bool follow_symlinks = false);
+
 bool WriteStringToFile(const std::string& content, const std::string& path,
                        bool follow_symlinks = false);
 bool WriteStringToFd(const std::string& content, int fd);
@@ -51,6 +64,29 @@ bool Realpath(const std::string& path, std::string* result);
 bool Readlink(const std::string& path, std::string* result);
 #endif
 
+#if !defined(_WIN32)
+// Reads the same file over and over, as daemons polling /proc and /sys files do, without
+// reopening it each time: the file is kept open and read again with pread() from offset 0,
+// which makes procfs and sysfs files generate their contents afresh, into a buffer that is
+// reused from one read to the next.
+class CachedFileReader {
+ public:
+  explicit CachedFileReader(const std::string& path, bool follow_symlinks = false);
+
+  // Reads the whole file, and points `content` at it until the next Read(). Returns false on
+  // failure, after which the next Read() reopens the file.
+  bool Read(std::string_view* content);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CachedFileReader);
+
+  const std::string path_;
+  const int flags_;
+  unique_fd fd_;
+  std::vector<char> buffer_;
+};
+#endif
+
 std::string GetExecutablePath();
 std::string GetExecutableDirectory();
 
@@ -57,6 +57,9 @@
 #endif
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <functional>
 #include <memory>
 #include <ostream>
@@ -106,6 +109,38 @@ class LogdLogger {
 };
 #endif
 
+// Wraps another logger so that logging only copies the message into a bounded
+// queue, and a thread of its own passes it on. Use it for processes that must
+// not stall on a slow log sink:
+//
+//   SetLogger(AsyncLogger(LogdLogger()));
+//
+// Queueing never blocks: a message that finds the queue full is dropped, and
+// the number dropped is logged with the next message that gets through. FATAL
+// and FATAL_WITHOUT_ABORT messages are not queued; they wait for the queue to
+// drain and are written by the caller, so they are out before any abort. The
+// queue is also drained at exit. In a child forked after the logger was made,
+// where its thread does not exist, messages are written by the caller.
+class AsyncLogger {
+ public:
+  // `capacity` is rounded up to a power of two.
+  explicit AsyncLogger(LogFunction&& logger, size_t capacity = 256);
+
+  void operator()(LogId, LogSeverity, const char* tag, const char* file,
+                  unsigned int line, const char* message);
+
+  // Blocks until every message queued so far has been written.
+  void Flush();
+
+  // Returns the number of messages dropped because the queue was full.
+  uint64_t GetDroppedCount() const;
+
+ private:
+  struct State;
+  // Shared by the copies that std::function makes.
+  std::shared_ptr<State> state_;
+};
+
 // Configure logging based on ANDROID_LOG_TAGS environment variable.
 // We need to parse a string that looks like
 //
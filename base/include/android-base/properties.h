@@ -26,6 +26,8 @@
 #include <chrono>
 #include <limits>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace android {
 namespace base {
@@ -59,6 +61,12 @@ template <typename T> T GetUintProperty(const std::string& key,
 // tell you whether or not your call succeeded. A `false` return value definitely means failure.
 bool SetProperty(const std::string& key, const std::string& value);
 
+// Sets each of the `properties` (pairs of key and value) in a single request to init.
+// Either all of them are set or, if any of them couldn't be, none are, with the exception of a
+// failure to add a new property once the property area is full.
+// Returns true on success, false on failure.
+bool SetProperties(const std::vector<std::pair<std::string, std::string>>& properties);
+
 // Waits for the system property `key` to have the value `expected_value`.
 // Times out after `relative_timeout`.
 // Returns true on success, false on timeout.
@@ -71,6 +79,14 @@ bool WaitForProperty(const std::string& key, const std::string& expected_value,
 bool WaitForPropertyCreation(const std::string& key, std::chrono::milliseconds relative_timeout =
                                                          std::chrono::milliseconds::max());
 
+// Waits for each of the system `properties` (pairs of key and expected value) to have its
+// expected value, creating it first if need be, in a single wait on every property change.
+// Times out after `relative_timeout`.
+// Returns true on success, false on timeout.
+bool WaitForProperties(const std::vector<std::pair<std::string, std::string>>& properties,
+                       std::chrono::milliseconds relative_timeout =
+                           std::chrono::milliseconds::max());
+
 } // namespace base
 } // namespace android
 
@@ -17,8 +17,13 @@
 #ifndef ANDROID_BASE_STRINGS_H
 #define ANDROID_BASE_STRINGS_H
 
+#include <stddef.h>
+
+#include <iterator>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 namespace android {
@@ -32,22 +37,130 @@ namespace base {
 std::vector<std::string> Split(const std::string& s,
                                const std::string& delimiters);
 
+// Splits a string like Split(), without copying anything: iterating over a SplitView yields
+// each piece as a std::string_view into `s`, which must outlive it.
+//
+//   for (std::string_view field : SplitView(line, " \t")) { ... }
+//
+// An empty delimiter list yields `s` whole.
+class SplitView {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = ptrdiff_t;
+    using pointer = const std::string_view*;
+    using reference = const std::string_view&;
+
+    iterator() : at_end_(true), last_(true) {}
+
+    reference operator*() const { return piece_; }
+    pointer operator->() const { return &piece_; }
+
+    iterator& operator++() {
+      if (last_) {
+        at_end_ = true;
+      } else {
+        Find();
+      }
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator result = *this;
+      ++*this;
+      return result;
+    }
+
+    bool operator==(const iterator& other) const {
+      return at_end_ == other.at_end_ && (at_end_ || piece_.data() == other.piece_.data());
+    }
+    bool operator!=(const iterator& other) const { return !(*this == other); }
+
+   private:
+    friend class SplitView;
+
+    iterator(std::string_view s, std::string_view delimiters)
+        : rest_(s), delimiters_(delimiters), at_end_(false), last_(false) {
+      Find();
+    }
+
+    void Find() {
+      // A single delimiter, the common case, can be found with memchr().
+      size_t found = delimiters_.size() == 1 ? rest_.find(delimiters_[0])
+                                             : rest_.find_first_of(delimiters_);
+      piece_ = rest_.substr(0, found);
+      if (found == rest_.npos) {
+        last_ = true;
+      } else {
+        rest_.remove_prefix(found + 1);
+      }
+    }
+
+    std::string_view piece_;
+    std::string_view rest_;
+    std::string_view delimiters_;
+    bool at_end_;
+    bool last_;
+  };
+
+  SplitView(std::string_view s, std::string_view delimiters) : s_(s), delimiters_(delimiters) {}
+
+  iterator begin() const { return iterator(s_, delimiters_); }
+  iterator end() const { return iterator(); }
+
+ private:
+  std::string_view s_;
+  std::string_view delimiters_;
+};
+
 // Trims whitespace off both ends of the given string.
 std::string Trim(const std::string& s);
 
+// Like Trim(), returning a std::string_view into `s`.
+std::string_view TrimView(std::string_view s);
+
 // Joins a container of things into a single string, using the given separator.
+//
+// Things that convert to std::string_view are appended directly, into a string sized up front;
+// anything else is formatted with operator<<.
 template <typename ContainerT, typename SeparatorT>
 std::string Join(const ContainerT& things, SeparatorT separator) {
   if (things.empty()) {
     return "";
   }
 
-  std::ostringstream result;
-  result << *things.begin();
-  for (auto it = std::next(things.begin()); it != things.end(); ++it) {
-    result << separator << *it;
+  if constexpr (std::is_convertible_v<decltype(*things.begin()), std::string_view>) {
+    std::string_view separator_view;
+    char separator_char = '\0';
+    if constexpr (std::is_convertible_v<SeparatorT, std::string_view>) {
+      separator_view = separator;
+    } else {
+      separator_char = separator;
+      separator_view = std::string_view(&separator_char, 1);
+    }
+
+    size_t length = 0;
+    for (const auto& thing : things) {
+      length += std::string_view(thing).size() + separator_view.size();
+    }
+
+    std::string result;
+    result.reserve(length - separator_view.size());
+    result.append(std::string_view(*things.begin()));
+    for (auto it = std::next(things.begin()); it != things.end(); ++it) {
+      result.append(separator_view);
+      result.append(std::string_view(*it));
+    }
+    return result;
+  } else {
+    std::ostringstream result;
+    result << *things.begin();
+    for (auto it = std::next(things.begin()); it != things.end(); ++it) {
+      result << separator << *it;
+    }
+    return result.str();
   }
-  return result.str();
 }
 
 // We instantiate the common cases in strings.cpp.
@@ -57,15 +170,15 @@ extern template std::string Join(const std::vector<std::string>&, const std::str
 extern template std::string Join(const std::vector<const char*>&, const std::string&);
 
 // Tests whether 's' starts with 'prefix'.
-bool StartsWith(const std::string& s, const char* prefix);
-bool StartsWithIgnoreCase(const std::string& s, const char* prefix);
+bool StartsWith(std::string_view s, std::string_view prefix);
+bool StartsWithIgnoreCase(std::string_view s, std::string_view prefix);
 
 // Tests whether 's' ends with 'suffix'.
-bool EndsWith(const std::string& s, const char* suffix);
-bool EndsWithIgnoreCase(const std::string& s, const char* suffix);
+bool EndsWith(std::string_view s, std::string_view suffix);
+bool EndsWithIgnoreCase(std::string_view s, std::string_view suffix);
 
 // Tests whether 'lhs' equals 'rhs', ignoring case.
-bool EqualsIgnoreCase(const std::string& lhs, const std::string& rhs);
+bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs);
 
 }  // namespace base
 }  // namespace android
@@ -35,11 +35,15 @@
 #include <sys/uio.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
 #include <limits>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -255,6 +259,238 @@ void LogdLogger::operator()(LogId id, LogSeverity severity, const char* tag,
 }
 #endif
 
+struct AsyncLogger::State {
+  // A slot's sequence is its index while it is free for the producer that
+  // claims that position, and position + 1 once the message is in. Strings
+  // keep their capacity, so a queue that has warmed up no longer allocates.
+  struct Slot {
+    std::atomic<size_t> sequence;
+    LogId id;
+    LogSeverity severity;
+    std::string tag;
+    std::string file;
+    unsigned int line;
+    std::string message;
+  };
+
+  State(LogFunction&& logger, size_t capacity);
+  ~State();
+
+  bool Enqueue(LogId id, LogSeverity severity, const char* tag, const char* file,
+               unsigned int line, const char* message);
+  void Flush();
+  void Run();
+
+  // The live loggers, whose queues get drained at exit.
+  static std::mutex& RegistryLock();
+  static std::vector<State*>& Registry();
+  static void FlushAll();
+
+  const LogFunction logger;
+  const size_t mask;
+  std::unique_ptr<Slot[]> slots;
+  const pid_t pid;
+
+  std::atomic<size_t> enqueue_pos;
+  std::atomic<size_t> written;
+  std::atomic<uint64_t> dropped;
+  // Set while the thread is asleep, or about to sleep, on `wake`.
+  std::atomic<bool> sleeping;
+  // Callers blocked in Flush(), whom the thread must tell about progress.
+  std::atomic<int> flushing;
+
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable progress;
+  bool exiting;  // guarded by lock
+
+  std::thread thread;
+};
+
+static size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t result = 2;
+  while (result < n) result <<= 1;
+  return result;
+}
+
+AsyncLogger::State::State(LogFunction&& logger, size_t capacity)
+    : logger(std::move(logger)),
+      mask(RoundUpToPowerOfTwo(capacity) - 1),
+      slots(new Slot[mask + 1]),
+      pid(getpid()),
+      enqueue_pos(0),
+      written(0),
+      dropped(0),
+      sleeping(false),
+      flushing(0),
+      exiting(false) {
+  for (size_t i = 0; i <= mask; ++i) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  thread = std::thread(&State::Run, this);
+
+  std::lock_guard<std::mutex> guard(RegistryLock());
+  static bool flush_at_exit = false;
+  if (!flush_at_exit) {
+    atexit(FlushAll);
+    flush_at_exit = true;
+  }
+  Registry().push_back(this);
+}
+
+AsyncLogger::State::~State() {
+  {
+    std::lock_guard<std::mutex> guard(RegistryLock());
+    auto& registry = Registry();
+    registry.erase(std::find(registry.begin(), registry.end(), this));
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    exiting = true;
+  }
+  wake.notify_one();
+  thread.join();
+}
+
+bool AsyncLogger::State::Enqueue(LogId id, LogSeverity severity, const char* tag,
+                                 const char* file, unsigned int line, const char* message) {
+  size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+  Slot* slot;
+  while (true) {
+    slot = &slots[pos & mask];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The thread has not written this slot's previous message yet.
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->id = id;
+  slot->severity = severity;
+  slot->tag.assign(tag != nullptr ? tag : "");
+  slot->file.assign(file != nullptr ? file : "");
+  slot->line = line;
+  slot->message.assign(message);
+  // Sequentially consistent with the check of `sleeping`, which the thread
+  // sets before it looks at the queue one last time.
+  slot->sequence.store(pos + 1);
+  if (sleeping.load()) {
+    std::lock_guard<std::mutex> guard(lock);
+    wake.notify_one();
+  }
+  return true;
+}
+
+void AsyncLogger::State::Flush() {
+  if (std::this_thread::get_id() == thread.get_id()) {
+    // Logged by the wrapped logger itself; the queue can't drain under it.
+    return;
+  }
+  size_t target = enqueue_pos.load();
+  flushing++;
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    progress.wait(guard, [this, target]() { return written.load() >= target; });
+  }
+  flushing--;
+}
+
+std::mutex& AsyncLogger::State::RegistryLock() {
+  static auto& registry_lock = *new std::mutex();
+  return registry_lock;
+}
+
+std::vector<AsyncLogger::State*>& AsyncLogger::State::Registry() {
+  static auto& registry = *new std::vector<State*>();
+  return registry;
+}
+
+void AsyncLogger::State::FlushAll() {
+  std::lock_guard<std::mutex> guard(RegistryLock());
+  for (State* state : Registry()) {
+    if (state->pid == getpid()) {
+      state->Flush();
+    }
+  }
+}
+
+void AsyncLogger::State::Run() {
+  size_t pos = 0;
+  uint64_t reported_dropped = 0;
+  while (true) {
+    Slot* slot = &slots[pos & mask];
+    if (slot->sequence.load(std::memory_order_acquire) != pos + 1) {
+      std::unique_lock<std::mutex> guard(lock);
+      progress.notify_all();
+      sleeping.store(true);
+      while (slot->sequence.load() != pos + 1 && !exiting) {
+        wake.wait(guard);
+      }
+      sleeping.store(false);
+      if (slot->sequence.load() != pos + 1) {
+        // Exiting, with the queue drained.
+        return;
+      }
+    }
+
+    uint64_t now_dropped = dropped.load(std::memory_order_relaxed);
+    if (now_dropped != reported_dropped) {
+      std::string dropped_message = std::to_string(now_dropped - reported_dropped) +
+                                    " log messages dropped: queue full";
+      logger(slot->id, WARNING, slot->tag.c_str(), slot->file.c_str(), slot->line,
+             dropped_message.c_str());
+      reported_dropped = now_dropped;
+    }
+    logger(slot->id, slot->severity, slot->tag.c_str(), slot->file.c_str(), slot->line,
+           slot->message.c_str());
+    slot->sequence.store(pos + mask + 1, std::memory_order_release);
+    ++pos;
+
+    written.store(pos);
+    if (flushing.load() != 0) {
+      std::lock_guard<std::mutex> guard(lock);
+      progress.notify_all();
+    }
+  }
+}
+
+AsyncLogger::AsyncLogger(LogFunction&& logger, size_t capacity)
+    : state_(std::make_shared<State>(std::move(logger), capacity)) {
+}
+
+void AsyncLogger::operator()(LogId id, LogSeverity severity, const char* tag,
+                             const char* file, unsigned int line, const char* message) {
+  if (state_->pid != getpid()) {
+    // A forked child has no thread to drain the queue.
+    state_->logger(id, severity, tag, file, line, message);
+    return;
+  }
+  if (severity >= FATAL_WITHOUT_ABORT) {
+    state_->Flush();
+    state_->logger(id, severity, tag, file, line, message);
+    return;
+  }
+  state_->Enqueue(id, severity, tag, file, line, message);
+}
+
+void AsyncLogger::Flush() {
+  if (state_->pid == getpid()) {
+    state_->Flush();
+  }
+}
+
+uint64_t AsyncLogger::GetDroppedCount() const {
+  return state_->dropped.load(std::memory_order_relaxed);
+}
+
 void InitLogging(char* argv[], LogFunction&& logger, AbortFunction&& aborter) {
   SetLogger(std::forward<LogFunction>(logger));
   SetAborter(std::forward<AbortFunction>(aborter));
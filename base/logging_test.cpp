@@ -22,8 +22,11 @@
 #include <signal.h>
 #endif
 
+#include <algorithm>
+#include <mutex>
 #include <regex>
 #include <string>
+#include <vector>
 
 #include "android-base/file.h"
 #include "android-base/stringprintf.h"
@@ -598,3 +601,53 @@ TEST(logging, LOG_FATAL_ABORTER_MESSAGE) {
 __attribute__((constructor)) void TestLoggingInConstructor() {
   LOG(ERROR) << "foobar";
 }
+
+TEST(logging, AsyncLogger) {
+  std::vector<std::string> messages;
+  android::base::AsyncLogger logger(
+      [&messages](android::base::LogId, android::base::LogSeverity, const char*, const char*,
+                  unsigned int, const char* message) { messages.push_back(message); },
+      4);
+  for (int i = 0; i < 100; ++i) {
+    logger(android::base::DEFAULT, android::base::INFO, "tag", __FILE__, __LINE__,
+           std::to_string(i).c_str());
+    // Never more than the capacity queued, so nothing is dropped.
+    if (i % 4 == 3) logger.Flush();
+  }
+  logger.Flush();
+  ASSERT_EQ(100U, messages.size());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(std::to_string(i), messages[i]);
+  }
+  EXPECT_EQ(0U, logger.GetDroppedCount());
+}
+
+TEST(logging, AsyncLogger_drops_when_full) {
+  std::mutex sink_lock;
+  std::vector<std::string> messages;
+  std::unique_lock<std::mutex> blocked(sink_lock);
+  android::base::AsyncLogger logger(
+      [&](android::base::LogId, android::base::LogSeverity, const char*, const char*,
+          unsigned int, const char* message) {
+        std::lock_guard<std::mutex> guard(sink_lock);
+        messages.push_back(message);
+      },
+      4);
+  // The first message may already be taken off the queue, and held up in the
+  // sink, so at most 5 get through.
+  for (int i = 0; i < 20; ++i) {
+    logger(android::base::DEFAULT, android::base::INFO, "tag", __FILE__, __LINE__, "queued");
+  }
+  EXPECT_GE(logger.GetDroppedCount(), 15U);
+  blocked.unlock();
+
+  // FATAL_WITHOUT_ABORT waits for the queue, so it is written last.
+  logger(android::base::DEFAULT, android::base::FATAL_WITHOUT_ABORT, "tag", __FILE__, __LINE__,
+         "fatal");
+  ASSERT_FALSE(messages.empty());
+  EXPECT_EQ("fatal", messages.back());
+  EXPECT_EQ(1U, std::count_if(messages.begin(), messages.end(), [](const std::string& m) {
+              return m.find("log messages dropped") != std::string::npos;
+            }));
+  EXPECT_EQ(20U - logger.GetDroppedCount() + 2U, messages.size());
+}
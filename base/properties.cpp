@@ -18,22 +18,66 @@
 
 #include "android-base/properties.h"
 
+#include <stdio.h>
+#include <sys/socket.h>
 #include <sys/system_properties.h>
 #include <sys/_system_properties.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <string>
 
+#include <android-base/file.h>
 #include <android-base/parseint.h>
+#include <android-base/unique_fd.h>
 
 using namespace std::chrono_literals;
 
 namespace android {
 namespace base {
 
+// Callers look up the same few properties over and over, and each __system_property_find()
+// walks a trie spread across the property areas. A prop_info never moves or goes away once
+// it exists, so remember the ones that have been found. Values are still read through
+// __system_property_read(), which follows the property's serial, so updates are always seen.
+//
+// Entries are only ever added, each with a single compare-and-swap, so lookups never take a
+// lock. Missing properties aren't remembered, since they may be created later. Keys that don't
+// fit in the table within a few probes fall back to __system_property_find() every time.
+struct FoundProperty {
+  const std::string name;
+  const prop_info* const pi;
+};
+
+static constexpr size_t kFoundPropertiesSize = 512;  // Must be a power of two.
+static constexpr size_t kMaxProbes = 8;
+static std::atomic<FoundProperty*> found_properties[kFoundPropertiesSize];
+
+static const prop_info* FindProperty(const std::string& key) {
+  size_t hash = std::hash<std::string>()(key);
+  for (size_t i = 0; i < kMaxProbes; ++i) {
+    auto& slot = found_properties[(hash + i) & (kFoundPropertiesSize - 1)];
+    FoundProperty* found = slot.load(std::memory_order_acquire);
+    if (found == nullptr) {
+      const prop_info* pi = __system_property_find(key.c_str());
+      if (pi == nullptr) return nullptr;
+
+      FoundProperty* entry = new FoundProperty{key, pi};
+      if (slot.compare_exchange_strong(found, entry, std::memory_order_acq_rel)) return pi;
+      // Another thread got this slot first; |found| is now its entry.
+      delete entry;
+    }
+    if (found->name == key) return found->pi;
+  }
+  return __system_property_find(key.c_str());
+}
+
 std::string GetProperty(const std::string& key, const std::string& default_value) {
-  const prop_info* pi = __system_property_find(key.c_str());
+  const prop_info* pi = FindProperty(key);
   if (pi == nullptr) return default_value;
 
   char buf[PROP_VALUE_MAX];
@@ -85,6 +129,39 @@ bool SetProperty(const std::string& key, const std::string& value) {
   return (__system_property_set(key.c_str(), value.c_str()) == 0);
 }
 
+// See init's property_service.cpp, which this must match.
+static constexpr uint32_t kPropMsgSetPropBatch = 0x00020002;
+
+static void AppendUint32(std::string* out, uint32_t value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+bool SetProperties(const std::vector<std::pair<std::string, std::string>>& properties) {
+  std::string request;
+  AppendUint32(&request, kPropMsgSetPropBatch);
+  AppendUint32(&request, properties.size());
+  for (const auto& [key, value] : properties) {
+    AppendUint32(&request, key.size());
+    request.append(key);
+    AppendUint32(&request, value.size());
+    request.append(value);
+  }
+
+  unique_fd fd(socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (fd == -1) return false;
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_LOCAL;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "/dev/socket/%s", PROP_SERVICE_NAME);
+  if (TEMP_FAILURE_RETRY(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) == -1) {
+    return false;
+  }
+
+  uint32_t result;
+  return WriteFully(fd, request.data(), request.size()) &&
+         ReadFully(fd, &result, sizeof(result)) && result == PROP_SUCCESS;
+}
+
 struct WaitForPropertyData {
   bool done;
   const std::string* expected_value;
@@ -133,7 +210,7 @@ static const prop_info* WaitForPropertyCreation(const std::string& key,
   // Find the property's prop_info*.
   const prop_info* pi;
   unsigned global_serial = 0;
-  while ((pi = __system_property_find(key.c_str())) == nullptr) {
+  while ((pi = FindProperty(key)) == nullptr) {
     // The property doesn't even exist yet.
     // Wait for a global change and then look again.
     timespec ts;
@@ -171,5 +248,34 @@ bool WaitForPropertyCreation(const std::string& key,
   return (WaitForPropertyCreation(key, relative_timeout, start_time) != nullptr);
 }
 
+static bool HasValue(const std::string& key, const std::string& expected_value) {
+  const prop_info* pi = FindProperty(key);
+  if (pi == nullptr) return false;
+
+  WaitForPropertyData data;
+  data.expected_value = &expected_value;
+  data.done = false;
+  __system_property_read_callback(pi, WaitForPropertyCallback, &data);
+  return data.done;
+}
+
+bool WaitForProperties(const std::vector<std::pair<std::string, std::string>>& properties,
+                       std::chrono::milliseconds relative_timeout) {
+  auto start_time = std::chrono::steady_clock::now();
+  // Any property being added or changed bumps the global serial, so read it before checking
+  // the values: a change made after the check is then sure to end the wait.
+  unsigned global_serial = __system_property_area_serial();
+  while (true) {
+    bool done = std::all_of(properties.begin(), properties.end(), [](const auto& property) {
+      return HasValue(property.first, property.second);
+    });
+    if (done) return true;
+
+    timespec ts;
+    UpdateTimeSpec(ts, relative_timeout, start_time);
+    if (!__system_property_wait(nullptr, global_serial, &global_serial, &ts)) return false;
+  }
+}
+
 }  // namespace base
 }  // namespace android
@@ -22,6 +22,7 @@
 #include <chrono>
 #include <string>
 #include <thread>
+#include <vector>
 
 using namespace std::chrono_literals;
 
@@ -51,6 +52,44 @@ TEST(properties, empty) {
   ASSERT_EQ("default", s);
 }
 
+TEST(properties, concurrent_readers) {
+  android::base::SetProperty("debug.libbase.property_test", "0");
+
+  // Readers racing to remember the same property must all see it, and keep seeing updates.
+  std::atomic<bool> stop(false);
+  std::atomic<int> bad_reads(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&stop, &bad_reads]() {
+      while (!stop) {
+        std::string s = android::base::GetProperty("debug.libbase.property_test", "missing");
+        if (s != "0" && s != "1") ++bad_reads;
+      }
+    });
+  }
+
+  android::base::SetProperty("debug.libbase.property_test", "1");
+  ASSERT_TRUE(android::base::WaitForProperty("debug.libbase.property_test", "1", 1s));
+  std::this_thread::sleep_for(10ms);
+  ASSERT_EQ("1", android::base::GetProperty("debug.libbase.property_test", ""));
+
+  stop = true;
+  for (auto& reader : readers) reader.join();
+  ASSERT_EQ(0, bad_reads);
+}
+
+TEST(properties, SetProperties) {
+  ASSERT_TRUE(android::base::SetProperties({{"debug.libbase.property_test", "batch1"},
+                                            {"debug.libbase.property_test2", "batch2"}}));
+  ASSERT_TRUE(android::base::WaitForProperty("debug.libbase.property_test", "batch1", 1s));
+  ASSERT_TRUE(android::base::WaitForProperty("debug.libbase.property_test2", "batch2", 1s));
+
+  // A property that can't be set stops the whole batch from being set.
+  ASSERT_FALSE(android::base::SetProperties({{"debug.libbase.property_test", "batch3"},
+                                             {"ro.build.fingerprint", "batch3"}}));
+  ASSERT_EQ("batch1", android::base::GetProperty("debug.libbase.property_test", ""));
+}
+
 static void CheckGetBoolProperty(bool expected, const std::string& value, bool default_value) {
   android::base::SetProperty("debug.libbase.property_test", value.c_str());
   ASSERT_EQ(expected, android::base::GetBoolProperty("debug.libbase.property_test", default_value));
@@ -204,3 +243,38 @@ TEST(properties, WaitForPropertyCreation_timeout) {
   // Upper bounds on timing are inherently flaky, but let's try...
   ASSERT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0), 600ms);
 }
+
+TEST(properties, WaitForProperties) {
+  android::base::SetProperty("debug.libbase.WaitForProperties_test1", "");
+  android::base::SetProperty("debug.libbase.WaitForProperties_test2", "");
+  std::atomic<bool> flag{false};
+  std::thread thread([&]() {
+    std::this_thread::sleep_for(100ms);
+    android::base::SetProperty("debug.libbase.WaitForProperties_test1", "a");
+    while (!flag) std::this_thread::yield();
+    std::this_thread::sleep_for(100ms);
+    android::base::SetProperty("debug.libbase.WaitForProperties_test2", "b");
+  });
+
+  ASSERT_TRUE(android::base::WaitForProperty("debug.libbase.WaitForProperties_test1", "a", 1s));
+  flag = true;
+  ASSERT_TRUE(android::base::WaitForProperties({{"debug.libbase.WaitForProperties_test1", "a"},
+                                                {"debug.libbase.WaitForProperties_test2", "b"}},
+                                               1s));
+  thread.join();
+  ASSERT_TRUE(android::base::WaitForProperties({}, 0ms));
+}
+
+TEST(properties, WaitForProperties_timeout) {
+  android::base::SetProperty("debug.libbase.WaitForProperties_test1", "a");
+  auto t0 = std::chrono::steady_clock::now();
+  ASSERT_FALSE(android::base::WaitForProperties(
+      {{"debug.libbase.WaitForProperties_test1", "a"},
+       {"debug.libbase.WaitForProperties_timeout_test", "a"}},
+      200ms));
+  auto t1 = std::chrono::steady_clock::now();
+
+  ASSERT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0), 200ms);
+  // Upper bounds on timing are inherently flaky, but let's try...
+  ASSERT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0), 600ms);
+}
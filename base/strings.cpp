@@ -16,8 +16,8 @@
 
 #include "android-base/strings.h"
 
+#include <ctype.h>
 #include <stdlib.h>
-#include <string.h>
 
 #include <string>
 #include <vector>
@@ -33,51 +33,31 @@ std::vector<std::string> Split(const std::string& s,
   CHECK_NE(delimiters.size(), 0U);
 
   std::vector<std::string> result;
-
-  size_t base = 0;
-  size_t found;
-  while (true) {
-    found = s.find_first_of(delimiters, base);
-    result.push_back(s.substr(base, found - base));
-    if (found == s.npos) break;
-    base = found + 1;
+  for (std::string_view piece : SplitView(s, delimiters)) {
+    result.emplace_back(piece);
   }
-
   return result;
 }
 
 std::string Trim(const std::string& s) {
-  std::string result;
-
-  if (s.size() == 0) {
-    return result;
-  }
+  return std::string(TrimView(s));
+}
 
+std::string_view TrimView(std::string_view s) {
   size_t start_index = 0;
-  size_t end_index = s.size() - 1;
+  size_t end_index = s.size();
 
   // Skip initial whitespace.
-  while (start_index < s.size()) {
-    if (!isspace(s[start_index])) {
-      break;
-    }
+  while (start_index < end_index && isspace(s[start_index])) {
     start_index++;
   }
 
   // Skip terminating whitespace.
-  while (end_index >= start_index) {
-    if (!isspace(s[end_index])) {
-      break;
-    }
+  while (end_index > start_index && isspace(s[end_index - 1])) {
     end_index--;
   }
 
-  // All spaces, no beef.
-  if (end_index < start_index) {
-    return "";
-  }
-  // Start_index is the first non-space, end_index is the last one.
-  return s.substr(start_index, end_index - start_index + 1);
+  return s.substr(start_index, end_index - start_index);
 }
 
 // These cases are probably the norm, so we mark them extern in the header to
@@ -87,34 +67,36 @@ template std::string Join(const std::vector<const char*>&, char);
 template std::string Join(const std::vector<std::string>&, const std::string&);
 template std::string Join(const std::vector<const char*>&, const std::string&);
 
-bool StartsWith(const std::string& s, const char* prefix) {
-  return strncmp(s.c_str(), prefix, strlen(prefix)) == 0;
+bool StartsWith(std::string_view s, std::string_view prefix) {
+  return s.substr(0, prefix.size()) == prefix;
 }
 
-bool StartsWithIgnoreCase(const std::string& s, const char* prefix) {
-  return strncasecmp(s.c_str(), prefix, strlen(prefix)) == 0;
+// Unlike strncasecmp(), doesn't stop at a nul.
+static bool EqualsIgnoreCase(const char* lhs, const char* rhs, size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    if (tolower(static_cast<unsigned char>(lhs[i])) !=
+        tolower(static_cast<unsigned char>(rhs[i]))) {
+      return false;
+    }
+  }
+  return true;
 }
 
-static bool EndsWith(const std::string& s, const char* suffix, bool case_sensitive) {
-  size_t suffix_length = strlen(suffix);
-  size_t string_length = s.size();
-  if (suffix_length > string_length) {
-    return false;
-  }
-  size_t offset = string_length - suffix_length;
-  return (case_sensitive ? strncmp : strncasecmp)(s.c_str() + offset, suffix, suffix_length) == 0;
+bool StartsWithIgnoreCase(std::string_view s, std::string_view prefix) {
+  return s.size() >= prefix.size() && EqualsIgnoreCase(s.data(), prefix.data(), prefix.size());
 }
 
-bool EndsWith(const std::string& s, const char* suffix) {
-  return EndsWith(s, suffix, true);
+bool EndsWith(std::string_view s, std::string_view suffix) {
+  return s.size() >= suffix.size() && s.substr(s.size() - suffix.size()) == suffix;
 }
 
-bool EndsWithIgnoreCase(const std::string& s, const char* suffix) {
-  return EndsWith(s, suffix, false);
+bool EndsWithIgnoreCase(std::string_view s, std::string_view suffix) {
+  return s.size() >= suffix.size() &&
+         EqualsIgnoreCase(s.data() + s.size() - suffix.size(), suffix.data(), suffix.size());
 }
 
-bool EqualsIgnoreCase(const std::string& lhs, const std::string& rhs) {
-  return strcasecmp(lhs.c_str(), rhs.c_str()) == 0;
+bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs) {
+  return lhs.size() == rhs.size() && EqualsIgnoreCase(lhs.data(), rhs.data(), lhs.size());
 }
 
 }  // namespace base
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "android-base/strings.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+// A line like init's parser splits.
+static const std::string kLine =
+    "service vold /system/bin/vold --blkid_context=u:r:blkid:s0 --fsck_context=u:r:fsck:s0";
+
+static void BM_Split(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    size_t length = 0;
+    for (const std::string& piece : android::base::Split(kLine, " ")) {
+      length += piece.size();
+    }
+    benchmark::DoNotOptimize(length);
+  }
+}
+BENCHMARK(BM_Split);
+
+static void BM_SplitView(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    size_t length = 0;
+    for (std::string_view piece : android::base::SplitView(kLine, " ")) {
+      length += piece.size();
+    }
+    benchmark::DoNotOptimize(length);
+  }
+}
+BENCHMARK(BM_SplitView);
+
+static const std::string kPadded = "  \t ro.build.fingerprint=generic/sdk/generic:8.0.0 \n";
+
+static void BM_Trim(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    std::string trimmed = android::base::Trim(kPadded);
+    benchmark::DoNotOptimize(trimmed.data());
+  }
+}
+BENCHMARK(BM_Trim);
+
+static void BM_TrimView(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    std::string_view trimmed = android::base::TrimView(kPadded);
+    benchmark::DoNotOptimize(trimmed.data());
+  }
+}
+BENCHMARK(BM_TrimView);
+
+static void BM_Join(benchmark::State& state) {
+  std::vector<std::string> pieces = android::base::Split(kLine, " ");
+  while (state.KeepRunning()) {
+    std::string joined = android::base::Join(pieces, ' ');
+    benchmark::DoNotOptimize(joined.data());
+  }
+}
+BENCHMARK(BM_Join);
+
+static void BM_StartsWith(benchmark::State& state) {
+  std::string_view prefix("service ");
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(android::base::StartsWith(kLine, prefix));
+    benchmark::DoNotOptimize(android::base::EndsWith(kLine, "s0"));
+  }
+}
+BENCHMARK(BM_StartsWith);
+
+BENCHMARK_MAIN();
@@ -19,6 +19,7 @@
 #include <gtest/gtest.h>
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <set>
 #include <unordered_set>
@@ -75,6 +76,41 @@ TEST(strings, split_any_with_empty_part) {
   ASSERT_EQ("bar", parts[2]);
 }
 
+static std::vector<std::string> SplitViewPieces(std::string_view s, std::string_view delimiters) {
+  std::vector<std::string> result;
+  for (std::string_view piece : android::base::SplitView(s, delimiters)) {
+    result.emplace_back(piece);
+  }
+  return result;
+}
+
+TEST(strings, split_view_matches_split) {
+  static const char* cases[] = {"", "foo", "foo,bar,baz", "foo,,bar", ",", "foo,", ",foo",
+                                "foo:bar,baz", "foo:,bar"};
+  for (const char* s : cases) {
+    EXPECT_EQ(android::base::Split(s, ",:"), SplitViewPieces(s, ",:")) << s;
+  }
+  EXPECT_EQ(android::base::Split(std::string("foo\0bar", 7), std::string("\0", 1)),
+            SplitViewPieces(std::string_view("foo\0bar", 7), std::string_view("\0", 1)));
+}
+
+TEST(strings, split_view_points_into_string) {
+  std::string s("foo bar");
+  auto view = android::base::SplitView(s, " ");
+  auto it = view.begin();
+  ASSERT_NE(view.end(), it);
+  EXPECT_EQ(s.data(), it->data());
+  EXPECT_EQ(3U, it->size());
+  ++it;
+  ASSERT_NE(view.end(), it);
+  EXPECT_EQ(s.data() + 4, it->data());
+  EXPECT_EQ(view.end(), ++it);
+}
+
+TEST(strings, split_view_no_delimiters) {
+  EXPECT_EQ(std::vector<std::string>{"foo,bar"}, SplitViewPieces("foo,bar", ""));
+}
+
 TEST(strings, trim_empty) {
   ASSERT_EQ("", android::base::Trim(""));
 }
@@ -103,6 +139,15 @@ TEST(strings, trim_other_whitespace) {
   ASSERT_EQ("foo", android::base::Trim("\v\tfoo\n\f"));
 }
 
+TEST(strings, trim_view) {
+  std::string s(" \t foo bar\n ");
+  std::string_view trimmed = android::base::TrimView(s);
+  EXPECT_EQ("foo bar", trimmed);
+  EXPECT_EQ(s.data() + 3, trimmed.data());
+  EXPECT_EQ("", android::base::TrimView(" \t\n"));
+  EXPECT_EQ("", android::base::TrimView(""));
+}
+
 TEST(strings, join_nothing) {
   std::vector<std::string> list = {};
   ASSERT_EQ("", android::base::Join(list, ','));
@@ -134,6 +179,14 @@ TEST(strings, join_unordered_set) {
               "2,1" == android::base::Join(list, ','));
 }
 
+TEST(strings, join_string_views) {
+  std::vector<std::string_view> list = {"foo", "", "bar"};
+  ASSERT_EQ("foo--bar", android::base::Join(list, '-'));
+  ASSERT_EQ("foo, , bar", android::base::Join(list, ", "));
+  std::vector<const char*> pointers = {"foo", "bar"};
+  ASSERT_EQ("foo::bar", android::base::Join(pointers, std::string("::")));
+}
+
 TEST(strings, StartsWith_empty) {
   ASSERT_FALSE(android::base::StartsWith("", "foo"));
   ASSERT_TRUE(android::base::StartsWith("", ""));
@@ -252,6 +305,23 @@ TEST(strings, EqualsIgnoreCase) {
   ASSERT_FALSE(android::base::EqualsIgnoreCase("foo", "fool"));
 }
 
+TEST(strings, StartsWith_string_view) {
+  std::string_view s("foobar", 3);
+  ASSERT_TRUE(android::base::StartsWith(s, std::string("fo")));
+  ASSERT_FALSE(android::base::StartsWith(s, "foob"));
+  ASSERT_TRUE(android::base::EndsWith(s, std::string_view("oo")));
+  ASSERT_TRUE(android::base::EndsWithIgnoreCase(s, "OO"));
+}
+
+TEST(strings, StartsWith_nul) {
+  std::string s("foo\0bar", 7);
+  ASSERT_TRUE(android::base::StartsWith(s, std::string_view("foo\0b", 5)));
+  ASSERT_FALSE(android::base::StartsWith(s, std::string_view("foo\0c", 5)));
+  ASSERT_TRUE(android::base::EndsWithIgnoreCase(s, std::string_view("\0BAR", 4)));
+  ASSERT_FALSE(android::base::EqualsIgnoreCase(s, std::string_view("FOO\0BAZ", 7)));
+  ASSERT_TRUE(android::base::EqualsIgnoreCase(s, std::string_view("FOO\0BAR", 7)));
+}
+
 TEST(strings, ubsan_28729303) {
   android::base::Split("/dev/null", ":");
 }
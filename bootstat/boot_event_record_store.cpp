@@ -17,12 +17,15 @@
 #include "boot_event_record_store.h"
 
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <sys/file.h>
 #include <sys/stat.h>
-#include <utime.h>
+#include <unistd.h>
 
 #include <chrono>
 #include <cstdlib>
+#include <memory>
 #include <string>
 #include <utility>
 
@@ -30,11 +33,21 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
+#include <android-base/unique_fd.h>
 
 namespace {
 
 const char BOOTSTAT_DATA_DIR[] = "/data/misc/bootstat/";
 
+// The record log and the file it is rewritten into during compaction, both
+// in the store directory.
+const char RECORD_LOG[] = ".boot_events";
+const char RECORD_LOG_TMP[] = ".boot_events.tmp";
+
+// The number of superseded records tolerated in the record log, on top of
+// one per event, before the log is compacted.
+const size_t COMPACT_SLACK_RECORDS = 64;
+
 // Given a boot even record file at |path|, extracts the event's relative time
 // from the record into |uptime|.
 bool ParseRecordEventTime(const std::string& path, int32_t* uptime) {
@@ -51,9 +64,65 @@ bool ParseRecordEventTime(const std::string& path, int32_t* uptime) {
   return true;
 }
 
+std::string FormatRecord(const std::string& event, int32_t value) {
+  return event + " " + std::to_string(value) + "\n";
+}
+
+// Parses the records in |log| into |index|, later records replacing earlier
+// ones, and returns the number of records parsed.  A trailing line without a
+// newline is an interrupted append and is ignored.
+size_t ParseRecordLog(const std::string& log, std::map<std::string, int32_t>* index) {
+  size_t records = 0;
+  size_t pos = 0;
+  while (pos < log.size()) {
+    size_t eol = log.find('\n', pos);
+    if (eol == std::string::npos) {
+      break;
+    }
+
+    // The value follows the last space, so event names may contain spaces.
+    size_t sep = log.rfind(' ', eol);
+    int32_t value;
+    if (sep != std::string::npos && sep > pos &&
+        android::base::ParseInt(log.substr(sep + 1, eol - sep - 1), &value)) {
+      (*index)[log.substr(pos, sep - pos)] = value;
+      ++records;
+    } else {
+      LOG(ERROR) << "Malformed boot event record: " << log.substr(pos, eol - pos);
+    }
+    pos = eol + 1;
+  }
+  return records;
+}
+
+// Opens the record log at |path| for appending and takes an exclusive lock
+// on it.  The compaction of another process may replace the log between the
+// open and the lock, in which case the new log is opened instead.
+android::base::unique_fd OpenLockedLog(const std::string& path, int flags) {
+  while (true) {
+    android::base::unique_fd fd(
+        open(path.c_str(), flags | O_CLOEXEC, S_IRUSR | S_IWUSR));
+    if (fd == -1) {
+      PLOG(ERROR) << "Failed to open " << path;
+      return fd;
+    }
+    if (flock(fd, LOCK_EX) == -1) {
+      PLOG(ERROR) << "Failed to lock " << path;
+      return android::base::unique_fd();
+    }
+
+    struct stat fd_stat, path_stat;
+    if (fstat(fd, &fd_stat) == 0 && stat(path.c_str(), &path_stat) == 0 &&
+        fd_stat.st_ino == path_stat.st_ino && fd_stat.st_dev == path_stat.st_dev) {
+      return fd;
+    }
+  }
+}
+
 }  // namespace
 
-BootEventRecordStore::BootEventRecordStore() {
+BootEventRecordStore::BootEventRecordStore()
+    : log_records_(0), index_loaded_(false) {
   SetStorePath(BOOTSTAT_DATA_DIR);
 }
 
@@ -63,37 +132,31 @@ void BootEventRecordStore::AddBootEvent(const std::string& event) {
     AddBootEventWithValue(event, uptime.count());
 }
 
-// The implementation of AddBootEventValue makes use of the mtime file
-// attribute to store the value associated with a boot event in order to
-// optimize on-disk size requirements and small-file thrashing.
 void BootEventRecordStore::AddBootEventWithValue(
     const std::string& event, int32_t value) {
-  std::string record_path = GetBootEventPath(event);
-  int record_fd = creat(record_path.c_str(), S_IRUSR | S_IWUSR);
-  if (record_fd == -1) {
-    PLOG(ERROR) << "Failed to create " << record_path;
+  if (event.empty() || event.find('\n') != std::string::npos) {
+    LOG(ERROR) << "Invalid boot event name: " << event;
     return;
   }
 
-  // Fill out the stat structure for |record_path| in order to get the atime to
-  // set in the utime() call.
-  struct stat file_stat;
-  if (stat(record_path.c_str(), &file_stat) == -1) {
-    PLOG(ERROR) << "Failed to read " << record_path;
-    close(record_fd);
+  LoadIndex();
+
+  // Re-recording an unchanged value is common (e.g. build_date) and costs
+  // nothing.
+  auto it = index_.find(event);
+  if (it != index_.end() && it->second == value) {
     return;
   }
 
-  // Set the |modtime| of the file to store the value of the boot event while
-  // preserving the |actime| (as read by stat).
-  struct utimbuf times = {/* actime */ file_stat.st_atime, /* modtime */ value};
-  if (utime(record_path.c_str(), &times) == -1) {
-    PLOG(ERROR) << "Failed to set mtime for " << record_path;
-    close(record_fd);
+  if (!AppendToLog(FormatRecord(event, value))) {
     return;
   }
+  index_[event] = value;
+  ++log_records_;
 
-  close(record_fd);
+  if (log_records_ > 2 * index_.size() + COMPACT_SLACK_RECORDS) {
+    CompactLog();
+  }
 }
 
 bool BootEventRecordStore::GetBootEvent(
@@ -101,6 +164,14 @@ bool BootEventRecordStore::GetBootEvent(
   CHECK_NE(static_cast<BootEventRecord*>(nullptr), record);
   CHECK(!event.empty());
 
+  LoadIndex();
+  auto it = index_.find(event);
+  if (it != index_.end()) {
+    *record = *it;
+    return true;
+  }
+
+  // Fall back to a record in the legacy layout that was not migrated.
   const std::string record_path = GetBootEventPath(event);
   int32_t uptime;
   if (!ParseRecordEventTime(record_path, &uptime)) {
@@ -114,14 +185,54 @@ bool BootEventRecordStore::GetBootEvent(
 
 std::vector<BootEventRecordStore::BootEventRecord> BootEventRecordStore::
     GetAllBootEvents() const {
-  std::vector<BootEventRecord> events;
+  LoadIndex();
+  return std::vector<BootEventRecord>(index_.begin(), index_.end());
+}
+
+void BootEventRecordStore::SetStorePath(const std::string& path) {
+  DCHECK_EQ('/', path.back());
+  store_path_ = path;
+  index_loaded_ = false;
+}
+
+std::string BootEventRecordStore::GetBootEventPath(
+    const std::string& event) const {
+  DCHECK_EQ('/', store_path_.back());
+  return store_path_ + event;
+}
+
+std::string BootEventRecordStore::GetLogPath() const {
+  DCHECK_EQ('/', store_path_.back());
+  return store_path_ + RECORD_LOG;
+}
+
+void BootEventRecordStore::LoadIndex() const {
+  if (index_loaded_) {
+    return;
+  }
+  index_loaded_ = true;
+  index_.clear();
+  log_records_ = 0;
+
+  std::string log;
+  if (android::base::ReadFileToString(GetLogPath(), &log)) {
+    log_records_ = ParseRecordLog(log, &index_);
+    return;
+  }
+  if (errno != ENOENT) {
+    PLOG(ERROR) << "Failed to read " << GetLogPath();
+    return;
+  }
 
+  // There is no log yet, so fold any records in the legacy layout into it.
   std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(store_path_.c_str()), closedir);
 
   // This case could happen due to external manipulation of the filesystem,
   // so crash out if the record store doesn't exist.
   CHECK_NE(static_cast<DIR*>(nullptr), dir.get());
 
+  std::string records;
+  std::vector<std::string> legacy_paths;
   struct dirent* entry;
   while ((entry = readdir(dir.get())) != NULL) {
     // Only parse regular files.
@@ -130,25 +241,79 @@ std::vector<BootEventRecordStore::BootEventRecord> BootEventRecordStore::
     }
 
     const std::string event = entry->d_name;
-    BootEventRecord record;
-    if (!GetBootEvent(event, &record)) {
+    if (event == RECORD_LOG || event == RECORD_LOG_TMP) {
+      continue;
+    }
+
+    const std::string record_path = GetBootEventPath(event);
+    int32_t uptime;
+    if (!ParseRecordEventTime(record_path, &uptime)) {
       LOG(ERROR) << "Failed to parse boot time event: " << event;
       continue;
     }
 
-    events.push_back(record);
+    records += FormatRecord(event, uptime);
+    legacy_paths.push_back(record_path);
+    index_[event] = uptime;
   }
 
-  return events;
+  if (records.empty() || !AppendToLog(records)) {
+    return;
+  }
+  log_records_ = index_.size();
+  for (const auto& path : legacy_paths) {
+    unlink(path.c_str());
+  }
 }
 
-void BootEventRecordStore::SetStorePath(const std::string& path) {
-  DCHECK_EQ('/', path.back());
-  store_path_ = path;
+bool BootEventRecordStore::AppendToLog(const std::string& data) const {
+  const std::string log_path = GetLogPath();
+  android::base::unique_fd fd(OpenLockedLog(log_path, O_WRONLY | O_APPEND | O_CREAT));
+  if (fd == -1) {
+    return false;
+  }
+  if (!android::base::WriteStringToFd(data, fd)) {
+    PLOG(ERROR) << "Failed to append to " << log_path;
+    return false;
+  }
+  return true;
 }
 
-std::string BootEventRecordStore::GetBootEventPath(
-    const std::string& event) const {
-  DCHECK_EQ('/', store_path_.back());
-  return store_path_ + event;
+void BootEventRecordStore::CompactLog() const {
+  const std::string log_path = GetLogPath();
+  android::base::unique_fd fd(OpenLockedLog(log_path, O_RDONLY));
+  if (fd == -1) {
+    return;
+  }
+
+  // Re-read the log under the lock to pick up records appended by other
+  // processes since it was loaded.
+  std::string log;
+  if (!android::base::ReadFdToString(fd, &log)) {
+    PLOG(ERROR) << "Failed to read " << log_path;
+    return;
+  }
+  std::map<std::string, int32_t> index;
+  ParseRecordLog(log, &index);
+
+  std::string records;
+  for (const auto& record : index) {
+    records += FormatRecord(record.first, record.second);
+  }
+
+  const std::string tmp_path = store_path_ + RECORD_LOG_TMP;
+  if (!android::base::WriteStringToFile(records, tmp_path, S_IRUSR | S_IWUSR,
+                                        getuid(), getgid())) {
+    PLOG(ERROR) << "Failed to write " << tmp_path;
+    unlink(tmp_path.c_str());
+    return;
+  }
+  if (rename(tmp_path.c_str(), log_path.c_str()) == -1) {
+    PLOG(ERROR) << "Failed to replace " << log_path;
+    unlink(tmp_path.c_str());
+    return;
+  }
+
+  index_.swap(index);
+  log_records_ = index_.size();
 }
@@ -17,7 +17,9 @@
 #ifndef BOOT_EVENT_RECORD_STORE_H_
 #define BOOT_EVENT_RECORD_STORE_H_
 
+#include <cstddef>
 #include <cstdint>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -26,6 +28,13 @@
 
 // BootEventRecordStore manages the persistence of boot events to the record
 // store and the retrieval of all boot event records from the store.
+//
+// The record store is a single append-only log file in the store directory,
+// one "<event> <value>" line per record; the last record for an event wins.
+// Adding an event costs one append, and the log is read once into an
+// in-memory index on first use.  Records left behind by the older
+// one-file-per-event layout are folded into the log the first time it is
+// created.
 class BootEventRecordStore {
  public:
   // A BootEventRecord consists of the event name and the timestamp the event
@@ -56,16 +65,41 @@ class BootEventRecordStore {
   FRIEND_TEST(BootEventRecordStoreTest, AddBootEventWithValue);
   FRIEND_TEST(BootEventRecordStoreTest, GetBootEvent);
   FRIEND_TEST(BootEventRecordStoreTest, GetBootEventNoFileContent);
+  FRIEND_TEST(BootEventRecordStoreTest, OverwriteBootEvent);
+  FRIEND_TEST(BootEventRecordStoreTest, PersistAcrossInstances);
+  FRIEND_TEST(BootEventRecordStoreTest, MigrateLegacyRecords);
+  FRIEND_TEST(BootEventRecordStoreTest, CompactLog);
 
   // Sets the filesystem path of the record store.
   void SetStorePath(const std::string& path);
 
-  // Constructs the full path of the given boot |event|.
+  // Constructs the full path of the given boot |event| in the legacy
+  // one-file-per-event layout.
   std::string GetBootEventPath(const std::string& event) const;
 
+  // Returns the full path of the record log.
+  std::string GetLogPath() const;
+
+  // Reads the record log into |index_| if that has not been done yet,
+  // migrating legacy records when there is no log.
+  void LoadIndex() const;
+
+  // Appends |data| to the record log, creating it if needed.
+  bool AppendToLog(const std::string& data) const;
+
+  // Rewrites the record log with one record per event.
+  void CompactLog() const;
+
   // The filesystem path of the record store.
   std::string store_path_;
 
+  // The most recent value of every event in the record log, and the number
+  // of records in the log.  The log is compacted once it holds many more
+  // records than events.
+  mutable std::map<std::string, int32_t> index_;
+  mutable size_t log_records_;
+  mutable bool index_loaded_;
+
   DISALLOW_COPY_AND_ASSIGN(BootEventRecordStore);
 };
 
@@ -230,3 +230,82 @@ TEST_F(BootEventRecordStoreTest, GetBootEventNoFileContent) {
   EXPECT_EQ("devonian", record.first);
   EXPECT_EQ(2718, record.second);
 }
+
+TEST_F(BootEventRecordStoreTest, OverwriteBootEvent) {
+  BootEventRecordStore store;
+  store.SetStorePath(GetStorePathForTesting());
+
+  store.AddBootEventWithValue("ordovician", 1);
+  store.AddBootEventWithValue("ordovician", 2);
+
+  auto events = store.GetAllBootEvents();
+  ASSERT_EQ(1U, events.size());
+  EXPECT_EQ("ordovician", events[0].first);
+  EXPECT_EQ(2, events[0].second);
+}
+
+TEST_F(BootEventRecordStoreTest, PersistAcrossInstances) {
+  {
+    BootEventRecordStore store;
+    store.SetStorePath(GetStorePathForTesting());
+    store.AddBootEventWithValue("silurian", 443);
+    store.AddBootEventWithValue("cambrian", 541);
+  }
+
+  BootEventRecordStore store;
+  store.SetStorePath(GetStorePathForTesting());
+
+  BootEventRecordStore::BootEventRecord record;
+  ASSERT_TRUE(store.GetBootEvent("silurian", &record));
+  EXPECT_EQ(443, record.second);
+  ASSERT_TRUE(store.GetBootEvent("cambrian", &record));
+  EXPECT_EQ(541, record.second);
+}
+
+// Tests that records in the one-file-per-event layout are moved into the log.
+TEST_F(BootEventRecordStoreTest, MigrateLegacyRecords) {
+  BootEventRecordStore store;
+  store.SetStorePath(GetStorePathForTesting());
+
+  EXPECT_TRUE(CreateEmptyBootEventRecord(store.GetBootEventPath("ediacaran"), 635));
+  EXPECT_TRUE(CreateEmptyBootEventRecord(store.GetBootEventPath("cryogenian"), 720));
+
+  store.AddBootEventWithValue("tonian", 1000);
+
+  EXPECT_EQ(-1, access(store.GetBootEventPath("ediacaran").c_str(), F_OK));
+  EXPECT_EQ(-1, access(store.GetBootEventPath("cryogenian").c_str(), F_OK));
+
+  BootEventRecordStore reloaded;
+  reloaded.SetStorePath(GetStorePathForTesting());
+
+  auto events = reloaded.GetAllBootEvents();
+  ASSERT_EQ(3U, events.size());
+  EXPECT_THAT(events, UnorderedElementsAreArray({
+      BootEventRecordStore::BootEventRecord("ediacaran", 635),
+      BootEventRecordStore::BootEventRecord("cryogenian", 720),
+      BootEventRecordStore::BootEventRecord("tonian", 1000),
+  }));
+}
+
+TEST_F(BootEventRecordStoreTest, CompactLog) {
+  BootEventRecordStore store;
+  store.SetStorePath(GetStorePathForTesting());
+
+  store.AddBootEventWithValue("archean", 4000);
+  for (int32_t i = 0; i < 1000; ++i) {
+    store.AddBootEventWithValue("proterozoic", i);
+  }
+
+  std::string log;
+  ASSERT_TRUE(android::base::ReadFileToString(store.GetLogPath(), &log));
+  EXPECT_GT(200U, log.size() / sizeof("proterozoic 999"));
+
+  BootEventRecordStore reloaded;
+  reloaded.SetStorePath(GetStorePathForTesting());
+
+  auto events = reloaded.GetAllBootEvents();
+  EXPECT_THAT(events, UnorderedElementsAreArray({
+      BootEventRecordStore::BootEventRecord("archean", 4000),
+      BootEventRecordStore::BootEventRecord("proterozoic", 999),
+  }));
+}
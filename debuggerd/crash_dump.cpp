@@ -203,6 +203,7 @@ int main(int argc, char** argv) {
 
   pid_t target = getppid();
   bool tombstoned_connected = false;
+  bool compress_output = false;
   unique_fd tombstoned_socket;
   unique_fd output_fd;
 
@@ -347,7 +348,8 @@ int main(int argc, char** argv) {
     ATRACE_NAME("tombstoned_connect");
     const DebuggerdDumpType dump_type_enum = static_cast<DebuggerdDumpType>(dump_type);
     LOG(INFO) << "obtaining output fd from tombstoned, type: " << dump_type_enum;
-    tombstoned_connected = tombstoned_connect(target, &tombstoned_socket, &output_fd, dump_type_enum);
+    tombstoned_connected = tombstoned_connect(target, &tombstoned_socket, &output_fd,
+                                              dump_type_enum, &compress_output);
   }
 
   // Write a '\1' to stdout to tell the crashing process to resume.
@@ -409,7 +411,8 @@ int main(int argc, char** argv) {
   } else {
     ATRACE_NAME("engrave_tombstone");
     engrave_tombstone(output_fd.get(), backtrace_map.get(), &open_files, target, main_tid,
-                      process_name, threads, abort_address, fatal_signal ? &amfd_data : nullptr);
+                      process_name, threads, abort_address, fatal_signal ? &amfd_data : nullptr,
+                      compress_output);
   }
 
   // We don't actually need to PTRACE_DETACH, as long as our tracees aren't in
@@ -19,6 +19,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #include <map>
@@ -28,17 +29,42 @@
 
 class BacktraceMap;
 
+// A compressed tombstone is a sequence of sections. Each section is a
+// TombstoneSectionHeader followed by compressed_size bytes of zlib data,
+// which inflates to uncompressed_size bytes of ordinary tombstone text.
+// A tool can walk the headers to find a section without inflating the
+// ones in front of it. Anything that does not start with the magic, e.g.
+// an error written by crash_dump, is plain text up to the end of the file.
+constexpr char kTombstoneSectionMagic[4] = {'T', 'S', 'Z', '1'};
+
+enum TombstoneSectionType : uint32_t {
+  kTombstoneSectionCrashedThread,
+  kTombstoneSectionLogTail,
+  kTombstoneSectionThread,
+  kTombstoneSectionOpenFiles,
+  kTombstoneSectionLogs,
+};
+
+struct TombstoneSectionHeader {
+  char magic[4];
+  uint32_t type;
+  uint32_t compressed_size;
+  uint32_t uncompressed_size;
+};
+
 /* Create and open a tombstone file for writing.
  * Returns a writable file descriptor, or -1 with errno set appropriately.
  * If out_path is non-null, *out_path is set to the path of the tombstone file.
  */
 int open_tombstone(std::string* path);
 
-/* Creates a tombstone file and writes the crash dump to it. */
+/* Creates a tombstone file and writes the crash dump to it.
+ * If compress is set, the tombstone is written as compressed sections.
+ */
 void engrave_tombstone(int tombstone_fd, BacktraceMap* map, const OpenFilesList* open_files,
                        pid_t pid, pid_t tid, const std::string& process_name,
                        const std::map<pid_t, std::string>& threads, uintptr_t abort_msg_address,
-                       std::string* amfd_data);
+                       std::string* amfd_data, bool compress = false);
 
 void engrave_tombstone_ucontext(int tombstone_fd, uintptr_t abort_msg_address, siginfo_t* siginfo,
                                 ucontext_t* ucontext);
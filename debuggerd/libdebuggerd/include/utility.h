@@ -55,10 +55,15 @@ struct log_t{
     pid_t current_tid;
     // logd daemon crash, can block asking for logcat data, allow suppression.
     bool should_retrieve_logcat;
+    // If set, tombstone output is appended here instead of being written
+    // to tfd, so that a whole section can be written at once.
+    std::string* tombstone_data;
+    // Write each section of tombstone_data compressed.
+    bool compress_sections;
 
     log_t()
         : tfd(-1), amfd_data(nullptr), crashed_tid(-1), current_tid(-1),
-          should_retrieve_logcat(true) {}
+          should_retrieve_logcat(true), tombstone_data(nullptr), compress_sections(false) {}
 };
 
 // List of types of logs to simplify the logging decision in _LOG
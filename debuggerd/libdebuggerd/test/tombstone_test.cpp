@@ -18,6 +18,8 @@
 
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <android-base/file.h>
@@ -643,3 +645,68 @@ TEST_F(TombstoneTest, dump_header_info) {
   expected += android::base::StringPrintf("ABI: '%s'\n", ABI_STRING);
   ASSERT_STREQ(expected.c_str(), amfd_data_.c_str());
 }
+
+TEST_F(TombstoneTest, write_section) {
+  std::string section;
+  log_.tombstone_data = &section;
+  dump_header_info(&log_);
+
+  // Nothing reaches the tombstone until the section is written.
+  std::string tombstone_contents;
+  ASSERT_TRUE(lseek(log_.tfd, 0, SEEK_SET) == 0);
+  ASSERT_TRUE(android::base::ReadFdToString(log_.tfd, &tombstone_contents));
+  ASSERT_STREQ("", tombstone_contents.c_str());
+
+  std::string expected = "Build fingerprint: 'unknown'\nRevision: 'unknown'\n";
+  expected += android::base::StringPrintf("ABI: '%s'\n", ABI_STRING);
+  ASSERT_STREQ(expected.c_str(), section.c_str());
+  ASSERT_STREQ(expected.c_str(), amfd_data_.c_str());
+
+  write_section(&log_, kTombstoneSectionCrashedThread, &section);
+  ASSERT_STREQ("", section.c_str());
+  ASSERT_TRUE(lseek(log_.tfd, 0, SEEK_SET) == 0);
+  ASSERT_TRUE(android::base::ReadFdToString(log_.tfd, &tombstone_contents));
+  ASSERT_STREQ(expected.c_str(), tombstone_contents.c_str());
+}
+
+TEST_F(TombstoneTest, write_section_compressed) {
+  std::string section;
+  log_.tombstone_data = &section;
+  log_.compress_sections = true;
+  dump_header_info(&log_);
+  std::string expected = section;
+  write_section(&log_, kTombstoneSectionThread, &section);
+  _LOG(&log_, logtype::THREAD, "second section\n");
+  write_section(&log_, kTombstoneSectionOpenFiles, &section);
+
+  std::string tombstone_contents;
+  ASSERT_TRUE(lseek(log_.tfd, 0, SEEK_SET) == 0);
+  ASSERT_TRUE(android::base::ReadFdToString(log_.tfd, &tombstone_contents));
+
+  // Walk the sections by their headers.
+  std::vector<std::pair<uint32_t, std::string>> sections;
+  size_t offset = 0;
+  while (offset < tombstone_contents.size()) {
+    TombstoneSectionHeader header;
+    ASSERT_LE(offset + sizeof(header), tombstone_contents.size());
+    memcpy(&header, &tombstone_contents[offset], sizeof(header));
+    ASSERT_EQ(0, memcmp(header.magic, kTombstoneSectionMagic, sizeof(header.magic)));
+    offset += sizeof(header);
+    ASSERT_LE(offset + header.compressed_size, tombstone_contents.size());
+
+    std::string data(header.uncompressed_size, '\0');
+    uLongf size = data.size();
+    ASSERT_EQ(Z_OK, uncompress(reinterpret_cast<Bytef*>(&data[0]), &size,
+                               reinterpret_cast<const Bytef*>(&tombstone_contents[offset]),
+                               header.compressed_size));
+    ASSERT_EQ(data.size(), size);
+    sections.emplace_back(header.type, data);
+    offset += header.compressed_size;
+  }
+
+  ASSERT_EQ(2U, sections.size());
+  ASSERT_EQ(kTombstoneSectionThread, sections[0].first);
+  ASSERT_EQ(expected, sections[0].second);
+  ASSERT_EQ(kTombstoneSectionOpenFiles, sections[1].first);
+  ASSERT_EQ("second section\n", sections[1].second);
+}
@@ -31,6 +31,7 @@
 
 #include <memory>
 #include <string>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
@@ -42,6 +43,7 @@
 #include <log/log.h>
 #include <log/logprint.h>
 #include <private/android_filesystem_config.h>
+#include <zlib.h>
 
 #include "debuggerd/handler.h"
 
@@ -55,6 +57,9 @@ using android::base::StringPrintf;
 
 #define STACK_WORDS 16
 
+// The most log entries to read from each log buffer.
+#define MAX_LOG_ENTRIES 1000
+
 #define MAX_TOMBSTONES  10
 #define TOMBSTONE_DIR   "/data/tombstones"
 #define TOMBSTONE_TEMPLATE (TOMBSTONE_DIR"/tombstone_%02d")
@@ -658,7 +663,45 @@ static void dump_logs(log_t* log, pid_t pid, unsigned int tail) {
   dump_log_file(log, pid, "main", tail);
 }
 
+// Writes out a finished section of the tombstone, and starts a new one.
+static void write_section(log_t* log, TombstoneSectionType type, std::string* section) {
+  if (log->tfd == -1 || section->empty()) {
+    section->clear();
+    return;
+  }
+
+  if (!log->compress_sections) {
+    android::base::WriteFully(log->tfd, section->data(), section->size());
+    section->clear();
+    return;
+  }
+
+  // The device may be stuck waiting for this tombstone, favor speed.
+  uLongf compressed_size = compressBound(section->size());
+  std::string compressed(sizeof(TombstoneSectionHeader) + compressed_size, '\0');
+  int ret = compress2(reinterpret_cast<Bytef*>(&compressed[sizeof(TombstoneSectionHeader)]),
+                      &compressed_size, reinterpret_cast<const Bytef*>(section->data()),
+                      section->size(), Z_BEST_SPEED);
+  if (ret != Z_OK) {
+    ALOGE("failed to compress tombstone section: %d", ret);
+    android::base::WriteFully(log->tfd, section->data(), section->size());
+    section->clear();
+    return;
+  }
+
+  TombstoneSectionHeader header;
+  memcpy(header.magic, kTombstoneSectionMagic, sizeof(header.magic));
+  header.type = type;
+  header.compressed_size = compressed_size;
+  header.uncompressed_size = section->size();
+  memcpy(&compressed[0], &header, sizeof(header));
+  android::base::WriteFully(log->tfd, compressed.data(), sizeof(header) + compressed_size);
+  section->clear();
+}
+
 // Dumps all information about the specified pid to the tombstone.
+// Each section is written out as soon as it is complete, the crashing
+// thread first.
 static void dump_crash(log_t* log, BacktraceMap* map, const OpenFilesList* open_files, pid_t pid,
                        pid_t tid, const std::string& process_name,
                        const std::map<pid_t, std::string>& threads, uintptr_t abort_msg_address) {
@@ -667,12 +710,30 @@ static void dump_crash(log_t* log, BacktraceMap* map, const OpenFilesList* open_
   property_get("ro.debuggable", value, "0");
   bool want_logs = (value[0] == '1');
 
+  std::string section;
+  log->tombstone_data = &section;
+
   _LOG(log, logtype::HEADER,
        "*** *** *** *** *** *** *** *** *** *** *** *** *** *** *** ***\n");
   dump_header_info(log);
   dump_thread(log, pid, tid, process_name, threads.find(tid)->second, map, abort_msg_address, true);
+  write_section(log, kTombstoneSectionCrashedThread, &section);
   if (want_logs) {
     dump_logs(log, pid, 5);
+    write_section(log, kTombstoneSectionLogTail, &section);
+  }
+
+  // Reading the full logs does not need ptrace, so do it on another thread
+  // while the rest of the threads are unwound. The unwinds themselves have
+  // to stay on this thread, since it is the one that is attached to them.
+  std::string logs;
+  std::thread logs_thread;
+  if (want_logs) {
+    log_t logs_log = *log;
+    logs_log.tombstone_data = &logs;
+    logs_log.amfd_data = nullptr;
+    logs_thread = std::thread(
+        [logs_log, pid]() mutable { dump_logs(&logs_log, pid, MAX_LOG_ENTRIES); });
   }
 
   for (const auto& it : threads) {
@@ -681,17 +742,21 @@ static void dump_crash(log_t* log, BacktraceMap* map, const OpenFilesList* open_
 
     if (thread_tid != tid) {
       dump_thread(log, pid, thread_tid, process_name, thread_name, map, 0, false);
+      write_section(log, kTombstoneSectionThread, &section);
     }
   }
 
   if (open_files) {
     _LOG(log, logtype::OPEN_FILES, "\nopen files:\n");
     dump_open_files_list_to_log(*open_files, log, "    ");
+    write_section(log, kTombstoneSectionOpenFiles, &section);
   }
 
-  if (want_logs) {
-    dump_logs(log, pid, 0);
+  if (logs_thread.joinable()) {
+    logs_thread.join();
+    write_section(log, kTombstoneSectionLogs, &logs);
   }
+  log->tombstone_data = nullptr;
 }
 
 // open_tombstone - find an available tombstone slot, if any, of the
@@ -750,12 +815,13 @@ int open_tombstone(std::string* out_path) {
 void engrave_tombstone(int tombstone_fd, BacktraceMap* map, const OpenFilesList* open_files,
                        pid_t pid, pid_t tid, const std::string& process_name,
                        const std::map<pid_t, std::string>& threads, uintptr_t abort_msg_address,
-                       std::string* amfd_data) {
+                       std::string* amfd_data, bool compress) {
   log_t log;
   log.current_tid = tid;
   log.crashed_tid = tid;
   log.tfd = tombstone_fd;
   log.amfd_data = amfd_data;
+  log.compress_sections = compress;
   dump_crash(&log, map, open_files, pid, tid, process_name, threads, abort_msg_address);
 }
 
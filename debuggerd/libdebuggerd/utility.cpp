@@ -62,7 +62,11 @@ void _LOG(log_t* log, enum logtype ltype, const char* fmt, ...) {
   }
 
   if (write_to_tombstone) {
-    TEMP_FAILURE_RETRY(write(log->tfd, buf, len));
+    if (log->tombstone_data != nullptr) {
+      log->tombstone_data->append(buf, len);
+    } else {
+      TEMP_FAILURE_RETRY(write(log->tfd, buf, len));
+    }
   }
 
   if (write_to_logcat) {
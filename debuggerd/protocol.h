@@ -46,11 +46,18 @@ struct DumpRequest {
   int32_t pid;
 };
 
+struct PerformDump {
+  // If set, the dump should be written as compressed sections, see
+  // TombstoneSectionHeader in libdebuggerd/include/tombstone.h.
+  bool compress;
+};
+
 // The full packet must always be written, regardless of whether the union is used.
 struct TombstonedCrashPacket {
   CrashPacketType packet_type;
   union {
     DumpRequest dump_request;
+    PerformDump perform_dump;
   } packet;
 };
 
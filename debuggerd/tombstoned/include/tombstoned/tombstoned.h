@@ -22,7 +22,10 @@
 
 #include "dump_type.h"
 
+// If compress_output is not null, it is set to whether tombstoned asked for
+// the output to be compressed.
 bool tombstoned_connect(pid_t pid, android::base::unique_fd* tombstoned_socket,
-                        android::base::unique_fd* output_fd, DebuggerdDumpType dump_type);
+                        android::base::unique_fd* output_fd, DebuggerdDumpType dump_type,
+                        bool* compress_output = nullptr);
 
 bool tombstoned_notify_completion(int tombstoned_socket);
@@ -53,5 +53,6 @@ struct InterceptManager {
   InterceptManager(InterceptManager& copy) = delete;
   InterceptManager(InterceptManager&& move) = delete;
 
+  bool HasIntercept(pid_t pid) const { return intercepts.count(pid) != 0; }
   bool GetIntercept(pid_t pid, DebuggerdDumpType dump_type, android::base::unique_fd* out_fd);
 };
@@ -21,7 +21,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <deque>
 #include <string>
 #include <unordered_map>
@@ -31,6 +33,7 @@
 #include <event2/listener.h>
 #include <event2/thread.h>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
@@ -44,7 +47,9 @@
 
 #include "intercept_manager.h"
 
+using android::base::GetBoolProperty;
 using android::base::GetIntProperty;
+using android::base::ReadFileToString;
 using android::base::StringPrintf;
 using android::base::unique_fd;
 
@@ -53,8 +58,31 @@ static InterceptManager* intercept_manager;
 enum CrashStatus {
   kCrashStatusRunning,
   kCrashStatusQueued,
+  kCrashStatusCoalesced,
+  kCrashStatusRejected,
 };
 
+// Queued requests are handed out in this order: crashes first, then java
+// traces, then native backtraces (debuggerd -b, dumpsys).
+enum CrashPriority {
+  kCrashPriorityCrash,
+  kCrashPriorityJavaTrace,
+  kCrashPriorityBacktrace,
+  kCrashPriorityCount,
+};
+
+static CrashPriority crash_priority(DebuggerdDumpType dump_type) {
+  switch (dump_type) {
+    case kDebuggerdTombstone:
+    case kDebuggerdAnyIntercept:
+      return kCrashPriorityCrash;
+    case kDebuggerdJavaBacktrace:
+      return kCrashPriorityJavaTrace;
+    default:
+      return kCrashPriorityBacktrace;
+  }
+}
+
 // Ownership of Crash is a bit messy.
 // It's either owned by an active event that must have a timeout, or owned by
 // queued_requests, in the case that multiple crashes come in at the same time.
@@ -63,23 +91,35 @@ struct Crash {
 
   unique_fd crash_fd;
   pid_t crash_pid;
+  uid_t crash_uid;
   event* crash_event = nullptr;
   std::string crash_path;
 
   DebuggerdDumpType crash_type;
+
+  // Whether someone registered an intercept for this request. Those are
+  // never rate limited, coalesced or dropped.
+  bool intercepted = false;
+  std::string cmdline;
+  std::chrono::steady_clock::time_point queued_time;
 };
 
+static constexpr std::chrono::seconds kRateLimitWindow(60);
+
 class CrashQueue {
  public:
   CrashQueue(const std::string& dir_path, const std::string& file_name_prefix, size_t max_artifacts,
-             size_t max_concurrent_dumps)
+             size_t max_concurrent_dumps, size_t max_queued_requests, size_t max_requests_per_uid)
       : file_name_prefix_(file_name_prefix),
         dir_path_(dir_path),
         dir_fd_(open(dir_path.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC)),
         max_artifacts_(max_artifacts),
         next_artifact_(0),
         max_concurrent_dumps_(max_concurrent_dumps),
-        num_concurrent_dumps_(0) {
+        num_concurrent_dumps_(0),
+        max_queued_requests_(max_queued_requests),
+        num_queued_requests_(0),
+        max_requests_per_uid_(max_requests_per_uid) {
     if (dir_fd_ == -1) {
       PLOG(FATAL) << "failed to open directory: " << dir_path;
     }
@@ -98,14 +138,18 @@ class CrashQueue {
   static CrashQueue* for_tombstones() {
     static CrashQueue queue("/data/tombstones", "tombstone_" /* file_name_prefix */,
                             GetIntProperty("tombstoned.max_tombstone_count", 10),
-                            1 /* max_concurrent_dumps */);
+                            1 /* max_concurrent_dumps */,
+                            GetIntProperty("tombstoned.max_queued_tombstones", 8),
+                            GetIntProperty("tombstoned.max_tombstones_per_uid", 20));
     return &queue;
   }
 
   static CrashQueue* for_anrs() {
     static CrashQueue queue("/data/anr", "trace_" /* file_name_prefix */,
                             GetIntProperty("tombstoned.max_anr_count", 64),
-                            4 /* max_concurrent_dumps */);
+                            4 /* max_concurrent_dumps */,
+                            GetIntProperty("tombstoned.max_queued_anrs", 64),
+                            GetIntProperty("tombstoned.max_anrs_per_uid", 0));
     return &queue;
   }
 
@@ -129,21 +173,70 @@ class CrashQueue {
     return {std::move(result), dir_path_ + "/" + file_name};
   }
 
-  bool maybe_enqueue_crash(Crash* crash) {
-    if (num_concurrent_dumps_ == max_concurrent_dumps_) {
-      queued_requests_.push_back(crash);
-      return true;
+  // Decides what to do with a new request: run it now, queue it, or refuse
+  // it. Refused requests are not given an output fd, crash_dump still logs
+  // the crash to logcat.
+  CrashStatus maybe_enqueue_crash(Crash* crash) {
+    if (!crash->intercepted && !check_rate_limit(crash->crash_uid)) {
+      LOG(WARNING) << "rejecting crash request for pid " << crash->crash_pid << ": uid "
+                   << crash->crash_uid << " made more than " << max_requests_per_uid_
+                   << " requests in the last " << kRateLimitWindow.count() << "s";
+      ++stats_.rejected;
+      return kCrashStatusRejected;
     }
 
-    return false;
+    if (num_concurrent_dumps_ < max_concurrent_dumps_) {
+      return kCrashStatusRunning;
+    }
+
+    if (!crash->intercepted) {
+      const Crash* queued = find_identical(crash);
+      if (queued != nullptr) {
+        LOG(WARNING) << "coalescing crash request for pid " << crash->crash_pid
+                     << " with the queued request for pid " << queued->crash_pid;
+        ++stats_.coalesced;
+        return kCrashStatusCoalesced;
+      }
+    }
+
+    CrashPriority priority = crash_priority(crash->crash_type);
+    if (num_queued_requests_ >= max_queued_requests_ && !crash->intercepted &&
+        !drop_lower_priority(priority)) {
+      LOG(WARNING) << "rejecting crash request for pid " << crash->crash_pid << ": "
+                   << num_queued_requests_ << " requests already queued";
+      ++stats_.rejected;
+      return kCrashStatusRejected;
+    }
+
+    crash->queued_time = std::chrono::steady_clock::now();
+    queued_requests_[priority].push_back(crash);
+    ++num_queued_requests_;
+    return kCrashStatusQueued;
   }
 
   void maybe_dequeue_crashes(void (*handler)(Crash* crash)) {
-    while (!queued_requests_.empty() && num_concurrent_dumps_ < max_concurrent_dumps_) {
-      Crash* next_crash = queued_requests_.front();
-      queued_requests_.pop_front();
+    while (num_queued_requests_ > 0 && num_concurrent_dumps_ < max_concurrent_dumps_) {
+      std::deque<Crash*>* queue = &queued_requests_[0];
+      while (queue->empty()) {
+        ++queue;
+      }
+      Crash* next_crash = queue->front();
+      queue->pop_front();
+      --num_queued_requests_;
+
+      auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - next_crash->queued_time);
+      LOG(INFO) << "dequeueing crash request for pid " << next_crash->crash_pid << " after "
+                << delay.count() << "ms";
+      ++stats_.dequeued;
+      stats_.total_delay += delay;
+      stats_.max_delay = std::max(stats_.max_delay, delay);
       handler(next_crash);
     }
+
+    if (num_queued_requests_ == 0 && stats_.dequeued + stats_.coalesced + stats_.rejected != 0) {
+      log_and_reset_stats();
+    }
   }
 
   void on_crash_started() { ++num_concurrent_dumps_; }
@@ -177,6 +270,73 @@ class CrashQueue {
     next_artifact_ = oldest_tombstone;
   }
 
+  bool check_rate_limit(uid_t uid) {
+    if (max_requests_per_uid_ == 0) {
+      return true;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    RateLimit& limit = rate_limits_[uid];
+    if (limit.requests == 0 || now - limit.window_start >= kRateLimitWindow) {
+      limit.window_start = now;
+      limit.requests = 0;
+    }
+    return ++limit.requests <= max_requests_per_uid_;
+  }
+
+  // Finds a queued request that is most likely the same crash again, e.g. a
+  // process in a crash loop. Native and java backtraces are only ever the
+  // same if they are for the same pid.
+  const Crash* find_identical(const Crash* crash) {
+    for (const Crash* queued : queued_requests_[crash_priority(crash->crash_type)]) {
+      if (queued->intercepted || queued->crash_type != crash->crash_type) {
+        continue;
+      }
+      if (queued->crash_pid == crash->crash_pid) {
+        return queued;
+      }
+      if (crash->crash_type == kDebuggerdTombstone && queued->crash_uid == crash->crash_uid &&
+          !crash->cmdline.empty() && queued->cmdline == crash->cmdline) {
+        return queued;
+      }
+    }
+    return nullptr;
+  }
+
+  // Makes room in a full queue by dropping the newest request that has a
+  // lower priority than the given one, if there is one.
+  bool drop_lower_priority(CrashPriority priority) {
+    for (size_t i = kCrashPriorityCount - 1; i > priority; --i) {
+      std::deque<Crash*>& queue = queued_requests_[i];
+      for (auto it = queue.rbegin(); it != queue.rend(); ++it) {
+        Crash* dropped = *it;
+        if (dropped->intercepted) {
+          continue;
+        }
+        LOG(WARNING) << "dropping queued crash request for pid " << dropped->crash_pid
+                     << " to make room";
+        queue.erase(std::next(it).base());
+        --num_queued_requests_;
+        ++stats_.rejected;
+        delete dropped;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void log_and_reset_stats() {
+    std::chrono::milliseconds average_delay(0);
+    if (stats_.dequeued != 0) {
+      average_delay = stats_.total_delay / static_cast<int>(stats_.dequeued);
+    }
+    LOG(INFO) << "crash queue for " << dir_path_ << " drained: " << stats_.dequeued
+              << " queued (average delay " << average_delay.count() << "ms, max "
+              << stats_.max_delay.count() << "ms), " << stats_.coalesced << " coalesced, "
+              << stats_.rejected << " rejected";
+    stats_ = {};
+  }
+
   const std::string file_name_prefix_;
 
   const std::string dir_path_;
@@ -188,7 +348,28 @@ class CrashQueue {
   const size_t max_concurrent_dumps_;
   size_t num_concurrent_dumps_;
 
-  std::deque<Crash*> queued_requests_;
+  const size_t max_queued_requests_;
+  size_t num_queued_requests_;
+  std::array<std::deque<Crash*>, kCrashPriorityCount> queued_requests_;
+
+  // Each uid may make max_requests_per_uid_ requests per kRateLimitWindow,
+  // zero means there is no limit.
+  struct RateLimit {
+    std::chrono::steady_clock::time_point window_start;
+    size_t requests = 0;
+  };
+  const size_t max_requests_per_uid_;
+  std::unordered_map<uid_t, RateLimit> rate_limits_;
+
+  // Collected from when requests start to back up until the queue is empty.
+  struct Stats {
+    size_t dequeued = 0;
+    size_t coalesced = 0;
+    size_t rejected = 0;
+    std::chrono::milliseconds total_delay{0};
+    std::chrono::milliseconds max_delay{0};
+  };
+  Stats stats_;
 
   DISALLOW_COPY_AND_ASSIGN(CrashQueue);
 };
@@ -202,14 +383,22 @@ static void crash_request_cb(evutil_socket_t sockfd, short ev, void* arg);
 static void crash_completed_cb(evutil_socket_t sockfd, short ev, void* arg);
 
 static void perform_request(Crash* crash) {
+  // Only tombstones that go to the rotated files are compressed, whoever
+  // intercepts a dump gets plain text.
+  static const bool compress_tombstones =
+      GetBoolProperty("tombstoned.compress_tombstones", false);
+  bool compress = false;
+
   unique_fd output_fd;
   if (!intercept_manager->GetIntercept(crash->crash_pid, crash->crash_type, &output_fd)) {
     std::tie(output_fd, crash->crash_path) = CrashQueue::for_crash(crash)->get_output();
+    compress = compress_tombstones && crash->crash_type == kDebuggerdTombstone;
   }
 
   TombstonedCrashPacket response = {
     .packet_type = CrashPacketType::kPerformDump
   };
+  response.packet.perform_dump.compress = compress;
   ssize_t rc = send_fd(crash->crash_fd, &response, sizeof(response), std::move(output_fd));
   if (rc == -1) {
     PLOG(WARNING) << "failed to send response to CrashRequest";
@@ -284,12 +473,10 @@ static void crash_request_cb(evutil_socket_t sockfd, short ev, void* arg) {
     goto fail;
   }
 
-  if (crash->crash_type != kDebuggerdJavaBacktrace) {
-    crash->crash_pid = request.packet.dump_request.pid;
-  } else {
+  {
     // Requests for java traces are sent from untrusted processes, so we
     // must not trust the PID sent down with the request. Instead, we ask the
-    // kernel.
+    // kernel. The uid is used for rate limiting all requests.
     ucred cr = {};
     socklen_t len = sizeof(cr);
     int ret = getsockopt(sockfd, SOL_SOCKET, SO_PEERCRED, &cr, &len);
@@ -298,15 +485,29 @@ static void crash_request_cb(evutil_socket_t sockfd, short ev, void* arg) {
       goto fail;
     }
 
-    crash->crash_pid = cr.pid;
+    crash->crash_uid = cr.uid;
+    if (crash->crash_type != kDebuggerdJavaBacktrace) {
+      crash->crash_pid = request.packet.dump_request.pid;
+    } else {
+      crash->crash_pid = cr.pid;
+    }
   }
 
   LOG(INFO) << "received crash request for pid " << crash->crash_pid;
 
-  if (CrashQueue::for_crash(crash)->maybe_enqueue_crash(crash)) {
-    LOG(INFO) << "enqueueing crash request for pid " << crash->crash_pid;
-  } else {
-    perform_request(crash);
+  crash->intercepted = intercept_manager->HasIntercept(crash->crash_pid);
+  ReadFileToString(StringPrintf("/proc/%d/cmdline", crash->crash_pid), &crash->cmdline);
+
+  switch (CrashQueue::for_crash(crash)->maybe_enqueue_crash(crash)) {
+    case kCrashStatusRunning:
+      perform_request(crash);
+      break;
+    case kCrashStatusQueued:
+      LOG(INFO) << "enqueueing crash request for pid " << crash->crash_pid;
+      break;
+    case kCrashStatusCoalesced:
+    case kCrashStatusRejected:
+      goto fail;
   }
 
   return;
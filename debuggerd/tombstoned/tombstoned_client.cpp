@@ -31,7 +31,7 @@
 using android::base::unique_fd;
 
 bool tombstoned_connect(pid_t pid, unique_fd* tombstoned_socket, unique_fd* output_fd,
-                        DebuggerdDumpType dump_type) {
+                        DebuggerdDumpType dump_type, bool* compress_output) {
   unique_fd sockfd(
       socket_local_client((dump_type != kDebuggerdJavaBacktrace ? kTombstonedCrashSocketName
                                                                 : kTombstonedJavaTraceSocketName),
@@ -75,6 +75,11 @@ bool tombstoned_connect(pid_t pid, unique_fd* tombstoned_socket, unique_fd* outp
                           strerror(errno));
   }
 
+  if (compress_output != nullptr) {
+    *compress_output = packet.packet_type == CrashPacketType::kPerformDump &&
+                       packet.packet.perform_dump.compress;
+  }
+
   *tombstoned_socket = std::move(sockfd);
   *output_fd = std::move(tmp_output_fd);
   return true;
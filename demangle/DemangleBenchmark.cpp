@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <demangle.h>
+
+#include "Demangler.h"
+
+// A mix of names of the sort found in tombstones and profiles.
+static const char* kNames[] = {
+  "_ZN7android6Parcel13continueWriteEm",
+  "_ZN7android6Thread11_threadLoopEPv",
+  "_ZN3art9ArtMethod6InvokeEPNS_6ThreadEPjjPNS_6JValueEPKc",
+  "_ZNSt3__16vectorIiNS_9allocatorIiEEE9push_backERKi",
+  "_ZN3one3twoIiEEvv",
+  "_ZNK7android7RefBase9incStrongEPKv",
+  "_ZN1a1b1cES0_",
+  "_ZN3one3twoEPFviE",
+  "__libc_init",
+  "main",
+};
+static constexpr size_t kNumNames = sizeof(kNames) / sizeof(kNames[0]);
+
+static void BM_parse_new_demangler(benchmark::State& state) {
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    Demangler demangler;
+    benchmark::DoNotOptimize(demangler.Parse(kNames[i++ % kNumNames]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_parse_new_demangler);
+
+static void BM_parse_reused_demangler(benchmark::State& state) {
+  Demangler demangler;
+  std::string demangled;
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    demangler.ParseInto(kNames[i++ % kNumNames], &demangled);
+    benchmark::DoNotOptimize(demangled.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_parse_reused_demangler);
+
+static void BM_demangle_cached(benchmark::State& state) {
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(demangle(kNames[i++ % kNumNames]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_demangle_cached);
+
+static void BM_demangle_cached_buffer(benchmark::State& state) {
+  char buf[256];
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(demangle(kNames[i++ % kNumNames], buf, sizeof(buf)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_demangle_cached_buffer);
+
+BENCHMARK_MAIN();
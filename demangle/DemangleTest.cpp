@@ -449,3 +449,49 @@ TEST(DemangleTest, demangle) {
   str = demangle("Xa");
   ASSERT_EQ("Xa", str);
 }
+
+TEST(DemangleTest, ParseInto) {
+  Demangler demangler;
+  std::string str;
+
+  ASSERT_TRUE(demangler.ParseInto("_ZN3one3twoIiEEv", &str));
+  ASSERT_EQ("one::two<int>()", str);
+
+  // Reusing the same demangler and output must not leak earlier state.
+  ASSERT_TRUE(demangler.ParseInto("_ZN1a1b1cES0_", &str));
+  ASSERT_EQ("a::b::c(a::b)", str);
+
+  ASSERT_FALSE(demangler.ParseInto("_Za", &str));
+  ASSERT_EQ("_Za", str);
+
+  ASSERT_FALSE(demangler.ParseInto("Xa", &str));
+  ASSERT_EQ("Xa", str);
+
+  ASSERT_TRUE(demangler.ParseInto("_ZN3one3twoEPFviE", &str));
+  ASSERT_EQ("one::two(void (*)(int))", str);
+}
+
+TEST(DemangleTest, demangle_repeated) {
+  // The second lookup is served from the cache.
+  for (size_t i = 0; i < 2; i++) {
+    ASSERT_EQ("a::b::c(a::b)", demangle("_ZN1a1b1cES0_"));
+    ASSERT_EQ("one::two<int>()", demangle("_ZN3one3twoIiEEv"));
+    ASSERT_EQ("_Za", demangle("_Za"));
+  }
+}
+
+TEST(DemangleTest, demangle_buffer) {
+  char buf[16];
+
+  ASSERT_EQ(13U, demangle("_ZN1a1b1cES0_", buf, sizeof(buf)));
+  ASSERT_STREQ("a::b::c(a::b)", buf);
+
+  ASSERT_EQ(2U, demangle("Xa", buf, sizeof(buf)));
+  ASSERT_STREQ("Xa", buf);
+
+  // Truncated output is still nul terminated.
+  ASSERT_EQ(13U, demangle("_ZN1a1b1cES0_", buf, 8));
+  ASSERT_STREQ("a::b::c", buf);
+
+  ASSERT_EQ(13U, demangle("_ZN1a1b1cES0_", nullptr, 0));
+}
@@ -15,9 +15,11 @@
  */
 
 #include <assert.h>
+#include <string.h>
 
+#include <algorithm>
 #include <cctype>
-#include <stack>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -32,18 +34,38 @@ void Demangler::Save(const std::string& str, bool is_name) {
   last_save_name_ = is_name;
 }
 
-std::string Demangler::GetArgumentsString() {
-  size_t num_args = cur_state_.args.size();
-  std::string arg_str;
-  if (num_args > 0) {
-    arg_str = cur_state_.args[0];
-    for (size_t i = 1; i < num_args; i++) {
-      arg_str += ", " + cur_state_.args[i];
+static void AppendArguments(const std::vector<std::string>& args, std::string* str) {
+  for (size_t i = 0; i < args.size(); i++) {
+    if (i != 0) {
+      *str += ", ";
     }
+    *str += args[i];
   }
+}
+
+std::string Demangler::GetArgumentsString() {
+  std::string arg_str;
+  AppendArguments(cur_state_.args, &arg_str);
   return arg_str;
 }
 
+void Demangler::AppendArgumentsString(std::string* str) {
+  AppendArguments(cur_state_.args, str);
+}
+
+void Demangler::PushState() {
+  if (state_depth_ == state_stack_.size()) {
+    state_stack_.emplace_back();
+  }
+  std::swap(cur_state_, state_stack_[state_depth_++]);
+  cur_state_.Clear();
+}
+
+void Demangler::PopState() {
+  assert(state_depth_ > 0);
+  std::swap(cur_state_, state_stack_[--state_depth_]);
+}
+
 const char* Demangler::AppendOperatorString(const char* name) {
   const char* oper = nullptr;
   switch (*name) {
@@ -392,10 +414,11 @@ const char* Demangler::ParseComplexArgument(const char* name) {
 }
 
 void Demangler::FinalizeTemplate() {
-  std::string arg_str(GetArgumentsString());
-  cur_state_ = state_stack_.top();
-  state_stack_.pop();
-  cur_state_.str += '<' + arg_str + '>';
+  PopState();
+  // The template arguments are now in the state that was just popped.
+  cur_state_.str += '<';
+  AppendArguments(state_stack_[state_depth_].args, &cur_state_.str);
+  cur_state_.str += '>';
 }
 
 const char* Demangler::ParseComplexString(const char* name) {
@@ -454,8 +477,7 @@ const char* Demangler::ParseComplexString(const char* name) {
   }
   if (*name == 'I') {
     // Save the current argument state.
-    state_stack_.push(cur_state_);
-    cur_state_.Clear();
+    PushState();
 
     parse_funcs_.push_back(parse_func_);
     parse_func_ = &Demangler::ParseTemplateArgumentsComplex;
@@ -507,8 +529,7 @@ const char* Demangler::ParseFunctionArgument(const char* name) {
     }
     str += cur_state_.args[0];
 
-    cur_state_ = state_stack_.top();
-    state_stack_.pop();
+    PopState();
     cur_state_.args.emplace_back(std::move(str));
 
     parse_func_ = parse_funcs_.back();
@@ -568,9 +589,7 @@ const char* Demangler::ParseArguments(const char* name) {
       }
     }
 
-    state_stack_.push(cur_state_);
-
-    cur_state_.Clear();
+    PushState();
 
     // The function parameter has this format:
     //   First argument is the function modifier.
@@ -620,8 +639,7 @@ const char* Demangler::ParseArguments(const char* name) {
 
   case 'I':
     // Save the current argument state.
-    state_stack_.push(cur_state_);
-    cur_state_.Clear();
+    PushState();
 
     parse_funcs_.push_back(parse_func_);
     parse_func_ = &Demangler::ParseTemplateArguments;
@@ -709,10 +727,11 @@ const char* Demangler::FindFunctionName(const char* name) {
   return name;
 }
 
-std::string Demangler::Parse(const char* name, size_t max_length) {
+bool Demangler::ParseInto(const char* name, std::string* demangled, size_t max_length) {
   if (name[0] == '\0' || name[0] != '_' || name[1] == '\0' || name[1] != 'Z') {
     // Name is not mangled.
-    return name;
+    demangled->assign(name);
+    return false;
   }
 
   Clear();
@@ -726,23 +745,63 @@ std::string Demangler::Parse(const char* name, size_t max_length) {
   }
   if (cur_name == nullptr || *cur_name != '\0' || function_name_.empty() ||
       !cur_state_.suffixes.empty()) {
-    return name;
+    demangled->assign(name);
+    return false;
   }
 
-  std::string arg_str;
+  demangled->assign(function_name_);
   if (cur_state_.args.size() == 1 && cur_state_.args[0] == "void") {
     // If the only argument is void, then don't print any args.
-    arg_str = "()";
-  } else {
-    arg_str = GetArgumentsString();
-    if (!arg_str.empty()) {
-      arg_str = '(' + arg_str + ')';
-    }
+    *demangled += "()";
+  } else if (!cur_state_.args.empty()) {
+    *demangled += '(';
+    AppendArgumentsString(demangled);
+    *demangled += ')';
+  }
+  *demangled += function_suffix_;
+  return true;
+}
+
+std::string Demangler::Parse(const char* name, size_t max_length) {
+  std::string demangled;
+  ParseInto(name, &demangled, max_length);
+  return demangled;
+}
+
+// Symbolizers tend to see the same few functions over and over, so keep the
+// most recent results around. The cache is simply dropped once it is full.
+static constexpr size_t kMaxCacheEntries = 1024;
+
+static const std::string& DemangleCached(const char* name) {
+  thread_local Demangler demangler;
+  thread_local std::map<std::string, std::string, std::less<>> cache;
+  thread_local std::string scratch;
+
+  if (name[0] != '_' || name[1] != 'Z') {
+    scratch.assign(name);
+    return scratch;
+  }
+  auto entry = cache.find(name);
+  if (entry != cache.end()) {
+    return entry->second;
   }
-  return function_name_ + arg_str + function_suffix_;
+  demangler.ParseInto(name, &scratch);
+  if (cache.size() >= kMaxCacheEntries) {
+    cache.clear();
+  }
+  return cache.emplace(name, scratch).first->second;
 }
 
 std::string demangle(const char* name) {
-  Demangler demangler;
-  return demangler.Parse(name);
+  return DemangleCached(name);
+}
+
+size_t demangle(const char* name, char* buf, size_t buf_size) {
+  const std::string& demangled = DemangleCached(name);
+  if (buf_size > 0) {
+    size_t copy = std::min(demangled.size(), buf_size - 1);
+    memcpy(buf, demangled.data(), copy);
+    buf[copy] = '\0';
+  }
+  return demangled.size();
 }
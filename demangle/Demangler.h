@@ -19,7 +19,6 @@
 
 #include <assert.h>
 
-#include <stack>
 #include <string>
 #include <vector>
 
@@ -33,10 +32,17 @@ class Demangler {
   // is checked.
   std::string Parse(const char* name, size_t max_length = kMaxDefaultLength);
 
+  // Same as Parse, but the result is written into *demangled so that its
+  // storage can be reused across calls. Returns false, and sets *demangled
+  // to name, if the name could not be demangled.
+  bool ParseInto(const char* name, std::string* demangled,
+                 size_t max_length = kMaxDefaultLength);
+
   void AppendCurrent(const std::string& str);
   void AppendCurrent(const char* str);
   void AppendArgument(const std::string& str);
   std::string GetArgumentsString();
+  void AppendArgumentsString(std::string* str);
   void FinalizeTemplate();
   const char* ParseS(const char* name);
   const char* AppendOperatorString(const char* name);
@@ -50,12 +56,13 @@ class Demangler {
     first_save_.clear();
     cur_state_.Clear();
     saves_.clear();
-    while (!state_stack_.empty()) {
-      state_stack_.pop();
-    }
+    state_depth_ = 0;
     last_save_name_ = false;
   }
 
+  void PushState();
+  void PopState();
+
   using parse_func_type = const char* (Demangler::*)(const char*);
   parse_func_type parse_func_;
   std::vector<parse_func_type> parse_funcs_;
@@ -80,7 +87,11 @@ class Demangler {
     std::vector<std::string> suffixes;
     std::string last_save;
   };
-  std::stack<StateData> state_stack_;
+  // Saved states are swapped in and out of this vector rather than copied,
+  // and the entries above state_depth_ are kept so that their string
+  // storage is reused by the next Parse.
+  std::vector<StateData> state_stack_;
+  size_t state_depth_ = 0;
   std::string first_save_;
   StateData cur_state_;
 
@@ -17,6 +17,8 @@
 #ifndef __LIB_DEMANGLE_H_
 #define __LIB_DEMANGLE_H_
 
+#include <stddef.h>
+
 #include <string>
 
 // If the name cannot be demangled, the original name will be returned as
@@ -24,4 +26,14 @@
 // will be returned as a std::string.
 std::string demangle(const char* name);
 
+// Same as above, but writes the result into buf, truncating it if needed
+// and always nul terminating it when buf_size is non-zero. Returns the
+// length of the full result, not counting the nul, so a return value of
+// buf_size or more means the output was truncated.
+//
+// Both variants reuse per-thread parser state and remember recently
+// demangled names, so a repeated name is not parsed again and the buffer
+// variant does not allocate for it.
+size_t demangle(const char* name, char* buf, size_t buf_size);
+
 #endif  // __LIB_DEMANGLE_H_
@@ -70,8 +70,14 @@ struct Action {
     double start;
 };
 
-static Action *action_list = 0;
-static Action *action_last = 0;
+// Each thread builds and runs its own queue, one per device.
+static thread_local Action *action_list = 0;
+static thread_local Action *action_last = 0;
+static thread_local std::string g_log_prefix;
+
+void fb_set_log_prefix(const std::string& prefix) {
+    g_log_prefix = prefix;
+}
 
 
 
@@ -91,10 +97,10 @@ bool fb_getvar(Transport* transport, const std::string& key, std::string* value)
 
 static int cb_default(Action* a, int status, const char* resp) {
     if (status) {
-        fprintf(stderr,"FAILED (%s)\n", resp);
+        fprintf(stderr, "%sFAILED (%s)\n", g_log_prefix.c_str(), resp);
     } else {
         double split = now();
-        fprintf(stderr,"OKAY [%7.3fs]\n", (split - a->start));
+        fprintf(stderr, "%sOKAY [%7.3fs]\n", g_log_prefix.c_str(), (split - a->start));
         a->start = split;
     }
     return status;
@@ -177,7 +183,7 @@ void fb_queue_flash_sparse(const char* ptn, struct sparse_file* s, uint32_t sz,
 
     a = queue_action(OP_DOWNLOAD_SPARSE, "");
     a->data = s;
-    a->size = 0;
+    a->size = sz;
     a->msg = mkmsg("sending sparse '%s' %zu/%zu (%d KB)", ptn, current, total, sz / 1024);
 
     a = queue_action(OP_COMMAND, "flash:%s", ptn);
@@ -215,15 +221,15 @@ static int cb_check(Action* a, int status, const char* resp, int invert)
     int yes;
 
     if (status) {
-        fprintf(stderr,"FAILED (%s)\n", resp);
+        fprintf(stderr, "%sFAILED (%s)\n", g_log_prefix.c_str(), resp);
         return status;
     }
 
     if (a->prod) {
         if (strcmp(a->prod, cur_product) != 0) {
             double split = now();
-            fprintf(stderr,"IGNORE, product is %s required only for %s [%7.3fs]\n",
-                    cur_product, a->prod, (split - a->start));
+            fprintf(stderr, "%sIGNORE, product is %s required only for %s [%7.3fs]\n",
+                    g_log_prefix.c_str(), cur_product, a->prod, (split - a->start));
             a->start = split;
             return 0;
         }
@@ -234,14 +240,14 @@ static int cb_check(Action* a, int status, const char* resp, int invert)
 
     if (yes) {
         double split = now();
-        fprintf(stderr,"OKAY [%7.3fs]\n", (split - a->start));
+        fprintf(stderr, "%sOKAY [%7.3fs]\n", g_log_prefix.c_str(), (split - a->start));
         a->start = split;
         return 0;
     }
 
-    fprintf(stderr,"FAILED\n\n");
-    fprintf(stderr,"Device %s is '%s'.\n", a->cmd + 7, resp);
-    fprintf(stderr,"Update %s '%s'",
+    fprintf(stderr, "%sFAILED\n\n", g_log_prefix.c_str());
+    fprintf(stderr, "%sDevice %s is '%s'.\n", g_log_prefix.c_str(), a->cmd + 7, resp);
+    fprintf(stderr, "%sUpdate %s '%s'", g_log_prefix.c_str(),
             invert ? "rejects" : "requires", value[0]);
     for (n = 1; n < count; n++) {
         fprintf(stderr," or '%s'", value[n]);
@@ -279,10 +285,10 @@ void fb_queue_require(const char *prod, const char *var,
 
 static int cb_display(Action* a, int status, const char* resp) {
     if (status) {
-        fprintf(stderr, "%s FAILED (%s)\n", a->cmd, resp);
+        fprintf(stderr, "%s%s FAILED (%s)\n", g_log_prefix.c_str(), a->cmd, resp);
         return status;
     }
-    fprintf(stderr, "%s: %s\n", static_cast<const char*>(a->data), resp);
+    fprintf(stderr, "%s%s: %s\n", g_log_prefix.c_str(), static_cast<const char*>(a->data), resp);
     free(static_cast<char*>(a->data));
     return 0;
 }
@@ -295,7 +301,7 @@ void fb_queue_display(const char* var, const char* prettyname) {
 
 static int cb_save(Action* a, int status, const char* resp) {
     if (status) {
-        fprintf(stderr, "%s FAILED (%s)\n", a->cmd, resp);
+        fprintf(stderr, "%s%s FAILED (%s)\n", g_log_prefix.c_str(), a->cmd, resp);
         return status;
     }
     strncpy(reinterpret_cast<char*>(a->data), resp, a->size);
@@ -372,12 +378,20 @@ int64_t fb_execute_queue(Transport* transport)
     resp[FB_RESPONSE_SZ] = 0;
 
     double start = -1;
+    double send_time = 0;
+    double send_bytes = 0;
+    double command_time = 0;
     for (a = action_list; a; a = a->next) {
         a->start = now();
         if (start < 0) start = a->start;
+        double action_start = a->start;
+        // Read the next sparse image in the background while the device works on this action.
+        if (a->op != OP_DOWNLOAD_SPARSE && a->next && a->next->op == OP_DOWNLOAD_SPARSE) {
+            fb_prepare_sparse(reinterpret_cast<sparse_file*>(a->next->data));
+        }
         if (a->msg) {
             // fprintf(stderr,"%30s... ",a->msg);
-            fprintf(stderr,"%s...\n",a->msg);
+            fprintf(stderr, "%s%s...\n", g_log_prefix.c_str(), a->msg);
         }
         if (a->op == OP_DOWNLOAD) {
             status = fb_download_data(transport, a->data, a->size);
@@ -396,7 +410,7 @@ int64_t fb_execute_queue(Transport* transport)
             status = a->func(a, status, status ? fb_get_error().c_str() : resp);
             if (status) break;
         } else if (a->op == OP_NOTICE) {
-            fprintf(stderr,"%s\n",(char*)a->data);
+            fprintf(stderr, "%s%s\n", g_log_prefix.c_str(), (char*)a->data);
         } else if (a->op == OP_DOWNLOAD_SPARSE) {
             status = fb_download_data_sparse(transport, reinterpret_cast<sparse_file*>(a->data));
             status = a->func(a, status, status ? fb_get_error().c_str() : "");
@@ -409,8 +423,22 @@ int64_t fb_execute_queue(Transport* transport)
         } else {
             die("bogus action");
         }
-    }
 
-    fprintf(stderr,"finished. total time: %.3fs\n", (now() - start));
+        double elapsed = now() - action_start;
+        if (a->op == OP_DOWNLOAD || a->op == OP_DOWNLOAD_FD || a->op == OP_DOWNLOAD_SPARSE) {
+            send_time += elapsed;
+            send_bytes += a->size;
+        } else if (a->op == OP_COMMAND || a->op == OP_QUERY) {
+            command_time += elapsed;
+        }
+    }
+    fb_prepare_sparse(nullptr);
+
+    fprintf(stderr,
+            "%ssending: %.3fs at %.1f MB/s (waiting for host data: %.3fs), commands: %.3fs\n",
+            g_log_prefix.c_str(), send_time,
+            send_time > 0 ? send_bytes / send_time / (1024 * 1024) : 0.0,
+            fb_get_sparse_wait_time(), command_time);
+    fprintf(stderr, "%sfinished. total time: %.3fs\n", g_log_prefix.c_str(), (now() - start));
     return status;
 }
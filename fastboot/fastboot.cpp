@@ -43,6 +43,9 @@
 
 #include <chrono>
 #include <functional>
+#include <map>
+#include <mutex>
+#include <string>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -73,7 +76,7 @@ using android::base::unique_fd;
 #define O_BINARY 0
 #endif
 
-char cur_product[FB_RESPONSE_SZ + 1];
+thread_local char cur_product[FB_RESPONSE_SZ + 1];
 
 static const char* serial = nullptr;
 static const char* cmdline = nullptr;
@@ -84,7 +87,7 @@ static int long_listing = 0;
 // let's keep it at 1GB to avoid memory pressure on the host.
 static constexpr int64_t RESPARSE_LIMIT = 1 * 1024 * 1024 * 1024;
 static int64_t sparse_limit = -1;
-static int64_t target_sparse_limit = -1;
+static thread_local int64_t target_sparse_limit = -1;
 
 static unsigned page_size = 2048;
 static unsigned base_addr      = 0x10000000;
@@ -239,16 +242,11 @@ static int list_devices_callback(usb_ifc_info* info) {
 // If |serial| is non-null but invalid, this prints an error message to stderr and returns nullptr.
 // Otherwise it blocks until the target is available.
 //
-// The returned Transport is a singleton, so multiple calls to this function will return the same
-// object, and the caller should not attempt to delete the returned Transport.
+// Each call opens a new Transport, which the caller should not attempt to delete.
 static Transport* open_device() {
-    static Transport* transport = nullptr;
+    Transport* transport = nullptr;
     bool announce = true;
 
-    if (transport != nullptr) {
-        return transport;
-    }
-
     Socket::Protocol protocol = Socket::Protocol::kTcp;
     std::string host;
     int port = 0;
@@ -388,6 +386,9 @@ static int show_help() {
             "                                           For ethernet, provide an address in the\n"
             "                                           form <protocol>:<hostname>[:port] where\n"
             "                                           <protocol> is either tcp or udp.\n"
+            "                                           Give several devices separated by\n"
+            "                                           commas to run the same commands on\n"
+            "                                           all of them at once.\n"
             "  -c <cmdline>                             Override kernel commandline.\n"
             "  -i <vendor id>                           Specify a custom USB vendor id.\n"
             "  -b, --base <base_addr>                   Specify a custom kernel base\n"
@@ -846,6 +847,12 @@ static bool load_buf_fd(Transport* transport, int fd, struct fastboot_buffer* bu
     return true;
 }
 
+// Resparsed images by path and sparse limit. When several devices are flashed at once, the
+// first one to need an image reads and resparses it and the others reuse the result. The
+// Windows build reads file-backed chunks through the shared file offset, so it doesn't share.
+static std::mutex g_sparse_cache_lock;
+static std::map<std::pair<std::string, int64_t>, sparse_file**> g_sparse_cache;
+
 static bool load_buf(Transport* transport, const char* fname, struct fastboot_buffer* buf) {
     unique_fd fd(TEMP_FAILURE_RETRY(open(fname, O_RDONLY | O_BINARY)));
 
@@ -862,7 +869,30 @@ static bool load_buf(Transport* transport, const char* fname, struct fastboot_bu
         return false;
     }
 
-    return load_buf_fd(transport, fd.release(), buf);
+    int64_t limit = get_sparse_limit(transport, s.st_size);
+#if defined(_WIN32)
+    limit = 0;
+#endif
+    if (limit == 0) {
+        return load_buf_fd(transport, fd.release(), buf);
+    }
+
+    std::lock_guard<std::mutex> lock(g_sparse_cache_lock);
+    auto key = std::make_pair(std::string(fname), limit);
+    auto it = g_sparse_cache.find(key);
+    if (it != g_sparse_cache.end()) {
+        buf->type = FB_BUFFER_SPARSE;
+        buf->data = it->second;
+        return true;
+    }
+
+    if (!load_buf_fd(transport, fd.release(), buf)) {
+        return false;
+    }
+    if (buf->type == FB_BUFFER_SPARSE) {
+        g_sparse_cache[key] = reinterpret_cast<sparse_file**>(buf->data);
+    }
+    return true;
 }
 
 static void rewrite_vbmeta_buffer(struct fastboot_buffer* buf) {
@@ -1487,6 +1517,42 @@ failed:
     fprintf(stderr, "FAILED (%s)\n", fb_get_error().c_str());
 }
 
+// Runs |run| against each of |serials| at once, on its own thread with its own command queue,
+// and reports how each device did. A failure on one device doesn't stop the others.
+static int run_on_devices(const std::vector<std::string>& serials,
+                          const std::function<int(Transport*)>& run) {
+    std::vector<Transport*> transports;
+    for (const auto& device_serial : serials) {
+        // open_device() and match_fastboot() identify the device by |serial|.
+        serial = device_serial.c_str();
+        Transport* transport = open_device();
+        if (transport == nullptr) {
+            return 1;
+        }
+        transports.push_back(transport);
+    }
+
+    std::vector<int> results(serials.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < serials.size(); ++i) {
+        threads.emplace_back([&, i]() {
+            fb_set_log_prefix(serials[i] + ": ");
+            std::function<int(Transport*)> device_run = run;
+            results[i] = device_run(transports[i]);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < serials.size(); ++i) {
+        fprintf(stderr, "%s: %s\n", serials[i].c_str(), results[i] ? "FAILED" : "OKAY");
+        if (results[i]) status = EXIT_FAILURE;
+    }
+    return status;
+}
+
 int main(int argc, char **argv)
 {
     bool wants_wipe = false;
@@ -1643,246 +1709,260 @@ int main(int argc, char **argv)
         return show_help();
     }
 
-    Transport* transport = open_device();
-    if (transport == nullptr) {
-        return 1;
-    }
-
-    if (!supports_AB(transport) && supports_AB_obsolete(transport)) {
-        fprintf(stderr, "Warning: Device A/B support is outdated. Bootloader update required.\n");
-    }
-    if (slot_override != "") slot_override = verify_slot(transport, slot_override);
-    if (next_active != "") next_active = verify_slot(transport, next_active, false);
-
-    if (wants_set_active) {
-        if (next_active == "") {
-            if (slot_override == "") {
-                std::string current_slot;
-                if (fb_getvar(transport, "current-slot", &current_slot)) {
-                    next_active = verify_slot(transport, current_slot, false);
+    // Everything from here on talks to one device. It's run once per device, each on its own
+    // copy of the options above, so that several devices can be flashed at once.
+    auto run = [=](Transport* transport) mutable -> int {
+        if (!supports_AB(transport) && supports_AB_obsolete(transport)) {
+            fprintf(stderr, "Warning: Device A/B support is outdated. Bootloader update required.\n");
+        }
+        if (slot_override != "") slot_override = verify_slot(transport, slot_override);
+        if (next_active != "") next_active = verify_slot(transport, next_active, false);
+
+        if (wants_set_active) {
+            if (next_active == "") {
+                if (slot_override == "") {
+                    std::string current_slot;
+                    if (fb_getvar(transport, "current-slot", &current_slot)) {
+                        next_active = verify_slot(transport, current_slot, false);
+                    } else {
+                        wants_set_active = false;
+                    }
                 } else {
-                    wants_set_active = false;
+                    next_active = verify_slot(transport, slot_override, false);
                 }
-            } else {
-                next_active = verify_slot(transport, slot_override, false);
             }
         }
-    }
 
-    std::vector<std::string> args(argv, argv + argc);
-    while (!args.empty()) {
-        std::string command = next_arg(&args);
-
-        if (command == "getvar") {
-            std::string variable = next_arg(&args);
-            fb_queue_display(variable.c_str(), variable.c_str());
-        } else if (command == "erase") {
-            std::string partition = next_arg(&args);
-            auto erase = [&](const std::string& partition) {
-                std::string partition_type;
-                if (fb_getvar(transport, std::string("partition-type:") + partition,
-                              &partition_type) &&
-                    fs_get_generator(partition_type) != nullptr) {
-                    fprintf(stderr, "******** Did you mean to fastboot format this %s partition?\n",
-                            partition_type.c_str());
-                }
+        std::vector<std::string> args(argv, argv + argc);
+        while (!args.empty()) {
+            std::string command = next_arg(&args);
+
+            if (command == "getvar") {
+                std::string variable = next_arg(&args);
+                fb_queue_display(variable.c_str(), variable.c_str());
+            } else if (command == "erase") {
+                std::string partition = next_arg(&args);
+                auto erase = [&](const std::string& partition) {
+                    std::string partition_type;
+                    if (fb_getvar(transport, std::string("partition-type:") + partition,
+                                  &partition_type) &&
+                        fs_get_generator(partition_type) != nullptr) {
+                        fprintf(stderr, "******** Did you mean to fastboot format this %s partition?\n",
+                                partition_type.c_str());
+                    }
 
-                fb_queue_erase(partition.c_str());
-            };
-            do_for_partitions(transport, partition, slot_override, erase, true);
-        } else if (android::base::StartsWith(command, "format")) {
-            // Parsing for: "format[:[type][:[size]]]"
-            // Some valid things:
-            //  - select only the size, and leave default fs type:
-            //    format::0x4000000 userdata
-            //  - default fs type and size:
-            //    format userdata
-            //    format:: userdata
-            std::vector<std::string> pieces = android::base::Split(command, ":");
-            std::string type_override;
-            if (pieces.size() > 1) type_override = pieces[1].c_str();
-            std::string size_override;
-            if (pieces.size() > 2) size_override = pieces[2].c_str();
-
-            std::string partition = next_arg(&args);
-
-            auto format = [&](const std::string& partition) {
-                if (erase_first && needs_erase(transport, partition.c_str())) {
                     fb_queue_erase(partition.c_str());
+                };
+                do_for_partitions(transport, partition, slot_override, erase, true);
+            } else if (android::base::StartsWith(command, "format")) {
+                // Parsing for: "format[:[type][:[size]]]"
+                // Some valid things:
+                //  - select only the size, and leave default fs type:
+                //    format::0x4000000 userdata
+                //  - default fs type and size:
+                //    format userdata
+                //    format:: userdata
+                std::vector<std::string> pieces = android::base::Split(command, ":");
+                std::string type_override;
+                if (pieces.size() > 1) type_override = pieces[1].c_str();
+                std::string size_override;
+                if (pieces.size() > 2) size_override = pieces[2].c_str();
+
+                std::string partition = next_arg(&args);
+
+                auto format = [&](const std::string& partition) {
+                    if (erase_first && needs_erase(transport, partition.c_str())) {
+                        fb_queue_erase(partition.c_str());
+                    }
+                    fb_perform_format(transport, partition.c_str(), 0, type_override, size_override,
+                                      "");
+                };
+                do_for_partitions(transport, partition.c_str(), slot_override, format, true);
+            } else if (command == "signature") {
+                std::string filename = next_arg(&args);
+                data = load_file(filename.c_str(), &sz);
+                if (data == nullptr) die("could not load '%s': %s", filename.c_str(), strerror(errno));
+                if (sz != 256) die("signature must be 256 bytes");
+                fb_queue_download("signature", data, sz);
+                fb_queue_command("signature", "installing signature");
+            } else if (command == "reboot") {
+                wants_reboot = true;
+
+                if (args.size() == 1) {
+                    std::string what = next_arg(&args);
+                    if (what == "bootloader") {
+                        wants_reboot = false;
+                        wants_reboot_bootloader = true;
+                    } else if (what == "emergency") {
+                        wants_reboot = false;
+                        wants_reboot_emergency = true;
+                    } else {
+                        syntax_error("unknown reboot target %s", what.c_str());
+                    }
+
                 }
-                fb_perform_format(transport, partition.c_str(), 0, type_override, size_override,
-                                  "");
-            };
-            do_for_partitions(transport, partition.c_str(), slot_override, format, true);
-        } else if (command == "signature") {
-            std::string filename = next_arg(&args);
-            data = load_file(filename.c_str(), &sz);
-            if (data == nullptr) die("could not load '%s': %s", filename.c_str(), strerror(errno));
-            if (sz != 256) die("signature must be 256 bytes");
-            fb_queue_download("signature", data, sz);
-            fb_queue_command("signature", "installing signature");
-        } else if (command == "reboot") {
-            wants_reboot = true;
-
-            if (args.size() == 1) {
-                std::string what = next_arg(&args);
-                if (what == "bootloader") {
-                    wants_reboot = false;
-                    wants_reboot_bootloader = true;
-                } else if (what == "emergency") {
-                    wants_reboot = false;
-                    wants_reboot_emergency = true;
+                if (!args.empty()) syntax_error("junk after reboot command");
+            } else if (command == "reboot-bootloader") {
+                wants_reboot_bootloader = true;
+            } else if (command == "continue") {
+                fb_queue_command("continue", "resuming boot");
+            } else if (command == "boot") {
+                std::string kernel = next_arg(&args);
+                std::string ramdisk;
+                if (!args.empty()) ramdisk = next_arg(&args);
+                std::string second_stage;
+                if (!args.empty()) second_stage = next_arg(&args);
+
+                data = load_bootable_image(kernel, ramdisk, second_stage, &sz, cmdline);
+                fb_queue_download("boot.img", data, sz);
+                fb_queue_command("boot", "booting");
+            } else if (command == "flash") {
+                std::string pname = next_arg(&args);
+
+                std::string fname;
+                if (!args.empty()) {
+                    fname = next_arg(&args);
                 } else {
-                    syntax_error("unknown reboot target %s", what.c_str());
+                    fname = find_item(pname);
+                }
+                if (fname.empty()) die("cannot determine image filename for '%s'", pname.c_str());
+
+                auto flash = [&](const std::string &partition) {
+                    if (erase_first && needs_erase(transport, partition.c_str())) {
+                        fb_queue_erase(partition.c_str());
+                    }
+                    do_flash(transport, partition.c_str(), fname.c_str());
+                };
+                do_for_partitions(transport, pname.c_str(), slot_override, flash, true);
+            } else if (command == "flash:raw") {
+                std::string partition = next_arg(&args);
+                std::string kernel = next_arg(&args);
+                std::string ramdisk;
+                if (!args.empty()) ramdisk = next_arg(&args);
+                std::string second_stage;
+                if (!args.empty()) second_stage = next_arg(&args);
+
+                data = load_bootable_image(kernel, ramdisk, second_stage, &sz, cmdline);
+                auto flashraw = [&](const std::string& partition) {
+                    fb_queue_flash(partition.c_str(), data, sz);
+                };
+                do_for_partitions(transport, partition, slot_override, flashraw, true);
+            } else if (command == "flashall") {
+                if (slot_override == "all") {
+                    fprintf(stderr, "Warning: slot set to 'all'. Secondary slots will not be flashed.\n");
+                    do_flashall(transport, slot_override, erase_first, true);
+                } else {
+                    do_flashall(transport, slot_override, erase_first, skip_secondary);
+                }
+                wants_reboot = true;
+            } else if (command == "update") {
+                bool slot_all = (slot_override == "all");
+                if (slot_all) {
+                    fprintf(stderr, "Warning: slot set to 'all'. Secondary slots will not be flashed.\n");
                 }
+                std::string filename = "update.zip";
+                if (!args.empty()) {
+                    filename = next_arg(&args);
+                }
+                do_update(transport, filename.c_str(), slot_override, erase_first,
+                          skip_secondary || slot_all);
+                wants_reboot = true;
+            } else if (command == "set_active") {
+                std::string slot = verify_slot(transport, next_arg(&args), false);
+
+                // Legacy support: verify_slot() removes leading underscores, we need to put them
+                // back in for old bootloaders. Legacy bootloaders do not have the slot-count
+                // variable but do have slot-suffixes.
+                std::string var;
+                if (!fb_getvar(transport, "slot-count", &var) &&
+                        fb_getvar(transport, "slot-suffixes", &var)) {
+                    slot = "_" + slot;
+                }
+                fb_set_active(slot.c_str());
+            } else if (command == "stage") {
+                std::string filename = next_arg(&args);
 
-            }
-            if (!args.empty()) syntax_error("junk after reboot command");
-        } else if (command == "reboot-bootloader") {
-            wants_reboot_bootloader = true;
-        } else if (command == "continue") {
-            fb_queue_command("continue", "resuming boot");
-        } else if (command == "boot") {
-            std::string kernel = next_arg(&args);
-            std::string ramdisk;
-            if (!args.empty()) ramdisk = next_arg(&args);
-            std::string second_stage;
-            if (!args.empty()) second_stage = next_arg(&args);
-
-            data = load_bootable_image(kernel, ramdisk, second_stage, &sz, cmdline);
-            fb_queue_download("boot.img", data, sz);
-            fb_queue_command("boot", "booting");
-        } else if (command == "flash") {
-            std::string pname = next_arg(&args);
-
-            std::string fname;
-            if (!args.empty()) {
-                fname = next_arg(&args);
+                struct fastboot_buffer buf;
+                if (!load_buf(transport, filename.c_str(), &buf) || buf.type != FB_BUFFER_FD) {
+                    die("cannot load '%s'", filename.c_str());
+                }
+                fb_queue_download_fd(filename.c_str(), buf.fd, buf.sz);
+            } else if (command == "get_staged") {
+                std::string filename = next_arg(&args);
+                fb_queue_upload(filename.c_str());
+            } else if (command == "oem") {
+                do_oem_command("oem", &args);
+            } else if (command == "flashing") {
+                if (args.empty()) {
+                    syntax_error("missing 'flashing' command");
+                } else if (args.size() == 1 && (args[0] == "unlock" || args[0] == "lock" ||
+                                                args[0] == "unlock_critical" ||
+                                                args[0] == "lock_critical" ||
+                                                args[0] == "get_unlock_ability" ||
+                                                args[0] == "get_unlock_bootloader_nonce" ||
+                                                args[0] == "lock_bootloader")) {
+                    do_oem_command("flashing", &args);
+                } else if (args.size() == 2 && args[0] == "unlock_bootloader") {
+                    do_bypass_unlock_command(&args);
+                } else {
+                    syntax_error("unknown 'flashing' command %s", args[0].c_str());
+                }
             } else {
-                fname = find_item(pname);
+                syntax_error("unknown command %s", command.c_str());
             }
-            if (fname.empty()) die("cannot determine image filename for '%s'", pname.c_str());
+        }
 
-            auto flash = [&](const std::string &partition) {
-                if (erase_first && needs_erase(transport, partition.c_str())) {
-                    fb_queue_erase(partition.c_str());
+        if (wants_wipe) {
+            fprintf(stderr, "wiping userdata...\n");
+            fb_queue_erase("userdata");
+            if (set_fbe_marker) {
+                fprintf(stderr, "setting FBE marker...\n");
+                std::string initial_userdata_dir = create_fbemarker_tmpdir();
+                if (initial_userdata_dir.empty()) {
+                    return 1;
                 }
-                do_flash(transport, partition.c_str(), fname.c_str());
-            };
-            do_for_partitions(transport, pname.c_str(), slot_override, flash, true);
-        } else if (command == "flash:raw") {
-            std::string partition = next_arg(&args);
-            std::string kernel = next_arg(&args);
-            std::string ramdisk;
-            if (!args.empty()) ramdisk = next_arg(&args);
-            std::string second_stage;
-            if (!args.empty()) second_stage = next_arg(&args);
-
-            data = load_bootable_image(kernel, ramdisk, second_stage, &sz, cmdline);
-            auto flashraw = [&](const std::string& partition) {
-                fb_queue_flash(partition.c_str(), data, sz);
-            };
-            do_for_partitions(transport, partition, slot_override, flashraw, true);
-        } else if (command == "flashall") {
-            if (slot_override == "all") {
-                fprintf(stderr, "Warning: slot set to 'all'. Secondary slots will not be flashed.\n");
-                do_flashall(transport, slot_override, erase_first, true);
+                fb_perform_format(transport, "userdata", 1, "", "", initial_userdata_dir);
+                delete_fbemarker_tmpdir(initial_userdata_dir);
             } else {
-                do_flashall(transport, slot_override, erase_first, skip_secondary);
-            }
-            wants_reboot = true;
-        } else if (command == "update") {
-            bool slot_all = (slot_override == "all");
-            if (slot_all) {
-                fprintf(stderr, "Warning: slot set to 'all'. Secondary slots will not be flashed.\n");
+                fb_perform_format(transport, "userdata", 1, "", "", "");
             }
-            std::string filename = "update.zip";
-            if (!args.empty()) {
-                filename = next_arg(&args);
-            }
-            do_update(transport, filename.c_str(), slot_override, erase_first,
-                      skip_secondary || slot_all);
-            wants_reboot = true;
-        } else if (command == "set_active") {
-            std::string slot = verify_slot(transport, next_arg(&args), false);
-
-            // Legacy support: verify_slot() removes leading underscores, we need to put them back
-            // in for old bootloaders. Legacy bootloaders do not have the slot-count variable but
-            // do have slot-suffixes.
-            std::string var;
-            if (!fb_getvar(transport, "slot-count", &var) &&
-                    fb_getvar(transport, "slot-suffixes", &var)) {
-                slot = "_" + slot;
-            }
-            fb_set_active(slot.c_str());
-        } else if (command == "stage") {
-            std::string filename = next_arg(&args);
 
-            struct fastboot_buffer buf;
-            if (!load_buf(transport, filename.c_str(), &buf) || buf.type != FB_BUFFER_FD) {
-                die("cannot load '%s'", filename.c_str());
-            }
-            fb_queue_download_fd(filename.c_str(), buf.fd, buf.sz);
-        } else if (command == "get_staged") {
-            std::string filename = next_arg(&args);
-            fb_queue_upload(filename.c_str());
-        } else if (command == "oem") {
-            do_oem_command("oem", &args);
-        } else if (command == "flashing") {
-            if (args.empty()) {
-                syntax_error("missing 'flashing' command");
-            } else if (args.size() == 1 && (args[0] == "unlock" || args[0] == "lock" ||
-                                            args[0] == "unlock_critical" ||
-                                            args[0] == "lock_critical" ||
-                                            args[0] == "get_unlock_ability" ||
-                                            args[0] == "get_unlock_bootloader_nonce" ||
-                                            args[0] == "lock_bootloader")) {
-                do_oem_command("flashing", &args);
-            } else if (args.size() == 2 && args[0] == "unlock_bootloader") {
-                do_bypass_unlock_command(&args);
-            } else {
-                syntax_error("unknown 'flashing' command %s", args[0].c_str());
+            std::string cache_type;
+            if (fb_getvar(transport, "partition-type:cache", &cache_type) && !cache_type.empty()) {
+                fprintf(stderr, "wiping cache...\n");
+                fb_queue_erase("cache");
+                fb_perform_format(transport, "cache", 1, "", "", "");
             }
-        } else {
-            syntax_error("unknown command %s", command.c_str());
         }
-    }
-
-    if (wants_wipe) {
-        fprintf(stderr, "wiping userdata...\n");
-        fb_queue_erase("userdata");
-        if (set_fbe_marker) {
-            fprintf(stderr, "setting FBE marker...\n");
-            std::string initial_userdata_dir = create_fbemarker_tmpdir();
-            if (initial_userdata_dir.empty()) {
-                return 1;
-            }
-            fb_perform_format(transport, "userdata", 1, "", "", initial_userdata_dir);
-            delete_fbemarker_tmpdir(initial_userdata_dir);
-        } else {
-            fb_perform_format(transport, "userdata", 1, "", "", "");
+        if (wants_set_active) {
+            fb_set_active(next_active.c_str());
         }
-
-        std::string cache_type;
-        if (fb_getvar(transport, "partition-type:cache", &cache_type) && !cache_type.empty()) {
-            fprintf(stderr, "wiping cache...\n");
-            fb_queue_erase("cache");
-            fb_perform_format(transport, "cache", 1, "", "", "");
+        if (wants_reboot && !skip_reboot) {
+            fb_queue_reboot();
+            fb_queue_wait_for_disconnect();
+        } else if (wants_reboot_bootloader) {
+            fb_queue_command("reboot-bootloader", "rebooting into bootloader");
+            fb_queue_wait_for_disconnect();
+        } else if (wants_reboot_emergency) {
+            fb_queue_command("reboot-emergency", "rebooting into emergency download (EDL) mode");
+            fb_queue_wait_for_disconnect();
         }
+
+        return fb_execute_queue(transport) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    };
+
+    std::vector<std::string> serials;
+    if (serial != nullptr) {
+        serials = android::base::Split(serial, ",");
     }
-    if (wants_set_active) {
-        fb_set_active(next_active.c_str());
-    }
-    if (wants_reboot && !skip_reboot) {
-        fb_queue_reboot();
-        fb_queue_wait_for_disconnect();
-    } else if (wants_reboot_bootloader) {
-        fb_queue_command("reboot-bootloader", "rebooting into bootloader");
-        fb_queue_wait_for_disconnect();
-    } else if (wants_reboot_emergency) {
-        fb_queue_command("reboot-emergency", "rebooting into emergency download (EDL) mode");
-        fb_queue_wait_for_disconnect();
+    if (serials.size() > 1) {
+        return run_on_devices(serials, run);
     }
 
-    return fb_execute_queue(transport) ? EXIT_FAILURE : EXIT_SUCCESS;
+    Transport* transport = open_device();
+    if (transport == nullptr) {
+        return 1;
+    }
+    return run(transport);
 }
@@ -44,6 +44,11 @@ int fb_command_response(Transport* transport, const char* cmd, char* response);
 int64_t fb_download_data(Transport* transport, const void* data, uint32_t size);
 int64_t fb_download_data_fd(Transport* transport, int fd, uint32_t size);
 int fb_download_data_sparse(Transport* transport, struct sparse_file* s);
+// Starts serializing s in the background so that a later fb_download_data_sparse() of it can
+// begin sending at once. Only one file is prepared at a time; nullptr drops it.
+void fb_prepare_sparse(struct sparse_file* s);
+// Total time sparse downloads spent waiting for data to be read on the host.
+double fb_get_sparse_wait_time();
 int64_t fb_upload_data(Transport* transport, const char* outfile);
 const std::string fb_get_error();
 
@@ -70,6 +75,8 @@ void fb_queue_upload(const char* outfile);
 void fb_queue_notice(const char *notice);
 void fb_queue_wait_for_disconnect(void);
 int64_t fb_execute_queue(Transport* transport);
+// Sets a prefix for the progress lines this thread's queue prints, such as a device serial.
+void fb_set_log_prefix(const std::string& prefix);
 void fb_set_active(const char *slot);
 
 /* util stuff */
@@ -78,6 +85,6 @@ char *mkmsg(const char *fmt, ...);
 __attribute__((__noreturn__)) void die(const char *fmt, ...);
 
 /* Current product */
-extern char cur_product[FB_RESPONSE_SZ + 1];
+extern thread_local char cur_product[FB_RESPONSE_SZ + 1];
 
 #endif
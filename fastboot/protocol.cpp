@@ -26,9 +26,6 @@
  * SUCH DAMAGE.
  */
 
-#define round_down(a, b) \
-    ({ typeof(a) _a = (a); typeof(b) _b = (b); _a - (_a % _b); })
-
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,9 +33,15 @@
 #include <errno.h>
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <android-base/file.h>
+#include <android-base/macros.h>
 #include <android-base/stringprintf.h>
 #include <android-base/unique_fd.h>
 #include <sparse/sparse.h>
@@ -47,7 +50,8 @@
 #include "fastboot.h"
 #include "transport.h"
 
-static std::string g_error;
+// Per thread, so that several devices can be driven at once.
+static thread_local std::string g_error;
 
 using android::base::unique_fd;
 using android::base::WriteStringToFile;
@@ -267,69 +271,143 @@ int64_t fb_upload_data(Transport* transport, const char* outfile) {
     return _command_end(transport);
 }
 
-#define TRANSPORT_BUF_SIZE 1024
-static char transport_buf[TRANSPORT_BUF_SIZE];
-static int transport_buf_len;
+// Serializes a sparse file in the Android sparse format on a background thread into a small
+// ring of buffers, so that reading and resparsing the backing files overlaps with the transfer
+// of the data before it.
+class SparseProducer {
+  public:
+    explicit SparseProducer(struct sparse_file* s) : s_(s), thread_(&SparseProducer::Run, this) {}
+
+    ~SparseProducer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cancelled_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
 
-static int fb_download_data_sparse_write(void *priv, const void *data, int len)
-{
-    int r;
-    Transport* transport = reinterpret_cast<Transport*>(priv);
-    int to_write;
-    const char* ptr = reinterpret_cast<const char*>(data);
+    struct sparse_file* file() const { return s_; }
 
-    if (transport_buf_len) {
-        to_write = std::min(TRANSPORT_BUF_SIZE - transport_buf_len, len);
+    // Waits for the next buffer of data. Returns false once all of it has been handed out, with
+    // *failed set if serializing the sparse file failed.
+    bool Next(std::vector<char>* buf, bool* failed) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return !ready_.empty() || done_; });
+        if (ready_.empty()) {
+            *failed = failed_;
+            return false;
+        }
+        *buf = std::move(ready_.front());
+        ready_.pop_front();
+        cv_.notify_all();
+        return true;
+    }
 
-        memcpy(transport_buf + transport_buf_len, ptr, to_write);
-        transport_buf_len += to_write;
-        ptr += to_write;
-        len -= to_write;
+    // Hands a buffer from Next() back for reuse.
+    void Release(std::vector<char> buf) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buf.clear();
+        free_.push_back(std::move(buf));
+        cv_.notify_all();
     }
 
-    if (transport_buf_len == TRANSPORT_BUF_SIZE) {
-        r = _command_write_data(transport, transport_buf, TRANSPORT_BUF_SIZE);
-        if (r != TRANSPORT_BUF_SIZE) {
+  private:
+    // A multiple of the 1KiB the transfer was previously batched in, so only the last write of a
+    // download is short.
+    static constexpr size_t kBufferSize = 1024 * 1024;
+    static constexpr size_t kBufferCount = 4;
+
+    static int Write(void* priv, const void* data, int len) {
+        SparseProducer* producer = reinterpret_cast<SparseProducer*>(priv);
+        const char* ptr = reinterpret_cast<const char*>(data);
+
+        if (data == nullptr) {
             return -1;
         }
-        transport_buf_len = 0;
+
+        while (len > 0) {
+            if (producer->current_.size() == kBufferSize && !producer->Flush()) {
+                return -1;
+            }
+            size_t to_copy = std::min(static_cast<size_t>(len),
+                                      kBufferSize - producer->current_.size());
+            producer->current_.insert(producer->current_.end(), ptr, ptr + to_copy);
+            ptr += to_copy;
+            len -= to_copy;
+        }
+        return 0;
     }
 
-    if (len > TRANSPORT_BUF_SIZE) {
-        if (transport_buf_len > 0) {
-            g_error = "internal error: transport_buf not empty";
-            return -1;
+    // Queues the current buffer and waits for a free one. Returns false if cancelled.
+    bool Flush() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.push_back(std::move(current_));
+        cv_.notify_all();
+        cv_.wait(lock, [this]() {
+            return cancelled_ || !free_.empty() || allocated_ < kBufferCount;
+        });
+        if (cancelled_) {
+            return false;
         }
-        to_write = round_down(len, TRANSPORT_BUF_SIZE);
-        r = _command_write_data(transport, ptr, to_write);
-        if (r != to_write) {
-            return -1;
+        if (!free_.empty()) {
+            current_ = std::move(free_.back());
+            free_.pop_back();
+        } else {
+            current_ = std::vector<char>();
+            current_.reserve(kBufferSize);
+            allocated_++;
         }
-        ptr += to_write;
-        len -= to_write;
+        return true;
     }
 
-    if (len > 0) {
-        if (len > TRANSPORT_BUF_SIZE) {
-            g_error = "internal error: too much left for transport_buf";
-            return -1;
+    void Run() {
+        current_.reserve(kBufferSize);
+        allocated_ = 1;
+
+        int r = sparse_file_callback(s_, true, false, Write, this);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (r >= 0 && !current_.empty()) {
+            ready_.push_back(std::move(current_));
         }
-        memcpy(transport_buf, ptr, len);
-        transport_buf_len = len;
+        failed_ = r < 0;
+        done_ = true;
+        cv_.notify_all();
     }
 
-    return 0;
-}
+    struct sparse_file* s_;
 
-static int fb_download_data_sparse_flush(Transport* transport) {
-    if (transport_buf_len > 0) {
-        int64_t r = _command_write_data(transport, transport_buf, transport_buf_len);
-        if (r != static_cast<int64_t>(transport_buf_len)) {
-            return -1;
-        }
-        transport_buf_len = 0;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::vector<char>> ready_;
+    std::vector<std::vector<char>> free_;
+    size_t allocated_ = 0;
+    bool cancelled_ = false;
+    bool done_ = false;
+    bool failed_ = false;
+
+    // Only touched by the producer thread.
+    std::vector<char> current_;
+
+    // Last, so that everything above is initialized before the thread starts.
+    std::thread thread_;
+
+    DISALLOW_COPY_AND_ASSIGN(SparseProducer);
+};
+
+static thread_local std::unique_ptr<SparseProducer> g_prepared_sparse;
+static thread_local double g_sparse_wait_time;
+
+void fb_prepare_sparse(struct sparse_file* s) {
+    if (g_prepared_sparse && g_prepared_sparse->file() == s) {
+        return;
     }
-    return 0;
+    g_prepared_sparse.reset(s ? new SparseProducer(s) : nullptr);
+}
+
+double fb_get_sparse_wait_time() {
+    return g_sparse_wait_time;
 }
 
 int fb_download_data_sparse(Transport* transport, struct sparse_file* s) {
@@ -338,19 +416,36 @@ int fb_download_data_sparse(Transport* transport, struct sparse_file* s) {
         return -1;
     }
 
+    std::unique_ptr<SparseProducer> producer;
+    if (g_prepared_sparse && g_prepared_sparse->file() == s) {
+        producer = std::move(g_prepared_sparse);
+    } else {
+        producer.reset(new SparseProducer(s));
+    }
+
     std::string cmd(android::base::StringPrintf("download:%08x", size));
     int r = _command_start(transport, cmd.c_str(), size, 0);
     if (r < 0) {
         return -1;
     }
 
-    r = sparse_file_callback(s, true, false, fb_download_data_sparse_write, transport);
-    if (r < 0) {
-        return -1;
-    }
+    std::vector<char> buf;
+    bool failed = false;
+    while (true) {
+        double start = now();
+        bool more = producer->Next(&buf, &failed);
+        g_sparse_wait_time += now() - start;
+        if (!more) {
+            break;
+        }
 
-    r = fb_download_data_sparse_flush(transport);
-    if (r < 0) {
+        if (_command_write_data(transport, buf.data(), buf.size()) < 0) {
+            return -1;
+        }
+        producer->Release(std::move(buf));
+    }
+    if (failed) {
+        g_error = "failed to read sparse data";
         return -1;
     }
 
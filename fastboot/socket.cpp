@@ -28,6 +28,10 @@
 
 #include "socket.h"
 
+#if !defined(_WIN32)
+#include <netinet/tcp.h>
+#endif
+
 #include <android-base/errors.h>
 #include <android-base/stringprintf.h>
 
@@ -253,6 +257,11 @@ std::unique_ptr<Socket> Socket::NewClient(Protocol protocol, const std::string&
     } else {
         cutils_socket_t sock = socket_network_client(host.c_str(), port, SOCK_STREAM);
         if (sock != INVALID_SOCKET) {
+            // Each download ends in a short segment; don't let Nagle hold it back until the
+            // device ACKs the rest of the write.
+            int on = 1;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on),
+                       sizeof(on));
             return std::unique_ptr<TcpSocket>(new TcpSocket(sock));
         }
     }
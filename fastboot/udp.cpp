@@ -130,9 +130,16 @@ class UdpTransport : public Transport {
                                    uint8_t* rx_data, size_t rx_length, int attempts,
                                    std::string* error);
 
+    // Like SendData() for a write that doesn't expect response data, but keeps up to
+    // |window_size_| packets in flight instead of waiting for each ACK. Returns the number of
+    // response data bytes received, which should be 0, or -1 and fills |error| on failure.
+    ssize_t SendWindowedData(Id id, const uint8_t* tx_data, size_t tx_length, int attempts,
+                             std::string* error);
+
     std::unique_ptr<Socket> socket_;
     int sequence_ = -1;
     size_t max_data_length_ = kMinPacketSize - kHeaderSize;
+    size_t window_size_ = 1;
     std::vector<uint8_t> rx_packet_;
 
     DISALLOW_COPY_AND_ASSIGN(UdpTransport);
@@ -150,7 +157,7 @@ std::unique_ptr<UdpTransport> UdpTransport::NewTransport(std::unique_ptr<Socket>
 }
 
 bool UdpTransport::InitializeProtocol(std::string* error) {
-    uint8_t rx_data[4];
+    uint8_t rx_data[6];
 
     sequence_ = 0;
     rx_packet_.resize(kMinPacketSize);
@@ -183,7 +190,7 @@ bool UdpTransport::InitializeProtocol(std::string* error) {
     // The first two data bytes contain the version, the second two bytes contain the target max
     // supported packet size, which must be at least 512 bytes.
     uint16_t version = ExtractUint16(rx_data);
-    if (version < kProtocolVersion) {
+    if (version < kMinProtocolVersion) {
         *error = android::base::StringPrintf("target reported invalid protocol version %d",
                                              version);
         return false;
@@ -198,6 +205,12 @@ bool UdpTransport::InitializeProtocol(std::string* error) {
     max_data_length_ = packet_size - kHeaderSize;
     rx_packet_.resize(packet_size);
 
+    // From version 2 the next two bytes give the target's write window in packets.
+    if (std::min(version, kProtocolVersion) >= 2 && rx_bytes >= 6) {
+        uint16_t window_size = std::min(kHostMaxWindowSize, ExtractUint16(rx_data + 4));
+        window_size_ = std::max<size_t>(1, window_size);
+    }
+
     return true;
 }
 
@@ -324,6 +337,78 @@ ssize_t UdpTransport::SendSinglePacketHelper(
     return total_data_bytes;
 }
 
+// Go-back-N: the target ACKs packets in sequence order and drops any that arrive early, so an ACK
+// also covers every earlier packet. On a timeout everything past the last ACK is sent again.
+ssize_t UdpTransport::SendWindowedData(Id id, const uint8_t* tx_data, size_t tx_length,
+                                       const int attempts, std::string* error) {
+    if (socket_ == nullptr) {
+        *error = "socket is closed";
+        return -1;
+    }
+    error->clear();
+
+    const size_t num_packets = (tx_length + max_data_length_ - 1) / max_data_length_;
+    size_t acked = 0;
+    size_t sent = 0;
+    ssize_t total_data_bytes = 0;
+    int attempts_left = attempts;
+
+    while (acked < num_packets) {
+        while (sent < num_packets && sent - acked < window_size_) {
+            size_t offset = sent * max_data_length_;
+            size_t packet_data_length = std::min(max_data_length_, tx_length - offset);
+            Header header;
+            header.Set(id, sequence_ + sent,
+                       sent + 1 < num_packets ? kFlagContinuation : kFlagNone);
+            if (!socket_->Send({{header.bytes(), kHeaderSize},
+                                {tx_data + offset, packet_data_length}})) {
+                *error = Socket::GetErrorMessage();
+                return -1;
+            }
+            ++sent;
+        }
+
+        ssize_t bytes = socket_->Receive(rx_packet_.data(), rx_packet_.size(), kResponseTimeoutMs);
+        if (bytes == -1) {
+            if (!socket_->ReceiveTimedOut()) {
+                *error = Socket::GetErrorMessage();
+                return -1;
+            }
+            if (--attempts_left <= 0) {
+                *error = "no response from target";
+                return -1;
+            }
+            sent = acked;
+            continue;
+        } else if (bytes < static_cast<ssize_t>(kHeaderSize)) {
+            *error = "protocol error: incomplete header";
+            return -1;
+        }
+
+        // Anything outside the packets in flight is a stale retransmission and is ignored.
+        uint16_t first_unacked = sequence_ + acked;
+        size_t index = static_cast<uint16_t>(ExtractUint16(&rx_packet_[kIndexSeqH]) -
+                                             first_unacked);
+        if (index >= sent - acked ||
+            (rx_packet_[kIndexId] != id && rx_packet_[kIndexId] != kIdError)) {
+            continue;
+        }
+
+        if (rx_packet_[kIndexId] == kIdError) {
+            error->append(rx_packet_.data() + kHeaderSize, rx_packet_.data() + bytes);
+            *error = "target reported error: " + *error;
+            return -1;
+        }
+
+        total_data_bytes += bytes - kHeaderSize;
+        acked += index + 1;
+        attempts_left = attempts;
+    }
+
+    sequence_ += num_packets;
+    return total_data_bytes;
+}
+
 ssize_t UdpTransport::Read(void* data, size_t length) {
     // Read from the target by sending an empty packet.
     std::string error;
@@ -345,8 +430,14 @@ ssize_t UdpTransport::Read(void* data, size_t length) {
 
 ssize_t UdpTransport::Write(const void* data, size_t length) {
     std::string error;
-    ssize_t bytes = SendData(kIdFastboot, reinterpret_cast<const uint8_t*>(data), length, nullptr,
-                             0, kMaxTransmissionAttempts, &error);
+    ssize_t bytes;
+    if (window_size_ > 1 && length > max_data_length_) {
+        bytes = SendWindowedData(kIdFastboot, reinterpret_cast<const uint8_t*>(data), length,
+                                 kMaxTransmissionAttempts, &error);
+    } else {
+        bytes = SendData(kIdFastboot, reinterpret_cast<const uint8_t*>(data), length, nullptr, 0,
+                         kMaxTransmissionAttempts, &error);
+    }
 
     if (bytes == -1) {
         fprintf(stderr, "UDP error: %s\n", error.c_str());
@@ -46,11 +46,18 @@ std::unique_ptr<Transport> Connect(const std::string& hostname, int port, std::s
 // Internal namespace for test use only.
 namespace internal {
 
-constexpr uint16_t kProtocolVersion = 1;
+constexpr uint16_t kProtocolVersion = 2;
+
+// The oldest protocol version the host still speaks. Version 1 has no write window.
+constexpr uint16_t kMinProtocolVersion = 1;
 
 // This will be negotiated with the device so may end up being smaller.
 constexpr uint16_t kHostMaxPacketSize = 8192;
 
+// Maximum number of unacknowledged write packets in flight. In protocol version 2 the device
+// reports its own limit in the initialization response and the smaller value is used.
+constexpr uint16_t kHostMaxWindowSize = 32;
+
 // Retransmission constants. Retransmission timeout must be at least 500ms, and the host must
 // attempt to send packets for at least 1 minute once the device has connected. See
 // fastboot_protocol.txt for more information.
@@ -126,6 +126,13 @@ TEST_F(UdpConnectTest, InitializationVersionMismatch) {
 
     EXPECT_TRUE(UdpConnect());
 
+    mock_socket_->ExpectSend(QueryPacket(0));
+    mock_socket_->AddReceive(QueryPacket(0, 0));
+    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->AddReceive(InitPacket(0, 1, 1024));
+
+    EXPECT_TRUE(UdpConnect());
+
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
     mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
@@ -309,15 +316,21 @@ class UdpTest : public ::testing::Test {
     }
 
     // Sets up |mock_socket_| to correctly initialize the protocol and creates |transport_|. This
-    // can be called multiple times in a test if needed.
-    bool InitializeTransport(uint16_t starting_sequence, int device_max_packet_size = 512) {
+    // can be called multiple times in a test if needed. A |device_window_size| of 0 leaves the
+    // write window out of the init response, as older devices do.
+    bool InitializeTransport(uint16_t starting_sequence, int device_max_packet_size = 512,
+                             uint16_t device_window_size = 0) {
         mock_socket_ = new SocketMock;
         mock_socket_->ExpectSend(QueryPacket(0));
         mock_socket_->AddReceive(QueryPacket(0, starting_sequence));
         mock_socket_->ExpectSend(
                 InitPacket(starting_sequence, kProtocolVersion, kHostMaxPacketSize));
-        mock_socket_->AddReceive(
-                InitPacket(starting_sequence, kProtocolVersion, device_max_packet_size));
+        std::string init_response =
+                InitPacket(starting_sequence, kProtocolVersion, device_max_packet_size);
+        if (device_window_size != 0) {
+            init_response += PacketValue(device_window_size);
+        }
+        mock_socket_->AddReceive(init_response);
 
         std::string error;
         transport_ = Connect(std::unique_ptr<Socket>(mock_socket_), &error);
@@ -454,6 +467,55 @@ TEST_F(UdpTest, ContinuationPackets) {
     }
 }
 
+// Tests that a write window keeps several packets in flight, refilling it as ACKs arrive.
+TEST_F(UdpTest, WindowedWrite) {
+    for (uint16_t seq : kTestSequenceNumbers) {
+        ASSERT_TRUE(InitializeTransport(seq, 512, 2));
+
+        std::string data(508 * 3, 'x');
+        mock_socket_->ExpectSend(FastbootPacket(seq + 1, data.substr(0, 508), kFlagContinuation));
+        mock_socket_->ExpectSend(FastbootPacket(seq + 2, data.substr(508, 508), kFlagContinuation));
+        mock_socket_->AddReceive(FastbootPacket(seq + 1));
+        mock_socket_->ExpectSend(FastbootPacket(seq + 3, data.substr(1016)));
+        mock_socket_->AddReceive(FastbootPacket(seq + 2));
+        mock_socket_->AddReceive(FastbootPacket(seq + 3));
+        EXPECT_TRUE(Write(data));
+
+        // Small writes and reads still go one packet at a time.
+        mock_socket_->ExpectSend(FastbootPacket(seq + 4, "foo"));
+        mock_socket_->AddReceive(FastbootPacket(seq + 4));
+        mock_socket_->ExpectSend(FastbootPacket(seq + 5));
+        mock_socket_->AddReceive(FastbootPacket(seq + 5, "bar"));
+        EXPECT_TRUE(Write("foo"));
+        EXPECT_TRUE(Read("bar"));
+    }
+}
+
+// Tests that a lost ACK is covered by a later one, and that a timeout resends the whole window.
+TEST_F(UdpTest, WindowedWriteRecovery) {
+    ASSERT_TRUE(InitializeTransport(0, 512, 2));
+
+    std::string data(508 * 4, 'x');
+    mock_socket_->ExpectSend(FastbootPacket(1, data.substr(0, 508), kFlagContinuation));
+    mock_socket_->ExpectSend(FastbootPacket(2, data.substr(508, 508), kFlagContinuation));
+    mock_socket_->AddReceive(FastbootPacket(0, "stale"));
+    mock_socket_->AddReceive(FastbootPacket(2));
+    mock_socket_->ExpectSend(FastbootPacket(3, data.substr(1016, 508), kFlagContinuation));
+    mock_socket_->ExpectSend(FastbootPacket(4, data.substr(1524)));
+    mock_socket_->AddReceiveTimeout();
+    mock_socket_->ExpectSend(FastbootPacket(3, data.substr(1016, 508), kFlagContinuation));
+    mock_socket_->ExpectSend(FastbootPacket(4, data.substr(1524)));
+    mock_socket_->AddReceive(FastbootPacket(3));
+    mock_socket_->AddReceive(FastbootPacket(4));
+    EXPECT_TRUE(Write(data));
+
+    // An error for any packet in flight fails the write.
+    mock_socket_->ExpectSend(FastbootPacket(5, data.substr(0, 508), kFlagContinuation));
+    mock_socket_->ExpectSend(FastbootPacket(6, data.substr(508, 508), kFlagContinuation));
+    mock_socket_->AddReceive(ErrorPacket(6, "test error"));
+    EXPECT_FALSE(Write(data));
+}
+
 // Tests that the continuation bit is respected even if the packet isn't max size.
 TEST_F(UdpTest, SmallContinuationPackets) {
     mock_socket_->ExpectSend(FastbootPacket(1));
@@ -19,9 +19,11 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
@@ -31,9 +33,15 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <thread>
+#include <vector>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
@@ -90,24 +98,80 @@ enum FsStatFlags {
     FS_STAT_ENABLE_ENCRYPTION_FAILED = 0x40000,
 };
 
-// TODO: switch to inotify()
-bool fs_mgr_wait_for_file(const std::string& filename,
-                          const std::chrono::milliseconds relative_timeout) {
-    auto start_time = std::chrono::steady_clock::now();
+// Returns the closest ancestor directory of |path| that exists.
+static std::string existing_parent_dir(const std::string& path) {
+    std::string dir = path;
+    while (true) {
+        size_t slash = dir.find_last_of('/');
+        if (slash == std::string::npos) return ".";
+        dir.resize(slash == 0 ? 1 : slash);
+        if (dir == "/" || !access(dir.c_str(), F_OK)) return dir;
+    }
+}
 
+// Waits for all of |filenames| to exist. Their closest existing parent
+// directories are watched with inotify, so that the wait ends as soon as
+// ueventd creates the last node; directories that appear meanwhile, such as
+// by-name, are watched in turn. Falls back to polling if inotify is not
+// available.
+bool fs_mgr_wait_for_files(const std::vector<std::string>& filenames,
+                           const std::chrono::milliseconds relative_timeout) {
+    auto deadline = std::chrono::steady_clock::now() + relative_timeout;
+    android::base::unique_fd inotify_fd(inotify_init1(IN_CLOEXEC | IN_NONBLOCK));
+    if (inotify_fd == -1) {
+        PWARNING << "inotify_init1 failed, polling for " << filenames.size() << " file(s)";
+    }
+
+    std::set<std::string> watched_dirs;
+    std::vector<std::string> pending(filenames);
     while (true) {
-        if (!access(filename.c_str(), F_OK) || errno != ENOENT) {
+        // Watches are added before checking, so no creation can be missed.
+        if (inotify_fd != -1) {
+            for (const auto& filename : pending) {
+                std::string dir = existing_parent_dir(filename);
+                if (watched_dirs.count(dir)) continue;
+                if (inotify_add_watch(inotify_fd, dir.c_str(), IN_CREATE | IN_MOVED_TO) == -1) {
+                    PWARNING << "inotify_add_watch(" << dir << ") failed, polling instead";
+                    inotify_fd.reset();
+                    break;
+                }
+                watched_dirs.insert(dir);
+            }
+        }
+
+        pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                     [](const std::string& filename) {
+                                         return !access(filename.c_str(), F_OK) || errno != ENOENT;
+                                     }),
+                      pending.end());
+        if (pending.empty()) {
             return true;
         }
 
-        std::this_thread::sleep_for(50ms);
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (remaining <= 0ms) {
+            return false;
+        }
 
-        auto now = std::chrono::steady_clock::now();
-        auto time_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time);
-        if (time_elapsed > relative_timeout) return false;
+        // Without inotify, poll() just sleeps for the polling interval.
+        struct pollfd pfd = {inotify_fd.get(), POLLIN, 0};
+        int timeout_ms = inotify_fd != -1 ? remaining.count() : std::min(remaining, 50ms).count();
+        if (TEMP_FAILURE_RETRY(poll(&pfd, 1, timeout_ms)) > 0) {
+            // The events only tell that something was created; drain them and
+            // check again.
+            char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            while (read(inotify_fd, buf, sizeof(buf)) > 0) {
+            }
+        }
     }
 }
 
+bool fs_mgr_wait_for_file(const std::string& filename,
+                          const std::chrono::milliseconds relative_timeout) {
+    return fs_mgr_wait_for_files({filename}, relative_timeout);
+}
+
 static void log_fs_stat(const char* blk_device, int fs_stat)
 {
     if ((fs_stat & FS_STAT_IS_EXT4) == 0) return; // only log ext4
@@ -791,26 +855,40 @@ bool is_device_secure() {
     return strcmp(value, "0") ? true : false;
 }
 
-/* When multiple fstab records share the same mount_point, it will
- * try to mount each one in turn, and ignore any duplicates after a
- * first successful mount.
- * Returns -1 on error, and  FS_MGR_MNTALL_* otherwise.
- */
-int fs_mgr_mount_all(struct fstab *fstab, int mount_mode)
-{
-    int i = 0;
-    int encryptable = FS_MGR_MNTALL_DEV_NOT_ENCRYPTABLE;
-    int error_count = 0;
+// The outcome of mounting one run of consecutive fstab entries that share a
+// mount point.
+struct MountResult {
+    bool attempted = false;  // false if every entry of the run was skipped
+    bool fatal = false;      // mounting cannot go on, see FS_MGR_MNTALL_FAIL
+    int top_idx = -1;
+    int attempted_idx = -1;
     int mret = -1;
     int mount_errno = 0;
-    int attempted_idx = -1;
-    FsManagerAvbUniquePtr avb_handle(nullptr);
+};
 
-    if (!fstab) {
-        return FS_MGR_MNTALL_FAIL;
-    }
+// State shared by the threads of fs_mgr_mount_all().
+struct MountAllContext {
+    struct fstab* fstab;
+    int mount_mode;
+    // Serializes setting up verity and AVB hashtrees, which share the lazily
+    // opened |avb_handle| and device-mapper control.
+    std::mutex verity_lock;
+    FsManagerAvbUniquePtr avb_handle;
+};
 
-    for (i = 0; i < fstab->num_entries; i++) {
+/*
+ * Waits for, verifies and mounts the first usable entry of
+ * fstab->recs[start_idx..end_idx], which all share a mount point.
+ * Entries that should not be mounted are skipped, the same way
+ * fs_mgr_mount_all() always did.
+ */
+static MountResult mount_run(MountAllContext* ctx, int start_idx, int end_idx) {
+    struct fstab* fstab = ctx->fstab;
+    const int mount_mode = ctx->mount_mode;
+    MountResult result;
+    android::base::Timer timer;
+
+    for (int i = start_idx; i <= end_idx; i++) {
         /* Don't mount entries that are managed by vold or not for the mount mode*/
         if ((fstab->recs[i].fs_mgr_flags & (MF_VOLDMANAGED | MF_RECOVERYONLY)) ||
              ((mount_mode == MOUNT_MODE_LATE) && !fs_mgr_is_latemount(&fstab->recs[i])) ||
@@ -849,14 +927,17 @@ int fs_mgr_mount_all(struct fstab *fstab, int mount_mode)
         }
 
         if (fstab->recs[i].fs_mgr_flags & MF_AVB) {
-            if (!avb_handle) {
-                avb_handle = FsManagerAvbHandle::Open(*fstab);
-                if (!avb_handle) {
+            std::lock_guard<std::mutex> lock(ctx->verity_lock);
+            if (!ctx->avb_handle) {
+                ctx->avb_handle = FsManagerAvbHandle::Open(*fstab);
+                if (!ctx->avb_handle) {
                     LERROR << "Failed to open FsManagerAvbHandle";
-                    return FS_MGR_MNTALL_FAIL;
+                    result.fatal = true;
+                    return result;
                 }
             }
-            if (avb_handle->SetUpAvbHashtree(&fstab->recs[i], true /* wait_for_verity_dev */) ==
+            if (ctx->avb_handle->SetUpAvbHashtree(&fstab->recs[i],
+                                                  true /* wait_for_verity_dev */) ==
                 SetUpAvbHashtreeResult::kFail) {
                 LERROR << "Failed to set up AVB on partition: "
                        << fstab->recs[i].mount_point << ", skipping!";
@@ -864,6 +945,7 @@ int fs_mgr_mount_all(struct fstab *fstab, int mount_mode)
                 continue;
             }
         } else if ((fstab->recs[i].fs_mgr_flags & MF_VERIFY) && is_device_secure()) {
+            std::lock_guard<std::mutex> lock(ctx->verity_lock);
             int rc = fs_mgr_setup_verity(&fstab->recs[i], true);
             if (__android_log_is_debuggable() &&
                     (rc == FS_MGR_SETUP_VERITY_DISABLED ||
@@ -876,121 +958,314 @@ int fs_mgr_mount_all(struct fstab *fstab, int mount_mode)
         }
 
         int last_idx_inspected;
-        int top_idx = i;
+        result.attempted = true;
+        result.top_idx = i;
+        result.mret = mount_with_alternatives(fstab, i, &last_idx_inspected,
+                                              &result.attempted_idx);
+        result.mount_errno = errno;
+        LINFO << __FUNCTION__ << "(): " << fstab->recs[i].mount_point << " took "
+              << timer.duration().count() << "ms, ret=" << result.mret;
+        break;
+    }
+    return result;
+}
 
-        mret = mount_with_alternatives(fstab, i, &last_idx_inspected, &attempted_idx);
-        i = last_idx_inspected;
-        mount_errno = errno;
+// Whether one of the mount points is the other or lies below it.
+static bool mount_points_nest(const char* a, const char* b) {
+    size_t len_a = strlen(a);
+    size_t len_b = strlen(b);
+    while (len_a > 1 && a[len_a - 1] == '/') len_a--;
+    while (len_b > 1 && b[len_b - 1] == '/') len_b--;
+    if (len_a > len_b) {
+        std::swap(a, b);
+        std::swap(len_a, len_b);
+    }
+    return !strncmp(a, b, len_a) &&
+           (len_a == len_b || b[len_a] == '/' || a[len_a - 1] == '/');
+}
 
-        /* Deal with encryptability. */
-        if (!mret) {
-            int status = handle_encryptable(&fstab->recs[attempted_idx]);
+/*
+ * Mounts the runs of fstab entries sharing a mount point on several threads.
+ * A run waits until every earlier run whose mount point nests with its own,
+ * or which uses the same block device, has been mounted and its result
+ * handled: a child mount point needs its parent mounted, and check_fs()
+ * temporarily mounts on the mount point itself.
+ */
+class MountScheduler {
+  public:
+    struct Run {
+        int start_idx;
+        int end_idx;
+        std::vector<size_t> deps;
+        enum { kWaiting, kRunning, kMounted, kDone } state;
+        MountResult result;
+    };
 
-            if (status == FS_MGR_MNTALL_FAIL) {
-                /* Fatal error - no point continuing */
-                return status;
+    explicit MountScheduler(MountAllContext* ctx) : ctx_(ctx), aborting_(false) {
+        struct fstab* fstab = ctx->fstab;
+        for (int i = 0; i < fstab->num_entries;) {
+            Run run = {i, i, {}, Run::kWaiting, {}};
+            /* We required that fstab entries for the same mountpoint be consecutive */
+            while (run.end_idx + 1 < fstab->num_entries &&
+                   !strcmp(fstab->recs[i].mount_point, fstab->recs[run.end_idx + 1].mount_point)) {
+                run.end_idx++;
             }
-
-            if (status != FS_MGR_MNTALL_DEV_NOT_ENCRYPTABLE) {
-                if (encryptable != FS_MGR_MNTALL_DEV_NOT_ENCRYPTABLE) {
-                    // Log and continue
-                    LERROR << "Only one encryptable/encrypted partition supported";
+            for (size_t r = 0; r < runs_.size(); r++) {
+                const fstab_rec* other = &fstab->recs[runs_[r].start_idx];
+                if (mount_points_nest(other->mount_point, fstab->recs[i].mount_point) ||
+                    !strcmp(other->blk_device, fstab->recs[i].blk_device)) {
+                    run.deps.push_back(r);
                 }
-                encryptable = status;
             }
+            i = run.end_idx + 1;
+            runs_.push_back(std::move(run));
+        }
 
-            /* Success!  Go get the next one */
-            continue;
+        size_t num_threads = std::min<size_t>(
+            runs_.size(), std::max(1u, std::min(std::thread::hardware_concurrency(), 4u)));
+        for (size_t t = 0; t < num_threads; t++) {
+            threads_.emplace_back([this] { RunWorker(); });
         }
+    }
 
-        bool wiped = partition_wiped(fstab->recs[top_idx].blk_device);
-        bool crypt_footer = false;
-        if (mret && mount_errno != EBUSY && mount_errno != EACCES &&
-            fs_mgr_is_formattable(&fstab->recs[top_idx]) && wiped) {
-            /* top_idx and attempted_idx point at the same partition, but sometimes
-             * at two different lines in the fstab.  Use the top one for formatting
-             * as that is the preferred one.
-             */
-            LERROR << __FUNCTION__ << "(): " << fstab->recs[top_idx].blk_device
-                   << " is wiped and " << fstab->recs[top_idx].mount_point
-                   << " " << fstab->recs[top_idx].fs_type
-                   << " is formattable. Format it.";
-            if (fs_mgr_is_encryptable(&fstab->recs[top_idx]) &&
-                strcmp(fstab->recs[top_idx].key_loc, KEY_IN_FOOTER)) {
-                int fd = open(fstab->recs[top_idx].key_loc, O_WRONLY);
-                if (fd >= 0) {
-                    LINFO << __FUNCTION__ << "(): also wipe "
-                          << fstab->recs[top_idx].key_loc;
-                    wipe_block_device(fd, get_file_size(fd));
-                    close(fd);
-                } else {
-                    PERROR << __FUNCTION__ << "(): "
-                           << fstab->recs[top_idx].key_loc << " wouldn't open";
+    ~MountScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            aborting_ = true;
+        }
+        cv_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    size_t size() const { return runs_.size(); }
+    const Run& run(size_t r) const { return runs_[r]; }
+
+    // Returns the result of the r-th run once it is mounted.
+    MountResult WaitForMounted(size_t r) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this, r] { return runs_[r].state == Run::kMounted; });
+        return runs_[r].result;
+    }
+
+    // Lets the runs that depend on the r-th one start.
+    void SetDone(size_t r) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            runs_[r].state = Run::kDone;
+        }
+        cv_.notify_all();
+    }
+
+  private:
+    // Returns the first waiting run whose dependencies are done, or -1.
+    ssize_t FindReadyLocked() const {
+        for (size_t r = 0; r < runs_.size(); r++) {
+            if (runs_[r].state != Run::kWaiting) continue;
+            bool ready = true;
+            for (size_t dep : runs_[r].deps) {
+                if (runs_[dep].state != Run::kDone) {
+                    ready = false;
+                    break;
                 }
-            } else if (fs_mgr_is_encryptable(&fstab->recs[top_idx]) &&
-                !strcmp(fstab->recs[top_idx].key_loc, KEY_IN_FOOTER)) {
-                crypt_footer = true;
-            }
-            if (fs_mgr_do_format(&fstab->recs[top_idx], crypt_footer) == 0) {
-                /* Let's replay the mount actions. */
-                i = top_idx - 1;
-                continue;
-            } else {
-                LERROR << __FUNCTION__ << "(): Format failed. "
-                       << "Suggest recovery...";
-                encryptable = FS_MGR_MNTALL_DEV_NEEDS_RECOVERY;
-                continue;
             }
+            if (ready) return r;
         }
+        return -1;
+    }
 
-        /* mount(2) returned an error, handle the encryptable/formattable case */
-        if (mret && mount_errno != EBUSY && mount_errno != EACCES &&
-            fs_mgr_is_encryptable(&fstab->recs[attempted_idx])) {
-            if (wiped) {
-                LERROR << __FUNCTION__ << "(): "
-                       << fstab->recs[attempted_idx].blk_device
-                       << " is wiped and "
-                       << fstab->recs[attempted_idx].mount_point << " "
-                       << fstab->recs[attempted_idx].fs_type
-                       << " is encryptable. Suggest recovery...";
-                encryptable = FS_MGR_MNTALL_DEV_NEEDS_RECOVERY;
-                continue;
-            } else {
-                /* Need to mount a tmpfs at this mountpoint for now, and set
-                 * properties that vold will query later for decrypting
+    // Returns whether some run has not been started yet.
+    bool HasWaitingLocked() const {
+        for (const Run& run : runs_) {
+            if (run.state == Run::kWaiting) return true;
+        }
+        return false;
+    }
+
+    void RunWorker() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            ssize_t r = -1;
+            cv_.wait(lock, [this, &r] {
+                if (aborting_) return true;
+                r = FindReadyLocked();
+                return r >= 0 || !HasWaitingLocked();
+            });
+            if (aborting_ || r < 0) return;
+
+            runs_[r].state = Run::kRunning;
+            lock.unlock();
+            MountResult result = mount_run(ctx_, runs_[r].start_idx, runs_[r].end_idx);
+            lock.lock();
+            runs_[r].result = result;
+            runs_[r].state = Run::kMounted;
+            cv_.notify_all();
+        }
+    }
+
+    MountAllContext* ctx_;
+    std::vector<std::thread> threads_;
+
+    // The following members are guarded by |mutex_|, except for the indices
+    // and dependencies of |runs_|, which do not change once threads start.
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Run> runs_;
+    bool aborting_;
+};
+
+/* When multiple fstab records share the same mount_point, it will
+ * try to mount each one in turn, and ignore any duplicates after a
+ * first successful mount.
+ * Independent mount points are checked and mounted concurrently; their
+ * results are handled in fstab order.
+ * Returns -1 on error, and  FS_MGR_MNTALL_* otherwise.
+ */
+int fs_mgr_mount_all(struct fstab *fstab, int mount_mode)
+{
+    int encryptable = FS_MGR_MNTALL_DEV_NOT_ENCRYPTABLE;
+    int error_count = 0;
+
+    if (!fstab) {
+        return FS_MGR_MNTALL_FAIL;
+    }
+
+    MountAllContext ctx;
+    ctx.fstab = fstab;
+    ctx.mount_mode = mount_mode;
+    MountScheduler scheduler(&ctx);
+
+    for (size_t r = 0; r < scheduler.size(); r++) {
+        MountResult result = scheduler.WaitForMounted(r);
+
+        while (true) {
+            if (result.fatal) {
+                return FS_MGR_MNTALL_FAIL;
+            }
+            if (!result.attempted) {
+                break;
+            }
+
+            const int top_idx = result.top_idx;
+            const int attempted_idx = result.attempted_idx;
+            const int mret = result.mret;
+            const int mount_errno = result.mount_errno;
+
+            /* Deal with encryptability. */
+            if (!mret) {
+                int status = handle_encryptable(&fstab->recs[attempted_idx]);
+
+                if (status == FS_MGR_MNTALL_FAIL) {
+                    /* Fatal error - no point continuing */
+                    return status;
+                }
+
+                if (status != FS_MGR_MNTALL_DEV_NOT_ENCRYPTABLE) {
+                    if (encryptable != FS_MGR_MNTALL_DEV_NOT_ENCRYPTABLE) {
+                        // Log and continue
+                        LERROR << "Only one encryptable/encrypted partition supported";
+                    }
+                    encryptable = status;
+                }
+
+                /* Success!  Go get the next one */
+                break;
+            }
+
+            bool wiped = partition_wiped(fstab->recs[top_idx].blk_device);
+            bool crypt_footer = false;
+            if (mret && mount_errno != EBUSY && mount_errno != EACCES &&
+                fs_mgr_is_formattable(&fstab->recs[top_idx]) && wiped) {
+                /* top_idx and attempted_idx point at the same partition, but sometimes
+                 * at two different lines in the fstab.  Use the top one for formatting
+                 * as that is the preferred one.
                  */
-                LERROR << __FUNCTION__ << "(): possibly an encryptable blkdev "
-                       << fstab->recs[attempted_idx].blk_device
-                       << " for mount " << fstab->recs[attempted_idx].mount_point
-                       << " type " << fstab->recs[attempted_idx].fs_type;
-                if (fs_mgr_do_tmpfs_mount(fstab->recs[attempted_idx].mount_point) < 0) {
-                    ++error_count;
+                LERROR << __FUNCTION__ << "(): " << fstab->recs[top_idx].blk_device
+                       << " is wiped and " << fstab->recs[top_idx].mount_point
+                       << " " << fstab->recs[top_idx].fs_type
+                       << " is formattable. Format it.";
+                if (fs_mgr_is_encryptable(&fstab->recs[top_idx]) &&
+                    strcmp(fstab->recs[top_idx].key_loc, KEY_IN_FOOTER)) {
+                    int fd = open(fstab->recs[top_idx].key_loc, O_WRONLY);
+                    if (fd >= 0) {
+                        LINFO << __FUNCTION__ << "(): also wipe "
+                              << fstab->recs[top_idx].key_loc;
+                        wipe_block_device(fd, get_file_size(fd));
+                        close(fd);
+                    } else {
+                        PERROR << __FUNCTION__ << "(): "
+                               << fstab->recs[top_idx].key_loc << " wouldn't open";
+                    }
+                } else if (fs_mgr_is_encryptable(&fstab->recs[top_idx]) &&
+                    !strcmp(fstab->recs[top_idx].key_loc, KEY_IN_FOOTER)) {
+                    crypt_footer = true;
+                }
+                if (fs_mgr_do_format(&fstab->recs[top_idx], crypt_footer) == 0) {
+                    /* Let's replay the mount actions. */
+                    result = mount_run(&ctx, top_idx, scheduler.run(r).end_idx);
                     continue;
+                } else {
+                    LERROR << __FUNCTION__ << "(): Format failed. "
+                           << "Suggest recovery...";
+                    encryptable = FS_MGR_MNTALL_DEV_NEEDS_RECOVERY;
+                    break;
                 }
             }
-            encryptable = FS_MGR_MNTALL_DEV_MIGHT_BE_ENCRYPTED;
-        } else if (mret && mount_errno != EBUSY && mount_errno != EACCES &&
-                   should_use_metadata_encryption(&fstab->recs[attempted_idx])) {
-            encryptable = FS_MGR_MNTALL_DEV_IS_METADATA_ENCRYPTED;
-        } else {
-            // fs_options might be null so we cannot use PERROR << directly.
-            // Use StringPrintf to output "(null)" instead.
-            if (fs_mgr_is_nofail(&fstab->recs[attempted_idx])) {
-                PERROR << android::base::StringPrintf(
-                    "Ignoring failure to mount an un-encryptable or wiped "
-                    "partition on %s at %s options: %s",
-                    fstab->recs[attempted_idx].blk_device, fstab->recs[attempted_idx].mount_point,
-                    fstab->recs[attempted_idx].fs_options);
+
+            /* mount(2) returned an error, handle the encryptable/formattable case */
+            if (mret && mount_errno != EBUSY && mount_errno != EACCES &&
+                fs_mgr_is_encryptable(&fstab->recs[attempted_idx])) {
+                if (wiped) {
+                    LERROR << __FUNCTION__ << "(): "
+                           << fstab->recs[attempted_idx].blk_device
+                           << " is wiped and "
+                           << fstab->recs[attempted_idx].mount_point << " "
+                           << fstab->recs[attempted_idx].fs_type
+                           << " is encryptable. Suggest recovery...";
+                    encryptable = FS_MGR_MNTALL_DEV_NEEDS_RECOVERY;
+                    break;
+                } else {
+                    /* Need to mount a tmpfs at this mountpoint for now, and set
+                     * properties that vold will query later for decrypting
+                     */
+                    LERROR << __FUNCTION__ << "(): possibly an encryptable blkdev "
+                           << fstab->recs[attempted_idx].blk_device
+                           << " for mount " << fstab->recs[attempted_idx].mount_point
+                           << " type " << fstab->recs[attempted_idx].fs_type;
+                    if (fs_mgr_do_tmpfs_mount(fstab->recs[attempted_idx].mount_point) < 0) {
+                        ++error_count;
+                        break;
+                    }
+                }
+                encryptable = FS_MGR_MNTALL_DEV_MIGHT_BE_ENCRYPTED;
+            } else if (mret && mount_errno != EBUSY && mount_errno != EACCES &&
+                       should_use_metadata_encryption(&fstab->recs[attempted_idx])) {
+                encryptable = FS_MGR_MNTALL_DEV_IS_METADATA_ENCRYPTED;
             } else {
-                PERROR << android::base::StringPrintf(
-                    "Failed to mount an un-encryptable or wiped partition "
-                    "on %s at %s options: %s",
-                    fstab->recs[attempted_idx].blk_device, fstab->recs[attempted_idx].mount_point,
-                    fstab->recs[attempted_idx].fs_options);
-                ++error_count;
+                // fs_options might be null so we cannot use PERROR << directly.
+                // Use StringPrintf to output "(null)" instead.
+                if (fs_mgr_is_nofail(&fstab->recs[attempted_idx])) {
+                    PERROR << android::base::StringPrintf(
+                        "Ignoring failure to mount an un-encryptable or wiped "
+                        "partition on %s at %s options: %s",
+                        fstab->recs[attempted_idx].blk_device,
+                        fstab->recs[attempted_idx].mount_point,
+                        fstab->recs[attempted_idx].fs_options);
+                } else {
+                    PERROR << android::base::StringPrintf(
+                        "Failed to mount an un-encryptable or wiped partition "
+                        "on %s at %s options: %s",
+                        fstab->recs[attempted_idx].blk_device,
+                        fstab->recs[attempted_idx].mount_point,
+                        fstab->recs[attempted_idx].fs_options);
+                    ++error_count;
+                }
             }
-            continue;
+            break;
         }
+
+        scheduler.SetDone(r);
     }
 
     if (error_count) {
@@ -1296,21 +1571,14 @@ void fs_mgr_get_crypt_info(struct fstab* fstab, char* key_loc, char* real_blk_de
     }
 }
 
-bool fs_mgr_load_verity_state(int* mode) {
-    /* return the default mode, unless any of the verified partitions are in
-     * logging mode, in which case return that */
-    *mode = VERITY_MODE_DEFAULT;
-
-    std::unique_ptr<fstab, decltype(&fs_mgr_free_fstab)> fstab(fs_mgr_read_fstab_default(),
-                                                               fs_mgr_free_fstab);
-    if (!fstab) {
-        LERROR << "Failed to read default fstab";
-        return false;
-    }
+/* return the default mode, unless any of the verified partitions are in
+ * logging mode, in which case return that */
+static int load_verity_mode(struct fstab* fstab) {
+    int mode = VERITY_MODE_DEFAULT;
 
     for (int i = 0; i < fstab->num_entries; i++) {
         if (fs_mgr_is_avb(&fstab->recs[i])) {
-            *mode = VERITY_MODE_RESTART;  // avb only supports restart mode.
+            mode = VERITY_MODE_RESTART;  // avb only supports restart mode.
             break;
         } else if (!fs_mgr_is_verified(&fstab->recs[i])) {
             continue;
@@ -1321,11 +1589,25 @@ bool fs_mgr_load_verity_state(int* mode) {
             continue;
         }
         if (current != VERITY_MODE_DEFAULT) {
-            *mode = current;
+            mode = current;
             break;
         }
     }
 
+    return mode;
+}
+
+bool fs_mgr_load_verity_state(int* mode) {
+    *mode = VERITY_MODE_DEFAULT;
+
+    std::unique_ptr<fstab, decltype(&fs_mgr_free_fstab)> fstab(fs_mgr_read_fstab_default(),
+                                                               fs_mgr_free_fstab);
+    if (!fstab) {
+        LERROR << "Failed to read default fstab";
+        return false;
+    }
+
+    *mode = load_verity_mode(fstab.get());
     return true;
 }
 
@@ -1334,24 +1616,22 @@ bool fs_mgr_update_verity_state(fs_mgr_verity_state_callback callback) {
         return false;
     }
 
-    int mode;
-    if (!fs_mgr_load_verity_state(&mode)) {
+    // The fstab is read once for both the mode and the partitions.
+    std::unique_ptr<fstab, decltype(&fs_mgr_free_fstab)> fstab(fs_mgr_read_fstab_default(),
+                                                               fs_mgr_free_fstab);
+    if (!fstab) {
+        LERROR << "Failed to read default fstab";
         return false;
     }
 
+    int mode = load_verity_mode(fstab.get());
+
     android::base::unique_fd fd(TEMP_FAILURE_RETRY(open("/dev/device-mapper", O_RDWR | O_CLOEXEC)));
     if (fd == -1) {
         PERROR << "Error opening device mapper";
         return false;
     }
 
-    std::unique_ptr<fstab, decltype(&fs_mgr_free_fstab)> fstab(fs_mgr_read_fstab_default(),
-                                                               fs_mgr_free_fstab);
-    if (!fstab) {
-        LERROR << "Failed to read default fstab";
-        return false;
-    }
-
     alignas(dm_ioctl) char buffer[DM_BUF_SIZE];
     struct dm_ioctl* io = (struct dm_ioctl*)buffer;
     bool system_root = android::base::GetProperty("ro.build.system_root_image", "") == "true";
@@ -21,8 +21,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mount.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <map>
+#include <memory>
+#include <mutex>
+
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
@@ -649,10 +654,60 @@ static struct fstab *in_place_merge(struct fstab *a, struct fstab *b)
     return a;
 }
 
+static char *strdup_or_null(const char *s)
+{
+    return s ? strdup(s) : NULL;
+}
+
+/* Returns a copy of fstab that the caller owns, as if it had been parsed. */
+static struct fstab *copy_fstab(const struct fstab *src)
+{
+    struct fstab *fstab = static_cast<struct fstab *>(calloc(1, sizeof(struct fstab)));
+    fstab->recs = static_cast<struct fstab_rec *>(
+        calloc(src->num_entries, sizeof(struct fstab_rec)));
+    memcpy(fstab->recs, src->recs, src->num_entries * sizeof(struct fstab_rec));
+    fstab->num_entries = src->num_entries;
+    fstab->fstab_filename = strdup_or_null(src->fstab_filename);
+
+    for (int i = 0; i < fstab->num_entries; i++) {
+        struct fstab_rec *rec = &fstab->recs[i];
+        rec->blk_device = strdup_or_null(rec->blk_device);
+        rec->mount_point = strdup_or_null(rec->mount_point);
+        rec->fs_type = strdup_or_null(rec->fs_type);
+        rec->fs_options = strdup_or_null(rec->fs_options);
+        rec->key_loc = strdup_or_null(rec->key_loc);
+        rec->key_dir = strdup_or_null(rec->key_dir);
+        rec->verity_loc = strdup_or_null(rec->verity_loc);
+        rec->label = strdup_or_null(rec->label);
+    }
+    return fstab;
+}
+
+/* init, vold and fs_mgr read the same fstab files several times. Each file is
+ * parsed once per process; later reads copy the parsed entries, unless the
+ * file was replaced or modified in the meantime. */
+struct cached_fstab {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    std::unique_ptr<struct fstab, decltype(&fs_mgr_free_fstab)> fstab;
+};
+
+static std::mutex fstab_cache_lock;
+static std::map<std::string, cached_fstab> fstab_cache;
+
+static bool same_file(const cached_fstab &cached, const struct stat &st)
+{
+    return cached.dev == st.st_dev && cached.ino == st.st_ino && cached.size == st.st_size &&
+           cached.mtime.tv_sec == st.st_mtim.tv_sec && cached.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
 struct fstab *fs_mgr_read_fstab(const char *fstab_path)
 {
     FILE *fstab_file;
     struct fstab *fstab;
+    struct stat st;
 
     fstab_file = fopen(fstab_path, "r");
     if (!fstab_file) {
@@ -660,9 +715,26 @@ struct fstab *fs_mgr_read_fstab(const char *fstab_path)
         return nullptr;
     }
 
+    bool cacheable = fstat(fileno(fstab_file), &st) == 0;
+    if (cacheable) {
+        std::lock_guard<std::mutex> lock(fstab_cache_lock);
+        auto it = fstab_cache.find(fstab_path);
+        if (it != fstab_cache.end() && same_file(it->second, st)) {
+            fclose(fstab_file);
+            return copy_fstab(it->second.fstab.get());
+        }
+    }
+
     fstab = fs_mgr_read_fstab_file(fstab_file);
     if (fstab) {
         fstab->fstab_filename = strdup(fstab_path);
+        if (cacheable) {
+            std::lock_guard<std::mutex> lock(fstab_cache_lock);
+            cached_fstab cached = {st.st_dev, st.st_ino, st.st_size, st.st_mtim,
+                                   {copy_fstab(fstab), fs_mgr_free_fstab}};
+            fstab_cache.erase(fstab_path);
+            fstab_cache.emplace(fstab_path, std::move(cached));
+        }
     } else {
         LERROR << __FUNCTION__ << "(): failed to load fstab from : '" << fstab_path << "'";
     }
@@ -676,6 +748,16 @@ struct fstab *fs_mgr_read_fstab(const char *fstab_path)
  */
 struct fstab *fs_mgr_read_fstab_dt()
 {
+    /* The device tree does not change while running, so a successful parse
+     * is kept like those of fstab files. */
+    static std::mutex dt_fstab_lock;
+    static std::unique_ptr<struct fstab, decltype(&fs_mgr_free_fstab)> dt_fstab(
+        nullptr, fs_mgr_free_fstab);
+    std::lock_guard<std::mutex> lock(dt_fstab_lock);
+    if (dt_fstab) {
+        return copy_fstab(dt_fstab.get());
+    }
+
     std::string fstab_buf = read_fstab_from_dt();
     if (fstab_buf.empty()) {
         LINFO << __FUNCTION__ << "(): failed to read fstab from dt";
@@ -694,8 +776,10 @@ struct fstab *fs_mgr_read_fstab_dt()
     if (!fstab) {
         LERROR << __FUNCTION__ << "(): failed to load fstab from kernel:"
                << std::endl << fstab_buf;
+        return nullptr;
     }
 
+    dt_fstab.reset(copy_fstab(fstab));
     return fstab;
 }
 
@@ -745,6 +829,7 @@ void fs_mgr_free_fstab(struct fstab *fstab)
         free(fstab->recs[i].fs_options);
         free(fstab->recs[i].key_loc);
         free(fstab->recs[i].key_dir);
+        free(fstab->recs[i].verity_loc);
         free(fstab->recs[i].label);
     }
 
@@ -799,12 +884,10 @@ struct fstab_rec *fs_mgr_get_entry_for_mount_point_after(struct fstab_rec *start
     }
 
     if (start_rec) {
-        for (i = 0; i < fstab->num_entries; i++) {
-            if (&fstab->recs[i] == start_rec) {
-                i++;
-                break;
-            }
-        }
+        /* start_rec points into fstab->recs, or the search is over */
+        i = start_rec >= fstab->recs && start_rec < fstab->recs + fstab->num_entries
+                ? start_rec - fstab->recs + 1
+                : fstab->num_entries;
     } else {
         i = 0;
     }
@@ -19,6 +19,7 @@
 
 #include <chrono>
 #include <string>
+#include <vector>
 
 #include <android-base/logging.h>
 
@@ -118,6 +119,8 @@ using namespace std::chrono_literals;
 int fs_mgr_set_blk_ro(const char *blockdev);
 bool fs_mgr_wait_for_file(const std::string& filename,
                           const std::chrono::milliseconds relative_timeout);
+bool fs_mgr_wait_for_files(const std::vector<std::string>& filenames,
+                           const std::chrono::milliseconds relative_timeout);
 bool fs_mgr_update_for_slotselect(struct fstab *fstab);
 bool fs_mgr_is_device_unlocked();
 const std::string& get_android_dt_dir();
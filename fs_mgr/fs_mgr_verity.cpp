@@ -29,8 +29,15 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
 #include <android-base/file.h>
+#include <android-base/parseint.h>
 #include <android-base/properties.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 #include <crypto_utils/android_pubkey.h>
@@ -346,7 +353,7 @@ out:
     return rc;
 }
 
-static int was_verity_restart()
+static int check_verity_restart_files()
 {
     static const char* files[] = {
         // clang-format off
@@ -367,108 +374,202 @@ static int was_verity_restart()
     return 0;
 }
 
-static int metadata_add(FILE *fp, long start, const char *tag,
-        unsigned int length, off64_t *offset)
+/* The logs of the last boot do not change, so they are only scanned for the
+ * first verified partition. */
+static int was_verity_restart()
 {
-    if (fseek(fp, start, SEEK_SET) < 0 ||
-        fprintf(fp, "%s %u\n", tag, length) < 0) {
-        return -1;
-    }
+    static const int restarted = check_verity_restart_files();
+    return restarted;
+}
 
-    *offset = ftell(fp);
+#define METADATA_START 0x4000 /* skip cryptfs metadata area */
+#define METADATA_READ_SIZE 4096
+#define METADATA_MAX_SIZE (1024 * 1024)
+
+/* The tags of a metadata partition, read in one go the first time one of its
+ * tags is looked up, and kept up to date as tags are added. The tags are only
+ * ever written through metadata_find(), so the copy stays valid for the life
+ * of the process. */
+struct metadata_index {
+    bool has_magic;
+    /* data offset of each (tag, length); the first one found wins */
+    std::map<std::pair<std::string, unsigned int>, off64_t> tags;
+    /* where the next tag is added, over the end-of-data marker */
+    off64_t end;
+};
 
-    if (fseek(fp, length, SEEK_CUR) < 0 ||
-        fprintf(fp, METADATA_EOD " 0\n") < 0) {
-        return -1;
+static std::mutex metadata_lock;
+static std::map<std::string, metadata_index> metadata_indices;
+
+/* Parses the tags from buf, which holds the metadata from METADATA_START + 4
+ * on, and sets index->end to the end-of-data marker or to whatever follows
+ * the last valid tag. Returns false if buf ends in the middle of a tag, in
+ * which case more data may complete it. */
+static bool metadata_parse(const std::string& buf, metadata_index* index)
+{
+    size_t pos = 0;
+    bool complete = true;
+
+    index->tags.clear();
+    while (true) {
+        /* "<tag> <length>\n" */
+        size_t space = buf.find(' ', pos);
+        size_t newline = space != std::string::npos ? buf.find('\n', space) : space;
+        if (newline == std::string::npos) {
+            /* room for the longest tag, a space, a %u and a newline */
+            complete = buf.size() - pos > METADATA_TAG_MAX_LENGTH + 12;
+            break;
+        }
+
+        std::string tag = buf.substr(pos, space - pos);
+        unsigned int length = 0;
+        if (tag.empty() || tag.size() > METADATA_TAG_MAX_LENGTH || tag == METADATA_EOD ||
+            !android::base::ParseUint(buf.substr(space + 1, newline - space - 1), &length)) {
+            break;
+        }
+        if (newline + 1 + length > buf.size()) {
+            complete = false;
+            break;
+        }
+
+        /* found a tag */
+        index->tags.emplace(std::make_pair(tag, length),
+                            METADATA_START + sizeof(uint32_t) + newline + 1);
+        pos = newline + 1 + length;
     }
 
-    return 0;
+    index->end = METADATA_START + sizeof(uint32_t) + pos;
+    return complete;
 }
 
-static int metadata_find(const char *fname, const char *stag,
-        unsigned int slength, off64_t *offset)
+/* Reads the magic and the tags of fname with as few reads as possible. */
+static bool metadata_load(int fd, const char* fname, metadata_index* index)
 {
-    FILE *fp = NULL;
-    char tag[METADATA_TAG_MAX_LENGTH + 1];
-    int rc = -1;
-    int n;
-    long start = 0x4000; /* skip cryptfs metadata area */
     uint32_t magic;
-    unsigned int length = 0;
 
-    if (!fname) {
-        return -1;
+    if (TEMP_FAILURE_RETRY(pread64(fd, &magic, sizeof(magic), METADATA_START)) !=
+            sizeof(magic)) {
+        PERROR << "Failed to read magic from " << fname;
+        return false;
     }
 
-    fp = fopen(fname, "r+");
+    index->has_magic = magic == METADATA_MAGIC;
+    index->end = METADATA_START + sizeof(magic);
+    if (!index->has_magic) {
+        return true;
+    }
 
-    if (!fp) {
-        PERROR << "Failed to open " << fname;
-        goto out;
+    /* Usually a single read covers all the tags. */
+    std::string buf;
+    for (size_t size = METADATA_READ_SIZE;; size *= 2) {
+        buf.resize(size);
+        ssize_t n = TEMP_FAILURE_RETRY(pread64(fd, &buf[0], size,
+                                               METADATA_START + sizeof(magic)));
+        if (n < 0) {
+            PERROR << "Failed to read metadata from " << fname;
+            return false;
+        }
+        buf.resize(n);
+        if (metadata_parse(buf, index) || static_cast<size_t>(n) < size ||
+            size >= METADATA_MAX_SIZE) {
+            return true;
+        }
     }
+}
 
-    /* check magic */
-    if (fseek(fp, start, SEEK_SET) < 0 ||
-        fread(&magic, sizeof(magic), 1, fp) != 1) {
-        PERROR << "Failed to read magic from " << fname;
-        goto out;
+static bool pwrite_fully(int fd, const void* data, size_t size, off64_t offset)
+{
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(pwrite64(fd, p, size, offset));
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+        offset += n;
     }
+    return true;
+}
 
-    if (magic != METADATA_MAGIC) {
-        magic = METADATA_MAGIC;
+static int metadata_add(int fd, metadata_index* index, const char *tag,
+        unsigned int length, off64_t *offset)
+{
+    std::string header = android::base::StringPrintf("%s %u\n", tag, length);
+    std::string eod = METADATA_EOD " 0\n";
+    off64_t data = index->end + header.size();
 
-        if (fseek(fp, start, SEEK_SET) < 0 ||
-            fwrite(&magic, sizeof(magic), 1, fp) != 1) {
-            PERROR << "Failed to write magic to " << fname;
-            goto out;
-        }
+    if (!pwrite_fully(fd, header.data(), header.size(), index->end) ||
+        !pwrite_fully(fd, eod.data(), eod.size(), data + length)) {
+        return -1;
+    }
 
-        rc = metadata_add(fp, start + sizeof(magic), stag, slength, offset);
-        if (rc < 0) {
-            PERROR << "Failed to add metadata to " << fname;
-        }
+    index->tags.emplace(std::make_pair(tag, length), data);
+    index->end = data + length;
+    *offset = data;
+    return 0;
+}
 
-        goto out;
+static bool metadata_lookup(const metadata_index& index, const char *stag,
+        unsigned int slength, off64_t *offset)
+{
+    auto found = index.tags.find(std::make_pair(stag, slength));
+    if (found == index.tags.end()) {
+        return false;
     }
+    *offset = found->second;
+    return true;
+}
 
-    start += sizeof(magic);
+static int metadata_find(const char *fname, const char *stag,
+        unsigned int slength, off64_t *offset)
+{
+    if (!fname) {
+        return -1;
+    }
 
-    while (1) {
-        n = fscanf(fp, "%" STRINGIFY(METADATA_TAG_MAX_LENGTH) "s %u\n",
-                tag, &length);
+    std::lock_guard<std::mutex> lock(metadata_lock);
+    auto it = metadata_indices.find(fname);
+    if (it != metadata_indices.end() && metadata_lookup(it->second, stag, slength, offset)) {
+        return 0;
+    }
 
-        if (n == 2 && strcmp(tag, METADATA_EOD)) {
-            /* found a tag */
-            start = ftell(fp);
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(fname, O_RDWR | O_CLOEXEC)));
+    if (fd == -1) {
+        PERROR << "Failed to open " << fname;
+        return -1;
+    }
 
-            if (!strcmp(tag, stag) && length == slength) {
-                *offset = start;
-                rc = 0;
-                goto out;
-            }
+    if (it == metadata_indices.end()) {
+        metadata_index index;
+        if (!metadata_load(fd, fname, &index)) {
+            return -1;
+        }
+        it = metadata_indices.emplace(fname, std::move(index)).first;
+        if (metadata_lookup(it->second, stag, slength, offset)) {
+            return 0;
+        }
+    }
 
-            start += length;
+    metadata_index* index = &it->second;
+    if (!index->has_magic) {
+        uint32_t magic = METADATA_MAGIC;
 
-            if (fseek(fp, length, SEEK_CUR) < 0) {
-                PERROR << "Failed to seek " << fname;
-                goto out;
-            }
-        } else {
-            rc = metadata_add(fp, start, stag, slength, offset);
-            if (rc < 0) {
-                PERROR << "Failed to write metadata to " << fname;
-            }
-            goto out;
+        if (!pwrite_fully(fd, &magic, sizeof(magic), METADATA_START)) {
+            PERROR << "Failed to write magic to " << fname;
+            return -1;
         }
-   }
+        index->has_magic = true;
+    }
 
-out:
-    if (fp) {
-        fflush(fp);
-        fclose(fp);
+    if (metadata_add(fd, index, stag, slength, offset) < 0) {
+        PERROR << "Failed to write metadata to " << fname;
+        /* the partition is in an unknown state, read it again next time */
+        metadata_indices.erase(it);
+        return -1;
     }
 
-    return rc;
+    return 0;
 }
 
 static int write_verity_state(const char *fname, off64_t offset, int32_t mode)
@@ -571,7 +672,11 @@ static int read_partition(const char *path, uint64_t size)
     return 0;
 }
 
-static int compare_last_signature(struct fstab_rec *fstab, int *match)
+/* Compares the signature of the verity table with the one seen on the last
+ * boot. The verity metadata is read from the partition unless the caller
+ * already has it. */
+static int compare_last_signature(struct fstab_rec *fstab,
+        const struct fec_verity_metadata *metadata, int *match)
 {
     char tag[METADATA_TAG_MAX_LENGTH + 1];
     int fd = -1;
@@ -584,16 +689,20 @@ static int compare_last_signature(struct fstab_rec *fstab, int *match)
 
     *match = 1;
 
-    if (fec_open(&f, fstab->blk_device, O_RDONLY, FEC_VERITY_DISABLE,
-            FEC_DEFAULT_ROOTS) == -1) {
-        PERROR << "Failed to open '" << fstab->blk_device << "'";
-        return rc;
-    }
+    if (metadata) {
+        verity = *metadata;
+    } else {
+        if (fec_open(&f, fstab->blk_device, O_RDONLY, FEC_VERITY_DISABLE,
+                FEC_DEFAULT_ROOTS) == -1) {
+            PERROR << "Failed to open '" << fstab->blk_device << "'";
+            return rc;
+        }
 
-    // read verity metadata
-    if (fec_verity_get_metadata(f, &verity) == -1) {
-        PERROR << "Failed to get verity metadata '" << fstab->blk_device << "'";
-        goto out;
+        // read verity metadata
+        if (fec_verity_get_metadata(f, &verity) == -1) {
+            PERROR << "Failed to get verity metadata '" << fstab->blk_device << "'";
+            goto out;
+        }
     }
 
     SHA256(verity.signature, sizeof(verity.signature), curr);
@@ -638,7 +747,12 @@ static int compare_last_signature(struct fstab_rec *fstab, int *match)
     rc = 0;
 
 out:
-    fec_close(f);
+    if (fd != -1) {
+        close(fd);
+    }
+    if (f) {
+        fec_close(f);
+    }
     return rc;
 }
 
@@ -656,7 +770,8 @@ static int get_verity_state_offset(struct fstab_rec *fstab, off64_t *offset)
                 offset);
 }
 
-int load_verity_state(struct fstab_rec* fstab, int* mode) {
+static int load_verity_state(struct fstab_rec* fstab,
+                             const struct fec_verity_metadata* metadata, int* mode) {
     int match = 0;
     off64_t offset = 0;
 
@@ -683,7 +798,7 @@ int load_verity_state(struct fstab_rec* fstab, int* mode) {
         return write_verity_state(fstab->verity_loc, offset, *mode);
     }
 
-    if (!compare_last_signature(fstab, &match) && !match) {
+    if (!compare_last_signature(fstab, metadata, &match) && !match) {
         /* partition has been reflashed, reset dm-verity state */
         *mode = VERITY_MODE_DEFAULT;
         return write_verity_state(fstab->verity_loc, offset, *mode);
@@ -692,6 +807,10 @@ int load_verity_state(struct fstab_rec* fstab, int* mode) {
     return read_verity_state(fstab->verity_loc, offset, mode);
 }
 
+int load_verity_state(struct fstab_rec* fstab, int* mode) {
+    return load_verity_state(fstab, nullptr, mode);
+}
+
 // Update the verity table using the actual block device path.
 // Two cases:
 // Case-1: verity table is shared for devices with different by-name prefix.
@@ -822,7 +941,7 @@ int fs_mgr_setup_verity(struct fstab_rec *fstab, bool wait_for_verity_dev)
         goto out;
     }
 
-    if (load_verity_state(fstab, &params.mode) < 0) {
+    if (load_verity_state(fstab, &verity, &params.mode) < 0) {
         /* if accessing or updating the state failed, switch to the default
          * safe mode. This makes sure the device won't end up in an endless
          * restart loop, and no corrupted data will be exposed to userspace
@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <memory>
+#include <unordered_map>
 
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
@@ -68,15 +69,54 @@ public:
     virtual ~GateKeeperProxy() {
     }
 
+    // The secure user id files are only ever changed by this process, so their contents are
+    // kept in memory and the files are written through. A verify then does no file I/O at all.
+    struct SidEntry {
+        bool exists;
+        uint64_t sid;
+    };
+
+    const SidEntry& load_sid(uint32_t uid) {
+        auto it = sid_cache.find(uid);
+        if (it != sid_cache.end()) {
+            return it->second;
+        }
+
+        char filename[21];
+        SidEntry entry = { false, 0 };
+        snprintf(filename, sizeof(filename), "%u", uid);
+        int fd = open(filename, O_RDONLY);
+        if (fd >= 0) {
+            entry.exists = true;
+            if (read(fd, &entry.sid, sizeof(entry.sid)) != sizeof(entry.sid)) {
+                entry.sid = 0;
+            }
+            close(fd);
+        }
+        return sid_cache[uid] = entry;
+    }
+
     void store_sid(uint32_t uid, uint64_t sid) {
+        const SidEntry& cached = load_sid(uid);
+        if (cached.exists && cached.sid == sid) {
+            return;
+        }
+
         char filename[21];
         snprintf(filename, sizeof(filename), "%u", uid);
         int fd = open(filename, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR);
         if (fd < 0) {
             ALOGE("could not open file: %s: %s", filename, strerror(errno));
+            // the file may be in any state now, go back to it next time
+            sid_cache.erase(uid);
             return;
         }
-        write(fd, &sid, sizeof(sid));
+        if (write(fd, &sid, sizeof(sid)) != sizeof(sid)) {
+            ALOGE("could not write file: %s: %s", filename, strerror(errno));
+            sid_cache.erase(uid);
+        } else {
+            sid_cache[uid] = { true, sid };
+        }
         close(fd);
     }
 
@@ -110,22 +150,13 @@ public:
     }
 
     void maybe_store_sid(uint32_t uid, uint64_t sid) {
-        char filename[21];
-        snprintf(filename, sizeof(filename), "%u", uid);
-        if (access(filename, F_OK) == -1) {
+        if (!load_sid(uid).exists) {
             store_sid(uid, sid);
         }
     }
 
     uint64_t read_sid(uint32_t uid) {
-        char filename[21];
-        uint64_t sid;
-        snprintf(filename, sizeof(filename), "%u", uid);
-        int fd = open(filename, O_RDONLY);
-        if (fd < 0) return 0;
-        read(fd, &sid, sizeof(sid));
-        close(fd);
-        return sid;
+        return load_sid(uid).sid;
     }
 
     void clear_sid(uint32_t uid) {
@@ -133,10 +164,23 @@ public:
         snprintf(filename, sizeof(filename), "%u", uid);
         if (remove(filename) < 0) {
             ALOGE("%s: could not remove file [%s], attempting 0 write", __func__, strerror(errno));
+            sid_cache.erase(uid);
             store_sid(uid, 0);
+        } else {
+            sid_cache[uid] = { false, 0 };
         }
     }
 
+    sp<IKeystoreService> get_keystore() {
+        // Looked up once and kept until keystore restarts.
+        if (keystore == nullptr || !IInterface::asBinder(keystore)->isBinderAlive()) {
+            sp<IServiceManager> sm = defaultServiceManager();
+            sp<IBinder> binder = sm->getService(String16("android.security.keystore"));
+            keystore = interface_cast<IKeystoreService>(binder);
+        }
+        return keystore;
+    }
+
     virtual int enroll(uint32_t uid,
             const uint8_t *current_password_handle, uint32_t current_password_handle_length,
             const uint8_t *current_password, uint32_t current_password_length,
@@ -312,10 +356,7 @@ public:
         }
 
         if (ret == 0 && *auth_token != NULL && *auth_token_length > 0) {
-            // TODO: cache service?
-            sp<IServiceManager> sm = defaultServiceManager();
-            sp<IBinder> binder = sm->getService(String16("android.security.keystore"));
-            sp<IKeystoreService> service = interface_cast<IKeystoreService>(binder);
+            sp<IKeystoreService> service = get_keystore();
             if (service != NULL) {
                 auto ret = service->addAuthToken(*auth_token, *auth_token_length);
                 if (!ret.isOk()) {
@@ -387,6 +428,10 @@ private:
     std::unique_ptr<SoftGateKeeperDevice> soft_device;
 
     bool clear_state_if_needed_done;
+
+    // Only touched from the single binder thread, see main().
+    std::unordered_map<uint32_t, SidEntry> sid_cache;
+    sp<IKeystoreService> keystore;
 };
 }// namespace android
 
@@ -45,6 +45,8 @@
 #define ALWAYS_PLUGGED_CAPACITY 100
 #define MILLION 1.0e6
 #define DEFAULT_VBUS_VOLTAGE 5000000
+// sysfs attributes are at most a page
+#define SYSFS_ATTR_SIZE 4096
 
 namespace android {
 
@@ -82,7 +84,8 @@ static void initBatteryProperties(BatteryProperties* props) {
 }
 
 BatteryMonitor::BatteryMonitor() : mHealthdConfig(nullptr), mBatteryDevicePresent(false),
-    mAlwaysPluggedDevice(false), mBatteryFixedCapacity(0), mBatteryFixedTemperature(0) {
+    mAlwaysPluggedDevice(false), mBatteryFixedCapacity(0), mBatteryFixedTemperature(0),
+    mLastBatteryStatus(BATTERY_STATUS_UNKNOWN) {
     initBatteryProperties(&props);
 }
 
@@ -132,9 +135,41 @@ int BatteryMonitor::getBatteryHealth(const char* status) {
     return ret;
 }
 
+int BatteryMonitor::getSysfsFd(const String8& path) {
+    auto it = mSysfsFds.find(path.string());
+    if (it != mSysfsFds.end())
+        return it->second.get();
+
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.string(), O_RDONLY | O_CLOEXEC)));
+    if (fd == -1)
+        return -1;
+
+    int ret = fd.get();
+    mSysfsFds[path.string()] = std::move(fd);
+    return ret;
+}
+
 int BatteryMonitor::readFromFile(const String8& path, std::string* buf) {
-    if (android::base::ReadFileToString(path.c_str(), buf)) {
-        *buf = android::base::Trim(*buf);
+    char data[SYSFS_ATTR_SIZE];
+
+    buf->clear();
+    if (path.isEmpty())
+        return 0;
+
+    // Each read from the start of a sysfs attribute gets its current value, so the files
+    // are kept open. A supply that went away and came back needs them opened again.
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = getSysfsFd(path);
+        if (fd == -1)
+            break;
+
+        ssize_t n = TEMP_FAILURE_RETRY(pread(fd, data, sizeof(data), 0));
+        if (n >= 0) {
+            buf->assign(data, n);
+            *buf = android::base::Trim(*buf);
+            break;
+        }
+        mSysfsFds.erase(path.string());
     }
     return buf->length();
 }
@@ -192,6 +227,36 @@ int BatteryMonitor::getIntField(const String8& path) {
     return value;
 }
 
+void BatteryMonitor::invalidateCharger(const char* name) {
+    for (size_t i = 0; i < mChargerNames.size(); i++) {
+        if (mChargerNames[i] == name)
+            mChargerStates[i].stale = true;
+    }
+}
+
+void BatteryMonitor::invalidateChargers(void) {
+    for (auto& charger : mChargerStates)
+        charger.stale = true;
+}
+
+void BatteryMonitor::updateCharger(ChargerState* charger) {
+    std::string buf;
+
+    charger->stale = false;
+    charger->online = getIntField(charger->onlinePath);
+    if (!charger->online)
+        return;
+
+    charger->type = readPowerSupplyType(charger->typePath);
+    charger->maxCurrent = getIntField(charger->currentMaxPath);
+    if (readFromFile(charger->voltageMaxPath, &buf) > 0) {
+        charger->maxVoltage = 0;
+        android::base::ParseInt(buf, &charger->maxVoltage);
+    } else {
+        charger->maxVoltage = DEFAULT_VBUS_VOLTAGE;
+    }
+}
+
 bool BatteryMonitor::update(void) {
     bool logthis;
 
@@ -243,52 +308,43 @@ bool BatteryMonitor::update(void) {
     if (readFromFile(mHealthdConfig->batteryTechnologyPath, &buf) > 0)
         props.batteryTechnology = String8(buf.c_str());
 
+    // Some drivers only send a uevent for the battery when a charger comes or goes.
+    if (props.batteryStatus != mLastBatteryStatus) {
+        invalidateChargers();
+        mLastBatteryStatus = props.batteryStatus;
+    }
+
     unsigned int i;
     double MaxPower = 0;
 
-    for (i = 0; i < mChargerNames.size(); i++) {
-        String8 path;
-        path.appendFormat("%s/%s/online", POWER_SUPPLY_SYSFS_PATH,
-                          mChargerNames[i].string());
-        if (getIntField(path)) {
-            path.clear();
-            path.appendFormat("%s/%s/type", POWER_SUPPLY_SYSFS_PATH,
-                              mChargerNames[i].string());
-            switch(readPowerSupplyType(path)) {
-            case ANDROID_POWER_SUPPLY_TYPE_AC:
-                props.chargerAcOnline = true;
-                break;
-            case ANDROID_POWER_SUPPLY_TYPE_USB:
-                props.chargerUsbOnline = true;
-                break;
-            case ANDROID_POWER_SUPPLY_TYPE_WIRELESS:
-                props.chargerWirelessOnline = true;
-                break;
-            default:
-                KLOG_WARNING(LOG_TAG, "%s: Unknown power supply type\n",
-                             mChargerNames[i].string());
-            }
-            path.clear();
-            path.appendFormat("%s/%s/current_max", POWER_SUPPLY_SYSFS_PATH,
-                              mChargerNames[i].string());
-            int ChargingCurrent =
-                    (access(path.string(), R_OK) == 0) ? getIntField(path) : 0;
+    for (i = 0; i < mChargerStates.size(); i++) {
+        ChargerState& charger = mChargerStates[i];
+        if (charger.stale)
+            updateCharger(&charger);
+        if (!charger.online)
+            continue;
+
+        switch(charger.type) {
+        case ANDROID_POWER_SUPPLY_TYPE_AC:
+            props.chargerAcOnline = true;
+            break;
+        case ANDROID_POWER_SUPPLY_TYPE_USB:
+            props.chargerUsbOnline = true;
+            break;
+        case ANDROID_POWER_SUPPLY_TYPE_WIRELESS:
+            props.chargerWirelessOnline = true;
+            break;
+        default:
+            KLOG_WARNING(LOG_TAG, "%s: Unknown power supply type\n",
+                         mChargerNames[i].string());
+        }
 
-            path.clear();
-            path.appendFormat("%s/%s/voltage_max", POWER_SUPPLY_SYSFS_PATH,
-                              mChargerNames[i].string());
-
-            int ChargingVoltage =
-                (access(path.string(), R_OK) == 0) ? getIntField(path) :
-                DEFAULT_VBUS_VOLTAGE;
-
-            double power = ((double)ChargingCurrent / MILLION) *
-                           ((double)ChargingVoltage / MILLION);
-            if (MaxPower < power) {
-                props.maxChargingCurrent = ChargingCurrent;
-                props.maxChargingVoltage = ChargingVoltage;
-                MaxPower = power;
-            }
+        double power = ((double)charger.maxCurrent / MILLION) *
+                       ((double)charger.maxVoltage / MILLION);
+        if (MaxPower < power) {
+            props.maxChargingCurrent = charger.maxCurrent;
+            props.maxChargingVoltage = charger.maxVoltage;
+            MaxPower = power;
         }
     }
 
@@ -497,8 +553,18 @@ void BatteryMonitor::init(struct healthd_config *hc) {
             case ANDROID_POWER_SUPPLY_TYPE_WIRELESS:
                 path.clear();
                 path.appendFormat("%s/%s/online", POWER_SUPPLY_SYSFS_PATH, name);
-                if (access(path.string(), R_OK) == 0)
+                if (access(path.string(), R_OK) == 0) {
+                    ChargerState charger = {};
+                    charger.stale = true;
+                    charger.onlinePath = path;
+                    charger.typePath.appendFormat("%s/%s/type", POWER_SUPPLY_SYSFS_PATH, name);
+                    charger.currentMaxPath.appendFormat("%s/%s/current_max",
+                                                        POWER_SUPPLY_SYSFS_PATH, name);
+                    charger.voltageMaxPath.appendFormat("%s/%s/voltage_max",
+                                                        POWER_SUPPLY_SYSFS_PATH, name);
                     mChargerNames.add(String8(name));
+                    mChargerStates.push_back(charger);
+                }
                 break;
 
             case ANDROID_POWER_SUPPLY_TYPE_BATTERY:
@@ -131,7 +131,7 @@ status_t healthd_get_property(int id, struct BatteryProperty *val) {
     return gBatteryMonitor->getProperty(id, val);
 }
 
-void healthd_battery_update(void) {
+static void battery_update(void) {
     // Fast wake interval when on charger (watch for overheat);
     // slow wake interval when on battery (watch for drained battery).
 
@@ -139,8 +139,9 @@ void healthd_battery_update(void) {
        healthd_config.periodic_chores_interval_fast :
            healthd_config.periodic_chores_interval_slow;
 
-    if (new_wake_interval != wakealarm_wake_interval)
-            wakealarm_set_interval(new_wake_interval);
+    // The state was just read, so restart the wake alarm from now even if its interval
+    // didn't change: an update driven by a uevent takes the place of the next chores.
+    wakealarm_set_interval(new_wake_interval);
 
     // During awake periods poll at fast rate.  If wake alarm is set at fast
     // rate then just use the alarm; if wake alarm is set at slow rate then
@@ -155,6 +156,11 @@ void healthd_battery_update(void) {
                 -1 : healthd_config.periodic_chores_interval_fast * 1000;
 }
 
+void healthd_battery_update(void) {
+    gBatteryMonitor->invalidateChargers();
+    battery_update();
+}
+
 void healthd_dump_battery_state(int fd) {
     gBatteryMonitor->dumpState(fd);
     fsync(fd);
@@ -165,31 +171,58 @@ static void periodic_chores() {
 }
 
 #define UEVENT_MSG_LEN 2048
+// Returns whether the uevent in |msg| is from a power supply, and invalidates the state that
+// healthd keeps for it.
+static bool power_supply_uevent(const char* msg) {
+    const char* name = NULL;
+    bool power_supply = false;
+
+    for (const char* cp = msg; *cp; cp += strlen(cp) + 1) {
+        if (!strcmp(cp, "SUBSYSTEM=" POWER_SUPPLY_SUBSYSTEM))
+            power_supply = true;
+        else if (!strncmp(cp, "POWER_SUPPLY_NAME=", strlen("POWER_SUPPLY_NAME=")))
+            name = cp + strlen("POWER_SUPPLY_NAME=");
+    }
+
+    if (!power_supply)
+        return false;
+    if (name)
+        gBatteryMonitor->invalidateCharger(name);
+    else
+        gBatteryMonitor->invalidateChargers();
+    return true;
+}
+
 static void uevent_event(uint32_t /*epevents*/) {
     char msg[UEVENT_MSG_LEN+2];
-    char *cp;
+    bool update = false;
     int n;
 
-    n = uevent_kernel_multicast_recv(uevent_fd, msg, UEVENT_MSG_LEN);
-    if (n <= 0)
-        return;
-    if (n >= UEVENT_MSG_LEN)   /* overflow -- discard */
-        return;
-
-    msg[n] = '\0';
-    msg[n+1] = '\0';
-    cp = msg;
-
-    while (*cp) {
-        if (!strcmp(cp, "SUBSYSTEM=" POWER_SUPPLY_SUBSYSTEM)) {
-            healthd_battery_update();
-            break;
+    // A charger being plugged in sends a burst of uevents, so take all that are queued and
+    // read the state once.
+    while (true) {
+        n = uevent_kernel_multicast_recv(uevent_fd, msg, UEVENT_MSG_LEN);
+        if (n < 0 && (errno == EIO || errno == EINTR))
+            continue;          /* not from the kernel, or interrupted */
+        if (n < 0 && errno == ENOBUFS) {
+            // Some uevents were lost; they might have been ours.
+            gBatteryMonitor->invalidateChargers();
+            update = true;
+            continue;
         }
+        if (n <= 0)
+            break;
+        if (n >= UEVENT_MSG_LEN)   /* overflow -- discard */
+            continue;
 
-        /* advance to after the next \0 */
-        while (*cp++)
-            ;
+        msg[n] = '\0';
+        msg[n+1] = '\0';
+        if (power_supply_uevent(msg))
+            update = true;
     }
+
+    if (update)
+        battery_update();
 }
 
 static void uevent_init(void) {
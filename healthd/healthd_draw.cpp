@@ -24,7 +24,8 @@
 #define LOGV(x...) KLOG_DEBUG("charger", x);
 
 HealthdDraw::HealthdDraw(animation* anim)
-  : kSplitScreen(HEALTHD_DRAW_SPLIT_SCREEN),
+  : screen_valid_(false),
+    kSplitScreen(HEALTHD_DRAW_SPLIT_SCREEN),
     kSplitOffset(HEALTHD_DRAW_SPLIT_OFFSET) {
   gr_init();
   gr_font_size(gr_sys_font(), &char_width_, &char_height_);
@@ -48,17 +49,41 @@ HealthdDraw::HealthdDraw(animation* anim)
 HealthdDraw::~HealthdDraw() {}
 
 void HealthdDraw::redraw_screen(const animation* batt_anim, GRSurface* surf_unknown) {
+  bool unknown = batt_anim->cur_level < 0 || batt_anim->num_frames == 0;
+
+  // Most of the time nothing but the battery frame moves, and when not
+  // charging not even that, so only draw and flip when the picture changes.
+  screen_content content;
+  content.surface =
+      unknown ? surf_unknown : batt_anim->frames[batt_anim->cur_frame].surface;
+  content.level = unknown ? -1 : batt_anim->cur_level;
+  content.status = unknown ? -1 : batt_anim->cur_status;
+  content.minute = time(nullptr) / 60;
+  if (screen_valid_ && content.surface == screen_.surface &&
+      content.level == screen_.level && content.status == screen_.status &&
+      content.minute == screen_.minute) {
+    LOGV("screen unchanged\n");
+    return;
+  }
+
   clear_screen();
 
   /* try to display *something* */
-  if (batt_anim->cur_level < 0 || batt_anim->num_frames == 0)
+  if (unknown)
     draw_unknown(surf_unknown);
   else
     draw_battery(batt_anim);
   gr_flip();
+
+  screen_ = content;
+  screen_valid_ = true;
 }
 
-void HealthdDraw::blank_screen(bool blank) { gr_fb_blank(blank); }
+void HealthdDraw::blank_screen(bool blank) {
+  // The panel may not keep its contents while blanked.
+  if (blank) screen_valid_ = false;
+  gr_fb_blank(blank);
+}
 
 void HealthdDraw::clear_screen(void) {
   gr_color(0, 0, 0, 255);
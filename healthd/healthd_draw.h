@@ -17,6 +17,8 @@
 #ifndef HEALTHD_DRAW_H
 #define HEALTHD_DRAW_H
 
+#include <time.h>
+
 #include <linux/input.h>
 #include <minui/minui.h>
 
@@ -66,6 +68,17 @@ class HealthdDraw {
   int screen_width_;
   int screen_height_;
 
+  // What the last flip put on screen, so that redraws that would not change
+  // it can be skipped.
+  struct screen_content {
+    const GRSurface* surface;
+    int level;
+    int status;
+    time_t minute;
+  };
+  bool screen_valid_;
+  screen_content screen_;
+
   // Device screen is split vertically.
   const bool kSplitScreen;
   // Pixels to offset graphics towards center split.
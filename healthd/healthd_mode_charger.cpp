@@ -30,6 +30,7 @@
 #include <unistd.h>
 
 #include <functional>
+#include <future>
 
 #include <android-base/file.h>
 #include <android-base/macros.h>
@@ -88,6 +89,13 @@ struct key_state {
     int64_t timestamp;
 };
 
+// The frames of the battery_scale image, as decoded off the main thread.
+struct scale_frames {
+    int ret;
+    int count;
+    GRSurface** frames;
+};
+
 struct charger {
     bool have_battery_state;
     bool charger_connected;
@@ -98,7 +106,9 @@ struct charger {
     key_state keys[KEY_MAX + 1];
 
     animation* batt_anim;
+    std::future<scale_frames> pending_frames;
     GRSurface* surf_unknown;
+    bool surf_unknown_loaded;
     int boot_min_cap;
 };
 
@@ -272,6 +282,55 @@ static void reset_animation(animation* anim) {
     anim->run = false;
 }
 
+static scale_frames load_scale_frames(std::string file) {
+    scale_frames loaded;
+    int scale_fps;  // Not in use (charger/battery_scale doesn't have FPS text
+                    // chunk). We are using hard-coded frame.disp_time instead.
+    loaded.ret = res_create_multi_display_surface(file.c_str(), &loaded.count, &scale_fps,
+                                                  &loaded.frames);
+    return loaded;
+}
+
+/* Waits for the battery_scale frames to be decoded, the first time they are needed. */
+static void finish_loading_frames(charger* charger) {
+    animation* anim = charger->batt_anim;
+
+    if (!charger->pending_frames.valid()) return;
+
+    scale_frames loaded = charger->pending_frames.get();
+    if (loaded.ret < 0) {
+        LOGE("Cannot load battery_scale image\n");
+        anim->num_frames = 0;
+        anim->num_cycles = 1;
+    } else if (loaded.count != anim->num_frames) {
+        LOGE("battery_scale image has unexpected frame count (%d, expected %d)\n", loaded.count,
+             anim->num_frames);
+        anim->num_frames = 0;
+        anim->num_cycles = 1;
+    } else {
+        for (int i = 0; i < anim->num_frames; i++) {
+            anim->frames[i].surface = loaded.frames[i];
+        }
+    }
+}
+
+static void load_unknown_surface(charger* charger) {
+    int ret;
+
+    if (charger->surf_unknown_loaded) return;
+    charger->surf_unknown_loaded = true;
+
+    ret = res_create_display_surface(charger->batt_anim->fail_file.c_str(), &charger->surf_unknown);
+    if (ret < 0) {
+        LOGE("Cannot load custom battery_fail image. Reverting to built in.\n");
+        ret = res_create_display_surface("charger/battery_fail", &charger->surf_unknown);
+        if (ret < 0) {
+            LOGE("Cannot load built in battery_fail image\n");
+            charger->surf_unknown = NULL;
+        }
+    }
+}
+
 static void update_screen_state(charger* charger, int64_t now) {
     animation* batt_anim = charger->batt_anim;
     int disp_time;
@@ -296,6 +355,8 @@ static void update_screen_state(charger* charger, int64_t now) {
 #endif
     }
 
+    finish_loading_frames(charger);
+
     /* animation is over, blank screen and leave */
     if (batt_anim->num_cycles > 0 && batt_anim->cur_cycle == batt_anim->num_cycles) {
         reset_animation(batt_anim);
@@ -335,6 +396,7 @@ static void update_screen_state(charger* charger, int64_t now) {
     if (batt_anim->cur_cycle == 0) healthd_draw->blank_screen(false);
 
     /* draw the new frame (@ cur_frame) */
+    if (batt_anim->num_frames == 0 || batt_anim->cur_level < 0) load_unknown_surface(charger);
     healthd_draw->redraw_screen(charger->batt_anim, charger->surf_unknown);
 
     /* if we don't have anim frames, we only have one image, so just bump
@@ -615,52 +677,27 @@ animation* init_animation() {
 void healthd_mode_charger_init(struct healthd_config* config) {
     int ret;
     charger* charger = &charger_state;
-    int i;
     int epollfd;
 
     dump_last_kmsg();
 
     LOGW("--------------- STARTING CHARGER MODE ---------------\n");
 
+    animation* anim = init_animation();
+    charger->batt_anim = anim;
+
+    /* Decoding battery_scale takes a while, so let it overlap with the
+     * input and graphics setup; battery_fail is only decoded if it is shown.
+     */
+    charger->pending_frames = std::async(std::launch::async, load_scale_frames,
+                                         anim->animation_file);
+
     ret = ev_init(std::bind(&input_callback, charger, std::placeholders::_1, std::placeholders::_2));
     if (!ret) {
         epollfd = ev_get_epollfd();
         healthd_register_event(epollfd, charger_event_handler, EVENT_WAKEUP_FD);
     }
 
-    animation* anim = init_animation();
-    charger->batt_anim = anim;
-
-    ret = res_create_display_surface(anim->fail_file.c_str(), &charger->surf_unknown);
-    if (ret < 0) {
-        LOGE("Cannot load custom battery_fail image. Reverting to built in.\n");
-        ret = res_create_display_surface("charger/battery_fail", &charger->surf_unknown);
-        if (ret < 0) {
-            LOGE("Cannot load built in battery_fail image\n");
-            charger->surf_unknown = NULL;
-        }
-    }
-
-    GRSurface** scale_frames;
-    int scale_count;
-    int scale_fps;  // Not in use (charger/battery_scale doesn't have FPS text
-                    // chunk). We are using hard-coded frame.disp_time instead.
-    ret = res_create_multi_display_surface(anim->animation_file.c_str(), &scale_count, &scale_fps,
-                                           &scale_frames);
-    if (ret < 0) {
-        LOGE("Cannot load battery_scale image\n");
-        anim->num_frames = 0;
-        anim->num_cycles = 1;
-    } else if (scale_count != anim->num_frames) {
-        LOGE("battery_scale image has unexpected frame count (%d, expected %d)\n", scale_count,
-             anim->num_frames);
-        anim->num_frames = 0;
-        anim->num_cycles = 1;
-    } else {
-        for (i = 0; i < anim->num_frames; i++) {
-            anim->frames[i].surface = scale_frames[i];
-        }
-    }
     ev_sync_key_state(
         std::bind(&set_key_callback, charger, std::placeholders::_1, std::placeholders::_2));
 
@@ -17,6 +17,11 @@
 #ifndef HEALTHD_BATTERYMONITOR_H
 #define HEALTHD_BATTERYMONITOR_H
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/unique_fd.h>
 #include <batteryservice/BatteryService.h>
 #include <binder/IInterface.h>
 #include <utils/String8.h>
@@ -40,22 +45,44 @@ class BatteryMonitor {
     BatteryMonitor();
     void init(struct healthd_config *hc);
     bool update(void);
+    // Makes the next update() re-read the state of one charger, or all of them.
+    // The state of the other chargers is kept from the last update.
+    void invalidateCharger(const char* name);
+    void invalidateChargers(void);
     int getChargeStatus();
     status_t getProperty(int id, struct BatteryProperty *val);
     void dumpState(int fd);
 
   private:
+    struct ChargerState {
+        bool stale;
+        bool online;
+        PowerSupplyType type;
+        int maxCurrent;
+        int maxVoltage;
+        String8 onlinePath;
+        String8 typePath;
+        String8 currentMaxPath;
+        String8 voltageMaxPath;
+    };
+
     struct healthd_config *mHealthdConfig;
     Vector<String8> mChargerNames;
+    std::vector<ChargerState> mChargerStates;
+    // open power_supply attributes, path -> fd
+    std::unordered_map<std::string, android::base::unique_fd> mSysfsFds;
     bool mBatteryDevicePresent;
     bool mAlwaysPluggedDevice;
     int mBatteryFixedCapacity;
     int mBatteryFixedTemperature;
+    int mLastBatteryStatus;
     struct BatteryProperties props;
 
     int getBatteryStatus(const char* status);
     int getBatteryHealth(const char* status);
     int readFromFile(const String8& path, std::string* buf);
+    int getSysfsFd(const String8& path);
+    void updateCharger(ChargerState* charger);
     PowerSupplyType readPowerSupplyType(const String8& path);
     bool getBooleanField(const String8& path);
     int getIntField(const String8& path);
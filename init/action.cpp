@@ -23,6 +23,7 @@
 
 #include "util.h"
 
+using android::base::boot_clock;
 using android::base::Join;
 
 namespace android {
@@ -245,9 +246,29 @@ ActionManager& ActionManager::GetInstance() {
 }
 
 void ActionManager::AddAction(std::unique_ptr<Action> action) {
+    IndexAction(action.get());
     actions_.emplace_back(std::move(action));
 }
 
+void ActionManager::IndexAction(const Action* action) {
+    // Actions with an event trigger never match a property change.
+    if (!action->event_trigger().empty()) return;
+
+    for (const auto& [trigger_name, trigger_value] : action->property_triggers()) {
+        property_actions_[trigger_name].emplace_back(action);
+    }
+}
+
+void ActionManager::UnindexAction(const Action* action) {
+    for (const auto& [trigger_name, trigger_value] : action->property_triggers()) {
+        auto it = property_actions_.find(trigger_name);
+        if (it == property_actions_.end()) continue;
+        auto& actions = it->second;
+        actions.erase(std::remove(actions.begin(), actions.end(), action), actions.end());
+        if (actions.empty()) property_actions_.erase(it);
+    }
+}
+
 void ActionManager::QueueEventTrigger(const std::string& trigger) {
     event_queue_.emplace(trigger);
 }
@@ -271,18 +292,37 @@ void ActionManager::QueueBuiltinAction(BuiltinFunction func, const std::string&
     action->AddCommand(func, name_vector, 0);
 
     event_queue_.emplace(action.get());
+    IndexAction(action.get());
     actions_.emplace_back(std::move(action));
 }
 
 void ActionManager::ExecuteOneCommand() {
     // Loop through the event queue until we have an action to execute
     while (current_executing_actions_.empty() && !event_queue_.empty()) {
-        for (const auto& action : actions_) {
-            if (std::visit([&action](const auto& event) { return action->CheckEvent(event); },
-                           event_queue_.front())) {
-                current_executing_actions_.emplace(action.get());
+        auto start = boot_clock::now();
+        const auto& event = event_queue_.front();
+        auto property_change = std::get_if<PropertyChange>(&event);
+        if (property_change && !property_change->first.empty()) {
+            auto it = property_actions_.find(property_change->first);
+            if (it != property_actions_.end()) {
+                for (const Action* action : it->second) {
+                    ++trigger_stats_.checks;
+                    if (action->CheckEvent(*property_change)) {
+                        current_executing_actions_.emplace(action);
+                    }
+                }
+            }
+        } else {
+            for (const auto& action : actions_) {
+                ++trigger_stats_.checks;
+                if (std::visit([&action](const auto& event) { return action->CheckEvent(event); },
+                               event)) {
+                    current_executing_actions_.emplace(action.get());
+                }
             }
         }
+        ++trigger_stats_.events;
+        trigger_stats_.duration += boot_clock::now() - start;
         event_queue_.pop();
     }
 
@@ -308,6 +348,7 @@ void ActionManager::ExecuteOneCommand() {
         current_executing_actions_.pop();
         current_command_ = 0;
         if (action->oneshot()) {
+            UnindexAction(action);
             auto eraser = [&action] (std::unique_ptr<Action>& a) {
                 return a.get() == action;
             };
@@ -324,6 +365,15 @@ void ActionManager::DumpState() const {
     for (const auto& a : actions_) {
         a->DumpState();
     }
+    DumpTriggerStats();
+}
+
+void ActionManager::DumpTriggerStats() const {
+    LOG(INFO) << "matched " << trigger_stats_.events << " events against " << actions_.size()
+              << " actions with " << trigger_stats_.checks << " trigger checks in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(trigger_stats_.duration)
+                         .count()
+              << "us";
 }
 
 void ActionManager::ClearQueue() {
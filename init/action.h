@@ -17,9 +17,11 @@
 #ifndef _INIT_ACTION_H
 #define _INIT_ACTION_H
 
+#include <chrono>
 #include <map>
 #include <queue>
 #include <string>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -66,6 +68,10 @@ class Action {
     std::string BuildTriggersString() const;
     void DumpState() const;
 
+    const std::map<std::string, std::string>& property_triggers() const {
+        return property_triggers_;
+    }
+    const std::string& event_trigger() const { return event_trigger_; }
     bool oneshot() const { return oneshot_; }
     const std::string& filename() const { return filename_; }
     int line() const { return line_; }
@@ -89,6 +95,14 @@ private:
     static const KeywordMap<BuiltinFunction>* function_map_;
 };
 
+// How much work matching queued events against actions' triggers has been.
+struct TriggerStats {
+    uint64_t events = 0;
+    // Actions whose triggers were checked against an event.
+    uint64_t checks = 0;
+    std::chrono::nanoseconds duration = {};
+};
+
 class ActionManager {
   public:
     static ActionManager& GetInstance();
@@ -104,13 +118,23 @@ class ActionManager {
     void ExecuteOneCommand();
     bool HasMoreCommands() const;
     void DumpState() const;
+    void DumpTriggerStats() const;
     void ClearQueue();
 
+    const TriggerStats& trigger_stats() const { return trigger_stats_; }
+
   private:
     ActionManager(ActionManager const&) = delete;
     void operator=(ActionManager const&) = delete;
 
+    void IndexAction(const Action* action);
+    void UnindexAction(const Action* action);
+
     std::vector<std::unique_ptr<Action>> actions_;
+    // Actions that only have property triggers, by the name of each property they trigger on, in
+    // the same order as actions_. A property change can only match the actions listed under it.
+    std::unordered_map<std::string, std::vector<const Action*>> property_actions_;
+    TriggerStats trigger_stats_;
     std::queue<std::variant<EventTrigger, PropertyChange, BuiltinAction>> event_queue_;
     std::queue<const Action*> current_executing_actions_;
     std::size_t current_command_;
@@ -31,11 +31,14 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 
 using android::base::StringPrintf;
 using namespace std::chrono_literals;
@@ -62,30 +65,39 @@ static std::unique_ptr<FILE, decltype(&fclose)> fopen_unique(const char* filenam
   return result;
 }
 
-static void log_header() {
+static bool get_header(std::string* header) {
   char date[32];
   time_t now_t = time(NULL);
   struct tm now = *localtime(&now_t);
   strftime(date, sizeof(date), "%F %T", &now);
 
   utsname uts;
-  if (uname(&uts) == -1) return;
+  if (uname(&uts) == -1) return false;
 
   std::string fingerprint = android::base::GetProperty("ro.build.fingerprint", "");
-  if (fingerprint.empty()) return;
+  if (fingerprint.empty()) return false;
 
   std::string kernel_cmdline;
   android::base::ReadFileToString("/proc/cmdline", &kernel_cmdline);
 
+  *header = "version = Android init 0.8\n";
+  *header += StringPrintf("title = Boot chart for Android (%s)\n", date);
+  *header += StringPrintf("system.uname = %s %s %s %s\n", uts.sysname, uts.release, uts.version,
+                          uts.machine);
+  *header += StringPrintf("system.release = %s\n", fingerprint.c_str());
+  // TODO: use /proc/cpuinfo "model name" line for x86, "Processor" line for arm.
+  *header += StringPrintf("system.cpu = %s\n", uts.machine);
+  *header += StringPrintf("system.kernel.options = %s\n", kernel_cmdline.c_str());
+  return true;
+}
+
+static void log_header() {
+  std::string header;
+  if (!get_header(&header)) return;
+
   auto fp = fopen_unique("/data/bootchart/header", "we");
   if (!fp) return;
-  fprintf(&*fp, "version = Android init 0.8\n");
-  fprintf(&*fp, "title = Boot chart for Android (%s)\n", date);
-  fprintf(&*fp, "system.uname = %s %s %s %s\n", uts.sysname, uts.release, uts.version, uts.machine);
-  fprintf(&*fp, "system.release = %s\n", fingerprint.c_str());
-  // TODO: use /proc/cpuinfo "model name" line for x86, "Processor" line for arm.
-  fprintf(&*fp, "system.cpu = %s\n", uts.machine);
-  fprintf(&*fp, "system.kernel.options = %s\n", kernel_cmdline.c_str());
+  fputs(header.c_str(), &*fp);
 }
 
 static void log_uptime(FILE* log) {
@@ -135,6 +147,244 @@ static void log_processes(FILE* log) {
   fputc('\n', log);
 }
 
+// Binary mode writes everything to a single file of records instead, each of which is a uint32_t
+// type and a uint32_t payload size followed by the payload. Rather than copying every
+// /proc/<pid>/stat, it keeps only the fields that bootchart uses, and only writes a task's name
+// when it changes. Files are read into one buffer that's reused for the whole run, and each
+// sample is written with a single write(). convert-bootchart.py turns the records back into the
+// text logs; keep the two in sync.
+static constexpr uint32_t kRecordHeader = 1;     // The text of the header file.
+static constexpr uint32_t kRecordSample = 2;     // uint64_t uptime in jiffies, for what follows.
+static constexpr uint32_t kRecordProcStat = 3;   // The text of /proc/stat.
+static constexpr uint32_t kRecordDiskStats = 4;  // The text of /proc/diskstats.
+static constexpr uint32_t kRecordTaskName = 5;   // uint32_t pid, then the task's name.
+// uint32_t pid, ppid and state, then uint64_t utime, stime and starttime in jiffies.
+static constexpr uint32_t kRecordTask = 6;
+// uint32_t pid, then uint64_t time spent running and waiting to run in ns, and timeslices.
+static constexpr uint32_t kRecordTaskSchedStat = 7;
+// uint32_t pid, then uint64_t bytes read from and written to storage.
+static constexpr uint32_t kRecordTaskIo = 8;
+
+class BinaryBootchart {
+ public:
+  BinaryBootchart(bool schedstat, bool io) : schedstat_(schedstat), io_(io) {}
+
+  bool Start();
+  bool LogSample();
+
+ private:
+  struct TaskName {
+    uint64_t starttime;
+    std::string comm;
+  };
+
+  bool ReadFile(const char* path);
+  void AppendRecord(uint32_t type, const void* data, size_t size);
+  void BeginRecord(uint32_t type);
+  template <typename T> void Append(T value) {
+    record_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+  void EndRecord();
+  void LogTask(int pid);
+  void LogTaskName(int pid, uint64_t starttime, const char* comm, size_t comm_size);
+
+  const bool schedstat_;
+  const bool io_;
+  android::base::unique_fd fd_;
+  std::unique_ptr<DIR, int(*)(DIR*)> proc_{nullptr, closedir};
+  std::vector<char> buffer_ = std::vector<char>(16 * 1024);
+  size_t buffer_size_ = 0;
+  std::string record_;
+  size_t record_start_ = 0;
+  std::unordered_map<int, TaskName> task_names_;
+};
+
+bool BinaryBootchart::Start() {
+  fd_.reset(open("/data/bootchart/bootchart.bin", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+  if (fd_ == -1) {
+    PLOG(ERROR) << "bootchart: failed to open /data/bootchart/bootchart.bin";
+    return false;
+  }
+  proc_.reset(opendir("/proc"));
+  if (!proc_) {
+    PLOG(ERROR) << "bootchart: failed to open /proc";
+    return false;
+  }
+
+  std::string header;
+  if (get_header(&header)) {
+    AppendRecord(kRecordHeader, header.data(), header.size());
+  }
+  return true;
+}
+
+// Reads |path| into buffer_, leaving its size in buffer_size_ and a NUL after it.
+bool BinaryBootchart::ReadFile(const char* path) {
+  android::base::unique_fd fd(open(path, O_RDONLY | O_CLOEXEC));
+  if (fd == -1) return false;
+
+  buffer_size_ = 0;
+  while (true) {
+    if (buffer_size_ + 1 == buffer_.size()) buffer_.resize(buffer_.size() * 2);
+    ssize_t n = TEMP_FAILURE_RETRY(
+        read(fd, &buffer_[buffer_size_], buffer_.size() - 1 - buffer_size_));
+    if (n == -1) return false;
+    if (n == 0) break;
+    buffer_size_ += n;
+  }
+  buffer_[buffer_size_] = '\0';
+  return true;
+}
+
+void BinaryBootchart::BeginRecord(uint32_t type) {
+  record_start_ = record_.size();
+  Append(type);
+  Append(static_cast<uint32_t>(0));
+}
+
+void BinaryBootchart::EndRecord() {
+  uint32_t size = record_.size() - record_start_ - 2 * sizeof(uint32_t);
+  memcpy(&record_[record_start_ + sizeof(uint32_t)], &size, sizeof(size));
+}
+
+void BinaryBootchart::AppendRecord(uint32_t type, const void* data, size_t size) {
+  BeginRecord(type);
+  record_.append(static_cast<const char*>(data), size);
+  EndRecord();
+}
+
+void BinaryBootchart::LogTaskName(int pid, uint64_t starttime, const char* comm,
+                                  size_t comm_size) {
+  // Processes often rename themselves after they start, so check the name each time, but only
+  // log it when it changes.
+  auto& task_name = task_names_[pid];
+  if (task_name.starttime == starttime && task_name.comm.compare(0, std::string::npos, comm,
+                                                                 comm_size) == 0) {
+    return;
+  }
+  task_name.starttime = starttime;
+  task_name.comm.assign(comm, comm_size);
+
+  // /proc/<pid>/stat only has truncated task names, so get the full name from
+  // /proc/<pid>/cmdline when there is one.
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
+  BeginRecord(kRecordTaskName);
+  Append(static_cast<uint32_t>(pid));
+  if (ReadFile(path) && buffer_size_ > 0 && buffer_[0] != '\0') {
+    record_.append(&buffer_[0], strnlen(&buffer_[0], buffer_size_));
+  } else {
+    record_.append(task_name.comm);
+  }
+  EndRecord();
+}
+
+void BinaryBootchart::LogTask(int pid) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  if (!ReadFile(path)) return;
+
+  // The name is in parentheses, and may itself contain spaces and parentheses.
+  char* open = strchr(&buffer_[0], '(');
+  char* close = strrchr(&buffer_[0], ')');
+  if (open == nullptr || close == nullptr || close < open) return;
+
+  // Fields 3 onwards, counting from 1 as proc(5) does.
+  uint64_t fields[23] = {};
+  if (close[1] != ' ' || close[2] == '\0') return;
+  char* p = close + 2;
+  char state = *p++;
+  for (size_t i = 4; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+    fields[i] = strtoull(p, &p, 10);
+  }
+  uint64_t utime = fields[14];
+  uint64_t stime = fields[15];
+  uint64_t starttime = fields[22];
+
+  LogTaskName(pid, starttime, open + 1, close - open - 1);
+
+  BeginRecord(kRecordTask);
+  Append(static_cast<uint32_t>(pid));
+  Append(static_cast<uint32_t>(fields[4]));
+  Append(static_cast<uint32_t>(state));
+  Append(utime);
+  Append(stime);
+  Append(starttime);
+  EndRecord();
+
+  if (schedstat_) {
+    snprintf(path, sizeof(path), "/proc/%d/schedstat", pid);
+    if (ReadFile(path)) {
+      char* q = &buffer_[0];
+      uint64_t run_ns = strtoull(q, &q, 10);
+      uint64_t wait_ns = strtoull(q, &q, 10);
+      uint64_t timeslices = strtoull(q, &q, 10);
+      BeginRecord(kRecordTaskSchedStat);
+      Append(static_cast<uint32_t>(pid));
+      Append(run_ns);
+      Append(wait_ns);
+      Append(timeslices);
+      EndRecord();
+    }
+  }
+
+  if (io_) {
+    snprintf(path, sizeof(path), "/proc/%d/io", pid);
+    if (ReadFile(path)) {
+      const char* read_bytes = strstr(&buffer_[0], "\nread_bytes: ");
+      const char* write_bytes = strstr(&buffer_[0], "\nwrite_bytes: ");
+      if (read_bytes != nullptr && write_bytes != nullptr) {
+        BeginRecord(kRecordTaskIo);
+        Append(static_cast<uint32_t>(pid));
+        Append(static_cast<uint64_t>(strtoull(read_bytes + strlen("\nread_bytes: "), nullptr, 10)));
+        Append(static_cast<uint64_t>(strtoull(write_bytes + strlen("\nwrite_bytes: "), nullptr, 10)));
+        EndRecord();
+      }
+    }
+  }
+}
+
+bool BinaryBootchart::LogSample() {
+  uint64_t uptime = get_uptime_jiffies();
+  AppendRecord(kRecordSample, &uptime, sizeof(uptime));
+
+  if (ReadFile("/proc/stat")) AppendRecord(kRecordProcStat, &buffer_[0], buffer_size_);
+  if (ReadFile("/proc/diskstats")) AppendRecord(kRecordDiskStats, &buffer_[0], buffer_size_);
+
+  rewinddir(proc_.get());
+  while (dirent* entry = readdir(proc_.get())) {
+    // Only match numeric values.
+    int pid = atoi(entry->d_name);
+    if (pid == 0) continue;
+    LogTask(pid);
+  }
+
+  bool result = android::base::WriteFully(fd_, record_.data(), record_.size());
+  if (!result) PLOG(ERROR) << "bootchart: failed to write /data/bootchart/bootchart.bin";
+  record_.clear();
+  return result;
+}
+
+static bool wait_for_next_sample() {
+  std::unique_lock<std::mutex> lock(g_bootcharting_finished_mutex);
+  g_bootcharting_finished_cv.wait_for(lock, 200ms);
+  return !g_bootcharting_finished;
+}
+
+static void bootchart_binary_thread_main(bool schedstat, bool io) {
+  LOG(INFO) << "Bootcharting started (binary" << (schedstat ? ", schedstat" : "")
+            << (io ? ", io" : "") << ")";
+
+  BinaryBootchart bootchart(schedstat, io);
+  if (!bootchart.Start()) return;
+
+  while (wait_for_next_sample()) {
+    if (!bootchart.LogSample()) break;
+  }
+
+  LOG(INFO) << "Bootcharting finished";
+}
+
 static void bootchart_thread_main() {
   LOG(INFO) << "Bootcharting started";
 
@@ -148,13 +398,7 @@ static void bootchart_thread_main() {
 
   log_header();
 
-  while (true) {
-    {
-      std::unique_lock<std::mutex> lock(g_bootcharting_finished_mutex);
-      g_bootcharting_finished_cv.wait_for(lock, 200ms);
-      if (g_bootcharting_finished) break;
-    }
-
+  while (wait_for_next_sample()) {
     log_file(&*stat_log, "/proc/stat");
     log_file(&*disk_log, "/proc/diskstats");
     log_processes(&*proc_log);
@@ -164,14 +408,35 @@ static void bootchart_thread_main() {
 }
 
 static int do_bootchart_start() {
-  // We don't care about the content, but we do care that /data/bootchart/enabled actually exists.
+  // /data/bootchart/enabled must exist. It may also list options, separated by whitespace:
+  // "binary" to write bootchart.bin rather than the text logs, and "schedstat" and "io" to also
+  // sample each task's scheduling and I/O statistics in binary mode.
   std::string start;
   if (!android::base::ReadFileToString("/data/bootchart/enabled", &start)) {
     LOG(VERBOSE) << "Not bootcharting";
     return 0;
   }
 
-  g_bootcharting_thread = new std::thread(bootchart_thread_main);
+  bool binary = false;
+  bool schedstat = false;
+  bool io = false;
+  for (const auto& option : android::base::Split(android::base::Trim(start), " \t\n")) {
+    if (option == "binary") {
+      binary = true;
+    } else if (option == "schedstat") {
+      schedstat = true;
+    } else if (option == "io") {
+      io = true;
+    } else if (!option.empty()) {
+      LOG(WARNING) << "bootchart: ignoring unknown option '" << option << "'";
+    }
+  }
+
+  if (binary) {
+    g_bootcharting_thread = new std::thread(bootchart_binary_thread_main, schedstat, io);
+  } else {
+    g_bootcharting_thread = new std::thread(bootchart_thread_main);
+  }
   return 0;
 }
 
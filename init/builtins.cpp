@@ -39,6 +39,8 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <thread>
+
 #include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -47,6 +49,7 @@
 #include <android-base/strings.h>
 #include <bootloader_message/bootloader_message.h>
 #include <cutils/android_reboot.h>
+#include <cutils/iosched_policy.h>
 #include <ext4_utils/ext4_crypt.h>
 #include <ext4_utils/ext4_crypt_init_extensions.h>
 #include <fs_mgr.h>
@@ -59,6 +62,7 @@
 #include "init.h"
 #include "init_parser.h"
 #include "property_service.h"
+#include "readahead.h"
 #include "reboot.h"
 #include "service.h"
 #include "signal_handler.h"
@@ -129,8 +133,7 @@ static int do_class_start(const std::vector<std::string>& args) {
          * which are explicitly disabled.  They must
          * be started individually.
          */
-    ServiceManager::GetInstance().
-        ForEachServiceInClass(args[1], [] (Service* s) { s->StartIfNotDisabled(); });
+    ServiceManager::GetInstance().StartClass(args[1]);
     return 0;
 }
 
@@ -825,6 +828,49 @@ static int do_load_system_props(const std::vector<std::string>& args) {
     return 0;
 }
 
+// Both readahead commands do their work on a background thread, since walking directories or
+// reading files would otherwise hold up every other action and property change.
+static int do_readahead_record(const std::vector<std::string>& args) {
+    std::string trace = args[1];
+    std::vector<std::string> dirs(args.begin() + 2, args.end());
+    std::thread([trace, dirs]() {
+        android::base::Timer t;
+        std::vector<ReadaheadRange> ranges;
+        for (const auto& dir : dirs) {
+            GetCachedRangesInDir(dir, &ranges);
+        }
+        std::string err;
+        if (!WriteReadaheadTrace(trace, ranges, &err)) {
+            LOG(ERROR) << "readahead_record: " << err;
+            return;
+        }
+        LOG(INFO) << "readahead_record: recorded " << ranges.size() << " ranges to " << trace
+                  << " in " << t;
+    }).detach();
+    return 0;
+}
+
+static int do_readahead_replay(const std::vector<std::string>& args) {
+    std::vector<ReadaheadRange> ranges;
+    std::string err;
+    if (!ReadReadaheadTrace(args[1], &ranges, &err)) {
+        // There won't be a trace until one boot has recorded it.
+        LOG(INFO) << "readahead_replay: " << err;
+        return -1;
+    }
+    std::thread([ranges = std::move(ranges)]() {
+        // The threads that ReadaheadRanges() starts inherit these, so that the reads only use
+        // what the rest of boot leaves idle.
+        setpriority(PRIO_PROCESS, gettid(), 19);
+        android_set_ioprio(gettid(), IoSchedClass_BE, 7);
+
+        android::base::Timer t;
+        ReadaheadRanges(ranges);
+        LOG(INFO) << "readahead_replay: read " << ranges.size() << " ranges in " << t;
+    }).detach();
+    return 0;
+}
+
 static int do_wait(const std::vector<std::string>& args) {
     if (args.size() == 2) {
         return wait_for_file(args[1].c_str(), kCommandRetryTimeout);
@@ -923,6 +969,8 @@ const BuiltinFunctionMap::Map& BuiltinFunctionMap::map() const {
         {"mkdir",                   {1,     4,    do_mkdir}},
         {"mount_all",               {1,     kMax, do_mount_all}},
         {"mount",                   {3,     kMax, do_mount}},
+        {"readahead_record",        {2,     kMax, do_readahead_record}},
+        {"readahead_replay",        {1,     1,    do_readahead_replay}},
         {"umount",                  {1,     1,    do_umount}},
         {"restart",                 {1,     1,    do_restart}},
         {"restorecon",              {1,     kMax, do_restorecon}},
@@ -0,0 +1,164 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2017 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+"""Converts a binary bootchart.bin written by init into a bootchart.tgz.
+
+The tarball holds the same header, proc_stat.log, proc_ps.log and
+proc_diskstats.log that init writes in text mode, so it can be used with
+pybootchartgui and compare-bootcharts.py as before.
+
+If the bootchart also sampled scheduling or I/O statistics, the tasks that
+spent longest waiting to run and that did the most I/O are printed.
+
+The record format is described in bootchart.cpp; keep the two in sync.
+"""
+
+from __future__ import print_function
+
+import argparse
+import io
+import struct
+import sys
+import tarfile
+import time
+
+RECORD_HEADER = 1
+RECORD_SAMPLE = 2
+RECORD_PROC_STAT = 3
+RECORD_DISK_STATS = 4
+RECORD_TASK_NAME = 5
+RECORD_TASK = 6
+RECORD_TASK_SCHEDSTAT = 7
+RECORD_TASK_IO = 8
+
+# The number of fields in /proc/<pid>/stat that are written out for each task.
+STAT_FIELDS = 44
+
+
+def read_records(data):
+    offset = 0
+    while offset + 8 <= len(data):
+        record_type, size = struct.unpack_from('<II', data, offset)
+        offset += 8
+        if offset + size > len(data):
+            print('warning: ignoring truncated record at the end', file=sys.stderr)
+            return
+        yield record_type, data[offset:offset + size]
+        offset += size
+
+
+def stat_line(pid, name, ppid, state, utime, stime, starttime):
+    fields = [0] * STAT_FIELDS
+    fields[3] = ppid
+    fields[13] = utime
+    fields[14] = stime
+    fields[21] = starttime
+    rest = ' '.join(str(f) for f in fields[3:])
+    return '{} ({}) {} {}\n'.format(pid, name, state, rest)
+
+
+def convert(data):
+    header = ''
+    proc_stat = []
+    proc_ps = []
+    diskstats = []
+    names = {}
+    wait_ns = {}
+    io_bytes = {}
+    sample_uptime = '0\n'
+
+    for record_type, payload in read_records(data):
+        if record_type == RECORD_HEADER:
+            header = payload.decode('utf-8', 'replace')
+        elif record_type == RECORD_SAMPLE:
+            uptime = '{}\n'.format(struct.unpack('<Q', payload)[0])
+            # Close the previous sample's list of processes and start the next.
+            if proc_ps:
+                proc_ps.append('\n')
+            proc_ps.append(uptime)
+            sample_uptime = uptime
+        elif record_type == RECORD_PROC_STAT:
+            proc_stat.append(sample_uptime + payload.decode('utf-8', 'replace') + '\n')
+        elif record_type == RECORD_DISK_STATS:
+            diskstats.append(sample_uptime + payload.decode('utf-8', 'replace') + '\n')
+        elif record_type == RECORD_TASK_NAME:
+            pid = struct.unpack_from('<I', payload)[0]
+            names[pid] = payload[4:].decode('utf-8', 'replace')
+        elif record_type == RECORD_TASK:
+            pid, ppid, state, utime, stime, starttime = struct.unpack('<IIIQQQ', payload)
+            proc_ps.append(stat_line(pid, names.get(pid, '?'), ppid, chr(state), utime, stime,
+                                     starttime))
+        elif record_type == RECORD_TASK_SCHEDSTAT:
+            pid, _, wait, _ = struct.unpack('<IQQQ', payload)
+            wait_ns[names.get(pid, str(pid))] = wait
+        elif record_type == RECORD_TASK_IO:
+            pid, read_bytes, write_bytes = struct.unpack('<IQQ', payload)
+            io_bytes[names.get(pid, str(pid))] = (read_bytes, write_bytes)
+        else:
+            print('warning: ignoring unknown record type {}'.format(record_type),
+                  file=sys.stderr)
+    if proc_ps:
+        proc_ps.append('\n')
+
+    files = {
+        'header': header,
+        'proc_stat.log': ''.join(proc_stat),
+        'proc_ps.log': ''.join(proc_ps),
+        'proc_diskstats.log': ''.join(diskstats),
+    }
+    return files, wait_ns, io_bytes
+
+
+def write_tarball(path, files):
+    with tarfile.open(path, 'w:gz') as tar:
+        for name in ['header', 'proc_stat.log', 'proc_ps.log', 'proc_diskstats.log']:
+            content = files[name].encode('utf-8')
+            info = tarfile.TarInfo(name)
+            info.size = len(content)
+            info.mtime = time.time()
+            tar.addfile(info, io.BytesIO(content))
+
+
+def print_top(title, values, key, fmt, count):
+    if not values:
+        return
+    print(title)
+    for name, value in sorted(values.items(), key=key, reverse=True)[:count]:
+        print('  ' + fmt(value) + '  ' + name)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', help='bootchart.bin pulled from /data/bootchart')
+    parser.add_argument('output', help='bootchart.tgz to write')
+    parser.add_argument('--top', type=int, default=10,
+                        help='how many tasks to list for scheduling and I/O statistics')
+    args = parser.parse_args()
+
+    with open(args.input, 'rb') as f:
+        files, wait_ns, io_bytes = convert(f.read())
+    write_tarball(args.output, files)
+
+    # Each task's statistics accumulate over its life, so its last sample is its total.
+    print_top('Longest waiting to run (ms):', wait_ns, lambda item: item[1],
+              lambda value: '{:10.1f}'.format(value / 1e6), args.top)
+    print_top('Most I/O (KB read, KB written):', io_bytes, lambda item: sum(item[1]),
+              lambda value: '{:10d} {:10d}'.format(value[0] // 1024, value[1] // 1024), args.top)
+
+
+if __name__ == '__main__':
+    main()
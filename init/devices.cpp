@@ -18,6 +18,7 @@
 
 #include <errno.h>
 #include <fnmatch.h>
+#include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include <unistd.h>
 
@@ -131,6 +132,62 @@ bool Permissions::Match(const std::string& path) const {
     return path == name_;
 }
 
+std::string Permissions::LiteralPrefix() const {
+    if (!wildcard_) return name_;
+    return name_.substr(0, name_.find_first_of("*?[\\"));
+}
+
+void PermissionsIndex::Add(size_t index, const Permissions& permissions) {
+    std::string literal_prefix = permissions.LiteralPrefix();
+    if (permissions.exact()) {
+        exact_[literal_prefix].emplace_back(index);
+        return;
+    }
+
+    size_t node = 0;
+    for (char c : literal_prefix) {
+        const auto& children = trie_[node].children;
+        auto it = std::find_if(children.begin(), children.end(),
+                               [c](const auto& child) { return child.first == c; });
+        if (it != children.end()) {
+            node = it->second;
+        } else {
+            size_t child = trie_.size();
+            trie_[node].children.emplace_back(c, child);
+            trie_.emplace_back();
+            node = child;
+        }
+    }
+    trie_[node].permissions.emplace_back(index);
+}
+
+void PermissionsIndex::FindCandidates(const std::string& path,
+                                      std::vector<size_t>* candidates) const {
+    auto exact = exact_.find(path);
+    if (exact != exact_.end()) {
+        candidates->insert(candidates->end(), exact->second.begin(), exact->second.end());
+    }
+
+    size_t node = 0;
+    for (size_t i = 0;; ++i) {
+        const auto& permissions = trie_[node].permissions;
+        candidates->insert(candidates->end(), permissions.begin(), permissions.end());
+        if (i == path.size()) break;
+
+        const auto& children = trie_[node].children;
+        auto it = std::find_if(children.begin(), children.end(),
+                               [c = path[i]](const auto& child) { return child.first == c; });
+        if (it == children.end()) break;
+        node = it->second;
+    }
+}
+
+// Sorts |v| and removes any duplicates.
+static void SortUnique(std::vector<size_t>* v) {
+    std::sort(v->begin(), v->end());
+    v->erase(std::unique(v->begin(), v->end()), v->end());
+}
+
 bool SysfsPermissions::MatchWithSubsystem(const std::string& path,
                                           const std::string& subsystem) const {
     std::string path_basename = Basename(path);
@@ -194,7 +251,18 @@ void DeviceHandler::FixupSysPermissions(const std::string& upath,
     // contain, so we prepend it...
     std::string path = "/sys" + upath;
 
-    for (const auto& s : sysfs_permissions_) {
+    // Every path that SysfsPermissions::MatchWithSubsystem() tries.
+    std::string path_basename = Basename(path);
+    std::vector<size_t> candidates;
+    sysfs_permissions_index_.FindCandidates(path, &candidates);
+    sysfs_permissions_index_.FindCandidates("/sys/class/" + subsystem + "/" + path_basename,
+                                            &candidates);
+    sysfs_permissions_index_.FindCandidates(
+        "/sys/bus/" + subsystem + "/devices/" + path_basename, &candidates);
+    SortUnique(&candidates);
+
+    for (size_t i : candidates) {
+        const auto& s = sysfs_permissions_[i];
         if (s.MatchWithSubsystem(path, subsystem)) s.SetPermissions(path);
     }
 
@@ -208,11 +276,20 @@ void DeviceHandler::FixupSysPermissions(const std::string& upath,
 
 std::tuple<mode_t, uid_t, gid_t> DeviceHandler::GetDevicePermissions(
     const std::string& path, const std::vector<std::string>& links) const {
+    std::vector<size_t> candidates;
+    dev_permissions_index_.FindCandidates(path, &candidates);
+    for (const auto& link : links) {
+        dev_permissions_index_.FindCandidates(link, &candidates);
+    }
+    SortUnique(&candidates);
+
     // Search the perms list in reverse so that ueventd.$hardware can override ueventd.rc.
-    for (auto it = dev_permissions_.crbegin(); it != dev_permissions_.crend(); ++it) {
-        if (it->Match(path) || std::any_of(links.cbegin(), links.cend(),
-                                           [it](const auto& link) { return it->Match(link); })) {
-            return {it->perm(), it->uid(), it->gid()};
+    for (auto it = candidates.crbegin(); it != candidates.crend(); ++it) {
+        const auto& permissions = dev_permissions_[*it];
+        if (permissions.Match(path) ||
+            std::any_of(links.cbegin(), links.cend(),
+                        [&permissions](const auto& link) { return permissions.Match(link); })) {
+            return {permissions.perm(), permissions.uid(), permissions.gid()};
         }
     }
     /* Default if nothing found. */
@@ -346,12 +423,21 @@ std::vector<std::string> DeviceHandler::GetBlockDeviceSymlinks(const Uevent& uev
     return links;
 }
 
+// Creates |path| and any missing parents. mkdir_recursive() stats every parent and looks up an
+// SELinux label for |path| even when it already exists, which is the common case here since most
+// devices share their directory with others, so check for that first.
+static int MakeDirectory(const std::string& path, selabel_handle* sehandle) {
+    struct stat sb;
+    if (stat(path.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode)) return 0;
+    return mkdir_recursive(path, 0755, sehandle);
+}
+
 void DeviceHandler::HandleDevice(const std::string& action, const std::string& devpath, bool block,
                                  int major, int minor, const std::vector<std::string>& links) const {
     if (action == "add") {
         MakeDevice(devpath, block, major, minor, links);
         for (const auto& link : links) {
-            if (mkdir_recursive(Dirname(link), 0755, sehandle_)) {
+            if (MakeDirectory(Dirname(link), sehandle_)) {
                 PLOG(ERROR) << "Failed to create directory " << Dirname(link);
             }
 
@@ -415,7 +501,7 @@ void DeviceHandler::HandleDeviceEvent(const Uevent& uevent) {
         devpath = "/dev/" + Basename(uevent.path);
     }
 
-    mkdir_recursive(Dirname(devpath), 0755, sehandle_);
+    MakeDirectory(Dirname(devpath), sehandle_);
 
     HandleDevice(uevent.action, devpath, block, uevent.major, uevent.minor, links);
 }
@@ -425,6 +511,8 @@ DeviceHandler::DeviceHandler(std::vector<Permissions> dev_permissions,
                              std::vector<Subsystem> subsystems, bool skip_restorecon)
     : dev_permissions_(std::move(dev_permissions)),
       sysfs_permissions_(std::move(sysfs_permissions)),
+      dev_permissions_index_(dev_permissions_),
+      sysfs_permissions_index_(sysfs_permissions_),
       subsystems_(std::move(subsystems)),
       sehandle_(selinux_android_file_context_handle()),
       skip_restorecon_(skip_restorecon),
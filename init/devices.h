@@ -22,6 +22,8 @@
 
 #include <algorithm>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <android-base/file.h>
@@ -37,6 +39,10 @@ class Permissions {
     Permissions(const std::string& name, mode_t perm, uid_t uid, gid_t gid);
 
     bool Match(const std::string& path) const;
+    // Whether Match() only accepts a path equal to LiteralPrefix().
+    bool exact() const { return !prefix_ && !wildcard_; }
+    // The part of the name that every matching path starts with.
+    std::string LiteralPrefix() const;
 
     mode_t perm() const { return perm_; }
     uid_t uid() const { return uid_; }
@@ -67,6 +73,35 @@ class SysfsPermissions : public Permissions {
     const std::string attribute_;
 };
 
+// Finds which of a list of permissions may match a path, without calling Match() on every one of
+// them. Exact names are looked up in a hash table, and the others in a trie of their literal
+// prefixes, so only the rules whose literal prefix the path starts with are returned.
+class PermissionsIndex {
+  public:
+    PermissionsIndex() {}
+    template <typename T>
+    explicit PermissionsIndex(const std::vector<T>& permissions) {
+        for (size_t i = 0; i < permissions.size(); ++i) {
+            Add(i, permissions[i]);
+        }
+    }
+
+    // Appends the indices of the permissions that may match |path| to |candidates|. Every index
+    // whose Match() accepts |path| is included, but wildcard rules still need to be checked.
+    void FindCandidates(const std::string& path, std::vector<size_t>* candidates) const;
+
+  private:
+    struct Node {
+        std::vector<std::pair<char, size_t>> children;
+        std::vector<size_t> permissions;
+    };
+
+    void Add(size_t index, const Permissions& permissions);
+
+    std::unordered_map<std::string, std::vector<size_t>> exact_;
+    std::vector<Node> trie_ = std::vector<Node>(1);
+};
+
 class Subsystem {
   public:
     friend class SubsystemParser;
@@ -123,6 +158,8 @@ class DeviceHandler {
 
     std::vector<Permissions> dev_permissions_;
     std::vector<SysfsPermissions> sysfs_permissions_;
+    PermissionsIndex dev_permissions_index_;
+    PermissionsIndex sysfs_permissions_index_;
     std::vector<Subsystem> subsystems_;
     selabel_handle* sehandle_;
     bool skip_restorecon_;
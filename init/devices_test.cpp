@@ -311,5 +311,41 @@ TEST(device_handler, SysfsPermissionsMatchWithSubsystemBus) {
     EXPECT_EQ(1001U, permissions.gid());
 }
 
+TEST(device_handler, PermissionsIndexFindsEveryMatch) {
+    std::vector<Permissions> permissions = {
+        {"/dev/null", 0666, 0, 0},
+        {"/dev/dri/*", 0666, 0, 1000},
+        {"/dev/device*name", 0666, 0, 1000},
+        {"/dev/device*name*", 0666, 0, 1000},
+        {"/dev/d?v", 0666, 0, 1000},  // No '*', so this is an exact name.
+        {"/dev/tty[0-9]*", 0666, 0, 1000},
+        {"*/input*", 0666, 0, 1000},
+        {"/dev/*", 0666, 0, 1000},
+        {"/dev/null", 0660, 0, 0},
+    };
+    PermissionsIndex index(permissions);
+
+    for (const std::string path :
+         {"/dev/null", "/dev/nul", "/dev/nullsuffix", "/dev/dri/card0", "/dev/dri/",
+          "/dev/devicename", "/dev/device123name", "/dev/device123namesuffix",
+          "/dev/device123name/sub", "/dev/d?v", "/dev/dav", "/dev/tty1", "/dev/ttyS1",
+          "/dev/input/event0", "/sys/input0", "/", ""}) {
+        std::vector<size_t> expected;
+        for (size_t i = 0; i < permissions.size(); ++i) {
+            if (permissions[i].Match(path)) expected.emplace_back(i);
+        }
+
+        std::vector<size_t> candidates;
+        index.FindCandidates(path, &candidates);
+        std::vector<size_t> matches;
+        for (size_t i : candidates) {
+            if (permissions[i].Match(path)) matches.emplace_back(i);
+        }
+        std::sort(matches.begin(), matches.end());
+
+        EXPECT_EQ(expected, matches) << path;
+    }
+}
+
 }  // namespace init
 }  // namespace android
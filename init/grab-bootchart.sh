@@ -13,10 +13,16 @@ TARBALL=bootchart.tgz
 
 FILES="header proc_stat.log proc_ps.log proc_diskstats.log"
 
-for f in $FILES; do
-    adb "${@}" pull $LOGROOT/$f $TMPDIR/$f 2>&1 > /dev/null
-done
-(cd $TMPDIR && tar -czf $TARBALL $FILES)
+# A bootchart recorded in binary mode is a single file, which is converted into the same
+# tarball that text mode's logs make.
+if adb "${@}" pull $LOGROOT/bootchart.bin $TMPDIR/bootchart.bin > /dev/null 2>&1; then
+    $(dirname $0)/convert-bootchart.py $TMPDIR/bootchart.bin $TMPDIR/$TARBALL || exit 1
+else
+    for f in $FILES; do
+        adb "${@}" pull $LOGROOT/$f $TMPDIR/$f 2>&1 > /dev/null
+    done
+    (cd $TMPDIR && tar -czf $TARBALL $FILES)
+fi
 bootchart ${TMPDIR}/${TARBALL}
 gnome-open ${TARBALL%.tgz}.png
 echo "Clean up ${TMPDIR}/ and ./${TARBALL%.tgz}.png when done"
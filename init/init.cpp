@@ -86,7 +86,6 @@ static int property_triggers_enabled = 0;
 static char qemu[32];
 
 std::string default_console = "/dev/console";
-static time_t process_needs_restart_at;
 
 const char *ENV[32];
 
@@ -190,6 +189,11 @@ void property_changed(const std::string& name, const std::string& value) {
 
     if (property_triggers_enabled) ActionManager::GetInstance().QueuePropertyChange(name, value);
 
+    // Record what matching triggers cost during boot.
+    if (name == "sys.boot_completed" && value == "1") {
+        ActionManager::GetInstance().DumpTriggerStats();
+    }
+
     if (waiting_for_prop) {
         if (wait_prop_name == name && wait_prop_value == value) {
             LOG(INFO) << "Wait for property took " << *waiting_for_prop;
@@ -198,14 +202,6 @@ void property_changed(const std::string& name, const std::string& value) {
     }
 }
 
-static void restart_processes()
-{
-    process_needs_restart_at = 0;
-    ServiceManager::GetInstance().ForEachServiceWithFlags(SVC_RESTARTING, [](Service* s) {
-        s->RestartIfNeeded(&process_needs_restart_at);
-    });
-}
-
 void handle_control_message(const std::string& msg, const std::string& name) {
     Service* svc = ServiceManager::GetInstance().FindServiceByName(name);
     if (svc == nullptr) {
@@ -1195,12 +1191,15 @@ int main(int argc, char** argv) {
             am.ExecuteOneCommand();
         }
         if (!(waiting_for_prop || sm.IsWaitingForExec())) {
-            if (!shutting_down) restart_processes();
-
-            // If there's a process that needs restarting, wake up in time for that.
-            if (process_needs_restart_at != 0) {
-                epoll_timeout_ms = (process_needs_restart_at - time(nullptr)) * 1000;
-                if (epoll_timeout_ms < 0) epoll_timeout_ms = 0;
+            if (!shutting_down) {
+                // If there's a process that needs restarting, wake up in time for that.
+                auto next_restart_time = sm.RestartServices();
+                if (next_restart_time != boot_clock::time_point::max()) {
+                    // Round up, so as not to wake just before the restart is due.
+                    auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        next_restart_time - boot_clock::now() + 1ms - 1ns);
+                    epoll_timeout_ms = std::max<int64_t>(timeout.count(), 0);
+                }
             }
 
             // If there's more work to do, wake up again immediately.
@@ -1208,7 +1207,14 @@ int main(int argc, char** argv) {
         }
 
         epoll_event ev;
-        int nr = TEMP_FAILURE_RETRY(epoll_wait(epoll_fd, &ev, 1, epoll_timeout_ms));
+        int nr = 0;
+        // Persistent properties are written without syncing them, so sync them once init has
+        // nothing else to do, covering the whole burst of writes that came before.
+        if (epoll_timeout_ms != 0 && persistent_properties_need_sync()) {
+            nr = TEMP_FAILURE_RETRY(epoll_wait(epoll_fd, &ev, 1, 0));
+            if (nr == 0) sync_persistent_properties();
+        }
+        if (nr == 0) nr = TEMP_FAILURE_RETRY(epoll_wait(epoll_fd, &ev, 1, epoll_timeout_ms));
         if (nr == -1) {
             PLOG(ERROR) << "epoll_wait failed";
         } else if (nr == 1) {
@@ -16,6 +16,7 @@
 
 #include "init_first_stage.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -29,6 +30,7 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 
 #include "devices.h"
 #include "fs_mgr.h"
@@ -57,8 +59,9 @@ class FirstStageMount {
 
   protected:
     bool InitRequiredDevices();
-    bool InitVerityDevice(const std::string& verity_device);
+    bool InitVerityDevices();
     bool MountPartitions();
+    void PrefetchFiles();
 
     virtual ListenerAction UeventCallback(const Uevent& uevent);
 
@@ -71,6 +74,8 @@ class FirstStageMount {
     std::unique_ptr<fstab, decltype(&fs_mgr_free_fstab)> device_tree_fstab_;
     std::vector<fstab_rec*> mount_fstab_recs_;
     std::set<std::string> required_devices_partition_names_;
+    // The "dm-XX" names of the verity devices that SetUpDmVerity() created.
+    std::set<std::string> required_verity_devices_;
     DeviceHandler device_handler_;
     UeventListener uevent_listener_;
 };
@@ -232,31 +237,40 @@ ListenerAction FirstStageMount::UeventCallback(const Uevent& uevent) {
     return ListenerAction::kContinue;
 }
 
-// Creates "/dev/block/dm-XX" for dm-verity by running coldboot on /sys/block/dm-XX.
-bool FirstStageMount::InitVerityDevice(const std::string& verity_device) {
-    const std::string device_name(basename(verity_device.c_str()));
-    const std::string syspath = "/sys/block/" + device_name;
-    bool found = false;
+// Creates "/dev/block/dm-XX" for each of required_verity_devices_ by running coldboot on
+// /sys/block/dm-XX. All of them are waited for together, so that the wait for one partition's
+// device overlaps with the others'.
+bool FirstStageMount::InitVerityDevices() {
+    if (required_verity_devices_.empty()) return true;
 
-    auto verity_callback = [&device_name, &verity_device, this, &found](const Uevent& uevent) {
-        if (uevent.device_name == device_name) {
-            LOG(VERBOSE) << "Creating dm-verity device : " << verity_device;
+    auto verity_callback = [this](const Uevent& uevent) {
+        auto iter = required_verity_devices_.find(uevent.device_name);
+        if (iter != required_verity_devices_.end()) {
+            LOG(VERBOSE) << "Creating dm-verity device : /dev/block/" << *iter;
             device_handler_.HandleDeviceEvent(uevent);
-            found = true;
-            return ListenerAction::kStop;
+            required_verity_devices_.erase(iter);
+            if (required_verity_devices_.empty()) return ListenerAction::kStop;
         }
         return ListenerAction::kContinue;
     };
 
-    uevent_listener_.RegenerateUeventsForPath(syspath, verity_callback);
-    if (!found) {
-        LOG(INFO) << "dm-verity device not found in /sys, waiting for its uevent";
+    // Copied, since the callback removes devices as it finds them.
+    std::vector<std::string> verity_devices(required_verity_devices_.begin(),
+                                            required_verity_devices_.end());
+    for (const auto& device : verity_devices) {
+        if (required_verity_devices_.count(device) == 0) continue;
+        uevent_listener_.RegenerateUeventsForPath("/sys/block/" + device, verity_callback);
+    }
+    if (!required_verity_devices_.empty()) {
+        LOG(INFO) << "dm-verity device(s) not found in /sys, waiting for their uevent(s): "
+                  << android::base::Join(required_verity_devices_, ", ");
         Timer t;
         uevent_listener_.Poll(verity_callback, 10s);
-        LOG(INFO) << "wait for dm-verity device returned after " << t;
+        LOG(INFO) << "wait for dm-verity devices returned after " << t;
     }
-    if (!found) {
-        LOG(ERROR) << "dm-verity device not found after polling timeout";
+    if (!required_verity_devices_.empty()) {
+        LOG(ERROR) << "dm-verity device(s) not found after polling timeout: "
+                   << android::base::Join(required_verity_devices_, ", ");
         return false;
     }
 
@@ -264,19 +278,53 @@ bool FirstStageMount::InitVerityDevice(const std::string& verity_device) {
 }
 
 bool FirstStageMount::MountPartitions() {
+    // Set up every partition's verity device before waiting for any of them to be created.
     for (auto fstab_rec : mount_fstab_recs_) {
         if (!SetUpDmVerity(fstab_rec)) {
             PLOG(ERROR) << "Failed to setup verity for '" << fstab_rec->mount_point << "'";
             return false;
         }
+    }
+    if (!InitVerityDevices()) return false;
+
+    for (auto fstab_rec : mount_fstab_recs_) {
         if (fs_mgr_do_mount_one(fstab_rec)) {
             PLOG(ERROR) << "Failed to mount '" << fstab_rec->mount_point << "'";
             return false;
         }
     }
+
+    PrefetchFiles();
     return true;
 }
 
+// Starts reading the files listed in each mounted partition's etc/readahead.list into the page
+// cache, so that second stage init finds its .rc files and the binaries that it starts first
+// already there. The reads are only queued, without waiting for them, so this doesn't delay
+// the exec of second stage init.
+void FirstStageMount::PrefetchFiles() {
+    Timer t;
+    size_t count = 0;
+    for (auto fstab_rec : mount_fstab_recs_) {
+        std::string list_path = std::string(fstab_rec->mount_point) + "/etc/readahead.list";
+        std::string list;
+        if (!android::base::ReadFileToString(list_path, &list)) continue;
+
+        for (const auto& line : android::base::Split(list, "\n")) {
+            std::string path = android::base::Trim(line);
+            if (path.empty() || path[0] == '#') continue;
+
+            android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+            if (fd == -1 || posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) != 0) {
+                LOG(VERBOSE) << "Unable to prefetch " << path << " from " << list_path;
+                continue;
+            }
+            ++count;
+        }
+    }
+    if (count > 0) LOG(INFO) << "Prefetching " << count << " files took " << t;
+}
+
 bool FirstStageMountVBootV1::GetRequiredDevices() {
     std::string verity_loc_device;
     need_dm_verity_ = false;
@@ -329,8 +377,9 @@ bool FirstStageMountVBootV1::SetUpDmVerity(fstab_rec* fstab_rec) {
             case FS_MGR_SETUP_VERITY_SUCCESS:
                 // The exact block device name (fstab_rec->blk_device) is changed to
                 // "/dev/block/dm-XX". Needs to create it because ueventd isn't started in init
-                // first stage.
-                return InitVerityDevice(fstab_rec->blk_device);
+                // first stage, which InitVerityDevices() will do.
+                required_verity_devices_.emplace(basename(fstab_rec->blk_device));
+                return true;
             default:
                 return false;
         }
@@ -429,8 +478,9 @@ bool FirstStageMountVBootV2::SetUpDmVerity(fstab_rec* fstab_rec) {
             case SetUpAvbHashtreeResult::kSuccess:
                 // The exact block device name (fstab_rec->blk_device) is changed to
                 // "/dev/block/dm-XX". Needs to create it because ueventd isn't started in init
-                // first stage.
-                return InitVerityDevice(fstab_rec->blk_device);
+                // first stage, which InitVerityDevices() will do.
+                required_verity_devices_.emplace(basename(fstab_rec->blk_device));
+                return true;
             default:
                 return false;
         }
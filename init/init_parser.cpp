@@ -46,62 +46,31 @@ void Parser::AddSingleLineParser(const std::string& prefix, LineCallback callbac
     line_callbacks_.emplace_back(prefix, callback);
 }
 
-void Parser::ParseData(const std::string& filename, const std::string& data) {
-    //TODO: Use a parser with const input and remove this copy
-    std::vector<char> data_copy(data.begin(), data.end());
-    data_copy.push_back('\0');
+void Parser::ReadConfigFile(ConfigFile* file) {
+    std::string data;
+    file->read = ReadFile(file->path, &data, &file->err);
+    if (!file->read) return;
+
+    data.push_back('\n'); // TODO: fix parse_config.
+    data.push_back('\0');
 
     parse_state state;
     state.line = 0;
-    state.ptr = &data_copy[0];
+    state.ptr = &data[0];
     state.nexttoken = 0;
 
-    SectionParser* section_parser = nullptr;
     std::vector<std::string> args;
 
     for (;;) {
         switch (next_token(&state)) {
         case T_EOF:
-            if (section_parser) {
-                section_parser->EndSection();
-            }
             return;
         case T_NEWLINE:
             state.line++;
-            if (args.empty()) {
-                break;
-            }
-            // If we have a line matching a prefix we recognize, call its callback and unset any
-            // current section parsers.  This is meant for /sys/ and /dev/ line entries for uevent.
-            for (const auto& [prefix, callback] : line_callbacks_) {
-                if (android::base::StartsWith(args[0], prefix.c_str())) {
-                    if (section_parser) section_parser->EndSection();
-
-                    std::string ret_err;
-                    if (!callback(std::move(args), &ret_err)) {
-                        LOG(ERROR) << filename << ": " << state.line << ": " << ret_err;
-                    }
-                    section_parser = nullptr;
-                    break;
-                }
-            }
-            if (section_parsers_.count(args[0])) {
-                if (section_parser) {
-                    section_parser->EndSection();
-                }
-                section_parser = section_parsers_[args[0]].get();
-                std::string ret_err;
-                if (!section_parser->ParseSection(std::move(args), filename, state.line, &ret_err)) {
-                    LOG(ERROR) << filename << ": " << state.line << ": " << ret_err;
-                    section_parser = nullptr;
-                }
-            } else if (section_parser) {
-                std::string ret_err;
-                if (!section_parser->ParseLineSection(std::move(args), state.line, &ret_err)) {
-                    LOG(ERROR) << filename << ": " << state.line << ": " << ret_err;
-                }
+            if (!args.empty()) {
+                file->lines.push_back({state.line, std::move(args)});
+                args.clear();
             }
-            args.clear();
             break;
         case T_TEXT:
             args.emplace_back(state.text);
@@ -110,23 +79,70 @@ void Parser::ParseData(const std::string& filename, const std::string& data) {
     }
 }
 
+void Parser::ParseData(const std::string& filename, std::vector<ConfigLine>* lines) {
+    SectionParser* section_parser = nullptr;
+
+    for (auto& [line, args] : *lines) {
+        // If we have a line matching a prefix we recognize, call its callback and unset any
+        // current section parsers.  This is meant for /sys/ and /dev/ line entries for uevent.
+        for (const auto& [prefix, callback] : line_callbacks_) {
+            if (android::base::StartsWith(args[0], prefix.c_str())) {
+                if (section_parser) section_parser->EndSection();
+
+                std::string ret_err;
+                if (!callback(std::move(args), &ret_err)) {
+                    LOG(ERROR) << filename << ": " << line << ": " << ret_err;
+                }
+                section_parser = nullptr;
+                break;
+            }
+        }
+        if (args.empty()) continue;
+
+        if (section_parsers_.count(args[0])) {
+            if (section_parser) {
+                section_parser->EndSection();
+            }
+            section_parser = section_parsers_[args[0]].get();
+            std::string ret_err;
+            if (!section_parser->ParseSection(std::move(args), filename, line, &ret_err)) {
+                LOG(ERROR) << filename << ": " << line << ": " << ret_err;
+                section_parser = nullptr;
+            }
+        } else if (section_parser) {
+            std::string ret_err;
+            if (!section_parser->ParseLineSection(std::move(args), line, &ret_err)) {
+                LOG(ERROR) << filename << ": " << line << ": " << ret_err;
+            }
+        }
+    }
+
+    if (section_parser) {
+        section_parser->EndSection();
+    }
+}
+
 bool Parser::ParseConfigFile(const std::string& path) {
-    LOG(INFO) << "Parsing file " << path << "...";
+    ConfigFile file;
+    file.path = path;
+    ReadConfigFile(&file);
+    return ParseConfigFile(&file);
+}
+
+bool Parser::ParseConfigFile(ConfigFile* file) {
+    LOG(INFO) << "Parsing file " << file->path << "...";
     android::base::Timer t;
-    std::string data;
-    std::string err;
-    if (!ReadFile(path, &data, &err)) {
-        LOG(ERROR) << err;
+    if (!file->read) {
+        LOG(ERROR) << file->err;
         return false;
     }
 
-    data.push_back('\n'); // TODO: fix parse_config.
-    ParseData(path, data);
+    ParseData(file->path, &file->lines);
     for (const auto& [section_name, section_parser] : section_parsers_) {
         section_parser->EndFile();
     }
 
-    LOG(VERBOSE) << "(Parsing " << path << " took " << t << ".)";
+    LOG(VERBOSE) << "(Parsing " << file->path << " took " << t << ".)";
     return true;
 }
 
@@ -149,9 +165,17 @@ bool Parser::ParseConfigDir(const std::string& path) {
     }
     // Sort first so we load files in a consistent order (bug 31996208)
     std::sort(files.begin(), files.end());
-    for (const auto& file : files) {
-        if (!ParseConfigFile(file)) {
-            LOG(ERROR) << "could not import file '" << file << "'";
+
+    std::vector<ConfigFile> config_files(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        config_files[i].path = files[i];
+    }
+    ForEachIndexInParallel(config_files.size(),
+                           [&config_files](size_t i) { ReadConfigFile(&config_files[i]); });
+
+    for (auto& file : config_files) {
+        if (!ParseConfigFile(&file)) {
+            LOG(ERROR) << "could not import file '" << file.path << "'";
         }
     }
     return true;
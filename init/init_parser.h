@@ -85,8 +85,26 @@ class Parser {
     bool is_odm_etc_init_loaded() { return is_odm_etc_init_loaded_; }
 
   private:
-    void ParseData(const std::string& filename, const std::string& data);
+    // The arguments of one non-empty line of a config file.
+    struct ConfigLine {
+        int line;
+        std::vector<std::string> args;
+    };
+
+    // A config file that has been read and split into lines. Files are independent up to this
+    // point, so a directory's files are read in parallel; only applying their lines to the
+    // section parsers has to happen in order.
+    struct ConfigFile {
+        std::string path;
+        bool read = false;
+        std::string err;
+        std::vector<ConfigLine> lines;
+    };
+
+    static void ReadConfigFile(ConfigFile* file);
+    void ParseData(const std::string& filename, std::vector<ConfigLine>* lines);
     bool ParseConfigFile(const std::string& path);
+    bool ParseConfigFile(ConfigFile* file);
     bool ParseConfigDir(const std::string& path);
 
     std::map<std::string, std::unique_ptr<SectionParser>> section_parsers_;
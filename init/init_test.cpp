@@ -14,9 +14,12 @@
  * limitations under the License.
  */
 
+#include <unistd.h>
+
 #include <functional>
 
 #include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <android-base/test_utils.h>
 #include <gtest/gtest.h>
 
@@ -55,8 +58,9 @@ class TestFunctionMap : public KeywordMap<BuiltinFunction> {
 using ActionManagerCommand = std::function<void(ActionManager&)>;
 
 void TestInit(const std::string& init_script_file, const TestFunctionMap& test_function_map,
-              const std::vector<ActionManagerCommand>& commands) {
-    ActionManager am;
+              const std::vector<ActionManagerCommand>& commands, ActionManager* am_out = nullptr) {
+    ActionManager local_am;
+    ActionManager& am = am_out ? *am_out : local_am;
 
     Action::set_function_map(&test_function_map);
 
@@ -76,11 +80,12 @@ void TestInit(const std::string& init_script_file, const TestFunctionMap& test_f
 }
 
 void TestInitText(const std::string& init_script, const TestFunctionMap& test_function_map,
-                  const std::vector<ActionManagerCommand>& commands) {
+                  const std::vector<ActionManagerCommand>& commands,
+                  ActionManager* am = nullptr) {
     TemporaryFile tf;
     ASSERT_TRUE(tf.fd != -1);
     ASSERT_TRUE(android::base::WriteStringToFd(init_script, tf.fd));
-    TestInit(tf.path, test_function_map, commands);
+    TestInit(tf.path, test_function_map, commands, am);
 }
 
 TEST(init, SimpleEventTrigger) {
@@ -128,6 +133,45 @@ execute_third
     TestInitText(init_script, test_function_map, commands);
 }
 
+TEST(init, PropertyTriggerOnlyChecksInterestedActions) {
+    std::string init_script =
+        R"init(
+on property:init_test.a=1
+execute_first
+
+on boot
+execute_never
+
+on property:init_test.b=*
+execute_never
+
+on property:init_test.a=*
+execute_second
+
+on property:init_test.a=2
+execute_never
+)init";
+
+    int num_executed = 0;
+    TestFunctionMap test_function_map;
+    test_function_map.Add("execute_first", [&num_executed]() { EXPECT_EQ(0, num_executed++); });
+    test_function_map.Add("execute_second", [&num_executed]() { EXPECT_EQ(1, num_executed++); });
+    test_function_map.Add("execute_never", []() { FAIL(); });
+
+    ActionManagerCommand set_a = [](ActionManager& am) {
+        am.QueuePropertyChange("init_test.a", "1");
+    };
+    std::vector<ActionManagerCommand> commands{set_a};
+
+    ActionManager am;
+    TestInitText(init_script, test_function_map, commands, &am);
+
+    EXPECT_EQ(2, num_executed);
+    EXPECT_EQ(1U, am.trigger_stats().events);
+    // Only the three actions that trigger on init_test.a were looked at.
+    EXPECT_EQ(3U, am.trigger_stats().checks);
+}
+
 TEST(init, EventTriggerOrderMultipleFiles) {
     // 6 total files, which should have their triggers executed in the following order:
     // 1: start - original script parsed
@@ -189,5 +233,38 @@ TEST(init, EventTriggerOrderMultipleFiles) {
     EXPECT_EQ(6, num_executed);
 }
 
+TEST(init, EventTriggerOrderLargeDirectory) {
+    // The files in a directory are read in parallel, but must still be applied in sorted order.
+    TemporaryDir dir;
+    std::string err;
+    const int kNumFiles = 50;
+    for (int i = 1; i <= kNumFiles; ++i) {
+        std::string path = android::base::StringPrintf("%s/%03d.rc", dir.path, i);
+        std::string script = android::base::StringPrintf("\non boot\n\nexecute %d\n", i);
+        ASSERT_TRUE(WriteFile(path, script, &err));
+    }
+
+    int num_executed = 0;
+    auto execute_command = [&num_executed](const std::vector<std::string>& args) {
+        EXPECT_EQ(2U, args.size());
+        EXPECT_EQ(++num_executed, std::stoi(args[1]));
+        return 0;
+    };
+
+    TestFunctionMap test_function_map;
+    test_function_map.Add("execute", 1, 1, execute_command);
+
+    ActionManagerCommand trigger_boot = [](ActionManager& am) { am.QueueEventTrigger("boot"); };
+    std::vector<ActionManagerCommand> commands{trigger_boot};
+
+    TestInit(dir.path, test_function_map, commands);
+
+    EXPECT_EQ(kNumFiles, num_executed);
+
+    for (int i = 1; i <= kNumFiles; ++i) {
+        unlink(android::base::StringPrintf("%s/%03d.rc", dir.path, i).c_str());
+    }
+}
+
 }  // namespace init
 }  // namespace android
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "persistent_properties.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+
+namespace android {
+namespace init {
+
+// The file starts with kMagic and kVersion. Each record after that is the lengths of the
+// property's name and value, the name and value themselves, and a checksum of all of those.
+static constexpr uint32_t kMagic = 0x504f5250;  // "PROP"
+static constexpr uint32_t kVersion = 1;
+static constexpr size_t kHeaderSize = 2 * sizeof(uint32_t);
+
+// Files smaller than this aren't worth compacting.
+static constexpr size_t kMinCompactSize = 16 * 1024;
+
+// FNV-1a, which is enough to catch a record torn by a crash.
+static uint32_t Checksum(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+static void AppendUint32(std::string* out, uint32_t value) {
+    out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static size_t RecordSize(const std::string& name, const std::string& value) {
+    return 3 * sizeof(uint32_t) + name.size() + value.size();
+}
+
+static void AppendRecord(std::string* out, const std::string& name, const std::string& value) {
+    size_t start = out->size();
+    AppendUint32(out, name.size());
+    AppendUint32(out, value.size());
+    out->append(name);
+    out->append(value);
+    AppendUint32(out, Checksum(&(*out)[start], out->size() - start));
+}
+
+// Decodes the record at |*offset| in |data|, and moves |*offset| past it.
+static bool DecodeRecord(const std::string& data, size_t* offset, std::string* name,
+                         std::string* value) {
+    const char* p = data.data() + *offset;
+    size_t available = data.size() - *offset;
+    if (available < 2 * sizeof(uint32_t)) return false;
+
+    uint32_t name_length;
+    uint32_t value_length;
+    memcpy(&name_length, p, sizeof(name_length));
+    memcpy(&value_length, p + sizeof(name_length), sizeof(value_length));
+    if (name_length > available || value_length > available) return false;
+
+    size_t length = 2 * sizeof(uint32_t) + name_length + value_length;
+    if (length + sizeof(uint32_t) > available) return false;
+
+    uint32_t checksum;
+    memcpy(&checksum, p + length, sizeof(checksum));
+    if (checksum != Checksum(p, length)) return false;
+
+    name->assign(p + 2 * sizeof(uint32_t), name_length);
+    value->assign(p + 2 * sizeof(uint32_t) + name_length, value_length);
+    *offset += length + sizeof(uint32_t);
+    return true;
+}
+
+bool PersistentPropertyStore::Open(int flags, std::string* err) {
+    fd_.reset(TEMP_FAILURE_RETRY(
+        open(path_.c_str(), flags | O_APPEND | O_NOFOLLOW | O_CLOEXEC, 0600)));
+    if (fd_ == -1) {
+        *err = "Unable to open '" + path_ + "': " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool PersistentPropertyStore::Load(std::map<std::string, std::string>* properties,
+                                   std::string* err) {
+    properties->clear();
+    properties_.clear();
+    sync_pending_ = false;
+
+    if (!Open(O_RDWR | O_CREAT, err)) return false;
+
+    // The file must not be accessible to others, must be owned by us, and must not be a hard
+    // link to any other file.
+    struct stat sb;
+    if (fstat(fd_, &sb) == -1) {
+        *err = "fstat failed for '" + path_ + "': " + strerror(errno);
+        return false;
+    }
+    if ((sb.st_mode & (S_IRWXG | S_IRWXO)) != 0 || sb.st_uid != getuid() ||
+        sb.st_gid != getgid() || sb.st_nlink != 1) {
+        LOG(ERROR) << "Replacing insecure persistent property file " << path_
+                   << " (uid=" << sb.st_uid << " gid=" << sb.st_gid << " nlink=" << sb.st_nlink
+                   << " mode=" << std::oct << sb.st_mode << std::dec << ")";
+        return Compact(err);
+    }
+
+    std::string data;
+    if (!android::base::ReadFdToString(fd_, &data)) {
+        *err = "Unable to read '" + path_ + "': " + strerror(errno);
+        return false;
+    }
+
+    uint32_t header[2] = {};
+    if (data.size() >= kHeaderSize) memcpy(header, data.data(), kHeaderSize);
+    if (header[0] != kMagic || header[1] != kVersion) {
+        if (!data.empty()) {
+            LOG(ERROR) << "Discarding persistent property file " << path_
+                       << " with unknown format";
+        }
+        return Compact(err);
+    }
+
+    size_t offset = kHeaderSize;
+    std::string name;
+    std::string value;
+    while (DecodeRecord(data, &offset, &name, &value)) {
+        properties_[name] = value;
+    }
+    if (offset != data.size()) {
+        LOG(WARNING) << "Dropping " << (data.size() - offset) << " bytes of torn or corrupt records from "
+                     << path_;
+        if (ftruncate(fd_, offset) == -1) {
+            *err = "Unable to truncate '" + path_ + "': " + strerror(errno);
+            return false;
+        }
+    }
+
+    file_size_ = offset;
+    live_size_ = kHeaderSize;
+    for (const auto& it : properties_) {
+        live_size_ += RecordSize(it.first, it.second);
+    }
+    *properties = properties_;
+    return true;
+}
+
+bool PersistentPropertyStore::Write(const std::string& name, const std::string& value,
+                                    std::string* err) {
+    if (fd_ == -1) {
+        *err = "Persistent property file '" + path_ + "' isn't open";
+        return false;
+    }
+
+    auto it = properties_.find(name);
+    if (it != properties_.end() && it->second == value) return true;
+
+    std::string record;
+    AppendRecord(&record, name, value);
+    if (!android::base::WriteFully(fd_, record.data(), record.size())) {
+        *err = "Unable to write '" + path_ + "': " + strerror(errno);
+        // Don't leave a partial record for later ones to be appended after.
+        if (ftruncate(fd_, file_size_) == -1) {
+            PLOG(ERROR) << "Unable to truncate " << path_;
+        }
+        return false;
+    }
+
+    if (it != properties_.end()) {
+        live_size_ -= RecordSize(name, it->second);
+        it->second = value;
+    } else {
+        properties_.emplace(name, value);
+    }
+    live_size_ += record.size();
+    file_size_ += record.size();
+    sync_pending_ = true;
+    return true;
+}
+
+bool PersistentPropertyStore::Sync(std::string* err) {
+    if (!sync_pending_) return true;
+
+    if (file_size_ >= kMinCompactSize && file_size_ - live_size_ > live_size_) {
+        return Compact(err);
+    }
+
+    if (fsync(fd_) == -1) {
+        *err = "Unable to sync '" + path_ + "': " + strerror(errno);
+        return false;
+    }
+    sync_pending_ = false;
+    return true;
+}
+
+// Replaces the file with one holding only the current values.
+bool PersistentPropertyStore::Compact(std::string* err) {
+    std::string data;
+    AppendUint32(&data, kMagic);
+    AppendUint32(&data, kVersion);
+    for (const auto& it : properties_) {
+        AppendRecord(&data, it.first, it.second);
+    }
+
+    std::string temp_path = path_ + ".tmp";
+    unlink(temp_path.c_str());
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(
+        open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600)));
+    if (fd == -1) {
+        *err = "Unable to open '" + temp_path + "': " + strerror(errno);
+        return false;
+    }
+    if (!android::base::WriteFully(fd, data.data(), data.size()) || fsync(fd) == -1) {
+        *err = "Unable to write '" + temp_path + "': " + strerror(errno);
+        unlink(temp_path.c_str());
+        return false;
+    }
+    fd.reset();
+
+    if (rename(temp_path.c_str(), path_.c_str()) == -1) {
+        *err = "Unable to rename '" + temp_path + "' to '" + path_ + "': " + strerror(errno);
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    // Make the rename itself durable.
+    android::base::unique_fd dir(TEMP_FAILURE_RETRY(
+        open(android::base::Dirname(path_).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+    if (dir == -1 || fsync(dir) == -1) {
+        PLOG(WARNING) << "Unable to sync the directory of " << path_;
+    }
+
+    if (!Open(O_RDWR, err)) return false;
+    file_size_ = live_size_ = data.size();
+    sync_pending_ = false;
+    return true;
+}
+
+}  // namespace init
+}  // namespace android
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_PERSISTENT_PROPERTIES_H
+#define _INIT_PERSISTENT_PROPERTIES_H
+
+#include <map>
+#include <string>
+
+#include <android-base/unique_fd.h>
+
+namespace android {
+namespace init {
+
+// Keeps persistent properties in a single append-only file of records, where each record
+// overrides any earlier one for the same property.
+//
+// Write() appends a record without syncing it, so that a burst of property changes costs one
+// fsync in Sync() rather than one each. Once overridden records make up most of the file, Sync()
+// rewrites it with only the current values.
+class PersistentPropertyStore {
+  public:
+    explicit PersistentPropertyStore(const std::string& path) : path_(path) {}
+
+    // Opens the file, creating it if needed, and returns the current value of every property
+    // in it. A record torn by a crash while it was being appended is dropped, along with
+    // anything after it.
+    bool Load(std::map<std::string, std::string>* properties, std::string* err);
+
+    // Appends a record, unless |value| is already the property's current value.
+    bool Write(const std::string& name, const std::string& value, std::string* err);
+
+    // Makes everything written so far durable.
+    bool Sync(std::string* err);
+
+    bool sync_pending() const { return sync_pending_; }
+
+  private:
+    bool Open(int flags, std::string* err);
+    bool Compact(std::string* err);
+
+    const std::string path_;
+    android::base::unique_fd fd_;
+
+    std::map<std::string, std::string> properties_;
+    // The size of the file, and how much of it is records for the current values.
+    size_t file_size_ = 0;
+    size_t live_size_ = 0;
+    bool sync_pending_ = false;
+};
+
+}  // namespace init
+}  // namespace android
+
+#endif
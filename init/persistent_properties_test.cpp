@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "persistent_properties.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+
+namespace android {
+namespace init {
+
+static off_t FileSize(const std::string& path) {
+    struct stat sb;
+    return stat(path.c_str(), &sb) == 0 ? sb.st_size : -1;
+}
+
+TEST(persistent_properties, RoundTrip) {
+    TemporaryDir dir;
+    std::string path = std::string(dir.path) + "/properties";
+    std::map<std::string, std::string> properties;
+    std::string err;
+
+    PersistentPropertyStore store(path);
+    ASSERT_TRUE(store.Load(&properties, &err)) << err;
+    EXPECT_TRUE(properties.empty());
+    EXPECT_FALSE(store.sync_pending());
+
+    ASSERT_TRUE(store.Write("persist.a", "1", &err)) << err;
+    ASSERT_TRUE(store.Write("persist.b", "", &err)) << err;
+    ASSERT_TRUE(store.Write("persist.a", "2", &err)) << err;
+    EXPECT_TRUE(store.sync_pending());
+    ASSERT_TRUE(store.Sync(&err)) << err;
+    EXPECT_FALSE(store.sync_pending());
+
+    PersistentPropertyStore reloaded(path);
+    ASSERT_TRUE(reloaded.Load(&properties, &err)) << err;
+    std::map<std::string, std::string> expected = {{"persist.a", "2"}, {"persist.b", ""}};
+    EXPECT_EQ(expected, properties);
+}
+
+TEST(persistent_properties, UnchangedValueIsNotWritten) {
+    TemporaryDir dir;
+    std::string path = std::string(dir.path) + "/properties";
+    std::map<std::string, std::string> properties;
+    std::string err;
+
+    PersistentPropertyStore store(path);
+    ASSERT_TRUE(store.Load(&properties, &err)) << err;
+    ASSERT_TRUE(store.Write("persist.a", "1", &err)) << err;
+    ASSERT_TRUE(store.Sync(&err)) << err;
+
+    off_t size = FileSize(path);
+    ASSERT_TRUE(store.Write("persist.a", "1", &err)) << err;
+    EXPECT_FALSE(store.sync_pending());
+    EXPECT_EQ(size, FileSize(path));
+}
+
+TEST(persistent_properties, TornRecordIsDropped) {
+    TemporaryDir dir;
+    std::string path = std::string(dir.path) + "/properties";
+    std::map<std::string, std::string> properties;
+    std::string err;
+
+    PersistentPropertyStore store(path);
+    ASSERT_TRUE(store.Load(&properties, &err)) << err;
+    ASSERT_TRUE(store.Write("persist.a", "1", &err)) << err;
+    off_t size = FileSize(path);
+    ASSERT_TRUE(store.Write("persist.b", "2", &err)) << err;
+    ASSERT_TRUE(store.Sync(&err)) << err;
+
+    // Simulate a crash part way through appending the second record.
+    ASSERT_EQ(0, truncate(path.c_str(), FileSize(path) - 1));
+
+    PersistentPropertyStore reloaded(path);
+    ASSERT_TRUE(reloaded.Load(&properties, &err)) << err;
+    std::map<std::string, std::string> expected = {{"persist.a", "1"}};
+    EXPECT_EQ(expected, properties);
+    EXPECT_EQ(size, FileSize(path));
+
+    // Later records must survive being appended after the torn one was dropped.
+    ASSERT_TRUE(reloaded.Write("persist.c", "3", &err)) << err;
+    ASSERT_TRUE(reloaded.Sync(&err)) << err;
+    PersistentPropertyStore again(path);
+    ASSERT_TRUE(again.Load(&properties, &err)) << err;
+    expected["persist.c"] = "3";
+    EXPECT_EQ(expected, properties);
+}
+
+TEST(persistent_properties, CorruptRecordIsDropped) {
+    TemporaryDir dir;
+    std::string path = std::string(dir.path) + "/properties";
+    std::map<std::string, std::string> properties;
+    std::string err;
+
+    PersistentPropertyStore store(path);
+    ASSERT_TRUE(store.Load(&properties, &err)) << err;
+    ASSERT_TRUE(store.Write("persist.a", "1", &err)) << err;
+    ASSERT_TRUE(store.Write("persist.b", "2", &err)) << err;
+    ASSERT_TRUE(store.Sync(&err)) << err;
+
+    std::string data;
+    ASSERT_TRUE(android::base::ReadFileToString(path, &data));
+    data[data.size() - 5] ^= 1;  // The last byte of persist.b's value.
+    ASSERT_TRUE(android::base::WriteStringToFile(data, path));
+
+    PersistentPropertyStore reloaded(path);
+    ASSERT_TRUE(reloaded.Load(&properties, &err)) << err;
+    std::map<std::string, std::string> expected = {{"persist.a", "1"}};
+    EXPECT_EQ(expected, properties);
+}
+
+TEST(persistent_properties, Compaction) {
+    TemporaryDir dir;
+    std::string path = std::string(dir.path) + "/properties";
+    std::map<std::string, std::string> properties;
+    std::string err;
+
+    PersistentPropertyStore store(path);
+    ASSERT_TRUE(store.Load(&properties, &err)) << err;
+    ASSERT_TRUE(store.Write("persist.b", "unchanged", &err)) << err;
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_TRUE(store.Write("persist.a", std::to_string(i), &err)) << err;
+    }
+    off_t size = FileSize(path);
+    ASSERT_TRUE(store.Sync(&err)) << err;
+    EXPECT_LT(FileSize(path), size / 100);
+
+    // The store must still be writable after being replaced.
+    ASSERT_TRUE(store.Write("persist.c", "new", &err)) << err;
+    ASSERT_TRUE(store.Sync(&err)) << err;
+
+    PersistentPropertyStore reloaded(path);
+    ASSERT_TRUE(reloaded.Load(&properties, &err)) << err;
+    std::map<std::string, std::string> expected = {
+        {"persist.a", "9999"}, {"persist.b", "unchanged"}, {"persist.c", "new"}};
+    EXPECT_EQ(expected, properties);
+}
+
+TEST(persistent_properties, InsecureFileIsReplaced) {
+    TemporaryDir dir;
+    std::string path = std::string(dir.path) + "/properties";
+    std::map<std::string, std::string> properties;
+    std::string err;
+
+    PersistentPropertyStore store(path);
+    ASSERT_TRUE(store.Load(&properties, &err)) << err;
+    ASSERT_TRUE(store.Write("persist.a", "1", &err)) << err;
+    ASSERT_TRUE(store.Sync(&err)) << err;
+    ASSERT_EQ(0, chmod(path.c_str(), 0644));
+
+    PersistentPropertyStore reloaded(path);
+    ASSERT_TRUE(reloaded.Load(&properties, &err)) << err;
+    EXPECT_TRUE(properties.empty());
+    EXPECT_NE(-1, FileSize(path));
+}
+
+}  // namespace init
+}  // namespace android
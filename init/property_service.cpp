@@ -38,6 +38,7 @@
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
 
+#include <map>
 #include <memory>
 #include <queue>
 #include <vector>
@@ -54,18 +55,26 @@
 #include <selinux/selinux.h>
 
 #include "init.h"
+#include "persistent_properties.h"
 #include "util.h"
 #include "vendor_init.h"
 
 using android::base::Timer;
 
+// Sets several properties in one request: a uint32_t count followed by that many name/value
+// pairs, each encoded as in PROP_MSG_SETPROP2. The single reply is PROP_SUCCESS, or the error
+// for the first property that couldn't be set. This must match libbase's SetProperties().
+#define PROP_MSG_SETPROP_BATCH 0x00020002
+
 #define PERSISTENT_PROPERTY_DIR  "/data/property"
+#define PERSISTENT_PROPERTY_FILE PERSISTENT_PROPERTY_DIR "/persistent_properties"
 #define RECOVERY_MOUNT_POINT "/recovery"
 
 namespace android {
 namespace init {
 
 static int persistent_properties_loaded = 0;
+static std::unique_ptr<PersistentPropertyStore> persistent_property_store;
 
 static int property_set_fd = -1;
 
@@ -76,7 +85,10 @@ void property_init() {
     }
 }
 
-static bool check_mac_perms(const std::string& name, char* sctx, struct ucred* cr) {
+// If |access_cache| is given, it holds earlier decisions for the same |sctx|, keyed by the
+// property's target context, so that each context is only checked once.
+static bool check_mac_perms(const std::string& name, char* sctx, struct ucred* cr,
+                            std::map<std::string, bool>* access_cache = nullptr) {
 
     if (!sctx) {
       return false;
@@ -91,6 +103,14 @@ static bool check_mac_perms(const std::string& name, char* sctx, struct ucred* c
       return false;
     }
 
+    if (access_cache) {
+        auto it = access_cache->find(tctx);
+        if (it != access_cache->end()) {
+            freecon(tctx);
+            return it->second;
+        }
+    }
+
     property_audit_data audit_data;
 
     audit_data.name = name.c_str();
@@ -98,6 +118,7 @@ static bool check_mac_perms(const std::string& name, char* sctx, struct ucred* c
 
     bool has_access = (selinux_check_access(sctx, tctx, "property_service", "set", &audit_data) == 0);
 
+    if (access_cache) access_cache->emplace(tctx, has_access);
     freecon(tctx);
     return has_access;
 }
@@ -121,24 +142,20 @@ static int check_control_mac_perms(const char *name, char *sctx, struct ucred *c
 
 static void write_persistent_property(const char *name, const char *value)
 {
-    char tempPath[PATH_MAX];
-    char path[PATH_MAX];
-    int fd;
-
-    snprintf(tempPath, sizeof(tempPath), "%s/.temp.XXXXXX", PERSISTENT_PROPERTY_DIR);
-    fd = mkstemp(tempPath);
-    if (fd < 0) {
-        PLOG(ERROR) << "Unable to write persistent property to temp file " << tempPath;
-        return;
+    std::string err;
+    if (!persistent_property_store->Write(name, value, &err)) {
+        LOG(ERROR) << "Unable to write persistent property " << name << ": " << err;
     }
-    write(fd, value, strlen(value));
-    fsync(fd);
-    close(fd);
+}
+
+bool persistent_properties_need_sync() {
+    return persistent_property_store && persistent_property_store->sync_pending();
+}
 
-    snprintf(path, sizeof(path), "%s/%s", PERSISTENT_PROPERTY_DIR, name);
-    if (rename(tempPath, path)) {
-        PLOG(ERROR) << "Unable to rename persistent property file " << tempPath << " to " << path;
-        unlink(tempPath);
+void sync_persistent_properties() {
+    std::string err;
+    if (persistent_properties_need_sync() && !persistent_property_store->Sync(&err)) {
+        LOG(ERROR) << "Unable to sync persistent properties: " << err;
     }
 }
 
@@ -167,29 +184,37 @@ bool is_legal_property_name(const std::string& name) {
     return true;
 }
 
-static uint32_t PropertySetImpl(const std::string& name, const std::string& value) {
-    size_t valuelen = value.size();
-
+// Checks everything about setting |name| to |value| that can be checked without setting it.
+static uint32_t CheckPropertySet(const std::string& name, const std::string& value) {
     if (!is_legal_property_name(name)) {
         LOG(ERROR) << "property_set(\"" << name << "\", \"" << value << "\") failed: bad name";
         return PROP_ERROR_INVALID_NAME;
     }
 
-    if (valuelen >= PROP_VALUE_MAX) {
+    if (value.size() >= PROP_VALUE_MAX) {
         LOG(ERROR) << "property_set(\"" << name << "\", \"" << value << "\") failed: "
                    << "value too long";
         return PROP_ERROR_INVALID_VALUE;
     }
 
+    // ro.* properties are actually "write-once".
+    if (android::base::StartsWith(name, "ro.") && __system_property_find(name.c_str()) != nullptr) {
+        LOG(ERROR) << "property_set(\"" << name << "\", \"" << value << "\") failed: "
+                   << "property already set";
+        return PROP_ERROR_READ_ONLY_PROPERTY;
+    }
+
+    return PROP_SUCCESS;
+}
+
+static uint32_t PropertySetImpl(const std::string& name, const std::string& value) {
+    size_t valuelen = value.size();
+
+    uint32_t result = CheckPropertySet(name, value);
+    if (result != PROP_SUCCESS) return result;
+
     prop_info* pi = (prop_info*) __system_property_find(name.c_str());
     if (pi != nullptr) {
-        // ro.* properties are actually "write-once".
-        if (android::base::StartsWith(name, "ro.")) {
-            LOG(ERROR) << "property_set(\"" << name << "\", \"" << value << "\") failed: "
-                       << "property already set";
-            return PROP_ERROR_READ_ONLY_PROPERTY;
-        }
-
         __system_property_update(pi, value.c_str(), valuelen);
     } else {
         int rc = __system_property_add(name.c_str(), name.size(), value.c_str(), valuelen);
@@ -456,8 +481,47 @@ static void handle_property_set(SocketConnection& socket,
   freecon(source_ctx);
 }
 
+// Sets every property in a PROP_MSG_SETPROP_BATCH, or none of them if any of them can't be
+// set. Control messages can't be batched, since they can't be undone or checked in advance.
+static void handle_property_set_batch(SocketConnection& socket,
+                                      const std::vector<std::pair<std::string, std::string>>& properties) {
+  struct ucred cr = socket.cred();
+  char* source_ctx = nullptr;
+  getpeercon(socket.socket(), &source_ctx);
+
+  uint32_t result = PROP_SUCCESS;
+  std::map<std::string, bool> access_cache;
+  for (const auto& [name, value] : properties) {
+    if (android::base::StartsWith(name, "ctl.")) {
+      LOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): control message \"" << name
+                 << "\" can't be batched";
+      result = PROP_ERROR_HANDLE_CONTROL_MESSAGE;
+      break;
+    }
+    result = CheckPropertySet(name, value);
+    if (result != PROP_SUCCESS) break;
+    if (!check_mac_perms(name, source_ctx, &cr, &access_cache)) {
+      LOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): permission denied uid:" << cr.uid
+                 << " name:" << name;
+      result = PROP_ERROR_PERMISSION_DENIED;
+      break;
+    }
+  }
+
+  if (result == PROP_SUCCESS) {
+    for (const auto& [name, value] : properties) {
+      uint32_t set_result = property_set(name, value);
+      if (result == PROP_SUCCESS) result = set_result;
+    }
+  }
+  socket.SendUint32(result);
+
+  freecon(source_ctx);
+}
+
 static void handle_property_set_fd() {
     static constexpr uint32_t kDefaultSocketTimeout = 2000; /* ms */
+    static constexpr uint32_t kMaxBatchSize = 1024;
 
     int s = accept4(property_set_fd, nullptr, nullptr, SOCK_CLOEXEC);
     if (s == -1) {
@@ -514,6 +578,33 @@ static void handle_property_set_fd() {
         break;
       }
 
+    case PROP_MSG_SETPROP_BATCH: {
+        uint32_t count = 0;
+        if (!socket.RecvUint32(&count, &timeout_ms)) {
+          PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): error while reading the count from the socket";
+          socket.SendUint32(PROP_ERROR_READ_DATA);
+          return;
+        }
+        if (count > kMaxBatchSize) {
+          LOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): batch of " << count << " is too large";
+          socket.SendUint32(PROP_ERROR_INVALID_VALUE);
+          return;
+        }
+
+        std::vector<std::pair<std::string, std::string>> properties(count);
+        for (auto& [name, value] : properties) {
+          if (!socket.RecvString(&name, &timeout_ms) ||
+              !socket.RecvString(&value, &timeout_ms)) {
+            PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): error while reading name/value from the socket";
+            socket.SendUint32(PROP_ERROR_READ_DATA);
+            return;
+          }
+        }
+
+        handle_property_set_batch(socket, properties);
+        break;
+      }
+
     default:
         LOG(ERROR) << "sys_prop: invalid command " << cmd;
         socket.SendUint32(PROP_ERROR_INVALID_CMD);
@@ -599,14 +690,16 @@ static bool load_properties_from_file(const char* filename, const char* filter)
     return true;
 }
 
-static void load_persistent_properties() {
-    persistent_properties_loaded = 1;
-
+// Reads properties from the one-file-per-property layout that persistent properties were kept in
+// before PERSISTENT_PROPERTY_FILE, returning the names of the files they were read from.
+static std::vector<std::string> load_legacy_persistent_properties(
+        std::map<std::string, std::string>* properties) {
+    std::vector<std::string> files;
     std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir(PERSISTENT_PROPERTY_DIR), closedir);
     if (!dir) {
         PLOG(ERROR) << "Unable to open persistent property directory \""
                     << PERSISTENT_PROPERTY_DIR << "\"";
-        return;
+        return files;
     }
 
     struct dirent* entry;
@@ -646,12 +739,57 @@ static void load_persistent_properties() {
         int length = read(fd, value, sizeof(value) - 1);
         if (length >= 0) {
             value[length] = 0;
-            property_set(entry->d_name, value);
+            (*properties)[entry->d_name] = value;
+            files.emplace_back(entry->d_name);
         } else {
             PLOG(ERROR) << "Unable to read persistent property file " << entry->d_name;
         }
         close(fd);
     }
+    return files;
+}
+
+static void load_persistent_properties() {
+    persistent_properties_loaded = 1;
+
+    std::map<std::string, std::string> legacy_properties;
+    std::vector<std::string> legacy_files = load_legacy_persistent_properties(&legacy_properties);
+
+    std::map<std::string, std::string> properties;
+    std::string err;
+    persistent_property_store.reset(new PersistentPropertyStore(PERSISTENT_PROPERTY_FILE));
+    bool migrated = persistent_property_store->Load(&properties, &err);
+    if (!migrated) {
+        LOG(ERROR) << "Unable to load persistent properties: " << err;
+    }
+
+    // Anything only in the legacy layout is moved into the store. Values already in the store
+    // are newer, so they win.
+    for (const auto& it : legacy_properties) {
+        if (properties.count(it.first)) continue;
+        properties.emplace(it);
+        if (migrated && !persistent_property_store->Write(it.first, it.second, &err)) {
+            LOG(ERROR) << "Unable to migrate persistent property " << it.first << ": " << err;
+            migrated = false;
+        }
+    }
+    if (migrated && !persistent_property_store->Sync(&err)) {
+        LOG(ERROR) << "Unable to sync migrated persistent properties: " << err;
+        migrated = false;
+    }
+    if (migrated) {
+        for (const auto& file : legacy_files) {
+            std::string path = PERSISTENT_PROPERTY_DIR "/" + file;
+            if (unlink(path.c_str()) == -1) {
+                PLOG(ERROR) << "Unable to remove legacy persistent property file " << path;
+            }
+        }
+    }
+
+    // The store already has these values, so setting them doesn't write anything.
+    for (const auto& it : properties) {
+        property_set(it.first, it.second);
+    }
 }
 
 // persist.sys.usb.config values can't be combined on build-time when property
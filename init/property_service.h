@@ -36,6 +36,8 @@ void property_load_boot_defaults(void);
 void load_persist_props(void);
 void load_system_props(void);
 void start_property_service(void);
+bool persistent_properties_need_sync(void);
+void sync_persistent_properties(void);
 uint32_t property_set(const std::string& name, const std::string& value);
 bool is_legal_property_name(const std::string& name);
 
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "readahead.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+
+#include "util.h"
+
+using android::base::StringPrintf;
+
+namespace android {
+namespace init {
+
+bool GetCachedRanges(const std::string& path, std::vector<ReadaheadRange>* ranges,
+                     std::string* err) {
+    android::base::unique_fd fd(
+        TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC)));
+    if (fd == -1) {
+        *err = "Unable to open '" + path + "': " + strerror(errno);
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        *err = "fstat failed for '" + path + "': " + strerror(errno);
+        return false;
+    }
+    if (!S_ISREG(sb.st_mode) || sb.st_size == 0) return true;
+
+    void* addr = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        *err = "Unable to mmap '" + path + "': " + strerror(errno);
+        return false;
+    }
+
+    uint64_t size = sb.st_size;
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> resident((size + page_size - 1) / page_size);
+    int result = mincore(addr, size, resident.data());
+    int saved_errno = errno;
+    munmap(addr, size);
+    if (result == -1) {
+        *err = "mincore failed for '" + path + "': " + strerror(saved_errno);
+        return false;
+    }
+
+    // Merge each run of resident pages into one range.
+    for (size_t i = 0; i < resident.size();) {
+        if (!(resident[i] & 1)) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < resident.size() && (resident[i] & 1)) ++i;
+        uint64_t offset = start * page_size;
+        ranges->push_back({path, offset, std::min<uint64_t>(i * page_size, size) - offset});
+    }
+    return true;
+}
+
+void GetCachedRangesInDir(const std::string& dir, std::vector<ReadaheadRange>* ranges) {
+    std::unique_ptr<DIR, decltype(&closedir)> d(opendir(dir.c_str()), closedir);
+    if (!d) {
+        PLOG(ERROR) << "Unable to open directory " << dir << " for readahead";
+        return;
+    }
+
+    while (dirent* entry = readdir(d.get())) {
+        std::string path = dir + "/" + entry->d_name;
+        if (entry->d_type == DT_DIR) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            GetCachedRangesInDir(path, ranges);
+        } else if (entry->d_type == DT_REG) {
+            std::string err;
+            if (!GetCachedRanges(path, ranges, &err)) {
+                LOG(VERBOSE) << err;
+            }
+        }
+    }
+}
+
+bool WriteReadaheadTrace(const std::string& path, const std::vector<ReadaheadRange>& ranges,
+                         std::string* err) {
+    std::string content;
+    for (const auto& range : ranges) {
+        content += StringPrintf("%" PRIu64 " %" PRIu64 " %s\n", range.offset, range.length,
+                                range.path.c_str());
+    }
+
+    // Replace the old trace in one step, so that a replay never sees half of a trace.
+    std::string temp_path = path + ".tmp";
+    if (!WriteFile(temp_path, content, err)) return false;
+    if (rename(temp_path.c_str(), path.c_str()) == -1) {
+        *err = "Unable to rename '" + temp_path + "' to '" + path + "': " + strerror(errno);
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ReadReadaheadTrace(const std::string& path, std::vector<ReadaheadRange>* ranges,
+                        std::string* err) {
+    std::string content;
+    if (!ReadFile(path, &content, err)) return false;
+
+    ranges->clear();
+    for (const auto& line : android::base::Split(content, "\n")) {
+        if (line.empty()) continue;
+
+        const char* p = line.c_str();
+        char* end;
+        errno = 0;
+        uint64_t offset = strtoull(p, &end, 10);
+        if (end == p || *end != ' ') {
+            *err = "Malformed line in '" + path + "': " + line;
+            return false;
+        }
+        p = end + 1;
+        uint64_t length = strtoull(p, &end, 10);
+        if (end == p || *end != ' ' || end[1] != '/' || errno != 0) {
+            *err = "Malformed line in '" + path + "': " + line;
+            return false;
+        }
+        ranges->push_back({end + 1, offset, length});
+    }
+    return true;
+}
+
+void ReadaheadRanges(const std::vector<ReadaheadRange>& ranges) {
+    // A trace lists each file's ranges together, so each file is opened once.
+    std::vector<std::pair<size_t, size_t>> files;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (files.empty() || ranges[files.back().first].path != ranges[i].path) {
+            files.emplace_back(i, i);
+        }
+        files.back().second = i + 1;
+    }
+
+    ForEachIndexInParallel(files.size(), [&ranges, &files](size_t i) {
+        const std::string& path = ranges[files[i].first].path;
+        android::base::unique_fd fd(
+            TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC)));
+        if (fd == -1) {
+            // Files come and go with updates; the next recording will drop this one.
+            PLOG(VERBOSE) << "Unable to open " << path << " for readahead";
+            return;
+        }
+        for (size_t j = files[i].first; j < files[i].second; ++j) {
+            if (readahead(fd, ranges[j].offset, ranges[j].length) == -1) {
+                PLOG(VERBOSE) << "readahead failed for " << path;
+                break;
+            }
+        }
+    });
+}
+
+}  // namespace init
+}  // namespace android
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_READAHEAD_H
+#define _INIT_READAHEAD_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace android {
+namespace init {
+
+// A byte range of a file that was in the page cache when a trace was recorded.
+struct ReadaheadRange {
+    std::string path;
+    uint64_t offset;
+    uint64_t length;
+};
+
+// Appends the ranges of |path| that are in the page cache to |ranges|.
+bool GetCachedRanges(const std::string& path, std::vector<ReadaheadRange>* ranges,
+                     std::string* err);
+
+// Appends the cached ranges of every regular file under |dir| to |ranges|.
+void GetCachedRangesInDir(const std::string& dir, std::vector<ReadaheadRange>* ranges);
+
+// A trace is a text file with one range per line, as "<offset> <length> <path>".
+bool WriteReadaheadTrace(const std::string& path, const std::vector<ReadaheadRange>& ranges,
+                         std::string* err);
+bool ReadReadaheadTrace(const std::string& path, std::vector<ReadaheadRange>* ranges,
+                        std::string* err);
+
+// Reads |ranges| into the page cache, one file at a time on each of a few threads.
+void ReadaheadRanges(const std::vector<ReadaheadRange>& ranges);
+
+}  // namespace init
+}  // namespace android
+
+#endif
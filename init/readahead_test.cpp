@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "readahead.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+
+namespace android {
+namespace init {
+
+TEST(readahead, CachedFileIsOneRange) {
+    TemporaryDir dir;
+    std::string path = std::string(dir.path) + "/file";
+    std::string content(3 * getpagesize() + 1, 'x');
+    ASSERT_TRUE(android::base::WriteStringToFile(content, path));
+
+    // The file was just written, so all of it is in the page cache.
+    std::vector<ReadaheadRange> ranges;
+    std::string err;
+    ASSERT_TRUE(GetCachedRanges(path, &ranges, &err)) << err;
+    ASSERT_EQ(1U, ranges.size());
+    EXPECT_EQ(path, ranges[0].path);
+    EXPECT_EQ(0U, ranges[0].offset);
+    EXPECT_EQ(content.size(), ranges[0].length);
+}
+
+TEST(readahead, CachedRangesInDir) {
+    TemporaryDir dir;
+    std::string subdir = std::string(dir.path) + "/subdir";
+    ASSERT_EQ(0, mkdir(subdir.c_str(), 0700));
+    ASSERT_TRUE(android::base::WriteStringToFile("a", std::string(dir.path) + "/a"));
+    ASSERT_TRUE(android::base::WriteStringToFile("b", subdir + "/b"));
+    ASSERT_TRUE(android::base::WriteStringToFile("", subdir + "/empty"));
+
+    std::vector<ReadaheadRange> ranges;
+    GetCachedRangesInDir(dir.path, &ranges);
+    ASSERT_EQ(2U, ranges.size());
+    for (const auto& range : ranges) {
+        EXPECT_EQ(1U, range.length);
+    }
+}
+
+TEST(readahead, TraceRoundTrip) {
+    TemporaryDir dir;
+    std::string trace = std::string(dir.path) + "/trace";
+    std::vector<ReadaheadRange> ranges = {
+        {"/system/bin/surfaceflinger", 0, 8192},
+        {"/system/bin/surfaceflinger", 65536, 4096},
+        {"/system/etc/init/a file with spaces.rc", 0, 100},
+    };
+
+    std::string err;
+    ASSERT_TRUE(WriteReadaheadTrace(trace, ranges, &err)) << err;
+    std::vector<ReadaheadRange> read_ranges;
+    ASSERT_TRUE(ReadReadaheadTrace(trace, &read_ranges, &err)) << err;
+
+    ASSERT_EQ(ranges.size(), read_ranges.size());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        EXPECT_EQ(ranges[i].path, read_ranges[i].path);
+        EXPECT_EQ(ranges[i].offset, read_ranges[i].offset);
+        EXPECT_EQ(ranges[i].length, read_ranges[i].length);
+    }
+
+    // Missing files are skipped rather than stopping the replay.
+    ReadaheadRanges(read_ranges);
+}
+
+TEST(readahead, MalformedTrace) {
+    TemporaryDir dir;
+    std::string trace = std::string(dir.path) + "/trace";
+    ASSERT_TRUE(android::base::WriteStringToFile("0 4096\n", trace, 0600, getuid(), getgid()));
+
+    std::vector<ReadaheadRange> ranges;
+    std::string err;
+    EXPECT_FALSE(ReadReadaheadTrace(trace, &ranges, &err));
+}
+
+}  // namespace init
+}  // namespace android
@@ -57,7 +57,7 @@ using android::base::WriteStringToFile;
 namespace android {
 namespace init {
 
-static std::string ComputeContextFromExecutable(std::string& service_name,
+static std::string ComputeContextFromExecutable(const std::string& service_name,
                                                 const std::string& service_path) {
     std::string computed_context;
 
@@ -76,9 +76,11 @@ static std::string ComputeContextFromExecutable(std::string& service_name,
     }
     std::unique_ptr<char> filecon(raw_filecon);
 
+    // This is called from several threads at once by ServiceManager::StartClass(), and
+    // libselinux's class lookup fills in a cache without any locking, so only look it up once.
+    static const security_class_t process_class = string_to_security_class("process");
     char* new_con = nullptr;
-    int rc = security_compute_create(mycon.get(), filecon.get(),
-                                     string_to_security_class("process"), &new_con);
+    int rc = security_compute_create(mycon.get(), filecon.get(), process_class, &new_con);
     if (rc == 0) {
         computed_context = new_con;
         free(new_con);
@@ -161,12 +163,17 @@ ServiceEnvironmentInfo::ServiceEnvironmentInfo(const std::string& name,
     : name(name), value(value) {
 }
 
+// A service isn't restarted sooner than this after it was last started.
+static constexpr std::chrono::seconds kMinRestartDelay = 5s;
+
 Service::Service(const std::string& name, const std::vector<std::string>& args)
     : name_(name),
       classnames_({"default"}),
       flags_(0),
       pid_(0),
       crash_count_(0),
+      restart_delay_(kMinRestartDelay),
+      restart_backoff_max_(0),
       uid_(0),
       gid_(0),
       namespace_flags_(0),
@@ -193,6 +200,8 @@ Service::Service(const std::string& name, unsigned flags, uid_t uid, gid_t gid,
       flags_(flags),
       pid_(0),
       crash_count_(0),
+      restart_delay_(kMinRestartDelay),
+      restart_backoff_max_(0),
       uid_(uid),
       gid_(gid),
       supp_gids_(supp_gids),
@@ -338,6 +347,7 @@ void Service::Reap() {
 
     flags_ &= (~SVC_RESTART);
     flags_ |= SVC_RESTARTING;
+    ScheduleRestart(now);
 
     // Execute all onrestart commands for this service.
     onrestart_.ExecuteAllCommands();
@@ -435,6 +445,17 @@ bool Service::ParsePriority(const std::vector<std::string>& args, std::string* e
     return true;
 }
 
+bool Service::ParseRestartBackoff(const std::vector<std::string>& args, std::string* err) {
+    int max_seconds;
+    if (!ParseInt(args[1], &max_seconds, static_cast<int>(kMinRestartDelay.count()))) {
+        *err = StringPrintf("restart_backoff must be at least %lld seconds",
+                            static_cast<long long>(kMinRestartDelay.count()));
+        return false;
+    }
+    restart_backoff_max_ = std::chrono::seconds(max_seconds);
+    return true;
+}
+
 bool Service::ParseIoprio(const std::vector<std::string>& args, std::string* err) {
     if (!ParseInt(args[2], &ioprio_pri_, 0, 7)) {
         *err = "priority value must be range 0 - 7";
@@ -643,6 +664,8 @@ const Service::OptionParserMap::Map& Service::OptionParserMap::map() const {
         {"keycodes",    {1,     kMax, &Service::ParseKeycodes}},
         {"oneshot",     {0,     0,    &Service::ParseOneshot}},
         {"onrestart",   {1,     kMax, &Service::ParseOnrestart}},
+        {"restart_backoff",
+                        {1,     1,    &Service::ParseRestartBackoff}},
         {"oom_score_adjust",
                         {1,     1,    &Service::ParseOomScoreAdjust}},
         {"memcg.swappiness",
@@ -687,51 +710,80 @@ bool Service::ExecStart(std::unique_ptr<android::base::Timer>* exec_waiter) {
     return true;
 }
 
-bool Service::Start() {
-    // Starting a service removes it from the disabled or reset state and
-    // immediately takes it out of the restarting state if it was in there.
-    flags_ &= (~(SVC_DISABLED|SVC_RESTARTING|SVC_RESET|SVC_RESTART|SVC_DISABLED_START));
+void Service::PrepareStart(PreparedStart* prepared) const {
+    auto start = boot_clock::now();
+    auto record_duration =
+        make_scope_guard([&]() { prepared->duration = boot_clock::now() - start; });
 
     // Running processes require no additional work --- if they're in the
     // process of exiting, we've ensured that they will immediately restart
     // on exit, unless they are ONESHOT.
     if (flags_ & SVC_RUNNING) {
-        return false;
+        prepared->skip = true;
+        return;
     }
 
-    bool needs_console = (flags_ & SVC_CONSOLE);
-    if (needs_console) {
-        if (console_.empty()) {
-            console_ = default_console;
-        }
+    if (flags_ & SVC_CONSOLE) {
+        const std::string& console = console_.empty() ? default_console : console_;
 
         // Make sure that open call succeeds to ensure a console driver is
         // properly registered for the device node
-        int console_fd = open(console_.c_str(), O_RDWR | O_CLOEXEC);
+        int console_fd = open(console.c_str(), O_RDWR | O_CLOEXEC);
         if (console_fd < 0) {
-            PLOG(ERROR) << "service '" << name_ << "' couldn't open console '" << console_ << "'";
-            flags_ |= SVC_DISABLED;
-            return false;
+            prepared->error = StringPrintf("service '%s' couldn't open console '%s': %s",
+                                           name_.c_str(), console.c_str(), strerror(errno));
+            prepared->disable = true;
+            return;
         }
         close(console_fd);
     }
 
     struct stat sb;
     if (stat(args_[0].c_str(), &sb) == -1) {
-        PLOG(ERROR) << "cannot find '" << args_[0] << "', disabling '" << name_ << "'";
-        flags_ |= SVC_DISABLED;
-        return false;
+        prepared->error = StringPrintf("cannot find '%s', disabling '%s': %s", args_[0].c_str(),
+                                       name_.c_str(), strerror(errno));
+        prepared->disable = true;
+        return;
     }
 
-    std::string scon;
     if (!seclabel_.empty()) {
-        scon = seclabel_;
+        prepared->scon = seclabel_;
     } else {
-        scon = ComputeContextFromExecutable(name_, args_[0]);
-        if (scon == "") {
-            return false;
+        prepared->scon = ComputeContextFromExecutable(name_, args_[0]);
+        if (prepared->scon == "") {
+            // ComputeContextFromExecutable() has already logged why.
+            prepared->skip = true;
         }
     }
+}
+
+bool Service::Start() {
+    PreparedStart prepared;
+    PrepareStart(&prepared);
+    return Start(prepared);
+}
+
+bool Service::Start(const PreparedStart& prepared) {
+    auto start = boot_clock::now();
+
+    // Starting a service removes it from the disabled or reset state and
+    // immediately takes it out of the restarting state if it was in there.
+    flags_ &= (~(SVC_DISABLED|SVC_RESTARTING|SVC_RESET|SVC_RESTART|SVC_DISABLED_START));
+
+    if (prepared.skip) {
+        return false;
+    }
+    if (!prepared.error.empty()) {
+        LOG(ERROR) << prepared.error;
+        if (prepared.disable) flags_ |= SVC_DISABLED;
+        return false;
+    }
+
+    bool needs_console = (flags_ & SVC_CONSOLE);
+    if (needs_console && console_.empty()) {
+        console_ = default_console;
+    }
+    const std::string& scon = prepared.scon;
 
     LOG(INFO) << "starting service '" << name_ << "'...";
 
@@ -862,6 +914,12 @@ bool Service::Start() {
     }
 
     NotifyStateChange("running");
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    LOG(INFO) << "service '" << name_ << "' started as pid " << pid_ << " (preparing took "
+              << duration_cast<microseconds>(prepared.duration).count() << "us, starting took "
+              << duration_cast<microseconds>(boot_clock::now() - start).count() << "us)";
     return true;
 }
 
@@ -909,22 +967,28 @@ void Service::Restart() {
     } /* else: Service is restarting anyways. */
 }
 
-void Service::RestartIfNeeded(time_t* process_needs_restart_at) {
-    boot_clock::time_point now = boot_clock::now();
-    boot_clock::time_point next_start = time_started_ + 5s;
-    if (now > next_start) {
-        flags_ &= (~SVC_RESTARTING);
-        Start();
-        return;
+void Service::ScheduleRestart(boot_clock::time_point now) {
+    // A service that stayed up for the longest delay has stopped crash looping.
+    if (restart_backoff_max_ > 0s && now - time_started_ >= restart_backoff_max_) {
+        restart_delay_ = kMinRestartDelay;
     }
 
-    time_t next_start_time_t = time(nullptr) +
-        time_t(std::chrono::duration_cast<std::chrono::seconds>(next_start - now).count());
-    if (next_start_time_t < *process_needs_restart_at || *process_needs_restart_at == 0) {
-        *process_needs_restart_at = next_start_time_t;
+    restart_time_ = time_started_ + restart_delay_;
+
+    // Only crashes that are throttled back off further, so a service that exits now and then
+    // is still restarted right away.
+    if (restart_backoff_max_ > 0s && now < restart_time_) {
+        restart_delay_ = std::min(restart_delay_ * 2, restart_backoff_max_);
     }
 }
 
+void Service::RestartIfNeeded(boot_clock::time_point now) {
+    if (!(flags_ & SVC_RESTARTING) || now < restart_time_) return;
+
+    flags_ &= (~SVC_RESTARTING);
+    Start();
+}
+
 // The how field should be either SVC_DISABLED, SVC_RESET, or SVC_RESTART.
 void Service::StopOrReset(int how) {
     // The service is still SVC_RUNNING until its process exits, but if it has
@@ -1129,6 +1193,32 @@ void ServiceManager::ForEachServiceInClass(const std::string& classname,
     }
 }
 
+void ServiceManager::StartClass(const std::string& classname) const {
+    std::vector<Service*> services;
+    for (const auto& s : services_) {
+        if (s->classnames().find(classname) == s->classnames().end()) continue;
+
+        // Starting a class does not start services which are explicitly disabled, it only
+        // records that the class was started for them.
+        if (s->flags() & SVC_DISABLED) {
+            s->StartIfNotDisabled();
+        } else {
+            services.emplace_back(s.get());
+        }
+    }
+
+    // Do the part of starting each service that doesn't fork in parallel, then fork them back to
+    // back in the order they were defined.
+    android::base::Timer t;
+    std::vector<PreparedStart> prepared(services.size());
+    ForEachIndexInParallel(services.size(),
+                           [&](size_t i) { services[i]->PrepareStart(&prepared[i]); });
+    for (size_t i = 0; i < services.size(); ++i) {
+        services[i]->Start(prepared[i]);
+    }
+    LOG(VERBOSE) << "(Starting class '" << classname << "' took " << t << ".)";
+}
+
 void ServiceManager::ForEachServiceWithFlags(unsigned matchflags,
                                              void (*func)(Service* svc)) const {
     for (const auto& s : services_) {
@@ -1147,9 +1237,26 @@ void ServiceManager::RemoveService(const Service& svc) {
         return;
     }
 
+    for (auto it = restart_queue_.begin(); it != restart_queue_.end();) {
+        if (it->second == svc_it->get()) {
+            it = restart_queue_.erase(it);
+        } else {
+            ++it;
+        }
+    }
     services_.erase(svc_it);
 }
 
+boot_clock::time_point ServiceManager::RestartServices() {
+    boot_clock::time_point now = boot_clock::now();
+    while (!restart_queue_.empty() && restart_queue_.begin()->first <= now) {
+        Service* svc = restart_queue_.begin()->second;
+        restart_queue_.erase(restart_queue_.begin());
+        svc->RestartIfNeeded(now);
+    }
+    return restart_queue_.empty() ? boot_clock::time_point::max() : restart_queue_.begin()->first;
+}
+
 void ServiceManager::DumpState() const {
     for (const auto& s : services_) {
         s->DumpState();
@@ -1204,6 +1311,9 @@ bool ServiceManager::ReapOneProcess() {
     }
 
     svc->Reap();
+    if (svc->flags() & SVC_RESTARTING) {
+        restart_queue_.emplace(svc->restart_time(), svc);
+    }
 
     if (svc->flags() & SVC_EXEC) {
         exec_waiter_.reset();
@@ -19,6 +19,7 @@
 
 #include <sys/types.h>
 
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
@@ -64,6 +65,16 @@ struct ServiceEnvironmentInfo {
     std::string value;
 };
 
+// The checks and SELinux context computation that Service::Start() does before it forks. They
+// only read the filesystem and policy, so they can be done for several services at once.
+struct PreparedStart {
+    bool skip = false;  // The service is already running.
+    std::string error;
+    bool disable = false;  // Whether |error| should disable the service.
+    std::string scon;
+    std::chrono::nanoseconds duration = {};
+};
+
 class Service {
   public:
     Service(const std::string& name, const std::vector<std::string>& args);
@@ -76,14 +87,16 @@ class Service {
     bool IsRunning() { return (flags_ & SVC_RUNNING) != 0; }
     bool ParseLine(const std::vector<std::string>& args, std::string* err);
     bool ExecStart(std::unique_ptr<android::base::Timer>* exec_waiter);
+    void PrepareStart(PreparedStart* prepared) const;
     bool Start();
+    bool Start(const PreparedStart& prepared);
     bool StartIfNotDisabled();
     bool Enable();
     void Reset();
     void Stop();
     void Terminate();
     void Restart();
-    void RestartIfNeeded(time_t* process_needs_restart_at);
+    void RestartIfNeeded(android::base::boot_clock::time_point now);
     void Reap();
     void DumpState() const;
     void SetShutdownCritical() { flags_ |= SVC_SHUTDOWN_CRITICAL; }
@@ -109,6 +122,8 @@ class Service {
     int oom_score_adjust() const { return oom_score_adjust_; }
     bool process_cgroup_empty() const { return process_cgroup_empty_; }
     const std::vector<std::string>& args() const { return args_; }
+    android::base::boot_clock::time_point restart_time() const { return restart_time_; }
+    std::chrono::seconds restart_delay() const { return restart_delay_; }
 
   private:
     using OptionParser = bool (Service::*) (const std::vector<std::string>& args,
@@ -120,6 +135,7 @@ class Service {
     void ZapStdio() const;
     void OpenConsole() const;
     void KillProcessGroup(int signal);
+    void ScheduleRestart(android::base::boot_clock::time_point now);
     void SetProcessAttributes();
 
     bool ParseCapabilities(const std::vector<std::string>& args, std::string *err);
@@ -129,6 +145,7 @@ class Service {
     bool ParseDisabled(const std::vector<std::string>& args, std::string* err);
     bool ParseGroup(const std::vector<std::string>& args, std::string* err);
     bool ParsePriority(const std::vector<std::string>& args, std::string* err);
+    bool ParseRestartBackoff(const std::vector<std::string>& args, std::string* err);
     bool ParseIoprio(const std::vector<std::string>& args, std::string* err);
     bool ParseKeycodes(const std::vector<std::string>& args, std::string* err);
     bool ParseOneshot(const std::vector<std::string>& args, std::string* err);
@@ -159,6 +176,12 @@ class Service {
     android::base::boot_clock::time_point time_crashed_;  // first crash within inspection window
     int crash_count_;                     // number of times crashed within window
 
+    // The delay from the last start to the next restart, which doubles up to
+    // |restart_backoff_max_| while the service keeps crashing, if that is set.
+    std::chrono::seconds restart_delay_;
+    std::chrono::seconds restart_backoff_max_;
+    android::base::boot_clock::time_point restart_time_;
+
     uid_t uid_;
     gid_t gid_;
     std::vector<gid_t> supp_gids_;
@@ -211,9 +234,13 @@ class ServiceManager {
     void ForEachService(const std::function<void(Service*)>& callback) const;
     void ForEachServiceInClass(const std::string& classname,
                                void (*func)(Service* svc)) const;
+    void StartClass(const std::string& classname) const;
     void ForEachServiceWithFlags(unsigned matchflags,
                              void (*func)(Service* svc)) const;
     void ReapAnyOutstandingChildren();
+    // Starts the services whose restart time has come, and returns when the next one is due,
+    // or boot_clock::time_point::max() if none are.
+    android::base::boot_clock::time_point RestartServices();
     void RemoveService(const Service& svc);
     void DumpState() const;
     void ClearExecWait();
@@ -227,6 +254,10 @@ class ServiceManager {
     std::unique_ptr<android::base::Timer> exec_waiter_;
 
     std::vector<std::unique_ptr<Service>> services_;
+
+    // Services waiting to restart, by restart time. A service that is stopped or started in
+    // the meantime keeps its entry until it is due, then it is dropped.
+    std::multimap<android::base::boot_clock::time_point, Service*> restart_queue_;
 };
 
 class ServiceParser : public SectionParser {
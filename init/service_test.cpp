@@ -71,5 +71,15 @@ TEST(service, pod_initialized) {
     EXPECT_FALSE(service_in_old_memory->process_cgroup_empty());
 }
 
+TEST(service, restart_backoff) {
+    Service service("test_restart_backoff", std::vector<std::string>{"/bin/test"});
+    EXPECT_EQ(std::chrono::seconds(5), service.restart_delay());
+
+    std::string err;
+    EXPECT_TRUE(service.ParseLine({"restart_backoff", "60"}, &err)) << err;
+    EXPECT_FALSE(service.ParseLine({"restart_backoff", "1"}, &err));
+    EXPECT_FALSE(service.ParseLine({"restart_backoff", "soon"}, &err));
+}
+
 }  // namespace init
 }  // namespace android
@@ -17,8 +17,10 @@
 #include "uevent_listener.h"
 
 #include <fcntl.h>
+#include <linux/netlink.h>
 #include <poll.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include <memory>
@@ -29,6 +31,9 @@
 namespace android {
 namespace init {
 
+// The most uevents read from the socket by one recvmmsg().
+static constexpr size_t kUeventBatchSize = 16;
+
 static void ParseEvent(const char* msg, Uevent* uevent) {
     uevent->partition_num = -1;
     uevent->major = -1;
@@ -92,27 +97,73 @@ UeventListener::UeventListener() {
     fcntl(device_fd_, F_SETFL, O_NONBLOCK);
 }
 
-bool UeventListener::ReadUevent(Uevent* uevent) const {
-    char msg[UEVENT_MSG_LEN + 2];
-    int n = uevent_kernel_multicast_recv(device_fd_, msg, UEVENT_MSG_LEN);
+// The same checks as uevent_kernel_multicast_recv(): only accept multicast messages that were
+// sent by the kernel.
+static bool IsKernelUevent(const msghdr& hdr) {
+    const cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+    if (cmsg == nullptr || cmsg->cmsg_type != SCM_CREDENTIALS) return false;
+
+    const ucred* cred = reinterpret_cast<const ucred*>(CMSG_DATA(cmsg));
+    if (cred->uid != 0) return false;
+
+    const sockaddr_nl* addr = reinterpret_cast<const sockaddr_nl*>(hdr.msg_name);
+    return addr->nl_pid == 0 && addr->nl_groups != 0;
+}
+
+// Reads as many uevents as are pending, up to kUeventBatchSize, with a single system call.
+// Returns false once there is nothing left to read.
+bool UeventListener::ReceiveUevents() const {
+    received_uevents_.clear();
+    next_received_uevent_ = 0;
+
+    char msgs[kUeventBatchSize][UEVENT_MSG_LEN + 2];
+    char controls[kUeventBatchSize][CMSG_SPACE(sizeof(ucred))];
+    sockaddr_nl addrs[kUeventBatchSize];
+    iovec iovs[kUeventBatchSize];
+    mmsghdr hdrs[kUeventBatchSize] = {};
+    for (size_t i = 0; i < kUeventBatchSize; ++i) {
+        iovs[i] = {msgs[i], UEVENT_MSG_LEN};
+        hdrs[i].msg_hdr.msg_name = &addrs[i];
+        hdrs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        hdrs[i].msg_hdr.msg_iov = &iovs[i];
+        hdrs[i].msg_hdr.msg_iovlen = 1;
+        hdrs[i].msg_hdr.msg_control = controls[i];
+        hdrs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+    }
+
+    int n = TEMP_FAILURE_RETRY(recvmmsg(device_fd_, hdrs, kUeventBatchSize, MSG_DONTWAIT, nullptr));
     if (n <= 0) {
-        if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            LOG(ERROR) << "Error reading from Uevent Fd";
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            PLOG(ERROR) << "Error reading from Uevent Fd";
         }
         return false;
     }
-    if (n >= UEVENT_MSG_LEN) {
-        LOG(ERROR) << "Uevent overflowed buffer, discarding";
-        // Return true here even if we discard as we may have more uevents pending and we
-        // want to keep processing them.
-        return true;
-    }
 
-    msg[n] = '\0';
-    msg[n + 1] = '\0';
+    for (int i = 0; i < n; ++i) {
+        if (!IsKernelUevent(hdrs[i].msg_hdr)) continue;
 
-    ParseEvent(msg, uevent);
+        size_t length = hdrs[i].msg_len;
+        if (length >= UEVENT_MSG_LEN || (hdrs[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+            LOG(ERROR) << "Uevent overflowed buffer, discarding";
+            continue;
+        }
+
+        msgs[i][length] = '\0';
+        msgs[i][length + 1] = '\0';
+
+        received_uevents_.emplace_back();
+        ParseEvent(msgs[i], &received_uevents_.back());
+    }
+    return true;
+}
+
+bool UeventListener::ReadUevent(Uevent* uevent) const {
+    // Keep going past batches whose uevents were all discarded, as more may be pending.
+    while (next_received_uevent_ == received_uevents_.size()) {
+        if (!ReceiveUevents()) return false;
+    }
 
+    *uevent = std::move(received_uevents_[next_received_uevent_++]);
     return true;
 }
 
@@ -22,6 +22,7 @@
 #include <chrono>
 #include <functional>
 #include <optional>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 
@@ -51,9 +52,15 @@ class UeventListener {
 
   private:
     bool ReadUevent(Uevent* uevent) const;
+    bool ReceiveUevents() const;
     ListenerAction RegenerateUeventsForDir(DIR* d, const ListenerCallback& callback) const;
 
     android::base::unique_fd device_fd_;
+
+    // Uevents received from the socket but not yet returned by ReadUevent(). They're kept
+    // across calls so that a callback returning kStop doesn't lose the rest of a batch.
+    mutable std::vector<Uevent> received_uevents_;
+    mutable size_t next_received_uevent_ = 0;
 };
 
 }  // namespace init
@@ -17,6 +17,7 @@
 #include "ueventd.h"
 
 #include <ctype.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
@@ -24,8 +25,10 @@
 #include <string.h>
 #include <sys/wait.h>
 
-#include <set>
+#include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <android-base/chrono_utils.h>
 #include <android-base/logging.h>
@@ -61,13 +64,14 @@
 
 // Handling of uevent messages has two unique properties:
 // 1) It can be done in isolation; it doesn't need to read or write any status once it is started.
-// 2) It uses setegid() and setfscreatecon() so either care (aka locking) must be taken to ensure
-//    that no file system operations are done while the uevent process has an abnormal egid or
-//    fscreatecon or this handling must happen in a separate process.
-// Given the above two properties, it is best to fork() subprocesses to handle the uevents.  This
-// reduces the overhead and complexity that would be required in a solution with threads and locks.
-// In testing, a racy multithreaded solution has the same performance as the fork() solution, so
-// there is no reason to deal with the complexity of the former.
+// 2) It uses setegid() and setfscreatecon(), which both change only the calling thread's
+//    credentials (see ueventd_test.cpp), so threads handling different uevents don't interfere.
+// Given the above two properties, cold boot handles uevents on a pool of threads.  Unlike
+// subprocesses, threads share the DeviceHandler and its tables rather than each having a copy.
+
+// The uevents for a single device must still be handled in the order they arrived, since for
+// example its 'change' must not be handled before its 'add'.  So the uevents are grouped by device,
+// and each thread takes the next group from a shared queue and handles all of its uevents in order.
 
 // One other important caveat during the boot process is the handling of SELinux restorecon.
 // Since many devices have child devices, calling selinux_android_restorecon() recursively for each
@@ -80,17 +84,15 @@
 // 1) ueventd regenerates uevents by doing the /sys traversal and listens to the netlink socket for
 //    the generated uevents.  It writes these uevents into a queue represented by a vector.
 //
-// 2) ueventd forks 'n' separate uevent handler subprocesses and has each of them to handle the
-//    uevents in the queue based on a starting offset (their process number) and a stride (the total
-//    number of processes).  Note that no IPC happens at this point and only const functions from
-//    DeviceHandler should be called from this context.
+// 2) ueventd starts a pool of threads that take groups of uevents from the queue, one device at a
+//    time.  Note that no IPC happens at this point and only const functions from DeviceHandler
+//    should be called from this context.
 //
-// 3) In parallel to the subprocesses handling the uevents, the main thread of ueventd calls
-//    selinux_android_restorecon() recursively on /sys/class, /sys/block, and /sys/devices.
+// 3) In parallel to those threads, another set of threads calls selinux_android_restorecon()
+//    recursively on each directory in /sys.
 //
-// 4) Once the restorecon operation finishes, the main thread calls waitpid() to wait for all
-//    subprocess handlers to complete and exit.  Once this happens, it marks coldboot as having
-//    completed.
+// 4) Once both have finished, restorecon is re-enabled for future uevents and coldboot is marked as
+//    having completed.
 //
 // At this point, ueventd is single threaded, poll()'s and then handles any future uevents.
 
@@ -100,42 +102,29 @@
 // the uevent listener resumes in polling mode and will handle the uevents that occurred during
 // coldboot.
 
+using namespace std::string_literals;
+
 namespace android {
 namespace init {
 
 class ColdBoot {
   public:
     ColdBoot(UeventListener& uevent_listener, DeviceHandler& device_handler)
-        : uevent_listener_(uevent_listener),
-          device_handler_(device_handler),
-          num_handler_subprocesses_(std::thread::hardware_concurrency() ?: 4) {}
+        : uevent_listener_(uevent_listener), device_handler_(device_handler) {}
 
     void Run();
 
   private:
-    void UeventHandlerMain(unsigned int process_num, unsigned int total_processes);
     void RegenerateUevents();
-    void ForkSubProcesses();
+    void HandleUevents();
     void DoRestoreCon();
-    void WaitForSubProcesses();
 
     UeventListener& uevent_listener_;
     DeviceHandler& device_handler_;
 
-    unsigned int num_handler_subprocesses_;
     std::vector<Uevent> uevent_queue_;
-
-    std::set<pid_t> subprocess_pids_;
 };
 
-void ColdBoot::UeventHandlerMain(unsigned int process_num, unsigned int total_processes) {
-    for (unsigned int i = process_num; i < uevent_queue_.size(); i += total_processes) {
-        auto& uevent = uevent_queue_[i];
-        device_handler_.HandleDeviceEvent(uevent);
-    }
-    _exit(EXIT_SUCCESS);
-}
-
 void ColdBoot::RegenerateUevents() {
     uevent_listener_.RegenerateUevents([this](const Uevent& uevent) {
         HandleFirmwareEvent(uevent);
@@ -145,69 +134,65 @@ void ColdBoot::RegenerateUevents() {
     });
 }
 
-void ColdBoot::ForkSubProcesses() {
-    for (unsigned int i = 0; i < num_handler_subprocesses_; ++i) {
-        auto pid = fork();
-        if (pid < 0) {
-            PLOG(FATAL) << "fork() failed!";
-        }
+void ColdBoot::HandleUevents() {
+    // Group the uevents by device, keeping each device's in the order they arrived.
+    std::vector<std::vector<const Uevent*>> devices;
+    std::unordered_map<std::string, size_t> device_indices;
+    for (const auto& uevent : uevent_queue_) {
+        auto [it, inserted] = device_indices.emplace(uevent.path, devices.size());
+        if (inserted) devices.emplace_back();
+        devices[it->second].emplace_back(&uevent);
+    }
 
-        if (pid == 0) {
-            UeventHandlerMain(i, num_handler_subprocesses_);
+    ForEachIndexInParallel(devices.size(), [this, &devices](size_t i) {
+        for (const Uevent* uevent : devices[i]) {
+            device_handler_.HandleDeviceEvent(*uevent);
         }
-
-        subprocess_pids_.emplace(pid);
-    }
+    });
 }
 
 void ColdBoot::DoRestoreCon() {
-    selinux_android_restorecon("/sys", SELINUX_ANDROID_RESTORECON_RECURSE);
-    device_handler_.set_skip_restorecon(false);
-}
-
-void ColdBoot::WaitForSubProcesses() {
-    // Treat subprocesses that crash or get stuck the same as if ueventd itself has crashed or gets
-    // stuck.
-    //
-    // When a subprocess crashes, we fatally abort from ueventd.  init will restart ueventd when
-    // init reaps it, and the cold boot process will start again.  If this continues to fail, then
-    // since ueventd is marked as a critical service, init will reboot to recovery.
-    //
-    // When a subprocess gets stuck, keep ueventd spinning waiting for it.  init has a timeout for
-    // cold boot and will reboot to the bootloader if ueventd does not complete in time.
-    while (!subprocess_pids_.empty()) {
-        int status;
-        pid_t pid = TEMP_FAILURE_RETRY(waitpid(-1, &status, 0));
-        if (pid == -1) {
-            PLOG(ERROR) << "waitpid() failed";
+    std::vector<std::string> dirs;
+    std::unique_ptr<DIR, decltype(&closedir)> sys(opendir("/sys"), closedir);
+    if (!sys) {
+        PLOG(ERROR) << "couldn't open /sys, restoring its contexts in one pass";
+        selinux_android_restorecon("/sys", SELINUX_ANDROID_RESTORECON_RECURSE);
+        return;
+    }
+    while (dirent* entry = readdir(sys.get())) {
+        if (entry->d_type != DT_DIR || !strcmp(entry->d_name, ".") ||
+            !strcmp(entry->d_name, "..")) {
             continue;
         }
-
-        auto it = std::find(subprocess_pids_.begin(), subprocess_pids_.end(), pid);
-        if (it == subprocess_pids_.end()) continue;
-
-        if (WIFEXITED(status)) {
-            if (WEXITSTATUS(status) == EXIT_SUCCESS) {
-                subprocess_pids_.erase(it);
-            } else {
-                LOG(FATAL) << "subprocess exited with status " << WEXITSTATUS(status);
-            }
-        } else if (WIFSIGNALED(status)) {
-            LOG(FATAL) << "subprocess killed by signal " << WTERMSIG(status);
-        }
+        dirs.emplace_back("/sys/"s + entry->d_name);
     }
+
+    selinux_android_restorecon("/sys", 0);
+    ForEachIndexInParallel(dirs.size(), [&dirs](size_t i) {
+        selinux_android_restorecon(dirs[i].c_str(), SELINUX_ANDROID_RESTORECON_RECURSE);
+    });
 }
 
 void ColdBoot::Run() {
     android::base::Timer cold_boot_timer;
 
+    android::base::Timer regenerate_timer;
     RegenerateUevents();
+    LOG(INFO) << "Coldboot regenerated " << uevent_queue_.size() << " uevents in "
+              << regenerate_timer;
 
-    ForkSubProcesses();
+    std::thread restorecon_thread([this]() {
+        android::base::Timer restorecon_timer;
+        DoRestoreCon();
+        LOG(INFO) << "Coldboot restorecon of /sys took " << restorecon_timer;
+    });
 
-    DoRestoreCon();
+    android::base::Timer handle_timer;
+    HandleUevents();
+    LOG(INFO) << "Coldboot handled uevents in " << handle_timer;
 
-    WaitForSubProcesses();
+    restorecon_thread.join();
+    device_handler_.set_skip_restorecon(false);
 
     close(open(COLDBOOT_DONE, O_WRONLY | O_CREAT | O_CLOEXEC, 0000));
     LOG(INFO) << "Coldboot took " << cold_boot_timer.duration().count() / 1000.0f << " seconds";
@@ -269,10 +254,9 @@ int ueventd_main(int argc, char** argv) {
         cold_boot.Run();
     }
 
-    // We use waitpid() in ColdBoot, so we can't ignore SIGCHLD until now.
     signal(SIGCHLD, SIG_IGN);
-    // Reap and pending children that exited between the last call to waitpid() and setting SIG_IGN
-    // for SIGCHLD above.
+    // Reap any firmware loading children that exited during cold boot, before SIG_IGN was set for
+    // SIGCHLD above.
     while (waitpid(-1, nullptr, WNOHANG) > 0) {
     }
 
@@ -19,16 +19,20 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <string>
 #include <thread>
 #include <vector>
 
 #include <android-base/file.h>
 #include <android-base/scopeguard.h>
+#include <android-base/stringprintf.h>
 #include <android-base/test_utils.h>
 #include <gtest/gtest.h>
 #include <selinux/selinux.h>
 
+#include "devices.h"
+
 using namespace std::string_literals;
 
 template <typename T, typename F>
@@ -120,3 +124,64 @@ TEST(ueventd, setfscreatecon_IsPerThread) {
         freecon(file_context);
     }
 }
+
+// Compares finding the permissions for coldboot-like device paths with PermissionsIndex against
+// calling Match() on every rule, as DeviceHandler used to.
+TEST(ueventd, PermissionsIndexBenchmark) {
+    using android::base::StringPrintf;
+    using android::init::Permissions;
+    using android::init::PermissionsIndex;
+
+    // Roughly the mix of a device's ueventd.rc files.
+    std::vector<Permissions> permissions;
+    for (int i = 0; i < 100; ++i) {
+        permissions.emplace_back(StringPrintf("/dev/device%d", i), 0660, 0, 1000);
+        permissions.emplace_back(StringPrintf("/dev/class%d/*", i), 0660, 0, 1000);
+        permissions.emplace_back(StringPrintf("/dev/block/by-name/part%d*", i), 0660, 0, 1000);
+        permissions.emplace_back(StringPrintf("/dev/bus%d*/dev*", i), 0660, 0, 1000);
+    }
+    PermissionsIndex index(permissions);
+
+    std::vector<std::string> paths;
+    for (int i = 0; i < 5000; ++i) {
+        paths.emplace_back(StringPrintf("/dev/device%d", i % 150));
+        paths.emplace_back(StringPrintf("/dev/class%d/node%d", i % 150, i));
+        paths.emplace_back(StringPrintf("/dev/bus%d-%d/dev%d", i % 150, i, i));
+        paths.emplace_back(StringPrintf("/dev/other%d", i));
+    }
+
+    // Like DeviceHandler::GetDevicePermissions(), the last matching rule wins.
+    auto linear_scan = [&](const std::string& path) -> int {
+        for (size_t i = permissions.size(); i-- > 0;) {
+            if (permissions[i].Match(path)) return i;
+        }
+        return -1;
+    };
+    auto indexed = [&](const std::string& path) -> int {
+        std::vector<size_t> candidates;
+        index.FindCandidates(path, &candidates);
+        std::sort(candidates.begin(), candidates.end());
+        for (size_t i = candidates.size(); i-- > 0;) {
+            if (permissions[candidates[i]].Match(path)) return candidates[i];
+        }
+        return -1;
+    };
+
+    auto time = [&paths](const auto& find, std::vector<int>* results) {
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& path : paths) {
+            results->emplace_back(find(path));
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - start)
+            .count();
+    };
+    std::vector<int> linear_results;
+    std::vector<int> indexed_results;
+    auto linear_us = time(linear_scan, &linear_results);
+    auto indexed_us = time(indexed, &indexed_results);
+
+    EXPECT_EQ(linear_results, indexed_results);
+    GTEST_LOG_(INFO) << paths.size() << " paths against " << permissions.size()
+                     << " rules: linear scan " << linear_us << "us, index " << indexed_us << "us";
+}
@@ -29,7 +29,9 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <thread>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -292,6 +294,25 @@ bool is_dir(const char* pathname) {
     return S_ISDIR(info.st_mode);
 }
 
+void ForEachIndexInParallel(size_t count, const std::function<void(size_t)>& fn) {
+    std::atomic<size_t> next_index(0);
+    auto run = [&fn, &next_index, count]() {
+        for (size_t i; (i = next_index++) < count;) {
+            fn(i);
+        }
+    };
+
+    size_t num_threads = std::min<size_t>(count, std::thread::hardware_concurrency() ?: 4);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
 bool expand_props(const std::string& src, std::string* dst) {
     const char* src_ptr = src.c_str();
 
@@ -53,6 +53,10 @@ std::string bytes_to_hex(const uint8_t *bytes, size_t bytes_len);
 bool is_dir(const char* pathname);
 bool expand_props(const std::string& src, std::string* dst);
 
+// Calls |fn| for every index in [0, count) across up to hardware_concurrency() threads, including
+// the calling one, and returns once all the calls have.
+void ForEachIndexInParallel(size_t count, const std::function<void(size_t)>& fn);
+
 void panic() __attribute__((__noreturn__));
 
 // Returns the platform's Android DT directory as specified in the kernel cmdline.
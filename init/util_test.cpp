@@ -20,6 +20,9 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 
+#include <atomic>
+#include <vector>
+
 #include <android-base/stringprintf.h>
 #include <android-base/test_utils.h>
 #include <gtest/gtest.h>
@@ -191,5 +194,15 @@ TEST(util, mkdir_recursive_extra_slashes) {
     EXPECT_TRUE(is_dir(path1.c_str()));
 }
 
+TEST(util, ForEachIndexInParallel) {
+    std::vector<std::atomic<int>> calls(1000);
+    ForEachIndexInParallel(calls.size(), [&calls](size_t i) { ++calls[i]; });
+    for (size_t i = 0; i < calls.size(); ++i) {
+        EXPECT_EQ(1, calls[i]) << i;
+    }
+
+    ForEachIndexInParallel(0, [](size_t) { FAIL(); });
+}
+
 }  // namespace init
 }  // namespace android
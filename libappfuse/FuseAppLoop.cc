@@ -19,6 +19,9 @@
 #include <sys/eventfd.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <thread>
+
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 
@@ -85,11 +88,23 @@ bool HandleWrite(FuseAppLoop* loop, FuseBuffer* buffer, FuseAppLoopCallback* cal
     return true;
 }
 
-bool HandleMessage(FuseAppLoop* loop, FuseBuffer* buffer, int fd, FuseAppLoopCallback* callback) {
-    if (!buffer->request.Read(fd)) {
-        return false;
+// Whether a request causes a callback, and may run on a worker thread.
+bool IsDispatched(uint32_t opcode) {
+    switch (opcode) {
+        case FUSE_LOOKUP:
+        case FUSE_GETATTR:
+        case FUSE_OPEN:
+        case FUSE_READ:
+        case FUSE_WRITE:
+        case FUSE_RELEASE:
+        case FUSE_FSYNC:
+            return true;
+        default:
+            return false;
     }
+}
 
+bool HandleMessage(FuseAppLoop* loop, FuseBuffer* buffer, int fd, FuseAppLoopCallback* callback) {
     const uint32_t opcode = buffer->request.header.opcode;
     LOG(VERBOSE) << "Read a fuse packet, opcode=" << opcode;
     switch (opcode) {
@@ -131,9 +146,21 @@ bool HandleMessage(FuseAppLoop* loop, FuseBuffer* buffer, int fd, FuseAppLoopCal
 
 FuseAppLoopCallback::~FuseAppLoopCallback() = default;
 
-FuseAppLoop::FuseAppLoop(base::unique_fd&& fd) : fd_(std::move(fd)) {}
+FuseAppLoop::FuseAppLoop(base::unique_fd&& fd) : FuseAppLoop(std::move(fd), 0, 0) {}
+
+FuseAppLoop::FuseAppLoop(base::unique_fd&& fd, size_t num_workers, size_t max_outstanding)
+    : fd_(std::move(fd)),
+      num_workers_(num_workers),
+      max_outstanding_(num_workers != 0 ? std::max<size_t>(max_outstanding, 1) : 0),
+      breaking_(false),
+      stopping_(false) {}
 
 void FuseAppLoop::Break() {
+    if (num_workers_ != 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        breaking_ = true;
+        slot_available_.notify_all();
+    }
     const int64_t value = 1;
     if (write(break_fd_, &value, sizeof(value)) == -1) {
         PLOG(ERROR) << "Failed to send a break event";
@@ -141,6 +168,7 @@ void FuseAppLoop::Break() {
 }
 
 bool FuseAppLoop::ReplySimple(uint64_t unique, int32_t result) {
+    Replied(unique);
     if (result == -ENOSYS) {
         // We should not return -ENOSYS because the kernel stops delivering FUSE
         // command after receiving -ENOSYS as a result for the command.
@@ -152,6 +180,7 @@ bool FuseAppLoop::ReplySimple(uint64_t unique, int32_t result) {
 }
 
 bool FuseAppLoop::ReplyLookup(uint64_t unique, uint64_t inode, int64_t size) {
+    Replied(unique);
     FuseSimpleResponse response;
     response.Reset(sizeof(fuse_entry_out), 0, unique);
     response.entry_out.nodeid = inode;
@@ -164,6 +193,7 @@ bool FuseAppLoop::ReplyLookup(uint64_t unique, uint64_t inode, int64_t size) {
 }
 
 bool FuseAppLoop::ReplyGetAttr(uint64_t unique, uint64_t inode, int64_t size, int mode) {
+    Replied(unique);
     CHECK(mode == (S_IFREG | 0777) || mode == (S_IFDIR | 0777));
     FuseSimpleResponse response;
     response.Reset(sizeof(fuse_attr_out), 0, unique);
@@ -175,6 +205,7 @@ bool FuseAppLoop::ReplyGetAttr(uint64_t unique, uint64_t inode, int64_t size, in
 }
 
 bool FuseAppLoop::ReplyOpen(uint64_t unique, uint64_t fh) {
+    Replied(unique);
     FuseSimpleResponse response;
     response.Reset(sizeof(fuse_open_out), kFuseSuccess, unique);
     response.open_out.fh = fh;
@@ -182,6 +213,7 @@ bool FuseAppLoop::ReplyOpen(uint64_t unique, uint64_t fh) {
 }
 
 bool FuseAppLoop::ReplyWrite(uint64_t unique, uint32_t size) {
+    Replied(unique);
     CHECK(size <= kFuseMaxWrite);
     FuseSimpleResponse response;
     response.Reset(sizeof(fuse_write_out), kFuseSuccess, unique);
@@ -190,12 +222,75 @@ bool FuseAppLoop::ReplyWrite(uint64_t unique, uint32_t size) {
 }
 
 bool FuseAppLoop::ReplyRead(uint64_t unique, uint32_t size, const void* data) {
+    Replied(unique);
     CHECK(size <= kFuseMaxRead);
     FuseSimpleResponse response;
     response.ResetHeader(size, kFuseSuccess, unique);
     return response.WriteWithBody(fd_, sizeof(FuseResponse), data);
 }
 
+void FuseAppLoop::Replied(uint64_t unique) {
+    if (num_workers_ == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (outstanding_.erase(unique) != 0) {
+        slot_available_.notify_one();
+    }
+}
+
+FuseBuffer* FuseAppLoop::WaitForBuffer() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // A request may be replied to before its callback returns, so a buffer is
+    // not always free once the request stops being outstanding.
+    slot_available_.wait(lock, [this] {
+        return breaking_ || (outstanding_.size() < max_outstanding_ &&
+                             (!free_buffers_.empty() || buffers_.size() < max_outstanding_));
+    });
+    if (breaking_) {
+        return nullptr;
+    }
+    if (free_buffers_.empty()) {
+        buffers_.emplace_back(new FuseBuffer());
+        return buffers_.back().get();
+    }
+    FuseBuffer* buffer = free_buffers_.back();
+    free_buffers_.pop_back();
+    return buffer;
+}
+
+void FuseAppLoop::Dispatch(FuseBuffer* buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Counted before any worker can reply to it.
+    outstanding_.insert(buffer->request.header.unique);
+    queue_.push_back(buffer);
+    request_queued_.notify_one();
+}
+
+void FuseAppLoop::RunWorker(FuseAppLoopCallback* callback) {
+    while (true) {
+        FuseBuffer* buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            request_queued_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            buffer = queue_.front();
+            queue_.pop_front();
+        }
+
+        // A failed reply is noticed by the loop, which reads from the same FD.
+        HandleMessage(this, buffer, fd_, callback);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_buffers_.push_back(buffer);
+            slot_available_.notify_one();
+        }
+    }
+}
+
 void FuseAppLoop::Start(FuseAppLoopCallback* callback) {
     break_fd_.reset(eventfd(/* initval */ 0, EFD_CLOEXEC));
     if (break_fd_.get() == -1) {
@@ -223,8 +318,30 @@ void FuseAppLoop::Start(FuseAppLoopCallback* callback) {
     last_event = 0;
     break_event = 0;
 
-    FuseBuffer buffer;
+    std::unique_ptr<FuseBuffer> single_buffer;
+    std::vector<std::thread> workers;
+    if (num_workers_ == 0) {
+        single_buffer.reset(new FuseBuffer());
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            breaking_ = false;
+            stopping_ = false;
+        }
+        for (size_t i = 0; i < num_workers_; i++) {
+            workers.emplace_back([this, callback] { RunWorker(callback); });
+        }
+    }
+
+    FuseBuffer* buffer = single_buffer.get();
     while (true) {
+        if (buffer == nullptr) {
+            buffer = WaitForBuffer();
+            if (buffer == nullptr) {
+                break;
+            }
+        }
+
         if (!epoll_controller->Wait(1)) {
             break;
         }
@@ -236,11 +353,35 @@ void FuseAppLoop::Start(FuseAppLoopCallback* callback) {
             break;
         }
 
-        if (!HandleMessage(this, &buffer, fd_, callback)) {
+        if (!buffer->request.Read(fd_)) {
+            break;
+        }
+        if (!workers.empty() && IsDispatched(buffer->request.header.opcode)) {
+            Dispatch(buffer);
+            buffer = nullptr;
+        } else if (!HandleMessage(this, buffer, fd_, callback)) {
             break;
         }
     }
 
+    if (!workers.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            request_queued_.notify_all();
+        }
+        // Workers run the requests already queued before exiting.
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        outstanding_.clear();
+        free_buffers_.clear();
+        for (const std::unique_ptr<FuseBuffer>& owned : buffers_) {
+            free_buffers_.push_back(owned.get());
+        }
+    }
+
     LOG(VERBOSE) << "FuseAppLoop exit";
 }
 
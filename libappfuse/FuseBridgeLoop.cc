@@ -16,6 +16,7 @@
 
 #include "libappfuse/FuseBridgeLoop.h"
 
+#include <poll.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
 
@@ -30,6 +31,10 @@ namespace android {
 namespace fuse {
 namespace {
 
+// Maximum number of messages transferred by a bridge for one epoll event, so
+// that busy mounts need fewer wakeups without starving the others.
+constexpr size_t kMaxMessagesPerTransfer = 16;
+
 enum class FuseBridgeState { kWaitToReadEither, kWaitToReadProxy, kWaitToWriteProxy, kClosing };
 
 struct FuseBridgeEntryEvent {
@@ -88,6 +93,8 @@ class FuseBridgeEntry {
 
         last_device_events_.events = 0;
         last_proxy_events_.events = 0;
+        // The events observed by epoll were set from the state at this point.
+        last_state_ = state_;
 
         LOG(VERBOSE) << "Transfer device_read_ready=" << device_read_ready
                      << " proxy_read_ready=" << proxy_read_ready
@@ -101,17 +108,15 @@ class FuseBridgeEntry {
 
         switch (state_) {
             case FuseBridgeState::kWaitToReadEither:
-                if (proxy_read_ready) {
-                    state_ = ReadFromProxy();
-                } else if (device_read_ready) {
-                    state_ = ReadFromDevice(callback);
-                }
+                TransferBatch(callback, proxy_read_ready, device_read_ready);
                 return;
 
-            case FuseBridgeState::kWaitToReadProxy:
+            case FuseBridgeState::kWaitToReadProxy: {
                 CHECK(proxy_read_ready);
-                state_ = ReadFromProxy();
+                bool proxy_ready = true;
+                state_ = ReadFromProxy(/* first */ true, &proxy_ready);
                 return;
+            }
 
             case FuseBridgeState::kWaitToWriteProxy:
                 CHECK(proxy_write_ready);
@@ -130,14 +135,36 @@ class FuseBridgeEntry {
   private:
     friend class BridgeEpollController;
 
-    FuseBridgeState ReadFromProxy() {
+    // Transfers messages while either FD has one, replies from the proxy first,
+    // until the state changes or kMaxMessagesPerTransfer have been transferred.
+    void TransferBatch(FuseBridgeLoopCallback* callback, bool proxy_ready, bool device_ready) {
+        // Whether epoll reported the device readable and it was not read yet.
+        bool device_polled = device_ready;
+        for (size_t i = 0;
+             i < kMaxMessagesPerTransfer && state_ == FuseBridgeState::kWaitToReadEither; i++) {
+            if (proxy_ready) {
+                state_ = ReadFromProxy(/* first */ i == 0, &proxy_ready);
+            } else if (device_ready) {
+                state_ = ReadFromDevice(callback, device_polled, &device_ready);
+                device_polled = false;
+            } else {
+                return;
+            }
+        }
+    }
+
+    // Clears |*ready| once the proxy has no more messages. |first| tells that
+    // epoll just reported the proxy readable.
+    FuseBridgeState ReadFromProxy(bool first, bool* ready) {
         switch (buffer_.response.ReadOrAgain(proxy_fd_)) {
             case ResultOrAgain::kSuccess:
                 break;
             case ResultOrAgain::kFailure:
                 return FuseBridgeState::kClosing;
             case ResultOrAgain::kAgain:
-                return FuseBridgeState::kWaitToReadProxy;
+                *ready = false;
+                return first ? FuseBridgeState::kWaitToReadProxy
+                             : FuseBridgeState::kWaitToReadEither;
         }
 
         if (!buffer_.response.Write(device_fd_)) {
@@ -172,8 +199,21 @@ class FuseBridgeEntry {
         return FuseBridgeState::kWaitToReadEither;
     }
 
-    FuseBridgeState ReadFromDevice(FuseBridgeLoopCallback* callback) {
+    // Clears |*ready| once the device has no more requests. Unless |polled|
+    // tells that epoll reported it readable, the device is polled first, as its
+    // FD blocks: replies are written to it, and a non-blocking socket standing
+    // for /dev/fuse in tests could fail them.
+    FuseBridgeState ReadFromDevice(FuseBridgeLoopCallback* callback, bool polled, bool* ready) {
         LOG(VERBOSE) << "ReadFromDevice";
+        if (!polled) {
+            pollfd device_poll = {device_fd_, POLLIN, 0};
+            if (TEMP_FAILURE_RETRY(poll(&device_poll, 1, 0)) != 1 ||
+                device_poll.revents != POLLIN) {
+                // Errors and hang-ups are left to the next epoll event.
+                *ready = false;
+                return FuseBridgeState::kWaitToReadEither;
+            }
+        }
         if (!buffer_.request.Read(device_fd_)) {
             return FuseBridgeState::kClosing;
         }
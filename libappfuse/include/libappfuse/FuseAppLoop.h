@@ -17,8 +17,12 @@
 #ifndef ANDROID_LIBAPPFUSE_FUSEAPPLOOP_H_
 #define ANDROID_LIBAPPFUSE_FUSEAPPLOOP_H_
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <unordered_set>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 
@@ -44,8 +48,17 @@ class FuseAppLoopCallback {
 
 class FuseAppLoop final {
   public:
+    // Invokes the callback on the thread running |Start|, one request at a time.
     FuseAppLoop(base::unique_fd&& fd);
 
+    // Invokes the callback for lookup, getattr, open, read, write, release and
+    // fsync on |num_workers| threads, so that requests are processed
+    // concurrently and may be replied to out of order, from any thread. The
+    // loop stops reading requests while |max_outstanding| of them have not been
+    // replied yet. As with a single thread, |data| passed to |OnWrite| is valid
+    // only until the callback returns.
+    FuseAppLoop(base::unique_fd&& fd, size_t num_workers, size_t max_outstanding);
+
     void Start(FuseAppLoopCallback* callback);
     void Break();
 
@@ -57,11 +70,32 @@ class FuseAppLoop final {
     bool ReplyRead(uint64_t unique, uint32_t size, const void* data);
 
   private:
+    void RunWorker(FuseAppLoopCallback* callback);
+    // Returns a buffer for the next request once fewer than |max_outstanding_|
+    // requests are outstanding, or nullptr if the loop is breaking.
+    FuseBuffer* WaitForBuffer();
+    void Dispatch(FuseBuffer* buffer);
+    void Replied(uint64_t unique);
+
     base::unique_fd fd_;
     base::unique_fd break_fd_;
 
+    const size_t num_workers_;
+    const size_t max_outstanding_;
+
     // Lock for multi-threading.
     std::mutex mutex_;
+
+    // The following members are guarded by |mutex_|.
+    std::condition_variable request_queued_;
+    std::condition_variable slot_available_;
+    std::deque<FuseBuffer*> queue_;
+    std::vector<std::unique_ptr<FuseBuffer>> buffers_;
+    std::vector<FuseBuffer*> free_buffers_;
+    // Unique IDs of the requests dispatched to workers and not replied yet.
+    std::unordered_set<uint64_t> outstanding_;
+    bool breaking_;
+    bool stopping_;
 };
 
 bool StartFuseAppLoop(int fd, FuseAppLoopCallback* callback);
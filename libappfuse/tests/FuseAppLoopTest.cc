@@ -21,6 +21,9 @@
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 #include <gtest/gtest.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 
 #include "libappfuse/EpollController.h"
@@ -80,6 +83,33 @@ class Callback : public FuseAppLoopCallback {
   }
 };
 
+// Records reads without replying to them.
+class DeferringCallback : public FuseAppLoopCallback {
+ public:
+  std::mutex mutex;
+  std::condition_variable read_received;
+  std::vector<uint64_t> reads;
+
+  void OnGetAttr(uint64_t, uint64_t) override {}
+  void OnLookup(uint64_t, uint64_t) override {}
+  void OnFsync(uint64_t, uint64_t) override {}
+  void OnWrite(uint64_t, uint64_t, uint64_t, uint32_t, const void*) override {}
+  void OnOpen(uint64_t, uint64_t) override {}
+  void OnRelease(uint64_t, uint64_t) override {}
+
+  void OnRead(uint64_t unique, uint64_t, uint64_t, uint32_t) override {
+      std::lock_guard<std::mutex> lock(mutex);
+      reads.push_back(unique);
+      read_received.notify_all();
+  }
+
+  bool WaitForReads(size_t count) {
+      std::unique_lock<std::mutex> lock(mutex);
+      return read_received.wait_for(lock, std::chrono::seconds(5),
+                                    [this, count] { return reads.size() >= count; });
+  }
+};
+
 class FuseAppLoopTest : public ::testing::Test {
  protected:
    std::thread thread_;
@@ -295,5 +325,68 @@ TEST_F(FuseAppLoopTest, Break) {
     }
 }
 
+TEST(FuseAppLoopWorkersTest, ReplyOutOfOrder) {
+  base::unique_fd sockets[2];
+  ASSERT_TRUE(SetupMessageSockets(&sockets));
+  FuseAppLoop loop(std::move(sockets[1]), 2, 2);
+  DeferringCallback callback;
+  std::thread thread([&loop, &callback] { loop.Start(&callback); });
+
+  FuseRequest request;
+  FuseResponse response;
+  for (uint64_t unique = 1; unique <= 3; unique++) {
+    request.Reset(sizeof(fuse_read_in), FUSE_READ, unique);
+    request.header.nodeid = 10;
+    request.read_in.size = 1;
+    ASSERT_TRUE(request.Write(sockets[0]));
+  }
+
+  // The third request is not read while two are outstanding.
+  ASSERT_TRUE(callback.WaitForReads(2));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  uint64_t first, second;
+  {
+    std::lock_guard<std::mutex> lock(callback.mutex);
+    ASSERT_EQ(2u, callback.reads.size());
+    first = callback.reads[0];
+    second = callback.reads[1];
+  }
+
+  ASSERT_TRUE(loop.ReplySimple(second, 0));
+  ASSERT_TRUE(response.Read(sockets[0]));
+  EXPECT_EQ(second, response.header.unique);
+
+  ASSERT_TRUE(callback.WaitForReads(3));
+  EXPECT_EQ(3u, callback.reads[2]);
+  ASSERT_TRUE(loop.ReplySimple(3, 0));
+  ASSERT_TRUE(response.Read(sockets[0]));
+  EXPECT_EQ(3u, response.header.unique);
+  ASSERT_TRUE(loop.ReplySimple(first, 0));
+  ASSERT_TRUE(response.Read(sockets[0]));
+  EXPECT_EQ(first, response.header.unique);
+
+  sockets[0].reset();
+  thread.join();
+}
+
+TEST(FuseAppLoopWorkersTest, Break) {
+  base::unique_fd sockets[2];
+  ASSERT_TRUE(SetupMessageSockets(&sockets));
+  FuseAppLoop loop(std::move(sockets[1]), 2, 1);
+  DeferringCallback callback;
+  std::thread thread([&loop, &callback] { loop.Start(&callback); });
+
+  FuseRequest request;
+  request.Reset(sizeof(fuse_read_in), FUSE_READ, 1);
+  request.header.nodeid = 10;
+  request.read_in.size = 1;
+  ASSERT_TRUE(request.Write(sockets[0]));
+  ASSERT_TRUE(callback.WaitForReads(1));
+
+  // Breaks the loop although it waits for a reply before reading further.
+  loop.Break();
+  thread.join();
+}
+
 }  // namespace fuse
 }  // namespace android
@@ -210,5 +210,41 @@ TEST_F(FuseBridgeLoopTest, Proxy) {
   Close();
 }
 
+TEST_F(FuseBridgeLoopTest, ProxyMultipleRequests) {
+  // The proxy socket cannot buffer all the requests, so the bridge has to wait
+  // for it in the middle, then resume reading the device.
+  constexpr uint64_t kRequestCount = 8;
+  std::thread writer([this] {
+    FuseRequest request;
+    for (uint64_t unique = 1; unique <= kRequestCount; unique++) {
+      memset(&request, 0, sizeof(fuse_in_header) + sizeof(fuse_write_in));
+      request.header.opcode = FUSE_WRITE;
+      request.header.unique = unique;
+      request.header.len = sizeof(fuse_in_header) + sizeof(fuse_write_in) + kFuseMaxWrite;
+      request.write_in.size = kFuseMaxWrite;
+      ASSERT_TRUE(request.Write(dev_sockets_[0]));
+    }
+  });
+
+  for (uint64_t unique = 1; unique <= kRequestCount; unique++) {
+    ASSERT_TRUE(request_.Read(proxy_sockets_[1]));
+    EXPECT_EQ(unique, request_.header.unique);
+  }
+  writer.join();
+
+  for (uint64_t unique = 1; unique <= kRequestCount; unique++) {
+    memset(&response_, 0, sizeof(FuseResponse));
+    response_.header.len = sizeof(fuse_out_header);
+    response_.header.unique = unique;
+    ASSERT_TRUE(response_.Write(proxy_sockets_[1]));
+  }
+  for (uint64_t unique = 1; unique <= kRequestCount; unique++) {
+    ASSERT_TRUE(response_.Read(dev_sockets_[0]));
+    EXPECT_EQ(unique, response_.header.unique);
+  }
+
+  Close();
+}
+
 }  // namespace fuse
 }  // namespace android
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Throughput of the appfuse loops over socketpairs. Every iteration is one
+// request: with a depth of 1 the time per iteration is the latency of a
+// request, and with a larger depth the requests are pipelined, as the kernel
+// does for parallel I/O.
+
+#include <string.h>
+
+#include <memory>
+#include <thread>
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+
+#include "libappfuse/FuseAppLoop.h"
+#include "libappfuse/FuseBridgeLoop.h"
+#include "libappfuse/FuseBuffer.h"
+
+namespace android {
+namespace fuse {
+namespace {
+
+constexpr uint64_t kInode = 2;
+
+// Replies to reads and writes with |size| bytes, right away.
+class ReplyingCallback : public FuseAppLoopCallback {
+  public:
+    ReplyingCallback() : loop(nullptr), data_(new char[kFuseMaxRead]()) {}
+
+    void OnLookup(uint64_t unique, uint64_t inode) override {
+        loop->ReplyLookup(unique, inode, 0);
+    }
+    void OnGetAttr(uint64_t unique, uint64_t inode) override {
+        loop->ReplyGetAttr(unique, inode, 0, S_IFREG | 0777);
+    }
+    void OnFsync(uint64_t unique, uint64_t) override { loop->ReplySimple(unique, 0); }
+    void OnWrite(uint64_t unique, uint64_t, uint64_t, uint32_t size, const void*) override {
+        loop->ReplyWrite(unique, size);
+    }
+    void OnRead(uint64_t unique, uint64_t, uint64_t, uint32_t size) override {
+        loop->ReplyRead(unique, size, data_.get());
+    }
+    void OnOpen(uint64_t unique, uint64_t inode) override { loop->ReplyOpen(unique, inode); }
+    void OnRelease(uint64_t unique, uint64_t) override { loop->ReplySimple(unique, 0); }
+
+    FuseAppLoop* loop;
+
+  private:
+    std::unique_ptr<char[]> data_;
+};
+
+// Builds a read or write request of |size| bytes.
+void InitRequest(FuseRequest* request, uint32_t opcode, size_t size) {
+    if (opcode == FUSE_READ) {
+        request->Reset(sizeof(fuse_read_in), FUSE_READ, 0);
+        request->read_in.size = size;
+    } else {
+        request->Reset(sizeof(fuse_write_in) + size, FUSE_WRITE, 0);
+        request->write_in.size = size;
+    }
+    request->header.nodeid = kInode;
+}
+
+// Keeps |depth| requests in flight on |fd| and counts one iteration per reply.
+void RunRequests(benchmark::State& state, int fd, uint32_t opcode, size_t size, size_t depth) {
+    std::unique_ptr<FuseRequest> request(new FuseRequest());
+    std::unique_ptr<FuseResponse> response(new FuseResponse());
+    InitRequest(request.get(), opcode, size);
+
+    uint64_t unique = 0;
+    auto send = [&] {
+        request->header.unique = ++unique;
+        CHECK(request->Write(fd));
+    };
+
+    for (size_t i = 0; i < depth; i++) {
+        send();
+    }
+    while (state.KeepRunning()) {
+        CHECK(response->Read(fd));
+        send();
+    }
+    for (size_t i = 0; i < depth; i++) {
+        CHECK(response->Read(fd));
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Arguments: size, number of workers, depth. The loops run on other threads,
+// so rates are measured against real time.
+void FuseAppLoopArgs(benchmark::internal::Benchmark* b, size_t max_size) {
+    b->UseRealTime();
+    for (int depth : {1, 8}) {
+        for (int workers : {0, 4}) {
+            for (size_t size : {4096u, 65536u, static_cast<unsigned>(max_size)}) {
+                b->Args({static_cast<int>(size), workers, depth});
+            }
+        }
+    }
+}
+
+void RunFuseAppLoop(benchmark::State& state, uint32_t opcode) {
+    const size_t size = state.range(0);
+    const size_t workers = state.range(1);
+    const size_t depth = state.range(2);
+
+    base::unique_fd sockets[2];
+    CHECK(SetupMessageSockets(&sockets));
+    // Allows the whole pipeline to be outstanding.
+    FuseAppLoop loop(std::move(sockets[1]), workers, depth);
+    ReplyingCallback callback;
+    callback.loop = &loop;
+    std::thread thread([&loop, &callback] { loop.Start(&callback); });
+
+    RunRequests(state, sockets[0], opcode, size, depth);
+
+    sockets[0].reset();
+    thread.join();
+}
+
+void BM_FuseAppLoop_Read(benchmark::State& state) {
+    RunFuseAppLoop(state, FUSE_READ);
+}
+BENCHMARK(BM_FuseAppLoop_Read)->Apply([](benchmark::internal::Benchmark* b) {
+    FuseAppLoopArgs(b, kFuseMaxRead);
+});
+
+void BM_FuseAppLoop_Write(benchmark::State& state) {
+    RunFuseAppLoop(state, FUSE_WRITE);
+}
+BENCHMARK(BM_FuseAppLoop_Write)->Apply([](benchmark::internal::Benchmark* b) {
+    FuseAppLoopArgs(b, kFuseMaxWrite);
+});
+
+class NullBridgeCallback : public FuseBridgeLoopCallback {
+  public:
+    void OnMount(int) override {}
+    void OnClosed(int) override {}
+};
+
+// Arguments: size, depth.
+void FuseBridgeLoopArgs(benchmark::internal::Benchmark* b, size_t max_size) {
+    b->UseRealTime();
+    for (int depth : {1, 8}) {
+        for (size_t size : {4096u, 65536u, static_cast<unsigned>(max_size)}) {
+            b->Args({static_cast<int>(size), depth});
+        }
+    }
+}
+
+void RunFuseBridgeLoop(benchmark::State& state, uint32_t opcode) {
+    const size_t size = state.range(0);
+    const size_t depth = state.range(1);
+
+    base::unique_fd dev_sockets[2];
+    base::unique_fd proxy_sockets[2];
+    CHECK(SetupMessageSockets(&dev_sockets));
+    CHECK(SetupMessageSockets(&proxy_sockets));
+
+    NullBridgeCallback callback;
+    std::thread bridge([&] {
+        FuseBridgeLoop loop;
+        loop.AddBridge(1, std::move(dev_sockets[1]), std::move(proxy_sockets[0]));
+        loop.Start(&callback);
+    });
+
+    // Plays the app, replying to every request with |size| bytes.
+    const int proxy_fd = proxy_sockets[1];
+    std::thread proxy([proxy_fd, opcode, size] {
+        std::unique_ptr<FuseBuffer> buffer(new FuseBuffer());
+        std::unique_ptr<FuseResponse> response(new FuseResponse());
+        if (opcode == FUSE_READ) {
+            response->Reset(size, kFuseSuccess, 0);
+        } else {
+            response->Reset(sizeof(fuse_write_out), kFuseSuccess, 0);
+            response->write_out.size = size;
+        }
+        while (buffer->request.Read(proxy_fd)) {
+            response->header.unique = buffer->request.header.unique;
+            if (!response->Write(proxy_fd)) {
+                break;
+            }
+        }
+    });
+
+    RunRequests(state, dev_sockets[0], opcode, size, depth);
+
+    dev_sockets[0].reset();
+    bridge.join();
+    proxy.join();
+}
+
+void BM_FuseBridgeLoop_Read(benchmark::State& state) {
+    RunFuseBridgeLoop(state, FUSE_READ);
+}
+BENCHMARK(BM_FuseBridgeLoop_Read)->Apply([](benchmark::internal::Benchmark* b) {
+    FuseBridgeLoopArgs(b, kFuseMaxRead);
+});
+
+void BM_FuseBridgeLoop_Write(benchmark::State& state) {
+    RunFuseBridgeLoop(state, FUSE_WRITE);
+}
+BENCHMARK(BM_FuseBridgeLoop_Write)->Apply([](benchmark::internal::Benchmark* b) {
+    FuseBridgeLoopArgs(b, kFuseMaxWrite);
+});
+
+// The cost of moving one message through a socketpair, which every loop pays
+// at least once per request.
+void BM_FuseBuffer_WriteRead(benchmark::State& state) {
+    const size_t size = state.range(0);
+    base::unique_fd sockets[2];
+    CHECK(SetupMessageSockets(&sockets));
+    std::unique_ptr<FuseRequest> request(new FuseRequest());
+    std::unique_ptr<FuseRequest> received(new FuseRequest());
+    InitRequest(request.get(), FUSE_WRITE, size);
+
+    while (state.KeepRunning()) {
+        CHECK(request->Write(sockets[0]));
+        CHECK(received->Read(sockets[1]));
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_FuseBuffer_WriteRead)->Arg(4096)->Arg(65536)->Arg(kFuseMaxWrite);
+
+}  // namespace
+}  // namespace fuse
+}  // namespace android
+
+BENCHMARK_MAIN();
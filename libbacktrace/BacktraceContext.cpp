@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <backtrace/Backtrace.h>
+#include <backtrace/BacktraceContext.h>
+#include <backtrace/BacktraceMap.h>
+
+#include "thread_utils.h"
+
+BacktraceContext::BacktraceContext(pid_t pid, BacktraceMap* map)
+    : pid_(pid), map_(map), map_shared_(true) {
+  if (pid_ == BACKTRACE_CURRENT_PROCESS) {
+    pid_ = getpid();
+  }
+  if (map_ == nullptr) {
+    map_ = BacktraceMap::Create(pid_);
+    map_shared_ = false;
+  }
+}
+
+BacktraceContext::~BacktraceContext() {
+  // The backtrace object refers to the map, so destroy it first.
+  backtrace_.reset();
+  if (map_ && !map_shared_) {
+    delete map_;
+    map_ = nullptr;
+  }
+}
+
+Backtrace* BacktraceContext::Get(pid_t tid) {
+  if (tid == BACKTRACE_CURRENT_THREAD) {
+    tid = (pid_ == getpid()) ? gettid() : pid_;
+  }
+  if (backtrace_ == nullptr || backtrace_->Tid() != tid) {
+    backtrace_.reset(Backtrace::Create(pid_, tid, map_));
+  }
+  return backtrace_.get();
+}
@@ -72,6 +72,9 @@ bool BacktraceCurrent::Unwind(size_t num_ignore_frames, ucontext_t* ucontext) {
   }
 
   error_ = BACKTRACE_UNWIND_NO_ERROR;
+  // Keep the storage of the frames, this object may be reused for
+  // many unwinds.
+  frames_.clear();
   if (ucontext) {
     return UnwindFromContext(num_ignore_frames, ucontext);
   }
@@ -29,12 +29,14 @@
 #include "BacktraceLog.h"
 #include "UnwindCurrent.h"
 
+UnwindCurrent::UnwindCurrent(pid_t pid, pid_t tid, BacktraceMap* map)
+    : BacktraceCurrent(pid, tid, map), cursor_(new unw_cursor_t) {}
+
 std::string UnwindCurrent::GetFunctionNameRaw(uintptr_t pc, uintptr_t* offset) {
   if (!initialized_) {
     // If init local is not called, then trying to get a function name will
     // fail, so try to initialize first.
-    std::unique_ptr<unw_cursor_t> cursor(new unw_cursor_t);
-    if (unw_init_local(cursor.get(), &context_) < 0) {
+    if (unw_init_local(cursor_.get(), &context_) < 0) {
       return "";
     }
     initialized_ = true;
@@ -88,9 +90,8 @@ bool UnwindCurrent::UnwindFromContext(size_t num_ignore_frames, ucontext_t* ucon
     GetUnwContextFromUcontext(ucontext);
   }
 
-  // The cursor structure is pretty large, do not put it on the stack.
-  std::unique_ptr<unw_cursor_t> cursor(new unw_cursor_t);
-  int ret = unw_init_local(cursor.get(), &context_);
+  unw_cursor_t* cursor = cursor_.get();
+  int ret = unw_init_local(cursor, &context_);
   if (ret < 0) {
     BACK_LOGW("unw_init_local failed %d", ret);
     error_ = BACKTRACE_UNWIND_ERROR_SETUP_FAILED;
@@ -101,13 +102,13 @@ bool UnwindCurrent::UnwindFromContext(size_t num_ignore_frames, ucontext_t* ucon
   size_t num_frames = 0;
   do {
     unw_word_t pc;
-    ret = unw_get_reg(cursor.get(), UNW_REG_IP, &pc);
+    ret = unw_get_reg(cursor, UNW_REG_IP, &pc);
     if (ret < 0) {
       BACK_LOGW("Failed to read IP %d", ret);
       break;
     }
     unw_word_t sp;
-    ret = unw_get_reg(cursor.get(), UNW_REG_SP, &sp);
+    ret = unw_get_reg(cursor, UNW_REG_SP, &sp);
     if (ret < 0) {
       BACK_LOGW("Failed to read SP %d", ret);
       break;
@@ -158,7 +159,7 @@ bool UnwindCurrent::UnwindFromContext(size_t num_ignore_frames, ucontext_t* ucon
     if (map.flags & PROT_DEVICE_MAP) {
       break;
     }
-    ret = unw_step (cursor.get());
+    ret = unw_step (cursor);
   } while (ret > 0 && num_frames < MAX_BACKTRACE_FRAMES);
 
   return true;
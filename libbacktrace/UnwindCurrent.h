@@ -21,6 +21,7 @@
 #include <sys/types.h>
 #include <ucontext.h>
 
+#include <memory>
 #include <string>
 
 #include <backtrace/Backtrace.h>
@@ -33,7 +34,7 @@
 
 class UnwindCurrent : public BacktraceCurrent {
  public:
-  UnwindCurrent(pid_t pid, pid_t tid, BacktraceMap* map) : BacktraceCurrent(pid, tid, map) {}
+  UnwindCurrent(pid_t pid, pid_t tid, BacktraceMap* map);
   virtual ~UnwindCurrent() {}
 
   std::string GetFunctionNameRaw(uintptr_t pc, uintptr_t* offset) override;
@@ -45,6 +46,10 @@ class UnwindCurrent : public BacktraceCurrent {
 
   unw_context_t context_;
 
+  // The cursor structure is pretty large, do not put it on the stack.
+  // It is allocated once and reused by every unwind.
+  std::unique_ptr<unw_cursor_t> cursor_;
+
   bool initialized_ = false;
 };
 
@@ -87,6 +87,8 @@ bool UnwindPtrace::Unwind(size_t num_ignore_frames, ucontext_t* ucontext) {
   }
 
   error_ = BACKTRACE_UNWIND_NO_ERROR;
+  // Start from no frames, in case this object is being reused.
+  frames_.clear();
 
   if (ucontext) {
     BACK_LOGW("Unwinding from a specified context not supported yet.");
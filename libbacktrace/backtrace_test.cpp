@@ -41,6 +41,7 @@
 #include <vector>
 
 #include <backtrace/Backtrace.h>
+#include <backtrace/BacktraceContext.h>
 #include <backtrace/BacktraceMap.h>
 
 #include <android-base/macros.h>
@@ -249,6 +250,36 @@ TEST(libbacktrace, local_trace) {
   ASSERT_NE(test_level_one(1, 2, 3, 4, VerifyLevelBacktrace, nullptr), 0);
 }
 
+static void VerifyLevelBacktraceContext(void*) {
+  BacktraceContext context(BACKTRACE_CURRENT_PROCESS);
+  ASSERT_TRUE(context.GetMap() != nullptr);
+  Backtrace* backtrace = context.Get();
+  ASSERT_TRUE(backtrace != nullptr);
+  ASSERT_EQ(context.GetMap(), backtrace->GetMap());
+
+  ASSERT_TRUE(backtrace->Unwind(0));
+  ASSERT_EQ(BACKTRACE_UNWIND_NO_ERROR, backtrace->GetError());
+  size_t num_frames = backtrace->NumFrames();
+  VerifyLevelDump(backtrace);
+
+  // The same object is reused, and no frames are left over from the
+  // previous unwind.
+  ASSERT_EQ(backtrace, context.Get(gettid()));
+  ASSERT_TRUE(backtrace->Unwind(2));
+  ASSERT_EQ(BACKTRACE_UNWIND_NO_ERROR, backtrace->GetError());
+  ASSERT_EQ(num_frames - 2, backtrace->NumFrames()) << DumpFrames(backtrace);
+
+  ASSERT_EQ(backtrace, context.Get());
+  ASSERT_TRUE(backtrace->Unwind(0));
+  ASSERT_EQ(BACKTRACE_UNWIND_NO_ERROR, backtrace->GetError());
+  ASSERT_EQ(num_frames, backtrace->NumFrames()) << DumpFrames(backtrace);
+  VerifyLevelDump(backtrace);
+}
+
+TEST(libbacktrace, local_trace_context) {
+  ASSERT_NE(test_level_one(1, 2, 3, 4, VerifyLevelBacktraceContext, nullptr), 0);
+}
+
 static void VerifyIgnoreFrames(Backtrace* bt_all, Backtrace* bt_ign1, Backtrace* bt_ign2,
                                const char* cur_proc) {
   EXPECT_EQ(bt_all->NumFrames(), bt_ign1->NumFrames() + 1)
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BACKTRACE_BACKTRACE_CONTEXT_H
+#define _BACKTRACE_BACKTRACE_CONTEXT_H
+
+#include <sys/types.h>
+
+#include <memory>
+
+#include <backtrace/Backtrace.h>
+#include <backtrace/backtrace_constants.h>
+
+class BacktraceMap;
+
+// Holds the map, the unwinder state and the frame storage used to unwind
+// the threads of a single process, so that they can be reused by many
+// unwinds instead of being created again for each one.
+// A context is not thread safe, each thread doing unwinds should use
+// its own context.
+class BacktraceContext {
+ public:
+  // The pid is interpreted the same way as in Backtrace::Create().
+  // If map is NULL, then create the map and manage it internally.
+  // If map is not NULL, the map is still owned by the caller.
+  BacktraceContext(pid_t pid, BacktraceMap* map = NULL);
+  ~BacktraceContext();
+
+  // Get the Backtrace object used to unwind the given thread. The object is
+  // owned by the context, and the same object is returned for as long as
+  // the same thread is requested. The frames of an unwind are only valid
+  // until the next unwind done through this context.
+  Backtrace* Get(pid_t tid = BACKTRACE_CURRENT_THREAD);
+
+  pid_t Pid() const { return pid_; }
+
+  BacktraceMap* GetMap() { return map_; }
+
+ private:
+  pid_t pid_;
+
+  BacktraceMap* map_;
+  bool map_shared_;
+
+  std::unique_ptr<Backtrace> backtrace_;
+};
+
+#endif // _BACKTRACE_BACKTRACE_CONTEXT_H
@@ -18,25 +18,51 @@
  * Implementation of the user-space ashmem API for devices, which have our
  * ashmem-enabled kernel. See ashmem-sim.c for the "fake" tmp-based version,
  * used by the simulator.
+ *
+ * When sys.use_memfd is set and the kernel supports sealing memfds against
+ * future writes, regions are memfds instead, which need no device node and
+ * one less system call to set up.  The rest of the API works on either kind
+ * of region, whichever process created it.
  */
 #define LOG_TAG "ashmem"
 
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/ashmem.h>
+#include <linux/falloc.h>
+#include <linux/memfd.h>
 #include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <cutils/ashmem.h>
+#include <cutils/properties.h>
 #include <log/log.h>
 
 #define ASHMEM_DEVICE "/dev/ashmem"
 
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+/* memfd_create() takes names of up to 249 bytes, fewer than ashmem. */
+#define MEMFD_NAME_LEN 250
+
+/* Every memfd region is sealed against resizing, which ashmem forbids too. */
+#define MEMFD_REGION_SEALS (F_SEAL_GROW | F_SEAL_SHRINK)
+
+/* Regions kept by ashmem_recycle_region(), and the most bytes they may hold. */
+#define POOL_MAX_REGIONS 16
+#define POOL_MAX_BYTES (16 * 1024 * 1024)
+
 /* ashmem identity */
 static dev_t __ashmem_rdev;
 /*
@@ -45,6 +71,176 @@ static dev_t __ashmem_rdev;
  */
 static pthread_mutex_t __ashmem_lock = PTHREAD_MUTEX_INITIALIZER;
 
+struct pooled_region {
+    int fd;
+    size_t size;
+    char name[MEMFD_NAME_LEN];
+};
+
+/* Regions ready to be handed out again, most recently recycled last. */
+static struct pooled_region __pool[POOL_MAX_REGIONS];
+static size_t __pool_count;
+static size_t __pool_bytes;
+static pthread_mutex_t __pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t __memfd_once = PTHREAD_ONCE_INIT;
+static bool __use_memfd;
+
+static int memfd_create_region_fd(const char *name)
+{
+#if defined(__NR_memfd_create)
+    return syscall(__NR_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    (void)name;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static void pool_prepare_fork()
+{
+    pthread_mutex_lock(&__pool_lock);
+}
+
+static void pool_parent_fork()
+{
+    pthread_mutex_unlock(&__pool_lock);
+}
+
+/* The child shares the pooled regions with its parent, so must not use them. */
+static void pool_child_fork()
+{
+    size_t i;
+
+    for (i = 0; i < __pool_count; i++) {
+        close(__pool[i].fd);
+    }
+    __pool_count = 0;
+    __pool_bytes = 0;
+    pthread_mutex_unlock(&__pool_lock);
+}
+
+static void memfd_init_once()
+{
+    int fd;
+
+    pthread_atfork(pool_prepare_fork, pool_parent_fork, pool_child_fork);
+
+    if (!property_get_bool("sys.use_memfd", false)) {
+        return;
+    }
+
+    /* ashmem_set_prot_region() needs F_SEAL_FUTURE_WRITE, from Linux 5.1. */
+    fd = memfd_create_region_fd("ashmem_probe");
+    if (fd < 0) {
+        ALOGD("memfd_create unsupported (%s), using " ASHMEM_DEVICE, strerror(errno));
+        return;
+    }
+    if (TEMP_FAILURE_RETRY(fcntl(fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE)) < 0) {
+        ALOGD("memfd sealing unsupported (%s), using " ASHMEM_DEVICE, strerror(errno));
+    } else {
+        __use_memfd = true;
+    }
+    close(fd);
+}
+
+/* Returns the seals of a memfd region, or <0 if fd is not one. */
+static int memfd_region_seals(int fd)
+{
+    int seals = TEMP_FAILURE_RETRY(fcntl(fd, F_GET_SEALS));
+    if (seals < 0 || (seals & MEMFD_REGION_SEALS) != MEMFD_REGION_SEALS) {
+        return -1;
+    }
+    return seals;
+}
+
+/* Reads back the name a memfd region was created with. */
+static bool memfd_region_name(int fd, char *name, size_t len)
+{
+    static const char prefix[] = "/memfd:";
+    static const char suffix[] = " (deleted)";
+    char path[32];
+    char link[sizeof(prefix) + MEMFD_NAME_LEN + sizeof(suffix)];
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    ssize_t n = readlink(path, link, sizeof(link) - 1);
+    if (n < 0) {
+        return false;
+    }
+    link[n] = '\0';
+
+    size_t prefix_len = strlen(prefix);
+    size_t suffix_len = strlen(suffix);
+    if ((size_t)n < prefix_len + suffix_len || strncmp(link, prefix, prefix_len) ||
+            strcmp(link + n - suffix_len, suffix)) {
+        return false;
+    }
+    link[n - suffix_len] = '\0';
+    return strlcpy(name, link + prefix_len, len) < len;
+}
+
+static int memfd_create_region(const char *name, size_t size)
+{
+    int ret, save_errno;
+
+    int fd = memfd_create_region_fd(name);
+    if (fd < 0) {
+        return fd;
+    }
+
+    ret = TEMP_FAILURE_RETRY(ftruncate(fd, size));
+    if (ret < 0) {
+        goto error;
+    }
+    ret = TEMP_FAILURE_RETRY(fcntl(fd, F_ADD_SEALS, MEMFD_REGION_SEALS));
+    if (ret < 0) {
+        goto error;
+    }
+    return fd;
+
+error:
+    save_errno = errno;
+    close(fd);
+    errno = save_errno;
+    return ret;
+}
+
+/*
+ * Like ashmem's protection mask, the seals can only take access away: once
+ * sealed against writes, a region can no longer be mapped writable.  Unlike
+ * ashmem, a memfd cannot be made unreadable.
+ */
+static int memfd_set_prot_region(int fd, int seals, int prot)
+{
+    if (prot & PROT_WRITE) {
+        if (seals & F_SEAL_FUTURE_WRITE) {
+            errno = EINVAL;
+            return -1;
+        }
+        return 0;
+    }
+    return TEMP_FAILURE_RETRY(fcntl(fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE | F_SEAL_SEAL));
+}
+
+/* Takes a pooled region of the given size and name, or returns -1. */
+static int pool_take(const char *name, size_t size)
+{
+    int fd = -1;
+    size_t i;
+
+    pthread_mutex_lock(&__pool_lock);
+    for (i = __pool_count; i-- > 0;) {
+        if (__pool[i].size == size && !strcmp(__pool[i].name, name)) {
+            fd = __pool[i].fd;
+            __pool_bytes -= size;
+            __pool[i] = __pool[--__pool_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&__pool_lock);
+    return fd;
+}
+
 /* logistics of getting file descriptor for ashmem */
 static int __ashmem_open_locked()
 {
@@ -137,7 +333,7 @@ static int __ashmem_is_ashmem(int fd, int fatal)
 
 int ashmem_valid(int fd)
 {
-    return __ashmem_is_ashmem(fd, 0) >= 0;
+    return memfd_region_seals(fd) >= 0 || __ashmem_is_ashmem(fd, 0) >= 0;
 }
 
 /*
@@ -151,6 +347,18 @@ int ashmem_create_region(const char *name, size_t size)
 {
     int ret, save_errno;
 
+    pthread_once(&__memfd_once, memfd_init_once);
+    if (__use_memfd) {
+        char buf[MEMFD_NAME_LEN] = {0};
+
+        strlcpy(buf, name ? name : "", sizeof(buf));
+        int fd = pool_take(buf, size);
+        if (fd >= 0) {
+            return fd;
+        }
+        return memfd_create_region(buf, size);
+    }
+
     int fd = __ashmem_open();
     if (fd < 0) {
         return fd;
@@ -180,8 +388,51 @@ error:
     return ret;
 }
 
+/*
+ * ashmem_recycle_region - gives up a region, which ashmem_create_region()
+ * may hand out again, zeroed, for the same name and size
+ */
+int ashmem_recycle_region(int fd)
+{
+    struct stat st;
+    char name[MEMFD_NAME_LEN];
+    bool pooled = false;
+    int seals = memfd_region_seals(fd);
+
+    /*
+     * Only memfd regions can be zeroed in place, and only those still
+     * writable can be handed out as new.
+     */
+    if (seals != MEMFD_REGION_SEALS ||
+            TEMP_FAILURE_RETRY(fstat(fd, &st)) < 0 || st.st_size > POOL_MAX_BYTES ||
+            !memfd_region_name(fd, name, sizeof(name)) ||
+            TEMP_FAILURE_RETRY(fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                         0, st.st_size)) < 0 ||
+            lseek(fd, 0, SEEK_SET) < 0) {
+        return close(fd);
+    }
+
+    pthread_mutex_lock(&__pool_lock);
+    if (__pool_count < POOL_MAX_REGIONS && __pool_bytes + st.st_size <= POOL_MAX_BYTES) {
+        __pool[__pool_count].fd = fd;
+        __pool[__pool_count].size = st.st_size;
+        memcpy(__pool[__pool_count].name, name, sizeof(name));
+        __pool_count++;
+        __pool_bytes += st.st_size;
+        pooled = true;
+    }
+    pthread_mutex_unlock(&__pool_lock);
+
+    return pooled ? 0 : close(fd);
+}
+
 int ashmem_set_prot_region(int fd, int prot)
 {
+    int seals = memfd_region_seals(fd);
+    if (seals >= 0) {
+        return memfd_set_prot_region(fd, seals, prot);
+    }
+
     int ret = __ashmem_is_ashmem(fd, 1);
     if (ret < 0) {
         return ret;
@@ -194,6 +445,11 @@ int ashmem_pin_region(int fd, size_t offset, size_t len)
 {
     struct ashmem_pin pin = { offset, len };
 
+    /* memfd pages are never purged. */
+    if (memfd_region_seals(fd) >= 0) {
+        return ASHMEM_NOT_PURGED;
+    }
+
     int ret = __ashmem_is_ashmem(fd, 1);
     if (ret < 0) {
         return ret;
@@ -206,6 +462,10 @@ int ashmem_unpin_region(int fd, size_t offset, size_t len)
 {
     struct ashmem_pin pin = { offset, len };
 
+    if (memfd_region_seals(fd) >= 0) {
+        return ASHMEM_IS_UNPINNED;
+    }
+
     int ret = __ashmem_is_ashmem(fd, 1);
     if (ret < 0) {
         return ret;
@@ -216,6 +476,14 @@ int ashmem_unpin_region(int fd, size_t offset, size_t len)
 
 int ashmem_get_size_region(int fd)
 {
+    if (memfd_region_seals(fd) >= 0) {
+        struct stat st;
+        if (TEMP_FAILURE_RETRY(fstat(fd, &st)) < 0) {
+            return -1;
+        }
+        return st.st_size;
+    }
+
     int ret = __ashmem_is_ashmem(fd, 1);
     if (ret < 0) {
         return ret;
@@ -55,6 +55,11 @@ int ashmem_create_region(const char *ignored __unused, size_t size)
     return fd;
 }
 
+int ashmem_recycle_region(int fd)
+{
+    return close(fd);
+}
+
 int ashmem_set_prot_region(int fd __unused, int prot __unused)
 {
     return 0;
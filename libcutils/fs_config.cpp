@@ -30,6 +30,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <cutils/threads.h>
 #include <log/log.h>
 #include <private/android_filesystem_config.h>
 #include <private/fs_config.h>
@@ -234,22 +235,33 @@ static size_t strip(const char* path, size_t len, const char suffix[]) {
     return len - strlen(suffix);
 }
 
-static int fs_config_open(int dir, int which, const char* target_out_path) {
-    int fd = -1;
+// Returns the name of a config file under target_out_path, to be freed, or
+// NULL if there is no target_out_path.
+static char* fs_config_target_name(int dir, int which, const char* target_out_path) {
+    char* name = NULL;
 
     if (target_out_path && *target_out_path) {
         // target_out_path is the path to the directory holding content of
         // system partition but as we cannot guarantee it ends with '/system'
         // or with or without a trailing slash, need to strip them carefully.
-        char* name = NULL;
         size_t len = strlen(target_out_path);
         len = strip(target_out_path, len, "/");
         len = strip(target_out_path, len, "/system");
-        if (asprintf(&name, "%.*s%s", (int)len, target_out_path, conf[which][dir]) != -1) {
-            fd = TEMP_FAILURE_RETRY(open(name, O_RDONLY | O_BINARY));
-            free(name);
+        if (asprintf(&name, "%.*s%s", (int)len, target_out_path, conf[which][dir]) == -1) {
+            name = NULL;
         }
     }
+    return name;
+}
+
+static int fs_config_open(int dir, int which, const char* target_out_path) {
+    int fd = -1;
+
+    char* name = fs_config_target_name(dir, which, target_out_path);
+    if (name) {
+        fd = TEMP_FAILURE_RETRY(open(name, O_RDONLY | O_BINARY));
+        free(name);
+    }
     if (fd < 0) {
         fd = TEMP_FAILURE_RETRY(open(conf[which][dir], O_RDONLY | O_BINARY));
     }
@@ -302,60 +314,503 @@ static bool fs_config_cmp(bool partial, const char* prefix, size_t len, const ch
 auto __for_testing_only__fs_config_cmp = fs_config_cmp;
 #endif
 
-void fs_config(const char* path, int dir, const char* target_out_path, unsigned* uid, unsigned* gid,
-               unsigned* mode, uint64_t* capabilities) {
-    const struct fs_path_config* pc;
-    size_t which, plen;
+// fs_config() applies the first rule matching a path, out of those of the
+// fs_config_* files of each partition and then of the built-in tables.
+// Rather than reading the files and trying every rule for every path, the
+// rules are compiled once into an image, which is searched instead.
+//
+// The image holds the rules in order, and keys sorted by name: the prefix of
+// each rule, without a trailing '*' for files, and again without a leading
+// "system/" that fs_config_cmp() may alias away.  Each key links to the
+// closest key before it that is a prefix of it, so that the keys form a tree
+// of prefixes.  Every rule that can match a path has a key that is a prefix
+// of the path, or of the path without "system/"; those keys are found by a
+// binary search for the last key not after that string, then by following
+// its links.  The first of their rules that fs_config_cmp() matches wins.
+//
+// The image is made of offsets, in host byte order, so that it can be written
+// out by fs_config_compile() and mapped back.
+
+static const uint32_t kImageMagic = 0x31494346;  // "FCI1"
+static const uint32_t kNoParent = UINT32_MAX;
+static const char kSystem[] = "system/";
+
+struct fs_config_image_header {
+    uint32_t magic;
+    uint32_t length;
+    uint32_t dir;
+    uint32_t rule_count;  // the last rule is the default one, and has no key
+    uint32_t rules_offset;
+    uint32_t key_count;
+    uint32_t keys_offset;
+    uint32_t reserved;
+};
 
-    if (path[0] == '/') {
-        path++;
+struct fs_config_image_rule {
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t prefix;  // offset of the nul-terminated prefix
+    uint32_t len;
+    uint32_t reserved;
+    uint64_t capabilities;
+};
+
+struct fs_config_image_key {
+    uint32_t name;  // offset of the first len bytes of a rule's prefix
+    uint32_t len;
+    uint32_t rule;
+    uint32_t parent;  // the closest earlier key that is a prefix of this one
+};
+
+struct compiled_rule {
+    const char* prefix;
+    size_t len;
+    unsigned mode;
+    unsigned uid;
+    unsigned gid;
+    uint64_t capabilities;
+};
+
+struct compiled_key {
+    const char* name;
+    size_t len;
+    uint32_t rule;
+};
+
+struct compile_state {
+    int dir;
+    compiled_rule* rules;
+    size_t rule_count;
+    size_t rule_capacity;
+    // The contents of the config files, which the rules point into.
+    char* files[sizeof(conf) / sizeof(conf[0])];
+};
+
+static bool add_rule(compile_state* state, const char* prefix, size_t len, unsigned mode,
+                     unsigned uid, unsigned gid, uint64_t capabilities) {
+    if (state->rule_count == state->rule_capacity) {
+        size_t capacity = state->rule_capacity ? state->rule_capacity * 2 : 64;
+        void* rules = realloc(state->rules, capacity * sizeof(*state->rules));
+        if (!rules) return false;
+        state->rules = static_cast<compiled_rule*>(rules);
+        state->rule_capacity = capacity;
     }
+    compiled_rule* rule = &state->rules[state->rule_count++];
+    rule->prefix = prefix;
+    rule->len = len;
+    rule->mode = mode;
+    rule->uid = uid;
+    rule->gid = gid;
+    rule->capabilities = capabilities;
+    return true;
+}
 
-    plen = strlen(path);
+static char* read_all(int fd, size_t* size) {
+    size_t capacity = 4096;
+    size_t used = 0;
+    char* data = static_cast<char*>(malloc(capacity));
+
+    while (data) {
+        if (used == capacity) {
+            capacity *= 2;
+            char* bigger = static_cast<char*>(realloc(data, capacity));
+            if (!bigger) break;
+            data = bigger;
+        }
+        ssize_t n = TEMP_FAILURE_RETRY(read(fd, data + used, capacity - used));
+        if (n < 0) break;
+        if (n == 0) {
+            *size = used;
+            return data;
+        }
+        used += n;
+    }
+    free(data);
+    return NULL;
+}
 
-    for (which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+// Adds the rules of one config file, up to the first corrupted one.
+static bool add_file_rules(compile_state* state, size_t which, const char* target_out_path) {
+    const char* name = conf[which][state->dir];
+    int fd = fs_config_open(state->dir, which, target_out_path);
+    if (fd < 0) return true;
+
+    size_t size;
+    char* data = read_all(fd, &size);
+    close(fd);
+    if (!data) {
+        ALOGE("%s could not be read", name);
+        return false;
+    }
+    state->files[which] = data;
+
+    size_t offset = 0;
+    while (size - offset >= sizeof(struct fs_path_config_from_file)) {
         struct fs_path_config_from_file header;
+        memcpy(&header, data + offset, sizeof(header));
+        uint16_t host_len = get2LE((const uint8_t*)&header.len);
+        ssize_t remainder = host_len - sizeof(header);
+        if (remainder <= 0) {
+            ALOGE("%s len is corrupted", name);
+            break;
+        }
+        if ((size_t)remainder > size - offset - sizeof(header)) {
+            ALOGE("%s prefix is truncated", name);
+            break;
+        }
+        const char* prefix = data + offset + sizeof(header);
+        size_t len = strnlen(prefix, remainder);
+        if (len >= (size_t)remainder) {  // missing a terminating null
+            ALOGE("%s is corrupted", name);
+            break;
+        }
+        if (!add_rule(state, prefix, len, get2LE((const uint8_t*)&(header.mode)),
+                      get2LE((const uint8_t*)&(header.uid)), get2LE((const uint8_t*)&(header.gid)),
+                      get8LE((const uint8_t*)&(header.capabilities)))) {
+            return false;
+        }
+        offset += host_len;
+    }
+    return true;
+}
 
-        int fd = fs_config_open(dir, which, target_out_path);
-        if (fd < 0) continue;
+static int compare_names(const char* a, size_t a_len, const char* b, size_t b_len) {
+    int result = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (result) return result;
+    return (a_len > b_len) - (a_len < b_len);
+}
 
-        while (TEMP_FAILURE_RETRY(read(fd, &header, sizeof(header))) == sizeof(header)) {
-            char* prefix;
-            uint16_t host_len = get2LE((const uint8_t*)&header.len);
-            ssize_t len, remainder = host_len - sizeof(header);
-            if (remainder <= 0) {
-                ALOGE("%s len is corrupted", conf[which][dir]);
-                break;
-            }
-            prefix = static_cast<char*>(calloc(1, remainder));
-            if (!prefix) {
-                ALOGE("%s out of memory", conf[which][dir]);
-                break;
-            }
-            if (TEMP_FAILURE_RETRY(read(fd, prefix, remainder)) != remainder) {
-                free(prefix);
-                ALOGE("%s prefix is truncated", conf[which][dir]);
-                break;
-            }
-            len = strnlen(prefix, remainder);
-            if (len >= remainder) {  // missing a terminating null
-                free(prefix);
-                ALOGE("%s is corrupted", conf[which][dir]);
-                break;
-            }
-            if (fs_config_cmp(dir, prefix, len, path, plen)) {
-                free(prefix);
-                close(fd);
-                *uid = get2LE((const uint8_t*)&(header.uid));
-                *gid = get2LE((const uint8_t*)&(header.gid));
-                *mode = (*mode & (~07777)) | get2LE((const uint8_t*)&(header.mode));
-                *capabilities = get8LE((const uint8_t*)&(header.capabilities));
-                return;
+static int compare_keys(const void* a, const void* b) {
+    const compiled_key* key_a = static_cast<const compiled_key*>(a);
+    const compiled_key* key_b = static_cast<const compiled_key*>(b);
+    int result = compare_names(key_a->name, key_a->len, key_b->name, key_b->len);
+    if (result) return result;
+    return (key_a->rule > key_b->rule) - (key_a->rule < key_b->rule);
+}
+
+static bool is_prefix(const compiled_key* a, const compiled_key* b) {
+    return a->len <= b->len && !memcmp(a->name, b->name, a->len);
+}
+
+// Compiles the rules for dir into a malloc'ed image, or returns NULL and
+// sets *error.
+static void* compile_image(int dir, const char* target_out_path, size_t* length, int* error) {
+    compile_state state;
+    memset(&state, 0, sizeof(state));
+    state.dir = dir;
+
+    compiled_key* keys = NULL;
+    uint32_t* stack = NULL;
+    uint8_t* image = NULL;
+    size_t key_count = 0;
+    size_t strings_length = 0;
+    size_t total;
+
+    *error = -ENOMEM;
+    for (size_t which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+        if (!add_file_rules(&state, which, target_out_path)) goto done;
+    }
+    for (const struct fs_path_config* pc = dir ? android_dirs : android_files;; pc++) {
+        const char* prefix = pc->prefix ? pc->prefix : "";
+        if (!add_rule(&state, prefix, strlen(prefix), pc->mode, pc->uid, pc->gid,
+                      pc->capabilities)) {
+            goto done;
+        }
+        if (!pc->prefix) break;
+    }
+
+    keys = static_cast<compiled_key*>(malloc(2 * state.rule_count * sizeof(*keys)));
+    stack = static_cast<uint32_t*>(malloc(2 * state.rule_count * sizeof(*stack)));
+    if (!keys || !stack) goto done;
+    for (size_t i = 0; i < state.rule_count; ++i) {
+        const compiled_rule* rule = &state.rules[i];
+        strings_length += rule->len + 1;
+        if (i == state.rule_count - 1) break;
+
+        size_t len = rule->len;
+        if (!dir && len && rule->prefix[len - 1] == '*') len--;
+        keys[key_count++] = {rule->prefix, len, (uint32_t)i};
+        if (len > strlen(kSystem) && !strncmp(rule->prefix, kSystem, strlen(kSystem))) {
+            keys[key_count++] = {rule->prefix + strlen(kSystem), len - strlen(kSystem),
+                                 (uint32_t)i};
+        }
+    }
+    qsort(keys, key_count, sizeof(*keys), compare_keys);
+
+    struct fs_config_image_header header;
+    header.magic = kImageMagic;
+    header.dir = dir;
+    header.rule_count = state.rule_count;
+    header.rules_offset = sizeof(header);
+    header.key_count = key_count;
+    header.keys_offset = header.rules_offset + state.rule_count * sizeof(fs_config_image_rule);
+    header.reserved = 0;
+    total = header.keys_offset + key_count * sizeof(fs_config_image_key) + strings_length;
+    if (total > UINT32_MAX) {
+        *error = -EFBIG;
+        goto done;
+    }
+    header.length = total;
+
+    image = static_cast<uint8_t*>(calloc(1, total));
+    if (!image) goto done;
+    memcpy(image, &header, sizeof(header));
+    {
+        fs_config_image_rule* rules =
+            reinterpret_cast<fs_config_image_rule*>(image + header.rules_offset);
+        size_t string = header.keys_offset + key_count * sizeof(fs_config_image_key);
+        for (size_t i = 0; i < state.rule_count; ++i) {
+            const compiled_rule* rule = &state.rules[i];
+            rules[i].mode = rule->mode;
+            rules[i].uid = rule->uid;
+            rules[i].gid = rule->gid;
+            rules[i].prefix = string;
+            rules[i].len = rule->len;
+            rules[i].capabilities = rule->capabilities;
+            memcpy(image + string, rule->prefix, rule->len);
+            string += rule->len + 1;
+        }
+
+        fs_config_image_key* image_keys =
+            reinterpret_cast<fs_config_image_key*>(image + header.keys_offset);
+        size_t depth = 0;
+        for (size_t i = 0; i < key_count; ++i) {
+            const compiled_key* key = &keys[i];
+            while (depth && !is_prefix(&keys[stack[depth - 1]], key)) depth--;
+            image_keys[i].name =
+                rules[key->rule].prefix + (key->name - state.rules[key->rule].prefix);
+            image_keys[i].len = key->len;
+            image_keys[i].rule = key->rule;
+            image_keys[i].parent = depth ? stack[depth - 1] : kNoParent;
+            stack[depth++] = i;
+        }
+    }
+    *length = total;
+    *error = 0;
+
+done:
+    for (size_t which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+        free(state.files[which]);
+    }
+    free(state.rules);
+    free(keys);
+    free(stack);
+    return image;
+}
+
+ssize_t fs_config_compile(int dir, const char* target_out_path, void* buffer, size_t length) {
+    size_t image_length;
+    int error;
+    void* image = compile_image(dir ? 1 : 0, target_out_path, &image_length, &error);
+    if (!image) return error;
+
+    if (image_length <= length) memcpy(buffer, image, image_length);
+    free(image);
+    return image_length;
+}
+
+// Checks what can be checked of an image without reading every entry; the
+// entries a lookup reads are checked as it goes.
+static const fs_config_image_header* check_image(const void* image, size_t length) {
+    const fs_config_image_header* header = static_cast<const fs_config_image_header*>(image);
+    if (length < sizeof(*header) || ((uintptr_t)image % sizeof(uint64_t))) return NULL;
+    if (header->magic != kImageMagic || header->length != length || header->dir > 1) return NULL;
+    if (!header->rule_count || (header->rules_offset % sizeof(uint64_t)) ||
+        (header->keys_offset % sizeof(uint32_t))) {
+        return NULL;
+    }
+    if ((uint64_t)header->rules_offset + (uint64_t)header->rule_count * sizeof(fs_config_image_rule) >
+            length ||
+        (uint64_t)header->keys_offset + (uint64_t)header->key_count * sizeof(fs_config_image_key) >
+            length) {
+        return NULL;
+    }
+    // Every string ends before the end of the image.
+    if (static_cast<const char*>(image)[length - 1]) return NULL;
+    return header;
+}
+
+static bool check_string(const fs_config_image_header* header, uint32_t offset, uint32_t len) {
+    return offset < header->length && len < header->length - offset;
+}
+
+// Lowers *best to the first rule matching path that has a key which is a
+// prefix of search.  Returns false if the image is corrupted.
+static bool find_first_rule(const fs_config_image_header* header, const char* path, size_t plen,
+                            const char* search, size_t slen, uint32_t* best) {
+    const char* base = reinterpret_cast<const char*>(header);
+    const fs_config_image_key* keys =
+        reinterpret_cast<const fs_config_image_key*>(base + header->keys_offset);
+    const fs_config_image_rule* rules =
+        reinterpret_cast<const fs_config_image_rule*>(base + header->rules_offset);
+
+    // The last key not after search; any key that is a prefix of search is
+    // also a prefix of it.
+    uint32_t low = 0;
+    uint32_t high = header->key_count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (!check_string(header, keys[mid].name, keys[mid].len)) return false;
+        if (compare_names(base + keys[mid].name, keys[mid].len, search, slen) <= 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0) return true;
+
+    uint32_t i = low - 1;
+    const char* name = base + keys[i].name;
+    size_t common = 0;
+    while (common < keys[i].len && common < slen && name[common] == search[common]) common++;
+
+    while (i != kNoParent) {
+        const fs_config_image_key* key = &keys[i];
+        if (key->rule >= header->rule_count - 1 || (key->parent != kNoParent && key->parent >= i)) {
+            return false;
+        }
+        if (key->len <= common && key->rule < *best) {
+            const fs_config_image_rule* rule = &rules[key->rule];
+            if (!check_string(header, rule->prefix, rule->len)) return false;
+            if (fs_config_cmp(header->dir, base + rule->prefix, rule->len, path, plen)) {
+                *best = key->rule;
             }
-            free(prefix);
         }
-        close(fd);
+        i = key->parent;
     }
+    return true;
+}
+
+int fs_config_lookup(const void* image, size_t length, const char* path, unsigned* uid,
+                     unsigned* gid, unsigned* mode, uint64_t* capabilities) {
+    const fs_config_image_header* header = check_image(image, length);
+    if (!header) return -EINVAL;
+
+    if (path[0] == '/') {
+        path++;
+    }
+    size_t plen = strlen(path);
+
+    uint32_t best = header->rule_count - 1;
+    if (!find_first_rule(header, path, plen, path, plen, &best)) return -EINVAL;
+    if (!strncmp(path, kSystem, strlen(kSystem)) &&
+        !find_first_rule(header, path, plen, path + strlen(kSystem), plen - strlen(kSystem),
+                         &best)) {
+        return -EINVAL;
+    }
+
+    const fs_config_image_rule* rule = reinterpret_cast<const fs_config_image_rule*>(
+                                           static_cast<const char*>(image) + header->rules_offset) +
+                                       best;
+    *uid = rule->uid;
+    *gid = rule->gid;
+    *mode = (*mode & (~07777)) | rule->mode;
+    *capabilities = rule->capabilities;
+    return 0;
+}
+
+// What a config file was when an image was compiled.
+struct fs_config_stamp {
+    bool present;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+};
+
+static void fs_config_get_stamp(int dir, int which, const char* target_out_path,
+                                fs_config_stamp* stamp) {
+    struct stat st;
+
+    // As fs_config_open() finds it.
+    char* name = fs_config_target_name(dir, which, target_out_path);
+    bool present = (name && !stat(name, &st)) || !stat(conf[which][dir], &st);
+    free(name);
+
+    memset(stamp, 0, sizeof(*stamp));
+    stamp->present = present;
+    if (present) {
+        stamp->dev = st.st_dev;
+        stamp->ino = st.st_ino;
+        stamp->size = st.st_size;
+        stamp->mtime = st.st_mtime;
+    }
+}
+
+static bool fs_config_same_stamp(const fs_config_stamp* a, const fs_config_stamp* b) {
+    return a->present == b->present && a->dev == b->dev && a->ino == b->ino &&
+           a->size == b->size && a->mtime == b->mtime;
+}
+
+// The image last compiled for directories or files, kept as long as the
+// config files it was compiled from do not change, guarded by cache_lock.
+struct fs_config_cache {
+    char* target_out_path;
+    fs_config_stamp stamps[sizeof(conf) / sizeof(conf[0])];
+    void* image;
+    size_t length;
+};
+
+static fs_config_cache caches[2];
+static mutex_t cache_lock = MUTEX_INITIALIZER;
+
+static fs_config_cache* get_cache(int dir, const char* target_out_path) {
+    fs_config_cache* cache = &caches[dir];
+    fs_config_stamp stamps[sizeof(conf) / sizeof(conf[0])];
+
+    if (target_out_path && !*target_out_path) target_out_path = NULL;
+    for (size_t which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+        fs_config_get_stamp(dir, which, target_out_path, &stamps[which]);
+    }
+
+    if (cache->image && !cache->target_out_path == !target_out_path &&
+        (!target_out_path || !strcmp(cache->target_out_path, target_out_path))) {
+        size_t which;
+        for (which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+            if (!fs_config_same_stamp(&cache->stamps[which], &stamps[which])) break;
+        }
+        if (which == (sizeof(conf) / sizeof(conf[0]))) return cache;
+    }
+
+    free(cache->image);
+    free(cache->target_out_path);
+    memset(cache, 0, sizeof(*cache));
+
+    int error;
+    char* target_copy = target_out_path ? strdup(target_out_path) : NULL;
+    if (target_out_path && !target_copy) return NULL;
+    cache->image = compile_image(dir, target_out_path, &cache->length, &error);
+    if (!cache->image) {
+        free(target_copy);
+        return NULL;
+    }
+    cache->target_out_path = target_copy;
+    memcpy(cache->stamps, stamps, sizeof(stamps));
+    return cache;
+}
+
+void fs_config(const char* path, int dir, const char* target_out_path, unsigned* uid, unsigned* gid,
+               unsigned* mode, uint64_t* capabilities) {
+    const struct fs_path_config* pc;
+    size_t plen;
+
+    dir = dir ? 1 : 0;
+    mutex_lock(&cache_lock);
+    fs_config_cache* cache = get_cache(dir, target_out_path);
+    if (cache && !fs_config_lookup(cache->image, cache->length, path, uid, gid, mode,
+                                   capabilities)) {
+        mutex_unlock(&cache_lock);
+        return;
+    }
+    mutex_unlock(&cache_lock);
+
+    // Out of memory for the image: fall back on the built-in rules alone.
+    if (path[0] == '/') {
+        path++;
+    }
+
+    plen = strlen(path);
 
     for (pc = dir ? android_dirs : android_files; pc->prefix; pc++) {
         if (fs_config_cmp(dir, pc->prefix, strlen(pc->prefix), path, plen)) {
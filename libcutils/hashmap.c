@@ -14,32 +14,177 @@
  * limitations under the License.
  */
 
+
 #include <cutils/hashmap.h>
 #include <assert.h>
 #include <errno.h>
 #include <cutils/threads.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <sys/types.h>
 
-typedef struct Entry Entry;
-struct Entry {
+/*
+ * Entries live directly in an array of slots, in the style of Abseil's
+ * SwissTable.  Beside the slots is an array of control bytes, one per slot,
+ * telling whether the slot is empty, holds a removed entry, or is full, and
+ * for a full slot holding 7 bits of its key's hash.  A lookup loads the
+ * control bytes of GROUP_SIZE slots at once as a word, from the slot the hash
+ * maps to, and only looks at the slots whose bits match; it moves on to
+ * another group only if this one has no empty slot, so at the load factors
+ * used nearly every lookup reads one group and calls equals() once at most.
+ *
+ * Removed entries leave a tombstone, unless no probe could have gone past
+ * their slot, so that entries never move while the table is in use; later
+ * insertions reuse them, and rebuilding the table drops them.
+ *
+ * An entry costs two words and a control byte, plus the free slots the load
+ * factor leaves, and no allocation of its own.
+ */
+typedef struct Slot Slot;
+struct Slot {
     void* key;
-    int hash;
     void* value;
-    Entry* next;
 };
 
+// A group of control bytes, loaded as one word.
+typedef uint64_t Group;
+#define GROUP_SIZE 8
+
+// The control byte of a full slot has the top bit clear.
+#define CONTROL_EMPTY ((uint8_t) 0x80)
+#define CONTROL_DELETED ((uint8_t) 0xfe)
+
+#define GROUP_LSBS 0x0101010101010101ULL
+#define GROUP_MSBS 0x8080808080808080ULL
+
 struct Hashmap {
-    Entry** buckets;
-    size_t bucketCount;
+    Slot* slots;
+    // slotCount + GROUP_SIZE bytes, the last GROUP_SIZE copying the first,
+    // so that a group can be loaded from any slot without wrapping around.
+    // Allocated along with the slots.
+    uint8_t* control;
+    size_t slotCount;
+    unsigned int shift;
+    // Empty slots that may still be filled before the table is rebuilt.
+    size_t growthLeft;
     int (*hash)(void* key);
     bool (*equals)(void* keyA, void* keyB);
-    mutex_t lock; 
+    mutex_t lock;
     size_t size;
 };
 
+#define MINIMUM_SLOT_COUNT GROUP_SIZE
+
+/**
+ * Returns the number of entries a table can hold before it is rebuilt, for
+ * the 0.75 load factor of the chained table.  A group of 8 slots is then full
+ * often enough at 0.875 that misses probe several groups.  At least one slot
+ * always stays empty, which stops probes.
+ */
+static inline size_t maximumSize(size_t slotCount) {
+    return slotCount * 3 / 4;
+}
+
+/**
+ * Returns the home slot of a hash.  The hash is multiplied by 2^32 / phi and
+ * the top bits picked, "shift" being 32 minus the log2 of the slot count, so
+ * that the home slot does not depend on the low 7 bits kept in the control
+ * byte.
+ */
+#ifdef __clang__
+__attribute__((no_sanitize("integer")))
+#endif
+static inline size_t calculateIndex(unsigned int shift, unsigned int hash) {
+    return ((uint32_t) hash * 0x9e3779b9u) >> shift;
+}
+
+static unsigned int calculateShift(size_t slotCount) {
+    unsigned int shift = 32;
+    while (((size_t) 1 << (32 - shift)) < slotCount) {
+        shift--;
+    }
+    return shift;
+}
+
+static inline uint8_t calculateTag(unsigned int hash) {
+    return hash & 0x7f;
+}
+
+static inline bool isFull(uint8_t control) {
+    return (control & CONTROL_EMPTY) == 0;
+}
+
+/**
+ * Loads the group of control bytes starting at the given one.  Byte i of
+ * the group is bits 8i to 8i + 7 of the word.
+ */
+static inline Group loadGroup(const uint8_t* control) {
+    Group group;
+    memcpy(&group, control, sizeof(group));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    group = __builtin_bswap64(group);
+#endif
+    return group;
+}
+
+/*
+ * The match functions return a mask with the top bit set of every byte of a
+ * group that matches.  matchTag() may also report a byte following a match,
+ * which the key comparison then rules out.
+ */
+
+#ifdef __clang__
+__attribute__((no_sanitize("integer")))
+#endif
+static inline Group matchTag(Group group, uint8_t tag) {
+    Group x = group ^ (GROUP_LSBS * tag);
+    return (x - GROUP_LSBS) & ~x & GROUP_MSBS;
+}
+
+#ifdef __clang__
+__attribute__((no_sanitize("integer")))
+#endif
+static inline Group matchEmpty(Group group) {
+    // Only CONTROL_EMPTY has its top bit set and bit 1 clear.
+    return group & ~(group << 6) & GROUP_MSBS;
+}
+
+static inline Group matchEmptyOrDeleted(Group group) {
+    return group & GROUP_MSBS;
+}
+
+// Returns the byte of the lowest match in a mask.
+static inline size_t firstMatch(Group matches) {
+    return __builtin_ctzll(matches) >> 3;
+}
+
+static inline void setControl(Hashmap* map, size_t index, uint8_t control) {
+    map->control[index] = control;
+    if (index < GROUP_SIZE) {
+        map->control[map->slotCount + index] = control;
+    }
+}
+
+/**
+ * Gives map an empty table of slotCount slots.  Returns false, leaving map
+ * unchanged, if it could not be allocated.
+ */
+static bool allocateSlots(Hashmap* map, size_t slotCount) {
+    Slot* slots = malloc(slotCount * sizeof(Slot) + slotCount + GROUP_SIZE);
+    if (slots == NULL) {
+        return false;
+    }
+    map->slots = slots;
+    map->control = (uint8_t*) (slots + slotCount);
+    memset(map->control, CONTROL_EMPTY, slotCount + GROUP_SIZE);
+    map->slotCount = slotCount;
+    map->shift = calculateShift(slotCount);
+    map->growthLeft = maximumSize(slotCount);
+    return true;
+}
+
 Hashmap* hashmapCreate(size_t initialCapacity,
         int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
     assert(hash != NULL);
@@ -50,16 +195,13 @@ Hashmap* hashmapCreate(size_t initialCapacity,
         return NULL;
     }
     
-    // 0.75 load factor.
-    size_t minimumBucketCount = initialCapacity * 4 / 3;
-    map->bucketCount = 1;
-    while (map->bucketCount <= minimumBucketCount) {
-        // Bucket count must be power of 2.
-        map->bucketCount <<= 1; 
+    size_t slotCount = MINIMUM_SLOT_COUNT;
+    while (maximumSize(slotCount) < initialCapacity) {
+        // Slot count must be power of 2.
+        slotCount <<= 1;
     }
 
-    map->buckets = calloc(map->bucketCount, sizeof(Entry*));
-    if (map->buckets == NULL) {
+    if (!allocateSlots(map, slotCount)) {
         free(map);
         return NULL;
     }
@@ -80,7 +222,7 @@ Hashmap* hashmapCreate(size_t initialCapacity,
 #ifdef __clang__
 __attribute__((no_sanitize("integer")))
 #endif
-static inline int hashKey(Hashmap* map, void* key) {
+static inline unsigned int hashKey(Hashmap* map, void* key) {
     int h = map->hash(key);
 
     // We apply this secondary hashing discovered by Doug Lea to defend
@@ -90,46 +232,114 @@ static inline int hashKey(Hashmap* map, void* key) {
     h += (h << 4);
     h ^= (((unsigned int) h) >> 10);
        
-    return h;
+    return (unsigned int) h;
 }
 
 size_t hashmapSize(Hashmap* map) {
     return map->size;
 }
 
-static inline size_t calculateIndex(size_t bucketCount, int hash) {
-    return ((size_t) hash) & (bucketCount - 1);
+/**
+ * Returns the slot holding the given key, or NULL if there is none.
+ */
+static Slot* findSlot(Hashmap* map, void* key, unsigned int hash) {
+    size_t mask = map->slotCount - 1;
+    size_t position = calculateIndex(map->shift, hash);
+    uint8_t tag = calculateTag(hash);
+    size_t step = 0;
+    while (true) {
+        Group group = loadGroup(&map->control[position]);
+        Group matches = matchTag(group, tag);
+        while (matches != 0) {
+            Slot* slot = &map->slots[(position + firstMatch(matches)) & mask];
+            if (slot->key == key || map->equals(slot->key, key)) {
+                return slot;
+            }
+            matches &= matches - 1;
+        }
+        // The key would have been put in an empty slot of this group.
+        if (matchEmpty(group) != 0) {
+            return NULL;
+        }
+        // Visits every group, the slot count being a power of 2.
+        step += GROUP_SIZE;
+        position = (position + step) & mask;
+    }
 }
 
-static void expandIfNecessary(Hashmap* map) {
-    // If the load factor exceeds 0.75...
-    if (map->size > (map->bucketCount * 3 / 4)) {
-        // Start off with a 0.33 load factor.
-        size_t newBucketCount = map->bucketCount << 1;
-        Entry** newBuckets = calloc(newBucketCount, sizeof(Entry*));
-        if (newBuckets == NULL) {
-            // Abort expansion.
-            return;
+/**
+ * Returns the index of the first empty or deleted slot on the probe sequence
+ * of a hash.
+ */
+static size_t findFreeSlot(Hashmap* map, unsigned int hash) {
+    size_t mask = map->slotCount - 1;
+    size_t position = calculateIndex(map->shift, hash);
+    size_t step = 0;
+    while (true) {
+        Group matches = matchEmptyOrDeleted(loadGroup(&map->control[position]));
+        if (matches != 0) {
+            return (position + firstMatch(matches)) & mask;
         }
-        
-        // Move over existing entries.
-        size_t i;
-        for (i = 0; i < map->bucketCount; i++) {
-            Entry* entry = map->buckets[i];
-            while (entry != NULL) {
-                Entry* next = entry->next;
-                size_t index = calculateIndex(newBucketCount, entry->hash);
-                entry->next = newBuckets[index];
-                newBuckets[index] = entry;
-                entry = next;
-            }
+        step += GROUP_SIZE;
+        position = (position + step) & mask;
+    }
+}
+
+static void fillSlot(Hashmap* map, size_t index, void* key, unsigned int hash,
+        void* value) {
+    if (map->control[index] == CONTROL_EMPTY) {
+        map->growthLeft--;
+    }
+    setControl(map, index, calculateTag(hash));
+    map->slots[index].key = key;
+    map->slots[index].value = value;
+}
+
+/**
+ * Moves the entries to a new table of slotCount slots, dropping tombstones.
+ * Returns false, leaving the table unchanged, if it could not be allocated.
+ */
+static bool rebuild(Hashmap* map, size_t slotCount) {
+    Slot* oldSlots = map->slots;
+    uint8_t* oldControl = map->control;
+    size_t oldSlotCount = map->slotCount;
+    if (!allocateSlots(map, slotCount)) {
+        return false;
+    }
+
+    size_t i;
+    for (i = 0; i < oldSlotCount; i++) {
+        if (isFull(oldControl[i])) {
+            Slot* slot = &oldSlots[i];
+            unsigned int hash = hashKey(map, slot->key);
+            fillSlot(map, findFreeSlot(map, hash), slot->key, hash, slot->value);
         }
+    }
+
+    free(oldSlots);
+    return true;
+}
 
-        // Copy over internals.
-        free(map->buckets);
-        map->buckets = newBuckets;
-        map->bucketCount = newBucketCount;
+/**
+ * Returns in *index the slot to put a key known not to be in the table in.
+ * Rebuilds the table first if the key would take an empty slot past the
+ * load factor: at the same size if dropping the tombstones leaves room for
+ * an eighth of the slots, so that rebuilds stay rare, else doubled.  Returns
+ * false if the table could not be rebuilt.
+ */
+static bool prepareInsert(Hashmap* map, unsigned int hash, size_t* index) {
+    *index = findFreeSlot(map, hash);
+    if (map->growthLeft == 0 && map->control[*index] == CONTROL_EMPTY) {
+        size_t slotCount = map->slotCount;
+        if (map->size + slotCount / 8 > maximumSize(slotCount)) {
+            slotCount <<= 1;
+        }
+        if (!rebuild(map, slotCount)) {
+            return false;
+        }
+        *index = findFreeSlot(map, hash);
     }
+    return true;
 }
 
 void hashmapLock(Hashmap* map) {
@@ -141,16 +351,7 @@ void hashmapUnlock(Hashmap* map) {
 }
 
 void hashmapFree(Hashmap* map) {
-    size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry* next = entry->next;
-            free(entry);
-            entry = next;
-        }
-    }
-    free(map->buckets);
+    free(map->slots);
     mutex_destroy(&map->lock);
     free(map);
 }
@@ -170,177 +371,116 @@ int hashmapHash(void* key, size_t keySize) {
     return h;
 }
 
-static Entry* createEntry(void* key, int hash, void* value) {
-    Entry* entry = malloc(sizeof(Entry));
-    if (entry == NULL) {
-        return NULL;
-    }
-    entry->key = key;
-    entry->hash = hash;
-    entry->value = value;
-    entry->next = NULL;
-    return entry;
-}
-
-static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
-        bool (*equals)(void*, void*)) {
-    if (keyA == keyB) {
-        return true;
-    }
-    if (hashA != hashB) {
-        return false;
-    }
-    return equals(keyA, keyB);
-}
-
 void* hashmapPut(Hashmap* map, void* key, void* value) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry** p = &(map->buckets[index]);
-    while (true) {
-        Entry* current = *p;
-
-        // Add a new entry.
-        if (current == NULL) {
-            *p = createEntry(key, hash, value);
-            if (*p == NULL) {
-                errno = ENOMEM;
-                return NULL;
-            }
-            map->size++;
-            expandIfNecessary(map);
-            return NULL;
-        }
-
-        // Replace existing entry.
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* oldValue = current->value;
-            current->value = value;
-            return oldValue;
-        }
+    unsigned int hash = hashKey(map, key);
+
+    // Replace existing entry.
+    Slot* slot = findSlot(map, key, hash);
+    if (slot != NULL) {
+        void* oldValue = slot->value;
+        slot->value = value;
+        return oldValue;
+    }
 
-        // Move to next entry.
-        p = &current->next;
+    // Add a new entry.
+    size_t index;
+    if (!prepareInsert(map, hash, &index)) {
+        errno = ENOMEM;
+        return NULL;
     }
+    fillSlot(map, index, key, hash, value);
+    map->size++;
+    return NULL;
 }
 
 void* hashmapGet(Hashmap* map, void* key) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry* entry = map->buckets[index];
-    while (entry != NULL) {
-        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
-            return entry->value;
-        }
-        entry = entry->next;
-    }
-
-    return NULL;
+    Slot* slot = findSlot(map, key, hashKey(map, key));
+    return slot != NULL ? slot->value : NULL;
 }
 
 bool hashmapContainsKey(Hashmap* map, void* key) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry* entry = map->buckets[index];
-    while (entry != NULL) {
-        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
-            return true;
-        }
-        entry = entry->next;
-    }
-
-    return false;
+    return findSlot(map, key, hashKey(map, key)) != NULL;
 }
 
 void* hashmapMemoize(Hashmap* map, void* key, 
         void* (*initialValue)(void* key, void* context), void* context) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
+    unsigned int hash = hashKey(map, key);
 
-    Entry** p = &(map->buckets[index]);
-    while (true) {
-        Entry* current = *p;
-
-        // Add a new entry.
-        if (current == NULL) {
-            *p = createEntry(key, hash, NULL);
-            if (*p == NULL) {
-                errno = ENOMEM;
-                return NULL;
-            }
-            void* value = initialValue(key, context);
-            (*p)->value = value;
-            map->size++;
-            expandIfNecessary(map);
-            return value;
-        }
-
-        // Return existing value.
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            return current->value;
-        }
+    // Return existing value.
+    Slot* slot = findSlot(map, key, hash);
+    if (slot != NULL) {
+        return slot->value;
+    }
 
-        // Move to next entry.
-        p = &current->next;
+    // Add a new entry, before calling the callback as the chained table did.
+    size_t index;
+    if (!prepareInsert(map, hash, &index)) {
+        errno = ENOMEM;
+        return NULL;
     }
+    fillSlot(map, index, key, hash, NULL);
+    map->size++;
+    void* value = initialValue(key, context);
+    // The callback may have changed the table.
+    slot = findSlot(map, key, hash);
+    if (slot != NULL) {
+        slot->value = value;
+    }
+    return value;
 }
 
 void* hashmapRemove(Hashmap* map, void* key) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    // Pointer to the current entry.
-    Entry** p = &(map->buckets[index]);
-    Entry* current;
-    while ((current = *p) != NULL) {
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* value = current->value;
-            *p = current->next;
-            free(current);
-            map->size--;
-            return value;
-        }
-
-        p = &current->next;
+    Slot* slot = findSlot(map, key, hashKey(map, key));
+    if (slot == NULL) {
+        return NULL;
     }
-
-    return NULL;
+    void* value = slot->value;
+
+    // No probe can have gone past the slot if every group holding it has an
+    // empty slot, so it can be emptied rather than left as a tombstone.
+    size_t index = slot - map->slots;
+    size_t mask = map->slotCount - 1;
+    Group emptyBefore = matchEmpty(loadGroup(
+            &map->control[(index + map->slotCount - GROUP_SIZE) & mask]));
+    Group emptyAfter = matchEmpty(loadGroup(&map->control[index]));
+    if (emptyBefore != 0 && emptyAfter != 0 &&
+            (__builtin_clzll(emptyBefore) >> 3) + firstMatch(emptyAfter) < GROUP_SIZE) {
+        setControl(map, index, CONTROL_EMPTY);
+        map->growthLeft++;
+    } else {
+        setControl(map, index, CONTROL_DELETED);
+    }
+    map->size--;
+    return value;
 }
 
 void hashmapForEach(Hashmap* map, 
         bool (*callback)(void* key, void* value, void* context),
         void* context) {
+    // Entries do not move when the callback removes one.
     size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry *next = entry->next;
-            if (!callback(entry->key, entry->value, context)) {
+    for (i = 0; i < map->slotCount; i++) {
+        if (isFull(map->control[i])) {
+            Slot* slot = &map->slots[i];
+            if (!callback(slot->key, slot->value, context)) {
                 return;
             }
-            entry = next;
         }
     }
 }
 
 size_t hashmapCurrentCapacity(Hashmap* map) {
-    size_t bucketCount = map->bucketCount;
-    return bucketCount * 3 / 4;
+    return maximumSize(map->slotCount);
 }
 
 size_t hashmapCountCollisions(Hashmap* map) {
+    // Entries that could not be placed in their home slot.
     size_t collisions = 0;
     size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            if (entry->next != NULL) {
-                collisions++;
-            }
-            entry = entry->next;
+    for (i = 0; i < map->slotCount; i++) {
+        if (isFull(map->control[i]) &&
+                calculateIndex(map->shift, hashKey(map, map->slots[i].key)) != i) {
+            collisions++;
         }
     }
     return collisions;
@@ -27,6 +27,13 @@ int ashmem_pin_region(int fd, size_t offset, size_t len);
 int ashmem_unpin_region(int fd, size_t offset, size_t len);
 int ashmem_get_size_region(int fd);
 
+/*
+ * Closes a region, or keeps it for a later ashmem_create_region() of the same
+ * name and size, which gets it back zeroed.  Only pass regions that were never
+ * shared with another process, and that are no longer mapped.
+ */
+int ashmem_recycle_region(int fd);
+
 #ifdef __cplusplus
 }
 #endif
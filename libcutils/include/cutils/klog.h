@@ -29,6 +29,17 @@ void klog_write(int level, const char *fmt, ...)
     __attribute__ ((format(printf, 2, 3)));
 void klog_writev(int level, const struct iovec* iov, int iov_count);
 
+/*
+ * Holds messages back and writes those with the same "<level>" prefix
+ * together, in order, so that a burst of messages costs one write.  A batch
+ * is written by klog_flush(), or by the first message logged window_ms or
+ * more after it started; its messages all get the kernel timestamp of that
+ * write.  A window_ms of 0 writes what is held back and stops buffering.
+ * What is held back is written at exit(), but not on exec.
+ */
+void klog_set_buffered(int window_ms);
+void klog_flush(void);
+
 __END_DECLS
 
 #define KLOG_ERROR_LEVEL   3
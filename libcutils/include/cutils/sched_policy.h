@@ -63,6 +63,14 @@ extern int set_cpuset_policy(int tid, SchedPolicy policy);
  */
 extern int set_sched_policy(int tid, SchedPolicy policy);
 
+/* Like set_cpuset_policy() and set_sched_policy(), but for every thread of the thread group
+ * tgid. Each cgroup is updated for the whole group with a single write where the kernel allows
+ * it, instead of one write per thread. Zero tgid means the current process.
+ * Return value: 0 for success, or -errno for error.
+ */
+extern int set_cpuset_policy_tgid(int tgid, SchedPolicy policy);
+extern int set_sched_policy_tgid(int tgid, SchedPolicy policy);
+
 /* Return the policy associated with the cgroup of thread tid via policy pointer.
  * On platforms which support gettid(), zero tid means current thread.
  * Return value: 0 for success, or -1 for error and set errno.
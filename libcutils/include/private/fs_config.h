@@ -75,6 +75,22 @@ void fs_config(const char* path, int dir, const char* target_out_path, unsigned*
 
 ssize_t fs_config_generate(char* buffer, size_t length, const struct fs_path_config* pc);
 
+/*
+ * Compiles the rules fs_config() applies to directories or files into an
+ * image that fs_config_lookup() searches in O(log n), and that may be written
+ * to a file and mapped back on the same host.  Returns the size of the image,
+ * which is only written if it fits in length bytes, or -ENOMEM or -EFBIG.
+ */
+ssize_t fs_config_compile(int dir, const char* target_out_path, void* buffer, size_t length);
+
+/*
+ * Does what fs_config() does, with the rules of an image made by
+ * fs_config_compile(), which must be 8 byte aligned.  Returns 0, or -EINVAL
+ * if the image is corrupted.
+ */
+int fs_config_lookup(const void* image, size_t length, const char* path, unsigned* uid,
+                     unsigned* gid, unsigned* mode, uint64_t* capabilities);
+
 __END_DECLS
 
 #endif /* _LIBS_CUTILS_PRIVATE_FS_CONFIG_H */
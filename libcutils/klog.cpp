@@ -16,14 +16,18 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #include <cutils/android_get_control_file.h>
 #include <cutils/klog.h>
 
@@ -43,12 +47,119 @@ static int __open_klog(void) {
 
 #define LOG_BUF_MAX 512
 
+// The longest record /dev/kmsg takes in one write.
+#define KLOG_RECORD_MAX 976
+
+static int klog_fd() {
+    static int fd = __open_klog();
+    return fd;
+}
+
+// While buffering, messages are appended to klog_buffer, one per line, and
+// written as a single record, which dmesg still shows as separate lines.
+// The kernel only parses the "<level>" prefix of a record's first line, so
+// only messages with the same prefix share a record, and the prefix is
+// dropped from all but the first.  Guarded by klog_lock.
+static std::atomic<int64_t> klog_window_ns(0);
+static pthread_mutex_t klog_lock = PTHREAD_MUTEX_INITIALIZER;
+static char klog_buffer[KLOG_RECORD_MAX];
+static size_t klog_buffered;
+static size_t klog_prefix_len;
+static int64_t klog_first_ns;
+
+static int64_t klog_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Returns the length of a leading "<level>", or 0.
+static size_t klog_prefix(const char* msg, size_t len) {
+    if (len == 0 || msg[0] != '<') return 0;
+    for (size_t i = 1; i < len && i < 8; ++i) {
+        if (msg[i] == '>') return i > 1 ? i + 1 : 0;
+        if (msg[i] < '0' || msg[i] > '9') return 0;
+    }
+    return 0;
+}
+
+static void klog_flush_locked() {
+    if (klog_buffered == 0) return;
+    TEMP_FAILURE_RETRY(write(klog_fd(), klog_buffer, klog_buffered));
+    klog_buffered = 0;
+}
+
+static void klog_buffer_locked(const char* msg, size_t len, int64_t window_ns) {
+    size_t prefix_len = klog_prefix(msg, len);
+    int64_t now = klog_now_ns();
+
+    if (klog_buffered != 0) {
+        bool separate = klog_buffer[klog_buffered - 1] != '\n';
+        if (now - klog_first_ns >= window_ns || prefix_len != klog_prefix_len ||
+            memcmp(klog_buffer, msg, prefix_len) ||
+            klog_buffered + separate + len - prefix_len > sizeof(klog_buffer)) {
+            klog_flush_locked();
+        } else {
+            if (separate) klog_buffer[klog_buffered++] = '\n';
+            memcpy(klog_buffer + klog_buffered, msg + prefix_len, len - prefix_len);
+            klog_buffered += len - prefix_len;
+            return;
+        }
+    }
+
+    if (len > sizeof(klog_buffer)) {
+        TEMP_FAILURE_RETRY(write(klog_fd(), msg, len));
+        return;
+    }
+    memcpy(klog_buffer, msg, len);
+    klog_buffered = len;
+    klog_prefix_len = prefix_len;
+    klog_first_ns = now;
+}
+
+void klog_set_buffered(int window_ms) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, [] { atexit(klog_flush); });
+
+    pthread_mutex_lock(&klog_lock);
+    if (window_ms <= 0) klog_flush_locked();
+    klog_window_ns = window_ms > 0 ? window_ms * 1000000LL : 0;
+    pthread_mutex_unlock(&klog_lock);
+}
+
+void klog_flush(void) {
+    pthread_mutex_lock(&klog_lock);
+    klog_flush_locked();
+    pthread_mutex_unlock(&klog_lock);
+}
+
 void klog_writev(int level, const struct iovec* iov, int iov_count) {
     if (level > klog_level) return;
 
-    static int klog_fd = __open_klog();
-    if (klog_fd == -1) return;
-    TEMP_FAILURE_RETRY(writev(klog_fd, iov, iov_count));
+    if (klog_fd() == -1) return;
+
+    int64_t window_ns = klog_window_ns;
+    if (window_ns != 0) {
+        char msg[KLOG_RECORD_MAX];
+        size_t len = 0;
+        int i;
+        for (i = 0; i < iov_count && iov[i].iov_len <= sizeof(msg) - len; ++i) {
+            memcpy(msg + len, iov[i].iov_base, iov[i].iov_len);
+            len += iov[i].iov_len;
+        }
+        pthread_mutex_lock(&klog_lock);
+        if (i == iov_count) {
+            klog_buffer_locked(msg, len, window_ns);
+            pthread_mutex_unlock(&klog_lock);
+            return;
+        }
+        // Too long to buffer; write it after what came before it.
+        klog_flush_locked();
+        TEMP_FAILURE_RETRY(writev(klog_fd(), iov, iov_count));
+        pthread_mutex_unlock(&klog_lock);
+        return;
+    }
+    TEMP_FAILURE_RETRY(writev(klog_fd(), iov, iov_count));
 }
 
 void klog_write(int level, const char* fmt, ...) {
@@ -16,6 +16,7 @@
 
 #define LOG_TAG "SchedPolicy"
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -65,6 +66,17 @@ static int fg_schedboost_fd = -1;
 static int ta_schedboost_fd = -1;
 static int rt_schedboost_fd = -1;
 
+// File descriptors open to the cgroup.procs files of the same cgroups, which move every thread
+// of a thread group with one write, or -1 on error
+static int system_bg_cpuset_procs_fd = -1;
+static int bg_cpuset_procs_fd = -1;
+static int fg_cpuset_procs_fd = -1;
+static int ta_cpuset_procs_fd = -1;
+static int bg_schedboost_procs_fd = -1;
+static int fg_schedboost_procs_fd = -1;
+static int ta_schedboost_procs_fd = -1;
+static int rt_schedboost_procs_fd = -1;
+
 /* Add tid to the scheduling group defined by the policy */
 static int add_tid_to_cgroup(int tid, int fd)
 {
@@ -100,6 +112,43 @@ static int add_tid_to_cgroup(int tid, int fd)
     return 0;
 }
 
+/* Add every thread of thread group tgid to the scheduling group defined by the policy.
+ * procs_fd is open to the group's cgroup.procs and tasks_fd to its tasks; if the former can't
+ * be used, the threads are added one at a time.
+ */
+static int add_tgid_to_cgroup(int tgid, int procs_fd, int tasks_fd)
+{
+    if (procs_fd >= 0) {
+        char text[22];
+        int len = snprintf(text, sizeof(text), "%d", tgid);
+        if (write(procs_fd, text, len) == len || errno == ESRCH) {
+            return 0;
+        }
+        SLOGW("add_tgid_to_cgroup failed to write '%s' (%s); fd=%d\n",
+              text, strerror(errno), procs_fd);
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", tgid);
+    DIR* d = opendir(path);
+    if (d == NULL) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    int ret = 0;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        int tid = atoi(de->d_name);
+        if (tid > 0 && add_tid_to_cgroup(tid, tasks_fd) != 0) {
+            ret = -1;
+            break;
+        }
+    }
+    int saved_errno = errno;
+    closedir(d);
+    errno = saved_errno;
+    return ret;
+}
+
 /*
     If CONFIG_CPUSETS for Linux kernel is set, "tasks" can be found under
     /dev/cpuset mounted in init.rc; otherwise, that file does not exist
@@ -153,6 +202,12 @@ static void __initialize() {
             filename = "/dev/cpuset/top-app/tasks";
             ta_cpuset_fd = open(filename, O_WRONLY | O_CLOEXEC);
 
+            fg_cpuset_procs_fd = open("/dev/cpuset/foreground/cgroup.procs", O_WRONLY | O_CLOEXEC);
+            bg_cpuset_procs_fd = open("/dev/cpuset/background/cgroup.procs", O_WRONLY | O_CLOEXEC);
+            system_bg_cpuset_procs_fd =
+                    open("/dev/cpuset/system-background/cgroup.procs", O_WRONLY | O_CLOEXEC);
+            ta_cpuset_procs_fd = open("/dev/cpuset/top-app/cgroup.procs", O_WRONLY | O_CLOEXEC);
+
             if (schedboost_enabled()) {
                 filename = "/dev/stune/top-app/tasks";
                 ta_schedboost_fd = open(filename, O_WRONLY | O_CLOEXEC);
@@ -162,6 +217,14 @@ static void __initialize() {
                 bg_schedboost_fd = open(filename, O_WRONLY | O_CLOEXEC);
                 filename = "/dev/stune/rt/tasks";
                 rt_schedboost_fd = open(filename, O_WRONLY | O_CLOEXEC);
+
+                ta_schedboost_procs_fd =
+                        open("/dev/stune/top-app/cgroup.procs", O_WRONLY | O_CLOEXEC);
+                fg_schedboost_procs_fd =
+                        open("/dev/stune/foreground/cgroup.procs", O_WRONLY | O_CLOEXEC);
+                bg_schedboost_procs_fd =
+                        open("/dev/stune/background/cgroup.procs", O_WRONLY | O_CLOEXEC);
+                rt_schedboost_procs_fd = open("/dev/stune/rt/cgroup.procs", O_WRONLY | O_CLOEXEC);
             }
         }
     }
@@ -276,43 +339,52 @@ int get_sched_policy(int tid, SchedPolicy *policy)
     return 0;
 }
 
-int set_cpuset_policy(int tid, SchedPolicy policy)
+/* Look up the cpuset and schedtune cgroups of the policy, as the descriptors of their tasks
+ * files, or of their cgroup.procs files if procs is set.
+ */
+static void get_cpuset_fds(SchedPolicy policy, bool procs, int* fd, int* boost_fd)
 {
-    // in the absence of cpusets, use the old sched policy
-    if (!cpusets_enabled()) {
-        return set_sched_policy(tid, policy);
-    }
-
-    if (tid == 0) {
-        tid = gettid();
-    }
-    policy = _policy(policy);
-    pthread_once(&the_once, __initialize);
-
-    int fd = -1;
-    int boost_fd = -1;
     switch (policy) {
     case SP_BACKGROUND:
-        fd = bg_cpuset_fd;
-        boost_fd = bg_schedboost_fd;
+        *fd = procs ? bg_cpuset_procs_fd : bg_cpuset_fd;
+        *boost_fd = procs ? bg_schedboost_procs_fd : bg_schedboost_fd;
         break;
     case SP_FOREGROUND:
     case SP_AUDIO_APP:
     case SP_AUDIO_SYS:
-        fd = fg_cpuset_fd;
-        boost_fd = fg_schedboost_fd;
+        *fd = procs ? fg_cpuset_procs_fd : fg_cpuset_fd;
+        *boost_fd = procs ? fg_schedboost_procs_fd : fg_schedboost_fd;
         break;
     case SP_TOP_APP :
-        fd = ta_cpuset_fd;
-        boost_fd = ta_schedboost_fd;
+        *fd = procs ? ta_cpuset_procs_fd : ta_cpuset_fd;
+        *boost_fd = procs ? ta_schedboost_procs_fd : ta_schedboost_fd;
         break;
     case SP_SYSTEM:
-        fd = system_bg_cpuset_fd;
+        *fd = procs ? system_bg_cpuset_procs_fd : system_bg_cpuset_fd;
+        *boost_fd = -1;
         break;
     default:
-        boost_fd = fd = -1;
+        *boost_fd = *fd = -1;
         break;
     }
+}
+
+int set_cpuset_policy(int tid, SchedPolicy policy)
+{
+    // in the absence of cpusets, use the old sched policy
+    if (!cpusets_enabled()) {
+        return set_sched_policy(tid, policy);
+    }
+
+    if (tid == 0) {
+        tid = gettid();
+    }
+    policy = _policy(policy);
+    pthread_once(&the_once, __initialize);
+
+    int fd;
+    int boost_fd;
+    get_cpuset_fds(policy, false, &fd, &boost_fd);
 
     if (add_tid_to_cgroup(tid, fd) != 0) {
         if (errno != ESRCH && errno != ENOENT)
@@ -329,6 +401,40 @@ int set_cpuset_policy(int tid, SchedPolicy policy)
     return 0;
 }
 
+int set_cpuset_policy_tgid(int tgid, SchedPolicy policy)
+{
+    if (!cpusets_enabled()) {
+        return set_sched_policy_tgid(tgid, policy);
+    }
+
+    if (tgid == 0) {
+        tgid = getpid();
+    }
+    policy = _policy(policy);
+    pthread_once(&the_once, __initialize);
+
+    int fd;
+    int boost_fd;
+    int procs_fd;
+    int boost_procs_fd;
+    get_cpuset_fds(policy, false, &fd, &boost_fd);
+    get_cpuset_fds(policy, true, &procs_fd, &boost_procs_fd);
+
+    if (add_tgid_to_cgroup(tgid, procs_fd, fd) != 0) {
+        if (errno != ESRCH && errno != ENOENT)
+            return -errno;
+    }
+
+    if (schedboost_enabled() && boost_fd > 0) {
+        if (add_tgid_to_cgroup(tgid, boost_procs_fd, boost_fd) != 0) {
+            if (errno != ESRCH && errno != ENOENT)
+                return -errno;
+        }
+    }
+
+    return 0;
+}
+
 static void set_timerslack_ns(int tid, unsigned long slack) {
     // v4.6+ kernels support the /proc/<tid>/timerslack_ns interface.
     // TODO: once we've backported this, log if the open(2) fails.
@@ -354,6 +460,27 @@ static void set_timerslack_ns(int tid, unsigned long slack) {
     }
 }
 
+/* Look up the schedtune cgroup of the policy, as the descriptor of its tasks file, or of its
+ * cgroup.procs file if procs is set.
+ */
+static int get_schedboost_fd(SchedPolicy policy, bool procs)
+{
+    switch (policy) {
+    case SP_BACKGROUND:
+        return procs ? bg_schedboost_procs_fd : bg_schedboost_fd;
+    case SP_FOREGROUND:
+    case SP_AUDIO_APP:
+    case SP_AUDIO_SYS:
+        return procs ? fg_schedboost_procs_fd : fg_schedboost_fd;
+    case SP_TOP_APP:
+        return procs ? ta_schedboost_procs_fd : ta_schedboost_fd;
+    case SP_RT_APP:
+        return procs ? rt_schedboost_procs_fd : rt_schedboost_fd;
+    default:
+        return -1;
+    }
+}
+
 int set_sched_policy(int tid, SchedPolicy policy)
 {
     if (tid == 0) {
@@ -407,27 +534,7 @@ int set_sched_policy(int tid, SchedPolicy policy)
 #endif
 
     if (schedboost_enabled()) {
-        int boost_fd = -1;
-        switch (policy) {
-        case SP_BACKGROUND:
-            boost_fd = bg_schedboost_fd;
-            break;
-        case SP_FOREGROUND:
-        case SP_AUDIO_APP:
-        case SP_AUDIO_SYS:
-            boost_fd = fg_schedboost_fd;
-            break;
-        case SP_TOP_APP:
-            boost_fd = ta_schedboost_fd;
-            break;
-        case SP_RT_APP:
-	    boost_fd = rt_schedboost_fd;
-	    break;
-        default:
-            boost_fd = -1;
-            break;
-        }
-
+        int boost_fd = get_schedboost_fd(policy, false);
         if (boost_fd > 0 && add_tid_to_cgroup(tid, boost_fd) != 0) {
             if (errno != ESRCH && errno != ENOENT)
                 return -errno;
@@ -440,6 +547,41 @@ int set_sched_policy(int tid, SchedPolicy policy)
     return 0;
 }
 
+int set_sched_policy_tgid(int tgid, SchedPolicy policy)
+{
+    if (tgid == 0) {
+        tgid = getpid();
+    }
+    policy = _policy(policy);
+    pthread_once(&the_once, __initialize);
+
+    if (schedboost_enabled()) {
+        int boost_fd = get_schedboost_fd(policy, false);
+        if (boost_fd > 0 &&
+            add_tgid_to_cgroup(tgid, get_schedboost_fd(policy, true), boost_fd) != 0) {
+            if (errno != ESRCH && errno != ENOENT)
+                return -errno;
+        }
+    }
+
+    // Timer slack is per thread, so it still takes a write for each of them.
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", tgid);
+    DIR* d = opendir(path);
+    if (d != NULL) {
+        struct dirent* de;
+        while ((de = readdir(d)) != NULL) {
+            int tid = atoi(de->d_name);
+            if (tid > 0) {
+                set_timerslack_ns(tid, policy == SP_BACKGROUND ? TIMER_SLACK_BG : TIMER_SLACK_FG);
+            }
+        }
+        closedir(d);
+    }
+
+    return 0;
+}
+
 #else
 
 /* Stubs for non-Android targets. */
@@ -449,6 +591,11 @@ int set_sched_policy(int tid UNUSED, SchedPolicy policy UNUSED)
     return 0;
 }
 
+int set_sched_policy_tgid(int tgid UNUSED, SchedPolicy policy UNUSED)
+{
+    return 0;
+}
+
 int get_sched_policy(int tid UNUSED, SchedPolicy *policy)
 {
     *policy = SP_SYSTEM_DEFAULT;
@@ -29,24 +29,33 @@
 #include <cutils/str_parms.h>
 #include <log/log.h>
 
-#define UNUSED __attribute__((unused))
-
-/* When an object is allocated but not freed in a function,
- * because its ownership is released to other object like a hashmap,
- * call RELEASE_OWNERSHIP to tell the clang analyzer and avoid
- * false warnings about potential memory leak.
- * For now, a "temporary" assignment to global variables
- * is enough to confuse the clang static analyzer.
+/* Up to this many keys are looked up by a linear search of the array,
+ * which needs no hashing and no allocation; past it a hashmap indexes
+ * them.  Audio HALs rarely exchange more.
  */
-#ifdef __clang_analyzer__
-static void *released_pointer;
-#define RELEASE_OWNERSHIP(x) { released_pointer = x; released_pointer = 0; }
-#else
-#define RELEASE_OWNERSHIP(x)
-#endif
+#define MAX_LINEAR_KEYS 16
+
+struct str_parm {
+    char *key;
+    char *value;
+};
 
+/* The string given to str_parms_create_str() is copied once, into the same
+ * allocation as the str_parms, and split in place: the keys and values
+ * parsed from it point into buf.  Only those added later by
+ * str_parms_add_str() are allocated, each on its own.
+ */
 struct str_parms {
-    Hashmap *map;
+    struct str_parm *parms;
+    size_t count;
+    size_t capacity;
+    /* Maps keys to 1 + their index in parms; built on the first lookup past
+     * MAX_LINEAR_KEYS keys, and dropped when a key is deleted.
+     */
+    Hashmap *index;
+    char *buf;
+    size_t buf_len;
+    struct str_parm inline_parms[MAX_LINEAR_KEYS];
 };
 
 
@@ -69,127 +78,206 @@ static int str_hash_fn(void *str)
     return (int)hash;
 }
 
-struct str_parms *str_parms_create(void)
+static struct str_parms *alloc_str_parms(size_t buf_len)
 {
     struct str_parms *str_parms;
 
-    str_parms = calloc(1, sizeof(struct str_parms));
+    str_parms = calloc(1, sizeof(struct str_parms) + buf_len);
     if (!str_parms)
         return NULL;
 
-    str_parms->map = hashmapCreate(5, str_hash_fn, str_eq);
-    if (!str_parms->map)
-        goto err;
-
+    str_parms->parms = str_parms->inline_parms;
+    str_parms->capacity = MAX_LINEAR_KEYS;
+    str_parms->buf = (char *)(str_parms + 1);
+    str_parms->buf_len = buf_len;
     return str_parms;
+}
 
-err:
-    free(str_parms);
-    return NULL;
+struct str_parms *str_parms_create(void)
+{
+    return alloc_str_parms(0);
 }
 
-struct remove_ctxt {
-    struct str_parms *str_parms;
-    const char *key;
-};
+/* Returns whether a key or value was allocated on its own rather than
+ * parsed into buf.
+ */
+static bool is_allocated(struct str_parms *str_parms, const char *str)
+{
+    uintptr_t offset = (uintptr_t)str - (uintptr_t)str_parms->buf;
+    return offset >= str_parms->buf_len;
+}
 
-static bool remove_pair(void *key, void *value, void *context)
+static void drop_index(struct str_parms *str_parms)
 {
-    struct remove_ctxt *ctxt = context;
-    bool should_continue;
-
-    /*
-     * - if key is not supplied, then we are removing all entries,
-     *   so remove key and continue (i.e. return true)
-     * - if key is supplied and matches, then remove it and don't
-     *   continue (return false). Otherwise, return true and keep searching
-     *   for key.
-     *
-     */
-    if (!ctxt->key) {
-        should_continue = true;
-        goto do_remove;
-    } else if (!strcmp(ctxt->key, key)) {
-        should_continue = false;
-        goto do_remove;
+    if (str_parms->index) {
+        hashmapFree(str_parms->index);
+        str_parms->index = NULL;
     }
+}
+
+/* Adds parms[i] to the index, dropping the index if it cannot take it. */
+static bool index_parm(struct str_parms *str_parms, size_t i)
+{
+    int saved_errno = errno;
+    bool added;
+
+    /* hashmapPut() returns NULL for a new key, setting errno if it fails. */
+    errno = 0;
+    hashmapPut(str_parms->index, str_parms->parms[i].key,
+               (void *)(uintptr_t)(i + 1));
+    added = errno != ENOMEM;
+    errno = saved_errno;
+
+    if (!added)
+        drop_index(str_parms);
+    return added;
+}
+
+static bool build_index(struct str_parms *str_parms)
+{
+    size_t i;
 
+    str_parms->index = hashmapCreate(str_parms->count * 2, str_hash_fn, str_eq);
+    if (!str_parms->index)
+        return false;
+
+    for (i = 0; i < str_parms->count; i++) {
+        if (!index_parm(str_parms, i))
+            return false;
+    }
     return true;
+}
+
+/* Returns the entry for key, or NULL. */
+static struct str_parm *find_parm(struct str_parms *str_parms,
+                                  const char *key)
+{
+    size_t i;
+
+    if (str_parms->count > MAX_LINEAR_KEYS &&
+            (str_parms->index || build_index(str_parms))) {
+        i = (uintptr_t)hashmapGet(str_parms->index, (void *)key);
+        return i ? &str_parms->parms[i - 1] : NULL;
+    }
+
+    /* Without an index, as when it could not be allocated. */
+    for (i = 0; i < str_parms->count; i++) {
+        if (!strcmp(str_parms->parms[i].key, key))
+            return &str_parms->parms[i];
+    }
+    return NULL;
+}
+
+static void free_parm(struct str_parms *str_parms, struct str_parm *parm)
+{
+    if (is_allocated(str_parms, parm->key))
+        free(parm->key);
+    if (is_allocated(str_parms, parm->value))
+        free(parm->value);
+}
 
-do_remove:
-    hashmapRemove(ctxt->str_parms->map, key);
-    free(key);
-    free(value);
-    return should_continue;
+/* Appends an entry for a key known not to be there yet.  Returns false if
+ * the array could not grow, leaving key and value to the caller.
+ */
+static bool append_parm(struct str_parms *str_parms, char *key, char *value)
+{
+    if (str_parms->count == str_parms->capacity) {
+        size_t capacity = str_parms->capacity * 2;
+        struct str_parm *parms;
+
+        if (str_parms->parms == str_parms->inline_parms) {
+            parms = malloc(capacity * sizeof(*parms));
+            if (parms)
+                memcpy(parms, str_parms->parms,
+                       str_parms->count * sizeof(*parms));
+        } else {
+            parms = realloc(str_parms->parms, capacity * sizeof(*parms));
+        }
+        if (!parms)
+            return false;
+        str_parms->parms = parms;
+        str_parms->capacity = capacity;
+    }
+
+    str_parms->parms[str_parms->count].key = key;
+    str_parms->parms[str_parms->count].value = value;
+    str_parms->count++;
+
+    /* If the index cannot take the key, find_parm() builds a new one. */
+    if (str_parms->index)
+        index_parm(str_parms, str_parms->count - 1);
+    return true;
 }
 
 void str_parms_del(struct str_parms *str_parms, const char *key)
 {
-    struct remove_ctxt ctxt = {
-        .str_parms = str_parms,
-        .key = key,
-    };
-    hashmapForEach(str_parms->map, remove_pair, &ctxt);
+    struct str_parm *parm = find_parm(str_parms, key);
+    size_t after;
+
+    if (!parm)
+        return;
+
+    free_parm(str_parms, parm);
+    /* Keep the rest in order, which str_parms_to_str() follows. */
+    after = str_parms->parms + str_parms->count - (parm + 1);
+    memmove(parm, parm + 1, after * sizeof(*parm));
+    str_parms->count--;
+    drop_index(str_parms);
 }
 
 void str_parms_destroy(struct str_parms *str_parms)
 {
-    struct remove_ctxt ctxt = {
-        .str_parms = str_parms,
-    };
+    size_t i;
 
-    hashmapForEach(str_parms->map, remove_pair, &ctxt);
-    hashmapFree(str_parms->map);
+    for (i = 0; i < str_parms->count; i++)
+        free_parm(str_parms, &str_parms->parms[i]);
+    if (str_parms->parms != str_parms->inline_parms)
+        free(str_parms->parms);
+    drop_index(str_parms);
     free(str_parms);
 }
 
 struct str_parms *str_parms_create_str(const char *_string)
 {
     struct str_parms *str_parms;
+    size_t len = strlen(_string);
     char *str;
     char *kvpair;
     char *tmpstr;
     int items = 0;
 
-    str_parms = str_parms_create();
+    str_parms = alloc_str_parms(len + 1);
     if (!str_parms)
-        goto err_create_str_parms;
+        return NULL;
 
-    str = strdup(_string);
-    if (!str)
-        goto err_strdup;
+    str = str_parms->buf;
+    memcpy(str, _string, len + 1);
 
     ALOGV("%s: source string == '%s'\n", __func__, _string);
 
     kvpair = strtok_r(str, ";", &tmpstr);
     while (kvpair && *kvpair) {
-        char *eq = strchr(kvpair, '='); /* would love strchrnul */
+        char *eq = kvpair + strcspn(kvpair, "=");
         char *value;
-        char *key;
-        void *old_val;
+        struct str_parm *parm;
 
         if (eq == kvpair)
             goto next_pair;
 
-        if (eq) {
-            key = strndup(kvpair, eq - kvpair);
-            if (*(++eq))
-                value = strdup(eq);
-            else
-                value = strdup("");
-        } else {
-            key = strdup(kvpair);
-            value = strdup("");
+        /* A key without '=' gets an empty value: its own terminator. */
+        value = eq;
+        if (*eq) {
+            *eq = '\0';
+            value = eq + 1;
         }
 
-        /* if we replaced a value, free it */
-        old_val = hashmapPut(str_parms->map, key, value);
-        RELEASE_OWNERSHIP(value);
-        if (old_val) {
-            free(old_val);
-            free(key);
-        } else {
-            RELEASE_OWNERSHIP(key);
+        parm = find_parm(str_parms, kvpair);
+        if (parm) {
+            /* Only str_parms_add_str() allocates values. */
+            parm->value = value;
+        } else if (!append_parm(str_parms, kvpair, value)) {
+            str_parms_destroy(str_parms);
+            return NULL;
         }
 
         items++;
@@ -200,62 +288,38 @@ next_pair:
     if (!items)
         ALOGV("%s: no items found in string\n", __func__);
 
-    free(str);
-
     return str_parms;
-
-err_strdup:
-    str_parms_destroy(str_parms);
-err_create_str_parms:
-    return NULL;
 }
 
 int str_parms_add_str(struct str_parms *str_parms, const char *key,
                       const char *value)
 {
-    void *tmp_key = NULL;
-    void *tmp_val = NULL;
-    void *old_val = NULL;
-
-    // strdup and hashmapPut both set errno on failure.
-    // Set errno to 0 so we can recognize whether anything went wrong.
     int saved_errno = errno;
-    errno = 0;
-
-    tmp_key = strdup(key);
-    if (tmp_key == NULL) {
-        goto clean_up;
-    }
+    struct str_parm *parm;
+    char *tmp_key = NULL;
+    char *tmp_val;
 
     tmp_val = strdup(value);
-    if (tmp_val == NULL) {
-        goto clean_up;
-    }
+    if (tmp_val == NULL)
+        goto err;
 
-    old_val = hashmapPut(str_parms->map, tmp_key, tmp_val);
-    if (old_val == NULL) {
-        // Did hashmapPut fail?
-        if (errno == ENOMEM) {
-            goto clean_up;
-        }
-        // For new keys, hashmap takes ownership of tmp_key and tmp_val.
-        RELEASE_OWNERSHIP(tmp_key);
-        RELEASE_OWNERSHIP(tmp_val);
-        tmp_key = tmp_val = NULL;
-    } else {
-        // For existing keys, hashmap takes ownership of tmp_val.
-        // (It also gives up ownership of old_val.)
-        RELEASE_OWNERSHIP(tmp_val);
-        tmp_val = NULL;
+    parm = find_parm(str_parms, key);
+    if (parm) {
+        if (is_allocated(str_parms, parm->value))
+            free(parm->value);
+        parm->value = tmp_val;
+        return 0;
     }
 
-clean_up:
+    tmp_key = strdup(key);
+    if (tmp_key != NULL && append_parm(str_parms, tmp_key, tmp_val))
+        return 0;
+
+err:
     free(tmp_key);
     free(tmp_val);
-    free(old_val);
-    int result = -errno;
     errno = saved_errno;
-    return result;
+    return -ENOMEM;
 }
 
 int str_parms_add_int(struct str_parms *str_parms, const char *key, int value)
@@ -286,30 +350,32 @@ int str_parms_add_float(struct str_parms *str_parms, const char *key,
 }
 
 int str_parms_has_key(struct str_parms *str_parms, const char *key) {
-    return hashmapGet(str_parms->map, (void *)key) != NULL;
+    return find_parm(str_parms, key) != NULL;
 }
 
 int str_parms_get_str(struct str_parms *str_parms, const char *key, char *val,
                       int len)
 {
-    char *value;
+    struct str_parm *parm;
 
-    value = hashmapGet(str_parms->map, (void *)key);
-    if (value)
-        return strlcpy(val, value, len);
+    parm = find_parm(str_parms, key);
+    if (parm)
+        return strlcpy(val, parm->value, len);
 
     return -ENOENT;
 }
 
 int str_parms_get_int(struct str_parms *str_parms, const char *key, int *val)
 {
+    struct str_parm *parm;
     char *value;
     char *end;
 
-    value = hashmapGet(str_parms->map, (void *)key);
-    if (!value)
+    parm = find_parm(str_parms, key);
+    if (!parm)
         return -ENOENT;
 
+    value = parm->value;
     *val = (int)strtol(value, &end, 0);
     if (*value != '\0' && *end == '\0')
         return 0;
@@ -320,14 +386,16 @@ int str_parms_get_int(struct str_parms *str_parms, const char *key, int *val)
 int str_parms_get_float(struct str_parms *str_parms, const char *key,
                         float *val)
 {
+    struct str_parm *parm;
     float out;
     char *value;
     char *end;
 
-    value = hashmapGet(str_parms->map, (void *)key);
-    if (!value)
+    parm = find_parm(str_parms, key);
+    if (!parm)
         return -ENOENT;
 
+    value = parm->value;
     out = strtof(value, &end);
     if (*value == '\0' || *end != '\0')
         return -EINVAL;
@@ -336,47 +404,43 @@ int str_parms_get_float(struct str_parms *str_parms, const char *key,
     return 0;
 }
 
-static bool combine_strings(void *key, void *value, void *context)
+char *str_parms_to_str(struct str_parms *str_parms)
 {
-    char **old_str = context;
-    char *new_str;
-    int ret;
+    size_t len = 1;
+    size_t i;
+    char *str;
+    char *p;
 
-    ret = asprintf(&new_str, "%s%s%s=%s",
-                   *old_str ? *old_str : "",
-                   *old_str ? ";" : "",
-                   (char *)key,
-                   (char *)value);
-    if (*old_str)
-        free(*old_str);
-
-    if (ret >= 0) {
-        *old_str = new_str;
-        return true;
-    }
+    for (i = 0; i < str_parms->count; i++)
+        len += strlen(str_parms->parms[i].key) +
+               strlen(str_parms->parms[i].value) + 2;
 
-    *old_str = NULL;
-    return false;
-}
-
-char *str_parms_to_str(struct str_parms *str_parms)
-{
-    char *str = NULL;
+    str = malloc(len);
+    if (!str)
+        return NULL;
 
-    if (hashmapSize(str_parms->map) > 0)
-        hashmapForEach(str_parms->map, combine_strings, &str);
-    else
-        str = strdup("");
+    p = str;
+    for (i = 0; i < str_parms->count; i++) {
+        size_t key_len = strlen(str_parms->parms[i].key);
+        size_t value_len = strlen(str_parms->parms[i].value);
+
+        if (i)
+            *p++ = ';';
+        memcpy(p, str_parms->parms[i].key, key_len);
+        p += key_len;
+        *p++ = '=';
+        memcpy(p, str_parms->parms[i].value, value_len);
+        p += value_len;
+    }
+    *p = '\0';
     return str;
 }
 
-static bool dump_entry(void *key, void *value, void *context UNUSED)
-{
-    ALOGI("key: '%s' value: '%s'\n", (char *)key, (char *)value);
-    return true;
-}
-
 void str_parms_dump(struct str_parms *str_parms)
 {
-    hashmapForEach(str_parms->map, dump_entry, str_parms);
+    size_t i;
+
+    for (i = 0; i < str_parms->count; i++)
+        ALOGI("key: '%s' value: '%s'\n", str_parms->parms[i].key,
+              str_parms->parms[i].value);
 }
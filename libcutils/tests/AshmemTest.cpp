@@ -249,3 +249,33 @@ TEST(AshmemTest, ForkMultiRegionTest) {
         EXPECT_EQ(0, munmap(region, size));
     }
 }
+
+TEST(AshmemTest, RecycleTest) {
+    constexpr size_t size = PAGE_SIZE * 2;
+    uint8_t data[size];
+    FillData(data, size);
+
+    for (int i = 0; i < 2; i++) {
+        unique_fd fd(ashmem_create_region("recycle", size));
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(size, static_cast<size_t>(ashmem_get_size_region(fd)));
+        ASSERT_EQ(0, lseek(fd, 0, SEEK_CUR));
+
+        void* region;
+        ASSERT_NO_FATAL_FAILURE(TestMmap(fd, size, PROT_READ | PROT_WRITE, &region));
+        // A recycled region comes back zeroed.
+        uint8_t zeroes[size] = {};
+        ASSERT_EQ(0, memcmp(region, zeroes, size));
+        memcpy(region, data, size);
+        EXPECT_EQ(0, munmap(region, size));
+        ASSERT_EQ(size, static_cast<size_t>(TEMP_FAILURE_RETRY(read(fd, zeroes, size))));
+
+        ASSERT_EQ(0, ashmem_recycle_region(fd.release()));
+    }
+
+    // Regions made read-only are never handed out again.
+    unique_fd fd;
+    ASSERT_NO_FATAL_FAILURE(TestCreateRegion(size, fd, PROT_READ));
+    ASSERT_EQ(0, ashmem_recycle_region(fd.release()));
+    ASSERT_NO_FATAL_FAILURE(TestCreateRegion(size, fd, PROT_READ | PROT_WRITE));
+}
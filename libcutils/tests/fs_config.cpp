@@ -14,7 +14,11 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <string>
 
@@ -23,6 +27,7 @@
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <android-base/test_utils.h>
 
 #include <private/android_filesystem_config.h>
 #include <private/fs_config.h>
@@ -246,3 +251,131 @@ TEST(fs_config, odm_files_alias) {
 TEST(fs_config, system_alias) {
     EXPECT_FALSE(check_fs_config_cmp(fs_config_cmp_tests));
 }
+
+// Writes rules to the fs_config_dirs or fs_config_files of the system
+// partition under root.
+static bool write_overrides(const TemporaryDir& root, const char* type_name,
+                            const std::vector<fs_path_config>& rules) {
+    std::string data;
+    for (const auto& rule : rules) {
+        char buffer[sizeof(fs_path_config_from_file) + PATH_MAX];
+        ssize_t len = fs_config_generate(buffer, sizeof(buffer), &rule);
+        if (len < 0) return false;
+        data.append(buffer, len);
+    }
+    std::string dir = std::string(root.path) + "/system";
+    mkdir(dir.c_str(), 0700);
+    dir += "/etc";
+    mkdir(dir.c_str(), 0700);
+    return android::base::WriteStringToFile(data, dir + "/fs_config_" + type_name);
+}
+
+static void check_lookup(const char* path, bool dir, const std::string& target_out_path,
+                         unsigned uid, unsigned gid, unsigned mode, uint64_t capabilities) {
+    unsigned found_uid, found_gid, found_mode = S_IFREG | 07777;
+    uint64_t found_capabilities;
+    fs_config(path, dir, target_out_path.c_str(), &found_uid, &found_gid, &found_mode,
+              &found_capabilities);
+    EXPECT_EQ(uid, found_uid) << path;
+    EXPECT_EQ(gid, found_gid) << path;
+    EXPECT_EQ(S_IFREG | mode, found_mode) << path;
+    EXPECT_EQ(capabilities, found_capabilities) << path;
+}
+
+TEST(fs_config, overrides_first_match) {
+    TemporaryDir root;
+    ASSERT_TRUE(write_overrides(root, "files", {
+        // clang-format off
+        { 00750, AID_ROOT,   AID_SHELL,  0x10, "system/xbin/fs_config_test_one" },
+        { 00700, AID_SYSTEM, AID_SYSTEM, 0x20, "system/xbin/fs_config_test_*" },
+        { 00755, AID_SHELL,  AID_SHELL,  0x40, "vendor/bin/fs_config_test_two" },
+        { 00644, AID_MEDIA,  AID_MEDIA,  0,    "fs_config_test/*" },
+        // clang-format on
+    }));
+    std::string target_out_path = std::string(root.path) + "/system";
+
+    check_lookup("system/xbin/fs_config_test_one", false, target_out_path, AID_ROOT, AID_SHELL,
+                 00750, 0x10);
+    check_lookup("/system/xbin/fs_config_test_other", false, target_out_path, AID_SYSTEM,
+                 AID_SYSTEM, 00700, 0x20);
+    check_lookup("system/xbin/fs_config_test_", false, target_out_path, AID_SYSTEM, AID_SYSTEM,
+                 00700, 0x20);
+    // Aliased to and from system/vendor.
+    check_lookup("system/vendor/bin/fs_config_test_two", false, target_out_path, AID_SHELL,
+                 AID_SHELL, 00755, 0x40);
+    check_lookup("vendor/bin/fs_config_test_two", false, target_out_path, AID_SHELL, AID_SHELL,
+                 00755, 0x40);
+    check_lookup("fs_config_test/a/b", false, target_out_path, AID_MEDIA, AID_MEDIA, 00644, 0);
+    // Not a file rule.
+    check_lookup("system/xbin/fs_config_test_one", true, target_out_path, AID_ROOT, AID_SHELL,
+                 00755, 0);
+}
+
+TEST(fs_config, overrides_fall_back_to_builtin) {
+    TemporaryDir root;
+    ASSERT_TRUE(write_overrides(root, "files", {
+        { 00750, AID_ROOT, AID_SHELL, 0, "system/bin/fs_config_test" },
+    }));
+    std::string target_out_path = std::string(root.path) + "/system";
+
+    check_lookup("system/bin/logd", false, target_out_path, AID_LOGD, AID_LOGD, 00550,
+                 CAP_MASK_LONG(CAP_SYSLOG) | CAP_MASK_LONG(CAP_AUDIT_CONTROL) |
+                     CAP_MASK_LONG(CAP_SETGID));
+    check_lookup("system/bin/fs_config_test_not", false, target_out_path, AID_ROOT, AID_SHELL,
+                 00755, 0);
+    check_lookup("fs_config_test_nowhere", false, target_out_path, AID_ROOT, AID_ROOT, 00644, 0);
+    check_lookup("fs_config_test_nowhere", true, target_out_path, AID_ROOT, AID_ROOT, 00755, 0);
+}
+
+TEST(fs_config, overrides_reloaded) {
+    TemporaryDir root;
+    std::string target_out_path = std::string(root.path) + "/system";
+    ASSERT_TRUE(write_overrides(root, "dirs", {
+        { 00700, AID_SYSTEM, AID_SYSTEM, 0, "data/fs_config_test" },
+    }));
+    check_lookup("data/fs_config_test/a", true, target_out_path, AID_SYSTEM, AID_SYSTEM, 00700, 0);
+
+    ASSERT_TRUE(write_overrides(root, "dirs", {
+        { 00770, AID_SHELL, AID_SHELL, 0, "data/fs_config_test" },
+        { 00700, AID_SYSTEM, AID_SYSTEM, 0, "data/fs_config_test_other" },
+    }));
+    check_lookup("data/fs_config_test/a", true, target_out_path, AID_SHELL, AID_SHELL, 00770, 0);
+}
+
+TEST(fs_config, compile_lookup) {
+    TemporaryDir root;
+    ASSERT_TRUE(write_overrides(root, "files", {
+        { 00700, AID_SYSTEM, AID_SYSTEM, 0x20, "system/xbin/fs_config_test_*" },
+    }));
+    std::string target_out_path = std::string(root.path) + "/system";
+
+    ssize_t length = fs_config_compile(false, target_out_path.c_str(), nullptr, 0);
+    ASSERT_GT(length, 0);
+    std::vector<uint64_t> image((length + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    ASSERT_EQ(length, fs_config_compile(false, target_out_path.c_str(), image.data(), length));
+
+    static const char* paths[] = {
+        "system/xbin/fs_config_test_one", "system/bin/logd", "system/vendor/bin/hw/x",
+        "vendor/bin/hw/x", "system/xbin/su", "init", "fs_config_test_nowhere", "",
+    };
+    for (const char* path : paths) {
+        unsigned uid, gid, mode = 0, expected_uid, expected_gid, expected_mode = 0;
+        uint64_t capabilities, expected_capabilities;
+        fs_config(path, false, target_out_path.c_str(), &expected_uid, &expected_gid,
+                  &expected_mode, &expected_capabilities);
+        ASSERT_EQ(0, fs_config_lookup(image.data(), length, path, &uid, &gid, &mode,
+                                      &capabilities));
+        EXPECT_EQ(expected_uid, uid) << path;
+        EXPECT_EQ(expected_gid, gid) << path;
+        EXPECT_EQ(expected_mode, mode) << path;
+        EXPECT_EQ(expected_capabilities, capabilities) << path;
+    }
+
+    unsigned uid, gid, mode = 0;
+    uint64_t capabilities;
+    EXPECT_EQ(-EINVAL, fs_config_lookup(image.data(), length - 1, "init", &uid, &gid, &mode,
+                                        &capabilities));
+    image[0] = 0;
+    EXPECT_EQ(-EINVAL, fs_config_lookup(image.data(), length, "init", &uid, &gid, &mode,
+                                        &capabilities));
+}
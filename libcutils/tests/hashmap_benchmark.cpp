@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <cutils/hashmap.h>
+
+// A table holding 4096 entries is first grown to 8192 slots, so filling it
+// with 2048 to 6062 entries covers load factors from 0.25 up to just below
+// the 0.75 at which it grows again.
+static constexpr int kSlots = 8192;
+
+static void LoadFactors(benchmark::internal::Benchmark* b) {
+    for (int percent : { 25, 50, 62, 74 }) {
+        b->Arg(kSlots * percent / 100);
+    }
+}
+
+class Map {
+  public:
+    explicit Map(int size) : keys_(size * 2), order_(size * 2) {
+        for (size_t i = 0; i < keys_.size(); ++i) keys_[i] = i;
+        map_ = hashmapCreate(4096, hashmapIntHash, hashmapIntEquals);
+        for (int i = 0; i < size; ++i) hashmapPut(map_, &keys_[i], &keys_[i]);
+
+        // Look the keys up in an order unrelated to the one they were put in,
+        // which would otherwise favor a table allocating entries in sequence.
+        for (size_t i = 0; i < order_.size(); ++i) order_[i] = i;
+        std::mt19937 random(42);
+        std::shuffle(order_.begin(), order_.begin() + size, random);
+        std::shuffle(order_.begin() + size, order_.end(), random);
+    }
+    ~Map() { hashmapFree(map_); }
+
+    Hashmap* get() { return map_; }
+    // Keys [0, size) are present, keys [size, 2 * size) are not.
+    void* key(int i) { return &keys_[order_[i]]; }
+
+  private:
+    std::vector<int> keys_;
+    std::vector<int> order_;
+    Hashmap* map_;
+};
+
+static void BM_hashmap_get_hit(benchmark::State& state) {
+    Map map(state.range(0));
+    int i = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(hashmapGet(map.get(), map.key(i)));
+        if (++i == state.range(0)) i = 0;
+    }
+}
+BENCHMARK(BM_hashmap_get_hit)->Apply(LoadFactors);
+
+static void BM_hashmap_get_miss(benchmark::State& state) {
+    Map map(state.range(0));
+    int i = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(hashmapGet(map.get(), map.key(state.range(0) + i)));
+        if (++i == state.range(0)) i = 0;
+    }
+}
+BENCHMARK(BM_hashmap_get_miss)->Apply(LoadFactors);
+
+// Removes and puts back a key, keeping the load factor constant.
+static void BM_hashmap_remove_put(benchmark::State& state) {
+    Map map(state.range(0));
+    int i = 0;
+    while (state.KeepRunning()) {
+        void* key = map.key(i);
+        hashmapRemove(map.get(), key);
+        hashmapPut(map.get(), key, key);
+        if (++i == state.range(0)) i = 0;
+    }
+}
+BENCHMARK(BM_hashmap_remove_put)->Apply(LoadFactors);
+
+static void BM_hashmap_fill(benchmark::State& state) {
+    std::vector<int> keys(state.range(0));
+    for (size_t i = 0; i < keys.size(); ++i) keys[i] = i;
+    while (state.KeepRunning()) {
+        Hashmap* map = hashmapCreate(0, hashmapIntHash, hashmapIntEquals);
+        for (int& key : keys) hashmapPut(map, &key, &key);
+        hashmapFree(map);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_hashmap_fill)->Arg(16)->Arg(1024);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+#include <cutils/hashmap.h>
+#include <gtest/gtest.h>
+
+static int BadHash(void*) {
+    return 42;
+}
+
+static void* Value(int i) {
+    return reinterpret_cast<void*>(static_cast<intptr_t>(i + 1));
+}
+
+class HashmapTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        keys_.resize(1000);
+        for (size_t i = 0; i < keys_.size(); ++i) keys_[i] = i;
+    }
+
+    void* Key(int i) { return &keys_[i]; }
+
+    std::vector<int> keys_;
+};
+
+TEST_F(HashmapTest, put_get_remove) {
+    Hashmap* map = hashmapCreate(0, hashmapIntHash, hashmapIntEquals);
+    ASSERT_TRUE(map != nullptr);
+
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(nullptr, hashmapPut(map, Key(i), Value(i)));
+    }
+    ASSERT_EQ(1000U, hashmapSize(map));
+    ASSERT_GE(hashmapCurrentCapacity(map), 1000U);
+
+    int other = 7;
+    ASSERT_EQ(Value(7), hashmapGet(map, &other));
+    ASSERT_EQ(Value(7), hashmapPut(map, &other, Value(700)));
+    ASSERT_EQ(Value(700), hashmapGet(map, Key(7)));
+    ASSERT_EQ(1000U, hashmapSize(map));
+
+    for (int i = 0; i < 1000; i += 2) {
+        ASSERT_EQ(i == 7 ? Value(700) : Value(i), hashmapRemove(map, Key(i)));
+    }
+    ASSERT_EQ(500U, hashmapSize(map));
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(i % 2 == 1, hashmapContainsKey(map, Key(i))) << i;
+    }
+    ASSERT_EQ(nullptr, hashmapRemove(map, Key(0)));
+
+    hashmapFree(map);
+}
+
+TEST_F(HashmapTest, collisions) {
+    // Every key has the same home slot, so every lookup probes.
+    Hashmap* map = hashmapCreate(4, BadHash, hashmapIntEquals);
+    ASSERT_TRUE(map != nullptr);
+
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(nullptr, hashmapPut(map, Key(i), Value(i)));
+    }
+    ASSERT_EQ(99U, hashmapCountCollisions(map));
+    for (int i = 0; i < 100; i += 3) {
+        ASSERT_EQ(Value(i), hashmapRemove(map, Key(i)));
+    }
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(i % 3 == 0 ? nullptr : Value(i), hashmapGet(map, Key(i))) << i;
+    }
+
+    hashmapFree(map);
+}
+
+TEST_F(HashmapTest, churn) {
+    // Removed entries' slots are reclaimed rather than growing the table.
+    Hashmap* map = hashmapCreate(100, hashmapIntHash, hashmapIntEquals);
+    ASSERT_TRUE(map != nullptr);
+    size_t capacity = hashmapCurrentCapacity(map);
+
+    for (int i = 0; i < 100; ++i) {
+        hashmapPut(map, Key(i), Value(i));
+    }
+    for (int i = 100; i < 1000; ++i) {
+        ASSERT_EQ(Value(i - 100), hashmapRemove(map, Key(i - 100)));
+        ASSERT_EQ(nullptr, hashmapPut(map, Key(i), Value(i)));
+    }
+    ASSERT_EQ(100U, hashmapSize(map));
+    ASSERT_EQ(capacity, hashmapCurrentCapacity(map));
+    for (int i = 900; i < 1000; ++i) {
+        ASSERT_EQ(Value(i), hashmapGet(map, Key(i))) << i;
+    }
+
+    hashmapFree(map);
+}
+
+struct RemoveContext {
+    Hashmap* map;
+    std::map<int, int> seen;
+};
+
+static bool RemoveVisited(void* key, void*, void* context) {
+    auto* ctx = static_cast<RemoveContext*>(context);
+    ctx->seen[*static_cast<int*>(key)]++;
+    hashmapRemove(ctx->map, key);
+    return true;
+}
+
+TEST_F(HashmapTest, for_each_remove) {
+    for (auto hash : { hashmapIntHash, BadHash }) {
+        RemoveContext ctx;
+        ctx.map = hashmapCreate(0, hash, hashmapIntEquals);
+        ASSERT_TRUE(ctx.map != nullptr);
+        for (int i = 0; i < 300; ++i) {
+            hashmapPut(ctx.map, Key(i), Value(i));
+        }
+
+        hashmapForEach(ctx.map, RemoveVisited, &ctx);
+        ASSERT_EQ(0U, hashmapSize(ctx.map));
+        ASSERT_EQ(300U, ctx.seen.size());
+        for (auto& entry : ctx.seen) {
+            ASSERT_EQ(1, entry.second) << entry.first;
+        }
+        hashmapFree(ctx.map);
+    }
+}
+
+static bool StopAtThird(void*, void*, void* context) {
+    return ++*static_cast<int*>(context) < 3;
+}
+
+TEST_F(HashmapTest, for_each_stop) {
+    Hashmap* map = hashmapCreate(0, hashmapIntHash, hashmapIntEquals);
+    for (int i = 0; i < 10; ++i) {
+        hashmapPut(map, Key(i), Value(i));
+    }
+    int calls = 0;
+    hashmapForEach(map, StopAtThird, &calls);
+    ASSERT_EQ(3, calls);
+    hashmapFree(map);
+}
+
+static void* Initial(void* key, void* context) {
+    ++*static_cast<int*>(context);
+    return Value(*static_cast<int*>(key));
+}
+
+TEST_F(HashmapTest, memoize) {
+    Hashmap* map = hashmapCreate(0, hashmapIntHash, hashmapIntEquals);
+    int calls = 0;
+    ASSERT_EQ(Value(5), hashmapMemoize(map, Key(5), Initial, &calls));
+    ASSERT_EQ(Value(5), hashmapMemoize(map, Key(5), Initial, &calls));
+    ASSERT_EQ(1, calls);
+    ASSERT_EQ(1U, hashmapSize(map));
+    hashmapFree(map);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <stdlib.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <cutils/sched_policy.h>
+
+// Keeps |count| threads blocked, like the threads of an app being moved between
+// foreground and background.
+class Threads {
+  public:
+    explicit Threads(int count) {
+        for (int i = 0; i < count; ++i) {
+            threads_.emplace_back([this]() {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return done_; });
+            });
+        }
+    }
+
+    ~Threads() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        cv_.notify_all();
+        for (auto& thread : threads_) thread.join();
+    }
+
+  private:
+    bool done_ = false;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::thread> threads_;
+};
+
+static std::vector<int> GetTids() {
+    std::vector<int> tids;
+    DIR* d = opendir("/proc/self/task");
+    while (dirent* de = readdir(d)) {
+        int tid = atoi(de->d_name);
+        if (tid > 0) tids.push_back(tid);
+    }
+    closedir(d);
+    return tids;
+}
+
+// What a caller has to do without set_cpuset_policy_tgid().
+static void BM_set_cpuset_policy_each_thread(benchmark::State& state) {
+    Threads threads(state.range(0));
+    std::vector<int> tids = GetTids();
+    SchedPolicy policy = SP_FOREGROUND;
+    while (state.KeepRunning()) {
+        policy = policy == SP_FOREGROUND ? SP_BACKGROUND : SP_FOREGROUND;
+        for (int tid : tids) set_cpuset_policy(tid, policy);
+    }
+    set_cpuset_policy_tgid(0, SP_FOREGROUND);
+}
+BENCHMARK(BM_set_cpuset_policy_each_thread)->Arg(10)->Arg(100);
+
+static void BM_set_cpuset_policy_tgid(benchmark::State& state) {
+    Threads threads(state.range(0));
+    SchedPolicy policy = SP_FOREGROUND;
+    while (state.KeepRunning()) {
+        policy = policy == SP_FOREGROUND ? SP_BACKGROUND : SP_FOREGROUND;
+        set_cpuset_policy_tgid(0, policy);
+    }
+    set_cpuset_policy_tgid(0, SP_FOREGROUND);
+}
+BENCHMARK(BM_set_cpuset_policy_tgid)->Arg(10)->Arg(100);
+
+BENCHMARK_MAIN();
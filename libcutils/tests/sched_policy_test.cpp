@@ -16,6 +16,8 @@
 
 #include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -96,3 +98,42 @@ TEST(SchedPolicy, get_sched_policy) {
     ASSERT_EQ(0, get_sched_policy(0, &newPolicy));
     EXPECT_EQ(SP_BACKGROUND, newPolicy);
 }
+
+TEST(SchedPolicy, set_cpuset_policy_tgid) {
+    if (!cpusets_enabled() && !schedboost_enabled()) {
+        GTEST_LOG_(INFO) << "skipping test that requires cpusets or schedtune";
+        return;
+    }
+
+    bool done = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+    pid_t tid = 0;
+    std::thread thread([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        tid = gettid();
+        cv.notify_all();
+        cv.wait(lock, [&done]() { return done; });
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&tid]() { return tid != 0; });
+    }
+
+    // Every thread of the process moves, not just the calling one.
+    ASSERT_EQ(0, set_cpuset_policy_tgid(0, SP_BACKGROUND));
+    SchedPolicy policy;
+    EXPECT_EQ(0, get_sched_policy(tid, &policy));
+    EXPECT_EQ(SP_BACKGROUND, policy);
+
+    ASSERT_EQ(0, set_cpuset_policy_tgid(0, SP_FOREGROUND));
+    EXPECT_EQ(0, get_sched_policy(tid, &policy));
+    EXPECT_EQ(SP_FOREGROUND, policy);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    cv.notify_all();
+    thread.join();
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <cutils/str_parms.h>
+
+// What an audio HAL typically gets from AudioFlinger.
+static const char kParameters[] =
+        "routing=2;format=1;channels=3;sampling_rate=48000;frame_count=256;"
+        "input_source=1;bt_headset_nrec=on";
+
+static std::string ManyParameters() {
+    std::string str;
+    for (int i = 0; i < 64; ++i) {
+        str += "key" + std::to_string(i) + "=" + std::to_string(i) + ";";
+    }
+    return str;
+}
+
+static void BM_str_parms_create_str(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        str_parms_destroy(str_parms_create_str(kParameters));
+    }
+}
+BENCHMARK(BM_str_parms_create_str);
+
+static void BM_str_parms_create_str_many(benchmark::State& state) {
+    std::string str = ManyParameters();
+    while (state.KeepRunning()) {
+        str_parms_destroy(str_parms_create_str(str.c_str()));
+    }
+}
+BENCHMARK(BM_str_parms_create_str_many);
+
+static void BM_str_parms_get_int(benchmark::State& state) {
+    str_parms* parms = str_parms_create_str(kParameters);
+    int value;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(str_parms_get_int(parms, "sampling_rate", &value));
+    }
+    str_parms_destroy(parms);
+}
+BENCHMARK(BM_str_parms_get_int);
+
+static void BM_str_parms_get_int_many(benchmark::State& state) {
+    std::string str = ManyParameters();
+    str_parms* parms = str_parms_create_str(str.c_str());
+    int value;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(str_parms_get_int(parms, "key42", &value));
+    }
+    str_parms_destroy(parms);
+}
+BENCHMARK(BM_str_parms_get_int_many);
+
+// Parses a request, answers it, and formats the reply.
+static void BM_str_parms_round_trip(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        str_parms* parms = str_parms_create_str(kParameters);
+        int routing;
+        char nrec[8];
+        str_parms_get_int(parms, "routing", &routing);
+        str_parms_get_str(parms, "bt_headset_nrec", nrec, sizeof(nrec));
+        str_parms_del(parms, "frame_count");
+        str_parms_add_int(parms, "latency", 20);
+        free(str_parms_to_str(parms));
+        str_parms_destroy(parms);
+    }
+}
+BENCHMARK(BM_str_parms_round_trip);
+
+BENCHMARK_MAIN();
@@ -14,6 +14,11 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <string.h>
+
+#include <string>
+
 #include <cutils/str_parms.h>
 #include <gtest/gtest.h>
 
@@ -55,3 +60,68 @@ TEST(str_parms, put_ENOMEM) {
     ASSERT_EQ(ENOMEM, errno);
     test_str_parms_str("foo=bar;baz=", "foo=bar;baz=");
 }
+
+TEST(str_parms, get) {
+    str_parms* str_parms = str_parms_create_str("int=-12;hex=0x10;float=1.5;empty;bad=1x");
+    ASSERT_TRUE(str_parms != nullptr);
+
+    int i;
+    ASSERT_EQ(0, str_parms_get_int(str_parms, "int", &i));
+    ASSERT_EQ(-12, i);
+    ASSERT_EQ(0, str_parms_get_int(str_parms, "hex", &i));
+    ASSERT_EQ(16, i);
+    ASSERT_EQ(-EINVAL, str_parms_get_int(str_parms, "bad", &i));
+    ASSERT_EQ(-EINVAL, str_parms_get_int(str_parms, "empty", &i));
+    ASSERT_EQ(-ENOENT, str_parms_get_int(str_parms, "missing", &i));
+
+    float f;
+    ASSERT_EQ(0, str_parms_get_float(str_parms, "float", &f));
+    ASSERT_EQ(1.5f, f);
+
+    char value[4];
+    ASSERT_EQ(3, str_parms_get_str(str_parms, "float", value, sizeof(value)));
+    ASSERT_STREQ("1.5", value);
+    ASSERT_EQ(0, str_parms_get_str(str_parms, "empty", value, sizeof(value)));
+    ASSERT_STREQ("", value);
+    ASSERT_TRUE(str_parms_has_key(str_parms, "empty"));
+    ASSERT_FALSE(str_parms_has_key(str_parms, "missing"));
+
+    str_parms_destroy(str_parms);
+}
+
+TEST(str_parms, many_keys) {
+    // Past a few keys, lookups go through an index, which has to follow
+    // additions and deletions.
+    std::string str;
+    for (int i = 0; i < 40; ++i) {
+        str += "key" + std::to_string(i) + "=" + std::to_string(i) + ";";
+    }
+    str_parms* str_parms = str_parms_create_str(str.c_str());
+    ASSERT_TRUE(str_parms != nullptr);
+
+    for (int i = 0; i < 40; i += 2) {
+        str_parms_del(str_parms, ("key" + std::to_string(i)).c_str());
+    }
+    for (int i = 40; i < 60; ++i) {
+        ASSERT_EQ(0, str_parms_add_int(str_parms, ("key" + std::to_string(i)).c_str(), i));
+    }
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "key1", "one"));
+
+    for (int i = 0; i < 60; ++i) {
+        std::string key = "key" + std::to_string(i);
+        int value;
+        if (i < 40 && i % 2 == 0) {
+            ASSERT_FALSE(str_parms_has_key(str_parms, key.c_str())) << key;
+        } else if (i == 1) {
+            ASSERT_EQ(-EINVAL, str_parms_get_int(str_parms, key.c_str(), &value));
+        } else {
+            ASSERT_EQ(0, str_parms_get_int(str_parms, key.c_str(), &value)) << key;
+            ASSERT_EQ(i, value);
+        }
+    }
+
+    char* out_str = str_parms_to_str(str_parms);
+    ASSERT_EQ(0, strncmp("key1=one;key3=3;", out_str, 16)) << out_str;
+    free(out_str);
+    str_parms_destroy(str_parms);
+}
@@ -41,6 +41,41 @@ int ion_map(int fd, ion_user_handle_t handle, size_t length, int prot,
 int ion_share(int fd, ion_user_handle_t handle, int *share_fd);
 int ion_import(int fd, int share_fd, ion_user_handle_t *handle);
 
+/*
+ * Buffer pool on top of ion_alloc_fd for clients that allocate and free
+ * buffers of the same shape over and over (camera, codecs). Freed buffers
+ * are kept, up to max_buffers_per_class per (size class, align, heap mask,
+ * flags) and max_bytes in total, and handed out again instead of going back
+ * to the kernel. Buffers may be larger than requested, by at most 25%, and
+ * recycled buffers are not cleared. Only return a buffer to the pool once no
+ * one else, including other processes it was shared with, is using it.
+ *
+ * The pool does not own the ion fd. ion_pool_trim gives cached buffers back
+ * until at most max_bytes are held and is meant to be called on memory
+ * pressure; the pool also empties itself if the kernel runs out of memory
+ * during an allocation. All functions are thread safe.
+ */
+struct ion_pool;
+
+struct ion_pool_stats {
+    unsigned long long alloc_count;    /* successful ion_pool_alloc_fd calls */
+    unsigned long long hit_count;      /* ... of which served from the pool */
+    unsigned long long free_count;     /* ion_pool_free_fd calls */
+    unsigned long long release_count;  /* buffers closed: pool full or trimmed */
+    size_t outstanding_buffers;        /* allocated and not freed yet */
+    size_t cached_buffers;             /* held by the pool for reuse */
+    size_t cached_bytes;
+};
+
+struct ion_pool *ion_pool_create(int fd, size_t max_buffers_per_class,
+                                 size_t max_bytes);
+void ion_pool_destroy(struct ion_pool *pool);
+int ion_pool_alloc_fd(struct ion_pool *pool, size_t len, size_t align,
+                      unsigned int heap_mask, unsigned int flags, int *handle_fd);
+int ion_pool_free_fd(struct ion_pool *pool, int handle_fd);
+void ion_pool_trim(struct ion_pool *pool, size_t max_bytes);
+void ion_pool_get_stats(struct ion_pool *pool, struct ion_pool_stats *stats);
+
 __END_DECLS
 
 #endif /* __SYS_CORE_ION_H */
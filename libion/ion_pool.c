@@ -0,0 +1,281 @@
+/*
+ *  ion_pool.c
+ *
+ * User space recycling of ion buffers
+ *
+ *   Copyright 2017 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#define LOG_TAG "ion"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ion/ion.h>
+#include <log/log.h>
+
+/*
+ * Freed buffers are kept per size class, i.e. per (len, align, heap mask,
+ * flags) with len rounded up so that nearby sizes share buffers. Small
+ * buffers are only rounded to a page; above that the class is a quarter
+ * of the enclosing power of two, which bounds the slack at 25%.
+ */
+#define ION_POOL_EXACT_PAGES 16
+
+struct ion_pool_class {
+    size_t len;
+    size_t align;
+    unsigned int heap_mask;
+    unsigned int flags;
+    size_t count;
+    int *fds;
+    struct ion_pool_class *next;
+};
+
+/* A buffer handed out by the pool, so that ion_pool_free_fd knows its class. */
+struct ion_pool_buffer {
+    int fd;
+    struct ion_pool_class *cls;
+    struct ion_pool_buffer *next;
+};
+
+struct ion_pool {
+    int fd;
+    size_t max_buffers_per_class;
+    size_t max_bytes;
+    pthread_mutex_t lock;
+    struct ion_pool_class *classes;
+    struct ion_pool_buffer *outstanding;
+    struct ion_pool_stats stats;
+};
+
+static size_t ion_pool_size_class(size_t len)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t step;
+
+    len = (len + page - 1) & ~(page - 1);
+    if (len <= ION_POOL_EXACT_PAGES * page)
+        return len;
+    step = (size_t)1 << (sizeof(long) * 8 - 1 - __builtin_clzl(len));
+    step /= 4;
+    return (len + step - 1) & ~(step - 1);
+}
+
+struct ion_pool *ion_pool_create(int fd, size_t max_buffers_per_class,
+                                 size_t max_bytes)
+{
+    struct ion_pool *pool;
+
+    if (fd < 0 || max_buffers_per_class == 0)
+        return NULL;
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+    pool->fd = fd;
+    pool->max_buffers_per_class = max_buffers_per_class;
+    pool->max_bytes = max_bytes;
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+static struct ion_pool_class *ion_pool_find_class(struct ion_pool *pool,
+        size_t len, size_t align, unsigned int heap_mask, unsigned int flags)
+{
+    struct ion_pool_class *cls;
+
+    for (cls = pool->classes; cls != NULL; cls = cls->next) {
+        if (cls->len == len && cls->align == align &&
+            cls->heap_mask == heap_mask && cls->flags == flags)
+            return cls;
+    }
+
+    cls = calloc(1, sizeof(*cls));
+    if (cls == NULL)
+        return NULL;
+    cls->fds = calloc(pool->max_buffers_per_class, sizeof(int));
+    if (cls->fds == NULL) {
+        free(cls);
+        return NULL;
+    }
+    cls->len = len;
+    cls->align = align;
+    cls->heap_mask = heap_mask;
+    cls->flags = flags;
+    cls->next = pool->classes;
+    pool->classes = cls;
+    return cls;
+}
+
+/* Called with pool->lock held. */
+static void ion_pool_release(struct ion_pool *pool, struct ion_pool_class *cls)
+{
+    close(cls->fds[--cls->count]);
+    pool->stats.cached_buffers--;
+    pool->stats.cached_bytes -= cls->len;
+    pool->stats.release_count++;
+}
+
+/* Called with pool->lock held. */
+static void ion_pool_trim_locked(struct ion_pool *pool, size_t max_bytes)
+{
+    struct ion_pool_class *cls;
+
+    /* Drop one buffer per class per pass so no single size is wiped out first. */
+    while (pool->stats.cached_bytes > max_bytes) {
+        for (cls = pool->classes; cls != NULL; cls = cls->next) {
+            if (cls->count > 0)
+                ion_pool_release(pool, cls);
+            if (pool->stats.cached_bytes <= max_bytes)
+                break;
+        }
+    }
+}
+
+int ion_pool_alloc_fd(struct ion_pool *pool, size_t len, size_t align,
+                      unsigned int heap_mask, unsigned int flags, int *handle_fd)
+{
+    struct ion_pool_class *cls;
+    struct ion_pool_buffer *buf;
+    int ret;
+
+    if (pool == NULL || handle_fd == NULL || len == 0)
+        return -EINVAL;
+
+    buf = malloc(sizeof(*buf));
+    if (buf == NULL)
+        return -ENOMEM;
+
+    pthread_mutex_lock(&pool->lock);
+    cls = ion_pool_find_class(pool, ion_pool_size_class(len), align,
+                              heap_mask, flags);
+    if (cls == NULL) {
+        pthread_mutex_unlock(&pool->lock);
+        free(buf);
+        return -ENOMEM;
+    }
+
+    if (cls->count > 0) {
+        buf->fd = cls->fds[--cls->count];
+        pool->stats.cached_buffers--;
+        pool->stats.cached_bytes -= cls->len;
+        pool->stats.hit_count++;
+    } else {
+        ret = ion_alloc_fd(pool->fd, cls->len, align, heap_mask, flags, &buf->fd);
+        if (ret == -ENOMEM && pool->stats.cached_bytes > 0) {
+            /* The kernel is short on memory, give back what we hold and retry. */
+            ion_pool_trim_locked(pool, 0);
+            ret = ion_alloc_fd(pool->fd, cls->len, align, heap_mask, flags, &buf->fd);
+        }
+        if (ret < 0) {
+            pthread_mutex_unlock(&pool->lock);
+            free(buf);
+            return ret;
+        }
+    }
+
+    buf->cls = cls;
+    buf->next = pool->outstanding;
+    pool->outstanding = buf;
+    pool->stats.alloc_count++;
+    pool->stats.outstanding_buffers++;
+    *handle_fd = buf->fd;
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+int ion_pool_free_fd(struct ion_pool *pool, int handle_fd)
+{
+    struct ion_pool_buffer **link;
+    struct ion_pool_buffer *buf;
+    struct ion_pool_class *cls;
+
+    if (pool == NULL)
+        return -EINVAL;
+
+    pthread_mutex_lock(&pool->lock);
+    for (link = &pool->outstanding; *link != NULL; link = &(*link)->next) {
+        if ((*link)->fd == handle_fd)
+            break;
+    }
+    buf = *link;
+    if (buf == NULL) {
+        pthread_mutex_unlock(&pool->lock);
+        ALOGE("ion_pool_free_fd: fd %d was not allocated from this pool\n", handle_fd);
+        return -EINVAL;
+    }
+    *link = buf->next;
+    cls = buf->cls;
+    free(buf);
+
+    pool->stats.free_count++;
+    pool->stats.outstanding_buffers--;
+    if (cls->count < pool->max_buffers_per_class &&
+        pool->stats.cached_bytes + cls->len <= pool->max_bytes) {
+        cls->fds[cls->count++] = handle_fd;
+        pool->stats.cached_buffers++;
+        pool->stats.cached_bytes += cls->len;
+    } else {
+        close(handle_fd);
+        pool->stats.release_count++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void ion_pool_trim(struct ion_pool *pool, size_t max_bytes)
+{
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    ion_pool_trim_locked(pool, max_bytes);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void ion_pool_get_stats(struct ion_pool *pool, struct ion_pool_stats *stats)
+{
+    if (pool == NULL || stats == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void ion_pool_destroy(struct ion_pool *pool)
+{
+    struct ion_pool_class *cls;
+    struct ion_pool_buffer *buf;
+
+    if (pool == NULL)
+        return;
+
+    ion_pool_trim_locked(pool, 0);
+    while ((cls = pool->classes) != NULL) {
+        pool->classes = cls->next;
+        free(cls->fds);
+        free(cls);
+    }
+    /* Outstanding buffers stay valid, they are simply no longer tracked. */
+    while ((buf = pool->outstanding) != NULL) {
+        pool->outstanding = buf->next;
+        free(buf);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
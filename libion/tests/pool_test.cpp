@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <ion/ion.h>
+#include "ion_test_fixture.h"
+
+class Pool : public IonAllHeapsTest {
+};
+
+TEST_F(Pool, Recycle)
+{
+    for (unsigned int heapMask : m_allHeaps) {
+        SCOPED_TRACE(::testing::Message() << "heap " << heapMask);
+        struct ion_pool *pool = ion_pool_create(m_ionFd, 4, 16*1024*1024);
+        ASSERT_TRUE(pool != NULL);
+
+        int fd = -1;
+        ASSERT_EQ(0, ion_pool_alloc_fd(pool, 64*1024, 0, heapMask, 0, &fd));
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(0, ion_pool_free_fd(pool, fd));
+
+        // The same shape, and a nearby size in the same class, reuse the buffer.
+        int fd2 = -1;
+        ASSERT_EQ(0, ion_pool_alloc_fd(pool, 64*1024, 0, heapMask, 0, &fd2));
+        ASSERT_EQ(fd, fd2);
+        ASSERT_EQ(0, ion_pool_free_fd(pool, fd2));
+        ASSERT_EQ(0, ion_pool_alloc_fd(pool, 64*1024 - 100, 0, heapMask, 0, &fd2));
+        ASSERT_EQ(fd, fd2);
+
+        // Different flags do not.
+        int fd3 = -1;
+        ASSERT_EQ(0, ion_pool_alloc_fd(pool, 64*1024, 0, heapMask, ION_FLAG_CACHED, &fd3));
+        ASSERT_GE(fd3, 0);
+        ASSERT_NE(fd2, fd3);
+
+        struct ion_pool_stats stats;
+        ion_pool_get_stats(pool, &stats);
+        EXPECT_EQ(4U, stats.alloc_count);
+        EXPECT_EQ(2U, stats.hit_count);
+        EXPECT_EQ(2U, stats.free_count);
+        EXPECT_EQ(2U, stats.outstanding_buffers);
+        EXPECT_EQ(0U, stats.cached_buffers);
+
+        ASSERT_EQ(0, ion_pool_free_fd(pool, fd2));
+        ASSERT_EQ(0, ion_pool_free_fd(pool, fd3));
+        ion_pool_get_stats(pool, &stats);
+        EXPECT_EQ(2U, stats.cached_buffers);
+        EXPECT_EQ(2U*64*1024, stats.cached_bytes);
+
+        ion_pool_destroy(pool);
+    }
+}
+
+TEST_F(Pool, Bounded)
+{
+    for (unsigned int heapMask : m_allHeaps) {
+        SCOPED_TRACE(::testing::Message() << "heap " << heapMask);
+        struct ion_pool *pool = ion_pool_create(m_ionFd, 2, 16*1024*1024);
+        ASSERT_TRUE(pool != NULL);
+
+        int fds[4];
+        for (int& fd : fds) {
+            ASSERT_EQ(0, ion_pool_alloc_fd(pool, 4096, 0, heapMask, 0, &fd));
+        }
+        for (int fd : fds) {
+            ASSERT_EQ(0, ion_pool_free_fd(pool, fd));
+        }
+
+        struct ion_pool_stats stats;
+        ion_pool_get_stats(pool, &stats);
+        EXPECT_EQ(2U, stats.cached_buffers);
+        EXPECT_EQ(2U, stats.release_count);
+
+        ion_pool_trim(pool, 0);
+        ion_pool_get_stats(pool, &stats);
+        EXPECT_EQ(0U, stats.cached_buffers);
+        EXPECT_EQ(0U, stats.cached_bytes);
+        EXPECT_EQ(4U, stats.release_count);
+
+        ion_pool_destroy(pool);
+    }
+}
+
+TEST_F(Pool, InvalidValues)
+{
+    struct ion_pool *pool = ion_pool_create(m_ionFd, 2, 1024*1024);
+    ASSERT_TRUE(pool != NULL);
+
+    int fd = -1;
+    EXPECT_EQ(-EINVAL, ion_pool_alloc_fd(pool, 0, 0, 1, 0, &fd));
+    EXPECT_EQ(-EINVAL, ion_pool_alloc_fd(pool, 4096, 0, 1, 0, NULL));
+    EXPECT_EQ(-EINVAL, ion_pool_free_fd(pool, m_ionFd));
+
+    ion_pool_destroy(pool);
+
+    EXPECT_TRUE(ion_pool_create(-1, 2, 1024*1024) == NULL);
+    EXPECT_TRUE(ion_pool_create(m_ionFd, 0, 1024*1024) == NULL);
+}
@@ -63,13 +63,20 @@ LIBLOG_HIDDEN void __android_log_config_write() {
   }
 
   if ((__android_log_transport == LOGGER_DEFAULT) ||
-      (__android_log_transport & LOGGER_LOGD)) {
+      (__android_log_transport & (LOGGER_LOGD | LOGGER_SHM))) {
 #if (FAKE_LOG_DEVICE == 0)
     extern struct android_log_transport_write logdLoggerWrite;
+    extern struct android_log_transport_write logdAsyncLoggerWrite;
+    extern struct android_log_transport_write logdShmLoggerWrite;
     extern struct android_log_transport_write pmsgLoggerWrite;
 
+    /* logd_shm falls back to the logd transport by itself if refused */
     __android_log_add_transport(&__android_log_transport_write,
-                                &logdLoggerWrite);
+                                (__android_log_transport & LOGGER_SHM)
+                                    ? &logdShmLoggerWrite
+                                    : (__android_log_transport & LOGGER_ASYNC)
+                                          ? &logdAsyncLoggerWrite
+                                          : &logdLoggerWrite);
     __android_log_add_transport(&__android_log_persist_write, &pmsgLoggerWrite);
 #else
     extern struct android_log_transport_write fakeLoggerWrite;
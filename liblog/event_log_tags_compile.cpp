@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host tool run at build time, compiles the merged event-log-tags text
+// file into the precompiled event-log-tags.bin that liblog maps in place.
+//
+//   event-log-tags-compile <event-log-tags> <event-log-tags.bin>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <log/event_tag_map.h>
+#include <private/android_logger.h>
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <event-log-tags> <event-log-tags.bin>\n",
+            argv[0]);
+    return 1;
+  }
+
+  EventTagMap* map = android_openEventTagMap(argv[1]);
+  if (!map) {
+    fprintf(stderr, "%s: %s: %s\n", argv[0], argv[1], strerror(errno));
+    return 1;
+  }
+
+  int fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s: %s\n", argv[0], argv[2], strerror(errno));
+    android_closeEventTagMap(map);
+    return 1;
+  }
+
+  int ret = android_writeEventTagMapBinary(map, fd);
+  int save_errno = errno;
+  android_closeEventTagMap(map);
+  if (close(fd) && !ret) {
+    ret = -1;
+    save_errno = errno;
+  }
+  if (ret) {
+    fprintf(stderr, "%s: %s: %s\n", argv[0], argv[2], strerror(save_errno));
+    unlink(argv[2]);
+    return 1;
+  }
+  return 0;
+}
@@ -24,11 +24,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <experimental/string_view>
 #include <functional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <log/event_tag_map.h>
 #include <log/log_properties.h>
@@ -41,6 +44,55 @@
 
 #define OUT_TAG "EventTagMap"
 
+// Precompiled binary form of EVENT_TAG_MAP_FILE, written at build time by
+// event-log-tags-compile.  It is mapped shared and read only, looked up
+// in place with a minimal perfect hash on the tag number, so opening the
+// map costs nothing more than the mmap.  Layout, all little endian:
+//
+//   EventTagMapHeader
+//   uint32_t seeds[buckets]       displacement for each hash bucket
+//   EventTagMapEntry entries[count]  one slot per tag, nothing empty
+//   uint32_t byName[count]        entry indices sorted by name then format
+//   char strings[strings]         nul terminated names and formats
+//
+// The file is trusted no more than the text one.  The header and sizes
+// are checked at open, every offset is bounds checked as it is used, so
+// that a corrupt map can at worst miss.
+#define EVENT_TAG_MAP_BINARY_FILE EVENT_TAG_MAP_FILE ".bin"
+#define EVENT_TAG_MAP_BINARY_MAGIC 0x424d5445  // "ETMB"
+#define EVENT_TAG_MAP_BINARY_VERSION 1
+
+struct EventTagMapHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;    // of entries, also the size of the hash table
+  uint32_t buckets;  // of seeds
+  uint32_t strings;  // size of the string pool
+  uint32_t reserved;
+};
+
+struct EventTagMapEntry {
+  uint32_t tag;
+  uint32_t name;  // offset into the string pool
+  uint32_t nameLen;
+  uint32_t format;  // offset into the string pool
+  uint32_t formatLen;
+};
+
+// Average keys per bucket the compiler starts out with.
+#define EVENT_TAG_MAP_BUCKET_LOAD 4
+
+// murmur3 finalizer, seed 0 picks the bucket, the bucket seed the slot.
+static inline uint32_t eventTagHash(uint32_t tag, uint32_t seed) {
+  uint32_t h = tag ^ (seed * 0x9e3779b9U);
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+  return h;
+}
+
 class MapString {
  private:
   const std::string* alloc;                  // HAS-AN
@@ -120,6 +172,14 @@ struct EventTagMap {
   size_t mapLen[NUM_MAPS];
 
  private:
+  // precompiled map in mapAddr[0], immutable and so needs no lock
+  const EventTagMapHeader* binary;
+  const uint32_t* seeds;
+  const EventTagMapEntry* entries;
+  const uint32_t* byName;
+  const char* strings;
+
+  // overlay of the dynamic tags, or everything without a binary map
   std::unordered_map<uint32_t, TagFmt> Idx2TagFmt;
   std::unordered_map<TagFmt, uint32_t> TagFmt2Idx;
   std::unordered_map<MapString, uint32_t> Tag2Idx;
@@ -127,7 +187,8 @@ struct EventTagMap {
   android::RWLock rwlock;
 
  public:
-  EventTagMap() {
+  EventTagMap()
+      : binary(NULL), seeds(NULL), entries(NULL), byName(NULL), strings(NULL) {
     memset(mapAddr, 0, sizeof(mapAddr));
     memset(mapLen, 0, sizeof(mapLen));
   }
@@ -148,6 +209,19 @@ struct EventTagMap {
   const TagFmt* find(uint32_t tag) const;
   int find(TagFmt&& tagfmt) const;
   int find(MapString&& tag) const;
+
+  bool setBinary(void* addr, size_t len);
+  bool isBinary() const {
+    return binary != NULL;
+  }
+  const char* findBinary(uint32_t tag, bool format, size_t* len) const;
+  int writeBinary(int fd) const;
+
+ private:
+  bool binaryString(uint32_t offset, uint32_t len) const;
+  MapString binaryName(uint32_t index) const;
+  MapString binaryFormat(uint32_t index) const;
+  int findBinary(const MapString& tag, const MapString* format) const;
 };
 
 bool EventTagMap::emplaceUnique(uint32_t tag, const TagFmt& tagfmt,
@@ -215,6 +289,9 @@ const TagFmt* EventTagMap::find(uint32_t tag) const {
 }
 
 int EventTagMap::find(TagFmt&& tagfmt) const {
+  int ret = findBinary(tagfmt.first, &tagfmt.second);
+  if (ret != -1) return ret;
+
   std::unordered_map<TagFmt, uint32_t>::const_iterator it;
   android::RWLock::AutoRLock readLock(const_cast<android::RWLock&>(rwlock));
   it = TagFmt2Idx.find(std::move(tagfmt));
@@ -223,6 +300,9 @@ int EventTagMap::find(TagFmt&& tagfmt) const {
 }
 
 int EventTagMap::find(MapString&& tag) const {
+  int ret = findBinary(tag, NULL);
+  if (ret != -1) return ret;
+
   std::unordered_map<MapString, uint32_t>::const_iterator it;
   android::RWLock::AutoRLock readLock(const_cast<android::RWLock&>(rwlock));
   it = Tag2Idx.find(std::move(tag));
@@ -230,6 +310,257 @@ int EventTagMap::find(MapString&& tag) const {
   return it->second;
 }
 
+// Adopt a mapping of a precompiled map, false if it is not one we can use.
+bool EventTagMap::setBinary(void* addr, size_t len) {
+  const EventTagMapHeader* header = static_cast<EventTagMapHeader*>(addr);
+  if (len < sizeof(*header)) return false;
+  if (header->magic != EVENT_TAG_MAP_BINARY_MAGIC) return false;
+  if (header->version != EVENT_TAG_MAP_BINARY_VERSION) return false;
+  if (!header->count || !header->buckets || !header->strings) return false;
+
+  uint64_t size = sizeof(*header);
+  size += (uint64_t)header->buckets * sizeof(seeds[0]);
+  size += (uint64_t)header->count * (sizeof(entries[0]) + sizeof(byName[0]));
+  size += header->strings;
+  if (size != len) return false;
+
+  const char* cp = static_cast<const char*>(addr) + sizeof(*header);
+  const uint32_t* s = reinterpret_cast<const uint32_t*>(cp);
+  cp += header->buckets * sizeof(seeds[0]);
+  const EventTagMapEntry* e = reinterpret_cast<const EventTagMapEntry*>(cp);
+  cp += header->count * sizeof(entries[0]);
+  const uint32_t* n = reinterpret_cast<const uint32_t*>(cp);
+  cp += header->count * sizeof(byName[0]);
+  if (cp[header->strings - 1] != '\0') return false;
+
+  binary = header;
+  seeds = s;
+  entries = e;
+  byName = n;
+  strings = cp;
+  return true;
+}
+
+// Every string in the pool is nul terminated, which also keeps the
+// deprecated android_lookupEventTag() from writing to our read only map.
+bool EventTagMap::binaryString(uint32_t offset, uint32_t len) const {
+  return (offset < binary->strings) && (len < (binary->strings - offset)) &&
+         (strings[offset + len] == '\0');
+}
+
+MapString EventTagMap::binaryName(uint32_t index) const {
+  const EventTagMapEntry& entry = entries[index];
+  if (!binaryString(entry.name, entry.nameLen)) return MapString(NULL, 0);
+  return MapString(strings + entry.name, entry.nameLen);
+}
+
+MapString EventTagMap::binaryFormat(uint32_t index) const {
+  const EventTagMapEntry& entry = entries[index];
+  if (!binaryString(entry.format, entry.formatLen)) return MapString(NULL, 0);
+  return MapString(strings + entry.format, entry.formatLen);
+}
+
+const char* EventTagMap::findBinary(uint32_t tag, bool format,
+                                    size_t* len) const {
+  if (!binary) return NULL;
+  uint32_t seed = seeds[eventTagHash(tag, 0) % binary->buckets];
+  uint32_t index = eventTagHash(tag, seed) % binary->count;
+  if (entries[index].tag != tag) return NULL;
+  MapString str = format ? binaryFormat(index) : binaryName(index);
+  if (!format && !str.length()) return NULL;  // corrupt
+  if (len) *len = str.length();
+  return str.data();
+}
+
+static int compareMapString(const MapString& lval, const MapString& rval) {
+  size_t len = std::min(lval.length(), rval.length());
+  int ret = len ? memcmp(lval.data(), rval.data(), len) : 0;
+  if (ret) return ret;
+  if (lval.length() == rval.length()) return 0;
+  return (lval.length() < rval.length()) ? -1 : 1;
+}
+
+// Tag number by name, and format if not NULL.  Without a format the
+// first one sorted wins, which prefers entries that have no format.
+int EventTagMap::findBinary(const MapString& tag,
+                            const MapString* format) const {
+  if (!binary || !tag.length()) return -1;
+  uint32_t count = binary->count;
+  uint32_t lo = 0, hi = count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (byName[mid] >= count) return -1;  // corrupt
+    if (compareMapString(binaryName(byName[mid]), tag) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  for (; lo < count; ++lo) {
+    uint32_t index = byName[lo];
+    if (index >= count) return -1;
+    if (binaryName(index) != tag) return -1;
+    if (!format || (binaryFormat(index) == *format)) return entries[index].tag;
+  }
+  return -1;
+}
+
+// Compile everything we know into a precompiled map.  All the tags must
+// land on a free slot for a seed in their bucket, buckets with the most
+// tags are placed while there is the most room.  Should we fail to find
+// seeds, we try again with more and smaller buckets.
+int EventTagMap::writeBinary(int fd) const {
+  std::vector<std::pair<uint32_t, std::pair<MapString, MapString>>> tags;
+  android::RWLock::AutoRLock readLock(const_cast<android::RWLock&>(rwlock));
+
+  if (binary) {
+    for (uint32_t index = 0; index < binary->count; ++index) {
+      MapString name = binaryName(index);
+      if (!name.length()) continue;
+      tags.emplace_back(entries[index].tag,
+                        std::make_pair(std::move(name), binaryFormat(index)));
+    }
+  }
+  for (auto& it : Idx2TagFmt) {
+    if (findBinary(it.first, false, NULL)) continue;
+    tags.emplace_back(
+        it.first,
+        std::make_pair(MapString(it.second.first.data(),
+                                 it.second.first.length()),
+                       MapString(it.second.second.data(),
+                                 it.second.second.length())));
+  }
+  if (tags.empty() || (tags.size() >= UINT32_MAX)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  uint32_t count = tags.size();
+  uint32_t buckets = (count + EVENT_TAG_MAP_BUCKET_LOAD - 1) /
+                     EVENT_TAG_MAP_BUCKET_LOAD;
+  std::vector<uint32_t> seed;
+  std::vector<uint32_t> slot(count);
+  for (;;) {
+    std::vector<std::vector<uint32_t>> bucket(buckets);
+    for (uint32_t i = 0; i < count; ++i) {
+      bucket[eventTagHash(tags[i].first, 0) % buckets].push_back(i);
+    }
+    std::vector<uint32_t> order(buckets);
+    for (uint32_t b = 0; b < buckets; ++b) order[b] = b;
+    std::stable_sort(order.begin(), order.end(),
+                     [&bucket](uint32_t l, uint32_t r) {
+                       return bucket[l].size() > bucket[r].size();
+                     });
+
+    seed.assign(buckets, 0);
+    std::vector<bool> used(count, false);
+    std::vector<uint32_t> placed;
+    bool ok = true;
+    for (uint32_t b : order) {
+      if (bucket[b].empty()) break;
+      static const uint32_t maxSeed = 1 << 20;
+      uint32_t s;
+      for (s = 1; s < maxSeed; ++s) {
+        placed.clear();
+        for (uint32_t i : bucket[b]) {
+          uint32_t index = eventTagHash(tags[i].first, s) % count;
+          if (used[index] || (std::find(placed.begin(), placed.end(), index) !=
+                              placed.end())) {
+            break;
+          }
+          placed.push_back(index);
+        }
+        if (placed.size() == bucket[b].size()) break;
+      }
+      if (s >= maxSeed) {
+        ok = false;
+        break;
+      }
+      seed[b] = s;
+      for (size_t i = 0; i < placed.size(); ++i) {
+        used[placed[i]] = true;
+        slot[bucket[b][i]] = placed[i];
+      }
+    }
+    if (ok) break;
+    if (buckets >= count) {
+      errno = EDOM;
+      return -1;
+    }
+    buckets = std::min(buckets * 2, count);
+  }
+
+  // String pool, formats are frequently shared
+  std::string pool;
+  std::unordered_map<std::string, uint32_t> pooled;
+  auto intern = [&pool, &pooled](const MapString& str) -> uint32_t {
+    std::string key(str.data() ? str.data() : "", str.length());
+    auto it = pooled.find(key);
+    if (it != pooled.end()) return it->second;
+    uint32_t offset = pool.length();
+    pool.append(key);
+    pool.push_back('\0');
+    pooled.emplace(std::move(key), offset);
+    return offset;
+  };
+
+  std::vector<EventTagMapEntry> entry(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    EventTagMapEntry& e = entry[slot[i]];
+    e.tag = tags[i].first;
+    e.name = intern(tags[i].second.first);
+    e.nameLen = tags[i].second.first.length();
+    e.format = intern(tags[i].second.second);
+    e.formatLen = tags[i].second.second.length();
+  }
+  if (pool.length() >= UINT32_MAX) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  std::vector<uint32_t> sorted(count);
+  for (uint32_t i = 0; i < count; ++i) sorted[i] = slot[i];
+  std::sort(sorted.begin(), sorted.end(), [&entry, &pool](uint32_t l,
+                                                          uint32_t r) {
+    const EventTagMapEntry& le = entry[l];
+    const EventTagMapEntry& re = entry[r];
+    int ret = compareMapString(MapString(&pool[le.name], le.nameLen),
+                               MapString(&pool[re.name], re.nameLen));
+    if (!ret) {
+      ret = compareMapString(MapString(&pool[le.format], le.formatLen),
+                             MapString(&pool[re.format], re.formatLen));
+    }
+    return (ret < 0) || (!ret && (le.tag < re.tag));
+  });
+
+  EventTagMapHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = EVENT_TAG_MAP_BINARY_MAGIC;
+  header.version = EVENT_TAG_MAP_BINARY_VERSION;
+  header.count = count;
+  header.buckets = buckets;
+  header.strings = pool.length();
+
+  std::string out(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.append(reinterpret_cast<const char*>(seed.data()),
+             buckets * sizeof(seed[0]));
+  out.append(reinterpret_cast<const char*>(entry.data()),
+             count * sizeof(entry[0]));
+  out.append(reinterpret_cast<const char*>(sorted.data()),
+             count * sizeof(sorted[0]));
+  out.append(pool);
+
+  const char* cp = out.data();
+  size_t len = out.length();
+  while (len) {
+    ssize_t ret = TEMP_FAILURE_RETRY(write(fd, cp, len));
+    if (ret <= 0) return -1;
+    cp += ret;
+    len -= ret;
+  }
+  return 0;
+}
+
 // The position after the end of a valid section of the tag string,
 // caller makes sure delimited appropriately.
 static const char* endOfTag(const char* cp) {
@@ -347,8 +678,18 @@ static const char* eventTagFiles[NUM_MAPS] = {
   EVENT_TAG_MAP_FILE, "/dev/event-log-tags",
 };
 
+// Sniff for a precompiled map, the text ones begin with a comment or digit.
+static bool isBinaryMap(int fd) {
+  uint32_t magic;
+  return (TEMP_FAILURE_RETRY(pread(fd, &magic, sizeof(magic), 0)) ==
+          sizeof(magic)) &&
+         (magic == EVENT_TAG_MAP_BINARY_MAGIC);
+}
+
 // Parse the tags out of the file.
 static int parseMapLines(EventTagMap* map, size_t which) {
+  if (!which && map->isBinary()) return 0;
+
   const char* cp = static_cast<char*>(map->mapAddr[which]);
   size_t len = map->mapLen[which];
   const char* endp = cp + len;
@@ -407,7 +748,8 @@ static int parseMapLines(EventTagMap* map, size_t which) {
 // Open the map file and allocate a structure to manage it.
 //
 // We create a private mapping because we want to terminate the log tag
-// strings with '\0'.
+// strings with '\0'.  A precompiled map needs no such thing, it is mapped
+// shared and read only, and preferred over the text one when present.
 LIBLOG_ABI_PUBLIC EventTagMap* android_openEventTagMap(const char* fileName) {
   EventTagMap* newTagMap;
   off_t end[NUM_MAPS];
@@ -420,7 +762,14 @@ LIBLOG_ABI_PUBLIC EventTagMap* android_openEventTagMap(const char* fileName) {
   for (which = 0; which < NUM_MAPS; ++which) {
     const char* tagfile = fileName ? fileName : eventTagFiles[which];
 
-    fd[which] = open(tagfile, O_RDONLY | O_CLOEXEC);
+    if (!which && !fileName) {
+      fd[which] = open(EVENT_TAG_MAP_BINARY_FILE, O_RDONLY | O_CLOEXEC);
+      if ((fd[which] >= 0) && !isBinaryMap(fd[which])) {
+        close(fd[which]);
+        fd[which] = -1;
+      }
+    }
+    if (fd[which] < 0) fd[which] = open(tagfile, O_RDONLY | O_CLOEXEC);
     if (fd[which] < 0) {
       if (!which) {
         save_errno = errno;
@@ -449,15 +798,22 @@ LIBLOG_ABI_PUBLIC EventTagMap* android_openEventTagMap(const char* fileName) {
 
   for (which = 0; which < NUM_MAPS; ++which) {
     if (fd[which] >= 0) {
+      bool shared = which || isBinaryMap(fd[which]);
       newTagMap->mapAddr[which] =
-          mmap(NULL, end[which], which ? PROT_READ : PROT_READ | PROT_WRITE,
-               which ? MAP_SHARED : MAP_PRIVATE, fd[which], 0);
+          mmap(NULL, end[which], shared ? PROT_READ : PROT_READ | PROT_WRITE,
+               shared ? MAP_SHARED : MAP_PRIVATE, fd[which], 0);
       save_errno = errno;
       close(fd[which]); /* fd DONE */
       fd[which] = -1;
       if ((newTagMap->mapAddr[which] != MAP_FAILED) &&
           (newTagMap->mapAddr[which] != NULL)) {
         newTagMap->mapLen[which] = end[which];
+        if (!which && shared &&
+            !newTagMap->setBinary(newTagMap->mapAddr[which], end[which])) {
+          fprintf(stderr, OUT_TAG ": invalid precompiled map '%s'\n",
+                  fileName ? fileName : EVENT_TAG_MAP_BINARY_FILE);
+          goto fail_unmap;
+        }
       } else if (!which) {
         const char* tagfile = fileName ? fileName : eventTagFiles[which];
 
@@ -540,6 +896,8 @@ LIBLOG_ABI_PUBLIC const char* android_lookupEventTag_len(const EventTagMap* map,
                                                          size_t* len,
                                                          unsigned int tag) {
   if (len) *len = 0;
+  const char* name = map->findBinary(tag, false, len);
+  if (name) return name;
   const TagFmt* str = map->find(tag);
   if (!str) {
     str = __getEventTag(const_cast<EventTagMap*>(map), tag);
@@ -553,6 +911,9 @@ LIBLOG_ABI_PUBLIC const char* android_lookupEventTag_len(const EventTagMap* map,
 LIBLOG_ABI_PUBLIC const char* android_lookupEventFormat_len(
     const EventTagMap* map, size_t* len, unsigned int tag) {
   if (len) *len = 0;
+  if (map->findBinary(tag, false, NULL)) {
+    return map->findBinary(tag, true, len);
+  }
   const TagFmt* str = map->find(tag);
   if (!str) {
     str = __getEventTag(const_cast<EventTagMap*>(map), tag);
@@ -650,3 +1011,13 @@ LIBLOG_ABI_PUBLIC int android_lookupEventTagNum(EventTagMap* map,
   if (ret == -1) errno = ESRCH;
   return ret;
 }
+
+// Write the map out in its precompiled form
+LIBLOG_ABI_PRIVATE int android_writeEventTagMapBinary(EventTagMap* map,
+                                                      int fd) {
+  if (!map || (fd < 0)) {
+    errno = EINVAL;
+    return -1;
+  }
+  return map->writeBinary(fd);
+}
@@ -683,6 +683,10 @@ LIBLOG_ABI_PUBLIC int __android_log_is_loggable_len(int prio,
   return logLevel >= 0 && prio >= logLevel;
 }
 
+LIBLOG_ABI_PUBLIC uint32_t __android_log_loggable_generation() {
+  return 0; /* the result of __android_log_is_loggable never changes */
+}
+
 LIBLOG_ABI_PRIVATE int __android_log_is_debuggable() {
   return 1;
 }
@@ -19,6 +19,7 @@
 
 #include <errno.h>
 #include <stdint.h>
+#include <string.h>
 
 #if (defined(__cplusplus) && defined(_USING_LIBCXX))
 extern "C++" {
@@ -303,6 +304,168 @@ class android_log_event_list {
     return android_log_peek_next(ctx);
   }
 };
+
+/*
+ * Allocation free alternative to android_log_event_list for writing, the
+ * elements are serialized directly into a caller supplied buffer, typically
+ * on the stack, in the same format.  Elements that do not fit are dropped,
+ * truncating the event as the list API does.  Nested lists not supported.
+ *
+ *   uint8_t buffer[64];
+ *   android_log_event_builder builder(buffer);
+ *   builder << int32_t(1) << "two" << 3.0f;
+ *   builder.write(tag);
+ */
+class android_log_event_builder {
+  uint8_t* buffer;
+  size_t size;
+  size_t pos;
+  unsigned count;
+  bool overflow;
+
+  android_log_event_builder(const android_log_event_builder&) = delete;
+  void operator=(const android_log_event_builder&) = delete;
+
+  static constexpr size_t header = sizeof(uint8_t) + sizeof(uint8_t);
+  static constexpr size_t maximum =
+      LOGGER_ENTRY_MAX_PAYLOAD - sizeof(int32_t) /* tag */;
+
+  bool reserve(size_t needed) {
+    if (overflow || ((pos + needed) > size) || (count >= UINT8_MAX)) {
+      overflow = true;
+      return false;
+    }
+    return true;
+  }
+  void put(uint8_t type) {
+    buffer[pos++] = type;
+  }
+  void put4LE(uint32_t value) {
+    for (size_t i = 0; i < sizeof(value); ++i, value >>= 8) {
+      buffer[pos++] = value & 0xFF;
+    }
+  }
+  void put8LE(uint64_t value) {
+    for (size_t i = 0; i < sizeof(value); ++i, value >>= 8) {
+      buffer[pos++] = value & 0xFF;
+    }
+  }
+
+ public:
+  android_log_event_builder(uint8_t* buffer, size_t size)
+      : buffer(buffer),
+        size((size > maximum) ? maximum : size),
+        pos(header),
+        count(0),
+        overflow(size < header) {
+  }
+  template <size_t N>
+  explicit android_log_event_builder(uint8_t (&buffer)[N])
+      : android_log_event_builder(buffer, N) {
+  }
+
+  android_log_event_builder& operator<<(int32_t value) {
+    if (reserve(sizeof(uint8_t) + sizeof(value))) {
+      put(EVENT_TYPE_INT);
+      put4LE(value);
+      ++count;
+    }
+    return *this;
+  }
+  android_log_event_builder& operator<<(uint32_t value) {
+    return *this << static_cast<int32_t>(value);
+  }
+  android_log_event_builder& operator<<(bool value) {
+    return *this << static_cast<int32_t>(value ? 1 : 0);
+  }
+  android_log_event_builder& operator<<(int64_t value) {
+    if (reserve(sizeof(uint8_t) + sizeof(value))) {
+      put(EVENT_TYPE_LONG);
+      put8LE(value);
+      ++count;
+    }
+    return *this;
+  }
+  android_log_event_builder& operator<<(uint64_t value) {
+    return *this << static_cast<int64_t>(value);
+  }
+  android_log_event_builder& operator<<(float value) {
+    if (reserve(sizeof(uint8_t) + sizeof(value))) {
+      uint32_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      put(EVENT_TYPE_FLOAT);
+      put4LE(bits);
+      ++count;
+    }
+    return *this;
+  }
+  bool Append(const char* value, size_t len) {
+    static const size_t needed = sizeof(uint8_t) + sizeof(uint32_t);
+    if (!reserve(needed)) {
+      return false;
+    }
+    if (len > (size - pos - needed)) { /* truncate to fit, as the list API */
+      len = size - pos - needed;
+      overflow = true;
+    }
+    put(EVENT_TYPE_STRING);
+    put4LE(len);
+    if (len) {
+      memcpy(&buffer[pos], value, len);
+      pos += len;
+    }
+    ++count;
+    return !overflow;
+  }
+  android_log_event_builder& operator<<(const char* value) {
+    Append(value ? value : "", value ? strlen(value) : 0);
+    return *this;
+  }
+#if defined(_USING_LIBCXX)
+  android_log_event_builder& operator<<(const std::string& value) {
+    Append(value.data(), value.length());
+    return *this;
+  }
+#endif
+
+  bool overflowed() const {
+    return overflow;
+  }
+
+  /* Payload, excluding the tag, as __android_log_bwrite() expects it */
+  const uint8_t* payload(size_t* len) {
+    if (count <= 1) { /* it's not a list */
+      *len = pos - header;
+      return buffer + header;
+    }
+    buffer[0] = EVENT_TYPE_LIST;
+    buffer[1] = count;
+    *len = pos;
+    return buffer;
+  }
+
+  /* NB: LOG_ID_EVENTS only, returns as __android_log_bwrite() */
+  int write(int32_t tag) {
+    if (size < header) return -EINVAL;
+    size_t len;
+    const uint8_t* msg = payload(&len);
+    return __android_log_bwrite(tag, msg, len);
+  }
+};
+
+/*
+ * All elements of an event in one call, serialized on the stack.
+ *
+ *   android_log_event_write(tag, int32_t(1), "two", 3.0f);
+ */
+template <typename... Targs>
+int android_log_event_write(int32_t tag, const Targs&... args) {
+  uint8_t buffer[LOGGER_ENTRY_MAX_PAYLOAD - sizeof(int32_t)];
+  android_log_event_builder builder(buffer);
+  int unused[] = { 0, ((void)(builder << args), 0)... };
+  (void)unused;
+  return builder.write(tag);
+}
 }
 #endif
 #endif
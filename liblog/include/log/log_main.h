@@ -304,6 +304,7 @@ __BEGIN_DECLS
  */
 #ifndef ALOG
 #define ALOG(priority, tag, ...) LOG_PRI(ANDROID_##priority, tag, __VA_ARGS__)
+#define __ANDROID_ALOG_DEFAULT /* may be replaced by the C++ fast path */
 #endif
 
 /*
@@ -326,7 +327,9 @@ __BEGIN_DECLS
 
 #ifndef __ANDROID_USE_LIBLOG_LOGGABLE_INTERFACE
 #ifndef __ANDROID_API__
-#define __ANDROID_USE_LIBLOG_LOGGABLE_INTERFACE 2
+#define __ANDROID_USE_LIBLOG_LOGGABLE_INTERFACE 3
+#elif __ANDROID_API__ > 26 /* > Oreo */
+#define __ANDROID_USE_LIBLOG_LOGGABLE_INTERFACE 3
 #elif __ANDROID_API__ > 24 /* > Nougat */
 #define __ANDROID_USE_LIBLOG_LOGGABLE_INTERFACE 2
 #elif __ANDROID_API__ > 22 /* > Lollipop */
@@ -347,6 +350,7 @@ __BEGIN_DECLS
 int __android_log_is_loggable(int prio, const char* tag, int default_prio);
 
 #if __ANDROID_USE_LIBLOG_LOGGABLE_INTERFACE > 1
+#include <stdint.h>
 #include <sys/types.h>
 
 int __android_log_is_loggable_len(int prio, const char* tag, size_t len,
@@ -362,6 +366,14 @@ int __android_log_is_loggable_len(int prio, const char* tag, size_t len,
                                  ANDROID_LOG_VERBOSE) != 0)
 #endif
 
+#if __ANDROID_USE_LIBLOG_LOGGABLE_INTERFACE > 2
+/*
+ * A number that changes whenever any system property that may affect the
+ * result of __android_log_is_loggable() changes.
+ */
+uint32_t __android_log_loggable_generation();
+#endif
+
 #else
 
 #if LOG_NDEBUG /* Production */
@@ -380,10 +392,104 @@ int __android_log_is_loggable_len(int prio, const char* tag, size_t len,
 
 #endif /* !__ANDROID_USE_LIBLOG_LOGGABLE_INTERFACE */
 
+__END_DECLS
+
+/*
+ * C++ fast path for testing whether a message would be logged.
+ *
+ * Priorities below LOG_PRI_FLOOR, set at build time, are never logged and
+ * the message is removed by the compiler along with its arguments.
+ *
+ * Otherwise, for a constant priority and tag, the result is cached at the
+ * call site and only computed again once __android_log_loggable_generation()
+ * moves on, rather than revalidating the property cache on every call.
+ * ALOG and friends skip formatting disabled messages as a result.
+ */
+#if defined(__cplusplus) && (__ANDROID_USE_LIBLOG_LOGGABLE_INTERFACE > 2)
+#include <string.h>
+
+#include <atomic>
+
+#ifndef LOG_PRI_FLOOR
+#define LOG_PRI_FLOOR ANDROID_LOG_VERBOSE
+#endif
+
+extern "C++" {
+static constexpr bool __android_log_above_floor(int prio) {
+  return prio >= LOG_PRI_FLOOR;
+}
+
+class __android_log_loggable_cache {
+  /* generation << 32 | prio << 8 | valid << 1 | loggable */
+  std::atomic<uint64_t> state;
+  /* first tag seen, any other tag falls back to the uncached check */
+  std::atomic<const char*> owner;
+
+ public:
+  constexpr __android_log_loggable_cache() : state(0), owner(nullptr) {
+  }
+
+  bool test(int prio, const char* tag, int default_prio) {
+    static const char empty[] = "";
+    const char* key = tag ? tag : empty;
+    const char* expected = nullptr;
+    if (!owner.compare_exchange_strong(expected, key,
+                                       std::memory_order_relaxed) &&
+        (expected != key)) {
+      return __android_log_is_loggable_len(prio, tag,
+                                           (tag && *tag) ? strlen(tag) : 0,
+                                           default_prio) != 0;
+    }
+
+    uint64_t generation = __android_log_loggable_generation();
+    uint64_t current = state.load(std::memory_order_relaxed);
+    uint64_t match = (generation << 32) | ((prio & 0xFF) << 8) | 2;
+    if ((current & ~1ULL) == match) {
+      return current & 1;
+    }
+    bool loggable = __android_log_is_loggable_len(
+                        prio, tag, (tag && *tag) ? strlen(tag) : 0,
+                        default_prio) != 0;
+    state.store(match | loggable, std::memory_order_relaxed);
+    return loggable;
+  }
+};
+}
+
+#define __android_log_fast_loggable(prio, tag, default_prio)              \
+  (__android_log_above_floor(prio) &&                                    \
+   ((__builtin_constant_p(prio) && __builtin_constant_p(tag))            \
+        ? ({                                                             \
+            static __android_log_loggable_cache __android_log_cache;     \
+            __android_log_cache.test(prio, tag, default_prio);           \
+          })                                                             \
+        : (__android_log_is_loggable_len(prio, tag,                      \
+                                         (tag && *tag) ? strlen(tag) : 0, \
+                                         default_prio) != 0)))
+
+#undef android_testLog
+#if LOG_NDEBUG /* Production */
+#define android_testLog(prio, tag) \
+  __android_log_fast_loggable(prio, tag, ANDROID_LOG_DEBUG)
+#else
+#define android_testLog(prio, tag) \
+  __android_log_fast_loggable(prio, tag, ANDROID_LOG_VERBOSE)
+#endif
+
+#ifdef __ANDROID_ALOG_DEFAULT
+#undef ALOG
+/* Same default priority as the check made by __android_log_print() */
+#define ALOG(priority, tag, ...)                                         \
+  (__android_log_fast_loggable(ANDROID_##priority, tag,                  \
+                               ANDROID_LOG_VERBOSE)                      \
+       ? LOG_PRI(ANDROID_##priority, tag, __VA_ARGS__)                   \
+       : -1 /* -EPERM */)
+#endif
+
+#endif /* __cplusplus && __ANDROID_USE_LIBLOG_LOGGABLE_INTERFACE > 2 */
+
 #if defined(__clang__)
 #pragma clang diagnostic pop
 #endif
 
-__END_DECLS
-
 #endif /* _LIBS_LOG_LOG_MAIN_H */
@@ -146,6 +146,18 @@ char* android_log_formatLogLine(AndroidLogFormat* p_format, char* defaultBuffer,
                                 const AndroidLogEntry* p_line,
                                 size_t* p_outLength);
 
+/**
+ * Formats a log message into a buffer owned by p_format, valid until the
+ * next call or android_log_format_free(). The buffer is reused and grown as
+ * needed, the time and uid columns are cached between consecutive entries.
+ * Returns NULL on malloc error
+ *
+ * Assumes single threaded execution
+ */
+const char* android_log_formatLogLineArena(AndroidLogFormat* p_format,
+                                           const AndroidLogEntry* p_line,
+                                           size_t* p_outLength);
+
 /**
  * Either print or do not print log line, based on filter
  *
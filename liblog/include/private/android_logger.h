@@ -55,6 +55,37 @@ typedef struct __attribute__((__packed__)) {
   log_time realtime;
 } android_log_header_t;
 
+/*
+ * Shared memory ring to logd, LOGGER_SHM.  The writer creates the mapping
+ * and passes its descriptor over /dev/socket/logdshm, logd drains it for as
+ * long as that connection stays open.  Writers reserve space by advancing
+ * head, then publish each record by storing its size last.  logd zeroes the
+ * records it consumed before advancing tail.  All the fields after size are
+ * only accessed with __atomic builtins, by both sides.
+ */
+#define ANDROID_LOG_SHM_MAGIC 0x4d48534c /* "LSHM" */
+#define ANDROID_LOG_SHM_VERSION 1
+#define ANDROID_LOG_SHM_SIZE (256 * 1024) /* ring data, power of two */
+#define ANDROID_LOG_SHM_ALIGN 8           /* of each record */
+#define ANDROID_LOG_SHM_PAD 0xFFFF        /* record len, skip to the end */
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;     /* of the ring data that follows the header */
+  uint32_t futex;    /* bumped by writers to wake logd */
+  uint32_t sleeping; /* logd is waiting on futex */
+  uint32_t dropped;  /* ring was full, reported and reset by logd */
+  uint64_t head __attribute__((__aligned__(64))); /* reserved by writers */
+  uint64_t tail __attribute__((__aligned__(64))); /* consumed by logd */
+} __attribute__((__aligned__(64))) android_log_shm_t;
+
+typedef struct __attribute__((__packed__)) {
+  uint32_t size; /* of the record including alignment, zero until published */
+  uint16_t len;  /* of the payload that follows, or ANDROID_LOG_SHM_PAD */
+  android_log_header_t header;
+} android_log_shm_record_t;
+
 /* Event Header Structure to logd */
 typedef struct __attribute__((__packed__)) {
   int32_t tag;  // Little Endian Order
@@ -135,6 +166,12 @@ int __android_log_security_bwrite(int32_t tag, const void* payload, size_t len);
 int __android_log_security_bswrite(int32_t tag, const char* payload);
 int __android_log_security(); /* Device Owner is present */
 
+/* Messages dropped by LOGGER_ASYNC since the process started */
+unsigned long __android_log_async_dropped();
+
+/* Messages dropped by LOGGER_SHM since the process started */
+unsigned long __android_log_shm_dropped();
+
 #define BOOL_DEFAULT_FLAG_TRUE_FALSE 0x1
 #define BOOL_DEFAULT_FALSE 0x0        /* false if property not present   */
 #define BOOL_DEFAULT_TRUE 0x1         /* true if property not present    */
@@ -153,6 +190,32 @@ bool __android_logger_valid_buffer_size(unsigned long value);
 /* Retrieve the composed event buffer */
 int android_log_write_list_buffer(android_log_context ctx, const char** msg);
 
+/*
+ * Write an event tag map in the precompiled form android_openEventTagMap()
+ * prefers, see event-log-tags-compile.  Returns 0, or -1 and errno.
+ */
+struct EventTagMap;
+int android_writeEventTagMapBinary(struct EventTagMap* map, int fd);
+
+/*
+ * Ask logd to only send what passes these filters: per tag priorities as
+ * android_log_addFilterRule() resolves them (NULL tag for the default, the
+ * first rule given for a tag wins), any of the pids, and a regex the message
+ * must partially match.  Advisory, other transports and older logd ignore
+ * them, the reader must still filter what it gets.  Must be set before the
+ * first read.  Returns 0, or -errno.
+ */
+int android_logger_list_filter_priority(struct logger_list* logger_list,
+                                        const char* tag,
+                                        android_LogPriority pri);
+int android_logger_list_filter_pid(struct logger_list* logger_list, pid_t pid);
+int android_logger_list_filter_regex(struct logger_list* logger_list,
+                                     const char* regex);
+/* All the tag and priority rules of an AndroidLogFormat, in logprint.c */
+struct AndroidLogFormat_t;
+int android_logger_list_filter_format(struct logger_list* logger_list,
+                                      struct AndroidLogFormat_t* p_format);
+
 #ifdef __cplusplus
 #ifdef __class_android_log_event_list_defined
 #ifndef __class_android_log_event_list_private_defined
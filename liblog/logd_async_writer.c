@@ -0,0 +1,540 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Asynchronous variant of the logd transport, selected with
+ * android_set_log_transport(LOGGER_LOGD | LOGGER_ASYNC).
+ *
+ * Each writing thread copies its messages into a private single producer,
+ * single consumer, ring without taking any lock or making a system call.
+ * A flusher thread drains all the rings and sends their content to
+ * /dev/socket/logdw with one sendmmsg() per batch.  If a ring is full the
+ * message is dropped and counted, the count is reported to logd as a
+ * liblog event along with the next batch, as the synchronous transport does
+ * when the socket is full.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <private/android_filesystem_config.h>
+#include <private/android_logger.h>
+
+#include "config_write.h"
+#include "log_portability.h"
+#include "logger.h"
+
+#define ASYNC_RING_SIZE (16 * 1024) /* per thread, power of two */
+#define ASYNC_MAX_BATCH 64
+#define ASYNC_FLUSH_NSEC (5 * 1000000) /* batching delay while busy */
+
+#define ASYNC_PAD 0xFFFF /* async_record len, skip to the end of the ring */
+
+/* Message as queued, header and payload are sent as one contiguous iovec */
+struct __attribute__((__packed__)) async_record {
+  uint16_t size; /* of the record including alignment */
+  uint16_t len;  /* of the payload that follows */
+  android_log_header_t header;
+};
+
+struct async_ring {
+  struct async_ring* next; /* registry, only unlinked by the flusher */
+  atomic_size_t head;      /* only advanced by the owning thread */
+  atomic_size_t tail;      /* only advanced by the flusher */
+  atomic_flag busy;        /* owner is writing, catches signal reentry */
+  atomic_bool orphaned;    /* owning thread has exited */
+  char data[ASYNC_RING_SIZE];
+};
+
+static int asyncAvailable(log_id_t LogId);
+static int asyncOpen();
+static void asyncClose();
+static int asyncWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
+                      size_t nr);
+
+LIBLOG_HIDDEN struct android_log_transport_write logdAsyncLoggerWrite = {
+  .node = { &logdAsyncLoggerWrite.node, &logdAsyncLoggerWrite.node },
+  .context.sock = -EBADF,
+  .name = "logd_async",
+  .available = asyncAvailable,
+  .open = asyncOpen,
+  .close = asyncClose,
+  .write = asyncWrite,
+};
+
+static atomic_uintptr_t rings; /* struct async_ring* registry head */
+static pthread_key_t ringKey;
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+
+static atomic_ulong dropped;      /* not yet reported to logd */
+static atomic_ulong droppedTotal; /* __android_log_async_dropped() */
+
+static pthread_mutex_t flusherLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flusherCondition = PTHREAD_COND_INITIALIZER;
+static pthread_t flusherThread;
+static atomic_bool flusherRunning;
+static atomic_bool flusherSleeping;
+static bool flusherExit; /* flusherLock */
+
+static size_t align4(size_t size) {
+  return (size + 3) & ~(size_t)3;
+}
+
+static void ringOrphan(void* arg) {
+  struct async_ring* ring = arg;
+  atomic_store(&ring->orphaned, true);
+}
+
+static void ringKeyCreate() {
+  pthread_key_create(&ringKey, ringOrphan);
+}
+
+/* Ring of the calling thread, allocated and registered on first use */
+static struct async_ring* ringGet() {
+  struct async_ring* ring;
+  uintptr_t first;
+
+  pthread_once(&ringKeyOnce, ringKeyCreate);
+  ring = pthread_getspecific(ringKey);
+  if (ring) {
+    return ring;
+  }
+
+  ring = calloc(1, sizeof(*ring));
+  if (!ring) {
+    return NULL;
+  }
+  atomic_flag_clear(&ring->busy);
+  first = atomic_load(&rings);
+  do {
+    ring->next = (struct async_ring*)first;
+  } while (!atomic_compare_exchange_weak(&rings, &first, (uintptr_t)ring));
+  pthread_setspecific(ringKey, ring);
+  return ring;
+}
+
+static void flusherWake() {
+  pthread_mutex_lock(&flusherLock);
+  atomic_store(&flusherSleeping, false);
+  pthread_cond_signal(&flusherCondition);
+  pthread_mutex_unlock(&flusherLock);
+}
+
+static int asyncConnect() {
+  struct sockaddr_un un;
+  int sock = TEMP_FAILURE_RETRY(
+      socket(PF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0));
+  if (sock < 0) {
+    return -errno;
+  }
+
+  memset(&un, 0, sizeof(struct sockaddr_un));
+  un.sun_family = AF_UNIX;
+  strcpy(un.sun_path, "/dev/socket/logdw");
+  if (TEMP_FAILURE_RETRY(connect(sock, (struct sockaddr*)&un,
+                                 sizeof(struct sockaddr_un))) < 0) {
+    int ret = -errno;
+    close(sock);
+    return ret;
+  }
+  return sock;
+}
+
+/* flusher thread only, returns the number of messages sent */
+static size_t asyncSend(struct mmsghdr* msgs, size_t count) {
+  size_t sent = 0;
+  int sock = atomic_load(&logdAsyncLoggerWrite.context.sock);
+  bool retry = true;
+
+  while (sent < count) {
+    int ret = -EBADF;
+    if (sock >= 0) {
+      ret = TEMP_FAILURE_RETRY(sendmmsg(sock, msgs + sent, count - sent, 0));
+      if (ret < 0) {
+        ret = -errno;
+      }
+    }
+    if (ret > 0) {
+      sent += ret;
+      continue;
+    }
+    switch (ret) {
+      case -ENOTCONN:
+      case -ECONNREFUSED:
+      case -ENOENT:
+      case -EBADF:
+        if (retry) { /* logd restarted? */
+          retry = false;
+          sock = asyncConnect();
+          ret = atomic_exchange(&logdAsyncLoggerWrite.context.sock, sock);
+          if (ret >= 0) {
+            close(ret);
+          }
+          continue;
+        }
+      /* FALLTHRU */
+      default:
+        break;
+    }
+    break;
+  }
+  return sent;
+}
+
+/* Report messages dropped since the last report as a liblog event */
+static void asyncReport() {
+  struct async_record record;
+  android_log_event_int_t buffer;
+  struct iovec iov[2];
+  struct mmsghdr msg;
+  struct timespec now;
+  unsigned long snapshot = atomic_exchange(&dropped, 0);
+
+  if (!snapshot ||
+      !__android_log_is_loggable_len(ANDROID_LOG_INFO, "liblog",
+                                     strlen("liblog"), ANDROID_LOG_VERBOSE)) {
+    return;
+  }
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  record.header.id = LOG_ID_EVENTS;
+  record.header.tid = gettid();
+  record.header.realtime.tv_sec = now.tv_sec;
+  record.header.realtime.tv_nsec = now.tv_nsec;
+  buffer.header.tag = htole32(LIBLOG_LOG_TAG);
+  buffer.payload.type = EVENT_TYPE_INT;
+  buffer.payload.data = htole32(snapshot);
+
+  iov[0].iov_base = &record.header;
+  iov[0].iov_len = sizeof(record.header);
+  iov[1].iov_base = &buffer;
+  iov[1].iov_len = sizeof(buffer);
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_hdr.msg_iov = iov;
+  msg.msg_hdr.msg_iovlen = 2;
+  if (!asyncSend(&msg, 1)) {
+    atomic_fetch_add(&dropped, snapshot);
+  }
+}
+
+/* Send everything queued in ring, returns number of records */
+static size_t asyncDrain(struct async_ring* ring) {
+  struct mmsghdr msgs[ASYNC_MAX_BATCH];
+  struct iovec iov[ASYNC_MAX_BATCH];
+  size_t total = 0;
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+  while (tail != head) {
+    size_t count = 0;
+
+    memset(msgs, 0, sizeof(msgs));
+    while ((tail != head) && (count < ASYNC_MAX_BATCH)) {
+      struct async_record* record =
+          (struct async_record*)&ring->data[tail & (ASYNC_RING_SIZE - 1)];
+      tail += record->size;
+      if (record->len == ASYNC_PAD) {
+        continue;
+      }
+      iov[count].iov_base = &record->header;
+      iov[count].iov_len = sizeof(record->header) + record->len;
+      msgs[count].msg_hdr.msg_iov = &iov[count];
+      msgs[count].msg_hdr.msg_iovlen = 1;
+      ++count;
+    }
+    if (count) {
+      /* bounded loss, the remainder of a failed batch is dropped */
+      size_t sent = asyncSend(msgs, count);
+      atomic_fetch_add(&dropped, count - sent);
+      atomic_fetch_add(&droppedTotal, count - sent);
+    }
+    /* records are left in place until sent, release them */
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    total += count;
+  }
+  return total;
+}
+
+/*
+ * Flush all rings, freeing those of exited threads once they are empty.
+ * Returns the number of records sent.
+ */
+static size_t asyncFlush() {
+  size_t total = 0;
+  struct async_ring** prev = NULL;
+  struct async_ring* ring = (struct async_ring*)atomic_load(&rings);
+
+  asyncReport();
+  while (ring) {
+    struct async_ring* next = ring->next;
+    bool orphaned = atomic_load(&ring->orphaned);
+
+    total += asyncDrain(ring);
+
+    if (orphaned) {
+      /* producers only ever push onto the registry head */
+      uintptr_t expected = (uintptr_t)ring;
+      if (prev) {
+        *prev = next;
+        free(ring);
+        ring = next;
+        continue;
+      }
+      if (atomic_compare_exchange_strong(&rings, &expected,
+                                         (uintptr_t)next)) {
+        free(ring);
+        ring = next;
+        continue;
+      }
+      /* lost the race with a new thread, catch it on the next pass */
+    }
+    prev = &ring->next;
+    ring = next;
+  }
+  return total;
+}
+
+static bool asyncEmpty() {
+  struct async_ring* ring = (struct async_ring*)atomic_load(&rings);
+  for (; ring; ring = ring->next) {
+    if (atomic_load(&ring->head) != atomic_load(&ring->tail)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void* asyncFlusher(void* arg __unused) {
+  prctl(PR_SET_NAME, "liblog.async");
+
+  pthread_mutex_lock(&flusherLock);
+  while (!flusherExit) {
+    pthread_mutex_unlock(&flusherLock);
+    size_t total = asyncFlush();
+    pthread_mutex_lock(&flusherLock);
+
+    if (flusherExit) {
+      break;
+    }
+    if (total) {
+      /* busy, give the writers a moment to fill the next batch */
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += ASYNC_FLUSH_NSEC;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_nsec -= 1000000000;
+        ++deadline.tv_sec;
+      }
+      pthread_cond_timedwait(&flusherCondition, &flusherLock, &deadline);
+      continue;
+    }
+
+    /* idle, writers wake us with the first message */
+    atomic_store(&flusherSleeping, true);
+    pthread_mutex_unlock(&flusherLock);
+    bool empty = asyncEmpty();
+    pthread_mutex_lock(&flusherLock);
+    while (empty && !flusherExit && atomic_load(&flusherSleeping)) {
+      pthread_cond_wait(&flusherCondition, &flusherLock);
+    }
+    atomic_store(&flusherSleeping, false);
+  }
+  pthread_mutex_unlock(&flusherLock);
+
+  /* __android_log_close(), make sure nothing queued is lost */
+  asyncFlush();
+  return NULL;
+}
+
+static void asyncForkChild() {
+  /* threads do not survive fork, run the flusher again on demand */
+  pthread_mutex_init(&flusherLock, NULL);
+  pthread_cond_init(&flusherCondition, NULL);
+  atomic_store(&flusherRunning, false);
+  atomic_store(&flusherSleeping, false);
+}
+
+static pthread_once_t forkOnce = PTHREAD_ONCE_INIT;
+
+static void asyncForkRegister() {
+  pthread_atfork(NULL, NULL, asyncForkChild);
+}
+
+static int asyncStart() {
+  int ret = 0;
+
+  pthread_once(&forkOnce, asyncForkRegister);
+  pthread_mutex_lock(&flusherLock);
+  if (!atomic_load(&flusherRunning)) {
+    flusherExit = false;
+    ret = -pthread_create(&flusherThread, NULL, asyncFlusher, NULL);
+    if (!ret) {
+      atomic_store(&flusherRunning, true);
+    }
+  }
+  pthread_mutex_unlock(&flusherLock);
+  return ret;
+}
+
+/* log_init_lock assumed */
+static int asyncOpen() {
+  int sock = atomic_load(&logdAsyncLoggerWrite.context.sock);
+
+  if (sock < 0) {
+    sock = asyncConnect();
+    if (sock < 0) {
+      return sock;
+    }
+    sock = atomic_exchange(&logdAsyncLoggerWrite.context.sock, sock);
+    if (sock >= 0) {
+      close(sock);
+    }
+  }
+  return asyncStart();
+}
+
+/* log_init_lock assumed */
+static void asyncClose() {
+  int sock;
+
+  if (atomic_load(&flusherRunning)) {
+    pthread_mutex_lock(&flusherLock);
+    flusherExit = true;
+    pthread_cond_signal(&flusherCondition);
+    pthread_mutex_unlock(&flusherLock);
+    pthread_join(flusherThread, NULL);
+    atomic_store(&flusherRunning, false);
+  }
+
+  sock = atomic_exchange(&logdAsyncLoggerWrite.context.sock, -EBADF);
+  if (sock >= 0) {
+    close(sock);
+  }
+}
+
+static int asyncAvailable(log_id_t logId) {
+  if (logId >= LOG_ID_MAX || logId == LOG_ID_KERNEL) {
+    return -EINVAL;
+  }
+  if (atomic_load(&logdAsyncLoggerWrite.context.sock) < 0) {
+    if (access("/dev/socket/logdw", W_OK) == 0) {
+      return 0;
+    }
+    return -EBADF;
+  }
+  return 1;
+}
+
+static int asyncWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
+                      size_t nr) {
+  struct async_ring* ring;
+  struct async_record* record;
+  size_t i, len, size, head, tail, offset, used;
+  char* payload;
+
+  /* logd, after initialization and priv drop */
+  if (__android_log_uid() == AID_LOGD) {
+    return 0;
+  }
+
+  if (!atomic_load_explicit(&flusherRunning, memory_order_relaxed) &&
+      (asyncStart() < 0)) {
+    return -EBADF;
+  }
+
+  ring = ringGet();
+  if (!ring) {
+    return -ENOMEM;
+  }
+  if (atomic_flag_test_and_set_explicit(&ring->busy, memory_order_acquire)) {
+    /* reentered from a signal handler while queueing */
+    atomic_fetch_add(&droppedTotal, 1);
+    atomic_fetch_add(&dropped, 1);
+    return -EAGAIN;
+  }
+
+  for (len = i = 0; i < nr; ++i) {
+    len += vec[i].iov_len;
+  }
+  if (len > LOGGER_ENTRY_MAX_PAYLOAD) {
+    len = LOGGER_ENTRY_MAX_PAYLOAD;
+  }
+  size = align4(sizeof(*record) + len);
+
+  head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  offset = head & (ASYNC_RING_SIZE - 1);
+  used = (ASYNC_RING_SIZE - offset < size) ? ASYNC_RING_SIZE - offset : 0;
+  if ((ASYNC_RING_SIZE - (head - tail)) < (used + size)) {
+    atomic_flag_clear_explicit(&ring->busy, memory_order_release);
+    atomic_fetch_add(&droppedTotal, 1);
+    atomic_fetch_add(&dropped, 1);
+    flusherWake();
+    return -EAGAIN;
+  }
+
+  if (used) { /* does not fit before the end of the ring, pad */
+    record = (struct async_record*)&ring->data[offset];
+    record->size = used;
+    record->len = ASYNC_PAD;
+    head += used;
+    offset = 0;
+  }
+
+  record = (struct async_record*)&ring->data[offset];
+  record->size = size;
+  record->len = len;
+  record->header.id = logId;
+  record->header.tid = gettid();
+  record->header.realtime.tv_sec = ts->tv_sec;
+  record->header.realtime.tv_nsec = ts->tv_nsec;
+  payload = (char*)(record + 1);
+  for (i = 0, used = 0; (i < nr) && (used < len); ++i) {
+    size_t chunk = vec[i].iov_len;
+    if (chunk > (len - used)) {
+      chunk = len - used;
+    }
+    memcpy(payload + used, vec[i].iov_base, chunk);
+    used += chunk;
+  }
+
+  atomic_store_explicit(&ring->head, head + size, memory_order_release);
+  atomic_flag_clear_explicit(&ring->busy, memory_order_release);
+  /* pairs with the flusher setting flusherSleeping then checking rings */
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if (atomic_load(&flusherSleeping) ||
+      ((head + size - tail) > (ASYNC_RING_SIZE / 2))) {
+    flusherWake();
+  }
+
+  return len;
+}
+
+LIBLOG_ABI_PRIVATE unsigned long __android_log_async_dropped() {
+  return atomic_load(&droppedTotal);
+}
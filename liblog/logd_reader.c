@@ -458,13 +458,43 @@ static ssize_t logdSetPrune(struct android_log_logger_list* logger_list __unused
 static void caught_signal(int signum __unused) {
 }
 
+/*
+ * logd reader request keys for the android_logger_list_filter_*() calls,
+ * returns len if they do not all fit.
+ */
+static int logdFilter(struct android_log_logger_list* logger_list, char* buf,
+                      int len) {
+  char pri[16];
+  const char* keys[] = { " prio=", " tags=", " pids=", " regex=" };
+  const char* values[] = { logger_list->filter_pri ? pri : NULL,
+                           logger_list->filter_tags, logger_list->filter_pids,
+                           logger_list->filter_regex };
+  size_t i;
+  int ret = 0;
+
+  snprintf(pri, sizeof(pri), "%d", logger_list->filter_pri);
+  for (i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+    int n;
+
+    if (!values[i]) {
+      continue;
+    }
+    n = snprintf(buf + ret, len - ret, "%s%s", keys[i], values[i]);
+    if ((n < 0) || (n >= (len - ret))) {
+      return len;
+    }
+    ret += n;
+  }
+  return ret;
+}
+
 static int logdOpen(struct android_log_logger_list* logger_list,
                     struct android_log_transport_context* transp) {
   struct android_log_logger* logger;
   struct sigaction ignore;
   struct sigaction old_sigaction;
   unsigned int old_alarm = 0;
-  char buffer[256], *cp, c;
+  char buffer[1024], *cp, c;
   int e, ret, remaining, sock;
 
   if (!logger_list) {
@@ -534,6 +564,13 @@ static int logdOpen(struct android_log_logger_list* logger_list,
   if (logger_list->pid) {
     ret = snprintf(cp, remaining, " pid=%u", logger_list->pid);
     ret = min(ret, remaining);
+    remaining -= ret;
+    cp += ret;
+  }
+
+  /* All or nothing, logd only ever filters less than we do */
+  ret = logdFilter(logger_list, cp, remaining);
+  if (ret < remaining) {
     cp += ret;
   }
 
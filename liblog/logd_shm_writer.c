@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Shared memory variant of the logd transport, selected with
+ * android_set_log_transport(LOGGER_SHM).
+ *
+ * The process creates a sealed memfd ring and hands it to logd over
+ * /dev/socket/logdshm, logd only accepts rings from system uids.  Writers
+ * then copy their messages into the ring without a system call, logd is
+ * woken with a futex only when it went to sleep on an empty ring.  If the
+ * ring is full the message is dropped and counted, logd reports the count
+ * as a liblog event on behalf of the process.
+ *
+ * If logd refuses the ring, or does not listen on logdshm, messages are sent
+ * over /dev/socket/logdw as the logd transport does.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <private/android_filesystem_config.h>
+#include <private/android_logger.h>
+
+#include "config_write.h"
+#include "log_portability.h"
+#include "logger.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#endif
+#ifndef F_SEAL_SEAL
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+#define SHM_MAPPING_SIZE (sizeof(android_log_shm_t) + ANDROID_LOG_SHM_SIZE)
+
+static int shmAvailable(log_id_t LogId);
+static int shmOpen();
+static void shmClose();
+static int shmWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
+                    size_t nr);
+
+LIBLOG_HIDDEN struct android_log_transport_write logdShmLoggerWrite = {
+  .node = { &logdShmLoggerWrite.node, &logdShmLoggerWrite.node },
+  .context.sock = -EBADF,
+  .name = "logd_shm",
+  .available = shmAvailable,
+  .open = shmOpen,
+  .close = shmClose,
+  .write = shmWrite,
+};
+
+extern struct android_log_transport_write logdLoggerWrite;
+
+static pthread_mutex_t shmLock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_uintptr_t shmRing; /* android_log_shm_t*, registered */
+static atomic_bool shmFallback;  /* logd refused, use logdLoggerWrite */
+static atomic_ulong droppedTotal; /* __android_log_shm_dropped() */
+
+static size_t align(size_t size) {
+  return (size + ANDROID_LOG_SHM_ALIGN - 1) &
+         ~(size_t)(ANDROID_LOG_SHM_ALIGN - 1);
+}
+
+static int shmFutexWake(uint32_t* futex) {
+  /* not FUTEX_PRIVATE_FLAG, the waiter is in another process */
+  return syscall(__NR_futex, futex, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static int shmCreate() {
+#ifdef __NR_memfd_create
+  int fd = syscall(__NR_memfd_create, "liblog.shm",
+                   MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    return -errno;
+  }
+  /* logd must be able to trust the size of what it maps */
+  if ((ftruncate(fd, SHM_MAPPING_SIZE) < 0) ||
+      (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) <
+       0)) {
+    int ret = -errno;
+    close(fd);
+    return ret;
+  }
+  return fd;
+#else
+  return -ENOSYS;
+#endif
+}
+
+/* Hand the ring to logd, returns logd's verdict. */
+static int shmSend(int sock, int fd) {
+  uint32_t version = ANDROID_LOG_SHM_VERSION;
+  int32_t status = -EPROTO;
+  struct iovec iov = { &version, sizeof(version) };
+  union {
+    struct cmsghdr cmsg;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct msghdr msg;
+  struct cmsghdr* cmsg;
+  struct timeval timeout = { 1, 0 };
+  ssize_t ret;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(&control, 0, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  if (TEMP_FAILURE_RETRY(sendmsg(sock, &msg, 0)) < 0) {
+    return -errno;
+  }
+
+  /* do not hang the caller if logd is wedged */
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  ret = TEMP_FAILURE_RETRY(recv(sock, &status, sizeof(status), 0));
+  if (ret < 0) {
+    return -errno;
+  }
+  return (ret == sizeof(status)) ? status : -EPROTO;
+}
+
+/* shmLock held, replaces any ring already registered */
+static int shmRegister() {
+  struct sockaddr_un un;
+  android_log_shm_t* ring;
+  int sock, fd, ret;
+
+  sock = TEMP_FAILURE_RETRY(socket(PF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0));
+  if (sock < 0) {
+    return -errno;
+  }
+  memset(&un, 0, sizeof(struct sockaddr_un));
+  un.sun_family = AF_UNIX;
+  strcpy(un.sun_path, "/dev/socket/logdshm");
+  if (TEMP_FAILURE_RETRY(connect(sock, (struct sockaddr*)&un,
+                                 sizeof(struct sockaddr_un))) < 0) {
+    ret = -errno;
+    close(sock);
+    return ret;
+  }
+
+  fd = shmCreate();
+  if (fd < 0) {
+    close(sock);
+    return fd;
+  }
+  ring = mmap(NULL, SHM_MAPPING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+              0);
+  if (ring == MAP_FAILED) {
+    ret = -errno;
+    close(fd);
+    close(sock);
+    return ret;
+  }
+  ring->magic = ANDROID_LOG_SHM_MAGIC;
+  ring->version = ANDROID_LOG_SHM_VERSION;
+  ring->size = ANDROID_LOG_SHM_SIZE;
+
+  ret = shmSend(sock, fd);
+  close(fd);
+  if (ret < 0) {
+    munmap(ring, SHM_MAPPING_SIZE);
+    close(sock);
+    return ret;
+  }
+
+  /*
+   * A previous ring may still be in use by a writer racing with us, the
+   * same risk __android_log_close() accepts, so it is left mapped; logd
+   * stops draining it once the old connection is closed.
+   */
+  sock = atomic_exchange(&logdShmLoggerWrite.context.sock, sock);
+  if (sock >= 0) {
+    close(sock);
+  }
+  atomic_store(&shmRing, (uintptr_t)ring);
+  return 0;
+}
+
+/* On a full ring, check logd did not restart and forget about us */
+static void shmCheck() {
+  char c;
+  int sock;
+
+  if (pthread_mutex_trylock(&shmLock)) {
+    return;
+  }
+  sock = atomic_load(&logdShmLoggerWrite.context.sock);
+  if ((sock >= 0) &&
+      !TEMP_FAILURE_RETRY(recv(sock, &c, sizeof(c), MSG_DONTWAIT | MSG_PEEK))) {
+    /* EOF, register a fresh ring, messages stranded in the old are lost */
+    if (shmRegister() < 0) {
+      atomic_store(&shmRing, 0);
+    }
+  }
+  pthread_mutex_unlock(&shmLock);
+}
+
+static void shmForkChild() {
+  /* the ring belongs to the parent, logd would attribute our logs to it */
+  android_log_shm_t* ring = (android_log_shm_t*)atomic_exchange(&shmRing, 0);
+  int sock = atomic_exchange(&logdShmLoggerWrite.context.sock, -EBADF);
+
+  pthread_mutex_init(&shmLock, NULL);
+  if (ring) {
+    munmap(ring, SHM_MAPPING_SIZE);
+  }
+  if (sock >= 0) {
+    close(sock);
+  }
+}
+
+static pthread_once_t forkOnce = PTHREAD_ONCE_INIT;
+
+static void shmForkRegister() {
+  pthread_atfork(NULL, NULL, shmForkChild);
+}
+
+/* log_init_lock assumed */
+static int shmOpen() {
+  int ret;
+
+  pthread_once(&forkOnce, shmForkRegister);
+  pthread_mutex_lock(&shmLock);
+  ret = atomic_load(&shmRing) ? 0 : shmRegister();
+  pthread_mutex_unlock(&shmLock);
+  if (ret >= 0) {
+    atomic_store(&shmFallback, false);
+    return 0;
+  }
+
+  atomic_store(&shmFallback, true);
+  return logdLoggerWrite.open ? (*logdLoggerWrite.open)() : ret;
+}
+
+/* log_init_lock assumed */
+static void shmClose() {
+  int sock;
+
+  pthread_mutex_lock(&shmLock);
+  /* logd drains what is left in the ring once it sees us disconnect */
+  atomic_store(&shmRing, 0);
+  sock = atomic_exchange(&logdShmLoggerWrite.context.sock, -EBADF);
+  if (sock >= 0) {
+    close(sock);
+  }
+  pthread_mutex_unlock(&shmLock);
+
+  if (atomic_exchange(&shmFallback, false) && logdLoggerWrite.close) {
+    (*logdLoggerWrite.close)();
+  }
+}
+
+static int shmAvailable(log_id_t logId) {
+  if (logId >= LOG_ID_MAX || logId == LOG_ID_KERNEL) {
+    return -EINVAL;
+  }
+  if (atomic_load(&shmRing)) {
+    return 1;
+  }
+  if (atomic_load(&shmFallback)) {
+    return (*logdLoggerWrite.available)(logId);
+  }
+  if ((access("/dev/socket/logdshm", W_OK) == 0) ||
+      (access("/dev/socket/logdw", W_OK) == 0)) {
+    return 0;
+  }
+  return -EBADF;
+}
+
+static int shmDrop(android_log_shm_t* ring) {
+  __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+  atomic_fetch_add(&droppedTotal, 1);
+  shmCheck();
+  return -EAGAIN;
+}
+
+static int shmWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
+                    size_t nr) {
+  android_log_shm_t* ring;
+  android_log_shm_record_t* record;
+  uint64_t head, tail;
+  size_t i, len, size, offset, pad, used;
+  char* data;
+  char* payload;
+
+  /* logd, after initialization and priv drop */
+  if (__android_log_uid() == AID_LOGD) {
+    return 0;
+  }
+
+  ring = (android_log_shm_t*)atomic_load(&shmRing);
+  if (!ring) {
+    if (!atomic_load(&shmFallback)) { /* forked, or logd went away */
+      pthread_mutex_lock(&shmLock);
+      if (!atomic_load(&shmRing) && (shmRegister() < 0)) {
+        (*logdLoggerWrite.open)();
+        atomic_store(&shmFallback, true);
+      }
+      pthread_mutex_unlock(&shmLock);
+      ring = (android_log_shm_t*)atomic_load(&shmRing);
+    }
+    if (!ring) {
+      return (*logdLoggerWrite.write)(logId, ts, vec, nr);
+    }
+  }
+
+  for (len = i = 0; i < nr; ++i) {
+    len += vec[i].iov_len;
+  }
+  if (len > LOGGER_ENTRY_MAX_PAYLOAD) {
+    len = LOGGER_ENTRY_MAX_PAYLOAD;
+  }
+  size = align(sizeof(*record) + len);
+
+  /* reserve, any number of threads may be writing */
+  head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  do {
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    offset = head & (ANDROID_LOG_SHM_SIZE - 1);
+    pad = (ANDROID_LOG_SHM_SIZE - offset < size) ? ANDROID_LOG_SHM_SIZE - offset
+                                                 : 0;
+    if ((ANDROID_LOG_SHM_SIZE - (head - tail)) < (pad + size)) {
+      return shmDrop(ring);
+    }
+  } while (!__atomic_compare_exchange_n(&ring->head, &head, head + pad + size,
+                                        true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED));
+
+  data = (char*)(ring + 1);
+  if (pad) { /* does not fit before the end of the ring */
+    record = (android_log_shm_record_t*)&data[offset];
+    record->len = ANDROID_LOG_SHM_PAD;
+    __atomic_store_n((uint32_t*)record, pad, __ATOMIC_RELEASE);
+    offset = 0;
+  }
+
+  record = (android_log_shm_record_t*)&data[offset];
+  record->len = len;
+  record->header.id = logId;
+  record->header.tid = gettid();
+  record->header.realtime.tv_sec = ts->tv_sec;
+  record->header.realtime.tv_nsec = ts->tv_nsec;
+  payload = (char*)(record + 1);
+  for (i = 0, used = 0; (i < nr) && (used < len); ++i) {
+    size_t chunk = vec[i].iov_len;
+    if (chunk > (len - used)) {
+      chunk = len - used;
+    }
+    memcpy(payload + used, vec[i].iov_base, chunk);
+    used += chunk;
+  }
+  __atomic_store_n((uint32_t*)record, size, __ATOMIC_RELEASE);
+
+  /* pairs with logd setting sleeping then checking the ring */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_exchange_n(&ring->sleeping, 0, __ATOMIC_RELAXED)) {
+    __atomic_fetch_add(&ring->futex, 1, __ATOMIC_RELEASE);
+    shmFutexWake(&ring->futex);
+  }
+
+  return len;
+}
+
+LIBLOG_ABI_PRIVATE unsigned long __android_log_shm_dropped() {
+  return atomic_load(&droppedTotal);
+}
@@ -105,6 +105,11 @@ struct android_log_logger_list {
   unsigned int tail;
   log_time start;
   pid_t pid;
+  /* reader side filters, percent-encoded as logd takes them, or 0/NULL */
+  int filter_pri;
+  char* filter_tags;
+  char* filter_pids;
+  char* filter_regex;
 };
 
 struct android_log_logger {
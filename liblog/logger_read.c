@@ -19,6 +19,7 @@
 #include <pthread.h>
 #include <sched.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -327,6 +328,111 @@ LIBLOG_ABI_PUBLIC struct logger_list* android_logger_list_open(
   return logger_list;
 }
 
+/*
+ * Percent-encode anything that would end or split a value of the logd
+ * reader request.
+ */
+static char* filter_encode(const char* str) {
+  static const char hex[] = "0123456789ABCDEF";
+  char* buf = malloc(strlen(str) * 3 + 1);
+  char* cp = buf;
+
+  if (!buf) {
+    return NULL;
+  }
+  for (; *str; ++str) {
+    unsigned char c = *str;
+    if ((c <= ' ') || (c >= 0x7F) || strchr("%,:=", c)) {
+      *cp++ = '%';
+      *cp++ = hex[c >> 4];
+      *cp++ = hex[c & 0xF];
+    } else {
+      *cp++ = c;
+    }
+  }
+  *cp = '\0';
+  return buf;
+}
+
+static int filter_append(char** field, const char* value) {
+  size_t len = *field ? strlen(*field) : 0;
+  char* buf = realloc(*field, len + strlen(value) + 2);
+
+  if (!buf) {
+    return -ENOMEM;
+  }
+  if (len) {
+    buf[len++] = ',';
+  }
+  strcpy(buf + len, value);
+  *field = buf;
+  return 0;
+}
+
+LIBLOG_ABI_PRIVATE int android_logger_list_filter_priority(
+    struct logger_list* logger_list, const char* tag,
+    android_LogPriority pri) {
+  struct android_log_logger_list* logger_list_internal =
+      (struct android_log_logger_list*)logger_list;
+  char* encoded;
+  char* rule;
+  int ret;
+
+  if (!logger_list_internal || (pri <= ANDROID_LOG_DEFAULT)) {
+    return -EINVAL;
+  }
+  if (!tag || !strcmp(tag, "*")) {
+    logger_list_internal->filter_pri = pri;
+    return 0;
+  }
+
+  encoded = filter_encode(tag);
+  if (!encoded) {
+    return -ENOMEM;
+  }
+  rule = malloc(strlen(encoded) + 16);
+  if (!rule) {
+    free(encoded);
+    return -ENOMEM;
+  }
+  sprintf(rule, "%s:%d", encoded, pri);
+  ret = filter_append(&logger_list_internal->filter_tags, rule);
+  free(rule);
+  free(encoded);
+  return ret;
+}
+
+LIBLOG_ABI_PRIVATE int android_logger_list_filter_pid(
+    struct logger_list* logger_list, pid_t pid) {
+  struct android_log_logger_list* logger_list_internal =
+      (struct android_log_logger_list*)logger_list;
+  char num[16];
+
+  if (!logger_list_internal || (pid <= 0)) {
+    return -EINVAL;
+  }
+  snprintf(num, sizeof(num), "%d", pid);
+  return filter_append(&logger_list_internal->filter_pids, num);
+}
+
+LIBLOG_ABI_PRIVATE int android_logger_list_filter_regex(
+    struct logger_list* logger_list, const char* regex) {
+  struct android_log_logger_list* logger_list_internal =
+      (struct android_log_logger_list*)logger_list;
+  char* buf;
+
+  if (!logger_list_internal || !regex) {
+    return -EINVAL;
+  }
+  buf = filter_encode(regex);
+  if (!buf) {
+    return -ENOMEM;
+  }
+  free(logger_list_internal->filter_regex);
+  logger_list_internal->filter_regex = buf;
+  return 0;
+}
+
 /* Validate log_msg packet, read function has already been null checked */
 static int android_transport_read(struct android_log_logger_list* logger_list,
                                   struct android_log_transport_context* transp,
@@ -495,5 +601,8 @@ LIBLOG_ABI_PUBLIC void android_logger_list_free(struct logger_list* logger_list)
     android_logger_free((struct logger*)logger);
   }
 
+  free(logger_list_internal->filter_tags);
+  free(logger_list_internal->filter_pids);
+  free(logger_list_internal->filter_regex);
   free(logger_list_internal);
 }
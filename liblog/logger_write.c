@@ -660,9 +660,14 @@ LIBLOG_ABI_PUBLIC int android_set_log_transport(int transport_flag) {
     return retval;
   }
 
-  __android_log_transport &= LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR;
+  __android_log_transport &= LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR |
+                             LOGGER_ASYNC | LOGGER_SHM;
 
-  transport_flag &= LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR;
+  transport_flag &= LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR | LOGGER_ASYNC |
+                    LOGGER_SHM;
+  if (!(transport_flag & LOGGER_LOGD)) {
+    transport_flag &= ~LOGGER_ASYNC; /* only modifies LOGGER_LOGD */
+  }
 
   if (__android_log_transport != transport_flag) {
     __android_log_transport = transport_flag;
@@ -690,7 +695,8 @@ LIBLOG_ABI_PUBLIC int android_get_log_transport() {
   if (write_to_log == __write_to_log_null) {
     ret = LOGGER_NULL;
   } else {
-    __android_log_transport &= LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR;
+    __android_log_transport &= LOGGER_LOCAL | LOGGER_LOGD | LOGGER_STDERR |
+                               LOGGER_ASYNC | LOGGER_SHM;
     ret = __android_log_transport;
     if ((write_to_log != __write_to_log_init) &&
         (write_to_log != __write_to_log_daemon)) {
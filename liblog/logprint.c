@@ -38,6 +38,7 @@
 #include <cutils/list.h>
 #include <log/log.h>
 #include <log/logprint.h>
+#include <private/android_logger.h>
 
 #include "log_portability.h"
 
@@ -68,6 +69,16 @@ struct AndroidLogFormat_t {
   bool monotonic_output;
   bool uid_output;
   bool descriptive_output;
+  /* android_log_formatLogLineArena() only, single threaded */
+  char* arena;
+  size_t arenaSize;
+  bool cachedTimeValid; /* reset by android_log_setPrintFormat() */
+  time_t cachedSec;
+  char cachedTime[32]; /* date and time to the second of cachedSec */
+  char cachedZone[8];
+  bool cachedUidValid;
+  int32_t cachedUid;
+  char cachedUidName[16];
 };
 
 /*
@@ -194,6 +205,24 @@ static android_LogPriority filterPriForTag(AndroidLogFormat* p_format,
   return p_format->global_pri;
 }
 
+LIBLOG_ABI_PRIVATE int android_logger_list_filter_format(
+    struct logger_list* logger_list, AndroidLogFormat* p_format) {
+  FilterInfo* p_curFilter;
+  int ret;
+
+  ret = android_logger_list_filter_priority(logger_list, NULL,
+                                            p_format->global_pri);
+  for (p_curFilter = p_format->filters; !ret && (p_curFilter != NULL);
+       p_curFilter = p_curFilter->p_next) {
+    /* as resolved for printing, so a later duplicate can not override */
+    android_LogPriority pri = filterPriForTag(p_format, p_curFilter->mTag);
+
+    ret = android_logger_list_filter_priority(logger_list, p_curFilter->mTag,
+                                              pri);
+  }
+  return ret;
+}
+
 /**
  * returns 1 if this log line should be printed based on its priority
  * and tag, and 0 if it should not
@@ -226,6 +255,10 @@ LIBLOG_ABI_PUBLIC AndroidLogFormat* android_log_format_new() {
   p_ret->uid_output = false;
   p_ret->descriptive_output = false;
   descriptive_output = false;
+  p_ret->arena = NULL;
+  p_ret->arenaSize = 0;
+  p_ret->cachedTimeValid = false;
+  p_ret->cachedUidValid = false;
 
   return p_ret;
 }
@@ -244,6 +277,7 @@ LIBLOG_ABI_PUBLIC void android_log_format_free(AndroidLogFormat* p_format) {
     free(p_info_old);
   }
 
+  free(p_format->arena);
   free(p_format);
 
   /* Free conversion resource, can always be reconstructed */
@@ -256,6 +290,7 @@ LIBLOG_ABI_PUBLIC void android_log_format_free(AndroidLogFormat* p_format) {
 
 LIBLOG_ABI_PUBLIC int android_log_setPrintFormat(AndroidLogFormat* p_format,
                                                  AndroidLogPrintFormat format) {
+  p_format->cachedTimeValid = false;
   switch (format) {
     case FORMAT_MODIFIER_COLOR:
       p_format->colored_output = true;
@@ -1208,6 +1243,37 @@ LIBLOG_WEAK ssize_t utf8_character_length(const char* src, size_t len) {
   return num_to_read;
 }
 
+/*
+ * True if convertPrintable() would leave message unchanged: printable ASCII
+ * only and no backslash. Tested a word at a time, this is the common case.
+ */
+static bool isPlainPrintable(const char* message, size_t messageLen) {
+  static const uint64_t ones = 0x0101010101010101ULL;
+  static const uint64_t highs = 0x8080808080808080ULL;
+
+  while (messageLen >= sizeof(uint64_t)) {
+    uint64_t word, del, backslash;
+    memcpy(&word, message, sizeof(word));
+    del = word ^ (ones * 0x7F);
+    backslash = word ^ (ones * '\\');
+    /* any byte >= 0x80, < ' ', DEL or backslash */
+    if ((word & highs) || ((word - ones * ' ') & ~word & highs) ||
+        ((del - ones) & ~del & highs) ||
+        ((backslash - ones) & ~backslash & highs)) {
+      return false;
+    }
+    message += sizeof(uint64_t);
+    messageLen -= sizeof(uint64_t);
+  }
+  while (messageLen--) {
+    unsigned char c = *message++;
+    if ((c < ' ') || (c >= 0x7F) || (c == '\\')) {
+      return false;
+    }
+  }
+  return true;
+}
+
 /*
  * Convert to printable from message to p buffer, return string length. If p is
  * NULL, do not copy, but still return the expected string length.
@@ -1216,6 +1282,14 @@ static size_t convertPrintable(char* p, const char* message, size_t messageLen)
   char* begin = p;
   bool print = p != NULL;
 
+  if (isPlainPrintable(message, messageLen)) {
+    if (print) {
+      memcpy(p, message, messageLen);
+      p[messageLen] = '\0';
+    }
+    return messageLen;
+  }
+
   while (messageLen) {
     char buf[6];
     ssize_t len = sizeof(buf) - 1;
@@ -1547,17 +1621,31 @@ static void convertMonotonic(struct timespec* result,
  * Returns NULL on malloc error
  */
 
-LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
-                                                  char* defaultBuffer,
-                                                  size_t defaultBufferSize,
-                                                  const AndroidLogEntry* entry,
-                                                  size_t* p_outLength) {
+/* Copy up to len, stopping at a nul as strncat() would, returns the length */
+static size_t copyMessage(char* p, const char* message, size_t len) {
+  const char* nul = memchr(message, '\0', len);
+  if (nul) {
+    len = nul - message;
+  }
+  memcpy(p, message, len);
+  return len;
+}
+
+/*
+ * exclusive: caller guarantees p_format is not in use by any other thread,
+ * the result may then be formatted into, and cached in, p_format.
+ */
+static char* formatLogLine(AndroidLogFormat* p_format, char* defaultBuffer,
+                           size_t defaultBufferSize,
+                           const AndroidLogEntry* entry, size_t* p_outLength,
+                           bool exclusive) {
 #if !defined(_WIN32)
   struct tm tmBuf;
 #endif
   struct tm* ptm;
   /* good margin, 23+nul for msec, 26+nul for usec, 29+nul to nsec */
   char timeBuf[64];
+  char zoneBuf[sizeof(p_format->cachedZone)];
   char prefixBuf[128], suffixBuf[128];
   char priChar;
   int prefixSuffixIsHeaderFooter = 0;
@@ -1597,18 +1685,32 @@ LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
   if (now < 0) {
     nsec = NS_PER_SEC - nsec;
   }
+  zoneBuf[0] = '\0';
   if (p_format->epoch_output || p_format->monotonic_output) {
-    ptm = NULL;
     snprintf(timeBuf, sizeof(timeBuf),
              p_format->monotonic_output ? "%6lld" : "%19lld", (long long)now);
+  } else if (exclusive && p_format->cachedTimeValid &&
+             (p_format->cachedSec == now)) {
+    /* consecutive entries mostly land in the same second */
+    strcpy(timeBuf, p_format->cachedTime);
+    strcpy(zoneBuf, p_format->cachedZone);
   } else {
 #if !defined(_WIN32)
     ptm = localtime_r(&now, &tmBuf);
 #else
     ptm = localtime(&now);
 #endif
-    strftime(timeBuf, sizeof(timeBuf),
+    strftime(timeBuf, sizeof(p_format->cachedTime),
              &"%Y-%m-%d %H:%M:%S"[p_format->year_output ? 0 : 3], ptm);
+    if (p_format->zone_output) {
+      strftime(zoneBuf, sizeof(zoneBuf), " %z", ptm);
+    }
+    if (exclusive) {
+      strcpy(p_format->cachedTime, timeBuf);
+      strcpy(p_format->cachedZone, zoneBuf);
+      p_format->cachedSec = now;
+      p_format->cachedTimeValid = true;
+    }
   }
   len = strlen(timeBuf);
   if (p_format->nsec_time_output) {
@@ -1620,8 +1722,8 @@ LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
     len += snprintf(timeBuf + len, sizeof(timeBuf) - len, ".%03ld",
                     nsec / MS_PER_NSEC);
   }
-  if (p_format->zone_output && ptm) {
-    strftime(timeBuf + len, sizeof(timeBuf) - len, " %z", ptm);
+  if (zoneBuf[0]) {
+    strcpy(timeBuf + len, zoneBuf);
   }
 
   /*
@@ -1635,9 +1737,12 @@ LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
     suffixLen = MIN(suffixLen, sizeof(suffixBuf));
   }
 
-  char uid[16];
+  char uid[sizeof(p_format->cachedUidName)];
   uid[0] = '\0';
-  if (p_format->uid_output) {
+  if (p_format->uid_output && exclusive && p_format->cachedUidValid &&
+      (p_format->cachedUid == entry->uid)) {
+    strcpy(uid, p_format->cachedUidName);
+  } else if (p_format->uid_output) {
     if (entry->uid >= 0) {
 /*
  * This code is Android specific, bionic guarantees that
@@ -1662,6 +1767,11 @@ LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
     } else {
       snprintf(uid, sizeof(uid), "      ");
     }
+    if (exclusive) {
+      strcpy(p_format->cachedUidName, uid);
+      p_format->cachedUid = entry->uid;
+      p_format->cachedUidValid = true;
+    }
   }
 
   switch (p_format->format) {
@@ -1782,6 +1892,18 @@ LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
 
   if (defaultBufferSize >= bufferSize) {
     ret = defaultBuffer;
+  } else if (exclusive) {
+    if (p_format->arenaSize < bufferSize) {
+      /* grow geometrically, settles after the first few long entries */
+      size_t size = MAX(bufferSize, p_format->arenaSize * 2);
+      ret = (char*)realloc(p_format->arena, size);
+      if (ret == NULL) {
+        return ret;
+      }
+      p_format->arena = ret;
+      p_format->arenaSize = size;
+    }
+    ret = p_format->arena;
   } else {
     ret = (char*)malloc(bufferSize);
 
@@ -1790,21 +1912,19 @@ LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
     }
   }
 
-  ret[0] = '\0'; /* to start strcat off */
-
   p = ret;
   pm = entry->message;
 
+  /* lengths are all known, copy rather than strcat() rescanning the output */
   if (prefixSuffixIsHeaderFooter) {
-    strcat(p, prefixBuf);
+    memcpy(p, prefixBuf, prefixLen);
     p += prefixLen;
     if (p_format->printable_output) {
       p += convertPrintable(p, entry->message, entry->messageLen);
     } else {
-      strncat(p, entry->message, entry->messageLen);
-      p += entry->messageLen;
+      p += copyMessage(p, entry->message, entry->messageLen);
     }
-    strcat(p, suffixBuf);
+    memcpy(p, suffixBuf, suffixLen);
     p += suffixLen;
   } else {
     do {
@@ -1816,20 +1936,20 @@ LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
       while (pm < (entry->message + entry->messageLen) && *pm != '\n') pm++;
       lineLen = pm - lineStart;
 
-      strcat(p, prefixBuf);
+      memcpy(p, prefixBuf, prefixLen);
       p += prefixLen;
       if (p_format->printable_output) {
         p += convertPrintable(p, lineStart, lineLen);
       } else {
-        strncat(p, lineStart, lineLen);
-        p += lineLen;
+        p += copyMessage(p, lineStart, lineLen);
       }
-      strcat(p, suffixBuf);
+      memcpy(p, suffixBuf, suffixLen);
       p += suffixLen;
 
       if (*pm == '\n') pm++;
     } while (pm < (entry->message + entry->messageLen));
   }
+  *p = '\0';
 
   if (p_outLength != NULL) {
     *p_outLength = p - ret;
@@ -1838,6 +1958,21 @@ LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
   return ret;
 }
 
+LIBLOG_ABI_PUBLIC char* android_log_formatLogLine(AndroidLogFormat* p_format,
+                                                  char* defaultBuffer,
+                                                  size_t defaultBufferSize,
+                                                  const AndroidLogEntry* entry,
+                                                  size_t* p_outLength) {
+  return formatLogLine(p_format, defaultBuffer, defaultBufferSize, entry,
+                       p_outLength, false);
+}
+
+LIBLOG_ABI_PUBLIC const char* android_log_formatLogLineArena(
+    AndroidLogFormat* p_format, const AndroidLogEntry* entry,
+    size_t* p_outLength) {
+  return formatLogLine(p_format, NULL, 0, entry, p_outLength, true);
+}
+
 /**
  * Either print or do not print log line, based on filter
  *
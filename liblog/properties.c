@@ -277,6 +277,14 @@ LIBLOG_ABI_PUBLIC int __android_log_is_loggable(int prio, const char* tag,
   return logLevel >= 0 && prio >= logLevel;
 }
 
+/*
+ * Every property change moves the property area serial on, the C++ fast
+ * path in log_main.h caches __android_log_is_loggable() results against it.
+ */
+LIBLOG_ABI_PUBLIC uint32_t __android_log_loggable_generation() {
+  return __system_property_area_serial();
+}
+
 LIBLOG_ABI_PUBLIC int __android_log_is_debuggable() {
   static uint32_t serial;
   static struct cache_char tag_cache;
@@ -22,12 +22,21 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
 #include <unordered_set>
+#include <vector>
 
 #include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <cutils/sockets.h>
 #include <log/event_tag_map.h>
+#include <log/log_event_list.h>
 #include <log/log_transport.h>
+#include <log/logprint.h>
 #include <private/android_logger.h>
 
 #include "benchmark.h"
@@ -570,6 +579,53 @@ static void BM_log_event_overhead_null(int iters) {
 }
 BENCHMARK(BM_log_event_overhead_null);
 
+/*
+ *	Measure the time it takes to encode and submit a four element event
+ * list with the heap backed android_log_event_list, against the null logger
+ * so that only the encoding cost is measured.
+ */
+static void BM_log_event_list_null(int iters) {
+  set_log_null();
+  for (unsigned long long i = 0; i < (unsigned)iters; ++i) {
+    StartBenchmarkTiming();
+    android_log_event_list ctx(0);
+    ctx << (int32_t)i << (int64_t)i << "benchmark" << 1.5f;
+    ctx.write();
+    StopBenchmarkTiming();
+  }
+  set_log_default();
+}
+BENCHMARK(BM_log_event_list_null);
+
+/*
+ *	Same as above with android_log_event_builder encoding into the stack,
+ * expect this to be a fraction of the android_log_event_list time.
+ */
+static void BM_log_event_builder_null(int iters) {
+  set_log_null();
+  for (unsigned long long i = 0; i < (unsigned)iters; ++i) {
+    StartBenchmarkTiming();
+    uint8_t buffer[64];
+    android_log_event_builder builder(buffer);
+    builder << (int32_t)i << (int64_t)i << "benchmark" << 1.5f;
+    builder.write(0);
+    StopBenchmarkTiming();
+  }
+  set_log_default();
+}
+BENCHMARK(BM_log_event_builder_null);
+
+static void BM_log_event_write_null(int iters) {
+  set_log_null();
+  for (unsigned long long i = 0; i < (unsigned)iters; ++i) {
+    StartBenchmarkTiming();
+    android_log_event_write(0, (int32_t)i, (int64_t)i, "benchmark", 1.5f);
+    StopBenchmarkTiming();
+  }
+  set_log_default();
+}
+BENCHMARK(BM_log_event_write_null);
+
 /*
  *	Measure the time it takes to submit the android event logging call
  * using discrete acquisition (StartBenchmarkTiming() -> StopBenchmarkTiming())
@@ -890,6 +946,21 @@ static void BM_lookupEventFormat(int iters) {
 }
 BENCHMARK(BM_lookupEventFormat);
 
+/*
+ *	Measure the time it takes for android_openEventTagMap, which is
+ * what every logcat and event log reader pays at startup.
+ */
+static void BM_openEventTagMap(int iters) {
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    android_closeEventTagMap(android_openEventTagMap(NULL));
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_openEventTagMap);
+
 /*
  *	Measure the time it takes for android_lookupEventTagNum plus above
  */
@@ -1026,3 +1097,171 @@ static void BM_lookupEventTagNum_logd_existing(int iters) {
   }
 }
 BENCHMARK(BM_lookupEventTagNum_logd_existing);
+
+/*
+ *	End-to-end delivery, from __android_log_buf_write() in one of a number
+ * of writer threads to each of a number of readers receiving the entry from
+ * logd, with the main log buffer at a given size. ns/op is the wall time per
+ * entry written, percentiles of the latency and what the readers got through
+ * are reported on a line of their own. Resizing the buffer takes root, else
+ * all run at the size it already is.
+ */
+struct end_to_end {
+  unsigned writers;
+  unsigned readers;
+  unsigned long size;  // of the main log buffer, 0 leaves it alone
+};
+
+static const char end_to_end_tag[] = "liblog.end_to_end";
+
+static uint64_t monotonic_nsec() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void end_to_end_reader(struct logger_list* logger_list, unsigned run,
+                              std::vector<uint64_t>* latency, uint64_t* last,
+                              std::atomic<bool>* done) {
+  log_msg log_msg;
+  while (android_logger_list_read(logger_list, &log_msg) > 0) {
+    uint64_t now = monotonic_nsec();
+    AndroidLogEntry entry;
+    if (android_log_processLogBuffer(&log_msg.entry_v1, &entry) ||
+        (entry.tagLen != (sizeof(end_to_end_tag) - 1)) ||
+        strncmp(entry.tag, end_to_end_tag, entry.tagLen)) {
+      continue;
+    }
+    std::string message(entry.message, entry.messageLen);
+    unsigned id;
+    uint64_t sent;
+    if (sscanf(message.c_str(), "%u %" SCNu64, &id, &sent) != 2) {
+      if (sscanf(message.c_str(), "end %u", &id) == 1 && (id == run)) break;
+      continue;
+    }
+    if ((id == run) && (now >= sent)) {
+      latency->push_back(now - sent);
+      *last = now;
+    }
+  }
+  done->store(true);
+}
+
+static void BM_log_end_to_end(int iters, end_to_end config) {
+  static unsigned run;
+  ++run;
+  uint64_t called = monotonic_nsec();
+
+  struct logger* main_log = nullptr;
+  long old_size = 0;
+  struct logger_list* control =
+      android_logger_list_alloc(ANDROID_LOG_RDWR, 0, 0);
+  if (control && config.size) {
+    main_log = android_logger_open(control, LOG_ID_MAIN);
+    old_size = main_log ? android_logger_get_log_size(main_log) : 0;
+    if ((old_size <= 0) ||
+        android_logger_set_log_size(main_log, config.size)) {
+      fprintf(stderr, "WARNING: unable to resize the main log buffer\n");
+      old_size = 0;
+    }
+  }
+
+  // Only what is logged from here on, by us
+  pid_t pid = getpid();
+  std::vector<struct logger_list*> lists(config.readers);
+  std::vector<std::vector<uint64_t>> latency(config.readers);
+  std::vector<uint64_t> last(config.readers);
+  std::unique_ptr<std::atomic<bool>[]> done(
+      new std::atomic<bool>[config.readers]);
+  std::vector<std::thread> readers;
+  log_time start(CLOCK_REALTIME);
+  for (unsigned i = 0; i < config.readers; ++i) {
+    lists[i] = android_logger_list_alloc_time(ANDROID_LOG_RDONLY, start, pid);
+    if (!lists[i] || !android_logger_open(lists[i], LOG_ID_MAIN)) {
+      fprintf(stderr, "Unable to open main log: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    latency[i].reserve(iters);
+    done[i].store(false);
+    readers.emplace_back(end_to_end_reader, lists[i], run, &latency[i],
+                         &last[i], &done[i]);
+  }
+
+  std::atomic<int> next(0);
+  std::vector<std::thread> writers;
+  uint64_t begin = monotonic_nsec();
+  for (unsigned i = 0; i < config.writers; ++i) {
+    writers.emplace_back([&next, iters]() {
+      char buffer[64];
+      while (next.fetch_add(1) < iters) {
+        snprintf(buffer, sizeof(buffer), "%u %" PRIu64, run, monotonic_nsec());
+        LOG_FAILURE_RETRY(__android_log_buf_write(
+            LOG_ID_MAIN, ANDROID_LOG_INFO, end_to_end_tag, buffer));
+      }
+    });
+  }
+  for (auto& writer : writers) writer.join();
+
+  // Keep telling the readers we are done, logd may drop any one of these
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "end %u", run);
+  bool waiting = true;
+  for (int retry = 0; waiting && (retry < 100); ++retry) {
+    LOG_FAILURE_RETRY(__android_log_buf_write(LOG_ID_MAIN, ANDROID_LOG_INFO,
+                                              end_to_end_tag, buffer));
+    usleep(100000);
+    waiting = false;
+    for (unsigned i = 0; i < config.readers; ++i) {
+      if (!done[i].load()) waiting = true;
+    }
+  }
+  if (waiting) {
+    fprintf(stderr, "Readers did not finish\n");
+    exit(EXIT_FAILURE);
+  }
+  // Until the last entry arrived, not the end marker that got through
+  uint64_t end = *std::max_element(last.begin(), last.end());
+  if (end > begin) {
+    StartBenchmarkTiming(begin);
+    StopBenchmarkTiming(end);
+  }
+  for (auto& reader : readers) reader.join();
+  for (auto list : lists) android_logger_list_free(list);
+
+  if (old_size) android_logger_set_log_size(main_log, old_size);
+  android_logger_list_free(control);
+
+  std::vector<uint64_t> all;
+  for (auto& v : latency) all.insert(all.end(), v.begin(), v.end());
+  SetBenchmarkBytesProcessed(all.size() * (sizeof(end_to_end_tag) + 24));
+
+  // Iterations are ramped up until a run takes a second, or the whole call
+  // two, report the percentiles from that last run only.
+  if (all.empty() || (end <= begin) ||
+      (((end - begin) < 1000000000ULL) &&
+       ((monotonic_nsec() - called) < 2000000000ULL))) {
+    return;
+  }
+
+  std::sort(all.begin(), all.end());
+  uint64_t expected = (uint64_t)iters * config.readers;
+  char size[16];
+  ::testing::PrettyPrintInt(size, sizeof(size), config.size);
+  std::string name = android::base::StringPrintf(
+      "%uw%ur/%s", config.writers, config.readers, size);
+  printf("%-25s p50 %" PRIu64 " p99 %" PRIu64 " p999 %" PRIu64
+         " ns, %.0f/s delivered, %" PRIu64 " lost\n",
+         name.c_str(), all[all.size() / 2], all[all.size() * 99 / 100],
+         all[all.size() * 999 / 1000], all.size() * 1e9 / (end - begin),
+         (expected > all.size()) ? expected - all.size() : 0);
+}
+static ::testing::BenchmarkWantsArgBase<end_to_end>* _benchmark_end_to_end
+    __attribute__((unused)) =
+        ::testing::BenchmarkFactory("BM_log_end_to_end", BM_log_end_to_end)
+            ->Arg("1w1r/256Ki", { 1, 1, 256 * 1024 })
+            ->Arg("1w1r/1Mi", { 1, 1, 1024 * 1024 })
+            ->Arg("1w1r/4Mi", { 1, 1, 4 * 1024 * 1024 })
+            ->Arg("4w1r/1Mi", { 4, 1, 1024 * 1024 })
+            ->Arg("16w1r/1Mi", { 16, 1, 1024 * 1024 })
+            ->Arg("4w4r/1Mi", { 4, 4, 1024 * 1024 })
+            ->Arg("16w4r/4Mi", { 16, 4, 4 * 1024 * 1024 });
@@ -31,6 +31,7 @@
 
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
+#include <android-base/test_utils.h>
 #ifdef __ANDROID__  // includes sys/properties.h which does not exist outside
 #include <cutils/properties.h>
 #endif
@@ -304,8 +305,16 @@ static void print_transport(const char* prefix, int logger) {
     fprintf(stderr, "%sLOGGER_STDERR", prefix);
     prefix = orstr;
   }
+  if (logger & LOGGER_ASYNC) {
+    fprintf(stderr, "%sLOGGER_ASYNC", prefix);
+    prefix = orstr;
+  }
+  if (logger & LOGGER_SHM) {
+    fprintf(stderr, "%sLOGGER_SHM", prefix);
+    prefix = orstr;
+  }
   logger &= ~(LOGGER_LOGD | LOGGER_KERNEL | LOGGER_NULL | LOGGER_LOCAL |
-              LOGGER_STDERR);
+              LOGGER_STDERR | LOGGER_ASYNC | LOGGER_SHM);
   if (logger) {
     fprintf(stderr, "%s0x%x", prefix, logger);
     prefix = orstr;
@@ -398,6 +407,130 @@ TEST(liblog, android_set_log_transport) {
 #endif
 }
 
+#if (defined(__ANDROID__) && defined(USING_LOGGER_DEFAULT))
+TEST(liblog, android_set_log_transport_async) {
+  int logger = android_get_log_transport();
+
+  int ret;
+  EXPECT_EQ(LOGGER_LOGD | LOGGER_ASYNC,
+            ret = android_set_log_transport(LOGGER_LOGD | LOGGER_ASYNC));
+  print_transport("android_set_log_transport = ", ret);
+
+  pid_t pid = getpid();
+
+  struct logger_list* logger_list;
+  ASSERT_TRUE(NULL !=
+              (logger_list = android_logger_list_open(
+                   LOG_ID_EVENTS, ANDROID_LOG_RDONLY | ANDROID_LOG_NONBLOCK,
+                   1000, pid)));
+
+  unsigned long dropped = __android_log_async_dropped();
+  log_time ts(CLOCK_MONOTONIC);
+  EXPECT_LT(0, __android_log_btwrite(0, EVENT_TYPE_LONG, &ts, sizeof(ts)));
+  // must flush what is queued
+  __android_log_close();
+
+  usleep(1000000);
+
+  int count = 0;
+
+  for (;;) {
+    log_msg log_msg;
+    if (android_logger_list_read(logger_list, &log_msg) <= 0) {
+      break;
+    }
+
+    EXPECT_EQ(log_msg.entry.pid, pid);
+
+    if ((log_msg.entry.len != sizeof(android_log_event_long_t)) ||
+        (log_msg.id() != LOG_ID_EVENTS)) {
+      continue;
+    }
+
+    android_log_event_long_t* eventData;
+    eventData = reinterpret_cast<android_log_event_long_t*>(log_msg.msg());
+
+    if (!eventData || (eventData->payload.type != EVENT_TYPE_LONG)) {
+      continue;
+    }
+
+    log_time tx(reinterpret_cast<char*>(&eventData->payload.data));
+    if (ts == tx) {
+      ++count;
+    }
+  }
+
+  android_logger_list_close(logger_list);
+
+  EXPECT_EQ(dropped, __android_log_async_dropped());
+  EXPECT_EQ(1, count);
+
+  EXPECT_EQ(logger, ret = android_set_log_transport(logger));
+  print_transport("android_set_log_transport = ", ret);
+}
+
+// Delivered through the ring if logd accepts it, over logdw if it does not.
+TEST(liblog, android_set_log_transport_shm) {
+  int logger = android_get_log_transport();
+
+  int ret;
+  EXPECT_EQ(LOGGER_SHM, ret = android_set_log_transport(LOGGER_SHM));
+  print_transport("android_set_log_transport = ", ret);
+
+  pid_t pid = getpid();
+
+  struct logger_list* logger_list;
+  ASSERT_TRUE(NULL !=
+              (logger_list = android_logger_list_open(
+                   LOG_ID_EVENTS, ANDROID_LOG_RDONLY | ANDROID_LOG_NONBLOCK,
+                   1000, pid)));
+
+  unsigned long dropped = __android_log_shm_dropped();
+  log_time ts(CLOCK_MONOTONIC);
+  EXPECT_LT(0, __android_log_btwrite(0, EVENT_TYPE_LONG, &ts, sizeof(ts)));
+  // logd drains what is left in the ring when we disconnect
+  __android_log_close();
+
+  usleep(1000000);
+
+  int count = 0;
+
+  for (;;) {
+    log_msg log_msg;
+    if (android_logger_list_read(logger_list, &log_msg) <= 0) {
+      break;
+    }
+
+    EXPECT_EQ(log_msg.entry.pid, pid);
+
+    if ((log_msg.entry.len != sizeof(android_log_event_long_t)) ||
+        (log_msg.id() != LOG_ID_EVENTS)) {
+      continue;
+    }
+
+    android_log_event_long_t* eventData;
+    eventData = reinterpret_cast<android_log_event_long_t*>(log_msg.msg());
+
+    if (!eventData || (eventData->payload.type != EVENT_TYPE_LONG)) {
+      continue;
+    }
+
+    log_time tx(reinterpret_cast<char*>(&eventData->payload.data));
+    if (ts == tx) {
+      ++count;
+    }
+  }
+
+  android_logger_list_close(logger_list);
+
+  EXPECT_EQ(dropped, __android_log_shm_dropped());
+  EXPECT_EQ(1, count);
+
+  EXPECT_EQ(logger, ret = android_set_log_transport(logger));
+  print_transport("android_set_log_transport = ", ret);
+}
+#endif
+
 #ifdef TEST_PREFIX
 static inline uint32_t get4LE(const uint8_t* src) {
   return src[0] | (src[1] << 8) | (src[2] << 16) | (src[3] << 24);
@@ -1355,6 +1488,57 @@ TEST(liblog, dual_reader) {
 #endif
 }
 
+#if defined(__ANDROID__) && defined(USING_LOGGER_DEFAULT)
+TEST(liblog, android_logger_list_filter) {
+  static const char tag[] = "liblog.filter";
+  static const char other[] = "liblog.filter.other";
+  pid_t pid = getpid();
+
+  LOG_FAILURE_RETRY(
+      __android_log_buf_write(LOG_ID_MAIN, ANDROID_LOG_INFO, tag, "pass 1"));
+  LOG_FAILURE_RETRY(
+      __android_log_buf_write(LOG_ID_MAIN, ANDROID_LOG_WARN, tag, "pass 2"));
+  LOG_FAILURE_RETRY(
+      __android_log_buf_write(LOG_ID_MAIN, ANDROID_LOG_ERROR, other, "pass 3"));
+  LOG_FAILURE_RETRY(
+      __android_log_buf_write(LOG_ID_MAIN, ANDROID_LOG_ERROR, tag, "drop 4"));
+  usleep(1000000);
+
+  struct logger_list* logger_list;
+  ASSERT_TRUE(NULL != (logger_list = android_logger_list_open(
+                           LOG_ID_MAIN,
+                           ANDROID_LOG_RDONLY | ANDROID_LOG_NONBLOCK, 0, pid)));
+  // tag:W *:S -e " 2$", the same "pass 2" logcat would print
+  EXPECT_EQ(0, android_logger_list_filter_priority(logger_list, NULL,
+                                                   ANDROID_LOG_SILENT));
+  EXPECT_EQ(0, android_logger_list_filter_priority(logger_list, tag,
+                                                   ANDROID_LOG_WARN));
+  EXPECT_EQ(0, android_logger_list_filter_pid(logger_list, pid));
+  EXPECT_EQ(0, android_logger_list_filter_regex(logger_list, " 2$"));
+  EXPECT_GT(0, android_logger_list_filter_priority(logger_list, tag,
+                                                   ANDROID_LOG_DEFAULT));
+
+  int count = 0;
+  log_msg log_msg;
+  while (android_logger_list_read(logger_list, &log_msg) > 0) {
+    AndroidLogEntry entry;
+    ASSERT_EQ(0, android_log_processLogBuffer(&log_msg.entry_v1, &entry));
+    std::string name(entry.tag, entry.tagLen);
+    if ((name != tag) && (name != other)) {
+      continue;  // not from this test
+    }
+    EXPECT_EQ(ANDROID_LOG_WARN, entry.priority);
+    EXPECT_EQ(std::string("pass 2"),
+              std::string(entry.message, entry.messageLen));
+    ++count;
+  }
+  android_logger_list_close(logger_list);
+
+  // Earlier runs of this test leave their own "pass 2" behind
+  EXPECT_LE(1, count);
+}
+#endif
+
 #ifdef USING_LOGGER_DEFAULT  // Do not retest logprint
 static bool checkPriForTag(AndroidLogFormat* p_format, const char* tag,
                            android_LogPriority pri) {
@@ -1431,6 +1615,54 @@ TEST(liblog, filterRule) {
 
   android_log_format_free(p_format);
 }
+
+// The arena must format exactly as the caller supplied buffer does.
+TEST(liblog, android_log_formatLogLineArena) {
+  AndroidLogFormat* p_format = android_log_format_new();
+  ASSERT_TRUE(NULL != p_format);
+  android_log_setPrintFormat(p_format, FORMAT_THREADTIME);
+  android_log_setPrintFormat(p_format, FORMAT_MODIFIER_PRINTABLE);
+  android_log_setPrintFormat(p_format, FORMAT_MODIFIER_UID);
+
+  std::string longMessage(2 * LOGGER_ENTRY_MAX_PAYLOAD, 'x');
+  const char* messages[] = {
+    "plain printable text", "tab\tbackslash\\control\x01",
+    "multiple\nlines\n", longMessage.c_str(),
+  };
+
+  AndroidLogEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.tv_sec = 1000000;
+  entry.priority = ANDROID_LOG_INFO;
+  entry.uid = AID_SYSTEM;
+  entry.pid = 123;
+  entry.tid = 456;
+  entry.tag = "arena";
+  entry.tagLen = strlen(entry.tag);
+
+  for (size_t i = 0; i < sizeof(messages) / sizeof(messages[0]); ++i) {
+    entry.message = messages[i];
+    entry.messageLen = strlen(messages[i]);
+    entry.tv_nsec = i * 1000;  // same second, time column is cached
+
+    char defaultBuffer[512];
+    size_t expectedLen;
+    char* expected =
+        android_log_formatLogLine(p_format, defaultBuffer,
+                                  sizeof(defaultBuffer), &entry, &expectedLen);
+    ASSERT_TRUE(NULL != expected);
+    size_t len;
+    const char* line =
+        android_log_formatLogLineArena(p_format, &entry, &len);
+    ASSERT_TRUE(NULL != line);
+    EXPECT_EQ(std::string(expected, expectedLen), std::string(line, len));
+    if (expected != defaultBuffer) {
+      free(expected);
+    }
+  }
+
+  android_log_format_free(p_format);
+}
 #endif  // USING_LOGGER_DEFAULT
 
 #ifdef USING_LOGGER_DEFAULT  // Do not retest property handling
@@ -1723,6 +1955,51 @@ TEST(liblog, is_loggable) {
 }
 #endif  // USING_LOGGER_DEFAULT
 
+#ifdef USING_LOGGER_DEFAULT  // Do not retest property handling
+// android_testLog() caches its result for a constant tag at each call site,
+// make sure a property change is still picked up.
+static bool is_loggable_fast_info() {
+  return android_testLog(ANDROID_LOG_INFO, "is_loggable_fast");
+}
+
+TEST(liblog, is_loggable_fast) {
+#ifdef __ANDROID__
+  static const char key[] = "log.tag.is_loggable_fast";
+  char hold[PROP_VALUE_MAX];
+
+  property_get(key, hold, "");
+
+  property_set(key, "S");
+  usleep(20000);
+  uint32_t generation = __android_log_loggable_generation();
+  EXPECT_FALSE(is_loggable_fast_info());
+  EXPECT_FALSE(is_loggable_fast_info());
+
+  property_set(key, "I");
+  usleep(20000);
+  EXPECT_NE(generation, __android_log_loggable_generation());
+  EXPECT_TRUE(is_loggable_fast_info());
+  EXPECT_TRUE(is_loggable_fast_info());
+
+  property_set(key, "W");
+  usleep(20000);
+  EXPECT_FALSE(is_loggable_fast_info());
+
+  property_set(key, hold);
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
+
+// Below the floor set at build time nothing is ever logged.
+TEST(liblog, is_loggable_floor) {
+  static_assert(__android_log_above_floor(LOG_PRI_FLOOR),
+                "floor itself is logged");
+  static_assert(!__android_log_above_floor(LOG_PRI_FLOOR - 1),
+                "below the floor is not");
+}
+#endif  // USING_LOGGER_DEFAULT
+
 // Following tests the specific issues surrounding error handling wrt logd.
 // Kills logd and toss all collected data, equivalent to logcat -b all -c,
 // except we also return errors to the logging callers.
@@ -3039,6 +3316,35 @@ TEST(liblog, android_log_write_list_buffer) {
             0);
   EXPECT_STREQ(msgBuf, "[1005,tag_def,(tag|1),(name|3),(format|3)]");
 }
+
+TEST(liblog, android_log_event_builder) {
+  __android_log_event_list ctx(1005);
+  ctx << 1005 << "tag_def" << (int64_t)-1 << 1.5f;
+  std::string expected(ctx);
+  ctx.close();
+
+  uint8_t buffer[64];
+  android_log_event_builder builder(buffer);
+  builder << 1005 << "tag_def" << (int64_t)-1 << 1.5f;
+  EXPECT_FALSE(builder.overflowed());
+  size_t len;
+  const uint8_t* payload = builder.payload(&len);
+  EXPECT_EQ(expected, std::string(reinterpret_cast<const char*>(payload), len));
+
+  /* Truncation is reported, and the encoding kept valid */
+  uint8_t small[16];
+  android_log_event_builder truncated(small);
+  truncated << 1005 << "a string that will not fit";
+  EXPECT_TRUE(truncated.overflowed());
+  payload = truncated.payload(&len);
+  EXPECT_EQ(sizeof(small), len);
+  char msgBuf[1024];
+  memset(msgBuf, 0, sizeof(msgBuf));
+  EXPECT_EQ(android_log_buffer_to_string(reinterpret_cast<const char*>(payload),
+                                         len, msgBuf, sizeof(msgBuf)),
+            0);
+  EXPECT_STREQ(msgBuf, "[1005,a st]");
+}
 #endif  // USING_LOGGER_DEFAULT
 
 #ifdef USING_LOGGER_DEFAULT  // Do not retest pmsg functionality
@@ -3339,4 +3645,65 @@ TEST(liblog, android_lookupEventTagNum) {
   GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
 }
+
+TEST(liblog, android_writeEventTagMapBinary) {
+#ifdef __ANDROID__
+  static const char tags[] =
+      "# comment\n"
+      "42 answer (to life the universe etc|3)\n"
+      "314 pi\n"
+      "1004 chatty (dropped|3)\n"
+      "2718 e (value|1)\n"
+      "2719 e (value|2)\n"
+      "4294967294 big_tag (value|1)\n";
+  TemporaryFile text;
+  ASSERT_TRUE(android::base::WriteStringToFd(tags, text.fd));
+
+  EventTagMap* map = android_openEventTagMap(text.path);
+  ASSERT_TRUE(NULL != map);
+  TemporaryFile binary;
+  EXPECT_EQ(0, android_writeEventTagMapBinary(map, binary.fd));
+  android_closeEventTagMap(map);
+
+  map = android_openEventTagMap(binary.path);
+  ASSERT_TRUE(NULL != map);
+
+  size_t len;
+  const char* name = android_lookupEventTag_len(map, &len, 42);
+  ASSERT_TRUE(NULL != name);
+  EXPECT_EQ(std::string("answer"), std::string(name, len));
+  EXPECT_EQ('\0', name[len]);
+  const char* format = android_lookupEventFormat_len(map, &len, 42);
+  ASSERT_TRUE(NULL != format);
+  EXPECT_EQ(std::string("(to life the universe etc|3)"),
+            std::string(format, len));
+
+  name = android_lookupEventTag_len(map, &len, 314);
+  ASSERT_TRUE(NULL != name);
+  EXPECT_EQ(std::string("pi"), std::string(name, len));
+  android_lookupEventFormat_len(map, &len, 314);
+  EXPECT_EQ(0U, len);
+
+  name = android_lookupEventTag_len(map, &len, 4294967294U);
+  ASSERT_TRUE(NULL != name);
+  EXPECT_EQ(std::string("big_tag"), std::string(name, len));
+
+  EXPECT_EQ(2718, android_lookupEventTagNum(map, "e", "(value|1)",
+                                            ANDROID_LOG_UNKNOWN));
+  EXPECT_EQ(2719, android_lookupEventTagNum(map, "e", "(value|2)",
+                                            ANDROID_LOG_UNKNOWN));
+  EXPECT_EQ(1004, android_lookupEventTagNum(map, "chatty", "(dropped|3)",
+                                            ANDROID_LOG_UNKNOWN));
+  android_closeEventTagMap(map);
+
+  // A precompiled map that does not add up must be refused
+  std::string content;
+  ASSERT_TRUE(android::base::ReadFileToString(binary.path, &content));
+  ASSERT_TRUE(android::base::WriteStringToFile(
+      content.substr(0, content.length() - 1), binary.path));
+  EXPECT_TRUE(NULL == android_openEventTagMap(binary.path));
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
 #endif  // USING_LOGGER_DEFAULT
@@ -16,20 +16,64 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <utility>
 
 #include "Allocator.h"
 #include "HeapWalker.h"
 #include "LeakFolding.h"
+#include "ScanCache.h"
 #include "ScopedSignalHandler.h"
 #include "log.h"
 
 namespace android {
 
+// Ranges are scanned in pieces of at most this size, so that a large root or
+// allocation can be spread over several threads.
+static constexpr size_t kMarkChunkBytes = 64 * 1024;
+// A thread with more than this many ranges to scan shares half of them if
+// another thread is idle.
+static constexpr size_t kMarkShareThreshold = 64;
+// Smaller ranges are quicker to scan than to look up in the scan cache.
+static constexpr size_t kMinCachedRangeBytes = 4096;
+// Starting threads costs more than it saves on small heaps.
+static constexpr size_t kParallelMarkMinAllocations = 16 * 1024;
+
+struct HeapWalker::MarkState {
+  MarkState(Allocator<HeapWalker> allocator, size_t allocations)
+      : marks((allocations + 31) / 32, allocator), shared(allocator), threads(1), idle(0) {}
+
+  // One bit per allocation, set by the first thread to reach it.
+  allocator::vector<std::atomic<uint32_t>> marks;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  // Ranges any thread can take, guarded by mutex.
+  allocator::vector<Range> shared;
+  size_t threads;
+  std::atomic<size_t> idle;
+
+  struct ThreadArgs {
+    HeapWalker* walker;
+    MarkState* state;
+    size_t thread;
+  };
+};
+
+static void PushRange(allocator::vector<Range>& to_do, const Range& range) {
+  for (uintptr_t begin = range.begin; begin < range.end; begin += kMarkChunkBytes) {
+    to_do.push_back(Range{begin, std::min(range.end, begin + kMarkChunkBytes)});
+  }
+}
+
 bool HeapWalker::Allocation(uintptr_t begin, uintptr_t end) {
   if (end == begin) {
     end = begin + 1;
@@ -37,6 +81,8 @@ bool HeapWalker::Allocation(uintptr_t begin, uintptr_t end) {
   Range range{begin, end};
   auto inserted = allocations_.insert(std::pair<Range, AllocationInfo>(range, AllocationInfo{}));
   if (inserted.second) {
+    inserted.first->second.index = allocations_.size() - 1;
+    index_valid_ = false;
     valid_allocations_range_.begin = std::min(valid_allocations_range_.begin, begin);
     valid_allocations_range_.end = std::max(valid_allocations_range_.end, end);
     allocation_bytes_ += range.size();
@@ -52,39 +98,178 @@ bool HeapWalker::Allocation(uintptr_t begin, uintptr_t end) {
   }
 }
 
-bool HeapWalker::WordContainsAllocationPtr(uintptr_t word_ptr, Range* range, AllocationInfo** info) {
-  walking_ptr_ = word_ptr;
+bool HeapWalker::WordContainsAllocationPtr(uintptr_t word_ptr, size_t thread, Range* range,
+                                           AllocationInfo** info) {
+  walking_ptrs_[thread].store(word_ptr, std::memory_order_relaxed);
   // This access may segfault if the process under test has done something strange,
   // for example mprotect(PROT_NONE) on a native heap page.  If so, it will be
   // caught and handled by mmaping a zero page over the faulting page.
   uintptr_t value = *reinterpret_cast<uintptr_t*>(word_ptr);
-  walking_ptr_ = 0;
+  walking_ptrs_[thread].store(0, std::memory_order_relaxed);
+  return ValueIsAllocationPtr(value, range, info);
+}
+
+bool HeapWalker::ValueIsAllocationPtr(uintptr_t value, Range* range, AllocationInfo** info) {
   if (value >= valid_allocations_range_.begin && value < valid_allocations_range_.end) {
-    AllocationMap::iterator it = allocations_.find(Range{value, value + 1});
-    if (it != allocations_.end()) {
-      *range = it->first;
-      *info = &it->second;
+    size_t bucket = (value - valid_allocations_range_.begin) >> index_shift_;
+    auto first = index_ranges_.begin() + index_buckets_[bucket];
+    auto last = index_ranges_.begin() +
+                std::min<size_t>(index_buckets_[bucket + 1] + 1, index_ranges_.size());
+    auto it = std::upper_bound(first, last, value,
+                               [](uintptr_t v, const Range& r) { return v < r.begin; });
+    if (it != first && value < (--it)->end) {
+      *range = *it;
+      *info = index_infos_[it - index_ranges_.begin()];
       return true;
     }
   }
   return false;
 }
 
-void HeapWalker::RecurseRoot(const Range& root) {
-  allocator::vector<Range> to_do(1, root, allocator_);
-  while (!to_do.empty()) {
+void HeapWalker::BuildIndex() {
+  if (index_valid_) {
+    return;
+  }
+  index_valid_ = true;
+
+  index_ranges_.clear();
+  index_infos_.clear();
+  index_buckets_.clear();
+  index_ranges_.reserve(allocations_.size());
+  index_infos_.reserve(allocations_.size());
+  for (auto& it : allocations_) {
+    index_ranges_.push_back(it.first);
+    index_infos_.push_back(&it.second);
+  }
+  if (index_ranges_.empty()) {
+    return;
+  }
+
+  // About one bucket per allocation, so most lookups search only a few.
+  uintptr_t span = valid_allocations_range_.end - valid_allocations_range_.begin;
+  index_shift_ = 0;
+  while ((span - 1) >> index_shift_ >= index_ranges_.size()) {
+    index_shift_++;
+  }
+  size_t num_buckets = ((span - 1) >> index_shift_) + 1;
+
+  index_buckets_.resize(num_buckets + 1);
+  size_t i = 0;
+  for (size_t bucket = 0; bucket <= num_buckets; bucket++) {
+    uintptr_t bucket_begin = static_cast<uintptr_t>(bucket) << index_shift_;
+    while (i < index_ranges_.size() &&
+           index_ranges_[i].end - valid_allocations_range_.begin <= bucket_begin) {
+      i++;
+    }
+    index_buckets_[bucket] = i;
+  }
+}
+
+void HeapWalker::UseScanCache(const ScanCache* previous,
+                              const allocator::vector<Range>* clean_pages, ScanCache* next) {
+  previous_scan_cache_ = previous;
+  clean_pages_ = clean_pages;
+  next_scan_cache_ = next;
+}
+
+bool HeapWalker::IsClean(const Range& range) {
+  auto it = std::upper_bound(clean_pages_->begin(), clean_pages_->end(), range.begin,
+                             [](uintptr_t begin, const Range& r) { return begin < r.begin; });
+  return it != clean_pages_->begin() && range.end <= (--it)->end;
+}
+
+template <class F>
+void HeapWalker::ScanRange(const Range& range, size_t thread, allocator::vector<uintptr_t>& found,
+                           F&& f) {
+  // root_vals_ was written by this process, which the soft-dirty bits of the
+  // walked process don't cover.
+  if (next_scan_cache_ == nullptr || range.size() < kMinCachedRangeBytes ||
+      (range.begin >= root_vals_range_.begin && range.end <= root_vals_range_.end)) {
+    scanned_bytes_ += range.size();
+    ForEachPtrInRange(range, thread, f);
+    return;
+  }
+
+  // Pointers in pages nobody wrote since the last walk are the same, but
+  // may point at allocations that were freed since.
+  found.clear();
+  const uintptr_t* values;
+  size_t num_values;
+  if (previous_scan_cache_ != nullptr && IsClean(range) &&
+      previous_scan_cache_->Find(range, &values, &num_values)) {
+    cached_bytes_ += range.size();
+    for (size_t i = 0; i < num_values; i++) {
+      Range ref_range;
+      AllocationInfo* ref_info;
+      if (ValueIsAllocationPtr(values[i], &ref_range, &ref_info)) {
+        found.push_back(values[i]);
+        f(ref_range, ref_info);
+      }
+    }
+  } else {
+    scanned_bytes_ += range.size();
+    uintptr_t begin = (range.begin + (sizeof(uintptr_t) - 1)) & ~(sizeof(uintptr_t) - 1);
+    for (uintptr_t i = begin; i < range.end; i += sizeof(uintptr_t)) {
+      Range ref_range;
+      AllocationInfo* ref_info;
+      if (WordContainsAllocationPtr(i, thread, &ref_range, &ref_info)) {
+        found.push_back(*reinterpret_cast<uintptr_t*>(i));
+        f(ref_range, ref_info);
+      }
+    }
+  }
+  next_scan_cache_->Add(range, found.data(), found.size());
+}
+
+void HeapWalker::Mark(MarkState& state, size_t thread) {
+  allocator::vector<Range> to_do(allocator_);
+  allocator::vector<uintptr_t> found(allocator_);
+  while (true) {
+    if (to_do.empty()) {
+      std::unique_lock<std::mutex> lk(state.mutex);
+      state.idle++;
+      while (state.shared.empty()) {
+        if (state.idle == state.threads) {
+          // Everybody is out of work, so nobody can find more.
+          state.cond.notify_all();
+          return;
+        }
+        state.cond.wait(lk);
+      }
+      state.idle--;
+      size_t take = std::max<size_t>(1, state.shared.size() / state.threads);
+      to_do.insert(to_do.end(), state.shared.end() - take, state.shared.end());
+      state.shared.resize(state.shared.size() - take);
+    }
+
     Range range = to_do.back();
     to_do.pop_back();
 
-    ForEachPtrInRange(range, [&](Range& ref_range, AllocationInfo* ref_info) {
-      if (!ref_info->referenced_from_root) {
-        ref_info->referenced_from_root = true;
-        to_do.push_back(ref_range);
+    ScanRange(range, thread, found, [&](Range& ref_range, AllocationInfo* ref_info) {
+      std::atomic<uint32_t>& word = state.marks[ref_info->index / 32];
+      uint32_t bit = 1U << (ref_info->index % 32);
+      if (!(word.load(std::memory_order_relaxed) & bit) &&
+          !(word.fetch_or(bit, std::memory_order_relaxed) & bit)) {
+        PushRange(to_do, ref_range);
       }
     });
+
+    if (to_do.size() > kMarkShareThreshold && state.idle.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> lk(state.mutex);
+      size_t give = to_do.size() / 2;
+      state.shared.insert(state.shared.end(), to_do.end() - give, to_do.end());
+      to_do.resize(to_do.size() - give);
+      state.cond.notify_all();
+    }
   }
 }
 
+void* HeapWalker::MarkThread(void* arg) {
+  MarkState::ThreadArgs* args = reinterpret_cast<MarkState::ThreadArgs*>(arg);
+  args->walker->Mark(*args->state, args->thread);
+  return nullptr;
+}
+
 void HeapWalker::Root(uintptr_t begin, uintptr_t end) {
   roots_.push_back(Range{begin, end});
 }
@@ -102,16 +287,55 @@ size_t HeapWalker::AllocationBytes() {
 }
 
 bool HeapWalker::DetectLeaks() {
-  // Recursively walk pointers from roots to mark referenced allocations
+  BuildIndex();
+  MarkState state(allocator_, allocations_.size());
+
+  // Walk pointers from roots to mark referenced allocations
   for (auto it = roots_.begin(); it != roots_.end(); it++) {
-    RecurseRoot(*it);
+    PushRange(state.shared, *it);
+  }
+
+  root_vals_range_.begin = reinterpret_cast<uintptr_t>(root_vals_.data());
+  root_vals_range_.end = root_vals_range_.begin + root_vals_.size() * sizeof(uintptr_t);
+  PushRange(state.shared, root_vals_range_);
+
+  size_t num_threads = 1;
+  if (allocations_.size() >= kParallelMarkMinAllocations) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = std::min(kMaxMarkThreads, static_cast<size_t>(std::max(cpus, 1L)));
+  }
+
+  // The calling thread marks too, as thread 0.  Threads only start taking
+  // work once they have all been counted.
+  MarkState::ThreadArgs args[kMaxMarkThreads];
+  pthread_t pthreads[kMaxMarkThreads];
+  size_t started = 0;
+  {
+    std::lock_guard<std::mutex> lk(state.mutex);
+    for (size_t i = 1; i < num_threads; i++) {
+      args[started] = MarkState::ThreadArgs{this, &state, started + 1};
+      int ret = pthread_create(&pthreads[started], nullptr, MarkThread, &args[started]);
+      if (ret != 0) {
+        MEM_ALOGW("failed to start marking thread: %s", strerror(ret));
+        break;
+      }
+      started++;
+    }
+    state.threads = started + 1;
   }
 
-  Range vals;
-  vals.begin = reinterpret_cast<uintptr_t>(root_vals_.data());
-  vals.end = vals.begin + root_vals_.size() * sizeof(uintptr_t);
+  Mark(state, 0);
 
-  RecurseRoot(vals);
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(pthreads[i], nullptr);
+  }
+
+  for (auto& it : allocations_) {
+    AllocationInfo& info = it.second;
+    if (state.marks[info.index / 32].load(std::memory_order_relaxed) & (1U << (info.index % 32))) {
+      info.referenced_from_root = true;
+    }
+  }
 
   return true;
 }
@@ -164,7 +388,10 @@ static bool MapOverPage(void* addr) {
 void HeapWalker::HandleSegFault(ScopedSignalHandler& handler, int signal, siginfo_t* si,
                                 void* /*uctx*/) {
   uintptr_t addr = reinterpret_cast<uintptr_t>(si->si_addr);
-  if (addr != walking_ptr_) {
+  if (std::none_of(std::begin(walking_ptrs_), std::end(walking_ptrs_),
+                   [addr](const std::atomic<uintptr_t>& ptr) {
+                     return ptr.load(std::memory_order_relaxed) == addr;
+                   })) {
     handler.reset();
     return;
   }
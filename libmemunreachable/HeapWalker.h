@@ -19,6 +19,8 @@
 
 #include <signal.h>
 
+#include <atomic>
+
 #include "android-base/macros.h"
 
 #include "Allocator.h"
@@ -27,6 +29,8 @@
 
 namespace android {
 
+class ScanCache;
+
 // A range [begin, end)
 struct Range {
   uintptr_t begin;
@@ -50,10 +54,23 @@ class HeapWalker {
       : allocator_(allocator),
         allocations_(allocator),
         allocation_bytes_(0),
+        index_valid_(false),
+        index_ranges_(allocator),
+        index_infos_(allocator),
+        index_buckets_(allocator),
+        index_shift_(0),
         roots_(allocator),
         root_vals_(allocator),
-        segv_handler_(allocator),
-        walking_ptr_(0) {
+        previous_scan_cache_(nullptr),
+        clean_pages_(nullptr),
+        next_scan_cache_(nullptr),
+        scanned_bytes_(0),
+        cached_bytes_(0),
+        segv_handler_(allocator) {
+    root_vals_range_.begin = root_vals_range_.end = 0;
+    for (auto& walking_ptr : walking_ptrs_) {
+      walking_ptr = 0;
+    }
     valid_allocations_range_.end = 0;
     valid_allocations_range_.begin = ~valid_allocations_range_.end;
 
@@ -68,11 +85,20 @@ class HeapWalker {
   void Root(uintptr_t begin, uintptr_t end);
   void Root(const allocator::vector<uintptr_t>& vals);
 
+  // Makes DetectLeaks take the pointers that the walk that filled previous
+  // found in ranges lying entirely in clean_pages instead of scanning them,
+  // and record the pointers it finds in next.  previous may be null.
+  void UseScanCache(const ScanCache* previous, const allocator::vector<Range>* clean_pages,
+                    ScanCache* next);
+
   bool DetectLeaks();
 
   bool Leaked(allocator::vector<Range>&, size_t limit, size_t* num_leaks, size_t* leak_bytes);
   size_t Allocations();
   size_t AllocationBytes();
+  // Bytes DetectLeaks read, and bytes it took the pointers in from the scan cache.
+  size_t ScannedBytes() { return scanned_bytes_; }
+  size_t CachedBytes() { return cached_bytes_; }
 
   template <class F>
   void ForEachPtrInRange(const Range& range, F&& f);
@@ -82,11 +108,35 @@ class HeapWalker {
 
   struct AllocationInfo {
     bool referenced_from_root;
+    // Position in the mark bitmap, in the order the allocations were added
+    size_t index;
   };
 
+  // Upper bound on the threads that mark reachable allocations.
+  static constexpr size_t kMaxMarkThreads = 8;
+
  private:
-  void RecurseRoot(const Range& root);
-  bool WordContainsAllocationPtr(uintptr_t ptr, Range* range, AllocationInfo** info);
+  struct MarkState;
+
+  // Marks everything reachable from the ranges handed out by state, on the
+  // calling thread, until no thread has any work left.
+  void Mark(MarkState& state, size_t thread);
+  static void* MarkThread(void* arg);
+
+  // Builds the index that WordContainsAllocationPtr looks words up in, if
+  // allocations were added since it was last built.
+  void BuildIndex();
+
+  template <class F>
+  void ForEachPtrInRange(const Range& range, size_t thread, F&& f);
+  // Calls f for the pointers in range, from the scan cache if possible. found
+  // is scratch space.
+  template <class F>
+  void ScanRange(const Range& range, size_t thread, allocator::vector<uintptr_t>& found, F&& f);
+  bool WordContainsAllocationPtr(uintptr_t ptr, size_t thread, Range* range,
+                                 AllocationInfo** info);
+  bool ValueIsAllocationPtr(uintptr_t value, Range* range, AllocationInfo** info);
+  bool IsClean(const Range& range);
   void HandleSegFault(ScopedSignalHandler&, int, siginfo_t*, void*);
 
   DISALLOW_COPY_AND_ASSIGN(HeapWalker);
@@ -96,15 +146,42 @@ class HeapWalker {
   size_t allocation_bytes_;
   Range valid_allocations_range_;
 
+  // The allocations sorted by address, in flat arrays that are much cheaper
+  // to search than allocations_.  valid_allocations_range_ is split into
+  // buckets of 1 << index_shift_ bytes, and index_buckets_[b] is the first
+  // allocation that ends after the start of bucket b, so a word in bucket b
+  // can only point into allocations index_buckets_[b] to
+  // index_buckets_[b + 1].
+  bool index_valid_;
+  allocator::vector<Range> index_ranges_;
+  allocator::vector<AllocationInfo*> index_infos_;
+  allocator::vector<uint32_t> index_buckets_;
+  unsigned int index_shift_;
+
   allocator::vector<Range> roots_;
   allocator::vector<uintptr_t> root_vals_;
+  Range root_vals_range_;
+
+  const ScanCache* previous_scan_cache_;
+  const allocator::vector<Range>* clean_pages_;
+  ScanCache* next_scan_cache_;
+  std::atomic<size_t> scanned_bytes_;
+  std::atomic<size_t> cached_bytes_;
 
   ScopedSignalHandler segv_handler_;
-  uintptr_t walking_ptr_;
+  // The word each marking thread is reading, so that a fault on it can be
+  // told apart from a real crash.
+  std::atomic<uintptr_t> walking_ptrs_[kMaxMarkThreads];
 };
 
 template <class F>
 inline void HeapWalker::ForEachPtrInRange(const Range& range, F&& f) {
+  BuildIndex();
+  ForEachPtrInRange(range, 0, f);
+}
+
+template <class F>
+inline void HeapWalker::ForEachPtrInRange(const Range& range, size_t thread, F&& f) {
   uintptr_t begin = (range.begin + (sizeof(uintptr_t) - 1)) & ~(sizeof(uintptr_t) - 1);
   // TODO(ccross): we might need to consider a pointer to the end of a buffer
   // to be inside the buffer, which means the common case of a pointer to the
@@ -112,7 +189,7 @@ inline void HeapWalker::ForEachPtrInRange(const Range& range, F&& f) {
   for (uintptr_t i = begin; i < range.end; i += sizeof(uintptr_t)) {
     Range ref_range;
     AllocationInfo* ref_info;
-    if (WordContainsAllocationPtr(i, &ref_range, &ref_info)) {
+    if (WordContainsAllocationPtr(i, thread, &ref_range, &ref_info)) {
       f(ref_range, ref_info);
     }
   }
@@ -67,7 +67,9 @@ class LeakPipe {
     if (!SendFd(sv_[1], pipe.Receiver())) {
       return false;
     }
-    pipe.ReleaseReceiver();
+    // The receiving process has its own copy now.  Closing this one lets
+    // writes fail once the receiver stops reading.
+    pipe.CloseReceiver();
 
     sender_.SetFd(pipe.ReleaseSender());
     return true;
@@ -118,7 +120,15 @@ class LeakPipe {
         return false;
       }
 
-      ssize_t ret = TEMP_FAILURE_RETRY(write(fd_, vector.data(), size));
+      return SendArray(vector.data(), vector.size());
+    }
+
+    // Sends |count| objects without their count, for a receiver that learns
+    // it some other way.
+    template <typename T>
+    bool SendArray(const T* array, size_t count) {
+      size_t size = count * sizeof(T);
+      ssize_t ret = TEMP_FAILURE_RETRY(write(fd_, array, size));
       if (ret < 0) {
         MEM_ALOGE("failed to send vector: %s", strerror(errno));
         return false;
@@ -158,7 +168,14 @@ class LeakPipe {
 
       vector.resize(size / sizeof(T));
 
-      char* ptr = reinterpret_cast<char*>(vector.data());
+      return ReceiveArray(vector.data(), vector.size());
+    }
+
+    // Receives |count| objects sent by SendArray, possibly a few at a time.
+    template <typename T>
+    bool ReceiveArray(T* array, size_t count) {
+      size_t size = count * sizeof(T);
+      char* ptr = reinterpret_cast<char*>(array);
       while (size > 0) {
         ssize_t ret = TEMP_FAILURE_RETRY(read(fd_, ptr, size));
         if (ret < 0) {
@@ -15,6 +15,7 @@
  */
 
 #include <inttypes.h>
+#include <signal.h>
 #include <string.h>
 
 #include <functional>
@@ -35,8 +36,10 @@
 #include "LeakPipe.h"
 #include "ProcessMappings.h"
 #include "PtracerThread.h"
+#include "ScanCache.h"
 #include "ScopedDisableMalloc.h"
 #include "Semaphore.h"
+#include "SoftDirty.h"
 #include "ThreadCapture.h"
 
 #include "bionic.h"
@@ -60,6 +63,10 @@ class MemUnreachable {
                             size_t* leak_bytes);
   size_t Allocations() { return heap_walker_.Allocations(); }
   size_t AllocationBytes() { return heap_walker_.AllocationBytes(); }
+  void UseScanCache(const ScanCache* previous, const allocator::vector<Range>* clean_pages,
+                    ScanCache* next) {
+    heap_walker_.UseScanCache(previous, clean_pages, next);
+  }
 
  private:
   bool ClassifyMappings(const allocator::vector<Mapping>& mappings,
@@ -136,6 +143,10 @@ bool MemUnreachable::GetUnreachableMemory(allocator::vector<Leak>& leaks, size_t
   if (!heap_walker_.DetectLeaks()) {
     return false;
   }
+  if (heap_walker_.CachedBytes() > 0) {
+    MEM_ALOGI("scanned %zu bytes, reused pointers in %zu bytes from the previous walk",
+              heap_walker_.ScannedBytes(), heap_walker_.CachedBytes());
+  }
 
   allocator::vector<Range> leaked1{allocator_};
   heap_walker_.Leaked(leaked1, 0, num_leaks, leak_bytes);
@@ -269,7 +280,25 @@ static inline const char* plural(T val) {
   return (val == 1) ? "" : "s";
 }
 
-bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
+// Size of each of the scan caches kept between incremental walks.  Only the
+// parts that are written take up memory.
+static constexpr size_t kScanCacheBytes = (sizeof(uintptr_t) == 8 ? 256 : 32) * 1024 * 1024;
+
+// Scan caches kept between incremental walks, which all hold the mutex.
+static std::mutex scan_caches_mutex;
+static SharedScanCaches scan_caches;
+
+// Leaks received from the heap walker process at a time when they are passed
+// to a callback.
+static const size_t kLeakChunkSize = 16;
+
+// With caches, reuses what the previous walk found in pages that were not
+// written since, and records what this walk finds for the next one.  With
+// |leak_fn|, passes it the leaks a chunk at a time instead of collecting them
+// in |info|.leaks.
+static bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit,
+                                 SharedScanCaches* caches,
+                                 const std::function<bool(const Leak&)>* leak_fn) {
   int parent_pid = getpid();
   int parent_tid = gettid();
 
@@ -277,6 +306,7 @@ bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
 
   Semaphore continue_parent_sem;
   LeakPipe pipe;
+  bool record_scan_cache = false;
 
   PtracerThread thread{[&]() -> int {
     /////////////////////////////////////////////
@@ -288,6 +318,8 @@ bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
     allocator::vector<ThreadInfo> thread_info(heap);
     allocator::vector<Mapping> mappings(heap);
     allocator::vector<uintptr_t> refs(heap);
+    allocator::vector<Range> clean_pages(heap);
+    bool use_scan_cache = false;
 
     // ptrace all the threads
     if (!thread_capture.CaptureThreads()) {
@@ -312,6 +344,18 @@ bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
       return 1;
     }
 
+    // Find the pages written since the previous walk, and start over for the
+    // next one.  All threads are paused, so no write can be missed.
+    if (caches != nullptr) {
+      use_scan_cache =
+          caches->Previous()->Complete() && CleanPages(parent_pid, mappings, clean_pages);
+      record_scan_cache = ClearSoftDirty(parent_pid);
+      if (!record_scan_cache) {
+        use_scan_cache = false;
+        caches->Invalidate();
+      }
+    }
+
     // malloc must be enabled to call fork, at_fork handlers take the same
     // locks as ScopedDisableMalloc.  All threads are paused in ptrace, so
     // memory state is still consistent.  Unfreeze the original thread so it
@@ -334,12 +378,20 @@ bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
       if (!pipe.OpenSender()) {
         _exit(1);
       }
+      // The original thread may stop reading the leaks early, fail the
+      // writes instead of dying.
+      signal(SIGPIPE, SIG_IGN);
 
       MemUnreachable unreachable{parent_pid, heap};
 
       if (!unreachable.CollectAllocations(thread_info, mappings, refs)) {
         _exit(2);
       }
+      if (record_scan_cache) {
+        caches->Next()->Reset();
+        unreachable.UseScanCache(use_scan_cache ? caches->Previous() : nullptr, &clean_pages,
+                                 caches->Next());
+      }
       size_t num_allocations = unreachable.Allocations();
       size_t allocation_bytes = unreachable.AllocationBytes();
 
@@ -353,7 +405,12 @@ bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
       ok = ok && pipe.Sender().Send(allocation_bytes);
       ok = ok && pipe.Sender().Send(num_leaks);
       ok = ok && pipe.Sender().Send(leak_bytes);
-      ok = ok && pipe.Sender().SendVector(leaks);
+      if (record_scan_cache) {
+        bool scan_cache_ok = ok && caches->Next()->Finish();
+        ok = ok && pipe.Sender().Send(scan_cache_ok);
+      }
+      ok = ok && pipe.Sender().Send(leaks.size());
+      ok = ok && pipe.Sender().SendArray(leaks.data(), leaks.size());
 
       if (!ok) {
         _exit(3);
@@ -388,23 +445,28 @@ bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
 
   // Wait for the collection thread to exit
   int ret = thread.Join();
-  if (ret != 0) {
-    return false;
-  }
 
   // Get a pipe from the heap walker process.  Transferring a new pipe fd
   // ensures no other forked processes can have it open, so when the heap
   // walker process dies the remote side of the pipe will close.
-  if (!pipe.OpenReceiver()) {
-    return false;
-  }
-
-  bool ok = true;
+  bool ok = ret == 0 && pipe.OpenReceiver();
   ok = ok && pipe.Receiver().Receive(&info.num_allocations);
   ok = ok && pipe.Receiver().Receive(&info.allocation_bytes);
   ok = ok && pipe.Receiver().Receive(&info.num_leaks);
   ok = ok && pipe.Receiver().Receive(&info.leak_bytes);
-  ok = ok && pipe.Receiver().ReceiveVector(info.leaks);
+  if (record_scan_cache) {
+    // The soft-dirty bits were cleared, so without the new cache the old one
+    // is of no use either.
+    bool scan_cache_ok = false;
+    ok = ok && pipe.Receiver().Receive(&scan_cache_ok);
+    if (ok && scan_cache_ok) {
+      caches->Commit();
+    } else {
+      caches->Invalidate();
+    }
+  }
+  size_t num_leak_records = 0;
+  ok = ok && pipe.Receiver().Receive(&num_leak_records);
   if (!ok) {
     return false;
   }
@@ -413,7 +475,28 @@ bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
   MEM_ALOGE("%zu bytes in %zu allocation%s unreachable out of %zu bytes in %zu allocation%s",
             info.leak_bytes, info.num_leaks, plural(info.num_leaks), info.allocation_bytes,
             info.num_allocations, plural(info.num_allocations));
-  return true;
+
+  if (leak_fn == nullptr) {
+    info.leaks.resize(num_leak_records);
+    return pipe.Receiver().ReceiveArray(info.leaks.data(), info.leaks.size());
+  }
+
+  // Only a chunk of the leaks is held at a time, stop as soon as the callback
+  // has seen enough.
+  Leak chunk[kLeakChunkSize];
+  bool more = true;
+  while (ok && more && num_leak_records > 0) {
+    size_t count = std::min(num_leak_records, kLeakChunkSize);
+    ok = pipe.Receiver().ReceiveArray(chunk, count);
+    for (size_t i = 0; ok && more && i < count; i++) {
+      more = (*leak_fn)(chunk[i]);
+    }
+    num_leak_records -= count;
+  }
+  // As in ~UnreachableMemoryInfo, don't leave pointers to the leaks behind
+  // for the next walk to find.
+  memset(chunk, 0, sizeof(chunk));
+  return ok;
 }
 
 std::string Leak::ToString(bool log_contents) const {
@@ -496,13 +579,34 @@ std::string Leak::ToString(bool log_contents) const {
 #error "Unsupported ABI"
 #endif
 
-std::string UnreachableMemoryInfo::ToString(bool log_contents) const {
-  std::ostringstream oss;
-  oss << "  " << leak_bytes << " bytes in ";
-  oss << num_leaks << " unreachable allocation" << plural(num_leaks);
+bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit) {
+  return GetUnreachableMemory(info, limit, nullptr, nullptr);
+}
+
+bool GetUnreachableMemoryIncremental(UnreachableMemoryInfo& info, size_t limit) {
+  std::lock_guard<std::mutex> lk(scan_caches_mutex);
+  if (!SoftDirtySupported() || !scan_caches.Map(kScanCacheBytes)) {
+    return GetUnreachableMemory(info, limit, nullptr, nullptr);
+  }
+  return GetUnreachableMemory(info, limit, &scan_caches, nullptr);
+}
+
+bool IterateUnreachableMemory(UnreachableMemoryInfo& info, size_t limit,
+                              const std::function<bool(const Leak&)>& fn) {
+  return GetUnreachableMemory(info, limit, nullptr, &fn);
+}
+
+static void SummaryToString(const UnreachableMemoryInfo& info, std::ostream& oss) {
+  oss << "  " << info.leak_bytes << " bytes in ";
+  oss << info.num_leaks << " unreachable allocation" << plural(info.num_leaks);
   oss << std::endl;
   oss << "  ABI: '" ABI_STRING "'" << std::endl;
   oss << std::endl;
+}
+
+std::string UnreachableMemoryInfo::ToString(bool log_contents) const {
+  std::ostringstream oss;
+  SummaryToString(*this, oss);
 
   for (auto it = leaks.begin(); it != leaks.end(); it++) {
     oss << it->ToString(log_contents);
@@ -513,29 +617,41 @@ std::string UnreachableMemoryInfo::ToString(bool log_contents) const {
 }
 
 std::string GetUnreachableMemoryString(bool log_contents, size_t limit) {
+  // Formats each leak as it arrives rather than holding all of them and the
+  // string at once.  The summary is known before the first leak arrives.
   UnreachableMemoryInfo info;
-  if (!GetUnreachableMemory(info, limit)) {
+  std::ostringstream oss;
+  bool summarized = false;
+  bool ok = IterateUnreachableMemory(info, limit, [&](const Leak& leak) {
+    if (!summarized) {
+      SummaryToString(info, oss);
+      summarized = true;
+    }
+    oss << leak.ToString(log_contents);
+    oss << std::endl;
+    return true;
+  });
+  if (!ok) {
     return "Failed to get unreachable memory\n"
            "If you are trying to get unreachable memory from a system app\n"
            "(like com.android.systemui), disable selinux first using\n"
            "setenforce 0\n";
   }
+  if (!summarized) {
+    SummaryToString(info, oss);
+  }
 
-  return info.ToString(log_contents);
+  return oss.str();
 }
 
 }  // namespace android
 
 bool LogUnreachableMemory(bool log_contents, size_t limit) {
   android::UnreachableMemoryInfo info;
-  if (!android::GetUnreachableMemory(info, limit)) {
-    return false;
-  }
-
-  for (auto it = info.leaks.begin(); it != info.leaks.end(); it++) {
-    MEM_ALOGE("%s", it->ToString(log_contents).c_str());
-  }
-  return true;
+  return android::IterateUnreachableMemory(info, limit, [&](const android::Leak& leak) {
+    MEM_ALOGE("%s", leak.ToString(log_contents).c_str());
+    return true;
+  });
 }
 
 bool NoLeaks() {
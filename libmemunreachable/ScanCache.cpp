@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include "ScanCache.h"
+#include "log.h"
+
+namespace android {
+
+static constexpr uint32_t kScanCacheMagic = 0x53434e43;  // "SCNC"
+
+ScanCache::ScanCache(void* buffer, size_t size) {
+  // An eighth of the space holds entries, the rest the pointers in them.
+  size_t space = size - sizeof(Header);
+  header_ = reinterpret_cast<Header*>(buffer);
+  entries_ = reinterpret_cast<Entry*>(header_ + 1);
+  max_entries_ = space / 8 / sizeof(Entry);
+  values_ = reinterpret_cast<uintptr_t*>(entries_ + max_entries_);
+  max_values_ = (space - max_entries_ * sizeof(Entry)) / sizeof(uintptr_t);
+}
+
+void ScanCache::Reset() {
+  header_->magic = kScanCacheMagic;
+  header_->complete = 0;
+  header_->num_entries = 0;
+  header_->num_values = 0;
+  header_->overflow = false;
+}
+
+bool ScanCache::Complete() const {
+  return header_->magic == kScanCacheMagic && header_->complete;
+}
+
+bool ScanCache::Find(const Range& range, const uintptr_t** values, size_t* num_values) const {
+  const Entry* begin = entries_;
+  const Entry* end = begin + header_->num_entries.load(std::memory_order_relaxed);
+  const Entry* it = std::lower_bound(
+      begin, end, range.begin, [](const Entry& e, uintptr_t begin) { return e.begin < begin; });
+  if (it == end || it->begin != range.begin || it->end != range.end) {
+    return false;
+  }
+  *values = values_ + it->first_value;
+  *num_values = it->num_values;
+  return true;
+}
+
+void ScanCache::Add(const Range& range, const uintptr_t* values, size_t num_values) {
+  size_t entry = header_->num_entries.fetch_add(1, std::memory_order_relaxed);
+  size_t first = header_->num_values.fetch_add(num_values, std::memory_order_relaxed);
+  if (entry >= max_entries_ || first > max_values_ || num_values > max_values_ - first) {
+    header_->overflow = true;
+    return;
+  }
+  memcpy(values_ + first, values, num_values * sizeof(uintptr_t));
+  entries_[entry] = Entry{range.begin, range.end, first, num_values};
+}
+
+bool ScanCache::Finish() {
+  if (header_->overflow) {
+    MEM_ALOGW("scan cache is full, the next walk will scan everything");
+    return false;
+  }
+  std::sort(entries_, entries_ + header_->num_entries.load(),
+            [](const Entry& a, const Entry& b) { return a.begin < b.begin; });
+  header_->complete = 1;
+  return true;
+}
+
+SharedScanCaches::~SharedScanCaches() {
+  if (buffer_ != nullptr) {
+    munmap(buffer_, 2 * size_);
+  }
+}
+
+bool SharedScanCaches::Map(size_t size) {
+  if (buffer_ != nullptr) {
+    return true;
+  }
+  // Only the pages that walks write to take up memory.
+  void* buffer = mmap(NULL, 2 * size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (buffer == MAP_FAILED) {
+    MEM_ALOGE("failed to map scan caches: %s", strerror(errno));
+    return false;
+  }
+  buffer_ = buffer;
+  size_ = size;
+  caches_[0] = ScanCache(Buffer(0), size);
+  caches_[1] = ScanCache(Buffer(1), size);
+  current_ = 0;
+  return true;
+}
+
+void SharedScanCaches::Release(int which) {
+  if (madvise(Buffer(which), size_, MADV_REMOVE) != 0) {
+    caches_[which].Reset();
+  }
+}
+
+void SharedScanCaches::Commit() {
+  current_ ^= 1;
+  Release(current_ ^ 1);
+}
+
+void SharedScanCaches::Invalidate() {
+  Release(0);
+  Release(1);
+}
+
+}  // namespace android
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBMEMUNREACHABLE_SCAN_CACHE_H_
+#define LIBMEMUNREACHABLE_SCAN_CACHE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "android-base/macros.h"
+
+#include "HeapWalker.h"
+
+namespace android {
+
+// The pointers that a heap walk found in the ranges it scanned, so that the
+// next walk can take them instead of scanning again the ranges whose pages
+// have not been written since.  The cache lives in a buffer provided by the
+// caller, which can be shared with the heap walker process.
+class ScanCache {
+ public:
+  ScanCache() : header_(nullptr), entries_(nullptr), max_entries_(0), values_(nullptr), max_values_(0) {}
+  ScanCache(void* buffer, size_t size);
+
+  // Empties the cache, for a walk to fill it.
+  void Reset();
+  // Whether a walk filled the cache and everything it found fit.
+  bool Complete() const;
+
+  // Finds the pointers the walk that filled the cache found in range, if it
+  // scanned exactly that range.  The cache must be complete.
+  bool Find(const Range& range, const uintptr_t** values, size_t* num_values) const;
+
+  // Adds the pointers found in range.  Can be called from several threads.
+  void Add(const Range& range, const uintptr_t* values, size_t num_values);
+  // Prepares the cache for Find, returns false if something did not fit.
+  bool Finish();
+
+ private:
+  struct Entry {
+    uintptr_t begin;
+    uintptr_t end;
+    size_t first_value;
+    size_t num_values;
+  };
+
+  struct Header {
+    uint32_t magic;
+    uint32_t complete;
+    std::atomic<size_t> num_entries;
+    std::atomic<size_t> num_values;
+    std::atomic<bool> overflow;
+  };
+
+  Header* header_;
+  Entry* entries_;
+  size_t max_entries_;
+  uintptr_t* values_;
+  size_t max_values_;
+};
+
+// A pair of scan caches in memory that forked processes share: the one the
+// last walk filled and the one the next walk fills.
+class SharedScanCaches {
+ public:
+  SharedScanCaches() : buffer_(nullptr), size_(0), current_(0) {}
+  ~SharedScanCaches();
+
+  // Maps the caches, size bytes each, if not done yet.
+  bool Map(size_t size);
+
+  ScanCache* Previous() { return &caches_[current_]; }
+  ScanCache* Next() { return &caches_[current_ ^ 1]; }
+
+  // Makes the cache that the last walk filled the previous one, and releases
+  // the memory of the other.
+  void Commit();
+  // Drops both caches, for example after the walk failed.
+  void Invalidate();
+
+ private:
+  void* Buffer(int which) { return reinterpret_cast<char*>(buffer_) + which * size_; }
+  void Release(int which);
+
+  DISALLOW_COPY_AND_ASSIGN(SharedScanCaches);
+  void* buffer_;
+  size_t size_;
+  ScanCache caches_[2];
+  int current_;
+};
+
+}  // namespace android
+
+#endif  // LIBMEMUNREACHABLE_SCAN_CACHE_H_
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <android-base/unique_fd.h>
+
+#include "SoftDirty.h"
+#include "log.h"
+
+namespace android {
+
+// Bits of a /proc/pid/pagemap entry, see Documentation/vm/pagemap.txt
+static constexpr uint64_t kPagemapPresent = 1ULL << 63;
+static constexpr uint64_t kPagemapSoftDirty = 1ULL << 55;
+
+// Number of pagemap entries read at a time.
+static constexpr size_t kPagemapBatch = 512;
+
+bool ClearSoftDirty(pid_t pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/clear_refs", pid);
+  android::base::unique_fd fd(open(path, O_WRONLY | O_CLOEXEC));
+  if (fd == -1) {
+    MEM_ALOGE("failed to open %s: %s", path, strerror(errno));
+    return false;
+  }
+  if (TEMP_FAILURE_RETRY(write(fd, "4", 1)) != 1) {
+    MEM_ALOGE("failed to clear soft-dirty bits of %d: %s", pid, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+static bool ReadPagemap(int fd, uintptr_t page_index, uint64_t* entries, size_t count) {
+  size_t size = count * sizeof(uint64_t);
+  ssize_t ret = TEMP_FAILURE_RETRY(pread(fd, entries, size, page_index * sizeof(uint64_t)));
+  return ret == static_cast<ssize_t>(size);
+}
+
+static bool ProbeSoftDirty() {
+  const size_t page_size = sysconf(_SC_PAGE_SIZE);
+  void* page = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (page == MAP_FAILED) {
+    return false;
+  }
+
+  // A page written after the bits are cleared must read as soft-dirty, which
+  // kernels without CONFIG_MEM_SOFT_DIRTY never report.
+  bool supported = false;
+  volatile char* p = reinterpret_cast<volatile char*>(page);
+  *p = 1;
+  android::base::unique_fd fd(open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC));
+  if (fd != -1 && ClearSoftDirty(getpid())) {
+    *p = 2;
+    uint64_t entry;
+    if (ReadPagemap(fd, reinterpret_cast<uintptr_t>(page) / page_size, &entry, 1)) {
+      supported = (entry & kPagemapPresent) && (entry & kPagemapSoftDirty);
+    }
+  }
+
+  munmap(page, page_size);
+  return supported;
+}
+
+bool SoftDirtySupported() {
+  static bool supported = ProbeSoftDirty();
+  return supported;
+}
+
+bool CleanPages(pid_t pid, const allocator::vector<Mapping>& mappings,
+                allocator::vector<Range>& clean_pages) {
+  const size_t page_size = sysconf(_SC_PAGE_SIZE);
+  clean_pages.clear();
+
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/pagemap", pid);
+  android::base::unique_fd fd(open(path, O_RDONLY | O_CLOEXEC));
+  if (fd == -1) {
+    MEM_ALOGE("failed to open %s: %s", path, strerror(errno));
+    return false;
+  }
+
+  uint64_t entries[kPagemapBatch];
+  for (auto it = mappings.begin(); it != mappings.end(); it++) {
+    if (!it->read) {
+      continue;
+    }
+    uintptr_t first = it->begin / page_size;
+    uintptr_t last = it->end / page_size;
+    for (uintptr_t index = first; index < last; index += kPagemapBatch) {
+      size_t count = std::min<uintptr_t>(kPagemapBatch, last - index);
+      if (!ReadPagemap(fd, index, entries, count)) {
+        MEM_ALOGE("failed to read %s: %s", path, strerror(errno));
+        return false;
+      }
+      for (size_t i = 0; i < count; i++) {
+        // Pages that are not resident may have been discarded and refilled
+        // with zeroes, which doesn't make them soft-dirty.
+        if ((entries[i] & kPagemapPresent) && !(entries[i] & kPagemapSoftDirty)) {
+          uintptr_t begin = (index + i) * page_size;
+          if (!clean_pages.empty() && clean_pages.back().end == begin) {
+            clean_pages.back().end += page_size;
+          } else {
+            clean_pages.push_back(Range{begin, begin + page_size});
+          }
+        }
+      }
+    }
+  }
+
+  std::sort(clean_pages.begin(), clean_pages.end(),
+            [](const Range& a, const Range& b) { return a.begin < b.begin; });
+  return true;
+}
+
+}  // namespace android
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBMEMUNREACHABLE_SOFT_DIRTY_H_
+#define LIBMEMUNREACHABLE_SOFT_DIRTY_H_
+
+#include <sys/types.h>
+
+#include "Allocator.h"
+#include "HeapWalker.h"
+#include "ProcessMappings.h"
+
+namespace android {
+
+// Whether the kernel tracks which pages were written since the soft-dirty
+// bits were last cleared.  Checking clears the bits of the calling process.
+bool SoftDirtySupported();
+
+// Clears the soft-dirty bits of all pages of process pid.
+bool ClearSoftDirty(pid_t pid);
+
+// Finds the pages of the readable mappings of process pid that are resident
+// and have not been written since the soft-dirty bits were last cleared, as
+// sorted ranges of whole pages.
+bool CleanPages(pid_t pid, const allocator::vector<Mapping>& mappings,
+                allocator::vector<Range>& clean_pages);
+
+}  // namespace android
+
+#endif  // LIBMEMUNREACHABLE_SOFT_DIRTY_H_
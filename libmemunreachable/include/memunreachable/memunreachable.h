@@ -22,6 +22,7 @@
 
 #ifdef __cplusplus
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -74,6 +75,19 @@ struct UnreachableMemoryInfo {
 
 bool GetUnreachableMemory(UnreachableMemoryInfo& info, size_t limit = 100);
 
+// Like GetUnreachableMemory, but only scans again the memory written since
+// the previous call, on kernels that track soft-dirty pages.  Keeps the
+// pointers found by the previous call in memory of the calling process, and
+// clears the soft-dirty bits of all of its pages.
+bool GetUnreachableMemoryIncremental(UnreachableMemoryInfo& info, size_t limit = 100);
+
+// Like GetUnreachableMemory, but passes the leaks to |fn| one at a time,
+// largest first, as they are received from the process that found them,
+// instead of collecting them in |info|.leaks.  The other fields of |info| are
+// set before the first call.  Stops receiving leaks when |fn| returns false.
+bool IterateUnreachableMemory(UnreachableMemoryInfo& info, size_t limit,
+                              const std::function<bool(const Leak&)>& fn);
+
 std::string GetUnreachableMemoryString(bool log_contents = false, size_t limit = 100);
 
 }  // namespace android
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/mman.h>
+
+#include <random>
+
+#include <benchmark/benchmark.h>
+
+#include "Allocator.h"
+#include "HeapWalker.h"
+
+namespace android {
+
+// A synthetic heap of allocations of 16 to 256 bytes with gaps between them.
+// Half of each allocation's words point somewhere into another allocation,
+// the rest hold random values, mostly outside the heap.
+class SyntheticHeap {
+ public:
+  explicit SyntheticHeap(size_t num_allocations) : size_(num_allocations * 512) {
+    std::mt19937_64 random(num_allocations);
+    std::uniform_int_distribution<size_t> num_words(2, 32);
+
+    buffer_ = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    uintptr_t begin = reinterpret_cast<uintptr_t>(buffer_);
+    uintptr_t offset = 0;
+    for (size_t i = 0; i < num_allocations; i++) {
+      size_t size = num_words(random) * sizeof(uintptr_t);
+      allocations_.push_back(Range{begin + offset, begin + offset + size});
+      offset += size + num_words(random) * sizeof(uintptr_t);
+    }
+
+    for (const Range& range : allocations_) {
+      uintptr_t* words = reinterpret_cast<uintptr_t*>(range.begin);
+      for (size_t i = 0; i < range.size() / sizeof(uintptr_t); i++) {
+        if (i % 2 == 0) {
+          const Range& to = allocations_[random() % allocations_.size()];
+          words[i] = to.begin + random() % to.size();
+        } else {
+          words[i] = random();
+        }
+      }
+    }
+
+    for (size_t i = 0; i < 64; i++) {
+      roots_.push_back(allocations_[random() % allocations_.size()].begin);
+    }
+  }
+
+  ~SyntheticHeap() { munmap(buffer_, size_); }
+
+  void AddTo(HeapWalker& heap_walker) {
+    for (const Range& range : allocations_) {
+      heap_walker.Allocation(range.begin, range.end);
+    }
+    heap_walker.Root(reinterpret_cast<uintptr_t>(roots_.data()),
+                     reinterpret_cast<uintptr_t>(roots_.data() + roots_.size()));
+  }
+
+  const std::vector<Range>& allocations() { return allocations_; }
+
+ private:
+  void* buffer_;
+  size_t size_;
+  std::vector<Range> allocations_;
+  std::vector<uintptr_t> roots_;
+};
+
+// Scans every allocation for pointers into the heap, as the mark phase does
+// for each reachable allocation.
+static void BM_heap_walker_scan(benchmark::State& state) {
+  SyntheticHeap synthetic_heap(state.range(0));
+  Heap heap;
+  HeapWalker heap_walker(heap);
+  synthetic_heap.AddTo(heap_walker);
+
+  size_t words = 0;
+  while (state.KeepRunning()) {
+    size_t found = 0;
+    for (const Range& range : synthetic_heap.allocations()) {
+      heap_walker.ForEachPtrInRange(range, [&](Range&, HeapWalker::AllocationInfo*) { found++; });
+      words += range.size() / sizeof(uintptr_t);
+    }
+    benchmark::DoNotOptimize(found);
+  }
+  state.SetItemsProcessed(words);
+}
+BENCHMARK(BM_heap_walker_scan)->Arg(1 << 10)->Arg(1 << 14)->Arg(1 << 18);
+
+static void BM_heap_walker_detect_leaks(benchmark::State& state) {
+  SyntheticHeap synthetic_heap(state.range(0));
+  Heap heap;
+
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    {
+      HeapWalker heap_walker(heap);
+      synthetic_heap.AddTo(heap_walker);
+      state.ResumeTiming();
+
+      heap_walker.DetectLeaks();
+      state.PauseTiming();
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_heap_walker_detect_leaks)->Arg(1 << 10)->Arg(1 << 14)->Arg(1 << 18);
+
+}  // namespace android
+
+BENCHMARK_MAIN();
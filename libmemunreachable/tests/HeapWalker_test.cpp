@@ -22,6 +22,7 @@
 #include <ScopedDisableMalloc.h>
 #include <gtest/gtest.h>
 #include "Allocator.h"
+#include "ScanCache.h"
 
 namespace android {
 
@@ -202,4 +203,136 @@ TEST_F(HeapWalkerTest, segv) {
   ASSERT_EQ(0U, leaked.size());
 }
 
+TEST_F(HeapWalkerTest, parallel) {
+  // Enough allocations to be marked by several threads, as a binary tree in
+  // which the subtree under node 2 is unreachable.
+  const size_t num_nodes = 64 * 1024;
+  const size_t node_size = 2 * sizeof(uintptr_t);
+  const size_t buffer_size = num_nodes * node_size;
+  void* buffer = mmap(NULL, buffer_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  ASSERT_NE(MAP_FAILED, buffer);
+  uintptr_t* nodes = reinterpret_cast<uintptr_t*>(buffer);
+
+  for (size_t i = 1; i < num_nodes; i++) {
+    if (i != 2) {
+      nodes[((i - 1) / 2) * 2 + (i - 1) % 2] = buffer_begin(buffer) + i * node_size;
+    }
+  }
+  void* root[1]{buffer};
+
+  size_t expected_leaks = 0;
+  for (size_t i = 1; i < num_nodes; i++) {
+    size_t j = i;
+    while (j > 2) {
+      j = (j - 1) / 2;
+    }
+    if (j == 2) {
+      expected_leaks++;
+    }
+  }
+
+  HeapWalker heap_walker(heap_);
+  for (size_t i = 0; i < num_nodes; i++) {
+    uintptr_t begin = buffer_begin(buffer) + i * node_size;
+    ASSERT_TRUE(heap_walker.Allocation(begin, begin + node_size));
+  }
+  heap_walker.Root(buffer_begin(root), buffer_end(root));
+
+  ASSERT_EQ(true, heap_walker.DetectLeaks());
+
+  allocator::vector<Range> leaked(heap_);
+  size_t num_leaks = 0;
+  size_t leaked_bytes = 0;
+  ASSERT_EQ(true, heap_walker.Leaked(leaked, 100, &num_leaks, &leaked_bytes));
+
+  EXPECT_EQ(expected_leaks, num_leaks);
+  EXPECT_EQ(expected_leaks * node_size, leaked_bytes);
+  EXPECT_EQ(100U, leaked.size());
+
+  munmap(buffer, buffer_size);
+}
+
+TEST_F(HeapWalkerTest, scan_cache) {
+  const size_t page_size = sysconf(_SC_PAGE_SIZE);
+  const size_t cache_size = 64 * 1024;
+  void* root = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  ASSERT_NE(MAP_FAILED, root);
+  void* caches = mmap(NULL, 2 * cache_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+                      -1, 0);
+  ASSERT_NE(MAP_FAILED, caches);
+  ScanCache first(caches, cache_size);
+  ScanCache second(reinterpret_cast<char*>(caches) + cache_size, cache_size);
+
+  char buffer1[16]{};
+  char buffer2[16]{};
+  void** ptrs = reinterpret_cast<void**>(root);
+  ptrs[0] = buffer1;
+  ptrs[1] = buffer2;
+
+  Range root_range{buffer_begin(root), buffer_begin(root) + page_size};
+  allocator::vector<Range> clean_pages(heap_);
+  size_t num_leaks = 0;
+  allocator::vector<Range> leaked(heap_);
+
+  {
+    HeapWalker heap_walker(heap_);
+    heap_walker.Allocation(buffer_begin(buffer1), buffer_end(buffer1));
+    heap_walker.Allocation(buffer_begin(buffer2), buffer_end(buffer2));
+    heap_walker.Root(root_range.begin, root_range.end);
+    first.Reset();
+    heap_walker.UseScanCache(nullptr, &clean_pages, &first);
+
+    ASSERT_EQ(true, heap_walker.DetectLeaks());
+    ASSERT_TRUE(first.Finish());
+    ASSERT_TRUE(first.Complete());
+    EXPECT_EQ(0U, heap_walker.CachedBytes());
+
+    ASSERT_EQ(true, heap_walker.Leaked(leaked, 100, &num_leaks, nullptr));
+    EXPECT_EQ(0U, num_leaks);
+  }
+
+  // A page said to be clean isn't read again, so the pointer cleared from it
+  // is still found.
+  ptrs[1] = nullptr;
+  clean_pages.push_back(root_range);
+  {
+    HeapWalker heap_walker(heap_);
+    heap_walker.Allocation(buffer_begin(buffer1), buffer_end(buffer1));
+    heap_walker.Allocation(buffer_begin(buffer2), buffer_end(buffer2));
+    heap_walker.Root(root_range.begin, root_range.end);
+    second.Reset();
+    heap_walker.UseScanCache(&first, &clean_pages, &second);
+
+    ASSERT_EQ(true, heap_walker.DetectLeaks());
+    ASSERT_TRUE(second.Finish());
+    EXPECT_EQ(page_size, heap_walker.CachedBytes());
+
+    ASSERT_EQ(true, heap_walker.Leaked(leaked, 100, &num_leaks, nullptr));
+    EXPECT_EQ(0U, num_leaks);
+  }
+
+  // A dirty page is scanned again.
+  clean_pages.clear();
+  {
+    HeapWalker heap_walker(heap_);
+    heap_walker.Allocation(buffer_begin(buffer1), buffer_end(buffer1));
+    heap_walker.Allocation(buffer_begin(buffer2), buffer_end(buffer2));
+    heap_walker.Root(root_range.begin, root_range.end);
+    first.Reset();
+    heap_walker.UseScanCache(&second, &clean_pages, &first);
+
+    ASSERT_EQ(true, heap_walker.DetectLeaks());
+    ASSERT_TRUE(first.Finish());
+    EXPECT_EQ(0U, heap_walker.CachedBytes());
+
+    ASSERT_EQ(true, heap_walker.Leaked(leaked, 100, &num_leaks, nullptr));
+    EXPECT_EQ(1U, num_leaks);
+    ASSERT_EQ(1U, leaked.size());
+    EXPECT_EQ(buffer_begin(buffer2), leaked[0].begin);
+  }
+
+  munmap(caches, 2 * cache_size);
+  munmap(root, page_size);
+}
+
 }  // namespace android
@@ -15,6 +15,7 @@
  */
 
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <sys/prctl.h>
 #include <unistd.h>
@@ -119,6 +120,82 @@ TEST(MemunreachableTest, global) {
   }
 }
 
+TEST(MemunreachableTest, iterate) {
+  HiddenPointer hidden_ptr1(256);
+  HiddenPointer hidden_ptr2(512);
+  HiddenPointer hidden_ptr3(1024);
+
+  {
+    UnreachableMemoryInfo info;
+    size_t calls = 0;
+    size_t last_size = SIZE_MAX;
+
+    ASSERT_TRUE(IterateUnreachableMemory(info, 100, [&](const Leak& leak) {
+      EXPECT_LE(leak.total_size, last_size);
+      last_size = leak.total_size;
+      calls++;
+      return true;
+    }));
+    ASSERT_EQ(3U, info.num_leaks);
+    ASSERT_EQ(0U, info.leaks.size());
+    ASSERT_GE(calls, 1U);
+  }
+
+  {
+    UnreachableMemoryInfo info;
+    size_t calls = 0;
+
+    ASSERT_TRUE(IterateUnreachableMemory(info, 100, [&](const Leak&) {
+      calls++;
+      return false;
+    }));
+    ASSERT_EQ(3U, info.num_leaks);
+    ASSERT_EQ(1U, calls);
+  }
+
+  hidden_ptr1.Free();
+  hidden_ptr2.Free();
+  hidden_ptr3.Free();
+}
+
+TEST(MemunreachableTest, incremental) {
+  HiddenPointer hidden_ptr;
+
+  g_ptr = hidden_ptr.Get();
+
+  {
+    UnreachableMemoryInfo info;
+
+    ASSERT_TRUE(GetUnreachableMemoryIncremental(info));
+    ASSERT_EQ(0U, info.leaks.size());
+  }
+
+  {
+    UnreachableMemoryInfo info;
+
+    ASSERT_TRUE(GetUnreachableMemoryIncremental(info));
+    ASSERT_EQ(0U, info.leaks.size());
+  }
+
+  g_ptr = nullptr;
+
+  {
+    UnreachableMemoryInfo info;
+
+    ASSERT_TRUE(GetUnreachableMemoryIncremental(info));
+    ASSERT_EQ(1U, info.leaks.size());
+  }
+
+  hidden_ptr.Free();
+
+  {
+    UnreachableMemoryInfo info;
+
+    ASSERT_TRUE(GetUnreachableMemoryIncremental(info));
+    ASSERT_EQ(0U, info.leaks.size());
+  }
+}
+
 TEST(MemunreachableTest, tls) {
   HiddenPointer hidden_ptr;
   pthread_key_t key;
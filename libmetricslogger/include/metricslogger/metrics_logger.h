@@ -14,8 +14,12 @@
  * limitations under the License.
  */
 
+#include <chrono>
 #include <cstdint>
+#include <map>
+#include <mutex>
 #include <string>
+#include <utility>
 
 namespace android {
 namespace metricslogger {
@@ -32,6 +36,53 @@ void LogCounter(const std::string& name, int32_t val);
 // |value| in the field |field|.
 void LogMultiAction(int32_t category, int32_t field, const std::string& value);
 
+// Accumulates histogram and counter samples in process and logs them in
+// bulk, for callers that would otherwise log a metric per request. Each flush
+// logs one entry per histogram bucket and one per counter, carrying the
+// accumulated count as its value, which Tron sums exactly as it would the
+// individual samples. A batch is flushed when it holds |max_samples| samples,
+// when a sample arrives |max_delay| after the oldest pending one, on Flush()
+// and on destruction. Safe to use from multiple threads.
+class MetricsBatch {
+  public:
+    explicit MetricsBatch(size_t max_samples = 4096,
+                          std::chrono::milliseconds max_delay = std::chrono::minutes(1));
+    ~MetricsBatch();
+
+    MetricsBatch(const MetricsBatch&) = delete;
+    MetricsBatch& operator=(const MetricsBatch&) = delete;
+
+    // Records |count| samples of |data| in the histogram |event|, as if
+    // LogHistogram(event, data) had been called |count| times.
+    void AddHistogram(const std::string& event, int32_t data, int32_t count = 1);
+
+    // Adds |val| to the counter |name|, as if by LogCounter(name, val).
+    void AddCounter(const std::string& name, int32_t val);
+
+    // Logs everything accumulated so far.
+    void Flush();
+
+    // Returns the number of samples waiting to be logged.
+    size_t pending() const;
+
+  private:
+    typedef std::map<std::pair<std::string, int32_t>, int64_t> HistogramMap;
+    typedef std::map<std::string, int64_t> CounterMap;
+
+    // Returns true if the batch should be flushed after adding a sample.
+    bool AddSampleLocked();
+    static void Log(const HistogramMap& histograms, const CounterMap& counters);
+
+    const size_t max_samples_;
+    const std::chrono::milliseconds max_delay_;
+
+    mutable std::mutex lock_;
+    HistogramMap histograms_;
+    CounterMap counters_;
+    size_t samples_;
+    std::chrono::steady_clock::time_point oldest_;
+};
+
 // TODO: replace these with the metric_logger.proto definitions
 enum {
     LOGBUILDER_CATEGORY = 757,
@@ -16,7 +16,9 @@
 
 #include "metricslogger/metrics_logger.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <limits>
 
 #include <log/log_event_list.h>
 
@@ -37,6 +39,19 @@ void LogCounter(const std::string& name, int32_t val) {
         << val << LOG_ID_EVENTS;
 }
 
+// Logs a histogram bucket holding |count| samples. Counts beyond the range of a
+// single entry are split across entries.
+static void LogHistogramCount(const std::string& event, int32_t data, int64_t count) {
+    while (count > 0) {
+        int32_t value = static_cast<int32_t>(
+            std::min<int64_t>(count, std::numeric_limits<int32_t>::max()));
+        android_log_event_list log(MULTI_ACTION_LOG_TAG);
+        log << LOGBUILDER_CATEGORY << LOGBUILDER_HISTOGRAM << LOGBUILDER_NAME << event
+            << LOGBUILDER_BUCKET << data << LOGBUILDER_VALUE << value << LOG_ID_EVENTS;
+        count -= value;
+    }
+}
+
 // Mirror com.android.internal.logging.MetricsLogger#action().
 void LogMultiAction(int32_t category, int32_t field, const std::string& value) {
     android_log_event_list log(MULTI_ACTION_LOG_TAG);
@@ -44,5 +59,79 @@ void LogMultiAction(int32_t category, int32_t field, const std::string& value) {
         << field << value << LOG_ID_EVENTS;
 }
 
+MetricsBatch::MetricsBatch(size_t max_samples, std::chrono::milliseconds max_delay)
+    : max_samples_(max_samples), max_delay_(max_delay), samples_(0) {}
+
+MetricsBatch::~MetricsBatch() {
+    Flush();
+}
+
+bool MetricsBatch::AddSampleLocked() {
+    auto now = std::chrono::steady_clock::now();
+    if (samples_++ == 0) {
+        oldest_ = now;
+    }
+    return samples_ >= max_samples_ || now - oldest_ >= max_delay_;
+}
+
+void MetricsBatch::AddHistogram(const std::string& event, int32_t data, int32_t count) {
+    if (count <= 0) return;
+
+    bool flush;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        histograms_[std::make_pair(event, data)] += count;
+        flush = AddSampleLocked();
+    }
+    if (flush) Flush();
+}
+
+void MetricsBatch::AddCounter(const std::string& name, int32_t val) {
+    bool flush;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        counters_[name] += val;
+        flush = AddSampleLocked();
+    }
+    if (flush) Flush();
+}
+
+void MetricsBatch::Flush() {
+    HistogramMap histograms;
+    CounterMap counters;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (samples_ == 0) return;
+        histograms.swap(histograms_);
+        counters.swap(counters_);
+        samples_ = 0;
+    }
+
+    // Logging happens outside the lock so that recording threads never wait
+    // on the log socket.
+    Log(histograms, counters);
+}
+
+void MetricsBatch::Log(const HistogramMap& histograms, const CounterMap& counters) {
+    for (const auto& bucket : histograms) {
+        LogHistogramCount(bucket.first.first, bucket.first.second, bucket.second);
+    }
+    for (const auto& counter : counters) {
+        int64_t val = counter.second;
+        while (val != 0) {
+            int32_t part = static_cast<int32_t>(std::max<int64_t>(
+                std::min<int64_t>(val, std::numeric_limits<int32_t>::max()),
+                std::numeric_limits<int32_t>::min()));
+            LogCounter(counter.first, part);
+            val -= part;
+        }
+    }
+}
+
+size_t MetricsBatch::pending() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return samples_;
+}
+
 }  // namespace metricslogger
 }  // namespace android
@@ -26,3 +26,29 @@ TEST(MetricsLoggerTest, AddSingleBootEvent) {
 TEST(MetricsLoggerTest, AddCounterVal) {
     android::metricslogger::LogCounter("test_count", 10);
 }
+
+TEST(MetricsLoggerTest, BatchFlushesOnSampleLimit) {
+    android::metricslogger::MetricsBatch batch(3, std::chrono::hours(1));
+    batch.AddHistogram("test_event", 42);
+    batch.AddHistogram("test_event", 42, 5);
+    EXPECT_EQ(2U, batch.pending());
+    batch.AddCounter("test_count", 10);
+    EXPECT_EQ(0U, batch.pending());
+}
+
+TEST(MetricsLoggerTest, BatchFlushesOnDelay) {
+    android::metricslogger::MetricsBatch batch(1000, std::chrono::milliseconds(0));
+    batch.AddCounter("test_count", 10);
+    EXPECT_EQ(0U, batch.pending());
+}
+
+TEST(MetricsLoggerTest, BatchFlush) {
+    android::metricslogger::MetricsBatch batch;
+    batch.AddHistogram("test_event", 42);
+    batch.AddHistogram("test_event", 43);
+    batch.AddCounter("test_count", 10);
+    batch.AddHistogram("test_event", 42, 0);
+    EXPECT_EQ(3U, batch.pending());
+    batch.Flush();
+    EXPECT_EQ(0U, batch.pending());
+}
@@ -67,7 +67,8 @@ bool NativeBridgeInitialized();
 // Use NativeBridgeLoadLibraryExt() instead in namespace scenario.
 void* NativeBridgeLoadLibrary(const char* libpath, int flag);
 
-// Get a native bridge trampoline for specified native method.
+// Get a native bridge trampoline for specified native method. Results, including failed
+// lookups, are cached per library handle until NativeBridgeUnloadLibrary() is called on it.
 void* NativeBridgeGetTrampoline(void* handle, const char* name, const char* shorty, uint32_t len);
 
 // True if native library paths are valid and is for an ABI that is supported by native bridge.
@@ -27,6 +27,9 @@
 #include <unistd.h>
 
 #include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 #include <log/log.h>
 
@@ -182,10 +185,29 @@ static bool isCompatibleWith(const uint32_t version) {
   return true;
 }
 
+// Trampolines already handed out by the bridge, keyed by library handle and then by method name
+// and shorty. getTrampoline crosses into the bridge implementation and JNI lookups try several
+// names per method, so both hits and misses are remembered; each method is resolved at most once
+// for as long as its library stays loaded.
+using TrampolineMap = std::unordered_map<std::string, void*>;
+static std::mutex trampolines_mutex;
+static std::unordered_map<void*, TrampolineMap> trampolines;
+
+static void ClearTrampolines(void* handle) {
+  std::lock_guard<std::mutex> guard(trampolines_mutex);
+  trampolines.erase(handle);
+}
+
+static void ClearAllTrampolines() {
+  std::lock_guard<std::mutex> guard(trampolines_mutex);
+  trampolines.clear();
+}
+
 static void CloseNativeBridge(bool with_error) {
   state = NativeBridgeState::kClosed;
   had_error |= with_error;
   ReleaseAppCodeCacheDir();
+  ClearAllTrampolines();
 }
 
 bool LoadNativeBridge(const char* nb_library_filename,
@@ -511,10 +533,34 @@ void* NativeBridgeLoadLibrary(const char* libpath, int flag) {
 
 void* NativeBridgeGetTrampoline(void* handle, const char* name, const char* shorty,
                                 uint32_t len) {
-  if (NativeBridgeInitialized()) {
-    return callbacks->getTrampoline(handle, name, shorty, len);
+  if (!NativeBridgeInitialized()) {
+    return nullptr;
   }
-  return nullptr;
+
+  std::string key(name);
+  if (shorty != nullptr) {
+    key.push_back('\0');
+    key.append(shorty, len);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(trampolines_mutex);
+    auto lib = trampolines.find(handle);
+    if (lib != trampolines.end()) {
+      auto it = lib->second.find(key);
+      if (it != lib->second.end()) {
+        return it->second;
+      }
+    }
+  }
+
+  // Resolve without holding the lock; if another thread got there first the bridge hands out
+  // the same trampoline and the existing entry is kept.
+  void* trampoline = callbacks->getTrampoline(handle, name, shorty, len);
+
+  std::lock_guard<std::mutex> guard(trampolines_mutex);
+  trampolines[handle].emplace(std::move(key), trampoline);
+  return trampoline;
 }
 
 bool NativeBridgeIsSupported(const char* libpath) {
@@ -545,6 +591,8 @@ NativeBridgeSignalHandlerFn NativeBridgeGetSignalHandler(int signal) {
 int NativeBridgeUnloadLibrary(void* handle) {
   if (NativeBridgeInitialized()) {
     if (isCompatibleWith(NAMESPACE_VERSION)) {
+      // The handle may be reused by a later load, forget what was resolved through it.
+      ClearTrampolines(handle);
       return callbacks->unloadLibrary(handle);
     } else {
       ALOGE("not compatible with version %d, cannot unload library", NAMESPACE_VERSION);
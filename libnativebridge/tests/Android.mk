@@ -24,7 +24,8 @@ test_src_files := \
     NativeBridge3IsPathSupported_test.cpp \
     NativeBridge3InitAnonymousNamespace_test.cpp \
     NativeBridge3CreateNamespace_test.cpp \
-    NativeBridge3LoadLibraryExt_test.cpp
+    NativeBridge3LoadLibraryExt_test.cpp \
+    NativeBridge3GetTrampoline_test.cpp
 
 
 shared_libraries := \
@@ -32,8 +32,14 @@ extern "C" void* native_bridge3_loadLibrary(const char* /* libpath */, int /* fl
   return nullptr;
 }
 
+// Number of getTrampoline calls, looked up by tests to check the caching in libnativebridge.
+extern "C" {
+uint32_t native_bridge3_getTrampoline_calls = 0;
+}
+
 extern "C" void* native_bridge3_getTrampoline(void* /* handle */, const char* /* name */,
                                              const char* /* shorty */, uint32_t /* len */) {
+  native_bridge3_getTrampoline_calls++;
   return nullptr;
 }
 
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "NativeBridgeTest.h"
+
+#include <dlfcn.h>
+
+namespace android {
+
+TEST_F(NativeBridgeTest, V3_GetTrampolineCached) {
+    // Init
+    ASSERT_TRUE(LoadNativeBridge(kNativeBridgeLibrary3, nullptr));
+    ASSERT_TRUE(NativeBridgeAvailable());
+    ASSERT_TRUE(PreInitializeNativeBridge(".", "isa"));
+    ASSERT_TRUE(NativeBridgeAvailable());
+    ASSERT_TRUE(InitializeNativeBridge(nullptr, nullptr));
+    ASSERT_TRUE(NativeBridgeAvailable());
+
+    void* dummy = dlopen(kNativeBridgeLibrary3, RTLD_NOW | RTLD_NOLOAD);
+    ASSERT_TRUE(dummy != nullptr);
+    uint32_t* calls = reinterpret_cast<uint32_t*>(
+        dlsym(dummy, "native_bridge3_getTrampoline_calls"));
+    ASSERT_TRUE(calls != nullptr);
+
+    void* handle = reinterpret_cast<void*>(0x1000);
+    ASSERT_EQ(nullptr, NativeBridgeGetTrampoline(handle, "Java_Foo_bar", "VI", 2));
+    ASSERT_EQ(1U, *calls);
+
+    // Repeated lookups, including failed ones, are answered from the cache.
+    ASSERT_EQ(nullptr, NativeBridgeGetTrampoline(handle, "Java_Foo_bar", "VI", 2));
+    ASSERT_EQ(1U, *calls);
+
+    // A different shorty, method or library is a separate lookup.
+    ASSERT_EQ(nullptr, NativeBridgeGetTrampoline(handle, "Java_Foo_bar", "VJ", 2));
+    ASSERT_EQ(2U, *calls);
+    ASSERT_EQ(nullptr, NativeBridgeGetTrampoline(handle, "JNI_OnLoad", nullptr, 0));
+    ASSERT_EQ(3U, *calls);
+    void* other_handle = reinterpret_cast<void*>(0x2000);
+    ASSERT_EQ(nullptr, NativeBridgeGetTrampoline(other_handle, "Java_Foo_bar", "VI", 2));
+    ASSERT_EQ(4U, *calls);
+
+    // Unloading the library drops its entries.
+    ASSERT_EQ(0, NativeBridgeUnloadLibrary(handle));
+    ASSERT_EQ(nullptr, NativeBridgeGetTrampoline(handle, "Java_Foo_bar", "VI", 2));
+    ASSERT_EQ(5U, *calls);
+    ASSERT_EQ(nullptr, NativeBridgeGetTrampoline(other_handle, "Java_Foo_bar", "VI", 2));
+    ASSERT_EQ(5U, *calls);
+
+    dlclose(dummy);
+
+    // Clean-up code_cache
+    ASSERT_EQ(0, rmdir(kCodeCache));
+}
+
+}  // namespace android
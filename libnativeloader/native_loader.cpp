@@ -17,7 +17,9 @@
 #include "nativeloader/native_loader.h"
 #include <nativehelper/ScopedUtfChars.h>
 
+#include <ctype.h>
 #include <dlfcn.h>
+#include <string.h>
 #ifdef __ANDROID__
 #define LOG_TAG "libnativeloader"
 #include "nativeloader/dlext_namespaces.h"
@@ -110,9 +112,28 @@ static bool is_debuggable() {
   return std::string(debuggable) == "1";
 }
 
+// The parts of a classloader namespace configuration that do not depend on
+// the classloader itself. These are built once in Initialize() so that
+// Create() only has to append the per-apk paths.
+struct NamespaceTemplate {
+  explicit NamespaceTemplate(const char* name) : name(name) { }
+
+  const char* name;
+  // Appended to the classloader library_path and permitted_path.
+  std::string extra_path;
+  // Libraries linked from the default namespace.
+  std::string exposed_libraries;
+};
+
 class LibraryNamespaces {
  public:
-  LibraryNamespaces() : initialized_(false) { }
+  LibraryNamespaces()
+      : initialized_(false),
+        get_parent_(nullptr),
+        default_template_(kClassloaderNamespaceName),
+        vendor_template_(kVendorClassloaderNamespaceName) {
+    BuildTemplates();
+  }
 
   bool Create(JNIEnv* env,
               uint32_t target_sdk_version,
@@ -123,10 +144,15 @@ class LibraryNamespaces {
               jstring java_permitted_path,
               NativeLoaderNamespace* ns,
               std::string* error_msg) {
+    const bool use_vendor_template = is_for_vendor && !is_shared;
+    const NamespaceTemplate& ns_template =
+        use_vendor_template ? vendor_template_ : default_template_;
+
     std::string library_path; // empty string by default.
 
     if (java_library_path != nullptr) {
       ScopedUtfChars library_path_utf_chars(env, java_library_path);
+      library_path.reserve(library_path_utf_chars.size() + ns_template.extra_path.size());
       library_path = library_path_utf_chars.c_str();
     }
 
@@ -141,7 +167,10 @@ class LibraryNamespaces {
     if (java_permitted_path != nullptr) {
       ScopedUtfChars path(env, java_permitted_path);
       if (path.c_str() != nullptr && path.size() > 0) {
-        permitted_path = permitted_path + ":" + path.c_str();
+        permitted_path.reserve(permitted_path.size() + 1 + path.size() +
+                               ns_template.extra_path.size());
+        permitted_path += ':';
+        permitted_path += path.c_str();
       }
     }
 
@@ -174,33 +203,22 @@ class LibraryNamespaces {
       is_native_bridge = NativeBridgeIsPathSupported(library_path.c_str());
     }
 
-    std::string system_exposed_libraries = system_public_libraries_;
-    const char* namespace_name = kClassloaderNamespaceName;
+    const std::string& system_exposed_libraries = ns_template.exposed_libraries;
+    const char* namespace_name = ns_template.name;
     android_namespace_t* vndk_ns = nullptr;
-    if (is_for_vendor && !is_shared) {
+    if (use_vendor_template) {
       LOG_FATAL_IF(is_native_bridge, "Unbundled vendor apk must not use translated architecture");
 
-      // For vendor apks, give access to the vendor lib even though
-      // they are treated as unbundled; the libs and apks are still bundled
-      // together in the vendor partition.
-#if defined(__LP64__)
-      std::string vendor_lib_path = "/vendor/lib64";
-#else
-      std::string vendor_lib_path = "/vendor/lib";
-#endif
-      library_path = library_path + ":" + vendor_lib_path.c_str();
-      permitted_path = permitted_path + ":" + vendor_lib_path.c_str();
-
-      // Also give access to LLNDK libraries since they are available to vendors
-      system_exposed_libraries = system_exposed_libraries + ":" + system_llndk_libraries_.c_str();
+      // The vendor template gives access to the vendor lib and to the LLNDK
+      // libraries, see BuildTemplates().
+      library_path += vendor_template_.extra_path;
+      permitted_path += vendor_template_.extra_path;
 
       // Give access to VNDK-SP libraries from the 'vndk' namespace.
       vndk_ns = android_get_exported_namespace(kVndkNamespaceName);
       LOG_ALWAYS_FATAL_IF(vndk_ns == nullptr,
                           "Cannot find \"%s\" namespace for vendor apks", kVndkNamespaceName);
 
-      // Different name is useful for debugging
-      namespace_name = kVendorClassloaderNamespaceName;
       ALOGD("classloader namespace configured for unbundled vendor apk. library_path=%s", library_path.c_str());
     }
 
@@ -359,6 +377,8 @@ class LibraryNamespaces {
     ReadConfig(kPublicNativeLibrariesVendorConfig, &sonames);
 
     vendor_public_libraries_ = base::Join(sonames, ':');
+
+    BuildTemplates();
   }
 
   void Reset() {
@@ -375,40 +395,70 @@ class LibraryNamespaces {
       return false;
     }
 
-    std::vector<std::string> lines = base::Split(file_content, "\n");
-
-    for (auto& line : lines) {
-      auto trimmed_line = base::Trim(line);
-      if (trimmed_line[0] == '#' || trimmed_line.empty()) {
+    // Walk the file in place rather than splitting it into a vector of
+    // lines and trimming copies of each one.
+    const char* p = file_content.c_str();
+    const char* end = p + file_content.size();
+    while (p < end) {
+      const char* line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+      if (line_end == nullptr) {
+        line_end = end;
+      }
+      const char* line = p;
+      p = line_end + 1;
+
+      const char* first = line;
+      const char* last = line_end;
+      while (first < last && isspace(*first)) first++;
+      while (last > first && isspace(last[-1])) last--;
+      if (first == last || *first == '#') {
         continue;
       }
-      size_t space_pos = trimmed_line.rfind(' ');
-      if (space_pos != std::string::npos) {
-        std::string type = trimmed_line.substr(space_pos + 1);
-        if (type != "32" && type != "64") {
-          if (error_msg) *error_msg = "Malformed line: " + line;
+
+      const char* space = last;
+      while (space > first && space[-1] != ' ') space--;
+      if (space != first) {
+        size_t type_len = last - space;
+        if (type_len != 2 || !((space[0] == '3' && space[1] == '2') ||
+                               (space[0] == '6' && space[1] == '4'))) {
+          if (error_msg) *error_msg = "Malformed line: " + std::string(line, line_end);
           return false;
         }
 #if defined(__LP64__)
         // Skip 32 bit public library.
-        if (type == "32") {
+        if (space[0] == '3') {
           continue;
         }
 #else
         // Skip 64 bit public library.
-        if (type == "64") {
+        if (space[0] == '6') {
           continue;
         }
 #endif
-        trimmed_line.resize(space_pos);
+        last = space - 1;
       }
 
-      sonames->push_back(trimmed_line);
+      sonames->emplace_back(first, last);
     }
 
     return true;
   }
 
+  void BuildTemplates() {
+    default_template_.exposed_libraries = system_public_libraries_;
+
+    // For vendor apks, give access to the vendor lib even though
+    // they are treated as unbundled; the libs and apks are still bundled
+    // together in the vendor partition.
+#if defined(__LP64__)
+    vendor_template_.extra_path = ":/vendor/lib64";
+#else
+    vendor_template_.extra_path = ":/vendor/lib";
+#endif
+    // Also give access to LLNDK libraries since they are available to vendors
+    vendor_template_.exposed_libraries = system_public_libraries_ + ":" + system_llndk_libraries_;
+  }
+
   bool InitPublicNamespace(const char* library_path, std::string* error_msg) {
     // Ask native bride if this apps library path should be handled by it
     bool is_native_bridge = NativeBridgeIsPathSupported(library_path);
@@ -437,12 +487,16 @@ class LibraryNamespaces {
   }
 
   jobject GetParentClassLoader(JNIEnv* env, jobject class_loader) {
-    jclass class_loader_class = env->FindClass("java/lang/ClassLoader");
-    jmethodID get_parent = env->GetMethodID(class_loader_class,
-                                            "getParent",
-                                            "()Ljava/lang/ClassLoader;");
+    // java.lang.ClassLoader is never unloaded, so the method id stays valid.
+    if (get_parent_ == nullptr) {
+      jclass class_loader_class = env->FindClass("java/lang/ClassLoader");
+      get_parent_ = env->GetMethodID(class_loader_class,
+                                     "getParent",
+                                     "()Ljava/lang/ClassLoader;");
+      env->DeleteLocalRef(class_loader_class);
+    }
 
-    return env->CallObjectMethod(class_loader, get_parent);
+    return env->CallObjectMethod(class_loader, get_parent_);
   }
 
   bool FindParentNamespaceByClassLoader(JNIEnv* env,
@@ -467,6 +521,9 @@ class LibraryNamespaces {
   std::string vendor_public_libraries_;
   std::string system_llndk_libraries_;
   std::string system_vndksp_libraries_;
+  jmethodID get_parent_;
+  NamespaceTemplate default_template_;
+  NamespaceTemplate vendor_template_;
 
   DISALLOW_COPY_AND_ASSIGN(LibraryNamespaces);
 };
@@ -42,6 +42,7 @@ PIXELFLINGER_SRC_FILES_arm64 := \
 	codeflinger/Arm64Disassembler.cpp \
 	arch-arm64/col32cb16blend.S \
 	arch-arm64/t32cb16blend.S \
+	arch-arm64/t32cb16.S \
 
 ifndef ARCH_MIPS_REV6
 PIXELFLINGER_SRC_FILES_mips := \
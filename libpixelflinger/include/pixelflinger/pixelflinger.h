@@ -315,6 +315,18 @@ extern "C" {
 ssize_t gglInit(GGLContext** context);
 ssize_t gglUninit(GGLContext* context);
 
+// Keeps the generated scanline code in the file at path, and reuses the code
+// already there, so that later processes don't generate it again. The file
+// is shared by all the processes using it, and only used while private to
+// the user. A NULL path stops using the file.
+ssize_t gglSetCodeCacheFile(const char* path);
+
+// Renders large rectangles, such as full screen clears and blits, with up to
+// count threads. This is only done when splitting a rectangle in bands of
+// rows doesn't change the result. 1 (the default) renders everything on the
+// calling thread.
+ssize_t gglSetRectThreads(GGLContext* context, int count);
+
 GGLint gglBitBlit(
         GGLContext* c,
         int tmu,
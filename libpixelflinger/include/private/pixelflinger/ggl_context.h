@@ -525,6 +525,12 @@ struct state_t {
 
 // ----------------------------------------------------------------------------
 
+enum {
+    GGL_SCANLINE_ANY        = 0,    // the fastest available
+    GGL_SCANLINE_GENERATED  = 1,    // generated code, never hand-written
+    GGL_SCANLINE_GENERIC    = 2,    // the generic C pipeline only
+};
+
 struct context_t {
 	GGLContext          procs;
 	state_t             state;
@@ -548,6 +554,10 @@ struct context_t {
     void*               base;
     Assembly*           scanline_as;
     GGLenum             error;
+    // threads rendering large rectangles, see gglSetRectThreads()
+    uint32_t            rectThreads;
+    // which scanlines may be picked, for tests and benchmarks
+    uint32_t            scanlineSelect;
 };
 
 // ----------------------------------------------------------------------------
@@ -834,3 +834,18 @@ ssize_t gglUninit(GGLContext* con)
 	return 0;
 }
 
+ssize_t gglSetCodeCacheFile(const char* path)
+{
+    return ggl_set_code_cache_file(path);
+}
+
+ssize_t gglSetRectThreads(GGLContext* con, int count)
+{
+    GGL_CONTEXT(c, (void*)con);
+    if (count < 1) {
+        return -1;
+    }
+    c->rectThreads = count;
+    return 0;
+}
+
@@ -18,12 +18,24 @@
 #define LOG_TAG "pixelflinger"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 #include <cutils/memory.h>
+#include <cutils/properties.h>
 #include <log/log.h>
+#include <utils/SortedVector.h>
 
 #include "buffer.h"
 #include "scanline.h"
@@ -130,6 +142,7 @@ extern "C" void scanline_col32cb16blend_neon(uint16_t *dst, uint32_t *col, size_
 extern "C" void scanline_col32cb16blend_arm(uint16_t *dst, uint32_t col, size_t ct);
 #elif defined(__aarch64__)
 extern "C" void scanline_t32cb16blend_arm64(uint16_t*, uint32_t*, size_t);
+extern "C" void scanline_t32cb16_arm64(uint16_t *dst, uint32_t *src, size_t ct);
 extern "C" void scanline_col32cb16blend_arm64(uint16_t *dst, uint32_t col, size_t ct);
 #elif defined(__mips__) && !defined(__LP64__) && __mips_isa_rev < 6
 extern "C" void scanline_t32cb16blend_mips(uint16_t*, uint32_t*, size_t);
@@ -301,8 +314,174 @@ public:
         : Assembly(size), mKey(needs) { }
     const AssemblyKey<needs_t>& key() const { return mKey; }
 };
+
+/*
+ * The optional code cache file holds the scanlines generated by earlier
+ * processes, so that they don't have to be generated again. It starts with
+ * a code_file_header_t, followed by a code_file_entry_t and the code for each
+ * scanline. The code only depends on the needs (and on the pixel format
+ * table, which is built in), so the file is discarded when the build
+ * changes.
+ */
+static const uint32_t CODE_FILE_MAGIC = 0x43474747; // "GGGC"
+static const uint32_t CODE_FILE_VERSION = 1;
+static const size_t CODE_FILE_MAX_SIZE = 256 * 1024;
+
+#if defined(__arm__)
+static const char CODE_FILE_ARCH[] = "arm";
+#elif defined(__aarch64__)
+static const char CODE_FILE_ARCH[] = "arm64";
+#elif defined(__mips__) && defined(__LP64__)
+static const char CODE_FILE_ARCH[] = "mips64";
+#else
+static const char CODE_FILE_ARCH[] = "mips";
 #endif
 
+struct code_file_header_t {
+    uint32_t magic;
+    uint32_t version;
+    char arch[8];
+    char fingerprint[PROPERTY_VALUE_MAX];
+};
+
+struct code_file_entry_t {
+    needs_t needs;
+    uint32_t size;
+};
+
+static pthread_mutex_t gCodeFileLock = PTHREAD_MUTEX_INITIALIZER;
+static char* gCodeFilePath = NULL;
+// The needs whose code is already in the file.
+static SortedVector<needs_t> gCodeFileNeeds;
+
+static void init_code_file_header(code_file_header_t* header)
+{
+    memset(header, 0, sizeof(*header));
+    header->magic = CODE_FILE_MAGIC;
+    header->version = CODE_FILE_VERSION;
+    strlcpy(header->arch, CODE_FILE_ARCH, sizeof(header->arch));
+    property_get("ro.build.fingerprint", header->fingerprint, "");
+}
+
+// Loads the code in the file into gCodeCache. Returns false if the file
+// can't be used, in which case it should be started over.
+static bool load_code_file(int fd)
+{
+    // Don't execute code that someone else could have written.
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_uid != geteuid() || (st.st_mode & 022)) {
+        ALOGE("code cache file %s is not private, not using it", gCodeFilePath);
+        return false;
+    }
+    if (st.st_size > (off_t)CODE_FILE_MAX_SIZE) {
+        return false;
+    }
+
+    code_file_header_t expected, header;
+    init_code_file_header(&expected);
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+            memcmp(&header, &expected, sizeof(header))) {
+        return false;
+    }
+
+    off_t offset = sizeof(header);
+    code_file_entry_t entry;
+    // A truncated last entry, from a process that died while writing it,
+    // is ignored.
+    while (pread(fd, &entry, sizeof(entry), offset) == sizeof(entry)) {
+        offset += sizeof(entry);
+        if (entry.size == 0 || entry.size > ASSEMBLY_SCRATCH_SIZE ||
+                offset + entry.size > st.st_size) {
+            break;
+        }
+        sp<ScanlineAssembly> a = new ScanlineAssembly(entry.needs, entry.size);
+        if (pread(fd, a->base(), entry.size, offset) != (ssize_t)entry.size) {
+            break;
+        }
+        offset += entry.size;
+        if (gCodeFileNeeds.indexOf(entry.needs) < 0 &&
+                gCodeCache.cache(a->key(), a) >= 0) {
+            gCodeFileNeeds.add(entry.needs);
+        }
+    }
+    return true;
+}
+
+static void save_code_file_entry(const needs_t& needs, const sp<Assembly>& assembly)
+{
+    pthread_mutex_lock(&gCodeFileLock);
+    if (gCodeFilePath && gCodeFileNeeds.indexOf(needs) < 0) {
+        int fd = open(gCodeFilePath, O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (fd >= 0) {
+            struct stat st;
+            code_file_entry_t entry;
+            entry.needs = needs;
+            entry.size = assembly->size();
+            // Other processes append to the same file.
+            flock(fd, LOCK_EX);
+            if (fstat(fd, &st) == 0 &&
+                    st.st_size + sizeof(entry) + entry.size <= CODE_FILE_MAX_SIZE) {
+                char* buffer = (char*)malloc(sizeof(entry) + entry.size);
+                if (buffer) {
+                    memcpy(buffer, &entry, sizeof(entry));
+                    memcpy(buffer + sizeof(entry), assembly->base(), entry.size);
+                    if (write(fd, buffer, sizeof(entry) + entry.size) < 0) {
+                        ALOGE("cannot write code cache file %s: %s", gCodeFilePath,
+                                strerror(errno));
+                    }
+                    free(buffer);
+                }
+            }
+            flock(fd, LOCK_UN);
+            close(fd);
+        }
+        gCodeFileNeeds.add(needs);
+    }
+    pthread_mutex_unlock(&gCodeFileLock);
+}
+#endif
+
+ssize_t ggl_set_code_cache_file(const char* path)
+{
+#if ANDROID_ARM_CODEGEN
+    pthread_mutex_lock(&gCodeFileLock);
+    ssize_t err = 0;
+    free(gCodeFilePath);
+    gCodeFilePath = NULL;
+    gCodeFileNeeds.clear();
+    if (path) {
+        int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            ALOGE("cannot open code cache file %s: %s", path, strerror(errno));
+            err = -1;
+        } else {
+            gCodeFilePath = strdup(path);
+            flock(fd, LOCK_EX);
+            if (!load_code_file(fd)) {
+                // start over, with the header for this build
+                code_file_header_t header;
+                init_code_file_header(&header);
+                gCodeFileNeeds.clear();
+                if (fchmod(fd, 0600) < 0 || ftruncate(fd, 0) < 0 ||
+                        write(fd, &header, sizeof(header)) != sizeof(header)) {
+                    ALOGE("cannot write code cache file %s: %s", path, strerror(errno));
+                    free(gCodeFilePath);
+                    gCodeFilePath = NULL;
+                    err = -1;
+                }
+            }
+            flock(fd, LOCK_UN);
+            close(fd);
+        }
+    }
+    pthread_mutex_unlock(&gCodeFileLock);
+    return err;
+#else
+    (void)path;
+    return 0;
+#endif
+}
+
 // ----------------------------------------------------------------------------
 
 void ggl_init_scanline(context_t* c)
@@ -324,17 +503,9 @@ void ggl_uninit_scanline(context_t* c)
 
 // ----------------------------------------------------------------------------
 
-static void pick_scanline(context_t* c)
+// Picks a hand-written scanline for the needs, if there is one.
+static bool pick_shortcut(context_t* c)
 {
-#if (!defined(DEBUG__CODEGEN_ONLY) || (DEBUG__CODEGEN_ONLY == 0))
-
-#if ANDROID_CODEGEN == ANDROID_CODEGEN_GENERIC
-    c->init_y = init_y;
-    c->step_y = step_y__generic;
-    c->scanline = scanline;
-    return;
-#endif
-
     //printf("*** needs [%08lx:%08lx:%08lx:%08lx]\n",
     //    c->state.needs.n, c->state.needs.p,
     //    c->state.needs.t[0], c->state.needs.t[1]);
@@ -357,7 +528,7 @@ static void pick_scanline(context_t* c)
                 // (so the current color doesn't show through)
                 c->scanline = scanline_memcpy;
                 c->init_y = init_y_noop;
-                return;
+                return true;
             }
         }
     }
@@ -365,9 +536,9 @@ static void pick_scanline(context_t* c)
     if (c->state.needs.match(fill16noblend)) {
         c->init_y = init_y_packed;
         switch (c->formats[cb_format].size) {
-        case 1: c->scanline = scanline_memset8;  return;
-        case 2: c->scanline = scanline_memset16; return;
-        case 4: c->scanline = scanline_memset32; return;
+        case 1: c->scanline = scanline_memset8;  return true;
+        case 2: c->scanline = scanline_memset16; return true;
+        case 4: c->scanline = scanline_memset32; return true;
         }
     }
 
@@ -376,9 +547,33 @@ static void pick_scanline(context_t* c)
         if (c->state.needs.match(shortcuts[i].filter)) {
             c->scanline = shortcuts[i].scanline;
             c->init_y = shortcuts[i].init_y;
-            return;
+            return true;
         }
     }
+    return false;
+}
+
+static void pick_scanline(context_t* c)
+{
+    if (c->scanlineSelect == GGL_SCANLINE_GENERIC) {
+        c->init_y = init_y;
+        c->step_y = step_y__generic;
+        c->scanline = scanline;
+        return;
+    }
+
+#if (!defined(DEBUG__CODEGEN_ONLY) || (DEBUG__CODEGEN_ONLY == 0))
+
+#if ANDROID_CODEGEN == ANDROID_CODEGEN_GENERIC
+    c->init_y = init_y;
+    c->step_y = step_y__generic;
+    c->scanline = scanline;
+    return;
+#endif
+
+    if (c->scanlineSelect != GGL_SCANLINE_GENERATED && pick_shortcut(c)) {
+        return;
+    }
 
 #if DEBUG_NEEDS
     ALOGI("Needs: n=0x%08x p=0x%08x t0=0x%08x t1=0x%08x",
@@ -419,6 +614,9 @@ static void pick_scanline(context_t* c)
             // finally, cache this assembly
             err = gCodeCache.cache(a->key(), a) < 0;
         }
+        if (ggl_likely(!err)) {
+            save_code_file_entry(c->state.needs, a);
+        }
         if (ggl_unlikely(err)) {
             ALOGE("error generating or caching assembly. Reverting to NOP.");
             c->scanline = scanline_noop;
@@ -2144,6 +2342,10 @@ void scanline_t32cb16(context_t* c)
     const int32_t u = (c->state.texture[0].shade.is0>>16) + x;
     const int32_t v = (c->state.texture[0].shade.it0>>16) + y;
     uint32_t *src = reinterpret_cast<uint32_t*>(tex->data)+(u+(tex->stride*v));
+
+#if ((ANDROID_CODEGEN >= ANDROID_CODEGEN_ASM) && defined(__aarch64__))
+    scanline_t32cb16_arm64(dst, src, ct);
+#else
     int sR, sG, sB;
     uint32_t s, d;
 
@@ -2175,6 +2377,7 @@ last_one:
     if (ct > 0) {
         goto last_one;
     }
+#endif
 }
 
 void scanline_t32cb16blend(context_t* c)
@@ -2369,6 +2572,112 @@ void rect_memcpy(context_t* c, size_t yc)
         } while (--yc);
     }
 }
+
 // ----------------------------------------------------------------------------
-}; // namespace android
 
+/*
+ * Large rectangles can be split in bands of rows, each rendered by its own
+ * thread from a copy of the context. This is only done when nothing is
+ * iterated from one row to the next but y (and z), so that each band can
+ * start at its first row and render exactly what a single thread would.
+ */
+
+// Don't bother with threads for less pixels, or thinner bands, than this.
+static const size_t RECT_THREADS_MIN_PIXELS = 128 * 1024;
+static const size_t RECT_THREADS_MIN_ROWS = 16;
+
+struct rect_band_t {
+    context_t*  c;
+    size_t      yc;
+    size_t*     remaining;  // bands of the rectangle not done yet
+};
+
+// The workers outlive any context, and are never destroyed.
+struct rect_workers_t {
+    std::mutex                  lock;
+    std::condition_variable     work;
+    std::condition_variable     done;
+    std::deque<rect_band_t>     bands;
+    size_t                      count = 0;
+};
+
+static rect_workers_t& rect_workers()
+{
+    static rect_workers_t* workers = new rect_workers_t;
+    return *workers;
+}
+
+static void rect_worker()
+{
+    rect_workers_t& w = rect_workers();
+    std::unique_lock<std::mutex> lock(w.lock);
+    while (true) {
+        w.work.wait(lock, [&w] { return !w.bands.empty(); });
+        rect_band_t band = w.bands.front();
+        w.bands.pop_front();
+        lock.unlock();
+        band.c->rect(band.c, band.yc);
+        lock.lock();
+        if (--*band.remaining == 0) {
+            w.done.notify_all();
+        }
+    }
+}
+
+bool ggl_rect_threaded(context_t* c, size_t yc)
+{
+    const size_t xc = c->iterators.xr - c->iterators.xl;
+    size_t bands = c->rectThreads;
+    if (bands > yc / RECT_THREADS_MIN_ROWS) {
+        bands = yc / RECT_THREADS_MIN_ROWS;
+    }
+    if (bands < 2 || xc * yc < RECT_THREADS_MIN_PIXELS || c->step_y != step_y__nop) {
+        return false;
+    }
+
+    // contexts are aligned on cache lines, see gglInit()
+    void* base = malloc((bands - 1) * sizeof(context_t) + 32);
+    if (!base) {
+        return false;
+    }
+    context_t* copies = (context_t*)((uintptr_t(base) + 31) & ~uintptr_t(31));
+
+    // The calling thread renders the last band into c itself, which leaves
+    // c as it would be after rendering the whole rectangle.
+    const int32_t y = c->iterators.y;
+    const uint32_t ydzdy = c->iterators.ydzdy;
+    size_t remaining = bands - 1;
+    size_t start = 0;
+    rect_workers_t& w = rect_workers();
+    {
+        std::lock_guard<std::mutex> lock(w.lock);
+        for (size_t i = 0; i < bands - 1; i++) {
+            const size_t rows = yc / bands;
+            context_t* band = &copies[i];
+            memcpy(band, c, sizeof(context_t));
+            band->iterators.y = y + start;
+            band->iterators.ydzdy = ydzdy + start * uint32_t(c->shade.dzdy);
+            w.bands.push_back({ band, rows, &remaining });
+            start += rows;
+        }
+        while (w.count < c->rectThreads - 1) {
+            std::thread(rect_worker).detach();
+            w.count++;
+        }
+    }
+    w.work.notify_all();
+
+    c->iterators.y = y + start;
+    c->iterators.ydzdy = ydzdy + start * uint32_t(c->shade.dzdy);
+    c->rect(c, yc - start);
+
+    {
+        std::unique_lock<std::mutex> lock(w.lock);
+        w.done.wait(lock, [&remaining] { return remaining == 0; });
+    }
+    free(base);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
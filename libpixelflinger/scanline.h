@@ -26,6 +26,8 @@ namespace android {
 void ggl_init_scanline(context_t* c);
 void ggl_uninit_scanline(context_t* c);
 void ggl_pick_scanline(context_t* c);
+ssize_t ggl_set_code_cache_file(const char* path);
+bool ggl_rect_threaded(context_t* c, size_t yc);
 
 }; // namespace android
 
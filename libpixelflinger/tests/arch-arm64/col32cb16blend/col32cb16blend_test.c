@@ -57,7 +57,10 @@ struct test_t tests[] =
     {"Count 3, Src=Rand, Dst=Rand", 0x11111111, 0xEDFE, 3},
     {"Count 4, Src=Rand, Dst=Rand", 0x12345678, 0x9ABC, 4},
     {"Count 5, Src=Rand, Dst=Rand", 0xEFEFFEFE, 0xFACC, 5},
-    {"Count 10, Src=Rand, Dst=Rand", 0x12345678, 0x9ABC, 10}
+    {"Count 10, Src=Rand, Dst=Rand", 0x12345678, 0x9ABC, 10},
+    {"Count 8, Src=Rand, Dst=Rand", 0x40402010, 0x1234, 8},
+    {"Count 15, Src=Rand, Dst=Rand", 0x20181008, 0xBEEF, 15},
+    {"Count 16, Src=Rand, Dst=Rand", 0x60584840, 0x5A5A, 16}
 };
 
 void scanline_col32cb16blend_arm64(uint16_t *dst, int32_t src, size_t count);
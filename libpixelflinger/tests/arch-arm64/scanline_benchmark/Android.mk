@@ -0,0 +1,18 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+# Run with:
+#   adb shell /data/benchmarktest64/pixelflinger-arm64-scanline-benchmark/pixelflinger-arm64-scanline-benchmark
+LOCAL_SRC_FILES:= \
+    scanline_benchmark.cpp \
+    ../../../arch-arm64/col32cb16blend.S \
+    ../../../arch-arm64/t32cb16blend.S \
+    ../../../arch-arm64/t32cb16.S
+
+LOCAL_MODULE:= pixelflinger-arm64-scanline-benchmark
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_MULTILIB := 64
+
+include $(BUILD_NATIVE_BENCHMARK)
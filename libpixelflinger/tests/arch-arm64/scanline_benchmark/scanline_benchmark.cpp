@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+extern "C" void scanline_t32cb16blend_arm64(uint16_t*, uint32_t*, size_t);
+extern "C" void scanline_t32cb16_arm64(uint16_t* dst, uint32_t* src, size_t ct);
+extern "C" void scanline_col32cb16blend_arm64(uint16_t* dst, uint32_t col, size_t ct);
+
+// The C scanlines used when no assembly is available, for comparison.
+
+static void scanline_t32cb16blend_c(uint16_t* dst, uint32_t* src, size_t ct) {
+    while (ct--) {
+        uint32_t s = *src++;
+        if (s) {
+            uint16_t d = *dst;
+            int sA = (s >> 24);
+            int f = 0x100 - (sA + (sA >> 7));
+            int sR = ((s >> 3) & 0x1F) + ((f * ((d >> 11) & 0x1f)) >> 8);
+            int sG = ((s >> 10) & 0x3F) + ((f * ((d >> 5) & 0x3f)) >> 8);
+            int sB = ((s >> 19) & 0x1F) + ((f * (d & 0x1f)) >> 8);
+            *dst = uint16_t((sR << 11) | (sG << 5) | sB);
+        }
+        dst++;
+    }
+}
+
+static void scanline_t32cb16_c(uint16_t* dst, uint32_t* src, size_t ct) {
+    while (ct--) {
+        uint32_t s = *src++;
+        *dst++ = uint16_t(((s << 8) & 0xf800) | ((s >> 5) & 0x07e0) | ((s >> 19) & 0x001f));
+    }
+}
+
+static void scanline_col32cb16blend_c(uint16_t* dst, uint32_t s, size_t ct) {
+    int sA = (s >> 24);
+    int f = 0x100 - (sA + (sA >> 7));
+    while (ct--) {
+        uint16_t d = *dst;
+        int sR = ((s >> 3) & 0x1F) + ((f * ((d >> 11) & 0x1f)) >> 8);
+        int sG = ((s >> 10) & 0x3F) + ((f * ((d >> 5) & 0x3f)) >> 8);
+        int sB = ((s >> 19) & 0x1F) + ((f * (d & 0x1f)) >> 8);
+        *dst++ = uint16_t((sR << 11) | (sG << 5) | sB);
+    }
+}
+
+// Premultiplied pixels with varying alpha, none of them fully transparent.
+static std::vector<uint32_t> make_src(size_t count) {
+    std::vector<uint32_t> src(count);
+    srand(0);
+    for (auto& s : src) {
+        uint32_t a = 1 + rand() % 255;
+        s = (a << 24) | ((rand() % (a + 1)) << 16) | ((rand() % (a + 1)) << 8) | (rand() % (a + 1));
+    }
+    return src;
+}
+
+template <void (*scanline)(uint16_t*, uint32_t*, size_t)>
+static void BM_scanline_t32(benchmark::State& state) {
+    std::vector<uint32_t> src = make_src(state.range(0));
+    std::vector<uint16_t> dst(state.range(0), 0x7BEF);
+    while (state.KeepRunning()) {
+        scanline(dst.data(), src.data(), dst.size());
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <void (*scanline)(uint16_t*, uint32_t, size_t)>
+static void BM_scanline_col32(benchmark::State& state) {
+    std::vector<uint16_t> dst(state.range(0), 0x7BEF);
+    while (state.KeepRunning()) {
+        scanline(dst.data(), 0x80402010, dst.size());
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Scanline widths of a small and a full HD display, and a few odd ones.
+#define SCANLINE_WIDTHS Arg(7)->Arg(61)->Arg(480)->Arg(1080)->Arg(1920)
+
+BENCHMARK_TEMPLATE(BM_scanline_t32, scanline_t32cb16blend_arm64)->SCANLINE_WIDTHS;
+BENCHMARK_TEMPLATE(BM_scanline_t32, scanline_t32cb16blend_c)->SCANLINE_WIDTHS;
+BENCHMARK_TEMPLATE(BM_scanline_t32, scanline_t32cb16_arm64)->SCANLINE_WIDTHS;
+BENCHMARK_TEMPLATE(BM_scanline_t32, scanline_t32cb16_c)->SCANLINE_WIDTHS;
+BENCHMARK_TEMPLATE(BM_scanline_col32, scanline_col32cb16blend_arm64)->SCANLINE_WIDTHS;
+BENCHMARK_TEMPLATE(BM_scanline_col32, scanline_col32cb16blend_c)->SCANLINE_WIDTHS;
+
+BENCHMARK_MAIN();
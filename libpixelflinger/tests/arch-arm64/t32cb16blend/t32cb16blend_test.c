@@ -57,7 +57,10 @@ struct test_t tests[] =
     {"Count 3, Src=Rand, Dst=Rand", 0x11111111, 0xEDFE, 3},
     {"Count 4, Src=Rand, Dst=Rand", 0x12345678, 0x9ABC, 4},
     {"Count 5, Src=Rand, Dst=Rand", 0xEFEFFEFE, 0xFACC, 5},
-    {"Count 10, Src=Rand, Dst=Rand", 0x12345678, 0x9ABC, 10}
+    {"Count 10, Src=Rand, Dst=Rand", 0x12345678, 0x9ABC, 10},
+    {"Count 8, Src=Rand, Dst=Rand", 0x80402010, 0x1234, 8},
+    {"Count 15, Src=Rand, Dst=Rand", 0x7F00FF80, 0xBEEF, 15},
+    {"Count 16, Src=Rand, Dst=Rand", 0xC0A08060, 0x5A5A, 16}
 
 };
 
@@ -0,0 +1,19 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+# Run with:
+#   adb shell /data/benchmarktest/pixelflinger-benchmark/pixelflinger-benchmark
+LOCAL_SRC_FILES:= \
+	pixelflinger_benchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libpixelflinger
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/../../include
+
+LOCAL_MODULE:= pixelflinger-benchmark
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_BENCHMARK)
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <pixelflinger/pixelflinger.h>
+#include <private/pixelflinger/ggl_context.h>
+
+// Renders full screen rectangles with common shader configurations, through
+// each kind of scanline pixelflinger can pick, and reports the pixel rate.
+
+#if defined(__arm__)
+#define ARCH "arm"
+#elif defined(__aarch64__)
+#define ARCH "arm64"
+#elif defined(__mips__) && defined(__LP64__)
+#define ARCH "mips64"
+#elif defined(__mips__)
+#define ARCH "mips"
+#elif defined(__x86_64__)
+#define ARCH "x86_64"
+#elif defined(__i386__)
+#define ARCH "x86"
+#else
+#define ARCH "unknown"
+#endif
+
+#if defined(__arm__) || defined(__aarch64__) || \
+    (defined(__mips__) && ((!defined(__LP64__) && __mips_isa_rev < 6) || defined(__LP64__)))
+#define HAVE_CODEGEN 1
+#else
+#define HAVE_CODEGEN 0
+#endif
+
+static const int kWidth = 1080;
+static const int kHeight = 1920;
+
+struct config_t {
+    const char* name;
+    GGLenum     cbFormat;
+    GGLenum     texFormat;  // 0 for no texture
+    bool        blend;
+    bool        dither;
+    bool        smooth;
+    bool        modulate;
+};
+
+static const config_t kConfigs[] = {
+    { "fill_565",                   GGL_PIXEL_FORMAT_RGB_565,   0,                          false, false, false, false },
+    { "fill_blend_565",             GGL_PIXEL_FORMAT_RGB_565,   0,                          true,  false, false, false },
+    { "gradient_565_dither",        GGL_PIXEL_FORMAT_RGB_565,   0,                          false, true,  true,  false },
+    { "tex_565_to_565",             GGL_PIXEL_FORMAT_RGB_565,   GGL_PIXEL_FORMAT_RGB_565,   false, false, false, false },
+    { "tex_8888_to_565",            GGL_PIXEL_FORMAT_RGB_565,   GGL_PIXEL_FORMAT_RGBA_8888, false, false, false, false },
+    { "tex_8888_to_565_dither",     GGL_PIXEL_FORMAT_RGB_565,   GGL_PIXEL_FORMAT_RGBA_8888, false, true,  false, false },
+    { "tex_8888_to_565_blend",      GGL_PIXEL_FORMAT_RGB_565,   GGL_PIXEL_FORMAT_RGBA_8888, true,  false, false, false },
+    { "tex_8888_to_565_blend_mod",  GGL_PIXEL_FORMAT_RGB_565,   GGL_PIXEL_FORMAT_RGBA_8888, true,  false, false, true  },
+    { "tex_8888_to_8888_blend",     GGL_PIXEL_FORMAT_RGBA_8888, GGL_PIXEL_FORMAT_RGBA_8888, true,  false, false, false },
+    { "tex_565_to_8888",            GGL_PIXEL_FORMAT_RGBA_8888, GGL_PIXEL_FORMAT_RGB_565,   false, false, false, false },
+};
+
+static const char* const kPaths[] = { "any", "generated", "generic" };
+
+static size_t bytes_per_pixel(GGLenum format) {
+    return format == GGL_PIXEL_FORMAT_RGB_565 ? 2 : 4;
+}
+
+static void BM_pixelflinger_rect(benchmark::State& state) {
+    const config_t& config = kConfigs[state.range(0)];
+    const uint32_t path = state.range(1);
+
+    std::vector<uint8_t> cb(kWidth * kHeight * bytes_per_pixel(config.cbFormat), 0x5A);
+    std::vector<uint8_t> tex;
+    if (config.texFormat) {
+        // premultiplied pixels with varying alpha
+        tex.resize(kWidth * kHeight * bytes_per_pixel(config.texFormat));
+        srand(0);
+        for (auto& b : tex) {
+            b = rand();
+        }
+        if (config.texFormat == GGL_PIXEL_FORMAT_RGBA_8888) {
+            uint32_t* p = reinterpret_cast<uint32_t*>(tex.data());
+            for (size_t i = 0; i < tex.size() / 4; i++) {
+                uint32_t a = p[i] >> 24;
+                p[i] = (a << 24) | (((p[i] >> 16) & 0xff) * a / 255) << 16 |
+                       (((p[i] >> 8) & 0xff) * a / 255) << 8 | ((p[i] & 0xff) * a / 255);
+            }
+        }
+    }
+
+    GGLContext* gl;
+    if (gglInit(&gl) < 0) {
+        state.SkipWithError("gglInit failed");
+        return;
+    }
+    reinterpret_cast<android::context_t*>(gl)->scanlineSelect = path;
+
+    GGLSurface surface = { sizeof(GGLSurface), kWidth, kHeight, kWidth,
+                           cb.data(), (GGLubyte)config.cbFormat, {}, {}, nullptr };
+    gl->colorBuffer(gl, &surface);
+
+    GGLclampx color[4] = { 0x8000, 0x4000, 0xC000, 0xC000 };
+    gl->color4xv(gl, color);
+    if (config.smooth) {
+        GGLcolor grad[12] = { 0, 0x40, 0x20,    0x10000, -0x20, 0x40,
+                              0x8000, 0x10, 0x10, 0x10000, 0, 0 };
+        gl->shadeModel(gl, GGL_SMOOTH);
+        gl->colorGrad12xv(gl, grad);
+    }
+    if (config.dither) {
+        gl->enable(gl, GGL_DITHER);
+    }
+    if (config.blend) {
+        gl->enable(gl, GGL_BLEND);
+        gl->blendFunc(gl, GGL_ONE, GGL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    GGLSurface texSurface = { sizeof(GGLSurface), kWidth, kHeight, kWidth,
+                              tex.data(), (GGLubyte)config.texFormat, {}, {}, nullptr };
+    if (config.texFormat) {
+        gl->activeTexture(gl, 0);
+        gl->bindTexture(gl, &texSurface);
+        gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE,
+                    config.modulate ? GGL_MODULATE : GGL_REPLACE);
+        gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+        gl->texGeni(gl, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+        gl->enable(gl, GGL_TEXTURE_2D);
+        gl->texCoord2i(gl, 0, 0);
+    }
+
+    while (state.KeepRunning()) {
+        gl->recti(gl, 0, 0, kWidth, kHeight);
+    }
+
+    state.SetItemsProcessed(state.iterations() * kWidth * kHeight);
+    state.SetLabel(std::string(ARCH) + "/" + config.name + "/" + kPaths[path]);
+    gglUninit(gl);
+}
+
+static void all_configs(benchmark::internal::Benchmark* b) {
+    for (size_t i = 0; i < sizeof(kConfigs) / sizeof(kConfigs[0]); i++) {
+        b->Args({ int(i), android::GGL_SCANLINE_ANY });
+#if HAVE_CODEGEN
+        b->Args({ int(i), android::GGL_SCANLINE_GENERATED });
+#endif
+        b->Args({ int(i), android::GGL_SCANLINE_GENERIC });
+    }
+}
+BENCHMARK(BM_pixelflinger_rect)->Apply(all_configs);
+
+BENCHMARK_MAIN();
@@ -26,6 +26,7 @@
 
 #include "trap.h"
 #include "picker.h"
+#include "scanline.h"
 
 namespace android {
 
@@ -438,7 +439,9 @@ void recti(void* con, GGLint l, GGLint t, GGLint r, GGLint b)
         c->iterators.xl = l;
         c->iterators.xr = r;
         c->init_y(c, t);
-        c->rect(c, yc);
+        if (!ggl_rect_threaded(c, yc)) {
+            c->rect(c, yc);
+        }
     }
 }
 
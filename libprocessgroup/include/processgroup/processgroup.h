@@ -24,15 +24,31 @@ __BEGIN_DECLS
 
 // Return 0 and removes the cgroup if there are no longer any processes in it.
 // Returns -1 in the case of an error occurring or if there are processes still running
-// even after retrying for up to 200ms.
+// even after waiting for up to 200ms for them to exit.
 int killProcessGroup(uid_t uid, int initialPid, int signal);
 
 // Returns the same as killProcessGroup(), however it does not retry, which means
 // that it only returns 0 in the case that the cgroup exists and it contains no processes.
 int killProcessGroupOnce(uid_t uid, int initialPid, int signal);
 
+// Signals the processes in the cgroup like killProcessGroupOnce(), but instead of waiting for
+// them to exit, returns a descriptor to add to the caller's poll loop, or -errno.
+// Call finishKillProcessGroup() each time the descriptor becomes readable.
+int killProcessGroupAsync(uid_t uid, int initialPid, int signal);
+
+// Returns 0 and removes the cgroup if there are no longer any processes in it.
+// Returns -EAGAIN if there are, in which case |fd| becomes readable again a little later.
+// Otherwise returns -errno. |fd| is closed unless -EAGAIN is returned; a caller that gives up
+// waiting closes it.
+int finishKillProcessGroup(uid_t uid, int initialPid, int fd);
+
 int createProcessGroup(uid_t uid, int initialPid);
 
+// Moves each of |pids| into the process cgroup that createProcessGroup() made for
+// |initialPid|, opening it once for all of them.
+// Returns 0 on success, or -errno for the first pid that couldn't be moved.
+int addProcessesToProcessGroup(uid_t uid, int initialPid, const pid_t* pids, size_t count);
+
 bool setProcessGroupSwappiness(uid_t uid, int initialPid, int swappiness);
 bool setProcessGroupSoftLimit(uid_t uid, int initialPid, int64_t softLimitInBytes);
 bool setProcessGroupLimit(uid_t uid, int initialPid, int64_t limitInBytes);
@@ -22,18 +22,24 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <memory>
 #include <mutex>
 #include <set>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -42,7 +48,6 @@
 
 #include <processgroup/processgroup.h>
 
-using android::base::WriteStringToFile;
 
 using namespace std::chrono_literals;
 
@@ -73,6 +78,9 @@ class ProcessGroup {
 
     bool Open(uid_t uid, int pid);
 
+    // Starts reading the cgroup's processes again from the beginning.
+    bool Rewind();
+
     // Return positive number and sets *pid = next pid in process cgroup on success
     // Returns 0 if there are no pids left in the process cgroup
     // Returns -errno if an error was encountered
@@ -119,21 +127,94 @@ static int convertUidPidToPath(char *path, size_t size, uid_t uid, int pid)
             pid);
 }
 
-bool ProcessGroup::Open(uid_t uid, int pid) {
+// Descriptors of the most recently used uid directories. Zygote creates a process cgroup for
+// every fork, so each operation works relative to an open directory instead of walking and
+// checking a fresh path. The descriptors are shared, so that one can be evicted while another
+// thread still uses it.
+static constexpr size_t kUidDirCacheSize = 16;
+
+struct UidDir {
+    uid_t uid;
+    std::shared_ptr<android::base::unique_fd> fd;
+};
+
+static std::mutex uid_dirs_lock;
+static std::vector<UidDir> uid_dirs;  // Most recently used first.
+
+static bool mkdirAndChown(const char *path, mode_t mode, uid_t uid, gid_t gid);
+
+// Returns the uid's directory under the cgroup root, creating it first if |create| is set.
+static std::shared_ptr<android::base::unique_fd> openUidDir(uid_t uid, bool create) {
+    {
+        std::lock_guard<std::mutex> lock(uid_dirs_lock);
+        auto it = std::find_if(uid_dirs.begin(), uid_dirs.end(),
+                               [uid](const UidDir& dir) { return dir.uid == uid; });
+        if (it != uid_dirs.end()) {
+            std::rotate(uid_dirs.begin(), it, it + 1);
+            return uid_dirs.front().fd;
+        }
+    }
+
     char path[PROCESSGROUP_MAX_PATH_LEN] = {0};
-    convertUidPidToPath(path, sizeof(path), uid, pid);
-    strlcat(path, PROCESSGROUP_CGROUP_PROCS_FILE, sizeof(path));
+    convertUidToPath(path, sizeof(path), uid);
+    if (create && !mkdirAndChown(path, 0750, AID_SYSTEM, AID_SYSTEM)) {
+        PLOG(ERROR) << "Failed to make and chown " << path;
+        return nullptr;
+    }
+
+    auto fd = std::make_shared<android::base::unique_fd>(
+        open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (*fd == -1) return nullptr;
 
-    int fd = open(path, O_RDONLY);
+    std::lock_guard<std::mutex> lock(uid_dirs_lock);
+    if (uid_dirs.size() == kUidDirCacheSize) uid_dirs.pop_back();
+    uid_dirs.insert(uid_dirs.begin(), UidDir{uid, fd});
+    return fd;
+}
+
+// Drops the cached directory of |uid|, which was removed, or all of them if |uid| is -1.
+static void forgetUidDir(uid_t uid) {
+    std::lock_guard<std::mutex> lock(uid_dirs_lock);
+    uid_dirs.erase(std::remove_if(uid_dirs.begin(), uid_dirs.end(),
+                                  [uid](const UidDir& dir) {
+                                      return uid == static_cast<uid_t>(-1) || dir.uid == uid;
+                                  }),
+                   uid_dirs.end());
+}
+
+// Opens |fileName| in the process cgroup of |pid|. A cached uid directory may have been removed
+// by another process, in which case it is looked up again.
+static int openProcessGroupFile(uid_t uid, int pid, const char* fileName, int flags) {
+    char name[PROCESSGROUP_MAX_PATH_LEN];
+    snprintf(name, sizeof(name), "%s%d%s", PROCESSGROUP_PID_PREFIX, pid, fileName);
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        auto dir = openUidDir(uid, false);
+        if (!dir) return -1;
+        int fd = openat(*dir, name, flags | O_CLOEXEC);
+        if (fd != -1 || errno != ENOENT || attempt > 0) return fd;
+        forgetUidDir(uid);
+    }
+    return -1;
+}
+
+bool ProcessGroup::Open(uid_t uid, int pid) {
+    int fd = openProcessGroupFile(uid, pid, PROCESSGROUP_CGROUP_PROCS_FILE, O_RDONLY);
     if (fd < 0) return false;
 
     fd_.reset(fd);
 
-    LOG(VERBOSE) << "Initialized context for " << path;
+    LOG(VERBOSE) << "Initialized context for uid " << uid << " pid " << pid;
 
     return true;
 }
 
+bool ProcessGroup::Rewind() {
+    buf_ptr_ = buf_;
+    buf_len_ = 0;
+    return lseek(fd_, 0, SEEK_SET) == 0;
+}
+
 int ProcessGroup::RefillBuffer() {
     memmove(buf_, buf_ptr_, buf_len_);
     buf_ptr_ = buf_;
@@ -187,11 +268,18 @@ static int removeProcessGroup(uid_t uid, int pid)
     int ret;
     char path[PROCESSGROUP_MAX_PATH_LEN] = {0};
 
-    convertUidPidToPath(path, sizeof(path), uid, pid);
-    ret = rmdir(path);
+    auto dir = openUidDir(uid, false);
+    if (dir) {
+        snprintf(path, sizeof(path), "%s%d", PROCESSGROUP_PID_PREFIX, pid);
+        ret = unlinkat(*dir, path, AT_REMOVEDIR);
+    } else {
+        convertUidPidToPath(path, sizeof(path), uid, pid);
+        ret = rmdir(path);
+    }
 
+    // This only succeeds once the uid has no process cgroups left.
     convertUidToPath(path, sizeof(path), uid);
-    rmdir(path);
+    if (rmdir(path) == 0) forgetUidDir(uid);
 
     return ret;
 }
@@ -222,50 +310,64 @@ static void removeUidProcessGroups(const char *uid_path)
 void removeAllProcessGroups()
 {
     LOG(VERBOSE) << "removeAllProcessGroups()";
+    forgetUidDir(-1);
     const char* cgroup_root_path = getCgroupRootPath();
     std::unique_ptr<DIR, decltype(&closedir)> root(opendir(cgroup_root_path), closedir);
     if (root == NULL) {
         PLOG(ERROR) << "Failed to open " << cgroup_root_path;
-    } else {
-        dirent* dir;
-        while ((dir = readdir(root.get())) != nullptr) {
-            char path[PROCESSGROUP_MAX_PATH_LEN];
+        return;
+    }
 
-            if (dir->d_type != DT_DIR) {
-                continue;
-            }
-            if (strncmp(dir->d_name, PROCESSGROUP_UID_PREFIX, strlen(PROCESSGROUP_UID_PREFIX))) {
-                continue;
-            }
+    std::vector<std::string> uid_paths;
+    dirent* dir;
+    while ((dir = readdir(root.get())) != nullptr) {
+        if (dir->d_type != DT_DIR) {
+            continue;
+        }
+        if (strncmp(dir->d_name, PROCESSGROUP_UID_PREFIX, strlen(PROCESSGROUP_UID_PREFIX))) {
+            continue;
+        }
+        uid_paths.emplace_back(std::string(cgroup_root_path) + "/" + dir->d_name);
+    }
 
-            snprintf(path, sizeof(path), "%s/%s", cgroup_root_path, dir->d_name);
+    // Each rmdir of a cgroup waits for the kernel to tear it down, and there can be thousands
+    // of them at boot, so the uids are split between a few threads.
+    std::atomic<size_t> next(0);
+    auto remove_uids = [&uid_paths, &next]() {
+        for (size_t i; (i = next++) < uid_paths.size();) {
+            const char* path = uid_paths[i].c_str();
             removeUidProcessGroups(path);
             LOG(VERBOSE) << "Removing " << path;
             if (rmdir(path) == -1) PLOG(WARNING) << "Failed to remove " << path;
         }
+    };
+    size_t thread_count = std::min<size_t>(std::max(1U, std::thread::hardware_concurrency()),
+                                           std::min<size_t>(uid_paths.size(), 4));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back(remove_uids);
+    }
+    remove_uids();
+    for (auto& thread : threads) {
+        thread.join();
     }
 }
 
-// Returns number of processes killed on success
-// Returns 0 if there are no processes in the process cgroup left to kill
+// Signals the processes in |process_group| that aren't in |signalled| yet, and adds them to it.
+// Returns the number of processes in the process cgroup, which is 0 once it's empty.
 // Returns -errno on error
-static int doKillProcessGroupOnce(uid_t uid, int initialPid, int signal) {
-    ProcessGroup process_group;
-    if (!process_group.Open(uid, initialPid)) {
-        PLOG(WARNING) << "Failed to open process cgroup uid " << uid << " pid " << initialPid;
-        return -errno;
-    }
-
+static int doKillProcessGroupOnce(ProcessGroup* process_group, uid_t uid, int initialPid,
+                                  int signal, std::set<pid_t>* signalled) {
     // We separate all of the pids in the cgroup into those pids that are also the leaders of
     // process groups (stored in the pgids set) and those that are not (stored in the pids set).
     std::set<pid_t> pgids;
-    pgids.emplace(initialPid);
+    if (signalled->insert(initialPid).second) pgids.emplace(initialPid);
     std::set<pid_t> pids;
 
     int ret;
     pid_t pid;
     int processes = 0;
-    while ((ret = process_group.GetOneAppProcess(&pid)) > 0 && pid >= 0) {
+    while ((ret = process_group->GetOneAppProcess(&pid)) > 0 && pid >= 0) {
         processes++;
         if (pid == 0) {
             // Should never happen...  but if it does, trying to kill this
@@ -273,6 +375,8 @@ static int doKillProcessGroupOnce(uid_t uid, int initialPid, int signal) {
             LOG(WARNING) << "Yikes, we've been told to kill pid 0!  How about we don't do that?";
             continue;
         }
+        // A process that was already signalled is just still exiting.
+        if (!signalled->insert(pid).second) continue;
         pid_t pgid = getpgid(pid);
         if (pgid == -1) PLOG(ERROR) << "getpgid(" << pid << ") failed";
         if (pgid == pid) {
@@ -284,7 +388,7 @@ static int doKillProcessGroupOnce(uid_t uid, int initialPid, int signal) {
 
     // Erase all pids that will be killed when we kill the process groups.
     for (auto it = pids.begin(); it != pids.end();) {
-        pid_t pgid = getpgid(pid);
+        pid_t pgid = getpgid(*it);
         if (pgids.count(pgid) == 1) {
             it = pids.erase(it);
         } else {
@@ -315,22 +419,37 @@ static int doKillProcessGroupOnce(uid_t uid, int initialPid, int signal) {
     return ret >= 0 ? processes : ret;
 }
 
-static int killProcessGroup(uid_t uid, int initialPid, int signal, int retries) {
+static int killProcessGroup(uid_t uid, int initialPid, int signal, bool wait) {
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-    int retry = retries;
+    ProcessGroup process_group;
+    if (!process_group.Open(uid, initialPid)) {
+        PLOG(WARNING) << "Failed to open process cgroup uid " << uid << " pid " << initialPid;
+        PLOG(ERROR) << "Error encountered killing process cgroup uid " << uid << " pid "
+                    << initialPid;
+        return -1;
+    }
+
+    // Signal everything once, then keep rereading the same cgroup.procs until it's empty,
+    // checking often at first since most processes exit right away. Only processes that
+    // turn up later, such as ones forked meanwhile, are signalled again.
+    std::set<pid_t> signalled;
+    auto delay = 1ms;
     int processes;
-    while ((processes = doKillProcessGroupOnce(uid, initialPid, signal)) > 0) {
-        LOG(VERBOSE) << "Killed " << processes << " processes for processgroup " << initialPid;
-        if (retry > 0) {
-            std::this_thread::sleep_for(5ms);
-            --retry;
-        } else {
+    while ((processes = doKillProcessGroupOnce(&process_group, uid, initialPid, signal,
+                                               &signalled)) > 0) {
+        LOG(VERBOSE) << processes << " processes remain in processgroup " << initialPid;
+        if (!wait || std::chrono::steady_clock::now() - start >= 200ms) break;
+        std::this_thread::sleep_for(delay);
+        delay = std::min<std::chrono::milliseconds>(delay * 2, 5ms);
+        if (!process_group.Rewind()) {
+            processes = -errno;
             break;
         }
     }
 
     if (processes < 0) {
+        errno = -processes;
         PLOG(ERROR) << "Error encountered killing process cgroup uid " << uid << " pid "
                     << initialPid;
         return -1;
@@ -339,20 +458,17 @@ static int killProcessGroup(uid_t uid, int initialPid, int signal, int retries)
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
 
-    // We only calculate the number of 'processes' when killing the processes.
-    // In the retries == 0 case, we only kill the processes once and therefore
-    // will not have waited then recalculated how many processes are remaining
-    // after the first signals have been sent.
-    // Logging anything regarding the number of 'processes' here does not make sense.
+    // Without waiting, the processes were only counted before the signals were sent, so
+    // logging anything regarding the number of 'processes' here does not make sense.
 
     if (processes == 0) {
-        if (retries > 0) {
+        if (wait) {
             LOG(INFO) << "Successfully killed process cgroup uid " << uid << " pid " << initialPid
                       << " in " << static_cast<int>(ms) << "ms";
         }
         return removeProcessGroup(uid, initialPid);
     } else {
-        if (retries > 0) {
+        if (wait) {
             LOG(ERROR) << "Failed to kill process cgroup uid " << uid << " pid " << initialPid
                        << " in " << static_cast<int>(ms) << "ms, " << processes
                        << " processes remain";
@@ -362,11 +478,71 @@ static int killProcessGroup(uid_t uid, int initialPid, int signal, int retries)
 }
 
 int killProcessGroup(uid_t uid, int initialPid, int signal) {
-    return killProcessGroup(uid, initialPid, signal, 40 /*retries*/);
+    return killProcessGroup(uid, initialPid, signal, true /*wait*/);
 }
 
 int killProcessGroupOnce(uid_t uid, int initialPid, int signal) {
-    return killProcessGroup(uid, initialPid, signal, 0 /*retries*/);
+    return killProcessGroup(uid, initialPid, signal, false /*wait*/);
+}
+
+// Arms |fd| to become readable again after |ms|.
+static bool armKillTimer(int fd, long ms) {
+    struct itimerspec its = {};
+    its.it_value.tv_sec = ms / 1000;
+    its.it_value.tv_nsec = (ms % 1000) * 1000000 + 1;
+    return timerfd_settime(fd, 0, &its, nullptr) == 0;
+}
+
+int killProcessGroupAsync(uid_t uid, int initialPid, int signal) {
+    ProcessGroup process_group;
+    if (!process_group.Open(uid, initialPid)) {
+        int saved_errno = errno;
+        PLOG(WARNING) << "Failed to open process cgroup uid " << uid << " pid " << initialPid;
+        return -saved_errno;
+    }
+
+    std::set<pid_t> signalled;
+    int processes = doKillProcessGroupOnce(&process_group, uid, initialPid, signal, &signalled);
+    if (processes < 0) return processes;
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) return -errno;
+
+    // Most processes are gone within a millisecond of being killed; an empty group is
+    // reported right away.
+    if (!armKillTimer(fd, processes > 0 ? 1 : 0)) {
+        int saved_errno = errno;
+        close(fd);
+        return -saved_errno;
+    }
+    return fd;
+}
+
+int finishKillProcessGroup(uid_t uid, int initialPid, int fd) {
+    uint64_t expirations;
+    TEMP_FAILURE_RETRY(read(fd, &expirations, sizeof(expirations)));
+
+    int ret;
+    pid_t pid;
+    int processes = 0;
+    ProcessGroup process_group;
+    if (!process_group.Open(uid, initialPid)) {
+        ret = -errno;
+    } else {
+        while ((ret = process_group.GetOneAppProcess(&pid)) > 0) {
+            processes++;
+        }
+    }
+
+    if (ret == 0 && processes > 0) {
+        if (armKillTimer(fd, 5)) return -EAGAIN;
+        ret = -errno;
+    }
+    close(fd);
+
+    if (ret < 0) return ret;
+    if (removeProcessGroup(uid, initialPid) == -1) return -errno;
+    return 0;
 }
 
 static bool mkdirAndChown(const char *path, mode_t mode, uid_t uid, gid_t gid)
@@ -385,47 +561,72 @@ static bool mkdirAndChown(const char *path, mode_t mode, uid_t uid, gid_t gid)
     return true;
 }
 
+// Writes each of |pids| to the open cgroup.procs |fd|. The kernel takes one pid per write.
+static int writeProcesses(int fd, const pid_t* pids, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        std::string pid = std::to_string(pids[i]);
+        if (TEMP_FAILURE_RETRY(write(fd, pid.c_str(), pid.size())) == -1) {
+            int saved_errno = errno;
+            PLOG(ERROR) << "Failed to move pid " << pids[i] << " to its process cgroup";
+            return -saved_errno;
+        }
+    }
+    return 0;
+}
+
 int createProcessGroup(uid_t uid, int initialPid)
 {
-    char path[PROCESSGROUP_MAX_PATH_LEN] = {0};
-
-    convertUidToPath(path, sizeof(path), uid);
-
-    if (!mkdirAndChown(path, 0750, AID_SYSTEM, AID_SYSTEM)) {
-        PLOG(ERROR) << "Failed to make and chown " << path;
-        return -errno;
-    }
+    char name[PROCESSGROUP_MAX_PATH_LEN];
+    snprintf(name, sizeof(name), "%s%d", PROCESSGROUP_PID_PREFIX, initialPid);
 
-    convertUidPidToPath(path, sizeof(path), uid, initialPid);
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        auto dir = openUidDir(uid, true);
+        if (!dir) return -errno;
 
-    if (!mkdirAndChown(path, 0750, AID_SYSTEM, AID_SYSTEM)) {
-        PLOG(ERROR) << "Failed to make and chown " << path;
-        return -errno;
+        if (mkdirat(*dir, name, 0750) == -1 && errno != EEXIST) {
+            // Someone else removed the uid directory we had cached.
+            if (errno == ENOENT && attempt == 0) {
+                forgetUidDir(uid);
+                continue;
+            }
+            PLOG(ERROR) << "Failed to make " << name << " for uid " << uid;
+            return -errno;
+        }
+        if (fchownat(*dir, name, AID_SYSTEM, AID_SYSTEM, 0) == -1) {
+            int saved_errno = errno;
+            PLOG(ERROR) << "Failed to chown " << name << " for uid " << uid;
+            unlinkat(*dir, name, AT_REMOVEDIR);
+            return -saved_errno;
+        }
+        break;
     }
 
-    strlcat(path, PROCESSGROUP_CGROUP_PROCS_FILE, sizeof(path));
+    return addProcessesToProcessGroup(uid, initialPid, &initialPid, 1);
+}
 
-    int ret = 0;
-    if (!WriteStringToFile(std::to_string(initialPid), path)) {
-        ret = -errno;
-        PLOG(ERROR) << "Failed to write '" << initialPid << "' to " << path;
+int addProcessesToProcessGroup(uid_t uid, int initialPid, const pid_t* pids, size_t count)
+{
+    android::base::unique_fd fd(
+        openProcessGroupFile(uid, initialPid, PROCESSGROUP_CGROUP_PROCS_FILE, O_WRONLY));
+    if (fd == -1) {
+        int saved_errno = errno;
+        PLOG(ERROR) << "Failed to open the process cgroup of uid " << uid << " pid " << initialPid;
+        return -saved_errno;
     }
-
-    return ret;
+    return writeProcesses(fd, pids, count);
 }
 
 static bool setProcessGroupValue(uid_t uid, int pid, const char* fileName, int64_t value) {
-    char path[PROCESSGROUP_MAX_PATH_LEN] = {0};
     if (strcmp(getCgroupRootPath(), MEM_CGROUP_PATH)) {
-        PLOG(ERROR) << "Memcg is not mounted." << path;
+        PLOG(ERROR) << "Memcg is not mounted.";
         return false;
     }
 
-    convertUidPidToPath(path, sizeof(path), uid, pid);
-    strlcat(path, fileName, sizeof(path));
-
-    if (!WriteStringToFile(std::to_string(value), path)) {
-        PLOG(ERROR) << "Failed to write '" << value << "' to " << path;
+    std::string content = std::to_string(value);
+    android::base::unique_fd fd(openProcessGroupFile(uid, pid, fileName, O_WRONLY));
+    if (fd == -1 || !android::base::WriteFully(fd, content.c_str(), content.size())) {
+        PLOG(ERROR) << "Failed to write '" << value << "' to " << fileName << " of uid " << uid
+                    << " pid " << pid;
         return false;
     }
     return true;
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include <procinfo/process.h>
+
+namespace android {
+namespace procinfo {
+
+#if defined(__linux__)
+
+// A process or thread as described by its /proc stat file.
+struct ThreadStat {
+  pid_t tid;
+  pid_t pid;  // thread group id
+  pid_t ppid;
+  uid_t uid;
+  ProcessState state;
+  std::string name;  // comm, as truncated by the kernel
+  uint64_t utime;    // user and system time, in clock ticks
+  uint64_t stime;
+  uint64_t start_time;  // clock ticks after boot, tells reused ids apart
+  uint64_t rss;         // resident set size, in pages
+  int num_threads;
+};
+
+// Parse the contents of a /proc/<pid>/stat or /proc/<pid>/task/<tid>/stat
+// file into |stat|. |buf| need not be nul terminated. The thread group id
+// and uid are not part of the file and are left untouched.
+bool ParseThreadStat(const char* buf, size_t len, ThreadStat* stat);
+
+// A whole-system snapshot of /proc. Directories are enumerated with
+// getdents64 and stat files parsed in place, and Update() reuses the
+// buffers and entries of the previous scan, so periodic sampling does
+// little beyond the unavoidable syscalls.
+class ProcessSnapshot {
+ public:
+  ProcessSnapshot();
+  ~ProcessSnapshot();
+
+  ProcessSnapshot(const ProcessSnapshot&) = delete;
+  ProcessSnapshot& operator=(const ProcessSnapshot&) = delete;
+
+  // Rescan /proc, recording every process, or every thread of every
+  // process if |threads| is set. Processes and threads exiting during the
+  // scan are skipped. Returns false if /proc could not be read.
+  bool Update(bool threads = false);
+
+  // Sorted by tid. A process-only scan holds the thread group leaders.
+  const std::vector<ThreadStat>& entries() const { return entries_; }
+
+  // Returns the entry for |tid|, or nullptr.
+  const ThreadStat* Find(pid_t tid) const;
+
+ private:
+  bool ReadIds(int dir_fd, std::vector<pid_t>* ids);
+  bool ReadStat(int dir_fd, const char* path, ThreadStat* stat);
+  ThreadStat* NextEntry();
+
+  int proc_fd_;
+  size_t count_;
+  std::vector<ThreadStat> entries_;
+  std::vector<pid_t> pids_;
+  std::vector<pid_t> tids_;
+  std::vector<char> dirent_buf_;
+  char stat_buf_[2048];
+};
+
+// What happened to a thread between two snapshots.
+struct ThreadDelta {
+  pid_t tid;
+  pid_t pid;
+  uint64_t utime;  // clock ticks spent since the earlier snapshot
+  uint64_t stime;
+  ProcessState old_state;
+  ProcessState new_state;
+  bool started;  // only in the later snapshot, old_state is unknown
+  bool exited;   // only in the earlier snapshot, new_state is unknown
+};
+
+// Fill |out| with a delta for every thread that used CPU time, changed
+// state, started or exited between |before| and |after|. An id reused in
+// between counts as one thread exiting and another starting.
+void ComputeThreadDeltas(const ProcessSnapshot& before, const ProcessSnapshot& after,
+                         std::vector<ThreadDelta>* out);
+
+#endif
+
+} /* namespace procinfo */
+} /* namespace android */
@@ -24,6 +24,7 @@
 
 #include <string>
 
+#include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 
 using android::base::unique_fd;
@@ -62,67 +63,110 @@ static ProcessState parse_state(const char* state) {
   }
 }
 
+template <size_t N>
+static bool HeaderIs(const char* line, size_t header_len, const char (&header)[N]) {
+  return header_len == N - 1 && memcmp(line, header, N - 1) == 0;
+}
+
+// Parses the leading decimal number in [p, end), like atoi without reading
+// beyond |end|.
+static int ParseStatusInt(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t')) ++p;
+  int value = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    value = value * 10 + (*p++ - '0');
+  }
+  return value;
+}
+
+// Parses one "Header:\tvalue" line of a status file, |end| excludes the
+// newline.
+static void ParseStatusLine(const char* line, const char* end, ProcessInfo* process_info,
+                            int* field_bitmap) {
+  const char* tab = static_cast<const char*>(memchr(line, '\t', end - line));
+  if (tab == nullptr) {
+    return;
+  }
+
+  size_t header_len = tab - line;
+  const char* value = tab + 1;
+  if (HeaderIs(line, header_len, "Name:")) {
+    process_info->name.assign(value, end - value);
+    *field_bitmap |= 1;
+  } else if (HeaderIs(line, header_len, "Pid:")) {
+    process_info->tid = ParseStatusInt(value, end);
+    *field_bitmap |= 2;
+  } else if (HeaderIs(line, header_len, "Tgid:")) {
+    process_info->pid = ParseStatusInt(value, end);
+    *field_bitmap |= 4;
+  } else if (HeaderIs(line, header_len, "PPid:")) {
+    process_info->ppid = ParseStatusInt(value, end);
+    *field_bitmap |= 8;
+  } else if (HeaderIs(line, header_len, "TracerPid:")) {
+    process_info->tracer = ParseStatusInt(value, end);
+    *field_bitmap |= 16;
+  } else if (HeaderIs(line, header_len, "Uid:")) {
+    process_info->uid = ParseStatusInt(value, end);
+    *field_bitmap |= 32;
+  } else if (HeaderIs(line, header_len, "Gid:")) {
+    process_info->gid = ParseStatusInt(value, end);
+    *field_bitmap |= 64;
+  } else if (HeaderIs(line, header_len, "State:")) {
+    process_info->state = value < end ? parse_state(value) : kProcessStateUnknown;
+    *field_bitmap |= 128;
+  }
+}
+
 bool GetProcessInfoFromProcPidFd(int fd, ProcessInfo* process_info) {
-  int status_fd = openat(fd, "status", O_RDONLY | O_CLOEXEC);
+  unique_fd status_fd(openat(fd, "status", O_RDONLY | O_CLOEXEC));
 
   if (status_fd == -1) {
     PLOG(ERROR) << "failed to open status fd in GetProcessInfoFromProcPidFd";
     return false;
   }
 
-  std::unique_ptr<FILE, decltype(&fclose)> fp(fdopen(status_fd, "r"), fclose);
-  if (!fp) {
-    PLOG(ERROR) << "failed to open status file in GetProcessInfoFromProcPidFd";
-    close(status_fd);
-    return false;
-  }
-
+  // The fields we want are at the top of the file, so the scan normally
+  // ends within the first read. Lines are parsed in place; one that does
+  // not fit in the buffer (a long Groups: list) is skipped.
   int field_bitmap = 0;
   static constexpr int finished_bitmap = 255;
-  char* line = nullptr;
+  char buf[4096];
   size_t len = 0;
-
-  while (getline(&line, &len, fp.get()) != -1 && field_bitmap != finished_bitmap) {
-    char* tab = strchr(line, '\t');
-    if (tab == nullptr) {
-      continue;
+  bool eof = false;
+  bool skip = false;
+
+  while (field_bitmap != finished_bitmap && !eof) {
+    ssize_t n = TEMP_FAILURE_RETRY(read(status_fd.get(), buf + len, sizeof(buf) - len));
+    if (n == -1) {
+      PLOG(ERROR) << "failed to read status file in GetProcessInfoFromProcPidFd";
+      return false;
+    }
+    eof = n == 0;
+    len += n;
+
+    const char* line = buf;
+    const char* end = buf + len;
+    const char* newline;
+    while ((newline = static_cast<const char*>(memchr(line, '\n', end - line)))) {
+      if (!skip) {
+        ParseStatusLine(line, newline, process_info, &field_bitmap);
+      }
+      skip = false;
+      line = newline + 1;
+    }
+    if (eof && line < end && !skip) {
+      ParseStatusLine(line, end, process_info, &field_bitmap);
     }
 
-    size_t header_len = tab - line;
-    std::string header = std::string(line, header_len);
-    if (header == "Name:") {
-      std::string name = line + header_len + 1;
-
-      // line includes the trailing newline.
-      name.pop_back();
-      process_info->name = std::move(name);
-
-      field_bitmap |= 1;
-    } else if (header == "Pid:") {
-      process_info->tid = atoi(tab + 1);
-      field_bitmap |= 2;
-    } else if (header == "Tgid:") {
-      process_info->pid = atoi(tab + 1);
-      field_bitmap |= 4;
-    } else if (header == "PPid:") {
-      process_info->ppid = atoi(tab + 1);
-      field_bitmap |= 8;
-    } else if (header == "TracerPid:") {
-      process_info->tracer = atoi(tab + 1);
-      field_bitmap |= 16;
-    } else if (header == "Uid:") {
-      process_info->uid = atoi(tab + 1);
-      field_bitmap |= 32;
-    } else if (header == "Gid:") {
-      process_info->gid = atoi(tab + 1);
-      field_bitmap |= 64;
-    } else if (header == "State:") {
-      process_info->state = parse_state(tab + 1);
-      field_bitmap |= 128;
+    len = end - line;
+    if (len == sizeof(buf)) {
+      skip = true;
+      len = 0;
+    } else {
+      memmove(buf, line, len);
     }
   }
 
-  free(line);
   return field_bitmap == finished_bitmap;
 }
 
@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <procinfo/process_snapshot.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+using android::base::unique_fd;
+
+namespace android {
+namespace procinfo {
+
+namespace {
+
+// The getdents64 record, not exported by every libc.
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+constexpr size_t kDirentBufSize = 32 * 1024;
+
+// Unlike the status file, stat uses single letters for every state the
+// kernel has, including the newer ones, so no error is logged here.
+ProcessState StatState(char state) {
+  switch (state) {
+    case 'R':
+      return kProcessStateRunning;
+    case 'S':
+    case 'I':  // idle kernel thread
+      return kProcessStateSleeping;
+    case 'D':
+      return kProcessStateUninterruptibleWait;
+    case 'T':
+    case 't':  // tracing stop
+      return kProcessStateStopped;
+    case 'Z':
+    case 'X':
+      return kProcessStateZombie;
+    default:
+      return kProcessStateUnknown;
+  }
+}
+
+// Parses a decimal field at |*p|, leaves |*p| after the following space.
+template <typename T>
+bool NextField(const char** p, const char* end, T* value) {
+  const char* cp = *p;
+  bool negative = (cp < end) && (*cp == '-');
+  if (negative) ++cp;
+  if ((cp >= end) || (*cp < '0') || (*cp > '9')) return false;
+  uint64_t v = 0;
+  while ((cp < end) && (*cp >= '0') && (*cp <= '9')) {
+    v = v * 10 + (*cp++ - '0');
+  }
+  if ((cp < end) && (*cp == ' ')) ++cp;
+  *value = negative ? static_cast<T>(-static_cast<int64_t>(v)) : static_cast<T>(v);
+  *p = cp;
+  return true;
+}
+
+bool SkipFields(const char** p, const char* end, int count) {
+  const char* cp = *p;
+  while (count-- > 0) {
+    const char* space = static_cast<const char*>(memchr(cp, ' ', end - cp));
+    if (!space) return false;
+    cp = space + 1;
+  }
+  *p = cp;
+  return true;
+}
+
+// Parses the name of a /proc directory entry as an id, rejecting anything
+// that is not all digits.
+pid_t ParseId(const char* name) {
+  pid_t id = 0;
+  for (; *name; ++name) {
+    if ((*name < '0') || (*name > '9')) return 0;
+    id = id * 10 + (*name - '0');
+  }
+  return id;
+}
+
+}  // namespace
+
+bool ParseThreadStat(const char* buf, size_t len, ThreadStat* stat) {
+  const char* end = buf + len;
+  const char* p = buf;
+
+  pid_t tid;
+  if (!NextField(&p, end, &tid) || (p >= end) || (*p != '(')) return false;
+
+  // The name may itself contain ')' and spaces, the last ')' ends it.
+  const char* name = p + 1;
+  const char* close = nullptr;
+  for (const char* cp = end; cp > name;) {
+    if (*--cp == ')') {
+      close = cp;
+      break;
+    }
+  }
+  if (!close || (end - close) < 3) return false;
+  p = close + 2;
+
+  // Fields are numbered from 1 as in proc(5), |p| is at field 3.
+  char state = *p;
+  p += 2;
+  ThreadStat result;
+  if (!NextField(&p, end, &result.ppid)) return false;          // 4
+  if (!SkipFields(&p, end, 9)) return false;                   // 5-13
+  if (!NextField(&p, end, &result.utime)) return false;         // 14
+  if (!NextField(&p, end, &result.stime)) return false;         // 15
+  if (!SkipFields(&p, end, 4)) return false;                   // 16-19
+  if (!NextField(&p, end, &result.num_threads)) return false;   // 20
+  if (!SkipFields(&p, end, 1)) return false;                   // 21
+  if (!NextField(&p, end, &result.start_time)) return false;    // 22
+  if (!SkipFields(&p, end, 1)) return false;                   // 23
+  if (!NextField(&p, end, &result.rss)) return false;           // 24
+
+  stat->tid = tid;
+  stat->ppid = result.ppid;
+  stat->state = StatState(state);
+  stat->name.assign(name, close - name);
+  stat->utime = result.utime;
+  stat->stime = result.stime;
+  stat->start_time = result.start_time;
+  stat->rss = result.rss;
+  stat->num_threads = result.num_threads;
+  return true;
+}
+
+ProcessSnapshot::ProcessSnapshot()
+    : proc_fd_(-1), count_(0), dirent_buf_(kDirentBufSize) {}
+
+ProcessSnapshot::~ProcessSnapshot() {
+  if (proc_fd_ != -1) close(proc_fd_);
+}
+
+bool ProcessSnapshot::ReadIds(int dir_fd, std::vector<pid_t>* ids) {
+  ids->clear();
+  if (lseek(dir_fd, 0, SEEK_SET) == -1) return false;
+
+  while (true) {
+    long n = syscall(SYS_getdents64, dir_fd, dirent_buf_.data(), dirent_buf_.size());
+    if (n < 0) return false;
+    if (n == 0) return true;
+
+    for (long pos = 0; pos < n;) {
+      auto dent = reinterpret_cast<linux_dirent64*>(dirent_buf_.data() + pos);
+      pos += dent->d_reclen;
+      if (dent->d_type != DT_DIR && dent->d_type != DT_UNKNOWN) continue;
+      pid_t id = ParseId(dent->d_name);
+      if (id > 0) ids->push_back(id);
+    }
+  }
+}
+
+bool ProcessSnapshot::ReadStat(int dir_fd, const char* path, ThreadStat* stat) {
+  unique_fd fd(openat(dir_fd, path, O_RDONLY | O_CLOEXEC));
+  if (fd == -1) return false;  // exited since the directory was read
+
+  ssize_t n = TEMP_FAILURE_RETRY(read(fd.get(), stat_buf_, sizeof(stat_buf_)));
+  if (n <= 0) return false;
+  return ParseThreadStat(stat_buf_, n, stat);
+}
+
+ThreadStat* ProcessSnapshot::NextEntry() {
+  if (count_ == entries_.size()) entries_.emplace_back();
+  return &entries_[count_++];
+}
+
+bool ProcessSnapshot::Update(bool threads) {
+  if (proc_fd_ == -1) {
+    proc_fd_ = open("/proc", O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+    if (proc_fd_ == -1) {
+      PLOG(ERROR) << "failed to open /proc";
+      return false;
+    }
+  }
+  if (!ReadIds(proc_fd_, &pids_)) {
+    PLOG(ERROR) << "failed to read /proc";
+    return false;
+  }
+
+  // Entries are overwritten in place to keep their name buffers.
+  count_ = 0;
+  char path[64];
+  for (pid_t pid : pids_) {
+    struct stat st;
+    snprintf(path, sizeof(path), "%d", pid);
+    if (fstatat(proc_fd_, path, &st, 0) == -1) continue;
+
+    if (!threads) {
+      snprintf(path, sizeof(path), "%d/stat", pid);
+      ThreadStat* entry = NextEntry();
+      if (!ReadStat(proc_fd_, path, entry)) {
+        --count_;
+        continue;
+      }
+      entry->pid = pid;
+      entry->uid = st.st_uid;
+      continue;
+    }
+
+    snprintf(path, sizeof(path), "%d/task", pid);
+    unique_fd task_fd(openat(proc_fd_, path, O_DIRECTORY | O_RDONLY | O_CLOEXEC));
+    if (task_fd == -1 || !ReadIds(task_fd.get(), &tids_)) continue;
+    for (pid_t tid : tids_) {
+      snprintf(path, sizeof(path), "%d/stat", tid);
+      ThreadStat* entry = NextEntry();
+      if (!ReadStat(task_fd.get(), path, entry)) {
+        --count_;
+        continue;
+      }
+      entry->pid = pid;
+      entry->uid = st.st_uid;
+    }
+  }
+  entries_.resize(count_);
+
+  // /proc lists processes in order already, threads of a process are
+  // listed together, so this is close to a no-op.
+  if (!std::is_sorted(entries_.begin(), entries_.end(),
+                      [](const ThreadStat& a, const ThreadStat& b) { return a.tid < b.tid; })) {
+    std::sort(entries_.begin(), entries_.end(),
+              [](const ThreadStat& a, const ThreadStat& b) { return a.tid < b.tid; });
+  }
+  return true;
+}
+
+const ThreadStat* ProcessSnapshot::Find(pid_t tid) const {
+  auto it = std::lower_bound(entries_.begin(), entries_.end(), tid,
+                             [](const ThreadStat& a, pid_t tid) { return a.tid < tid; });
+  if (it == entries_.end() || it->tid != tid) return nullptr;
+  return &*it;
+}
+
+void ComputeThreadDeltas(const ProcessSnapshot& before, const ProcessSnapshot& after,
+                         std::vector<ThreadDelta>* out) {
+  out->clear();
+
+  auto exited = [out](const ThreadStat& t) {
+    out->push_back({t.tid, t.pid, 0, 0, t.state, kProcessStateUnknown, false, true});
+  };
+  auto started = [out](const ThreadStat& t) {
+    out->push_back({t.tid, t.pid, t.utime, t.stime, kProcessStateUnknown, t.state, true, false});
+  };
+
+  // Both sides are sorted by tid, walk them together.
+  auto b = before.entries().begin(), b_end = before.entries().end();
+  auto a = after.entries().begin(), a_end = after.entries().end();
+  while (b != b_end || a != a_end) {
+    if (a == a_end || (b != b_end && b->tid < a->tid)) {
+      exited(*b++);
+    } else if (b == b_end || a->tid < b->tid) {
+      started(*a++);
+    } else if (b->start_time != a->start_time) {
+      exited(*b++);
+      started(*a++);
+    } else {
+      uint64_t utime = (a->utime > b->utime) ? a->utime - b->utime : 0;
+      uint64_t stime = (a->stime > b->stime) ? a->stime - b->stime : 0;
+      if (utime || stime || a->state != b->state) {
+        out->push_back({a->tid, a->pid, utime, stime, b->state, a->state, false, false});
+      }
+      ++a;
+      ++b;
+    }
+  }
+}
+
+} /* namespace procinfo */
+} /* namespace android */
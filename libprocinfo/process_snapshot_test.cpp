@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <procinfo/process_snapshot.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+#if !defined(__BIONIC__)
+#include <syscall.h>
+static pid_t gettid() {
+  return syscall(__NR_gettid);
+}
+#endif
+
+static const android::procinfo::ThreadDelta* FindDelta(
+    const std::vector<android::procinfo::ThreadDelta>& deltas, pid_t tid) {
+  for (const auto& delta : deltas) {
+    if (delta.tid == tid) return &delta;
+  }
+  return nullptr;
+}
+
+TEST(process_snapshot, parse_stat) {
+  const char stat[] =
+      "1234 (a) b) c) S 1 1234 1234 0 -1 4194560 100 0 0 0 17 5 0 0 20 0 3 0 4567 "
+      "12345678 890 18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 0 0 0 0 0 0\n";
+  android::procinfo::ThreadStat stat_info;
+  ASSERT_TRUE(android::procinfo::ParseThreadStat(stat, strlen(stat), &stat_info));
+  ASSERT_EQ(1234, stat_info.tid);
+  ASSERT_EQ("a) b) c", stat_info.name);
+  ASSERT_EQ(android::procinfo::kProcessStateSleeping, stat_info.state);
+  ASSERT_EQ(1, stat_info.ppid);
+  ASSERT_EQ(17u, stat_info.utime);
+  ASSERT_EQ(5u, stat_info.stime);
+  ASSERT_EQ(3, stat_info.num_threads);
+  ASSERT_EQ(4567u, stat_info.start_time);
+  ASSERT_EQ(890u, stat_info.rss);
+
+  ASSERT_FALSE(android::procinfo::ParseThreadStat(stat, 20, &stat_info));
+  ASSERT_FALSE(android::procinfo::ParseThreadStat("1234 (x", 7, &stat_info));
+}
+
+TEST(process_snapshot, snapshot_smoke) {
+  android::procinfo::ProcessSnapshot snapshot;
+  ASSERT_TRUE(snapshot.Update());
+
+  const android::procinfo::ThreadStat* self = snapshot.Find(getpid());
+  ASSERT_NE(nullptr, self);
+  ASSERT_EQ(getpid(), self->pid);
+  ASSERT_EQ(getppid(), self->ppid);
+  ASSERT_EQ(getuid(), self->uid);
+  ASSERT_EQ(android::procinfo::kProcessStateRunning, self->state);
+
+  // A second scan reuses the entries and must give the same answer.
+  ASSERT_TRUE(snapshot.Update());
+  self = snapshot.Find(getpid());
+  ASSERT_NE(nullptr, self);
+  ASSERT_EQ(getppid(), self->ppid);
+}
+
+TEST(process_snapshot, snapshot_threads) {
+  pid_t main_tid = gettid();
+  std::thread([main_tid]() {
+    pid_t thread_tid = gettid();
+    android::procinfo::ProcessSnapshot snapshot;
+    ASSERT_TRUE(snapshot.Update(true));
+
+    const android::procinfo::ThreadStat* thread = snapshot.Find(thread_tid);
+    ASSERT_NE(nullptr, thread);
+    ASSERT_EQ(getpid(), thread->pid);
+    ASSERT_NE(nullptr, snapshot.Find(main_tid));
+  }).join();
+}
+
+TEST(process_snapshot, thread_deltas) {
+  android::procinfo::ProcessSnapshot before;
+  android::procinfo::ProcessSnapshot after;
+  std::vector<android::procinfo::ThreadDelta> deltas;
+
+  ASSERT_TRUE(before.Update(true));
+  pid_t forkpid = fork();
+  ASSERT_NE(-1, forkpid);
+  if (forkpid == 0) {
+    pause();
+    _exit(0);
+  }
+
+  // Burn enough CPU for this thread's clock ticks to move.
+  auto until = std::chrono::steady_clock::now() + 100ms;
+  while (std::chrono::steady_clock::now() < until) {
+  }
+
+  ASSERT_TRUE(after.Update(true));
+  android::procinfo::ComputeThreadDeltas(before, after, &deltas);
+  const android::procinfo::ThreadDelta* child = FindDelta(deltas, forkpid);
+  ASSERT_NE(nullptr, child);
+  ASSERT_TRUE(child->started);
+  const android::procinfo::ThreadDelta* self = FindDelta(deltas, gettid());
+  ASSERT_NE(nullptr, self);
+  ASSERT_FALSE(self->started);
+  ASSERT_GT(self->utime + self->stime, 0u);
+
+  ASSERT_EQ(0, kill(forkpid, SIGKILL));
+  ASSERT_EQ(forkpid, waitpid(forkpid, nullptr, 0));
+
+  ASSERT_TRUE(before.Update(true));
+  android::procinfo::ComputeThreadDeltas(after, before, &deltas);
+  child = FindDelta(deltas, forkpid);
+  ASSERT_NE(nullptr, child);
+  ASSERT_TRUE(child->exited);
+}
@@ -18,6 +18,7 @@
 #define _LIBSPARSE_SPARSE_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef	__cplusplus
@@ -285,6 +286,81 @@ struct sparse_file *sparse_file_import_auto(int fd, bool crc, bool verbose);
 int sparse_file_resparse(struct sparse_file *in_s, unsigned int max_len,
 		struct sparse_file **out_s, int out_s_count);
 
+struct sparse_stream;
+
+/**
+ * struct sparse_stream_callbacks - callbacks for a streaming sparse parser
+ *
+ * @header - called once the file header has been parsed, with the block size
+ *           and the number of blocks in the expanded image
+ * @raw - called with raw data destined for byte offset in the expanded image.
+ *        A raw chunk may be delivered in several calls as its bytes arrive.
+ * @fill - called for len bytes at offset filled with the 32 bit fill_val
+ * @skip - called for len bytes at offset that the image doesn't care about
+ *
+ * Any callback may be NULL.  Callbacks should return negative on error, 0 on
+ * success; an error stops the parse and is returned by sparse_stream_write.
+ */
+struct sparse_stream_callbacks {
+	int (*header)(void *priv, unsigned int block_size, unsigned int total_blocks);
+	int (*raw)(void *priv, const void *data, size_t len, int64_t offset);
+	int (*fill)(void *priv, uint32_t fill_val, int64_t len, int64_t offset);
+	int (*skip)(void *priv, int64_t len, int64_t offset);
+};
+
+/**
+ * sparse_stream_new - create a push-style parser for the Android sparse format
+ *
+ * @callbacks - functions to call as chunks are parsed
+ * @priv - value that will be passed as the first argument to the callbacks
+ * @crc - verify the crc of the image if it has a crc chunk
+ *
+ * Creates a parser that is fed the bytes of a sparse file in order with
+ * sparse_stream_write, in pieces of any size, and calls back for each chunk as
+ * soon as its header arrives.  Unlike sparse_file_import the input doesn't
+ * need to be seekable or kept around, and the parser uses a fixed amount of
+ * memory regardless of the size of the image.
+ *
+ * Returns the parser, or NULL on error.
+ */
+struct sparse_stream *sparse_stream_new(
+		const struct sparse_stream_callbacks *callbacks, void *priv, bool crc);
+
+/**
+ * sparse_stream_write - feed bytes of a sparse file to a streaming parser
+ *
+ * @stream - streaming parser
+ * @data - next bytes of the sparse file
+ * @len - number of bytes in data
+ *
+ * Parses len bytes, calling the callbacks for any chunks or parts of raw
+ * chunks they complete.  Bytes after the last chunk are ignored.  Once an
+ * error has been returned every further call returns the same error.
+ *
+ * Returns 0 on success, negative errno on error.
+ */
+int sparse_stream_write(struct sparse_stream *stream, const void *data,
+		size_t len);
+
+/**
+ * sparse_stream_finish - check that a streaming parser saw a complete file
+ *
+ * @stream - streaming parser
+ *
+ * Call once the input has been exhausted.
+ *
+ * Returns 0 if every chunk was parsed, negative errno on error or if the
+ * input ended early.
+ */
+int sparse_stream_finish(struct sparse_stream *stream);
+
+/**
+ * sparse_stream_destroy - destroy a streaming parser
+ *
+ * @stream - streaming parser
+ */
+void sparse_stream_destroy(struct sparse_stream *stream);
+
 /**
  * sparse_file_verbose - set a sparse file cookie to print verbose errors
  *
@@ -41,6 +41,11 @@
 #define ftruncate64 ftruncate
 #endif
 
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
 #if defined(__APPLE__) && defined(__MACH__)
 #define lseek64 lseek
 #define ftruncate64 ftruncate
@@ -56,6 +61,10 @@
 #define SPARSE_HEADER_LEN       (sizeof(sparse_header_t))
 #define CHUNK_HEADER_LEN (sizeof(chunk_header_t))
 
+/* Largest single in-kernel copy; sendfile transfers at most 0x7ffff000 */
+#define COPY_CHUNK_MAX (1024 * 1024 * 1024)
+#define COPY_BUF_SIZE (64 * 1024)
+
 #define container_of(inner, outer_t, elem) \
 	((outer_t *)((char *)(inner) - offsetof(outer_t, elem)))
 
@@ -64,6 +73,9 @@ struct output_file_ops {
 	int (*skip)(struct output_file *, int64_t);
 	int (*pad)(struct output_file *, int64_t);
 	int (*write)(struct output_file *, void *, size_t);
+	/* Optional: copies len bytes at offset in fd to the output without
+	 * passing them through a user space buffer */
+	int (*copy)(struct output_file *, int fd, int64_t offset, size_t len);
 	void (*close)(struct output_file *);
 };
 
@@ -72,6 +84,8 @@ struct sparse_file_ops {
 			void *data);
 	int (*write_fill_chunk)(struct output_file *out, unsigned int len,
 			uint32_t fill_val);
+	int (*write_fd_chunk)(struct output_file *out, unsigned int len,
+			int fd, int64_t offset);
 	int (*write_skip_chunk)(struct output_file *out, int64_t len);
 	int (*write_end_chunk)(struct output_file *out);
 };
@@ -101,6 +115,8 @@ struct output_file_gz {
 struct output_file_normal {
 	struct output_file out;
 	int fd;
+	bool no_copy_file_range;
+	bool no_sendfile;
 };
 
 #define to_output_file_normal(_o) \
@@ -171,6 +187,103 @@ static int file_write(struct output_file *out, void *data, size_t len)
 	return 0;
 }
 
+#if defined(__linux__)
+/* Errors that mean the kernel can't do this kind of copy between these two
+ * files, rather than that the copy itself failed */
+static bool copy_unsupported(int err)
+{
+	return err == ENOSYS || err == EXDEV || err == EINVAL ||
+			err == EOPNOTSUPP || err == EBADF;
+}
+
+static int file_copy_buffered(struct output_file *out, int fd, int64_t offset,
+		size_t len)
+{
+	int ret = 0;
+	char *buf = malloc(min(len, (size_t)COPY_BUF_SIZE));
+	if (!buf) {
+		return -ENOMEM;
+	}
+
+	while (len > 0) {
+		size_t chunk = min(len, (size_t)COPY_BUF_SIZE);
+		ssize_t read_len = pread64(fd, buf, chunk, offset);
+		if (read_len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ret = -errno;
+			break;
+		} else if (read_len == 0) {
+			ret = -EINVAL;
+			break;
+		}
+
+		ret = file_write(out, buf, read_len);
+		if (ret < 0) {
+			break;
+		}
+
+		offset += read_len;
+		len -= read_len;
+	}
+
+	free(buf);
+	return ret;
+}
+
+static int file_copy(struct output_file *out, int fd, int64_t offset,
+		size_t len)
+{
+	ssize_t ret;
+	struct output_file_normal *outn = to_output_file_normal(out);
+
+	while (len > 0) {
+		size_t chunk = min(len, (size_t)COPY_CHUNK_MAX);
+
+		if (!outn->no_copy_file_range) {
+#if defined(__NR_copy_file_range)
+			off64_t in_offset = offset;
+			ret = syscall(__NR_copy_file_range, fd, &in_offset, outn->fd,
+					NULL, chunk, 0);
+#else
+			ret = -1;
+			errno = ENOSYS;
+#endif
+			if (ret < 0 && copy_unsupported(errno)) {
+				outn->no_copy_file_range = true;
+				continue;
+			}
+		} else if (!outn->no_sendfile) {
+			off64_t in_offset = offset;
+			ret = sendfile64(outn->fd, fd, &in_offset, chunk);
+			if (ret < 0 && copy_unsupported(errno)) {
+				outn->no_sendfile = true;
+				continue;
+			}
+		} else {
+			return file_copy_buffered(out, fd, offset, len);
+		}
+
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			error_errno("copy");
+			return -1;
+		} else if (ret == 0) {
+			/* The source is shorter than the backed block */
+			return -EINVAL;
+		}
+
+		offset += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+#endif
+
 static void file_close(struct output_file *out)
 {
 	struct output_file_normal *outn = to_output_file_normal(out);
@@ -183,6 +296,9 @@ static struct output_file_ops file_ops = {
 	.skip = file_skip,
 	.pad = file_pad,
 	.write = file_write,
+#if defined(__linux__)
+	.copy = file_copy,
+#endif
 	.close = file_close,
 };
 
@@ -446,6 +562,40 @@ static int write_sparse_data_chunk(struct output_file *out, unsigned int len,
 	return 0;
 }
 
+static int write_sparse_fd_chunk(struct output_file *out, unsigned int len,
+		int fd, int64_t offset)
+{
+	chunk_header_t chunk_header;
+	int rnd_up_len, zero_len;
+	int ret;
+
+	/* Round up the data length to a multiple of the block size */
+	rnd_up_len = ALIGN(len, out->block_size);
+	zero_len = rnd_up_len - len;
+
+	chunk_header.chunk_type = CHUNK_TYPE_RAW;
+	chunk_header.reserved1 = 0;
+	chunk_header.chunk_sz = rnd_up_len / out->block_size;
+	chunk_header.total_sz = CHUNK_HEADER_LEN + rnd_up_len;
+	ret = out->ops->write(out, &chunk_header, sizeof(chunk_header));
+
+	if (ret < 0)
+		return -1;
+	ret = out->ops->copy(out, fd, offset, len);
+	if (ret < 0)
+		return -1;
+	if (zero_len) {
+		ret = out->ops->write(out, out->zero_buf, zero_len);
+		if (ret < 0)
+			return -1;
+	}
+
+	out->cur_out_ptr += rnd_up_len;
+	out->chunk_cnt++;
+
+	return 0;
+}
+
 int write_sparse_end_chunk(struct output_file *out)
 {
 	chunk_header_t chunk_header;
@@ -475,6 +625,7 @@ int write_sparse_end_chunk(struct output_file *out)
 static struct sparse_file_ops sparse_file_ops = {
 		.write_data_chunk = write_sparse_data_chunk,
 		.write_fill_chunk = write_sparse_fill_chunk,
+		.write_fd_chunk = write_sparse_fd_chunk,
 		.write_skip_chunk = write_sparse_skip_chunk,
 		.write_end_chunk = write_sparse_end_chunk,
 };
@@ -497,6 +648,24 @@ static int write_normal_data_chunk(struct output_file *out, unsigned int len,
 	return ret;
 }
 
+static int write_normal_fd_chunk(struct output_file *out, unsigned int len,
+		int fd, int64_t offset)
+{
+	int ret;
+	unsigned int rnd_up_len = ALIGN(len, out->block_size);
+
+	ret = out->ops->copy(out, fd, offset, len);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (rnd_up_len > len) {
+		ret = out->ops->skip(out, rnd_up_len - len);
+	}
+
+	return ret;
+}
+
 static int write_normal_fill_chunk(struct output_file *out, unsigned int len,
 		uint32_t fill_val)
 {
@@ -535,6 +704,7 @@ int write_normal_end_chunk(struct output_file *out)
 static struct sparse_file_ops normal_file_ops = {
 		.write_data_chunk = write_normal_data_chunk,
 		.write_fill_chunk = write_normal_fill_chunk,
+		.write_fd_chunk = write_normal_fd_chunk,
 		.write_skip_chunk = write_normal_skip_chunk,
 		.write_end_chunk = write_normal_end_chunk,
 };
@@ -708,6 +878,11 @@ int write_fd_chunk(struct output_file *out, unsigned int len,
 	uint64_t buffer_size;
 	char *ptr;
 
+	/* Let the kernel move the data when nothing needs to see it on the way */
+	if (out->ops->copy && !out->use_crc) {
+		return out->sparse_ops->write_fd_chunk(out, len, fd, offset);
+	}
+
 	aligned_offset = offset & ~(4096 - 1);
 	aligned_diff = offset - aligned_offset;
 	buffer_size = (uint64_t)len + (uint64_t)aligned_diff;
@@ -43,7 +43,20 @@
  */
 
 /* Code taken from FreeBSD 8 */
+#include <limits.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <zlib.h>
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <arm_acle.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+#include "sparse_crc32.h"
 
 static uint32_t crc32_tab[] = {
         0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
@@ -92,13 +105,9 @@ static uint32_t crc32_tab[] = {
 };
 
 /*
- * A function that calculates the CRC-32 based on the table above is
- * given below for documentation purposes. An equivalent implementation
- * of this function that's actually used in the kernel can be found
- * in sys/libkern.h, where it can be inlined.
+ * Byte at a time implementation using the table above.
  */
-
-uint32_t sparse_crc32(uint32_t crc_in, const void *buf, int size)
+static uint32_t sparse_crc32_table(uint32_t crc_in, const void *buf, size_t size)
 {
         const uint8_t *p = buf;
         uint32_t crc;
@@ -109,3 +118,86 @@ uint32_t sparse_crc32(uint32_t crc_in, const void *buf, int size)
         return crc ^ ~0U;
 }
 
+#if defined(__aarch64__) && defined(__linux__)
+/*
+ * The ARMv8 CRC32 instructions implement this same polynomial.  They are
+ * optional before ARMv8.1, so use them only if the kernel reports them.
+ */
+__attribute__((target("crc")))
+static uint32_t sparse_crc32_armv8(uint32_t crc_in, const void *buf, size_t size)
+{
+        const uint8_t *p = buf;
+        uint32_t crc;
+
+        crc = crc_in ^ ~0U;
+        while (size && ((uintptr_t)p & 7)) {
+                crc = __crc32b(crc, *p++);
+                size--;
+        }
+        while (size >= 32) {
+                crc = __crc32d(crc, *(const uint64_t *)p);
+                crc = __crc32d(crc, *(const uint64_t *)(p + 8));
+                crc = __crc32d(crc, *(const uint64_t *)(p + 16));
+                crc = __crc32d(crc, *(const uint64_t *)(p + 24));
+                p += 32;
+                size -= 32;
+        }
+        while (size >= 8) {
+                crc = __crc32d(crc, *(const uint64_t *)p);
+                p += 8;
+                size -= 8;
+        }
+        while (size--)
+                crc = __crc32b(crc, *p++);
+        return crc ^ ~0U;
+}
+#endif
+
+/*
+ * zlib computes the same CRC-32 a word at a time, and builds of zlib that
+ * have been accelerated (PCLMULQDQ on x86, the CRC32 instructions on ARM)
+ * pick that up transparently.
+ */
+static uint32_t sparse_crc32_zlib(uint32_t crc_in, const void *buf, size_t size)
+{
+        const Bytef *p = buf;
+        uLong crc = crc_in;
+
+        while (size > 0) {
+                uInt len = size > UINT_MAX ? UINT_MAX : (uInt)size;
+                crc = crc32(crc, p, len);
+                p += len;
+                size -= len;
+        }
+        return crc;
+}
+
+#if defined(__aarch64__) && defined(__linux__)
+static bool have_armv8_crc32;
+
+static void sparse_crc32_init(void)
+{
+        have_armv8_crc32 = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+#endif
+
+/*
+ * Buffers shorter than this, like the single fill words output_file.c adds,
+ * are cheaper to do through the table than through a call into zlib.
+ */
+#define SPARSE_CRC32_SHORT 16
+
+uint32_t sparse_crc32(uint32_t crc_in, const void *buf, size_t size)
+{
+        if (size < SPARSE_CRC32_SHORT)
+                return sparse_crc32_table(crc_in, buf, size);
+
+#if defined(__aarch64__) && defined(__linux__)
+        static pthread_once_t once = PTHREAD_ONCE_INIT;
+        pthread_once(&once, sparse_crc32_init);
+        if (have_armv8_crc32)
+                return sparse_crc32_armv8(crc_in, buf, size);
+#endif
+
+        return sparse_crc32_zlib(crc_in, buf, size);
+}
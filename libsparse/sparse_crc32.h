@@ -17,6 +17,7 @@
 #ifndef _LIBSPARSE_SPARSE_CRC32_H_
 #define _LIBSPARSE_SPARSE_CRC32_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
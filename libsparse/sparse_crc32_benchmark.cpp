@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "sparse_crc32.h"
+
+static std::vector<uint8_t> MakeData(size_t size) {
+  std::vector<uint8_t> data(size);
+  srand(size);
+  for (auto& byte : data) {
+    byte = rand();
+  }
+  return data;
+}
+
+// The byte at a time loop sparse_crc32() used before it dispatched to faster
+// implementations, as a baseline.
+static uint32_t ReferenceCrc32(uint32_t crc, const uint8_t* p, size_t size) {
+  static uint32_t table[256];
+  if (table[1] == 0) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+  }
+
+  crc = ~crc;
+  while (size--) {
+    crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void BM_sparse_crc32(benchmark::State& state) {
+  std::vector<uint8_t> data = MakeData(state.range(0));
+  if (sparse_crc32(0, data.data(), data.size()) != ReferenceCrc32(0, data.data(), data.size())) {
+    state.SkipWithError("sparse_crc32 disagrees with the reference implementation");
+    return;
+  }
+
+  uint32_t crc = 0;
+  while (state.KeepRunning()) {
+    crc = sparse_crc32(crc, data.data(), data.size());
+  }
+  benchmark::DoNotOptimize(crc);
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_sparse_crc32)->Arg(4096)->Arg(1024 * 1024)->Arg(64 * 1024 * 1024);
+
+static void BM_reference_crc32(benchmark::State& state) {
+  std::vector<uint8_t> data = MakeData(state.range(0));
+
+  uint32_t crc = 0;
+  while (state.KeepRunning()) {
+    crc = ReferenceCrc32(crc, data.data(), data.size());
+  }
+  benchmark::DoNotOptimize(crc);
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_reference_crc32)->Arg(4096)->Arg(1024 * 1024)->Arg(64 * 1024 * 1024);
+
+BENCHMARK_MAIN();
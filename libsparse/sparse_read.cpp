@@ -18,18 +18,25 @@
 #define _LARGEFILE64_SOURCE 1
 
 #include <algorithm>
+#include <atomic>
+#include <errno.h>
 #include <inttypes.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
 #include <sparse/sparse.h>
 
+#include "android-base/macros.h"
 #include "android-base/stringprintf.h"
 #include "defs.h"
 #include "output_file.h"
@@ -41,6 +48,7 @@
 #if defined(__APPLE__) && defined(__MACH__)
 #define lseek64 lseek
 #define off64_t off_t
+#define pread64 pread
 #endif
 
 #define SPARSE_HEADER_MAJOR_VER 1
@@ -329,55 +337,182 @@ static int sparse_file_read_sparse(struct sparse_file *s, int fd, bool crc)
 	return 0;
 }
 
+/* Returns true if every 32-bit word of the block matches the first one.  This
+ * is the same as the block matching itself shifted by one word, which lets the
+ * C library's vectorized memcmp do the comparison. */
+static bool block_is_fill(const uint32_t *buf, unsigned int words)
+{
+	return memcmp(buf, buf + 1, (words - 1) * sizeof(uint32_t)) == 0;
+}
+
+static int read_at(int fd, void *buf, size_t len, int64_t offset)
+{
+#if defined(_WIN32)
+	if (lseek64(fd, offset, SEEK_SET) < 0) {
+		return -errno;
+	}
+	return read_all(fd, buf, len);
+#else
+	char *ptr = (char *)buf;
+
+	while (len > 0) {
+		ssize_t ret = TEMP_FAILURE_RETRY(pread64(fd, ptr, len, offset));
+		if (ret < 0) {
+			return -errno;
+		} else if (ret == 0) {
+			return -EINVAL;
+		}
+		ptr += ret;
+		len -= ret;
+		offset += ret;
+	}
+
+	return 0;
+#endif
+}
+
+/* Classification of one block of a normal image, filled in by the scan and
+ * consumed in block order when the backed blocks are queued. */
+struct normal_block {
+	bool fill;
+	uint32_t fill_val;
+};
+
+/* Classifies blocks [first, first + count) of the image, reading them in one
+ * go into buf, which must hold count blocks. */
+static int classify_blocks(struct sparse_file *s, int fd, unsigned int first,
+		unsigned int count, uint32_t *buf, struct normal_block *blocks)
+{
+	int64_t offset = (int64_t)first * s->block_size;
+	int64_t len = std::min(s->len - offset, (int64_t)count * s->block_size);
+	unsigned int words = s->block_size / sizeof(uint32_t);
+	int ret;
+
+	ret = read_at(fd, buf, len, offset);
+	if (ret < 0) {
+		return ret;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		const uint32_t *block_buf = buf + (size_t)i * words;
+		/* A trailing partial block is always stored as data */
+		blocks[i].fill = (int64_t)(i + 1) * s->block_size <= len &&
+				block_is_fill(block_buf, words);
+		blocks[i].fill_val = block_buf[0];
+	}
+
+	return 0;
+}
+
+/* Scans the image for fill blocks.  The scan is split into batches of
+ * READ_NORMAL_BATCH_SIZE bytes that are handed out to up to
+ * READ_NORMAL_MAX_THREADS workers, each reading with its own positional reads,
+ * so large images are read and compared on all cores at once.  Batches are
+ * kept small enough that each one is still in cache when it is compared. */
+static constexpr int64_t READ_NORMAL_BATCH_SIZE = 256 * 1024;
+static constexpr unsigned int READ_NORMAL_MAX_THREADS = 8;
+
+static int scan_normal_blocks(struct sparse_file *s, int fd,
+		unsigned int block_count, struct normal_block *blocks)
+{
+	unsigned int batch_blocks = std::max<int64_t>(1,
+			READ_NORMAL_BATCH_SIZE / s->block_size);
+	unsigned int batch_count = DIV_ROUND_UP(block_count, batch_blocks);
+	std::atomic<unsigned int> next_batch(0);
+	std::atomic<int> err(0);
+
+	auto worker = [&]() {
+		uint32_t *buf = (uint32_t *)malloc((size_t)batch_blocks * s->block_size);
+		if (!buf) {
+			err = -ENOMEM;
+			return;
+		}
+
+		unsigned int batch;
+		while (err == 0 && (batch = next_batch++) < batch_count) {
+			unsigned int first = batch * batch_blocks;
+			unsigned int count = std::min(batch_blocks, block_count - first);
+			int ret = classify_blocks(s, fd, first, count, buf, blocks + first);
+			if (ret < 0) {
+				int expected = 0;
+				err.compare_exchange_strong(expected, ret);
+			}
+		}
+
+		free(buf);
+	};
+
+	unsigned int num_threads = 1;
+#if !defined(_WIN32)
+	num_threads = std::min({std::max(1u, std::thread::hardware_concurrency()),
+			READ_NORMAL_MAX_THREADS, batch_count});
+#endif
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < num_threads; i++) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	return err;
+}
+
 static int sparse_file_read_normal(struct sparse_file *s, int fd)
 {
 	int ret;
-	uint32_t *buf = (uint32_t *)malloc(s->block_size);
-	unsigned int block = 0;
-	int64_t remain = s->len;
-	int64_t offset = 0;
-	unsigned int to_read;
-	unsigned int i;
-	bool sparse_block;
+	unsigned int block_count = DIV_ROUND_UP(s->len, s->block_size);
+	/* Keep queued runs well within the unsigned byte length of a backed block */
+	unsigned int max_run = (UINT_MAX / 2) / s->block_size;
+	unsigned int block;
+	unsigned int run;
 
-	if (!buf) {
+	if (block_count == 0) {
+		return 0;
+	}
+
+	struct normal_block *blocks = (struct normal_block *)malloc(
+			(size_t)block_count * sizeof(struct normal_block));
+	if (!blocks) {
 		return -ENOMEM;
 	}
 
-	while (remain > 0) {
-		to_read = std::min(remain, (int64_t)(s->block_size));
-		ret = read_all(fd, buf, to_read);
-		if (ret < 0) {
-			error("failed to read sparse file");
-			free(buf);
-			return ret;
-		}
+	ret = scan_normal_blocks(s, fd, block_count, blocks);
+	if (ret < 0) {
+		error("failed to read sparse file");
+		free(blocks);
+		return ret;
+	}
 
-		if (to_read == s->block_size) {
-			sparse_block = true;
-			for (i = 1; i < s->block_size / sizeof(uint32_t); i++) {
-				if (buf[0] != buf[i]) {
-					sparse_block = false;
-					break;
-				}
+	/* Queue runs of identical blocks in order, so the backed block list is
+	 * appended to rather than searched and merged one block at a time */
+	for (block = 0; block < block_count; block += run) {
+		const struct normal_block *first = &blocks[block];
+		for (run = 1; block + run < block_count && run < max_run; run++) {
+			const struct normal_block *next = &blocks[block + run];
+			if (next->fill != first->fill ||
+					(first->fill && next->fill_val != first->fill_val)) {
+				break;
 			}
-		} else {
-			sparse_block = false;
 		}
 
-		if (sparse_block) {
-			/* TODO: add flag to use skip instead of fill for buf[0] == 0 */
-			sparse_file_add_fill(s, buf[0], to_read, block);
+		int64_t offset = (int64_t)block * s->block_size;
+		unsigned int len = std::min(s->len - offset, (int64_t)run * s->block_size);
+		if (first->fill) {
+			/* TODO: add flag to use skip instead of fill for fill_val == 0 */
+			ret = sparse_file_add_fill(s, first->fill_val, len, block);
 		} else {
-			sparse_file_add_fd(s, fd, offset, to_read, block);
+			ret = sparse_file_add_fd(s, fd, offset, len, block);
+		}
+		if (ret < 0) {
+			free(blocks);
+			return ret;
 		}
-
-		remain -= to_read;
-		offset += to_read;
-		block++;
 	}
 
-	free(buf);
+	free(blocks);
 	return 0;
 }
 
@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sparse/sparse.h>
+
+#include "sparse_crc32.h"
+#include "sparse_format.h"
+
+#define SPARSE_HEADER_MAJOR_VER 1
+#define SPARSE_HEADER_LEN       (sizeof(sparse_header_t))
+#define CHUNK_HEADER_LEN (sizeof(chunk_header_t))
+
+#define CRC_BUF_SIZE 4096
+
+#define min(a, b) \
+	({ typeof(a) _a = (a); typeof(b) _b = (b); (_a < _b) ? _a : _b; })
+
+enum sparse_stream_state {
+	STREAM_FILE_HEADER,
+	STREAM_CHUNK_HEADER,
+	STREAM_RAW_DATA,
+	STREAM_FILL_DATA,
+	STREAM_CRC32_DATA,
+	STREAM_DONE,
+};
+
+struct sparse_stream {
+	const struct sparse_stream_callbacks *callbacks;
+	void *priv;
+	bool use_crc;
+	uint32_t crc32;
+	int error;
+
+	enum sparse_stream_state state;
+	sparse_header_t sparse_header;
+	chunk_header_t chunk_header;
+
+	/* Fixed size structure being assembled from the input */
+	union {
+		sparse_header_t sparse_header;
+		chunk_header_t chunk_header;
+		uint32_t val;
+	} collect;
+	size_t collected;
+
+	/* Bytes of an oversized header still to be dropped */
+	size_t discard;
+
+	unsigned int chunks_done;
+	unsigned int cur_block;
+	int64_t offset;
+	int64_t raw_remain;
+
+	/* Expanded fill or skip data, used only to compute the crc */
+	uint32_t crc_buf[CRC_BUF_SIZE / sizeof(uint32_t)];
+};
+
+struct sparse_stream *sparse_stream_new(
+		const struct sparse_stream_callbacks *callbacks, void *priv, bool crc)
+{
+	struct sparse_stream *stream = calloc(1, sizeof(struct sparse_stream));
+	if (!stream) {
+		return NULL;
+	}
+
+	stream->callbacks = callbacks;
+	stream->priv = priv;
+	stream->use_crc = crc;
+	stream->state = STREAM_FILE_HEADER;
+
+	return stream;
+}
+
+void sparse_stream_destroy(struct sparse_stream *stream)
+{
+	free(stream);
+}
+
+/* Copies input into stream->collect until it holds want bytes.  Returns true
+ * once the structure is complete. */
+static bool collect(struct sparse_stream *stream, const uint8_t **data,
+		size_t *len, size_t want)
+{
+	size_t n = min(want - stream->collected, *len);
+
+	memcpy((uint8_t *)&stream->collect + stream->collected, *data, n);
+	stream->collected += n;
+	*data += n;
+	*len -= n;
+
+	if (stream->collected < want) {
+		return false;
+	}
+
+	stream->collected = 0;
+	return true;
+}
+
+/* Adds len bytes of the repeated value val to the crc */
+static void crc_repeated(struct sparse_stream *stream, uint32_t val,
+		int64_t len)
+{
+	unsigned int i;
+
+	for (i = 0; i < CRC_BUF_SIZE / sizeof(uint32_t); i++) {
+		stream->crc_buf[i] = val;
+	}
+
+	while (len) {
+		int64_t chunk = min(len, (int64_t)CRC_BUF_SIZE);
+		stream->crc32 = sparse_crc32(stream->crc32, stream->crc_buf, chunk);
+		len -= chunk;
+	}
+}
+
+static int next_chunk(struct sparse_stream *stream)
+{
+	stream->chunks_done++;
+	if (stream->chunks_done < stream->sparse_header.total_chunks) {
+		stream->state = STREAM_CHUNK_HEADER;
+		return 0;
+	}
+
+	if (stream->cur_block != stream->sparse_header.total_blks) {
+		return -EINVAL;
+	}
+
+	stream->state = STREAM_DONE;
+	return 0;
+}
+
+static int process_file_header(struct sparse_stream *stream)
+{
+	sparse_header_t *sparse_header = &stream->sparse_header;
+
+	*sparse_header = stream->collect.sparse_header;
+
+	if (sparse_header->magic != SPARSE_HEADER_MAGIC) {
+		return -EINVAL;
+	}
+
+	if (sparse_header->major_version != SPARSE_HEADER_MAJOR_VER) {
+		return -EINVAL;
+	}
+
+	if (sparse_header->file_hdr_sz < SPARSE_HEADER_LEN) {
+		return -EINVAL;
+	}
+
+	if (sparse_header->chunk_hdr_sz < CHUNK_HEADER_LEN) {
+		return -EINVAL;
+	}
+
+	if (sparse_header->blk_sz == 0 || sparse_header->blk_sz % 4) {
+		return -EINVAL;
+	}
+
+	/* Skip the remaining bytes in a header that is longer than we expected */
+	stream->discard = sparse_header->file_hdr_sz - SPARSE_HEADER_LEN;
+
+	if (stream->callbacks->header) {
+		int ret = stream->callbacks->header(stream->priv, sparse_header->blk_sz,
+				sparse_header->total_blks);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	stream->state = STREAM_CHUNK_HEADER;
+	stream->chunks_done = 0;
+	if (sparse_header->total_chunks == 0) {
+		/* next_chunk() counts a chunk, so check the empty image directly */
+		if (sparse_header->total_blks != 0) {
+			return -EINVAL;
+		}
+		stream->state = STREAM_DONE;
+	}
+
+	return 0;
+}
+
+static int process_chunk_header(struct sparse_stream *stream)
+{
+	chunk_header_t *chunk_header = &stream->chunk_header;
+	unsigned int block_size = stream->sparse_header.blk_sz;
+	unsigned int chunk_data_size;
+	int64_t len;
+	int ret;
+
+	*chunk_header = stream->collect.chunk_header;
+
+	if (chunk_header->total_sz < stream->sparse_header.chunk_hdr_sz) {
+		return -EINVAL;
+	}
+	chunk_data_size = chunk_header->total_sz - stream->sparse_header.chunk_hdr_sz;
+
+	/* Skip the remaining bytes in a header that is longer than we expected */
+	stream->discard = stream->sparse_header.chunk_hdr_sz - CHUNK_HEADER_LEN;
+
+	if (chunk_header->chunk_type != CHUNK_TYPE_CRC32 &&
+			chunk_header->chunk_sz >
+			stream->sparse_header.total_blks - stream->cur_block) {
+		return -EINVAL;
+	}
+	len = (int64_t)chunk_header->chunk_sz * block_size;
+
+	switch (chunk_header->chunk_type) {
+	case CHUNK_TYPE_RAW:
+		if (chunk_data_size != len) {
+			return -EINVAL;
+		}
+		stream->raw_remain = len;
+		stream->state = STREAM_RAW_DATA;
+		if (len == 0) {
+			return next_chunk(stream);
+		}
+		return 0;
+	case CHUNK_TYPE_FILL:
+		if (chunk_data_size != sizeof(uint32_t)) {
+			return -EINVAL;
+		}
+		stream->state = STREAM_FILL_DATA;
+		return 0;
+	case CHUNK_TYPE_DONT_CARE:
+		if (chunk_data_size != 0) {
+			return -EINVAL;
+		}
+		if (stream->callbacks->skip) {
+			ret = stream->callbacks->skip(stream->priv, len, stream->offset);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+		if (stream->use_crc) {
+			crc_repeated(stream, 0, len);
+		}
+		stream->cur_block += chunk_header->chunk_sz;
+		stream->offset += len;
+		return next_chunk(stream);
+	case CHUNK_TYPE_CRC32:
+		if (chunk_data_size != sizeof(uint32_t)) {
+			return -EINVAL;
+		}
+		stream->state = STREAM_CRC32_DATA;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int process_raw_data(struct sparse_stream *stream, const uint8_t **data,
+		size_t *len)
+{
+	size_t n = min((int64_t)*len, stream->raw_remain);
+	int ret;
+
+	if (stream->callbacks->raw) {
+		ret = stream->callbacks->raw(stream->priv, *data, n, stream->offset);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	if (stream->use_crc) {
+		stream->crc32 = sparse_crc32(stream->crc32, *data, n);
+	}
+
+	*data += n;
+	*len -= n;
+	stream->offset += n;
+	stream->raw_remain -= n;
+
+	if (stream->raw_remain == 0) {
+		stream->cur_block += stream->chunk_header.chunk_sz;
+		return next_chunk(stream);
+	}
+
+	return 0;
+}
+
+static int process_fill_data(struct sparse_stream *stream)
+{
+	uint32_t fill_val = stream->collect.val;
+	int64_t len = (int64_t)stream->chunk_header.chunk_sz *
+			stream->sparse_header.blk_sz;
+	int ret;
+
+	if (stream->callbacks->fill) {
+		ret = stream->callbacks->fill(stream->priv, fill_val, len,
+				stream->offset);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	if (stream->use_crc) {
+		crc_repeated(stream, fill_val, len);
+	}
+
+	stream->cur_block += stream->chunk_header.chunk_sz;
+	stream->offset += len;
+	return next_chunk(stream);
+}
+
+static int process_crc32_data(struct sparse_stream *stream)
+{
+	if (stream->use_crc && stream->collect.val != stream->crc32) {
+		return -EINVAL;
+	}
+
+	return next_chunk(stream);
+}
+
+int sparse_stream_write(struct sparse_stream *stream, const void *data,
+		size_t len)
+{
+	const uint8_t *ptr = data;
+	int ret = 0;
+
+	if (stream->error) {
+		return stream->error;
+	}
+
+	while (len > 0 && stream->state != STREAM_DONE) {
+		if (stream->discard) {
+			size_t n = min(stream->discard, len);
+			stream->discard -= n;
+			ptr += n;
+			len -= n;
+			continue;
+		}
+
+		switch (stream->state) {
+		case STREAM_FILE_HEADER:
+			if (collect(stream, &ptr, &len, SPARSE_HEADER_LEN)) {
+				ret = process_file_header(stream);
+			}
+			break;
+		case STREAM_CHUNK_HEADER:
+			if (collect(stream, &ptr, &len, CHUNK_HEADER_LEN)) {
+				ret = process_chunk_header(stream);
+			}
+			break;
+		case STREAM_RAW_DATA:
+			ret = process_raw_data(stream, &ptr, &len);
+			break;
+		case STREAM_FILL_DATA:
+			if (collect(stream, &ptr, &len, sizeof(uint32_t))) {
+				ret = process_fill_data(stream);
+			}
+			break;
+		case STREAM_CRC32_DATA:
+			if (collect(stream, &ptr, &len, sizeof(uint32_t))) {
+				ret = process_crc32_data(stream);
+			}
+			break;
+		case STREAM_DONE:
+			break;
+		}
+
+		if (ret < 0) {
+			stream->error = ret;
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+int sparse_stream_finish(struct sparse_stream *stream)
+{
+	if (stream->error) {
+		return stream->error;
+	}
+
+	if (stream->state != STREAM_DONE) {
+		/* The input ended before the last chunk */
+		return -EINVAL;
+	}
+
+	return 0;
+}
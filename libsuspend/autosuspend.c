@@ -98,3 +98,16 @@ int autosuspend_disable(void)
     autosuspend_enabled = false;
     return 0;
 }
+
+int autosuspend_get_stats(struct autosuspend_stats *stats)
+{
+    int ret;
+
+    ret = autosuspend_init();
+    if (ret) {
+        return ret;
+    }
+
+    autosuspend_ops->get_stats(stats);
+    return 0;
+}
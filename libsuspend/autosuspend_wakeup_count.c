@@ -27,16 +27,30 @@
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <log/log.h>
 
+#include <suspend/autosuspend.h>
+
 #include "autosuspend_ops.h"
 
 #define SYS_POWER_STATE "/sys/power/state"
 #define SYS_POWER_WAKEUP_COUNT "/sys/power/wakeup_count"
 
 #define BASE_SLEEP_TIME 100000
+#define MAX_SLEEP_TIME 60000000
+// wakeup events racing the suspend request are retried at the base sleep
+// time this many times in a row before backing off
+#define MAX_FAST_RETRIES 16
+
+enum suspend_result {
+    SUSPEND_SUCCESS,
+    SUSPEND_ERROR,      // wakeup_count could not be read
+    SUSPEND_RACE,       // a wakeup event arrived before suspend was requested
+    SUSPEND_ABORTED,    // suspend was refused or aborted by the kernel
+};
 
 static int state_fd;
 static int wakeup_count_fd;
@@ -45,14 +59,59 @@ static sem_t suspend_lockout;
 static const char *sleep_state = "mem";
 static void (*wakeup_func)(bool success) = NULL;
 static int sleep_time = BASE_SLEEP_TIME;
+static int fast_retries;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct autosuspend_stats stats;
+
+static uint64_t now_us(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-static void update_sleep_time(bool success) {
-    if (success) {
+// A race means a wakeup event was reported and handled, the next read of
+// wakeup_count blocks until no events are in progress, so retrying promptly
+// suspends as soon as the system is idle again. Anything else is backed off
+// exponentially, as is a wakeup source that keeps firing.
+static void update_sleep_time(enum suspend_result result) {
+    if (result == SUSPEND_SUCCESS) {
         sleep_time = BASE_SLEEP_TIME;
-        return;
+        fast_retries = 0;
+    } else if (result == SUSPEND_RACE && fast_retries < MAX_FAST_RETRIES) {
+        sleep_time = BASE_SLEEP_TIME;
+        fast_retries++;
+    } else {
+        // double sleep time after each failure up to one minute
+        sleep_time = MIN(sleep_time * 2, MAX_SLEEP_TIME);
+    }
+
+    pthread_mutex_lock(&stats_lock);
+    stats.sleep_time_us = sleep_time;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static void update_stats(enum suspend_result result, uint64_t latency_us,
+                         uint64_t suspended_us) {
+    pthread_mutex_lock(&stats_lock);
+    stats.attempts++;
+    switch (result) {
+    case SUSPEND_SUCCESS:
+        stats.successes++;
+        stats.total_suspended_us += suspended_us;
+        break;
+    case SUSPEND_ERROR:
+        stats.errors++;
+        break;
+    case SUSPEND_RACE:
+        stats.wakeup_races++;
+        break;
+    case SUSPEND_ABORTED:
+        stats.aborts++;
+        break;
     }
-    // double sleep time after each failure up to one minute
-    sleep_time = MIN(sleep_time * 2, 60000000);
+    stats.total_latency_us += latency_us;
+    stats.max_latency_us = MAX(stats.max_latency_us, latency_us);
+    pthread_mutex_unlock(&stats_lock);
 }
 
 static void *suspend_thread_func(void *arg __attribute__((unused)))
@@ -61,12 +120,13 @@ static void *suspend_thread_func(void *arg __attribute__((unused)))
     char wakeup_count[20];
     int wakeup_count_len;
     int ret;
-    bool success = true;
+    enum suspend_result result = SUSPEND_SUCCESS;
+    uint64_t start, requested, boot_requested, suspended;
 
     while (1) {
-        update_sleep_time(success);
+        update_sleep_time(result);
         usleep(sleep_time);
-        success = false;
+        result = SUSPEND_ERROR;
         ALOGV("%s: read wakeup_count\n", __func__);
         lseek(wakeup_count_fd, 0, SEEK_SET);
         wakeup_count_len = TEMP_FAILURE_RETRY(read(wakeup_count_fd, wakeup_count,
@@ -75,10 +135,12 @@ static void *suspend_thread_func(void *arg __attribute__((unused)))
             strerror_r(errno, buf, sizeof(buf));
             ALOGE("Error reading from %s: %s\n", SYS_POWER_WAKEUP_COUNT, buf);
             wakeup_count_len = 0;
+            update_stats(result, 0, 0);
             continue;
         }
         if (!wakeup_count_len) {
             ALOGE("Empty wakeup count\n");
+            update_stats(result, 0, 0);
             continue;
         }
 
@@ -90,22 +152,37 @@ static void *suspend_thread_func(void *arg __attribute__((unused)))
             continue;
         }
 
+        // latency runs from autosuspend being enabled with the wakeup count
+        // known to the suspend request, or to the request being abandoned
+        start = now_us(CLOCK_MONOTONIC);
+        suspended = 0;
         ALOGV("%s: write %*s to wakeup_count\n", __func__, wakeup_count_len, wakeup_count);
         ret = TEMP_FAILURE_RETRY(write(wakeup_count_fd, wakeup_count, wakeup_count_len));
         if (ret < 0) {
+            // expected whenever a wakeup event arrived after the read
             strerror_r(errno, buf, sizeof(buf));
-            ALOGE("Error writing to %s: %s\n", SYS_POWER_WAKEUP_COUNT, buf);
+            ALOGV("Error writing to %s: %s\n", SYS_POWER_WAKEUP_COUNT, buf);
+            result = SUSPEND_RACE;
+            requested = now_us(CLOCK_MONOTONIC);
         } else {
             ALOGV("%s: write %s to %s\n", __func__, sleep_state, SYS_POWER_STATE);
+            boot_requested = now_us(CLOCK_BOOTTIME);
+            requested = now_us(CLOCK_MONOTONIC);
             ret = TEMP_FAILURE_RETRY(write(state_fd, sleep_state, strlen(sleep_state)));
             if (ret >= 0) {
-                success = true;
+                result = SUSPEND_SUCCESS;
+                // CLOCK_MONOTONIC stops while suspended, CLOCK_BOOTTIME does not
+                suspended = (now_us(CLOCK_BOOTTIME) - boot_requested) -
+                        (now_us(CLOCK_MONOTONIC) - requested);
+            } else {
+                result = SUSPEND_ABORTED;
             }
             void (*func)(bool success) = wakeup_func;
             if (func != NULL) {
-                (*func)(success);
+                (*func)(result == SUSPEND_SUCCESS);
             }
         }
+        update_stats(result, requested - start, suspended);
 
         ALOGV("%s: release sem\n", __func__);
         ret = sem_post(&suspend_lockout);
@@ -155,6 +232,13 @@ static int autosuspend_wakeup_count_disable(void)
     return ret;
 }
 
+static void autosuspend_wakeup_count_get_stats(struct autosuspend_stats *out)
+{
+    pthread_mutex_lock(&stats_lock);
+    *out = stats;
+    pthread_mutex_unlock(&stats_lock);
+}
+
 void set_wakeup_callback(void (*func)(bool success))
 {
     if (wakeup_func != NULL) {
@@ -167,6 +251,7 @@ void set_wakeup_callback(void (*func)(bool success))
 struct autosuspend_ops autosuspend_wakeup_count_ops = {
         .enable = autosuspend_wakeup_count_enable,
         .disable = autosuspend_wakeup_count_disable,
+        .get_stats = autosuspend_wakeup_count_get_stats,
 };
 
 struct autosuspend_ops *autosuspend_wakeup_count_init(void)
@@ -19,6 +19,7 @@
 
 #include <sys/cdefs.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 __BEGIN_DECLS
 
@@ -53,6 +54,35 @@ int autosuspend_disable(void);
  */
 void set_wakeup_callback(void (*func)(bool success));
 
+/*
+ * Counters describing the suspend attempts made since autosuspend was
+ * initialized, for power tuning. An attempt is one pass of the suspend
+ * loop; it ends in a success, an error reading the wakeup count, a wakeup
+ * event racing the suspend request, or the kernel aborting suspend.
+ * Latency runs from autosuspend being enabled with no wakeup event in
+ * progress to suspend being requested.
+ */
+struct autosuspend_stats {
+    uint64_t attempts;
+    uint64_t successes;
+    uint64_t errors;
+    uint64_t wakeup_races;
+    uint64_t aborts;
+    uint64_t total_latency_us;
+    uint64_t max_latency_us;
+    uint64_t total_suspended_us;    /* time spent suspended */
+    uint32_t sleep_time_us;         /* current delay between attempts */
+};
+
+/*
+ * autosuspend_get_stats
+ *
+ * Fill in stats with the suspend attempt counters.
+ *
+ * Returns 0 on success, -1 if autosuspend could not be initialized.
+ */
+int autosuspend_get_stats(struct autosuspend_stats *stats);
+
 __END_DECLS
 
 #endif
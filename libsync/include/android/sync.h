@@ -37,6 +37,8 @@
  * break builds.
  */
 
+#include <stddef.h>
+
 #include "../ndk/sync.h"
 
 __BEGIN_DECLS
@@ -59,6 +61,22 @@ struct sync_pt_info {
 
 /* timeout in msecs */
 int sync_wait(int fd, int timeout);
+
+#define SYNC_WAIT_ALL 0
+#define SYNC_WAIT_ANY 1
+
+/* Waits on count fences in a single poll loop instead of one sync_wait per
+ * fence. With SYNC_WAIT_ALL, returns 0 once every fence has signaled. With
+ * SYNC_WAIT_ANY, returns the index of a signaled fence as soon as there is
+ * one. The timeout in msecs covers the whole call. On failure returns -1 with
+ * errno set like sync_wait: ETIME on timeout, EINVAL for an invalid fence. */
+int sync_wait_many(const int *fds, size_t count, int timeout, int mode);
+
+/* Merges count fences into a new one. The merges form a balanced tree, so the
+ * intermediate fences stay small and at most one per level of the tree is open
+ * at a time; they are all closed before returning. The input fds remain owned
+ * by the caller. */
+int sync_merge_many(const char *name, const int *fds, size_t count);
 struct sync_fence_info_data *sync_fence_info(int fd);
 struct sync_pt_info *sync_pt_info(struct sync_fence_info_data *info,
                                   struct sync_pt_info *itr);
@@ -23,6 +23,8 @@
 #include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -128,6 +130,103 @@ int sync_wait(int fd, int timeout)
     return ret;
 }
 
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Small waits, the common case, do not need to allocate. */
+#define SYNC_WAIT_MANY_STACK_FDS 16
+
+int sync_wait_many(const int *fds, size_t count, int timeout, int mode)
+{
+    struct pollfd stack_pfds[SYNC_WAIT_MANY_STACK_FDS];
+    struct pollfd *pfds = stack_pfds;
+    int64_t deadline = 0;
+    size_t pending;
+    size_t i;
+    int ret;
+
+    if (fds == NULL || count == 0 || (mode != SYNC_WAIT_ALL && mode != SYNC_WAIT_ANY)) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if (fds[i] < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if (count == 1) {
+        return sync_wait(fds[0], timeout);
+    }
+
+    if (count > SYNC_WAIT_MANY_STACK_FDS) {
+        pfds = malloc(count * sizeof(*pfds));
+        if (pfds == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        pfds[i].fd = fds[i];
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
+    }
+    if (timeout > 0)
+        deadline = now_ms() + timeout;
+
+    pending = count;
+    for (;;) {
+        int wait_ms = timeout;
+        if (timeout > 0) {
+            int64_t left = deadline - now_ms();
+            wait_ms = left > 0 ? (int)left : 0;
+        }
+
+        ret = poll(pfds, count, wait_ms);
+        if (ret == -1) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            break;
+        }
+        if (ret == 0) {
+            errno = ETIME;
+            ret = -1;
+            break;
+        }
+
+        for (i = 0; i < count; i++) {
+            if (pfds[i].revents == 0)
+                continue;
+            if (pfds[i].revents & (POLLERR | POLLNVAL)) {
+                errno = EINVAL;
+                ret = -1;
+                goto out;
+            }
+            if (mode == SYNC_WAIT_ANY) {
+                ret = (int)i;
+                goto out;
+            }
+            /* Signaled, poll() skips negative fds from now on. */
+            pfds[i].fd = -1;
+            pfds[i].revents = 0;
+            pending--;
+        }
+        if (pending == 0) {
+            ret = 0;
+            break;
+        }
+    }
+
+out:
+    if (pfds != stack_pfds)
+        free(pfds);
+    return ret;
+}
+
 static int legacy_sync_merge(const char *name, int fd1, int fd2)
 {
     struct sync_legacy_merge_data data;
@@ -183,6 +282,58 @@ int sync_merge(const char *name, int fd1, int fd2)
     return ret;
 }
 
+/*
+ * Merges fds[0..count) as a balanced tree and returns the resulting fence.
+ * *owned is set if the result is an intermediate fence that the caller must
+ * close, as opposed to one of the input fds. Depth first, so at most one
+ * intermediate per tree level is open at any time.
+ */
+static int sync_merge_range(const char *name, const int *fds, size_t count, int *owned)
+{
+    int left, right, left_owned, right_owned;
+    int saved_errno;
+    int ret;
+
+    if (count == 1) {
+        *owned = 0;
+        return fds[0];
+    }
+
+    left = sync_merge_range(name, fds, count / 2, &left_owned);
+    if (left < 0)
+        return left;
+    right = sync_merge_range(name, fds + count / 2, count - count / 2, &right_owned);
+    if (right < 0) {
+        ret = right;
+    } else {
+        ret = sync_merge(name, left, right);
+    }
+
+    saved_errno = errno;
+    if (left_owned)
+        close(left);
+    if (right >= 0 && right_owned)
+        close(right);
+    errno = saved_errno;
+    *owned = 1;
+    return ret;
+}
+
+int sync_merge_many(const char *name, const int *fds, size_t count)
+{
+    int owned;
+
+    if (fds == NULL || count == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* Always hand back a new fence, even for a single input. */
+    if (count == 1)
+        return sync_merge(name, fds[0], fds[0]);
+
+    return sync_merge_range(name, fds, count, &owned);
+}
+
 static struct sync_fence_info_data *legacy_sync_fence_info(int fd)
 {
     struct sync_fence_info_data *legacy_info;
@@ -448,6 +448,85 @@ TEST(FenceTest, MultiTimelineWait) {
     ASSERT_EQ(mergedFence.wait(100), 0);
 }
 
+TEST(FenceTest, WaitManyAll) {
+    SyncTimeline timelineA, timelineB, timelineC;
+
+    SyncFence fenceA(timelineA, 5);
+    SyncFence fenceB(timelineB, 5);
+    SyncFence fenceC(timelineC, 5);
+    int fds[] = {fenceA.getFd(), fenceB.getFd(), fenceC.getFd()};
+
+    ASSERT_EQ(sync_wait_many(fds, 3, 0, SYNC_WAIT_ALL), -1);
+    ASSERT_EQ(errno, ETIME);
+
+    timelineA.inc(5);
+    timelineC.inc(5);
+    ASSERT_EQ(sync_wait_many(fds, 3, 0, SYNC_WAIT_ALL), -1);
+    ASSERT_EQ(errno, ETIME);
+
+    thread signaler([&]{
+        usleep(10000);
+        timelineB.inc(5);
+    });
+    ASSERT_EQ(sync_wait_many(fds, 3, 1000, SYNC_WAIT_ALL), 0);
+    signaler.join();
+}
+
+TEST(FenceTest, WaitManyAny) {
+    SyncTimeline timelineA, timelineB;
+
+    SyncFence fenceA(timelineA, 5);
+    SyncFence fenceB(timelineB, 5);
+    int fds[] = {fenceA.getFd(), fenceB.getFd()};
+
+    ASSERT_EQ(sync_wait_many(fds, 2, 0, SYNC_WAIT_ANY), -1);
+    ASSERT_EQ(errno, ETIME);
+
+    timelineB.inc(5);
+    ASSERT_EQ(sync_wait_many(fds, 2, 0, SYNC_WAIT_ANY), 1);
+    ASSERT_EQ(sync_wait_many(fds, 2, 0, SYNC_WAIT_ALL), -1);
+
+    int bad[] = {fenceA.getFd(), -1};
+    ASSERT_EQ(sync_wait_many(bad, 2, 0, SYNC_WAIT_ANY), -1);
+    ASSERT_EQ(errno, EINVAL);
+    ASSERT_EQ(sync_wait_many(fds, 2, 0, 42), -1);
+    ASSERT_EQ(errno, EINVAL);
+}
+
+TEST(FenceTest, MergeMany) {
+    const int timelineCount = 20;
+    vector<SyncTimeline> timelines(timelineCount);
+    vector<SyncFence> fences;
+    vector<int> fds;
+    fences.reserve(timelineCount);
+    for (auto& timeline : timelines) {
+        fences.emplace_back(timeline, 1);
+        fds.push_back(fences.back().getFd());
+    }
+
+    int fd = sync_merge_many("mergeMany", fds.data(), fds.size());
+    ASSERT_GE(fd, 0);
+
+    struct sync_file_info* info = sync_file_info(fd);
+    ASSERT_TRUE(info != NULL);
+    ASSERT_EQ(info->num_fences, timelineCount);
+    sync_file_info_free(info);
+
+    for (int i = 0; i < timelineCount - 1; i++) {
+        timelines[i].inc(1);
+    }
+    ASSERT_EQ(sync_wait(fd, 0), -1);
+    ASSERT_EQ(errno, ETIME);
+    timelines[timelineCount - 1].inc(1);
+    ASSERT_EQ(sync_wait(fd, 100), 0);
+    close(fd);
+
+    // The inputs are left untouched.
+    for (auto& fence : fences) {
+        ASSERT_TRUE(fence.isValid());
+    }
+}
+
 TEST(StressTest, TwoThreadsSharedTimeline) {
     const int iterations = 1 << 16;
     int counter = 0;
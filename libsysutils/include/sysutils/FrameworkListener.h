@@ -16,6 +16,10 @@
 #ifndef _FRAMEWORKSOCKETLISTENER_H
 #define _FRAMEWORKSOCKETLISTENER_H
 
+#include <string>
+#include <unordered_map>
+#include <utility>
+
 #include "SocketListener.h"
 #include "FrameworkCommand.h"
 
@@ -29,19 +33,28 @@ public:
     int errorRate;
 
 private:
+    class WorkQueue;
+
     int mCommandCount;
     bool mWithSeq;
     FrameworkCommandCollection *mCommands;
+    // mCommands by name, with whether each runs on a worker thread.
+    std::unordered_map<std::string, std::pair<FrameworkCommand *, bool>> mCommandMap;
+    WorkQueue *mWorkQueue;
     bool mSkipToNextNullByte;
 
 public:
     FrameworkListener(const char *socketName);
     FrameworkListener(const char *socketName, bool withSeq);
     FrameworkListener(int sock);
-    virtual ~FrameworkListener() {}
+    virtual ~FrameworkListener();
 
 protected:
     void registerCmd(FrameworkCommand *cmd);
+    /* A long-running command runs on a worker thread, so that it does not
+     * hold up the other clients. The commands of one client still run, and
+     * are replied to, in the order they were received. */
+    void registerCmd(FrameworkCommand *cmd, bool longRunning);
     virtual bool onDataAvailable(SocketClient *c);
 
 private:
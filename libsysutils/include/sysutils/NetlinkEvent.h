@@ -42,6 +42,9 @@ private:
     Action mAction;
     char *mSubsystem;
     char *mParams[NL_PARAMS_MAX];
+    // A uevent is copied here once, and mPath, mSubsystem and mParams point
+    // into the copy instead of being allocated one by one.
+    char *mUevent;
 
 public:
     NetlinkEvent();
@@ -21,7 +21,11 @@
 class NetlinkEvent;
 
 class NetlinkListener : public SocketListener {
-    char mBuffer[64 * 1024] __attribute__((aligned(4)));
+    // Datagrams are received kMaxBatch at a time, each in its own buffer of
+    // kBufferSize bytes.
+    static const int kMaxBatch = 8;
+    static const size_t kBufferSize = 64 * 1024;
+    char *mBuffers;
     int mFormat;
 
 public:
@@ -39,11 +43,14 @@ public:
 #else
     NetlinkListener(int socket, int format = NETLINK_FORMAT_ASCII);
 #endif
-    virtual ~NetlinkListener() {}
+    virtual ~NetlinkListener();
 
 protected:
     virtual bool onDataAvailable(SocketClient *cli);
     virtual void onEvent(NetlinkEvent *evt) = 0;
+
+private:
+    void dispatch(char *buffer, ssize_t count);
 };
 
 #endif
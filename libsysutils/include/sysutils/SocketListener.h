@@ -18,6 +18,8 @@
 
 #include <pthread.h>
 
+#include <unordered_map>
+
 #include <sysutils/SocketClient.h>
 #include "SocketClientCommand.h"
 
@@ -26,8 +28,11 @@ class SocketListener {
     const char              *mSocketName;
     int                     mSock;
     SocketClientCollection  *mClients;
+    // mClients indexed by socket, to find the clients that epoll reports.
+    std::unordered_map<int, SocketClient *> mClientsBySocket;
     pthread_mutex_t         mClientsLock;
     int                     mCtrlPipe[2];
+    int                     mEpollFd;
     pthread_t               mThread;
     bool                    mUseCmdNum;
 
@@ -52,6 +57,7 @@ protected:
 
 private:
     bool release(SocketClient *c, bool wakeup);
+    void addClientLocked(SocketClient *c);
     static void *threadStart(void *obj);
     void runListener();
     void init(const char *socketName, int socketFd, bool listen, bool useCmdNum);
@@ -21,6 +21,12 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <log/log.h>
 #include <sysutils/FrameworkCommand.h>
 #include <sysutils/FrameworkListener.h>
@@ -30,6 +36,122 @@ static const int CMD_BUF_SIZE = 1024;
 
 #define UNUSED __attribute__((unused))
 
+// A parsed command, or the error to reply with instead.
+struct FrameworkJob {
+    bool hasCmdNum;
+    int cmdNum;
+    FrameworkCommand *cmd;  // NULL to reply with error
+    const char *error;
+    // The arguments, copied from the read buffer when the job is queued.
+    std::vector<std::string> args;
+};
+
+// Sets the command number of cli, as replies use it, and runs the command.
+static void runJob(SocketClient *cli, const FrameworkJob &job, int argc, char **argv) {
+    if (job.hasCmdNum) {
+        cli->setCmdNum(job.cmdNum);
+    }
+    if (!job.cmd) {
+        cli->sendMsg(500, job.error, false);
+    } else if (job.cmd->runCommand(cli, argc, argv)) {
+        SLOGW("Handler '%s' error (%s)", job.cmd->getCommand(), strerror(errno));
+    }
+}
+
+/*
+ * Runs the jobs of each client in order on a few worker threads. While a
+ * client has a job queued or running, all of its later commands are queued
+ * behind it, so replies are never reordered and no two threads set the
+ * command number of a client at the same time.
+ */
+class FrameworkListener::WorkQueue {
+  public:
+    static const size_t kWorkers = 4;
+
+    ~WorkQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mStopping = true;
+        }
+        mCond.notify_all();
+        for (auto &worker : mWorkers) {
+            worker.join();
+        }
+        for (auto &client : mJobs) {
+            for (size_t i = 0; i < client.second.size(); i++) {
+                client.first->decRef();
+            }
+        }
+    }
+
+    // Whether cli has jobs that are not done yet.
+    bool isBusy(SocketClient *cli) {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mJobs.find(cli) != mJobs.end();
+    }
+
+    void enqueue(SocketClient *cli, FrameworkJob job) {
+        cli->incRef();
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            std::deque<FrameworkJob> &jobs = mJobs[cli];
+            jobs.push_back(std::move(job));
+            if (jobs.size() == 1) {
+                mReady.push_back(cli);
+            }
+            // Started the first time they are needed.
+            while (mWorkers.size() < kWorkers) {
+                mWorkers.emplace_back([this] { run(); });
+            }
+        }
+        mCond.notify_one();
+    }
+
+  private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mLock);
+        while (true) {
+            mCond.wait(lock, [this] { return mStopping || !mReady.empty(); });
+            if (mStopping) {
+                return;
+            }
+            SocketClient *cli = mReady.front();
+            mReady.pop_front();
+            // The job stays queued while it runs, so that the client is busy.
+            std::deque<FrameworkJob> &jobs = mJobs[cli];
+            FrameworkJob &job = jobs.front();
+            lock.unlock();
+
+            std::vector<char *> argv;
+            for (auto &arg : job.args) {
+                argv.push_back(&arg[0]);
+            }
+            runJob(cli, job, argv.size(), argv.data());
+
+            lock.lock();
+            jobs.pop_front();
+            if (jobs.empty()) {
+                mJobs.erase(cli);
+            } else {
+                mReady.push_back(cli);
+                mCond.notify_one();
+            }
+            lock.unlock();
+            cli->decRef();
+            lock.lock();
+        }
+    }
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    // The following members are guarded by mLock.
+    std::unordered_map<SocketClient *, std::deque<FrameworkJob>> mJobs;
+    // The clients whose first job is waiting for a worker.
+    std::deque<SocketClient *> mReady;
+    std::vector<std::thread> mWorkers;
+    bool mStopping = false;
+};
+
 FrameworkListener::FrameworkListener(const char *socketName, bool withSeq) :
                             SocketListener(socketName, true, withSeq) {
     init(socketName, withSeq);
@@ -47,12 +169,17 @@ FrameworkListener::FrameworkListener(int sock) :
 
 void FrameworkListener::init(const char *socketName UNUSED, bool withSeq) {
     mCommands = new FrameworkCommandCollection();
+    mWorkQueue = new WorkQueue();
     errorRate = 0;
     mCommandCount = 0;
     mWithSeq = withSeq;
     mSkipToNextNullByte = false;
 }
 
+FrameworkListener::~FrameworkListener() {
+    delete mWorkQueue;
+}
+
 bool FrameworkListener::onDataAvailable(SocketClient *c) {
     char buffer[CMD_BUF_SIZE];
     int len;
@@ -91,28 +218,34 @@ bool FrameworkListener::onDataAvailable(SocketClient *c) {
 }
 
 void FrameworkListener::registerCmd(FrameworkCommand *cmd) {
+    registerCmd(cmd, false);
+}
+
+void FrameworkListener::registerCmd(FrameworkCommand *cmd, bool longRunning) {
     mCommands->push_back(cmd);
+    // As with a linear search, the first command registered with a name wins.
+    mCommandMap.emplace(cmd->getCommand(), std::make_pair(cmd, longRunning));
 }
 
+/*
+ * Tokenizes data in place: unescaping and dropping quotes only ever shortens
+ * it, and each argument ends where a space was.
+ */
 void FrameworkListener::dispatchCommand(SocketClient *cli, char *data) {
-    FrameworkCommandCollection::iterator i;
     int argc = 0;
     char *argv[FrameworkListener::CMD_ARGS_MAX];
-    char tmp[CMD_BUF_SIZE];
     char *p = data;
-    char *q = tmp;
-    char *qlimit = tmp + sizeof(tmp) - 1;
+    char *q = data;
+    char *arg = data;
     bool esc = false;
     bool quote = false;
     bool haveCmdNum = !mWithSeq;
+    bool longRunning = false;
+    FrameworkJob job = {false, 0, NULL, NULL, {}};
 
-    memset(argv, 0, sizeof(argv));
-    memset(tmp, 0, sizeof(tmp));
     while(*p) {
         if (*p == '\\') {
             if (esc) {
-                if (q >= qlimit)
-                    goto overflow;
                 *q++ = '\\';
                 esc = false;
             } else
@@ -121,16 +254,12 @@ void FrameworkListener::dispatchCommand(SocketClient *cli, char *data) {
             continue;
         } else if (esc) {
             if (*p == '"') {
-                if (q >= qlimit)
-                    goto overflow;
                 *q++ = '"';
             } else if (*p == '\\') {
-                if (q >= qlimit)
-                    goto overflow;
                 *q++ = '\\';
             } else {
-                cli->sendMsg(500, "Unsupported escape sequence", false);
-                goto out;
+                job.error = "Unsupported escape sequence";
+                goto reply;
             }
             p++;
             esc = false;
@@ -146,27 +275,25 @@ void FrameworkListener::dispatchCommand(SocketClient *cli, char *data) {
             continue;
         }
 
-        if (q >= qlimit)
-            goto overflow;
         *q = *p++;
         if (!quote && *q == ' ') {
-            *q = '\0';
+            *q++ = '\0';
             if (!haveCmdNum) {
                 char *endptr;
-                int cmdNum = (int)strtol(tmp, &endptr, 0);
+                int cmdNum = (int)strtol(arg, &endptr, 0);
                 if (endptr == NULL || *endptr != '\0') {
-                    cli->sendMsg(500, "Invalid sequence number", false);
-                    goto out;
+                    job.error = "Invalid sequence number";
+                    goto reply;
                 }
-                cli->setCmdNum(cmdNum);
+                job.hasCmdNum = true;
+                job.cmdNum = cmdNum;
                 haveCmdNum = true;
             } else {
                 if (argc >= CMD_ARGS_MAX)
                     goto overflow;
-                argv[argc++] = strdup(tmp);
+                argv[argc++] = arg;
             }
-            memset(tmp, 0, sizeof(tmp));
-            q = tmp;
+            arg = q;
             continue;
         }
         q++;
@@ -175,42 +302,39 @@ void FrameworkListener::dispatchCommand(SocketClient *cli, char *data) {
     *q = '\0';
     if (argc >= CMD_ARGS_MAX)
         goto overflow;
-    argv[argc++] = strdup(tmp);
-#if 0
-    for (int k = 0; k < argc; k++) {
-        SLOGD("arg[%d] = '%s'", k, argv[k]);
-    }
-#endif
+    argv[argc++] = arg;
 
     if (quote) {
-        cli->sendMsg(500, "Unclosed quotes error", false);
-        goto out;
+        job.error = "Unclosed quotes error";
+        goto reply;
     }
 
     if (errorRate && (++mCommandCount % errorRate == 0)) {
         /* ignore this command - let the timeout handler handle it */
         SLOGE("Faking a timeout");
-        goto out;
+        return;
     }
 
-    for (i = mCommands->begin(); i != mCommands->end(); ++i) {
-        FrameworkCommand *c = *i;
-
-        if (!strcmp(argv[0], c->getCommand())) {
-            if (c->runCommand(cli, argc, argv)) {
-                SLOGW("Handler '%s' error (%s)", c->getCommand(), strerror(errno));
-            }
-            goto out;
+    {
+        auto it = mCommandMap.find(argv[0]);
+        if (it != mCommandMap.end()) {
+            job.cmd = it->second.first;
+            longRunning = it->second.second;
+        } else {
+            job.error = "Command not recognized";
         }
     }
-    cli->sendMsg(500, "Command not recognized", false);
-out:
-    int j;
-    for (j = 0; j < argc; j++)
-        free(argv[j]);
-    return;
+    goto reply;
 
 overflow:
-    cli->sendMsg(500, "Command too long", false);
-    goto out;
+    job.error = "Command too long";
+reply:
+    if (!longRunning && !mWorkQueue->isBusy(cli)) {
+        runJob(cli, job, job.cmd ? argc : 0, argv);
+        return;
+    }
+    if (job.cmd) {
+        job.args.assign(argv, argv + argc);
+    }
+    mWorkQueue->enqueue(cli, std::move(job));
 }
@@ -45,14 +45,20 @@ const int LOCAL_NFLOG_PACKET = NFNL_SUBSYS_ULOG << 8 | NFULNL_MSG_PACKET;
 #include <sysutils/NetlinkEvent.h>
 
 NetlinkEvent::NetlinkEvent() {
+    mSeq = 0;
     mAction = Action::kUnknown;
     memset(mParams, 0, sizeof(mParams));
     mPath = NULL;
     mSubsystem = NULL;
+    mUevent = NULL;
 }
 
 NetlinkEvent::~NetlinkEvent() {
     int i;
+    if (mUevent) {
+        free(mUevent);
+        return;
+    }
     if (mPath)
         free(mPath);
     if (mSubsystem)
@@ -558,8 +564,8 @@ bool NetlinkEvent::parseBinaryNetlinkMessage(char *buffer, int size) {
  * from the 'prefix' array, then return 'str + prefixlen', otherwise return
  * NULL.
  */
-static const char*
-has_prefix(const char* str, const char* end, const char* prefix, size_t prefixlen)
+static char*
+has_prefix(char* str, const char* end, const char* prefix, size_t prefixlen)
 {
     if ((end - str) >= (ptrdiff_t)prefixlen &&
         (prefixlen == 0 || !memcmp(str, prefix, prefixlen))) {
@@ -581,31 +587,37 @@ has_prefix(const char* str, const char* end, const char* prefix, size_t prefixle
  * netlink socket.
  */
 bool NetlinkEvent::parseAsciiNetlinkMessage(char *buffer, int size) {
-    const char *s = buffer;
+    char *s;
     const char *end;
     int param_idx = 0;
     int first = 1;
 
-    if (size == 0)
+    if (size == 0 || mUevent)
         return false;
 
     /* Ensure the buffer is zero-terminated, the code below depends on this */
     buffer[size-1] = '\0';
 
+    mUevent = static_cast<char *>(malloc(size));
+    if (!mUevent)
+        return false;
+    memcpy(mUevent, buffer, size);
+
+    s = mUevent;
     end = s + size;
     while (s < end) {
         if (first) {
-            const char *p;
+            char *p;
             /* buffer is 0-terminated, no need to check p < end */
             for (p = s; *p != '@'; p++) {
                 if (!*p) { /* no '@', should not happen */
                     return false;
                 }
             }
-            mPath = strdup(p+1);
+            mPath = p+1;
             first = 0;
         } else {
-            const char* a;
+            char* a;
             if ((a = HAS_CONST_PREFIX(s, end, "ACTION=")) != NULL) {
                 if (!strcmp(a, "add"))
                     mAction = Action::kAdd;
@@ -616,9 +628,9 @@ bool NetlinkEvent::parseAsciiNetlinkMessage(char *buffer, int size) {
             } else if ((a = HAS_CONST_PREFIX(s, end, "SEQNUM=")) != NULL) {
                 mSeq = atoi(a);
             } else if ((a = HAS_CONST_PREFIX(s, end, "SUBSYSTEM=")) != NULL) {
-                mSubsystem = strdup(a);
+                mSubsystem = a;
             } else if (param_idx < NL_PARAMS_MAX) {
-                mParams[param_idx++] = strdup(s);
+                mParams[param_idx++] = s;
             }
         }
         s += strlen(s) + 1;
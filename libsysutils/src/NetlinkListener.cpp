@@ -17,6 +17,7 @@
 #define LOG_TAG "NetlinkListener"
 
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -24,7 +25,6 @@
 
 #include <linux/netlink.h> /* out of order because must follow sys/socket.h */
 
-#include <cutils/uevent.h>
 #include <log/log.h>
 #include <sysutils/NetlinkEvent.h>
 
@@ -36,40 +36,100 @@
 NetlinkListener::NetlinkListener(int socket) :
                             SocketListener(socket, false) {
     mFormat = NETLINK_FORMAT_ASCII;
+    mBuffers = static_cast<char *>(malloc(kMaxBatch * kBufferSize));
 }
 #endif
 
 NetlinkListener::NetlinkListener(int socket, int format) :
                             SocketListener(socket, false), mFormat(format) {
+    mBuffers = static_cast<char *>(malloc(kMaxBatch * kBufferSize));
+}
+
+NetlinkListener::~NetlinkListener() {
+    free(mBuffers);
 }
 
 bool NetlinkListener::onDataAvailable(SocketClient *cli)
 {
     int socket = cli->getSocket();
-    ssize_t count;
-    uid_t uid = -1;
+    struct mmsghdr msgs[kMaxBatch];
+    struct iovec iovs[kMaxBatch];
+    struct sockaddr_nl addrs[kMaxBatch];
+    char controls[kMaxBatch][CMSG_SPACE(sizeof(struct ucred))];
 
     bool require_group = true;
     if (mFormat == NETLINK_FORMAT_BINARY_UNICAST) {
         require_group = false;
     }
 
-    count = TEMP_FAILURE_RETRY(uevent_kernel_recv(socket,
-            mBuffer, sizeof(mBuffer), require_group, &uid));
-    if (count < 0) {
-        SLOGE("recvmsg failed (%s)", strerror(errno));
-        return false;
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < kMaxBatch; i++) {
+        iovs[i].iov_base = mBuffers + i * kBufferSize;
+        iovs[i].iov_len = kBufferSize;
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = controls[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
     }
 
-    NetlinkEvent *evt = new NetlinkEvent();
-    if (evt->decode(mBuffer, count, mFormat)) {
-        onEvent(evt);
-    } else if (mFormat != NETLINK_FORMAT_BINARY) {
-        // Don't complain if parseBinaryNetlinkMessage returns false. That can
-        // just mean that the buffer contained no messages we're interested in.
-        SLOGE("Error decoding NetlinkEvent");
+    // Drains the datagrams that are already queued, so that a burst of
+    // events costs one wakeup and one system call per kMaxBatch datagrams.
+    int received = TEMP_FAILURE_RETRY(recvmmsg(socket, msgs, kMaxBatch, MSG_WAITFORONE, NULL));
+    if (received < 0) {
+        SLOGE("recvmmsg failed (%s)", strerror(errno));
+        return false;
     }
 
-    delete evt;
+    for (int i = 0; i < received; i++) {
+        char *buffer = static_cast<char *>(iovs[i].iov_base);
+        ssize_t count = msgs[i].msg_len;
+
+        // The same checks as uevent_kernel_recv().
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+        if (count <= 0) {
+            continue;
+        } else if (cmsg == NULL || cmsg->cmsg_type != SCM_CREDENTIALS ||
+                   ((struct ucred *) CMSG_DATA(cmsg))->uid != 0 || addrs[i].nl_pid != 0 ||
+                   (require_group && addrs[i].nl_groups == 0)) {
+            /* clear residual potentially malicious data */
+            bzero(buffer, count);
+            SLOGE("recvmmsg failed (%s)", strerror(EIO));
+            continue;
+        }
+
+        dispatch(buffer, count);
+    }
     return true;
 }
+
+/*
+ * Passes one NetlinkEvent per message in the datagram to onEvent(). A uevent
+ * is a single message; a binary datagram may hold several, all of which are
+ * delivered.
+ */
+void NetlinkListener::dispatch(char *buffer, ssize_t count)
+{
+    if (mFormat == NETLINK_FORMAT_ASCII) {
+        NetlinkEvent evt;
+        if (evt.decode(buffer, count, mFormat)) {
+            onEvent(&evt);
+        } else {
+            SLOGE("Error decoding NetlinkEvent");
+        }
+        return;
+    }
+
+    // Don't complain if decode returns false. That can just mean that the
+    // message is not one we're interested in.
+    int size = count;
+    for (struct nlmsghdr *nh = (struct nlmsghdr *) buffer;
+         NLMSG_OK(nh, (unsigned) size) && nh->nlmsg_type != NLMSG_DONE;
+         nh = NLMSG_NEXT(nh, size)) {
+        NetlinkEvent evt;
+        if (evt.decode(reinterpret_cast<char *>(nh), nh->nlmsg_len, mFormat)) {
+            onEvent(&evt);
+        }
+    }
+}
@@ -19,7 +19,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -34,6 +34,9 @@
 #define CtrlPipe_Shutdown 0
 #define CtrlPipe_Wakeup   1
 
+// Events handled per epoll_wait(); more are returned by the next call.
+static const int kMaxEvents = 64;
+
 SocketListener::SocketListener(const char *socketName, bool listen) {
     init(socketName, -1, listen, false);
 }
@@ -53,6 +56,9 @@ void SocketListener::init(const char *socketName, int socketFd, bool listen, boo
     mUseCmdNum = useCmdNum;
     pthread_mutex_init(&mClientsLock, NULL);
     mClients = new SocketClientCollection();
+    mCtrlPipe[0] = -1;
+    mCtrlPipe[1] = -1;
+    mEpollFd = -1;
 }
 
 SocketListener::~SocketListener() {
@@ -63,6 +69,9 @@ SocketListener::~SocketListener() {
         close(mCtrlPipe[0]);
         close(mCtrlPipe[1]);
     }
+    if (mEpollFd != -1) {
+        close(mEpollFd);
+    }
     SocketClientCollection::iterator it;
     for (it = mClients->begin(); it != mClients->end();) {
         (*it)->decRef();
@@ -94,14 +103,39 @@ int SocketListener::startListener(int backlog) {
     if (mListen && listen(mSock, backlog) < 0) {
         SLOGE("Unable to listen on socket (%s)", strerror(errno));
         return -1;
-    } else if (!mListen)
-        mClients->push_back(new SocketClient(mSock, false, mUseCmdNum));
+    }
 
     if (pipe(mCtrlPipe)) {
         SLOGE("pipe failed (%s)", strerror(errno));
         return -1;
     }
 
+    // Every socket is registered once, instead of rebuilding an fd_set from
+    // all the clients on each wakeup, and there is no FD_SETSIZE limit.
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd == -1) {
+        SLOGE("epoll_create1 failed (%s)", strerror(errno));
+        return -1;
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = mCtrlPipe[0];
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mCtrlPipe[0], &event)) {
+        SLOGE("epoll_ctl failed (%s)", strerror(errno));
+        return -1;
+    }
+    if (mListen) {
+        event.data.fd = mSock;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mSock, &event)) {
+            SLOGE("epoll_ctl failed (%s)", strerror(errno));
+            return -1;
+        }
+    } else {
+        pthread_mutex_lock(&mClientsLock);
+        addClientLocked(new SocketClient(mSock, false, mUseCmdNum));
+        pthread_mutex_unlock(&mClientsLock);
+    }
+
     if (pthread_create(&mThread, NULL, SocketListener::threadStart, this)) {
         SLOGE("pthread_create (%s)", strerror(errno));
         return -1;
@@ -129,17 +163,22 @@ int SocketListener::stopListener() {
     close(mCtrlPipe[1]);
     mCtrlPipe[0] = -1;
     mCtrlPipe[1] = -1;
+    close(mEpollFd);
+    mEpollFd = -1;
 
     if (mSocketName && mSock > -1) {
         close(mSock);
         mSock = -1;
     }
 
+    pthread_mutex_lock(&mClientsLock);
     SocketClientCollection::iterator it;
     for (it = mClients->begin(); it != mClients->end();) {
         delete (*it);
         it = mClients->erase(it);
     }
+    mClientsBySocket.clear();
+    pthread_mutex_unlock(&mClientsLock);
     return 0;
 }
 
@@ -151,48 +190,48 @@ void *SocketListener::threadStart(void *obj) {
     return NULL;
 }
 
+void SocketListener::addClientLocked(SocketClient *c) {
+    int fd = c->getSocket();
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event)) {
+        SLOGE("epoll_ctl failed (%s) for %d", strerror(errno), fd);
+    }
+    mClients->push_back(c);
+    mClientsBySocket[fd] = c;
+}
+
 void SocketListener::runListener() {
 
     SocketClientCollection pendingList;
+    struct epoll_event events[kMaxEvents];
 
     while(1) {
         SocketClientCollection::iterator it;
-        fd_set read_fds;
         int rc = 0;
-        int max = -1;
-
-        FD_ZERO(&read_fds);
-
-        if (mListen) {
-            max = mSock;
-            FD_SET(mSock, &read_fds);
-        }
 
-        FD_SET(mCtrlPipe[0], &read_fds);
-        if (mCtrlPipe[0] > max)
-            max = mCtrlPipe[0];
-
-        pthread_mutex_lock(&mClientsLock);
-        for (it = mClients->begin(); it != mClients->end(); ++it) {
-            // NB: calling out to an other object with mClientsLock held (safe)
-            int fd = (*it)->getSocket();
-            FD_SET(fd, &read_fds);
-            if (fd > max) {
-                max = fd;
-            }
-        }
-        pthread_mutex_unlock(&mClientsLock);
-        SLOGV("mListen=%d, max=%d, mSocketName=%s", mListen, max, mSocketName);
-        if ((rc = select(max + 1, &read_fds, NULL, NULL, NULL)) < 0) {
+        SLOGV("mListen=%d, mSocketName=%s", mListen, mSocketName);
+        if ((rc = epoll_wait(mEpollFd, events, kMaxEvents, -1)) < 0) {
             if (errno == EINTR)
                 continue;
-            SLOGE("select failed (%s) mListen=%d, max=%d", strerror(errno), mListen, max);
+            SLOGE("epoll_wait failed (%s) mListen=%d", strerror(errno), mListen);
             sleep(1);
             continue;
         } else if (!rc)
             continue;
 
-        if (FD_ISSET(mCtrlPipe[0], &read_fds)) {
+        bool ctrl = false;
+        bool accepting = false;
+        for (int i = 0; i < rc; i++) {
+            if (events[i].data.fd == mCtrlPipe[0]) {
+                ctrl = true;
+            } else if (mListen && events[i].data.fd == mSock) {
+                accepting = true;
+            }
+        }
+
+        if (ctrl) {
             char c = CtrlPipe_Shutdown;
             TEMP_FAILURE_RETRY(read(mCtrlPipe[0], &c, 1));
             if (c == CtrlPipe_Shutdown) {
@@ -200,7 +239,7 @@ void SocketListener::runListener() {
             }
             continue;
         }
-        if (mListen && FD_ISSET(mSock, &read_fds)) {
+        if (accepting) {
             int c = TEMP_FAILURE_RETRY(accept4(mSock, nullptr, nullptr, SOCK_CLOEXEC));
             if (c < 0) {
                 SLOGE("accept failed (%s)", strerror(errno));
@@ -208,18 +247,18 @@ void SocketListener::runListener() {
                 continue;
             }
             pthread_mutex_lock(&mClientsLock);
-            mClients->push_back(new SocketClient(c, true, mUseCmdNum));
+            addClientLocked(new SocketClient(c, true, mUseCmdNum));
             pthread_mutex_unlock(&mClientsLock);
         }
 
-        /* Add all active clients to the pending list first */
+        /* Add all active clients to the pending list first. A client may
+         * have been released since epoll reported it. */
         pendingList.clear();
         pthread_mutex_lock(&mClientsLock);
-        for (it = mClients->begin(); it != mClients->end(); ++it) {
-            SocketClient* c = *it;
-            // NB: calling out to an other object with mClientsLock held (safe)
-            int fd = c->getSocket();
-            if (FD_ISSET(fd, &read_fds)) {
+        for (int i = 0; i < rc; i++) {
+            auto client = mClientsBySocket.find(events[i].data.fd);
+            if (client != mClientsBySocket.end()) {
+                SocketClient* c = client->second;
                 pendingList.push_back(c);
                 c->incRef();
             }
@@ -257,6 +296,11 @@ bool SocketListener::release(SocketClient* c, bool wakeup) {
                 break;
             }
         }
+        if (ret) {
+            // The socket stops being watched before decRef() may close it.
+            mClientsBySocket.erase(c->getSocket());
+            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, c->getSocket(), NULL);
+        }
         pthread_mutex_unlock(&mClientsLock);
         if (ret) {
             ret = c->decRef();
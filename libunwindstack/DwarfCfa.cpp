@@ -49,7 +49,9 @@ bool DwarfCfa<AddressType>::GetLocationInfo(uint64_t pc, uint64_t start_offset,
   memory_->set_cur_offset(start_offset);
   uint64_t cfa_offset;
   cur_pc_ = fde_->pc_start;
+  row_start_ = cur_pc_;
   while ((cfa_offset = memory_->cur_offset()) < end_offset && cur_pc_ <= pc) {
+    row_start_ = cur_pc_;
     operands_.clear();
     // Read the cfa information.
     uint8_t cfa_value;
@@ -124,6 +126,13 @@ bool DwarfCfa<AddressType>::GetLocationInfo(uint64_t pc, uint64_t start_offset,
       }
     }
   }
+  if (cur_pc_ <= pc) {
+    // Ran out of instructions, the row goes on to the end of the fde.
+    row_start_ = cur_pc_;
+    row_end_ = fde_->pc_end;
+  } else {
+    row_end_ = cur_pc_;
+  }
   return true;
 }
 
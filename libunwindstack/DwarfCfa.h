@@ -79,6 +79,10 @@ class DwarfCfa {
 
   AddressType cur_pc() { return cur_pc_; }
 
+  // The pcs sharing the location info found by the last GetLocationInfo().
+  uint64_t row_start() { return row_start_; }
+  uint64_t row_end() { return row_end_; }
+
   void set_cie_loc_regs(const dwarf_loc_regs_t* cie_loc_regs) { cie_loc_regs_ = cie_loc_regs; }
 
  protected:
@@ -94,6 +98,8 @@ class DwarfCfa {
   const DwarfFde* fde_;
 
   AddressType cur_pc_;
+  uint64_t row_start_ = 0;
+  uint64_t row_end_ = 0;
   const dwarf_loc_regs_t* cie_loc_regs_ = nullptr;
   std::vector<AddressType> operands_;
   std::stack<dwarf_loc_regs_t> loc_reg_state_;
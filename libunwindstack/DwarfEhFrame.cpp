@@ -16,6 +16,8 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+
 #include <unwindstack/DwarfStructs.h>
 #include <unwindstack/Memory.h>
 
@@ -74,6 +76,17 @@ bool DwarfEhFrame<AddressType>::Init(uint64_t offset, uint64_t size) {
 
 template <typename AddressType>
 const DwarfFde* DwarfEhFrame<AddressType>::GetFdeFromIndex(size_t index) {
+  if (table_entry_size_ == 0) {
+    // The entries can not be found by index in the table itself.
+    if (cur_entries_offset_ != 0) {
+      CreateSortedFdeList();
+    }
+    if (index >= fdes_.size()) {
+      return nullptr;
+    }
+    return this->GetFdeFromOffset(fdes_[index].offset);
+  }
+
   const FdeInfo* info = GetFdeInfoFromIndex(index);
   if (info == nullptr) {
     return nullptr;
@@ -134,65 +147,58 @@ bool DwarfEhFrame<AddressType>::GetFdeOffsetBinary(uint64_t pc, uint64_t* fde_of
 }
 
 template <typename AddressType>
-bool DwarfEhFrame<AddressType>::GetFdeOffsetSequential(uint64_t pc, uint64_t* fde_offset) {
-  CHECK(fde_count_ != 0);
-  last_error_ = DWARF_ERROR_NONE;
-  // We can do a binary search if the pc is in the range of the elements
-  // that have already been cached.
-  if (!fde_info_.empty()) {
-    const FdeInfo* info = &fde_info_[fde_info_.size() - 1];
-    if (pc >= info->pc) {
-      *fde_offset = info->offset;
-      return true;
-    }
-    if (pc < info->pc) {
-      return GetFdeOffsetBinary(pc, fde_offset, fde_info_.size());
-    }
-  }
-
-  if (cur_entries_offset_ == 0) {
-    // All entries read, or error encountered.
-    return false;
-  }
-
+void DwarfEhFrame<AddressType>::CreateSortedFdeList() {
   memory_.set_data_offset(entries_data_offset_);
   memory_.set_cur_offset(cur_entries_offset_);
   cur_entries_offset_ = 0;
 
-  FdeInfo* prev_info = nullptr;
-  for (size_t current = fde_info_.size();
-       current < fde_count_ && memory_.cur_offset() < entries_end_; current++) {
+  fdes_.reserve(fde_count_);
+  while (fdes_.size() < fde_count_ && memory_.cur_offset() < entries_end_) {
     memory_.set_pc_offset(memory_.cur_offset());
     uint64_t value;
-    if (!memory_.template ReadEncodedValue<AddressType>(table_encoding_, &value)) {
-      last_error_ = DWARF_ERROR_MEMORY_INVALID;
-      return false;
+    FdeInfo info;
+    if (!memory_.template ReadEncodedValue<AddressType>(table_encoding_, &value) ||
+        !memory_.template ReadEncodedValue<AddressType>(table_encoding_, &info.offset)) {
+      // Keep what was read, a pc past it will not be found.
+      fdes_read_error_ = true;
+      break;
     }
+    info.pc = value;
+    fdes_.push_back(info);
+  }
+  fdes_.shrink_to_fit();
 
-    FdeInfo* info = &fde_info_[current];
-    if (!memory_.template ReadEncodedValue<AddressType>(table_encoding_, &info->offset)) {
-      fde_info_.erase(current);
-      last_error_ = DWARF_ERROR_MEMORY_INVALID;
-      return false;
-    }
-    info->pc = value;
+  // The table is supposed to be sorted already.
+  auto compare = [](const FdeInfo& a, const FdeInfo& b) { return a.pc < b.pc; };
+  if (!std::is_sorted(fdes_.begin(), fdes_.end(), compare)) {
+    std::stable_sort(fdes_.begin(), fdes_.end(), compare);
+  }
+}
 
-    if (pc < info->pc) {
-      if (prev_info == nullptr) {
-        return false;
-      }
-      cur_entries_offset_ = memory_.cur_offset();
-      *fde_offset = prev_info->offset;
-      return true;
-    }
-    prev_info = info;
+template <typename AddressType>
+bool DwarfEhFrame<AddressType>::GetFdeOffsetSequential(uint64_t pc, uint64_t* fde_offset) {
+  CHECK(fde_count_ != 0);
+  last_error_ = DWARF_ERROR_NONE;
+  if (cur_entries_offset_ != 0) {
+    CreateSortedFdeList();
   }
 
-  if (fde_count_ == fde_info_.size() && pc >= prev_info->pc) {
-    *fde_offset = prev_info->offset;
-    return true;
+  // Find the last entry that starts at or before the pc.
+  auto entry = std::upper_bound(fdes_.begin(), fdes_.end(), pc,
+                                [](uint64_t pc, const FdeInfo& info) { return pc < info.pc; });
+  if (entry == fdes_.begin()) {
+    return false;
   }
-  return false;
+  if (entry == fdes_.end() && fdes_.size() != fde_count_ && fdes_.back().pc != pc) {
+    // Past the part of the table that could be read, only an exact match
+    // is known to be right.
+    if (fdes_read_error_) {
+      last_error_ = DWARF_ERROR_MEMORY_INVALID;
+    }
+    return false;
+  }
+  *fde_offset = (entry - 1)->offset;
+  return true;
 }
 
 template <typename AddressType>
@@ -19,6 +19,8 @@
 
 #include <stdint.h>
 
+#include <vector>
+
 #include <unwindstack/DwarfSection.h>
 
 namespace unwindstack {
@@ -70,6 +72,8 @@ class DwarfEhFrame : public DwarfSectionImpl<AddressType> {
 
   bool GetFdeOffsetSequential(uint64_t pc, uint64_t* fde_offset);
 
+  void CreateSortedFdeList();
+
   bool GetFdeOffsetBinary(uint64_t pc, uint64_t* fde_offset, uint64_t total_entries);
 
  protected:
@@ -86,6 +90,11 @@ class DwarfEhFrame : public DwarfSectionImpl<AddressType> {
   uint64_t cur_entries_offset_ = 0;
 
   std::unordered_map<uint64_t, FdeInfo> fde_info_;
+
+  // When the table entries are not a fixed size, the whole table is read
+  // in one pass on the first lookup and searched from here instead.
+  std::vector<FdeInfo> fdes_;
+  bool fdes_read_error_ = false;
 };
 
 }  // namespace unwindstack
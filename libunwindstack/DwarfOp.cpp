@@ -18,6 +18,7 @@
 
 #include <deque>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/stringprintf.h>
@@ -94,6 +95,112 @@ bool DwarfOp<AddressType>::Decode(uint8_t dwarf_version) {
   return (this->*handle_func)();
 }
 
+template <typename AddressType>
+bool DwarfOp<AddressType>::Predecode(uint64_t start, uint64_t end, uint8_t dwarf_version,
+                                     std::vector<DwarfExpressionOp>* ops) {
+  last_error_ = DWARF_ERROR_NONE;
+  ops->clear();
+
+  // The index of the op at each offset, and the offsets branched to.
+  struct Branch {
+    size_t index;
+    uint64_t targets[2];
+  };
+  std::unordered_map<uint64_t, uint64_t> indexes;
+  std::vector<Branch> branches;
+  memory_->set_cur_offset(start);
+  while (memory_->cur_offset() < end) {
+    indexes[memory_->cur_offset()] = ops->size();
+
+    DwarfExpressionOp decoded = {};
+    if (!memory_->ReadBytes(&decoded.op, 1)) {
+      last_error_ = DWARF_ERROR_MEMORY_INVALID;
+      return false;
+    }
+    const auto* op = &kCallbackTable[decoded.op];
+    if (op->handle_func == nullptr || dwarf_version < op->supported_version) {
+      last_error_ = DWARF_ERROR_ILLEGAL_VALUE;
+      return false;
+    }
+    for (size_t i = 0; i < op->num_operands; i++) {
+      if (!memory_->ReadEncodedValue<AddressType>(op->operands[i], &decoded.operands[i])) {
+        last_error_ = DWARF_ERROR_MEMORY_INVALID;
+        return false;
+      }
+    }
+
+    // The same targets op_bra() and op_skip() would go to.
+    if (op->handle_func == &DwarfOp::op_bra || op->handle_func == &DwarfOp::op_skip) {
+      int16_t offset = static_cast<int16_t>(static_cast<AddressType>(decoded.operands[0]));
+      uint64_t cur_offset = memory_->cur_offset();
+      uint64_t not_taken = cur_offset + offset;
+      if (op->handle_func == &DwarfOp::op_bra) {
+        not_taken = cur_offset - offset;
+      }
+      branches.push_back(Branch{ops->size(), {cur_offset + offset, not_taken}});
+    }
+    ops->push_back(decoded);
+  }
+
+  for (const auto& branch : branches) {
+    DwarfExpressionOp* decoded = &(*ops)[branch.index];
+    for (size_t i = 0; i < 2; i++) {
+      uint64_t target = branch.targets[i];
+      if (target >= end) {
+        // Same as running off the end.
+        decoded->operands[i] = ops->size();
+        continue;
+      }
+      auto index = indexes.find(target);
+      if (index == indexes.end()) {
+        last_error_ = DWARF_ERROR_NOT_IMPLEMENTED;
+        return false;
+      }
+      decoded->operands[i] = index->second;
+    }
+  }
+  return true;
+}
+
+template <typename AddressType>
+bool DwarfOp<AddressType>::Eval(const std::vector<DwarfExpressionOp>& ops) {
+  uint32_t iterations = 0;
+  is_register_ = false;
+  stack_.clear();
+  size_t index = 0;
+  while (index < ops.size()) {
+    last_error_ = DWARF_ERROR_NONE;
+    const DwarfExpressionOp& decoded = ops[index++];
+    cur_op_ = decoded.op;
+    const auto* op = &kCallbackTable[cur_op_];
+
+    // Make sure that the required number of stack elements is available.
+    if (stack_.size() < op->num_required_stack_values) {
+      last_error_ = DWARF_ERROR_STACK_INDEX_NOT_VALID;
+      return false;
+    }
+
+    if (op->handle_func == &DwarfOp::op_bra) {
+      index = decoded.operands[StackPop() != 0 ? 0 : 1];
+    } else if (op->handle_func == &DwarfOp::op_skip) {
+      index = decoded.operands[0];
+    } else {
+      operands_.assign(decoded.operands, decoded.operands + op->num_operands);
+      if (!(this->*op->handle_func)()) {
+        return false;
+      }
+    }
+
+    // To protect against a branch that creates an infinite loop,
+    // terminate if the number of iterations gets too high.
+    if (iterations++ == 1000) {
+      last_error_ = DWARF_ERROR_TOO_MANY_ITERATIONS;
+      return false;
+    }
+  }
+  return true;
+}
+
 template <typename AddressType>
 void DwarfOp<AddressType>::GetLogInfo(uint64_t start, uint64_t end,
                                       std::vector<std::string>* lines) {
@@ -24,6 +24,8 @@
 #include <type_traits>
 #include <vector>
 
+#include <unwindstack/DwarfStructs.h>
+
 #include "DwarfEncoding.h"
 #include "DwarfError.h"
 
@@ -65,6 +67,16 @@ class DwarfOp {
 
   bool Eval(uint64_t start, uint64_t end, uint8_t dwarf_version);
 
+  // Reads the expression between start and end once, so that it can be
+  // evaluated again and again without going back to memory. Fails for
+  // anything that Eval() would not treat as a sequence of whole ops, like
+  // a branch into the middle of an op, those are left to Eval().
+  bool Predecode(uint64_t start, uint64_t end, uint8_t dwarf_version,
+                 std::vector<DwarfExpressionOp>* ops);
+
+  // Same as Eval() for an expression made by Predecode().
+  bool Eval(const std::vector<DwarfExpressionOp>& ops);
+
   void GetLogInfo(uint64_t start, uint64_t end, std::vector<std::string>* lines);
 
   AddressType StackAt(size_t index) { return stack_[index]; }
@@ -16,6 +16,8 @@
 
 #include <stdint.h>
 
+#include <utility>
+
 #include <unwindstack/DwarfLocation.h>
 #include <unwindstack/DwarfMemory.h>
 #include <unwindstack/DwarfSection.h>
@@ -39,6 +41,9 @@ const DwarfFde* DwarfSection::GetFdeFromPc(uint64_t pc) {
     return nullptr;
   }
   const DwarfFde* fde = GetFdeFromOffset(fde_offset);
+  if (fde == nullptr) {
+    return nullptr;
+  }
   // Guaranteed pc >= pc_start, need to check pc in the fde range.
   if (pc < fde->pc_end) {
     return fde;
@@ -47,8 +52,48 @@ const DwarfFde* DwarfSection::GetFdeFromPc(uint64_t pc) {
   return nullptr;
 }
 
+const DwarfSection::LocRegsRow* DwarfSection::FindLocRegsRow(uint64_t pc) {
+  auto entry = loc_regs_index_.upper_bound(pc);
+  if (entry == loc_regs_index_.end() || pc < entry->second->pc_start) {
+    return nullptr;
+  }
+  loc_regs_rows_.splice(loc_regs_rows_.begin(), loc_regs_rows_, entry->second);
+  return &*entry->second;
+}
+
+const DwarfSection::LocRegsRow* DwarfSection::AddLocRegsRow(uint64_t pc, const DwarfFde* fde,
+                                                            dwarf_loc_regs_t* loc_regs) {
+  uint64_t pc_start = loc_regs_row_start_;
+  uint64_t pc_end = loc_regs_row_end_;
+  if (pc < pc_start || pc >= pc_end) {
+    // Only trust it for this one pc.
+    pc_start = pc;
+    pc_end = pc + 1;
+  }
+
+  auto entry = loc_regs_index_.find(pc_end);
+  if (entry != loc_regs_index_.end()) {
+    loc_regs_rows_.erase(entry->second);
+    loc_regs_index_.erase(entry);
+  } else if (loc_regs_rows_.size() >= kMaxLocRegsRows) {
+    loc_regs_index_.erase(loc_regs_rows_.back().pc_end);
+    loc_regs_rows_.pop_back();
+  }
+  loc_regs_rows_.push_front(LocRegsRow{pc_start, pc_end, fde, std::move(*loc_regs)});
+  loc_regs_index_[pc_end] = loc_regs_rows_.begin();
+  return &loc_regs_rows_.front();
+}
+
 bool DwarfSection::Step(uint64_t pc, Regs* regs, Memory* process_memory) {
   last_error_ = DWARF_ERROR_NONE;
+
+  // A pc in a row that was already evaluated needs neither the fde lookup
+  // nor running the cfa instructions.
+  const LocRegsRow* row = FindLocRegsRow(pc);
+  if (row != nullptr) {
+    return Eval(row->fde->cie, process_memory, row->loc_regs, regs);
+  }
+
   const DwarfFde* fde = GetFdeFromPc(pc);
   if (fde == nullptr || fde->cie == nullptr) {
     last_error_ = DWARF_ERROR_ILLEGAL_STATE;
@@ -57,23 +102,40 @@ bool DwarfSection::Step(uint64_t pc, Regs* regs, Memory* process_memory) {
 
   // Now get the location information for this pc.
   dwarf_loc_regs_t loc_regs;
+  loc_regs_row_start_ = pc;
+  loc_regs_row_end_ = pc + 1;
   if (!GetCfaLocationInfo(pc, fde, &loc_regs)) {
     return false;
   }
+  row = AddLocRegsRow(pc, fde, &loc_regs);
 
   // Now eval the actual registers.
-  return Eval(fde->cie, process_memory, loc_regs, regs);
+  return Eval(fde->cie, process_memory, row->loc_regs, regs);
 }
 
 template <typename AddressType>
 bool DwarfSectionImpl<AddressType>::EvalExpression(const DwarfLocation& loc, uint8_t version,
-                                                   Memory* regular_memory, AddressType* value) {
+                                                   Memory* regular_memory,
+                                                   RegsImpl<AddressType>* regs,
+                                                   AddressType* value) {
   DwarfOp<AddressType> op(&memory_, regular_memory);
+  op.set_regs(regs);
 
-  // Need to evaluate the op data.
+  // Need to evaluate the op data. The same expressions come up over and
+  // over, so only read each one once. The ones that can not be read ahead
+  // of time are left empty and evaluated in place.
   uint64_t start = loc.values[1];
   uint64_t end = start + loc.values[0];
-  if (!op.Eval(start, end, version)) {
+  auto entry = expressions_.find(start);
+  if (entry == expressions_.end()) {
+    entry = expressions_.emplace(start, std::vector<DwarfExpressionOp>()).first;
+    if (!op.Predecode(start, end, version, &entry->second)) {
+      entry->second.clear();
+    }
+  }
+  bool evaluated =
+      entry->second.empty() ? op.Eval(start, end, version) : op.Eval(entry->second);
+  if (!evaluated) {
     last_error_ = op.last_error();
     return false;
   }
@@ -131,7 +193,7 @@ bool DwarfSectionImpl<AddressType>::Eval(const DwarfCie* cie, Memory* regular_me
     case DWARF_LOCATION_EXPRESSION:
     case DWARF_LOCATION_VAL_EXPRESSION: {
       AddressType value;
-      if (!EvalExpression(*loc, cie->version, regular_memory, &value)) {
+      if (!EvalExpression(*loc, cie->version, regular_memory, cur_regs, &value)) {
         return false;
       }
       if (loc->type == DWARF_LOCATION_EXPRESSION) {
@@ -199,7 +261,7 @@ bool DwarfSectionImpl<AddressType>::Eval(const DwarfCie* cie, Memory* regular_me
       case DWARF_LOCATION_EXPRESSION:
       case DWARF_LOCATION_VAL_EXPRESSION: {
         AddressType value;
-        if (!EvalExpression(*loc, cie->version, regular_memory, &value)) {
+        if (!EvalExpression(*loc, cie->version, regular_memory, cur_regs, &value)) {
           return false;
         }
         if (loc->type == DWARF_LOCATION_EXPRESSION) {
@@ -527,6 +589,8 @@ bool DwarfSectionImpl<AddressType>::GetCfaLocationInfo(uint64_t pc, const DwarfF
     last_error_ = cfa.last_error();
     return false;
   }
+  loc_regs_row_start_ = cfa.row_start();
+  loc_regs_row_end_ = cfa.row_end();
   return true;
 }
 
@@ -18,6 +18,7 @@
 #include <string.h>
 
 #include <memory>
+#include <mutex>
 #include <string>
 
 #define LOG_TAG "unwind"
@@ -57,9 +58,11 @@ bool Elf::Init() {
 // It is expensive to initialize the .gnu_debugdata section. Provide a method
 // to initialize this data separately.
 void Elf::InitGnuDebugdata() {
-  if (!valid_ || interface_->gnu_debugdata_offset() == 0) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!valid_ || gnu_debugdata_initialized_ || interface_->gnu_debugdata_offset() == 0) {
     return;
   }
+  gnu_debugdata_initialized_ = true;
 
   gnu_debugdata_memory_.reset(interface_->CreateGnuDebugdataMemory());
   gnu_debugdata_interface_.reset(CreateInterfaceFromMemory(gnu_debugdata_memory_.get()));
@@ -69,6 +72,7 @@ void Elf::InitGnuDebugdata() {
   }
   if (gnu->Init()) {
     gnu->InitHeaders();
+    memory_usage_.store(gnu_debugdata_memory_->Size(), std::memory_order_relaxed);
   } else {
     // Free all of the memory associated with the gnu_debugdata section.
     gnu_debugdata_memory_.reset(nullptr);
@@ -77,6 +81,7 @@ void Elf::InitGnuDebugdata() {
 }
 
 bool Elf::GetSoname(std::string* name) {
+  std::lock_guard<std::mutex> guard(lock_);
   return valid_ && interface_->GetSoname(name);
 }
 
@@ -89,15 +94,31 @@ uint64_t Elf::GetRelPc(uint64_t pc, const MapInfo* map_info) {
   return pc - map_info->start + load_bias + map_info->elf_offset;
 }
 
+void Elf::SetUnwindTable(UnwindTable* table) {
+  std::lock_guard<std::mutex> guard(lock_);
+  unwind_table_.reset(table);
+}
+
 bool Elf::GetFunctionName(uint64_t addr, std::string* name, uint64_t* func_offset) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (unwind_table_ && unwind_table_->GetFunctionName(addr, name, func_offset)) {
+    return true;
+  }
   return valid_ && (interface_->GetFunctionName(addr, name, func_offset) ||
                     (gnu_debugdata_interface_ &&
                      gnu_debugdata_interface_->GetFunctionName(addr, name, func_offset)));
 }
 
 bool Elf::Step(uint64_t rel_pc, Regs* regs, Memory* process_memory) {
-  return valid_ && (regs->StepIfSignalHandler(rel_pc, this, process_memory) ||
-                    interface_->Step(rel_pc, regs, process_memory) ||
+  std::lock_guard<std::mutex> guard(lock_);
+  // The signal handler check goes first so a table row can not hide it.
+  if (valid_ && regs->StepIfSignalHandler(rel_pc, this, process_memory)) {
+    return true;
+  }
+  if (unwind_table_ && unwind_table_->Step(rel_pc, regs, process_memory)) {
+    return true;
+  }
+  return valid_ && (interface_->Step(rel_pc, regs, process_memory) ||
                     (gnu_debugdata_interface_ &&
                      gnu_debugdata_interface_->Step(rel_pc, regs, process_memory)));
 }
@@ -107,6 +128,10 @@ uint64_t Elf::GetLoadBias() {
   return interface_->load_bias();
 }
 
+uint64_t Elf::MemoryUsage() {
+  return memory_usage_.load(std::memory_order_relaxed);
+}
+
 bool Elf::IsValidElf(Memory* memory) {
   if (memory == nullptr) {
     return false;
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/ElfCache.h>
+
+namespace unwindstack {
+
+namespace {
+
+struct Entry {
+  ElfCache::Key key;
+  std::shared_ptr<Elf> elf;
+  uint64_t elf_offset;
+  uint64_t file_size;
+};
+
+// The list is kept most recently used first.
+struct Cache {
+  std::mutex lock;
+  bool enabled = false;
+  uint64_t limit = 64 * 1024 * 1024;
+  std::list<Entry> entries;
+  std::map<ElfCache::Key, std::list<Entry>::iterator> index;
+};
+
+Cache& GetCache() {
+  // Never destroyed, unwinds may still be running while the process exits.
+  static Cache* cache = new Cache;
+  return *cache;
+}
+
+uint64_t Usage(Cache& cache) {
+  uint64_t usage = 0;
+  for (auto& entry : cache.entries) {
+    usage += entry.file_size + entry.elf->MemoryUsage();
+  }
+  return usage;
+}
+
+void Trim(Cache& cache) {
+  uint64_t usage = Usage(cache);
+  auto it = cache.entries.end();
+  while (usage > cache.limit && it != cache.entries.begin()) {
+    --it;
+    // Only the cache holds it, nobody else can get at it without the lock.
+    if (it->elf.use_count() != 1) {
+      continue;
+    }
+    usage -= it->file_size + it->elf->MemoryUsage();
+    cache.index.erase(it->key);
+    it = cache.entries.erase(it);
+  }
+}
+
+}  // namespace
+
+bool ElfCache::Key::Init(const std::string& map_name, uint64_t map_offset) {
+  struct stat st;
+  if (stat(map_name.c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+  name = map_name;
+  offset = map_offset;
+  dev = st.st_dev;
+  ino = st.st_ino;
+  mtime_sec = st.st_mtim.tv_sec;
+  mtime_nsec = st.st_mtim.tv_nsec;
+  size = st.st_size;
+  return true;
+}
+
+bool ElfCache::Key::operator<(const Key& other) const {
+  return std::tie(ino, dev, offset, mtime_sec, mtime_nsec, size, name) <
+         std::tie(other.ino, other.dev, other.offset, other.mtime_sec, other.mtime_nsec,
+                  other.size, other.name);
+}
+
+void ElfCache::SetEnabled(bool enabled) {
+  Cache& cache = GetCache();
+  std::lock_guard<std::mutex> guard(cache.lock);
+  cache.enabled = enabled;
+  if (!enabled) {
+    cache.index.clear();
+    cache.entries.clear();
+  }
+}
+
+bool ElfCache::Enabled() {
+  Cache& cache = GetCache();
+  std::lock_guard<std::mutex> guard(cache.lock);
+  return cache.enabled;
+}
+
+void ElfCache::SetMemoryLimit(uint64_t limit) {
+  Cache& cache = GetCache();
+  std::lock_guard<std::mutex> guard(cache.lock);
+  cache.limit = limit;
+  Trim(cache);
+}
+
+uint64_t ElfCache::MemoryUsage() {
+  Cache& cache = GetCache();
+  std::lock_guard<std::mutex> guard(cache.lock);
+  return Usage(cache);
+}
+
+void ElfCache::Clear() {
+  Cache& cache = GetCache();
+  std::lock_guard<std::mutex> guard(cache.lock);
+  cache.index.clear();
+  cache.entries.clear();
+}
+
+std::shared_ptr<Elf> ElfCache::Get(const Key& key, uint64_t* elf_offset) {
+  Cache& cache = GetCache();
+  std::lock_guard<std::mutex> guard(cache.lock);
+  auto found = cache.index.find(key);
+  if (found == cache.index.end()) {
+    return nullptr;
+  }
+  cache.entries.splice(cache.entries.begin(), cache.entries, found->second);
+  *elf_offset = found->second->elf_offset;
+  return found->second->elf;
+}
+
+void ElfCache::Add(const Key& key, std::shared_ptr<Elf>* elf, uint64_t* elf_offset,
+                   uint64_t file_size) {
+  Cache& cache = GetCache();
+  std::lock_guard<std::mutex> guard(cache.lock);
+  if (!cache.enabled) {
+    return;
+  }
+  auto found = cache.index.find(key);
+  if (found != cache.index.end()) {
+    cache.entries.splice(cache.entries.begin(), cache.entries, found->second);
+    *elf = found->second->elf;
+    *elf_offset = found->second->elf_offset;
+    return;
+  }
+  cache.entries.push_front(Entry{key, *elf, *elf_offset, file_size});
+  cache.index[key] = cache.entries.begin();
+  Trim(cache);
+}
+
+}  // namespace unwindstack
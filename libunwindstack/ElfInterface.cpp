@@ -42,7 +42,7 @@ ElfInterface::~ElfInterface() {
   }
 }
 
-Memory* ElfInterface::CreateGnuDebugdataMemory() {
+MemoryBuffer* ElfInterface::CreateGnuDebugdataMemory() {
   if (gnu_debugdata_offset_ == 0 || gnu_debugdata_size_ == 0) {
     return nullptr;
   }
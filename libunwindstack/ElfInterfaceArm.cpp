@@ -17,6 +17,10 @@
 #include <elf.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <deque>
+#include <vector>
+
 #include <unwindstack/Memory.h>
 #include <unwindstack/Regs.h>
 
@@ -26,6 +30,44 @@
 
 namespace unwindstack {
 
+static uint32_t Prel31Addr(uint32_t offset, uint32_t data) {
+  // Sign extend the value if necessary.
+  int32_t value = (static_cast<int32_t>(data) << 1) >> 1;
+  return offset + value;
+}
+
+void ElfInterfaceArm::InitTable() {
+  if (table_initialized_ || start_offset_ == 0 || total_entries_ == 0) {
+    return;
+  }
+  table_initialized_ = true;
+
+  // Read in chunks so that a bad entry count does not allocate more than
+  // what is actually there.
+  constexpr size_t kChunkEntries = 512;
+  std::vector<uint32_t> chunk(kChunkEntries * 2);
+  for (size_t index = 0; index < total_entries_;) {
+    size_t count = std::min(kChunkEntries, total_entries_ - index);
+    uint64_t offset = start_offset_ + index * 8;
+    if (memory_->Read(offset, chunk.data(), count * 8)) {
+      for (size_t i = 0; i < count; i++) {
+        table_.push_back(Prel31Addr(offset + i * 8, chunk[i * 2]));
+      }
+    } else {
+      // Only the first word of each entry is needed here.
+      for (size_t i = 0; i < count; i++) {
+        uint32_t addr;
+        if (!GetPrel31Addr(offset + i * 8, &addr)) {
+          std::vector<uint32_t>().swap(table_);
+          return;
+        }
+        table_.push_back(addr);
+      }
+    }
+    index += count;
+  }
+}
+
 bool ElfInterfaceArm::FindEntry(uint32_t pc, uint64_t* entry_offset) {
   if (start_offset_ == 0 || total_entries_ == 0) {
     return false;
@@ -37,6 +79,16 @@ bool ElfInterfaceArm::FindEntry(uint32_t pc, uint64_t* entry_offset) {
   }
   pc -= load_bias_;
 
+  InitTable();
+  if (!table_.empty()) {
+    auto entry = std::upper_bound(table_.begin(), table_.end(), pc);
+    if (entry == table_.begin()) {
+      return false;
+    }
+    *entry_offset = start_offset_ + (entry - table_.begin() - 1) * 8;
+    return true;
+  }
+
   size_t first = 0;
   size_t last = total_entries_;
   while (first < last) {
@@ -71,9 +123,33 @@ bool ElfInterfaceArm::GetPrel31Addr(uint32_t offset, uint32_t* addr) {
     return false;
   }
 
-  // Sign extend the value if necessary.
-  int32_t value = (static_cast<int32_t>(data) << 1) >> 1;
-  *addr = offset + value;
+  *addr = Prel31Addr(offset, data);
+  return true;
+}
+
+bool ElfInterfaceArm::ExtractEntryData(uint64_t entry_offset, ArmExidx* arm) {
+  auto entry = entries_.find(entry_offset);
+  if (entry != entries_.end()) {
+    if (entry->second.size == 0) {
+      // A cant unwind entry.
+      return false;
+    }
+    const uint8_t* data = &entries_data_[entry->second.offset];
+    arm->data()->assign(data, data + entry->second.size);
+    return true;
+  }
+
+  if (!arm->ExtractEntryData(entry_offset)) {
+    // Anything else may only be a failed read, so try it again next time.
+    if (arm->status() == ARM_STATUS_NO_UNWIND) {
+      entries_[entry_offset] = EntryData{0, 0};
+    }
+    return false;
+  }
+  std::deque<uint8_t>* data = arm->data();
+  entries_[entry_offset] =
+      EntryData{static_cast<uint32_t>(entries_data_.size()), static_cast<uint8_t>(data->size())};
+  entries_data_.insert(entries_data_.end(), data->begin(), data->end());
   return true;
 }
 
@@ -115,7 +191,7 @@ bool ElfInterfaceArm::StepExidx(uint64_t pc, Regs* regs, Memory* process_memory)
   }
   ArmExidx arm(regs_arm, memory_, process_memory);
   arm.set_cfa(regs_arm->sp());
-  if (arm.ExtractEntryData(entry_offset) && arm.Eval()) {
+  if (ExtractEntryData(entry_offset, &arm) && arm.Eval()) {
     // If the pc was not set, then use the LR registers for the PC.
     if (!arm.pc_set()) {
       regs_arm->set_pc((*regs_arm)[ARM_REG_LR]);
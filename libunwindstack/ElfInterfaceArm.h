@@ -22,12 +22,16 @@
 
 #include <iterator>
 #include <unordered_map>
+#include <vector>
 
 #include <unwindstack/ElfInterface.h>
 #include <unwindstack/Memory.h>
 
 namespace unwindstack {
 
+// Forward declarations.
+class ArmExidx;
+
 class ElfInterfaceArm : public ElfInterface32 {
  public:
   ElfInterfaceArm(Memory* memory) : ElfInterface32(memory) {}
@@ -46,6 +50,9 @@ class ElfInterfaceArm : public ElfInterface32 {
     bool operator!=(const iterator& rhs) { return this->index_ != rhs.index_; }
 
     uint32_t operator*() {
+      if (!interface_->table_.empty()) {
+        return interface_->table_[index_];
+      }
       uint32_t addr = interface_->addrs_[index_];
       if (addr == 0) {
         if (!interface_->GetPrel31Addr(interface_->start_offset_ + index_ * 8, &addr)) {
@@ -61,13 +68,19 @@ class ElfInterfaceArm : public ElfInterface32 {
     size_t index_ = 0;
   };
 
-  iterator begin() { return iterator(this, 0); }
+  iterator begin() {
+    InitTable();
+    return iterator(this, 0);
+  }
   iterator end() { return iterator(this, total_entries_); }
 
   bool GetPrel31Addr(uint32_t offset, uint32_t* addr);
 
   bool FindEntry(uint32_t pc, uint64_t* entry_offset);
 
+  // Like ArmExidx::ExtractEntryData(), but only reads an entry once.
+  bool ExtractEntryData(uint64_t entry_offset, ArmExidx* arm);
+
   bool HandleType(uint64_t offset, uint32_t type) override;
 
   bool Step(uint64_t pc, Regs* regs, Memory* process_memory) override;
@@ -83,10 +96,25 @@ class ElfInterfaceArm : public ElfInterface32 {
   void set_total_entries(size_t total_entries) { total_entries_ = total_entries; }
 
  private:
+  void InitTable();
+
   uint64_t start_offset_ = 0;
   size_t total_entries_ = 0;
 
+  // The pcs of all of the entries, read at once the first time one is
+  // needed. Only when that fails are they read one at a time into addrs_.
+  bool table_initialized_ = false;
+  std::vector<uint32_t> table_;
   std::unordered_map<size_t, uint32_t> addrs_;
+
+  // The unwind instructions of the entries already extracted, as offsets
+  // into entries_data_. Entries that can not be unwound have no data.
+  struct EntryData {
+    uint32_t offset;
+    uint8_t size;
+  };
+  std::unordered_map<uint64_t, EntryData> entries_;
+  std::vector<uint8_t> entries_data_;
 };
 
 }  // namespace unwindstack
@@ -21,12 +21,39 @@
 #include <string>
 
 #include <unwindstack/Elf.h>
+#include <unwindstack/ElfCache.h>
 #include <unwindstack/MapInfo.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
 
 namespace unwindstack {
 
+MemoryFileAtOffset* MapInfo::CreateFileMemory() {
+  std::unique_ptr<MemoryFileAtOffset> file_memory(new MemoryFileAtOffset);
+  uint64_t map_size;
+  if (offset != 0) {
+    // Only map in a piece of the file.
+    map_size = end - start;
+  } else {
+    map_size = UINT64_MAX;
+  }
+  if (!file_memory->Init(name, offset, map_size)) {
+    return nullptr;
+  }
+
+  // It's possible that a non-zero offset might not be pointing to
+  // valid elf data. Check if this is a valid elf, and if not assume
+  // that this was meant to incorporate the entire file.
+  if (offset != 0 && !Elf::IsValidElf(file_memory.get())) {
+    // Don't bother checking the validity that will happen on the elf init.
+    if (!file_memory->Init(name, 0)) {
+      return nullptr;
+    }
+    elf_offset = offset;
+  }
+  return file_memory.release();
+}
+
 Memory* MapInfo::CreateMemory(pid_t pid) {
   if (end <= start) {
     return nullptr;
@@ -41,29 +68,11 @@ Memory* MapInfo::CreateMemory(pid_t pid) {
       return nullptr;
     }
 
-    std::unique_ptr<MemoryFileAtOffset> file_memory(new MemoryFileAtOffset);
-    uint64_t map_size;
-    if (offset != 0) {
-      // Only map in a piece of the file.
-      map_size = end - start;
-    } else {
-      map_size = UINT64_MAX;
-    }
-    if (file_memory->Init(name, offset, map_size)) {
-      // It's possible that a non-zero offset might not be pointing to
-      // valid elf data. Check if this is a valid elf, and if not assume
-      // that this was meant to incorporate the entire file.
-      if (offset != 0 && !Elf::IsValidElf(file_memory.get())) {
-        // Don't bother checking the validity that will happen on the elf init.
-        if (file_memory->Init(name, 0)) {
-          elf_offset = offset;
-          return file_memory.release();
-        }
-        // Fall through if the init fails.
-      } else {
-        return file_memory.release();
-      }
+    Memory* file_memory = CreateFileMemory();
+    if (file_memory != nullptr) {
+      return file_memory;
     }
+    // Fall through if the init fails.
   }
 
   Memory* memory = nullptr;
@@ -77,16 +86,43 @@ Memory* MapInfo::CreateMemory(pid_t pid) {
 
 Elf* MapInfo::GetElf(pid_t pid, bool init_gnu_debugdata) {
   if (elf) {
-    return elf;
+    return elf.get();
+  }
+
+  // Only the files can be shared, the memory of a process is its own.
+  ElfCache::Key key;
+  if (end > start && !name.empty() && !(flags & MAPS_FLAGS_DEVICE_MAP) && ElfCache::Enabled() &&
+      key.Init(name, offset)) {
+    elf = ElfCache::Get(key, &elf_offset);
+    if (elf) {
+      if (init_gnu_debugdata) {
+        elf->InitGnuDebugdata();
+      }
+      return elf.get();
+    }
+
+    elf_offset = 0;
+    MemoryFileAtOffset* file_memory = CreateFileMemory();
+    if (file_memory != nullptr) {
+      uint64_t file_size = file_memory->Size();
+      elf.reset(new Elf(file_memory));
+      elf->Init();
+      // Another thread might have cached the same file in the meantime.
+      ElfCache::Add(key, &elf, &elf_offset, file_size);
+      if (init_gnu_debugdata) {
+        elf->InitGnuDebugdata();
+      }
+      return elf.get();
+    }
   }
 
-  elf = new Elf(CreateMemory(pid));
+  elf.reset(new Elf(CreateMemory(pid)));
   if (elf->Init() && init_gnu_debugdata) {
     elf->InitGnuDebugdata();
   }
   // If the init fails, keep the elf around as an invalid object so we
   // don't try to reinit the object.
-  return elf;
+  return elf.get();
 }
 
 }  // namespace unwindstack
@@ -19,6 +19,7 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -27,6 +28,7 @@
 
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <unwindstack/Elf.h>
@@ -55,35 +57,98 @@ MapInfo* Maps::Find(uint64_t pc) {
   return nullptr;
 }
 
-bool Maps::ParseLine(const char* line, MapInfo* map_info) {
-  char permissions[5];
-  int name_pos;
-  // Linux /proc/<pid>/maps lines:
-  // 6f000000-6f01e000 rwxp 00000000 00:0c 16389419   /system/lib/libcomposer.so
-  if (sscanf(line, "%" SCNx64 "-%" SCNx64 " %4s %" SCNx64 " %*x:%*x %*d %n", &map_info->start,
-             &map_info->end, permissions, &map_info->offset, &name_pos) != 4) {
+static bool ParseHex(const char** cur, const char* end, uint64_t* value) {
+  const char* data = *cur;
+  uint64_t result = 0;
+  for (; data < end; data++) {
+    unsigned digit;
+    if (*data >= '0' && *data <= '9') {
+      digit = *data - '0';
+    } else if (*data >= 'a' && *data <= 'f') {
+      digit = *data - 'a' + 10;
+    } else if (*data >= 'A' && *data <= 'F') {
+      digit = *data - 'A' + 10;
+    } else {
+      break;
+    }
+    result = (result << 4) | digit;
+  }
+  if (data == *cur) {
+    return false;
+  }
+  *cur = data;
+  *value = result;
+  return true;
+}
+
+static bool SkipSpaces(const char** cur, const char* end) {
+  const char* data = *cur;
+  while (data < end && (*data == ' ' || *data == '\t')) {
+    data++;
+  }
+  if (data == *cur) {
+    return false;
+  }
+  *cur = data;
+  return true;
+}
+
+// Linux /proc/<pid>/maps lines:
+// 6f000000-6f01e000 rwxp 00000000 00:0c 16389419   /system/lib/libcomposer.so
+// Parsed by hand, sscanf() is most of the cost of parsing a process with
+// thousands of maps.
+static bool ParseMapsLine(const char* line, const char* end, MapInfo* map_info) {
+  if (end > line && end[-1] == '\n') {
+    end--;
+  }
+
+  const char* cur = line;
+  if (!ParseHex(&cur, end, &map_info->start) || cur == end || *cur++ != '-' ||
+      !ParseHex(&cur, end, &map_info->end) || !SkipSpaces(&cur, end)) {
     return false;
   }
+
+  const char* permissions = cur;
+  while (cur < end && cur - permissions < 4 && *cur != ' ' && *cur != '\t') {
+    cur++;
+  }
+  size_t permissions_len = cur - permissions;
   map_info->flags = PROT_NONE;
-  if (permissions[0] == 'r') {
+  if (permissions_len > 0 && permissions[0] == 'r') {
     map_info->flags |= PROT_READ;
   }
-  if (permissions[1] == 'w') {
+  if (permissions_len > 1 && permissions[1] == 'w') {
     map_info->flags |= PROT_WRITE;
   }
-  if (permissions[2] == 'x') {
+  if (permissions_len > 2 && permissions[2] == 'x') {
     map_info->flags |= PROT_EXEC;
   }
 
-  if (line[name_pos] != '\0') {
-    map_info->name = &line[name_pos];
-    size_t length = map_info->name.length() - 1;
-    if (map_info->name[length] == '\n') {
-      map_info->name.erase(length);
-    }
+  // The device and inode are not used.
+  uint64_t unused;
+  if (permissions_len == 0 || !SkipSpaces(&cur, end) ||
+      !ParseHex(&cur, end, &map_info->offset) || !SkipSpaces(&cur, end) ||
+      !ParseHex(&cur, end, &unused) || cur == end || *cur++ != ':' ||
+      !ParseHex(&cur, end, &unused) || !SkipSpaces(&cur, end)) {
+    return false;
+  }
+  const char* inode = cur;
+  while (cur < end && *cur >= '0' && *cur <= '9') {
+    cur++;
+  }
+  if (cur == inode) {
+    return false;
+  }
+  if (cur != end && !SkipSpaces(&cur, end)) {
+    return false;
+  }
+
+  if (cur != end) {
+    map_info->name.assign(cur, end - cur);
 
     // Mark a device map in /dev/and not in /dev/ashmem/ specially.
-    if (map_info->name.substr(0, 5) == "/dev/" && map_info->name.substr(5, 7) != "ashmem/") {
+    if (map_info->name.compare(0, 5, "/dev/") == 0 &&
+        map_info->name.compare(5, 7, "ashmem/") != 0) {
       map_info->flags |= MAPS_FLAGS_DEVICE_MAP;
     }
   }
@@ -91,50 +156,96 @@ bool Maps::ParseLine(const char* line, MapInfo* map_info) {
   return true;
 }
 
+bool Maps::ParseLine(const char* line, MapInfo* map_info) {
+  return ParseMapsLine(line, line + strlen(line), map_info);
+}
+
 bool Maps::Parse() {
-  std::unique_ptr<FILE, decltype(&fclose)> fp(fopen(GetMapsFile().c_str(), "re"), fclose);
-  if (!fp) {
+  android::base::unique_fd fd(
+      TEMP_FAILURE_RETRY(open(GetMapsFile().c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd == -1) {
     return false;
   }
 
-  bool valid = true;
-  char* line = nullptr;
-  size_t line_len;
-  while (getline(&line, &line_len, fp.get()) > 0) {
-    MapInfo map_info;
-    if (!ParseLine(line, &map_info)) {
-      valid = false;
+  // Read in large chunks, only a partial last line is carried over.
+  std::vector<char> buffer(kReadBufferSize);
+  size_t used = 0;
+  while (true) {
+    if (used == buffer.size()) {
+      buffer.resize(buffer.size() * 2);
+    }
+    ssize_t bytes = TEMP_FAILURE_RETRY(read(fd, &buffer[used], buffer.size() - used));
+    if (bytes == -1) {
+      return false;
+    }
+    if (bytes == 0) {
       break;
     }
+    used += bytes;
 
-    maps_.push_back(map_info);
+    const char* line = buffer.data();
+    const char* end = line + used;
+    const char* end_of_line;
+    while ((end_of_line = reinterpret_cast<const char*>(memchr(line, '\n', end - line))) !=
+           nullptr) {
+      MapInfo map_info;
+      if (!ParseMapsLine(line, end_of_line, &map_info)) {
+        return false;
+      }
+      maps_.push_back(map_info);
+      line = end_of_line + 1;
+    }
+    used = end - line;
+    memmove(buffer.data(), line, used);
   }
-  free(line);
 
-  return valid;
+  if (used != 0) {
+    MapInfo map_info;
+    if (!ParseMapsLine(buffer.data(), buffer.data() + used, &map_info)) {
+      return false;
+    }
+    maps_.push_back(map_info);
+  }
+  return true;
 }
 
-Maps::~Maps() {
-  for (auto& map : maps_) {
-    delete map.elf;
-    map.elf = nullptr;
+bool Maps::Refresh() {
+  std::vector<MapInfo> old_maps;
+  old_maps.swap(maps_);
+  if (!Parse()) {
+    maps_.swap(old_maps);
+    return false;
+  }
+
+  // Both lists are sorted by address, so a single pass finds every map
+  // that is still the same and keeps its elf.
+  auto old_info = old_maps.begin();
+  for (auto& info : maps_) {
+    while (old_info != old_maps.end() && old_info->start < info.start) {
+      ++old_info;
+    }
+    if (old_info == old_maps.end()) {
+      break;
+    }
+    if (old_info->start == info.start && old_info->end == info.end &&
+        old_info->offset == info.offset && old_info->flags == info.flags &&
+        old_info->name == info.name) {
+      info.elf = std::move(old_info->elf);
+      info.elf_offset = old_info->elf_offset;
+    }
   }
+  return true;
 }
 
 bool BufferMaps::Parse() {
   const char* start_of_line = buffer_;
   do {
-    std::string line;
     const char* end_of_line = strchr(start_of_line, '\n');
-    if (end_of_line == nullptr) {
-      line = start_of_line;
-    } else {
-      end_of_line++;
-      line = std::string(start_of_line, end_of_line - start_of_line);
-    }
+    const char* end = (end_of_line == nullptr) ? start_of_line + strlen(start_of_line)
+                                               : ++end_of_line;
 
     MapInfo map_info;
-    if (!ParseLine(line.c_str(), &map_info)) {
+    if (!ParseMapsLine(start_of_line, end, &map_info)) {
       return false;
     }
     maps_.push_back(map_info);
@@ -25,6 +25,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <utility>
 
 #include <android-base/unique_fd.h>
 
@@ -148,13 +149,33 @@ bool MemoryRemote::PtraceRead(uint64_t addr, long* value) {
   return true;
 }
 
-bool MemoryRemote::Read(uint64_t addr, void* dst, size_t bytes) {
-  // Make sure that there is no overflow.
-  uint64_t max_size;
-  if (__builtin_add_overflow(addr, bytes, &max_size)) {
-    return false;
+size_t MemoryRemote::ProcessVmRead(uint64_t addr, void* dst, size_t size) {
+#if !defined(__LP64__)
+  // Cannot read an address greater than 32 bits.
+  if (addr > UINT32_MAX || size > UINT32_MAX - addr) {
+    return 0;
+  }
+#endif
+  struct iovec local_io;
+  local_io.iov_base = dst;
+  local_io.iov_len = size;
+
+  struct iovec remote_io;
+  remote_io.iov_base = reinterpret_cast<void*>(static_cast<uintptr_t>(addr));
+  remote_io.iov_len = size;
+
+  ssize_t bytes_read = process_vm_readv(pid_, &local_io, 1, &remote_io, 1, 0);
+  if (bytes_read == -1) {
+    if (errno == ENOSYS) {
+      // Don't bother trying again.
+      vm_read_supported_ = false;
+    }
+    return 0;
   }
+  return bytes_read;
+}
 
+bool MemoryRemote::PtraceReadFully(uint64_t addr, void* dst, size_t bytes) {
   size_t bytes_read = 0;
   long data;
   size_t align_bytes = addr & (sizeof(long) - 1);
@@ -191,6 +212,27 @@ bool MemoryRemote::Read(uint64_t addr, void* dst, size_t bytes) {
   return true;
 }
 
+bool MemoryRemote::Read(uint64_t addr, void* dst, size_t bytes) {
+  // Make sure that there is no overflow.
+  uint64_t max_size;
+  if (__builtin_add_overflow(addr, bytes, &max_size)) {
+    return false;
+  }
+
+  // One process_vm_readv() instead of a ptrace() per word. It stops at the
+  // first page it can not read, ptrace() gets to try the rest since it can
+  // also read pages mapped without read permission.
+  size_t bytes_read = 0;
+  if (vm_read_supported_) {
+    bytes_read = ProcessVmRead(addr, dst, bytes);
+    if (bytes_read == bytes) {
+      return true;
+    }
+  }
+  return PtraceReadFully(addr + bytes_read, reinterpret_cast<uint8_t*>(dst) + bytes_read,
+                         bytes - bytes_read);
+}
+
 bool MemoryLocal::Read(uint64_t addr, void* dst, size_t size) {
   // Make sure that there is no overflow.
   uint64_t max_size;
@@ -249,6 +291,51 @@ bool MemoryOffline::Read(uint64_t addr, void* dst, size_t size) {
   return true;
 }
 
+const uint8_t* MemoryCache::GetPage(uint64_t page) {
+  auto entry = pages_.find(page);
+  if (entry != pages_.end()) {
+    return entry->second.data();
+  }
+  if (bad_pages_.count(page) != 0) {
+    return nullptr;
+  }
+
+  if (pages_.size() + bad_pages_.size() >= kMaxPages) {
+    Clear();
+  }
+  std::vector<uint8_t> data(kPageSize);
+  if (!impl_->Read(page, data.data(), kPageSize)) {
+    bad_pages_.insert(page);
+    return nullptr;
+  }
+  return pages_.emplace(page, std::move(data)).first->second.data();
+}
+
+bool MemoryCache::Read(uint64_t addr, void* dst, size_t size) {
+  uint64_t max_read;
+  if (__builtin_add_overflow(addr, size, &max_read) || size > kPageSize) {
+    return impl_->Read(addr, dst, size);
+  }
+
+  uint8_t* data = reinterpret_cast<uint8_t*>(dst);
+  uint64_t cur_addr = addr;
+  size_t left = size;
+  while (left != 0) {
+    uint64_t page = cur_addr & ~static_cast<uint64_t>(kPageSize - 1);
+    const uint8_t* page_data = GetPage(page);
+    if (page_data == nullptr) {
+      return impl_->Read(addr, dst, size);
+    }
+    size_t offset = cur_addr - page;
+    size_t copy_bytes = std::min(left, kPageSize - offset);
+    memcpy(data, &page_data[offset], copy_bytes);
+    data += copy_bytes;
+    cur_addr += copy_bytes;
+    left -= copy_bytes;
+  }
+  return true;
+}
+
 MemoryRange::MemoryRange(Memory* memory, uint64_t begin, uint64_t end)
     : memory_(memory), begin_(begin), length_(end - begin) {
   CHECK(end > begin);
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/ProcessUnwinder.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+namespace {
+
+// The threads of a process share its address space, so all the workers
+// use one cache of its pages. MemoryCache is not thread safe.
+class MemorySharedCache : public Memory {
+ public:
+  MemorySharedCache(pid_t pid) : cache_(new MemoryRemote(pid)) {}
+  virtual ~MemorySharedCache() = default;
+
+  bool Read(uint64_t addr, void* dst, size_t size) override {
+    std::lock_guard<std::mutex> guard(lock_);
+    return cache_.Read(addr, dst, size);
+  }
+
+ private:
+  std::mutex lock_;
+  MemoryCache cache_;
+};
+
+// MapInfo::GetElf is not thread safe, the workers take turns.
+class ThreadUnwinder : public Unwinder {
+ public:
+  ThreadUnwinder(size_t max_frames, pid_t pid, Maps* maps, Regs* regs, Memory* process_memory,
+                 std::mutex* elf_lock)
+      : Unwinder(max_frames, pid, maps, regs, process_memory), elf_lock_(elf_lock) {}
+  virtual ~ThreadUnwinder() = default;
+
+ protected:
+  Elf* GetElf(MapInfo* map_info) override {
+    std::lock_guard<std::mutex> guard(*elf_lock_);
+    return Unwinder::GetElf(map_info);
+  }
+
+ private:
+  std::mutex* elf_lock_;
+};
+
+}  // namespace
+
+ProcessUnwinder::ProcessUnwinder(pid_t pid, size_t max_frames)
+    : pid_(pid), max_frames_(max_frames), maps_(pid), memory_(new MemorySharedCache(pid)) {}
+
+ProcessUnwinder::~ProcessUnwinder() = default;
+
+bool ProcessUnwinder::Init() {
+  return maps_.Parse();
+}
+
+void ProcessUnwinder::UnwindThread(Regs* regs, ThreadUnwind* thread) {
+  ThreadUnwinder unwinder(max_frames_, pid_, &maps_, regs, memory_.get(), &elf_lock_);
+  unwinder.set_use_frame_pointers(use_frame_pointers_);
+  unwinder.Unwind();
+  thread->frames.swap(*unwinder.mutable_frames());
+}
+
+void ProcessUnwinder::Unwind(const std::vector<pid_t>& tids, std::vector<ThreadUnwind>* threads,
+                             size_t num_workers) {
+  threads->clear();
+  threads->resize(tids.size());
+
+  // ptrace requests only work from the thread that attached, so get all
+  // of the registers first. The memory is read with process_vm_readv,
+  // which works from any thread.
+  std::vector<std::unique_ptr<Regs>> regs(tids.size());
+  for (size_t i = 0; i < tids.size(); i++) {
+    ThreadUnwind* thread = &(*threads)[i];
+    thread->tid = tids[i];
+    thread->machine_type = 0;
+    regs[i].reset(Regs::RemoteGet(tids[i], &thread->machine_type));
+    thread->regs_valid = regs[i] != nullptr;
+  }
+
+  std::atomic_size_t next(0);
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next++) < tids.size()) {
+      if (regs[i] != nullptr) {
+        UnwindThread(regs[i].get(), &(*threads)[i]);
+      }
+    }
+  };
+
+  if (num_workers == 0) {
+    num_workers = std::max(1U, std::thread::hardware_concurrency());
+  }
+  num_workers = std::min(num_workers, tids.size());
+  if (num_workers <= 1) {
+    worker();
+    return;
+  }
+
+  // The calling thread is one of the workers.
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < num_workers; i++) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : pool) {
+    thread.join();
+  }
+}
+
+bool ProcessUnwinder::GetThreads(pid_t pid, std::vector<pid_t>* tids) {
+  std::string task_dir = "/proc/" + std::to_string(pid) + "/task";
+  std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(task_dir.c_str()), closedir);
+  if (dir == nullptr) {
+    return false;
+  }
+
+  tids->clear();
+  struct dirent* entry;
+  while ((entry = readdir(dir.get())) != nullptr) {
+    pid_t tid = atoi(entry->d_name);
+    if (tid > 0) {
+      tids->push_back(tid);
+    }
+  }
+  std::sort(tids->begin(), tids->end());
+  return true;
+}
+
+}  // namespace unwindstack
@@ -16,6 +16,7 @@
 
 #include <elf.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <sys/ptrace.h>
 #include <sys/uio.h>
 
@@ -23,6 +24,7 @@
 
 #include <unwindstack/Elf.h>
 #include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
 #include <unwindstack/Regs.h>
 
@@ -53,6 +55,29 @@ bool RegsImpl<AddressType>::GetReturnAddressFromDefault(Memory* memory, uint64_t
   }
 }
 
+template <typename AddressType>
+bool RegsImpl<AddressType>::StepFrameRecord(Memory* process_memory, Maps* maps, uint16_t fp_reg,
+                                            uint16_t pc_reg) {
+  AddressType fp = regs_[fp_reg];
+  if (fp < sp_ || (fp & (sizeof(AddressType) - 1)) != 0) {
+    return false;
+  }
+  AddressType record[2];
+  if (!process_memory->Read(fp, record, sizeof(record))) {
+    return false;
+  }
+  MapInfo* map_info = maps->Find(record[1]);
+  if (map_info == nullptr || (map_info->flags & PROT_EXEC) == 0) {
+    return false;
+  }
+
+  regs_[fp_reg] = record[0];
+  regs_[pc_reg] = record[1];
+  regs_[sp_reg_] = fp + sizeof(record);
+  SetFromRaw();
+  return true;
+}
+
 RegsArm::RegsArm()
     : RegsImpl<uint32_t>(ARM_REG_LAST, ARM_REG_SP, Location(LOCATION_REGISTER, ARM_REG_LR)) {}
 
@@ -420,6 +445,12 @@ bool RegsArm::StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_mem
   return true;
 }
 
+bool RegsArm::StepFramePointer(Memory*, Maps*) {
+  // Where r7/r11 point depends on the compiler and on arm versus thumb,
+  // there is no frame record layout that can be trusted.
+  return false;
+}
+
 bool RegsArm64::StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_memory) {
   uint64_t data;
   Memory* elf_memory = elf->memory();
@@ -447,6 +478,10 @@ bool RegsArm64::StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_m
   return true;
 }
 
+bool RegsArm64::StepFramePointer(Memory* process_memory, Maps* maps) {
+  return StepFrameRecord(process_memory, maps, ARM64_REG_R29, ARM64_REG_PC);
+}
+
 bool RegsX86::StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_memory) {
   uint64_t data;
   Memory* elf_memory = elf->memory();
@@ -508,6 +543,10 @@ bool RegsX86::StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_mem
   return false;
 }
 
+bool RegsX86::StepFramePointer(Memory* process_memory, Maps* maps) {
+  return StepFrameRecord(process_memory, maps, X86_REG_EBP, X86_REG_PC);
+}
+
 bool RegsX86_64::StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_memory) {
   uint64_t data;
   Memory* elf_memory = elf->memory();
@@ -537,4 +576,8 @@ bool RegsX86_64::StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_
   return true;
 }
 
+bool RegsX86_64::StepFramePointer(Memory* process_memory, Maps* maps) {
+  return StepFrameRecord(process_memory, maps, X86_64_REG_RBP, X86_64_REG_PC);
+}
+
 }  // namespace unwindstack
@@ -16,96 +16,122 @@
 
 #include <elf.h>
 #include <stdint.h>
+#include <string.h>
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include <unwindstack/Memory.h>
 
-#include "Check.h"
 #include "Symbols.h"
 
 namespace unwindstack {
 
 Symbols::Symbols(uint64_t offset, uint64_t size, uint64_t entry_size, uint64_t str_offset,
                  uint64_t str_size)
-    : cur_offset_(offset),
-      offset_(offset),
+    : offset_(offset),
       end_(offset + size),
       entry_size_(entry_size),
       str_offset_(str_offset),
       str_end_(str_offset_ + str_size) {}
 
-const Symbols::Info* Symbols::GetInfoFromCache(uint64_t addr) {
-  // Binary search the table.
-  size_t first = 0;
-  size_t last = symbols_.size();
-  while (first < last) {
-    size_t current = first + (last - first) / 2;
-    const Info* info = &symbols_[current];
-    if (addr < info->start_offset) {
-      last = current;
-    } else if (addr < info->end_offset) {
-      return info;
-    } else {
-      first = current + 1;
+template <typename SymType>
+void Symbols::BuildTable(uint64_t load_bias, Memory* elf_memory) {
+  struct Info {
+    uint64_t start;
+    uint64_t end;
+    uint32_t name;
+  };
+  std::vector<Info> infos;
+
+  std::vector<uint8_t> buffer;
+  uint64_t cur_offset = offset_;
+  while (cur_offset + entry_size_ <= end_) {
+    // Read a batch of entries at once, or one at a time if the whole batch
+    // can not be read.
+    size_t entries = std::min<uint64_t>(kReadEntries, (end_ - cur_offset) / entry_size_);
+    size_t bytes = (entries - 1) * entry_size_ + sizeof(SymType);
+    buffer.resize(bytes);
+    if (!elf_memory->Read(cur_offset, buffer.data(), bytes)) {
+      entries = 1;
+      bytes = sizeof(SymType);
+      if (!elf_memory->Read(cur_offset, buffer.data(), bytes)) {
+        // Stop all processing, something looks like it is corrupted.
+        break;
+      }
     }
+
+    for (size_t i = 0; i < entries; i++) {
+      SymType entry;
+      memcpy(&entry, &buffer[i * entry_size_], sizeof(entry));
+      if (entry.st_shndx == SHN_UNDEF || ELF32_ST_TYPE(entry.st_info) != STT_FUNC ||
+          entry.st_size == 0) {
+        continue;
+      }
+      // Treat st_value as virtual address.
+      uint64_t start = entry.st_value;
+      if (entry.st_shndx != SHN_ABS) {
+        start += load_bias;
+      }
+      infos.push_back(Info{start, start + entry.st_size, entry.st_name});
+    }
+    cur_offset += entries * entry_size_;
+  }
+
+  std::sort(infos.begin(), infos.end(),
+            [](const Info& a, const Info& b) { return a.start < b.start; });
+  starts_.resize(infos.size());
+  ends_.resize(infos.size());
+  names_.resize(infos.size());
+  for (size_t i = 0; i < infos.size(); i++) {
+    starts_[i] = infos[i].start;
+    ends_[i] = infos[i].end;
+    names_[i] = infos[i].name;
   }
-  return nullptr;
+}
+
+ssize_t Symbols::Find(uint64_t addr) {
+  size_t total = starts_.size();
+  if (total == 0 || addr < starts_[0]) {
+    return -1;
+  }
+
+  // Find the last start <= addr, written so that the compiler can use
+  // conditional moves instead of branches.
+  const uint64_t* base = starts_.data();
+  while (total > 1) {
+    size_t half = total / 2;
+    base = (base[half] <= addr) ? base + half : base;
+    total -= half;
+  }
+  size_t index = base - starts_.data();
+  if (addr >= ends_[index]) {
+    return -1;
+  }
+  return index;
 }
 
 template <typename SymType>
 bool Symbols::GetName(uint64_t addr, uint64_t load_bias, Memory* elf_memory, std::string* name,
                       uint64_t* func_offset) {
-  addr += load_bias;
-
-  if (symbols_.size() != 0) {
-    const Info* info = GetInfoFromCache(addr);
-    if (info) {
-      CHECK(addr >= info->start_offset && addr <= info->end_offset);
-      *func_offset = addr - info->start_offset;
-      return elf_memory->ReadString(info->str_offset, name, str_end_ - info->str_offset);
-    }
+  if (!initialized_) {
+    BuildTable<SymType>(load_bias, elf_memory);
+    initialized_ = true;
   }
 
-  bool symbol_added = false;
-  bool return_value = false;
-  while (cur_offset_ + entry_size_ <= end_) {
-    SymType entry;
-    if (!elf_memory->Read(cur_offset_, &entry, sizeof(entry))) {
-      // Stop all processing, something looks like it is corrupted.
-      cur_offset_ = UINT64_MAX;
-      return false;
-    }
-    cur_offset_ += entry_size_;
-
-    if (entry.st_shndx != SHN_UNDEF && ELF32_ST_TYPE(entry.st_info) == STT_FUNC) {
-      // Treat st_value as virtual address.
-      uint64_t start_offset = entry.st_value;
-      if (entry.st_shndx != SHN_ABS) {
-        start_offset += load_bias;
-      }
-      uint64_t end_offset = start_offset + entry.st_size;
-
-      // Cache the value.
-      symbols_.emplace_back(start_offset, end_offset, str_offset_ + entry.st_name);
-      symbol_added = true;
-
-      if (addr >= start_offset && addr < end_offset) {
-        *func_offset = addr - start_offset;
-        uint64_t offset = str_offset_ + entry.st_name;
-        if (offset < str_end_) {
-          return_value = elf_memory->ReadString(offset, name, str_end_ - offset);
-        }
-        break;
-      }
-    }
+  addr += load_bias;
+  ssize_t index = Find(addr);
+  if (index == -1) {
+    return false;
   }
 
-  if (symbol_added) {
-    std::sort(symbols_.begin(), symbols_.end(),
-              [](const Info& a, const Info& b) { return a.start_offset < b.start_offset; });
+  *func_offset = addr - starts_[index];
+  uint64_t offset = str_offset_ + names_[index];
+  if (offset >= str_end_) {
+    return false;
   }
-  return return_value;
+  return elf_memory->ReadString(offset, name, str_end_ - offset);
 }
 
 // Instantiate all of the needed template functions.
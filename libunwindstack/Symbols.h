@@ -18,6 +18,7 @@
 #define _LIBUNWINDSTACK_SYMBOLS_H
 
 #include <stdint.h>
+#include <sys/types.h>
 
 #include <string>
 #include <vector>
@@ -27,40 +28,47 @@ namespace unwindstack {
 // Forward declaration.
 class Memory;
 
+// The function symbols of one symbol table, read in full the first time a
+// name is needed and then kept as parallel arrays sorted by address, so
+// that a lookup is a binary search over the start addresses alone.
 class Symbols {
-  struct Info {
-    Info(uint64_t start_offset, uint64_t end_offset, uint64_t str_offset)
-        : start_offset(start_offset), end_offset(end_offset), str_offset(str_offset) {}
-    uint64_t start_offset;
-    uint64_t end_offset;
-    uint64_t str_offset;
-  };
-
  public:
   Symbols(uint64_t offset, uint64_t size, uint64_t entry_size, uint64_t str_offset,
           uint64_t str_size);
   virtual ~Symbols() = default;
 
-  const Info* GetInfoFromCache(uint64_t addr);
-
   template <typename SymType>
   bool GetName(uint64_t addr, uint64_t load_bias, Memory* elf_memory, std::string* name,
                uint64_t* func_offset);
 
   void ClearCache() {
-    symbols_.clear();
-    cur_offset_ = offset_;
+    starts_.clear();
+    ends_.clear();
+    names_.clear();
+    initialized_ = false;
   }
 
  private:
-  uint64_t cur_offset_;
+  // Entries read from the table with a single Read when possible.
+  static constexpr size_t kReadEntries = 256;
+
+  template <typename SymType>
+  void BuildTable(uint64_t load_bias, Memory* elf_memory);
+
+  // Index of the function containing addr, or -1.
+  ssize_t Find(uint64_t addr);
+
   uint64_t offset_;
   uint64_t end_;
   uint64_t entry_size_;
   uint64_t str_offset_;
   uint64_t str_end_;
 
-  std::vector<Info> symbols_;
+  bool initialized_ = false;
+  std::vector<uint64_t> starts_;
+  std::vector<uint64_t> ends_;
+  // Offsets into the string table, st_name is 32 bits for both classes.
+  std::vector<uint32_t> names_;
 };
 
 }  // namespace unwindstack
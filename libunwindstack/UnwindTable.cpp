@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include <android-base/unique_fd.h>
+
+#include <unwindstack/DwarfLocation.h>
+#include <unwindstack/DwarfStructs.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/UnwindTable.h>
+
+#include "DwarfEhFrame.h"
+
+namespace unwindstack {
+
+UnwindTable::~UnwindTable() {
+  Clear();
+}
+
+void UnwindTable::Clear() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+    data_ = nullptr;
+  }
+  size_ = 0;
+  header_ = nullptr;
+  rows_ = nullptr;
+  rules_ = nullptr;
+  symbols_ = nullptr;
+  strings_ = nullptr;
+}
+
+bool UnwindTable::Init(const std::string& file) {
+  // Clear out any previous data if it exists.
+  Clear();
+
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(file.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd == -1) {
+    return false;
+  }
+  struct stat buf;
+  if (fstat(fd, &buf) == -1) {
+    return false;
+  }
+  if (static_cast<uint64_t>(buf.st_size) < sizeof(UnwindTableHeader)) {
+    return false;
+  }
+
+  size_t size = buf.st_size;
+  void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  data_ = map;
+  size_ = size;
+
+  const UnwindTableHeader* header = reinterpret_cast<const UnwindTableHeader*>(data_);
+  if (header->magic != kUnwindTableMagic || header->version != kUnwindTableVersion ||
+      (header->class_type != ELFCLASS32 && header->class_type != ELFCLASS64)) {
+    Clear();
+    return false;
+  }
+
+  // None of the counts can overflow this, they are all 32 bit.
+  uint64_t rows_offset = sizeof(UnwindTableHeader);
+  uint64_t rules_offset = rows_offset + uint64_t(header->num_rows) * sizeof(UnwindTableRow);
+  uint64_t symbols_offset = rules_offset + uint64_t(header->num_rules) * sizeof(UnwindTableRule);
+  uint64_t strings_offset =
+      symbols_offset + uint64_t(header->num_symbols) * sizeof(UnwindTableSymbol);
+  if (strings_offset + header->strings_size > size_ ||
+      (header->strings_size != 0 &&
+       reinterpret_cast<const char*>(data_)[strings_offset + header->strings_size - 1] != '\0')) {
+    Clear();
+    return false;
+  }
+
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(data_);
+  header_ = header;
+  rows_ = reinterpret_cast<const UnwindTableRow*>(&data[rows_offset]);
+  rules_ = reinterpret_cast<const UnwindTableRule*>(&data[rules_offset]);
+  symbols_ = reinterpret_cast<const UnwindTableSymbol*>(&data[symbols_offset]);
+  strings_ = reinterpret_cast<const char*>(&data[strings_offset]);
+  return true;
+}
+
+const UnwindTableRow* UnwindTable::FindRow(uint64_t rel_pc) {
+  const UnwindTableRow* end = &rows_[header_->num_rows];
+  const UnwindTableRow* row =
+      std::upper_bound(rows_, end, rel_pc, [](uint64_t pc, const UnwindTableRow& entry) {
+        return pc < entry.pc_start;
+      });
+  if (row == rows_) {
+    return nullptr;
+  }
+  --row;
+  if (rel_pc >= row->pc_end) {
+    return nullptr;
+  }
+  return row;
+}
+
+template <typename AddressType>
+bool UnwindTable::StepWithTemplate(const UnwindTableRow* row, Regs* regs,
+                                   Memory* process_memory) {
+  dwarf_loc_regs_t loc_regs;
+  for (size_t i = row->rules_index; i < row->rules_index + row->num_rules; i++) {
+    const UnwindTableRule& rule = rules_[i];
+    if (rule.type == DWARF_LOCATION_EXPRESSION || rule.type == DWARF_LOCATION_VAL_EXPRESSION) {
+      // The tool never writes these, there is no expression to run.
+      return false;
+    }
+    loc_regs[rule.reg] = DwarfLocation{static_cast<DwarfLocationEnum>(rule.type),
+                                       {rule.values[0], rule.values[1]}};
+  }
+
+  // The rows only hold the rules that need nothing of the section itself,
+  // so no section memory is needed to evaluate them.
+  DwarfCie cie;
+  cie.return_address_register = row->return_address_register;
+  DwarfEhFrame<AddressType> section(nullptr);
+  return section.Eval(&cie, process_memory, loc_regs, regs);
+}
+
+bool UnwindTable::Step(uint64_t rel_pc, Regs* regs, Memory* process_memory) {
+  if (header_ == nullptr) {
+    return false;
+  }
+  const UnwindTableRow* row = FindRow(rel_pc);
+  if (row == nullptr ||
+      uint64_t(row->rules_index) + row->num_rules > uint64_t(header_->num_rules)) {
+    return false;
+  }
+  if (header_->class_type == ELFCLASS32) {
+    return StepWithTemplate<uint32_t>(row, regs, process_memory);
+  }
+  return StepWithTemplate<uint64_t>(row, regs, process_memory);
+}
+
+bool UnwindTable::GetFunctionName(uint64_t addr, std::string* name, uint64_t* func_offset) {
+  if (header_ == nullptr) {
+    return false;
+  }
+  const UnwindTableSymbol* end = &symbols_[header_->num_symbols];
+  const UnwindTableSymbol* symbol =
+      std::upper_bound(symbols_, end, addr, [](uint64_t pc, const UnwindTableSymbol& entry) {
+        return pc < entry.start;
+      });
+  if (symbol == symbols_) {
+    return false;
+  }
+  --symbol;
+  if (addr >= symbol->end || symbol->name_offset >= header_->strings_size) {
+    return false;
+  }
+  *name = &strings_[symbol->name_offset];
+  *func_offset = addr - symbol->start;
+  return true;
+}
+
+}  // namespace unwindstack
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+Elf* Unwinder::GetElf(MapInfo* map_info) {
+  return map_info->GetElf(pid_, true);
+}
+
+bool Unwinder::StepFramePointer(uint64_t rel_pc, Elf* elf) {
+  // A signal frame does not have a frame record.
+  if (elf->valid() && regs_->StepIfSignalHandler(rel_pc, elf, process_memory_)) {
+    return true;
+  }
+  return regs_->StepFramePointer(process_memory_, maps_);
+}
+
+void Unwinder::Unwind() {
+  frames_.clear();
+  for (size_t frame_num = 0; frame_num < max_frames_; frame_num++) {
+    if (regs_->pc() == 0) {
+      break;
+    }
+
+    frames_.resize(frame_num + 1);
+    FrameData* frame = &frames_.back();
+    frame->num = frame_num;
+    frame->pc = regs_->pc();
+    frame->sp = regs_->sp();
+    frame->rel_pc = frame->pc;
+
+    MapInfo* map_info = maps_->Find(regs_->pc());
+    if (map_info == nullptr) {
+      break;
+    }
+    frame->map_name = map_info->name;
+    frame->map_start = map_info->start;
+    frame->map_end = map_info->end;
+
+    Elf* elf = GetElf(map_info);
+    frame->map_offset = map_info->elf_offset;
+
+    uint64_t rel_pc = elf->GetRelPc(regs_->pc(), map_info);
+    uint64_t adjusted_rel_pc = rel_pc;
+    // Don't need to adjust the first frame pc.
+    if (frame_num != 0) {
+      adjusted_rel_pc = regs_->GetAdjustedPc(rel_pc, elf);
+    }
+    frame->rel_pc = adjusted_rel_pc;
+    if (resolve_names_ &&
+        !elf->GetFunctionName(adjusted_rel_pc, &frame->function_name, &frame->function_offset)) {
+      frame->function_name.clear();
+    }
+
+    // The first frame can be stopped anywhere, including before its frame
+    // record is set up, so it always goes through the unwind information.
+    uint64_t step_pc = rel_pc + map_info->elf_offset;
+    if (use_frame_pointers_ && frame_num != 0 && StepFramePointer(step_pc, elf)) {
+      continue;
+    }
+    if (!elf->Step(step_pc, regs_, process_memory_)) {
+      break;
+    }
+  }
+}
+
+}  // namespace unwindstack
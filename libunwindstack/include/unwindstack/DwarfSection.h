@@ -20,7 +20,10 @@
 #include <stdint.h>
 
 #include <iterator>
+#include <list>
+#include <map>
 #include <unordered_map>
+#include <vector>
 
 #include <unwindstack/DwarfLocation.h>
 #include <unwindstack/DwarfMemory.h>
@@ -32,6 +35,8 @@ namespace unwindstack {
 enum DwarfError : uint8_t;
 class Memory;
 class Regs;
+template <typename AddressType>
+class RegsImpl;
 
 class DwarfSection {
  public:
@@ -90,6 +95,10 @@ class DwarfSection {
 
   virtual bool GetCfaLocationInfo(uint64_t pc, const DwarfFde* fde, dwarf_loc_regs_t* loc_regs) = 0;
 
+  // The pcs sharing the location info found by the last GetCfaLocationInfo().
+  uint64_t loc_regs_row_start() { return loc_regs_row_start_; }
+  uint64_t loc_regs_row_end() { return loc_regs_row_end_; }
+
   virtual bool IsCie32(uint32_t value32) = 0;
 
   virtual bool IsCie64(uint64_t value64) = 0;
@@ -103,13 +112,34 @@ class DwarfSection {
   bool Step(uint64_t pc, Regs* regs, Memory* process_memory);
 
  protected:
+  // The location info of one row of an fde's cfa table, which is all Step()
+  // needs when the same pcs show up again.
+  struct LocRegsRow {
+    uint64_t pc_start;
+    uint64_t pc_end;
+    const DwarfFde* fde;
+    dwarf_loc_regs_t loc_regs;
+  };
+  static constexpr size_t kMaxLocRegsRows = 1024;
+
+  const LocRegsRow* FindLocRegsRow(uint64_t pc);
+  const LocRegsRow* AddLocRegsRow(uint64_t pc, const DwarfFde* fde, dwarf_loc_regs_t* loc_regs);
+
   DwarfMemory memory_;
   DwarfError last_error_;
 
+  // Set by GetCfaLocationInfo() to the pcs sharing the location info found.
+  uint64_t loc_regs_row_start_ = 0;
+  uint64_t loc_regs_row_end_ = 0;
+
   uint64_t fde_count_;
   std::unordered_map<uint64_t, DwarfFde> fde_entries_;
   std::unordered_map<uint64_t, DwarfCie> cie_entries_;
   std::unordered_map<uint64_t, dwarf_loc_regs_t> cie_loc_regs_;
+
+  // Most recently used first, indexed by the end of the rows.
+  std::list<LocRegsRow> loc_regs_rows_;
+  std::map<uint64_t, std::list<LocRegsRow>::iterator> loc_regs_index_;
 };
 
 template <typename AddressType>
@@ -133,7 +163,10 @@ class DwarfSectionImpl : public DwarfSection {
 
  protected:
   bool EvalExpression(const DwarfLocation& loc, uint8_t version, Memory* regular_memory,
-                      AddressType* value);
+                      RegsImpl<AddressType>* regs, AddressType* value);
+
+  // Indexed by the offset of the expression.
+  std::unordered_map<uint64_t, std::vector<DwarfExpressionOp>> expressions_;
 };
 
 }  // namespace unwindstack
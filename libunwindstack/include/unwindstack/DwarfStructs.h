@@ -47,6 +47,14 @@ struct DwarfFde {
   const DwarfCie* cie = nullptr;
 };
 
+// One op of a dwarf expression with its operands already read, made by
+// DwarfOp::Predecode(). For branches the operands are the indexes of the
+// ops to go to instead.
+struct DwarfExpressionOp {
+  uint64_t operands[2];
+  uint8_t op;
+};
+
 constexpr uint16_t CFA_REG = static_cast<uint16_t>(-1);
 
 }  // namespace unwindstack
@@ -19,11 +19,14 @@
 
 #include <stddef.h>
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include <unwindstack/ElfInterface.h>
 #include <unwindstack/Memory.h>
+#include <unwindstack/UnwindTable.h>
 
 #if !defined(EM_AARCH64)
 #define EM_AARCH64 183
@@ -68,6 +71,13 @@ class Elf {
 
   ElfInterface* gnu_debugdata_interface() { return gnu_debugdata_interface_.get(); }
 
+  // A table made by the unwind_table tool, used before the unwind
+  // information and symbols of the elf itself. Takes ownership.
+  void SetUnwindTable(UnwindTable* table);
+
+  // Heap used by the elf on top of its memory object.
+  uint64_t MemoryUsage();
+
   static bool IsValidElf(Memory* memory);
 
  protected:
@@ -77,8 +87,15 @@ class Elf {
   uint32_t machine_type_;
   uint8_t class_type_;
 
-  std::unique_ptr<Memory> gnu_debugdata_memory_;
+  bool gnu_debugdata_initialized_ = false;
+  std::unique_ptr<MemoryBuffer> gnu_debugdata_memory_;
   std::unique_ptr<ElfInterface> gnu_debugdata_interface_;
+  std::unique_ptr<UnwindTable> unwind_table_;
+  std::atomic<uint64_t> memory_usage_{0};
+
+  // An elf may be shared through the ElfCache, this serializes everything
+  // that fills in the lazily built state of the interfaces.
+  std::mutex lock_;
 };
 
 }  // namespace unwindstack
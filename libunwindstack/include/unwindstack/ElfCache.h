@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_ELF_CACHE_H
+#define _LIBUNWINDSTACK_ELF_CACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+
+namespace unwindstack {
+
+// Forward declarations.
+class Elf;
+
+// Process wide cache of the Elf objects created for file backed maps, so
+// that unwinding the same processes over and over does not parse the same
+// files over and over. An entry is only reused while the file it was made
+// from has not changed on disk. Entries still referenced by a MapInfo are
+// never dropped, the others go least recently used first once the memory
+// used by all of them goes over the limit.
+//
+// Disabled by default.
+class ElfCache {
+ public:
+  // Identifies one version of a file mapped at a given offset.
+  struct Key {
+    std::string name;
+    uint64_t offset;
+    dev_t dev;
+    ino_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t size;
+
+    bool Init(const std::string& name, uint64_t offset);
+
+    bool operator<(const Key& other) const;
+  };
+
+  static void SetEnabled(bool enabled);
+  static bool Enabled();
+
+  // Bytes of mapped elf files and decompressed .gnu_debugdata to keep.
+  static void SetMemoryLimit(uint64_t limit);
+  static uint64_t MemoryUsage();
+
+  // Drops all entries, those still in use live on until they are released.
+  static void Clear();
+
+  // Returns nullptr if the key is not cached.
+  static std::shared_ptr<Elf> Get(const Key& key, uint64_t* elf_offset);
+
+  // Caches the elf, unless another thread got there first, in which case
+  // the elf and offset are replaced by the ones already in the cache.
+  // file_size is the size of the mapping of the elf's memory.
+  static void Add(const Key& key, std::shared_ptr<Elf>* elf, uint64_t* elf_offset,
+                  uint64_t file_size);
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_ELF_CACHE_H
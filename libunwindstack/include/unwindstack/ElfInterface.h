@@ -31,6 +31,7 @@ namespace unwindstack {
 
 // Forward declarations.
 class Memory;
+class MemoryBuffer;
 class Regs;
 class Symbols;
 
@@ -61,7 +62,7 @@ class ElfInterface {
 
   virtual bool Step(uint64_t rel_pc, Regs* regs, Memory* process_memory);
 
-  Memory* CreateGnuDebugdataMemory();
+  MemoryBuffer* CreateGnuDebugdataMemory();
 
   Memory* memory() { return memory_; }
 
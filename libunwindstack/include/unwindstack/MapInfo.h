@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 
+#include <memory>
 #include <string>
 
 namespace unwindstack {
@@ -26,6 +27,7 @@ namespace unwindstack {
 // Forward declarations.
 class Elf;
 class Memory;
+class MemoryFileAtOffset;
 
 struct MapInfo {
   uint64_t start;
@@ -33,7 +35,8 @@ struct MapInfo {
   uint64_t offset;
   uint16_t flags;
   std::string name;
-  Elf* elf = nullptr;
+  // Shared with the ElfCache and other maps of the same file when cached.
+  std::shared_ptr<Elf> elf;
   // This value is only non-zero if the offset is non-zero but there is
   // no elf signature found at that offset. This indicates that the
   // entire file is represented by the Memory object returned by CreateMemory,
@@ -41,7 +44,11 @@ struct MapInfo {
   uint64_t elf_offset;
 
   Memory* CreateMemory(pid_t pid);
+  // The elf stays owned by the map info.
   Elf* GetElf(pid_t pid, bool init_gnu_debugdata = false);
+
+ private:
+  MemoryFileAtOffset* CreateFileMemory();
 };
 
 }  // namespace unwindstack
@@ -34,7 +34,7 @@ static constexpr int MAPS_FLAGS_DEVICE_MAP = 0x8000;
 class Maps {
  public:
   Maps() = default;
-  virtual ~Maps();
+  virtual ~Maps() = default;
 
   MapInfo* Find(uint64_t pc);
 
@@ -42,6 +42,11 @@ class Maps {
 
   virtual bool Parse();
 
+  // Parse again, keeping the elf of every map that did not change. Any
+  // MapInfo pointer from before is invalid afterwards. On failure the old
+  // maps are left in place.
+  bool Refresh();
+
   virtual const std::string GetMapsFile() const { return ""; }
 
   typedef std::vector<MapInfo>::iterator iterator;
@@ -55,6 +60,8 @@ class Maps {
   size_t Total() { return maps_.size(); }
 
  protected:
+  static constexpr size_t kReadBufferSize = 64 * 1024;
+
   std::vector<MapInfo> maps_;
 };
 
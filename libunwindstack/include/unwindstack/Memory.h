@@ -21,7 +21,10 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace unwindstack {
@@ -80,6 +83,8 @@ class MemoryFileAtOffset : public Memory {
 
   void Clear();
 
+  uint64_t Size() { return size_; }
+
  protected:
   size_t size_ = 0;
   size_t offset_ = 0;
@@ -109,10 +114,16 @@ class MemoryRemote : public Memory {
   pid_t pid() { return pid_; }
 
  protected:
+  // Returns how many bytes could be read from the start of the range.
+  virtual size_t ProcessVmRead(uint64_t addr, void* dst, size_t size);
+
   virtual bool PtraceRead(uint64_t addr, long* value);
 
+  bool PtraceReadFully(uint64_t addr, void* dst, size_t size);
+
  private:
   pid_t pid_;
+  bool vm_read_supported_ = true;
 };
 
 class MemoryLocal : public Memory {
@@ -123,6 +134,33 @@ class MemoryLocal : public Memory {
   bool Read(uint64_t addr, void* dst, size_t size) override;
 };
 
+// Keeps the pages read through another memory object, for the duration of
+// one unwind, while the memory it reads can not change. Reads that cross
+// into a page that can not be read as a whole go straight through.
+class MemoryCache : public Memory {
+ public:
+  MemoryCache(Memory* memory) : impl_(memory) {}
+  virtual ~MemoryCache() = default;
+
+  bool Read(uint64_t addr, void* dst, size_t size) override;
+
+  void Clear() {
+    pages_.clear();
+    bad_pages_.clear();
+  }
+
+  static constexpr size_t kPageSize = 4096;
+  // Enough for a deep stack, starts over once reached.
+  static constexpr size_t kMaxPages = 256;
+
+ private:
+  const uint8_t* GetPage(uint64_t page);
+
+  std::unique_ptr<Memory> impl_;
+  std::unordered_map<uint64_t, std::vector<uint8_t>> pages_;
+  std::unordered_set<uint64_t> bad_pages_;
+};
+
 class MemoryRange : public Memory {
  public:
   MemoryRange(Memory* memory, uint64_t begin, uint64_t end);
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_PROCESS_UNWINDER_H
+#define _LIBUNWINDSTACK_PROCESS_UNWINDER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unwindstack/Maps.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+// Forward declarations.
+class Memory;
+class Regs;
+
+struct ThreadUnwind {
+  pid_t tid;
+  uint32_t machine_type;
+  // False if the registers of the thread could not be read.
+  bool regs_valid;
+  std::vector<FrameData> frames;
+};
+
+// Unwinds all of the threads of one process, sharing a single copy of its
+// maps, elf files and memory between them instead of rebuilding them for
+// every thread. The unwinds themselves run on a pool of worker threads.
+class ProcessUnwinder {
+ public:
+  ProcessUnwinder(pid_t pid, size_t max_frames = 64);
+  ~ProcessUnwinder();
+
+  // Reads the maps of the process, must be called before Unwind.
+  bool Init();
+
+  // Every thread in tids must be ptrace attached by the calling thread and
+  // stopped. The registers are read here, the rest of the work is split
+  // across up to num_workers threads, the number of cpus when zero. The
+  // results are in the same order as tids.
+  void Unwind(const std::vector<pid_t>& tids, std::vector<ThreadUnwind>* threads,
+              size_t num_workers = 0);
+
+  static bool GetThreads(pid_t pid, std::vector<pid_t>* tids);
+
+  Maps* maps() { return &maps_; }
+
+  void set_use_frame_pointers(bool use_frame_pointers) { use_frame_pointers_ = use_frame_pointers; }
+
+ private:
+  void UnwindThread(Regs* regs, ThreadUnwind* thread);
+
+  pid_t pid_;
+  size_t max_frames_;
+  RemoteMaps maps_;
+  // MapInfo::GetElf must not run concurrently for one map.
+  std::mutex elf_lock_;
+  std::unique_ptr<Memory> memory_;
+  bool use_frame_pointers_ = false;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_PROCESS_UNWINDER_H
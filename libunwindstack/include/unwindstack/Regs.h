@@ -26,6 +26,7 @@ namespace unwindstack {
 // Forward declarations.
 class Elf;
 struct MapInfo;
+class Maps;
 class Memory;
 struct x86_ucontext_t;
 struct x86_64_ucontext_t;
@@ -59,6 +60,10 @@ class Regs {
 
   virtual bool StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_memory) = 0;
 
+  // Step through the frame record the frame pointer points at, only if it
+  // is further up the stack and returns into executable code.
+  virtual bool StepFramePointer(Memory* process_memory, Maps* maps) = 0;
+
   virtual void SetFromRaw() = 0;
 
   uint16_t sp_reg() { return sp_reg_; }
@@ -95,6 +100,10 @@ class RegsImpl : public Regs {
   void* RawData() override { return regs_.data(); }
 
  protected:
+  // A frame record is the frame pointer of the caller followed by the
+  // return address.
+  bool StepFrameRecord(Memory* process_memory, Maps* maps, uint16_t fp_reg, uint16_t pc_reg);
+
   AddressType pc_;
   AddressType sp_;
   std::vector<AddressType> regs_;
@@ -110,6 +119,8 @@ class RegsArm : public RegsImpl<uint32_t> {
   void SetFromRaw() override;
 
   bool StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_memory) override;
+
+  bool StepFramePointer(Memory* process_memory, Maps* maps) override;
 };
 
 class RegsArm64 : public RegsImpl<uint64_t> {
@@ -122,6 +133,8 @@ class RegsArm64 : public RegsImpl<uint64_t> {
   void SetFromRaw() override;
 
   bool StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_memory) override;
+
+  bool StepFramePointer(Memory* process_memory, Maps* maps) override;
 };
 
 class RegsX86 : public RegsImpl<uint32_t> {
@@ -135,6 +148,8 @@ class RegsX86 : public RegsImpl<uint32_t> {
 
   bool StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_memory) override;
 
+  bool StepFramePointer(Memory* process_memory, Maps* maps) override;
+
   void SetFromUcontext(x86_ucontext_t* ucontext);
 };
 
@@ -149,6 +164,8 @@ class RegsX86_64 : public RegsImpl<uint64_t> {
 
   bool StepIfSignalHandler(uint64_t rel_pc, Elf* elf, Memory* process_memory) override;
 
+  bool StepFramePointer(Memory* process_memory, Maps* maps) override;
+
   void SetFromUcontext(x86_64_ucontext_t* ucontext);
 };
 
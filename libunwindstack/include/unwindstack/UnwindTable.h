@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _LIBUNWINDSTACK_UNWIND_TABLE_H
+#define _LIBUNWINDSTACK_UNWIND_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace unwindstack {
+
+// Forward declarations.
+class Memory;
+class Regs;
+
+// The unwind information of one elf file flattened by the unwind_table tool
+// into a file that is used in place once mapped, so that offline unwinds
+// need neither the elf file nor to run any cfa instructions. The file is
+//
+//   UnwindTableHeader
+//   UnwindTableRow[num_rows]        sorted by pc, never overlapping
+//   UnwindTableRule[num_rules]
+//   UnwindTableSymbol[num_symbols]  sorted by start, never overlapping
+//   char[strings_size]              nul terminated names
+//
+// with all pcs relative to the elf like the ones Elf::Step() takes. Rows
+// only exist for pcs whose rules need no dwarf expression, anything else is
+// left to the elf.
+static constexpr uint32_t kUnwindTableMagic = 0x54577755;  // "UwWT"
+static constexpr uint32_t kUnwindTableVersion = 1;
+
+struct UnwindTableHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t machine_type;
+  uint32_t class_type;
+  uint32_t num_rows;
+  uint32_t num_rules;
+  uint32_t num_symbols;
+  uint32_t strings_size;
+};
+
+struct UnwindTableRow {
+  uint64_t pc_start;
+  uint64_t pc_end;
+  uint32_t rules_index;
+  uint16_t num_rules;
+  uint16_t return_address_register;
+};
+
+// A DwarfLocation, reg is CFA_REG for the rule giving the cfa.
+struct UnwindTableRule {
+  uint64_t values[2];
+  uint16_t reg;
+  uint8_t type;
+  uint8_t pad[5];
+};
+
+struct UnwindTableSymbol {
+  uint64_t start;
+  uint64_t end;
+  uint32_t name_offset;
+  uint32_t pad;
+};
+
+class UnwindTable {
+ public:
+  UnwindTable() = default;
+  virtual ~UnwindTable();
+
+  bool Init(const std::string& file);
+
+  bool Step(uint64_t rel_pc, Regs* regs, Memory* process_memory);
+
+  bool GetFunctionName(uint64_t addr, std::string* name, uint64_t* func_offset);
+
+  // Only valid once Init() succeeded.
+  uint32_t machine_type() { return header_->machine_type; }
+  uint8_t class_type() { return header_->class_type; }
+
+ protected:
+  void Clear();
+
+  const UnwindTableRow* FindRow(uint64_t rel_pc);
+
+  template <typename AddressType>
+  bool StepWithTemplate(const UnwindTableRow* row, Regs* regs, Memory* process_memory);
+
+  void* data_ = nullptr;
+  size_t size_ = 0;
+
+  const UnwindTableHeader* header_ = nullptr;
+  const UnwindTableRow* rows_ = nullptr;
+  const UnwindTableRule* rules_ = nullptr;
+  const UnwindTableSymbol* symbols_ = nullptr;
+  const char* strings_ = nullptr;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_UNWIND_TABLE_H
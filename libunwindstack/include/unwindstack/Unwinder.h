@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_UNWINDER_H
+#define _LIBUNWINDSTACK_UNWINDER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+namespace unwindstack {
+
+// Forward declarations.
+class Elf;
+struct MapInfo;
+class Maps;
+class Memory;
+class Regs;
+
+struct FrameData {
+  size_t num;
+
+  uint64_t rel_pc;
+  uint64_t pc;
+  uint64_t sp;
+
+  std::string function_name;
+  uint64_t function_offset;
+
+  std::string map_name;
+  uint64_t map_offset;
+  uint64_t map_start;
+  uint64_t map_end;
+};
+
+// Unwinds a single thread starting from regs, which are updated as it goes.
+class Unwinder {
+ public:
+  Unwinder(size_t max_frames, pid_t pid, Maps* maps, Regs* regs, Memory* process_memory)
+      : max_frames_(max_frames), pid_(pid), maps_(maps), regs_(regs),
+        process_memory_(process_memory) {}
+  virtual ~Unwinder() = default;
+
+  void Unwind();
+
+  const std::vector<FrameData>& frames() { return frames_; }
+  std::vector<FrameData>* mutable_frames() { return &frames_; }
+
+  // Follow the frame pointer chain, and only use the unwind information
+  // of the elf for the first frame and wherever the chain looks broken.
+  // Much cheaper, but only right for code built with frame pointers.
+  void set_use_frame_pointers(bool use_frame_pointers) { use_frame_pointers_ = use_frame_pointers; }
+
+  void set_resolve_names(bool resolve_names) { resolve_names_ = resolve_names; }
+
+ protected:
+  virtual Elf* GetElf(MapInfo* map_info);
+
+ private:
+  bool StepFramePointer(uint64_t rel_pc, Elf* elf);
+
+  size_t max_frames_;
+  pid_t pid_;
+  Maps* maps_;
+  Regs* regs_;
+  Memory* process_memory_;
+  bool use_frame_pointers_ = false;
+  bool resolve_names_ = true;
+  std::vector<FrameData> frames_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_UNWINDER_H
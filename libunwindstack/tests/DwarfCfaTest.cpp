@@ -312,6 +312,28 @@ TYPED_TEST_P(DwarfCfaTest, cfa_advance_loc1) {
   ASSERT_EQ("", GetFakeLogBuf());
 }
 
+TYPED_TEST_P(DwarfCfaTest, cfa_row_range) {
+  this->fde_.pc_end = 0x3000;
+  this->memory_.SetMemory(0x1000, std::vector<uint8_t>{0x44, 0x00, 0x48, 0x00});
+  dwarf_loc_regs_t loc_regs;
+
+  ASSERT_TRUE(this->cfa_->GetLocationInfo(0x2000, 0x1000, 0x1004, &loc_regs));
+  EXPECT_EQ(0x2000U, this->cfa_->row_start());
+  EXPECT_EQ(0x2010U, this->cfa_->row_end());
+
+  ASSERT_TRUE(this->cfa_->GetLocationInfo(0x2018, 0x1000, 0x1004, &loc_regs));
+  EXPECT_EQ(0x2010U, this->cfa_->row_start());
+  EXPECT_EQ(0x2030U, this->cfa_->row_end());
+
+  // The last row covers the rest of the fde.
+  ASSERT_TRUE(this->cfa_->GetLocationInfo(0x2040, 0x1000, 0x1004, &loc_regs));
+  EXPECT_EQ(0x2030U, this->cfa_->row_start());
+  EXPECT_EQ(0x3000U, this->cfa_->row_end());
+
+  ASSERT_EQ("", GetFakeLogPrint());
+  ASSERT_EQ("", GetFakeLogBuf());
+}
+
 TYPED_TEST_P(DwarfCfaTest, cfa_advance_loc2) {
   this->memory_.SetMemory(0x600, std::vector<uint8_t>{0x03, 0x04, 0x03});
   dwarf_loc_regs_t loc_regs;
@@ -952,7 +974,7 @@ TYPED_TEST_P(DwarfCfaTest, cfa_register_override) {
 
 REGISTER_TYPED_TEST_CASE_P(DwarfCfaTest, cfa_illegal, cfa_nop, cfa_offset, cfa_offset_extended,
                            cfa_offset_extended_sf, cfa_restore, cfa_restore_extended, cfa_set_loc,
-                           cfa_advance_loc1, cfa_advance_loc2, cfa_advance_loc4, cfa_undefined,
+                           cfa_advance_loc1, cfa_row_range, cfa_advance_loc2, cfa_advance_loc4, cfa_undefined,
                            cfa_same, cfa_register, cfa_state, cfa_state_cfa_offset_restore,
                            cfa_def_cfa, cfa_def_cfa_sf, cfa_def_cfa_register, cfa_def_cfa_offset,
                            cfa_def_cfa_offset_sf, cfa_def_cfa_expression, cfa_expression,
@@ -46,6 +46,9 @@ class MockDwarfEhFrame : public DwarfEhFrame<TypeParam> {
   void TestSetFdeInfo(uint64_t index, const typename DwarfEhFrame<TypeParam>::FdeInfo& info) {
     this->fde_info_[index] = info;
   }
+  void TestPushFdeInfo(const typename DwarfEhFrame<TypeParam>::FdeInfo& info) {
+    this->fdes_.push_back(info);
+  }
 
   uint8_t TestGetVersion() { return this->version_; }
   uint8_t TestGetPtrEncoding() { return this->ptr_encoding_; }
@@ -270,6 +273,60 @@ TYPED_TEST_P(DwarfEhFrameTest, GetFdeOffsetSequential_end_check) {
   ASSERT_EQ(DWARF_ERROR_NONE, this->eh_frame_->last_error());
 }
 
+TYPED_TEST_P(DwarfEhFrameTest, GetFdeOffsetSequential_read_once) {
+  this->eh_frame_->TestSetFdeCount(4);
+  this->eh_frame_->TestSetEntriesDataOffset(0x100);
+  this->eh_frame_->TestSetEntriesEnd(0x2000);
+  this->eh_frame_->TestSetTableEncoding(DW_EH_PE_udata4);
+  this->eh_frame_->TestSetCurEntriesOffset(0x1040);
+
+  // Out of order, which the table should not be, but still works.
+  this->memory_.SetData32(0x1040, 0x340);
+  this->memory_.SetData32(0x1044, 0x500);
+  this->memory_.SetData32(0x1048, 0x140);
+  this->memory_.SetData32(0x104c, 0x300);
+  this->memory_.SetData32(0x1050, 0x440);
+  this->memory_.SetData32(0x1054, 0x600);
+  this->memory_.SetData32(0x1058, 0x240);
+  this->memory_.SetData32(0x105c, 0x400);
+
+  uint64_t fde_offset;
+  ASSERT_TRUE(this->eh_frame_->GetFdeOffsetSequential(0x540, &fde_offset));
+  EXPECT_EQ(0x600U, fde_offset);
+
+  // All of the table was read on the first lookup.
+  this->memory_.Clear();
+  EXPECT_FALSE(this->eh_frame_->GetFdeOffsetSequential(0x100, &fde_offset));
+  ASSERT_TRUE(this->eh_frame_->GetFdeOffsetSequential(0x140, &fde_offset));
+  EXPECT_EQ(0x300U, fde_offset);
+  ASSERT_TRUE(this->eh_frame_->GetFdeOffsetSequential(0x2ff, &fde_offset));
+  EXPECT_EQ(0x400U, fde_offset);
+  ASSERT_TRUE(this->eh_frame_->GetFdeOffsetSequential(0x340, &fde_offset));
+  EXPECT_EQ(0x500U, fde_offset);
+}
+
+TYPED_TEST_P(DwarfEhFrameTest, GetFdeOffsetSequential_read_fail) {
+  this->eh_frame_->TestSetFdeCount(3);
+  this->eh_frame_->TestSetEntriesDataOffset(0x100);
+  this->eh_frame_->TestSetEntriesEnd(0x2000);
+  this->eh_frame_->TestSetTableEncoding(DW_EH_PE_udata4);
+  this->eh_frame_->TestSetCurEntriesOffset(0x1040);
+
+  this->memory_.SetData32(0x1040, 0x340);
+  this->memory_.SetData32(0x1044, 0x500);
+  this->memory_.SetData32(0x1048, 0x440);
+  this->memory_.SetData32(0x104c, 0x600);
+
+  // What could be read is still used.
+  uint64_t fde_offset;
+  ASSERT_TRUE(this->eh_frame_->GetFdeOffsetSequential(0x340, &fde_offset));
+  EXPECT_EQ(0x500U, fde_offset);
+  ASSERT_EQ(DWARF_ERROR_NONE, this->eh_frame_->last_error());
+
+  ASSERT_FALSE(this->eh_frame_->GetFdeOffsetSequential(0x540, &fde_offset));
+  ASSERT_EQ(DWARF_ERROR_MEMORY_INVALID, this->eh_frame_->last_error());
+}
+
 TYPED_TEST_P(DwarfEhFrameTest, GetFdeOffsetFromPc_fail_fde_count) {
   this->eh_frame_->TestSetFdeCount(0);
 
@@ -305,13 +362,13 @@ TYPED_TEST_P(DwarfEhFrameTest, GetFdeOffsetFromPc_sequential_search) {
   typename DwarfEhFrame<TypeParam>::FdeInfo info;
   info.pc = 0x50;
   info.offset = 0x10000;
-  this->eh_frame_->TestSetFdeInfo(0, info);
+  this->eh_frame_->TestPushFdeInfo(info);
   info.pc = 0x150;
   info.offset = 0x10100;
-  this->eh_frame_->TestSetFdeInfo(1, info);
+  this->eh_frame_->TestPushFdeInfo(info);
   info.pc = 0x250;
   info.offset = 0x10200;
-  this->eh_frame_->TestSetFdeInfo(2, info);
+  this->eh_frame_->TestPushFdeInfo(info);
 
   uint64_t fde_offset;
   ASSERT_TRUE(this->eh_frame_->GetFdeOffsetFromPc(0x200, &fde_offset));
@@ -404,7 +461,8 @@ REGISTER_TYPED_TEST_CASE_P(DwarfEhFrameTest, Init, GetFdeInfoFromIndex_expect_ca
                            GetFdeInfoFromIndex_read_pcrel, GetFdeInfoFromIndex_read_datarel,
                            GetFdeInfoFromIndex_cached, GetFdeOffsetBinary_verify,
                            GetFdeOffsetSequential, GetFdeOffsetSequential_last_element,
-                           GetFdeOffsetSequential_end_check, GetFdeOffsetFromPc_fail_fde_count,
+                           GetFdeOffsetSequential_end_check, GetFdeOffsetSequential_read_once,
+                           GetFdeOffsetSequential_read_fail, GetFdeOffsetFromPc_fail_fde_count,
                            GetFdeOffsetFromPc_binary_search, GetFdeOffsetFromPc_sequential_search,
                            GetCieFde32, GetCieFde64);
 
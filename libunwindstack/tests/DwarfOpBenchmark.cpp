@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/DwarfMemory.h>
+#include <unwindstack/DwarfStructs.h>
+
+#include "DwarfOp.h"
+
+#include "MemoryFake.h"
+#include "RegsFake.h"
+
+namespace unwindstack {
+
+// The kind of expression a signal trampoline uses to find a saved register:
+//   DW_OP_breg7 0x80, DW_OP_deref, DW_OP_plus_uconst 0x112
+static const std::vector<uint8_t> kExpression = {0x77, 0x80, 0x01, 0x06, 0x23, 0x92, 0x02};
+
+class DwarfOpBenchmark {
+ public:
+  DwarfOpBenchmark() : regs_(16, 7), dwarf_memory_(&op_memory_), op_(&dwarf_memory_, &memory_) {
+    op_memory_.SetMemory(0x1000, kExpression);
+    memory_.SetData64(0x2080, 0x5000);
+    regs_[7] = 0x2000;
+    op_.set_regs(&regs_);
+  }
+
+  DwarfOp<uint64_t>* op() { return &op_; }
+
+ private:
+  MemoryFake op_memory_;
+  MemoryFake memory_;
+  RegsFake<uint64_t> regs_;
+  DwarfMemory dwarf_memory_;
+  DwarfOp<uint64_t> op_;
+};
+
+static void BM_dwarf_op_eval(benchmark::State& state) {
+  DwarfOpBenchmark bench;
+  while (state.KeepRunning()) {
+    if (!bench.op()->Eval(0x1000, 0x1000 + kExpression.size(), DWARF_VERSION_MAX)) {
+      state.SkipWithError("Eval failed.");
+      break;
+    }
+  }
+}
+BENCHMARK(BM_dwarf_op_eval);
+
+static void BM_dwarf_op_eval_predecoded(benchmark::State& state) {
+  DwarfOpBenchmark bench;
+  std::vector<DwarfExpressionOp> ops;
+  if (!bench.op()->Predecode(0x1000, 0x1000 + kExpression.size(), DWARF_VERSION_MAX, &ops)) {
+    state.SkipWithError("Predecode failed.");
+    return;
+  }
+  while (state.KeepRunning()) {
+    if (!bench.op()->Eval(ops)) {
+      state.SkipWithError("Eval failed.");
+      break;
+    }
+  }
+}
+BENCHMARK(BM_dwarf_op_eval_predecoded);
+
+}  // namespace unwindstack
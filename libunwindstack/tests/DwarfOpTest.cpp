@@ -1571,6 +1571,108 @@ TYPED_TEST_P(DwarfOpTest, op_nop) {
   ASSERT_EQ(0U, this->op_->StackSize());
 }
 
+TYPED_TEST_P(DwarfOpTest, predecode) {
+  std::vector<DwarfExpressionOp> ops;
+
+  // Memory error.
+  ASSERT_FALSE(this->op_->Predecode(0, 2, DWARF_VERSION_MAX, &ops));
+  ASSERT_EQ(DWARF_ERROR_MEMORY_INVALID, this->op_->last_error());
+
+  // Illegal opcode, and one not in the version.
+  this->op_memory_.SetMemory(0, std::vector<uint8_t>{0x08, 0x01, 0x00});
+  ASSERT_FALSE(this->op_->Predecode(0, 3, DWARF_VERSION_MAX, &ops));
+  ASSERT_EQ(DWARF_ERROR_ILLEGAL_VALUE, this->op_->last_error());
+  this->op_memory_.SetMemory(0, std::vector<uint8_t>{0x08, 0x01, 0x96, 0x97});
+  ASSERT_FALSE(this->op_->Predecode(0, 4, DWARF_VERSION_2, &ops));
+  ASSERT_EQ(DWARF_ERROR_ILLEGAL_VALUE, this->op_->last_error());
+
+  // DW_OP_breg7 0x80, DW_OP_deref, DW_OP_plus_uconst 0x112.
+  std::vector<uint8_t> opcode_buffer = {0x77, 0x80, 0x01, 0x06, 0x23, 0x92, 0x02};
+  this->op_memory_.SetMemory(0, opcode_buffer);
+  ASSERT_TRUE(this->op_->Predecode(0, opcode_buffer.size(), DWARF_VERSION_MAX, &ops));
+  ASSERT_EQ(3U, ops.size());
+  ASSERT_EQ(0x77U, ops[0].op);
+  ASSERT_EQ(0x80U, ops[0].operands[0]);
+  ASSERT_EQ(0x06U, ops[1].op);
+  ASSERT_EQ(0x23U, ops[2].op);
+  ASSERT_EQ(0x112U, ops[2].operands[0]);
+
+  RegsFake<TypeParam> regs(16, 10);
+  regs[7] = 0x1000;
+  this->op_->set_regs(&regs);
+  TypeParam value = 0x2000;
+  this->regular_memory_.SetMemory(0x1080, &value, sizeof(value));
+
+  // Nothing is read from the op memory any more.
+  this->op_memory_.Clear();
+  ASSERT_TRUE(this->op_->Eval(ops));
+  ASSERT_EQ(DWARF_ERROR_NONE, this->op_->last_error());
+  ASSERT_EQ(1U, this->op_->StackSize());
+  ASSERT_EQ(0x2112U, this->op_->StackAt(0));
+  ASSERT_FALSE(this->op_->is_register());
+
+  // Errors are the same as Eval().
+  regs[7] = 0x3000;
+  ASSERT_FALSE(this->op_->Eval(ops));
+  ASSERT_EQ(DWARF_ERROR_MEMORY_INVALID, this->op_->last_error());
+  ops.erase(ops.begin());
+  ASSERT_FALSE(this->op_->Eval(ops));
+  ASSERT_EQ(DWARF_ERROR_STACK_INDEX_NOT_VALID, this->op_->last_error());
+}
+
+TYPED_TEST_P(DwarfOpTest, predecode_branches) {
+  std::vector<DwarfExpressionOp> ops;
+  std::vector<uint8_t> opcode_buffer = {
+      // 0: DW_OP_lit2
+      0x32,
+      // 1: DW_OP_dup, DW_OP_bra 6, to offset 11 or off the front when zero.
+      0x12, 0x28, 0x06, 0x00,
+      // 5: Never run, DW_OP_lit10, DW_OP_drop three times.
+      0x3a, 0x13, 0x3a, 0x13, 0x3a, 0x13,
+      // 11: DW_OP_lit1, DW_OP_minus, DW_OP_skip -15, back to offset 1.
+      0x31, 0x1c, 0x2f, 0xf1, 0xff,
+  };
+  this->op_memory_.SetMemory(0, opcode_buffer);
+  ASSERT_TRUE(this->op_->Predecode(0, opcode_buffer.size(), DWARF_VERSION_MAX, &ops));
+  ASSERT_EQ(12U, ops.size());
+  ASSERT_EQ(9U, ops[2].operands[0]);
+  ASSERT_EQ(12U, ops[2].operands[1]);
+  ASSERT_EQ(1U, ops[11].operands[0]);
+
+  // Predecoding does not change what the expression evaluates to.
+  ASSERT_TRUE(this->op_->Eval(0, opcode_buffer.size(), DWARF_VERSION_MAX));
+  size_t stack_size = this->op_->StackSize();
+  std::vector<TypeParam> stack;
+  for (size_t i = 0; i < stack_size; i++) {
+    stack.push_back(this->op_->StackAt(i));
+  }
+  ASSERT_EQ(1U, stack_size);
+  ASSERT_EQ(0U, stack[0]);
+  ASSERT_TRUE(this->op_->Eval(ops));
+  ASSERT_EQ(stack_size, this->op_->StackSize());
+  for (size_t i = 0; i < stack_size; i++) {
+    ASSERT_EQ(stack[i], this->op_->StackAt(i)) << "Failed at index " << i;
+  }
+
+  // Infinite loop.
+  this->op_memory_.SetMemory(0, std::vector<uint8_t>{0x2f, 0xfd, 0xff});
+  ASSERT_TRUE(this->op_->Predecode(0, 3, DWARF_VERSION_MAX, &ops));
+  ASSERT_FALSE(this->op_->Eval(ops));
+  ASSERT_EQ(DWARF_ERROR_TOO_MANY_ITERATIONS, this->op_->last_error());
+
+  // Branch into the middle of an op, or in front of the expression.
+  this->op_memory_.SetMemory(0, std::vector<uint8_t>{0x08, 0x01, 0x2f, 0xfc, 0xff});
+  ASSERT_FALSE(this->op_->Predecode(0, 5, DWARF_VERSION_MAX, &ops));
+  this->op_memory_.SetMemory(0x10, std::vector<uint8_t>{0x08, 0x01, 0x2f, 0xf0, 0xff});
+  ASSERT_FALSE(this->op_->Predecode(0x10, 0x15, DWARF_VERSION_MAX, &ops));
+
+  // Branch past the end.
+  this->op_memory_.SetMemory(0, std::vector<uint8_t>{0x2f, 0x10, 0x00, 0x30});
+  ASSERT_TRUE(this->op_->Predecode(0, 4, DWARF_VERSION_MAX, &ops));
+  ASSERT_TRUE(this->op_->Eval(ops));
+  ASSERT_EQ(0U, this->op_->StackSize());
+}
+
 REGISTER_TYPED_TEST_CASE_P(DwarfOpTest, decode, eval, illegal_opcode, illegal_in_version3,
                            illegal_in_version4, not_implemented, op_addr, op_deref, op_deref_size,
                            const_unsigned, const_signed, const_uleb, const_sleb, op_dup, op_drop,
@@ -1578,7 +1680,8 @@ REGISTER_TYPED_TEST_CASE_P(DwarfOpTest, decode, eval, illegal_opcode, illegal_in
                            op_mod, op_mul, op_neg, op_not, op_or, op_plus, op_plus_uconst, op_shl,
                            op_shr, op_shra, op_xor, op_bra, compare_opcode_stack_error,
                            compare_opcodes, op_skip, op_lit, op_reg, op_regx, op_breg,
-                           op_breg_invalid_register, op_bregx, op_nop);
+                           op_breg_invalid_register, op_bregx, op_nop, predecode,
+                           predecode_branches);
 
 typedef ::testing::Types<uint32_t, uint64_t> DwarfOpTestTypes;
 INSTANTIATE_TYPED_TEST_CASE_P(, DwarfOpTest, DwarfOpTestTypes);
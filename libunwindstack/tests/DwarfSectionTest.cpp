@@ -53,6 +53,11 @@ class MockDwarfSection : public DwarfSection {
   MOCK_METHOD1(GetCieOffsetFromFde64, uint64_t(uint64_t));
 
   MOCK_METHOD1(AdjustPcFromFde, uint64_t(uint64_t));
+
+  void TestSetLocRegsRow(uint64_t start, uint64_t end) {
+    loc_regs_row_start_ = start;
+    loc_regs_row_end_ = end;
+  }
 };
 
 class DwarfSectionTest : public ::testing::Test {
@@ -161,4 +166,38 @@ TEST_F(DwarfSectionTest, Step_pass) {
   ASSERT_TRUE(mock_section.Step(0x1000, nullptr, &process));
 }
 
+TEST_F(DwarfSectionTest, Step_cached_row) {
+  MockDwarfSection mock_section(&memory_);
+
+  DwarfCie cie{};
+  DwarfFde fde{};
+  fde.pc_end = 0x2000;
+  fde.cie = &cie;
+
+  EXPECT_CALL(mock_section, GetFdeOffsetFromPc(0x1000, ::testing::_))
+      .WillOnce(::testing::Return(true));
+  EXPECT_CALL(mock_section, GetFdeFromOffset(::testing::_)).WillOnce(::testing::Return(&fde));
+
+  EXPECT_CALL(mock_section, GetCfaLocationInfo(0x1000, &fde, ::testing::_))
+      .WillOnce(::testing::DoAll(
+          ::testing::InvokeWithoutArgs([&]() { mock_section.TestSetLocRegsRow(0x1000, 0x1100); }),
+          ::testing::Return(true)));
+
+  MemoryFake process;
+  EXPECT_CALL(mock_section, Eval(&cie, &process, ::testing::_, nullptr))
+      .Times(3)
+      .WillRepeatedly(::testing::Return(true));
+
+  ASSERT_TRUE(mock_section.Step(0x1000, nullptr, &process));
+  // Anywhere in the same row needs no lookup.
+  ASSERT_TRUE(mock_section.Step(0x1000, nullptr, &process));
+  ASSERT_TRUE(mock_section.Step(0x10ff, nullptr, &process));
+  ::testing::Mock::VerifyAndClearExpectations(&mock_section);
+
+  // Outside of the row, the fde is looked up again.
+  EXPECT_CALL(mock_section, GetFdeOffsetFromPc(0x1100, ::testing::_))
+      .WillOnce(::testing::Return(false));
+  ASSERT_FALSE(mock_section.Step(0x1100, nullptr, &process));
+}
+
 }  // namespace unwindstack
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <elf.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/ElfCache.h>
+#include <unwindstack/MapInfo.h>
+
+#include "ElfTestUtils.h"
+
+namespace unwindstack {
+
+class ElfCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ElfCache::SetEnabled(true);
+    ElfCache::SetMemoryLimit(UINT64_MAX);
+    WriteElf(EM_ARM);
+  }
+
+  void TearDown() override {
+    ElfCache::SetEnabled(false);
+    ElfCache::SetMemoryLimit(64 * 1024 * 1024);
+  }
+
+  void WriteElf(uint16_t machine) {
+    std::vector<uint8_t> buffer(1024);
+    Elf32_Ehdr ehdr;
+    TestInitEhdr<Elf32_Ehdr>(&ehdr, ELFCLASS32, machine);
+    memcpy(buffer.data(), &ehdr, sizeof(ehdr));
+    ASSERT_EQ(0, ftruncate(elf_.fd, 0));
+    ASSERT_EQ(0, lseek(elf_.fd, 0, SEEK_SET));
+    ASSERT_TRUE(android::base::WriteFully(elf_.fd, buffer.data(), buffer.size()));
+  }
+
+  MapInfo Info() { return MapInfo{.start = 0x1000, .end = 0x2000, .offset = 0, .name = elf_.path}; }
+
+  TemporaryFile elf_;
+};
+
+TEST_F(ElfCacheTest, disabled) {
+  ElfCache::SetEnabled(false);
+
+  MapInfo info1 = Info();
+  MapInfo info2 = Info();
+  Elf* elf1 = info1.GetElf(getpid());
+  Elf* elf2 = info2.GetElf(getpid());
+  ASSERT_TRUE(elf1 != nullptr);
+  ASSERT_TRUE(elf1->valid());
+  EXPECT_NE(elf1, elf2);
+  EXPECT_EQ(0U, ElfCache::MemoryUsage());
+}
+
+TEST_F(ElfCacheTest, shared) {
+  MapInfo info1 = Info();
+  MapInfo info2 = Info();
+  Elf* elf1 = info1.GetElf(getpid());
+  Elf* elf2 = info2.GetElf(getpid());
+  ASSERT_TRUE(elf1 != nullptr);
+  ASSERT_TRUE(elf1->valid());
+  EXPECT_EQ(elf1, elf2);
+  EXPECT_EQ(1024U, ElfCache::MemoryUsage());
+
+  // A different offset is a different elf.
+  MapInfo info3 = Info();
+  info3.offset = 0x100;
+  EXPECT_NE(elf1, info3.GetElf(getpid()));
+}
+
+TEST_F(ElfCacheTest, anonymous_not_cached) {
+  MapInfo info{.start = 0x1000, .end = 0x2000, .offset = 0, .name = ""};
+  ASSERT_TRUE(info.GetElf(getpid()) != nullptr);
+  EXPECT_EQ(0U, ElfCache::MemoryUsage());
+}
+
+TEST_F(ElfCacheTest, file_changed) {
+  MapInfo info1 = Info();
+  Elf* elf1 = info1.GetElf(getpid());
+  ASSERT_TRUE(elf1->valid());
+  EXPECT_EQ(static_cast<uint32_t>(EM_ARM), elf1->machine_type());
+
+  // Make sure the modification time moves even on coarse file systems.
+  struct timespec times[2] = {{.tv_sec = 0, .tv_nsec = UTIME_OMIT}, {.tv_sec = 1, .tv_nsec = 0}};
+  WriteElf(EM_386);
+  ASSERT_EQ(0, futimens(elf_.fd, times));
+
+  MapInfo info2 = Info();
+  Elf* elf2 = info2.GetElf(getpid());
+  ASSERT_TRUE(elf2->valid());
+  EXPECT_NE(elf1, elf2);
+  EXPECT_EQ(static_cast<uint32_t>(EM_386), elf2->machine_type());
+}
+
+TEST_F(ElfCacheTest, memory_limit) {
+  std::unique_ptr<MapInfo> info1(new MapInfo(Info()));
+  Elf* elf1 = info1->GetElf(getpid());
+  ASSERT_TRUE(elf1 != nullptr);
+
+  // Still in use, so it stays.
+  ElfCache::SetMemoryLimit(0);
+  EXPECT_EQ(1024U, ElfCache::MemoryUsage());
+  MapInfo info2 = Info();
+  EXPECT_EQ(elf1, info2.GetElf(getpid()));
+
+  info1.reset();
+  info2.elf.reset();
+  ElfCache::SetMemoryLimit(0);
+  EXPECT_EQ(0U, ElfCache::MemoryUsage());
+}
+
+TEST_F(ElfCacheTest, clear) {
+  MapInfo info1 = Info();
+  Elf* elf1 = info1.GetElf(getpid());
+  ElfCache::Clear();
+  EXPECT_EQ(0U, ElfCache::MemoryUsage());
+
+  // The map info keeps its elf.
+  EXPECT_EQ(elf1, info1.GetElf(getpid()));
+  MapInfo info2 = Info();
+  EXPECT_NE(elf1, info2.GetElf(getpid()));
+}
+
+}  // namespace unwindstack
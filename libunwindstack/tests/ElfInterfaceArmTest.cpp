@@ -262,6 +262,40 @@ TEST_F(ElfInterfaceArmTest, FindEntry_load_bias) {
   ASSERT_EQ(0x1008U, entry_offset);
 }
 
+TEST_F(ElfInterfaceArmTest, FindEntry_whole_table) {
+  ElfInterfaceArm interface(&memory_);
+  interface.set_start_offset(0x1000);
+  interface.set_total_entries(1000);
+  for (size_t i = 0; i < 1000; i++) {
+    // Every entry covers 0x100 bytes starting at 0x10000.
+    memory_.SetData32(0x1000 + i * 8, 0x10000 + i * 0x100 - i * 8 - 0x1000);
+    memory_.SetData32(0x1004 + i * 8, 1);
+  }
+
+  uint64_t entry_offset;
+  ASSERT_FALSE(interface.FindEntry(0xffff, &entry_offset));
+  ASSERT_TRUE(interface.FindEntry(0x10000, &entry_offset));
+  ASSERT_EQ(0x1000U, entry_offset);
+  ASSERT_TRUE(interface.FindEntry(0x2a3ff, &entry_offset));
+  ASSERT_EQ(0x1000U + 0x1a3 * 8, entry_offset);
+  ASSERT_TRUE(interface.FindEntry(0x2a400, &entry_offset));
+  ASSERT_EQ(0x1000U + 0x1a4 * 8, entry_offset);
+  ASSERT_TRUE(interface.FindEntry(0x100000, &entry_offset));
+  ASSERT_EQ(0x1000U + 999 * 8, entry_offset);
+
+  // The table was read once, none of it is read again.
+  memory_.Clear();
+  ASSERT_TRUE(interface.FindEntry(0x2a400, &entry_offset));
+  ASSERT_EQ(0x1000U + 0x1a4 * 8, entry_offset);
+
+  size_t total = 0;
+  for (auto addr : interface) {
+    ASSERT_EQ(0x10000U + total * 0x100, addr);
+    total++;
+  }
+  ASSERT_EQ(1000U, total);
+}
+
 TEST_F(ElfInterfaceArmTest, HandleType_not_arm_exidx) {
   ElfInterfaceArm interface(&memory_);
 
@@ -374,4 +408,35 @@ TEST_F(ElfInterfaceArmTest, StepExidx_pc_set) {
   ASSERT_EQ(0x10U, regs[ARM_REG_PC]);
 }
 
+TEST_F(ElfInterfaceArmTest, StepExidx_cached) {
+  ElfInterfaceArm interface(&memory_);
+
+  interface.set_start_offset(0x1000);
+  interface.set_total_entries(2);
+  memory_.SetData32(0x1000, 0x6000);
+  memory_.SetData32(0x1004, 0x808800b0);
+  memory_.SetData32(0x1008, 0x8000);
+  memory_.SetData32(0x100c, 1);
+  process_memory_.SetData32(0x10000, 0x10);
+
+  RegsArm regs;
+  regs[ARM_REG_SP] = 0x10000;
+  regs.set_sp(regs[ARM_REG_SP]);
+  ASSERT_TRUE(interface.StepExidx(0x7000, &regs, &process_memory_));
+  ASSERT_EQ(0x10004U, regs.sp());
+  ASSERT_EQ(0x10U, regs.pc());
+
+  // A cant unwind entry.
+  ASSERT_FALSE(interface.StepExidx(0x9000, &regs, &process_memory_));
+
+  // Nothing about either entry is read again.
+  memory_.Clear();
+  regs[ARM_REG_SP] = 0x10000;
+  regs.set_sp(regs[ARM_REG_SP]);
+  ASSERT_TRUE(interface.StepExidx(0x7000, &regs, &process_memory_));
+  ASSERT_EQ(0x10004U, regs.sp());
+  ASSERT_EQ(0x10U, regs.pc());
+  ASSERT_FALSE(interface.StepExidx(0x9000, &regs, &process_memory_));
+}
+
 }  // namespace unwindstack
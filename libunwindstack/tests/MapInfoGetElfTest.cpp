@@ -58,8 +58,8 @@ class MapInfoGetElfTest : public ::testing::Test {
 
 TEST_F(MapInfoGetElfTest, invalid) {
   // The map is empty, but this should still create an invalid elf object.
-  std::unique_ptr<Elf> elf(info_->GetElf(getpid(), false));
-  ASSERT_TRUE(elf.get() != nullptr);
+  Elf* elf = info_->GetElf(getpid(), false);
+  ASSERT_TRUE(elf != nullptr);
   ASSERT_FALSE(elf->valid());
 }
 
@@ -68,8 +68,8 @@ TEST_F(MapInfoGetElfTest, valid32) {
   TestInitEhdr<Elf32_Ehdr>(&ehdr, ELFCLASS32, EM_ARM);
   memcpy(map_, &ehdr, sizeof(ehdr));
 
-  std::unique_ptr<Elf> elf(info_->GetElf(getpid(), false));
-  ASSERT_TRUE(elf.get() != nullptr);
+  Elf* elf = info_->GetElf(getpid(), false);
+  ASSERT_TRUE(elf != nullptr);
   ASSERT_TRUE(elf->valid());
   EXPECT_EQ(static_cast<uint32_t>(EM_ARM), elf->machine_type());
   EXPECT_EQ(ELFCLASS32, elf->class_type());
@@ -80,8 +80,8 @@ TEST_F(MapInfoGetElfTest, valid64) {
   TestInitEhdr<Elf64_Ehdr>(&ehdr, ELFCLASS64, EM_AARCH64);
   memcpy(map_, &ehdr, sizeof(ehdr));
 
-  std::unique_ptr<Elf> elf(info_->GetElf(getpid(), false));
-  ASSERT_TRUE(elf.get() != nullptr);
+  Elf* elf = info_->GetElf(getpid(), false);
+  ASSERT_TRUE(elf != nullptr);
   ASSERT_TRUE(elf->valid());
   EXPECT_EQ(static_cast<uint32_t>(EM_AARCH64), elf->machine_type());
   EXPECT_EQ(ELFCLASS64, elf->class_type());
@@ -93,8 +93,8 @@ TEST_F(MapInfoGetElfTest, gnu_debugdata_do_not_init32) {
         memcpy(&reinterpret_cast<uint8_t*>(map_)[offset], ptr, size);
       });
 
-  std::unique_ptr<Elf> elf(info_->GetElf(getpid(), false));
-  ASSERT_TRUE(elf.get() != nullptr);
+  Elf* elf = info_->GetElf(getpid(), false);
+  ASSERT_TRUE(elf != nullptr);
   ASSERT_TRUE(elf->valid());
   EXPECT_EQ(static_cast<uint32_t>(EM_ARM), elf->machine_type());
   EXPECT_EQ(ELFCLASS32, elf->class_type());
@@ -107,8 +107,8 @@ TEST_F(MapInfoGetElfTest, gnu_debugdata_do_not_init64) {
         memcpy(&reinterpret_cast<uint8_t*>(map_)[offset], ptr, size);
       });
 
-  std::unique_ptr<Elf> elf(info_->GetElf(getpid(), false));
-  ASSERT_TRUE(elf.get() != nullptr);
+  Elf* elf = info_->GetElf(getpid(), false);
+  ASSERT_TRUE(elf != nullptr);
   ASSERT_TRUE(elf->valid());
   EXPECT_EQ(static_cast<uint32_t>(EM_AARCH64), elf->machine_type());
   EXPECT_EQ(ELFCLASS64, elf->class_type());
@@ -121,8 +121,8 @@ TEST_F(MapInfoGetElfTest, gnu_debugdata_init32) {
         memcpy(&reinterpret_cast<uint8_t*>(map_)[offset], ptr, size);
       });
 
-  std::unique_ptr<Elf> elf(info_->GetElf(getpid(), true));
-  ASSERT_TRUE(elf.get() != nullptr);
+  Elf* elf = info_->GetElf(getpid(), true);
+  ASSERT_TRUE(elf != nullptr);
   ASSERT_TRUE(elf->valid());
   EXPECT_EQ(static_cast<uint32_t>(EM_ARM), elf->machine_type());
   EXPECT_EQ(ELFCLASS32, elf->class_type());
@@ -135,8 +135,8 @@ TEST_F(MapInfoGetElfTest, gnu_debugdata_init64) {
         memcpy(&reinterpret_cast<uint8_t*>(map_)[offset], ptr, size);
       });
 
-  std::unique_ptr<Elf> elf(info_->GetElf(getpid(), true));
-  ASSERT_TRUE(elf.get() != nullptr);
+  Elf* elf = info_->GetElf(getpid(), true);
+  ASSERT_TRUE(elf != nullptr);
   ASSERT_TRUE(elf->valid());
   EXPECT_EQ(static_cast<uint32_t>(EM_AARCH64), elf->machine_type());
   EXPECT_EQ(ELFCLASS64, elf->class_type());
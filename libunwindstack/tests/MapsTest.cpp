@@ -14,12 +14,18 @@
  * limitations under the License.
  */
 
+#include <inttypes.h>
 #include <sys/mman.h>
 
+#include <memory>
+#include <string>
+
 #include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <android-base/test_utils.h>
 #include <gtest/gtest.h>
 
+#include <unwindstack/Elf.h>
 #include <unwindstack/Maps.h>
 
 namespace unwindstack {
@@ -180,6 +186,104 @@ TEST(MapsTest, file_smoke) {
   ASSERT_EQ(it, maps.end());
 }
 
+TEST(MapsTest, parse_invalid) {
+  MapInfo info;
+  Maps maps;
+  ASSERT_FALSE(maps.ParseLine("", &info));
+  ASSERT_FALSE(maps.ParseLine("\n", &info));
+  ASSERT_FALSE(maps.ParseLine("1000 r--p 00000000 00:00 0\n", &info));
+  ASSERT_FALSE(maps.ParseLine("1000-2000 r--p\n", &info));
+  ASSERT_FALSE(maps.ParseLine("1000-2000 r--p 00000000 00:00\n", &info));
+  ASSERT_FALSE(maps.ParseLine("1000-2000 r--p 00000000 0000 0\n", &info));
+  ASSERT_FALSE(maps.ParseLine("1000-2000 r--p 00000000 00:00 0/fake.so\n", &info));
+
+  ASSERT_TRUE(maps.ParseLine("1000-2000 r--p 00000000 00:00 0   \n", &info));
+  ASSERT_EQ("", info.name);
+}
+
+TEST(MapsTest, file_large) {
+  TemporaryFile tf;
+  ASSERT_TRUE(tf.fd != -1);
+
+  // More than a single read, with no newline at the end.
+  std::string content;
+  for (size_t i = 0; i < 5000; i++) {
+    content += android::base::StringPrintf(
+        "%" PRIx64 "-%" PRIx64 " r-xp %zx fe:01 %zu   /fake%zu.so\n", 0x10000 + i * 0x1000,
+        0x11000 + i * 0x1000, i, i, i);
+  }
+  content += "7f0000000-7f0001000 rw-p 00000000 00:00 0   /" + std::string(100000, 'a');
+  ASSERT_TRUE(android::base::WriteStringToFile(content, tf.path, 0660, getuid(), getgid()));
+
+  FileMaps maps(tf.path);
+  ASSERT_TRUE(maps.Parse());
+  ASSERT_EQ(5001U, maps.Total());
+  size_t i = 0;
+  for (const auto& info : maps) {
+    if (i == 5000) {
+      ASSERT_EQ(0x7f0000000U, info.start);
+      ASSERT_EQ(100001U, info.name.length());
+      break;
+    }
+    ASSERT_EQ(0x10000U + i * 0x1000, info.start) << "Failed at map " << i;
+    ASSERT_EQ(0x11000U + i * 0x1000, info.end) << "Failed at map " << i;
+    ASSERT_EQ(i, info.offset) << "Failed at map " << i;
+    ASSERT_EQ(PROT_READ | PROT_EXEC, info.flags) << "Failed at map " << i;
+    ASSERT_EQ("/fake" + std::to_string(i) + ".so", info.name) << "Failed at map " << i;
+    i++;
+  }
+}
+
+TEST(MapsTest, refresh) {
+  TemporaryFile tf;
+  ASSERT_TRUE(tf.fd != -1);
+
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("1000-2000 r-xp 00000000 00:00 0   /fake.so\n"
+                                       "3000-4000 r-xp 00000000 00:00 0   /fake2.so\n"
+                                       "5000-6000 r-xp 00000000 00:00 0   /fake3.so\n",
+                                       tf.path, 0660, getuid(), getgid()));
+
+  FileMaps maps(tf.path);
+  ASSERT_TRUE(maps.Parse());
+  ASSERT_EQ(3U, maps.Total());
+  std::shared_ptr<Elf> elfs[3];
+  size_t i = 0;
+  for (auto& info : maps) {
+    elfs[i].reset(new Elf(nullptr));
+    info.elf = elfs[i++];
+    info.elf_offset = 0x100;
+  }
+
+  // The first map stays, the second changes and the third is gone.
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("1000-2000 r-xp 00000000 00:00 0   /fake.so\n"
+                                       "3000-4000 r-xp 00001000 00:00 0   /fake2.so\n"
+                                       "7000-8000 r-xp 00000000 00:00 0   /fake4.so\n",
+                                       tf.path, 0660, getuid(), getgid()));
+  ASSERT_TRUE(maps.Refresh());
+  ASSERT_EQ(3U, maps.Total());
+  auto it = maps.begin();
+  ASSERT_EQ(0x1000U, it->start);
+  ASSERT_EQ(elfs[0], it->elf);
+  ASSERT_EQ(0x100U, it->elf_offset);
+  ++it;
+  ASSERT_EQ(0x3000U, it->start);
+  ASSERT_EQ(0x1000U, it->offset);
+  ASSERT_TRUE(it->elf == nullptr);
+  ++it;
+  ASSERT_EQ(0x7000U, it->start);
+  ASSERT_TRUE(it->elf == nullptr);
+  ASSERT_EQ(1, elfs[1].use_count());
+  ASSERT_EQ(1, elfs[2].use_count());
+
+  // A failed refresh does not lose the old maps.
+  ASSERT_TRUE(android::base::WriteStringToFile("bad\n", tf.path, 0660, getuid(), getgid()));
+  ASSERT_FALSE(maps.Refresh());
+  ASSERT_EQ(3U, maps.Total());
+  ASSERT_EQ(elfs[0], maps.begin()->elf);
+}
+
 TEST(MapsTest, find) {
   BufferMaps maps(
       "1000-2000 r--p 00000010 00:00 0 /system/lib/fake1.so\n"
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <unwindstack/Memory.h>
+
+#include "MemoryFake.h"
+
+namespace unwindstack {
+
+class MemoryFakeCounted : public MemoryFake {
+ public:
+  bool Read(uint64_t addr, void* buffer, size_t size) override {
+    reads_++;
+    return MemoryFake::Read(addr, buffer, size);
+  }
+
+  size_t reads_ = 0;
+};
+
+class MemoryCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    memory_ = new MemoryFakeCounted;
+    cache_.reset(new MemoryCache(memory_));
+  }
+
+  void SetPages(uint64_t start, size_t pages) {
+    std::vector<uint8_t> src(pages * MemoryCache::kPageSize);
+    for (size_t i = 0; i < src.size(); i++) {
+      src[i] = i % 251;
+    }
+    memory_->SetMemory(start, src);
+  }
+
+  MemoryFakeCounted* memory_;
+  std::unique_ptr<MemoryCache> cache_;
+};
+
+TEST_F(MemoryCacheTest, read_cached) {
+  SetPages(0x10000, 1);
+
+  uint32_t value;
+  ASSERT_TRUE(cache_->Read(0x10004, &value, sizeof(value)));
+  EXPECT_EQ(0x07060504U, value);
+  EXPECT_EQ(1U, memory_->reads_);
+
+  // The rest of the page comes from the cache.
+  ASSERT_TRUE(cache_->Read(0x10ff0, &value, sizeof(value)));
+  ASSERT_TRUE(cache_->Read(0x10004, &value, sizeof(value)));
+  EXPECT_EQ(0x07060504U, value);
+  EXPECT_EQ(1U, memory_->reads_);
+
+  cache_->Clear();
+  ASSERT_TRUE(cache_->Read(0x10004, &value, sizeof(value)));
+  EXPECT_EQ(2U, memory_->reads_);
+}
+
+TEST_F(MemoryCacheTest, read_across_pages) {
+  SetPages(0x10000, 2);
+
+  std::vector<uint8_t> dst(16);
+  ASSERT_TRUE(cache_->Read(0x10ff8, dst.data(), dst.size()));
+  for (size_t i = 0; i < dst.size(); i++) {
+    ASSERT_EQ((0xff8 + i) % 251, dst[i]) << "Failed at byte " << i;
+  }
+  EXPECT_EQ(2U, memory_->reads_);
+}
+
+TEST_F(MemoryCacheTest, read_partial_page) {
+  // Only part of the page exists, that part is still readable.
+  std::vector<uint8_t> src(16, 0x4c);
+  memory_->SetMemory(0x10100, src);
+
+  std::vector<uint8_t> dst(16);
+  ASSERT_TRUE(cache_->Read(0x10100, dst.data(), dst.size()));
+  for (size_t i = 0; i < dst.size(); i++) {
+    ASSERT_EQ(0x4cU, dst[i]) << "Failed at byte " << i;
+  }
+  ASSERT_FALSE(cache_->Read(0x10108, dst.data(), dst.size()));
+
+  // The page is only tried once.
+  EXPECT_EQ(3U, memory_->reads_);
+  ASSERT_TRUE(cache_->Read(0x10100, dst.data(), dst.size()));
+  EXPECT_EQ(4U, memory_->reads_);
+}
+
+TEST_F(MemoryCacheTest, read_large) {
+  SetPages(0x10000, 3);
+
+  std::vector<uint8_t> dst(2 * MemoryCache::kPageSize);
+  ASSERT_TRUE(cache_->Read(0x10000, dst.data(), dst.size()));
+  EXPECT_EQ(1U, memory_->reads_);
+  ASSERT_TRUE(cache_->Read(0x10000, dst.data(), dst.size()));
+  EXPECT_EQ(2U, memory_->reads_);
+}
+
+TEST_F(MemoryCacheTest, read_max_pages) {
+  SetPages(0x10000, MemoryCache::kMaxPages + 1);
+
+  uint8_t value;
+  for (size_t i = 0; i <= MemoryCache::kMaxPages; i++) {
+    ASSERT_TRUE(cache_->Read(0x10000 + i * MemoryCache::kPageSize, &value, 1));
+  }
+  EXPECT_EQ(MemoryCache::kMaxPages + 1, memory_->reads_);
+
+  // Starting over dropped the first page.
+  ASSERT_TRUE(cache_->Read(0x10000, &value, 1));
+  EXPECT_EQ(MemoryCache::kMaxPages + 2, memory_->reads_);
+}
+
+TEST_F(MemoryCacheTest, read_overflow) {
+  std::vector<uint8_t> dst(200);
+  ASSERT_FALSE(cache_->Read(UINT64_MAX - 100, dst.data(), dst.size()));
+}
+
+}  // namespace unwindstack
@@ -34,6 +34,7 @@ class RegsFake : public RegsImpl<TypeParam> {
   uint64_t GetAdjustedPc(uint64_t, Elf*) override { return 0; }
   void SetFromRaw() override {}
   bool StepIfSignalHandler(uint64_t, Elf*, Memory*) override { return false; }
+  bool StepFramePointer(Memory*, Maps*) override { return false; }
   bool GetReturnAddressFromDefault(Memory*, uint64_t*) { return false; }
 };
 
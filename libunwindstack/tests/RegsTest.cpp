@@ -21,8 +21,10 @@
 #include <unwindstack/Elf.h>
 #include <unwindstack/ElfInterface.h>
 #include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
 #include <unwindstack/Regs.h>
 
+#include "Machine.h"
 #include "MemoryFake.h"
 
 namespace unwindstack {
@@ -61,6 +63,7 @@ class RegsTestImpl : public RegsImpl<TypeParam> {
   uint64_t GetAdjustedPc(uint64_t, Elf*) override { return 0; }
   void SetFromRaw() override {}
   bool StepIfSignalHandler(uint64_t, Elf*, Memory*) override { return false; }
+  bool StepFramePointer(Memory*, Maps*) override { return false; }
 };
 
 class RegsTest : public ::testing::Test {
@@ -286,4 +289,98 @@ TEST_F(RegsTest, x86_64_set_from_raw) {
   EXPECT_EQ(0x4900000000U, x86_64.pc());
 }
 
+TEST_F(RegsTest, x86_64_step_frame_pointer) {
+  BufferMaps maps(
+      "1000-2000 r-xp 00000000 00:00 0 /fake.so\n"
+      "3000-4000 r--p 00000000 00:00 0 /fake.so\n"
+      "10000-20000 rw-p 00000000 00:00 0 [stack]\n");
+  ASSERT_TRUE(maps.Parse());
+
+  RegsX86_64 x86_64;
+  uint64_t* regs = reinterpret_cast<uint64_t*>(x86_64.RawData());
+  regs[X86_64_REG_RBP] = 0x10100;
+  regs[X86_64_REG_SP] = 0x10000;
+  regs[X86_64_REG_PC] = 0x1100;
+  x86_64.SetFromRaw();
+
+  memory_->SetData64(0x10100, 0x10200);
+  memory_->SetData64(0x10108, 0x1200);
+  ASSERT_TRUE(x86_64.StepFramePointer(memory_, &maps));
+  EXPECT_EQ(0x1200U, x86_64.pc());
+  EXPECT_EQ(0x10110U, x86_64.sp());
+  EXPECT_EQ(0x10200U, regs[X86_64_REG_RBP]);
+
+  // Return address not in executable code.
+  memory_->SetData64(0x10200, 0x10300);
+  memory_->SetData64(0x10208, 0x3200);
+  ASSERT_FALSE(x86_64.StepFramePointer(memory_, &maps));
+  EXPECT_EQ(0x1200U, x86_64.pc());
+  EXPECT_EQ(0x10110U, x86_64.sp());
+
+  // Frame pointer below the stack pointer.
+  regs[X86_64_REG_RBP] = 0x10100;
+  ASSERT_FALSE(x86_64.StepFramePointer(memory_, &maps));
+
+  // Frame pointer not aligned.
+  memory_->SetData64(0x10208, 0x1300);
+  regs[X86_64_REG_RBP] = 0x10204;
+  ASSERT_FALSE(x86_64.StepFramePointer(memory_, &maps));
+  regs[X86_64_REG_RBP] = 0x10200;
+  ASSERT_TRUE(x86_64.StepFramePointer(memory_, &maps));
+  EXPECT_EQ(0x1300U, x86_64.pc());
+
+  // Unreadable record.
+  ASSERT_FALSE(x86_64.StepFramePointer(memory_, &maps));
+}
+
+TEST_F(RegsTest, x86_step_frame_pointer) {
+  BufferMaps maps(
+      "1000-2000 r-xp 00000000 00:00 0 /fake.so\n"
+      "10000-20000 rw-p 00000000 00:00 0 [stack]\n");
+  ASSERT_TRUE(maps.Parse());
+
+  RegsX86 x86;
+  uint32_t* regs = reinterpret_cast<uint32_t*>(x86.RawData());
+  regs[X86_REG_EBP] = 0x10100;
+  regs[X86_REG_SP] = 0x10000;
+  regs[X86_REG_PC] = 0x1100;
+  x86.SetFromRaw();
+
+  memory_->SetData32(0x10100, 0x10200);
+  memory_->SetData32(0x10104, 0x1200);
+  ASSERT_TRUE(x86.StepFramePointer(memory_, &maps));
+  EXPECT_EQ(0x1200U, x86.pc());
+  EXPECT_EQ(0x10108U, x86.sp());
+  EXPECT_EQ(0x10200U, regs[X86_REG_EBP]);
+}
+
+TEST_F(RegsTest, arm64_step_frame_pointer) {
+  BufferMaps maps(
+      "1000-2000 r-xp 00000000 00:00 0 /fake.so\n"
+      "10000-20000 rw-p 00000000 00:00 0 [stack]\n");
+  ASSERT_TRUE(maps.Parse());
+
+  RegsArm64 arm64;
+  uint64_t* regs = reinterpret_cast<uint64_t*>(arm64.RawData());
+  regs[ARM64_REG_R29] = 0x10100;
+  regs[ARM64_REG_SP] = 0x10000;
+  regs[ARM64_REG_PC] = 0x1100;
+  arm64.SetFromRaw();
+
+  memory_->SetData64(0x10100, 0x10200);
+  memory_->SetData64(0x10108, 0x1200);
+  ASSERT_TRUE(arm64.StepFramePointer(memory_, &maps));
+  EXPECT_EQ(0x1200U, arm64.pc());
+  EXPECT_EQ(0x10110U, arm64.sp());
+  EXPECT_EQ(0x10200U, regs[ARM64_REG_R29]);
+}
+
+TEST_F(RegsTest, arm_step_frame_pointer) {
+  BufferMaps maps("1000-2000 r-xp 00000000 00:00 0 /fake.so\n");
+  ASSERT_TRUE(maps.Parse());
+
+  RegsArm arm;
+  ASSERT_FALSE(arm.StepFramePointer(memory_, &maps));
+}
+
 }  // namespace unwindstack
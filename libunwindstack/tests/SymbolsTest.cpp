@@ -330,9 +330,56 @@ TYPED_TEST_P(SymbolsTest, symtab_read_cached) {
   ASSERT_EQ(3U, func_offset);
 }
 
+// Verify a table larger than a single read, with entries out of order.
+TYPED_TEST_P(SymbolsTest, symtab_large) {
+  constexpr size_t kEntries = 1000;
+  Symbols symbols(0x10000, kEntries * sizeof(TypeParam), sizeof(TypeParam), 0x2000, 0x100);
+
+  TypeParam sym;
+  for (size_t i = 0; i < kEntries; i++) {
+    this->InitSym(&sym, 0x100000 + ((i * 7) % kEntries) * 0x100, 0x80, 0x10);
+    this->memory_.SetMemory(0x10000 + i * sizeof(sym), &sym, sizeof(sym));
+  }
+  std::string fake_name("fake_function");
+  this->memory_.SetMemory(0x2010, fake_name.c_str(), fake_name.size() + 1);
+
+  std::string name;
+  uint64_t func_offset;
+  for (size_t i = 0; i < kEntries; i++) {
+    uint64_t addr = 0x100000 + i * 0x100;
+    ASSERT_TRUE(symbols.GetName<TypeParam>(addr + 0x7f, 0, &this->memory_, &name, &func_offset))
+        << "Failed at entry " << i;
+    ASSERT_EQ("fake_function", name);
+    ASSERT_EQ(0x7fU, func_offset);
+    ASSERT_FALSE(symbols.GetName<TypeParam>(addr + 0x80, 0, &this->memory_, &name, &func_offset))
+        << "Failed at entry " << i;
+  }
+  ASSERT_FALSE(symbols.GetName<TypeParam>(0xfffff, 0, &this->memory_, &name, &func_offset));
+}
+
+// Verify the entries before a read error are still used.
+TYPED_TEST_P(SymbolsTest, symtab_read_error) {
+  Symbols symbols(0x1000, 3 * sizeof(TypeParam), sizeof(TypeParam), 0x2000, 0x100);
+
+  TypeParam sym;
+  this->InitSym(&sym, 0x5000, 0x10, 0x10);
+  this->memory_.SetMemory(0x1000, &sym, sizeof(sym));
+  this->InitSym(&sym, 0x6000, 0x10, 0x10);
+  this->memory_.SetMemory(0x1000 + 2 * sizeof(sym), &sym, sizeof(sym));
+  std::string fake_name("fake_function");
+  this->memory_.SetMemory(0x2010, fake_name.c_str(), fake_name.size() + 1);
+
+  std::string name;
+  uint64_t func_offset;
+  ASSERT_TRUE(symbols.GetName<TypeParam>(0x5004, 0, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("fake_function", name);
+  ASSERT_EQ(4U, func_offset);
+  ASSERT_FALSE(symbols.GetName<TypeParam>(0x6004, 0, &this->memory_, &name, &func_offset));
+}
+
 REGISTER_TYPED_TEST_CASE_P(SymbolsTest, function_bounds_check, no_symbol, multiple_entries,
                            multiple_entries_nonstandard_size, load_bias, symtab_value_out_of_bounds,
-                           symtab_read_cached);
+                           symtab_read_cached, symtab_large, symtab_read_error);
 
 typedef ::testing::Types<Elf32_Sym, Elf64_Sym> SymbolsTestTypes;
 INSTANTIATE_TYPED_TEST_CASE_P(, SymbolsTest, SymbolsTestTypes);
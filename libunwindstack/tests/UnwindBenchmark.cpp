@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/RegsGetLocal.h>
+#include <unwindstack/Unwinder.h>
+
+#include "ArmExidx.h"
+#include "Machine.h"
+#include "MemoryFake.h"
+
+namespace unwindstack {
+
+static constexpr size_t kCallDepth = 32;
+
+// Builds a call chain of the given depth, then runs the benchmark at the
+// bottom of it. Built with frame pointers, so both kinds of unwinds work.
+static __attribute__((noinline)) void CallChain(size_t depth, benchmark::State& state,
+                                                void (*run)(benchmark::State&)) {
+  if (depth == 0) {
+    run(state);
+    return;
+  }
+  CallChain(depth - 1, state, run);
+  // Keep the call from becoming a jump.
+  asm volatile("" ::: "memory");
+}
+
+static void UnwindLocal(benchmark::State& state, bool use_frame_pointers) {
+  LocalMaps maps;
+  if (!maps.Parse()) {
+    state.SkipWithError("Failed to parse local maps.");
+    return;
+  }
+  MemoryLocal memory;
+  std::unique_ptr<Regs> regs(Regs::CreateFromLocal());
+
+  size_t frames = 0;
+  while (state.KeepRunning()) {
+    RegsGetLocal(regs.get());
+    Unwinder unwinder(kCallDepth + 16, getpid(), &maps, regs.get(), &memory);
+    unwinder.set_use_frame_pointers(use_frame_pointers);
+    unwinder.set_resolve_names(false);
+    unwinder.Unwind();
+    frames = unwinder.frames().size();
+  }
+  if (frames < kCallDepth) {
+    state.SkipWithError("Unwind stopped before the end of the call chain.");
+  }
+}
+
+static void BM_unwind_dwarf(benchmark::State& state) {
+  CallChain(kCallDepth, state, [](benchmark::State& state) { UnwindLocal(state, false); });
+}
+BENCHMARK(BM_unwind_dwarf);
+
+static void BM_unwind_frame_pointer(benchmark::State& state) {
+  CallChain(kCallDepth, state, [](benchmark::State& state) { UnwindLocal(state, true); });
+}
+BENCHMARK(BM_unwind_frame_pointer);
+
+// The cost of one arm exidx step for a typical function:
+//   vsp = vsp + 16
+//   pop {r4-r7, r14}
+//   finish
+static void BM_exidx_step(benchmark::State& state) {
+  MemoryFake elf_memory;
+  elf_memory.SetData32(0x1000, 0x7fff2340);
+  elf_memory.SetData32(0x1004, 0x8003abb0);
+  MemoryFake process_memory;
+  for (size_t i = 0; i < 16; i++) {
+    process_memory.SetData32(0x10000 + i * 4, 0x2000 + i);
+  }
+
+  RegsArm regs;
+  while (state.KeepRunning()) {
+    regs[ARM_REG_SP] = 0x10000;
+    regs.SetFromRaw();
+    ArmExidx exidx(&regs, &elf_memory, &process_memory);
+    if (!exidx.ExtractEntryData(0x1000) || !exidx.Eval()) {
+      state.SkipWithError("Exidx step failed.");
+      break;
+    }
+  }
+}
+BENCHMARK(BM_exidx_step);
+
+}  // namespace unwindstack
+
+BENCHMARK_MAIN()
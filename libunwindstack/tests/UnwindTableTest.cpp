@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <elf.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+
+#include <unwindstack/DwarfLocation.h>
+#include <unwindstack/DwarfStructs.h>
+#include <unwindstack/UnwindTable.h>
+
+#include "MemoryFake.h"
+#include "RegsFake.h"
+
+namespace unwindstack {
+
+class UnwindTableTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    header_ = {};
+    header_.magic = kUnwindTableMagic;
+    header_.version = kUnwindTableVersion;
+    header_.machine_type = EM_X86_64;
+    header_.class_type = ELFCLASS64;
+    rows_.clear();
+    rules_.clear();
+    symbols_.clear();
+    strings_.clear();
+  }
+
+  void AddRule(uint16_t reg, uint8_t type, uint64_t value0, uint64_t value1) {
+    UnwindTableRule rule = {};
+    rule.reg = reg;
+    rule.type = type;
+    rule.values[0] = value0;
+    rule.values[1] = value1;
+    rules_.push_back(rule);
+  }
+
+  void AddRow(uint64_t pc_start, uint64_t pc_end, uint32_t rules_index, uint16_t num_rules) {
+    UnwindTableRow row = {};
+    row.pc_start = pc_start;
+    row.pc_end = pc_end;
+    row.rules_index = rules_index;
+    row.num_rules = num_rules;
+    row.return_address_register = 5;
+    rows_.push_back(row);
+  }
+
+  void AddSymbol(uint64_t start, uint64_t end, const std::string& name) {
+    UnwindTableSymbol symbol = {};
+    symbol.start = start;
+    symbol.end = end;
+    symbol.name_offset = strings_.size();
+    symbols_.push_back(symbol);
+    strings_.append(name.c_str(), name.size() + 1);
+  }
+
+  void WriteTable() {
+    header_.num_rows = rows_.size();
+    header_.num_rules = rules_.size();
+    header_.num_symbols = symbols_.size();
+    header_.strings_size = strings_.size();
+    ASSERT_EQ(0, ftruncate(file_.fd, 0));
+    ASSERT_EQ(0, lseek(file_.fd, 0, SEEK_SET));
+    ASSERT_TRUE(android::base::WriteFully(file_.fd, &header_, sizeof(header_)));
+    ASSERT_TRUE(android::base::WriteFully(file_.fd, rows_.data(),
+                                          rows_.size() * sizeof(UnwindTableRow)));
+    ASSERT_TRUE(android::base::WriteFully(file_.fd, rules_.data(),
+                                          rules_.size() * sizeof(UnwindTableRule)));
+    ASSERT_TRUE(android::base::WriteFully(file_.fd, symbols_.data(),
+                                          symbols_.size() * sizeof(UnwindTableSymbol)));
+    ASSERT_TRUE(android::base::WriteFully(file_.fd, strings_.data(), strings_.size()));
+  }
+
+  TemporaryFile file_;
+  UnwindTableHeader header_;
+  std::vector<UnwindTableRow> rows_;
+  std::vector<UnwindTableRule> rules_;
+  std::vector<UnwindTableSymbol> symbols_;
+  std::string strings_;
+  MemoryFake memory_;
+};
+
+TEST_F(UnwindTableTest, init) {
+  AddSymbol(0x1000, 0x1100, "function");
+  ASSERT_NO_FATAL_FAILURE(WriteTable());
+
+  UnwindTable table;
+  ASSERT_TRUE(table.Init(file_.path));
+  EXPECT_EQ(static_cast<uint32_t>(EM_X86_64), table.machine_type());
+  EXPECT_EQ(ELFCLASS64, table.class_type());
+}
+
+TEST_F(UnwindTableTest, init_fail) {
+  UnwindTable table;
+  ASSERT_FALSE(table.Init("/does/not/exist"));
+
+  // Empty file.
+  ASSERT_FALSE(table.Init(file_.path));
+
+  header_.magic = 0;
+  ASSERT_NO_FATAL_FAILURE(WriteTable());
+  ASSERT_FALSE(table.Init(file_.path));
+
+  SetUp();
+  header_.version = kUnwindTableVersion + 1;
+  ASSERT_NO_FATAL_FAILURE(WriteTable());
+  ASSERT_FALSE(table.Init(file_.path));
+
+  SetUp();
+  header_.class_type = 0;
+  ASSERT_NO_FATAL_FAILURE(WriteTable());
+  ASSERT_FALSE(table.Init(file_.path));
+
+  // The counts do not fit in the file.
+  SetUp();
+  AddRow(0x1000, 0x1100, 0, 0);
+  ASSERT_NO_FATAL_FAILURE(WriteTable());
+  ASSERT_EQ(0, ftruncate(file_.fd, sizeof(header_) + sizeof(UnwindTableRow) - 1));
+  ASSERT_FALSE(table.Init(file_.path));
+
+  // The strings are not terminated.
+  SetUp();
+  AddSymbol(0x1000, 0x1100, "function");
+  strings_.pop_back();
+  ASSERT_NO_FATAL_FAILURE(WriteTable());
+  ASSERT_FALSE(table.Init(file_.path));
+}
+
+TEST_F(UnwindTableTest, step) {
+  AddRule(CFA_REG, DWARF_LOCATION_REGISTER, 9, 0x10);
+  AddRule(5, DWARF_LOCATION_OFFSET, static_cast<uint64_t>(-8), 0);
+  AddRule(CFA_REG, DWARF_LOCATION_REGISTER, 9, 0x20);
+  AddRule(5, DWARF_LOCATION_OFFSET, static_cast<uint64_t>(-8), 0);
+  AddRule(3, DWARF_LOCATION_VAL_OFFSET, static_cast<uint64_t>(-0x10), 0);
+  AddRow(0x1000, 0x1004, 0, 2);
+  AddRow(0x1004, 0x1100, 2, 3);
+  ASSERT_NO_FATAL_FAILURE(WriteTable());
+
+  UnwindTable table;
+  ASSERT_TRUE(table.Init(file_.path));
+
+  RegsFake<uint64_t> regs(10, 9);
+  regs.set_pc(0x1000);
+  regs.set_sp(0x4000);
+  regs[9] = 0x4000;
+  memory_.SetData64(0x4008, 0x2000);
+  ASSERT_TRUE(table.Step(0x1000, &regs, &memory_));
+  EXPECT_EQ(0x2000U, regs.pc());
+  EXPECT_EQ(0x4010U, regs.sp());
+
+  regs.set_pc(0x10ff);
+  regs.set_sp(0x4000);
+  regs[9] = 0x4000;
+  memory_.SetData64(0x4018, 0x3000);
+  ASSERT_TRUE(table.Step(0x10ff, &regs, &memory_));
+  EXPECT_EQ(0x3000U, regs.pc());
+  EXPECT_EQ(0x4020U, regs.sp());
+  EXPECT_EQ(0x4010U, regs[3]);
+}
+
+TEST_F(UnwindTableTest, step_32) {
+  header_.machine_type = EM_ARM;
+  header_.class_type = ELFCLASS32;
+  AddRule(CFA_REG, DWARF_LOCATION_REGISTER, 9, 0x8);
+  AddRule(5, DWARF_LOCATION_OFFSET, static_cast<uint64_t>(-4), 0);
+  AddRow(0x1000, 0x1100, 0, 2);
+  ASSERT_NO_FATAL_FAILURE(WriteTable());
+
+  UnwindTable table;
+  ASSERT_TRUE(table.Init(file_.path));
+
+  RegsFake<uint32_t> regs(10, 9);
+  regs.set_pc(0x1000);
+  regs.set_sp(0x4000);
+  regs[9] = 0x4000;
+  memory_.SetData32(0x4004, 0x2000);
+  ASSERT_TRUE(table.Step(0x1080, &regs, &memory_));
+  EXPECT_EQ(0x2000U, regs.pc());
+  EXPECT_EQ(0x4008U, regs.sp());
+}
+
+TEST_F(UnwindTableTest, step_fail) {
+  AddRule(CFA_REG, DWARF_LOCATION_REGISTER, 9, 0x10);
+  AddRule(5, DWARF_LOCATION_OFFSET, static_cast<uint64_t>(-8), 0);
+  AddRule(CFA_REG, DWARF_LOCATION_EXPRESSION, 2, 0x5000);
+  AddRow(0x1000, 0x1004, 0, 2);
+  AddRow(0x1004, 0x1008, 2, 1);
+  AddRow(0x2000, 0x2004, 2, 2);
+  AddRow(0x3000, 0x3004, 0, 2);
+  ASSERT_NO_FATAL_FAILURE(WriteTable());
+
+  UnwindTable table;
+  RegsFake<uint64_t> regs(10, 9);
+  ASSERT_FALSE(table.Step(0x1000, &regs, &memory_));
+
+  ASSERT_TRUE(table.Init(file_.path));
+  regs.set_sp(0x4000);
+  regs[9] = 0x4000;
+
+  // Outside of any row.
+  ASSERT_FALSE(table.Step(0xfff, &regs, &memory_));
+  ASSERT_FALSE(table.Step(0x1008, &regs, &memory_));
+  ASSERT_FALSE(table.Step(0x3004, &regs, &memory_));
+
+  // Expressions are not in the table.
+  ASSERT_FALSE(table.Step(0x1004, &regs, &memory_));
+
+  // Rules past the end of the table.
+  ASSERT_FALSE(table.Step(0x2000, &regs, &memory_));
+
+  // The return address can not be read.
+  ASSERT_FALSE(table.Step(0x3000, &regs, &memory_));
+}
+
+TEST_F(UnwindTableTest, function_name) {
+  AddSymbol(0x1000, 0x1100, "first");
+  AddSymbol(0x1100, 0x1200, "second");
+  AddSymbol(0x2000, 0x2010, "third");
+  ASSERT_NO_FATAL_FAILURE(WriteTable());
+
+  UnwindTable table;
+  std::string name;
+  uint64_t func_offset;
+  ASSERT_FALSE(table.GetFunctionName(0x1000, &name, &func_offset));
+
+  ASSERT_TRUE(table.Init(file_.path));
+  ASSERT_TRUE(table.GetFunctionName(0x1000, &name, &func_offset));
+  EXPECT_EQ("first", name);
+  EXPECT_EQ(0U, func_offset);
+  ASSERT_TRUE(table.GetFunctionName(0x1100, &name, &func_offset));
+  EXPECT_EQ("second", name);
+  EXPECT_EQ(0U, func_offset);
+  ASSERT_TRUE(table.GetFunctionName(0x200f, &name, &func_offset));
+  EXPECT_EQ("third", name);
+  EXPECT_EQ(0xfU, func_offset);
+
+  ASSERT_FALSE(table.GetFunctionName(0xfff, &name, &func_offset));
+  ASSERT_FALSE(table.GetFunctionName(0x1200, &name, &func_offset));
+  ASSERT_FALSE(table.GetFunctionName(0x2010, &name, &func_offset));
+}
+
+}  // namespace unwindstack
@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <sys/ptrace.h>
 #include <sys/syscall.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include <gtest/gtest.h>
@@ -36,6 +37,7 @@
 #include <unwindstack/MapInfo.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
+#include <unwindstack/ProcessUnwinder.h>
 #include <unwindstack/Regs.h>
 #include <unwindstack/RegsGetLocal.h>
 
@@ -46,6 +48,8 @@ static volatile bool g_ready_for_remote = false;
 static volatile bool g_signal_ready_for_remote = false;
 static std::atomic_bool g_finish(false);
 static std::atomic_uintptr_t g_ucontext;
+static std::atomic_int g_remote_threads(0);
+static volatile bool g_threads_ready_for_remote = false;
 
 static std::vector<const char*> kFunctionOrder{"InnerFunction", "MiddleFunction", "OuterFunction"};
 
@@ -141,6 +145,7 @@ extern "C" void InnerFunction(bool local) {
 
     VerifyUnwind(getpid(), &memory, &maps, regs.get(), kFunctionOrder);
   } else {
+    g_remote_threads++;
     g_ready_for_remote = true;
     g_ready = true;
     while (!g_finish.load()) {
@@ -313,4 +318,62 @@ TEST(UnwindTest, remote_through_signal_sa_siginfo) {
   RemoteThroughSignal(SA_SIGINFO);
 }
 
+TEST(UnwindTest, remote_process_unwinder) {
+  constexpr int kThreads = 4;
+
+  pid_t pid;
+  if ((pid = fork()) == 0) {
+    for (int i = 0; i < kThreads; i++) {
+      std::thread([]() { OuterFunction(false); }).detach();
+    }
+    while (g_remote_threads.load() != kThreads) {
+    }
+    g_threads_ready_for_remote = true;
+    while (!g_finish.load()) {
+    }
+    exit(0);
+  }
+  ASSERT_NE(-1, pid);
+
+  bool completed;
+  WaitForRemote(pid, reinterpret_cast<uint64_t>(&g_threads_ready_for_remote), true, &completed);
+  ASSERT_TRUE(completed) << "Timed out waiting for remote process to be ready.";
+
+  std::vector<pid_t> tids;
+  ASSERT_TRUE(ProcessUnwinder::GetThreads(pid, &tids));
+  ASSERT_EQ(static_cast<size_t>(kThreads + 1), tids.size());
+  ASSERT_EQ(pid, tids[0]);
+  for (size_t i = 1; i < tids.size(); i++) {
+    ASSERT_EQ(0, ptrace(PTRACE_ATTACH, tids[i], 0, 0));
+    ASSERT_EQ(tids[i], waitpid(tids[i], nullptr, __WALL));
+  }
+
+  ProcessUnwinder unwinder(pid);
+  ASSERT_TRUE(unwinder.Init());
+  std::vector<ThreadUnwind> threads;
+  unwinder.Unwind(tids, &threads, 2);
+  ASSERT_EQ(tids.size(), threads.size());
+
+  // The main thread is just spinning, every other one is in InnerFunction.
+  for (size_t i = 1; i < threads.size(); i++) {
+    ASSERT_EQ(tids[i], threads[i].tid);
+    ASSERT_TRUE(threads[i].regs_valid);
+    size_t function_name_index = 0;
+    for (const auto& frame : threads[i].frames) {
+      if (function_name_index < kFunctionOrder.size() &&
+          frame.function_name == kFunctionOrder[function_name_index]) {
+        function_name_index++;
+      }
+    }
+    ASSERT_EQ(kFunctionOrder.size(), function_name_index) << "Thread " << tids[i];
+  }
+
+  for (size_t i = 0; i < tids.size(); i++) {
+    ASSERT_EQ(0, ptrace(PTRACE_DETACH, tids[i], 0, 0));
+  }
+
+  kill(pid, SIGKILL);
+  ASSERT_EQ(pid, wait(nullptr));
+}
+
 }  // namespace unwindstack
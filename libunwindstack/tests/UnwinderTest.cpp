@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/ElfInterface.h>
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/Unwinder.h>
+
+#include "Machine.h"
+#include "MemoryFake.h"
+
+namespace unwindstack {
+
+struct StepData {
+  uint64_t pc;
+  uint64_t sp;
+  uint64_t bp;
+};
+
+class UnwinderElfFake : public Elf {
+ public:
+  UnwinderElfFake(Memory* memory) : Elf(memory) { valid_ = true; }
+  virtual ~UnwinderElfFake() = default;
+
+  void set_elf_interface(ElfInterface* interface) { interface_.reset(interface); }
+};
+
+// Every Step pops the next set of registers off the list.
+class UnwinderElfInterfaceFake : public ElfInterface {
+ public:
+  UnwinderElfInterfaceFake(Memory* memory, std::deque<StepData>* steps)
+      : ElfInterface(memory), steps_(steps) {}
+  virtual ~UnwinderElfInterfaceFake() = default;
+
+  bool Init() override { return false; }
+  void InitHeaders() override {}
+  bool GetSoname(std::string*) override { return false; }
+
+  bool GetFunctionName(uint64_t addr, std::string* name, uint64_t* offset) override {
+    *name = "Function" + std::to_string(addr >> 12);
+    *offset = addr & 0xfff;
+    return true;
+  }
+
+  bool Step(uint64_t, Regs* regs, Memory*) override {
+    if (steps_->empty()) {
+      return false;
+    }
+    uint64_t* raw = reinterpret_cast<uint64_t*>(regs->RawData());
+    raw[X86_64_REG_PC] = steps_->front().pc;
+    raw[X86_64_REG_SP] = steps_->front().sp;
+    raw[X86_64_REG_RBP] = steps_->front().bp;
+    regs->SetFromRaw();
+    steps_->pop_front();
+    return true;
+  }
+
+ private:
+  std::deque<StepData>* steps_;
+};
+
+class UnwinderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    maps_.reset(
+        new BufferMaps("1000-8000 r-xp 00000000 00:00 0 /fake.so\n"
+                       "10000-20000 rw-p 00000000 00:00 0 [stack]\n"));
+    ASSERT_TRUE(maps_->Parse());
+
+    UnwinderElfFake* elf = new UnwinderElfFake(new MemoryFake);
+    elf->set_elf_interface(new UnwinderElfInterfaceFake(elf->memory(), &steps_));
+    std::shared_ptr<Elf> shared_elf(elf);
+    for (auto& info : *maps_) {
+      info.elf = shared_elf;
+      info.elf_offset = 0;
+    }
+
+    uint64_t* raw = reinterpret_cast<uint64_t*>(regs_.RawData());
+    raw[X86_64_REG_PC] = 0x1100;
+    raw[X86_64_REG_SP] = 0x10000;
+    raw[X86_64_REG_RBP] = 0x10100;
+    regs_.SetFromRaw();
+  }
+
+  std::unique_ptr<Maps> maps_;
+  RegsX86_64 regs_;
+  MemoryFake memory_;
+  std::deque<StepData> steps_;
+};
+
+TEST_F(UnwinderTest, unwind) {
+  steps_.push_back(StepData{0x2100, 0x10010, 0x10100});
+  steps_.push_back(StepData{0x3100, 0x10110, 0x10200});
+
+  Unwinder unwinder(64, getpid(), maps_.get(), &regs_, &memory_);
+  unwinder.Unwind();
+
+  const auto& frames = unwinder.frames();
+  ASSERT_EQ(3U, frames.size());
+  EXPECT_EQ(0U, frames[0].num);
+  EXPECT_EQ(0x1100U, frames[0].pc);
+  EXPECT_EQ(0x10000U, frames[0].sp);
+  EXPECT_EQ(0x100U, frames[0].rel_pc);
+  EXPECT_EQ("Function0", frames[0].function_name);
+  EXPECT_EQ(0x100U, frames[0].function_offset);
+  EXPECT_EQ("/fake.so", frames[0].map_name);
+  EXPECT_EQ(0x1000U, frames[0].map_start);
+  EXPECT_EQ(0x8000U, frames[0].map_end);
+
+  EXPECT_EQ(1U, frames[1].num);
+  EXPECT_EQ(0x2100U, frames[1].pc);
+  EXPECT_EQ(0x10010U, frames[1].sp);
+  EXPECT_EQ(0x10ffU, frames[1].rel_pc);
+  EXPECT_EQ("Function1", frames[1].function_name);
+
+  EXPECT_EQ(2U, frames[2].num);
+  EXPECT_EQ(0x3100U, frames[2].pc);
+  EXPECT_EQ(0x20ffU, frames[2].rel_pc);
+}
+
+TEST_F(UnwinderTest, max_frames) {
+  for (size_t i = 0; i < 10; i++) {
+    steps_.push_back(StepData{0x2100, 0x10010, 0x10100});
+  }
+
+  Unwinder unwinder(5, getpid(), maps_.get(), &regs_, &memory_);
+  unwinder.Unwind();
+  ASSERT_EQ(5U, unwinder.frames().size());
+}
+
+TEST_F(UnwinderTest, pc_not_in_map) {
+  steps_.push_back(StepData{0x9000, 0x10010, 0x10100});
+  steps_.push_back(StepData{0x2100, 0x10110, 0x10200});
+
+  Unwinder unwinder(64, getpid(), maps_.get(), &regs_, &memory_);
+  unwinder.Unwind();
+
+  const auto& frames = unwinder.frames();
+  ASSERT_EQ(2U, frames.size());
+  EXPECT_EQ(0x9000U, frames[1].pc);
+  EXPECT_EQ(0x9000U, frames[1].rel_pc);
+  EXPECT_EQ("", frames[1].map_name);
+  EXPECT_EQ("", frames[1].function_name);
+}
+
+TEST_F(UnwinderTest, frame_pointers) {
+  // Only the first frame uses the elf.
+  steps_.push_back(StepData{0x2100, 0x10010, 0x10100});
+  memory_.SetData64(0x10100, 0x10200);
+  memory_.SetData64(0x10108, 0x3100);
+  memory_.SetData64(0x10200, 0);
+  memory_.SetData64(0x10208, 0x4100);
+
+  Unwinder unwinder(64, getpid(), maps_.get(), &regs_, &memory_);
+  unwinder.set_use_frame_pointers(true);
+  unwinder.set_resolve_names(false);
+  unwinder.Unwind();
+
+  const auto& frames = unwinder.frames();
+  ASSERT_EQ(4U, frames.size());
+  EXPECT_EQ(0x1100U, frames[0].pc);
+  EXPECT_EQ(0x2100U, frames[1].pc);
+  EXPECT_EQ(0x3100U, frames[2].pc);
+  EXPECT_EQ(0x10110U, frames[2].sp);
+  EXPECT_EQ(0x4100U, frames[3].pc);
+  EXPECT_EQ(0x10210U, frames[3].sp);
+  EXPECT_EQ("", frames[3].function_name);
+  // The chain ends at a zero frame pointer, the elf has nothing after it.
+  EXPECT_TRUE(steps_.empty());
+}
+
+TEST_F(UnwinderTest, frame_pointers_broken_chain) {
+  steps_.push_back(StepData{0x2100, 0x10010, 0x10100});
+  steps_.push_back(StepData{0x5100, 0x10400, 0x10500});
+  // Returns into the stack, not code.
+  memory_.SetData64(0x10100, 0x10200);
+  memory_.SetData64(0x10108, 0x10300);
+  memory_.SetData64(0x10500, 0);
+  memory_.SetData64(0x10508, 0x6100);
+
+  Unwinder unwinder(64, getpid(), maps_.get(), &regs_, &memory_);
+  unwinder.set_use_frame_pointers(true);
+  unwinder.Unwind();
+
+  const auto& frames = unwinder.frames();
+  ASSERT_EQ(4U, frames.size());
+  EXPECT_EQ(0x2100U, frames[1].pc);
+  EXPECT_EQ(0x5100U, frames[2].pc);
+  EXPECT_EQ(0x6100U, frames[3].pc);
+  EXPECT_EQ(0x10510U, frames[3].sp);
+  EXPECT_TRUE(steps_.empty());
+}
+
+}  // namespace unwindstack
@@ -92,7 +92,8 @@ void DoUnwind(pid_t pid) {
   }
   printf("\n");
 
-  unwindstack::MemoryRemote remote_memory(pid);
+  // The process is stopped, so its pages can be kept for the whole unwind.
+  unwindstack::MemoryCache remote_memory(new unwindstack::MemoryRemote(pid));
   for (size_t frame_num = 0; frame_num < 64; frame_num++) {
     if (regs->pc() == 0) {
       break;
@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Flattens the dwarf unwind information and the function names of an elf
+// into the table UnwindTable maps in, see UnwindTable.h for the format.
+//
+//   unwind_table <elf file> <table file>
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+
+#include <unwindstack/DwarfLocation.h>
+#include <unwindstack/DwarfSection.h>
+#include <unwindstack/DwarfStructs.h>
+#include <unwindstack/Elf.h>
+#include <unwindstack/ElfInterface.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/UnwindTable.h>
+
+namespace unwindstack {
+
+class TableBuilder {
+ public:
+  void AddSection(ElfInterface* interface, DwarfSection* section, uint64_t load_bias);
+
+  bool Write(uint32_t machine_type, uint8_t class_type, int fd);
+
+  size_t num_rows() { return rows_.size(); }
+  size_t num_skipped_rows() { return num_skipped_rows_; }
+  size_t num_symbols() { return symbols_.size(); }
+
+ private:
+  typedef std::vector<std::tuple<uint16_t, uint8_t, uint64_t, uint64_t>> Rules;
+
+  struct Row {
+    uint64_t pc_end;
+    uint16_t return_address_register;
+    Rules rules;
+  };
+
+  struct Symbol {
+    uint64_t end;
+    std::string name;
+  };
+
+  void AddRow(uint64_t pc_start, uint64_t pc_end, uint16_t return_address_register,
+              const dwarf_loc_regs_t& loc_regs);
+  void AddSymbol(ElfInterface* interface, uint64_t pc, uint64_t pc_end);
+
+  // Indexed by pc_start, the first section to cover a pc wins the same way
+  // ElfInterface::Step() tries them.
+  std::map<uint64_t, Row> rows_;
+  std::map<uint64_t, Symbol> symbols_;
+  size_t num_skipped_rows_ = 0;
+};
+
+void TableBuilder::AddRow(uint64_t pc_start, uint64_t pc_end, uint16_t return_address_register,
+                          const dwarf_loc_regs_t& loc_regs) {
+  if (loc_regs.count(CFA_REG) == 0) {
+    num_skipped_rows_++;
+    return;
+  }
+  Rules rules;
+  for (const auto& entry : loc_regs) {
+    const DwarfLocation& loc = entry.second;
+    if (loc.type == DWARF_LOCATION_EXPRESSION || loc.type == DWARF_LOCATION_VAL_EXPRESSION) {
+      // Expressions point into the section, leave these pcs to the elf.
+      num_skipped_rows_++;
+      return;
+    }
+    rules.emplace_back(entry.first, loc.type, loc.values[0], loc.values[1]);
+  }
+  std::sort(rules.begin(), rules.end());
+
+  auto next = rows_.lower_bound(pc_start);
+  if (next != rows_.end() && next->first < pc_end) {
+    return;
+  }
+  if (next != rows_.begin() && std::prev(next)->second.pc_end > pc_start) {
+    return;
+  }
+  rows_.emplace_hint(next, pc_start, Row{pc_end, return_address_register, std::move(rules)});
+}
+
+void TableBuilder::AddSymbol(ElfInterface* interface, uint64_t pc, uint64_t pc_end) {
+  std::string name;
+  uint64_t func_offset;
+  if (!interface->GetFunctionName(pc, &name, &func_offset) || name.empty()) {
+    return;
+  }
+  uint64_t start = pc - func_offset;
+  auto entry = symbols_.find(start);
+  if (entry == symbols_.end()) {
+    symbols_[start] = Symbol{pc_end, name};
+  } else if (entry->second.end < pc_end) {
+    entry->second.end = pc_end;
+  }
+}
+
+void TableBuilder::AddSection(ElfInterface* interface, DwarfSection* section,
+                              uint64_t load_bias) {
+  for (const DwarfFde* fde : *section) {
+    if (fde == nullptr || fde->cie == nullptr || fde->pc_start >= fde->pc_end) {
+      continue;
+    }
+    AddSymbol(interface, fde->pc_start + load_bias, fde->pc_end + load_bias);
+
+    // One lookup per row, each one ends where the location info changes.
+    uint64_t pc = fde->pc_start;
+    while (pc < fde->pc_end) {
+      dwarf_loc_regs_t loc_regs;
+      if (!section->GetCfaLocationInfo(pc, fde, &loc_regs)) {
+        num_skipped_rows_++;
+        break;
+      }
+      uint64_t row_end = std::min(section->loc_regs_row_end(), fde->pc_end);
+      if (row_end <= pc) {
+        row_end = pc + 1;
+      }
+      AddRow(pc + load_bias, row_end + load_bias, fde->cie->return_address_register, loc_regs);
+      pc = row_end;
+    }
+  }
+}
+
+bool TableBuilder::Write(uint32_t machine_type, uint8_t class_type, int fd) {
+  std::vector<UnwindTableRow> rows;
+  std::vector<UnwindTableRule> rules;
+  std::vector<UnwindTableSymbol> symbols;
+  std::string strings;
+
+  // Rows that only differ by pcs share their rules, and neighbouring rows
+  // that do not differ at all become one.
+  std::map<Rules, uint32_t> rules_index;
+  for (const auto& entry : rows_) {
+    const Row& row = entry.second;
+    auto index = rules_index.find(row.rules);
+    if (index == rules_index.end()) {
+      index = rules_index.emplace(row.rules, rules.size()).first;
+      for (const auto& rule : row.rules) {
+        UnwindTableRule table_rule = {};
+        table_rule.reg = std::get<0>(rule);
+        table_rule.type = std::get<1>(rule);
+        table_rule.values[0] = std::get<2>(rule);
+        table_rule.values[1] = std::get<3>(rule);
+        rules.push_back(table_rule);
+      }
+    }
+    if (!rows.empty() && rows.back().pc_end == entry.first &&
+        rows.back().rules_index == index->second &&
+        rows.back().return_address_register == row.return_address_register) {
+      rows.back().pc_end = row.pc_end;
+      continue;
+    }
+    UnwindTableRow table_row = {};
+    table_row.pc_start = entry.first;
+    table_row.pc_end = row.pc_end;
+    table_row.rules_index = index->second;
+    table_row.num_rules = row.rules.size();
+    table_row.return_address_register = row.return_address_register;
+    rows.push_back(table_row);
+  }
+
+  std::map<std::string, uint32_t> names;
+  for (auto entry = symbols_.begin(); entry != symbols_.end(); ++entry) {
+    UnwindTableSymbol symbol = {};
+    symbol.start = entry->first;
+    symbol.end = entry->second.end;
+    auto next = std::next(entry);
+    if (next != symbols_.end() && next->first < symbol.end) {
+      symbol.end = next->first;
+    }
+    auto name = names.find(entry->second.name);
+    if (name == names.end()) {
+      name = names.emplace(entry->second.name, strings.size()).first;
+      strings.append(entry->second.name.c_str(), entry->second.name.size() + 1);
+    }
+    symbol.name_offset = name->second;
+    symbols.push_back(symbol);
+  }
+
+  UnwindTableHeader header = {};
+  header.magic = kUnwindTableMagic;
+  header.version = kUnwindTableVersion;
+  header.machine_type = machine_type;
+  header.class_type = class_type;
+  header.num_rows = rows.size();
+  header.num_rules = rules.size();
+  header.num_symbols = symbols.size();
+  header.strings_size = strings.size();
+
+  return android::base::WriteFully(fd, &header, sizeof(header)) &&
+         android::base::WriteFully(fd, rows.data(), rows.size() * sizeof(UnwindTableRow)) &&
+         android::base::WriteFully(fd, rules.data(), rules.size() * sizeof(UnwindTableRule)) &&
+         android::base::WriteFully(fd, symbols.data(),
+                                   symbols.size() * sizeof(UnwindTableSymbol)) &&
+         android::base::WriteFully(fd, strings.data(), strings.size());
+}
+
+int WriteTable(const char* file, const char* table_file) {
+  MemoryFileAtOffset* memory = new MemoryFileAtOffset;
+  if (!memory->Init(file, 0)) {
+    printf("Failed to init\n");
+    return 1;
+  }
+
+  Elf elf(memory);
+  if (!elf.Init() || !elf.valid()) {
+    printf("%s is not a valid elf file.\n", file);
+    return 1;
+  }
+  elf.InitGnuDebugdata();
+
+  TableBuilder builder;
+  ElfInterface* interface = elf.interface();
+  if (interface->eh_frame() != nullptr) {
+    builder.AddSection(interface, interface->eh_frame(), interface->load_bias());
+  }
+  if (interface->debug_frame() != nullptr) {
+    builder.AddSection(interface, interface->debug_frame(), interface->load_bias());
+  }
+  ElfInterface* gnu_debugdata_interface = elf.gnu_debugdata_interface();
+  if (gnu_debugdata_interface != nullptr) {
+    if (gnu_debugdata_interface->eh_frame() != nullptr) {
+      builder.AddSection(gnu_debugdata_interface, gnu_debugdata_interface->eh_frame(), 0);
+    }
+    if (gnu_debugdata_interface->debug_frame() != nullptr) {
+      builder.AddSection(gnu_debugdata_interface, gnu_debugdata_interface->debug_frame(), 0);
+    }
+  }
+
+  android::base::unique_fd fd(
+      TEMP_FAILURE_RETRY(open(table_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)));
+  if (fd == -1) {
+    printf("Cannot open %s: %s\n", table_file, strerror(errno));
+    return 1;
+  }
+  if (!builder.Write(elf.machine_type(), elf.class_type(), fd)) {
+    printf("Failed to write %s: %s\n", table_file, strerror(errno));
+    unlink(table_file);
+    return 1;
+  }
+  printf("%zu rows, %zu rows left to the elf, %zu symbols\n", builder.num_rows(),
+         builder.num_skipped_rows(), builder.num_symbols());
+  return 0;
+}
+
+}  // namespace unwindstack
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    printf("Need to pass the name of an elf file and of the table to write.\n");
+    return 1;
+  }
+
+  struct stat st;
+  if (stat(argv[1], &st) == -1) {
+    printf("Cannot stat %s: %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    printf("%s is not a regular file.\n", argv[1]);
+    return 1;
+  }
+
+  return unwindstack::WriteTable(argv[1], argv[2]);
+}
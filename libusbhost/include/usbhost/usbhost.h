@@ -241,6 +241,64 @@ struct usb_request *usb_request_wait(struct usb_device *dev, int timeoutMillis);
 /* Cancels a pending usb_request_queue() operation. */
 int usb_request_cancel(struct usb_request *req);
 
+/* A queue of asynchronous transfers on a single bulk or interrupt endpoint.
+ * Up to depth transfers are in flight at once, so the host controller always
+ * has the next one ready. Completions are delivered by
+ * usb_device_dispatch_requests(), which is intended to be called from an
+ * external poll or epoll loop whenever the fd returned by usb_device_get_fd()
+ * is writable (POLLOUT). A device with queues must not also be used with
+ * usb_request_wait(), as either would reap the other's requests.
+ * Queues are not thread safe.
+ */
+struct usb_bulk_queue;
+
+/* Called when a queued transfer completes. status is 0 on success or a
+ * negative errno, e.g. -ENOENT if the transfer was cancelled or -ESHUTDOWN
+ * if the device went away. The transfer's slot is free again by the time the
+ * callback runs, so it may submit the next transfer.
+ */
+typedef void (* usb_bulk_complete_cb)(struct usb_bulk_queue *queue,
+                                      void *buffer,
+                                      int actual_length,
+                                      int status,
+                                      void *cookie);
+
+/* Creates a queue of up to depth transfers on the specified endpoint. */
+struct usb_bulk_queue *usb_bulk_queue_new(struct usb_device *dev,
+        const struct usb_endpoint_descriptor *ep_desc,
+        int depth,
+        usb_bulk_complete_cb complete_cb,
+        void *client_data);
+
+/* Cancels all pending transfers, waits for them to complete and releases the
+ * queue. Callbacks run for the cancelled transfers, and for any transfers of
+ * other queues on the same device that complete meanwhile; submitting to
+ * the queue from those callbacks fails with ESHUTDOWN. Queues must be freed
+ * before the device is closed.
+ */
+void usb_bulk_queue_free(struct usb_bulk_queue *queue);
+
+/* Submits a transfer of length bytes from or to buffer. Transfers are limited
+ * to 16K, as in usb_request_queue(); the callback reports the length actually
+ * transferred. cookie is passed to the callback.
+ * Returns 0 on success, or -1 with errno EBUSY if depth transfers are already
+ * pending, or the error from the kernel.
+ */
+int usb_bulk_queue_submit(struct usb_bulk_queue *queue, void *buffer, int length, void *cookie);
+
+/* Returns the number of transfers submitted and not yet completed. */
+int usb_bulk_queue_pending(struct usb_bulk_queue *queue);
+
+/* Returns the client_data passed to usb_bulk_queue_new(). */
+void *usb_bulk_queue_get_client_data(struct usb_bulk_queue *queue);
+
+/* Reaps every completed transfer of the device's queues without blocking and
+ * runs their callbacks.
+ * Returns the number of transfers completed, or -1 for error, e.g. errno
+ * ENODEV once the device has been removed and nothing is left to reap.
+ */
+int usb_device_dispatch_requests(struct usb_device *dev);
+
 #ifdef __cplusplus
 }
 #endif
@@ -86,6 +86,25 @@ struct usb_device {
     int desc_length;
     int fd;
     int writeable;
+    struct usb_bulk_queue *queues;
+};
+
+struct usb_bulk_slot {
+    struct usb_bulk_queue *queue;
+    struct usbdevfs_urb *urb;
+    void *cookie;
+};
+
+struct usb_bulk_queue {
+    struct usb_device *dev;
+    struct usb_bulk_queue *next;
+    usb_bulk_complete_cb complete_cb;
+    void *client_data;
+    int depth;
+    struct usb_bulk_slot *slots;
+    int *free_slots;    /* stack of indexes into slots */
+    int free_count;
+    int closing;        /* set by usb_bulk_queue_free() */
 };
 
 static inline int badname(const char *name)
@@ -727,3 +746,199 @@ int usb_request_cancel(struct usb_request *req)
     struct usbdevfs_urb *urb = ((struct usbdevfs_urb*)req->private_data);
     return ioctl(req->dev->fd, USBDEVFS_DISCARDURB, urb);
 }
+
+struct usb_bulk_queue *usb_bulk_queue_new(struct usb_device *dev,
+        const struct usb_endpoint_descriptor *ep_desc,
+        int depth,
+        usb_bulk_complete_cb complete_cb,
+        void *client_data)
+{
+    unsigned char type;
+    int i;
+
+    if (depth <= 0 || !complete_cb) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((ep_desc->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK) == USB_ENDPOINT_XFER_BULK)
+        type = USBDEVFS_URB_TYPE_BULK;
+    else if ((ep_desc->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK) == USB_ENDPOINT_XFER_INT)
+        type = USBDEVFS_URB_TYPE_INTERRUPT;
+    else {
+        D("Unsupported endpoint type %d", ep_desc->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct usb_bulk_queue *queue = calloc(1, sizeof(struct usb_bulk_queue));
+    if (!queue)
+        return NULL;
+    queue->slots = calloc(depth, sizeof(struct usb_bulk_slot));
+    queue->free_slots = calloc(depth, sizeof(int));
+    if (!queue->slots || !queue->free_slots)
+        goto failed;
+
+    for (i = 0; i < depth; i++) {
+        struct usbdevfs_urb *urb = calloc(1, sizeof(struct usbdevfs_urb));
+        if (!urb)
+            goto failed;
+        urb->type = type;
+        urb->endpoint = ep_desc->bEndpointAddress;
+        urb->usercontext = &queue->slots[i];
+        queue->slots[i].queue = queue;
+        queue->slots[i].urb = urb;
+        /* hand out the lowest slots first */
+        queue->free_slots[i] = depth - 1 - i;
+    }
+
+    queue->dev = dev;
+    queue->complete_cb = complete_cb;
+    queue->client_data = client_data;
+    queue->depth = depth;
+    queue->free_count = depth;
+    queue->next = dev->queues;
+    dev->queues = queue;
+    return queue;
+
+failed:
+    if (queue->slots) {
+        for (i = 0; i < depth; i++)
+            free(queue->slots[i].urb);
+    }
+    free(queue->slots);
+    free(queue->free_slots);
+    free(queue);
+    errno = ENOMEM;
+    return NULL;
+}
+
+/* Finds the queue slot an urb belongs to, or returns NULL for an urb
+ * submitted with usb_request_queue().
+ */
+static struct usb_bulk_slot *usb_bulk_find_slot(struct usb_device *dev,
+                                                struct usbdevfs_urb *urb)
+{
+    struct usb_bulk_slot *slot = (struct usb_bulk_slot *)urb->usercontext;
+    struct usb_bulk_queue *queue;
+
+    for (queue = dev->queues; queue; queue = queue->next) {
+        if (slot >= queue->slots && slot < queue->slots + queue->depth)
+            return slot;
+    }
+    return NULL;
+}
+
+/* Reaps one completed urb and runs its callback.
+ * Returns 1 if an urb was reaped, or -1 for error (EAGAIN if none is ready).
+ */
+static int usb_bulk_reap_one(struct usb_device *dev, int block)
+{
+    struct usbdevfs_urb *urb = NULL;
+    int res = TEMP_FAILURE_RETRY(ioctl(dev->fd, block ? USBDEVFS_REAPURB :
+                                       USBDEVFS_REAPURBNDELAY, &urb));
+    if (res < 0)
+        return -1;
+
+    D("[ urb @%p status = %d, actual = %d ]\n", urb, urb->status, urb->actual_length);
+    struct usb_bulk_slot *slot = usb_bulk_find_slot(dev, urb);
+    if (!slot) {
+        /* from usb_request_queue(), which must not be mixed with queues */
+        D("reaped urb @%p that belongs to no queue\n", urb);
+        return 1;
+    }
+
+    struct usb_bulk_queue *queue = slot->queue;
+    queue->free_slots[queue->free_count++] = slot - queue->slots;
+    queue->complete_cb(queue, urb->buffer, urb->actual_length, urb->status, slot->cookie);
+    return 1;
+}
+
+void usb_bulk_queue_free(struct usb_bulk_queue *queue)
+{
+    struct usb_device *dev = queue->dev;
+    struct usb_bulk_queue **prev;
+    int i;
+
+    /* cancel everything still in flight, then wait for the cancelled urbs to
+     * come back, as the kernel writes to them until they do */
+    queue->closing = 1;
+    for (i = 0; i < queue->depth; i++)
+        ioctl(dev->fd, USBDEVFS_DISCARDURB, queue->slots[i].urb);
+    while (queue->free_count < queue->depth) {
+        if (usb_bulk_reap_one(dev, 1) < 0) {
+            D("[ reap urb - error %d]\n", errno);
+            break;
+        }
+    }
+
+    for (prev = &dev->queues; *prev; prev = &(*prev)->next) {
+        if (*prev == queue) {
+            *prev = queue->next;
+            break;
+        }
+    }
+    for (i = 0; i < queue->depth; i++)
+        free(queue->slots[i].urb);
+    free(queue->slots);
+    free(queue->free_slots);
+    free(queue);
+}
+
+int usb_bulk_queue_submit(struct usb_bulk_queue *queue, void *buffer, int length, void *cookie)
+{
+    int res;
+
+    if (queue->closing) {
+        errno = ESHUTDOWN;
+        return -1;
+    }
+    if (queue->free_count == 0) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    int index = queue->free_slots[--queue->free_count];
+    struct usb_bulk_slot *slot = &queue->slots[index];
+    struct usbdevfs_urb *urb = slot->urb;
+
+    slot->cookie = cookie;
+    urb->status = -1;
+    urb->actual_length = 0;
+    urb->buffer = buffer;
+    // need to limit request size to avoid EINVAL
+    if (length > MAX_USBFS_BUFFER_SIZE)
+        urb->buffer_length = MAX_USBFS_BUFFER_SIZE;
+    else
+        urb->buffer_length = length;
+
+    do {
+        res = ioctl(queue->dev->fd, USBDEVFS_SUBMITURB, urb);
+    } while((res < 0) && (errno == EINTR));
+
+    if (res < 0)
+        queue->free_slots[queue->free_count++] = index;
+    return res;
+}
+
+int usb_bulk_queue_pending(struct usb_bulk_queue *queue)
+{
+    return queue->depth - queue->free_count;
+}
+
+void *usb_bulk_queue_get_client_data(struct usb_bulk_queue *queue)
+{
+    return queue->client_data;
+}
+
+int usb_device_dispatch_requests(struct usb_device *dev)
+{
+    int count = 0;
+
+    while (usb_bulk_reap_one(dev, 0) > 0)
+        count++;
+
+    if (count == 0 && errno != EAGAIN)
+        return -1;
+    return count;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <usbhost/usbhost.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+
+// Opens a file holding a bare device descriptor as a usb_device. The queue
+// bookkeeping can be exercised on it, but every usbfs ioctl fails.
+static struct usb_device* OpenFakeDevice(TemporaryFile* tf) {
+  struct usb_device_descriptor desc = {};
+  desc.bLength = USB_DT_DEVICE_SIZE;
+  desc.bDescriptorType = USB_DT_DEVICE;
+  if (!android::base::WriteFully(tf->fd, &desc, USB_DT_DEVICE_SIZE)) return nullptr;
+  return usb_device_new(tf->path, dup(tf->fd));
+}
+
+static void CountCompletion(struct usb_bulk_queue* queue, void*, int, int, void*) {
+  ++*static_cast<int*>(usb_bulk_queue_get_client_data(queue));
+}
+
+TEST(usbhost, bulk_queue_new_rejects_bad_arguments) {
+  TemporaryFile tf;
+  struct usb_device* dev = OpenFakeDevice(&tf);
+  ASSERT_NE(nullptr, dev);
+
+  struct usb_endpoint_descriptor ep = {};
+  ep.bEndpointAddress = USB_DIR_IN | 1;
+  ep.bmAttributes = USB_ENDPOINT_XFER_ISOC;
+  int completions = 0;
+  errno = 0;
+  ASSERT_EQ(nullptr, usb_bulk_queue_new(dev, &ep, 4, CountCompletion, &completions));
+  ASSERT_EQ(EINVAL, errno);
+
+  ep.bmAttributes = USB_ENDPOINT_XFER_BULK;
+  ASSERT_EQ(nullptr, usb_bulk_queue_new(dev, &ep, 0, CountCompletion, &completions));
+  ASSERT_EQ(nullptr, usb_bulk_queue_new(dev, &ep, 4, nullptr, &completions));
+
+  usb_device_close(dev);
+}
+
+TEST(usbhost, bulk_queue_failed_submit_frees_slot) {
+  TemporaryFile tf;
+  struct usb_device* dev = OpenFakeDevice(&tf);
+  ASSERT_NE(nullptr, dev);
+
+  struct usb_endpoint_descriptor ep = {};
+  ep.bEndpointAddress = USB_DIR_IN | 1;
+  ep.bmAttributes = USB_ENDPOINT_XFER_BULK;
+  int completions = 0;
+  struct usb_bulk_queue* queue = usb_bulk_queue_new(dev, &ep, 2, CountCompletion, &completions);
+  ASSERT_NE(nullptr, queue);
+  ASSERT_EQ(&completions, usb_bulk_queue_get_client_data(queue));
+
+  // A regular file has no usbfs ioctls, so every submit fails and must hand
+  // its slot back rather than leak it.
+  char buf[64];
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(-1, usb_bulk_queue_submit(queue, buf, sizeof(buf), nullptr));
+    ASSERT_NE(EBUSY, errno);
+    ASSERT_EQ(0, usb_bulk_queue_pending(queue));
+  }
+
+  ASSERT_EQ(-1, usb_device_dispatch_requests(dev));
+  ASSERT_NE(EAGAIN, errno);
+  ASSERT_EQ(0, completions);
+
+  usb_bulk_queue_free(queue);
+  usb_device_close(dev);
+}
+
+// Streams from the bulk IN endpoint of the interface named by
+// USBHOST_TEST_DEVICE, e.g. a gadget zero source/sink function, keeping
+// several transfers in flight, and reports the throughput.
+struct Stream {
+  std::vector<std::vector<char>> buffers;
+  size_t bytes = 0;
+  int errors = 0;
+  bool stop = false;
+};
+
+static void Resubmit(struct usb_bulk_queue* queue, void* buffer, int actual_length, int status,
+                     void*) {
+  Stream* stream = static_cast<Stream*>(usb_bulk_queue_get_client_data(queue));
+  if (status != 0) {
+    // Transfers cancelled by usb_bulk_queue_free() are expected to fail.
+    if (!stream->stop) stream->errors++;
+    return;
+  }
+  stream->bytes += actual_length;
+  if (!stream->stop) {
+    usb_bulk_queue_submit(queue, buffer, stream->buffers[0].size(), nullptr);
+  }
+}
+
+TEST(usbhost, bulk_queue_throughput) {
+  const char* dev_name = getenv("USBHOST_TEST_DEVICE");
+  if (dev_name == nullptr) {
+    GTEST_LOG_(INFO) << "set USBHOST_TEST_DEVICE to a /dev/bus/usb node to run this test";
+    return;
+  }
+
+  struct usb_device* dev = usb_device_open(dev_name);
+  ASSERT_NE(nullptr, dev);
+  ASSERT_NE(-1, usb_device_get_fd(dev));
+
+  const struct usb_endpoint_descriptor* in = nullptr;
+  struct usb_descriptor_iter iter;
+  usb_descriptor_iter_init(dev, &iter);
+  struct usb_descriptor_header* header;
+  while ((header = usb_descriptor_iter_next(&iter)) != nullptr && in == nullptr) {
+    if (header->bDescriptorType != USB_DT_ENDPOINT) continue;
+    auto ep = reinterpret_cast<const struct usb_endpoint_descriptor*>(header);
+    if ((ep->bEndpointAddress & USB_ENDPOINT_DIR_MASK) == USB_DIR_IN &&
+        (ep->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK) == USB_ENDPOINT_XFER_BULK) {
+      in = ep;
+    }
+  }
+  ASSERT_NE(nullptr, in);
+  ASSERT_EQ(0, usb_device_claim_interface(dev, 0));
+
+  constexpr int kDepth = 8;
+  Stream stream;
+  stream.buffers.assign(kDepth, std::vector<char>(16384));
+  struct usb_bulk_queue* queue = usb_bulk_queue_new(dev, in, kDepth, Resubmit, &stream);
+  ASSERT_NE(nullptr, queue);
+  for (auto& buffer : stream.buffers) {
+    ASSERT_EQ(0, usb_bulk_queue_submit(queue, buffer.data(), buffer.size(), nullptr));
+  }
+  ASSERT_EQ(kDepth, usb_bulk_queue_pending(queue));
+
+  auto start = std::chrono::steady_clock::now();
+  auto end = start + std::chrono::seconds(2);
+  struct pollfd pfd = {usb_device_get_fd(dev), POLLOUT, 0};
+  while (std::chrono::steady_clock::now() < end && stream.errors == 0) {
+    ASSERT_EQ(1, TEMP_FAILURE_RETRY(poll(&pfd, 1, 1000)));
+    ASSERT_LE(0, usb_device_dispatch_requests(dev));
+  }
+  stream.stop = true;
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  usb_bulk_queue_free(queue);
+  ASSERT_EQ(0, stream.errors);
+  GTEST_LOG_(INFO) << stream.bytes / seconds / (1024 * 1024) << " MiB/s";
+  ASSERT_GT(stream.bytes, 0u);
+
+  usb_device_release_interface(dev, 0);
+  usb_device_close(dev);
+}
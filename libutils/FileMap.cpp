@@ -34,7 +34,12 @@
 #include <stdlib.h>
 
 #if !defined(__MINGW32__)
+#include <pthread.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utils/KeyedVector.h>
 #endif
 
 #include <string.h>
@@ -46,13 +51,114 @@ using namespace android;
 
 /*static*/ long FileMap::mPageSize = -1;
 
+#if !defined(__MINGW32__)
+// Identifies a mapping shared through CREATE_SHARED.
+struct SharedMapKey {
+    dev_t   dev;
+    ino_t   ino;
+    off64_t offset;
+    size_t  length;
+    int     prot;
+
+    bool operator<(const SharedMapKey& other) const {
+        if (dev != other.dev) return dev < other.dev;
+        if (ino != other.ino) return ino < other.ino;
+        if (offset != other.offset) return offset < other.offset;
+        if (length != other.length) return length < other.length;
+        return prot < other.prot;
+    }
+};
+
+struct SharedMapping {
+    void*   base;
+    size_t  refs;
+};
+
+static pthread_mutex_t gSharedMapsMutex = PTHREAD_MUTEX_INITIALIZER;
+static KeyedVector<SharedMapKey, SharedMapping>* gSharedMaps = NULL;
+
+// Maps a page aligned range.
+static void* mapRange(int fd, off64_t offset, size_t length, int prot)
+{
+    void* ptr = mmap(NULL, length, prot, MAP_SHARED, fd, offset);
+    if (ptr == MAP_FAILED) {
+        ALOGE("mmap(%lld,%zu) failed: %s\n",
+            (long long)offset, length, strerror(errno));
+        return NULL;
+    }
+    return ptr;
+}
+
+// Returns the cached mapping of the same range of the same file, or maps it.
+static void* acquireSharedMapping(int fd, off64_t offset, size_t length, int prot)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ALOGE("fstat(%d) failed: %s\n", fd, strerror(errno));
+        return NULL;
+    }
+    SharedMapKey key;
+    memset(&key, 0, sizeof(key));
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+    key.offset = offset;
+    key.length = length;
+    key.prot = prot;
+
+    void* ptr = NULL;
+    pthread_mutex_lock(&gSharedMapsMutex);
+    if (gSharedMaps == NULL) {
+        gSharedMaps = new KeyedVector<SharedMapKey, SharedMapping>();
+    }
+    ssize_t index = gSharedMaps->indexOfKey(key);
+    if (index >= 0) {
+        SharedMapping& mapping = gSharedMaps->editValueAt(index);
+        mapping.refs++;
+        ptr = mapping.base;
+    } else {
+        // Mapped with the lock held, so that racing threads map it only once.
+        ptr = mapRange(fd, offset, length, prot);
+        if (ptr != NULL) {
+            SharedMapping mapping;
+            mapping.base = ptr;
+            mapping.refs = 1;
+            gSharedMaps->add(key, mapping);
+        }
+    }
+    pthread_mutex_unlock(&gSharedMapsMutex);
+    return ptr;
+}
+
+// Drops a reference to a mapping returned by acquireSharedMapping(), and
+// returns true if it was the last one, and the caller should unmap it.
+static bool releaseSharedMapping(void* base)
+{
+    bool last = false;
+    pthread_mutex_lock(&gSharedMapsMutex);
+    for (size_t i = 0; gSharedMaps != NULL && i < gSharedMaps->size(); i++) {
+        SharedMapping& mapping = gSharedMaps->editValueAt(i);
+        if (mapping.base == base) {
+            if (--mapping.refs == 0) {
+                gSharedMaps->removeItemsAt(i);
+                last = true;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gSharedMapsMutex);
+    return last;
+}
+#endif // !defined(__MINGW32__)
+
 // Constructor.  Create an empty object.
 FileMap::FileMap(void)
     : mFileName(NULL),
       mBasePtr(NULL),
       mBaseLength(0),
       mDataPtr(NULL),
-      mDataLength(0)
+      mDataLength(0),
+      mShared(false),
+      mMajorFaults(0)
 #if defined(__MINGW32__)
       ,
       mFileHandle(INVALID_HANDLE_VALUE),
@@ -64,7 +170,8 @@ FileMap::FileMap(void)
 // Move Constructor.
 FileMap::FileMap(FileMap&& other)
     : mFileName(other.mFileName), mBasePtr(other.mBasePtr), mBaseLength(other.mBaseLength),
-      mDataOffset(other.mDataOffset), mDataPtr(other.mDataPtr), mDataLength(other.mDataLength)
+      mDataOffset(other.mDataOffset), mDataPtr(other.mDataPtr), mDataLength(other.mDataLength),
+      mShared(other.mShared), mMajorFaults(other.mMajorFaults)
 #if defined(__MINGW32__)
       , mFileHandle(other.mFileHandle), mFileMapping(other.mFileMapping)
 #endif
@@ -72,6 +179,7 @@ FileMap::FileMap(FileMap&& other)
     other.mFileName = NULL;
     other.mBasePtr = NULL;
     other.mDataPtr = NULL;
+    other.mShared = false;
 #if defined(__MINGW32__)
     other.mFileHandle = INVALID_HANDLE_VALUE;
     other.mFileMapping = NULL;
@@ -86,9 +194,12 @@ FileMap& FileMap::operator=(FileMap&& other) {
     mDataOffset = other.mDataOffset;
     mDataPtr = other.mDataPtr;
     mDataLength = other.mDataLength;
+    mShared = other.mShared;
+    mMajorFaults = other.mMajorFaults;
     other.mFileName = NULL;
     other.mBasePtr = NULL;
     other.mDataPtr = NULL;
+    other.mShared = false;
 #if defined(__MINGW32__)
     mFileHandle = other.mFileHandle;
     mFileMapping = other.mFileMapping;
@@ -113,6 +224,10 @@ FileMap::~FileMap(void)
         CloseHandle(mFileMapping);
     }
 #else
+    if (mBasePtr && mShared && !releaseSharedMapping(mBasePtr)) {
+        // Still used by other FileMaps.
+        return;
+    }
     if (mBasePtr && munmap(mBasePtr, mBaseLength) != 0) {
         ALOGD("munmap(%p, %zu) failed\n", mBasePtr, mBaseLength);
     }
@@ -128,6 +243,12 @@ FileMap::~FileMap(void)
 // Returns "false" on failure.
 bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t length,
         bool readOnly)
+{
+    return create(origFileName, fd, offset, length, readOnly, 0);
+}
+
+bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t length,
+        bool readOnly, uint32_t createFlags)
 {
 #if defined(__MINGW32__)
     int     adjust;
@@ -143,6 +264,8 @@ bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t le
 
     DWORD  protect = readOnly ? PAGE_READONLY : PAGE_READWRITE;
 
+    (void) createFlags;
+
     mFileHandle  = (HANDLE) _get_osfhandle(fd);
     mFileMapping = CreateFileMapping( mFileHandle, NULL, protect, 0, 0, NULL);
     if (mFileMapping == NULL) {
@@ -168,7 +291,7 @@ bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t le
         return false;
     }
 #else // !defined(__MINGW32__)
-    int     prot, flags, adjust;
+    int     prot, adjust;
     off64_t adjOffset;
     size_t  adjLength;
 
@@ -191,18 +314,20 @@ bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t le
     adjOffset = offset - adjust;
     adjLength = length + adjust;
 
-    flags = MAP_SHARED;
     prot = PROT_READ;
     if (!readOnly)
         prot |= PROT_WRITE;
 
-    ptr = mmap(NULL, adjLength, prot, flags, fd, adjOffset);
-    if (ptr == MAP_FAILED) {
-        ALOGE("mmap(%lld,%zu) failed: %s\n",
-            (long long)adjOffset, adjLength, strerror(errno));
+    if (createFlags & CREATE_SHARED) {
+        ptr = acquireSharedMapping(fd, adjOffset, adjLength, prot);
+    } else {
+        ptr = mapRange(fd, adjOffset, adjLength, prot);
+    }
+    if (ptr == NULL) {
         return false;
     }
     mBasePtr = ptr;
+    mShared = (createFlags & CREATE_SHARED) != 0;
 #endif // !defined(__MINGW32__)
 
     mFileName = origFileName != NULL ? strdup(origFileName) : NULL;
@@ -216,6 +341,12 @@ bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t le
     ALOGV("MAP: base %p/%zu data %p/%zu\n",
         mBasePtr, mBaseLength, mDataPtr, mDataLength);
 
+#if !defined(__MINGW32__)
+    if (createFlags & CREATE_PREFAULT) {
+        prefault(0, mDataLength);
+    }
+#endif
+
     return true;
 }
 
@@ -231,6 +362,11 @@ int FileMap::advise(MapAdvice advice)
         case SEQUENTIAL:    sysAdvice = MADV_SEQUENTIAL;    break;
         case WILLNEED:      sysAdvice = MADV_WILLNEED;      break;
         case DONTNEED:      sysAdvice = MADV_DONTNEED;      break;
+#if defined(MADV_HUGEPAGE)
+        case HUGEPAGE:      sysAdvice = MADV_HUGEPAGE;      break;
+#else
+        case HUGEPAGE:      errno = EINVAL;                 return -1;
+#endif
         default:
                             assert(false);
                             return -1;
@@ -242,9 +378,88 @@ int FileMap::advise(MapAdvice advice)
     return cc;
 }
 
+// Count the pages of a page aligned range that are resident, or return -1.
+static ssize_t countResidentPages(void* start, size_t length, long pageSize)
+{
+#if defined(__linux__)
+    size_t pages = (length + pageSize - 1) / pageSize;
+    unsigned char* vec = (unsigned char*) malloc(pages);
+    if (vec == NULL) {
+        return -1;
+    }
+    if (mincore(start, length, vec) != 0) {
+        ALOGW("mincore(%p, %zu) failed: %s\n", start, length, strerror(errno));
+        free(vec);
+        return -1;
+    }
+    ssize_t resident = 0;
+    for (size_t i = 0; i < pages; i++) {
+        resident += vec[i] & 1;
+    }
+    free(vec);
+    return resident;
+#else
+    (void) start;
+    (void) length;
+    (void) pageSize;
+    return -1;
+#endif
+}
+
+// Read a range in now, rather than a page per fault later.
+int FileMap::prefault(size_t offset, size_t length)
+{
+    if (offset > mDataLength || length > mDataLength - offset) {
+        ALOGW("prefault(%zu, %zu) out of bounds of %zu\n", offset, length, mDataLength);
+        errno = EINVAL;
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    uintptr_t start = (uintptr_t) mDataPtr + offset;
+    uintptr_t end = start + length;
+    start &= ~(uintptr_t) (mPageSize - 1);
+    length = end - start;
+
+    ssize_t resident = countResidentPages((void*) start, length, mPageSize);
+    if (resident >= 0) {
+        mMajorFaults += (length + mPageSize - 1) / mPageSize - resident;
+    }
+#if defined(MADV_POPULATE_READ)
+    // What MAP_POPULATE does at mmap() time.
+    if (madvise((void*) start, length, MADV_POPULATE_READ) == 0) {
+        return 0;
+    }
+#endif
+    // Start reading the whole range ahead, then wait for each page.
+    madvise((void*) start, length, MADV_WILLNEED);
+    for (uintptr_t page = start; page < end; page += mPageSize) {
+        (void) *(volatile const char*) page;
+    }
+    return 0;
+}
+
+ssize_t FileMap::getResidentLength(void) const
+{
+    ssize_t resident = countResidentPages(mBasePtr, mBaseLength, mPageSize);
+    return resident >= 0 ? resident * mPageSize : -1;
+}
+
 #else
 int FileMap::advise(MapAdvice /* advice */)
 {
     return -1;
 }
+
+int FileMap::prefault(size_t /* offset */, size_t /* length */)
+{
+    return -1;
+}
+
+ssize_t FileMap::getResidentLength(void) const
+{
+    return -1;
+}
 #endif
@@ -15,6 +15,9 @@
 
 #include <utils/Looper.h>
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <algorithm>
 
 namespace android {
 
@@ -57,17 +60,39 @@ static const int EPOLL_SIZE_HINT = 8;
 // Maximum number of file descriptors for which to retrieve poll events each iteration.
 static const int EPOLL_MAX_EVENTS = 16;
 
+// The clock of systemTime(SYSTEM_TIME_MONOTONIC), which message times are in.
+#if defined(__ANDROID__)
+static const clockid_t MESSAGE_TIMER_CLOCK = CLOCK_MONOTONIC;
+#else
+static const clockid_t MESSAGE_TIMER_CLOCK = CLOCK_REALTIME;
+#endif
+
+// The epoll data of a request holds its sequence number along with its fd, so
+// that events left over from a previous registration of the fd can be told apart.
+static inline uint64_t epollData(int fd, int seq) {
+    return (uint64_t(uint32_t(seq)) << 32) | uint32_t(fd);
+}
+
 static pthread_once_t gTLSOnce = PTHREAD_ONCE_INIT;
 static pthread_key_t gTLSKey = 0;
 
 Looper::Looper(bool allowNonCallbacks) :
-        mAllowNonCallbacks(allowNonCallbacks), mSendingMessage(false),
+        mAllowNonCallbacks(allowNonCallbacks), mNextMessageSeq(0), mSendingMessage(false),
         mPolling(false), mEpollFd(-1), mEpollRebuildRequired(false),
-        mNextRequestSeq(0), mResponseIndex(0), mNextMessageUptime(LLONG_MAX) {
+        mEpollMayHaveStaleFds(false), mNextRequestSeq(0), mResponseIndex(0),
+        mNextMessageUptime(LLONG_MAX), mTimerUptime(LLONG_MAX) {
     mWakeEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
     LOG_ALWAYS_FATAL_IF(mWakeEventFd < 0, "Could not make wake event fd: %s",
                         strerror(errno));
 
+    // Delayed messages are sent when this timer fires, which is more precise
+    // than the millisecond timeout of epoll_wait.  Without it, pollInner
+    // shortens its timeout instead.
+    mTimerFd = timerfd_create(MESSAGE_TIMER_CLOCK, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (mTimerFd < 0) {
+        ALOGW("Could not make message timer fd, using poll timeouts: %s", strerror(errno));
+    }
+
     AutoMutex _l(mLock);
     rebuildEpollLocked();
 }
@@ -75,6 +100,9 @@ Looper::Looper(bool allowNonCallbacks) :
 Looper::~Looper() {
     close(mWakeEventFd);
     mWakeEventFd = -1;
+    if (mTimerFd >= 0) {
+        close(mTimerFd);
+    }
     if (mEpollFd >= 0) {
         close(mEpollFd);
     }
@@ -151,6 +179,14 @@ void Looper::rebuildEpollLocked() {
     int result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeEventFd, & eventItem);
     LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake event fd to epoll instance: %s",
                         strerror(errno));
+    mEpollMayHaveStaleFds = false;
+
+    if (mTimerFd >= 0) {
+        eventItem.data.fd = mTimerFd;
+        result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mTimerFd, & eventItem);
+        LOG_ALWAYS_FATAL_IF(result != 0, "Could not add timer fd to epoll instance: %s",
+                            strerror(errno));
+    }
 
     for (size_t i = 0; i < mRequests.size(); i++) {
         const Request& request = mRequests.valueAt(i);
@@ -216,8 +252,9 @@ int Looper::pollInner(int timeoutMillis) {
     ALOGD("%p ~ pollOnce - waiting: timeoutMillis=%d", this, timeoutMillis);
 #endif
 
-    // Adjust the timeout based on when the next message is due.
-    if (timeoutMillis != 0 && mNextMessageUptime != LLONG_MAX) {
+    // Adjust the timeout based on when the next message is due, unless the
+    // timer wakes us up for it.
+    if (timeoutMillis != 0 && mNextMessageUptime != LLONG_MAX && mTimerFd < 0) {
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
         int messageTimeoutMillis = toMillisecondTimeoutDelay(now, mNextMessageUptime);
         if (messageTimeoutMillis >= 0
@@ -278,9 +315,20 @@ int Looper::pollInner(int timeoutMillis) {
     ALOGD("%p ~ pollOnce - handling events from %d fds", this, eventCount);
 #endif
 
+    // Only the message timer firing counts as a timeout, as when epoll_wait
+    // timed out for the next message without the timer.
+    result = POLL_TIMEOUT;
     for (int i = 0; i < eventCount; i++) {
-        int fd = eventItems[i].data.fd;
+        int fd = int(uint32_t(eventItems[i].data.u64));
+        int seq = int(eventItems[i].data.u64 >> 32);
         uint32_t epollEvents = eventItems[i].events;
+        if (fd == mTimerFd) {
+            uint64_t expirations;
+            TEMP_FAILURE_RETRY(read(mTimerFd, &expirations, sizeof(uint64_t)));
+            mTimerUptime = LLONG_MAX;
+            continue;
+        }
+        result = POLL_WAKE;
         if (fd == mWakeEventFd) {
             if (epollEvents & EPOLLIN) {
                 awoken();
@@ -289,14 +337,21 @@ int Looper::pollInner(int timeoutMillis) {
             }
         } else {
             ssize_t requestIndex = mRequests.indexOfKey(fd);
-            if (requestIndex >= 0) {
+            if (requestIndex >= 0 && mRequests.valueAt(requestIndex).seq == seq) {
                 int events = 0;
                 if (epollEvents & EPOLLIN) events |= EVENT_INPUT;
                 if (epollEvents & EPOLLOUT) events |= EVENT_OUTPUT;
                 if (epollEvents & EPOLLERR) events |= EVENT_ERROR;
                 if (epollEvents & EPOLLHUP) events |= EVENT_HANGUP;
                 pushResponse(events, mRequests.valueAt(requestIndex));
+            } else if (mEpollMayHaveStaleFds) {
+                // The events may come from a file that is still registered under
+                // a closed fd, which can only be dropped by rebuilding the set.
+                ALOGW("Ignoring epoll events 0x%x on fd %d from an earlier registration, "
+                        "rebuilding epoll set.", epollEvents, fd);
+                scheduleEpollRebuildLocked();
             } else {
+                // The fd was removed or registered again while we were polling.
                 ALOGW("Ignoring unexpected epoll events 0x%x on fd %d that is "
                         "no longer registered.", epollEvents, fd);
             }
@@ -310,14 +365,16 @@ Done: ;
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
         const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(0);
         if (messageEnvelope.uptime <= now) {
-            // Remove the envelope from the list.
+            // Remove the envelope from the heap.
             // We keep a strong reference to the handler until the call to handleMessage
             // finishes.  Then we drop it so that the handler can be deleted *before*
             // we reacquire our lock.
             { // obtain handler
                 sp<MessageHandler> handler = messageEnvelope.handler;
                 Message message = messageEnvelope.message;
-                mMessageEnvelopes.removeAt(0);
+                std::pop_heap(mMessageEnvelopes.begin(), mMessageEnvelopes.end(),
+                        MessageEnvelope::isAfter);
+                mMessageEnvelopes.pop();
                 mSendingMessage = true;
                 mLock.unlock();
 
@@ -337,6 +394,9 @@ Done: ;
             break;
         }
     }
+    if (mTimerFd >= 0 && mNextMessageUptime != mTimerUptime) {
+        armTimer(mNextMessageUptime);
+    }
 
     // Release lock.
     mLock.unlock();
@@ -419,6 +479,21 @@ void Looper::awoken() {
     TEMP_FAILURE_RETRY(read(mWakeEventFd, &counter, sizeof(uint64_t)));
 }
 
+void Looper::armTimer(nsecs_t uptime) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (uptime != LLONG_MAX) {
+        // A zero it_value would disarm the timer instead.
+        uptime = std::max(uptime, nsecs_t(1));
+        spec.it_value.tv_sec = uptime / 1000000000LL;
+        spec.it_value.tv_nsec = uptime % 1000000000LL;
+    }
+    if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, NULL) != 0) {
+        LOG_ALWAYS_FATAL("Could not arm message timer fd %d: %s", mTimerFd, strerror(errno));
+    }
+    mTimerUptime = uptime;
+}
+
 void Looper::pushResponse(int events, const Request& request) {
     Response response;
     response.events = events;
@@ -485,9 +560,10 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
                     // before returning and unregistering itself.  Callback sequence number
                     // checks further ensure that the race is benign.
                     //
-                    // Unfortunately due to kernel limitations we need to rebuild the epoll
-                    // set from scratch because it may contain an old file handle that we are
-                    // now unable to remove since its file descriptor is no longer valid.
+                    // Unfortunately due to kernel limitations the epoll set may still
+                    // contain an old file handle that we are now unable to remove since its
+                    // file descriptor is no longer valid.  Should that handle ever report
+                    // events, pollInner rebuilds the epoll set from scratch.
                     // No such problem would have occurred if we were using the poll system
                     // call instead, but that approach carries others disadvantages.
 #if DEBUG_CALLBACKS
@@ -501,7 +577,7 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
                                 fd, strerror(errno));
                         return -1;
                     }
-                    scheduleEpollRebuildLocked();
+                    mEpollMayHaveStaleFds = true;
                 } else {
                     ALOGE("Error modifying epoll events for fd %d: %s", fd, strerror(errno));
                     return -1;
@@ -551,16 +627,17 @@ int Looper::removeFd(int fd, int seq) {
                 // side-effect of closing the file descriptor before returning and
                 // unregistering itself.
                 //
-                // Unfortunately due to kernel limitations we need to rebuild the epoll
-                // set from scratch because it may contain an old file handle that we are
-                // now unable to remove since its file descriptor is no longer valid.
+                // Unfortunately due to kernel limitations the epoll set may still
+                // contain an old file handle that we are now unable to remove since its
+                // file descriptor is no longer valid.  Should that handle ever report
+                // events, pollInner rebuilds the epoll set from scratch.
                 // No such problem would have occurred if we were using the poll system
                 // call instead, but that approach carries others disadvantages.
 #if DEBUG_CALLBACKS
                 ALOGD("%p ~ removeFd - EPOLL_CTL_DEL failed due to file descriptor "
                         "being closed: %s", this, strerror(errno));
 #endif
-                scheduleEpollRebuildLocked();
+                mEpollMayHaveStaleFds = true;
             } else {
                 // Some other error occurred.  This is really weird because it means
                 // our list of callbacks got out of sync with the epoll set somehow.
@@ -593,17 +670,16 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
             this, uptime, handler.get(), message.what);
 #endif
 
-    size_t i = 0;
+    bool atHead;
     { // acquire lock
         AutoMutex _l(mLock);
 
-        size_t messageCount = mMessageEnvelopes.size();
-        while (i < messageCount && uptime >= mMessageEnvelopes.itemAt(i).uptime) {
-            i += 1;
-        }
-
-        MessageEnvelope messageEnvelope(uptime, handler, message);
-        mMessageEnvelopes.insertAt(messageEnvelope, i, 1);
+        uint64_t seq = mNextMessageSeq++;
+        MessageEnvelope messageEnvelope(uptime, seq, handler, message);
+        mMessageEnvelopes.push(messageEnvelope);
+        std::push_heap(mMessageEnvelopes.begin(), mMessageEnvelopes.end(),
+                MessageEnvelope::isAfter);
+        atHead = mMessageEnvelopes.itemAt(0).seq == seq;
 
         // Optimization: If the Looper is currently sending a message, then we can skip
         // the call to wake() because the next thing the Looper will do after processing
@@ -615,7 +691,7 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
     } // release lock
 
     // Wake the poll loop only when we enqueue a new message at the head.
-    if (i == 0) {
+    if (atHead) {
         wake();
     }
 }
@@ -628,12 +704,17 @@ void Looper::removeMessages(const sp<MessageHandler>& handler) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
+        size_t count = mMessageEnvelopes.size();
+        for (size_t i = count; i != 0; ) {
             const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
             if (messageEnvelope.handler == handler) {
                 mMessageEnvelopes.removeAt(i);
             }
         }
+        if (mMessageEnvelopes.size() != count) {
+            std::make_heap(mMessageEnvelopes.begin(), mMessageEnvelopes.end(),
+                    MessageEnvelope::isAfter);
+        }
     } // release lock
 }
 
@@ -645,13 +726,18 @@ void Looper::removeMessages(const sp<MessageHandler>& handler, int what) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
+        size_t count = mMessageEnvelopes.size();
+        for (size_t i = count; i != 0; ) {
             const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
             if (messageEnvelope.handler == handler
                     && messageEnvelope.message.what == what) {
                 mMessageEnvelopes.removeAt(i);
             }
         }
+        if (mMessageEnvelopes.size() != count) {
+            std::make_heap(mMessageEnvelopes.begin(), mMessageEnvelopes.end(),
+                    MessageEnvelope::isAfter);
+        }
     } // release lock
 }
 
@@ -666,7 +752,7 @@ void Looper::Request::initEventItem(struct epoll_event* eventItem) const {
 
     memset(eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
     eventItem->events = epollEvents;
-    eventItem->data.fd = fd;
+    eventItem->data.u64 = epollData(fd, seq);
 }
 
 MessageHandler::~MessageHandler() { }
@@ -19,7 +19,19 @@
 
 #include <utils/RefBase.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/compiler.h>
 #include <utils/CallStack.h>
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+
+#if defined(__ANDROID__)
+#include <cutils/properties.h>
+#endif
 
 #ifndef __unused
 #define __unused __attribute__((__unused__))
@@ -39,6 +51,10 @@
 // this folder needs to exist and be writable
 #define DEBUG_REFS_CALLSTACK_PATH       "/data/debug"
 
+// system property holding N to track the references of one in every N
+// RefBase objects, in processes started after it is set, without DEBUG_REFS
+#define DEBUG_REFS_SAMPLE_PROPERTY      "debug.refbase.sample_period"
+
 // log all reference counting operations
 #define PRINT_REFS                      0
 
@@ -132,48 +148,45 @@ namespace android {
 
 // ---------------------------------------------------------------------------
 
-class RefBase::weakref_impl : public RefBase::weakref_type
-{
-public:
-    std::atomic<int32_t>    mStrong;
-    std::atomic<int32_t>    mWeak;
-    RefBase* const          mBase;
-    std::atomic<int32_t>    mFlags;
-
-#if !DEBUG_REFS
-
-    explicit weakref_impl(RefBase* base)
-        : mStrong(INITIAL_STRONG_VALUE)
-        , mWeak(0)
-        , mBase(base)
-        , mFlags(0)
-    {
+// One in every gTrackingSamplePeriod RefBase objects gets a ref_tracker when
+// it is constructed; 0 disables sampling.  gTrackerCount counts the trackers
+// alive, so that renameRefs() can skip its work when there are none.
+static std::atomic<uint32_t> gTrackingSamplePeriod(0);
+static std::atomic<uint32_t> gTrackingSampleCount(0);
+static std::atomic<int32_t> gTrackerCount(0);
+
+#if defined(__ANDROID__)
+// Picks up the sample period for the process before any RefBase can be
+// constructed by a library that depends on us.
+static struct TrackingSamplePeriodInit {
+    TrackingSamplePeriodInit() {
+        const int32_t period = property_get_int32(DEBUG_REFS_SAMPLE_PROPERTY, 0);
+        if (period > 0) {
+            gTrackingSamplePeriod.store(period, std::memory_order_relaxed);
+        }
     }
+} gTrackingSamplePeriodInit;
+#endif
 
-    void addStrongRef(const void* /*id*/) { }
-    void removeStrongRef(const void* /*id*/) { }
-    void renameStrongRefId(const void* /*old_id*/, const void* /*new_id*/) { }
-    void addWeakRef(const void* /*id*/) { }
-    void removeWeakRef(const void* /*id*/) { }
-    void renameWeakRefId(const void* /*old_id*/, const void* /*new_id*/) { }
-    void printRefs() const { }
-    void trackMe(bool, bool) { }
-
-#else
-
-    weakref_impl(RefBase* base)
-        : mStrong(INITIAL_STRONG_VALUE)
-        , mWeak(0)
-        , mBase(base)
-        , mFlags(0)
+// Records the strong and weak references held on one RefBase, with the call
+// stack that acquired each one.  Every object has one when DEBUG_REFS is
+// compiled in; otherwise only the objects picked by sampling do.  The lock
+// is per object, so tracking never serializes references to other objects.
+class ref_tracker
+{
+public:
+    ref_tracker(const RefBase* base, const void* refs, bool enabled)
+        : mBase(base)
+        , mRefs(refs)
         , mStrongRefs(NULL)
         , mWeakRefs(NULL)
-        , mTrackEnabled(!!DEBUG_REFS_ENABLED_BY_DEFAULT)
+        , mTrackEnabled(enabled)
         , mRetain(false)
     {
+        gTrackerCount.fetch_add(1, std::memory_order_relaxed);
     }
-    
-    ~weakref_impl()
+
+    ~ref_tracker()
     {
         bool dumpStack = false;
         if (!mRetain && mStrongRefs != NULL) {
@@ -207,40 +220,37 @@ public:
             ALOGE("above errors at:");
             CallStack stack(LOG_TAG);
         }
+
+        freeRefs(mStrongRefs);
+        freeRefs(mWeakRefs);
+        gTrackerCount.fetch_sub(1, std::memory_order_relaxed);
     }
 
-    void addStrongRef(const void* id) {
-        //ALOGD_IF(mTrackEnabled,
-        //        "addStrongRef: RefBase=%p, id=%p", mBase, id);
-        addRef(&mStrongRefs, id, mStrong.load(std::memory_order_relaxed));
+    void addStrongRef(const void* id, int32_t strong) {
+        addRef(&mStrongRefs, id, strong);
     }
 
-    void removeStrongRef(const void* id) {
-        //ALOGD_IF(mTrackEnabled,
-        //        "removeStrongRef: RefBase=%p, id=%p", mBase, id);
+    void removeStrongRef(const void* id, int32_t strong) {
         if (!mRetain) {
             removeRef(&mStrongRefs, id);
         } else {
-            addRef(&mStrongRefs, id, -mStrong.load(std::memory_order_relaxed));
+            addRef(&mStrongRefs, id, -strong);
         }
     }
 
     void renameStrongRefId(const void* old_id, const void* new_id) {
-        //ALOGD_IF(mTrackEnabled,
-        //        "renameStrongRefId: RefBase=%p, oid=%p, nid=%p",
-        //        mBase, old_id, new_id);
         renameRefsId(mStrongRefs, old_id, new_id);
     }
 
-    void addWeakRef(const void* id) {
-        addRef(&mWeakRefs, id, mWeak.load(std::memory_order_relaxed));
+    void addWeakRef(const void* id, int32_t weak) {
+        addRef(&mWeakRefs, id, weak);
     }
 
-    void removeWeakRef(const void* id) {
+    void removeWeakRef(const void* id, int32_t weak) {
         if (!mRetain) {
             removeRef(&mWeakRefs, id);
         } else {
-            addRef(&mWeakRefs, id, -mWeak.load(std::memory_order_relaxed));
+            addRef(&mWeakRefs, id, -weak);
         }
     }
 
@@ -263,12 +273,12 @@ public:
             char buf[128];
             snprintf(buf, sizeof(buf),
                      "Strong references on RefBase %p (weakref_type %p):\n",
-                     mBase, this);
+                     mBase, mRefs);
             text.append(buf);
             printRefsLocked(&text, mStrongRefs);
             snprintf(buf, sizeof(buf),
                      "Weak references on RefBase %p (weakref_type %p):\n",
-                     mBase, this);
+                     mBase, mRefs);
             text.append(buf);
             printRefsLocked(&text, mWeakRefs);
         }
@@ -276,14 +286,14 @@ public:
         {
             char name[100];
             snprintf(name, sizeof(name), DEBUG_REFS_CALLSTACK_PATH "/%p.stack",
-                     this);
+                     mRefs);
             int rc = open(name, O_RDWR | O_CREAT | O_APPEND, 644);
             if (rc >= 0) {
                 write(rc, text.string(), text.length());
                 close(rc);
-                ALOGD("STACK TRACE for %p saved in %s", this, name);
+                ALOGD("STACK TRACE for %p saved in %s", mRefs, name);
             }
-            else ALOGE("FAILED TO PRINT STACK TRACE for %p in %s: %s", this,
+            else ALOGE("FAILED TO PRINT STACK TRACE for %p in %s: %s", mRefs,
                       name, strerror(errno));
         }
     }
@@ -337,7 +347,7 @@ private:
 
             ALOGE("RefBase: removing id %p on RefBase %p"
                     "(weakref_type %p) that doesn't exist!",
-                    id, mBase, this);
+                    id, mBase, mRefs);
 
             ref = head;
             while (ref) {
@@ -381,6 +391,18 @@ private:
         }
     }
 
+    static void freeRefs(ref_entry* refs)
+    {
+        while (refs) {
+            ref_entry* next = refs->next;
+            delete refs;
+            refs = next;
+        }
+    }
+
+    const RefBase* const mBase;
+    const void* const mRefs;
+
     mutable Mutex mMutex;
     ref_entry* mStrongRefs;
     ref_entry* mWeakRefs;
@@ -389,8 +411,97 @@ private:
     // Collect stack traces on addref and removeref, instead of deleting the stack references
     // on removeref that match the address ones.
     bool mRetain;
+};
 
+// ---------------------------------------------------------------------------
+
+class RefBase::weakref_impl : public RefBase::weakref_type
+{
+public:
+    std::atomic<int32_t>    mStrong;
+    std::atomic<int32_t>    mWeak;
+    RefBase* const          mBase;
+    std::atomic<int32_t>    mFlags;
+    // NULL unless this object's references are being tracked.  Checked
+    // before every hook below, so untracked objects only pay for the test.
+    ref_tracker* const      mTracker;
+
+    explicit weakref_impl(RefBase* base)
+        : mStrong(INITIAL_STRONG_VALUE)
+        , mWeak(0)
+        , mBase(base)
+        , mFlags(0)
+        , mTracker(createTracker(base, this))
+    {
+    }
+
+    ~weakref_impl()
+    {
+        delete mTracker;
+    }
+
+    void addStrongRef(const void* id) {
+        if (CC_UNLIKELY(mTracker != NULL)) {
+            mTracker->addStrongRef(id, mStrong.load(std::memory_order_relaxed));
+        }
+    }
+
+    void removeStrongRef(const void* id) {
+        if (CC_UNLIKELY(mTracker != NULL)) {
+            mTracker->removeStrongRef(id, mStrong.load(std::memory_order_relaxed));
+        }
+    }
+
+    void renameStrongRefId(const void* old_id, const void* new_id) {
+        if (CC_UNLIKELY(mTracker != NULL)) {
+            mTracker->renameStrongRefId(old_id, new_id);
+        }
+    }
+
+    void addWeakRef(const void* id) {
+        if (CC_UNLIKELY(mTracker != NULL)) {
+            mTracker->addWeakRef(id, mWeak.load(std::memory_order_relaxed));
+        }
+    }
+
+    void removeWeakRef(const void* id) {
+        if (CC_UNLIKELY(mTracker != NULL)) {
+            mTracker->removeWeakRef(id, mWeak.load(std::memory_order_relaxed));
+        }
+    }
+
+    void renameWeakRefId(const void* old_id, const void* new_id) {
+        if (CC_UNLIKELY(mTracker != NULL)) {
+            mTracker->renameWeakRefId(old_id, new_id);
+        }
+    }
+
+    void printRefs() const {
+        if (mTracker != NULL) {
+            mTracker->printRefs();
+        }
+    }
+
+    void trackMe(bool track, bool retain) {
+        if (mTracker != NULL) {
+            mTracker->trackMe(track, retain);
+        }
+    }
+
+private:
+    static ref_tracker* createTracker(RefBase* base, const void* refs)
+    {
+#if DEBUG_REFS
+        return new ref_tracker(base, refs, !!DEBUG_REFS_ENABLED_BY_DEFAULT);
+#else
+        const uint32_t period = gTrackingSamplePeriod.load(std::memory_order_relaxed);
+        if (CC_LIKELY(period == 0) ||
+                gTrackingSampleCount.fetch_add(1, std::memory_order_relaxed) % period != 0) {
+            return NULL;
+        }
+        return new ref_tracker(base, refs, true);
 #endif
+    }
 };
 
 // ---------------------------------------------------------------------------
@@ -398,8 +509,11 @@ private:
 void RefBase::incStrong(const void* id) const
 {
     weakref_impl* const refs = mRefs;
-    refs->incWeak(id);
-    
+    // Same as refs->incWeak(id), without the call.
+    refs->addWeakRef(id);
+    const int32_t w __unused = refs->mWeak.fetch_add(1, std::memory_order_relaxed);
+    ALOG_ASSERT(w >= 0, "incWeak called on %p after last weak ref", refs);
+
     refs->addStrongRef(id);
     const int32_t c = refs->mStrong.fetch_add(1, std::memory_order_relaxed);
     ALOG_ASSERT(c > 0, "incStrong() called on %p after last strong ref", refs);
@@ -737,18 +851,25 @@ void RefBase::onLastWeakRef(const void* /*id*/)
 
 // ---------------------------------------------------------------------------
 
-#if DEBUG_REFS
+void RefBase::setTrackingSamplePeriod(uint32_t period) {
+    gTrackingSamplePeriod.store(period, std::memory_order_relaxed);
+}
+
 void RefBase::renameRefs(size_t n, const ReferenceRenamer& renamer) {
+    // Only tracked objects care about the ids of their references.
+    if (gTrackerCount.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
     for (size_t i=0 ; i<n ; i++) {
         renamer(i);
     }
 }
-#else
-void RefBase::renameRefs(size_t /*n*/, const ReferenceRenamer& /*renamer*/) { }
-#endif
 
 void RefBase::renameRefId(weakref_type* ref,
         const void* old_id, const void* new_id) {
+    if (ref == NULL) {
+        return;
+    }
     weakref_impl* const impl = static_cast<weakref_impl*>(ref);
     impl->renameStrongRefId(old_id, new_id);
     impl->renameWeakRefId(old_id, new_id);
@@ -756,6 +877,9 @@ void RefBase::renameRefId(weakref_type* ref,
 
 void RefBase::renameRefId(RefBase* ref,
         const void* old_id, const void* new_id) {
+    if (ref == NULL) {
+        return;
+    }
     ref->mRefs->renameStrongRefId(old_id, new_id);
     ref->mRefs->renameWeakRefId(old_id, new_id);
 }
@@ -41,6 +41,7 @@ SharedBuffer* SharedBuffer::alloc(size_t size)
         // The following is OK on Android-supported platforms.
         sb->mRefs.store(1, std::memory_order_relaxed);
         sb->mSize = size;
+        sb->mClientMetadata = 0;
     }
     return sb;
 }
@@ -59,6 +60,7 @@ SharedBuffer* SharedBuffer::edit() const
     SharedBuffer* sb = alloc(mSize);
     if (sb) {
         memcpy(sb->data(), data(), size());
+        sb->mClientMetadata = mClientMetadata;
         release();
     }
     return sb;
@@ -84,6 +86,7 @@ SharedBuffer* SharedBuffer::editResize(size_t newSize) const
     if (sb) {
         const size_t mySize = mSize;
         memcpy(sb->data(), data(), newSize < mySize ? newSize : mySize);
+        sb->mClientMetadata = mClientMetadata;
         release();
     }
     return sb;    
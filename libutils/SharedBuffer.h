@@ -91,6 +91,12 @@ public:
     
     //! returns wether or not we're the only owner
     inline          bool                    onlyOwner() const;
+
+    /*! a value the owner(s) can keep with the buffer, 0 when allocated.
+     * edit() and editResize() carry it over to the buffer they return.
+     */
+    inline          uint32_t                getClientMetadata() const;
+    inline          void                    setClientMetadata(uint32_t metadata);
     
 
 private:
@@ -102,7 +108,8 @@ private:
         // Must be sized to preserve correct alignment.
         mutable std::atomic<int32_t>        mRefs;
                 size_t                      mSize;
-                uint32_t                    mReserved[2];
+                uint32_t                    mClientMetadata;
+                uint32_t                    mReserved;
 };
 
 static_assert(sizeof(SharedBuffer) % 8 == 0
@@ -139,6 +146,14 @@ bool SharedBuffer::onlyOwner() const {
     return (mRefs.load(std::memory_order_acquire) == 1);
 }
 
+uint32_t SharedBuffer::getClientMetadata() const {
+    return mClientMetadata;
+}
+
+void SharedBuffer::setClientMetadata(uint32_t metadata) {
+    mClientMetadata = metadata;
+}
+
 }; // namespace android
 
 // ---------------------------------------------------------------------------
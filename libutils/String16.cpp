@@ -105,6 +105,12 @@ String16::String16(const String16& o)
     SharedBuffer::bufferFromData(mString)->acquire();
 }
 
+String16::String16(String16&& o) noexcept
+    : mString(o.mString)
+{
+    o.mString = getEmptyString();
+}
+
 String16::String16(const String16& o, size_t len, size_t begin)
     : mString(getEmptyString())
 {
@@ -161,6 +167,16 @@ String16::~String16()
     SharedBuffer::bufferFromData(mString)->release();
 }
 
+String16& String16::operator=(String16&& other) noexcept
+{
+    // Swapping saves the reference count updates, |other| releases the old
+    // value when it goes away.
+    const char16_t* old = mString;
+    mString = other.mString;
+    other.mString = old;
+    return *this;
+}
+
 size_t String16::size() const
 {
     return SharedBuffer::sizeFromData(mString)/sizeof(char16_t)-1;
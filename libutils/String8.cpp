@@ -168,6 +168,12 @@ String8::String8(const String8& o)
     SharedBuffer::bufferFromData(mString)->acquire();
 }
 
+String8::String8(String8&& o) noexcept
+    : mString(o.mString)
+{
+    o.mString = getEmptyString();
+}
+
 String8::String8(const char* o)
     : mString(allocFromUTF8(o, strlen(o)))
 {
@@ -214,6 +220,16 @@ String8::~String8()
     SharedBuffer::bufferFromData(mString)->release();
 }
 
+String8& String8::operator=(String8&& other) noexcept
+{
+    // Swapping saves the reference count updates, |other| releases the old
+    // value when it goes away.
+    const char* old = mString;
+    mString = other.mString;
+    other.mString = old;
+    return *this;
+}
+
 size_t String8::length() const
 {
     return SharedBuffer::sizeFromData(mString)-1;
@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ThreadPool"
+
+#include <utils/ThreadPool.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <deque>
+
+#include <log/log.h>
+#include <utils/AndroidThreads.h>
+#include <utils/Thread.h>
+
+namespace android {
+
+// The worker running on the calling thread, if any.
+static pthread_key_t gCurrentWorkerKey;
+static pthread_once_t gCurrentWorkerOnce = PTHREAD_ONCE_INIT;
+
+static void createCurrentWorkerKey() {
+    pthread_key_create(&gCurrentWorkerKey, NULL);
+}
+
+// --- ThreadPool::Task ---
+
+ThreadPool::Task::~Task() {
+}
+
+// --- ThreadPool::Worker ---
+
+class ThreadPool::Worker : public Thread {
+public:
+    Worker(ThreadPool* pool) : Thread(false), mPool(pool) {
+    }
+
+    ThreadPool* pool() const { return mPool; }
+
+    void push(const sp<Task>& task) {
+        Mutex::Autolock _l(mQueueLock);
+        mQueue.push_back(task);
+    }
+
+    // The owner runs its own tasks newest first...
+    sp<Task> popNewest() {
+        Mutex::Autolock _l(mQueueLock);
+        if (mQueue.empty()) {
+            return NULL;
+        }
+        sp<Task> task = mQueue.back();
+        mQueue.pop_back();
+        return task;
+    }
+
+    // ...and other workers take the oldest, which the owner would run last.
+    sp<Task> stealOldest() {
+        Mutex::Autolock _l(mQueueLock);
+        if (mQueue.empty()) {
+            return NULL;
+        }
+        sp<Task> task = mQueue.front();
+        mQueue.pop_front();
+        return task;
+    }
+
+    size_t clear() {
+        Mutex::Autolock _l(mQueueLock);
+        size_t count = mQueue.size();
+        mQueue.clear();
+        return count;
+    }
+
+private:
+    virtual status_t readyToRun() {
+        pthread_setspecific(gCurrentWorkerKey, this);
+        return NO_ERROR;
+    }
+
+    virtual bool threadLoop() {
+        sp<Task> task = mPool->takeTask(this);
+        if (task == NULL) {
+            return mPool->waitForTask();
+        }
+        task->run();
+        // Release the task before the pool can look idle.
+        task.clear();
+        mPool->taskDone();
+        return true;
+    }
+
+    ThreadPool* const mPool;
+    Mutex mQueueLock;
+    std::deque<sp<Task> > mQueue;
+};
+
+// --- CompletionTask ---
+
+// Sends a message to a Looper once the task it wraps has run.
+class CompletionTask : public ThreadPool::Task {
+public:
+    CompletionTask(const sp<ThreadPool::Task>& task, const sp<Looper>& looper,
+            const sp<MessageHandler>& handler, const Message& message) :
+            mTask(task), mLooper(looper), mHandler(handler), mMessage(message) {
+    }
+
+    virtual void run() {
+        mTask->run();
+        mLooper->sendMessage(mHandler, mMessage);
+    }
+
+private:
+    const sp<ThreadPool::Task> mTask;
+    const sp<Looper> mLooper;
+    const sp<MessageHandler> mHandler;
+    const Message mMessage;
+};
+
+// --- ThreadPool ---
+
+ThreadPool::ThreadPool(const char* name, size_t numThreads, int32_t priority) :
+        mName(name), mPriority(priority), mNextQueue(0), mQueued(0), mOutstanding(0),
+        mSleeping(0), mStarted(false), mExiting(false), mShutdown(false) {
+    pthread_once(&gCurrentWorkerOnce, createCurrentWorkerKey);
+
+    if (numThreads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = cpus > 0 ? static_cast<size_t>(cpus) : 1;
+    }
+    mWorkers.setCapacity(numThreads);
+    for (size_t i = 0; i < numThreads; i++) {
+        mWorkers.push(new Worker(this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+}
+
+status_t ThreadPool::start() {
+    size_t started = 0;
+    { // acquire lock
+        Mutex::Autolock _l(mLock);
+        if (mStarted || mShutdown) {
+            return INVALID_OPERATION;
+        }
+        mStarted = true;
+
+        for (; started < mWorkers.size(); started++) {
+            String8 name = String8::format("%s:%zu", mName.string(), started);
+            if (mWorkers[started]->run(name.string(), mPriority) != NO_ERROR) {
+                break;
+            }
+        }
+        if (started == 0) {
+            // No worker would drain the queues in shutdown().
+            mStarted = false;
+        }
+    } // release lock
+
+    if (started < mWorkers.size()) {
+        ALOGE("Could only start %zu of the %zu threads of pool %s",
+                started, mWorkers.size(), mName.string());
+        shutdown();
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
+
+status_t ThreadPool::post(const sp<Task>& task) {
+    if (task == NULL) {
+        return BAD_VALUE;
+    }
+
+    // Counted before checking mShutdown, so that shutdown() either sees the
+    // task in waitForIdle() or post() sees mShutdown.
+    mOutstanding++;
+    if (mShutdown) {
+        taskDone();
+        return INVALID_OPERATION;
+    }
+
+    Worker* worker = getCurrentWorker();
+    if (worker == NULL) {
+        worker = mWorkers[mNextQueue++ % mWorkers.size()].get();
+    }
+    // Counted before it is pushed, so that a worker never sees fewer tasks
+    // than it can take, and checked against mSleeping after, so that either
+    // this thread sees a worker going to sleep, or that worker sees the task.
+    mQueued++;
+    worker->push(task);
+    if (mSleeping != 0) {
+        Mutex::Autolock _l(mLock);
+        mTaskAvailable.signal();
+    }
+    return NO_ERROR;
+}
+
+status_t ThreadPool::post(const sp<Task>& task, const sp<Looper>& looper,
+        const sp<MessageHandler>& handler, const Message& message) {
+    if (task == NULL || looper == NULL || handler == NULL) {
+        return BAD_VALUE;
+    }
+    return post(new CompletionTask(task, looper, handler, message));
+}
+
+void ThreadPool::waitForIdle() {
+    LOG_ALWAYS_FATAL_IF(getCurrentWorker() != NULL,
+            "waitForIdle() called from a worker of pool %s", mName.string());
+
+    Mutex::Autolock _l(mLock);
+    if (!mStarted) {
+        return;
+    }
+    while (mOutstanding != 0) {
+        mIdle.wait(mLock);
+    }
+}
+
+void ThreadPool::shutdown() {
+    LOG_ALWAYS_FATAL_IF(getCurrentWorker() != NULL,
+            "shutdown() called from a worker of pool %s", mName.string());
+
+    mShutdown = true;
+    waitForIdle();
+
+    { // acquire lock
+        Mutex::Autolock _l(mLock);
+        mExiting = true;
+        mTaskAvailable.broadcast();
+    } // release lock
+
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        mWorkers[i]->join();
+    }
+    // Only tasks posted before start(), or left over after start() failed.
+    dropQueuedTasks();
+}
+
+status_t ThreadPool::setPriority(int32_t priority) {
+#if defined(__ANDROID__)
+    Mutex::Autolock _l(mLock);
+    mPriority = priority;
+
+    status_t result = NO_ERROR;
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        pid_t tid = mWorkers[i]->getTid();
+        if (tid != -1 && androidSetThreadPriority(tid, priority) != 0) {
+            result = INVALID_OPERATION;
+        }
+    }
+    return result;
+#else
+    (void)priority;
+    return INVALID_OPERATION;
+#endif
+}
+
+ThreadPool::Worker* ThreadPool::getCurrentWorker() const {
+    Worker* worker = static_cast<Worker*>(pthread_getspecific(gCurrentWorkerKey));
+    return worker != NULL && worker->pool() == this ? worker : NULL;
+}
+
+sp<ThreadPool::Task> ThreadPool::takeTask(Worker* worker) {
+    if (mQueued == 0) {
+        return NULL;
+    }
+
+    sp<Task> task = worker->popNewest();
+    if (task == NULL) {
+        // Steal from the other workers, starting with the next one, so that
+        // thieves spread over the victims.
+        size_t self = 0;
+        while (mWorkers[self].get() != worker) {
+            self++;
+        }
+        for (size_t i = 1; i < mWorkers.size() && task == NULL; i++) {
+            task = mWorkers[(self + i) % mWorkers.size()]->stealOldest();
+        }
+    }
+    if (task != NULL) {
+        mQueued--;
+    }
+    return task;
+}
+
+bool ThreadPool::waitForTask() {
+    Mutex::Autolock _l(mLock);
+    mSleeping++;
+    while (mQueued == 0 && !mExiting) {
+        mTaskAvailable.wait(mLock);
+    }
+    mSleeping--;
+    // Exit only once the queues are drained.
+    return !mExiting || mQueued != 0;
+}
+
+void ThreadPool::taskDone() {
+    if (--mOutstanding == 0) {
+        Mutex::Autolock _l(mLock);
+        mIdle.broadcast();
+    }
+}
+
+void ThreadPool::dropQueuedTasks() {
+    size_t dropped = 0;
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        dropped += mWorkers[i]->clear();
+    }
+    if (dropped != 0) {
+        ALOGW("Dropped %zu tasks never run by pool %s", dropped, mName.string());
+        mQueued -= dropped;
+        mOutstanding -= dropped;
+    }
+}
+
+} // namespace android
@@ -18,6 +18,7 @@
 
 #include <utils/Tokenizer.h>
 #include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <utils/Log.h>
 
@@ -27,8 +28,42 @@
 
 namespace android {
 
-static inline bool isDelimiter(char ch, const char* delimiters) {
-    return strchr(delimiters, ch) != NULL;
+// The delimiters passed to nextToken() and skipDelimiters() as a bitmap, so
+// that each character costs one lookup rather than a strchr().  Like strchr(),
+// it includes the terminating null.
+class DelimiterSet {
+public:
+    explicit DelimiterSet(const char* delimiters) {
+        memset(mBits, 0, sizeof(mBits));
+        add('\0');
+        for (const char* d = delimiters; *d; d++) {
+            add(*d);
+        }
+    }
+
+    inline void add(char ch) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        mBits[c >> 5] |= 1u << (c & 31);
+    }
+
+    inline void remove(char ch) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        mBits[c >> 5] &= ~(1u << (c & 31));
+    }
+
+    inline bool contains(char ch) const {
+        unsigned char c = static_cast<unsigned char>(ch);
+        return mBits[c >> 5] & (1u << (c & 31));
+    }
+
+private:
+    uint32_t mBits[256 / 32];
+};
+
+// Returns the end of the line starting at p, or end.
+static inline const char* findEol(const char* p, const char* end) {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    return eol != NULL ? eol : end;
 }
 
 Tokenizer::Tokenizer(const String8& filename, FileMap* fileMap, char* buffer,
@@ -110,32 +145,33 @@ String8 Tokenizer::getLocation() const {
 }
 
 String8 Tokenizer::peekRemainderOfLine() const {
-    const char* end = getEnd();
-    const char* eol = mCurrent;
-    while (eol != end) {
-        char ch = *eol;
-        if (ch == '\n') {
-            break;
-        }
-        eol += 1;
-    }
-    return String8(mCurrent, eol - mCurrent);
+    std::experimental::string_view line = peekRemainderOfLineView();
+    return String8(line.data(), line.size());
+}
+
+std::experimental::string_view Tokenizer::peekRemainderOfLineView() const {
+    const char* eol = findEol(mCurrent, getEnd());
+    return std::experimental::string_view(mCurrent, eol - mCurrent);
 }
 
 String8 Tokenizer::nextToken(const char* delimiters) {
+    std::experimental::string_view token = nextTokenView(delimiters);
+    return String8(token.data(), token.size());
+}
+
+std::experimental::string_view Tokenizer::nextTokenView(const char* delimiters) {
 #if DEBUG_TOKENIZER
     ALOGD("nextToken");
 #endif
+    DelimiterSet stop(delimiters);
+    stop.add('\n');
+
     const char* end = getEnd();
     const char* tokenStart = mCurrent;
-    while (mCurrent != end) {
-        char ch = *mCurrent;
-        if (ch == '\n' || isDelimiter(ch, delimiters)) {
-            break;
-        }
+    while (mCurrent != end && !stop.contains(*mCurrent)) {
         mCurrent += 1;
     }
-    return String8(tokenStart, mCurrent - tokenStart);
+    return std::experimental::string_view(tokenStart, mCurrent - tokenStart);
 }
 
 void Tokenizer::nextLine() {
@@ -143,12 +179,12 @@ void Tokenizer::nextLine() {
     ALOGD("nextLine");
 #endif
     const char* end = getEnd();
-    while (mCurrent != end) {
-        char ch = *(mCurrent++);
-        if (ch == '\n') {
-            mLineNumber += 1;
-            break;
-        }
+    const char* eol = findEol(mCurrent, end);
+    if (eol != end) {
+        mCurrent = eol + 1;
+        mLineNumber += 1;
+    } else {
+        mCurrent = end;
     }
 }
 
@@ -156,12 +192,11 @@ void Tokenizer::skipDelimiters(const char* delimiters) {
 #if DEBUG_TOKENIZER
     ALOGD("skipDelimiters");
 #endif
+    DelimiterSet skip(delimiters);
+    skip.remove('\n');
+
     const char* end = getEnd();
-    while (mCurrent != end) {
-        char ch = *mCurrent;
-        if (ch == '\n' || !isDelimiter(ch, delimiters)) {
-            break;
-        }
+    while (mCurrent != end && skip.contains(*mCurrent)) {
         mCurrent += 1;
     }
 }
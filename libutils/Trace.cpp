@@ -14,7 +14,19 @@
  * limitations under the License.
  */
 
+#define LOG_TAG "Trace"
+
 #include <utils/Trace.h>
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <log/log.h>
 #include <utils/misc.h>
 
 static void traceInit() __attribute__((constructor));
@@ -22,3 +34,156 @@ static void traceInit() __attribute__((constructor));
 static void traceInit() {
     ::android::add_sysprop_change_callback(atrace_update_tags, 0);
 }
+
+namespace android {
+
+// Same limit as libcutils puts on a marker.
+static const size_t kMaxMarkerLength = 1024;
+
+// A batch is written once an entry is added this long after the last write.
+static const nsecs_t kBatchFlushInterval = 5000000;  // 5ms
+
+// The state a thread keeps for itself, so that tracing never takes a lock.
+struct TraceBatch {
+    struct Entry {
+        const TraceName* name;
+        uint64_t count;
+        nsecs_t duration;
+    };
+
+    static const size_t kMaxEntries = 16;
+
+    // The "B|<pid>|" prefix of begin markers, which a fork() invalidates.
+    pid_t prefixPid;
+    size_t prefixLength;
+    char prefix[16];
+
+    pid_t tid;
+    nsecs_t lastFlush;
+    size_t numEntries;
+    Entry entries[kMaxEntries];
+};
+
+static pthread_key_t gTraceBatchKey;
+static pthread_once_t gTraceBatchOnce = PTHREAD_ONCE_INIT;
+
+static void destroyTraceBatch(void* batch) {
+    // The thread's last entries would otherwise be lost.
+    pthread_setspecific(gTraceBatchKey, batch);
+    TraceName::flushBatch();
+    pthread_setspecific(gTraceBatchKey, NULL);
+    free(batch);
+}
+
+static void createTraceBatchKey() {
+    pthread_key_create(&gTraceBatchKey, destroyTraceBatch);
+}
+
+static TraceBatch* getTraceBatch(bool create) {
+    pthread_once(&gTraceBatchOnce, createTraceBatchKey);
+    TraceBatch* batch = static_cast<TraceBatch*>(pthread_getspecific(gTraceBatchKey));
+    if (batch == NULL && create) {
+        batch = static_cast<TraceBatch*>(calloc(1, sizeof(TraceBatch)));
+        if (batch != NULL) {
+            batch->tid = gettid();
+            batch->lastFlush = systemTime(SYSTEM_TIME_MONOTONIC);
+            pthread_setspecific(gTraceBatchKey, batch);
+        }
+    }
+    return batch;
+}
+
+// Formats "<type>|<pid>|" into buf, and returns its length.
+static size_t formatPrefix(char* buf, size_t size, char type) {
+    int len = snprintf(buf, size, "%c|%d|", type, getpid());
+    return len > 0 ? static_cast<size_t>(len) : 0;
+}
+
+TraceName::TraceName(const char* name)
+    : mName(name), mLength(strlen(name)) {
+}
+
+void TraceName::begin() const {
+    char buf[kMaxMarkerLength];
+    size_t prefixLength;
+    TraceBatch* batch = getTraceBatch(true);
+    if (CC_LIKELY(batch != NULL)) {
+        const pid_t pid = getpid();
+        if (CC_UNLIKELY(batch->prefixPid != pid)) {
+            batch->prefixLength = formatPrefix(batch->prefix, sizeof(batch->prefix), 'B');
+            batch->prefixPid = pid;
+        }
+        prefixLength = batch->prefixLength;
+        memcpy(buf, batch->prefix, prefixLength);
+    } else {
+        prefixLength = formatPrefix(buf, sizeof(buf), 'B');
+    }
+
+    size_t nameLength = mLength;
+    if (CC_UNLIKELY(prefixLength + nameLength > sizeof(buf))) {
+        ALOGW("Truncated name in %s: %s\n", __FUNCTION__, mName);
+        nameLength = sizeof(buf) - prefixLength;
+    }
+    memcpy(buf + prefixLength, mName, nameLength);
+    write(atrace_marker_fd, buf, prefixLength + nameLength);
+}
+
+void TraceName::addToBatch(nsecs_t duration) const {
+    TraceBatch* batch = getTraceBatch(true);
+    if (batch == NULL) {
+        return;
+    }
+
+    TraceBatch::Entry* entry = NULL;
+    for (size_t i = 0; i < batch->numEntries; i++) {
+        if (batch->entries[i].name == this) {
+            entry = &batch->entries[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        if (batch->numEntries == TraceBatch::kMaxEntries) {
+            flushBatch();
+        }
+        entry = &batch->entries[batch->numEntries++];
+        entry->name = this;
+        entry->count = 0;
+        entry->duration = 0;
+    }
+    entry->count++;
+    entry->duration += duration;
+
+    if (systemTime(SYSTEM_TIME_MONOTONIC) - batch->lastFlush >= kBatchFlushInterval) {
+        flushBatch();
+    }
+}
+
+void TraceName::flushBatch() {
+    TraceBatch* batch = getTraceBatch(false);
+    if (batch == NULL) {
+        return;
+    }
+
+    // Counters belong to the process, so the tid tells threads apart.
+    if (atrace_marker_fd >= 0) {
+        char buf[kMaxMarkerLength];
+        const size_t prefixLength = formatPrefix(buf, sizeof(buf), 'C');
+        for (size_t i = 0; i < batch->numEntries; i++) {
+            const TraceBatch::Entry& entry = batch->entries[i];
+            int len = snprintf(buf + prefixLength, sizeof(buf) - prefixLength,
+                    "%s [%d] count|%" PRIu64, entry.name->name(), batch->tid, entry.count);
+            if (len > 0 && static_cast<size_t>(len) < sizeof(buf) - prefixLength) {
+                write(atrace_marker_fd, buf, prefixLength + len);
+            }
+            len = snprintf(buf + prefixLength, sizeof(buf) - prefixLength,
+                    "%s [%d] ns|%" PRId64, entry.name->name(), batch->tid, entry.duration);
+            if (len > 0 && static_cast<size_t>(len) < sizeof(buf) - prefixLength) {
+                write(atrace_marker_fd, buf, prefixLength + len);
+            }
+        }
+    }
+    batch->numEntries = 0;
+    batch->lastFlush = systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+}; // namespace android
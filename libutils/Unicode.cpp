@@ -18,6 +18,8 @@
 
 #include <utils/Unicode.h>
 #include <limits.h>
+#include <stddef.h>
+#include <string.h>
 
 #include <log/log.h>
 
@@ -65,6 +67,26 @@ static const char32_t kFirstByteMark[] = {
     0x00000000, 0x00000000, 0x000000C0, 0x000000E0, 0x000000F0
 };
 
+// Runs of ASCII are converted a word at a time: 8 UTF-8 bytes or 4 UTF-16
+// units are ASCII when none of them has a bit set above 0x7f.  The copy loops
+// below have no branches, so compilers turn them into vector code.
+static const size_t kAsciiRunBytes = 8;
+static const size_t kAsciiRunUnits = 4;
+
+static inline bool utf8_is_ascii_run(const uint8_t* src)
+{
+    uint64_t word;
+    memcpy(&word, src, sizeof(word));
+    return (word & 0x8080808080808080ULL) == 0;
+}
+
+static inline bool utf16_is_ascii_run(const char16_t* src)
+{
+    uint64_t word;
+    memcpy(&word, src, sizeof(word));
+    return (word & 0xFF80FF80FF80FF80ULL) == 0;
+}
+
 // --------------------------------------------------------------------------
 // UTF-32
 // --------------------------------------------------------------------------
@@ -372,6 +394,16 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst, size_t dst_le
     const char16_t* const end_utf16 = src + src_len;
     char *cur = dst;
     while (cur_utf16 < end_utf16) {
+        if (end_utf16 - cur_utf16 >= (ptrdiff_t)kAsciiRunUnits && dst_len >= kAsciiRunUnits &&
+                utf16_is_ascii_run(cur_utf16)) {
+            for (size_t i = 0; i < kAsciiRunUnits; i++) {
+                cur[i] = (char) cur_utf16[i];
+            }
+            cur_utf16 += kAsciiRunUnits;
+            cur += kAsciiRunUnits;
+            dst_len -= kAsciiRunUnits;
+            continue;
+        }
         char32_t utf32;
         // surrogate pairs
         if((*cur_utf16 & 0xFC00) == 0xD800 && (cur_utf16 + 1) < end_utf16
@@ -399,8 +431,17 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst, size_t dst_le
 ssize_t utf8_length(const char *src)
 {
     const char *cur = src;
+    // strlen is vectorized by libc, and knowing where the string ends lets
+    // the ASCII runs be read a word at a time without reading past it.
+    const char* const end = src + strlen(src);
     size_t ret = 0;
     while (*cur != '\0') {
+        if (end - cur >= (ptrdiff_t)kAsciiRunBytes &&
+                utf8_is_ascii_run(reinterpret_cast<const uint8_t*>(cur))) {
+            cur += kAsciiRunBytes;
+            ret += kAsciiRunBytes;
+            continue;
+        }
         const char first_char = *cur++;
         if ((first_char & 0x80) == 0) { // ASCII
             ret += 1;
@@ -448,6 +489,12 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len)
     size_t ret = 0;
     const char16_t* const end = src + src_len;
     while (src < end) {
+        if (end - src >= (ptrdiff_t)kAsciiRunUnits && SSIZE_MAX - kAsciiRunUnits >= ret &&
+                utf16_is_ascii_run(src)) {
+            src += kAsciiRunUnits;
+            ret += kAsciiRunUnits;
+            continue;
+        }
         size_t char_len;
         if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
                 && (*(src + 1) & 0xFC00) == 0xDC00) {
@@ -569,6 +616,11 @@ ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len, bool overreadIs
     /* Validate that the UTF-8 is the correct len */
     size_t u16measuredLen = 0;
     while (u8cur < u8end) {
+        if (u8end - u8cur >= (ptrdiff_t)kAsciiRunBytes && utf8_is_ascii_run(u8cur)) {
+            u8cur += kAsciiRunBytes;
+            u16measuredLen += kAsciiRunBytes;
+            continue;
+        }
         u16measuredLen++;
         int u8charLen = utf8_codepoint_len(*u8cur);
         // Malformed utf8, some characters are beyond the end.
@@ -622,6 +674,15 @@ char16_t* utf8_to_utf16_no_null_terminator(
     char16_t* u16cur = dst;
 
     while (u8cur < u8end && u16cur < u16end) {
+        if (u8end - u8cur >= (ptrdiff_t)kAsciiRunBytes &&
+                u16end - u16cur >= (ptrdiff_t)kAsciiRunBytes && utf8_is_ascii_run(u8cur)) {
+            for (size_t i = 0; i < kAsciiRunBytes; i++) {
+                u16cur[i] = u8cur[i];
+            }
+            u8cur += kAsciiRunBytes;
+            u16cur += kAsciiRunBytes;
+            continue;
+        }
         size_t u8len = utf8_codepoint_len(*u8cur);
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8len);
 
@@ -41,6 +41,27 @@ static inline size_t max(size_t a, size_t b) {
     return a>b ? a : b;
 }
 
+static inline size_t min(size_t a, size_t b) {
+    return a<b ? a : b;
+}
+
+// The capacity last set with setCapacity(), which _shrink() keeps.  It is
+// kept in the storage rather than in VectorImpl, whose layout is fixed.
+static inline size_t reservedCapacity(const void* storage) {
+    return storage ? SharedBuffer::bufferFromData(storage)->getClientMetadata() : 0;
+}
+
+// Whether the items in storage can be moved to a new address with memcpy,
+// without running their copy constructor and destructor.  Items that are
+// only trivially movable can be moved so if no other vector shares them.
+static inline bool canRelocate(uint32_t flags, const void* storage) {
+    if ((flags & VectorImpl::HAS_TRIVIAL_COPY) && (flags & VectorImpl::HAS_TRIVIAL_DTOR)) {
+        return true;
+    }
+    return (flags & VectorImpl::HAS_TRIVIAL_MOVE) &&
+            SharedBuffer::bufferFromData(storage)->onlyOwner();
+}
+
 // ----------------------------------------------------------------------------
 
 VectorImpl::VectorImpl(size_t itemSize, uint32_t flags)
@@ -97,6 +118,7 @@ void* VectorImpl::editArrayImpl()
             // editable. Otherwise we'd be editing the contents of a buffer
             // for which we're not the only owner, which is undefined behaviour.
             LOG_ALWAYS_FATAL_IF(editable == NULL);
+            editable->setClientMetadata(sb->getClientMetadata());
             _do_copy(editable->data(), mStorage, mCount);
             release_storage();
             mStorage = editable->data();
@@ -343,15 +365,26 @@ ssize_t VectorImpl::setCapacity(size_t new_capacity)
 
     size_t new_allocation_size = 0;
     LOG_ALWAYS_FATAL_IF(!safe_mul(&new_allocation_size, new_capacity, mItemSize));
-    SharedBuffer* sb = SharedBuffer::alloc(new_allocation_size);
-    if (sb) {
-        void* array = sb->data();
-        _do_copy(array, mStorage, size());
-        release_storage();
-        mStorage = const_cast<void*>(array);
+    SharedBuffer* sb;
+    if (mStorage && canRelocate(mFlags, mStorage)) {
+        sb = SharedBuffer::bufferFromData(mStorage)->editResize(new_allocation_size);
+        if (sb) {
+            mStorage = sb->data();
+        } else {
+            return NO_MEMORY;
+        }
     } else {
-        return NO_MEMORY;
+        sb = SharedBuffer::alloc(new_allocation_size);
+        if (sb) {
+            void* array = sb->data();
+            _do_copy(array, mStorage, size());
+            release_storage();
+            mStorage = const_cast<void*>(array);
+        } else {
+            return NO_MEMORY;
+        }
     }
+    sb->setClientMetadata(min(new_capacity, UINT32_MAX));
     return new_capacity;
 }
 
@@ -409,10 +442,10 @@ void* VectorImpl::_grow(size_t where, size_t amount)
 
 //        ALOGV("grow vector %p, new_capacity=%d", this, (int)new_capacity);
         if ((mStorage) &&
-            (mCount==where) &&
-            (mFlags & HAS_TRIVIAL_COPY) &&
-            (mFlags & HAS_TRIVIAL_DTOR))
+            (mCount==where || SharedBuffer::bufferFromData(mStorage)->onlyOwner()) &&
+            canRelocate(mFlags, mStorage))
         {
+            // Let realloc() move the items, then open the gap in place.
             const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
             SharedBuffer* sb = cur_sb->editResize(new_alloc_size);
             if (sb) {
@@ -420,10 +453,15 @@ void* VectorImpl::_grow(size_t where, size_t amount)
             } else {
                 return NULL;
             }
+            if (where != mCount) {
+                uint8_t* from = reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize;
+                memmove(from + amount*mItemSize, from, (mCount-where)*mItemSize);
+            }
         } else {
             SharedBuffer* sb = SharedBuffer::alloc(new_alloc_size);
             if (sb) {
                 void* array = sb->data();
+                sb->setClientMetadata(reservedCapacity(mStorage));
                 if (where != 0) {
                     _do_copy(array, mStorage, where);
                 }
@@ -466,17 +504,35 @@ void VectorImpl::_shrink(size_t where, size_t amount)
     size_t new_size;
     LOG_ALWAYS_FATAL_IF(!safe_sub(&new_size, mCount, amount));
 
-    if (new_size < (capacity() / 2)) {
-        // NOTE: (new_size * 2) is safe because capacity didn't overflow and
-        // new_size < (capacity / 2)).
-        const size_t new_capacity = max(kMinVectorCapacity, new_size * 2);
+    // NOTE: (new_size * 2) is safe because capacity didn't overflow and
+    // new_size < (capacity / 2)).
+    const size_t old_capacity = capacity();
+    const size_t new_capacity = new_size < (old_capacity / 2) ?
+            max(max(kMinVectorCapacity, new_size * 2), reservedCapacity(mStorage)) :
+            old_capacity;
 
+    if (new_capacity < old_capacity) {
         // NOTE: (new_capacity * mItemSize), (where * mItemSize) and
         // ((where + amount) * mItemSize) beyond this point are safe because
         // we are always reducing the capacity of the underlying SharedBuffer.
         // In other words, (old_capacity * mItemSize) did not overflow, and
         // where < (where + amount) < new_capacity < old_capacity.
-        if ((where == new_size) &&
+        if (SharedBuffer::bufferFromData(mStorage)->onlyOwner() &&
+            canRelocate(mFlags, mStorage))
+        {
+            // Close the gap in place, then let realloc() move the items.
+            uint8_t* to = reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize;
+            _do_destroy(to, amount);
+            if (where != new_size) {
+                memmove(to, to + amount*mItemSize, (new_size-where)*mItemSize);
+            }
+            // If this fails, the items stay where they are.
+            const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
+            SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
+            if (sb) {
+                mStorage = sb->data();
+            }
+        } else if ((where == new_size) &&
             (mFlags & HAS_TRIVIAL_COPY) &&
             (mFlags & HAS_TRIVIAL_DTOR))
         {
@@ -491,6 +547,7 @@ void VectorImpl::_shrink(size_t where, size_t amount)
             SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
             if (sb) {
                 void* array = sb->data();
+                sb->setClientMetadata(reservedCapacity(mStorage));
                 if (where != 0) {
                     _do_copy(array, mStorage, where);
                 }
@@ -549,11 +606,19 @@ void VectorImpl::_do_splat(void* dest, const void* item, size_t num) const {
 }
 
 void VectorImpl::_do_move_forward(void* dest, const void* from, size_t num) const {
-    do_move_forward(dest, from, num);
+    if (!(mFlags & HAS_TRIVIAL_MOVE)) {
+        do_move_forward(dest, from, num);
+    } else {
+        memmove(dest, from, num*itemSize());
+    }
 }
 
 void VectorImpl::_do_move_backward(void* dest, const void* from, size_t num) const {
-    do_move_backward(dest, from, num);
+    if (!(mFlags & HAS_TRIVIAL_MOVE)) {
+        do_move_backward(dest, from, num);
+    } else {
+        memmove(dest, from, num*itemSize());
+    }
 }
 
 /*****************************************************************************/
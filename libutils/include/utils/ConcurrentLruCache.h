@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UTILS_CONCURRENT_LRU_CACHE_H
+#define ANDROID_UTILS_CONCURRENT_LRU_CACHE_H
+
+#include <memory>
+#include <vector>
+
+#include <utils/JenkinsHash.h>
+#include <utils/LruCache.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+/**
+ * A thread-safe LruCache, split into shards that each hold an LruCache and
+ * a lock of their own, so that threads working on keys in different shards
+ * do not wait for each other.
+ *
+ * A key always lives in the same shard, picked from its hash_type().  Each
+ * shard holds up to maxCapacity / shardCount entries (rounded up), and evicts
+ * its own least recently used entry when full, so eviction order is only
+ * approximately LRU across the whole cache.
+ *
+ * Values are returned by copy, since a reference would outlive the lock.
+ * The OnEntryRemoved listener runs with the lock of the entry's shard held,
+ * and must not call back into the cache.
+ */
+template <typename TKey, typename TValue>
+class ConcurrentLruCache {
+public:
+    enum {
+        kDefaultShardCount = 16,
+    };
+
+    explicit ConcurrentLruCache(uint32_t maxCapacity,
+            uint32_t shardCount = kDefaultShardCount);
+
+    void setOnEntryRemovedListener(OnEntryRemoved<TKey, TValue>* listener);
+    size_t size() const;
+    TValue get(const TKey& key);
+    bool put(const TKey& key, const TValue& value);
+    bool remove(const TKey& key);
+    void clear();
+
+private:
+    ConcurrentLruCache(const ConcurrentLruCache& that);  // disallow copy constructor
+
+    struct Shard {
+        explicit Shard(uint32_t capacity) : cache(capacity) { }
+
+        mutable Mutex lock;
+        LruCache<TKey, TValue> cache;
+    };
+
+    Shard& shardFor(const TKey& key) const {
+        // Whiten the hash so the shard does not correlate with the bucket the
+        // shard's own hash set puts the key in.
+        return *mShards[JenkinsHashWhiten(hash_type(key)) & mShardMask];
+    }
+
+    std::vector<std::unique_ptr<Shard>> mShards;
+    uint32_t mShardMask;
+};
+
+// Implementation is here, because it's fully templated
+template <typename TKey, typename TValue>
+ConcurrentLruCache<TKey, TValue>::ConcurrentLruCache(uint32_t maxCapacity,
+        uint32_t shardCount) {
+    // Round up to a power of 2, so that a mask picks the shard.
+    uint32_t count = 1;
+    while (count < shardCount && count < (1u << 31)) {
+        count <<= 1;
+    }
+    mShardMask = count - 1;
+
+    uint32_t shardCapacity = LruCache<TKey, TValue>::kUnlimitedCapacity;
+    if (maxCapacity != LruCache<TKey, TValue>::kUnlimitedCapacity) {
+        shardCapacity = maxCapacity / count + (maxCapacity % count != 0);
+    }
+    mShards.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        mShards.emplace_back(new Shard(shardCapacity));
+    }
+}
+
+template <typename TKey, typename TValue>
+void ConcurrentLruCache<TKey, TValue>::setOnEntryRemovedListener(
+        OnEntryRemoved<TKey, TValue>* listener) {
+    for (auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        shard->cache.setOnEntryRemovedListener(listener);
+    }
+}
+
+template <typename TKey, typename TValue>
+size_t ConcurrentLruCache<TKey, TValue>::size() const {
+    // Not a snapshot: other threads can change the shards already counted.
+    size_t size = 0;
+    for (auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        size += shard->cache.size();
+    }
+    return size;
+}
+
+template <typename TKey, typename TValue>
+TValue ConcurrentLruCache<TKey, TValue>::get(const TKey& key) {
+    Shard& shard = shardFor(key);
+    Mutex::Autolock _l(shard.lock);
+    return shard.cache.get(key);
+}
+
+template <typename TKey, typename TValue>
+bool ConcurrentLruCache<TKey, TValue>::put(const TKey& key, const TValue& value) {
+    Shard& shard = shardFor(key);
+    Mutex::Autolock _l(shard.lock);
+    return shard.cache.put(key, value);
+}
+
+template <typename TKey, typename TValue>
+bool ConcurrentLruCache<TKey, TValue>::remove(const TKey& key) {
+    Shard& shard = shardFor(key);
+    Mutex::Autolock _l(shard.lock);
+    return shard.cache.remove(key);
+}
+
+template <typename TKey, typename TValue>
+void ConcurrentLruCache<TKey, TValue>::clear() {
+    for (auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        shard->cache.clear();
+    }
+}
+
+}
+#endif // ANDROID_UTILS_CONCURRENT_LRU_CACHE_H
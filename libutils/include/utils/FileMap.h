@@ -20,6 +20,7 @@
 #ifndef __LIBS_FILE_MAP_H
 #define __LIBS_FILE_MAP_H
 
+#include <stdint.h>
 #include <sys/types.h>
 
 #include <utils/Compat.h>
@@ -66,6 +67,30 @@ public:
     bool create(const char* origFileName, int fd,
                 off64_t offset, size_t length, bool readOnly);
 
+    /*
+     * Flags for create().
+     */
+    enum CreateFlags {
+        /*
+         * Fault the whole mapping in before returning, as MAP_POPULATE would,
+         * so that the first accesses do not stall on storage.  See prefault().
+         */
+        CREATE_PREFAULT = 0x1,
+        /*
+         * Share the mapping with any other FileMap created with this flag on
+         * the same range of the same file, with the same protection.  The
+         * pages are unmapped when the last of them goes away.  Meant for
+         * files that are mapped over and over, such as assets.
+         */
+        CREATE_SHARED   = 0x2,
+    };
+
+    /*
+     * Like create() above, with a combination of CreateFlags.
+     */
+    bool create(const char* origFileName, int fd,
+                off64_t offset, size_t length, bool readOnly, uint32_t flags);
+
     ~FileMap(void);
 
     /*
@@ -93,16 +118,44 @@ public:
      * including <sys/mman.h> everywhere.
      */
     enum MapAdvice {
-        NORMAL, RANDOM, SEQUENTIAL, WILLNEED, DONTNEED
+        NORMAL, RANDOM, SEQUENTIAL, WILLNEED, DONTNEED, HUGEPAGE
     };
 
     /*
      * Apply an madvise() call to the entire file.
      *
+     * HUGEPAGE asks for transparent huge pages, which the kernel only uses
+     * for file mappings on some file systems, and fails where the kernel has
+     * no support for them at all.
+     *
      * Returns 0 on success, -1 on failure.
      */
     int advise(MapAdvice advice);
 
+    /*
+     * Fault in "length" bytes of the requested data, starting "offset" bytes
+     * in, so that later accesses to them do not stall on storage.  Blocks
+     * until the pages have been read.
+     *
+     * Returns 0 on success, -1 on failure.
+     */
+    int prefault(size_t offset, size_t length);
+
+    /*
+     * Get the number of pages that were not resident when this map was
+     * prefaulted, through CREATE_PREFAULT or prefault(), and so had to be read
+     * from storage; without prefaulting, each would have cost a major fault.
+     * The kernel does not count faults per mapping, so faults taken by plain
+     * accesses to the data are not included.
+     */
+    size_t getMajorFaults(void) const { return mMajorFaults; }
+
+    /*
+     * Get the number of bytes of the mapping, rounded out to whole pages,
+     * that are currently resident in memory, or -1 on failure.
+     */
+    ssize_t getResidentLength(void) const;
+
 protected:
 
 private:
@@ -116,6 +169,8 @@ private:
     off64_t     mDataOffset;    // offset used when map was created
     void*       mDataPtr;       // start of requested data, offset from base
     size_t      mDataLength;    // length, measured from "mDataPtr"
+    bool        mShared;        // mBasePtr is owned by the shared mapping cache
+    size_t      mMajorFaults;   // major faults taken by prefaulting
 #if defined(__MINGW32__)
     HANDLE      mFileHandle;    // Win32 file handle
     HANDLE      mFileMapping;   // Win32 file mapping handle
@@ -434,23 +434,32 @@ private:
     };
 
     struct MessageEnvelope {
-        MessageEnvelope() : uptime(0) { }
+        MessageEnvelope() : uptime(0), seq(0) { }
 
-        MessageEnvelope(nsecs_t u, const sp<MessageHandler> h,
-                const Message& m) : uptime(u), handler(h), message(m) {
+        MessageEnvelope(nsecs_t u, uint64_t s, const sp<MessageHandler> h,
+                const Message& m) : uptime(u), seq(s), handler(h), message(m) {
         }
 
         nsecs_t uptime;
+        uint64_t seq; // keeps messages sent for the same time in order
         sp<MessageHandler> handler;
         Message message;
+
+        // Orders the heap of envelopes with the next message to send on top.
+        static bool isAfter(const MessageEnvelope& a, const MessageEnvelope& b) {
+            return a.uptime > b.uptime || (a.uptime == b.uptime && a.seq > b.seq);
+        }
     };
 
     const bool mAllowNonCallbacks; // immutable
 
     int mWakeEventFd;  // immutable
+    int mTimerFd;  // immutable, -1 if timerfd is not available
     Mutex mLock;
 
+    // A heap ordered by MessageEnvelope::isAfter.
     Vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
+    uint64_t mNextMessageSeq; // guarded by mLock
     bool mSendingMessage; // guarded by mLock
 
     // Whether we are currently waiting for work.  Not protected by a lock,
@@ -459,6 +468,9 @@ private:
 
     int mEpollFd; // guarded by mLock but only modified on the looper thread
     bool mEpollRebuildRequired; // guarded by mLock
+    // Set when a closed fd may have been left in the epoll set, which then
+    // only needs to be rebuilt if that fd ever reports events.
+    bool mEpollMayHaveStaleFds; // guarded by mLock
 
     // Locked list of file descriptor monitoring requests.
     KeyedVector<int, Request> mRequests;  // guarded by mLock
@@ -469,11 +481,13 @@ private:
     Vector<Response> mResponses;
     size_t mResponseIndex;
     nsecs_t mNextMessageUptime; // set to LLONG_MAX when none
+    nsecs_t mTimerUptime; // when mTimerFd fires, LLONG_MAX when disarmed
 
     int pollInner(int timeoutMillis);
     int removeFd(int fd, int seq);
     void awoken();
     void pushResponse(int events, const Request& request);
+    void armTimer(nsecs_t uptime);
     void rebuildEpollLocked();
     void scheduleEpollRebuildLocked();
 
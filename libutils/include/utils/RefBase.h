@@ -156,8 +156,9 @@
 // RefBase provides a number of additional callbacks for certain reference count
 // events, as well as some debugging facilities.
 
-// Debugging support can be enabled by turning on DEBUG_REFS in RefBase.cpp.
-// Otherwise little checking is provided.
+// Debugging support can be enabled by turning on DEBUG_REFS in RefBase.cpp,
+// or for a sample of objects with setTrackingSamplePeriod().  Otherwise little
+// checking is provided.
 
 // Thread safety:
 
@@ -290,6 +291,14 @@ public:
         getWeakRefs()->trackMe(enable, retain); 
     }
 
+            //! DEBUGGING ONLY: Track the references of one in every
+            // |period| objects constructed from now on, or of none if
+            // |period| is 0, without DEBUG_REFS.  Each sampled object
+            // records a stack per reference, logs those that remain when
+            // it is destroyed, and supports printRefs().  Defaults to the
+            // debug.refbase.sample_period system property.
+    static  void            setTrackingSamplePeriod(uint32_t period);
+
     typedef RefBase basetype;
 
 protected:
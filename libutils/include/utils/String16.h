@@ -54,6 +54,8 @@ public:
                                 String16();
     explicit                    String16(StaticLinkage);
                                 String16(const String16& o);
+                                // leaves |o| empty, without allocating
+                                String16(String16&& o) noexcept;
                                 String16(const String16& o,
                                          size_t len,
                                          size_t begin=0);
@@ -83,6 +85,7 @@ public:
             status_t            append(const char16_t* other, size_t len);
 
     inline  String16&           operator=(const String16& other);
+            String16&           operator=(String16&& other) noexcept;
 
     inline  String16&           operator+=(const String16& other);
     inline  String16            operator+(const String16& other) const;
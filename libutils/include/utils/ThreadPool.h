@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UTILS_THREAD_POOL_H
+#define UTILS_THREAD_POOL_H
+
+#include <atomic>
+
+#include <utils/Condition.h>
+#include <utils/Errors.h>
+#include <utils/Looper.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/ThreadDefs.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+/**
+ * A fixed set of worker threads that run tasks posted to them.
+ *
+ * Each worker has a queue of its own.  A task posted from one of the pool's
+ * workers goes on that worker's queue, which the worker runs newest first, so
+ * that tasks spawned by a task tend to run while its data is still in cache.
+ * Tasks posted from any other thread are spread over the queues in turn.  A
+ * worker whose queue is empty steals the oldest task of another worker before
+ * going to sleep, so no worker sits idle while there is work queued.
+ *
+ * Workers run at the priority given to the constructor; as for any thread
+ * created by libutils, a background priority also moves them to the
+ * background cgroup.
+ */
+class ThreadPool : public virtual RefBase {
+public:
+    /**
+     * A unit of work.  The pool holds a strong reference to a task until it
+     * has run.
+     */
+    class Task : public virtual RefBase {
+    protected:
+        virtual ~Task();
+
+    public:
+        virtual void run() = 0;
+    };
+
+    /**
+     * Creates a pool of numThreads workers named "<name>:<n>", or of one worker
+     * per online CPU if numThreads is 0.  The workers start with start().
+     */
+    explicit ThreadPool(const char* name, size_t numThreads = 0,
+            int32_t priority = PRIORITY_DEFAULT);
+
+    /**
+     * Starts the workers.  Returns INVALID_OPERATION if the pool was already
+     * started or has been shut down, or UNKNOWN_ERROR if a thread could not be
+     * created, in which case the workers already started are shut down.
+     */
+    status_t start();
+
+    /**
+     * Queues a task.  Returns INVALID_OPERATION if the pool has been shut down.
+     * Tasks may be posted before start(); they run once the workers start.
+     */
+    status_t post(const sp<Task>& task);
+
+    /**
+     * Queues a task and, once it has run, sends message to handler on looper,
+     * so that the thread polling the looper learns of its completion.
+     */
+    status_t post(const sp<Task>& task, const sp<Looper>& looper,
+            const sp<MessageHandler>& handler, const Message& message);
+
+    /**
+     * Blocks until every task posted so far has run, and the queues are empty.
+     * Must not be called from a worker.
+     */
+    void waitForIdle();
+
+    /**
+     * Stops accepting tasks, runs the tasks already queued, and waits for the
+     * workers to exit.  Must not be called from a worker.  Called by the
+     * destructor.
+     */
+    void shutdown();
+
+    /**
+     * Moves every worker to the given priority, and the matching cgroup.
+     * Workers started later also use it.  Only supported on Android; returns
+     * INVALID_OPERATION elsewhere.
+     */
+    status_t setPriority(int32_t priority);
+
+    size_t getThreadCount() const { return mWorkers.size(); }
+
+protected:
+    virtual ~ThreadPool();
+
+private:
+    class Worker;
+    friend class Worker;
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    // Returns the calling thread's worker if it belongs to this pool.
+    Worker* getCurrentWorker() const;
+    // Takes a task, from worker's own queue first.
+    sp<Task> takeTask(Worker* worker);
+    // Blocks until a task is queued, or returns false if the worker should exit.
+    bool waitForTask();
+    void taskDone();
+    // Drops the queued tasks, once no worker is left to run them.
+    void dropQueuedTasks();
+
+    const String8 mName;
+    int32_t mPriority;
+    Vector<sp<Worker> > mWorkers;
+
+    std::atomic<size_t> mNextQueue;
+    // Tasks queued and not yet taken by a worker.
+    std::atomic<size_t> mQueued;
+    // Tasks queued or running.
+    std::atomic<size_t> mOutstanding;
+    // Workers asleep, or about to sleep, in waitForTask().
+    std::atomic<size_t> mSleeping;
+
+    Mutex mLock;
+    Condition mTaskAvailable;  // signaled when a task is queued
+    Condition mIdle;           // broadcast when mOutstanding drops to 0
+    bool mStarted;             // guarded by mLock
+    bool mExiting;             // guarded by mLock; tells the workers to exit
+
+    // Set by shutdown(), after which post() fails.
+    std::atomic<bool> mShutdown;
+};
+
+} // namespace android
+
+#endif // UTILS_THREAD_POOL_H
@@ -18,6 +18,7 @@
 #define _UTILS_TOKENIZER_H
 
 #include <assert.h>
+#include <experimental/string_view>
 #include <utils/Errors.h>
 #include <utils/FileMap.h>
 #include <utils/String8.h>
@@ -88,6 +89,12 @@ public:
      */
     String8 peekRemainderOfLine() const;
 
+    /**
+     * Like peekRemainderOfLine(), but returns a view into the tokenizer's buffer,
+     * which stays valid as long as the tokenizer, instead of a copy.
+     */
+    std::experimental::string_view peekRemainderOfLineView() const;
+
     /**
      * Gets the character at the current position and advances past it.
      * Returns null at end of file.
@@ -103,6 +110,13 @@ public:
      */
     String8 nextToken(const char* delimiters);
 
+    /**
+     * Like nextToken(), but returns a view into the tokenizer's buffer, which
+     * stays valid as long as the tokenizer, instead of a copy, so that scanning
+     * a file allocates nothing per token.
+     */
+    std::experimental::string_view nextTokenView(const char* delimiters);
+
     /**
      * Advances to the next line.
      * Does nothing if already at the end of the file.
@@ -19,9 +19,12 @@
 
 #if defined(__ANDROID__)
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <cutils/compiler.h>
 #include <cutils/trace.h>
+#include <utils/Timers.h>
 
 // See <cutils/trace.h> for more ATRACE_* macros.
 
@@ -33,8 +36,107 @@
 // ATRACE_CALL is an ATRACE_NAME that uses the current function name.
 #define ATRACE_CALL() ATRACE_NAME(__FUNCTION__)
 
+// ATRACE_NAME_STATIC is an ATRACE_NAME for a name that lives as long as the
+// process, such as a string literal.  The name is interned the first time the
+// scope is entered, so each event costs one write() and no snprintf().
+#define ATRACE_NAME_STATIC(name) \
+    static const android::TraceName PASTE(___trace_name, __LINE__) (name); \
+    android::ScopedStaticTrace PASTE(___tracer, __LINE__) \
+            (ATRACE_TAG, PASTE(___trace_name, __LINE__))
+
+// ATRACE_CALL_STATIC is an ATRACE_NAME_STATIC that uses the current function name.
+#define ATRACE_CALL_STATIC() ATRACE_NAME_STATIC(__FUNCTION__)
+
+// ATRACE_NAME_BATCHED is for scopes entered too often to trace one by one,
+// such as the body of a hot loop.  Instead of a slice per entry, each thread
+// adds up how many times it entered the scope and how long it spent there,
+// and writes the totals as the "<name> [<tid>] count" and "<name> [<tid>] ns"
+// counters in a batch, at most every few milliseconds, before starting over.
+// ATRACE_FLUSH_BATCHED writes the calling thread's batch early, e.g. once the
+// loop is done; a thread's batch is also written when it exits.
+#define ATRACE_NAME_BATCHED(name) \
+    static const android::TraceName PASTE(___trace_name, __LINE__) (name); \
+    android::ScopedBatchedTrace PASTE(___tracer, __LINE__) \
+            (ATRACE_TAG, PASTE(___trace_name, __LINE__))
+#define ATRACE_FLUSH_BATCHED() android::TraceName::flushBatch()
+
+extern "C" void atrace_end_body();
+
 namespace android {
 
+// Returns nonzero if |tag| is enabled.  Once tracing is set up, this is a
+// single relaxed load, and it is constant for ATRACE_TAG_NEVER, so the
+// tracing of code built without an ATRACE_TAG compiles away.
+inline uint64_t traceTagEnabled(uint64_t tag) {
+    if (tag == ATRACE_TAG_NEVER) {
+        return 0;
+    }
+    const uint64_t tags = __atomic_load_n(&atrace_enabled_tags, __ATOMIC_RELAXED);
+    if (CC_UNLIKELY(tags & ATRACE_TAG_NOT_READY)) {
+        // Sets up tracing on first use.
+        return atrace_is_tag_enabled(tag);
+    }
+    return tags & tag;
+}
+
+// A trace name interned by ATRACE_NAME_STATIC and ATRACE_NAME_BATCHED.
+class TraceName {
+public:
+    explicit TraceName(const char* name);
+
+    // Writes the begin marker for this name.
+    void begin() const;
+    // Adds one entry to the calling thread's batch, flushing it if due.
+    void addToBatch(nsecs_t duration) const;
+    // Writes the calling thread's batch.
+    static void flushBatch();
+
+    const char* name() const { return mName; }
+    size_t length() const { return mLength; }
+
+private:
+    const char* const mName;
+    const size_t mLength;
+};
+
+class ScopedStaticTrace {
+public:
+    inline ScopedStaticTrace(uint64_t tag, const TraceName& name)
+            : mEnabled(traceTagEnabled(tag) != 0) {
+        if (CC_UNLIKELY(mEnabled)) {
+            name.begin();
+        }
+    }
+
+    inline ~ScopedStaticTrace() {
+        // Matches the begin marker even if the tag was toggled meanwhile.
+        if (CC_UNLIKELY(mEnabled)) {
+            atrace_end_body();
+        }
+    }
+
+private:
+    const bool mEnabled;
+};
+
+class ScopedBatchedTrace {
+public:
+    inline ScopedBatchedTrace(uint64_t tag, const TraceName& name)
+            : mName(name),
+              mStart(traceTagEnabled(tag) ? systemTime(SYSTEM_TIME_MONOTONIC) : 0) {
+    }
+
+    inline ~ScopedBatchedTrace() {
+        if (CC_UNLIKELY(mStart != 0)) {
+            mName.addToBatch(systemTime(SYSTEM_TIME_MONOTONIC) - mStart);
+        }
+    }
+
+private:
+    const TraceName& mName;
+    const nsecs_t mStart;
+};
+
 class ScopedTrace {
 public:
     inline ScopedTrace(uint64_t tag, const char* name) : mTag(tag) {
@@ -55,6 +157,10 @@ private:
 
 #define ATRACE_NAME(...)
 #define ATRACE_CALL()
+#define ATRACE_NAME_STATIC(...)
+#define ATRACE_CALL_STATIC()
+#define ATRACE_NAME_BATCHED(...)
+#define ATRACE_FLUSH_BATCHED()
 
 #endif // __ANDROID__
 
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <utils/ConcurrentLruCache.h>
+
+namespace android {
+
+typedef ConcurrentLruCache<int, int> IntCache;
+
+class CountingCallback : public OnEntryRemoved<int, int> {
+public:
+    CountingCallback() : count(0) { }
+    void operator()(int&, int&) {
+        count++;
+    }
+    std::atomic<int> count;
+};
+
+TEST(ConcurrentLruCacheTest, Empty) {
+    IntCache cache(100);
+
+    EXPECT_EQ(0, cache.get(0));
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST(ConcurrentLruCacheTest, Simple) {
+    IntCache cache(100);
+
+    ASSERT_TRUE(cache.put(1, 10));
+    ASSERT_TRUE(cache.put(2, 20));
+    ASSERT_FALSE(cache.put(2, 21));
+    EXPECT_EQ(10, cache.get(1));
+    EXPECT_EQ(20, cache.get(2));
+    EXPECT_EQ(2u, cache.size());
+
+    ASSERT_TRUE(cache.remove(1));
+    ASSERT_FALSE(cache.remove(1));
+    EXPECT_EQ(0, cache.get(1));
+    EXPECT_EQ(1u, cache.size());
+}
+
+TEST(ConcurrentLruCacheTest, MaxCapacity) {
+    // 4 shards of 2 entries each.
+    IntCache cache(8, 3);
+    CountingCallback callback;
+    cache.setOnEntryRemovedListener(&callback);
+
+    for (int i = 0; i < 100; i++) {
+        cache.put(i, i);
+    }
+    EXPECT_LE(cache.size(), 8u);
+    EXPECT_EQ(100 - static_cast<int>(cache.size()), callback.count);
+
+    cache.clear();
+    EXPECT_EQ(0u, cache.size());
+    EXPECT_EQ(100, callback.count);
+}
+
+TEST(ConcurrentLruCacheTest, GetUpdatesLru) {
+    // With a single shard, eviction is exactly LRU.
+    IntCache cache(2, 1);
+
+    cache.put(1, 10);
+    cache.put(2, 20);
+    EXPECT_EQ(10, cache.get(1));
+    cache.put(3, 30);
+    EXPECT_EQ(10, cache.get(1));
+    EXPECT_EQ(0, cache.get(2));
+    EXPECT_EQ(30, cache.get(3));
+}
+
+TEST(ConcurrentLruCacheTest, UnlimitedCapacity) {
+    IntCache cache(LruCache<int, int>::kUnlimitedCapacity);
+
+    for (int i = 0; i < 1000; i++) {
+        cache.put(i, i);
+    }
+    EXPECT_EQ(1000u, cache.size());
+}
+
+TEST(ConcurrentLruCacheTest, Threads) {
+    static constexpr int kThreads = 8;
+    static constexpr int kKeys = 512;
+    IntCache cache(kKeys / 2);
+    CountingCallback callback;
+    cache.setOnEntryRemovedListener(&callback);
+    std::atomic<int> puts(0);
+    std::atomic<int> removes(0);
+    std::atomic<bool> mismatch(false);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 20000; i++) {
+                int key = (i * 7 + t * 131) % kKeys;
+                switch (i % 3) {
+                case 0:
+                    if (cache.put(key, key + 1)) {
+                        puts++;
+                    }
+                    break;
+                case 1: {
+                    int value = cache.get(key);
+                    if (value != 0 && value != key + 1) {
+                        mismatch = true;
+                    }
+                    break;
+                }
+                case 2:
+                    if (cache.remove(key)) {
+                        removes++;
+                    }
+                    break;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_FALSE(mismatch);
+    EXPECT_LE(cache.size(), static_cast<size_t>(kKeys / 2));
+    // Every entry put is either still there, or was passed to the listener
+    // when it was removed or evicted.
+    EXPECT_EQ(puts, static_cast<int>(cache.size()) + callback.count);
+    EXPECT_LE(removes, callback.count);
+}
+
+}  // namespace android
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+#include <utils/FileMap.h>
+
+namespace android {
+
+class FileMapTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        mPageSize = sysconf(_SC_PAGESIZE);
+        mContents.resize(4 * mPageSize);
+        for (size_t i = 0; i < mContents.size(); i++) {
+            mContents[i] = 'a' + i % 26;
+        }
+        ASSERT_TRUE(base::WriteStringToFd(mContents, mFile.fd));
+    }
+
+    size_t mPageSize;
+    std::string mContents;
+    TemporaryFile mFile;
+};
+
+TEST_F(FileMapTest, Create) {
+    FileMap map;
+    ASSERT_TRUE(map.create("test", mFile.fd, 100, 1000, true));
+    ASSERT_STREQ("test", map.getFileName());
+    ASSERT_EQ(1000u, map.getDataLength());
+    ASSERT_EQ(100, map.getDataOffset());
+    ASSERT_EQ(0, memcmp(map.getDataPtr(), mContents.data() + 100, 1000));
+}
+
+TEST_F(FileMapTest, Prefault) {
+    FileMap map;
+    ASSERT_TRUE(map.create(NULL, mFile.fd, 0, mContents.size(), true,
+            FileMap::CREATE_PREFAULT));
+    ASSERT_EQ(static_cast<ssize_t>(mContents.size()), map.getResidentLength());
+
+    ASSERT_EQ(0, map.prefault(mPageSize + 1, mPageSize));
+    ASSERT_EQ(0, map.prefault(0, mContents.size()));
+    ASSERT_EQ(-1, map.prefault(1, mContents.size()));
+    ASSERT_EQ(-1, map.prefault(mContents.size() + 1, 0));
+
+    // The file was just written, so no page should have come from storage.
+    ASSERT_EQ(0u, map.getMajorFaults());
+}
+
+TEST_F(FileMapTest, Shared) {
+    FileMap* first = new FileMap();
+    FileMap second;
+    FileMap other;
+    ASSERT_TRUE(first->create(NULL, mFile.fd, 10, 100, true, FileMap::CREATE_SHARED));
+    ASSERT_TRUE(second.create(NULL, mFile.fd, 10, 100, true, FileMap::CREATE_SHARED));
+    ASSERT_TRUE(other.create(NULL, mFile.fd, 10, 100, false, FileMap::CREATE_SHARED));
+    ASSERT_EQ(first->getDataPtr(), second.getDataPtr());
+    ASSERT_NE(first->getDataPtr(), other.getDataPtr());
+
+    // The mapping outlives the first FileMap.
+    delete first;
+    ASSERT_EQ(0, memcmp(second.getDataPtr(), mContents.data() + 10, 100));
+
+    FileMap moved(std::move(second));
+    ASSERT_EQ(0, memcmp(moved.getDataPtr(), mContents.data() + 10, 100));
+}
+
+TEST_F(FileMapTest, SharedDifferentFiles) {
+    TemporaryFile file;
+    ASSERT_TRUE(base::WriteStringToFd(mContents, file.fd));
+
+    FileMap first;
+    FileMap second;
+    ASSERT_TRUE(first.create(NULL, mFile.fd, 0, 100, true, FileMap::CREATE_SHARED));
+    ASSERT_TRUE(second.create(NULL, file.fd, 0, 100, true, FileMap::CREATE_SHARED));
+    ASSERT_NE(first.getDataPtr(), second.getDataPtr());
+}
+
+} // namespace android
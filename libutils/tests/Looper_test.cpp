@@ -690,4 +690,70 @@ TEST_F(LooperTest, RemoveMessage_WhenRemovingSomeMessagesForHandler_ShouldRemove
             << "no more messages to handle";
 }
 
+TEST_F(LooperTest, SendMessageAtTime_WhenSentOutOfOrder_ShouldInvokeHandlersInTimeOrder) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    mLooper->sendMessageAtTime(now + ms2ns(30), handler, Message(MSG_TEST1));
+    mLooper->sendMessageAtTime(now + ms2ns(10), handler, Message(MSG_TEST2));
+    mLooper->sendMessageAtTime(now + ms2ns(10), handler, Message(MSG_TEST3));
+    mLooper->sendMessageAtTime(now + ms2ns(20), handler, Message(MSG_TEST4));
+
+    StopWatch stopWatch("pollOnce");
+    for (int i = 0; i < 10 && handler->messages.size() < 4; i++) {
+        mLooper->pollOnce(100);
+    }
+    int32_t elapsedMillis = ns2ms(stopWatch.elapsedTime());
+
+    EXPECT_NEAR(30, elapsedMillis, TIMING_TOLERANCE_MS)
+            << "last message should be handled around the time it was sent for";
+    ASSERT_EQ(size_t(4), handler->messages.size())
+            << "handled all messages";
+    EXPECT_EQ(MSG_TEST2, handler->messages[0].what)
+            << "messages sent for the same time should be handled in the order they were sent";
+    EXPECT_EQ(MSG_TEST3, handler->messages[1].what)
+            << "messages sent for the same time should be handled in the order they were sent";
+    EXPECT_EQ(MSG_TEST4, handler->messages[2].what)
+            << "messages should be handled in time order";
+    EXPECT_EQ(MSG_TEST1, handler->messages[3].what)
+            << "messages should be handled in time order";
+}
+
+TEST_F(LooperTest, AddFd_WhenFdIsReusedWhileOldFileIsStillOpen_ShouldIgnoreEventsOfOldFile) {
+    Pipe oldPipe;
+    StubCallbackHandler oldHandler(true);
+    oldHandler.setCallback(mLooper, oldPipe.receiveFd, Looper::EVENT_INPUT);
+
+    // Close the registered fd but keep its file open, so that the old file stays
+    // in the epoll set, and register a new file under the same fd.
+    int fd = oldPipe.receiveFd;
+    int oldFile = dup(fd);
+    Pipe newPipe;
+    dup2(newPipe.receiveFd, fd);
+    close(newPipe.receiveFd);
+    newPipe.receiveFd = fd;
+    oldPipe.receiveFd = oldFile;
+
+    StubCallbackHandler newHandler(true);
+    newHandler.setCallback(mLooper, fd, Looper::EVENT_INPUT);
+
+    oldPipe.writeSignal();
+    mLooper->pollOnce(0);
+    mLooper->pollOnce(0);
+
+    EXPECT_EQ(0, oldHandler.callbackCount)
+            << "old callback should not be invoked once replaced";
+    EXPECT_EQ(0, newHandler.callbackCount)
+            << "new callback should not be invoked for events of the old file";
+
+    newPipe.writeSignal();
+    int result = mLooper->pollOnce(100);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because the new fd was signalled";
+    EXPECT_EQ(1, newHandler.callbackCount)
+            << "new callback should be invoked exactly once for the new file";
+    EXPECT_EQ(0, oldHandler.callbackCount)
+            << "old callback should not be invoked once replaced";
+}
+
 } // namespace android
@@ -18,6 +18,7 @@
 
 #include <utils/StrongPointer.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 
 #include <thread>
 #include <atomic>
@@ -94,6 +95,41 @@ TEST(RefBase, WeakCopies) {
 // Set up a situation in which we race with visit2AndRremove() to delete
 // 2 strong references.  Bar destructor checks that there are no early
 // deletions and prior updates are visible to destructor.
+// Sampled objects track their references, which must follow sp<> and wp<>
+// as Vector moves them, and keep the counts the same as untracked objects.
+TEST(RefBase, SampledTracking) {
+    RefBase::setTrackingSamplePeriod(2);
+    bool isDeleted[8];
+    {
+        Vector<sp<Foo>> strongs;
+        Vector<wp<Foo>> weaks;
+        for (size_t i = 0; i < 8; ++i) {
+            sp<Foo> foo(new Foo(&isDeleted[i]));
+            // Insert at the front, so that Vector moves the existing entries.
+            strongs.insertAt(foo, 0);
+            weaks.insertAt(wp<Foo>(foo), 0);
+            ASSERT_EQ(2, foo->getStrongCount());
+            ASSERT_EQ(3, foo->getWeakRefs()->getWeakCount());
+        }
+        for (size_t i = 0; i < 8; ++i) {
+            sp<Foo> promoted = weaks[i].promote();
+            ASSERT_TRUE(promoted != nullptr);
+            ASSERT_EQ(2, promoted->getStrongCount());
+        }
+        strongs.removeItemsAt(0, 4);
+        for (size_t i = 4; i < 8; ++i) {
+            ASSERT_TRUE(isDeleted[i]) << "sampled object was leaked!";
+        }
+        for (size_t i = 0; i < 4; ++i) {
+            ASSERT_FALSE(isDeleted[i]) << "deleted too early!";
+        }
+    }
+    RefBase::setTrackingSamplePeriod(0);
+    for (size_t i = 0; i < 8; ++i) {
+        ASSERT_TRUE(isDeleted[i]) << "sampled object was leaked!";
+    }
+}
+
 class Bar : public RefBase {
 public:
     Bar(std::atomic<int>* delete_count) : mVisited1(false), mVisited2(false),
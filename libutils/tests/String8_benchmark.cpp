@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <utils/String16.h>
+#include <utils/String8.h>
+
+namespace android {
+
+static const char kShort[] = "ro.hw";
+static const char kLong[] = "persist.sys.dalvik.vm.lib.2.long.property.name";
+
+// Each construction from characters allocates a SharedBuffer, except for the
+// empty string.
+static void BM_String8_construct(benchmark::State& state, const char* chars) {
+    while (state.KeepRunning()) {
+        String8 s(chars);
+        benchmark::DoNotOptimize(s.string());
+    }
+}
+BENCHMARK_CAPTURE(BM_String8_construct, empty, "");
+BENCHMARK_CAPTURE(BM_String8_construct, short, kShort);
+BENCHMARK_CAPTURE(BM_String8_construct, long, kLong);
+
+static void BM_String16_construct(benchmark::State& state, const char* chars) {
+    while (state.KeepRunning()) {
+        String16 s(chars);
+        benchmark::DoNotOptimize(s.string());
+    }
+}
+BENCHMARK_CAPTURE(BM_String16_construct, empty, "");
+BENCHMARK_CAPTURE(BM_String16_construct, short, kShort);
+
+// A copy shares the buffer of the original, at the price of two atomic
+// reference count updates.
+template <class S>
+static void BM_copy(benchmark::State& state) {
+    S src(kLong);
+    while (state.KeepRunning()) {
+        S dst(src);
+        benchmark::DoNotOptimize(dst.string());
+    }
+}
+BENCHMARK_TEMPLATE(BM_copy, String8);
+BENCHMARK_TEMPLATE(BM_copy, String16);
+
+// A move hands over the buffer, and leaves the shared empty string behind.
+template <class S>
+static void BM_move(benchmark::State& state) {
+    S a(kLong);
+    S b;
+    while (state.KeepRunning()) {
+        b = std::move(a);
+        a = std::move(b);
+        benchmark::DoNotOptimize(a.string());
+    }
+}
+BENCHMARK_TEMPLATE(BM_move, String8);
+BENCHMARK_TEMPLATE(BM_move, String16);
+
+// std::vector moves its elements when it grows, now that the move
+// constructor is noexcept.
+template <class S>
+static void BM_vector_grow(benchmark::State& state) {
+    S src(kShort);
+    while (state.KeepRunning()) {
+        std::vector<S> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.push_back(src);
+        }
+        benchmark::DoNotOptimize(v.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_vector_grow, String8)->Arg(16)->Arg(1024);
+BENCHMARK_TEMPLATE(BM_vector_grow, String16)->Arg(16)->Arg(1024);
+
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -96,4 +96,39 @@ TEST_F(String8Test, CheckUtf32Conversion) {
     EXPECT_EQ(10U, string8.length());
 }
 
+TEST_F(String8Test, Move) {
+    String8 src("Hello, world!");
+    const char* data = src.string();
+
+    String8 dst(std::move(src));
+    EXPECT_EQ(data, dst.string());
+    EXPECT_STREQ("", src.string());
+    EXPECT_EQ(0U, src.length());
+
+    String8 other("Goodbye");
+    other = std::move(dst);
+    EXPECT_EQ(data, other.string());
+
+    other = std::move(other);
+    EXPECT_STREQ("Hello, world!", other.string());
+
+    // A moved-from string can be used again.
+    src.append("again");
+    EXPECT_STREQ("again", src.string());
+}
+
+TEST_F(String8Test, String16Move) {
+    String16 src("Hello, world!");
+    const char16_t* data = src.string();
+
+    String16 dst(std::move(src));
+    EXPECT_EQ(data, dst.string());
+    EXPECT_EQ(0U, src.size());
+
+    String16 other("Goodbye");
+    other = std::move(dst);
+    EXPECT_EQ(data, other.string());
+    EXPECT_EQ(String16("Hello, world!"), other);
+}
+
 }
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+
+#include <gtest/gtest.h>
+#include <utils/ThreadPool.h>
+
+namespace android {
+
+class CountingTask : public ThreadPool::Task {
+public:
+    explicit CountingTask(std::atomic<int>* count) : mCount(count) { }
+
+    virtual void run() {
+        (*mCount)++;
+    }
+
+private:
+    std::atomic<int>* mCount;
+};
+
+// Posts |depth| levels of two tasks each from within the pool.
+class ForkingTask : public ThreadPool::Task {
+public:
+    ForkingTask(ThreadPool* pool, int depth, std::atomic<int>* count) :
+            mPool(pool), mDepth(depth), mCount(count) { }
+
+    virtual void run() {
+        (*mCount)++;
+        if (mDepth > 0) {
+            EXPECT_EQ(NO_ERROR, mPool->post(new ForkingTask(mPool, mDepth - 1, mCount)));
+            EXPECT_EQ(NO_ERROR, mPool->post(new ForkingTask(mPool, mDepth - 1, mCount)));
+        }
+    }
+
+private:
+    // Not an sp<>, which could make a worker drop the last reference.
+    ThreadPool* mPool;
+    int mDepth;
+    std::atomic<int>* mCount;
+};
+
+class CompletionHandler : public MessageHandler {
+public:
+    CompletionHandler() : what(-1) { }
+
+    virtual void handleMessage(const Message& message) {
+        what = message.what;
+    }
+
+    int what;
+};
+
+TEST(ThreadPoolTest, RunsAllTasks) {
+    sp<ThreadPool> pool = new ThreadPool("test", 4);
+    ASSERT_EQ(4u, pool->getThreadCount());
+    ASSERT_EQ(NO_ERROR, pool->start());
+    ASSERT_EQ(INVALID_OPERATION, pool->start());
+
+    std::atomic<int> count(0);
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_EQ(NO_ERROR, pool->post(new CountingTask(&count)));
+    }
+    pool->waitForIdle();
+    EXPECT_EQ(1000, count);
+}
+
+TEST(ThreadPoolTest, DefaultsToOneThreadPerCpu) {
+    sp<ThreadPool> pool = new ThreadPool("test");
+    EXPECT_EQ(static_cast<size_t>(sysconf(_SC_NPROCESSORS_ONLN)), pool->getThreadCount());
+}
+
+TEST(ThreadPoolTest, TasksPostedBeforeStart) {
+    sp<ThreadPool> pool = new ThreadPool("test", 2);
+    std::atomic<int> count(0);
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(NO_ERROR, pool->post(new CountingTask(&count)));
+    }
+    EXPECT_EQ(0, count);
+
+    ASSERT_EQ(NO_ERROR, pool->start());
+    pool->waitForIdle();
+    EXPECT_EQ(10, count);
+}
+
+TEST(ThreadPoolTest, TasksPostedFromWorkers) {
+    sp<ThreadPool> pool = new ThreadPool("test", 4);
+    ASSERT_EQ(NO_ERROR, pool->start());
+
+    std::atomic<int> count(0);
+    ASSERT_EQ(NO_ERROR, pool->post(new ForkingTask(pool.get(), 10, &count)));
+    pool->waitForIdle();
+    EXPECT_EQ((1 << 11) - 1, count);
+}
+
+TEST(ThreadPoolTest, ShutdownRunsQueuedTasks) {
+    sp<ThreadPool> pool = new ThreadPool("test", 1);
+    std::atomic<int> count(0);
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(NO_ERROR, pool->post(new CountingTask(&count)));
+    }
+    ASSERT_EQ(NO_ERROR, pool->start());
+    pool->shutdown();
+    EXPECT_EQ(100, count);
+
+    EXPECT_EQ(INVALID_OPERATION, pool->post(new CountingTask(&count)));
+    EXPECT_EQ(INVALID_OPERATION, pool->start());
+    pool->waitForIdle();
+    EXPECT_EQ(100, count);
+}
+
+TEST(ThreadPoolTest, ShutdownWithoutStart) {
+    sp<ThreadPool> pool = new ThreadPool("test", 2);
+    std::atomic<int> count(0);
+    ASSERT_EQ(NO_ERROR, pool->post(new CountingTask(&count)));
+    pool->shutdown();
+    EXPECT_EQ(0, count);
+}
+
+TEST(ThreadPoolTest, PostNull) {
+    sp<ThreadPool> pool = new ThreadPool("test", 1);
+    EXPECT_EQ(BAD_VALUE, pool->post(NULL));
+}
+
+TEST(ThreadPoolTest, PostWithCompletionMessage) {
+    sp<ThreadPool> pool = new ThreadPool("test", 2);
+    ASSERT_EQ(NO_ERROR, pool->start());
+    sp<Looper> looper = new Looper(true);
+    sp<CompletionHandler> handler = new CompletionHandler();
+
+    std::atomic<int> count(0);
+    ASSERT_EQ(NO_ERROR, pool->post(new CountingTask(&count), looper, handler, Message(42)));
+    EXPECT_EQ(Looper::POLL_CALLBACK, looper->pollOnce(5000));
+    EXPECT_EQ(1, count);
+    EXPECT_EQ(42, handler->what);
+}
+
+} // namespace android
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <utils/Tokenizer.h>
+
+namespace android {
+
+static const char kWhitespace[] = " \t\r";
+
+class TokenizerTest : public testing::Test {
+protected:
+    virtual void TearDown() {
+        delete mTokenizer;
+    }
+
+    void fromContents(const char* contents) {
+        ASSERT_EQ(OK, Tokenizer::fromContents(String8("test.kl"), contents, &mTokenizer));
+    }
+
+    Tokenizer* mTokenizer = NULL;
+};
+
+TEST_F(TokenizerTest, Tokens) {
+    fromContents("key 1   Q\n\tkey 2 W\n");
+
+    EXPECT_STREQ("key", mTokenizer->nextToken(kWhitespace).string());
+    mTokenizer->skipDelimiters(kWhitespace);
+    EXPECT_EQ("1", mTokenizer->nextTokenView(kWhitespace));
+    mTokenizer->skipDelimiters(kWhitespace);
+    EXPECT_EQ("Q", mTokenizer->nextTokenView(kWhitespace));
+    EXPECT_TRUE(mTokenizer->isEol());
+    EXPECT_EQ("", mTokenizer->nextTokenView(kWhitespace));
+    EXPECT_STREQ("test.kl:1", mTokenizer->getLocation().string());
+
+    mTokenizer->nextLine();
+    EXPECT_EQ(2, mTokenizer->getLineNumber());
+    mTokenizer->skipDelimiters(kWhitespace);
+    EXPECT_EQ("key 2 W", mTokenizer->peekRemainderOfLineView());
+    EXPECT_STREQ("key 2 W", mTokenizer->peekRemainderOfLine().string());
+    EXPECT_EQ("key", mTokenizer->nextTokenView(kWhitespace));
+
+    mTokenizer->nextLine();
+    EXPECT_TRUE(mTokenizer->isEof());
+    EXPECT_EQ(3, mTokenizer->getLineNumber());
+    mTokenizer->nextLine();
+    EXPECT_EQ(3, mTokenizer->getLineNumber());
+    EXPECT_EQ("", mTokenizer->peekRemainderOfLineView());
+}
+
+TEST_F(TokenizerTest, NewlineIsNeverSkipped) {
+    fromContents(" \n x");
+
+    mTokenizer->skipDelimiters(" \n");
+    EXPECT_TRUE(mTokenizer->isEol());
+    EXPECT_EQ('\n', mTokenizer->peekChar());
+}
+
+TEST_F(TokenizerTest, NoTrailingNewline) {
+    fromContents("last token");
+
+    EXPECT_EQ("last", mTokenizer->nextTokenView(kWhitespace));
+    mTokenizer->skipDelimiters(kWhitespace);
+    EXPECT_EQ("token", mTokenizer->nextTokenView(kWhitespace));
+    EXPECT_TRUE(mTokenizer->isEof());
+    mTokenizer->nextLine();
+    EXPECT_TRUE(mTokenizer->isEof());
+    EXPECT_EQ(1, mTokenizer->getLineNumber());
+}
+
+TEST_F(TokenizerTest, HighBitCharacters) {
+    fromContents("caf\xc3\xa9\xff" "end");
+
+    EXPECT_EQ("caf\xc3\xa9", mTokenizer->nextTokenView("\xff"));
+    EXPECT_EQ('\xff', mTokenizer->nextChar());
+    EXPECT_EQ("end", mTokenizer->nextTokenView(kWhitespace));
+}
+
+} // namespace android
@@ -18,6 +18,9 @@
 #include <utils/Log.h>
 #include <utils/Unicode.h>
 
+#include <string>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 namespace android {
@@ -158,4 +161,57 @@ TEST_F(UnicodeTest, InvalidUtf8OverreadDetected) {
             true /* overreadIsFatal */), "" /* regex for ASSERT_DEATH */);
 }
 
+// The ASCII runs are converted a word at a time, check every position of a
+// multibyte character in and around them, with exact sized buffers.
+TEST_F(UnicodeTest, AsciiRunsAroundMultibyte) {
+    // U+00E9, U+2323 and U+1F600, which is a surrogate pair in UTF-16.
+    const char* const kMultibyte[] = { "\xc3\xa9", "\xe2\x8c\xa3", "\xf0\x9f\x98\x80" };
+    const size_t kUtf16Units[] = { 1, 1, 2 };
+
+    for (size_t m = 0; m < 3; m++) {
+        for (size_t before = 0; before < 20; before++) {
+            for (size_t after = 0; after < 20; after += 7) {
+                std::string utf8 = std::string(before, 'a') + kMultibyte[m] +
+                        std::string(after, 'z');
+                SCOPED_TRACE(utf8);
+
+                std::string ascii(before + after, 'a');
+                EXPECT_EQ((ssize_t)ascii.size(), utf8_length(ascii.c_str()));
+
+                const uint8_t* u8 = reinterpret_cast<const uint8_t*>(utf8.data());
+                ssize_t u16len = utf8_to_utf16_length(u8, utf8.size());
+                ASSERT_EQ((ssize_t)(before + kUtf16Units[m] + after), u16len);
+
+                std::vector<char16_t> utf16(u16len + 1);
+                char16_t* end = utf8_to_utf16(u8, utf8.size(), utf16.data(), utf16.size());
+                EXPECT_EQ(utf16.data() + u16len, end);
+                if (before > 0) {
+                    EXPECT_EQ(u'a', utf16[0]);
+                }
+                if (after > 0) {
+                    EXPECT_EQ(u'z', utf16[u16len - 1]);
+                }
+
+                ASSERT_EQ((ssize_t)utf8.size(), utf16_to_utf8_length(utf16.data(), u16len));
+                std::vector<char> back(utf8.size() + 1);
+                utf16_to_utf8(utf16.data(), u16len, back.data(), back.size());
+                EXPECT_STREQ(utf8.c_str(), back.data());
+            }
+        }
+    }
+}
+
+TEST_F(UnicodeTest, AsciiRunsTruncatedOutput) {
+    const uint8_t utf8[] = "0123456789abcdef0123";
+    for (size_t dstLen = 1; dstLen < sizeof(utf8); dstLen++) {
+        char16_t utf16[sizeof(utf8)] = {};
+        char16_t* end = utf8_to_utf16_no_null_terminator(utf8, sizeof(utf8) - 1, utf16, dstLen);
+        ASSERT_EQ(utf16 + dstLen, end);
+        EXPECT_EQ(0, utf16[dstLen]);
+        for (size_t i = 0; i < dstLen; i++) {
+            EXPECT_EQ(utf8[i], utf16[i]);
+        }
+    }
+}
+
 }
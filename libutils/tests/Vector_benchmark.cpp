@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+static const char kItem[] = "persist.sys.dalvik.vm.lib.2";
+
+// Appending reallocates geometrically; for String8, which is trivially
+// movable, each reallocation moves the items with realloc() instead of
+// copying and destroying them.
+static void BM_Vector_push_back_int(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        Vector<int> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.push_back(i);
+        }
+        benchmark::DoNotOptimize(v.array());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector_push_back_int)->Arg(16)->Arg(1024);
+
+static void BM_std_vector_push_back_int(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        std::vector<int> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.push_back(i);
+        }
+        benchmark::DoNotOptimize(v.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_std_vector_push_back_int)->Arg(16)->Arg(1024);
+
+static void BM_Vector_push_back_String8(benchmark::State& state) {
+    const String8 item(kItem);
+    while (state.KeepRunning()) {
+        Vector<String8> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.push_back(item);
+        }
+        benchmark::DoNotOptimize(v.array());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector_push_back_String8)->Arg(16)->Arg(1024);
+
+static void BM_std_vector_push_back_string(benchmark::State& state) {
+    const std::string item(kItem);
+    while (state.KeepRunning()) {
+        std::vector<std::string> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.push_back(item);
+        }
+        benchmark::DoNotOptimize(v.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_std_vector_push_back_string)->Arg(16)->Arg(1024);
+
+// Inserting at the front moves every item already there.
+static void BM_Vector_insert_front_String8(benchmark::State& state) {
+    const String8 item(kItem);
+    while (state.KeepRunning()) {
+        Vector<String8> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.push_front(item);
+        }
+        benchmark::DoNotOptimize(v.array());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector_insert_front_String8)->Arg(16)->Arg(1024);
+
+static void BM_std_vector_insert_front_string(benchmark::State& state) {
+    const std::string item(kItem);
+    while (state.KeepRunning()) {
+        std::vector<std::string> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.insert(v.begin(), item);
+        }
+        benchmark::DoNotOptimize(v.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_std_vector_insert_front_string)->Arg(16)->Arg(1024);
+
+// With a reserved capacity, the vector neither grows nor shrinks as it is
+// filled and emptied again.
+static void BM_Vector_fill_and_drain_reserved(benchmark::State& state) {
+    const String8 item(kItem);
+    Vector<String8> v;
+    v.reserve(state.range(0));
+    while (state.KeepRunning()) {
+        for (int i = 0; i < state.range(0); i++) {
+            v.push_back(item);
+        }
+        while (!v.empty()) {
+            v.pop();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vector_fill_and_drain_reserved)->Arg(16)->Arg(1024);
+
+static void BM_std_vector_fill_and_drain_reserved(benchmark::State& state) {
+    const std::string item(kItem);
+    std::vector<std::string> v;
+    v.reserve(state.range(0));
+    while (state.KeepRunning()) {
+        for (int i = 0; i < state.range(0); i++) {
+            v.push_back(item);
+        }
+        while (!v.empty()) {
+            v.pop_back();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_std_vector_fill_and_drain_reserved)->Arg(16)->Arg(1024);
+
+}  // namespace android
+
+BENCHMARK_MAIN();
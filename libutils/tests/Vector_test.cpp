@@ -22,6 +22,7 @@
 
 #include <android/log.h>
 #include <gtest/gtest.h>
+#include <utils/String8.h>
 #include <utils/Vector.h>
 
 namespace android {
@@ -92,6 +93,58 @@ TEST_F(VectorTest, SetCapacity_ShrinkBelowSize) {
   ASSERT_EQ(8U, vector.capacity());
 }
 
+TEST_F(VectorTest, SetCapacity_KeptOnRemove) {
+  Vector<int> vector;
+  vector.setCapacity(64);
+  for (int i = 0; i < 40; ++i) {
+    vector.add(i);
+  }
+  vector.removeItemsAt(1, 39);
+  ASSERT_EQ(1U, vector.size());
+  ASSERT_EQ(64U, vector.capacity());
+
+  // Copy-on-write keeps it too.
+  Vector<int> other = vector;
+  other.editArray();
+  other.removeAt(0);
+  ASSERT_EQ(64U, other.capacity());
+
+  // Without it, the vector shrinks.
+  Vector<int> unreserved;
+  for (int i = 0; i < 40; ++i) {
+    unreserved.add(i);
+  }
+  unreserved.removeItemsAt(1, 39);
+  ASSERT_GT(64U, unreserved.capacity());
+}
+
+TEST_F(VectorTest, TrivialMove_InsertAndRemove) {
+  Vector<String8> vector;
+  for (int i = 0; i < 16; ++i) {
+    vector.add(String8::format("%d", i));
+  }
+  // Grows the storage with a gap in the middle, while the copy shares it.
+  Vector<String8> copy = vector;
+  vector.insertAt(String8("x"), 4, 100);
+  ASSERT_EQ(116U, vector.size());
+  ASSERT_EQ(16U, copy.size());
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_STREQ(String8::format("%d", i).string(), copy[i].string());
+  }
+  EXPECT_STREQ("3", vector[3].string());
+  EXPECT_STREQ("x", vector[4].string());
+  EXPECT_STREQ("x", vector[103].string());
+  EXPECT_STREQ("4", vector[104].string());
+
+  // Shrinks the storage, closing the gap.
+  copy.clear();
+  vector.removeItemsAt(4, 100);
+  ASSERT_EQ(16U, vector.size());
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_STREQ(String8::format("%d", i).string(), vector[i].string());
+  }
+}
+
 TEST_F(VectorTest, _grow_OverflowSize) {
   Vector<int> vector;
   vector.add(1);
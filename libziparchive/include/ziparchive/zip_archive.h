@@ -25,6 +25,7 @@
 #include <sys/cdefs.h>
 #include <sys/types.h>
 #include <utils/Compat.h>
+#include <utils/FileMap.h>
 
 /* Zip compression methods we support */
 enum {
@@ -137,6 +138,26 @@ int32_t OpenArchiveFd(const int fd, const char* debugFileName, ZipArchiveHandle*
 
 int32_t OpenArchiveFromMemory(void* address, size_t length, const char* debugFileName,
                               ZipArchiveHandle* handle);
+
+/*
+ * Like OpenArchive, but first tries to build the table of entries from
+ * the index file at |indexFileName|, written earlier by WriteArchiveIndex
+ * for the same archive. This avoids hashing every entry name on open.
+ * If the index is missing, malformed or doesn't match the archive's
+ * central directory, the archive is scanned as usual.
+ *
+ * Returns 0 on success, and negative values on failure.
+ */
+int32_t OpenArchiveWithIndex(const char* fileName, const char* indexFileName,
+                             ZipArchiveHandle* handle);
+
+/*
+ * Writes a lookup index for the open archive |handle| to |fd|, for use
+ * with OpenArchiveWithIndex.
+ *
+ * Returns 0 on success, and negative values on failure.
+ */
+int32_t WriteArchiveIndex(const ZipArchiveHandle handle, int fd);
 /*
  * Close archive, releasing resources associated with it. This will
  * unmap the central directory of the zipfile and free all internal
@@ -215,6 +236,18 @@ int32_t ExtractEntryToFile(ZipArchiveHandle handle, ZipEntry* entry, int fd);
  */
 int32_t ExtractToMemory(ZipArchiveHandle handle, ZipEntry* entry, uint8_t* begin, uint32_t size);
 
+/*
+ * Maps the data of the stored (uncompressed) entry |entry| read-only,
+ * straight from the archive file, so it can be used without being copied.
+ * |advice| is applied to the mapping with madvise (failures are ignored).
+ * The caller owns the returned map.
+ *
+ * Returns nullptr if the entry is compressed or empty, if the archive
+ * was opened from memory, or if the mapping fails.
+ */
+android::FileMap* MapStoredEntry(ZipArchiveHandle handle, const ZipEntry* entry,
+                                 android::FileMap::MapAdvice advice = android::FileMap::NORMAL);
+
 int GetFileDescriptor(const ZipArchiveHandle handle);
 
 const char* ErrorCodeString(int32_t error_code);
@@ -228,6 +261,18 @@ typedef bool (*ProcessZipEntryFunction)(const uint8_t* buf, size_t buf_size, voi
  */
 int32_t ProcessZipEntryContents(ZipArchiveHandle handle, ZipEntry* entry,
                                 ProcessZipEntryFunction func, void* cookie);
+
+/*
+ * Uncompress |count| entries, writing entries[i] to fds[i] as
+ * ExtractEntryToFile would, using up to |num_threads| threads (0 means
+ * one per CPU). Entries are processed in order of their offset in the
+ * archive. All entries are attempted even if some fail.
+ *
+ * Returns 0 if every entry was extracted, otherwise the error code of the
+ * first failing entry in |entries|.
+ */
+int32_t ExtractEntriesToFiles(ZipArchiveHandle handle, ZipEntry* entries, const int* fds,
+                              size_t count, size_t num_threads);
 #endif
 
 #endif  // LIBZIPARCHIVE_ZIPARCHIVE_H_
@@ -43,4 +43,40 @@ class ZipArchiveStreamEntry {
   uint32_t crc32_;
 };
 
+// Random access reads of the uncompressed contents of an entry.
+//
+// Deflated entries can't be decompressed from an arbitrary offset, so as an
+// entry is first inflated a restart checkpoint (the compressed position and
+// the preceding 32KB of output) is recorded at the first deflate block
+// boundary after every |checkpoint_interval| bytes. A later ReadAt resumes
+// from the nearest checkpoint at or before the requested offset instead of
+// from the start of the entry. Each checkpoint costs 32KB of memory.
+//
+// Data is read with positional reads, so several of these can be used at
+// once on the same archive. The CRC isn't verified.
+class ZipArchiveRandomAccessEntry {
+ public:
+  static constexpr uint32_t kDefaultCheckpointInterval = 1024 * 1024;
+
+  virtual ~ZipArchiveRandomAccessEntry() {}
+
+  // Reads up to |len| bytes at |offset| into |buf|. Returns the number of
+  // bytes read (0 at or past the end of the entry), or -1 on error.
+  virtual ssize_t ReadAt(uint8_t* buf, size_t len, uint32_t offset) = 0;
+
+  uint32_t Size() const { return size_; }
+
+  static ZipArchiveRandomAccessEntry* Create(
+      ZipArchiveHandle handle, const ZipEntry& entry,
+      uint32_t checkpoint_interval = kDefaultCheckpointInterval);
+
+ protected:
+  ZipArchiveRandomAccessEntry(ZipArchiveHandle handle, const ZipEntry& entry)
+      : handle_(handle), data_offset_(entry.offset), size_(entry.uncompressed_length) {}
+
+  ZipArchiveHandle handle_;
+  const off64_t data_offset_;
+  const uint32_t size_;
+};
+
 #endif  // LIBZIPARCHIVE_ZIPARCHIVESTREAMENTRY_H_
@@ -96,6 +96,23 @@ class ZipWriter {
   // Move assignment.
   ZipWriter& operator=(ZipWriter&& zipWriter);
 
+  ~ZipWriter();
+
+  /**
+   * Switches the writer to compressing entries on |num_threads| background threads.
+   * The data for each entry is then buffered until FinishEntry(), compressed off the
+   * caller's thread and committed to the file in the order the entries were started.
+   * At most |max_pending_entries| finished entries are held in memory; FinishEntry()
+   * blocks until the oldest is committed once that many are outstanding.
+   *
+   * Errors committing an entry are reported by the FinishEntry(), GetLastEntry(),
+   * DiscardLastEntry() or Finish() call that commits it.
+   *
+   * Must be called before the first entry is started.
+   * Returns 0 on success, and an error value < 0 on failure.
+   */
+  int32_t SetCompressionThreads(size_t num_threads, size_t max_pending_entries);
+
   /**
    * Starts a new zip entry with the given path and flags.
    * Flags can be a bitwise OR of ZipWriter::kCompress and ZipWriter::kAlign.
@@ -166,6 +183,11 @@ class ZipWriter {
   int32_t CompressBytes(FileEntry* file, const void* data, size_t len);
   int32_t FlushCompressedBytes(FileEntry* file);
 
+  struct PendingEntry;
+  class CompressionPool;
+  int32_t CommitPendingEntries(size_t max_pending);
+  int32_t CommitEntry(PendingEntry* entry);
+
   enum class State {
     kWritingZip,
     kWritingEntry,
@@ -182,6 +204,11 @@ class ZipWriter {
 
   std::unique_ptr<z_stream, void (*)(z_stream*)> z_stream_;
   std::vector<uint8_t> buffer_;
+
+  // Only set after SetCompressionThreads().
+  std::unique_ptr<CompressionPool> pool_;
+  std::unique_ptr<PendingEntry> pending_entry_;
+  size_t max_pending_entries_;
 };
 
 #endif /* LIBZIPARCHIVE_ZIPWRITER_H_ */
@@ -27,10 +27,17 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include <android-base/file.h>
@@ -299,17 +306,13 @@ static int32_t MapCentralDirectory(const char* debug_file_name, ZipArchive* arch
  *
  * Returns 0 on success.
  */
-static int32_t ParseZipArchive(ZipArchive* archive) {
-  const uint8_t* const cd_ptr = archive->central_directory.GetBasePtr();
-  const size_t cd_length = archive->central_directory.GetMapLength();
-  const uint16_t num_entries = archive->num_entries;
-
+static int32_t AllocateHashTable(ZipArchive* archive) {
   /*
    * Create hash table.  We have a minimum 75% load factor, possibly as
    * low as 50% after we round off to a power of 2.  There must be at
    * least one unused entry to avoid an infinite loop during creation.
    */
-  archive->hash_table_size = RoundUpPower2(1 + (num_entries * 4) / 3);
+  archive->hash_table_size = RoundUpPower2(1 + (archive->num_entries * 4) / 3);
   archive->hash_table =
       reinterpret_cast<ZipString*>(calloc(archive->hash_table_size, sizeof(ZipString)));
   if (archive->hash_table == nullptr) {
@@ -317,6 +320,35 @@ static int32_t ParseZipArchive(ZipArchive* archive) {
           archive->hash_table_size, sizeof(ZipString));
     return -1;
   }
+  return 0;
+}
+
+static int32_t ValidateFirstLocalHeader(ZipArchive* archive) {
+  uint32_t lfh_start_bytes;
+  if (!archive->mapped_zip.ReadAtOffset(reinterpret_cast<uint8_t*>(&lfh_start_bytes),
+                                        sizeof(uint32_t), 0)) {
+    ALOGW("Zip: Unable to read header for entry at offset == 0.");
+    return -1;
+  }
+
+  if (lfh_start_bytes != LocalFileHeader::kSignature) {
+    ALOGW("Zip: Entry at offset zero has invalid LFH signature %" PRIx32, lfh_start_bytes);
+#if defined(__ANDROID__)
+    android_errorWriteLog(0x534e4554, "64211847");
+#endif
+    return -1;
+  }
+  return 0;
+}
+
+static int32_t ParseZipArchive(ZipArchive* archive) {
+  const uint8_t* const cd_ptr = archive->central_directory.GetBasePtr();
+  const size_t cd_length = archive->central_directory.GetMapLength();
+  const uint16_t num_entries = archive->num_entries;
+
+  if (AllocateHashTable(archive) != 0) {
+    return -1;
+  }
 
   /*
    * Walk through the central directory, adding entries to the hash
@@ -380,36 +412,218 @@ static int32_t ParseZipArchive(ZipArchive* archive) {
     }
   }
 
-  uint32_t lfh_start_bytes;
-  if (!archive->mapped_zip.ReadAtOffset(reinterpret_cast<uint8_t*>(&lfh_start_bytes),
-                                        sizeof(uint32_t), 0)) {
-    ALOGW("Zip: Unable to read header for entry at offset == 0.");
+  if (ValidateFirstLocalHeader(archive) != 0) {
     return -1;
   }
 
-  if (lfh_start_bytes != LocalFileHeader::kSignature) {
-    ALOGW("Zip: Entry at offset zero has invalid LFH signature %" PRIx32, lfh_start_bytes);
-#if defined(__ANDROID__)
-    android_errorWriteLog(0x534e4554, "64211847");
+  ALOGV("+++ zip good scan %" PRIu16 " entries", num_entries);
+
+  return 0;
+}
+
+static uint32_t CentralDirectoryCrc(const ZipArchive* archive) {
+  return crc32(0, archive->central_directory.GetBasePtr(),
+               archive->central_directory.GetMapLength());
+}
+
+/*
+ * Populates the hash table from an index previously written by
+ * WriteArchiveIndex, instead of hashing every name in the central
+ * directory. The index is only used if it was built from this exact
+ * central directory, and every slot is bounds checked before use.
+ *
+ * Returns true on success. On failure the archive is left as it was.
+ */
+static bool LoadArchiveIndex(ZipArchive* archive, const uint8_t* index, size_t index_length) {
+  if (index_length < sizeof(ArchiveIndexHeader)) {
+    return false;
+  }
+  ArchiveIndexHeader header;
+  memcpy(&header, index, sizeof(header));
+
+  const uint8_t* const cd_ptr = archive->central_directory.GetBasePtr();
+  const size_t cd_length = archive->central_directory.GetMapLength();
+  const uint32_t hash_table_size = RoundUpPower2(1 + (archive->num_entries * 4) / 3);
+  if (header.magic != ArchiveIndexHeader::kMagic ||
+      header.version != ArchiveIndexHeader::kVersion ||
+      header.cd_start_offset != archive->directory_offset || header.cd_size != cd_length ||
+      header.num_entries != archive->num_entries || header.hash_table_size != hash_table_size ||
+      index_length != sizeof(header) + hash_table_size * sizeof(uint32_t)) {
+    ALOGW("Zip: archive index doesn't match the archive");
+    return false;
+  }
+  if (header.cd_crc32 != CentralDirectoryCrc(archive)) {
+    ALOGW("Zip: archive index is stale");
+    return false;
+  }
+
+  if (AllocateHashTable(archive) != 0) {
+    return false;
+  }
+
+  const uint8_t* slots = index + sizeof(header);
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < hash_table_size; ++i) {
+    const uint32_t offset = get_unaligned<uint32_t>(slots + i * sizeof(uint32_t));
+    if (offset == ArchiveIndexHeader::kEmptySlot) {
+      continue;
+    }
+
+    if (cd_length < sizeof(CentralDirectoryRecord) ||
+        offset > cd_length - sizeof(CentralDirectoryRecord)) {
+      ALOGW("Zip: archive index has a bad slot %" PRIu32, i);
+      break;
+    }
+    const CentralDirectoryRecord* cdr =
+        reinterpret_cast<const CentralDirectoryRecord*>(cd_ptr + offset);
+    if (cdr->record_signature != CentralDirectoryRecord::kSignature ||
+        cdr->file_name_length > cd_length - sizeof(CentralDirectoryRecord) - offset) {
+      ALOGW("Zip: archive index has a bad slot %" PRIu32, i);
+      break;
+    }
+    archive->hash_table[i].name = cd_ptr + offset + sizeof(CentralDirectoryRecord);
+    archive->hash_table[i].name_length = cdr->file_name_length;
+    ++count;
+  }
+
+  if (count != archive->num_entries) {
+    free(archive->hash_table);
+    archive->hash_table = nullptr;
+    archive->hash_table_size = 0;
+    return false;
+  }
+  return true;
+}
+
+#if !defined(_WIN32)
+// Identifies a version of a file: if any of these change, its central
+// directory can't be assumed to be the same.
+typedef std::tuple<dev_t, ino_t, off64_t, int64_t, int64_t> ArchiveFileKey;
+
+static bool GetArchiveFileKey(int fd, ArchiveFileKey* key) {
+  struct stat sb;
+  if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode)) {
+    return false;
+  }
+#if defined(__APPLE__)
+  const struct timespec& mtime = sb.st_mtimespec;
+  const struct timespec& ctime = sb.st_ctimespec;
+#else
+  const struct timespec& mtime = sb.st_mtim;
+  const struct timespec& ctime = sb.st_ctim;
 #endif
-    return -1;
+  *key = ArchiveFileKey(sb.st_dev, sb.st_ino, sb.st_size,
+                        mtime.tv_sec * 1000000000LL + mtime.tv_nsec,
+                        ctime.tv_sec * 1000000000LL + ctime.tv_nsec);
+  return true;
+}
+
+static std::mutex g_shared_directories_lock;
+
+static std::map<ArchiveFileKey, std::weak_ptr<SharedCentralDirectory>>& SharedDirectories() {
+  // Intentionally leaked, so it outlives any handle closed during exit.
+  static auto* directories = new std::map<ArchiveFileKey, std::weak_ptr<SharedCentralDirectory>>;
+  return *directories;
+}
+
+/*
+ * Uses the central directory already parsed by another handle open on the
+ * same version of the same file, if there is one.
+ */
+static bool FindSharedDirectory(ZipArchive* archive, const ArchiveFileKey& key) {
+  std::lock_guard<std::mutex> guard(g_shared_directories_lock);
+  auto& directories = SharedDirectories();
+  auto it = directories.find(key);
+  if (it == directories.end()) {
+    return false;
+  }
+  std::shared_ptr<SharedCentralDirectory> shared = it->second.lock();
+  if (!shared) {
+    directories.erase(it);
+    return false;
   }
 
-  ALOGV("+++ zip good scan %" PRIu16 " entries", num_entries);
+  archive->directory_offset = shared->directory_offset;
+  archive->central_directory = shared->central_directory;
+  archive->num_entries = shared->num_entries;
+  archive->hash_table_size = shared->hash_table_size;
+  archive->hash_table = shared->hash_table;
+  archive->shared_directory = shared;
+  return true;
+}
 
-  return 0;
+/*
+ * Moves the central directory |archive| has just parsed into shared
+ * state for later opens of the same file to use.
+ */
+static void ShareDirectory(ZipArchive* archive, const ArchiveFileKey& key) {
+  std::shared_ptr<SharedCentralDirectory> shared = std::make_shared<SharedCentralDirectory>();
+  shared->directory_map = std::move(archive->directory_map);
+  archive->directory_map.reset(new android::FileMap());
+  shared->directory_offset = archive->directory_offset;
+  shared->central_directory = archive->central_directory;
+  shared->num_entries = archive->num_entries;
+  shared->hash_table_size = archive->hash_table_size;
+  shared->hash_table = archive->hash_table;
+  archive->shared_directory = shared;
+
+  std::lock_guard<std::mutex> guard(g_shared_directories_lock);
+  auto& directories = SharedDirectories();
+  for (auto it = directories.begin(); it != directories.end();) {
+    if (it->second.expired()) {
+      it = directories.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  directories[key] = shared;
 }
+#endif
 
-static int32_t OpenArchiveInternal(ZipArchive* archive, const char* debug_file_name) {
+static int32_t OpenArchiveInternal(ZipArchive* archive, const char* debug_file_name,
+                                   const char* index_file_name = nullptr) {
   int32_t result = -1;
+#if !defined(_WIN32)
+  ArchiveFileKey key;
+  const bool shareable = archive->mapped_zip.HasFd() &&
+                         GetArchiveFileKey(archive->mapped_zip.GetFileDescriptor(), &key);
+  if (shareable && FindSharedDirectory(archive, key)) {
+    return 0;
+  }
+#endif
+
   if ((result = MapCentralDirectory(debug_file_name, archive)) != 0) {
     return result;
   }
 
-  if ((result = ParseZipArchive(archive))) {
+  if (index_file_name != nullptr) {
+    const int index_fd = open(index_file_name, O_RDONLY | O_BINARY, 0);
+    struct stat sb;
+    if (index_fd != -1 && fstat(index_fd, &sb) == 0 && sb.st_size > 0) {
+      android::FileMap index_map;
+      const bool loaded =
+          index_map.create(index_file_name, index_fd, 0, sb.st_size, true /* read only */) &&
+          LoadArchiveIndex(archive, reinterpret_cast<const uint8_t*>(index_map.getDataPtr()),
+                           index_map.getDataLength());
+      close(index_fd);
+      if (loaded && (result = ValidateFirstLocalHeader(archive)) != 0) {
+        return result;
+      }
+    } else if (index_fd != -1) {
+      close(index_fd);
+    }
+  }
+
+  if (archive->hash_table == nullptr && (result = ParseZipArchive(archive))) {
     return result;
   }
 
+#if !defined(_WIN32)
+  if (shareable) {
+    ShareDirectory(archive, key);
+  }
+#endif
+
   return 0;
 }
 
@@ -440,6 +654,54 @@ int32_t OpenArchiveFromMemory(void* address, size_t length, const char* debug_fi
   return OpenArchiveInternal(archive, debug_file_name);
 }
 
+int32_t OpenArchiveWithIndex(const char* fileName, const char* indexFileName,
+                             ZipArchiveHandle* handle) {
+  const int fd = open(fileName, O_RDONLY | O_BINARY, 0);
+  ZipArchive* archive = new ZipArchive(fd, true);
+  *handle = archive;
+
+  if (fd < 0) {
+    ALOGW("Unable to open '%s': %s", fileName, strerror(errno));
+    return kIoError;
+  }
+
+  return OpenArchiveInternal(archive, fileName, indexFileName);
+}
+
+int32_t WriteArchiveIndex(const ZipArchiveHandle handle, int fd) {
+  const ZipArchive* archive = reinterpret_cast<const ZipArchive*>(handle);
+  if (archive == nullptr || archive->hash_table == nullptr) {
+    return kInvalidHandle;
+  }
+
+  ArchiveIndexHeader header;
+  header.magic = ArchiveIndexHeader::kMagic;
+  header.version = ArchiveIndexHeader::kVersion;
+  header.cd_start_offset = static_cast<uint32_t>(archive->directory_offset);
+  header.cd_size = static_cast<uint32_t>(archive->central_directory.GetMapLength());
+  header.cd_crc32 = CentralDirectoryCrc(archive);
+  header.num_entries = archive->num_entries;
+  header.hash_table_size = archive->hash_table_size;
+
+  std::vector<uint8_t> index(sizeof(header) + archive->hash_table_size * sizeof(uint32_t));
+  memcpy(index.data(), &header, sizeof(header));
+  const uint8_t* const cd_ptr = archive->central_directory.GetBasePtr();
+  for (uint32_t i = 0; i < archive->hash_table_size; ++i) {
+    uint32_t offset = ArchiveIndexHeader::kEmptySlot;
+    if (archive->hash_table[i].name != nullptr) {
+      offset = static_cast<uint32_t>(archive->hash_table[i].name - cd_ptr -
+                                     sizeof(CentralDirectoryRecord));
+    }
+    memcpy(&index[sizeof(header) + i * sizeof(uint32_t)], &offset, sizeof(offset));
+  }
+
+  if (!android::base::WriteFully(fd, index.data(), index.size())) {
+    ALOGW("Zip: failed to write archive index: %s", strerror(errno));
+    return kIoError;
+  }
+  return 0;
+}
+
 /*
  * Close a ZipArchive, closing the file and freeing the contents.
  */
@@ -449,9 +711,10 @@ void CloseArchive(ZipArchiveHandle handle) {
   delete archive;
 }
 
-static int32_t ValidateDataDescriptor(MappedZipFile& mapped_zip, ZipEntry* entry) {
+static int32_t ValidateDataDescriptor(MappedZipFile& mapped_zip, off64_t dd_offset,
+                                      ZipEntry* entry) {
   uint8_t ddBuf[sizeof(DataDescriptor) + sizeof(DataDescriptor::kOptSignature)];
-  if (!mapped_zip.ReadData(ddBuf, sizeof(ddBuf))) {
+  if (!mapped_zip.ReadAtOffset(ddBuf, sizeof(ddBuf), dd_offset)) {
     return kIoError;
   }
 
@@ -628,13 +891,17 @@ static int32_t FindEntry(const ZipArchive* archive, const int ent, ZipEntry* dat
 
 struct IterationHandle {
   uint32_t position;
+  // If |use_matches| is set, the hash_table slots whose names start with
+  // |prefix|, in hash table order, and |position| indexes into these.
+  bool use_matches;
+  std::vector<uint32_t> matches;
   // We're not using vector here because this code is used in the Windows SDK
   // where the STL is not available.
   ZipString prefix;
   ZipString suffix;
   ZipArchive* archive;
 
-  IterationHandle(const ZipString* in_prefix, const ZipString* in_suffix) {
+  IterationHandle(const ZipString* in_prefix, const ZipString* in_suffix) : use_matches(false) {
     if (in_prefix) {
       uint8_t* name_copy = new uint8_t[in_prefix->name_length];
       memcpy(name_copy, in_prefix->name, in_prefix->name_length);
@@ -661,6 +928,46 @@ struct IterationHandle {
   }
 };
 
+static bool NameLess(const ZipString& lhs, const ZipString& rhs) {
+  const int result = memcmp(lhs.name, rhs.name, std::min(lhs.name_length, rhs.name_length));
+  return result < 0 || (result == 0 && lhs.name_length < rhs.name_length);
+}
+
+/*
+ * Collects the hash table slots of every entry whose name starts with
+ * |prefix|, using (and building, the first time) the archive's sorted name
+ * index. The slots are returned in hash table order so prefix iteration
+ * visits entries in the same order as a full scan would.
+ */
+static void FindPrefixMatches(ZipArchive* archive, const ZipString& prefix,
+                              std::vector<uint32_t>* matches) {
+  std::lock_guard<std::mutex> guard(archive->sorted_names_lock);
+  const ZipString* hash_table = archive->hash_table;
+  std::vector<uint32_t>& sorted = archive->sorted_names;
+  if (sorted.empty()) {
+    sorted.reserve(archive->num_entries);
+    for (uint32_t i = 0; i < archive->hash_table_size; ++i) {
+      if (hash_table[i].name != nullptr) {
+        sorted.push_back(i);
+      }
+    }
+    std::sort(sorted.begin(), sorted.end(), [hash_table](uint32_t lhs, uint32_t rhs) {
+      return NameLess(hash_table[lhs], hash_table[rhs]);
+    });
+  }
+
+  // Every name starting with |prefix| sorts at or after it, and they're
+  // all contiguous.
+  auto it = std::lower_bound(sorted.begin(), sorted.end(), prefix,
+                             [hash_table](uint32_t slot, const ZipString& value) {
+                               return NameLess(hash_table[slot], value);
+                             });
+  for (; it != sorted.end() && hash_table[*it].StartsWith(prefix); ++it) {
+    matches->push_back(*it);
+  }
+  std::sort(matches->begin(), matches->end());
+}
+
 int32_t StartIteration(ZipArchiveHandle handle, void** cookie_ptr, const ZipString* optional_prefix,
                        const ZipString* optional_suffix) {
   ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle);
@@ -673,6 +980,10 @@ int32_t StartIteration(ZipArchiveHandle handle, void** cookie_ptr, const ZipStri
   IterationHandle* cookie = new IterationHandle(optional_prefix, optional_suffix);
   cookie->position = 0;
   cookie->archive = archive;
+  if (cookie->prefix.name_length != 0) {
+    FindPrefixMatches(archive, cookie->prefix, &cookie->matches);
+    cookie->use_matches = true;
+  }
 
   *cookie_ptr = cookie;
   return 0;
@@ -715,6 +1026,26 @@ int32_t Next(void* cookie, ZipEntry* data, ZipString* name) {
   const uint32_t hash_table_length = archive->hash_table_size;
   const ZipString* hash_table = archive->hash_table;
 
+  if (handle->use_matches) {
+    const std::vector<uint32_t>& matches = handle->matches;
+    for (uint32_t i = currentOffset; i < matches.size(); ++i) {
+      const uint32_t ent = matches[i];
+      if (handle->suffix.name_length == 0 || hash_table[ent].EndsWith(handle->suffix)) {
+        handle->position = (i + 1);
+        const int error = FindEntry(archive, ent, data);
+        if (!error) {
+          name->name = hash_table[ent].name;
+          name->name_length = hash_table[ent].name_length;
+        }
+
+        return error;
+      }
+    }
+
+    handle->position = 0;
+    return kIterationEnd;
+  }
+
   for (uint32_t i = currentOffset; i < hash_table_length; ++i) {
     if (hash_table[i].name != NULL &&
         (handle->prefix.name_length == 0 || hash_table[i].StartsWith(handle->prefix)) &&
@@ -737,6 +1068,11 @@ int32_t Next(void* cookie, ZipEntry* data, ZipString* name) {
 class Writer {
  public:
   virtual bool Append(uint8_t* buf, size_t buf_size) = 0;
+
+  // Returns a region of |*size| bytes that the entry can be written to in
+  // place of calling Append, or nullptr if the writer has no such region.
+  virtual uint8_t* GetBuffer(size_t* /* size */) { return nullptr; }
+
   virtual ~Writer() {}
 
  protected:
@@ -765,6 +1101,14 @@ class MemoryWriter : public Writer {
     return true;
   }
 
+  virtual uint8_t* GetBuffer(size_t* size) override {
+    if (bytes_written_ != 0) {
+      return nullptr;
+    }
+    *size = size_;
+    return buf_;
+  }
+
  private:
   uint8_t* const buf_;
   const size_t size_;
@@ -865,11 +1209,38 @@ static inline int zlib_inflateInit2(z_stream* stream, int window_bits) {
 }
 #pragma GCC diagnostic pop
 
+// Buffers are sized to the entry being extracted, within these bounds:
+// small entries don't pay for large allocations and large entries are
+// read and written in fewer, bigger chunks.
+static constexpr size_t kMinBufSize = 4096;
+static constexpr size_t kMaxBufSize = 128 * 1024;
+// Direct reads into a writer's buffer need no copy, so can be larger.
+static constexpr size_t kMaxDirectReadSize = 1024 * 1024;
+
+static size_t BufferSizeFor(uint32_t length) {
+  return std::min(std::max(static_cast<size_t>(length), kMinBufSize), kMaxBufSize);
+}
+
+// All reads are positional (starting at |*data_offset|, which is advanced past
+// the compressed data), so this can run concurrently on the same archive.
 static int32_t InflateEntryToWriter(MappedZipFile& mapped_zip, const ZipEntry* entry,
-                                    Writer* writer, uint64_t* crc_out) {
-  const size_t kBufSize = 32768;
-  std::vector<uint8_t> read_buf(kBufSize);
-  std::vector<uint8_t> write_buf(kBufSize);
+                                    off64_t* data_offset, Writer* writer, uint64_t* crc_out) {
+  const uint32_t uncompressed_length = entry->uncompressed_length;
+
+  // If the writer can take the whole entry at once, inflate straight into it
+  // rather than going through write_buf.
+  size_t direct_size = 0;
+  uint8_t* direct_buf = writer->GetBuffer(&direct_size);
+  if (direct_buf != nullptr && direct_size < uncompressed_length) {
+    direct_buf = nullptr;
+  }
+
+  const size_t kReadBufSize = BufferSizeFor(entry->compressed_length);
+  const size_t kWriteBufSize = BufferSizeFor(uncompressed_length);
+  std::vector<uint8_t> read_buf(kReadBufSize);
+  std::vector<uint8_t> write_buf(direct_buf == nullptr ? kWriteBufSize : 0);
+  uint8_t* const out_start = (direct_buf == nullptr) ? write_buf.data() : direct_buf;
+  const size_t out_size = (direct_buf == nullptr) ? kWriteBufSize : direct_size;
   z_stream zstream;
   int zerr;
 
@@ -882,8 +1253,8 @@ static int32_t InflateEntryToWriter(MappedZipFile& mapped_zip, const ZipEntry* e
   zstream.opaque = Z_NULL;
   zstream.next_in = NULL;
   zstream.avail_in = 0;
-  zstream.next_out = &write_buf[0];
-  zstream.avail_out = kBufSize;
+  zstream.next_out = out_start;
+  zstream.avail_out = out_size;
   zstream.data_type = Z_UNKNOWN;
 
   /*
@@ -907,19 +1278,20 @@ static int32_t InflateEntryToWriter(MappedZipFile& mapped_zip, const ZipEntry* e
 
   std::unique_ptr<z_stream, decltype(zstream_deleter)> zstream_guard(&zstream, zstream_deleter);
 
-  const uint32_t uncompressed_length = entry->uncompressed_length;
-
   uint64_t crc = 0;
+  size_t crc_pos = 0;
   uint32_t compressed_length = entry->compressed_length;
   do {
     /* read as much as we can */
     if (zstream.avail_in == 0) {
-      const size_t getSize = (compressed_length > kBufSize) ? kBufSize : compressed_length;
-      if (!mapped_zip.ReadData(read_buf.data(), getSize)) {
+      const size_t getSize = (compressed_length > kReadBufSize) ? kReadBufSize : compressed_length;
+      if (!mapped_zip.ReadAtOffset(read_buf.data(), getSize, *data_offset)) {
         ALOGW("Zip: inflate read failed, getSize = %zu: %s", getSize, strerror(errno));
         return kIoError;
       }
 
+      *data_offset += getSize;
+
       compressed_length -= getSize;
 
       zstream.next_in = &read_buf[0];
@@ -928,24 +1300,33 @@ static int32_t InflateEntryToWriter(MappedZipFile& mapped_zip, const ZipEntry* e
 
     /* uncompress the data */
     zerr = inflate(&zstream, Z_NO_FLUSH);
+    if (zerr == Z_BUF_ERROR && direct_buf != nullptr && zstream.avail_out == 0) {
+      // The file might have declared a bogus length.
+      return kInconsistentInformation;
+    }
     if (zerr != Z_OK && zerr != Z_STREAM_END) {
       ALOGW("Zip: inflate zerr=%d (nIn=%p aIn=%u nOut=%p aOut=%u)", zerr, zstream.next_in,
             zstream.avail_in, zstream.next_out, zstream.avail_out);
       return kZlibError;
     }
 
-    /* write when we're full or when we're done */
-    if (zstream.avail_out == 0 || (zerr == Z_STREAM_END && zstream.avail_out != kBufSize)) {
-      const size_t write_size = zstream.next_out - &write_buf[0];
-      if (!writer->Append(&write_buf[0], write_size)) {
+    if (direct_buf != nullptr) {
+      // Checksum the output as it's produced, while it's still in cache.
+      crc = crc32(crc, out_start + crc_pos, (zstream.next_out - out_start) - crc_pos);
+      crc_pos = zstream.next_out - out_start;
+    } else if (zstream.avail_out == 0 ||
+               (zerr == Z_STREAM_END && zstream.avail_out != out_size)) {
+      /* write when we're full or when we're done */
+      const size_t write_size = zstream.next_out - out_start;
+      if (!writer->Append(out_start, write_size)) {
         // The file might have declared a bogus length.
         return kInconsistentInformation;
       } else {
-        crc = crc32(crc, &write_buf[0], write_size);
+        crc = crc32(crc, out_start, write_size);
       }
 
-      zstream.next_out = &write_buf[0];
-      zstream.avail_out = kBufSize;
+      zstream.next_out = out_start;
+      zstream.avail_out = out_size;
     }
   } while (zerr == Z_OK);
 
@@ -968,24 +1349,46 @@ static int32_t InflateEntryToWriter(MappedZipFile& mapped_zip, const ZipEntry* e
   return 0;
 }
 
-static int32_t CopyEntryToWriter(MappedZipFile& mapped_zip, const ZipEntry* entry, Writer* writer,
-                                 uint64_t* crc_out) {
-  static const uint32_t kBufSize = 32768;
-  std::vector<uint8_t> buf(kBufSize);
-
+static int32_t CopyEntryToWriter(MappedZipFile& mapped_zip, const ZipEntry* entry,
+                                 off64_t* data_offset, Writer* writer, uint64_t* crc_out) {
   const uint32_t length = entry->uncompressed_length;
   uint32_t count = 0;
   uint64_t crc = 0;
+
+  // Stored data can be read straight into the writer's buffer, if it has one.
+  size_t direct_size = 0;
+  uint8_t* direct_buf = writer->GetBuffer(&direct_size);
+  if (direct_buf != nullptr && direct_size >= length) {
+    while (count < length) {
+      const size_t block_size = std::min(static_cast<size_t>(length - count), kMaxDirectReadSize);
+      if (!mapped_zip.ReadAtOffset(direct_buf + count, block_size, *data_offset)) {
+        ALOGW("CopyFileToFile: copy read failed, block_size = %zu: %s", block_size,
+              strerror(errno));
+        return kIoError;
+      }
+      *data_offset += block_size;
+      crc = crc32(crc, direct_buf + count, block_size);
+      count += block_size;
+    }
+
+    *crc_out = crc;
+    return 0;
+  }
+
+  const size_t kBufSize = BufferSizeFor(length);
+  std::vector<uint8_t> buf(kBufSize);
+
   while (count < length) {
     uint32_t remaining = length - count;
 
     // Safe conversion because kBufSize is narrow enough for a 32 bit signed
     // value.
     const size_t block_size = (remaining > kBufSize) ? kBufSize : remaining;
-    if (!mapped_zip.ReadData(buf.data(), block_size)) {
+    if (!mapped_zip.ReadAtOffset(buf.data(), block_size, *data_offset)) {
       ALOGW("CopyFileToFile: copy read failed, block_size = %zu: %s", block_size, strerror(errno));
       return kIoError;
     }
+    *data_offset += block_size;
 
     if (!writer->Append(&buf[0], block_size)) {
       return kIoError;
@@ -1004,22 +1407,17 @@ int32_t ExtractToWriter(ZipArchiveHandle handle, ZipEntry* entry, Writer* writer
   const uint16_t method = entry->method;
   off64_t data_offset = entry->offset;
 
-  if (!archive->mapped_zip.SeekToOffset(data_offset)) {
-    ALOGW("Zip: lseek to data at %" PRId64 " failed", static_cast<int64_t>(data_offset));
-    return kIoError;
-  }
-
   // this should default to kUnknownCompressionMethod.
   int32_t return_value = -1;
   uint64_t crc = 0;
   if (method == kCompressStored) {
-    return_value = CopyEntryToWriter(archive->mapped_zip, entry, writer, &crc);
+    return_value = CopyEntryToWriter(archive->mapped_zip, entry, &data_offset, writer, &crc);
   } else if (method == kCompressDeflated) {
-    return_value = InflateEntryToWriter(archive->mapped_zip, entry, writer, &crc);
+    return_value = InflateEntryToWriter(archive->mapped_zip, entry, &data_offset, writer, &crc);
   }
 
   if (!return_value && entry->has_data_descriptor) {
-    return_value = ValidateDataDescriptor(archive->mapped_zip, entry);
+    return_value = ValidateDataDescriptor(archive->mapped_zip, data_offset, entry);
     if (return_value) {
       return return_value;
     }
@@ -1048,6 +1446,39 @@ int32_t ExtractEntryToFile(ZipArchiveHandle handle, ZipEntry* entry, int fd) {
   return ExtractToWriter(handle, entry, writer.get());
 }
 
+android::FileMap* MapStoredEntry(ZipArchiveHandle handle, const ZipEntry* entry,
+                                 android::FileMap::MapAdvice advice) {
+  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle);
+  if (entry->method != kCompressStored || entry->compressed_length != entry->uncompressed_length ||
+      entry->uncompressed_length == 0) {
+    return nullptr;
+  }
+  if (!archive->mapped_zip.HasFd()) {
+    ALOGW("Zip: can't map an entry of an archive opened from memory");
+    return nullptr;
+  }
+
+  // The entry's data must lie entirely before the central directory.
+  const off64_t data_offset = entry->offset;
+  if (data_offset < 0 || data_offset + entry->uncompressed_length > archive->directory_offset) {
+    ALOGW("Zip: entry data at %" PRId64 " overlaps the central directory",
+          static_cast<int64_t>(data_offset));
+    return nullptr;
+  }
+
+  // FileMap takes care of mapping from the preceding page boundary, so the
+  // returned pointer is the first byte of the entry.
+  std::unique_ptr<android::FileMap> map(new android::FileMap());
+  if (!map->create(nullptr, archive->mapped_zip.GetFileDescriptor(), data_offset,
+                   entry->uncompressed_length, true /* read only */)) {
+    return nullptr;
+  }
+  if (advice != android::FileMap::NORMAL && map->advise(advice) != 0) {
+    ALOGV("Zip: madvise of mapped entry failed: %s", strerror(errno));
+  }
+  return map.release();
+}
+
 const char* ErrorCodeString(int32_t error_code) {
   // Make sure that the number of entries in kErrorMessages and ErrorCodes
   // match.
@@ -1093,6 +1524,56 @@ int32_t ProcessZipEntryContents(ZipArchiveHandle handle, ZipEntry* entry,
   return ExtractToWriter(handle, entry, &writer);
 }
 
+int32_t ExtractEntriesToFiles(ZipArchiveHandle handle, ZipEntry* entries, const int* fds,
+                              size_t count, size_t num_threads) {
+  if (count == 0) {
+    return 0;
+  }
+
+  // Hand entries out in the order they appear in the archive so that the
+  // reads issued by the pool move through the file (mostly) sequentially.
+  std::vector<size_t> order(count);
+  for (size_t i = 0; i < count; ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [entries](size_t lhs, size_t rhs) {
+    return entries[lhs].offset < entries[rhs].offset;
+  });
+
+  if (num_threads == 0) {
+    num_threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, count);
+
+  std::vector<int32_t> results(count, 0);
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next.fetch_add(1, std::memory_order_relaxed)) < count) {
+      const size_t idx = order[i];
+      results[idx] = ExtractEntryToFile(handle, &entries[idx], fds[idx]);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (results[i] != 0) {
+      ALOGW("Zip: extraction of entry %zu failed: %s", i, ErrorCodeString(results[i]));
+      return results[i];
+    }
+  }
+  return 0;
+}
+
 #endif  //! defined(_WIN32)
 
 int MappedZipFile::GetFileDescriptor() const {
@@ -1169,6 +1650,17 @@ bool MappedZipFile::ReadAtOffset(uint8_t* buf, size_t len, off64_t off) {
     return true;
   }
 #endif
+  if (!has_fd_) {
+    // Don't go through read_pos_ so that positional reads of a mapped archive
+    // are safe to issue from several threads at once.
+    if (off < 0 || off > data_length_ || len > static_cast<size_t>(data_length_ - off)) {
+      ALOGE("Zip: invalid offset: %" PRId64 ", length: %zu, data length: %" PRId64 "\n", off, len,
+            data_length_);
+      return false;
+    }
+    memcpy(buf, static_cast<uint8_t*>(base_ptr_) + off, len);
+    return true;
+  }
   if (!SeekToOffset(off)) {
     return false;
   }
@@ -22,6 +22,9 @@
 #include <tuple>
 #include <vector>
 
+#include <unistd.h>
+
+#include <android-base/macros.h>
 #include <android-base/test_utils.h>
 #include <benchmark/benchmark.h>
 #include <ziparchive/zip_archive.h>
@@ -84,4 +87,155 @@ static void Iterate_all_files(benchmark::State& state) {
 }
 BENCHMARK(Iterate_all_files);
 
+// Creates an archive with many resources and a handful of native libraries.
+static TemporaryFile* CreateLargeZip() {
+  TemporaryFile* result = new TemporaryFile;
+  FILE* fp = fdopen(result->fd, "w");
+
+  ZipWriter writer(fp);
+  for (size_t i = 0; i < 20000; i++) {
+    const std::string name = "res/drawable/icon" + std::to_string(i) + ".png";
+    writer.StartEntry(name.c_str(), 0);
+    writer.WriteBytes("helo", 4);
+    writer.FinishEntry();
+  }
+  for (size_t i = 0; i < 4; i++) {
+    const std::string name = "lib/arm64-v8a/lib" + std::to_string(i) + ".so";
+    writer.StartEntry(name.c_str(), 0);
+    writer.WriteBytes("helo", 4);
+    writer.FinishEntry();
+  }
+  writer.Finish();
+  fclose(fp);
+
+  return result;
+}
+
+static void Iterate_prefix(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateLargeZip());
+  ZipArchiveHandle handle;
+  void* iteration_cookie;
+  ZipEntry data;
+  ZipString name;
+  ZipString prefix("lib/arm64-v8a/");
+
+  OpenArchive(temp_file->path, &handle);
+  while (state.KeepRunning()) {
+    StartIteration(handle, &iteration_cookie, &prefix, nullptr);
+    while (Next(iteration_cookie, &data, &name) == 0) {
+    }
+    EndIteration(iteration_cookie);
+  }
+  CloseArchive(handle);
+}
+BENCHMARK(Iterate_prefix);
+
+// Fills |size| bytes that compress roughly like code or resources do: runs
+// drawn from a small dictionary of tokens, mixed with incompressible noise.
+static std::vector<uint8_t> MakeData(size_t size, unsigned noise_percent) {
+  static const char* kTokens[] = {"android",  "Landroid/os/Bundle;", "getString", "<LinearLayout",
+                                  "onCreate", "Ljava/lang/Object;",  "\0\0\0\0", "layout_width"};
+  std::vector<uint8_t> data;
+  data.reserve(size);
+  uint32_t seed = 0x12345678;
+  while (data.size() < size) {
+    seed = seed * 1103515245 + 12345;
+    if ((seed >> 16) % 100 < noise_percent) {
+      data.push_back(static_cast<uint8_t>(seed >> 8));
+    } else {
+      const char* token = kTokens[(seed >> 16) % arraysize(kTokens)];
+      data.insert(data.end(), token, token + strlen(token));
+    }
+  }
+  data.resize(size);
+  return data;
+}
+
+// Creates an archive shaped like a typical APK: a large dex, a stored
+// resource table and native library, and a number of small compressed XML
+// files.
+static TemporaryFile* CreateApk() {
+  TemporaryFile* result = new TemporaryFile;
+  FILE* fp = fdopen(result->fd, "w");
+
+  ZipWriter writer(fp);
+  auto add = [&writer](const std::string& name, size_t flags, const std::vector<uint8_t>& data) {
+    writer.StartEntry(name.c_str(), flags);
+    writer.WriteBytes(data.data(), data.size());
+    writer.FinishEntry();
+  };
+  add("classes.dex", ZipWriter::kCompress, MakeData(8 * 1024 * 1024, 30));
+  add("resources.arsc", ZipWriter::kAlign32, MakeData(2 * 1024 * 1024, 10));
+  add("lib/arm64-v8a/libfoo.so", ZipWriter::kAlign32, MakeData(4 * 1024 * 1024, 60));
+  for (size_t i = 0; i < 200; i++) {
+    add("res/layout/layout" + std::to_string(i) + ".xml", ZipWriter::kCompress,
+        MakeData(4096 + 64 * i, 5));
+  }
+  writer.Finish();
+  fclose(fp);
+
+  return result;
+}
+
+static std::vector<ZipEntry> GetEntries(ZipArchiveHandle handle) {
+  std::vector<ZipEntry> entries;
+  void* iteration_cookie;
+  ZipEntry data;
+  ZipString name;
+  StartIteration(handle, &iteration_cookie, nullptr, nullptr);
+  while (Next(iteration_cookie, &data, &name) == 0) {
+    entries.push_back(data);
+  }
+  EndIteration(iteration_cookie);
+  return entries;
+}
+
+static void Extract_apk_to_memory(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateApk());
+  ZipArchiveHandle handle;
+  OpenArchive(temp_file->path, &handle);
+  std::vector<ZipEntry> entries = GetEntries(handle);
+
+  size_t total = 0;
+  std::vector<uint8_t> buffer;
+  while (state.KeepRunning()) {
+    for (ZipEntry& entry : entries) {
+      buffer.resize(entry.uncompressed_length);
+      ExtractToMemory(handle, &entry, buffer.data(), buffer.size());
+      total += entry.uncompressed_length;
+    }
+  }
+  state.SetBytesProcessed(total);
+  CloseArchive(handle);
+}
+BENCHMARK(Extract_apk_to_memory);
+
+static void Extract_apk_to_files(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateApk());
+  ZipArchiveHandle handle;
+  OpenArchive(temp_file->path, &handle);
+  std::vector<ZipEntry> entries = GetEntries(handle);
+
+  std::vector<std::unique_ptr<TemporaryFile>> outputs;
+  std::vector<int> fds;
+  for (size_t i = 0; i < entries.size(); i++) {
+    outputs.emplace_back(new TemporaryFile);
+    fds.push_back(outputs.back()->fd);
+  }
+
+  size_t total = 0;
+  while (state.KeepRunning()) {
+    for (int fd : fds) {
+      lseek(fd, 0, SEEK_SET);
+    }
+    ExtractEntriesToFiles(handle, entries.data(), fds.data(), entries.size(), state.range(0));
+    for (const ZipEntry& entry : entries) {
+      total += entry.uncompressed_length;
+    }
+  }
+  state.SetBytesProcessed(total);
+  CloseArchive(handle);
+}
+BENCHMARK(Extract_apk_to_files)->Arg(1)->Arg(4);
+
 BENCHMARK_MAIN()
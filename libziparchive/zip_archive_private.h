@@ -22,6 +22,7 @@
 #include <unistd.h>
 
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <utils/FileMap.h>
@@ -146,6 +147,47 @@ class CentralDirectory {
   size_t length_;
 };
 
+// The header of a persisted lookup index for an archive (see
+// WriteArchiveIndex). It's followed by |hash_table_size| uint32_t slots,
+// each holding the offset of a record from the start of the central
+// directory, or |kEmptySlot|. The slots are laid out exactly as
+// ZipArchive::hash_table would be after parsing the same directory.
+struct ArchiveIndexHeader {
+  static const uint32_t kMagic = 0x5844495a;  // "ZIDX"
+  static const uint32_t kVersion = 1;
+  static const uint32_t kEmptySlot = 0xffffffff;
+
+  uint32_t magic;
+  uint32_t version;
+  // The central directory this index was built from; the index is only
+  // used if all of these still match.
+  uint32_t cd_start_offset;
+  uint32_t cd_size;
+  uint32_t cd_crc32;
+  uint32_t num_entries;
+  uint32_t hash_table_size;
+} __attribute__((packed));
+
+// The parsed central directory of an archive file, shared read-only by
+// every handle opened on that file in this process (see
+// OpenArchiveInternal). Handles copy the fields they need and keep this
+// alive with a reference.
+struct SharedCentralDirectory {
+  std::unique_ptr<android::FileMap> directory_map;
+  off64_t directory_offset;
+  CentralDirectory central_directory;
+  uint16_t num_entries;
+  uint32_t hash_table_size;
+  ZipString* hash_table;
+
+  SharedCentralDirectory() : directory_offset(0), num_entries(0), hash_table_size(0),
+                             hash_table(nullptr) {}
+  ~SharedCentralDirectory() { free(hash_table); }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SharedCentralDirectory);
+};
+
 struct ZipArchive {
   // open Zip archive
   mutable MappedZipFile mapped_zip;
@@ -166,6 +208,14 @@ struct ZipArchive {
   uint32_t hash_table_size;
   ZipString* hash_table;
 
+  // Indexes of the occupied hash_table slots, ordered by entry name. Built
+  // on the first prefix iteration so that those only visit the matches.
+  std::mutex sorted_names_lock;
+  std::vector<uint32_t> sorted_names;
+
+  // If set, the directory map and hash table belong to this.
+  std::shared_ptr<SharedCentralDirectory> shared_directory;
+
   ZipArchive(const int fd, bool assume_ownership)
       : mapped_zip(fd),
         close_file(assume_ownership),
@@ -191,7 +241,9 @@ struct ZipArchive {
       close(mapped_zip.GetFileDescriptor());
     }
 
-    free(hash_table);
+    if (!shared_directory) {
+      free(hash_table);
+    }
   }
 
   bool InitializeCentralDirectory(const char* debug_file_name, off64_t cd_start_offset,
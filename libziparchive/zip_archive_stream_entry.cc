@@ -23,6 +23,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -306,3 +307,217 @@ ZipArchiveStreamEntry* ZipArchiveStreamEntry::CreateRaw(ZipArchiveHandle handle,
   }
   return stream;
 }
+
+class ZipArchiveRandomAccessEntryUncompressed : public ZipArchiveRandomAccessEntry {
+ public:
+  ZipArchiveRandomAccessEntryUncompressed(ZipArchiveHandle handle, const ZipEntry& entry)
+      : ZipArchiveRandomAccessEntry(handle, entry) {}
+  virtual ~ZipArchiveRandomAccessEntryUncompressed() {}
+
+  ssize_t ReadAt(uint8_t* buf, size_t len, uint32_t offset) override;
+};
+
+ssize_t ZipArchiveRandomAccessEntryUncompressed::ReadAt(uint8_t* buf, size_t len,
+                                                        uint32_t offset) {
+  if (offset >= size_) {
+    return 0;
+  }
+  len = std::min(len, static_cast<size_t>(size_ - offset));
+  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
+  if (!archive->mapped_zip.ReadAtOffset(buf, len, data_offset_ + offset)) {
+    return -1;
+  }
+  return len;
+}
+
+class ZipArchiveRandomAccessEntryCompressed : public ZipArchiveRandomAccessEntry {
+ public:
+  ZipArchiveRandomAccessEntryCompressed(ZipArchiveHandle handle, const ZipEntry& entry,
+                                        uint32_t checkpoint_interval)
+      : ZipArchiveRandomAccessEntry(handle, entry),
+        compressed_length_(entry.compressed_length),
+        checkpoint_interval_(checkpoint_interval) {}
+  virtual ~ZipArchiveRandomAccessEntryCompressed();
+
+  ssize_t ReadAt(uint8_t* buf, size_t len, uint32_t offset) override;
+
+  bool Init();
+
+ private:
+  static constexpr size_t kWindowSize = 32768;
+
+  // Enough state to restart inflating at |out| bytes into the entry.
+  struct Checkpoint {
+    uint32_t out;
+    // Offset into the compressed data of the first byte not yet consumed.
+    uint32_t in;
+    // Number of bits of the byte before |in| yet to be consumed.
+    int bits;
+    // The last kWindowSize bytes of output before |out|.
+    std::vector<uint8_t> window;
+  };
+
+  bool Restore(const Checkpoint& checkpoint);
+  void AddCheckpoint();
+
+  const uint32_t compressed_length_;
+  const uint32_t checkpoint_interval_;
+
+  bool z_stream_init_ = false;
+  z_stream z_stream_;
+  // The next compressed byte to be read into in_.
+  uint32_t in_offset_;
+  // The uncompressed offset of the next byte inflate will produce.
+  uint32_t out_offset_;
+  std::vector<uint8_t> in_;
+  // Circular buffer of the most recent output, written at window_pos_.
+  std::vector<uint8_t> window_;
+  size_t window_pos_;
+  std::vector<Checkpoint> checkpoints_;
+};
+
+bool ZipArchiveRandomAccessEntryCompressed::Init() {
+  memset(&z_stream_, 0, sizeof(z_stream_));
+  int zerr = zlib_inflateInit2(&z_stream_, -MAX_WBITS);
+  if (zerr != Z_OK) {
+    ALOGE("Call to inflateInit2 failed (zerr=%d)", zerr);
+    return false;
+  }
+  z_stream_init_ = true;
+
+  in_.resize(kBufSize);
+  window_.resize(kWindowSize);
+  checkpoints_.push_back({0, 0, 0, {}});
+  return Restore(checkpoints_.back());
+}
+
+ZipArchiveRandomAccessEntryCompressed::~ZipArchiveRandomAccessEntryCompressed() {
+  if (z_stream_init_) {
+    inflateEnd(&z_stream_);
+  }
+}
+
+bool ZipArchiveRandomAccessEntryCompressed::Restore(const Checkpoint& checkpoint) {
+  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
+  if (inflateReset(&z_stream_) != Z_OK) {
+    return false;
+  }
+  z_stream_.next_in = nullptr;
+  z_stream_.avail_in = 0;
+  if (checkpoint.bits != 0) {
+    uint8_t byte;
+    if (!archive->mapped_zip.ReadAtOffset(&byte, 1, data_offset_ + checkpoint.in - 1)) {
+      return false;
+    }
+    inflatePrime(&z_stream_, checkpoint.bits, byte >> (8 - checkpoint.bits));
+  }
+  if (!checkpoint.window.empty()) {
+    inflateSetDictionary(&z_stream_, checkpoint.window.data(), checkpoint.window.size());
+    window_ = checkpoint.window;
+  } else {
+    std::fill(window_.begin(), window_.end(), 0);
+  }
+  window_pos_ = 0;
+  in_offset_ = checkpoint.in;
+  out_offset_ = checkpoint.out;
+  return true;
+}
+
+void ZipArchiveRandomAccessEntryCompressed::AddCheckpoint() {
+  Checkpoint checkpoint;
+  checkpoint.out = out_offset_;
+  checkpoint.in = in_offset_ - z_stream_.avail_in;
+  checkpoint.bits = z_stream_.data_type & 7;
+  checkpoint.window.reserve(kWindowSize);
+  checkpoint.window.insert(checkpoint.window.end(), window_.begin() + window_pos_, window_.end());
+  checkpoint.window.insert(checkpoint.window.end(), window_.begin(), window_.begin() + window_pos_);
+  checkpoints_.push_back(std::move(checkpoint));
+}
+
+ssize_t ZipArchiveRandomAccessEntryCompressed::ReadAt(uint8_t* buf, size_t len, uint32_t offset) {
+  if (offset >= size_) {
+    return 0;
+  }
+  const uint32_t end = offset + std::min(len, static_cast<size_t>(size_ - offset));
+
+  // Go back to the last checkpoint at or before |offset| if we've passed
+  // it, or if it saves inflating up to it.
+  auto it = std::upper_bound(
+      checkpoints_.begin(), checkpoints_.end(), offset,
+      [](uint32_t value, const Checkpoint& checkpoint) { return value < checkpoint.out; });
+  const Checkpoint& checkpoint = *(it - 1);
+  if (offset < out_offset_ || checkpoint.out > out_offset_) {
+    if (!Restore(checkpoint)) {
+      return -1;
+    }
+  }
+
+  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
+  while (out_offset_ < end) {
+    if (z_stream_.avail_in == 0) {
+      const uint32_t bytes = std::min(static_cast<size_t>(compressed_length_ - in_offset_),
+                                      in_.size());
+      if (bytes == 0) {
+        ALOGE("Compressed data ended early, possibly corrupted zip?");
+        return -1;
+      }
+      if (!archive->mapped_zip.ReadAtOffset(in_.data(), bytes, data_offset_ + in_offset_)) {
+        return -1;
+      }
+      in_offset_ += bytes;
+      z_stream_.next_in = in_.data();
+      z_stream_.avail_in = bytes;
+    }
+
+    // Inflate no further than the end of the window or of the request,
+    // stopping at block boundaries so checkpoints can be taken.
+    const size_t out_size =
+        std::min(kWindowSize - window_pos_, static_cast<size_t>(end - out_offset_));
+    uint8_t* out = window_.data() + window_pos_;
+    z_stream_.next_out = out;
+    z_stream_.avail_out = out_size;
+    int zerr = inflate(&z_stream_, Z_BLOCK);
+    if (zerr != Z_OK && zerr != Z_STREAM_END) {
+      ALOGE("inflate zerr=%d", zerr);
+      return -1;
+    }
+
+    const size_t produced = out_size - z_stream_.avail_out;
+    if (out_offset_ + produced > offset) {
+      const size_t skip = (out_offset_ < offset) ? offset - out_offset_ : 0;
+      memcpy(buf + (out_offset_ + skip - offset), out + skip, produced - skip);
+    }
+    out_offset_ += produced;
+    window_pos_ = (window_pos_ + produced) % kWindowSize;
+
+    if (zerr == Z_STREAM_END) {
+      break;
+    }
+    // At the end of a block header that isn't the last block?
+    if ((z_stream_.data_type & 128) && !(z_stream_.data_type & 64) &&
+        out_offset_ >= checkpoints_.back().out + checkpoint_interval_) {
+      AddCheckpoint();
+    }
+  }
+
+  if (out_offset_ < end) {
+    ALOGE("Inflated data ended early, possibly corrupted zip?");
+    return -1;
+  }
+  return end - offset;
+}
+
+ZipArchiveRandomAccessEntry* ZipArchiveRandomAccessEntry::Create(ZipArchiveHandle handle,
+                                                                 const ZipEntry& entry,
+                                                                 uint32_t checkpoint_interval) {
+  if (entry.method == kCompressStored) {
+    return new ZipArchiveRandomAccessEntryUncompressed(handle, entry);
+  }
+
+  std::unique_ptr<ZipArchiveRandomAccessEntryCompressed> stream(
+      new ZipArchiveRandomAccessEntryCompressed(handle, entry, checkpoint_interval));
+  if (!stream->Init()) {
+    return nullptr;
+  }
+  return stream.release();
+}
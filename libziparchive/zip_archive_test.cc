@@ -485,6 +485,165 @@ TEST(ziparchive, ExtractToFile) {
 }
 
 #if !defined(_WIN32)
+TEST(ziparchive, SharedCentralDirectory) {
+  ZipArchiveHandle first;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &first));
+  ZipArchiveHandle second;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &second));
+
+  // The second open reuses the first's parsed central directory.
+  const ZipArchive* first_archive = reinterpret_cast<ZipArchive*>(first);
+  const ZipArchive* second_archive = reinterpret_cast<ZipArchive*>(second);
+  ASSERT_TRUE(first_archive->shared_directory != nullptr);
+  ASSERT_EQ(first_archive->shared_directory, second_archive->shared_directory);
+  ASSERT_EQ(first_archive->hash_table, second_archive->hash_table);
+
+  // And it outlives the handle that parsed it.
+  CloseArchive(first);
+  ZipEntry data;
+  ZipString name;
+  SetZipString(&name, kATxtName);
+  ASSERT_EQ(0, FindEntry(second, name, &data));
+  std::vector<uint8_t> buffer(data.uncompressed_length);
+  ASSERT_EQ(0, ExtractToMemory(second, &data, buffer.data(), buffer.size()));
+  ASSERT_EQ(kATxtContents, buffer);
+  CloseArchive(second);
+}
+
+TEST(ziparchive, SharedCentralDirectoryChangedFile) {
+  TemporaryFile tmp_file;
+  ASSERT_NE(-1, tmp_file.fd);
+  ASSERT_TRUE(android::base::WriteFully(tmp_file.fd, kEmptyEntriesZip, sizeof(kEmptyEntriesZip)));
+  ZipArchiveHandle first;
+  ASSERT_EQ(0, OpenArchiveFd(tmp_file.fd, "SharedCentralDirectoryChangedFile", &first, false));
+
+  // Replace the contents while the first handle is still open.
+  ASSERT_EQ(0, ftruncate(tmp_file.fd, 0));
+  ASSERT_EQ(0, lseek(tmp_file.fd, 0, SEEK_SET));
+  ASSERT_TRUE(android::base::WriteFully(tmp_file.fd, reinterpret_cast<const uint8_t*>(kAbZip),
+                                        sizeof(kAbZip) - 1));
+  ZipArchiveHandle second;
+  ASSERT_EQ(0, OpenArchiveFd(tmp_file.fd, "SharedCentralDirectoryChangedFile", &second, false));
+  ASSERT_NE(reinterpret_cast<ZipArchive*>(first)->shared_directory,
+            reinterpret_cast<ZipArchive*>(second)->shared_directory);
+
+  ZipEntry entry;
+  ZipString ab_name;
+  SetZipString(&ab_name, kAbTxtName);
+  ASSERT_EQ(0, FindEntry(second, ab_name, &entry));
+
+  CloseArchive(first);
+  CloseArchive(second);
+}
+
+TEST(ziparchive, OpenWithIndex) {
+  const std::string zip_path = test_data_dir + "/" + kValidZip;
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchive(zip_path.c_str(), &handle));
+  TemporaryFile index_file;
+  ASSERT_NE(-1, index_file.fd);
+  ASSERT_EQ(0, WriteArchiveIndex(handle, index_file.fd));
+  CloseArchive(handle);
+
+  ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), index_file.path, &handle));
+  ZipEntry data;
+  ZipString name;
+  SetZipString(&name, kATxtName);
+  ASSERT_EQ(0, FindEntry(handle, name, &data));
+  ASSERT_EQ(static_cast<uint32_t>(17), data.uncompressed_length);
+  SetZipString(&name, kNonexistentTxtName);
+  ASSERT_EQ(kEntryNotFound, FindEntry(handle, name, &data));
+
+  void* iteration_cookie;
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie, nullptr, nullptr));
+  size_t count = 0;
+  while (Next(iteration_cookie, &data, &name) == 0) {
+    ++count;
+  }
+  ASSERT_EQ(5u, count);
+  CloseArchive(handle);
+
+  // An index for some other archive is ignored.
+  ASSERT_EQ(0, OpenArchiveWrapper(kLargeZip, &handle));
+  TemporaryFile other_index_file;
+  ASSERT_NE(-1, other_index_file.fd);
+  ASSERT_EQ(0, WriteArchiveIndex(handle, other_index_file.fd));
+  CloseArchive(handle);
+
+  ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), other_index_file.path, &handle));
+  SetZipString(&name, kATxtName);
+  ASSERT_EQ(0, FindEntry(handle, name, &data));
+  CloseArchive(handle);
+
+  // As is a missing one.
+  ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), "/does/not/exist", &handle));
+  ASSERT_EQ(0, FindEntry(handle, name, &data));
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, MapStoredEntry) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kLargeZip, &handle));
+
+  ZipEntry entry;
+  ZipString name;
+  SetZipString(&name, kLargeUncompressTxtName);
+  ASSERT_EQ(0, FindEntry(handle, name, &entry));
+  ASSERT_EQ(kCompressStored, entry.method);
+
+  std::unique_ptr<android::FileMap> map(
+      MapStoredEntry(handle, &entry, android::FileMap::SEQUENTIAL));
+  ASSERT_TRUE(map != nullptr);
+  ASSERT_EQ(entry.uncompressed_length, map->getDataLength());
+
+  std::vector<uint8_t> buffer(entry.uncompressed_length);
+  ASSERT_EQ(0, ExtractToMemory(handle, &entry, buffer.data(), buffer.size()));
+  ASSERT_EQ(0, memcmp(buffer.data(), map->getDataPtr(), buffer.size()));
+
+  // Compressed entries can't be mapped.
+  SetZipString(&name, kLargeCompressTxtName);
+  ASSERT_EQ(0, FindEntry(handle, name, &entry));
+  ASSERT_TRUE(MapStoredEntry(handle, &entry) == nullptr);
+
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, ExtractEntriesToFiles) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+
+  // b.txt comes after a.txt in the archive; pass them in the other order.
+  ZipEntry entries[2];
+  ZipString name;
+  SetZipString(&name, kBTxtName);
+  ASSERT_EQ(0, FindEntry(handle, name, &entries[0]));
+  SetZipString(&name, kATxtName);
+  ASSERT_EQ(0, FindEntry(handle, name, &entries[1]));
+
+  TemporaryFile b_file;
+  ASSERT_NE(-1, b_file.fd);
+  TemporaryFile a_file;
+  ASSERT_NE(-1, a_file.fd);
+  const int fds[2] = {b_file.fd, a_file.fd};
+  ASSERT_EQ(0, ExtractEntriesToFiles(handle, entries, fds, 2, 2));
+
+  std::vector<uint8_t> contents(kBTxtContents.size());
+  ASSERT_EQ(0, lseek64(b_file.fd, 0, SEEK_SET));
+  ASSERT_TRUE(android::base::ReadFully(b_file.fd, contents.data(), contents.size()));
+  ASSERT_EQ(kBTxtContents, contents);
+
+  contents.resize(kATxtContents.size());
+  ASSERT_EQ(0, lseek64(a_file.fd, 0, SEEK_SET));
+  ASSERT_TRUE(android::base::ReadFully(a_file.fd, contents.data(), contents.size()));
+  ASSERT_EQ(kATxtContents, contents);
+
+  // A bad destination fails the call but doesn't stop the other entry.
+  const int bad_fds[2] = {-1, a_file.fd};
+  ASSERT_EQ(kIoError, ExtractEntriesToFiles(handle, entries, bad_fds, 2, 0));
+
+  CloseArchive(handle);
+}
+
 TEST(ziparchive, OpenFromMemory) {
   const std::string zip_path = test_data_dir + "/" + kUpdateZip;
   android::base::unique_fd fd(open(zip_path.c_str(), O_RDONLY | O_BINARY));
@@ -634,6 +793,53 @@ TEST(ziparchive, StreamUncompressedBadCrc) {
 //
 // cat /tmp/data_descriptor.zip | xxd -i
 //
+static void ZipArchiveRandomAccessTest(const std::string& entry_name) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kLargeZip, &handle));
+
+  ZipEntry entry;
+  ZipString name;
+  SetZipString(&name, entry_name);
+  ASSERT_EQ(0, FindEntry(handle, name, &entry));
+  std::vector<uint8_t> expected(entry.uncompressed_length);
+  ASSERT_EQ(0, ExtractToMemory(handle, &entry, expected.data(), expected.size()));
+
+  std::unique_ptr<ZipArchiveRandomAccessEntry> stream(
+      ZipArchiveRandomAccessEntry::Create(handle, entry, 16384));
+  ASSERT_TRUE(stream.get() != nullptr);
+  ASSERT_EQ(entry.uncompressed_length, stream->Size());
+
+  // Forwards in one pass records the checkpoints, then backwards and
+  // scattered reads restart from them.
+  const size_t kChunk = 10000;
+  std::vector<uint8_t> buf(kChunk);
+  std::vector<uint32_t> offsets;
+  for (uint32_t offset = 0; offset < expected.size(); offset += kChunk) {
+    offsets.push_back(offset);
+  }
+  std::vector<uint32_t> reversed(offsets.rbegin(), offsets.rend());
+  offsets.insert(offsets.end(), reversed.begin(), reversed.end());
+  offsets.push_back(12345);
+  offsets.push_back(entry.uncompressed_length - 1);
+  offsets.push_back(3);
+  for (uint32_t offset : offsets) {
+    const size_t expected_len = std::min(kChunk, expected.size() - offset);
+    ASSERT_EQ(static_cast<ssize_t>(expected_len), stream->ReadAt(buf.data(), kChunk, offset));
+    ASSERT_EQ(0, memcmp(expected.data() + offset, buf.data(), expected_len)) << offset;
+  }
+  ASSERT_EQ(0, stream->ReadAt(buf.data(), kChunk, entry.uncompressed_length));
+
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, RandomAccessCompressed) {
+  ZipArchiveRandomAccessTest(kLargeCompressTxtName);
+}
+
+TEST(ziparchive, RandomAccessUncompressed) {
+  ZipArchiveRandomAccessTest(kLargeUncompressTxtName);
+}
+
 static const std::vector<uint8_t> kDataDescriptorZipFile{
     0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x08, 0x08, 0x08, 0x00, 0x30, 0x59, 0xce, 0x4a, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x6e, 0x61,
@@ -22,7 +22,11 @@
 #include <cstdio>
 #define DEF_MEM_LEVEL 8  // normally in zutil.h?
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "android-base/logging.h"
@@ -82,13 +86,153 @@ static void DeleteZStream(z_stream* stream) {
   delete stream;
 }
 
+static int InitDeflate(z_stream* stream) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+  return deflateInit2(stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL,
+                      Z_DEFAULT_STRATEGY);
+#pragma GCC diagnostic pop
+}
+
+// An entry whose data is buffered in memory until it has been compressed
+// (if needed) and can be committed to the file, when writing with
+// compression threads.
+struct ZipWriter::PendingEntry {
+  FileEntry entry;
+  uint32_t alignment;
+  // The uncompressed data, replaced by the compressed data when done.
+  std::vector<uint8_t> data;
+  int32_t result;
+  bool done;
+};
+
+// Compresses PendingEntries on a set of worker threads, and hands them
+// back in the order they were submitted.
+class ZipWriter::CompressionPool {
+ public:
+  explicit CompressionPool(size_t num_threads) : stopping_(false) {
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads_.emplace_back(&CompressionPool::Run, this);
+    }
+  }
+
+  ~CompressionPool() {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Submit(std::unique_ptr<PendingEntry> entry) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (entry->entry.compression_method == kCompressDeflated) {
+      work_.push_back(entry.get());
+      work_cv_.notify_one();
+    } else {
+      entry->done = true;
+    }
+    pending_.push_back(std::move(entry));
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> guard(lock_);
+    return pending_.size();
+  }
+
+  // Removes and returns the oldest entry if it's done, waiting for it if
+  // |wait| is set. Returns nullptr if there are no entries, or if the oldest
+  // isn't done and |wait| isn't set.
+  std::unique_ptr<PendingEntry> TakeOldest(bool wait) {
+    std::unique_lock<std::mutex> lock(lock_);
+    if (pending_.empty()) {
+      return nullptr;
+    }
+    if (wait) {
+      done_cv_.wait(lock, [this]() { return pending_.front()->done; });
+    } else if (!pending_.front()->done) {
+      return nullptr;
+    }
+    std::unique_ptr<PendingEntry> entry = std::move(pending_.front());
+    pending_.pop_front();
+    return entry;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CompressionPool);
+
+  void Run() {
+    while (true) {
+      PendingEntry* entry;
+      {
+        std::unique_lock<std::mutex> lock(lock_);
+        work_cv_.wait(lock, [this]() { return stopping_ || !work_.empty(); });
+        if (stopping_) {
+          return;
+        }
+        entry = work_.front();
+        work_.pop_front();
+      }
+
+      entry->result = Compress(entry);
+
+      {
+        std::lock_guard<std::mutex> guard(lock_);
+        entry->done = true;
+      }
+      done_cv_.notify_all();
+    }
+  }
+
+  static int32_t Compress(PendingEntry* pending) {
+    FileEntry& file = pending->entry;
+    std::vector<uint8_t>& data = pending->data;
+    file.crc32 = crc32(0, data.data(), data.size());
+
+    z_stream stream = {};
+    int zerr = InitDeflate(&stream);
+    if (zerr != Z_OK) {
+      ALOGE("deflateInit2 failed (zerr=%d)", zerr);
+      return kZlibError;
+    }
+    std::vector<uint8_t> out(deflateBound(&stream, data.size()));
+    stream.next_in = data.data();
+    stream.avail_in = data.size();
+    stream.next_out = out.data();
+    stream.avail_out = out.size();
+    zerr = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (zerr != Z_STREAM_END) {
+      return kZlibError;
+    }
+
+    out.resize(stream.total_out);
+    file.compressed_size = out.size();
+    data.swap(out);
+    return kNoError;
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex lock_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  // Entries in the order they were submitted, and those still to compress.
+  std::deque<std::unique_ptr<PendingEntry>> pending_;
+  std::deque<PendingEntry*> work_;
+  bool stopping_;
+};
+
 ZipWriter::ZipWriter(FILE* f)
     : file_(f),
       seekable_(false),
       current_offset_(0),
       state_(State::kWritingZip),
       z_stream_(nullptr, DeleteZStream),
-      buffer_(kBufSize) {
+      buffer_(kBufSize),
+      max_pending_entries_(0) {
   // Check if the file is seekable (regular file). If fstat fails, that's fine, subsequent calls
   // will fail as well.
   struct stat file_stats;
@@ -104,7 +248,10 @@ ZipWriter::ZipWriter(ZipWriter&& writer)
       state_(writer.state_),
       files_(std::move(writer.files_)),
       z_stream_(std::move(writer.z_stream_)),
-      buffer_(std::move(writer.buffer_)) {
+      buffer_(std::move(writer.buffer_)),
+      pool_(std::move(writer.pool_)),
+      pending_entry_(std::move(writer.pending_entry_)),
+      max_pending_entries_(writer.max_pending_entries_) {
   writer.file_ = nullptr;
   writer.state_ = State::kError;
 }
@@ -117,11 +264,27 @@ ZipWriter& ZipWriter::operator=(ZipWriter&& writer) {
   files_ = std::move(writer.files_);
   z_stream_ = std::move(writer.z_stream_);
   buffer_ = std::move(writer.buffer_);
+  pool_ = std::move(writer.pool_);
+  pending_entry_ = std::move(writer.pending_entry_);
+  max_pending_entries_ = writer.max_pending_entries_;
   writer.file_ = nullptr;
   writer.state_ = State::kError;
   return *this;
 }
 
+ZipWriter::~ZipWriter() {}
+
+int32_t ZipWriter::SetCompressionThreads(size_t num_threads, size_t max_pending_entries) {
+  if (state_ != State::kWritingZip || !files_.empty() || pool_ || num_threads == 0 ||
+      max_pending_entries == 0) {
+    return kInvalidState;
+  }
+
+  pool_.reset(new CompressionPool(num_threads));
+  max_pending_entries_ = max_pending_entries;
+  return kNoError;
+}
+
 int32_t ZipWriter::HandleError(int32_t error_code) {
   state_ = State::kError;
   z_stream_.reset();
@@ -221,9 +384,11 @@ int32_t ZipWriter::StartAlignedEntryWithTime(const char* path, size_t flags, tim
   if (flags & ZipWriter::kCompress) {
     file_entry.compression_method = kCompressDeflated;
 
-    int32_t result = PrepareDeflate();
-    if (result != kNoError) {
-      return result;
+    if (!pool_) {
+      int32_t result = PrepareDeflate();
+      if (result != kNoError) {
+        return result;
+      }
     }
   } else {
     file_entry.compression_method = kCompressStored;
@@ -231,6 +396,18 @@ int32_t ZipWriter::StartAlignedEntryWithTime(const char* path, size_t flags, tim
 
   ExtractTimeAndDate(time, &file_entry.last_mod_time, &file_entry.last_mod_date);
 
+  if (pool_) {
+    // The header can't be written until the entries before this one have
+    // been committed, so just buffer everything until then.
+    pending_entry_.reset(new PendingEntry());
+    pending_entry_->entry = std::move(file_entry);
+    pending_entry_->alignment = alignment;
+    pending_entry_->result = kNoError;
+    pending_entry_->done = false;
+    state_ = State::kWritingEntry;
+    return kNoError;
+  }
+
   off_t offset = current_offset_ + sizeof(LocalFileHeader) + file_entry.path.size();
   std::vector<char> zero_padding;
   if (alignment != 0 && (offset & (alignment - 1))) {
@@ -266,7 +443,16 @@ int32_t ZipWriter::StartAlignedEntryWithTime(const char* path, size_t flags, tim
 }
 
 int32_t ZipWriter::DiscardLastEntry() {
-  if (state_ != State::kWritingZip || files_.empty()) {
+  if (state_ != State::kWritingZip) {
+    return kInvalidState;
+  }
+
+  int32_t result = CommitPendingEntries(0);
+  if (result != kNoError) {
+    return result;
+  }
+
+  if (files_.empty()) {
     return kInvalidState;
   }
 
@@ -282,6 +468,13 @@ int32_t ZipWriter::DiscardLastEntry() {
 int32_t ZipWriter::GetLastEntry(FileEntry* out_entry) {
   CHECK(out_entry != nullptr);
 
+  if (state_ == State::kWritingZip) {
+    int32_t result = CommitPendingEntries(0);
+    if (result != kNoError) {
+      return result;
+    }
+  }
+
   if (files_.empty()) {
     return kInvalidState;
   }
@@ -295,11 +488,7 @@ int32_t ZipWriter::PrepareDeflate() {
   // Initialize the z_stream for compression.
   z_stream_ = std::unique_ptr<z_stream, void (*)(z_stream*)>(new z_stream(), DeleteZStream);
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wold-style-cast"
-  int zerr = deflateInit2(z_stream_.get(), Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
-                          DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
-#pragma GCC diagnostic pop
+  int zerr = InitDeflate(z_stream_.get());
 
   if (zerr != Z_OK) {
     if (zerr == Z_VERSION_ERROR) {
@@ -321,6 +510,13 @@ int32_t ZipWriter::WriteBytes(const void* data, size_t len) {
     return HandleError(kInvalidState);
   }
 
+  if (pool_) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    pending_entry_->data.insert(pending_entry_->data.end(), bytes, bytes + len);
+    pending_entry_->entry.uncompressed_size += len;
+    return kNoError;
+  }
+
   int32_t result = kNoError;
   if (current_file_entry_.compression_method & kCompressDeflated) {
     result = CompressBytes(&current_file_entry_, data, len);
@@ -425,6 +621,17 @@ int32_t ZipWriter::FinishEntry() {
     return kInvalidState;
   }
 
+  if (pool_) {
+    if (pending_entry_->entry.compression_method == kCompressStored) {
+      pending_entry_->entry.crc32 =
+          crc32(0, pending_entry_->data.data(), pending_entry_->data.size());
+      pending_entry_->entry.compressed_size = pending_entry_->data.size();
+    }
+    pool_->Submit(std::move(pending_entry_));
+    state_ = State::kWritingZip;
+    return CommitPendingEntries(max_pending_entries_);
+  }
+
   if (current_file_entry_.compression_method & kCompressDeflated) {
     int32_t result = FlushCompressedBytes(&current_file_entry_);
     if (result != kNoError) {
@@ -471,11 +678,98 @@ int32_t ZipWriter::FinishEntry() {
   return kNoError;
 }
 
+// Commits every finished entry at the head of the queue, then waits for
+// and commits more until no more than |max_pending| are left.
+int32_t ZipWriter::CommitPendingEntries(size_t max_pending) {
+  if (!pool_) {
+    return kNoError;
+  }
+
+  while (true) {
+    const bool wait = pool_->size() > max_pending;
+    std::unique_ptr<PendingEntry> entry = pool_->TakeOldest(wait);
+    if (!entry) {
+      return kNoError;
+    }
+    int32_t result = CommitEntry(entry.get());
+    if (result != kNoError) {
+      return result;
+    }
+  }
+}
+
+int32_t ZipWriter::CommitEntry(PendingEntry* pending) {
+  if (pending->result != kNoError) {
+    return HandleError(pending->result);
+  }
+
+  FileEntry& file = pending->entry;
+  file.local_file_header_offset = current_offset_;
+
+  off64_t offset = current_offset_ + sizeof(LocalFileHeader) + file.path.size();
+  std::vector<char> zero_padding;
+  const uint32_t alignment = pending->alignment;
+  if (alignment != 0 && (offset & (alignment - 1))) {
+    // Pad the extra field so the data will be aligned.
+    uint16_t padding = alignment - (offset % alignment);
+    file.padding_length = padding;
+    offset += padding;
+    zero_padding.resize(padding, 0);
+  }
+
+  // Everything's known up front, so only use a DataDescriptor where the
+  // synchronous path would have had to.
+  const bool use_data_descriptor = (file.compression_method & kCompressDeflated) || !seekable_;
+  LocalFileHeader header = {};
+  CopyFromFileEntry(file, use_data_descriptor, &header);
+  if (fwrite(&header, sizeof(header), 1, file_) != 1) {
+    return HandleError(kIoError);
+  }
+  if (fwrite(file.path.data(), 1, file.path.size(), file_) != file.path.size()) {
+    return HandleError(kIoError);
+  }
+  if (file.padding_length != 0 && fwrite(zero_padding.data(), 1, file.padding_length, file_) !=
+                                      file.padding_length) {
+    return HandleError(kIoError);
+  }
+
+  const std::vector<uint8_t>& data = pending->data;
+  if (!data.empty() && fwrite(data.data(), 1, data.size(), file_) != data.size()) {
+    return HandleError(kIoError);
+  }
+  offset += data.size();
+
+  if (use_data_descriptor) {
+    const uint32_t sig = DataDescriptor::kOptSignature;
+    if (fwrite(&sig, sizeof(sig), 1, file_) != 1) {
+      return HandleError(kIoError);
+    }
+
+    DataDescriptor dd = {};
+    dd.crc32 = file.crc32;
+    dd.compressed_size = file.compressed_size;
+    dd.uncompressed_size = file.uncompressed_size;
+    if (fwrite(&dd, sizeof(dd), 1, file_) != 1) {
+      return HandleError(kIoError);
+    }
+    offset += sizeof(DataDescriptor::kOptSignature) + sizeof(dd);
+  }
+
+  current_offset_ = offset;
+  files_.emplace_back(std::move(file));
+  return kNoError;
+}
+
 int32_t ZipWriter::Finish() {
   if (state_ != State::kWritingZip) {
     return kInvalidState;
   }
 
+  int32_t result = CommitPendingEntries(0);
+  if (result != kNoError) {
+    return result;
+  }
+
   off_t startOfCdr = current_offset_;
   for (FileEntry& file : files_) {
     CentralDirectoryRecord cdr = {};
@@ -286,6 +286,53 @@ TEST_F(zipwriter, WriteCompressedZipFlushFull) {
   CloseArchive(handle);
 }
 
+TEST_F(zipwriter, WriteZipWithCompressionThreads) {
+  ZipWriter writer(file_);
+  ASSERT_EQ(0, writer.SetCompressionThreads(4, 2));
+
+  std::vector<std::string> contents;
+  for (size_t i = 0; i < 50; i++) {
+    std::string content(i * 1000, static_cast<char>('a' + (i % 26)));
+    content += std::to_string(i);
+    contents.push_back(content);
+
+    const std::string name = "file" + std::to_string(i);
+    const size_t flags = (i % 3 == 0) ? ZipWriter::kAlign32 : ZipWriter::kCompress;
+    ASSERT_EQ(0, writer.StartEntry(name.c_str(), flags));
+    ASSERT_EQ(0, writer.WriteBytes(content.data(), content.size() / 2));
+    ASSERT_EQ(0, writer.WriteBytes(content.data() + content.size() / 2,
+                                   content.size() - content.size() / 2));
+    ASSERT_EQ(0, writer.FinishEntry());
+  }
+
+  ZipWriter::FileEntry last_entry;
+  ASSERT_EQ(0, writer.GetLastEntry(&last_entry));
+  EXPECT_EQ("file49", last_entry.path);
+  ASSERT_EQ(0, writer.Finish());
+
+  ASSERT_GE(0, lseek(fd_, 0, SEEK_SET));
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveFd(fd_, "temp", &handle, false));
+
+  off64_t last_offset = -1;
+  for (size_t i = 0; i < contents.size(); i++) {
+    const std::string name = "file" + std::to_string(i);
+    ZipEntry data;
+    ASSERT_EQ(0, FindEntry(handle, ZipString(name.c_str()), &data));
+    EXPECT_EQ((i % 3 == 0) ? kCompressStored : kCompressDeflated, data.method);
+    if (i % 3 == 0) {
+      EXPECT_EQ(0, data.offset & 0x03);
+    }
+    // Entries are committed in the order they were started.
+    EXPECT_LT(last_offset, data.offset);
+    last_offset = data.offset;
+    ASSERT_TRUE(AssertFileEntryContentsEq(contents[i], handle, &data));
+  }
+
+  CloseArchive(handle);
+}
+
 TEST_F(zipwriter, CheckStartEntryErrors) {
   ZipWriter writer(file_);
 
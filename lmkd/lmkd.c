@@ -28,6 +28,7 @@
 #include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
@@ -35,6 +36,7 @@
 #include <cutils/properties.h>
 #include <cutils/sockets.h>
 #include <log/log.h>
+#include <log/log_event_list.h>
 #include <processgroup/processgroup.h>
 
 #ifndef __unused
@@ -44,9 +46,16 @@
 #define MEMCG_SYSFS_PATH "/dev/memcg/"
 #define MEMCG_MEMORY_USAGE "/dev/memcg/memory.usage_in_bytes"
 #define MEMCG_MEMORYSW_USAGE "/dev/memcg/memory.memsw.usage_in_bytes"
+#define MEMCG_APP_PATH "/dev/memcg/apps/uid_%d"
+#define MEMCG_PROCESS_PATH "/dev/memcg/apps/uid_%d/pid_%d"
+
+/* Event log tag for kills, from event.logtags. */
+#define LMKD_KILL_TAG 10195355
 #define MEMPRESSURE_WATCH_MEDIUM_LEVEL "medium"
 #define MEMPRESSURE_WATCH_CRITICAL_LEVEL "critical"
 #define ZONEINFO_PATH "/proc/zoneinfo"
+#define VMSTAT_PATH "/proc/vmstat"
+#define PSI_MEMORY_PATH "/proc/pressure/memory"
 #define LINE_MAX 128
 
 #define INKERNEL_MINFREE_PATH "/sys/module/lowmemorykiller/parameters/minfree"
@@ -55,18 +64,24 @@
 #define ARRAY_SIZE(x)   (sizeof(x) / sizeof(*(x)))
 #define EIGHT_MEGA (1 << 23)
 
+/*
+ * Each command is a packet of ints in network byte order, the command code followed by its
+ * arguments.
+ */
 enum lmk_cmd {
-    LMK_TARGET,
-    LMK_PROCPRIO,
-    LMK_PROCREMOVE,
+    LMK_TARGET,         /* minfree and minkillprio for up to MAX_TARGETS targets */
+    LMK_PROCPRIO,       /* pid, uid and oomadj of a process */
+    LMK_PROCREMOVE,     /* pid of a process that died */
+    LMK_PROCPRIO_BATCH, /* pid, uid and oomadj of up to MAX_PROCPRIO_BATCH processes */
 };
 
 #define MAX_TARGETS 6
+#define MAX_PROCPRIO_BATCH 128
 /*
- * longest is LMK_TARGET followed by MAX_TARGETS each minfree and minkillprio
- * values
+ * longest is LMK_PROCPRIO_BATCH followed by MAX_PROCPRIO_BATCH each pid, uid
+ * and oomadj values
  */
-#define CTRL_PACKET_MAX (sizeof(int) * (MAX_TARGETS * 2 + 1))
+#define CTRL_PACKET_MAX (sizeof(int) * (MAX_PROCPRIO_BATCH * 3 + 1))
 
 /* default to old in-kernel interface if no memory pressure events */
 static int use_inkernel_interface = 1;
@@ -85,13 +100,34 @@ static int64_t upgrade_pressure;
 static int64_t downgrade_pressure;
 static bool is_go_device;
 
+/*
+ * Pressure prediction (ro.lmk.predict) samples memory every ro.lmk.predict_period_ms, and
+ * looks at the last ro.lmk.predict_window_ms of samples for how long tasks stalled on memory,
+ * how much of what reclaim scanned it could free, and how fast available memory is falling.
+ * The vmpressure events only fire once reclaim is already struggling, so this kills before
+ * the device stalls for long.
+ */
+static bool enable_pressure_predict;
+static int predict_period_ms;
+static int predict_window_ms;
+static int predict_horizon_ms;
+static int stall_medium_pct;
+static int stall_critical_pct;
+static int min_reclaim_efficiency_pct;
+static int64_t predict_medium_kb;
+static int64_t predict_critical_kb;
+static int predict_timer_fd = -1;
+
 /* control socket listen and data */
 static int ctrl_lfd;
 static int ctrl_dfd = -1;
 static int ctrl_dfd_reopened; /* did we reopen ctrl conn on this loop? */
 
-/* 2 memory pressure levels, 1 ctrl listen socket, 1 ctrl data socket */
-#define MAX_EPOLL_EVENTS 4
+/*
+ * 2 memory pressure levels, 1 pressure prediction timer, 1 process refresh timer,
+ * 1 kill tracking timer, 1 ctrl listen socket, 1 ctrl data socket
+ */
+#define MAX_EPOLL_EVENTS 7
 static int epollfd;
 static int maxevents;
 
@@ -110,25 +146,107 @@ struct sysmeminfo {
     int totalreserve_pages;
 };
 
-struct adjslot_list {
-    struct adjslot_list *next;
-    struct adjslot_list *prev;
+/* A snapshot of the counters pressure prediction works from. */
+struct mem_sample {
+    int64_t time_ms;
+    int64_t stall_us;       /* PSI "some" stall time, or -1 if the kernel has no PSI */
+    int64_t pgscan_direct;
+    int64_t pgscan_kswapd;
+    int64_t pgsteal;
+    int64_t available_kb;   /* free memory above the reserve, plus page cache */
 };
 
+#define MAX_MEM_SAMPLES 64
+static struct mem_sample mem_samples[MAX_MEM_SAMPLES];
+static int mem_sample_count;
+static int mem_sample_next;
+static int mem_window_size;
+
+/*
+ * Without PSI, the share of scanning done in direct reclaim stands in for stall time. It is
+ * meaningless over a handful of pages, so windows that scanned less than this are ignored.
+ */
+#define MIN_SCANNED_FOR_STALL_KB 1024
+
+/*
+ * What lmkd knows about each app. Entries are kept after an app's processes are gone, so that
+ * relaunches after a kill can be counted.
+ */
+struct uid_stats {
+    uid_t uid;
+    int64_t memory_kb;      /* the app's memcg, as of the last refresh */
+    int64_t swap_kb;
+    int kills;
+    int relaunches;         /* processes started within RELAUNCH_WINDOW_MS of a kill */
+    int64_t last_kill_ms;
+    struct uid_stats *hash_next;
+};
+
+#define UIDHASH_SZ 256
+static struct uid_stats *uidhash[UIDHASH_SZ];
+#define MAX_APPS 1024
+static struct uid_stats uid_pool[MAX_APPS];
+static int uid_pool_used;
+#define RELAUNCH_WINDOW_MS (60 * 1000)
+
+/* Whether victims are chosen by the memory killing them frees per unit of relaunch cost. */
+static bool kill_by_cost;
+
 struct proc {
-    struct adjslot_list asl;
     int pid;
     uid_t uid;
+    struct uid_stats *app;
     int oomadj;
-    struct proc *pidhash_next;
+    int oom_score_adj;      /* as Activity Manager last asked for it */
+    int soft_limit_mult;
+    int rss;                /* in pages, as of the last refresh */
+    int64_t memory_kb;      /* charged to the process's memcg, or rss without one */
+    int64_t swap_kb;
+    char name[LINE_MAX];    /* empty until it could be read */
+    int heap_index;
 };
 
-#define PIDHASH_SZ 1024
-static struct proc *pidhash[PIDHASH_SZ];
-#define pid_hashfn(x) ((((x) >> 8) ^ (x)) & (PIDHASH_SZ - 1))
+/*
+ * Processes live in a fixed pool, so that lmkd never allocates while memory is short. They are
+ * found by pid through an open-addressed table of pool indices, kept at most half full.
+ */
+#define MAX_PROCS 1024
+#define PID_TABLE_BITS 11
+#define PID_TABLE_SIZE (1 << PID_TABLE_BITS)
+static struct proc proc_pool[MAX_PROCS];
+static int proc_free_list[MAX_PROCS];  /* indices of unused entries in proc_pool */
+static int proc_free_count;
+static int pid_table[PID_TABLE_SIZE];  /* index into proc_pool plus one, or 0 if unused */
 
-#define ADJTOSLOT(adj) ((adj) + -OOM_SCORE_ADJ_MIN)
-static struct adjslot_list procadjslot_list[ADJTOSLOT(OOM_SCORE_ADJ_MAX) + 1];
+/*
+ * Every process, in a max-heap ordered by oomadj and then by rss, so the best process to
+ * kill is always at the top.
+ */
+static struct proc *proc_heap[MAX_PROCS];
+static int proc_heap_size;
+
+/* Cached rss is refreshed for this many processes every ro.lmk.rss_refresh_ms. */
+#define PROC_REFRESH_BATCH 32
+static int rss_refresh_ms;
+static int refresh_timer_fd = -1;
+static int refresh_next;
+
+/*
+ * Killed processes whose memory hasn't been freed yet. Killing more until it is would kill
+ * for the same shortage twice, so pressure events wait for these first.
+ */
+#define MAX_KILLS_IN_FLIGHT 8
+#define KILL_POLL_MS 20
+struct kill_in_flight {
+    int pid;
+    int64_t size_kb;
+    int64_t start_ms;
+};
+static struct kill_in_flight kills_in_flight[MAX_KILLS_IN_FLIGHT];
+static int kills_in_flight_count;
+static int kill_timer_fd = -1;
+static int kill_timeout_ms;
+static int kill_batch_max;
 
 /* PAGE_SIZE / 1024 */
 static long page_k;
@@ -153,76 +271,287 @@ static ssize_t read_all(int fd, char *buf, size_t max_len)
     return ret;
 }
 
-static struct proc *pid_lookup(int pid) {
-    struct proc *procp;
+static int64_t now_ms(void) {
+    struct timespec now;
 
-    for (procp = pidhash[pid_hashfn(pid)]; procp && procp->pid != pid;
-         procp = procp->pidhash_next)
-            ;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
 
-    return procp;
+static int proc_get_size(int pid) {
+    char path[PATH_MAX];
+    char line[LINE_MAX];
+    int fd;
+    int rss = 0;
+    int total;
+    ssize_t ret;
+
+    snprintf(path, PATH_MAX, "/proc/%d/statm", pid);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    ret = read_all(fd, line, sizeof(line) - 1);
+    if (ret < 0) {
+        close(fd);
+        return -1;
+    }
+
+    sscanf(line, "%d %d ", &total, &rss);
+    close(fd);
+    return rss;
 }
 
-static void adjslot_insert(struct adjslot_list *head, struct adjslot_list *new)
-{
-    struct adjslot_list *next = head->next;
-    new->prev = head;
-    new->next = next;
-    next->prev = new;
-    head->next = new;
+/* Reads a memcg usage file, in kB. Returns -1 if there is no such memcg. */
+static int64_t memcg_read_kb(const char *path) {
+    char buf[32];
+    int64_t bytes;
+    int fd;
+    ssize_t ret;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    ret = read_all(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (ret <= 0)
+        return -1;
+    buf[ret] = '\0';
+
+    bytes = strtoll(buf, NULL, 10);
+    return bytes / 1024;
 }
 
-static void adjslot_remove(struct adjslot_list *old)
-{
-    struct adjslot_list *prev = old->prev;
-    struct adjslot_list *next = old->next;
-    next->prev = prev;
-    prev->next = next;
+/* Reads the memory and swap charged to the memcg at |dir|. Returns -1 without one. */
+static int memcg_read_usage(const char *dir, int64_t *memory_kb, int64_t *swap_kb) {
+    char path[PATH_MAX];
+    int64_t memsw_kb;
+
+    snprintf(path, sizeof(path), "%s/memory.usage_in_bytes", dir);
+    *memory_kb = memcg_read_kb(path);
+    if (*memory_kb < 0)
+        return -1;
+
+    // memsw counts memory and swap together, and is missing without swap accounting.
+    snprintf(path, sizeof(path), "%s/memory.memsw.usage_in_bytes", dir);
+    memsw_kb = memcg_read_kb(path);
+    *swap_kb = memsw_kb > *memory_kb ? memsw_kb - *memory_kb : 0;
+    return 0;
+}
+
+static struct uid_stats *uid_stats_get(uid_t uid) {
+    struct uid_stats **head = &uidhash[uid % UIDHASH_SZ];
+    struct uid_stats *app;
+
+    for (app = *head; app && app->uid != uid; app = app->hash_next)
+        ;
+    if (app)
+        return app;
+
+    if (uid_pool_used == MAX_APPS)
+        return NULL;
+    app = &uid_pool[uid_pool_used++];
+    app->uid = uid;
+    app->hash_next = *head;
+    *head = app;
+    return app;
+}
+
+/*
+ * How much it hurts the user to kill a process and have it come back. Processes the user can
+ * see or feel cost the most, and an app that keeps getting relaunched after kills costs more
+ * each time.
+ */
+static int relaunch_cost(const struct proc *procp) {
+    int cost;
+    int relaunches = procp->app ? procp->app->relaunches : 0;
+
+    if (procp->oomadj >= 900)
+        cost = 1;       /* cached */
+    else if (procp->oomadj >= 800)
+        cost = 2;       /* older services */
+    else if (procp->oomadj >= 500)
+        cost = 4;       /* services, home and the previous app */
+    else if (procp->oomadj >= 200)
+        cost = 16;      /* perceptible */
+    else
+        cost = 64;      /* visible and foreground */
+
+    return cost * (1 + (relaunches < 7 ? relaunches : 7));
+}
+
+static char *proc_get_name(int pid) {
+    char path[PATH_MAX];
+    static char line[LINE_MAX];
+    int fd;
+    char *cp;
+    ssize_t ret;
+
+    snprintf(path, PATH_MAX, "/proc/%d/cmdline", pid);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    ret = read_all(fd, line, sizeof(line) - 1);
+    close(fd);
+    if (ret < 0) {
+        return NULL;
+    }
+    line[ret] = '\0';
+
+    cp = strchr(line, ' ');
+    if (cp)
+        *cp = '\0';
+
+    return line;
 }
 
-static struct adjslot_list *adjslot_tail(struct adjslot_list *head) {
-    struct adjslot_list *asl = head->prev;
+static bool proc_heap_above(struct proc *a, struct proc *b) {
+    return a->oomadj > b->oomadj || (a->oomadj == b->oomadj && a->rss > b->rss);
+}
 
-    return asl == head ? NULL : asl;
+static void proc_heap_set(int index, struct proc *procp) {
+    proc_heap[index] = procp;
+    procp->heap_index = index;
 }
 
-static void proc_slot(struct proc *procp) {
-    int adjslot = ADJTOSLOT(procp->oomadj);
+/* Restores the heap order after the key of the process at |index| changed. */
+static void proc_heap_fix(int index) {
+    struct proc *procp = proc_heap[index];
 
-    adjslot_insert(&procadjslot_list[adjslot], &procp->asl);
+    while (index > 0 && proc_heap_above(procp, proc_heap[(index - 1) / 2])) {
+        proc_heap_set(index, proc_heap[(index - 1) / 2]);
+        index = (index - 1) / 2;
+    }
+    while (2 * index + 1 < proc_heap_size) {
+        int child = 2 * index + 1;
+
+        if (child + 1 < proc_heap_size && proc_heap_above(proc_heap[child + 1], proc_heap[child]))
+            child++;
+        if (!proc_heap_above(proc_heap[child], procp))
+            break;
+        proc_heap_set(index, proc_heap[child]);
+        index = child;
+    }
+    proc_heap_set(index, procp);
 }
 
-static void proc_unslot(struct proc *procp) {
-    adjslot_remove(&procp->asl);
+static void proc_heap_insert(struct proc *procp) {
+    proc_heap_set(proc_heap_size++, procp);
+    proc_heap_fix(procp->heap_index);
 }
 
-static void proc_insert(struct proc *procp) {
-    int hval = pid_hashfn(procp->pid);
+static void proc_heap_remove(struct proc *procp) {
+    int index = procp->heap_index;
 
-    procp->pidhash_next = pidhash[hval];
-    pidhash[hval] = procp;
-    proc_slot(procp);
+    proc_heap_size--;
+    if (index == proc_heap_size)
+        return;
+    proc_heap_set(index, proc_heap[proc_heap_size]);
+    proc_heap_fix(index);
 }
 
-static int pid_remove(int pid) {
-    int hval = pid_hashfn(pid);
+/* Reads the name and size of |procp| now, so that killing it doesn't have to. */
+static void proc_refresh(struct proc *procp) {
+    char path[PATH_MAX];
+    int rss;
+
+    if (!procp->name[0]) {
+        char *taskname = proc_get_name(procp->pid);
+
+        if (taskname)
+            strlcpy(procp->name, taskname, sizeof(procp->name));
+    }
+
+    rss = proc_get_size(procp->pid);
+    if (rss >= 0 && rss != procp->rss) {
+        procp->rss = rss;
+        proc_heap_fix(procp->heap_index);
+    }
+
+    // libprocessgroup puts each app process in its own memcg, which also counts the page
+    // cache and swap that the process is charged for.
+    snprintf(path, sizeof(path), MEMCG_PROCESS_PATH, procp->uid, procp->pid);
+    if (memcg_read_usage(path, &procp->memory_kb, &procp->swap_kb)) {
+        procp->memory_kb = (int64_t)procp->rss * page_k;
+        procp->swap_kb = 0;
+    }
+
+    if (procp->app) {
+        snprintf(path, sizeof(path), MEMCG_APP_PATH, procp->uid);
+        if (memcg_read_usage(path, &procp->app->memory_kb, &procp->app->swap_kb))
+            procp->app->memory_kb = procp->app->swap_kb = 0;
+    }
+}
+
+static int pid_table_home(int pid) {
+    return ((uint32_t)pid * 2654435761u) >> (32 - PID_TABLE_BITS);
+}
+
+/* The slot of |pid| in pid_table, or of the unused slot where it would go. */
+static int pid_table_find(int pid) {
+    int slot = pid_table_home(pid);
+
+    while (pid_table[slot] && proc_pool[pid_table[slot] - 1].pid != pid)
+        slot = (slot + 1) & (PID_TABLE_SIZE - 1);
+    return slot;
+}
+
+static struct proc *pid_lookup(int pid) {
+    int slot = pid_table_find(pid);
+
+    return pid_table[slot] ? &proc_pool[pid_table[slot] - 1] : NULL;
+}
+
+static void proc_pool_init(void) {
+    int i;
+
+    for (i = 0; i < MAX_PROCS; i++)
+        proc_free_list[i] = MAX_PROCS - 1 - i;
+    proc_free_count = MAX_PROCS;
+}
+
+/* Takes an entry from the pool for |pid|, and adds it to the table and the heap. */
+static struct proc *proc_insert(int pid) {
     struct proc *procp;
-    struct proc *prevp;
 
-    for (procp = pidhash[hval], prevp = NULL; procp && procp->pid != pid;
-         procp = procp->pidhash_next)
-            prevp = procp;
+    if (!proc_free_count)
+        return NULL;
+    procp = &proc_pool[proc_free_list[--proc_free_count]];
+    memset(procp, 0, sizeof(*procp));
+    procp->pid = pid;
+
+    pid_table[pid_table_find(pid)] = procp - proc_pool + 1;
+    proc_heap_insert(procp);
+    return procp;
+}
 
-    if (!procp)
+static int pid_remove(int pid) {
+    int slot = pid_table_find(pid);
+    int next = slot;
+    struct proc *procp;
+
+    if (!pid_table[slot])
         return -1;
+    procp = &proc_pool[pid_table[slot] - 1];
 
-    if (!prevp)
-        pidhash[hval] = procp->pidhash_next;
-    else
-        prevp->pidhash_next = procp->pidhash_next;
+    // Move back the entries after the removed one that it kept from their home slot, so that
+    // lookups need no tombstones.
+    for (;;) {
+        int home;
+
+        next = (next + 1) & (PID_TABLE_SIZE - 1);
+        if (!pid_table[next])
+            break;
+        home = pid_table_home(proc_pool[pid_table[next] - 1].pid);
+        if (((next - home) & (PID_TABLE_SIZE - 1)) >= ((next - slot) & (PID_TABLE_SIZE - 1))) {
+            pid_table[slot] = pid_table[next];
+            slot = next;
+        }
+    }
+    pid_table[slot] = 0;
 
-    proc_unslot(procp);
-    free(procp);
+    proc_heap_remove(procp);
+    proc_free_list[proc_free_count++] = procp - proc_pool;
     return 0;
 }
 
@@ -251,12 +580,19 @@ static void cmd_procprio(int pid, int uid, int oomadj) {
     char path[80];
     char val[20];
     int soft_limit_mult;
+    int oom_score_adj = oomadj;
 
     if (oomadj < OOM_SCORE_ADJ_MIN || oomadj > OOM_SCORE_ADJ_MAX) {
         ALOGE("Invalid PROCPRIO oomadj argument %d", oomadj);
         return;
     }
 
+    // Activity Manager resends every process's priority when any of them changes, so most
+    // updates change nothing.
+    procp = use_inkernel_interface ? NULL : pid_lookup(pid);
+    if (procp && procp->uid == (uid_t)uid && procp->oom_score_adj == oom_score_adj)
+        return;
+
     snprintf(path, sizeof(path), "/proc/%d/oom_score_adj", pid);
     snprintf(val, sizeof(val), "%d", oomadj);
     writefilestring(path, val);
@@ -292,27 +628,42 @@ static void cmd_procprio(int pid, int uid, int oomadj) {
         soft_limit_mult = 64;
     }
 
-    snprintf(path, sizeof(path), "/dev/memcg/apps/uid_%d/pid_%d/memory.soft_limit_in_bytes", uid, pid);
-    snprintf(val, sizeof(val), "%d", soft_limit_mult * EIGHT_MEGA);
-    writefilestring(path, val);
+    if (!procp || procp->uid != (uid_t)uid || procp->soft_limit_mult != soft_limit_mult) {
+        snprintf(path, sizeof(path), "/dev/memcg/apps/uid_%d/pid_%d/memory.soft_limit_in_bytes",
+                 uid, pid);
+        snprintf(val, sizeof(val), "%d", soft_limit_mult * EIGHT_MEGA);
+        writefilestring(path, val);
+    }
 
-    procp = pid_lookup(pid);
     if (!procp) {
-            procp = malloc(sizeof(struct proc));
-            if (!procp) {
-                // Oh, the irony.  May need to rebuild our state.
-                return;
-            }
+        procp = proc_insert(pid);
+        if (!procp) {
+            ALOGE("Too many processes to track pid %d", pid);
+            return;
+        }
 
-            procp->pid = pid;
-            procp->uid = uid;
-            procp->oomadj = oomadj;
-            proc_insert(procp);
+        procp->uid = uid;
+        procp->oomadj = oomadj;
+        proc_heap_fix(procp->heap_index);
+        procp->app = uid_stats_get(uid);
+        if (procp->app && procp->app->last_kill_ms &&
+            now_ms() - procp->app->last_kill_ms < RELAUNCH_WINDOW_MS) {
+            procp->app->relaunches++;
+            procp->app->last_kill_ms = 0;
+        }
     } else {
-        proc_unslot(procp);
+        if (procp->uid != (uid_t)uid)
+            procp->app = uid_stats_get(uid);
+        procp->uid = uid;
         procp->oomadj = oomadj;
-        proc_slot(procp);
+        proc_heap_fix(procp->heap_index);
     }
+    procp->oom_score_adj = oom_score_adj;
+    procp->soft_limit_mult = soft_limit_mult;
+
+    // Activity Manager only updates priorities when it isn't short of memory, so this is a
+    // good time to read what killing the process will need.
+    proc_refresh(procp);
 }
 
 static void cmd_procremove(int pid) {
@@ -389,6 +740,7 @@ static void ctrl_command_handler(void) {
     int cmd = -1;
     int nargs;
     int targets;
+    int i;
 
     len = ctrl_data_read((char *)ibuf, CTRL_PACKET_MAX);
     if (len <= 0)
@@ -417,6 +769,12 @@ static void ctrl_command_handler(void) {
             goto wronglen;
         cmd_procremove(ntohl(ibuf[1]));
         break;
+    case LMK_PROCPRIO_BATCH:
+        if (nargs % 3)
+            goto wronglen;
+        for (i = 1; i < nargs; i += 3)
+            cmd_procprio(ntohl(ibuf[i]), ntohl(ibuf[i + 1]), ntohl(ibuf[i + 2]));
+        break;
     default:
         ALOGE("Received unknown command code %d", cmd);
         return;
@@ -534,120 +892,216 @@ static int zoneinfo_parse(struct sysmeminfo *mip) {
     return 0;
 }
 
-static int proc_get_size(int pid) {
-    char path[PATH_MAX];
-    char line[LINE_MAX];
-    int fd;
-    int rss = 0;
-    int total;
-    ssize_t ret;
+/* Memory that can be had without reclaiming anything but clean page cache. */
+static int64_t sysmeminfo_available_kb(const struct sysmeminfo *mip) {
+    return (int64_t)(mip->nr_free_pages - mip->totalreserve_pages +
+                     mip->nr_file_pages - mip->nr_shmem) * page_k;
+}
 
-    snprintf(path, PATH_MAX, "/proc/%d/statm", pid);
-    fd = open(path, O_RDONLY | O_CLOEXEC);
-    if (fd == -1)
-        return -1;
+/* Sets |fd| to expire every |period_ms|, or disarms it if |period_ms| is 0. */
+static int timer_set_period(int fd, int period_ms) {
+    struct itimerspec period;
 
-    ret = read_all(fd, line, sizeof(line) - 1);
-    if (ret < 0) {
-        close(fd);
-        return -1;
-    }
+    period.it_interval.tv_sec = period_ms / 1000;
+    period.it_interval.tv_nsec = (period_ms % 1000) * 1000000L;
+    period.it_value = period.it_interval;
+    return timerfd_settime(fd, 0, &period, NULL);
+}
 
-    sscanf(line, "%d %d ", &total, &rss);
-    close(fd);
-    return rss;
+static void kill_track(int pid, int64_t size_kb) {
+    struct kill_in_flight *kill;
+
+    if (kill_timer_fd == -1 || kills_in_flight_count == MAX_KILLS_IN_FLIGHT)
+        return;
+
+    kill = &kills_in_flight[kills_in_flight_count++];
+    kill->pid = pid;
+    kill->size_kb = size_kb;
+    kill->start_ms = now_ms();
+    if (kills_in_flight_count == 1 && timer_set_period(kill_timer_fd, KILL_POLL_MS) == -1) {
+        ALOGE("timerfd_settime for kill tracking failed; errno=%d", errno);
+        kills_in_flight_count = 0;
+    }
 }
 
-static char *proc_get_name(int pid) {
-    char path[PATH_MAX];
-    static char line[LINE_MAX];
-    int fd;
-    char *cp;
-    ssize_t ret;
+/*
+ * A killed process's memory is freed once it has no mm left, which statm shows as an rss of
+ * 0 even while the process is a zombie, or when the process is gone altogether.
+ */
+static void kill_poll_event(uint32_t events __unused) {
+    uint64_t expirations;
+    int64_t now = now_ms();
+    int i = 0;
 
-    snprintf(path, PATH_MAX, "/proc/%d/cmdline", pid);
-    fd = open(path, O_RDONLY | O_CLOEXEC);
-    if (fd == -1)
-        return NULL;
-    ret = read_all(fd, line, sizeof(line) - 1);
-    close(fd);
-    if (ret < 0) {
-        return NULL;
+    if (read(kill_timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        ALOGE("Error reading kill tracking timer; errno=%d", errno);
+
+    while (i < kills_in_flight_count) {
+        struct kill_in_flight *kill = &kills_in_flight[i];
+        int64_t elapsed_ms = now - kill->start_ms;
+
+        if (proc_get_size(kill->pid) > 0) {
+            if (elapsed_ms < kill_timeout_ms) {
+                i++;
+                continue;
+            }
+            ALOGW("Process %d still holds its memory %" PRId64 "ms after being killed",
+                  kill->pid, elapsed_ms);
+        } else if (debug_process_killing) {
+            ALOGI("Process %d freed %" PRId64 "kB in %" PRId64 "ms", kill->pid, kill->size_kb,
+                  elapsed_ms);
+        }
+        *kill = kills_in_flight[--kills_in_flight_count];
     }
 
-    cp = strchr(line, ' ');
-    if (cp)
-        *cp = '\0';
+    if (!kills_in_flight_count && timer_set_period(kill_timer_fd, 0) == -1)
+        ALOGE("timerfd_settime for kill tracking failed; errno=%d", errno);
+}
 
-    return line;
+/* Whether a pressure event should wait for earlier kills to free their memory. */
+static bool waiting_for_kills(void) {
+    if (!kills_in_flight_count)
+        return false;
+    if (debug_process_killing)
+        ALOGI("Waiting for %d killed processes to free their memory", kills_in_flight_count);
+    return true;
 }
 
-static struct proc *proc_adj_lru(int oomadj) {
-    return (struct proc *)adjslot_tail(&procadjslot_list[ADJTOSLOT(oomadj)]);
+static void log_kill(const struct proc *procp, int cost) {
+    android_log_context ctx = create_android_logger(LMKD_KILL_TAG);
+
+    if (!ctx)
+        return;
+    android_log_write_int32(ctx, procp->pid);
+    android_log_write_int32(ctx, procp->uid);
+    android_log_write_int32(ctx, procp->oom_score_adj);
+    android_log_write_int64(ctx, procp->memory_kb);
+    android_log_write_int64(ctx, procp->swap_kb);
+    android_log_write_int32(ctx, cost);
+    android_log_write_int32(ctx, procp->app ? procp->app->kills : 0);
+    android_log_write_int32(ctx, procp->app ? procp->app->relaunches : 0);
+    android_log_write_list(ctx, LOG_ID_EVENTS);
+    android_log_destroy(&ctx);
 }
 
 /* Kill one process specified by procp.  Returns the size of the process killed */
 static int kill_one_process(struct proc* procp, int min_score_adj, bool is_critical) {
     int pid = procp->pid;
     uid_t uid = procp->uid;
-    char *taskname;
-    int tasksize;
+    int tasksize = procp->rss;
+    int cost = relaunch_cost(procp);
     int r;
 
-    taskname = proc_get_name(pid);
-    if (!taskname) {
+    r = kill(pid, SIGKILL);
+    if (r) {
+        // The process is gone, and Activity Manager just hasn't told us yet.
+        ALOGE("kill(%d): errno=%d", pid, errno);
         pid_remove(pid);
         return -1;
     }
 
-    tasksize = proc_get_size(pid);
-    if (tasksize <= 0) {
-        pid_remove(pid);
-        return -1;
+    if (procp->app) {
+        procp->app->kills++;
+        procp->app->last_kill_ms = now_ms();
     }
 
     ALOGI(
-        "Killing '%s' (%d), uid %d, adj %d\n"
-        "   to free %ldkB because system is under %s memory pressure oom_adj %d\n",
-        taskname, pid, uid, procp->oomadj, tasksize * page_k, is_critical ? "critical" : "medium",
-        min_score_adj);
-    r = kill(pid, SIGKILL);
+        "Killed '%s' (%d), uid %d, adj %d\n"
+        "   to free %ldkB (memcg %" PRId64 "kB, swap %" PRId64 "kB, relaunch cost %d)"
+        " because system is under %s memory pressure oom_adj %d\n",
+        procp->name[0] ? procp->name : "<unknown>", pid, uid, procp->oomadj,
+        tasksize * page_k, procp->memory_kb, procp->swap_kb, cost,
+        is_critical ? "critical" : "medium", min_score_adj);
+    log_kill(procp, cost);
+    kill_track(pid, tasksize * page_k);
     pid_remove(pid);
+    return tasksize;
+}
 
-    if (r) {
-        ALOGE("kill(%d): errno=%d", procp->pid, errno);
-        return -1;
-    } else {
-        return tasksize;
+/*
+ * The process at or above |min_score_adj| whose kill frees the most memory for its relaunch
+ * cost. There are only a few hundred processes, and everything compared is cached.
+ */
+static struct proc *proc_cheapest_victim(int min_score_adj) {
+    struct proc *best = NULL;
+    int best_cost = 0;
+    int i;
+
+    for (i = 0; i < proc_heap_size; i++) {
+        struct proc *procp = proc_heap[i];
+        int cost;
+
+        if (procp->oomadj < min_score_adj)
+            continue;
+        cost = relaunch_cost(procp);
+        if (!best || procp->memory_kb * best_cost > best->memory_kb * cost) {
+            best = procp;
+            best_cost = cost;
+        }
     }
+    return best;
 }
 
 /*
- * Find a process to kill based on the current (possibly estimated) free memory
- * and cached memory sizes.  Returns the size of the killed processes.
+ * How far the memory that is easy to get is below what Activity Manager asked to keep free
+ * before processes at |min_score_adj| are killed, or 0 if it isn't.
  */
-static int find_and_kill_process(bool is_critical) {
+static int64_t memory_deficit_kb(int min_score_adj) {
+    struct sysmeminfo mi;
+    int64_t minfree_kb = 0;
     int i;
-    int killed_size = 0;
+
+    // Targets are in increasing order of adj and minfree.
+    for (i = 0; i < lowmem_targets_size; i++) {
+        if (lowmem_adj[i] >= min_score_adj) {
+            minfree_kb = (int64_t)lowmem_minfree[i] * page_k;
+            break;
+        }
+    }
+    if (!minfree_kb || zoneinfo_parse(&mi))
+        return 0;
+
+    return minfree_kb > sysmeminfo_available_kb(&mi) ? minfree_kb - sysmeminfo_available_kb(&mi)
+                                                       : 0;
+}
+
+/*
+ * Find processes to kill based on the current (possibly estimated) free memory
+ * and cached memory sizes.  Kills one process, or up to ro.lmk.kill_batch_max of
+ * them to cover |deficit_kb|.  Returns the size of the killed processes.
+ */
+static int find_and_kill_process(bool is_critical, int64_t deficit_kb) {
     int min_score_adj = is_critical ? critical_oomadj : medium_oomadj;
+    int killed_size = 0;
+    int kills = 0;
 
-    for (i = OOM_SCORE_ADJ_MAX; i >= min_score_adj; i--) {
+    while (kills < kill_batch_max) {
         struct proc *procp;
+        int size;
+
+        // The heap puts the process with the highest oomadj first, and the largest of those.
+        if (kill_by_cost)
+            procp = proc_cheapest_victim(min_score_adj);
+        else
+            procp = proc_heap_size && proc_heap[0]->oomadj >= min_score_adj ? proc_heap[0] : NULL;
+        if (!procp)
+            break;
 
-retry:
-        procp = proc_adj_lru(i);
+        size = kill_one_process(procp, min_score_adj, is_critical);
 
-        if (procp) {
-            killed_size = kill_one_process(procp, min_score_adj, is_critical);
-            if (killed_size < 0) {
-                goto retry;
-            } else {
-                return killed_size;
-            }
-        }
+        if (size < 0)
+            continue;
+        killed_size += size;
+        kills++;
+        if (killed_size * page_k >= deficit_kb)
+            break;
     }
 
-    return 0;
+    if (kills > 1) {
+        ALOGI("Killed %d processes to free %ldkB of a %" PRId64 "kB deficit", kills,
+              killed_size * page_k, deficit_kb);
+    }
+    return killed_size;
 }
 
 static int64_t get_memory_usage(const char* path) {
@@ -680,16 +1134,20 @@ static void mp_event_common(bool is_critical) {
     int index = is_critical ? CRITICAL_INDEX : MEDIUM_INDEX;
     int64_t mem_usage, memsw_usage;
     int64_t mem_pressure;
+    int64_t deficit_kb;
 
     ret = read(mpevfd[index], &evcount, sizeof(evcount));
     if (ret < 0)
         ALOGE("Error reading memory pressure event fd; errno=%d",
               errno);
 
+    if (waiting_for_kills())
+        return;
+
     mem_usage = get_memory_usage(MEMCG_MEMORY_USAGE);
     memsw_usage = get_memory_usage(MEMCG_MEMORYSW_USAGE);
     if (memsw_usage < 0 || mem_usage < 0) {
-        find_and_kill_process(is_critical);
+        find_and_kill_process(is_critical, 0);
         return;
     }
 
@@ -719,7 +1177,8 @@ static void mp_event_common(bool is_critical) {
         is_critical = false;
     }
 
-    if (find_and_kill_process(is_critical) == 0) {
+    deficit_kb = memory_deficit_kb(is_critical ? critical_oomadj : medium_oomadj);
+    if (find_and_kill_process(is_critical, deficit_kb) == 0) {
         if (debug_process_killing) {
             ALOGI("Nothing to kill");
         }
@@ -734,6 +1193,171 @@ static void mp_event_critical(uint32_t events __unused) {
     mp_event_common(true);
 }
 
+static int vmstat_parse(struct mem_sample *sample) {
+    char buf[PAGE_SIZE * 2];
+    char *save_ptr;
+    char *line;
+    int fd;
+    ssize_t size;
+
+    fd = open(VMSTAT_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        ALOGE("%s open: errno=%d", VMSTAT_PATH, errno);
+        return -1;
+    }
+
+    size = read_all(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (size < 0) {
+        ALOGE("%s read: errno=%d", VMSTAT_PATH, errno);
+        return -1;
+    }
+    buf[size] = 0;
+
+    /* Older kernels count scanning and stealing per zone, as pgscan_direct_normal and so on. */
+    for (line = strtok_r(buf, "\n", &save_ptr); line; line = strtok_r(NULL, "\n", &save_ptr)) {
+        char *value = strchr(line, ' ');
+        int64_t *counter;
+
+        if (!value)
+            continue;
+        *value++ = '\0';
+
+        if (!strncmp(line, "pgscan_direct", 13) && strcmp(line, "pgscan_direct_throttle"))
+            counter = &sample->pgscan_direct;
+        else if (!strncmp(line, "pgscan_kswapd", 13))
+            counter = &sample->pgscan_kswapd;
+        else if (!strncmp(line, "pgsteal_direct", 14) || !strncmp(line, "pgsteal_kswapd", 14))
+            counter = &sample->pgsteal;
+        else
+            continue;
+        *counter += strtoll(value, NULL, 10);
+    }
+    return 0;
+}
+
+/* Returns the total time in microseconds that some task stalled on memory, or -1. */
+static int64_t psi_read_stall_us(void) {
+    char buf[256];
+    char *total;
+    int fd;
+    ssize_t size;
+
+    fd = open(PSI_MEMORY_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    size = read_all(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (size < 0)
+        return -1;
+    buf[size] = 0;
+
+    /* The first line is "some avg10=... avg60=... avg300=... total=<us>". */
+    if (strncmp(buf, "some ", 5) || !(total = strstr(buf, "total=")))
+        return -1;
+    return strtoll(total + 6, NULL, 10);
+}
+
+static int mem_sample_read(struct mem_sample *sample) {
+    struct sysmeminfo mi;
+
+    memset(sample, 0, sizeof(*sample));
+    sample->time_ms = now_ms();
+    sample->stall_us = psi_read_stall_us();
+
+    if (vmstat_parse(sample) || zoneinfo_parse(&mi))
+        return -1;
+    sample->available_kb = sysmeminfo_available_kb(&mi);
+    return 0;
+}
+
+static void pressure_predict_event(uint32_t events __unused) {
+    uint64_t expirations;
+    struct mem_sample *oldest;
+    struct mem_sample *newest;
+    int64_t elapsed_ms;
+    int64_t scanned_direct, scanned, stolen;
+    int64_t stall_pct, efficiency_pct;
+    int64_t available_rate_kb, predicted_kb, deficit_kb;
+    bool is_medium, is_critical;
+
+    if (read(predict_timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        ALOGE("Error reading pressure prediction timer; errno=%d", errno);
+
+    newest = &mem_samples[mem_sample_next];
+    if (mem_sample_read(newest))
+        return;
+    mem_sample_next = (mem_sample_next + 1) % mem_window_size;
+    if (mem_sample_count < mem_window_size)
+        mem_sample_count++;
+    if (mem_sample_count < 2)
+        return;
+
+    /* With a full window, the next slot to overwrite holds the oldest sample. */
+    oldest = &mem_samples[mem_sample_count < mem_window_size ? 0 : mem_sample_next];
+    elapsed_ms = newest->time_ms - oldest->time_ms;
+    if (elapsed_ms <= 0)
+        return;
+
+    scanned_direct = newest->pgscan_direct - oldest->pgscan_direct;
+    scanned = scanned_direct + newest->pgscan_kswapd - oldest->pgscan_kswapd;
+    stolen = newest->pgsteal - oldest->pgsteal;
+
+    if (newest->stall_us >= 0 && oldest->stall_us >= 0)
+        stall_pct = (newest->stall_us - oldest->stall_us) / 10 / elapsed_ms;
+    else if (scanned * page_k >= MIN_SCANNED_FOR_STALL_KB)
+        stall_pct = scanned_direct * 100 / scanned;
+    else
+        stall_pct = 0;
+    efficiency_pct = scanned ? stolen * 100 / scanned : 100;
+
+    /* Extrapolate the fall in available memory over the window to the horizon. */
+    available_rate_kb = (newest->available_kb - oldest->available_kb) * 1000 / elapsed_ms;
+    predicted_kb = newest->available_kb;
+    if (available_rate_kb < 0)
+        predicted_kb += available_rate_kb * predict_horizon_ms / 1000;
+
+    is_critical = stall_pct >= stall_critical_pct ||
+                  (predict_critical_kb && predicted_kb < predict_critical_kb);
+    is_medium = is_critical || stall_pct >= stall_medium_pct ||
+                (predict_medium_kb && predicted_kb < predict_medium_kb);
+    if (!is_medium)
+        return;
+
+    /* Reclaim that scans much more than it frees is thrashing the page cache. */
+    if (!is_critical && scanned && efficiency_pct < min_reclaim_efficiency_pct)
+        is_critical = true;
+
+    if (waiting_for_kills())
+        return;
+
+    ALOGI("Predicted %s memory pressure: %s %" PRId64 "%%, reclaim efficiency %" PRId64
+          "%%, available %" PRId64 "kB changing by %" PRId64 "kB/s, %" PRId64
+          "kB in %dms",
+          is_critical ? "critical" : "medium",
+          newest->stall_us >= 0 ? "stall" : "direct reclaim", stall_pct, efficiency_pct,
+          newest->available_kb, available_rate_kb, predicted_kb, predict_horizon_ms);
+
+    if (is_critical && predict_critical_kb && predicted_kb < predict_critical_kb)
+        deficit_kb = predict_critical_kb - predicted_kb;
+    else if (predict_medium_kb && predicted_kb < predict_medium_kb)
+        deficit_kb = predict_medium_kb - predicted_kb;
+    else
+        deficit_kb = memory_deficit_kb(is_critical ? critical_oomadj : medium_oomadj);
+
+    if (find_and_kill_process(is_critical, deficit_kb) == 0) {
+        if (debug_process_killing) {
+            ALOGI("Nothing to kill");
+        }
+        return;
+    }
+
+    /* Judge what happens after the kill by itself, rather than with the samples that led to it. */
+    mem_sample_count = 0;
+    mem_sample_next = 0;
+}
+
 static int init_mp_common(char *levelstr, void *event_handler, bool is_critical)
 {
     int mpfd;
@@ -806,9 +1430,77 @@ static int init_mp_critical()
     return init_mp_common(MEMPRESSURE_WATCH_CRITICAL_LEVEL, (void *)&mp_event_critical, true);
 }
 
-static int init(void) {
+/*
+ * Calls |event_handler| every |period_ms| from the main loop, or once the timer is armed if
+ * |period_ms| is 0. Returns the timerfd, or -1.
+ */
+static int init_timer(int period_ms, void *event_handler, const char *name)
+{
     struct epoll_event epev;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        ALOGE("timerfd_create for %s failed; errno=%d", name, errno);
+        return -1;
+    }
+
+    if (timer_set_period(fd, period_ms) == -1) {
+        ALOGE("timerfd_settime for %s failed; errno=%d", name, errno);
+        goto err;
+    }
+
+    epev.events = EPOLLIN;
+    epev.data.ptr = event_handler;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &epev) == -1) {
+        ALOGE("epoll_ctl for %s failed; errno=%d", name, errno);
+        goto err;
+    }
+    maxevents++;
+    return fd;
+
+err:
+    close(fd);
+    return -1;
+}
+
+static int init_pressure_predict(void)
+{
+    predict_timer_fd = init_timer(predict_period_ms, (void *)pressure_predict_event,
+                                  "pressure prediction");
+    if (predict_timer_fd == -1)
+        return -1;
+
+    mem_window_size = predict_window_ms / predict_period_ms + 1;
+    if (mem_window_size < 2)
+        mem_window_size = 2;
+    if (mem_window_size > MAX_MEM_SAMPLES)
+        mem_window_size = MAX_MEM_SAMPLES;
+
+    ALOGI("Predicting memory pressure every %dms over %dms%s", predict_period_ms,
+          (mem_window_size - 1) * predict_period_ms,
+          psi_read_stall_us() >= 0 ? " using PSI" : "");
+    return 0;
+}
+
+static void proc_refresh_event(uint32_t events __unused) {
+    uint64_t expirations;
     int i;
+
+    if (read(refresh_timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        ALOGE("Error reading process refresh timer; errno=%d", errno);
+
+    // Refreshing reorders the heap, so a process may be skipped or seen twice in a round.
+    // Every one is still refreshed every few rounds, which is all a cache needs.
+    for (i = 0; i < PROC_REFRESH_BATCH && proc_heap_size; i++) {
+        if (refresh_next >= proc_heap_size)
+            refresh_next = 0;
+        proc_refresh(proc_heap[refresh_next++]);
+    }
+}
+
+static int init(void) {
+    struct epoll_event epev;
     int ret;
 
     page_k = sysconf(_SC_PAGESIZE);
@@ -844,6 +1536,7 @@ static int init(void) {
 
     has_inkernel_module = !access(INKERNEL_MINFREE_PATH, W_OK);
     use_inkernel_interface = has_inkernel_module && !is_go_device;
+    proc_pool_init();
 
     if (use_inkernel_interface) {
         ALOGI("Using in-kernel low memory killer interface");
@@ -852,11 +1545,12 @@ static int init(void) {
         ret |= init_mp_critical();
         if (ret)
             ALOGE("Kernel does not support memory pressure events or in-kernel low memory killer");
-    }
-
-    for (i = 0; i <= ADJTOSLOT(OOM_SCORE_ADJ_MAX); i++) {
-        procadjslot_list[i].next = &procadjslot_list[i];
-        procadjslot_list[i].prev = &procadjslot_list[i];
+        if (enable_pressure_predict)
+            init_pressure_predict();
+        if (rss_refresh_ms > 0)
+            refresh_timer_fd = init_timer(rss_refresh_ms, (void *)proc_refresh_event,
+                                          "process refresh");
+        kill_timer_fd = init_timer(0, (void *)kill_poll_event, "kill tracking");
     }
 
     return 0;
@@ -899,6 +1593,23 @@ int main(int argc __unused, char **argv __unused) {
     upgrade_pressure = (int64_t)property_get_int32("ro.lmk.upgrade_pressure", 50);
     downgrade_pressure = (int64_t)property_get_int32("ro.lmk.downgrade_pressure", 60);
     is_go_device = property_get_bool("ro.config.low_ram", false);
+    enable_pressure_predict = property_get_bool("ro.lmk.predict", false);
+    predict_period_ms = property_get_int32("ro.lmk.predict_period_ms", 200);
+    if (predict_period_ms <= 0)
+        predict_period_ms = 200;
+    predict_window_ms = property_get_int32("ro.lmk.predict_window_ms", 2000);
+    predict_horizon_ms = property_get_int32("ro.lmk.predict_horizon_ms", 1000);
+    stall_medium_pct = property_get_int32("ro.lmk.stall_medium", 10);
+    stall_critical_pct = property_get_int32("ro.lmk.stall_critical", 40);
+    min_reclaim_efficiency_pct = property_get_int32("ro.lmk.min_reclaim_efficiency", 20);
+    predict_medium_kb = (int64_t)property_get_int32("ro.lmk.predict_medium_kb", 0);
+    predict_critical_kb = (int64_t)property_get_int32("ro.lmk.predict_critical_kb", 0);
+    rss_refresh_ms = property_get_int32("ro.lmk.rss_refresh_ms", 2000);
+    kill_timeout_ms = property_get_int32("ro.lmk.kill_timeout_ms", 500);
+    kill_batch_max = property_get_int32("ro.lmk.kill_batch_max", 3);
+    kill_by_cost = property_get_bool("ro.lmk.kill_by_cost", false);
+    if (kill_batch_max < 1)
+        kill_batch_max = 1;
 
     mlockall(MCL_FUTURE);
     sched_setscheduler(0, SCHED_FIFO, &param);
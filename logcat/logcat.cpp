@@ -32,11 +32,14 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <memory>
+#include <new>
 #include <string>
 #include <vector>
 
@@ -108,6 +111,10 @@ struct android_logcat_context_internal {
     // 0 means "unbounded"
     size_t maxRotatedLogs;
     size_t outByteCount;
+    // page aligned staging for output to rotated files, nullptr otherwise
+    char* outBuf;
+    size_t outBufLen;
+    time_t outBufSince;  // CLOCK_MONOTONIC seconds of oldest staged byte
     int printBinary;
     int devCount;  // >1 means multiple
     pcrecpp::RE* regex;
@@ -117,6 +124,9 @@ struct android_logcat_context_internal {
     size_t maxCount;
     size_t printCount;
 
+    // 0 means decode and print on the reading thread
+    size_t parallel;
+
     bool printItAnyways;
     bool debug;
     bool hasOpenedEventTagMap;
@@ -160,7 +170,72 @@ static int openLogFile(const char* pathname) {
     return open(pathname, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
 }
 
+// Output to rotated files is staged and written out in large page aligned
+// chunks. While lines keep coming none is held back for more than about a
+// second, a quiet tail goes out with the next line, a rotation or on exit.
+static const size_t outBufSize = 64 * 1024;
+static const time_t outBufMaxAge = 1;
+
+static time_t monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static void flushOutput(android_logcat_context_internal* context) {
+    const char* buf = context->outBuf;
+    size_t len = context->outBufLen;
+
+    context->outBufLen = 0;
+    while (len && (context->output_fd >= 0)) {
+        ssize_t ret = TEMP_FAILURE_RETRY(write(context->output_fd, buf, len));
+        if (ret <= 0) {
+            fprintf(stderr, "+++ LOG: write failed (errno=%d)\n", errno);
+            break;
+        }
+        buf += ret;
+        len -= ret;
+    }
+}
+
+static ssize_t writeOutput(android_logcat_context_internal* context,
+                           const void* buf, size_t len) {
+    if (!context->outBuf) {
+        return TEMP_FAILURE_RETRY(write(context->output_fd, buf, len));
+    }
+
+    if (len > (outBufSize - context->outBufLen)) flushOutput(context);
+    if (len >= outBufSize) {
+        return TEMP_FAILURE_RETRY(write(context->output_fd, buf, len));
+    }
+
+    time_t now = monotonicSeconds();
+    if (!context->outBufLen) context->outBufSince = now;
+    memcpy(context->outBuf + context->outBufLen, buf, len);
+    context->outBufLen += len;
+    if ((context->outBufLen == outBufSize) ||
+        ((now - context->outBufSince) >= outBufMaxAge)) {
+        flushOutput(context);
+    }
+    return len;
+}
+
+// Reserve the blocks of the whole segment up front, so the filesystem does
+// not have to find one more extent for every few lines appended. The file
+// size is kept, readers and the restart accounting only see what is written.
+static void preallocateLogFile(android_logcat_context_internal* context) {
+    size_t size = context->logRotateSizeKBytes * 1024;
+
+    if ((context->output_fd < 0) || (context->outByteCount >= size)) return;
+    // Best effort, not every filesystem supports it.
+    TEMP_FAILURE_RETRY(fallocate(context->output_fd, FALLOC_FL_KEEP_SIZE,
+                                 context->outByteCount,
+                                 size - context->outByteCount));
+}
+
 static void close_output(android_logcat_context_internal* context) {
+    if (context->outBufLen) flushOutput(context);
+
     // split output_from_error
     if (context->error == context->output) {
         context->output = nullptr;
@@ -267,6 +342,11 @@ static void rotateLogs(android_logcat_context_internal* context) {
             break;
         }
 
+        // Renaming over an existing file has ext4 and f2fs write back
+        // all of its data first (auto_da_alloc), stalling us for every
+        // segment kept. Drop the file being replaced ahead of the rename.
+        if (!access(file0.c_str(), F_OK)) unlink(file1.c_str());
+
         err = rename(file0.c_str(), file1.c_str());
 
         if (err < 0 && errno != ENOENT) {
@@ -292,12 +372,13 @@ static void rotateLogs(android_logcat_context_internal* context) {
     }
 
     context->outByteCount = 0;
+    preallocateLogFile(context);
 }
 
 void printBinary(android_logcat_context_internal* context, struct log_msg* buf) {
     size_t size = buf->len();
 
-    TEMP_FAILURE_RETRY(write(context->output_fd, buf, size));
+    writeOutput(context, buf, size);
 }
 
 static bool regexOk(android_logcat_context_internal* context,
@@ -309,43 +390,76 @@ static bool regexOk(android_logcat_context_internal* context,
     return context->regex->PartialMatch(messageString);
 }
 
-static void processBuffer(android_logcat_context_internal* context,
-                          log_device_t* dev, struct log_msg* buf) {
-    int bytesWritten = 0;
+static void openEventTagMap(android_logcat_context_internal* context,
+                            bool binary) {
+    if (binary && !context->eventTagMap &&
+        !context->hasOpenedEventTagMap) {
+        context->eventTagMap = android_openEventTagMap(nullptr);
+        context->hasOpenedEventTagMap = true;
+    }
+}
+
+// Decode and filter an entry, true if it is to be printed. match is set if
+// it also counts towards --max-count. Safe to call from several threads
+// once the event tag map has been opened.
+static bool filterBuffer(android_logcat_context_internal* context, bool binary,
+                         struct log_msg* buf, AndroidLogEntry& entry,
+                         char* binaryMsgBuf, size_t binaryMsgBufSize,
+                         bool& match) {
     int err;
-    AndroidLogEntry entry;
-    char binaryMsgBuf[1024];
 
-    if (dev->binary) {
-        if (!context->eventTagMap && !context->hasOpenedEventTagMap) {
-            context->eventTagMap = android_openEventTagMap(nullptr);
-            context->hasOpenedEventTagMap = true;
-        }
+    match = false;
+    if (binary) {
         err = android_log_processBinaryLogBuffer(
             &buf->entry_v1, &entry, context->eventTagMap, binaryMsgBuf,
-            sizeof(binaryMsgBuf));
+            binaryMsgBufSize);
         // printf(">>> pri=%d len=%d msg='%s'\n",
         //    entry.priority, entry.messageLen, entry.message);
     } else {
         err = android_log_processLogBuffer(&buf->entry_v1, &entry);
     }
-    if ((err < 0) && !context->debug) return;
+    if ((err < 0) && !context->debug) return false;
 
-    if (android_log_shouldPrintLine(
+    if (!android_log_shouldPrintLine(
             context->logformat, std::string(entry.tag, entry.tagLen).c_str(),
             entry.priority)) {
-        bool match = regexOk(context, entry);
+        return false;
+    }
+    match = regexOk(context, entry);
+    return match || context->printItAnyways;
+}
 
-        context->printCount += match;
-        if (match || context->printItAnyways) {
-            bytesWritten = android_log_printLogLine(context->logformat,
-                                                    context->output_fd, &entry);
+static int writeLine(android_logcat_context_internal* context,
+                     const char* line, size_t len) {
+    int bytesWritten = writeOutput(context, line, len);
+    if (bytesWritten < 0) {
+        fprintf(stderr, "+++ LOG: write failed (errno=%d)\n", errno);
+        bytesWritten = 0;
+    }
+    return bytesWritten;
+}
 
-            if (bytesWritten < 0) {
-                logcat_panic(context, HELP_FALSE, "output error");
-                return;
-            }
+static void processBuffer(android_logcat_context_internal* context,
+                          log_device_t* dev, struct log_msg* buf) {
+    int bytesWritten = 0;
+    AndroidLogEntry entry;
+    char binaryMsgBuf[1024];
+    bool match;
+
+    openEventTagMap(context, dev->binary);
+    bool print = filterBuffer(context, dev->binary, buf, entry, binaryMsgBuf,
+                              sizeof(binaryMsgBuf), match);
+    context->printCount += match;
+    if (print) {
+        // as android_log_printLogLine(), without a malloc per long line
+        size_t len;
+        const char* line =
+            android_log_formatLogLineArena(context->logformat, &entry, &len);
+        if (!line) {
+            logcat_panic(context, HELP_FALSE, "output error");
+            return;
         }
+        bytesWritten = writeLine(context, line, len);
     }
 
     context->outByteCount += bytesWritten;
@@ -363,7 +477,7 @@ static void maybePrintStart(android_logcat_context_internal* context,
             char buf[1024];
             snprintf(buf, sizeof(buf), "--------- %s %s\n",
                      dev->printed ? "switch to" : "beginning of", dev->device);
-            if (write(context->output_fd, buf, strlen(buf)) < 0) {
+            if (writeOutput(context, buf, strlen(buf)) < 0) {
                 logcat_panic(context, HELP_FALSE, "output error");
                 return;
             }
@@ -372,6 +486,370 @@ static void maybePrintStart(android_logcat_context_internal* context,
     }
 }
 
+static log_device_t* findDevice(android_logcat_context_internal* context,
+                                log_id_t id) {
+    log_device_t* d;
+    for (d = context->devices; d; d = d->next) {
+        if (android_name_to_log_id(d->device) == id) break;
+    }
+    return d;
+}
+
+// Report the result of android_logger_list_read() that ends the loop
+static void readFailed(android_logcat_context_internal* context, int ret) {
+    if (ret == -EAGAIN) return;
+
+    if (!ret || (ret == -EIO)) {
+        logcat_panic(context, HELP_FALSE, "read: unexpected EOF!\n");
+    } else if (ret == -EINVAL) {
+        logcat_panic(context, HELP_FALSE, "read: unexpected length.\n");
+    } else {
+        logcat_panic(context, HELP_FALSE, "logcat read failure\n");
+    }
+}
+
+// --parallel: the calling thread does nothing but drain the logd socket
+// into a ring of entries, so that logd does not find us slow and prune
+// under us. Workers claim whatever has been read in batches, decode,
+// filter and format them. A writer thread then prints them strictly in the
+// order they were read, which is the order logd merged the buffers in, and
+// is the only thread to touch the output, rotation and --max-count.
+class LogcatPipeline {
+    static const size_t capacity = 256;  // entries in flight
+    static const size_t maxBatch = 16;   // claimed or written at a time
+
+    struct Slot {
+        struct log_msg msg;
+        log_device_t* dev;  // nullptr if unexpected
+        bool binary;
+        int ret;          // of android_logger_list_read()
+        log_time read;    // off the socket
+        bool ready;       // formatted, waiting to be written
+        bool match;       // counts towards --max-count
+        char* line;       // nullptr if not to be printed
+        size_t len;
+        char text[1024];  // line if it fits
+    };
+
+    android_logcat_context_internal* context;
+    bool printDividers;
+    log_device_t* unexpected;  // only touched by the writer
+    Slot* slots;
+    std::vector<pthread_t> workers;
+    pthread_t writer;
+    bool writerStarted;
+
+    // Everything below is protected by lock. Waiters say so, to save
+    // a wakeup per entry when everyone is keeping up.
+    pthread_mutex_t lock;
+    pthread_cond_t readable;  // for workers, head moved
+    pthread_cond_t ready;     // for the writer, slots are ready
+    pthread_cond_t space;     // for the reader, tail moved
+    uint64_t head;            // next to be read
+    uint64_t claim;           // next to be formatted
+    uint64_t tail;            // next to be written
+    size_t awake;             // workers not waiting on readable
+    bool writerWaiting;
+    bool readerWaiting;
+    bool eof;
+    std::atomic_bool finished;  // writer is done, no more output
+
+    // writer only
+    log_device_t* dev;
+    std::vector<struct iovec> iov;
+    size_t pending;  // bytes in iov
+    size_t lines;
+    uint64_t lagSum;  // nS from read to written
+    uint64_t lagMax;
+    uint64_t endToEndSum;  // nS from logged to written
+    uint64_t endToEndMax;
+
+    Slot& slot(uint64_t index) {
+        return slots[index % capacity];
+    }
+
+    void format(Slot& s);
+    void flush();
+    bool print(Slot& s);
+    void work();
+    void drain();
+
+    static void* workerStart(void* obj) {
+        static_cast<LogcatPipeline*>(obj)->work();
+        return nullptr;
+    }
+    static void* writerStart(void* obj) {
+        static_cast<LogcatPipeline*>(obj)->drain();
+        return nullptr;
+    }
+
+   public:
+    LogcatPipeline(android_logcat_context_internal* context,
+                   bool printDividers, log_device_t* unexpected)
+        : context(context),
+          printDividers(printDividers),
+          unexpected(unexpected),
+          slots(nullptr),
+          writerStarted(false),
+          head(0),
+          claim(0),
+          tail(0),
+          awake(0),
+          writerWaiting(false),
+          readerWaiting(false),
+          eof(false),
+          finished(false),
+          dev(nullptr),
+          pending(0),
+          lines(0),
+          lagSum(0),
+          lagMax(0),
+          endToEndSum(0),
+          endToEndMax(0) {
+        pthread_mutex_init(&lock, nullptr);
+        pthread_cond_init(&readable, nullptr);
+        pthread_cond_init(&ready, nullptr);
+        pthread_cond_init(&space, nullptr);
+    }
+    ~LogcatPipeline();
+
+    bool start(size_t count);
+    // Read until told to stop, logd runs out, or the writer is done.
+    void run(struct logger_list* logger_list);
+};
+
+LogcatPipeline::~LogcatPipeline() {
+    pthread_mutex_lock(&lock);
+    eof = true;
+    pthread_cond_broadcast(&readable);
+    pthread_cond_broadcast(&ready);
+    pthread_mutex_unlock(&lock);
+
+    for (pthread_t thread : workers) pthread_join(thread, nullptr);
+    if (writerStarted) pthread_join(writer, nullptr);
+
+    if (slots) {
+        for (uint64_t index = tail; index < head; ++index) {
+            Slot& s = slot(index);
+            if (s.line && (s.line != s.text)) free(s.line);
+        }
+        delete[] slots;
+    }
+
+    pthread_cond_destroy(&space);
+    pthread_cond_destroy(&ready);
+    pthread_cond_destroy(&readable);
+    pthread_mutex_destroy(&lock);
+}
+
+bool LogcatPipeline::start(size_t count) {
+    slots = new (std::nothrow) Slot[capacity];
+    if (!slots) return false;
+    iov.reserve(maxBatch);
+
+    pthread_mutex_lock(&lock);
+    while (workers.size() < count) {
+        pthread_t thread;
+        if (pthread_create(&thread, nullptr, workerStart, this)) break;
+        workers.push_back(thread);
+        ++awake;
+    }
+    pthread_mutex_unlock(&lock);
+    if (workers.empty()) return false;
+
+    writerStarted = !pthread_create(&writer, nullptr, writerStart, this);
+    return writerStarted;
+}
+
+void LogcatPipeline::format(Slot& s) {
+    AndroidLogEntry entry;
+    char binaryMsgBuf[1024];
+
+    s.line = nullptr;
+    s.len = 0;
+    s.match = false;
+    if (s.ret <= 0) return;
+    if (!filterBuffer(context, s.binary, &s.msg, entry, binaryMsgBuf,
+                      sizeof(binaryMsgBuf), s.match)) {
+        return;
+    }
+    s.line = android_log_formatLogLine(context->logformat, s.text,
+                                       sizeof(s.text), &entry, &s.len);
+    if (!s.line) logcat_panic(context, HELP_FALSE, "output error");
+}
+
+void LogcatPipeline::work() {
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while ((claim == head) && !eof) {
+            --awake;
+            pthread_cond_wait(&readable, &lock);
+            ++awake;
+        }
+        if (claim == head) break;
+
+        uint64_t first = claim;
+        uint64_t last = std::min(head, claim + maxBatch);
+        claim = last;
+        pthread_mutex_unlock(&lock);
+
+        for (uint64_t index = first; index < last; ++index) {
+            format(slot(index));
+        }
+
+        pthread_mutex_lock(&lock);
+        for (uint64_t index = first; index < last; ++index) {
+            slot(index).ready = true;
+        }
+        if (writerWaiting && (first == tail)) pthread_cond_signal(&ready);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void LogcatPipeline::flush() {
+    if (iov.empty()) return;
+    ssize_t ret = 0;
+    if (context->outBuf) {
+        for (auto& v : iov) {
+            ret += writeLine(context, (const char*)v.iov_base, v.iov_len);
+        }
+    } else {
+        ret = TEMP_FAILURE_RETRY(
+            writev(context->output_fd, &iov[0], iov.size()));
+    }
+    if (ret < 0) {
+        fprintf(stderr, "+++ LOG: write failed (errno=%d)\n", errno);
+    } else {
+        context->outByteCount += ret;
+    }
+    iov.clear();
+    pending = 0;
+}
+
+// Queue up one entry for output, false when there is to be no more.
+bool LogcatPipeline::print(Slot& s) {
+    if (s.ret <= 0) {
+        flush();
+        readFailed(context, s.ret);
+        return false;
+    }
+
+    if (!s.dev) {
+        context->devCount = 2;  // set to Multiple
+        s.dev = unexpected;
+    }
+    if (dev != s.dev) {
+        flush();
+        dev = s.dev;
+        maybePrintStart(context, dev, printDividers);
+        if (context->stop) return false;
+    }
+
+    context->printCount += s.match;
+    if (s.line) {
+        iov.push_back({ s.line, s.len });
+        pending += s.len;
+
+        log_time now(CLOCK_REALTIME);
+        log_time logged(s.msg.entry.sec, s.msg.entry.nsec);
+        uint64_t lag = (now > s.read) ? (now - s.read).nsec() : 0;
+        uint64_t endToEnd = (now > logged) ? (now - logged).nsec() : 0;
+        ++lines;
+        lagSum += lag;
+        lagMax = std::max(lagMax, lag);
+        endToEndSum += endToEnd;
+        endToEndMax = std::max(endToEndMax, endToEnd);
+    }
+
+    if (context->logRotateSizeKBytes > 0 &&
+        ((context->outByteCount + pending) / 1024) >=
+            context->logRotateSizeKBytes) {
+        flush();
+        rotateLogs(context);
+    }
+
+    return !context->stop &&
+           (!context->maxCount || (context->printCount < context->maxCount));
+}
+
+void LogcatPipeline::drain() {
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while ((tail == head) ? !eof : !slot(tail).ready) {
+            writerWaiting = true;
+            pthread_cond_wait(&ready, &lock);
+        }
+        writerWaiting = false;
+        if (tail == head) break;  // eof, and all written
+
+        uint64_t first = tail;
+        uint64_t last = first;
+        while ((last < head) && ((last - first) < maxBatch) &&
+               slot(last).ready) {
+            ++last;
+        }
+        pthread_mutex_unlock(&lock);
+
+        // Once done keep consuming, so the reader is never stuck on space
+        for (uint64_t index = first; index < last; ++index) {
+            if (!finished && !print(slot(index))) finished = true;
+        }
+        flush();
+        for (uint64_t index = first; index < last; ++index) {
+            Slot& s = slot(index);
+            if (s.line && (s.line != s.text)) free(s.line);
+            s.line = nullptr;
+        }
+
+        pthread_mutex_lock(&lock);
+        for (uint64_t index = first; index < last; ++index) {
+            slot(index).ready = false;
+        }
+        tail = last;
+        if (readerWaiting) pthread_cond_signal(&space);
+    }
+    pthread_mutex_unlock(&lock);
+
+    if (lines && context->error) {
+        fprintf(context->error,
+                "--------- %zu lines by %zu workers, lag avg %.3fms max "
+                "%.3fms, end-to-end avg %.3fms max %.3fms\n",
+                lines, workers.size(), lagSum / 1e6 / lines, lagMax / 1e6,
+                endToEndSum / 1e6 / lines, endToEndMax / 1e6);
+    }
+}
+
+void LogcatPipeline::run(struct logger_list* logger_list) {
+    pthread_mutex_lock(&lock);
+    while (!context->stop && !finished) {
+        while ((head - tail) >= capacity) {
+            readerWaiting = true;
+            pthread_cond_wait(&space, &lock);
+        }
+        readerWaiting = false;
+        Slot& s = slot(head);
+        pthread_mutex_unlock(&lock);
+
+        s.ret = android_logger_list_read(logger_list, &s.msg);
+        s.read = log_time(CLOCK_REALTIME);
+        s.ready = false;
+        if (s.ret > 0) {
+            s.dev = findDevice(context, s.msg.id());
+            s.binary = s.dev ? s.dev->binary : (s.msg.id() == LOG_ID_EVENTS);
+            openEventTagMap(context, s.binary);
+        }
+
+        pthread_mutex_lock(&lock);
+        ++head;
+        // Workers that are up will get to it, unless it is piling up
+        if (!awake || ((head - claim) > maxBatch)) {
+            pthread_cond_signal(&readable);
+        }
+        if (s.ret <= 0) break;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
 static void setupOutputAndSchedulingPolicy(
     android_logcat_context_internal* context, bool blocking) {
     if (!context->outputFileName) return;
@@ -421,6 +899,16 @@ static void setupOutputAndSchedulingPolicy(
     context->output = fdopen(context->output_fd, "web");
 
     context->outByteCount = statbuf.st_size;
+
+    if (context->logRotateSizeKBytes) {
+        if (!context->outBuf) {
+            void* buf = nullptr;
+            context->outBuf =
+                posix_memalign(&buf, getpagesize(), outBufSize) ? nullptr
+                                                                 : (char*)buf;
+        }
+        preallocateLogFile(context);
+    }
 }
 
 // clang-format off
@@ -494,6 +982,9 @@ static void show_help(android_logcat_context_internal* context) {
                     "                  Set prune white and ~black list, using same format as\n"
                     "                  listed above. Must be quoted.\n"
                     "  --pid=<pid>     Only prints logs from the given pid.\n"
+                    "  --parallel[=<workers>]\n"
+                    "                  Decode and format on <workers> threads so that reading\n"
+                    "                  from logd keeps up, report the lag on exit.\n"
                     // Check ANDROID_LOG_WRAP_DEFAULT_TIMEOUT value for match to 2 hours
                     "  --wrap          Sleep for 2 hours or when buffer about to wrap whichever\n"
                     "                  comes first. Improves efficiency of polling by providing\n"
@@ -870,6 +1361,7 @@ static int __logcat(android_logcat_context_internal* context) {
         static const char id_str[] = "id";
         static const char wrap_str[] = "wrap";
         static const char print_str[] = "print";
+        static const char parallel_str[] = "parallel";
         // clang-format off
         static const struct option long_options[] = {
           { "binary",        no_argument,       nullptr, 'B' },
@@ -889,6 +1381,7 @@ static int __logcat(android_logcat_context_internal* context) {
           { id_str,          required_argument, nullptr, 0 },
           { "last",          no_argument,       nullptr, 'L' },
           { "max-count",     required_argument, nullptr, 'm' },
+          { parallel_str,    optional_argument, nullptr, 0 },
           { pid_str,         required_argument, nullptr, 0 },
           { print_str,       no_argument,       nullptr, 0 },
           { "prune",         optional_argument, nullptr, 'p' },
@@ -946,6 +1439,20 @@ static int __logcat(android_logcat_context_internal* context) {
                     context->printItAnyways = true;
                     break;
                 }
+                if (long_options[option_index].name == parallel_str) {
+                    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                    context->parallel =
+                        std::min(std::max(cpus - 1, 1L), 8L);
+                    if (optctx.optarg &&
+                        !getSizeTArg(optctx.optarg, &context->parallel, 1,
+                                     64)) {
+                        logcat_panic(context, HELP_TRUE, "%s %s out of range\n",
+                                     long_options[option_index].name,
+                                     optctx.optarg);
+                        goto exit;
+                    }
+                    break;
+                }
                 if (long_options[option_index].name == debug_str) {
                     context->debug = true;
                     break;
@@ -1444,6 +1951,15 @@ static int __logcat(android_logcat_context_internal* context) {
     } else {
         logger_list = android_logger_list_alloc(mode, tail_lines, pid);
     }
+    // Have logd drop what we are going to filter out anyways, should it
+    // not we still filter everything ourselves.
+    if (!context->printBinary) {
+        android_logger_list_filter_format(logger_list, context->logformat);
+        if (context->regex && !context->printItAnyways) {
+            android_logger_list_filter_regex(logger_list,
+                                             context->regex->pattern().c_str());
+        }
+    }
     // We have three orthogonal actions below to clear, set log size and
     // get log size. All sharing the same iteration loop.
     while (dev) {
@@ -1624,34 +2140,25 @@ static int __logcat(android_logcat_context_internal* context) {
 
     dev = nullptr;
 
+    if (context->parallel && !context->printBinary) {
+        LogcatPipeline pipeline(context, printDividers, &unexpected);
+        if (pipeline.start(context->parallel)) {
+            pipeline.run(logger_list);
+            goto close;
+        }
+        // fall back to doing it all here
+    }
+
     while (!context->stop &&
            (!context->maxCount || (context->printCount < context->maxCount))) {
         struct log_msg log_msg;
         int ret = android_logger_list_read(logger_list, &log_msg);
-        if (!ret) {
-            logcat_panic(context, HELP_FALSE, "read: unexpected EOF!\n");
+        if (ret <= 0) {
+            readFailed(context, ret);
             break;
         }
 
-        if (ret < 0) {
-            if (ret == -EAGAIN) break;
-
-            if (ret == -EIO) {
-                logcat_panic(context, HELP_FALSE, "read: unexpected EOF!\n");
-                break;
-            }
-            if (ret == -EINVAL) {
-                logcat_panic(context, HELP_FALSE, "read: unexpected length.\n");
-                break;
-            }
-            logcat_panic(context, HELP_FALSE, "logcat read failure\n");
-            break;
-        }
-
-        log_device_t* d;
-        for (d = context->devices; d; d = d->next) {
-            if (android_name_to_log_id(d->device) == log_msg.id()) break;
-        }
+        log_device_t* d = findDevice(context, log_msg.id());
         if (!d) {
             context->devCount = 2; // set to Multiple
             d = &unexpected;
@@ -1848,6 +2355,7 @@ int android_logcat_destroy(android_logcat_context* ctx) {
     }
 
     android_closeEventTagMap(context->eventTagMap);
+    free(context->outBuf);
 
     // generic cleanup of devices list to handle all possible dirty cases
     log_device_t* dev;
@@ -1503,6 +1503,66 @@ TEST(logcat, maxcount) {
     ASSERT_EQ(3, count);
 }
 
+TEST(logcat, parallel) {
+    FILE* fp;
+    logcat_define(ctx);
+    static const int num = 1000;
+
+    char buffer[BIG_BUFFER];
+#define logcat_parallel_tag ___STRING(logcat) "_parallel"
+
+    for (int i = 0; i < num; ++i) {
+        LOG_FAILURE_RETRY(__android_log_print(
+            ANDROID_LOG_WARN, logcat_parallel_tag, "%d", i));
+    }
+    rest();
+
+    snprintf(buffer, sizeof(buffer),
+             logcat_executable " --pid %d -d -s " logcat_parallel_tag
+                               " -v brief --parallel=4 2>/dev/null",
+             getpid());
+
+    ASSERT_TRUE(NULL != (fp = logcat_popen(ctx, buffer)));
+
+    // Formatted on several threads, must still come out in order
+    int count = 0;
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        if (!strncmp(begin, buffer, sizeof(begin) - 1)) {
+            continue;
+        }
+
+        char* cp = strstr(buffer, "): ");
+        ASSERT_TRUE(NULL != cp);
+        EXPECT_EQ(count, atoi(cp + 3));
+
+        count++;
+    }
+
+    logcat_pclose(ctx, fp);
+
+    EXPECT_EQ(num, count);
+
+    snprintf(buffer, sizeof(buffer),
+             logcat_executable " --pid %d -d -s " logcat_parallel_tag
+                               " --max-count 3 --parallel 2>/dev/null",
+             getpid());
+
+    ASSERT_TRUE(NULL != (fp = logcat_popen(ctx, buffer)));
+
+    count = 0;
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        if (!strncmp(begin, buffer, sizeof(begin) - 1)) {
+            continue;
+        }
+
+        count++;
+    }
+
+    logcat_pclose(ctx, fp);
+
+    EXPECT_EQ(3, count);
+}
+
 static bool End_to_End(const char* tag, const char* fmt, ...)
 #if defined(__GNUC__)
     __attribute__((__format__(printf, 2, 3)))
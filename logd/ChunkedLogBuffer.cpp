@@ -0,0 +1,484 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits.h>
+
+#include <android-base/stringprintf.h>
+#include <private/android_logger.h>
+
+#include "ChunkedLogBuffer.h"
+#include "LogReader.h"
+#include "LogReaderBatch.h"
+#include "LogUtils.h"
+
+#define log_buffer_size(id) mMaxSize[id]
+
+ChunkedLogBuffer::ChunkedLogBuffer(LastLogTimes* times)
+    : LogBuffer(times), mNextChunkId(1), mSpool(nullptr) {
+    log_id_for_each(i) {
+        mChunkBytes[i] = 0;
+    }
+    if (__android_logger_property_get_bool(
+            "logd.spool", BOOL_DEFAULT_FALSE | BOOL_DEFAULT_FLAG_PERSIST)) {
+        mSpool = new LogSpool("/data/misc/logd/spool",
+                              LogSpool::defaultCapacity);
+    }
+}
+
+ChunkedLogBuffer::~ChunkedLogBuffer() {
+    log_id_for_each(i) {
+        for (LogBufferChunk* chunk : mChunks[i]) {
+            delete chunk;
+        }
+    }
+    delete mSpool;
+}
+
+// Chunks are an eighth of the buffer size so that pruning one keeps at
+// least 7/8ths of the history, but never too small for the largest entry.
+// Capped so that compressing a sealed chunk does not stall the writers.
+size_t ChunkedLogBuffer::chunkSize(log_id_t id, unsigned short len) const {
+    static const size_t maxChunkSize = 256 * 1024;
+    size_t size = log_buffer_size(id) / 8;
+    if (size > maxChunkSize) {
+        size = maxChunkSize;
+    }
+    size_t minimum = LogBufferChunk::entrySize(LOGGER_ENTRY_MAX_PAYLOAD);
+    if (minimum < LogBufferChunk::entrySize(len)) {
+        minimum = LogBufferChunk::entrySize(len);
+    }
+    return (size < minimum) ? minimum : size;
+}
+
+// LogBuffer::wrlock() must be held when this function is called.
+LogBufferChunk* ChunkedLogBuffer::newChunk(log_id_t id, unsigned short len) {
+    LogBufferChunk* chunk =
+        new LogBufferChunk(chunkSize(id, len), mNextChunkId++);
+    mChunks[id].push_back(chunk);
+    mChunkBytes[id] += chunk->capacity();
+    return chunk;
+}
+
+// (Re)compress chunk, accounting for the change in its footprint.
+//
+// LogBuffer::wrlock() must be held when this function is called.
+void ChunkedLogBuffer::sealChunk(log_id_t id, LogBufferChunk* chunk) {
+    mChunkBytes[id] -= chunk->footprint();
+    chunk->seal();
+    mChunkBytes[id] += chunk->footprint();
+}
+
+// Expire the oldest chunk of "id", readers still holding a reference keep
+// it allocated until they move on. Spooled first if enabled, unless the
+// buffer is being cleared.
+//
+// LogBuffer::wrlock() must be held when this function is called.
+void ChunkedLogBuffer::eraseChunk(log_id_t id, bool spool) {
+    LogBufferChunk* chunk = mChunks[id].front();
+    mChunks[id].pop_front();
+    mChunkBytes[id] -= chunk->footprint();
+
+    bool resident = chunk->incReader();
+    if (mSpool && spool) {
+        mSpool->spool(id, chunk);
+    }
+    if (resident) {
+        size_t offset = 0;
+        LogBufferElement* element;
+        while ((element = chunk->elementAt(offset))) {
+            stats.subtract(element);
+            offset = chunk->next(offset);
+        }
+    }
+    chunk->expire();
+    if (resident) {
+        chunk->decReader();
+    }
+}
+
+// LogBuffer::wrlock() must be held when this function is called.
+int ChunkedLogBuffer::logLocked(log_id_t log_id, log_time realtime, uid_t uid,
+                                pid_t pid, pid_t tid, const char* msg,
+                                unsigned short len) {
+    LogBufferElement* element = nullptr;
+    if (!mChunks[log_id].empty()) {
+        element = mChunks[log_id].back()->append(log_id, realtime, uid, pid,
+                                                 tid, msg, len);
+    }
+    if (!element) {
+        if (!mChunks[log_id].empty()) {
+            sealChunk(log_id, mChunks[log_id].back());
+        }
+        element = newChunk(log_id, len)->append(log_id, realtime, uid, pid,
+                                                tid, msg, len);
+    }
+    stats.add(element);
+    if (mChunkBytes[log_id] > log_buffer_size(log_id)) {
+        prune(log_id, mChunks[log_id].front()->elements(), AID_ROOT);
+    }
+
+    return len;
+}
+
+// Expire whole chunks of type "id" from the oldest end until the buffer is
+// back under its size limit, or all of them if pruneRows is ULONG_MAX. An
+// unprivileged clear marks only the callers entries as erased in place. As
+// with LogBuffer::prune() the oldest reader acts as a backstop.
+//
+// LogBuffer::wrlock() must be held when this function is called.
+bool ChunkedLogBuffer::prune(log_id_t id, unsigned long pruneRows,
+                             uid_t caller_uid) {
+    LogTimeEntry* oldest = nullptr;
+    bool busy = false;
+    bool clearAll = pruneRows == ULONG_MAX;
+
+    LogTimeEntry::rdlock();
+
+    // Region locked?
+    LastLogTimes::iterator times = mTimes.begin();
+    while (times != mTimes.end()) {
+        LogTimeEntry* entry = (*times);
+        if (entry->owned_Locked() && entry->isWatching(id) &&
+            (!oldest || (oldest->mStart > entry->mStart) ||
+             ((oldest->mStart == entry->mStart) &&
+              (entry->mTimeout.tv_sec || entry->mTimeout.tv_nsec)))) {
+            oldest = entry;
+        }
+        times++;
+    }
+    log_time watermark(log_time::tv_sec_max, log_time::tv_nsec_max);
+    if (oldest) watermark = oldest->mStart - pruneMargin;
+
+    if (__predict_false(caller_uid != AID_ROOT)) {  // unlikely
+        for (LogBufferChunk* chunk : mChunks[id]) {
+            if (!chunk->incReader()) {
+                continue;
+            }
+            bool erased = false;
+            size_t offset = 0;
+            LogBufferElement* element;
+            while ((element = chunk->elementAt(offset))) {
+                if (element->getUid() == caller_uid) {
+                    if (oldest && (watermark <= element->getRealTime())) {
+                        busy = true;
+                        kickMe(oldest, id, pruneRows);
+                        break;
+                    }
+                    stats.subtract(element);
+                    chunk->erase(offset);
+                    erased = true;
+                }
+                offset = chunk->next(offset);
+            }
+            if (erased && chunk->sealed()) {
+                sealChunk(id, chunk);
+            }
+            chunk->decReader();
+            if (busy) break;
+        }
+        while ((mChunks[id].size() > 1) && mChunks[id].front()->empty()) {
+            eraseChunk(id, false);
+        }
+        LogTimeEntry::unlock();
+        return busy;
+    }
+
+    while (!mChunks[id].empty()) {
+        LogBufferChunk* chunk = mChunks[id].front();
+        // always keep the chunk being written to, unless clearing
+        if (!clearAll && ((mChunks[id].size() == 1) ||
+                          (mChunkBytes[id] <= log_buffer_size(id)))) {
+            break;
+        }
+
+        if (oldest && (watermark <= chunk->newest())) {
+            busy = true;
+            kickMe(oldest, id, chunk->elements());
+            break;
+        }
+
+        eraseChunk(id, !clearAll);
+    }
+
+    LogTimeEntry::unlock();
+
+    return busy;
+}
+
+// get the memory footprint associated with "id", compressed or not.
+unsigned long ChunkedLogBuffer::getSizeUsed(log_id_t id) {
+    rdlock();
+    size_t retval = mChunkBytes[id];
+    unlock();
+    return retval;
+}
+
+std::string ChunkedLogBuffer::formatStatistics(uid_t uid, pid_t pid,
+                                               unsigned int logMask) {
+    std::string ret = LogBuffer::formatStatistics(uid, pid, logMask);
+
+    rdlock();
+    ret += "\nChunks (uncompressed/footprint):";
+    log_id_for_each(id) {
+        if (!(logMask & (1 << id)) || mChunks[id].empty()) continue;
+        size_t used = 0;
+        size_t sealed = 0;
+        for (LogBufferChunk* chunk : mChunks[id]) {
+            used += chunk->used();
+            if (chunk->sealed()) ++sealed;
+        }
+        ret += android::base::StringPrintf(
+            "\n%-8s %zu/%zu in %zu chunks (%zu compressed)",
+            android_log_id_to_name(id), used, mChunkBytes[id],
+            mChunks[id].size(), sealed);
+    }
+    ret += "\n";
+    if (mSpool) {
+        ret += android::base::StringPrintf("Spooled: %zu in %zu segments\n",
+                                           mSpool->size(),
+                                           mSpool->segments());
+    }
+    unlock();
+
+    return ret;
+}
+
+void ChunkedLogBuffer::convertTimestamps() {
+    log_id_for_each(i) {
+        for (LogBufferChunk* chunk : mChunks[i]) {
+            if (!chunk->incReader()) {
+                continue;
+            }
+            size_t offset = 0;
+            LogBufferElement* element;
+            while ((element = chunk->elementAt(offset))) {
+                convertTimestamp(element);
+                offset = chunk->next(offset);
+            }
+            chunk->updateTimes();
+            if (chunk->sealed()) {
+                sealChunk(i, chunk);
+            }
+            chunk->decReader();
+        }
+    }
+}
+
+// Take a reference on the first chunk from it onwards that can be made
+// resident, and position the cursor there.
+//
+// LogBuffer::rdlock() must be held when this function is called.
+bool ChunkedLogBuffer::hold(Cursor& cursor, LogBufferChunkCollection& chunks,
+                            LogBufferChunkCollection::iterator it,
+                            size_t offset) {
+    for (; it != chunks.end(); ++it, offset = 0) {
+        if ((*it)->incReader()) {
+            cursor.chunks = &chunks;
+            cursor.chunk = it;
+            cursor.held = *it;
+            cursor.id = (*it)->id();
+            cursor.offset = offset;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Lock need not be held, the reference keeps an expired chunk allocated.
+void ChunkedLogBuffer::release(Cursor& cursor) {
+    if (cursor.held) {
+        cursor.held->decReader();
+        cursor.held = nullptr;
+    }
+}
+
+// Position the cursor at the first chunk that may hold entries at or after
+// start, starting with any chunks loaded from the spool. Chances are we are
+// better off starting from the newest chunk.
+//
+// LogBuffer::rdlock() must be held when this function is called.
+void ChunkedLogBuffer::seek(Cursor& cursor, log_id_t id,
+                            const log_time& start,
+                            LogBufferChunkCollection& spooled) {
+    LogBufferChunkCollection& chunks = mChunks[id];
+
+    cursor.held = nullptr;
+    if (hold(cursor, spooled, spooled.begin(), 0) || chunks.empty()) {
+        return;
+    }
+
+    LogBufferChunkCollection::iterator it = chunks.begin();
+    size_t offset = 0;
+    if (start != log_time::EPOCH) {
+        it = chunks.end();
+        while (it != chunks.begin()) {
+            --it;
+            if ((*it)->newest() < start) {
+                ++it;
+                break;
+            }
+        }
+        if (it == chunks.end()) {  // nothing new, wait at the end
+            --it;
+            offset = (*it)->used();
+        }
+    }
+    hold(cursor, chunks, it, offset);
+}
+
+// Next live element at the cursor, moving on to newer chunks as each one is
+// exhausted, and from the spooled chunks to the buffer. If the chunk the
+// cursor was in has since been pruned, resume from the oldest chunk that
+// remains.
+//
+// LogBuffer::rdlock() must be held when this function is called.
+LogBufferElement* ChunkedLogBuffer::peek(Cursor& cursor, log_id_t id) {
+    LogBufferChunkCollection& chunks = mChunks[id];
+
+    if (cursor.held && (cursor.chunks == &chunks) &&
+        (chunks.empty() || (chunks.front()->id() > cursor.id))) {
+        release(cursor);
+    }
+    if (!cursor.held && !hold(cursor, chunks, chunks.begin(), 0)) {
+        return nullptr;
+    }
+
+    for (;;) {
+        LogBufferElement* element = cursor.held->elementAt(cursor.offset);
+        if (element) {
+            return element;
+        }
+        LogBufferChunkCollection* list = cursor.chunks;
+        LogBufferChunkCollection::iterator next = cursor.chunk;
+        if ((++next == list->end()) && (list == &chunks)) {
+            return nullptr;
+        }
+        release(cursor);
+        if (!hold(cursor, *list, next, 0) &&
+            ((list == &chunks) || !hold(cursor, chunks, chunks.begin(), 0))) {
+            return nullptr;
+        }
+    }
+}
+
+log_time ChunkedLogBuffer::flushTo(
+    SocketClient* reader, const log_time& start, pid_t* lastTid,
+    bool privileged, bool security,
+    int (*filter)(const LogBufferElement* element, void* arg), void* arg,
+    LogBufferCursor* /* cursor */, const LogReaderFilter* readerFilter) {
+    // Reader cursor unused, seek() only walks back over whole chunks.
+    Cursor cursors[LOG_ID_MAX];
+    LogBufferChunkCollection spooled[LOG_ID_MAX];
+    LogReaderBatch batch(reader, privileged, readerFilter);
+    uid_t uid = reader->getUid();
+
+    rdlock();
+
+    log_id_for_each(i) {
+        // older than anything still in the buffer?
+        if (mSpool && (start != log_time::EPOCH) &&
+            (mChunks[i].empty() || (start < mChunks[i].front()->oldest()))) {
+            log_time before(log_time::tv_sec_max, log_time::tv_nsec_max);
+            if (!mChunks[i].empty()) before = mChunks[i].front()->oldest();
+            mSpool->load(i, start, before, spooled[i]);
+        }
+        seek(cursors[i], i, start, spooled[i]);
+    }
+
+    log_time curr = start;
+
+    for (;;) {
+        // merge the log ids back together in timestamp order
+        LogBufferElement* element = nullptr;
+        log_id_t id = LOG_ID_MAX;
+        log_id_for_each(i) {
+            LogBufferElement* next = peek(cursors[i], i);
+            if (next &&
+                (!element || (next->getRealTime() < element->getRealTime()))) {
+                element = next;
+                id = i;
+            }
+        }
+        if (!element) {
+            break;
+        }
+        Cursor& cursor = cursors[id];
+        cursor.offset = cursor.held->next(cursor.offset);
+
+        if (element->getRealTime() < start) {
+            continue;
+        }
+
+        if (!privileged && (element->getUid() != uid)) {
+            continue;
+        }
+
+        if (!security && (element->getLogId() == LOG_ID_SECURITY)) {
+            continue;
+        }
+
+        // NB: calling out to another object with rdlock() held (safe)
+        if (filter) {
+            int ret = (*filter)(element, arg);
+            if (ret == false) {
+                continue;
+            }
+            if (ret != true) {
+                break;
+            }
+        }
+
+        bool sameTid = false;
+        if (lastTid) {
+            sameTid = lastTid[element->getLogId()] == element->getTid();
+            lastTid[element->getLogId()] = element->getTid();
+        }
+
+        bool queued = batch.add(element);
+        if (queued && !batch.full()) {
+            continue;
+        }
+
+        unlock();
+
+        // range locking in LastLogTimes looks after us
+        curr = batch.flush();
+        if (!queued && (curr != element->FLUSH_ERROR)) {
+            curr = element->flushTo(reader, this, privileged, sameTid);
+        }
+
+        if (curr == element->FLUSH_ERROR) {
+            break;
+        }
+
+        rdlock();
+    }
+    if (curr != LogBufferElement::FLUSH_ERROR) {
+        unlock();
+        if (!batch.empty()) {
+            curr = batch.flush();
+        }
+    }
+
+    log_id_for_each(i) {
+        release(cursors[i]);
+        for (LogBufferChunk* chunk : spooled[i]) {
+            chunk->expire();
+        }
+    }
+
+    return curr;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_CHUNKED_LOG_BUFFER_H__
+#define _LOGD_CHUNKED_LOG_BUFFER_H__
+
+#include <sys/types.h>
+
+#include <list>
+#include <string>
+
+#include "LogBuffer.h"
+#include "LogBufferChunk.h"
+#include "LogSpool.h"
+
+// Storage engine that packs the entries of each log id into fixed size
+// chunks rather than holding them as individual heap allocations. Pruning
+// expires whole chunks from the oldest end and readers scan each chunk
+// sequentially, merging the log ids back together in timestamp order.
+//
+// Each chunk is compressed when it is sealed and inflated again only while
+// readers walk through it, the buffer size limit applies to the compressed
+// footprint so more history fits in the same memory.
+//
+// Chatty identical message squashing and worst offender pruning are not
+// performed, the oldest entries are always the first expired.
+//
+// Expired chunks can also be spooled to disk with the logd.spool property,
+// readers asking for a start time older than the buffer are then served
+// from the spool first.
+//
+// Selected at startup with the logd.chunked property.
+class ChunkedLogBuffer : public LogBuffer {
+    // Reader position in the chunks of a single log id, revalidated against
+    // the oldest chunk id whenever the lock has been dropped. Holds a reader
+    // reference on the chunk so it stays resident and allocated. Chunks
+    // loaded from the spool are private to the reader and walked first.
+    struct Cursor {
+        LogBufferChunkCollection* chunks;
+        LogBufferChunkCollection::iterator chunk;
+        LogBufferChunk* held;
+        uint64_t id;
+        size_t offset;
+    };
+
+    LogBufferChunkCollection mChunks[LOG_ID_MAX];
+    // footprint of the chunks held per log id
+    size_t mChunkBytes[LOG_ID_MAX];
+    uint64_t mNextChunkId;
+    LogSpool* mSpool;  // nullable
+
+    size_t chunkSize(log_id_t id, unsigned short len) const;
+    LogBufferChunk* newChunk(log_id_t id, unsigned short len);
+    void sealChunk(log_id_t id, LogBufferChunk* chunk);
+    void eraseChunk(log_id_t id, bool spool);
+    bool hold(Cursor& cursor, LogBufferChunkCollection& chunks,
+              LogBufferChunkCollection::iterator it, size_t offset);
+    void release(Cursor& cursor);
+    void seek(Cursor& cursor, log_id_t id, const log_time& start,
+              LogBufferChunkCollection& spooled);
+    LogBufferElement* peek(Cursor& cursor, log_id_t id);
+
+   public:
+    explicit ChunkedLogBuffer(LastLogTimes* times);
+    ~ChunkedLogBuffer() override;
+
+    log_time flushTo(SocketClient* writer, const log_time& start,
+                     pid_t* lastTid, bool privileged, bool security,
+                     int (*filter)(const LogBufferElement* element, void* arg),
+                     void* arg, LogBufferCursor* cursor,
+                     const LogReaderFilter* readerFilter) override;
+    unsigned long getSizeUsed(log_id_t id) override;
+    std::string formatStatistics(uid_t uid, pid_t pid,
+                                 unsigned int logMask) override;
+
+   protected:
+    int logLocked(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
+                  pid_t tid, const char* msg, unsigned short len) override;
+    bool prune(log_id_t id, unsigned long pruneRows, uid_t uid) override;
+    void convertTimestamps() override;
+};
+
+#endif  // _LOGD_CHUNKED_LOG_BUFFER_H__
@@ -28,14 +28,16 @@
 
 FlushCommand::FlushCommand(LogReader& reader, bool nonBlock, unsigned long tail,
                            unsigned int logMask, pid_t pid, log_time start,
-                           uint64_t timeout)
+                           uint64_t timeout,
+                           std::shared_ptr<const LogReaderFilter> filter)
     : mReader(reader),
       mNonBlock(nonBlock),
       mTail(tail),
       mLogMask(logMask),
       mPid(pid),
       mStart(start),
-      mTimeout((start != log_time::EPOCH) ? timeout : 0) {
+      mTimeout((start != log_time::EPOCH) ? timeout : 0),
+      mFilter(filter) {
 }
 
 // runSocketCommand is called once for every open client on the
@@ -88,7 +90,7 @@ void FlushCommand::runSocketCommand(SocketClient* client) {
             return;
         }
         entry = new LogTimeEntry(mReader, client, mNonBlock, mTail, mLogMask,
-                                 mPid, mStart, mTimeout);
+                                 mPid, mStart, mTimeout, mFilter);
         times.push_front(entry);
     }
 
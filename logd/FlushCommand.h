@@ -16,6 +16,8 @@
 #ifndef _FLUSH_COMMAND_H
 #define _FLUSH_COMMAND_H
 
+#include <memory>
+
 #include <private/android_logger.h>
 #include <sysutils/SocketClientCommand.h>
 
@@ -33,12 +35,14 @@ class FlushCommand : public SocketClientCommand {
     pid_t mPid;
     log_time mStart;
     uint64_t mTimeout;
+    std::shared_ptr<const LogReaderFilter> mFilter;
 
    public:
-    explicit FlushCommand(LogReader& mReader, bool nonBlock = false,
-                          unsigned long tail = -1, unsigned int logMask = -1,
-                          pid_t pid = 0, log_time start = log_time::EPOCH,
-                          uint64_t timeout = 0);
+    explicit FlushCommand(
+        LogReader& mReader, bool nonBlock = false, unsigned long tail = -1,
+        unsigned int logMask = -1, pid_t pid = 0,
+        log_time start = log_time::EPOCH, uint64_t timeout = 0,
+        std::shared_ptr<const LogReaderFilter> filter = nullptr);
     virtual void runSocketCommand(SocketClient* client);
 
     static bool hasReadLogs(SocketClient* client);
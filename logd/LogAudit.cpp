@@ -26,6 +26,7 @@
 #include <syslog.h>
 
 #include <android-base/macros.h>
+#include <android-base/stringprintf.h>
 #include <private/android_filesystem_config.h>
 #include <private/android_logger.h>
 
@@ -50,7 +51,12 @@ LogAudit::LogAudit(LogBuffer* buf, LogReader* reader, int fdDmesg)
       events(__android_logger_property_get_bool("ro.logd.auditd.events",
                                                 BOOL_DEFAULT_TRUE)),
       initialized(false),
-      tooFast(false) {
+      tooFast(false),
+      mReceived(0),
+      mSuppressed(0),
+      mSummaries(0),
+      mRate(0),
+      mTooFast(false) {
     static const char auditd_message[] = { KMSG_PRIORITY(LOG_INFO),
                                            'l',
                                            'o',
@@ -80,6 +86,9 @@ void LogAudit::checkRateLimit() {
     bucket.emplace(android_log_clockid());
     oldest = bucket.back() - oldest;
     while (bucket.front() < oldest) bucket.pop();
+    atomic_store_explicit(
+        &mRate, (unsigned)(bucket.size() / AUDIT_RATE_LIMIT_BURST_DURATION),
+        memory_order_relaxed);
 
     static const size_t upperThreshold =
         ((AUDIT_RATE_LIMIT_BURST_DURATION *
@@ -90,6 +99,7 @@ void LogAudit::checkRateLimit() {
         // Hit peak, slow down source
         if (!tooFast) {
             tooFast = true;
+            atomic_store_explicit(&mTooFast, true, memory_order_relaxed);
             audit_rate_limit(mSock, AUDIT_RATE_LIMIT_MAX);
         }
 
@@ -110,6 +120,7 @@ void LogAudit::checkRateLimit() {
     if (bucket.size() >= lowerThreshold) return;
 
     tooFast = false;
+    atomic_store_explicit(&mTooFast, false, memory_order_relaxed);
     // Went below max sustained rate, allow source to speed up
     audit_rate_limit(mSock, AUDIT_RATE_LIMIT_DEFAULT);
 }
@@ -153,20 +164,30 @@ int LogAudit::logPrint(const char* fmt, ...) {
     if (rc < 0) {
         return rc;
     }
+    atomic_fetch_add_explicit(&mReceived, 1, memory_order_relaxed);
 
-    char* cp;
     // Work around kernels missing
     // https://github.com/torvalds/linux/commit/b8f89caafeb55fba75b74bea25adc4e4cd91be67
     // Such kernels improperly add newlines inside audit messages.
-    while ((cp = strchr(str, '\n'))) {
-        *cp = ' ';
+    // Newlines become spaces and runs of spaces are folded, in place and in a
+    // single pass over the message.
+    char* cp = str;
+    for (const char* sp = str; *sp; ++sp) {
+        char c = (*sp == '\n') ? ' ' : *sp;
+        if ((c == ' ') && (cp > str) && (cp[-1] == ' ')) {
+            continue;
+        }
+        *cp++ = c;
     }
+    *cp = '\0';
+
+    bool info = strstr(str, " permissive=1") || strstr(str, " policy loaded ");
 
-    while ((cp = strstr(str, "  "))) {
-        memmove(cp, cp + 1, strlen(cp + 1) + 1);
+    if (suppressDenial(str, info)) {
+        free(str);
+        return 0;
     }
 
-    bool info = strstr(str, " permissive=1") || strstr(str, " policy loaded ");
     if ((fdDmesg >= 0) && initialized) {
         struct iovec iov[3];
         static const char log_info[] = { KMSG_PRIORITY(LOG_INFO) };
@@ -375,6 +396,102 @@ int LogAudit::logPrint(const char* fmt, ...) {
     return rc;
 }
 
+// Returns true if str is an AVC denial already logged in the current window.
+bool LogAudit::suppressDenial(const char* str, bool info) {
+    log_time now(CLOCK_MONOTONIC);
+    if (!denials.empty()) {
+        flushDenials(now);
+    }
+
+    static const char avc[] = "): avc: ";
+    static const char denied[] = "denied ";
+    const char* denial = strstr(str, avc);
+    if (!denial) {
+        return false;
+    }
+    denial += strlen(avc);
+    if (fastcmp<strncmp>(denial, denied, strlen(denied))) {
+        return false;
+    }
+
+    auto it = denials.find(denial);
+    if (it != denials.end()) {
+        ++it->second.suppressed;
+        atomic_fetch_add_explicit(&mSuppressed, 1, memory_order_relaxed);
+        return true;
+    }
+
+    if (denials.size() >= maxDenials) {
+        auto oldest = denials.begin();
+        for (auto i = denials.begin(); i != denials.end(); ++i) {
+            if (i->second.start < oldest->second.start) {
+                oldest = i;
+            }
+        }
+        if (oldest->second.suppressed) {
+            logSummary(oldest->first, oldest->second);
+        }
+        denials.erase(oldest);
+    }
+    denials.emplace(denial, Denial{ now, 0, info });
+    return false;
+}
+
+// Close the windows that started more than dedupWindow seconds before now.
+void LogAudit::flushDenials(const log_time& now) {
+    const log_time expired = now - log_time(dedupWindow, 0);
+    for (auto it = denials.begin(); it != denials.end();) {
+        if (expired < it->second.start) {
+            ++it;
+            continue;
+        }
+        if (it->second.suppressed) {
+            logSummary(it->first, it->second);
+        }
+        it = denials.erase(it);
+    }
+}
+
+void LogAudit::logSummary(const std::string& denial, const Denial& record) {
+    atomic_fetch_add_explicit(&mSummaries, 1, memory_order_relaxed);
+    if (!main) {
+        return;
+    }
+
+    static const char tag[] = "auditd";
+    std::string msg = android::base::StringPrintf(
+        "avc: %s (%u duplicate messages suppressed)", denial.c_str(),
+        record.suppressed);
+    if (msg.size() > (LOGGER_ENTRY_MAX_PAYLOAD - sizeof(tag) - 2)) {
+        msg.resize(LOGGER_ENTRY_MAX_PAYLOAD - sizeof(tag) - 2);
+    }
+
+    size_t n = 1 + sizeof(tag) + msg.size() + 1;
+    char newstr[n];
+    *newstr = record.info ? ANDROID_LOG_INFO : ANDROID_LOG_WARN;
+    memcpy(newstr + 1, tag, sizeof(tag));
+    memcpy(newstr + 1 + sizeof(tag), msg.c_str(), msg.size() + 1);
+
+    log_time now(isMonotonic() ? CLOCK_MONOTONIC : CLOCK_REALTIME);
+    if (logbuf->log(LOG_ID_MAIN, now, AID_LOGD, getpid(), gettid(), newstr,
+                    (unsigned short)n) >= 0) {
+        reader->notifyNewLog();
+    }
+}
+
+std::string LogAudit::format() const {
+    return android::base::StringPrintf(
+        "\nAudit: %lu received, %u/s%s, %lu duplicate denials suppressed "
+        "in %lu summaries\n",
+        atomic_load_explicit(&mReceived, memory_order_relaxed),
+        atomic_load_explicit(&mRate, memory_order_relaxed),
+        atomic_load_explicit(&mTooFast, memory_order_relaxed)
+            ? " (rate limited)"
+            : "",
+        atomic_load_explicit(&mSuppressed, memory_order_relaxed),
+        atomic_load_explicit(&mSummaries, memory_order_relaxed));
+}
+
 int LogAudit::log(char* buf, size_t len) {
     char* audit = strstr(buf, " audit(");
     if (!audit || (audit >= &buf[len])) {
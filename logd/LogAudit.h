@@ -17,7 +17,11 @@
 #ifndef _LOGD_LOG_AUDIT_H__
 #define _LOGD_LOG_AUDIT_H__
 
+#include <stdatomic.h>
+
 #include <queue>
+#include <string>
+#include <unordered_map>
 
 #include <sysutils/SocketListener.h>
 
@@ -38,12 +42,35 @@ class LogAudit : public SocketListener {
     std::queue<log_time> bucket;
     void checkRateLimit();
 
+    // Identical AVC denials, keyed by the text following "avc: ", are only
+    // logged once per dedupWindow seconds. The repeats are counted and
+    // reported in a single summary once the window closes.
+    struct Denial {
+        log_time start;
+        unsigned suppressed;
+        bool info;
+    };
+    static const uint32_t dedupWindow = 2;
+    static const size_t maxDenials = 64;
+    std::unordered_map<std::string, Denial> denials;
+    bool suppressDenial(const char* str, bool info);
+    void flushDenials(const log_time& now);
+    void logSummary(const std::string& denial, const Denial& record);
+
+    // Reported by format(), updated by the listener thread.
+    atomic_ulong mReceived;
+    atomic_ulong mSuppressed;
+    atomic_ulong mSummaries;
+    atomic_uint mRate;
+    atomic_bool mTooFast;
+
    public:
     LogAudit(LogBuffer* buf, LogReader* reader, int fdDmesg);
     int log(char* buf, size_t len);
     bool isMonotonic() {
         return logbuf->isMonotonic();
     }
+    std::string format() const;
 
    protected:
     virtual bool onDataAvailable(SocketClient* cli);
@@ -22,18 +22,24 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/cdefs.h>
+#include <sys/prctl.h>
 #include <sys/user.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <iterator>
 #include <unordered_map>
 
+#include <android-base/stringprintf.h>
 #include <cutils/properties.h>
 #include <private/android_logger.h>
 
+#include "LogAudit.h"
 #include "LogBuffer.h"
+#include "LogIngestQueue.h"
 #include "LogKlog.h"
 #include "LogReader.h"
+#include "LogReaderBatch.h"
 #include "LogUtils.h"
 
 #ifndef __predict_false
@@ -73,26 +79,7 @@ void LogBuffer::init() {
         // be corrected. 1/30 corner case YMMV.
         //
         rdlock();
-        LogBufferElementCollection::iterator it = mLogElements.begin();
-        while ((it != mLogElements.end())) {
-            LogBufferElement* e = *it;
-            if (monotonic) {
-                if (!android::isMonotonic(e->mRealTime)) {
-                    LogKlog::convertRealToMonotonic(e->mRealTime);
-                    if ((e->mRealTime.tv_nsec % 1000) == 0) {
-                        e->mRealTime.tv_nsec++;
-                    }
-                }
-            } else {
-                if (android::isMonotonic(e->mRealTime)) {
-                    LogKlog::convertMonotonicToReal(e->mRealTime);
-                    if ((e->mRealTime.tv_nsec % 1000) == 0) {
-                        e->mRealTime.tv_nsec++;
-                    }
-                }
-            }
-            ++it;
-        }
+        convertTimestamps();
         unlock();
     }
 
@@ -115,8 +102,39 @@ void LogBuffer::init() {
     LogTimeEntry::unlock();
 }
 
+void LogBuffer::convertTimestamps() {
+    LogBufferElementCollection::iterator it = mLogElements.begin();
+    while ((it != mLogElements.end())) {
+        convertTimestamp(*it);
+        ++it;
+    }
+}
+
+void LogBuffer::convertTimestamp(LogBufferElement* e) {
+    if (monotonic) {
+        if (!android::isMonotonic(e->mRealTime)) {
+            LogKlog::convertRealToMonotonic(e->mRealTime);
+            if ((e->mRealTime.tv_nsec % 1000) == 0) {
+                e->mRealTime.tv_nsec++;
+            }
+        }
+    } else {
+        if (android::isMonotonic(e->mRealTime)) {
+            LogKlog::convertMonotonicToReal(e->mRealTime);
+            if ((e->mRealTime.tv_nsec % 1000) == 0) {
+                e->mRealTime.tv_nsec++;
+            }
+        }
+    }
+}
+
 LogBuffer::LogBuffer(LastLogTimes* times)
-    : monotonic(android_log_clockid() == CLOCK_MONOTONIC), mTimes(*times) {
+    : monotonic(android_log_clockid() == CLOCK_MONOTONIC),
+      mIndexed(__android_logger_property_get_bool(
+          "logd.index", BOOL_DEFAULT_FALSE | BOOL_DEFAULT_FLAG_PERSIST)),
+      mIngestQueue(nullptr),
+      mAudit(nullptr),
+      mTimes(*times) {
     pthread_rwlock_init(&mLogElementsLock, nullptr);
 
     log_id_for_each(i) {
@@ -124,10 +142,31 @@ LogBuffer::LogBuffer(LastLogTimes* times)
         droppedElements[i] = nullptr;
     }
 
+    memset(mPruneLatency, 0, sizeof(mPruneLatency));
+    mPruneExit = false;
+    mPruneRequest = 0;
+    pthread_mutex_init(&mPruneLock, nullptr);
+    pthread_cond_init(&mPruneCondition, nullptr);
+    mPruneAsync = __android_logger_property_get_bool(
+                      "logd.prune.async",
+                      BOOL_DEFAULT_FALSE | BOOL_DEFAULT_FLAG_PERSIST) &&
+                  !pthread_create(&mPruneThread, nullptr,
+                                  LogBuffer::pruneThreadStart, this);
+
     init();
 }
 
 LogBuffer::~LogBuffer() {
+    if (mPruneAsync) {
+        pthread_mutex_lock(&mPruneLock);
+        mPruneExit = true;
+        pthread_cond_signal(&mPruneCondition);
+        pthread_mutex_unlock(&mPruneLock);
+        pthread_join(mPruneThread, nullptr);
+    }
+    pthread_cond_destroy(&mPruneCondition);
+    pthread_mutex_destroy(&mPruneLock);
+
     log_id_for_each(i) {
         delete lastLoggedElements[i];
         delete droppedElements[i];
@@ -196,6 +235,26 @@ static enum match_type identical(LogBufferElement* elem,
     return SAME;
 }
 
+bool LogBuffer::isLoggable(log_id_t log_id, const char* msg,
+                           unsigned short len) {
+    if (log_id == LOG_ID_SECURITY) {
+        return true;
+    }
+
+    int prio = ANDROID_LOG_INFO;
+    const char* tag = nullptr;
+    if (log_id == LOG_ID_EVENTS) {
+        tag = tagToName(
+            (len >= sizeof(android_event_header_t))
+                ? reinterpret_cast<const android_event_header_t*>(msg)->tag
+                : 0);
+    } else {
+        prio = *msg;
+        tag = msg + 1;
+    }
+    return __android_log_is_loggable(prio, tag, ANDROID_LOG_VERBOSE);
+}
+
 int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
                    pid_t tid, const char* msg, unsigned short len) {
     if ((log_id >= LOG_ID_MAX) || (log_id < 0)) {
@@ -207,28 +266,63 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
     // exact entry with time specified in ms or us precision.
     if ((realtime.tv_nsec % 1000) == 0) ++realtime.tv_nsec;
 
-    LogBufferElement* elem =
-        new LogBufferElement(log_id, realtime, uid, pid, tid, msg, len);
-    if (log_id != LOG_ID_SECURITY) {
-        int prio = ANDROID_LOG_INFO;
-        const char* tag = nullptr;
-        if (log_id == LOG_ID_EVENTS) {
-            tag = tagToName(elem->getTag());
-        } else {
-            prio = *msg;
-            tag = msg + 1;
+    if (!isLoggable(log_id, msg, len)) {
+        // Log traffic received to total
+        wrlock();
+        stats.addTotal(log_id, len);
+        unlock();
+        return -EACCES;
+    }
+
+    wrlock();
+    int ret = logLocked(log_id, realtime, uid, pid, tid, msg, len);
+    unlock();
+
+    return ret;
+}
+
+// Publish a batch drained from the ingest queue under one write lock.
+size_t LogBuffer::log(LogIngestEntry* const* entries, size_t count) {
+    // The loggable check may consult properties, keep it outside the lock.
+    for (size_t i = 0; i < count; ++i) {
+        LogIngestEntry* entry = entries[i];
+        if ((entry->mLogId >= LOG_ID_MAX) || (entry->mLogId < 0)) {
+            entry->mLoggable = false;
+            continue;
         }
-        if (!__android_log_is_loggable(prio, tag, ANDROID_LOG_VERBOSE)) {
+        entry->mLoggable = isLoggable(entry->mLogId, entry->mMsg, entry->mLen);
+    }
+
+    size_t accepted = 0;
+    wrlock();
+    for (size_t i = 0; i < count; ++i) {
+        LogIngestEntry* entry = entries[i];
+        if ((entry->mLogId >= LOG_ID_MAX) || (entry->mLogId < 0)) {
+            continue;
+        }
+        if (!entry->mLoggable) {
             // Log traffic received to total
-            wrlock();
-            stats.addTotal(elem);
-            unlock();
-            delete elem;
-            return -EACCES;
+            stats.addTotal(entry->mLogId, entry->mLen);
+            continue;
+        }
+        log_time realtime = entry->mRealTime;
+        if ((realtime.tv_nsec % 1000) == 0) ++realtime.tv_nsec;
+        if (logLocked(entry->mLogId, realtime, entry->mUid, entry->mPid,
+                      entry->mTid, entry->mMsg, entry->mLen) > 0) {
+            ++accepted;
         }
     }
+    unlock();
+
+    return accepted;
+}
+
+int LogBuffer::logLocked(log_id_t log_id, log_time realtime, uid_t uid,
+                         pid_t pid, pid_t tid, const char* msg,
+                         unsigned short len) {
+    LogBufferElement* elem =
+        new LogBufferElement(log_id, realtime, uid, pid, tid, msg, len);
 
-    wrlock();
     LogBufferElement* currentLast = lastLoggedElements[log_id];
     if (currentLast) {
         LogBufferElement* dropped = droppedElements[log_id];
@@ -329,14 +423,12 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
                     // check for overflow
                     if (total >= UINT32_MAX) {
                         log(currentLast);
-                        unlock();
                         return len;
                     }
                     stats.addTotal(currentLast);
                     delete currentLast;
                     swab = total;
                     event->payload.data = htole32(swab);
-                    unlock();
                     return len;
                 }
                 if (count == USHRT_MAX) {
@@ -353,7 +445,6 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
             }
             droppedElements[log_id] = currentLast;
             lastLoggedElements[log_id] = elem;
-            unlock();
             return len;
         }
         if (dropped) {         // State 1 or 2
@@ -371,7 +462,6 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
     lastLoggedElements[log_id] = new LogBufferElement(*elem);
 
     log(elem);
-    unlock();
 
     return len;
 }
@@ -392,6 +482,7 @@ void LogBuffer::log(LogBufferElement* elem) {
                         (elem->getLogId() != LOG_ID_KERNEL) &&
                         ((*it)->getLogId() != LOG_ID_KERNEL))) {
         mLogElements.push_back(elem);
+        indexAdd(std::prev(mLogElements.end()));
     } else {
         log_time end = log_time::EPOCH;
         bool end_set = false;
@@ -418,6 +509,7 @@ void LogBuffer::log(LogBufferElement* elem) {
 
         if (end_always || (end_set && (end > (*it)->getRealTime()))) {
             mLogElements.push_back(elem);
+            indexAdd(std::prev(mLogElements.end()));
         } else {
             // should be short as timestamps are localized near end()
             do {
@@ -428,7 +520,7 @@ void LogBuffer::log(LogBufferElement* elem) {
                 --it;
             } while (((*it)->getRealTime() > elem->getRealTime()) &&
                      (!end_set || (end <= (*it)->getRealTime())));
-            mLogElements.insert(last, elem);
+            indexAdd(mLogElements.insert(last, elem));
         }
         LogTimeEntry::unlock();
     }
@@ -437,28 +529,205 @@ void LogBuffer::log(LogBufferElement* elem) {
     maybePrune(elem->getLogId());
 }
 
+// Add the element at it to the pid index. Postings follow mLogElements
+// order, the entries of the same pid already after it are still after it.
+//
+// LogBuffer::wrlock() must be held when this function is called.
+void LogBuffer::indexAdd(LogBufferElementCollection::iterator it) {
+    if (!mIndexed) {
+        return;
+    }
+
+    LogBufferElement* element = *it;
+    pid_t pid = element->getPid();
+    LogBufferPidPostings& postings = mPidIndex[pid];
+    LogBufferPidPostings::iterator pos = postings.end();
+    // short, elements are rarely inserted far from the end
+    for (LogBufferElementCollection::iterator next = std::next(it);
+         next != mLogElements.end(); ++next) {
+        if ((*next)->getPid() == pid) {
+            --pos;
+        }
+    }
+    mPidIndexOf[element] = postings.insert(pos, it);
+}
+
+// LogBuffer::wrlock() must be held when this function is called.
+void LogBuffer::indexRemove(const LogBufferElement* element) {
+    if (!mIndexed) {
+        return;
+    }
+
+    auto found = mPidIndexOf.find(element);
+    if (found == mPidIndexOf.end()) {
+        return;
+    }
+    auto postings = mPidIndex.find(element->getPid());
+    postings->second.erase(found->second);
+    if (postings->second.empty()) {
+        mPidIndex.erase(postings);
+    }
+    mPidIndexOf.erase(found);
+}
+
+// First element of pid after start, mLogElements.end() if none.
+//
+// LogBuffer::rdlock() must be held when this function is called.
+LogBufferElementCollection::iterator LogBuffer::indexFirst(
+    pid_t pid, const log_time& start) {
+    auto found = mPidIndex.find(pid);
+    if (found == mPidIndex.end()) {
+        return mLogElements.end();
+    }
+
+    LogBufferPidPostings& postings = found->second;
+    LogBufferPidPostings::iterator pos = postings.begin();
+    if (start != log_time::EPOCH) {
+        // Client wants to start from some specified time. Chances are
+        // we are better off starting from the end of the postings.
+        pos = postings.end();
+        while (pos != postings.begin()) {
+            --pos;
+            if ((**pos)->getRealTime() <= start) {
+                ++pos;
+                break;
+            }
+        }
+    }
+    return (pos == postings.end()) ? mLogElements.end() : *pos;
+}
+
+// Element of pid following the one at it, mLogElements.end() if none.
+//
+// LogBuffer::rdlock() must be held when this function is called.
+LogBufferElementCollection::iterator LogBuffer::indexNext(
+    pid_t pid, LogBufferElementCollection::iterator it) {
+    LogBufferElement* element = *it;
+    if (element->getPid() != pid) {
+        // erase() pushed a reader cursor back onto an element of another
+        // pid, catch up the long way round.
+        while ((++it != mLogElements.end()) && ((*it)->getPid() != pid)) {
+        }
+        return it;
+    }
+
+    auto found = mPidIndexOf.find(element);
+    if (found == mPidIndexOf.end()) {
+        return mLogElements.end();
+    }
+    LogBufferPidPostings::iterator pos = std::next(found->second);
+    if (pos == mPidIndex.find(pid)->second.end()) {
+        return mLogElements.end();
+    }
+    return *pos;
+}
+
 // Prune at most 10% of the log entries or maxPrune, whichever is less.
 //
 // LogBuffer::wrlock() must be held when this function is called.
-void LogBuffer::maybePrune(log_id_t id) {
+// Rows to prune from "id" to bring it back under 90% of its size, in one
+// slice of at most maxPrune rows, or zero if it is not over its size.
+//
+// LogBuffer::wrlock() must be held when this function is called.
+unsigned long LogBuffer::pruneRows(log_id_t id) {
     size_t sizes = stats.sizes(id);
     unsigned long maxSize = log_buffer_size(id);
-    if (sizes > maxSize) {
-        size_t sizeOver = sizes - ((maxSize * 9) / 10);
-        size_t elements = stats.realElements(id);
-        size_t minElements = elements / 100;
-        if (minElements < minPrune) {
-            minElements = minPrune;
+    if (sizes <= maxSize) {
+        return 0;
+    }
+    size_t sizeOver = sizes - ((maxSize * 9) / 10);
+    size_t elements = stats.realElements(id);
+    size_t minElements = elements / 100;
+    if (minElements < minPrune) {
+        minElements = minPrune;
+    }
+    unsigned long pruneRows = elements * sizeOver / sizes;
+    if (pruneRows < minElements) {
+        pruneRows = minElements;
+    }
+    if (pruneRows > maxPrune) {
+        pruneRows = maxPrune;
+    }
+    return pruneRows;
+}
+
+// prune() recording its latency in the histogram.
+//
+// LogBuffer::wrlock() must be held when this function is called.
+bool LogBuffer::timedPrune(log_id_t id, unsigned long pruneRows) {
+    log_time begin(CLOCK_MONOTONIC);
+    bool busy = prune(id, pruneRows);
+    uint64_t usec = (log_time(CLOCK_MONOTONIC) - begin).nsec() / 1000;
+
+    size_t bucket = 0;
+    while ((usec >>= 1) && (bucket < (pruneLatencyBuckets - 1))) {
+        ++bucket;
+    }
+    ++mPruneLatency[bucket];
+    return busy;
+}
+
+// LogBuffer::wrlock() must be held when this function is called.
+void LogBuffer::maybePrune(log_id_t id) {
+    unsigned long rows = pruneRows(id);
+    if (!rows) {
+        return;
+    }
+    // Leave it to the prune thread unless an eighth over the limit, from
+    // then on the writers pay inline to keep memory bounded.
+    unsigned long maxSize = log_buffer_size(id);
+    if (mPruneAsync && (stats.sizes(id) <= (maxSize + (maxSize / 8)))) {
+        pthread_mutex_lock(&mPruneLock);
+        if (!(mPruneRequest & (1 << id))) {
+            mPruneRequest |= 1 << id;
+            pthread_cond_signal(&mPruneCondition);
         }
-        unsigned long pruneRows = elements * sizeOver / sizes;
-        if (pruneRows < minElements) {
-            pruneRows = minElements;
+        pthread_mutex_unlock(&mPruneLock);
+        return;
+    }
+    timedPrune(id, rows);
+}
+
+void* LogBuffer::pruneThreadStart(void* obj) {
+    prctl(PR_SET_NAME, "logd.prune");
+
+    LogBuffer* me = reinterpret_cast<LogBuffer*>(obj);
+
+    for (;;) {
+        pthread_mutex_lock(&me->mPruneLock);
+        while (!me->mPruneRequest && !me->mPruneExit) {
+            pthread_cond_wait(&me->mPruneCondition, &me->mPruneLock);
         }
-        if (pruneRows > maxPrune) {
-            pruneRows = maxPrune;
+        unsigned int request = me->mPruneRequest;
+        me->mPruneRequest = 0;
+        bool exit = me->mPruneExit;
+        pthread_mutex_unlock(&me->mPruneLock);
+
+        if (exit) {
+            break;
+        }
+
+        log_id_for_each(id) {
+            if (!(request & (1 << id))) {
+                continue;
+            }
+            // One slice per hold of the lock, stop if readers hold us back,
+            // the next log() will ask again.
+            for (;;) {
+                me->wrlock();
+                size_t sizes = me->stats.sizes(id);
+                unsigned long rows = me->pruneRows(id);
+                bool done = !rows || me->timedPrune(id, rows) ||
+                            (me->stats.sizes(id) >= sizes);
+                me->unlock();
+                if (done) {
+                    break;
+                }
+            }
         }
-        prune(id, pruneRows);
     }
+
+    return nullptr;
 }
 
 LogBufferElementCollection::iterator LogBuffer::erase(
@@ -491,6 +760,19 @@ LogBufferElementCollection::iterator LogBuffer::erase(
         }
     }
 
+    // Push reader cursors back to the previous element, the next flushTo()
+    // resumes with whatever follows it. LogTimeEntry lock held by prune().
+    for (LastLogTimes::iterator t = mTimes.begin(); t != mTimes.end(); ++t) {
+        LogBufferCursor& cursor = (*t)->mCursor;
+        if (cursor.mSet && !cursor.mHead && (cursor.mLast == it)) {
+            if (it == mLogElements.begin()) {
+                cursor.mHead = true;
+            } else {
+                cursor.mLast = std::prev(it);
+            }
+        }
+    }
+
     bool setLast[LOG_ID_MAX];
     bool doSetLast = false;
     log_id_for_each(i) {
@@ -536,6 +818,7 @@ LogBufferElementCollection::iterator LogBuffer::erase(
         }
     }
 #endif
+    indexRemove(element);
     if (coalesce) {
         stats.erase(element);
     } else {
@@ -1097,13 +1380,26 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
                             pid_t* lastTid, bool privileged, bool security,
                             int (*filter)(const LogBufferElement* element,
                                           void* arg),
-                            void* arg) {
+                            void* arg, LogBufferCursor* cursor,
+                            const LogReaderFilter* readerFilter) {
     LogBufferElementCollection::iterator it;
     uid_t uid = reader->getUid();
+    pid_t pid = (mIndexed && cursor) ? cursor->mPid : 0;
 
     rdlock();
 
-    if (start == log_time::EPOCH) {
+    if (pid) {
+        // walk the index, the filter still checks each element
+        if (cursor->mSet && (cursor->mStart == start)) {
+            it = cursor->mHead ? indexFirst(pid, log_time::EPOCH)
+                               : indexNext(pid, cursor->mLast);
+        } else {
+            it = indexFirst(pid, start);
+        }
+    } else if (cursor && cursor->mSet && (cursor->mStart == start)) {
+        // resume after the last element visited by the previous call
+        it = cursor->mHead ? mLogElements.begin() : std::next(cursor->mLast);
+    } else if (start == log_time::EPOCH) {
         // client wants to start from the beginning
         it = mLogElements.begin();
     } else {
@@ -1133,11 +1429,13 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
     }
 
     log_time curr = start;
+    LogReaderBatch batch(reader, privileged, readerFilter);
 
     LogBufferElement* lastElement = nullptr;  // iterator corruption paranoia
     static const size_t maxSkip = 4194304;    // maximum entries to skip
     size_t skip = maxSkip;
-    for (; it != mLogElements.end(); ++it) {
+    for (; it != mLogElements.end();
+         it = pid ? indexNext(pid, it) : std::next(it)) {
         LogBufferElement* element = *it;
 
         if (!--skip) {
@@ -1150,6 +1448,12 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
         }
         lastElement = element;
 
+        if (cursor) {
+            cursor->mLast = it;
+            cursor->mSet = true;
+            cursor->mHead = false;
+        }
+
         if (!privileged && (element->getUid() != uid)) {
             continue;
         }
@@ -1165,6 +1469,9 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
                 continue;
             }
             if (ret != true) {
+                if (cursor) {  // element not consumed, search next time
+                    cursor->mSet = false;
+                }
                 break;
             }
         }
@@ -1181,10 +1488,20 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
                 (element->getDropped() && !sameTid) ? 0 : element->getTid();
         }
 
+        // regular entries are copied, lock only dropped to send the batch
+        bool queued = batch.add(element);
+        if (queued && !batch.full()) {
+            skip = maxSkip;
+            continue;
+        }
+
         unlock();
 
         // range locking in LastLogTimes looks after us
-        curr = element->flushTo(reader, this, privileged, sameTid);
+        curr = batch.flush();
+        if (!queued && (curr != element->FLUSH_ERROR)) {
+            curr = element->flushTo(reader, this, privileged, sameTid);
+        }
 
         if (curr == element->FLUSH_ERROR) {
             return curr;
@@ -1192,6 +1509,26 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
 
         skip = maxSkip;
         rdlock();
+        if (cursor) {
+            // erase() may have pushed the cursor back while unlocked, if it
+            // fell off the beginning pick up from there on the next call.
+            if (cursor->mHead) {
+                break;
+            }
+            it = cursor->mLast;
+            lastElement = *it;
+        }
+    }
+    if (!batch.empty()) {
+        unlock();
+        curr = batch.flush();
+        if (curr == LogBufferElement::FLUSH_ERROR) {
+            return curr;
+        }
+        rdlock();
+    }
+    if (cursor && cursor->mSet) {
+        cursor->mStart = curr;
     }
     unlock();
 
@@ -1200,11 +1537,37 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
 
 std::string LogBuffer::formatStatistics(uid_t uid, pid_t pid,
                                         unsigned int logMask) {
-    wrlock();
+    // Format from a snapshot, writers only wait for the copy and not for
+    // the name lookups and string formatting.
+    rdlock();
+    LogStatistics snapshot(stats);
+    unsigned long latency[pruneLatencyBuckets];
+    memcpy(latency, mPruneLatency, sizeof(latency));
+    unlock();
 
-    std::string ret = stats.format(uid, pid, logMask);
+    std::string ret = snapshot.format(uid, pid, logMask);
 
-    unlock();
+    std::string histogram;
+    for (size_t i = 0; i < pruneLatencyBuckets; ++i) {
+        if (!latency[i]) continue;
+        if (i == (pruneLatencyBuckets - 1)) {
+            histogram += android::base::StringPrintf(" >=%luus:%lu", 1UL << i,
+                                                     latency[i]);
+        } else {
+            histogram += android::base::StringPrintf(" <%luus:%lu", 2UL << i,
+                                                     latency[i]);
+        }
+    }
+    if (!histogram.empty()) {
+        ret += "\nPrune latency:" + histogram + "\n";
+    }
+
+    if (mIngestQueue) {
+        ret += mIngestQueue->format();
+    }
+    if (mAudit) {
+        ret += mAudit->format();
+    }
 
     return ret;
 }
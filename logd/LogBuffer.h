@@ -73,14 +73,24 @@ static bool isMonotonic(const log_time& mono) {
 }
 }
 
+class LogIngestQueue;
+class LogAudit;
+class LogReaderFilter;
+
 typedef std::list<LogBufferElement*> LogBufferElementCollection;
 
 class LogBuffer : public LogBufferInterface {
     LogBufferElementCollection mLogElements;
     pthread_rwlock_t mLogElementsLock;
 
+   protected:
     LogStatistics stats;
 
+    unsigned long mMaxSize[LOG_ID_MAX];
+
+    bool monotonic;
+
+   private:
     PruneList mPrune;
     // watermark for last per log id
     LogBufferElementCollection::iterator mLast[LOG_ID_MAX];
@@ -94,9 +104,20 @@ class LogBuffer : public LogBufferInterface {
         LogBufferPidIteratorMap;
     LogBufferPidIteratorMap mLastWorstPidOfSystem[LOG_ID_MAX];
 
-    unsigned long mMaxSize[LOG_ID_MAX];
-
-    bool monotonic;
+    // Optional index of the elements of each pid, kept in mLogElements
+    // order, so that pid filtered readers only visit their own entries.
+    typedef std::list<LogBufferElementCollection::iterator>
+        LogBufferPidPostings;
+    std::unordered_map<pid_t, LogBufferPidPostings> mPidIndex;
+    std::unordered_map<const LogBufferElement*, LogBufferPidPostings::iterator>
+        mPidIndexOf;
+    bool mIndexed;
+    void indexAdd(LogBufferElementCollection::iterator it);
+    void indexRemove(const LogBufferElement* element);
+    LogBufferElementCollection::iterator indexFirst(pid_t pid,
+                                                    const log_time& start);
+    LogBufferElementCollection::iterator indexNext(
+        pid_t pid, LogBufferElementCollection::iterator it);
 
     LogTags tags;
 
@@ -104,38 +125,54 @@ class LogBuffer : public LogBufferInterface {
     LogBufferElement* droppedElements[LOG_ID_MAX];
     void log(LogBufferElement* elem);
 
+    LogIngestQueue* mIngestQueue;
+    LogAudit* mAudit;
+
    public:
     LastLogTimes& mTimes;
 
     explicit LogBuffer(LastLogTimes* times);
     ~LogBuffer() override;
-    void init();
+    virtual void init();
     bool isMonotonic() {
         return monotonic;
     }
 
     int log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid, pid_t tid,
             const char* msg, unsigned short len) override;
+    size_t log(LogIngestEntry* const* entries, size_t count) override;
     // lastTid is an optional context to help detect if the last previous
     // valid message was from the same source so we can differentiate chatty
     // filter types (identical or expired)
-    log_time flushTo(SocketClient* writer, const log_time& start,
-                     pid_t* lastTid,  // &lastTid[LOG_ID_MAX] or nullptr
-                     bool privileged, bool security,
-                     int (*filter)(const LogBufferElement* element,
-                                   void* arg) = nullptr,
-                     void* arg = nullptr);
+    // cursor is an optional reader position carried between calls, used when
+    // start is the time returned by the previous call.
+    virtual log_time flushTo(
+        SocketClient* writer, const log_time& start,
+        pid_t* lastTid,  // &lastTid[LOG_ID_MAX] or nullptr
+        bool privileged, bool security,
+        int (*filter)(const LogBufferElement* element, void* arg) = nullptr,
+        void* arg = nullptr, LogBufferCursor* cursor = nullptr,
+        const LogReaderFilter* readerFilter = nullptr);
 
     bool clear(log_id_t id, uid_t uid = AID_ROOT);
     unsigned long getSize(log_id_t id);
     int setSize(log_id_t id, unsigned long size);
-    unsigned long getSizeUsed(log_id_t id);
+    virtual unsigned long getSizeUsed(log_id_t id);
 
-    std::string formatStatistics(uid_t uid, pid_t pid, unsigned int logMask);
+    virtual std::string formatStatistics(uid_t uid, pid_t pid,
+                                         unsigned int logMask);
 
     void enableStatistics() {
         stats.enableStatistics();
     }
+    // Report the depth and drops of the ingest queue in the statistics.
+    void setIngestQueue(LogIngestQueue* queue) {
+        mIngestQueue = queue;
+    }
+    // Report the audit message rates and suppressed denials in the statistics.
+    void setAudit(LogAudit* audit) {
+        mAudit = audit;
+    }
 
     int initPrune(const char* cp) {
         return mPrune.init(cp);
@@ -178,16 +215,49 @@ class LogBuffer : public LogBufferInterface {
         pthread_rwlock_unlock(&mLogElementsLock);
     }
 
+   protected:
+    static const log_time pruneMargin;
+
+    // __android_log_is_loggable() check of the message, without the lock.
+    bool isLoggable(log_id_t log_id, const char* msg, unsigned short len);
+    // Add a loggable message to the buffer.
+    // LogBuffer::wrlock() must be held when this is called.
+    virtual int logLocked(log_id_t log_id, log_time realtime, uid_t uid,
+                          pid_t pid, pid_t tid, const char* msg,
+                          unsigned short len);
+
+    void kickMe(LogTimeEntry* me, log_id_t id, unsigned long pruneRows);
+
+    // LogBuffer::wrlock() must be held when these are called.
+    virtual bool prune(log_id_t id, unsigned long pruneRows,
+                       uid_t uid = AID_ROOT);
+    // Convert held timestamps in-place after a change of the clock source.
+    virtual void convertTimestamps();
+    void convertTimestamp(LogBufferElement* element);
+
    private:
     static constexpr size_t minPrune = 4;
     static constexpr size_t maxPrune = 256;
-    static const log_time pruneMargin;
-
+    // log2 buckets of prune() latency in microseconds, last is open ended
+    static constexpr size_t pruneLatencyBuckets = 16;
+
+    // With logd.prune.async, log() leaves pruning within a slack above the
+    // size limit to a background thread that prunes in maxPrune slices,
+    // dropping the lock between slices so ingestion interleaves.
+    bool mPruneAsync;
+    bool mPruneExit;
+    unsigned int mPruneRequest;  // mask of log ids, protected by mPruneLock
+    pthread_mutex_t mPruneLock;
+    pthread_cond_t mPruneCondition;
+    pthread_t mPruneThread;
+    unsigned long mPruneLatency[pruneLatencyBuckets];
+
+    static void* pruneThreadStart(void* obj);
+    unsigned long pruneRows(log_id_t id);
+    bool timedPrune(log_id_t id, unsigned long pruneRows);
     void maybePrune(log_id_t id);
     bool isBusy(log_time watermark);
-    void kickMe(LogTimeEntry* me, log_id_t id, unsigned long pruneRows);
 
-    bool prune(log_id_t id, unsigned long pruneRows, uid_t uid = AID_ROOT);
     LogBufferElementCollection::iterator erase(
         LogBufferElementCollection::iterator it, bool coalesce = false);
 };
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include <memory>
+#include <new>
+
+#include <private/android_logger.h>
+#include <zlib.h>
+
+#include "LogBufferChunk.h"
+
+LogBufferChunk::LogBufferChunk(size_t capacity, uint64_t id)
+    : mData(new char[capacity]),
+      mCapacity(capacity),
+      mWriteOffset(0),
+      mElements(0),
+      mId(id),
+      mOldest(log_time::tv_sec_max, log_time::tv_nsec_max),
+      mNewest(log_time::EPOCH),
+      mCompressed(nullptr),
+      mCompressedSize(0),
+      mReaders(0),
+      mSealed(false),
+      mExpired(false),
+      mMapped(nullptr),
+      mMappedSize(0) {
+    pthread_mutex_init(&mLock, nullptr);
+}
+
+LogBufferChunk::LogBufferChunk(uint64_t id, void* mapped, size_t mappedSize,
+                               char* image, size_t imageSize, bool compressed,
+                               size_t used, size_t elements, log_time oldest,
+                               log_time newest)
+    : mData(compressed ? nullptr : image),
+      mCapacity(used),
+      mWriteOffset(used),
+      mElements(elements),
+      mId(id),
+      mOldest(oldest),
+      mNewest(newest),
+      mCompressed(compressed ? image : nullptr),
+      mCompressedSize(compressed ? imageSize : 0),
+      mReaders(0),
+      mSealed(true),
+      mExpired(false),
+      mMapped(mapped),
+      mMappedSize(mappedSize) {
+    pthread_mutex_init(&mLock, nullptr);
+    if (mData) {
+        relink();
+    }
+}
+
+LogBufferChunk::~LogBufferChunk() {
+    // Elements were placement constructed over mData and own no memory.
+    if (mMapped) {
+        if (mCompressed) {
+            delete[] mData;  // inflated copy
+        }
+        munmap(mMapped, mMappedSize);
+    } else {
+        delete[] mData;
+        delete[] mCompressed;
+    }
+    pthread_mutex_destroy(&mLock);
+}
+
+LogBufferElement* LogBufferChunk::append(log_id_t log_id, log_time realtime,
+                                         uid_t uid, pid_t pid, pid_t tid,
+                                         const char* msg, unsigned short len) {
+    size_t size = entrySize(len);
+    if (mSealed || (size > (mCapacity - mWriteOffset))) {
+        return nullptr;
+    }
+
+    Entry* entry = entryAt(mWriteOffset);
+    entry->mMsgLen = len;
+    entry->mErased = false;
+
+    char* storage = reinterpret_cast<char*>(entry + 1);
+    LogBufferElement* element =
+        new (storage) LogBufferElement(log_id, realtime, uid, pid, tid, msg,
+                                       len, storage + sizeof(LogBufferElement));
+
+    mWriteOffset += size;
+    ++mElements;
+    if (realtime < mOldest) mOldest = realtime;
+    if (mNewest < realtime) mNewest = realtime;
+
+    return element;
+}
+
+// Requires mLock held, and mData resident.
+bool LogBufferChunk::deflate() {
+    uLongf size = compressBound(mWriteOffset);
+    std::unique_ptr<Bytef[]> buffer(new (std::nothrow) Bytef[size]);
+    if (!buffer ||
+        (compress2(buffer.get(), &size, reinterpret_cast<Bytef*>(mData),
+                   mWriteOffset, Z_BEST_SPEED) != Z_OK) ||
+        (size >= mWriteOffset)) {
+        return false;
+    }
+    mCompressed = new (std::nothrow) char[size];
+    if (!mCompressed) {
+        return false;
+    }
+    memcpy(mCompressed, buffer.get(), size);
+    mCompressedSize = size;
+    return true;
+}
+
+// Requires mLock held, and mCompressed valid.
+bool LogBufferChunk::inflate() {
+    char* data = new (std::nothrow) char[mWriteOffset];
+    if (!data) {
+        return false;
+    }
+    uLongf size = mWriteOffset;
+    if ((uncompress(reinterpret_cast<Bytef*>(data), &size,
+                    reinterpret_cast<Bytef*>(mCompressed),
+                    mCompressedSize) != Z_OK) ||
+        (size != mWriteOffset)) {
+        delete[] data;
+        return false;
+    }
+    mData = data;
+    relink();
+    return true;
+}
+
+// Repoint the elements at their payload in a new copy of mData.
+void LogBufferChunk::relink() {
+    for (size_t offset = 0; offset < mWriteOffset; offset = next(offset)) {
+        char* storage = reinterpret_cast<char*>(entryAt(offset) + 1);
+        reinterpret_cast<LogBufferElement*>(storage)->mMsg =
+            storage + sizeof(LogBufferElement);
+    }
+}
+
+// The compressed copy is stale once the uncompressed data is modified.
+void LogBufferChunk::invalidate() {
+    pthread_mutex_lock(&mLock);
+    delete[] mCompressed;
+    mCompressed = nullptr;
+    mCompressedSize = 0;
+    pthread_mutex_unlock(&mLock);
+}
+
+void LogBufferChunk::seal() {
+    pthread_mutex_lock(&mLock);
+    mSealed = true;
+    if (mData && !mCompressed && deflate() && !mReaders) {
+        delete[] mData;
+        mData = nullptr;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+bool LogBufferChunk::incReader() {
+    pthread_mutex_lock(&mLock);
+    bool resident = mData || inflate();
+    if (resident) {
+        ++mReaders;
+    }
+    pthread_mutex_unlock(&mLock);
+    return resident;
+}
+
+void LogBufferChunk::decReader() {
+    pthread_mutex_lock(&mLock);
+    --mReaders;
+    bool release = !mReaders && mExpired;
+    if (!mReaders && mSealed && mCompressed) {
+        delete[] mData;
+        mData = nullptr;
+    }
+    pthread_mutex_unlock(&mLock);
+    if (release) {
+        // No one else is holding a reference to this
+        delete this;
+    }
+}
+
+void LogBufferChunk::expire() {
+    pthread_mutex_lock(&mLock);
+    mExpired = true;
+    bool release = !mReaders;
+    pthread_mutex_unlock(&mLock);
+    if (release) {
+        delete this;
+    }
+}
+
+LogBufferElement* LogBufferChunk::elementAt(size_t& offset) const {
+    if (!mData) {
+        return nullptr;
+    }
+    while (offset < mWriteOffset) {
+        Entry* entry = entryAt(offset);
+        if (!entry->mErased) {
+            return reinterpret_cast<LogBufferElement*>(entry + 1);
+        }
+        offset = next(offset);
+    }
+    return nullptr;
+}
+
+void LogBufferChunk::erase(size_t offset) {
+    Entry* entry = entryAt(offset);
+    if (!entry->mErased) {
+        entry->mErased = true;
+        --mElements;
+        if (mCompressed) invalidate();
+    }
+}
+
+void LogBufferChunk::updateTimes() {
+    mOldest = log_time(log_time::tv_sec_max, log_time::tv_nsec_max);
+    mNewest = log_time::EPOCH;
+    for (size_t offset = 0; offset < mWriteOffset; offset = next(offset)) {
+        log_time realtime =
+            reinterpret_cast<LogBufferElement*>(entryAt(offset) + 1)
+                ->getRealTime();
+        if (realtime < mOldest) mOldest = realtime;
+        if (mNewest < realtime) mNewest = realtime;
+    }
+    if (mCompressed) invalidate();
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_BUFFER_CHUNK_H__
+#define _LOGD_LOG_BUFFER_CHUNK_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <log/log.h>
+
+#include "LogBufferElement.h"
+
+// A fixed capacity, append only, region of memory holding the elements of
+// a single log id back to back, each immediately followed by its payload.
+// Elements are addressed by their byte offset into the chunk, offsets stay
+// valid for the life of the chunk as nothing is ever moved or compacted.
+//
+// Once sealed, no longer written to, the chunk is deflated and the original
+// released. Readers hold a reference with incReader() which inflates it on
+// demand, the inflated copy is released again with the last reference.
+class LogBufferChunk {
+    // precedes every element in the chunk
+    struct __attribute__((packed)) Entry {
+        uint16_t mMsgLen;
+        bool mErased;
+    };
+
+    pthread_mutex_t mLock;  // protects mData and mReaders against readers
+    char* mData;
+    const size_t mCapacity;
+    size_t mWriteOffset;
+    size_t mElements;  // elements in the chunk that are not erased
+    const uint64_t mId;
+    log_time mOldest;
+    log_time mNewest;
+
+    char* mCompressed;
+    size_t mCompressedSize;
+    unsigned int mReaders;
+    bool mSealed;
+    bool mExpired;
+
+    void* mMapped;  // image spooled to disk, see LogSpool
+    size_t mMappedSize;
+
+    Entry* entryAt(size_t offset) const {
+        return reinterpret_cast<Entry*>(mData + offset);
+    }
+    bool deflate();
+    bool inflate();
+    void relink();
+    void invalidate();
+
+   public:
+    // Footprint of a single element with a payload of len bytes.
+    static constexpr size_t entrySize(unsigned short len) {
+        return sizeof(Entry) + sizeof(LogBufferElement) + len;
+    }
+
+    LogBufferChunk(size_t capacity, uint64_t id);
+    // Sealed chunk over a private writable mapping of a spooled image,
+    // which is either compressed or the raw chunk data. Takes ownership of
+    // the mapping.
+    LogBufferChunk(uint64_t id, void* mapped, size_t mappedSize,
+                   char* image, size_t imageSize, bool compressed,
+                   size_t used, size_t elements, log_time oldest,
+                   log_time newest);
+    ~LogBufferChunk();
+
+    // Returns nullptr if the element does not fit in the remaining space.
+    LogBufferElement* append(log_id_t log_id, log_time realtime, uid_t uid,
+                             pid_t pid, pid_t tid, const char* msg,
+                             unsigned short len);
+    // Stop writing and compress, or recompress after modification.
+    void seal();
+
+    // References keeping the element data resident, incReader() returns
+    // false if the chunk could not be inflated.
+    bool incReader();
+    void decReader();
+    // Owner has unlinked the chunk, deleted with the last reference.
+    void expire();
+
+    // Element at offset, nullptr at the end of the chunk. Erased elements
+    // are skipped by advancing offset. A reference must be held if sealed.
+    LogBufferElement* elementAt(size_t& offset) const;
+    size_t next(size_t offset) const {
+        return offset + entrySize(entryAt(offset)->mMsgLen);
+    }
+    // Caller is responsible for updating statistics, and calling seal()
+    // again if the chunk was sealed.
+    void erase(size_t offset);
+    // Recalculate oldest() and newest() after timestamps are converted,
+    // also requires seal() again if the chunk was sealed.
+    void updateTimes();
+
+    // The compressed copy if there is one, otherwise the raw data which
+    // must be resident.
+    const char* image(size_t& size, bool& compressed) const {
+        compressed = mCompressed != nullptr;
+        size = compressed ? mCompressedSize : mWriteOffset;
+        return compressed ? mCompressed : mData;
+    }
+
+    uint64_t id() const {
+        return mId;
+    }
+    size_t capacity() const {
+        return mCapacity;
+    }
+    size_t used() const {
+        return mWriteOffset;
+    }
+    // memory accounted against the log buffer size
+    size_t footprint() const {
+        return mCompressed ? mCompressedSize : mCapacity;
+    }
+    size_t elements() const {
+        return mElements;
+    }
+    bool empty() const {
+        return mElements == 0;
+    }
+    bool sealed() const {
+        return mSealed;
+    }
+    // Range of timestamps held, entries are not necessarily in order.
+    log_time oldest() const {
+        return mOldest;
+    }
+    log_time newest() const {
+        return mNewest;
+    }
+};
+
+#endif  // _LOGD_LOG_BUFFER_CHUNK_H__
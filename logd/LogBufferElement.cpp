@@ -47,6 +47,21 @@ LogBufferElement::LogBufferElement(log_id_t log_id, log_time realtime,
     memcpy(mMsg, msg, len);
 }
 
+LogBufferElement::LogBufferElement(log_id_t log_id, log_time realtime,
+                                   uid_t uid, pid_t pid, pid_t tid,
+                                   const char* msg, unsigned short len,
+                                   char* storage)
+    : mUid(uid),
+      mPid(pid),
+      mTid(tid),
+      mRealTime(realtime),
+      mMsgLen(len),
+      mLogId(log_id),
+      mDropped(false) {
+    mMsg = storage;
+    memcpy(mMsg, msg, len);
+}
+
 LogBufferElement::LogBufferElement(const LogBufferElement& elem)
     : mUid(elem.mUid),
       mPid(elem.mPid),
@@ -228,10 +243,8 @@ size_t LogBufferElement::populateDroppedMessage(char*& buffer, LogBuffer* parent
     return retval;
 }
 
-log_time LogBufferElement::flushTo(SocketClient* reader, LogBuffer* parent,
-                                   bool privileged, bool lastSame) {
-    struct logger_entry_v4 entry;
-
+void LogBufferElement::populateHeader(struct logger_entry_v4& entry,
+                                      bool privileged) const {
     memset(&entry, 0, sizeof(struct logger_entry_v4));
 
     entry.hdr_size = privileged ? sizeof(struct logger_entry_v4)
@@ -242,6 +255,14 @@ log_time LogBufferElement::flushTo(SocketClient* reader, LogBuffer* parent,
     entry.uid = mUid;
     entry.sec = mRealTime.tv_sec;
     entry.nsec = mRealTime.tv_nsec;
+    entry.len = getMsgLen();
+}
+
+log_time LogBufferElement::flushTo(SocketClient* reader, LogBuffer* parent,
+                                   bool privileged, bool lastSame) {
+    struct logger_entry_v4 entry;
+
+    populateHeader(entry, privileged);
 
     struct iovec iovec[2];
     iovec[0].iov_base = &entry;
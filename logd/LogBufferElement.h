@@ -25,6 +25,7 @@
 #include <sysutils/SocketClient.h>
 
 class LogBuffer;
+class LogBufferChunk;
 
 #define EXPIRE_HOUR_THRESHOLD 24  // Only expire chatty UID logs to preserve
                                   // non-chatty UIDs less than this age in hours
@@ -34,6 +35,7 @@ class LogBuffer;
 
 class __attribute__((packed)) LogBufferElement {
     friend LogBuffer;
+    friend LogBufferChunk;
 
     // sized to match reality of incoming log packets
     const uint32_t mUid;
@@ -54,6 +56,12 @@ class __attribute__((packed)) LogBufferElement {
     size_t populateDroppedMessage(char*& buffer, LogBuffer* parent,
                                   bool lastSame);
 
+    // Placement construction over storage owned by a LogBufferChunk, the
+    // message is copied to storage and the destructor must not be run.
+    LogBufferElement(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
+                     pid_t tid, const char* msg, unsigned short len,
+                     char* storage);
+
    public:
     LogBufferElement(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
                      pid_t tid, const char* msg, unsigned short len);
@@ -91,6 +99,9 @@ class __attribute__((packed)) LogBufferElement {
         return mRealTime;
     }
 
+    // Header sent to readers ahead of the message, len is zero if dropped.
+    void populateHeader(struct logger_entry_v4& entry, bool privileged) const;
+
     static const log_time FLUSH_ERROR;
     log_time flushTo(SocketClient* writer, LogBuffer* parent, bool privileged,
                      bool lastSame);
@@ -15,6 +15,7 @@
  */
 
 #include "LogBufferInterface.h"
+#include "LogIngestQueue.h"
 #include "LogUtils.h"
 
 LogBufferInterface::LogBufferInterface() {
@@ -27,3 +28,14 @@ uid_t LogBufferInterface::pidToUid(pid_t pid) {
 pid_t LogBufferInterface::tidToPid(pid_t tid) {
     return android::tidToPid(tid);
 }
+size_t LogBufferInterface::log(LogIngestEntry* const* entries, size_t count) {
+    size_t accepted = 0;
+    for (size_t i = 0; i < count; ++i) {
+        LogIngestEntry* entry = entries[i];
+        if (log(entry->mLogId, entry->mRealTime, entry->mUid, entry->mPid,
+                entry->mTid, entry->mMsg, entry->mLen) > 0) {
+            ++accepted;
+        }
+    }
+    return accepted;
+}
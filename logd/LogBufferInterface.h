@@ -23,6 +23,8 @@
 #include <log/log_id.h>
 #include <log/log_time.h>
 
+struct LogIngestEntry;
+
 // Abstract interface that handles log when log available.
 class LogBufferInterface {
    public:
@@ -32,6 +34,9 @@ class LogBufferInterface {
     // Returns the size of the handled log message.
     virtual int log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
                     pid_t tid, const char* msg, unsigned short len) = 0;
+    // Handles a batch of entries drained from the LogIngestQueue.
+    // Returns the number of entries accepted.
+    virtual size_t log(LogIngestEntry* const* entries, size_t count);
 
     virtual uid_t pidToUid(pid_t pid);
     virtual pid_t tidToPid(pid_t tid);
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <sys/prctl.h>
+
+#include <android-base/stringprintf.h>
+
+#include "LogBufferInterface.h"
+#include "LogIngestQueue.h"
+#include "LogReader.h"
+
+LogIngestQueue::LogIngestQueue(LogBufferInterface* buf, LogReader* reader)
+    : mSlots(new Slot[slots]), mLogBuf(buf), mReader(reader) {
+    // slot sequence numbers tell producers and the committer whose turn it is
+    for (size_t i = 0; i < slots; ++i) {
+        atomic_init(&mSlots[i].mSequence, i);
+    }
+    atomic_init(&mEnqueue, 0);
+    atomic_init(&mDequeue, 0);
+    atomic_init(&mDropped, 0UL);
+    atomic_init(&mSleeping, false);
+    pthread_mutex_init(&mLock, nullptr);
+    pthread_cond_init(&mCondition, nullptr);
+}
+
+LogIngestQueue::~LogIngestQueue() {
+    pthread_cond_destroy(&mCondition);
+    pthread_mutex_destroy(&mLock);
+    delete[] mSlots;
+}
+
+int LogIngestQueue::startCommitter() {
+    pthread_attr_t attr;
+
+    if (!pthread_attr_init(&attr)) {
+        if (!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
+            if (!pthread_create(&mThread, &attr, LogIngestQueue::threadStart,
+                                this)) {
+                pthread_attr_destroy(&attr);
+                return 0;
+            }
+        }
+        pthread_attr_destroy(&attr);
+    }
+    return -1;
+}
+
+bool LogIngestQueue::log(log_id_t log_id, log_time realtime, uid_t uid,
+                         pid_t pid, pid_t tid, const char* msg,
+                         unsigned short len) {
+    size_t pos = atomic_load_explicit(&mEnqueue, memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &mSlots[pos & (slots - 1)];
+        size_t sequence =
+            atomic_load_explicit(&slot->mSequence, memory_order_acquire);
+        ssize_t diff = (ssize_t)(sequence - pos);
+        if (diff == 0) {
+            // on failure pos is reloaded with the current enqueue position
+            if (atomic_compare_exchange_weak_explicit(
+                    &mEnqueue, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {  // committer has not released the slot
+            atomic_fetch_add_explicit(&mDropped, 1UL, memory_order_relaxed);
+            return false;
+        } else {  // lost the race to another producer
+            pos = atomic_load_explicit(&mEnqueue, memory_order_relaxed);
+        }
+    }
+
+    LogIngestEntry& entry = slot->mEntry;
+    if (len > sizeof(entry.mMsg)) {
+        len = sizeof(entry.mMsg);
+    }
+    entry.mLogId = log_id;
+    entry.mRealTime = realtime;
+    entry.mUid = uid;
+    entry.mPid = pid;
+    entry.mTid = tid;
+    entry.mLen = len;
+    memcpy(entry.mMsg, msg, len);
+
+    // Publish, ordered against the committer announcing it is going to sleep
+    atomic_store_explicit(&slot->mSequence, pos + 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&mSleeping, memory_order_seq_cst)) {
+        pthread_mutex_lock(&mLock);
+        pthread_cond_signal(&mCondition);
+        pthread_mutex_unlock(&mLock);
+    }
+    return true;
+}
+
+// Published entry index places past the dequeue position, or nullptr.
+// Only called by the committer.
+LogIngestEntry* LogIngestQueue::front(size_t index) {
+    size_t pos = atomic_load_explicit(&mDequeue, memory_order_relaxed) + index;
+    Slot& slot = mSlots[pos & (slots - 1)];
+    if (atomic_load_explicit(&slot.mSequence, memory_order_seq_cst) !=
+        (pos + 1)) {
+        return nullptr;
+    }
+    return &slot.mEntry;
+}
+
+void LogIngestQueue::wait() {
+    pthread_mutex_lock(&mLock);
+    atomic_store_explicit(&mSleeping, true, memory_order_seq_cst);
+    while (!front(0)) {
+        pthread_cond_wait(&mCondition, &mLock);
+    }
+    atomic_store_explicit(&mSleeping, false, memory_order_relaxed);
+    pthread_mutex_unlock(&mLock);
+}
+
+void* LogIngestQueue::threadStart(void* obj) {
+    prctl(PR_SET_NAME, "logd.ingest");
+
+    LogIngestQueue* me = reinterpret_cast<LogIngestQueue*>(obj);
+    LogIngestEntry* entries[maxBatch];
+
+    for (;;) {
+        me->wait();
+
+        size_t count = 0;
+        while ((count < maxBatch) && (entries[count] = me->front(count))) {
+            ++count;
+        }
+
+        size_t accepted = me->mLogBuf->log(entries, count);
+
+        // hand the slots back to the producers
+        size_t pos = atomic_load_explicit(&me->mDequeue, memory_order_relaxed);
+        for (size_t i = 0; i < count; ++i, ++pos) {
+            atomic_store_explicit(&me->mSlots[pos & (slots - 1)].mSequence,
+                                  pos + slots, memory_order_release);
+        }
+        atomic_store_explicit(&me->mDequeue, pos, memory_order_relaxed);
+
+        if (accepted && me->mReader) {
+            me->mReader->notifyNewLog();
+        }
+    }
+
+    return nullptr;
+}
+
+size_t LogIngestQueue::depth() const {
+    return atomic_load_explicit(&mEnqueue, memory_order_relaxed) -
+           atomic_load_explicit(&mDequeue, memory_order_relaxed);
+}
+
+std::string LogIngestQueue::format() const {
+    return android::base::StringPrintf(
+        "\nIngest queue: %zu/%zu entries queued, %lu dropped\n", depth(),
+        slots, dropped());
+}
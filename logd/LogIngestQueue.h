@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_INGEST_QUEUE_H__
+#define _LOGD_LOG_INGEST_QUEUE_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include <string>
+
+#include <log/log.h>
+
+class LogBufferInterface;
+class LogReader;
+
+// A log message waiting in the ingest queue.
+struct LogIngestEntry {
+    log_id_t mLogId;
+    log_time mRealTime;
+    uid_t mUid;
+    pid_t mPid;
+    pid_t mTid;
+    unsigned short mLen;
+    bool mLoggable;  // scratch for LogBufferInterface::log(entries, count)
+    char mMsg[LOGGER_ENTRY_MAX_PAYLOAD];
+};
+
+// Bounded multi-producer single-consumer queue between the socket listeners
+// and the LogBuffer. Producers claim a slot with a compare and swap and never
+// take the LogBuffer lock; a single committer thread drains the queue and
+// publishes up to maxBatch entries for each acquisition of the write lock.
+// Messages arriving while the queue is full are dropped and counted.
+class LogIngestQueue {
+    struct Slot {
+        atomic_size_t mSequence;
+        LogIngestEntry mEntry;
+    };
+
+    static const size_t slots = 128;  // power of two
+    static const size_t maxBatch = 64;
+
+    Slot* mSlots;
+    atomic_size_t mEnqueue;
+    atomic_size_t mDequeue;  // only advanced by the committer
+    atomic_ulong mDropped;
+    atomic_bool mSleeping;
+
+    LogBufferInterface* mLogBuf;
+    LogReader* mReader;
+
+    pthread_mutex_t mLock;  // only used to sleep and wake the committer
+    pthread_cond_t mCondition;
+    pthread_t mThread;
+
+    LogIngestEntry* front(size_t index);
+    void wait();
+    static void* threadStart(void* me);
+
+   public:
+    LogIngestQueue(LogBufferInterface* buf, LogReader* reader /* nullable */);
+    ~LogIngestQueue();
+
+    // Start the committer thread, returns non-zero on failure.
+    int startCommitter();
+
+    // Queue a message, returns false if dropped because the queue is full.
+    bool log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
+             pid_t tid, const char* msg, unsigned short len);
+
+    size_t depth() const;
+    unsigned long dropped() const {
+        return atomic_load_explicit(&mDropped, memory_order_relaxed);
+    }
+    std::string format() const;
+};
+
+#endif  // _LOGD_LOG_INGEST_QUEUE_H__
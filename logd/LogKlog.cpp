@@ -226,7 +226,9 @@ bool LogKlog::onDataAvailable(SocketClient* cli) {
         enableLogging = false;
     }
 
-    char buffer[LOGGER_ENTRY_MAX_PAYLOAD];
+    // /proc/kmsg hands out as many whole records as fit, so a larger buffer
+    // drains a burst of kernel messages in fewer reads.
+    char buffer[LOGGER_ENTRY_MAX_PAYLOAD * 4];
     ssize_t len = 0;
 
     for (;;) {
@@ -293,15 +295,105 @@ void LogKlog::calculateCorrection(const log_time& monotonic,
     }
 }
 
+// Parses the "[ <seconds>.<fraction>]" timestamp at the start of buf into
+// now, returns pointer after ']'. Unlike log_time::strptime this involves
+// no calendar or timezone conversion and never reads beyond len.
+static const char* parseKernelTime(log_time& now, const char* buf,
+                                   ssize_t len) {
+    if ((len <= 10) || (*buf != '[')) return nullptr;
+
+    const char* cp = buf + 1;
+    const char* ep = &buf[len - 1];  // the ']' must not be the last char
+    while ((cp < ep) && isspace(*cp)) ++cp;
+
+    if ((cp >= ep) || !isdigit(*cp)) return nullptr;
+    uint32_t sec = 0;
+    while ((cp < ep) && isdigit(*cp)) {
+        sec = (sec * 10) + *cp++ - '0';
+    }
+    if ((cp >= ep) || (*cp++ != '.')) return nullptr;
+
+    uint32_t nsec = 0;
+    unsigned long multiplier = NS_PER_SEC;
+    while ((cp < ep) && isdigit(*cp) && (multiplier > 1)) {
+        multiplier /= 10;
+        nsec += (*cp++ - '0') * multiplier;
+    }
+    if ((cp >= ep) || (*cp != ']')) return nullptr;
+
+    now.tv_sec = sec;
+    now.tv_nsec = nsec;
+    return cp + 1;
+}
+
+static bool isMarkerAt(const char* s, const char* ep, const char* needle) {
+    const size_t needleLen = strlen(needle);
+    return ((ep - s) >= (ssize_t)needleLen) &&
+           !fastcmp<memcmp>(s, needle, needleLen);
+}
+
+// Searches buf once for every needle that log() and sniffTime() act on,
+// rather than once per needle with android::strnstr.
+void LogKlog::findMarkers(const char* buf, ssize_t len, Markers& markers) {
+    markers = {};
+    const char* ep = buf + len;
+    for (const char* s = buf; s < ep; ++s) {
+        const char** marker;
+        const char* needle;
+        switch (*s) {
+            case ' ':
+                marker = &markers.audit;
+                needle = auditStr;
+                break;
+            case 'l':
+                marker = &markers.klogd;
+                needle = klogdStr;
+                break;
+            case 'h':
+                marker = &markers.healthd;
+                needle = healthdStr;
+                break;
+            case 'S':
+                marker = &markers.suspended;
+                needle = suspendedStr;
+                break;
+            case 'P':
+                if (!markers.suspend && isMarkerAt(s, ep, suspendStr)) {
+                    markers.suspend = s;
+                } else if (!markers.resume && isMarkerAt(s, ep, resumeStr)) {
+                    markers.resume = s;
+                }
+                continue;
+            default:
+                continue;
+        }
+        if (!*marker && isMarkerAt(s, ep, needle)) {
+            *marker = s;
+        }
+    }
+}
+
+// Returns the pointer after needle if marker lies within [begin, ep) and is
+// followed by content.
+static const char* skipMarker(const char* marker, const char* needle,
+                              const char* begin, const char* ep) {
+    if (!marker || (marker < begin)) return nullptr;
+    marker += strlen(needle);
+    return (marker < ep) ? marker : nullptr;
+}
+
 void LogKlog::sniffTime(log_time& now, const char*& buf, ssize_t len,
                         bool reverse) {
+    Markers markers;
+    findMarkers(buf, len, markers);
+    sniffTime(now, buf, len, reverse, markers);
+}
+
+void LogKlog::sniffTime(log_time& now, const char*& buf, ssize_t len,
+                        bool reverse, const Markers& markers) {
     if (len <= 0) return;
 
-    const char* cp = nullptr;
-    if ((len > 10) && (*buf == '[')) {
-        cp = now.strptime(buf, "[ %s.%q]");  // can index beyond buffer bounds
-        if (cp && (cp > &buf[len - 1])) cp = nullptr;
-    }
+    const char* cp = parseKernelTime(now, buf, len);
     if (cp) {
         len -= cp - buf;
         if ((len > 0) && isspace(*cp)) {
@@ -312,27 +404,22 @@ void LogKlog::sniffTime(log_time& now, const char*& buf, ssize_t len,
 
         if (isMonotonic()) return;
 
+        const char* ep = cp + len;
         const char* b;
-        if (((b = android::strnstr(cp, len, suspendStr))) &&
-            (((b += strlen(suspendStr)) - cp) < len)) {
-            len -= b - cp;
-            calculateCorrection(now, b, len);
-        } else if (((b = android::strnstr(cp, len, resumeStr))) &&
-                   (((b += strlen(resumeStr)) - cp) < len)) {
-            len -= b - cp;
-            calculateCorrection(now, b, len);
-        } else if (((b = android::strnstr(cp, len, healthdStr))) &&
-                   (((b += strlen(healthdStr)) - cp) < len) &&
-                   ((b = android::strnstr(b, len -= b - cp, batteryStr))) &&
-                   (((b += strlen(batteryStr)) - cp) < len)) {
+        if ((b = skipMarker(markers.suspend, suspendStr, cp, ep))) {
+            calculateCorrection(now, b, ep - b);
+        } else if ((b = skipMarker(markers.resume, resumeStr, cp, ep))) {
+            calculateCorrection(now, b, ep - b);
+        } else if (((b = skipMarker(markers.healthd, healthdStr, cp, ep))) &&
+                   ((b = android::strnstr(b, ep - b, batteryStr))) &&
+                   ((b += strlen(batteryStr)) < ep)) {
             // NB: healthd is roughly 150us late, so we use it instead to
             //     trigger a check for ntp-induced or hardware clock drift.
             log_time real(CLOCK_REALTIME);
             log_time mono(CLOCK_MONOTONIC);
             correction = (real < mono) ? log_time::EPOCH : (real - mono);
-        } else if (((b = android::strnstr(cp, len, suspendedStr))) &&
-                   (((b += strlen(suspendStr)) - cp) < len)) {
-            len -= b - cp;
+        } else if ((b = skipMarker(markers.suspended, suspendedStr, cp, ep))) {
+            len = ep - b;
             log_time real;
             char* endp;
             real.tv_sec = strtol(b, &endp, 10);
@@ -545,18 +632,22 @@ static const char* strnrchr(const char* s, ssize_t len, char c) {
 // return -1 if message logd.klogd: <signature>
 //
 int LogKlog::log(const char* buf, ssize_t len) {
-    if (auditd && android::strnstr(buf, len, auditStr)) {
-        return 0;
-    }
-
     const char* p = buf;
     int pri = parseKernelPrio(p, len);
 
+    Markers markers;
+    findMarkers(p, len - (p - buf), markers);
+
+    if (auditd && markers.audit) {
+        return 0;
+    }
+
     log_time now;
-    sniffTime(now, p, len - (p - buf), false);
+    sniffTime(now, p, len - (p - buf), false, markers);
 
     // sniff for start marker
-    const char* start = android::strnstr(p, len - (p - buf), klogdStr);
+    const char* start =
+        (markers.klogd && (markers.klogd >= p)) ? markers.klogd : nullptr;
     if (start) {
         uint64_t sig = strtoll(start + strlen(klogdStr), nullptr, 10);
         if (sig == signature.nsec()) {
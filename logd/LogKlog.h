@@ -55,7 +55,21 @@ class LogKlog : public SocketListener {
     }
 
    protected:
+    // First occurrence of each string of interest in a kernel message,
+    // found in a single pass by findMarkers().
+    struct Markers {
+        const char* audit;
+        const char* klogd;
+        const char* suspend;
+        const char* resume;
+        const char* healthd;
+        const char* suspended;
+    };
+    static void findMarkers(const char* buf, ssize_t len, Markers& markers);
+
     void sniffTime(log_time& now, const char*& buf, ssize_t len, bool reverse);
+    void sniffTime(log_time& now, const char*& buf, ssize_t len, bool reverse,
+                   const Markers& markers);
     pid_t sniffPid(const char*& buf, ssize_t len);
     void calculateCorrection(const log_time& monotonic, const char* real_string,
                              ssize_t len);
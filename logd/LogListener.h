@@ -17,7 +17,11 @@
 #ifndef _LOGD_LOG_LISTENER_H__
 #define _LOGD_LOG_LISTENER_H__
 
+#include <sys/socket.h>
+
+#include <private/android_logger.h>
 #include <sysutils/SocketListener.h>
+#include "LogIngestQueue.h"
 #include "LogReader.h"
 
 // DEFAULT_OVERFLOWUID is defined in linux/highuid.h, which is not part of
@@ -31,16 +35,26 @@
 #endif
 
 class LogListener : public SocketListener {
+    // datagrams drained from the socket per recvmmsg()
+    static const unsigned maxBatch = 32;
+    struct Batch;
+
     LogBufferInterface* logbuf;
     LogReader* reader;
+    LogIngestQueue* queue;
+    Batch* batch;
 
    public:
-    LogListener(LogBufferInterface* buf, LogReader* reader /* nullable */);
+    LogListener(LogBufferInterface* buf, LogReader* reader /* nullable */,
+                LogIngestQueue* queue = nullptr);
+    virtual ~LogListener();
 
    protected:
     virtual bool onDataAvailable(SocketClient* cli);
 
    private:
+    bool accept(struct mmsghdr& msg, const android_log_header_t& header,
+                LogIngestEntry& entry);
     static int getLogSocket();
 };
 
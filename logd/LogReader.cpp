@@ -28,6 +28,7 @@
 #include "LogBuffer.h"
 #include "LogBufferElement.h"
 #include "LogReader.h"
+#include "LogReaderFilter.h"
 #include "LogUtils.h"
 
 LogReader::LogReader(LogBuffer* logbuf)
@@ -48,7 +49,7 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
         name_set = true;
     }
 
-    char buffer[255];
+    char buffer[1024];  // room for a filter after the arguments
 
     int len = read(cli->getSocket(), buffer, sizeof(buffer) - 1);
     if (len <= 0) {
@@ -107,6 +108,9 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
         pid = atol(cp + sizeof(_pid) - 1);
     }
 
+    std::shared_ptr<LogReaderFilter> filter(new LogReaderFilter());
+    if (!filter->parse(buffer)) filter.reset();
+
     bool nonBlock = false;
     if (!fastcmp<strncmp>(buffer, "dumpAndClose", 12)) {
         // Allow writer to get some cycles, and wait for pending notifications
@@ -195,11 +199,12 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
 
     android::prdebug(
         "logdr: UID=%d GID=%d PID=%d %c tail=%lu logMask=%x pid=%d "
-        "start=%" PRIu64 "ns timeout=%" PRIu64 "ns\n",
+        "start=%" PRIu64 "ns timeout=%" PRIu64 "ns%s\n",
         cli->getUid(), cli->getGid(), cli->getPid(), nonBlock ? 'n' : 'b', tail,
-        logMask, (int)pid, sequence.nsec(), timeout);
+        logMask, (int)pid, sequence.nsec(), timeout, filter ? " filtered" : "");
 
-    FlushCommand command(*this, nonBlock, tail, logMask, pid, sequence, timeout);
+    FlushCommand command(*this, nonBlock, tail, logMask, pid, sequence, timeout,
+                         filter);
 
     // Set acceptable upper limit to wait for slow reader processing b/27242723
     struct timeval t = { LOGD_SNDTIMEO, 0 };
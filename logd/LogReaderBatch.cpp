@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <new>
+
+#include <private/android_logger.h>
+
+#include "LogBufferElement.h"
+#include "LogReaderBatch.h"
+#include "LogReaderFilter.h"
+
+LogReaderBatch::LogReaderBatch(SocketClient* reader, bool privileged,
+                               const LogReaderFilter* filter)
+    : mReader(reader),
+      mPrivileged(privileged),
+      mFilter(filter),
+      mUsed(0),
+      mCount(0),
+      mLast(log_time::EPOCH) {
+}
+
+bool LogReaderBatch::add(const LogBufferElement* element) {
+    size_t len = element->getMsgLen();
+    if (element->getDropped() || full() || (len > (maxBytes - mUsed))) {
+        return false;
+    }
+    if (!mData) {
+        mData.reset(new (std::nothrow) char[maxBytes]);
+        if (!mData) {
+            return false;
+        }
+    }
+
+    struct logger_entry_v4& entry = mHeaders[mCount];
+    element->populateHeader(entry, mPrivileged);
+
+    char* msg = mData.get() + mUsed;
+    memcpy(msg, element->getMsg(), len);
+    mUsed += len;
+
+    struct iovec* iov = mIov[mCount];
+    iov[0].iov_base = &entry;
+    iov[0].iov_len = entry.hdr_size;
+    iov[1].iov_base = msg;
+    iov[1].iov_len = len;
+
+    struct mmsghdr& mmsg = mMsgs[mCount];
+    memset(&mmsg, 0, sizeof(mmsg));
+    mmsg.msg_hdr.msg_iov = iov;
+    mmsg.msg_hdr.msg_iovlen = 1 + (len != 0);
+
+    mLast = element->getRealTime();
+    ++mCount;
+    return true;
+}
+
+log_time LogReaderBatch::flush() {
+    log_time retval = mLast;
+
+    size_t count = mCount;
+    if (mFilter && mFilter->hasRegex()) {
+        count = 0;
+        for (size_t i = 0; i < mCount; ++i) {
+            if (mFilter->matchesRegex(static_cast<log_id_t>(mHeaders[i].lid),
+                                      static_cast<char*>(mIov[i][1].iov_base),
+                                      mIov[i][1].iov_len)) {
+                if (count != i) mMsgs[count] = mMsgs[i];
+                ++count;
+            }
+        }
+    }
+
+    size_t sent = 0;
+    while (sent < count) {
+        int ret = TEMP_FAILURE_RETRY(sendmmsg(mReader->getSocket(),
+                                              mMsgs + sent, count - sent,
+                                              MSG_NOSIGNAL));
+        if (ret <= 0) {
+            retval = LogBufferElement::FLUSH_ERROR;
+            break;
+        }
+        sent += ret;
+    }
+
+    mUsed = 0;
+    mCount = 0;
+    return retval;
+}
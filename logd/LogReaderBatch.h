@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_READER_BATCH_H__
+#define _LOGD_LOG_READER_BATCH_H__
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <memory>
+
+#include <log/log.h>
+#include <sysutils/SocketClient.h>
+
+class LogBufferElement;
+class LogReaderFilter;
+
+// Entries on their way to a reader, sent with a single sendmmsg() instead of
+// a write per entry. logdr is a SOCK_SEQPACKET socket so each entry is still
+// delivered as its own packet. Messages are copied in while the buffer lock
+// is held, the batch is then flushed with the lock dropped.
+//
+// Only the reader thread writes to the socket once it is running, so the
+// SocketClient write lock is not taken. A regex the reader asked for is
+// matched in flush(), where it can not hold up the writers.
+class LogReaderBatch {
+    static const size_t maxEntries = 64;
+    static const size_t maxBytes = 64 * 1024;
+
+    SocketClient* mReader;
+    const bool mPrivileged;
+    const LogReaderFilter* mFilter;
+    std::unique_ptr<char[]> mData;  // allocated with the first entry
+    size_t mUsed;
+    size_t mCount;
+    log_time mLast;
+
+    struct logger_entry_v4 mHeaders[maxEntries];
+    struct iovec mIov[maxEntries][2];
+    struct mmsghdr mMsgs[maxEntries];
+
+   public:
+    LogReaderBatch(SocketClient* reader, bool privileged,
+                   const LogReaderFilter* filter = nullptr);
+
+    // Copy element into the batch, returns false if it is a dropped (chatty)
+    // element or does not fit, and must be sent on its own after a flush().
+    bool add(const LogBufferElement* element);
+
+    // Send the batch, returns the timestamp of the last entry in it or
+    // LogBufferElement::FLUSH_ERROR.
+    log_time flush();
+
+    bool empty() const {
+        return !mCount;
+    }
+    bool full() const {
+        return mCount >= maxEntries;
+    }
+};
+
+#endif  // _LOGD_LOG_READER_BATCH_H__
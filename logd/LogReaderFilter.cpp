@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <pcrecpp.h>
+
+#include "LogBufferElement.h"
+#include "LogReaderFilter.h"
+#include "LogUtils.h"
+
+LogReaderFilter::LogReaderFilter() : mFloor(INT_MIN) {
+}
+
+LogReaderFilter::~LogReaderFilter() {
+}
+
+// Value of " key=" in the request, up to the next space.
+static bool findValue(const char* request, const char* key,
+                      std::string& value) {
+    const char* cp = strstr(request, key);
+    if (!cp) return false;
+    cp += strlen(key);
+    value.assign(cp, strcspn(cp, " "));
+    return true;
+}
+
+static int hexValue(char c) {
+    if (isdigit(c)) return c - '0';
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
+
+static std::string decode(const std::string& in) {
+    std::string out;
+    out.reserve(in.length());
+    for (size_t i = 0; i < in.length(); ++i) {
+        int hi, lo;
+        if ((in[i] == '%') && ((i + 2) < in.length()) &&
+            ((hi = hexValue(in[i + 1])) >= 0) &&
+            ((lo = hexValue(in[i + 2])) >= 0)) {
+            out += static_cast<char>((hi << 4) | lo);
+            i += 2;
+        } else {
+            out += in[i];
+        }
+    }
+    return out;
+}
+
+bool LogReaderFilter::parse(const char* request) {
+    bool found = false;
+    std::string value;
+
+    if (findValue(request, " prio=", value)) {
+        mFloor = atoi(value.c_str());
+        found = true;
+    }
+
+    if (findValue(request, " tags=", value)) {
+        size_t pos = 0;
+        while (pos < value.length()) {
+            size_t end = value.find(',', pos);
+            if (end == std::string::npos) end = value.length();
+            size_t colon = value.rfind(':', end);
+            if ((colon != std::string::npos) && (colon > pos)) {
+                mTags.emplace_back(decode(value.substr(pos, colon - pos)),
+                                   atoi(value.c_str() + colon + 1));
+            }
+            pos = end + 1;
+        }
+        found = true;
+    }
+
+    if (findValue(request, " pids=", value)) {
+        const char* cp = value.c_str();
+        while (*cp) {
+            char* ep;
+            long pid = strtol(cp, &ep, 10);
+            if (ep == cp) break;
+            if (pid > 0) mPids.push_back(pid);
+            cp = (*ep == ',') ? ep + 1 : ep;
+        }
+        found = true;
+    }
+
+    if (findValue(request, " regex=", value)) {
+        // Same (default) options as logcat, or the two would disagree.
+        mRegex.reset(new pcrecpp::RE(decode(value)));
+        if (!mRegex->error().empty()) {
+            android::prdebug("logdr: ignoring regex: %s",
+                             mRegex->error().c_str());
+            mRegex.reset();
+        }
+        found = true;
+    }
+
+    return found;
+}
+
+static bool isBinary(log_id_t id) {
+    return (id == LOG_ID_EVENTS) || (id == LOG_ID_SECURITY);
+}
+
+bool LogReaderFilter::matches(const LogBufferElement* element) const {
+    if (!mPids.empty() && (std::find(mPids.begin(), mPids.end(),
+                                     element->getPid()) == mPids.end())) {
+        return false;
+    }
+    if ((mFloor == INT_MIN) && mTags.empty()) return true;
+
+    const char* msg = element->getMsg();
+    size_t len = element->getMsgLen();
+    if (!msg) return true;  // chatty, tag and priority are made up later
+
+    // What logprint would make of the tag and priority
+    log_id_t id = element->getLogId();
+    const char* tag;
+    size_t tagLen;
+    int prio;
+    if (isBinary(id)) {
+        if (len < sizeof(android_event_header_t)) return true;
+        tag = android::tagToName(
+            reinterpret_cast<const android_event_header_t*>(msg)->tag);
+        if (!tag) return true;  // printed as [<tag>], not worth matching
+        tagLen = strlen(tag);
+        prio = (id == LOG_ID_SECURITY) ? ANDROID_LOG_WARN : ANDROID_LOG_INFO;
+    } else {
+        if (len < 3) return true;
+        const char* nul =
+            static_cast<const char*>(memchr(msg + 1, '\0', len - 1));
+        if (!nul) return true;  // malformed, logprint makes up a tag
+        tag = msg + 1;
+        tagLen = nul - tag;
+        prio = msg[0];
+    }
+
+    int floor = mFloor;
+    for (auto& rule : mTags) {
+        if ((rule.first.length() == tagLen) &&
+            !memcmp(rule.first.data(), tag, tagLen)) {
+            floor = rule.second;
+            break;
+        }
+    }
+    return prio >= floor;
+}
+
+bool LogReaderFilter::matchesRegex(log_id_t id, const char* msg,
+                                   size_t len) const {
+    if (!mRegex || isBinary(id) || (len < 3)) return true;
+
+    // As android_log_processLogBuffer() splits <prio><tag>\0<message>\0
+    const char* end = msg + len;
+    const char* start =
+        static_cast<const char*>(memchr(msg + 1, '\0', len - 1));
+    if (!start) return true;
+    ++start;
+    const char* nul =
+        static_cast<const char*>(memchr(start, '\0', end - start));
+    if (!nul) nul = end - 1;
+    size_t messageLen = (nul < start) ? 0 : (nul - start);
+
+    return mRegex->PartialMatch(pcrecpp::StringPiece(start, messageLen));
+}
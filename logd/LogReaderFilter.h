@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_READER_FILTER_H__
+#define _LOGD_LOG_READER_FILTER_H__
+
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <log/log.h>
+
+namespace pcrecpp {
+class RE;
+}
+
+class LogBufferElement;
+
+// Filter a reader asks logd to apply before entries are sent:
+//
+//   prio=<floor> tags=<tag>:<prio>,... pids=<pid>,... regex=<expression>
+//
+// with the tags and the expression percent-encoded. The client keeps
+// filtering what it receives, this only saves shipping the entries it would
+// throw away, so anything it can not decide the way logprint would is let
+// through. Read-only once parsed, safe to share between threads.
+class LogReaderFilter {
+    int mFloor;  // priority for tags without a rule of their own
+    std::vector<std::pair<std::string, int>> mTags;  // first rule wins
+    std::vector<pid_t> mPids;
+    std::unique_ptr<pcrecpp::RE> mRegex;
+
+   public:
+    LogReaderFilter();
+    ~LogReaderFilter();
+
+    // Pick up the filter keys of a reader request, false if there are none.
+    bool parse(const char* request);
+
+    // Tag, priority and pid, cheap enough to check with the buffer locked.
+    bool matches(const LogBufferElement* element) const;
+
+    bool hasRegex() const {
+        return !!mRegex;
+    }
+    // The message of a text entry against the expression, as logcat -e does.
+    bool matchesRegex(log_id_t id, const char* msg, size_t len) const;
+};
+
+#endif  // _LOGD_LOG_READER_FILTER_H__
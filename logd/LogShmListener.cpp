@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <cutils/sockets.h>
+#include <private/android_filesystem_config.h>
+#include <private/android_logger.h>
+
+#include "LogBufferInterface.h"
+#include "LogReader.h"
+#include "LogShmListener.h"
+#include "LogUtils.h"
+
+#ifndef F_GET_SEALS
+#define F_GET_SEALS 1034
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK 0x0002
+#endif
+
+static const size_t mappingSize =
+    sizeof(android_log_shm_t) + ANDROID_LOG_SHM_SIZE;
+
+static int futex(uint32_t* addr, int op, uint32_t val) {
+    // not FUTEX_PRIVATE_FLAG, the ring is shared with the client process
+    return syscall(__NR_futex, addr, op, val, nullptr, nullptr, 0);
+}
+
+LogShmRing::LogShmRing(SocketClient* cli, android_log_shm_t* shm,
+                       LogBufferInterface* buf, LogReader* reader,
+                       LogIngestQueue* queue)
+    : mClient(cli),
+      mShm(shm),
+      mData(reinterpret_cast<char*>(shm + 1)),
+      mTail(0),
+      mUid(cli->getUid()),
+      mPid(cli->getPid()),
+      mSecurity(clientHasLogCredentials(cli)),
+      mLogBuf(buf),
+      mReader(reader),
+      mQueue(queue),
+      mEntries(new LogIngestEntry[maxBatch + 1]) {  // + drop report
+    atomic_init(&mExit, false);
+}
+
+LogShmRing::~LogShmRing() {
+    munmap(mShm, mappingSize);
+    delete[] mEntries;
+}
+
+int LogShmRing::start() {
+    return pthread_create(&mThread, nullptr, LogShmRing::threadStart, this)
+               ? -1
+               : 0;
+}
+
+void LogShmRing::stop() {
+    atomic_store(&mExit, true);
+    __atomic_fetch_add(&mShm->futex, 1, __ATOMIC_RELEASE);
+    futex(&mShm->futex, FUTEX_WAKE, 1);
+    pthread_join(mThread, nullptr);
+}
+
+// Consume up to maxBatch published records and hand them to the LogBuffer,
+// returns false if the ring content can not be trusted.
+bool LogShmRing::drain(size_t& records) {
+    static const size_t minimum = sizeof(uint32_t) + sizeof(uint16_t);
+    LogIngestEntry* entries[maxBatch + 1];
+    android_log_shm_record_t record;
+    uint64_t tail = mTail;
+    size_t count = 0;
+    bool valid = true;
+
+    records = 0;
+    while (count < maxBatch) {
+        size_t offset = tail & (ANDROID_LOG_SHM_SIZE - 1);
+        char* data = mData + offset;
+        size_t size = __atomic_load_n(reinterpret_cast<uint32_t*>(data),
+                                      __ATOMIC_ACQUIRE);
+        if (!size) {
+            break;
+        }
+        if ((size % ANDROID_LOG_SHM_ALIGN) || (size < minimum) ||
+            (size > (ANDROID_LOG_SHM_SIZE - offset))) {
+            valid = false;
+            break;
+        }
+
+        // copied once, the client can still scribble over the original
+        memcpy(&record, data, std::min(sizeof(record), size));
+        if (record.len != ANDROID_LOG_SHM_PAD) {
+            if ((size < sizeof(record)) || !record.len ||
+                (record.len > (size - sizeof(record))) ||
+                (record.len > LOGGER_ENTRY_MAX_PAYLOAD)) {
+                valid = false;
+                break;
+            }
+            log_id_t id = static_cast<log_id_t>(record.header.id);
+            if ((id < LOG_ID_MAX) && (id != LOG_ID_KERNEL) &&
+                ((id != LOG_ID_SECURITY) ||
+                 (mSecurity && __android_log_security()))) {
+                LogIngestEntry& entry = mEntries[count];
+                entry.mLogId = id;
+                entry.mRealTime = record.header.realtime;
+                entry.mUid = mUid;
+                entry.mPid = mPid;
+                entry.mTid = record.header.tid;
+                entry.mLen = record.len;
+                memcpy(entry.mMsg, data + sizeof(record), record.len);
+                entries[count] = &entry;
+                ++count;
+            }
+        }
+
+        // writers rely on free space reading as unpublished
+        memset(data, 0, size);
+        tail += size;
+        ++records;
+    }
+
+    if (records) {
+        mTail = tail;
+        __atomic_store_n(&mShm->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if (__atomic_load_n(&mShm->dropped, __ATOMIC_RELAXED)) {
+        report(&mEntries[count]);
+        entries[count] = &mEntries[count];
+        ++count;
+    }
+
+    if (!count) {
+        return valid;
+    }
+    if (mQueue != nullptr) {
+        // committer notifies the reader once the batch is in the logbuf
+        for (size_t i = 0; i < count; ++i) {
+            LogIngestEntry* entry = entries[i];
+            mQueue->log(entry->mLogId, entry->mRealTime, entry->mUid,
+                        entry->mPid, entry->mTid, entry->mMsg, entry->mLen);
+        }
+    } else if (mLogBuf->log(entries, count) && (mReader != nullptr)) {
+        mReader->notifyNewLog();
+    }
+    return valid;
+}
+
+// Messages the client dropped on a full ring, reported as liblog would.
+void LogShmRing::report(LogIngestEntry* entry) {
+    uint32_t dropped = __atomic_exchange_n(&mShm->dropped, 0, __ATOMIC_RELAXED);
+    android_log_event_int_t buffer;
+
+    buffer.header.tag = htole32(LIBLOG_LOG_TAG);
+    buffer.payload.type = EVENT_TYPE_INT;
+    buffer.payload.data = htole32(dropped);
+
+    entry->mLogId = LOG_ID_EVENTS;
+    entry->mRealTime = log_time(CLOCK_REALTIME);
+    entry->mUid = mUid;
+    entry->mPid = mPid;
+    entry->mTid = mPid;
+    entry->mLen = sizeof(buffer);
+    memcpy(entry->mMsg, &buffer, sizeof(buffer));
+}
+
+void LogShmRing::wait() {
+    uint32_t sequence = __atomic_load_n(&mShm->futex, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&mShm->sleeping, 1, __ATOMIC_RELAXED);
+    // pairs with writers publishing then checking sleeping
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(reinterpret_cast<uint32_t*>(
+                             mData + (mTail & (ANDROID_LOG_SHM_SIZE - 1))),
+                         __ATOMIC_ACQUIRE) &&
+        !atomic_load(&mExit)) {
+        futex(&mShm->futex, FUTEX_WAIT, sequence);
+    }
+    __atomic_store_n(&mShm->sleeping, 0, __ATOMIC_RELAXED);
+}
+
+void* LogShmRing::threadStart(void* obj) {
+    prctl(PR_SET_NAME, "logd.shm");
+
+    LogShmRing* me = reinterpret_cast<LogShmRing*>(obj);
+
+    for (;;) {
+        size_t records;
+        if (!me->drain(records)) {
+            android::prdebug("logd.shm: bad record from pid %d, disconnected",
+                             me->mPid);
+            // the listener releases us once it sees the hang up
+            shutdown(me->mClient->getSocket(), SHUT_RDWR);
+            break;
+        }
+        if (records) {
+            continue;
+        }
+        if (atomic_load(&me->mExit)) {
+            break;
+        }
+        me->wait();
+    }
+    return nullptr;
+}
+
+LogShmListener::LogShmListener(LogBufferInterface* buf, LogReader* reader,
+                               LogIngestQueue* queue)
+    : SocketListener(getLogSocket(), true),
+      logbuf(buf),
+      reader(reader),
+      queue(queue) {
+}
+
+LogShmListener::~LogShmListener() {
+    for (auto ring : rings) {
+        ring->stop();
+        delete ring;
+    }
+}
+
+bool LogShmListener::onDataAvailable(SocketClient* cli) {
+    static bool name_set;
+    if (!name_set) {
+        prctl(PR_SET_NAME, "logd.shm.ctrl");
+        name_set = true;
+    }
+
+    for (auto it = rings.begin(); it != rings.end(); ++it) {
+        LogShmRing* ring = *it;
+        if (ring->client() != cli) {
+            continue;
+        }
+        char c;
+        if (TEMP_FAILURE_RETRY(read(cli->getSocket(), &c, sizeof(c))) > 0) {
+            return true;  // nothing more is expected, ignore
+        }
+        // client has gone, take what is left in its ring first
+        rings.erase(it);
+        ring->stop();
+        delete ring;
+        return false;
+    }
+
+    int32_t status = accept(cli);
+    if (status == -ECONNRESET) {
+        return false;
+    }
+    cli->sendData(&status, sizeof(status));
+    return status == 0;
+}
+
+// Receive and validate a ring, returns zero or a negative errno reported
+// back to the client.
+int LogShmListener::accept(SocketClient* cli) {
+    uint32_t version = 0;
+    struct iovec iov = { &version, sizeof(version) };
+    union {
+        struct cmsghdr cmsg;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n = TEMP_FAILURE_RETRY(
+        recvmsg(cli->getSocket(), &msg, MSG_CMSG_CLOEXEC));
+    if (n <= 0) {
+        return -ECONNRESET;
+    }
+
+    int fd = -1;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && (cmsg->cmsg_level == SOL_SOCKET) &&
+        (cmsg->cmsg_type == SCM_RIGHTS) &&
+        (cmsg->cmsg_len == CMSG_LEN(sizeof(int)))) {
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (fd < 0) {
+        return -EINVAL;
+    }
+
+    uid_t uid = cli->getUid();
+    int ret = 0;
+    struct stat st;
+    if ((uid >= AID_APP) || (uid == AID_LOGD)) {
+        ret = -EPERM;
+    } else if ((n != sizeof(version)) ||
+               (version != ANDROID_LOG_SHM_VERSION)) {
+        ret = -EPROTONOSUPPORT;
+    } else if (rings.size() >= maxRings) {
+        ret = -EBUSY;
+    } else if ((fstat(fd, &st) < 0) || ((size_t)st.st_size != mappingSize) ||
+               !(fcntl(fd, F_GET_SEALS) & F_SEAL_SHRINK)) {
+        // a mapping the client can shrink would SIGBUS us
+        ret = -EINVAL;
+    }
+    if (ret < 0) {
+        close(fd);
+        return ret;
+    }
+
+    void* map = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -errno;
+    }
+
+    android_log_shm_t* shm = reinterpret_cast<android_log_shm_t*>(map);
+    if ((shm->magic != ANDROID_LOG_SHM_MAGIC) ||
+        (shm->version != ANDROID_LOG_SHM_VERSION) ||
+        (shm->size != ANDROID_LOG_SHM_SIZE) ||
+        __atomic_load_n(&shm->tail, __ATOMIC_RELAXED)) {
+        munmap(map, mappingSize);
+        return -EINVAL;
+    }
+
+    LogShmRing* ring = new LogShmRing(cli, shm, logbuf, reader, queue);
+    if (ring->start()) {
+        delete ring;
+        return -ENOMEM;
+    }
+    rings.push_back(ring);
+    return 0;
+}
+
+int LogShmListener::getLogSocket() {
+    static const char socketName[] = "logdshm";
+    int sock = android_get_control_socket(socketName);
+
+    if (sock < 0) {  // logd started up in init.sh
+        sock = socket_local_server(
+            socketName, ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_SEQPACKET);
+    }
+    return sock;
+}
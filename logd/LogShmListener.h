@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_SHM_LISTENER_H__
+#define _LOGD_LOG_SHM_LISTENER_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include <list>
+
+#include <private/android_logger.h>
+#include <sysutils/SocketListener.h>
+
+#include "LogIngestQueue.h"
+
+class LogBufferInterface;
+class LogReader;
+
+// One shared memory ring registered by a LOGGER_SHM client, drained by its
+// own thread for as long as the client stays connected. Nothing read from
+// the ring is trusted, a malformed record shuts the ring down.
+class LogShmRing {
+    static const unsigned maxBatch = 32;
+
+    SocketClient* mClient;
+    android_log_shm_t* mShm;
+    char* mData;
+    uint64_t mTail;  // our own copy, the shared one is only written
+    uid_t mUid;
+    pid_t mPid;
+    bool mSecurity;  // client may write to LOG_ID_SECURITY
+    atomic_bool mExit;
+
+    LogBufferInterface* mLogBuf;
+    LogReader* mReader;
+    LogIngestQueue* mQueue;
+    LogIngestEntry* mEntries;
+
+    pthread_t mThread;
+
+    bool drain(size_t& records);
+    void report(LogIngestEntry* entry);
+    void wait();
+    static void* threadStart(void* me);
+
+   public:
+    LogShmRing(SocketClient* cli, android_log_shm_t* shm,
+               LogBufferInterface* buf, LogReader* reader,
+               LogIngestQueue* queue);
+    ~LogShmRing();
+
+    int start();
+    // Drain what is left, then stop the thread and release the mapping.
+    void stop();
+
+    SocketClient* client() const {
+        return mClient;
+    }
+};
+
+// Accepts LOGGER_SHM rings on /dev/socket/logdshm from system uids.
+class LogShmListener : public SocketListener {
+    static const size_t maxRings = 32;
+
+    LogBufferInterface* logbuf;
+    LogReader* reader;
+    LogIngestQueue* queue;
+    std::list<LogShmRing*> rings;  // only touched by the listener thread
+
+    int accept(SocketClient* cli);
+    static int getLogSocket();
+
+   public:
+    LogShmListener(LogBufferInterface* buf, LogReader* reader /* nullable */,
+                   LogIngestQueue* queue = nullptr);
+    virtual ~LogShmListener();
+
+   protected:
+    virtual bool onDataAvailable(SocketClient* cli);
+};
+
+#endif  // _LOGD_LOG_SHM_LISTENER_H__
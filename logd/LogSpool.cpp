@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <android-base/stringprintf.h>
+
+#include "LogBufferChunk.h"
+#include "LogSpool.h"
+
+// Leads every segment file, followed by the image of the chunk.
+struct __attribute__((packed)) SegmentHeader {
+    uint32_t mMagic;
+    uint16_t mElementSize;  // sizeof(LogBufferElement) of the writer
+    uint8_t mLogId;
+    uint8_t mCompressed;
+    uint32_t mElements;
+    uint32_t mUsed;
+    uint32_t mImageSize;
+    uint32_t mOldestSec;
+    uint32_t mOldestNsec;
+    uint32_t mNewestSec;
+    uint32_t mNewestNsec;
+};
+
+static const uint32_t segmentMagic = 0x4c4f4753;  // "LOGS"
+
+static bool valid(const SegmentHeader& header, size_t size) {
+    return (header.mMagic == segmentMagic) &&
+           (header.mElementSize == sizeof(LogBufferElement)) &&
+           (header.mLogId < LOG_ID_MAX) &&
+           ((sizeof(header) + header.mImageSize) == size) &&
+           (header.mCompressed || (header.mImageSize == header.mUsed));
+}
+
+LogSpool::LogSpool(const char* directory, size_t capacity)
+    : mDirectory(directory),
+      mCapacity(capacity),
+      mOpened(false),
+      mSize(0),
+      mNextSequence(1) {
+}
+
+std::string LogSpool::path(uint64_t sequence) const {
+    return android::base::StringPrintf("%s/%020" PRIu64, mDirectory.c_str(),
+                                       sequence);
+}
+
+// Add an existing segment to the index, returns false if not a segment.
+bool LogSpool::read(const std::string& name) {
+    char* end;
+    errno = 0;
+    uint64_t sequence = strtoull(name.c_str(), &end, 10);
+    if (errno || (end == name.c_str()) || *end) {
+        return false;
+    }
+
+    std::string file = mDirectory + "/" + name;
+    int fd = TEMP_FAILURE_RETRY(::open(file.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return false;
+    }
+    SegmentHeader header;
+    struct stat st;
+    bool ok = !fstat(fd, &st) &&
+              (TEMP_FAILURE_RETRY(::read(fd, &header, sizeof(header))) ==
+               static_cast<ssize_t>(sizeof(header))) &&
+              valid(header, st.st_size);
+    close(fd);
+    if (!ok) {
+        unlink(file.c_str());
+        return false;
+    }
+
+    std::list<Segment>::iterator it = mIndex.begin();
+    while ((it != mIndex.end()) && (it->mSequence < sequence)) {
+        ++it;
+    }
+    mIndex.insert(it, Segment{ sequence, static_cast<log_id_t>(header.mLogId),
+                               log_time(header.mOldestSec, header.mOldestNsec),
+                               log_time(header.mNewestSec, header.mNewestNsec),
+                               static_cast<size_t>(st.st_size) });
+    mSize += st.st_size;
+    if (mNextSequence <= sequence) {
+        mNextSequence = sequence + 1;
+    }
+    return true;
+}
+
+bool LogSpool::open() {
+    if (mOpened) {
+        return true;
+    }
+
+    mkdir(mDirectory.c_str(), 0750);
+    DIR* dir = opendir(mDirectory.c_str());
+    if (!dir) {
+        return false;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] != '.') {
+            read(entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    mOpened = true;
+    trim();
+    return true;
+}
+
+void LogSpool::trim() {
+    while ((mSize > mCapacity) && !mIndex.empty()) {
+        unlink(path(mIndex.front().mSequence).c_str());
+        mSize -= mIndex.front().mSize;
+        mIndex.pop_front();
+    }
+}
+
+void LogSpool::spool(log_id_t id, const LogBufferChunk* chunk) {
+    if (!open() || chunk->empty()) {
+        return;
+    }
+
+    size_t size;
+    bool compressed;
+    const char* image = chunk->image(size, compressed);
+    if (!image) {
+        return;
+    }
+
+    log_time oldest = chunk->oldest();
+    log_time newest = chunk->newest();
+    SegmentHeader header = {
+        segmentMagic,
+        static_cast<uint16_t>(sizeof(LogBufferElement)),
+        static_cast<uint8_t>(id),
+        static_cast<uint8_t>(compressed),
+        static_cast<uint32_t>(chunk->elements()),
+        static_cast<uint32_t>(chunk->used()),
+        static_cast<uint32_t>(size),
+        oldest.tv_sec,
+        oldest.tv_nsec,
+        newest.tv_sec,
+        newest.tv_nsec,
+    };
+
+    uint64_t sequence = mNextSequence++;
+    std::string file = path(sequence);
+    int fd = TEMP_FAILURE_RETRY(::open(
+        file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640));
+    if (fd < 0) {
+        return;
+    }
+    struct iovec iov[2] = {
+        { &header, sizeof(header) },
+        { const_cast<char*>(image), size },
+    };
+    ssize_t ret = TEMP_FAILURE_RETRY(writev(fd, iov, 2));
+    close(fd);
+    if (ret != static_cast<ssize_t>(sizeof(header) + size)) {
+        unlink(file.c_str());
+        return;
+    }
+
+    size += sizeof(header);
+    mIndex.push_back(Segment{ sequence, id, oldest, newest, size });
+    mSize += size;
+    trim();
+}
+
+void LogSpool::load(log_id_t id, const log_time& start,
+                    const log_time& before,
+                    LogBufferChunkCollection& chunks) const {
+    for (const Segment& segment : mIndex) {
+        if ((segment.mLogId != id) || (segment.mNewest < start) ||
+            !(segment.mOldest < before)) {
+            continue;
+        }
+
+        int fd = TEMP_FAILURE_RETRY(
+            ::open(path(segment.mSequence).c_str(), O_RDONLY | O_CLOEXEC));
+        if (fd < 0) {
+            continue;
+        }
+        void* mapped = mmap(nullptr, segment.mSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            continue;
+        }
+
+        const SegmentHeader& header =
+            *reinterpret_cast<const SegmentHeader*>(mapped);
+        if (!valid(header, segment.mSize)) {
+            munmap(mapped, segment.mSize);
+            continue;
+        }
+        chunks.push_back(new LogBufferChunk(
+            segment.mSequence, mapped, segment.mSize,
+            static_cast<char*>(mapped) + sizeof(header), header.mImageSize,
+            header.mCompressed, header.mUsed, header.mElements,
+            segment.mOldest, segment.mNewest));
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_SPOOL_H__
+#define _LOGD_LOG_SPOOL_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <list>
+#include <string>
+
+#include <log/log.h>
+
+class LogBufferChunk;
+typedef std::list<LogBufferChunk*> LogBufferChunkCollection;
+
+// Size capped store of the chunks expired from a ChunkedLogBuffer, one file
+// per chunk holding its (compressed) image. An index of the realtime range
+// held by each segment is kept in memory so that readers asking for history
+// older than the buffer can map just the segments they need. The oldest
+// segments are removed once the store grows beyond its capacity.
+//
+// Segments are only valid for the logd binary that wrote them, they are
+// ignored after an upgrade that changes the layout of LogBufferElement.
+class LogSpool {
+    struct Segment {
+        uint64_t mSequence;
+        log_id_t mLogId;
+        log_time mOldest;
+        log_time mNewest;
+        size_t mSize;  // on disk
+    };
+
+    const std::string mDirectory;
+    const size_t mCapacity;
+    bool mOpened;
+    std::list<Segment> mIndex;  // oldest first
+    size_t mSize;
+    uint64_t mNextSequence;
+
+    std::string path(uint64_t sequence) const;
+    bool read(const std::string& name);
+    void trim();
+
+   public:
+    static const size_t defaultCapacity = 32 * 1024 * 1024;
+
+    LogSpool(const char* directory, size_t capacity);
+
+    // Scan the directory, returns false if it is not (yet) available.
+    bool open();
+
+    // Write a sealed chunk as the newest segment.
+    //
+    // LogBuffer::wrlock() must be held when this function is called.
+    void spool(log_id_t id, const LogBufferChunk* chunk);
+
+    // Map the segments of "id" that hold entries at or after start but
+    // from before "before", oldest first. The caller owns the chunks.
+    //
+    // LogBuffer::rdlock() must be held when this function is called.
+    void load(log_id_t id, const log_time& start, const log_time& before,
+              LogBufferChunkCollection& chunks) const;
+
+    size_t size() const {
+        return mSize;
+    }
+    size_t segments() const {
+        return mIndex.size();
+    }
+};
+
+#endif  // _LOGD_LOG_SPOOL_H__
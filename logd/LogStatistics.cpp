@@ -82,8 +82,10 @@ char* pidToName(pid_t pid) {
 void LogStatistics::addTotal(LogBufferElement* element) {
     if (element->getDropped()) return;
 
-    log_id_t log_id = element->getLogId();
-    unsigned short size = element->getMsgLen();
+    addTotal(element->getLogId(), element->getMsgLen());
+}
+
+void LogStatistics::addTotal(log_id_t log_id, unsigned short size) {
     mSizesTotal[log_id] += size;
     SizesTotal += size;
     ++mElementsTotal[log_id];
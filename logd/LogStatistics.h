@@ -24,7 +24,7 @@
 #include <string.h>
 #include <sys/types.h>
 
-#include <algorithm>  // std::max
+#include <algorithm>  // std::max, std::push_heap
 #include <experimental/string_view>
 #include <memory>
 #include <string>  // std::string
@@ -89,6 +89,12 @@ class LogHashtable {
         const TEntry** retval = new const TEntry*[len];
         memset(retval, 0, sizeof(*retval) * len);
 
+        // Bounded min-heap of the len largest entries so far, smallest at
+        // retval[0], to keep the scan O(n log len) rather than O(n len).
+        auto larger = [](const TEntry* lhs, const TEntry* rhs) {
+            return lhs->getSizes() > rhs->getSizes();
+        };
+        size_t count = 0;
         for (const_iterator it = map.begin(); it != map.end(); ++it) {
             const TEntry& entry = it->second;
 
@@ -99,20 +105,17 @@ class LogHashtable {
                 continue;
             }
 
-            size_t sizes = entry.getSizes();
-            ssize_t index = len - 1;
-            while ((!retval[index] || (sizes > retval[index]->getSizes())) &&
-                   (--index >= 0))
-                ;
-            if (++index < (ssize_t)len) {
-                size_t num = len - index - 1;
-                if (num) {
-                    memmove(&retval[index + 1], &retval[index],
-                            num * sizeof(retval[0]));
-                }
-                retval[index] = &entry;
+            if (count < len) {
+                retval[count++] = &entry;
+                std::push_heap(retval, retval + count, larger);
+            } else if (entry.getSizes() > retval[0]->getSizes()) {
+                std::pop_heap(retval, retval + len, larger);
+                retval[len - 1] = &entry;
+                std::push_heap(retval, retval + len, larger);
             }
         }
+        // largest first, unused slots left nullptr
+        std::sort_heap(retval, retval + count, larger);
         std::unique_ptr<const TEntry* []> sorted(retval);
         return sorted;
     }
@@ -741,6 +744,7 @@ class LogStatistics {
     }
 
     void addTotal(LogBufferElement* entry);
+    void addTotal(log_id_t log_id, unsigned short size);
     void add(LogBufferElement* entry);
     void subtract(LogBufferElement* entry);
     // entry->setDropped(1) must follow this call
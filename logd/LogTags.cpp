@@ -171,6 +171,8 @@ void LogTags::AddEventLogTags(uint32_t tag, uid_t uid, const std::string& Name,
         // updatePersist -> trigger output on modified
         // content, reset tag2total if available
         if (update && (itot != tag2total.end())) tag2total[tag] = 0;
+
+        publish_locked(tag);
     }
 
     if (update) {
@@ -345,7 +347,90 @@ void LogTags::ReadPersistEventLogTags() {
     android_logger_list_free(logger_list);
 }
 
-LogTags::LogTags() {
+LogTags::TagTable::TagTable(size_t size, TagTable* prev)
+    : mask(size - 1), used(0), slots(new TagSlot[size]), prev(prev) {
+    for (size_t i = 0; i < size; ++i) {
+        slots[i].tag.store(emptyTag, std::memory_order_relaxed);
+        slots[i].name.store(nullptr, std::memory_order_relaxed);
+        slots[i].total.store(staticTotal, std::memory_order_relaxed);
+    }
+}
+
+static inline size_t hashTag(uint32_t tag) {
+    uint32_t h = tag * 0x9E3779B1U;
+    return h ^ (h >> 16);
+}
+
+const LogTags::TagSlot* LogTags::findSlot(uint32_t tag) const {
+    if (tag == emptyTag) return nullptr;
+
+    const TagTable* table = tagTable.load(std::memory_order_acquire);
+    for (size_t i = hashTag(tag);; ++i) {
+        const TagSlot& slot = table->slots[i & table->mask];
+        uint32_t slotTag = slot.tag.load(std::memory_order_acquire);
+        if (slotTag == tag) return &slot;
+        if (slotTag == emptyTag) return nullptr;
+    }
+}
+
+// Caller holds the writer lock. Copies the tag2name and tag2total entries
+// of tag into the lock free table.
+void LogTags::publish_locked(uint32_t tag) {
+    if (tag == emptyTag) return;
+
+    const char* name = nullptr;
+    tag2name_const_iterator it = tag2name.find(tag);
+    if ((it != tag2name.end()) && it->second.length()) {
+        name = tagNames.emplace(it->second).first->c_str();
+    }
+    tag2total_const_iterator itot = tag2total.find(tag);
+    size_t total = (itot != tag2total.end()) ? itot->second : staticTotal;
+
+    TagSlot* slot = const_cast<TagSlot*>(findSlot(tag));
+    if (slot) {
+        slot->name.store(name, std::memory_order_release);
+        slot->total.store(total, std::memory_order_release);
+        return;
+    }
+
+    TagTable* table = tagTable.load(std::memory_order_relaxed);
+    // Keep the load factor at or below 3/4 so probes stay short and end.
+    if (((table->used + 1) * 4) > ((table->mask + 1) * 3)) {
+        TagTable* bigger = new TagTable((table->mask + 1) * 2, table);
+        for (size_t i = 0; i <= table->mask; ++i) {
+            const TagSlot& from = table->slots[i];
+            uint32_t fromTag = from.tag.load(std::memory_order_relaxed);
+            if (fromTag == emptyTag) continue;
+            size_t j = hashTag(fromTag);
+            while (bigger->slots[j & bigger->mask].tag.load(
+                       std::memory_order_relaxed) != emptyTag) {
+                ++j;
+            }
+            TagSlot& to = bigger->slots[j & bigger->mask];
+            to.name.store(from.name.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+            to.total.store(from.total.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+            to.tag.store(fromTag, std::memory_order_relaxed);
+        }
+        bigger->used = table->used;
+        tagTable.store(bigger, std::memory_order_release);
+        table = bigger;
+    }
+
+    size_t i = hashTag(tag);
+    while (table->slots[i & table->mask].tag.load(std::memory_order_relaxed) !=
+           emptyTag) {
+        ++i;
+    }
+    slot = &table->slots[i & table->mask];
+    slot->name.store(name, std::memory_order_relaxed);
+    slot->total.store(total, std::memory_order_relaxed);
+    slot->tag.store(tag, std::memory_order_release);
+    ++table->used;
+}
+
+LogTags::LogTags() : tagTable(new TagTable(1024)) {
     ReadFileEventLogTags(system_event_log_tags);
     // Following will likely fail on boot, but is required if logd restarts
     ReadFileEventLogTags(dynamic_event_log_tags, false);
@@ -357,29 +442,21 @@ LogTags::LogTags() {
     logtags = this;
 }
 
-// Converts an event tag into a name
+// Converts an event tag into a name, without taking the lock.
 const char* LogTags::tagToName(uint32_t tag) const {
-    tag2name_const_iterator it;
-
-    android::RWLock::AutoRLock readLock(const_cast<android::RWLock&>(rwlock));
-
-    it = tag2name.find(tag);
-    if ((it == tag2name.end()) || (it->second.length() == 0)) return NULL;
+    const TagSlot* slot = findSlot(tag);
+    if (!slot) return NULL;
 
-    return it->second.c_str();
+    return slot->name.load(std::memory_order_acquire);
 }
 
 // Prototype in LogUtils.h allowing external access to our database.
 //
 // This must be a pure reader to our database, as everything else is
 // guaranteed single-threaded except this access point which is
-// asynchonous and can be multithreaded and thus rentrant.  The
-// object's rwlock is only used to guarantee atomic access to the
-// unordered_map to prevent corruption, with a requirement to be a
-// low chance of contention for this call.  If we end up changing
-// this algorithm resulting in write, then we should use a different
-// lock than the object's rwlock to protect groups of associated
-// actions.
+// asynchonous and can be multithreaded and thus rentrant.  Both calls
+// below are served from the lock free tag table, the object's rwlock
+// is only taken when a dynamic tag is due to be recorded to pmsg.
 const char* android::tagToName(uint32_t tag) {
     LogTags* me = logtags;
 
@@ -500,15 +577,24 @@ static int openFile(const char* name, int mode, bool warning) {
 }
 
 void LogTags::WritePmsgEventLogTags(uint32_t tag, uid_t uid) {
+    // Every 16K (half the smallest configurable pmsg buffer size) record
+    static const size_t rate_to_pmsg = 16 * 1024;
+
+    // Lock free pre-check, the common answer is that there is nothing to do.
+    const TagSlot* slot = findSlot(tag);
+    if (!slot) return;
+    size_t lastTotal = slot->total.load(std::memory_order_acquire);
+    if (lastTotal == staticTotal) return;  // source is a static entry
+    if (lastTotal && ((android::sizesTotal() - lastTotal) < rate_to_pmsg)) {
+        return;
+    }
+
     android::RWLock::AutoRLock readLock(rwlock);
 
     tag2total_const_iterator itot = tag2total.find(tag);
     if (itot == tag2total.end()) return;  // source is a static entry
 
-    size_t lastTotal = itot->second;
-
-    // Every 16K (half the smallest configurable pmsg buffer size) record
-    static const size_t rate_to_pmsg = 16 * 1024;
+    lastTotal = itot->second;
     if (lastTotal && ((android::sizesTotal() - lastTotal) < rate_to_pmsg)) {
         return;
     }
@@ -520,7 +606,8 @@ void LogTags::WritePmsgEventLogTags(uint32_t tag, uid_t uid) {
         if (pmsg_fd < 0) return;
     }
 
-    std::string Name = tag2name[tag];
+    tag2name_const_iterator it = tag2name.find(tag);
+    std::string Name = (it != tag2name.end()) ? it->second : "";
     tag2format_const_iterator iform = tag2format.find(tag);
     std::string Format = (iform != tag2format.end()) ? iform->second : "";
 
@@ -597,12 +684,17 @@ void LogTags::WriteDynamicEventLogTags(uint32_t tag, uid_t uid) {
     int fd = openFile(dynamic_event_log_tags, mode, true);
     if (fd < 0) return;
 
-    android::RWLock::AutoWLock writeLock(rwlock);
-
-    std::string ret = formatEntry_locked(tag, uid, false);
+    // Append the new entry without holding off the readers.
+    std::string ret;
+    {
+        android::RWLock::AutoRLock readLock(rwlock);
+        ret = formatEntry_locked(tag, uid, false);
+    }
     android::base::WriteStringToFd(ret, fd);
     TEMP_FAILURE_RETRY(close(fd));
 
+    android::RWLock::AutoWLock writeLock(rwlock);
+
     size_t size = 0;
     file2watermark_const_iterator iwater;
 
@@ -621,12 +713,16 @@ void LogTags::WriteDebugEventLogTags(uint32_t tag, uid_t uid) {
     one = fd >= 0;
     if (!one) return;
 
-    android::RWLock::AutoWLock writeLock(rwlock);
-
-    std::string ret = formatEntry_locked(tag, uid, false);
+    std::string ret;
+    {
+        android::RWLock::AutoRLock readLock(rwlock);
+        ret = formatEntry_locked(tag, uid, false);
+    }
     android::base::WriteStringToFd(ret, fd);
     TEMP_FAILURE_RETRY(close(fd));
 
+    android::RWLock::AutoWLock writeLock(rwlock);
+
     size_t size = 0;
     file2watermark_const_iterator iwater;
 
@@ -673,6 +769,7 @@ void LogTags::WritePersistEventLogTags(uint32_t tag, uid_t uid,
     // record totals for next watermark.
     android::RWLock::AutoWLock writeLock(rwlock);
     tag2total[tag] = lastTotal;
+    publish_locked(tag);
 }
 
 // nameToTag converts a name into an event tag. If format is NULL, then we
@@ -783,6 +880,8 @@ uint32_t LogTags::nameToTag(uid_t uid, const char* name, const char* format) {
             tag2uid[Tag].emplace(uid);
             uid2count[uid] = count + 1;
         }
+
+        publish_locked(Tag);
     }
 
     if (updateTag || updateFormat || updateWrite) {
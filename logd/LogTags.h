@@ -17,6 +17,8 @@
 #ifndef _LOGD_LOG_TAGS_H__
 #define _LOGD_LOG_TAGS_H__
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -53,6 +55,30 @@ class LogTags {
     typedef std::unordered_map<uint32_t, std::string>::const_iterator
         tag2format_const_iterator;
 
+    // Lock free copy of tag2name and tag2total for tagToName() and the
+    // WritePmsgEventLogTags() rate check, which run for every binary log
+    // entry.  Writers hold the writer lock and publish with publish_locked().
+    // A full table is replaced by a larger copy, and since readers may still
+    // be probing the old one, tables and interned names are never freed.
+    struct TagSlot {
+        std::atomic<uint32_t> tag;  // emptyTag if unused
+        std::atomic<const char*> name;
+        std::atomic<size_t> total;  // tag2total, or staticTotal if absent
+    };
+    struct TagTable {
+        explicit TagTable(size_t size, TagTable* prev = nullptr);
+        const size_t mask;
+        size_t used;
+        std::unique_ptr<TagSlot[]> slots;
+        TagTable* const prev;
+    };
+    static const size_t staticTotal = size_t(-1);
+    std::atomic<TagTable*> tagTable;
+    std::unordered_set<std::string> tagNames;  // interned tag2name values
+
+    const TagSlot* findSlot(uint32_t tag) const;
+    void publish_locked(uint32_t tag);
+
     static const size_t max_per_uid = 256;  // Put a cap on the tags per uid
     std::unordered_map<uid_t, size_t> uid2count;
     typedef std::unordered_map<uid_t, size_t>::const_iterator
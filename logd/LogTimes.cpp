@@ -30,7 +30,8 @@ pthread_mutex_t LogTimeEntry::timesLock = PTHREAD_MUTEX_INITIALIZER;
 LogTimeEntry::LogTimeEntry(LogReader& reader, SocketClient* client,
                            bool nonBlock, unsigned long tail,
                            unsigned int logMask, pid_t pid, log_time start,
-                           uint64_t timeout)
+                           uint64_t timeout,
+                           std::shared_ptr<const LogReaderFilter> filter)
     : mRefCount(1),
       mRelease(false),
       mError(false),
@@ -39,6 +40,7 @@ LogTimeEntry::LogTimeEntry(LogReader& reader, SocketClient* client,
       mReader(reader),
       mLogMask(logMask),
       mPid(pid),
+      mFilter(filter),
       mCount(0),
       mTail(tail),
       mIndex(0),
@@ -49,6 +51,7 @@ LogTimeEntry::LogTimeEntry(LogReader& reader, SocketClient* client,
     mTimeout.tv_sec = timeout / NS_PER_SEC;
     mTimeout.tv_nsec = timeout % NS_PER_SEC;
     memset(mLastTid, 0, sizeof(mLastTid));
+    mCursor.mPid = pid;
     pthread_cond_init(&threadTriggeredCondition, nullptr);
     cleanSkip_Locked();
 }
@@ -158,7 +161,8 @@ void* LogTimeEntry::threadStart(void* obj) {
             me->leadingDropped = true;
         }
         start = logbuf.flushTo(client, start, me->mLastTid, privileged,
-                               security, FilterSecondPass, me);
+                               security, FilterSecondPass, me, &me->mCursor,
+                               me->mFilter.get());
 
         wrlock();
 
@@ -269,7 +273,8 @@ int LogTimeEntry::FilterSecondPass(const LogBufferElement* element, void* obj) {
 ok:
     if (!me->skipAhead[element->getLogId()]) {
         LogTimeEntry::unlock();
-        return true;
+        // after the tail is counted, as if the client did the filtering
+        return !me->mFilter || me->mFilter->matches(element);
     }
 // FALLTHRU
 
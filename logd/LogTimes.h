@@ -22,13 +22,31 @@
 #include <time.h>
 
 #include <list>
+#include <memory>
 
 #include <log/log.h>
 #include <sysutils/SocketClient.h>
 
+#include "LogReaderFilter.h"
+
 class LogReader;
 class LogBufferElement;
 
+// Position of a reader in the LogBuffer element list, so that each wakeup
+// resumes after the last element visited instead of searching for the start
+// time again. Only touched by LogBuffer with its lock held, erase() pushes
+// the position back when the element referred to is pruned.
+struct LogBufferCursor {
+    std::list<LogBufferElement*>::iterator mLast;  // last element visited
+    log_time mStart;  // flushTo() start time the position is valid for
+    bool mSet;
+    bool mHead;  // mLast and all before it are gone, resume at the beginning
+    pid_t mPid;  // reader only wants this pid, or 0, see LogBuffer::mPidIndex
+
+    LogBufferCursor() : mSet(false), mHead(false), mPid(0) {
+    }
+};
+
 class LogTimeEntry {
     static pthread_mutex_t timesLock;
     unsigned int mRefCount;
@@ -43,6 +61,7 @@ class LogTimeEntry {
     static void threadStop(void* me);
     const unsigned int mLogMask;
     const pid_t mPid;
+    const std::shared_ptr<const LogReaderFilter> mFilter;  // or nullptr
     unsigned int skipAhead[LOG_ID_MAX];
     pid_t mLastTid[LOG_ID_MAX];
     unsigned long mCount;
@@ -52,10 +71,12 @@ class LogTimeEntry {
    public:
     LogTimeEntry(LogReader& reader, SocketClient* client, bool nonBlock,
                  unsigned long tail, unsigned int logMask, pid_t pid,
-                 log_time start, uint64_t timeout);
+                 log_time start, uint64_t timeout,
+                 std::shared_ptr<const LogReaderFilter> filter = nullptr);
 
     SocketClient* mClient;
     log_time mStart;
+    LogBufferCursor mCursor;
     struct timespec mTimeout;
     const bool mNonBlock;
     const log_time mEnd;  // only relevant if mNonBlock
@@ -47,11 +47,14 @@
 #include <private/android_logger.h>
 #include <utils/threads.h>
 
+#include "ChunkedLogBuffer.h"
 #include "CommandListener.h"
 #include "LogAudit.h"
 #include "LogBuffer.h"
+#include "LogIngestQueue.h"
 #include "LogKlog.h"
 #include "LogListener.h"
+#include "LogShmListener.h"
 #include "LogUtils.h"
 
 #define KMSG_PRIORITY(PRI)                                 \
@@ -486,7 +489,12 @@ int main(int argc, char* argv[]) {
     // LogBuffer is the object which is responsible for holding all
     // log entries.
 
-    logBuf = new LogBuffer(times);
+    if (__android_logger_property_get_bool(
+            "logd.chunked", BOOL_DEFAULT_FALSE | BOOL_DEFAULT_FLAG_PERSIST)) {
+        logBuf = new ChunkedLogBuffer(times);
+    } else {
+        logBuf = new LogBuffer(times);
+    }
 
     signal(SIGHUP, reinit_signal_handler);
 
@@ -509,12 +517,38 @@ int main(int argc, char* argv[]) {
     // initiated log messages. New log entries are added to LogBuffer
     // and LogReader is notified to send updates to connected clients.
 
-    LogListener* swl = new LogListener(logBuf, reader);
+    // LogIngestQueue optionally sits between LogListener and LogBuffer so
+    // that writers never wait on the LogBuffer lock, batches of entries are
+    // committed by its own thread.
+
+    LogIngestQueue* ingest = nullptr;
+    if (__android_logger_property_get_bool(
+            "logd.ingest", BOOL_DEFAULT_FALSE | BOOL_DEFAULT_FLAG_PERSIST)) {
+        ingest = new LogIngestQueue(logBuf, reader);
+        if (ingest->startCommitter()) {
+            exit(1);
+        }
+        logBuf->setIngestQueue(ingest);
+    }
+
+    LogListener* swl = new LogListener(logBuf, reader, ingest);
     // Backlog and /proc/sys/net/unix/max_dgram_qlen set to large value
     if (swl->startListener(600)) {
         exit(1);
     }
 
+    // LogShmListener listens on /dev/socket/logdshm for system daemons
+    // handing over a shared memory ring of log entries (LOGGER_SHM), each
+    // ring is drained by its own thread. Clients fall back to logdw.
+
+    if (__android_logger_property_get_bool(
+            "logd.shm", BOOL_DEFAULT_FALSE | BOOL_DEFAULT_FLAG_PERSIST)) {
+        LogShmListener* shm = new LogShmListener(logBuf, reader, ingest);
+        if (shm->startListener()) {
+            delete shm;
+        }
+    }
+
     // Command listener listens on /dev/socket/logd for incoming logd
     // administrative commands.
 
@@ -534,6 +568,7 @@ int main(int argc, char* argv[]) {
                               "ro.logd.auditd.dmesg", BOOL_DEFAULT_TRUE)
                               ? fdDmesg
                               : -1);
+        logBuf->setAudit(al);
     }
 
     LogKlog* kl = nullptr;
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <cutils/sockets.h>
+#include <log/log.h>
+#include <private/android_logger.h>
+
+// Rate at which logd accepts messages from /dev/socket/logdw. Writes are
+// blocking, so once the socket queue has filled the sender is paced by how
+// fast logd drains it. Compare runs against builds with and without the
+// recvmmsg() batching in LogListener.
+static void BM_logdw_throughput(benchmark::State& state) {
+    int fd = socket_local_client("logdw", ANDROID_SOCKET_NAMESPACE_RESERVED,
+                                 SOCK_DGRAM | SOCK_CLOEXEC);
+    if (fd < 0) {
+        state.SkipWithError("can not connect to logdw");
+        return;
+    }
+
+    static const char tag[] = "BM_logdw_throughput";
+    static const char msg[] =
+        "Lorem ipsum dolor sit amet, consectetur adipiscing elit";
+    char prio = ANDROID_LOG_INFO;
+
+    android_log_header_t header;
+    header.id = LOG_ID_MAIN;
+    header.tid = gettid();
+
+    struct iovec iov[4];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = &prio;
+    iov[1].iov_len = sizeof(prio);
+    iov[2].iov_base = const_cast<char*>(tag);
+    iov[2].iov_len = sizeof(tag);
+    iov[3].iov_base = const_cast<char*>(msg);
+    iov[3].iov_len = sizeof(msg);
+
+    while (state.KeepRunning()) {
+        header.realtime = log_time(CLOCK_REALTIME);
+        if (writev(fd, iov, 4) <= 0) {
+            state.SkipWithError("writev to logdw failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    close(fd);
+}
+BENCHMARK(BM_logdw_throughput);
+BENCHMARK(BM_logdw_throughput)->Threads(4);
+
+// Time to dump the main buffer as logcat -d does, dominated by the rate
+// at which the reader is sent entries from logdr.
+static void BM_logdr_dump(benchmark::State& state) {
+    size_t entries = 0;
+    while (state.KeepRunning()) {
+        struct logger_list* logger_list = android_logger_list_open(
+            LOG_ID_MAIN, ANDROID_LOG_RDONLY | ANDROID_LOG_NONBLOCK, 0, 0);
+        if (!logger_list) {
+            state.SkipWithError("can not open logdr");
+            break;
+        }
+        log_msg log_msg;
+        while (android_logger_list_read(logger_list, &log_msg) > 0) {
+            ++entries;
+        }
+        android_logger_list_free(logger_list);
+    }
+    state.SetItemsProcessed(entries);
+}
+BENCHMARK(BM_logdr_dump);
+
+BENCHMARK_MAIN();
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
@@ -43,15 +44,18 @@ static inline __u64 ptr_to_id(void *ptr)
     return (__u64) (uintptr_t) ptr;
 }
 
+/* Only needs the lock held for reading: the node can't be freed, which takes
+ * the lock for writing, and concurrent readers only ever add references. */
 static void acquire_node_locked(struct node* node)
 {
-    node->refcount++;
+    __atomic_add_fetch(&node->refcount, 1, __ATOMIC_RELAXED);
     DLOG(INFO) << "ACQUIRE " << std::hex << node << std::dec
                << " (" << node->name << ") rc=" << node->refcount;
 }
 
 static void remove_node_from_parent_locked(struct node* node);
 
+/* Needs the lock held for writing. */
 static void release_node_locked(struct node* node)
 {
     DLOG(INFO) << "RELEASE " << std::hex << node << std::dec
@@ -66,6 +70,7 @@ static void release_node_locked(struct node* node)
             memset(node->name, 0xef, node->namelen);
             free(node->name);
             free(node->actual_name);
+            free(node->child_buckets);
             memset(node, 0xfc, sizeof(*node));
             free(node);
         }
@@ -74,16 +79,74 @@ static void release_node_locked(struct node* node)
     }
 }
 
+/* FNV-1a over the case-folded name. */
+static __u32 hash_name(const char* name)
+{
+    __u32 hash = 2166136261u;
+    for (const char* p = name; *p; p++) {
+        hash ^= static_cast<unsigned char>(tolower(static_cast<unsigned char>(*p)));
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void index_child_locked(struct node* parent, struct node* node)
+{
+    struct node** bucket = &parent->child_buckets[node->name_hash & (parent->child_nbuckets - 1)];
+    node->hash_next = *bucket;
+    *bucket = node;
+}
+
+static void unindex_child_locked(struct node* parent, struct node* node)
+{
+    struct node** link = &parent->child_buckets[node->name_hash & (parent->child_nbuckets - 1)];
+    while (*link != node) {
+        link = &(*link)->hash_next;
+    }
+    *link = node->hash_next;
+    node->hash_next = NULL;
+}
+
+/* (Re)builds the index of parent's children with nbuckets buckets. On
+ * allocation failure the old index, if any, is kept; without one, lookups
+ * just walk the sibling list. */
+static void build_child_index_locked(struct node* parent, size_t nbuckets)
+{
+    struct node** buckets = static_cast<struct node**>(calloc(nbuckets, sizeof(struct node*)));
+    if (!buckets) {
+        return;
+    }
+    free(parent->child_buckets);
+    parent->child_buckets = buckets;
+    parent->child_nbuckets = nbuckets;
+    for (struct node* node = parent->child; node; node = node->next) {
+        index_child_locked(parent, node);
+    }
+}
+
 static void add_node_to_parent_locked(struct node *node, struct node *parent) {
     node->parent = parent;
     node->next = parent->child;
     parent->child = node;
+    parent->child_count++;
+    if (parent->child_nbuckets) {
+        index_child_locked(parent, node);
+        if (parent->child_count > parent->child_nbuckets) {
+            build_child_index_locked(parent, parent->child_nbuckets * 2);
+        }
+    } else if (parent->child_count > CHILD_INDEX_THRESHOLD) {
+        build_child_index_locked(parent, 2 * CHILD_INDEX_THRESHOLD);
+    }
     acquire_node_locked(parent);
 }
 
 static void remove_node_from_parent_locked(struct node* node)
 {
     if (node->parent) {
+        if (node->parent->child_nbuckets) {
+            unindex_child_locked(node->parent, node);
+        }
+        node->parent->child_count--;
         if (node->parent->child == node) {
             node->parent->child = node->parent->child->next;
         } else {
@@ -369,6 +432,7 @@ struct node *create_node_locked(struct fuse* fuse,
         memcpy(node->actual_name, actual_name, namelen + 1);
     }
     node->namelen = namelen;
+    node->name_hash = hash_name(name);
     node->nid = ptr_to_id(node);
     node->ino = fuse->global->inode_ctr++;
     node->gen = fuse->global->next_generation++;
@@ -417,8 +481,18 @@ static int rename_node_locked(struct node *node, const char *name,
         free(node->actual_name);
         node->actual_name = NULL;
     }
+
+    /* The new name may hash to another bucket of the parent's index. */
+    bool indexed = node->parent && node->parent->child_nbuckets;
+    if (indexed) {
+        unindex_child_locked(node->parent, node);
+    }
     memcpy(node->name, name, namelen + 1);
     node->namelen = namelen;
+    node->name_hash = hash_name(name);
+    if (indexed) {
+        index_child_locked(node->parent, node);
+    }
     return 0;
 }
 
@@ -443,6 +517,17 @@ static struct node* lookup_node_and_path_by_id_locked(struct fuse* fuse, __u64 n
 
 static struct node *lookup_child_by_name_locked(struct node *node, const char *name)
 {
+    if (node->child_nbuckets) {
+        __u32 hash = hash_name(name);
+        for (node = node->child_buckets[hash & (node->child_nbuckets - 1)]; node;
+                node = node->hash_next) {
+            if (node->name_hash == hash && !strcmp(name, node->name) && !node->deleted) {
+                return node;
+            }
+        }
+        return 0;
+    }
+
     for (node = node->child; node; node = node->next) {
         /* use exact string comparison, nodes that differ by case
          * must be considered distinct even if they refer to the same
@@ -517,11 +602,19 @@ static int fuse_reply_entry(struct fuse* fuse, __u64 unique,
         return -errno;
     }
 
-    pthread_mutex_lock(&fuse->global->lock);
-    node = acquire_or_create_child_locked(fuse, parent, name, actual_name);
-    if (!node) {
-        pthread_mutex_unlock(&fuse->global->lock);
-        return -ENOMEM;
+    pthread_rwlock_rdlock(&fuse->global->lock);
+    node = lookup_child_by_name_locked(parent, name);
+    if (node) {
+        acquire_node_locked(node);
+    } else {
+        /* Look again once no one else can create it in between. */
+        pthread_rwlock_unlock(&fuse->global->lock);
+        pthread_rwlock_wrlock(&fuse->global->lock);
+        node = acquire_or_create_child_locked(fuse, parent, name, actual_name);
+        if (!node) {
+            pthread_rwlock_unlock(&fuse->global->lock);
+            return -ENOMEM;
+        }
     }
     memset(&out, 0, sizeof(out));
     attr_from_stat(fuse, &out.attr, &s, node);
@@ -529,7 +622,7 @@ static int fuse_reply_entry(struct fuse* fuse, __u64 unique,
     out.entry_valid = 10;
     out.nodeid = node->nid;
     out.generation = node->gen;
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     fuse_reply(fuse, unique, &out, sizeof(out));
     return NO_STATUS;
 }
@@ -592,12 +685,12 @@ static int handle_lookup(struct fuse* fuse, struct fuse_handler* handler,
     char child_path[PATH_MAX];
     const char* actual_name;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     DLOG(INFO) << "[" << handler->token << "] LOOKUP " << name << " @ " << hdr->nodeid
                << " (" << (parent_node ? parent_node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!parent_node || !(actual_name = find_file_within(parent_path, name,
             child_path, sizeof(child_path), 1))) {
@@ -615,7 +708,7 @@ static int handle_forget(struct fuse* fuse, struct fuse_handler* handler,
 {
     struct node* node;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     node = lookup_node_by_id_locked(fuse, hdr->nodeid);
     DLOG(INFO) << "[" << handler->token << "] FORGET #" << req->nlookup
                << " @ " << std::hex << hdr->nodeid
@@ -627,7 +720,36 @@ static int handle_forget(struct fuse* fuse, struct fuse_handler* handler,
             release_node_locked(node);
         }
     }
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
+    return NO_STATUS; /* no reply */
+}
+
+static int handle_batch_forget(struct fuse* fuse, struct fuse_handler* handler,
+        const struct fuse_batch_forget_in* req, size_t data_len)
+{
+    const struct fuse_forget_one* forgets =
+            reinterpret_cast<const struct fuse_forget_one*>(req + 1);
+    __u32 count = req->count;
+
+    if (data_len < sizeof(*req)
+            || (data_len - sizeof(*req)) / sizeof(*forgets) < count) {
+        LOG(ERROR) << "[" << handler->token << "] truncated BATCH_FORGET of " << count;
+        return NO_STATUS;
+    }
+
+    pthread_rwlock_wrlock(&fuse->global->lock);
+    DLOG(INFO) << "[" << handler->token << "] BATCH_FORGET " << count;
+    for (__u32 i = 0; i < count; i++) {
+        struct node* node = lookup_node_by_id_locked(fuse, forgets[i].nodeid);
+        if (node) {
+            __u64 n = forgets[i].nlookup;
+            while (n) {
+                n--;
+                release_node_locked(node);
+            }
+        }
+    }
+    pthread_rwlock_unlock(&fuse->global->lock);
     return NO_STATUS; /* no reply */
 }
 
@@ -637,12 +759,12 @@ static int handle_getattr(struct fuse* fuse, struct fuse_handler* handler,
     struct node* node;
     char path[PATH_MAX];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     DLOG(INFO) << "[" << handler->token << "] GETATTR flags=" << req->getattr_flags
                << " fh=" << std::hex << req->fh << " @ " << hdr->nodeid << std::dec
                << " (" << (node ? node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
@@ -661,12 +783,12 @@ static int handle_setattr(struct fuse* fuse, struct fuse_handler* handler,
     char path[PATH_MAX];
     struct timespec times[2];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     DLOG(INFO) << "[" << handler->token << "] SETATTR fh=" << std::hex << req->fh
                << " valid=" << std::hex << req->valid << " @ " << hdr->nodeid << std::dec
                << " (" << (node ? node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
@@ -726,13 +848,13 @@ static int handle_mknod(struct fuse* fuse, struct fuse_handler* handler,
     char child_path[PATH_MAX];
     const char* actual_name;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     DLOG(INFO) << "[" << handler->token << "] MKNOD " << name << " 0" << std::oct << req->mode
                << " @ " << std::hex << hdr->nodeid
                << " (" << (parent_node ? parent_node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!parent_node || !(actual_name = find_file_within(parent_path, name,
             child_path, sizeof(child_path), 1))) {
@@ -756,13 +878,13 @@ static int handle_mkdir(struct fuse* fuse, struct fuse_handler* handler,
     char child_path[PATH_MAX];
     const char* actual_name;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     DLOG(INFO) << "[" << handler->token << "] MKDIR " << name << " 0" << std::oct << req->mode
                << " @ " << std::hex << hdr->nodeid
                << " (" << (parent_node ? parent_node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!parent_node || !(actual_name = find_file_within(parent_path, name,
             child_path, sizeof(child_path), 1))) {
@@ -805,12 +927,12 @@ static int handle_unlink(struct fuse* fuse, struct fuse_handler* handler,
     char parent_path[PATH_MAX];
     char child_path[PATH_MAX];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     DLOG(INFO) << "[" << handler->token << "] UNLINK " << name << " @ " << std::hex << hdr->nodeid
                << " (" << (parent_node ? parent_node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!parent_node || !find_file_within(parent_path, name,
             child_path, sizeof(child_path), 1)) {
@@ -822,12 +944,12 @@ static int handle_unlink(struct fuse* fuse, struct fuse_handler* handler,
     if (unlink(child_path) == -1) {
         return -errno;
     }
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     child_node = lookup_child_by_name_locked(parent_node, name);
     if (child_node) {
         child_node->deleted = true;
     }
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     if (parent_node && child_node) {
         /* Tell all other views that node is gone */
         DLOG(INFO) << "[" << handler->token << "] fuse_notify_delete"
@@ -855,12 +977,12 @@ static int handle_rmdir(struct fuse* fuse, struct fuse_handler* handler,
     char parent_path[PATH_MAX];
     char child_path[PATH_MAX];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     DLOG(INFO) << "[" << handler->token << "] UNLINK " << name << " @ " << std::hex << hdr->nodeid
                << " (" << (parent_node ? parent_node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!parent_node || !find_file_within(parent_path, name,
             child_path, sizeof(child_path), 1)) {
@@ -872,12 +994,12 @@ static int handle_rmdir(struct fuse* fuse, struct fuse_handler* handler,
     if (rmdir(child_path) == -1) {
         return -errno;
     }
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     child_node = lookup_child_by_name_locked(parent_node, name);
     if (child_node) {
         child_node->deleted = true;
     }
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     if (parent_node && child_node) {
         /* Tell all other views that node is gone */
         DLOG(INFO) << "[" << handler->token << "] fuse_notify_delete"
@@ -912,7 +1034,7 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
     int search;
     int res;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     old_parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             old_parent_path, sizeof(old_parent_path));
     new_parent_node = lookup_node_and_path_by_id_locked(fuse, req->newdir,
@@ -941,7 +1063,7 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
         goto lookup_error;
     }
     acquire_node_locked(child_node);
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     /* Special case for renaming a file where destination is same path
      * differing only by case.  In this case we don't want to look for a case
@@ -962,7 +1084,7 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
         goto io_error;
     }
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     res = rename_node_locked(child_node, new_name, new_actual_name);
     if (!res) {
         remove_node_from_parent_locked(child_node);
@@ -973,11 +1095,11 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
     goto done;
 
 io_error:
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
 done:
     release_node_locked(child_node);
 lookup_error:
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     return res;
 }
 
@@ -1000,12 +1122,12 @@ static int handle_open(struct fuse* fuse, struct fuse_handler* handler,
     struct fuse_open_out out = {};
     struct handle *h;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     DLOG(INFO) << "[" << handler->token << "] OPEN 0" << std::oct << req->flags
                << " @ " << std::hex << hdr->nodeid << std::dec
                << " (" << (node ? node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
@@ -1030,6 +1152,79 @@ static int handle_open(struct fuse* fuse, struct fuse_handler* handler,
     return NO_STATUS;
 }
 
+/* Reads whatever is left in the handler's splice pipe into its read buffer, and returns
+ * the number of bytes read.  The pipe is non-blocking, so this stops once it is empty;
+ * it never holds more than a reply header and MAX_READ bytes. */
+static size_t drain_splice_pipe(struct fuse_handler* handler)
+{
+    size_t total = 0;
+    for (;;) {
+        ssize_t res = TEMP_FAILURE_RETRY(read(handler->splice_pipe[0],
+                handler->read_buffer + total, sizeof(handler->read_buffer) - total));
+        if (res <= 0) {
+            return total;
+        }
+        total += res;
+    }
+}
+
+/* Replies to a read by splicing the data from fd into the handler's pipe after the reply
+ * header, and then the whole reply from the pipe to /dev/fuse, so that the data never goes
+ * through user space.  Returns false if the caller should read the data itself, otherwise
+ * sets *result to what handle_read should return. */
+static bool splice_read_reply(struct fuse* fuse, struct fuse_handler* handler, __u64 unique,
+        int fd, __u32 size, __u64 offset, int* result)
+{
+    struct fuse_out_header hdr;
+    hdr.len = sizeof(hdr) + size;
+    hdr.error = 0;
+    hdr.unique = unique;
+
+    if (TEMP_FAILURE_RETRY(write(handler->splice_pipe[1], &hdr, sizeof(hdr))) != sizeof(hdr)) {
+        return false;
+    }
+
+    loff_t off = offset;
+    ssize_t res = TEMP_FAILURE_RETRY(splice(fd, &off, handler->splice_pipe[1], NULL, size,
+            SPLICE_F_MOVE));
+    if (res == static_cast<ssize_t>(size)) {
+        ssize_t sent = TEMP_FAILURE_RETRY(splice(handler->splice_pipe[0], NULL, fuse->fd, NULL,
+                sizeof(hdr) + size, SPLICE_F_MOVE));
+        if (sent == static_cast<ssize_t>(sizeof(hdr) + size)) {
+            *result = NO_STATUS;
+            return true;
+        }
+        if (sent == -1 && errno == EINVAL) {
+            PLOG(WARNING) << "[" << handler->token << "] cannot splice to /dev/fuse";
+            __atomic_store_n(&fuse->no_splice, 1, __ATOMIC_RELAXED);
+        }
+        /* Whatever the kernel did not take is dropped; the caller replies again. */
+        drain_splice_pipe(handler);
+        return false;
+    }
+    if (res == -1) {
+        int err = errno;
+        drain_splice_pipe(handler);
+        if (err == EINVAL) {
+            PLOG(WARNING) << "[" << handler->token << "] cannot splice from the lower filesystem";
+            __atomic_store_n(&fuse->no_splice, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+        *result = -err;
+        return true;
+    }
+
+    /* A short read, at the end of the file: the header in the pipe has the wrong length,
+     * so send the data the usual way. */
+    size_t len = drain_splice_pipe(handler);
+    if (len != sizeof(hdr) + res) {
+        return false;
+    }
+    fuse_reply(fuse, unique, handler->read_buffer + sizeof(hdr), res);
+    *result = NO_STATUS;
+    return true;
+}
+
 static int handle_read(struct fuse* fuse, struct fuse_handler* handler,
         const struct fuse_in_header* hdr, const struct fuse_read_in* req)
 {
@@ -1042,13 +1237,18 @@ static int handle_read(struct fuse* fuse, struct fuse_handler* handler,
 
     /* Don't access any other fields of hdr or req beyond this point, the read buffer
      * overlaps the request buffer and will clobber data in the request.  This
-     * saves us 128KB per request handler thread at the cost of this scary comment. */
+     * saves us 256KB per request handler thread at the cost of this scary comment. */
 
     DLOG(INFO) << "[" << handler->token << "] READ " << std::hex << h << std::dec
                << "(" << h->fd << ") " << size << "@" << offset;
     if (size > MAX_READ) {
         return -EINVAL;
     }
+    if (size >= SPLICE_READ_MIN && handler->splice_pipe[0] != -1
+            && !__atomic_load_n(&fuse->no_splice, __ATOMIC_RELAXED)
+            && splice_read_reply(fuse, handler, unique, h->fd, size, offset, &res)) {
+        return res;
+    }
     res = TEMP_FAILURE_RETRY(pread64(h->fd, read_buffer, size, offset));
     if (res == -1) {
         return -errno;
@@ -1091,10 +1291,10 @@ static int handle_statfs(struct fuse* fuse, struct fuse_handler* handler,
     struct fuse_statfs_out out;
     int res;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     DLOG(INFO) << "[" << handler->token << "] STATFS";
     res = get_node_path_locked(&fuse->global->root, path, sizeof(path));
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     if (res < 0) {
         return -ENOENT;
     }
@@ -1165,11 +1365,11 @@ static int handle_opendir(struct fuse* fuse, struct fuse_handler* handler,
     struct fuse_open_out out = {};
     struct dirhandle *h;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     DLOG(INFO) << "[" << handler->token << "] OPENDIR @ " << std::hex << hdr->nodeid
                << " (" << (node ? node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
@@ -1254,15 +1454,16 @@ static int handle_init(struct fuse* fuse, struct fuse_handler* handler,
         return -1;
     }
 
-    /* We limit ourselves to 15 because we don't handle BATCH_FORGET yet */
-    out.minor = MIN(req->minor, 15);
+    memset(&out, 0, sizeof(out));
+    out.minor = MIN(req->minor, FUSE_SUPPORTED_MINOR);
     fuse_struct_size = sizeof(out);
 #if defined(FUSE_COMPAT_22_INIT_OUT_SIZE)
     /* FUSE_KERNEL_VERSION >= 23. */
 
-    /* Since we return minor version 15, the kernel does not accept the latest
-     * fuse_init_out size. We need to use FUSE_COMPAT_22_INIT_OUT_SIZE always.*/
-    fuse_struct_size = FUSE_COMPAT_22_INIT_OUT_SIZE;
+    /* Before 7.23, the kernel does not accept the latest fuse_init_out size. */
+    if (out.minor < 23) {
+        fuse_struct_size = FUSE_COMPAT_22_INIT_OUT_SIZE;
+    }
 #endif
 
     out.major = FUSE_KERNEL_VERSION;
@@ -1271,6 +1472,19 @@ static int handle_init(struct fuse* fuse, struct fuse_handler* handler,
     out.max_background = 32;
     out.congestion_threshold = 32;
     out.max_write = MAX_WRITE;
+#if defined(FUSE_MAX_PAGES)
+    /* Without it, requests carry at most 32 pages whatever max_write says. */
+    if (req->flags & FUSE_MAX_PAGES) {
+        out.flags |= FUSE_MAX_PAGES;
+        out.max_pages = MAX_WRITE / PAGE_SIZE;
+    }
+#endif
+    /* Replies spliced with SPLICE_F_MOVE may have their pages stolen. */
+    if (req->minor >= 14 && (req->flags & FUSE_SPLICE_WRITE)) {
+        out.flags |= FUSE_SPLICE_MOVE;
+    } else {
+        __atomic_store_n(&fuse->no_splice, 1, __ATOMIC_RELAXED);
+    }
     fuse_reply(fuse, hdr->unique, &out, fuse_struct_size);
     return NO_STATUS;
 }
@@ -1282,12 +1496,12 @@ static int handle_canonical_path(struct fuse* fuse, struct fuse_handler* handler
     char path[PATH_MAX];
     int len;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             path, sizeof(path));
     DLOG(INFO) << "[" << handler->token << "] CANONICAL_PATH @ " << std::hex << hdr->nodeid
                << std::dec << " (" << (node ? node->name : "?") << ")";
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
@@ -1317,6 +1531,12 @@ static int handle_fuse_request(struct fuse *fuse, struct fuse_handler* handler,
         return handle_forget(fuse, handler, hdr, req);
     }
 
+    case FUSE_BATCH_FORGET: {
+        const struct fuse_batch_forget_in *req =
+                static_cast<const struct fuse_batch_forget_in*>(data);
+        return handle_batch_forget(fuse, handler, req, data_len);
+    }
+
     case FUSE_GETATTR: { /* getattr_in -> attr_out */
         const struct fuse_getattr_in *req = static_cast<const struct fuse_getattr_in*>(data);
         return handle_getattr(fuse, handler, hdr, req);
@@ -1433,6 +1653,17 @@ static int handle_fuse_request(struct fuse *fuse, struct fuse_handler* handler,
 void handle_fuse_requests(struct fuse_handler* handler)
 {
     struct fuse* fuse = handler->fuse;
+
+    if (pipe2(handler->splice_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        PLOG(WARNING) << "[" << handler->token << "] cannot create splice pipe";
+        handler->splice_pipe[0] = handler->splice_pipe[1] = -1;
+    } else if (fcntl(handler->splice_pipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE) == -1) {
+        PLOG(WARNING) << "[" << handler->token << "] cannot resize splice pipe";
+        close(handler->splice_pipe[0]);
+        close(handler->splice_pipe[1]);
+        handler->splice_pipe[0] = handler->splice_pipe[1] = -1;
+    }
+
     for (;;) {
         ssize_t len = TEMP_FAILURE_RETRY(read(fuse->fd,
                 handler->request_buffer, sizeof(handler->request_buffer)));
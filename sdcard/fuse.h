@@ -52,11 +52,29 @@ static constexpr bool kEnableDLog = false;
 #define DLOG(x) \
     if (kEnableDLog) LOG(x)
 
+/* Number of children past which a directory's children are hash-indexed. */
+#define CHILD_INDEX_THRESHOLD 64
+
+/* Newest FUSE protocol minor version we speak.  From 7.16 on, the kernel may send
+ * BATCH_FORGET; 7.28 adds FUSE_MAX_PAGES, which lifts the 32 page limit on requests. */
+#if defined(FUSE_MAX_PAGES)
+#define FUSE_SUPPORTED_MINOR 28
+#else
+#define FUSE_SUPPORTED_MINOR 15
+#endif
+
 /* Maximum number of bytes to write in one request. */
 #define MAX_WRITE (256 * 1024)
 
-/* Maximum number of bytes to read in one request. */
-#define MAX_READ (128 * 1024)
+/* Maximum number of bytes to read in one request.
+ * Kernels that negotiate FUSE_MAX_PAGES send reads as large as writes. */
+#define MAX_READ MAX_WRITE
+
+/* Reads at least this large are spliced from the lower file to /dev/fuse. */
+#define SPLICE_READ_MIN (32 * 1024)
+
+/* Room for the reply header and the pages of MAX_READ bytes at any offset. */
+#define SPLICE_PIPE_SIZE (MAX_READ + 2 * PAGE_SIZE)
 
 /* Largest possible request.
  * The request size is bounded by the maximum size of a FUSE_WRITE request because it has
@@ -102,6 +120,8 @@ struct dirhandle {
 };
 
 struct node {
+    /* Taken with the tree lock held for reading or writing, so updated
+     * atomically; dropped only with it held for writing. */
     __u32 refcount;
     __u64 nid;
     __u64 gen;
@@ -121,6 +141,15 @@ struct node {
     struct node *child;         /* first contained file by this dir */
     struct node *parent;        /* containing directory */
 
+    /* Once a directory has more than CHILD_INDEX_THRESHOLD children, they are
+     * also chained into hash buckets by case-folded name, so that looking up
+     * a name doesn't walk the whole sibling list. */
+    struct node **child_buckets;
+    size_t child_nbuckets;      /* power of two, or 0 if there is no index */
+    size_t child_count;
+    struct node *hash_next;     /* next child in the same bucket */
+    __u32 name_hash;
+
     size_t namelen;
     char *name;
     /* If non-null, this is the real name of the file in the underlying storage.
@@ -140,7 +169,10 @@ struct node {
 
 /* Global data for all FUSE mounts */
 struct fuse_global {
-    pthread_mutex_t lock;
+    /* Guards the node tree. Held for reading to look nodes up, build paths
+     * and take references, and for writing to add, rename, release or
+     * re-derive nodes. */
+    pthread_rwlock_t lock;
 
     uid_t uid;
     gid_t gid;
@@ -188,6 +220,10 @@ struct fuse {
 
     gid_t gid;
     mode_t mask;
+
+    /* Set once splicing read replies turned out to be unsupported, by the
+     * kernel or by the lower filesystem.  Accessed atomically. */
+    int no_splice;
 };
 
 /* Private data used by a single FUSE handler */
@@ -195,6 +231,10 @@ struct fuse_handler {
     struct fuse* fuse;
     int token;
 
+    /* Pipe through which read replies are spliced, or -1 if there is none.
+     * It is empty between requests. */
+    int splice_pipe[2];
+
     /* To save memory, we never use the contents of the request buffer and the read
      * buffer at the same time.  This allows us to share the underlying storage. */
     union {
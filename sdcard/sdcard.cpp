@@ -28,6 +28,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/macros.h>
@@ -92,7 +94,7 @@ static bool package_parse_callback(pkg_info *info, void *userdata) {
 }
 
 static bool read_package_list(struct fuse_global* global) {
-    pthread_mutex_lock(&global->lock);
+    pthread_rwlock_wrlock(&global->lock);
 
     global->package_to_appid->clear();
     bool rc = packagelist_parse(package_parse_callback, global);
@@ -101,7 +103,7 @@ static bool read_package_list(struct fuse_global* global) {
     // Regenerate ownership details using newly loaded mapping.
     derive_permissions_recursive_locked(global->fuse_default, &global->root);
 
-    pthread_mutex_unlock(&global->lock);
+    pthread_rwlock_unlock(&global->lock);
 
     return rc;
 }
@@ -211,28 +213,48 @@ static void* start_handler(void* data) {
     return NULL;
 }
 
+/* Default number of request handler threads per view. Each thread has a
+ * request buffer of its own, of a little over MAX_WRITE bytes. */
+static int default_handler_threads() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus < 1 ? 1 : std::min(cpus, 4L);
+}
+
+static void start_handlers(struct fuse* fuse, int view, int threads) {
+    for (int i = 0; i < threads; i++) {
+        struct fuse_handler* handler =
+                static_cast<struct fuse_handler*>(calloc(1, sizeof(struct fuse_handler)));
+        if (!handler) {
+            LOG(FATAL) << "failed to allocate fuse handler";
+        }
+        handler->fuse = fuse;
+        handler->token = view * threads + i;
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, start_handler, handler)) {
+            LOG(FATAL) << "failed to pthread_create";
+        }
+    }
+}
+
 static void run(const char* source_path, const char* label, uid_t uid,
-        gid_t gid, userid_t userid, bool multi_user, bool full_write) {
+        gid_t gid, userid_t userid, bool multi_user, bool full_write, int threads) {
     struct fuse_global global;
     struct fuse fuse_default;
     struct fuse fuse_read;
     struct fuse fuse_write;
-    struct fuse_handler handler_default;
-    struct fuse_handler handler_read;
-    struct fuse_handler handler_write;
-    pthread_t thread_default;
-    pthread_t thread_read;
-    pthread_t thread_write;
 
     memset(&global, 0, sizeof(global));
     memset(&fuse_default, 0, sizeof(fuse_default));
     memset(&fuse_read, 0, sizeof(fuse_read));
     memset(&fuse_write, 0, sizeof(fuse_write));
-    memset(&handler_default, 0, sizeof(handler_default));
-    memset(&handler_read, 0, sizeof(handler_read));
-    memset(&handler_write, 0, sizeof(handler_write));
 
-    pthread_mutex_init(&global.lock, NULL);
+    /* Prefer writers, so that a stream of lookups can't hold off FORGET. */
+    pthread_rwlockattr_t lock_attr;
+    pthread_rwlockattr_init(&lock_attr);
+    pthread_rwlockattr_setkind_np(&lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&global.lock, &lock_attr);
+    pthread_rwlockattr_destroy(&lock_attr);
     global.package_to_appid = new AppIdMap;
     global.uid = uid;
     global.gid = gid;
@@ -271,14 +293,6 @@ static void run(const char* source_path, const char* label, uid_t uid,
     snprintf(fuse_read.dest_path, PATH_MAX, "/mnt/runtime/read/%s", label);
     snprintf(fuse_write.dest_path, PATH_MAX, "/mnt/runtime/write/%s", label);
 
-    handler_default.fuse = &fuse_default;
-    handler_read.fuse = &fuse_read;
-    handler_write.fuse = &fuse_write;
-
-    handler_default.token = 0;
-    handler_read.token = 1;
-    handler_write.token = 2;
-
     umask(0);
 
     if (multi_user) {
@@ -307,11 +321,9 @@ static void run(const char* source_path, const char* label, uid_t uid,
         fs_prepare_dir(global.obb_path, 0775, uid, gid);
     }
 
-    if (pthread_create(&thread_default, NULL, start_handler, &handler_default)
-            || pthread_create(&thread_read, NULL, start_handler, &handler_read)
-            || pthread_create(&thread_write, NULL, start_handler, &handler_write)) {
-        LOG(FATAL) << "failed to pthread_create";
-    }
+    start_handlers(&fuse_default, 0, threads);
+    start_handlers(&fuse_read, 1, threads);
+    start_handlers(&fuse_write, 2, threads);
 
     watch_package_list(&global);
     LOG(FATAL) << "terminated prematurely";
@@ -451,7 +463,8 @@ static int usage() {
                << "    -U: specify user ID that owns device"
                << "    -m: source_path is multi-user"
                << "    -w: runtime write mount has full write access"
-               << "    -P  preserve owners on the lower file system";
+               << "    -P  preserve owners on the lower file system"
+               << "    -t: number of request handler threads per FUSE view";
     return 1;
 }
 
@@ -464,12 +477,13 @@ extern "C" int sdcard_main(int argc, char **argv) {
     bool multi_user = false;
     bool full_write = false;
     bool derive_gid = false;
+    int threads = default_handler_threads();
     int i;
     struct rlimit rlim;
     int fs_version;
 
     int opt;
-    while ((opt = getopt(argc, argv, "u:g:U:mwG")) != -1) {
+    while ((opt = getopt(argc, argv, "u:g:U:mwGt:")) != -1) {
         switch (opt) {
             case 'u':
                 uid = strtoul(optarg, NULL, 10);
@@ -489,6 +503,9 @@ extern "C" int sdcard_main(int argc, char **argv) {
             case 'G':
                 derive_gid = true;
                 break;
+            case 't':
+                threads = strtoul(optarg, NULL, 10);
+                break;
             case '?':
             default:
                 return usage();
@@ -519,6 +536,10 @@ extern "C" int sdcard_main(int argc, char **argv) {
         LOG(ERROR) << "uid and gid must be nonzero";
         return usage();
     }
+    if (threads < 1) {
+        LOG(ERROR) << "at least one handler thread is needed";
+        return usage();
+    }
 
     rlim.rlim_cur = 8192;
     rlim.rlim_max = 8192;
@@ -534,7 +555,7 @@ extern "C" int sdcard_main(int argc, char **argv) {
     if (should_use_sdcardfs()) {
         run_sdcardfs(source_path, label, uid, gid, userid, multi_user, full_write, derive_gid);
     } else {
-        run(source_path, label, uid, gid, userid, multi_user, full_write);
+        run(source_path, label, uid, gid, userid, multi_user, full_write, threads);
     }
     return 1;
 }
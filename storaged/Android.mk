@@ -19,6 +19,8 @@ LOCAL_SRC_FILES := \
     storaged_service.cpp \
     storaged_utils.cpp \
     storaged_uid_monitor.cpp \
+    storaged_uid_io_history.cpp \
+    storaged_task_monitor.cpp \
     EventLogTags.logtags
 
 LOCAL_MODULE := libstoraged
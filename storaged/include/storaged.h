@@ -30,6 +30,7 @@
 #include <batteryservice/IBatteryPropertiesRegistrar.h>
 
 #include "storaged_info.h"
+#include "storaged_task_monitor.h"
 #include "storaged_uid_monitor.h"
 
 using namespace android;
@@ -152,6 +153,65 @@ public:
     }
 };
 
+// Exponentially weighted mean and variance, so that recent samples count most
+class ewma_stats {
+private:
+    double mAlpha;
+    double mMean;
+    double mVar;
+    uint32_t mCnt;
+public:
+    ewma_stats(double alpha) : mAlpha(alpha), mMean(0), mVar(0), mCnt(0) {};
+    ~ewma_stats() {};
+    double get_mean() {
+        return mMean;
+    }
+    double get_std() {
+        return sqrt(mVar);
+    }
+    uint32_t get_count() {
+        return mCnt;
+    }
+    void add(double num) {
+        if (mCnt++ == 0) {
+            mMean = num;
+            return;
+        }
+        double diff = num - mMean;
+        double incr = mAlpha * diff;
+        mMean += incr;
+        mVar = (1 - mAlpha) * (mVar + diff * incr);
+    }
+};
+
+// Log-linear histogram with 4 buckets per power of two, which bounds the error of a
+// percentile to 25% in constant memory, whatever the number of samples
+#define LATENCY_HISTOGRAM_SUB_BUCKETS ( 4 )
+#define LATENCY_HISTOGRAM_BUCKETS ( LATENCY_HISTOGRAM_SUB_BUCKETS * 31 )
+class latency_histogram {
+private:
+    uint64_t mBuckets[LATENCY_HISTOGRAM_BUCKETS];
+    uint64_t mCnt;
+    static uint32_t bucket(uint32_t value);
+    static uint32_t bucket_start(uint32_t bucket);
+public:
+    latency_histogram() {
+        reset();
+    }
+    ~latency_histogram() {};
+    uint64_t get_count() {
+        return mCnt;
+    }
+    void reset() {
+        memset(mBuckets, 0, sizeof(mBuckets));
+        mCnt = 0;
+    }
+    // adds |count| samples of |value|
+    void add(uint32_t value, uint64_t count);
+    // returns the value below which fall |percent| of the samples, 0 if there are none
+    uint32_t get_percentile(double percent);
+};
+
 #define MMC_DISK_STATS_PATH "/sys/block/mmcblk0/stat"
 #define SDA_DISK_STATS_PATH "/sys/block/sda/stat"
 #define EMMC_ECSD_PATH "/d/mmc0/mmc0:0001/ext_csd"
@@ -205,14 +265,39 @@ public:
     void update(void);
 };
 
+// Minimum number of requests in an interval for its latency to be meaningful
+#define DISK_LATENCY_MIN_IOS ( 16 )
+
 class disk_stats_publisher {
 private:
     FRIEND_TEST(storaged_test, disk_stats_publisher);
+    FRIEND_TEST(storaged_test, disk_latency_alert);
     const char* DISK_STATS_PATH;
     struct disk_stats mAccumulate;
     struct disk_stats mPrevious;
+    // per-request latencies (usec) of the current publish window
+    latency_histogram mReadLatency;
+    latency_histogram mWriteLatency;
+    // baseline of the per-request latencies (usec) of each interval
+    ewma_stats mReadBaseline;
+    ewma_stats mWriteBaseline;
+    // whether the last interval was reported as slow
+    bool mReadSlow;
+    bool mWriteSlow;
+    const uint32_t mWarmup;
+    const double mSigma;
+
+    bool detect(ewma_stats* baseline, uint32_t latency);
+    void update_latency(struct disk_stats* inc);
+    void update(struct disk_stats* stats);
 public:
-    disk_stats_publisher(void) {
+    disk_stats_publisher(uint32_t window_size = 30, double sigma = 3.0) :
+            mReadBaseline(2.0 / (window_size + 1)),
+            mWriteBaseline(2.0 / (window_size + 1)),
+            mReadSlow(false),
+            mWriteSlow(false),
+            mWarmup(window_size),
+            mSigma(sigma) {
         memset(&mAccumulate, 0, sizeof(struct disk_stats));
         memset(&mPrevious, 0, sizeof(struct disk_stats));
 
@@ -242,6 +327,7 @@ struct storaged_config {
     int periodic_chores_interval_disk_stats_publish;
     int periodic_chores_interval_uid_io;
     bool proc_uid_io_available;      // whether uid_io is accessible
+    int task_io_uids;           // number of top uids whose threads are looked at
     bool diskstats_available;   // whether diskstats is accessible
     int event_time_check_usec;  // check how much cputime spent in event loop
 };
@@ -254,6 +340,7 @@ private:
     disk_stats_publisher mDiskStats;
     disk_stats_monitor mDsm;
     uid_monitor mUidm;
+    task_monitor mTaskm;
     time_t mStarttime;
     sp<IBatteryPropertiesRegistrar> battery_properties;
     std::unique_ptr<storage_info_t> storage_info;
@@ -277,6 +364,13 @@ public:
             double hours, uint64_t threshold, bool force_report) {
         return mUidm.dump(hours, threshold, force_report);
     }
+    std::vector<struct uid_record> get_uid_history(
+            double hours, uint64_t threshold, uint64_t* start_ts) {
+        return mUidm.dump_history(hours, threshold, start_ts);
+    }
+    struct task_io_records get_task_records(void) {
+        return mTaskm.dump();
+    }
     void update_uid_io_interval(int interval) {
         if (interval >= DEFAULT_PERIODIC_CHORES_INTERVAL_UID_IO_LIMIT) {
             mConfig.periodic_chores_interval_uid_io = interval;
@@ -295,5 +389,7 @@ public:
 #define EVENTLOGTAG_DISKSTATS ( 2732 )
 #define EVENTLOGTAG_EMMCINFO ( 2733 )
 #define EVENTLOGTAG_UID_IO_ALERT ( 2734 )
+#define EVENTLOGTAG_DISK_LATENCY ( 2735 )
+#define EVENTLOGTAG_DISK_LATENCY_ALERT ( 2736 )
 
 #endif /* _STORAGED_H_ */
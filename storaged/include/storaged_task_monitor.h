@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _STORAGED_TASK_MONITOR_H_
+#define _STORAGED_TASK_MONITOR_H_
+
+#include <semaphore.h>
+#include <stdint.h>
+
+#include <linux/taskstats.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// maximum number of tasks kept from each update
+#define MAX_TASK_IO_RECORDS ( 32 )
+
+// I/O of one thread between two updates
+struct task_io_record {
+    uint32_t uid;
+    uint32_t pid;                   // thread group id
+    uint32_t tid;
+    std::string comm;
+    uint64_t read_bytes;            // bytes read (from storage layer)
+    uint64_t write_bytes;           // bytes written (to storage layer)
+};
+
+struct task_io_records {
+    uint64_t start_ts;
+    uint64_t end_ts;
+    std::vector<struct task_io_record> entries;
+};
+
+// Finds the threads that do the I/O of the apps that do the most, from the per-thread
+// taskstats that the kernel sends over generic netlink. Only the threads of the uids
+// passed to update() are queried, many per system call, so that the cost stays bounded.
+class task_monitor {
+private:
+    // taskstats netlink socket and family, opened on first use
+    int nl_fd;
+    uint16_t family_id;
+    uint32_t seq;
+    // buffer reused by each batch of replies
+    std::vector<uint8_t> reply_buffer;
+    // counters of the last update, tid -> taskstats
+    std::unordered_map<uint32_t, struct taskstats> last_stats;
+    uint64_t last_ts;
+    // tasks of the last update, most I/O first
+    struct task_io_records records;
+    // protects all of the above
+    sem_t tm_lock;
+
+    bool open_locked();
+    bool get_family_id_locked();
+    // queries the taskstats of |tids|, skipping the threads that are gone
+    bool query_locked(const std::vector<uint32_t>& tids,
+                      std::unordered_map<uint32_t, struct taskstats>* stats);
+
+public:
+    task_monitor();
+    ~task_monitor();
+    // called by storaged main thread after each uid I/O report
+    void update(const std::vector<uint32_t>& uids);
+    // called by dumpsys --tasks
+    struct task_io_records dump();
+};
+
+// Lists the threads of all the processes owned by |uids|, as (pid, tid) pairs.
+std::vector<std::pair<uint32_t, uint32_t>> get_uid_tasks(const std::vector<uint32_t>& uids);
+
+#endif /* _STORAGED_TASK_MONITOR_H_ */
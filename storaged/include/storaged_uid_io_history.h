@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _STORAGED_UID_IO_HISTORY_H_
+#define _STORAGED_UID_IO_HISTORY_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "storaged_uid_monitor.h"
+
+#define UID_IO_HISTORY_DIR "/data/misc/storaged"
+
+// Usage of one app in a bucket, as stored on disk
+struct uid_io_history_entry {
+    uint32_t name_id;               // index into the name table, 0 for "other"
+    uint32_t reserved;
+    struct uid_io_usage ios;
+};
+
+// The usage of all apps over one hour or one day
+struct uid_io_history_bucket {
+    uint64_t bucket;                // start time / bucket length, 0 if unused
+    uint64_t start_ts;              // start of the first record added
+    uint64_t end_ts;                // end of the last record added
+    std::vector<struct uid_io_history_entry> entries;
+};
+
+// A ring of buckets of the same length
+struct uid_io_history_tier {
+    uint64_t length;                // seconds per bucket
+    std::vector<struct uid_io_history_bucket> buckets;
+};
+
+// Keeps the uid I/O records across restarts, summed into the hourly buckets of the last two
+// days and the daily buckets of the last month. Each bucket has a fixed-size slot in a file,
+// so adding a record only rewrites the two buckets that it's added to.
+class uid_io_history {
+private:
+    std::string dir;
+    int fd;                         // holds the slots of all tiers
+    int names_fd;                   // holds one name per line, for name ids 1 and up
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint32_t> name_ids;
+    struct uid_io_history_tier tiers[2];
+
+    uint32_t get_name_id(const std::string& name);
+    void add_to_tier(int tier, uint64_t start_ts, uint64_t end_ts,
+                     const std::vector<struct uid_record>& entries);
+    bool write_bucket(int tier, size_t slot);
+    bool load_names();
+    bool load_buckets();
+
+public:
+    uid_io_history();
+    ~uid_io_history();
+    // opens the history in |dir|, creating it if needed
+    bool load(const std::string& dir);
+    // adds a record of the usage from |start_ts| to |end_ts|
+    void add(uint64_t start_ts, uint64_t end_ts, const std::vector<struct uid_record>& entries);
+    // sums the usage of each app over the |hours| before |now|, from the buckets fine enough
+    // for that span, and sets |*start_ts| to the start of the first bucket used
+    std::vector<struct uid_record> query(uint64_t now, double hours, uint64_t* start_ts);
+};
+
+#endif /* _STORAGED_UID_IO_HISTORY_H_ */
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -69,23 +70,42 @@ struct uid_records {
     std::vector<struct uid_record> entries;
 };
 
+class uid_io_history;
+
+// Parses one line of /proc/uid_io/stats, which may end at a '\n' or the end of the string.
+bool parse_uid_io_stats(const char* line, struct uid_info* u);
+
 class uid_monitor {
 private:
-    // last dump from /proc/uid_io/stats, uid -> uid_info
+    // last dump from /proc/uid_io/stats with package names, uid -> uid_info
     std::unordered_map<uint32_t, struct uid_info> last_uid_io_stats;
+    // uids whose names couldn't be looked up yet
+    std::vector<int> unnamed_uids;
+    // /proc/uid_io/stats, kept open between reads
+    int uid_io_fd;
+    // buffers reused by each read of /proc/uid_io/stats
+    std::string uid_io_buffer;
+    std::vector<struct uid_info> uid_io_snapshot;
     // current io usage for next report, app name -> uid_io_usage
     std::unordered_map<std::string, struct uid_io_usage> curr_io_stats;
+    // bytes read and written since the last report, uid -> bytes
+    std::unordered_map<uint32_t, uint64_t> curr_uid_bytes;
+    // uids of the last report, most bytes first
+    std::vector<uint32_t> top_uids;
     // io usage records, end timestamp -> {start timestamp, vector of records}
     std::map<uint64_t, struct uid_records> records;
     // charger ON/OFF
     charger_stat_t charger_stat;
-    // protects curr_io_stats, last_uid_io_stats, records and charger_stat
+    // protects curr_io_stats, curr_uid_bytes, top_uids, last_uid_io_stats, records and
+    // charger_stat
     sem_t um_lock;
     // start time for IO records
     uint64_t start_ts;
+    // records kept across restarts
+    std::unique_ptr<uid_io_history> history;
 
-    // reads from /proc/uid_io/stats
-    std::unordered_map<uint32_t, struct uid_info> get_uid_io_stats_locked();
+    // reads from /proc/uid_io/stats, without names
+    bool read_uid_io_stats_locked(std::vector<struct uid_info>* stats);
     // flushes curr_io_stats to records
     void add_records_locked(uint64_t curr_ts);
     // updates curr_io_stats and set last_uid_io_stats
@@ -101,6 +121,12 @@ public:
     // called by dumpsys
     std::map<uint64_t, struct uid_records> dump(
         double hours, uint64_t threshold, bool force_report);
+    // called by dumpsys --history
+    std::vector<struct uid_record> dump_history(
+        double hours, uint64_t threshold, uint64_t* start_ts);
+    // called by storaged main thread after report(), returns up to |count| uids that did the
+    // most I/O in the last report
+    std::vector<uint32_t> get_top_uids(size_t count);
     // called by battery properties listener
     void set_charger_state(charger_stat_t stat);
     // called by storaged periodic_chore or dump with force_report
@@ -40,5 +40,8 @@ void log_console_running_uids_info(std::vector<struct uid_info> uids);
 void log_debug_disk_perf(struct disk_perf* perf, const char* type);
 
 void log_event_disk_stats(struct disk_stats* stats, const char* type);
+void log_event_disk_latency(latency_histogram* read, latency_histogram* write, const char* type);
+void log_event_disk_latency_alert(const char* type, uint32_t latency, ewma_stats* baseline,
+                                  uint64_t ios);
 void log_event_emmc_info(struct emmc_info* info_);
 #endif /* _STORAGED_UTILS_H_ */
@@ -20,6 +20,8 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 #include <batteryservice/BatteryServiceConstants.h>
 #include <batteryservice/IBatteryPropertiesRegistrar.h>
@@ -31,28 +33,122 @@
 #include <storaged.h>
 #include <storaged_utils.h>
 
+/* latency_histogram */
+uint32_t latency_histogram::bucket(uint32_t value) {
+    if (value < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+    // The top two bits below the leading one pick the bucket within its power of two.
+    uint32_t order = 31 - __builtin_clz(value);
+    uint32_t sub = (value >> (order - 2)) & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1);
+    return (order - 1) * LATENCY_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+uint32_t latency_histogram::bucket_start(uint32_t bucket) {
+    if (bucket < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+    uint32_t order = bucket / LATENCY_HISTOGRAM_SUB_BUCKETS + 1;
+    uint32_t sub = bucket % LATENCY_HISTOGRAM_SUB_BUCKETS;
+    return (LATENCY_HISTOGRAM_SUB_BUCKETS + sub) << (order - 2);
+}
+
+void latency_histogram::add(uint32_t value, uint64_t count) {
+    mBuckets[bucket(value)] += count;
+    mCnt += count;
+}
+
+uint32_t latency_histogram::get_percentile(double percent) {
+    if (mCnt == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percent / 100 * mCnt);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i) {
+        seen += mBuckets[i];
+        if (seen > rank) {
+            // Report the middle of the bucket, halfway to the start of the next one.
+            if (i < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+                return i;
+            }
+            uint32_t start = bucket_start(i);
+            uint32_t next = i + 1 < LATENCY_HISTOGRAM_BUCKETS ? bucket_start(i + 1) : UINT32_MAX;
+            return start + (next - start) / 2;
+        }
+    }
+    return UINT32_MAX;
+}
+
 /* disk_stats_publisher */
 void disk_stats_publisher::publish(void) {
     // Logging
     struct disk_perf perf = get_disk_perf(&mAccumulate);
     log_debug_disk_perf(&perf, "regular");
     log_event_disk_stats(&mAccumulate, "regular");
+    log_event_disk_latency(&mReadLatency, &mWriteLatency, "regular");
     // Reset global structures
     memset(&mAccumulate, 0, sizeof(struct disk_stats));
+    mReadLatency.reset();
+    mWriteLatency.reset();
 }
 
-void disk_stats_publisher::update(void) {
-    struct disk_stats curr;
-    if (parse_disk_stats(DISK_STATS_PATH, &curr)) {
-        struct disk_stats inc = get_inc_disk_stats(&mPrevious, &curr);
-        add_disk_stats(&inc, &mAccumulate);
+bool disk_stats_publisher::detect(ewma_stats* baseline, uint32_t latency) {
+    return baseline->get_count() >= mWarmup &&
+            (double)latency > baseline->get_mean() + mSigma * baseline->get_std();
+}
+
+void disk_stats_publisher::update_latency(struct disk_stats* inc) {
+    // diskstats only has the total time of the requests of an interval, so each request
+    // is counted with the average latency of its interval. Intervals with only a few
+    // requests are too noisy for the baseline.
+    if (inc->read_ios) {
+        uint32_t latency = (uint32_t)std::min<uint64_t>(
+                inc->read_ticks * MSEC_TO_USEC / inc->read_ios, UINT32_MAX);
+        mReadLatency.add(latency, inc->read_ios);
+        if (inc->read_ios >= DISK_LATENCY_MIN_IOS) {
+            bool slow = detect(&mReadBaseline, latency);
+            if (slow && !mReadSlow) {
+                log_event_disk_latency_alert("read", latency, &mReadBaseline, inc->read_ios);
+            }
+            mReadSlow = slow;
+            mReadBaseline.add(latency);
+        }
+    }
+    if (inc->write_ios) {
+        uint32_t latency = (uint32_t)std::min<uint64_t>(
+                inc->write_ticks * MSEC_TO_USEC / inc->write_ios, UINT32_MAX);
+        mWriteLatency.add(latency, inc->write_ios);
+        if (inc->write_ios >= DISK_LATENCY_MIN_IOS) {
+            bool slow = detect(&mWriteBaseline, latency);
+            if (slow && !mWriteSlow) {
+                log_event_disk_latency_alert("write", latency, &mWriteBaseline, inc->write_ios);
+            }
+            mWriteSlow = slow;
+            mWriteBaseline.add(latency);
+        }
+    }
+}
+
+void disk_stats_publisher::update(struct disk_stats* stats) {
+    struct disk_stats inc = get_inc_disk_stats(&mPrevious, stats);
+    add_disk_stats(&inc, &mAccumulate);
 #ifdef DEBUG
 //            log_kernel_disk_stats(&mPrevious, "prev stats");
-//            log_kernel_disk_stats(&curr, "curr stats");
+//            log_kernel_disk_stats(stats, "curr stats");
 //            log_kernel_disk_stats(&inc, "inc stats");
 //            log_kernel_disk_stats(&mAccumulate, "accumulated stats");
 #endif
-        mPrevious = curr;
+    // The first read covers everything since boot, not an interval.
+    if (mPrevious.end_time != 0) {
+        update_latency(&inc);
+    }
+    mPrevious = *stats;
+}
+
+void disk_stats_publisher::update(void) {
+    struct disk_stats curr;
+    if (parse_disk_stats(DISK_STATS_PATH, &curr)) {
+        update(&curr);
     }
 }
 
@@ -226,6 +322,8 @@ storaged_t::storaged_t(void) {
     mConfig.periodic_chores_interval_uid_io =
         property_get_int32("ro.storaged.uid_io.interval", DEFAULT_PERIODIC_CHORES_INTERVAL_UID_IO);
 
+    mConfig.task_io_uids = property_get_int32("ro.storaged.task_io.uids", 0);
+
     storage_info.reset(storage_info_t::get_storage_info());
 
     mStarttime = time(NULL);
@@ -244,6 +342,9 @@ void storaged_t::event(void) {
     if (mConfig.proc_uid_io_available && mTimer &&
             (mTimer % mConfig.periodic_chores_interval_uid_io) == 0) {
          mUidm.report();
+         if (mConfig.task_io_uids > 0) {
+             mTaskm.update(mUidm.get_top_uids(mConfig.task_io_uids));
+         }
     }
 
     mTimer += mConfig.periodic_chores_interval_unit;
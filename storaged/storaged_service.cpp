@@ -15,6 +15,7 @@
  */
 
 #include <stdint.h>
+#include <time.h>
 
 #include <vector>
 
@@ -82,6 +83,19 @@ std::vector<struct uid_info> Storaged::dump_uids(const char* /* option */) {
     return uids_v;
 }
 
+static void dump_uid_record(int fd, const struct uid_record& record) {
+    dprintf(fd, "%s %ju %ju %ju %ju %ju %ju %ju %ju\n",
+        record.name.c_str(),
+        record.ios.bytes[READ][FOREGROUND][CHARGER_OFF],
+        record.ios.bytes[WRITE][FOREGROUND][CHARGER_OFF],
+        record.ios.bytes[READ][BACKGROUND][CHARGER_OFF],
+        record.ios.bytes[WRITE][BACKGROUND][CHARGER_OFF],
+        record.ios.bytes[READ][FOREGROUND][CHARGER_ON],
+        record.ios.bytes[WRITE][FOREGROUND][CHARGER_ON],
+        record.ios.bytes[READ][BACKGROUND][CHARGER_ON],
+        record.ios.bytes[WRITE][BACKGROUND][CHARGER_ON]);
+}
+
 status_t Storaged::dump(int fd, const Vector<String16>& args) {
     IPCThreadState* self = IPCThreadState::self();
     const int pid = self->getCallingPid();
@@ -96,6 +110,8 @@ status_t Storaged::dump(int fd, const Vector<String16>& args) {
     int time_window = 0;
     uint64_t threshold = 0;
     bool force_report = false;
+    bool history = false;
+    bool tasks = false;
     for (size_t i = 0; i < args.size(); i++) {
         const auto& arg = args[i];
         if (arg == String16("--hours")) {
@@ -123,6 +139,39 @@ status_t Storaged::dump(int fd, const Vector<String16>& args) {
             force_report = true;
             continue;
         }
+        if (arg == String16("--history")) {
+            history = true;
+            continue;
+        }
+        if (arg == String16("--tasks")) {
+            tasks = true;
+            continue;
+        }
+    }
+
+    if (history) {
+        // One record per app, summed over the whole span, biggest writers first.
+        uint64_t start_ts;
+        const std::vector<struct uid_record>& records =
+                storaged->get_uid_history(hours, threshold, &start_ts);
+        dprintf(fd, "%llu,%llu\n", (unsigned long long)start_ts,
+                (unsigned long long)time(NULL));
+        for (const auto& record : records) {
+            dump_uid_record(fd, record);
+        }
+        return NO_ERROR;
+    }
+
+    if (tasks) {
+        // The threads that did the most I/O between the last two reports.
+        const struct task_io_records& records = storaged->get_task_records();
+        dprintf(fd, "%llu,%llu\n", (unsigned long long)records.start_ts,
+                (unsigned long long)records.end_ts);
+        for (const auto& record : records.entries) {
+            dprintf(fd, "%u %u %u %s %ju %ju\n", record.uid, record.pid, record.tid,
+                    record.comm.c_str(), record.read_bytes, record.write_bytes);
+        }
+        return NO_ERROR;
     }
 
     uint64_t last_ts = 0;
@@ -136,16 +185,7 @@ status_t Storaged::dump(int fd, const Vector<String16>& args) {
         last_ts = it.first;
 
         for (const auto& record : it.second.entries) {
-            dprintf(fd, "%s %ju %ju %ju %ju %ju %ju %ju %ju\n",
-                record.name.c_str(),
-                record.ios.bytes[READ][FOREGROUND][CHARGER_OFF],
-                record.ios.bytes[WRITE][FOREGROUND][CHARGER_OFF],
-                record.ios.bytes[READ][BACKGROUND][CHARGER_OFF],
-                record.ios.bytes[WRITE][BACKGROUND][CHARGER_OFF],
-                record.ios.bytes[READ][FOREGROUND][CHARGER_ON],
-                record.ios.bytes[WRITE][FOREGROUND][CHARGER_ON],
-                record.ios.bytes[READ][BACKGROUND][CHARGER_ON],
-                record.ios.bytes[WRITE][BACKGROUND][CHARGER_ON]);
+            dump_uid_record(fd, record);
         }
     }
 
@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "storaged"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+
+#include "storaged.h"
+#include "storaged_task_monitor.h"
+
+using namespace android::base;
+
+// Requests sent with one system call. Each reply is a datagram of its own, and a batch of
+// them has to fit in the default receive buffer of the socket.
+static const size_t TASKSTATS_BATCH_SIZE = 32;
+// Room for one reply, with some to spare for the fields that newer kernels add.
+static const size_t TASKSTATS_REPLY_SIZE = 2048;
+// Bounds the cost of an update when the top uids run a lot of threads.
+static const size_t MAX_TASK_QUERIES = 2048;
+
+// Appends a generic netlink request with one attribute to |buf|.
+static void add_request(std::vector<uint8_t>* buf, uint16_t type, uint32_t seq, uint8_t cmd,
+                        uint16_t attr, const void* data, uint16_t len)
+{
+    size_t offset = buf->size();
+    uint32_t size = NLMSG_LENGTH(GENL_HDRLEN + NLA_HDRLEN + len);
+    buf->resize(offset + NLMSG_ALIGN(size));
+
+    struct nlmsghdr* n = (struct nlmsghdr*)(buf->data() + offset);
+    n->nlmsg_len = size;
+    n->nlmsg_type = type;
+    n->nlmsg_flags = NLM_F_REQUEST;
+    n->nlmsg_seq = seq;
+    n->nlmsg_pid = 0;
+
+    struct genlmsghdr* g = (struct genlmsghdr*)NLMSG_DATA(n);
+    g->cmd = cmd;
+    g->version = 1;
+
+    struct nlattr* a = (struct nlattr*)((uint8_t*)g + GENL_HDRLEN);
+    a->nla_type = attr;
+    a->nla_len = NLA_HDRLEN + len;
+    memcpy((uint8_t*)a + NLA_HDRLEN, data, len);
+}
+
+// Calls |fn| with the type, payload and payload length of each attribute in |data|.
+template <typename F>
+static void for_each_attr(const uint8_t* data, size_t len, F fn)
+{
+    while (len >= NLA_HDRLEN) {
+        const struct nlattr* a = (const struct nlattr*)data;
+        if (a->nla_len < NLA_HDRLEN || a->nla_len > len) {
+            return;
+        }
+        fn(a->nla_type & NLA_TYPE_MASK, data + NLA_HDRLEN, a->nla_len - NLA_HDRLEN);
+        size_t aligned = NLA_ALIGN(a->nla_len);
+        if (aligned >= len) {
+            return;
+        }
+        data += aligned;
+        len -= aligned;
+    }
+}
+
+static const uint8_t* genl_attrs(const struct nlmsghdr* n, size_t* len)
+{
+    if (n->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN)) {
+        *len = 0;
+        return nullptr;
+    }
+    *len = n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+    return (const uint8_t*)NLMSG_DATA(n) + GENL_HDRLEN;
+}
+
+static bool parse_taskstats(const struct nlmsghdr* n, struct taskstats* stats)
+{
+    bool found = false;
+    size_t len;
+    const uint8_t* attrs = genl_attrs(n, &len);
+    for_each_attr(attrs, len, [&](uint16_t type, const uint8_t* data, size_t size) {
+        if (type != TASKSTATS_TYPE_AGGR_PID) {
+            return;
+        }
+        for_each_attr(data, size, [&](uint16_t type, const uint8_t* data, size_t size) {
+            if (type == TASKSTATS_TYPE_STATS) {
+                // Older kernels send a shorter struct, newer ones a longer one.
+                memset(stats, 0, sizeof(*stats));
+                memcpy(stats, data, std::min(size, sizeof(*stats)));
+                found = true;
+            }
+        });
+    });
+    return found;
+}
+
+static uint64_t sub_or_zero(uint64_t a, uint64_t b)
+{
+    return a > b ? a - b : 0;
+}
+
+// Counted like /proc/uid_io/stats does, without the writes that were truncated away.
+static uint64_t get_write_bytes(const struct taskstats& stats)
+{
+    return sub_or_zero(stats.write_bytes, stats.cancelled_write_bytes);
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> get_uid_tasks(const std::vector<uint32_t>& uids)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> tasks;
+    if (uids.empty()) {
+        return tasks;
+    }
+
+    std::unique_ptr<DIR, decltype(&closedir)> proc(opendir("/proc"), closedir);
+    if (!proc) {
+        PLOG_TO(SYSTEM, ERROR) << "/proc: opendir failed";
+        return tasks;
+    }
+
+    std::unordered_set<uint32_t> uid_set(uids.begin(), uids.end());
+    while (struct dirent* entry = readdir(proc.get())) {
+        uint32_t pid;
+        struct stat st;
+        // /proc/<pid> belongs to the effective uid of the process.
+        if (!ParseUint(entry->d_name, &pid) ||
+            fstatat(dirfd(proc.get()), entry->d_name, &st, 0) == -1 ||
+            uid_set.count(st.st_uid) == 0) {
+            continue;
+        }
+
+        std::string task_dir = StringPrintf("/proc/%u/task", pid);
+        std::unique_ptr<DIR, decltype(&closedir)> task(opendir(task_dir.c_str()), closedir);
+        if (!task) {
+            // the process is gone
+            continue;
+        }
+        while (struct dirent* t = readdir(task.get())) {
+            uint32_t tid;
+            if (ParseUint(t->d_name, &tid)) {
+                tasks.emplace_back(pid, tid);
+            }
+        }
+    }
+    return tasks;
+}
+
+bool task_monitor::get_family_id_locked()
+{
+    std::vector<uint8_t> request;
+    const char name[] = TASKSTATS_GENL_NAME;
+    add_request(&request, GENL_ID_CTRL, ++seq, CTRL_CMD_GETFAMILY,
+                CTRL_ATTR_FAMILY_NAME, name, sizeof(name));
+    if (TEMP_FAILURE_RETRY(send(nl_fd, request.data(), request.size(), 0)) !=
+            (ssize_t)request.size()) {
+        PLOG_TO(SYSTEM, ERROR) << "taskstats: send failed";
+        return false;
+    }
+
+    ssize_t len = TEMP_FAILURE_RETRY(recv(nl_fd, reply_buffer.data(), reply_buffer.size(), 0));
+    if (len == -1) {
+        PLOG_TO(SYSTEM, ERROR) << "taskstats: recv failed";
+        return false;
+    }
+
+    family_id = 0;
+    const struct nlmsghdr* n = (const struct nlmsghdr*)reply_buffer.data();
+    if (NLMSG_OK(n, (size_t)len) && n->nlmsg_type != NLMSG_ERROR) {
+        size_t attrs_len;
+        const uint8_t* attrs = genl_attrs(n, &attrs_len);
+        for_each_attr(attrs, attrs_len, [this](uint16_t type, const uint8_t* data, size_t size) {
+            if (type == CTRL_ATTR_FAMILY_ID && size >= sizeof(uint16_t)) {
+                memcpy(&family_id, data, sizeof(uint16_t));
+            }
+        });
+    }
+    if (family_id == 0) {
+        LOG_TO(SYSTEM, ERROR) << "taskstats: family not found";
+        return false;
+    }
+    return true;
+}
+
+bool task_monitor::open_locked()
+{
+    if (nl_fd != -1) {
+        return true;
+    }
+
+    nl_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (nl_fd == -1) {
+        PLOG_TO(SYSTEM, ERROR) << "taskstats: socket failed";
+        return false;
+    }
+
+    // A reply that never comes mustn't stall the main thread.
+    struct timeval timeout = { 1, 0 };
+    reply_buffer.resize(TASKSTATS_BATCH_SIZE * TASKSTATS_REPLY_SIZE);
+    if (setsockopt(nl_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1 ||
+        !get_family_id_locked()) {
+        close(nl_fd);
+        nl_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool task_monitor::query_locked(const std::vector<uint32_t>& tids,
+                                std::unordered_map<uint32_t, struct taskstats>* stats)
+{
+    std::vector<uint8_t> request;
+    struct mmsghdr msgs[TASKSTATS_BATCH_SIZE];
+    struct iovec iovs[TASKSTATS_BATCH_SIZE];
+
+    for (size_t i = 0; i < tids.size(); i += TASKSTATS_BATCH_SIZE) {
+        size_t count = std::min(TASKSTATS_BATCH_SIZE, tids.size() - i);
+        uint32_t first_seq = seq + 1;
+        request.clear();
+        for (size_t j = 0; j < count; j++) {
+            add_request(&request, family_id, ++seq, TASKSTATS_CMD_GET,
+                        TASKSTATS_CMD_ATTR_PID, &tids[i + j], sizeof(uint32_t));
+        }
+
+        bool ok = TEMP_FAILURE_RETRY(send(nl_fd, request.data(), request.size(), 0)) ==
+                (ssize_t)request.size();
+        if (!ok) {
+            PLOG_TO(SYSTEM, ERROR) << "taskstats: send failed";
+        }
+
+        // Each request gets a reply, or an error if the thread is gone.
+        size_t answered = 0;
+        while (ok && answered < count) {
+            size_t left = count - answered;
+            for (size_t k = 0; k < left; k++) {
+                iovs[k].iov_base = reply_buffer.data() + k * TASKSTATS_REPLY_SIZE;
+                iovs[k].iov_len = TASKSTATS_REPLY_SIZE;
+                memset(&msgs[k], 0, sizeof(msgs[k]));
+                msgs[k].msg_hdr.msg_iov = &iovs[k];
+                msgs[k].msg_hdr.msg_iovlen = 1;
+            }
+            int received = TEMP_FAILURE_RETRY(recvmmsg(nl_fd, msgs, left, MSG_WAITFORONE,
+                                                       nullptr));
+            if (received <= 0) {
+                PLOG_TO(SYSTEM, ERROR) << "taskstats: recvmmsg failed";
+                ok = false;
+                break;
+            }
+
+            for (int k = 0; k < received; k++) {
+                const struct nlmsghdr* n = (const struct nlmsghdr*)iovs[k].iov_base;
+                size_t len = std::min<size_t>(msgs[k].msg_len, TASKSTATS_REPLY_SIZE);
+                for (; NLMSG_OK(n, len); n = NLMSG_NEXT(n, len)) {
+                    if (n->nlmsg_seq < first_seq || n->nlmsg_seq >= first_seq + count) {
+                        continue;
+                    }
+                    answered++;
+                    struct taskstats ts;
+                    if (n->nlmsg_type == family_id && parse_taskstats(n, &ts)) {
+                        (*stats)[tids[i + n->nlmsg_seq - first_seq]] = ts;
+                    }
+                }
+            }
+        }
+
+        if (!ok) {
+            // Replies still on their way would be mistaken for those of the next batch.
+            close(nl_fd);
+            nl_fd = -1;
+            return false;
+        }
+    }
+    return true;
+}
+
+void task_monitor::update(const std::vector<uint32_t>& uids)
+{
+    std::unique_ptr<lock_t> lock(new lock_t(&tm_lock));
+
+    uint64_t curr_ts = time(NULL);
+    std::vector<std::pair<uint32_t, uint32_t>> tasks = get_uid_tasks(uids);
+    if (tasks.size() > MAX_TASK_QUERIES) {
+        tasks.resize(MAX_TASK_QUERIES);
+    }
+
+    std::vector<uint32_t> tids;
+    std::unordered_map<uint32_t, uint32_t> pids;
+    for (const auto& task : tasks) {
+        tids.push_back(task.second);
+        pids[task.second] = task.first;
+    }
+
+    std::unordered_map<uint32_t, struct taskstats> curr_stats;
+    if (!tids.empty() && (!open_locked() || !query_locked(tids, &curr_stats))) {
+        return;
+    }
+
+    records.entries.clear();
+    for (const auto& it : curr_stats) {
+        const struct taskstats& curr = it.second;
+        struct task_io_record record = {};
+        auto last = last_stats.find(it.first);
+        if (last != last_stats.end() && last->second.ac_btime == curr.ac_btime) {
+            record.read_bytes = sub_or_zero(curr.read_bytes, last->second.read_bytes);
+            record.write_bytes = sub_or_zero(get_write_bytes(curr), get_write_bytes(last->second));
+        } else if (last_ts != 0 && curr.ac_btime >= last_ts) {
+            // started since the last update
+            record.read_bytes = curr.read_bytes;
+            record.write_bytes = get_write_bytes(curr);
+        } else {
+            // first seen, this update is its baseline
+            continue;
+        }
+        if (record.read_bytes == 0 && record.write_bytes == 0) {
+            continue;
+        }
+
+        record.uid = curr.ac_uid;
+        record.pid = pids[it.first];
+        record.tid = it.first;
+        record.comm.assign(curr.ac_comm, strnlen(curr.ac_comm, sizeof(curr.ac_comm)));
+        records.entries.push_back(record);
+    }
+
+    std::sort(records.entries.begin(), records.entries.end(),
+        [](const struct task_io_record& l, const struct task_io_record& r) {
+            return l.read_bytes + l.write_bytes > r.read_bytes + r.write_bytes;
+        });
+    if (records.entries.size() > MAX_TASK_IO_RECORDS) {
+        records.entries.resize(MAX_TASK_IO_RECORDS);
+    }
+    records.start_ts = last_ts;
+    records.end_ts = curr_ts;
+
+    last_stats.swap(curr_stats);
+    last_ts = curr_ts;
+}
+
+struct task_io_records task_monitor::dump()
+{
+    std::unique_ptr<lock_t> lock(new lock_t(&tm_lock));
+    return records;
+}
+
+task_monitor::task_monitor() : nl_fd(-1), family_id(0), seq(0), last_ts(0)
+{
+    records.start_ts = 0;
+    records.end_ts = 0;
+    sem_init(&tm_lock, 0, 1);
+}
+
+task_monitor::~task_monitor()
+{
+    if (nl_fd != -1) {
+        close(nl_fd);
+    }
+    sem_destroy(&tm_lock);
+}
@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "storaged"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+
+#include "storaged_uid_io_history.h"
+
+using namespace android::base;
+
+// The file starts with a header, followed by a fixed-size slot for each bucket of each tier.
+// A slot holds a header with a checksum, then up to MAX_BUCKET_ENTRIES entries.
+static const uint32_t HISTORY_MAGIC = 0x53494f55;  // "UOIS"
+static const uint32_t HISTORY_VERSION = 1;
+static const uint64_t HISTORY_HEADER_SIZE = 64;
+static const size_t MAX_BUCKET_ENTRIES = 256;
+
+static const uint64_t TIER_LENGTH[] = { 3600, 24 * 3600 };
+static const size_t TIER_BUCKETS[] = { 48, 31 };
+
+struct history_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t buckets[2];
+    uint32_t max_entries;
+};
+
+struct slot_header {
+    uint32_t checksum;              // of the rest of the slot, up to the last entry
+    uint32_t count;
+    uint64_t bucket;
+    uint64_t start_ts;
+    uint64_t end_ts;
+};
+
+static const uint64_t SLOT_SIZE =
+    sizeof(struct slot_header) + MAX_BUCKET_ENTRIES * sizeof(struct uid_io_history_entry);
+
+// FNV-1a, which is enough to catch a slot torn by a crash.
+static uint32_t checksum(const uint8_t* data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint64_t slot_offset(int tier, size_t slot)
+{
+    size_t index = tier == 0 ? slot : TIER_BUCKETS[0] + slot;
+    return HISTORY_HEADER_SIZE + index * SLOT_SIZE;
+}
+
+static void add_usage(struct uid_io_usage* to, const struct uid_io_usage& from)
+{
+    for (int i = 0; i < IO_TYPES; i++) {
+        for (int j = 0; j < UID_STATS; j++) {
+            for (int k = 0; k < CHARGER_STATS; k++) {
+                to->bytes[i][j][k] += from.bytes[i][j][k];
+            }
+        }
+    }
+}
+
+uid_io_history::uid_io_history() : fd(-1), names_fd(-1), names(1, "other")
+{
+    for (int tier = 0; tier < 2; tier++) {
+        tiers[tier].length = TIER_LENGTH[tier];
+        tiers[tier].buckets.resize(TIER_BUCKETS[tier]);
+    }
+}
+
+uid_io_history::~uid_io_history()
+{
+    if (fd != -1) {
+        close(fd);
+    }
+    if (names_fd != -1) {
+        close(names_fd);
+    }
+}
+
+bool uid_io_history::load_names()
+{
+    std::string path = dir + "/uid_io_names";
+    names_fd = TEMP_FAILURE_RETRY(open(path.c_str(),
+                                       O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600));
+    std::string content;
+    if (names_fd == -1 || !ReadFdToString(names_fd, &content)) {
+        PLOG_TO(SYSTEM, ERROR) << path << ": open failed";
+        return false;
+    }
+
+    // A name that was cut short by a crash is dropped, along with its id.
+    size_t end = content.rfind('\n');
+    end = end == std::string::npos ? 0 : end + 1;
+    if (end != content.size() && ftruncate(names_fd, end) == -1) {
+        PLOG_TO(SYSTEM, ERROR) << path << ": ftruncate failed";
+        return false;
+    }
+
+    names.assign(1, "other");
+    name_ids.clear();
+    for (size_t pos = 0; pos < end;) {
+        size_t next = content.find('\n', pos);
+        std::string name = content.substr(pos, next - pos);
+        name_ids[name] = names.size();
+        names.push_back(name);
+        pos = next + 1;
+    }
+    return true;
+}
+
+bool uid_io_history::load_buckets()
+{
+    std::string path = dir + "/uid_io_history";
+    fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600));
+    if (fd == -1) {
+        PLOG_TO(SYSTEM, ERROR) << path << ": open failed";
+        return false;
+    }
+
+    struct history_header header = {};
+    struct history_header expected = {
+        HISTORY_MAGIC, HISTORY_VERSION,
+        { (uint32_t)TIER_BUCKETS[0], (uint32_t)TIER_BUCKETS[1] },
+        (uint32_t)MAX_BUCKET_ENTRIES,
+    };
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(&header, &expected, sizeof(header))) {
+        // New, or laid out differently: start over.
+        if (ftruncate(fd, 0) == -1 ||
+            pwrite(fd, &expected, sizeof(expected), 0) != sizeof(expected)) {
+            PLOG_TO(SYSTEM, ERROR) << path << ": initialization failed";
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<uint8_t> slot(SLOT_SIZE);
+    for (int tier = 0; tier < 2; tier++) {
+        for (size_t i = 0; i < TIER_BUCKETS[tier]; i++) {
+            ssize_t len = pread(fd, slot.data(), SLOT_SIZE, slot_offset(tier, i));
+            if (len < (ssize_t)sizeof(struct slot_header)) {
+                continue;
+            }
+            struct slot_header h;
+            memcpy(&h, slot.data(), sizeof(h));
+            size_t size = sizeof(h) + h.count * sizeof(struct uid_io_history_entry);
+            if (h.bucket == 0 || h.count > MAX_BUCKET_ENTRIES || size > (size_t)len ||
+                h.checksum != checksum(slot.data() + sizeof(h.checksum),
+                                       size - sizeof(h.checksum))) {
+                continue;
+            }
+
+            struct uid_io_history_bucket& b = tiers[tier].buckets[i];
+            b.bucket = h.bucket;
+            b.start_ts = h.start_ts;
+            b.end_ts = h.end_ts;
+            b.entries.resize(h.count);
+            memcpy(b.entries.data(), slot.data() + sizeof(h),
+                   h.count * sizeof(struct uid_io_history_entry));
+            for (auto& entry : b.entries) {
+                if (entry.name_id >= names.size()) {
+                    entry.name_id = 0;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool uid_io_history::load(const std::string& history_dir)
+{
+    dir = history_dir;
+    return load_names() && load_buckets();
+}
+
+uint32_t uid_io_history::get_name_id(const std::string& name)
+{
+    auto it = name_ids.find(name);
+    if (it != name_ids.end()) {
+        return it->second;
+    }
+
+    std::string line = name + "\n";
+    if (names_fd == -1 || name.find('\n') != std::string::npos ||
+        !WriteFully(names_fd, line.data(), line.size())) {
+        return 0;
+    }
+    uint32_t id = names.size();
+    names.push_back(name);
+    name_ids[name] = id;
+    return id;
+}
+
+bool uid_io_history::write_bucket(int tier, size_t slot)
+{
+    if (fd == -1) {
+        return false;
+    }
+
+    const struct uid_io_history_bucket& b = tiers[tier].buckets[slot];
+    struct slot_header h = {};
+    h.count = b.entries.size();
+    h.bucket = b.bucket;
+    h.start_ts = b.start_ts;
+    h.end_ts = b.end_ts;
+
+    std::vector<uint8_t> data(sizeof(h) + h.count * sizeof(struct uid_io_history_entry));
+    memcpy(data.data(), &h, sizeof(h));
+    memcpy(data.data() + sizeof(h), b.entries.data(),
+           h.count * sizeof(struct uid_io_history_entry));
+    h.checksum = checksum(data.data() + sizeof(h.checksum), data.size() - sizeof(h.checksum));
+    memcpy(data.data(), &h.checksum, sizeof(h.checksum));
+
+    if (pwrite(fd, data.data(), data.size(), slot_offset(tier, slot)) != (ssize_t)data.size()) {
+        PLOG_TO(SYSTEM, ERROR) << "uid_io_history: write failed";
+        return false;
+    }
+    return true;
+}
+
+void uid_io_history::add_to_tier(int tier, uint64_t start_ts, uint64_t end_ts,
+                                 const std::vector<struct uid_record>& entries)
+{
+    struct uid_io_history_tier& t = tiers[tier];
+    // Bucket numbers start at 1, so that 0 can mean unused.
+    uint64_t bucket = (end_ts - 1) / t.length + 1;
+    size_t slot = bucket % t.buckets.size();
+    struct uid_io_history_bucket& b = t.buckets[slot];
+
+    if (b.bucket > bucket) {
+        // The clock went back; don't overwrite newer history.
+        return;
+    }
+    if (b.bucket != bucket) {
+        b.bucket = bucket;
+        b.start_ts = start_ts;
+        b.entries.clear();
+    }
+    b.end_ts = end_ts;
+
+    for (const auto& record : entries) {
+        uint32_t id = get_name_id(record.name);
+        auto it = std::find_if(b.entries.begin(), b.entries.end(),
+            [id](const struct uid_io_history_entry& e) { return e.name_id == id; });
+        if (it == b.entries.end()) {
+            // Apps beyond what fits in a slot are summed up as "other", which always fits.
+            if (id != 0 && b.entries.size() >= MAX_BUCKET_ENTRIES - 1) {
+                id = 0;
+                it = std::find_if(b.entries.begin(), b.entries.end(),
+                    [](const struct uid_io_history_entry& e) { return e.name_id == 0; });
+            }
+            if (it == b.entries.end()) {
+                struct uid_io_history_entry entry = {};
+                entry.name_id = id;
+                b.entries.push_back(entry);
+                it = b.entries.end() - 1;
+            }
+        }
+        add_usage(&it->ios, record.ios);
+    }
+
+    write_bucket(tier, slot);
+}
+
+void uid_io_history::add(uint64_t start_ts, uint64_t end_ts,
+                         const std::vector<struct uid_record>& entries)
+{
+    if (end_ts == 0 || entries.empty()) {
+        return;
+    }
+
+    for (int tier = 0; tier < 2; tier++) {
+        add_to_tier(tier, start_ts, end_ts, entries);
+    }
+    if (fd != -1 && fdatasync(fd) == -1) {
+        PLOG_TO(SYSTEM, ERROR) << "uid_io_history: fdatasync failed";
+    }
+}
+
+std::vector<struct uid_record> uid_io_history::query(uint64_t now, double hours,
+                                                     uint64_t* start_ts)
+{
+    // Hourly buckets are used when they cover the whole span, daily buckets otherwise.
+    uint64_t span = hours * 3600;
+    const struct uid_io_history_tier& t =
+        (hours > 0 && span <= TIER_BUCKETS[0] * TIER_LENGTH[0]) ? tiers[0] : tiers[1];
+    uint64_t first_bucket = (hours > 0 && now > span) ? (now - span) / t.length + 1 : 1;
+    uint64_t last_bucket = now / t.length + 1;
+
+    std::unordered_map<uint32_t, struct uid_io_usage> usage;
+    *start_ts = now;
+    for (const auto& b : t.buckets) {
+        if (b.bucket < first_bucket || b.bucket > last_bucket) {
+            continue;
+        }
+        *start_ts = std::min(*start_ts, b.start_ts);
+        for (const auto& entry : b.entries) {
+            add_usage(&usage[entry.name_id], entry.ios);
+        }
+    }
+
+    std::vector<struct uid_record> records;
+    for (const auto& it : usage) {
+        struct uid_record record;
+        record.name = names[it.first];
+        record.ios = it.second;
+        records.push_back(record);
+    }
+    return records;
+}
@@ -16,11 +16,18 @@
 
 #define LOG_TAG "storaged"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <android/content/pm/IPackageManagerNative.h>
 #include <android-base/file.h>
@@ -33,104 +40,145 @@
 #include <log/log_event_list.h>
 
 #include "storaged.h"
+#include "storaged_uid_io_history.h"
 #include "storaged_uid_monitor.h"
 
 using namespace android;
 using namespace android::base;
 using namespace android::content::pm;
 
-static bool refresh_uid_names;
-
-std::unordered_map<uint32_t, struct uid_info> uid_monitor::get_uid_io_stats()
-{
-    std::unique_ptr<lock_t> lock(new lock_t(&um_lock));
-    return get_uid_io_stats_locked();
-};
-
-static void get_uid_names(const vector<int>& uids, const vector<std::string*>& uid_names)
+static bool get_uid_names(const vector<int>& uids, std::vector<std::string>* names)
 {
     sp<IServiceManager> sm = defaultServiceManager();
     if (sm == NULL) {
         LOG_TO(SYSTEM, ERROR) << "defaultServiceManager failed";
-        return;
+        return false;
     }
 
     sp<IBinder> binder = sm->getService(String16("package_native"));
     if (binder == NULL) {
         LOG_TO(SYSTEM, ERROR) << "getService package_native failed";
-        return;
+        return false;
     }
 
     sp<IPackageManagerNative> package_mgr = interface_cast<IPackageManagerNative>(binder);
-    std::vector<std::string> names;
-    binder::Status status = package_mgr->getNamesForUids(uids, &names);
+    binder::Status status = package_mgr->getNamesForUids(uids, names);
     if (!status.isOk()) {
         LOG_TO(SYSTEM, ERROR) << "package_native::getNamesForUids failed: "
                               << status.exceptionMessage();
-        return;
+        return false;
     }
-
-    for (uint32_t i = 0; i < uid_names.size(); i++) {
-        if (!names[i].empty()) {
-            *uid_names[i] = names[i];
-        }
+    if (names->size() != uids.size()) {
+        LOG_TO(SYSTEM, ERROR) << "package_native::getNamesForUids returned "
+                              << names->size() << " names for " << uids.size() << " uids";
+        return false;
     }
-
-    refresh_uid_names = false;
+    return true;
 }
 
-std::unordered_map<uint32_t, struct uid_info> uid_monitor::get_uid_io_stats_locked()
+std::unordered_map<uint32_t, struct uid_info> uid_monitor::get_uid_io_stats()
 {
+    std::unique_ptr<lock_t> lock(new lock_t(&um_lock));
+
     std::unordered_map<uint32_t, struct uid_info> uid_io_stats;
-    std::string buffer;
-    if (!ReadFileToString(UID_IO_STATS_PATH, &buffer)) {
-        PLOG_TO(SYSTEM, ERROR) << UID_IO_STATS_PATH << ": ReadFileToString failed";
+    if (!read_uid_io_stats_locked(&uid_io_snapshot)) {
         return uid_io_stats;
     }
 
-    std::vector<std::string> io_stats = Split(buffer, "\n");
-    struct uid_info u;
     vector<int> uids;
-    vector<std::string*> uid_names;
-
-    for (uint32_t i = 0; i < io_stats.size(); i++) {
-        if (io_stats[i].empty()) {
-            continue;
+    for (const auto& u : uid_io_snapshot) {
+        struct uid_info& info = uid_io_stats[u.uid];
+        info = u;
+        auto last = last_uid_io_stats.find(u.uid);
+        if (last != last_uid_io_stats.end()) {
+            info.name = last->second.name;
+        } else {
+            info.name = std::to_string(u.uid);
+            uids.push_back(u.uid);
         }
-        std::vector<std::string> fields = Split(io_stats[i], " ");
-        if (fields.size() < 11 ||
-            !ParseUint(fields[0],  &u.uid) ||
-            !ParseUint(fields[1],  &u.io[FOREGROUND].rchar) ||
-            !ParseUint(fields[2],  &u.io[FOREGROUND].wchar) ||
-            !ParseUint(fields[3],  &u.io[FOREGROUND].read_bytes) ||
-            !ParseUint(fields[4],  &u.io[FOREGROUND].write_bytes) ||
-            !ParseUint(fields[5],  &u.io[BACKGROUND].rchar) ||
-            !ParseUint(fields[6],  &u.io[BACKGROUND].wchar) ||
-            !ParseUint(fields[7],  &u.io[BACKGROUND].read_bytes) ||
-            !ParseUint(fields[8],  &u.io[BACKGROUND].write_bytes) ||
-            !ParseUint(fields[9],  &u.io[FOREGROUND].fsync) ||
-            !ParseUint(fields[10], &u.io[BACKGROUND].fsync)) {
-            LOG_TO(SYSTEM, WARNING) << "Invalid I/O stats: \""
-                                    << io_stats[i] << "\"";
-            continue;
+    }
+
+    std::vector<std::string> names;
+    if (!uids.empty() && get_uid_names(uids, &names)) {
+        for (size_t i = 0; i < uids.size(); i++) {
+            if (!names[i].empty()) {
+                uid_io_stats[uids[i]].name = names[i];
+            }
         }
+    }
+    return uid_io_stats;
+}
 
-        uid_io_stats[u.uid] = u;
-        uid_io_stats[u.uid].name = std::to_string(u.uid);
-        uids.push_back(u.uid);
-        uid_names.push_back(&uid_io_stats[u.uid].name);
-        if (last_uid_io_stats.find(u.uid) == last_uid_io_stats.end()) {
-            refresh_uid_names = true;
+bool parse_uid_io_stats(const char* line, struct uid_info* u)
+{
+    uint64_t* fields[] = {
+        nullptr,
+        &u->io[FOREGROUND].rchar, &u->io[FOREGROUND].wchar,
+        &u->io[FOREGROUND].read_bytes, &u->io[FOREGROUND].write_bytes,
+        &u->io[BACKGROUND].rchar, &u->io[BACKGROUND].wchar,
+        &u->io[BACKGROUND].read_bytes, &u->io[BACKGROUND].write_bytes,
+        &u->io[FOREGROUND].fsync, &u->io[BACKGROUND].fsync,
+    };
+
+    for (size_t i = 0; i < arraysize(fields); i++) {
+        if (*line < '0' || *line > '9') {
+            return false;
+        }
+        char* end;
+        errno = 0;
+        unsigned long long value = strtoull(line, &end, 10);
+        if (errno != 0 || (*end != ' ' && *end != '\n' && *end != '\0')) {
+            return false;
+        }
+        if (i == 0) {
+            if (value > UINT32_MAX) {
+                return false;
+            }
+            u->uid = value;
         } else {
-            uid_io_stats[u.uid].name = last_uid_io_stats[u.uid].name;
+            *fields[i] = value;
+        }
+        line = end;
+        while (*line == ' ') {
+            line++;
         }
     }
+    return true;
+}
 
-    if (!uids.empty() && refresh_uid_names) {
-        get_uid_names(uids, uid_names);
+bool uid_monitor::read_uid_io_stats_locked(std::vector<struct uid_info>* stats)
+{
+    stats->clear();
+
+    // Reading from the start again makes the kernel generate a new snapshot.
+    if (uid_io_fd == -1) {
+        uid_io_fd = TEMP_FAILURE_RETRY(open(UID_IO_STATS_PATH, O_RDONLY | O_CLOEXEC));
+    }
+    if (uid_io_fd == -1 || lseek(uid_io_fd, 0, SEEK_SET) == -1 ||
+        !ReadFdToString(uid_io_fd, &uid_io_buffer)) {
+        PLOG_TO(SYSTEM, ERROR) << UID_IO_STATS_PATH << ": read failed";
+        if (uid_io_fd != -1) {
+            close(uid_io_fd);
+            uid_io_fd = -1;
+        }
+        return false;
     }
 
-    return uid_io_stats;
+    struct uid_info u;
+    const char* line = uid_io_buffer.c_str();
+    while (*line != '\0') {
+        const char* end = strchrnul(line, '\n');
+        if (end != line) {
+            if (parse_uid_io_stats(line, &u)) {
+                stats->push_back(u);
+            } else {
+                LOG_TO(SYSTEM, WARNING) << "Invalid I/O stats: \""
+                                        << std::string(line, end - line) << "\"";
+            }
+        }
+        line = *end == '\n' ? end + 1 : end;
+    }
+    return true;
 }
 
 static const int MAX_UID_RECORDS_SIZE = 1000 * 48; // 1000 uids in 48 hours
@@ -169,6 +217,17 @@ void uid_monitor::add_records_locked(uint64_t curr_ts)
     new_records.start_ts = start_ts;
     start_ts = curr_ts;
 
+    std::vector<std::pair<uint64_t, uint32_t>> uid_bytes;
+    for (const auto& it : curr_uid_bytes) {
+        uid_bytes.emplace_back(it.second, it.first);
+    }
+    std::sort(uid_bytes.rbegin(), uid_bytes.rend());
+    top_uids.clear();
+    for (const auto& it : uid_bytes) {
+        top_uids.push_back(it.second);
+    }
+    curr_uid_bytes.clear();
+
     if (new_records.entries.empty())
       return;
 
@@ -182,6 +241,19 @@ void uid_monitor::add_records_locked(uint64_t curr_ts)
     }
 
     records[curr_ts] = new_records;
+    history->add(new_records.start_ts, curr_ts, new_records.entries);
+}
+
+static inline uint64_t total_bytes(const struct uid_io_usage& ios)
+{
+    return ios.bytes[READ][FOREGROUND][CHARGER_ON] +
+           ios.bytes[READ][FOREGROUND][CHARGER_OFF] +
+           ios.bytes[READ][BACKGROUND][CHARGER_ON] +
+           ios.bytes[READ][BACKGROUND][CHARGER_OFF] +
+           ios.bytes[WRITE][FOREGROUND][CHARGER_ON] +
+           ios.bytes[WRITE][FOREGROUND][CHARGER_OFF] +
+           ios.bytes[WRITE][BACKGROUND][CHARGER_ON] +
+           ios.bytes[WRITE][BACKGROUND][CHARGER_OFF];
 }
 
 std::map<uint64_t, struct uid_records> uid_monitor::dump(
@@ -205,14 +277,7 @@ std::map<uint64_t, struct uid_records> uid_monitor::dump(
         struct uid_records filtered;
 
         for (const auto& rec : recs) {
-            if (rec.ios.bytes[READ][FOREGROUND][CHARGER_ON] +
-                rec.ios.bytes[READ][FOREGROUND][CHARGER_OFF] +
-                rec.ios.bytes[READ][BACKGROUND][CHARGER_ON] +
-                rec.ios.bytes[READ][BACKGROUND][CHARGER_OFF] +
-                rec.ios.bytes[WRITE][FOREGROUND][CHARGER_ON] +
-                rec.ios.bytes[WRITE][FOREGROUND][CHARGER_OFF] +
-                rec.ios.bytes[WRITE][BACKGROUND][CHARGER_ON] +
-                rec.ios.bytes[WRITE][BACKGROUND][CHARGER_OFF] > threshold) {
+            if (total_bytes(rec.ios) > threshold) {
                 filtered.entries.push_back(rec);
             }
         }
@@ -228,31 +293,86 @@ std::map<uint64_t, struct uid_records> uid_monitor::dump(
     return dump_records;
 }
 
+std::vector<struct uid_record> uid_monitor::dump_history(
+    double hours, uint64_t threshold, uint64_t* first_ts)
+{
+    std::unique_ptr<lock_t> lock(new lock_t(&um_lock));
+
+    std::vector<struct uid_record> history_records =
+        history->query(time(NULL), hours, first_ts);
+    history_records.erase(
+        std::remove_if(history_records.begin(), history_records.end(),
+            [threshold](const struct uid_record& rec) {
+                return total_bytes(rec.ios) <= threshold;
+            }),
+        history_records.end());
+
+    // Biggest writers first.
+    std::sort(history_records.begin(), history_records.end(),
+        [](const struct uid_record& a, const struct uid_record& b) {
+            uint64_t a_wr = a.ios.bytes[WRITE][FOREGROUND][CHARGER_ON] +
+                            a.ios.bytes[WRITE][FOREGROUND][CHARGER_OFF] +
+                            a.ios.bytes[WRITE][BACKGROUND][CHARGER_ON] +
+                            a.ios.bytes[WRITE][BACKGROUND][CHARGER_OFF];
+            uint64_t b_wr = b.ios.bytes[WRITE][FOREGROUND][CHARGER_ON] +
+                            b.ios.bytes[WRITE][FOREGROUND][CHARGER_OFF] +
+                            b.ios.bytes[WRITE][BACKGROUND][CHARGER_ON] +
+                            b.ios.bytes[WRITE][BACKGROUND][CHARGER_OFF];
+            return a_wr > b_wr;
+        });
+    return history_records;
+}
+
 void uid_monitor::update_curr_io_stats_locked()
 {
-    std::unordered_map<uint32_t, struct uid_info> uid_io_stats =
-        get_uid_io_stats_locked();
-    if (uid_io_stats.empty()) {
+    if (!read_uid_io_stats_locked(&uid_io_snapshot)) {
         return;
     }
 
-    for (const auto& it : uid_io_stats) {
-        const struct uid_info& uid = it.second;
+    // Only uids that appeared since the last read need a name from the package manager.
+    for (const auto& u : uid_io_snapshot) {
+        if (last_uid_io_stats.find(u.uid) == last_uid_io_stats.end()) {
+            struct uid_info& info = last_uid_io_stats[u.uid];
+            info.uid = u.uid;
+            info.name = std::to_string(u.uid);
+            unnamed_uids.push_back(u.uid);
+        }
+    }
+
+    std::vector<std::string> names;
+    if (!unnamed_uids.empty() && get_uid_names(unnamed_uids, &names)) {
+        for (size_t i = 0; i < unnamed_uids.size(); i++) {
+            auto it = last_uid_io_stats.find(unnamed_uids[i]);
+            if (it != last_uid_io_stats.end() && !names[i].empty()) {
+                it->second.name = names[i];
+            }
+        }
+        unnamed_uids.clear();
+    }
 
-        if (curr_io_stats.find(uid.name) == curr_io_stats.end()) {
-          curr_io_stats[uid.name] = {};
+    for (const auto& u : uid_io_snapshot) {
+        struct uid_info& last = last_uid_io_stats[u.uid];
+
+        int64_t fg_rd_delta = u.io[FOREGROUND].read_bytes -
+            last.io[FOREGROUND].read_bytes;
+        int64_t bg_rd_delta = u.io[BACKGROUND].read_bytes -
+            last.io[BACKGROUND].read_bytes;
+        int64_t fg_wr_delta = u.io[FOREGROUND].write_bytes -
+            last.io[FOREGROUND].write_bytes;
+        int64_t bg_wr_delta = u.io[BACKGROUND].write_bytes -
+            last.io[BACKGROUND].write_bytes;
+        memcpy(last.io, u.io, sizeof(last.io));
+
+        // Most uids don't do any I/O between two reads.
+        if (fg_rd_delta <= 0 && bg_rd_delta <= 0 && fg_wr_delta <= 0 && bg_wr_delta <= 0) {
+            continue;
         }
 
-        struct uid_io_usage& usage = curr_io_stats[uid.name];
-        int64_t fg_rd_delta = uid.io[FOREGROUND].read_bytes -
-            last_uid_io_stats[uid.uid].io[FOREGROUND].read_bytes;
-        int64_t bg_rd_delta = uid.io[BACKGROUND].read_bytes -
-            last_uid_io_stats[uid.uid].io[BACKGROUND].read_bytes;
-        int64_t fg_wr_delta = uid.io[FOREGROUND].write_bytes -
-            last_uid_io_stats[uid.uid].io[FOREGROUND].write_bytes;
-        int64_t bg_wr_delta = uid.io[BACKGROUND].write_bytes -
-            last_uid_io_stats[uid.uid].io[BACKGROUND].write_bytes;
+        curr_uid_bytes[u.uid] +=
+            std::max<int64_t>(fg_rd_delta, 0) + std::max<int64_t>(bg_rd_delta, 0) +
+            std::max<int64_t>(fg_wr_delta, 0) + std::max<int64_t>(bg_wr_delta, 0);
 
+        struct uid_io_usage& usage = curr_io_stats[last.name];
         usage.bytes[READ][FOREGROUND][charger_stat] +=
             (fg_rd_delta < 0) ? 0 : fg_rd_delta;
         usage.bytes[READ][BACKGROUND][charger_stat] +=
@@ -263,7 +383,20 @@ void uid_monitor::update_curr_io_stats_locked()
             (bg_wr_delta < 0) ? 0 : bg_wr_delta;
     }
 
-    last_uid_io_stats = uid_io_stats;
+    // Forget the uids that are gone, which only happens when packages are uninstalled.
+    if (last_uid_io_stats.size() > uid_io_snapshot.size()) {
+        std::unordered_set<uint32_t> uids;
+        for (const auto& u : uid_io_snapshot) {
+            uids.insert(u.uid);
+        }
+        for (auto it = last_uid_io_stats.begin(); it != last_uid_io_stats.end();) {
+            if (uids.count(it->first) == 0) {
+                it = last_uid_io_stats.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
 }
 
 void uid_monitor::report()
@@ -274,6 +407,14 @@ void uid_monitor::report()
     add_records_locked(time(NULL));
 }
 
+std::vector<uint32_t> uid_monitor::get_top_uids(size_t count)
+{
+    std::unique_ptr<lock_t> lock(new lock_t(&um_lock));
+
+    return std::vector<uint32_t>(top_uids.begin(),
+                                 top_uids.begin() + std::min(count, top_uids.size()));
+}
+
 void uid_monitor::set_charger_state(charger_stat_t stat)
 {
     std::unique_ptr<lock_t> lock(new lock_t(&um_lock));
@@ -290,15 +431,24 @@ void uid_monitor::init(charger_stat_t stat)
 {
     charger_stat = stat;
     start_ts = time(NULL);
-    last_uid_io_stats = get_uid_io_stats();
+
+    // The I/O done before storaged started isn't reported.
+    std::unique_ptr<lock_t> lock(new lock_t(&um_lock));
+    history->load(UID_IO_HISTORY_DIR);
+    update_curr_io_stats_locked();
+    curr_io_stats.clear();
+    curr_uid_bytes.clear();
 }
 
-uid_monitor::uid_monitor()
+uid_monitor::uid_monitor() : uid_io_fd(-1), history(new uid_io_history())
 {
     sem_init(&um_lock, 0, 1);
 }
 
 uid_monitor::~uid_monitor()
 {
+    if (uid_io_fd != -1) {
+        close(uid_io_fd);
+    }
     sem_destroy(&um_lock);
 }
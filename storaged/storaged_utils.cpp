@@ -230,3 +230,28 @@ void log_event_disk_stats(struct disk_stats* stats, const char* type) {
         << LOG_ID_EVENTS;
 }
 
+void log_event_disk_latency(latency_histogram* read, latency_histogram* write, const char* type) {
+    // skip when there was no I/O in the window
+    if (read->get_count() == 0 && write->get_count() == 0) return;
+
+    android_log_event_list(EVENTLOGTAG_DISK_LATENCY)
+        << type
+        << read->get_count() << read->get_percentile(50)
+        << read->get_percentile(90) << read->get_percentile(99)
+        << write->get_count() << write->get_percentile(50)
+        << write->get_percentile(90) << write->get_percentile(99)
+        << LOG_ID_EVENTS;
+}
+
+void log_event_disk_latency_alert(const char* type, uint32_t latency, ewma_stats* baseline,
+                                  uint64_t ios) {
+    LOG_TO(SYSTEM, WARNING) << "slow " << type << " requests: " << latency << "us, baseline "
+                            << (uint32_t)baseline->get_mean() << "us (std "
+                            << (uint32_t)baseline->get_std() << "us), " << ios << " requests";
+
+    android_log_event_list(EVENTLOGTAG_DISK_LATENCY_ALERT)
+        << type << latency << (uint32_t)baseline->get_mean()
+        << (uint32_t)baseline->get_std() << ios
+        << LOG_ID_EVENTS;
+}
+
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <deque>
 #include <fcntl.h>
 #include <random>
@@ -22,9 +23,12 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
 #include <gtest/gtest.h>
 
 #include <storaged.h>               // data structures
+#include <storaged_uid_io_history.h>
 #include <storaged_utils.h>         // functions to test
 
 #define MMC_DISK_STATS_PATH "/sys/block/mmcblk0/stat"
@@ -349,3 +353,196 @@ TEST(storaged_test, disk_stats_publisher) {
     }
 }
 
+TEST(storaged_test, latency_histogram) {
+    latency_histogram hist;
+    EXPECT_EQ(0U, hist.get_percentile(50));
+
+    // small values are exact
+    hist.add(3, 10);
+    EXPECT_EQ(3U, hist.get_percentile(50));
+    hist.reset();
+    EXPECT_EQ(0U, hist.get_count());
+
+    for (uint32_t i = 1; i <= 1000; ++i) {
+        hist.add(i * 100, 1);
+    }
+    EXPECT_EQ(1000U, hist.get_count());
+    // within the error of a bucket
+    EXPECT_NEAR(50000.0, hist.get_percentile(50), 50000 * 0.25);
+    EXPECT_NEAR(90000.0, hist.get_percentile(90), 90000 * 0.25);
+    EXPECT_NEAR(99000.0, hist.get_percentile(99), 99000 * 0.25);
+    EXPECT_LE(hist.get_percentile(50), hist.get_percentile(90));
+    EXPECT_LE(hist.get_percentile(90), hist.get_percentile(99));
+
+    hist.add(UINT32_MAX, 1000000);
+    EXPECT_GT(hist.get_percentile(99), 1U << 31);
+}
+
+TEST(storaged_test, ewma_stats) {
+    ewma_stats stats(0.1);
+    for (int i = 0; i < 100; ++i) {
+        stats.add(1000);
+    }
+    EXPECT_DOUBLE_EQ(1000.0, stats.get_mean());
+    EXPECT_DOUBLE_EQ(0.0, stats.get_std());
+
+    // a lasting change moves the mean
+    for (int i = 0; i < 100; ++i) {
+        stats.add(i % 2 ? 1900 : 2100);
+    }
+    EXPECT_NEAR(2000.0, stats.get_mean(), 20);
+    EXPECT_NEAR(100.0, stats.get_std(), 20);
+    EXPECT_EQ(200U, stats.get_count());
+}
+
+TEST(storaged_test, disk_latency_alert) {
+    disk_stats_publisher dsp;
+    // 1ms per read, 2ms per write
+    struct disk_stats norm_inc = {
+        .read_ios = 1000,
+        .read_merges = 0,
+        .read_sectors = 8000,
+        .read_ticks = 1000,
+        .write_ios = 500,
+        .write_merges = 0,
+        .write_sectors = 4000,
+        .write_ticks = 1000,
+        .io_in_flight = 0,
+        .io_ticks = 1500,
+        .io_in_queue = 2000,
+        .start_time = 0,
+        .end_time = 60000,
+        .counter = 0,
+        .io_avg = 0
+    };
+
+    struct disk_stats stats_base;
+    memset(&stats_base, 0, sizeof(stats_base));
+    for (uint32_t i = 0; i <= dsp.mWarmup + 10; ++i) {
+        struct disk_stats inc = norm_inc;
+        // some jitter for the baseline to learn
+        inc.read_ticks += (i % 3) * 100;
+        stats_base = disk_stats_add(stats_base, inc);
+        dsp.update(&stats_base);
+        EXPECT_FALSE(dsp.mReadSlow);
+        EXPECT_FALSE(dsp.mWriteSlow);
+    }
+    EXPECT_NEAR(1100.0, dsp.mReadBaseline.get_mean(), 100);
+    EXPECT_NEAR(2000.0, dsp.mWriteBaseline.get_mean(), 1);
+    // the first read isn't an interval
+    EXPECT_EQ((dsp.mWarmup + 10) * norm_inc.read_ios, dsp.mReadLatency.get_count());
+
+    // reads slow down 10x
+    struct disk_stats slow_inc = norm_inc;
+    slow_inc.read_ticks *= 10;
+    stats_base = disk_stats_add(stats_base, slow_inc);
+    dsp.update(&stats_base);
+    EXPECT_TRUE(dsp.mReadSlow);
+    EXPECT_FALSE(dsp.mWriteSlow);
+    EXPECT_GT(dsp.mReadLatency.get_percentile(99), 5000U);
+
+    // too few requests to tell
+    slow_inc.read_ios = DISK_LATENCY_MIN_IOS - 1;
+    stats_base = disk_stats_add(stats_base, slow_inc);
+    dsp.update(&stats_base);
+    EXPECT_TRUE(dsp.mReadSlow);
+
+    stats_base = disk_stats_add(stats_base, norm_inc);
+    dsp.update(&stats_base);
+    EXPECT_FALSE(dsp.mReadSlow);
+
+    dsp.publish();
+    EXPECT_EQ(0U, dsp.mReadLatency.get_count());
+    EXPECT_EQ(0U, dsp.mWriteLatency.get_count());
+}
+
+TEST(storaged_test, task_monitor) {
+    uint32_t uid = getuid();
+    std::vector<std::pair<uint32_t, uint32_t>> tasks = get_uid_tasks({uid});
+    std::pair<uint32_t, uint32_t> self(getpid(), gettid());
+    EXPECT_NE(tasks.end(), std::find(tasks.begin(), tasks.end(), self));
+
+    task_monitor tm;
+    tm.update({uid});
+    // the first update is only a baseline
+    EXPECT_TRUE(tm.dump().entries.empty());
+
+    TemporaryFile tf;
+    std::string data(1024 * 1024, 'x');
+    ASSERT_TRUE(android::base::WriteStringToFd(data, tf.fd));
+    ASSERT_EQ(0, fsync(tf.fd));
+
+    tm.update({uid});
+    struct task_io_records records = tm.dump();
+    auto it = std::find_if(records.entries.begin(), records.entries.end(),
+        [](const struct task_io_record& r) { return r.tid == (uint32_t)gettid(); });
+    ASSERT_NE(records.entries.end(), it);
+    EXPECT_EQ(uid, it->uid);
+    EXPECT_EQ((uint32_t)getpid(), it->pid);
+    EXPECT_GE(it->write_bytes, data.size());
+    EXPECT_LE(records.start_ts, records.end_ts);
+}
+
+TEST(storaged_test, parse_uid_io_stats) {
+    struct uid_info u;
+    ASSERT_TRUE(parse_uid_io_stats("10012 1 2 3 4 5 6 7 8 9 10\n1000 0 0 0 0 0 0 0 0 0 0", &u));
+    EXPECT_EQ(10012U, u.uid);
+    EXPECT_EQ(1U, u.io[FOREGROUND].rchar);
+    EXPECT_EQ(4U, u.io[FOREGROUND].write_bytes);
+    EXPECT_EQ(7U, u.io[BACKGROUND].read_bytes);
+    EXPECT_EQ(9U, u.io[FOREGROUND].fsync);
+    EXPECT_EQ(10U, u.io[BACKGROUND].fsync);
+
+    // Fields added by later kernels are ignored.
+    EXPECT_TRUE(parse_uid_io_stats("0 1 2 3 4 5 6 7 8 9 10 11", &u));
+
+    EXPECT_FALSE(parse_uid_io_stats("10012 1 2 3 4 5 6 7 8 9\n1000 0", &u));
+    EXPECT_FALSE(parse_uid_io_stats("10012 1 2 3 4 5 6 7 8 9 x", &u));
+    EXPECT_FALSE(parse_uid_io_stats("4294967296 1 2 3 4 5 6 7 8 9 10", &u));
+    EXPECT_FALSE(parse_uid_io_stats("", &u));
+}
+
+TEST(storaged_test, uid_io_history) {
+    TemporaryDir dir;
+    const uint64_t day = 24 * 3600;
+    const uint64_t now = 100 * day;
+
+    struct uid_record app = {};
+    app.name = "com.example.app";
+    app.ios.bytes[WRITE][FOREGROUND][CHARGER_OFF] = 100;
+    struct uid_record other_app = {};
+    other_app.name = "com.example.other";
+    other_app.ios.bytes[READ][BACKGROUND][CHARGER_ON] = 7;
+
+    {
+        uid_io_history history;
+        ASSERT_TRUE(history.load(dir.path));
+        history.add(now - 3 * day - 3600, now - 3 * day, {app});
+        history.add(now - 2 * 3600, now - 3600, {app, other_app});
+        history.add(now - 3600, now, {app});
+    }
+
+    // Everything survives a restart.
+    uid_io_history history;
+    ASSERT_TRUE(history.load(dir.path));
+
+    uint64_t start_ts;
+    std::vector<struct uid_record> records = history.query(now, 1, &start_ts);
+    ASSERT_EQ(1U, records.size());
+    EXPECT_EQ(app.name, records[0].name);
+    EXPECT_EQ(100U, records[0].ios.bytes[WRITE][FOREGROUND][CHARGER_OFF]);
+    EXPECT_EQ(now - 3600, start_ts);
+
+    // Spans longer than the hourly buckets cover are answered from the daily ones.
+    records = history.query(now, 7 * 24, &start_ts);
+    ASSERT_EQ(2U, records.size());
+    for (const auto& record : records) {
+        if (record.name == app.name) {
+            EXPECT_EQ(300U, record.ios.bytes[WRITE][FOREGROUND][CHARGER_OFF]);
+        } else {
+            EXPECT_EQ(other_app.name, record.name);
+            EXPECT_EQ(7U, record.ios.bytes[READ][BACKGROUND][CHARGER_ON]);
+        }
+    }
+    EXPECT_EQ(now - 3 * day - 3600, start_ts);
+}
@@ -39,6 +39,7 @@ __RCSID("$NetBSD: file.c,v 1.7 2011/04/18 22:46:48 joerg Exp $");
 
 #include <sys/param.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #ifndef __ANDROID__
@@ -48,6 +49,7 @@ __RCSID("$NetBSD: file.c,v 1.7 2011/04/18 22:46:48 joerg Exp $");
 #include <errno.h>
 #include <fcntl.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -85,6 +87,10 @@ grep_refill(struct file *f)
 	bufpos = buffer;
 	bufrem = 0;
 
+	/* A mapped file is consumed in one piece by grep_file_init() */
+	if (f->map != NULL)
+		return (0);
+
 #ifndef __ANDROID__
 	if (filebehave == FILE_GZIP)
 		nr = gzread(gzbufdesc, buffer, MAXBUFSIZ);
@@ -215,21 +221,93 @@ grep_file_init(struct file *f)
 #endif
 
 	/* Fill read buffer, also catches errors early */
-	if (grep_refill(f) != 0)
+	if (f->map != NULL) {
+		bufpos = f->map;
+		bufrem = f->maplen;
+	} else if (grep_refill(f) != 0)
 		goto error;
 
 	/* Check for binary stuff, if necessary */
 	if (!nulldataflag && binbehave != BINFILE_TEXT &&
-	    memchr(bufpos, '\0', bufrem) != NULL)
+	    memchr(bufpos, '\0', MIN(bufrem, MAXBUFSIZ)) != NULL)
 		f->binary = true;
 
 	return (f);
 error:
+	if (f->map != NULL)
+		munmap(f->map, f->maplen);
 	close(f->fd);
 	free(f);
 	return (NULL);
 }
 
+/*
+ * Maps a regular file so that lines are handed out without copying.  Line
+ * data is not NUL terminated, so this is not done when matching may read
+ * past the end of a line (-i and -w use mbstowcs() and sscanf()), and a
+ * file that is empty or cannot be mapped is read instead.
+ */
+static void
+grep_map(struct file *f)
+{
+	struct stat sb;
+	void *map;
+
+	if (filebehave != FILE_STDIO || iflag || wflag)
+		return;
+	if (fstat(f->fd, &sb) == -1 || !S_ISREG(sb.st_mode) ||
+	    sb.st_size <= 0 || (uintmax_t)sb.st_size > SIZE_MAX)
+		return;
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, f->fd, 0);
+	if (map == MAP_FAILED)
+		return;
+	madvise(map, sb.st_size, MADV_SEQUENTIAL);
+	f->map = map;
+	f->maplen = sb.st_size;
+}
+
+/*
+ * Skips ahead to the line holding the next candidate match of the
+ * prefilter literal, see prefilter.c.  Returns false if no line after the
+ * current position can match, else sets the bytes and, with -n, the lines
+ * skipped.
+ */
+bool
+grep_fskip(struct file *f, off_t *bytes, int *lines)
+{
+	const unsigned char *p, *start, *end;
+	off_t pos;
+
+	*bytes = 0;
+	*lines = 0;
+	if (f->map == NULL || prefilter_len == 0 || bufrem == 0 ||
+	    bufpos < f->map || bufpos >= f->map + f->maplen)
+		return (true);
+
+	pos = bufpos - f->map;
+	if (f->hint == HINT_NONE)
+		return (false);
+	if (f->hint >= pos && (size_t)f->hint < f->maplen) {
+		/* the prescan already found the first candidate */
+		p = f->map + f->hint;
+	} else if ((p = prefilter_find(bufpos, bufrem)) == NULL)
+		return (false);
+	f->hint = HINT_UNKNOWN;
+
+	/* back up to the start of the line */
+	for (start = p; start > bufpos && start[-1] != line_sep; --start)
+		;
+	if (nflag) {
+		for (p = bufpos; (end = memchr(p, line_sep, start - p)) != NULL;
+		    p = end + 1)
+			++*lines;
+	}
+	*bytes = start - bufpos;
+	bufrem -= start - bufpos;
+	bufpos = (unsigned char *)start;
+	return (true);
+}
+
 /*
  * Opens a file for processing.
  */
@@ -247,7 +325,9 @@ grep_open(const char *path)
 	} else if ((f->fd = open(path, O_RDONLY)) == -1) {
 		free(f);
 		return (NULL);
-	}
+	} else
+		grep_map(f);
+	f->hint = HINT_UNKNOWN;
 
 	return (grep_file_init(f));
 }
@@ -260,6 +340,10 @@ grep_close(struct file *f)
 {
 
 	close(f->fd);
+	if (f->map != NULL) {
+		munmap(f->map, f->maplen);
+		f->map = NULL;
+	}
 
 	/* Reset read buffer and line buffer */
 	bufpos = buffer;
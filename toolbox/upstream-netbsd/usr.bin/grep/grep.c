@@ -36,6 +36,7 @@
 #include <sys/cdefs.h>
 __RCSID("$NetBSD: grep.c,v 1.12 2014/07/11 16:30:45 christos Exp $");
 
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -71,7 +72,7 @@ const char	*errstr[] = {
 /* 4*/	"usage: %s [-abcDEFGHhIiJLlmnOoPqRSsUVvwxZz] [-A num] [-B num] [-C[num]]\n",
 /* 5*/	"\t[-e pattern] [-f file] [--binary-files=value] [--color=when]\n",
 /* 6*/	"\t[--context[=num]] [--directories=action] [--label] [--line-buffered]\n",
-/* 7*/	"\t[pattern] [file ...]\n",
+/* 7*/	"\t[--threads=num] [pattern] [file ...]\n",
 /* 8*/	"Binary file %s matches\n",
 /* 9*/	"%s (BSD grep) %s\n",
 };
@@ -125,6 +126,7 @@ int	 filebehave = FILE_STDIO;	/* -JZ: normal, gzip or bzip2 file */
 int	 devbehave = DEV_READ;		/* -D: handling of devices */
 int	 dirbehave = DIR_READ;		/* -dRr: handling of directories */
 int	 linkbehave = LINK_READ;	/* -OpS: handling of symlinks */
+unsigned int nthreads;		/* --threads: files prescanned in parallel */
 
 bool	 dexclude, dinclude;	/* --exclude-dir and --include-dir */
 bool	 fexclude, finclude;	/* --exclude and --include */
@@ -140,7 +142,8 @@ enum {
 	R_EXCLUDE_OPT,
 	R_INCLUDE_OPT,
 	R_DEXCLUDE_OPT,
-	R_DINCLUDE_OPT
+	R_DINCLUDE_OPT,
+	THREADS_OPT
 };
 
 static inline const char	*init_color(const char *);
@@ -181,6 +184,7 @@ struct option long_options[] =
 	{"include",		required_argument,	NULL, R_INCLUDE_OPT},
 	{"exclude-dir",		required_argument,	NULL, R_DEXCLUDE_OPT},
 	{"include-dir",		required_argument,	NULL, R_DINCLUDE_OPT},
+	{"threads",		required_argument,	NULL, THREADS_OPT},
 	{"after-context",	required_argument,	NULL, 'A'},
 	{"text",		no_argument,		NULL, 'a'},
 	{"before-context",	required_argument,	NULL, 'B'},
@@ -621,6 +625,15 @@ main(int argc, char *argv[])
 			dexclude = true;
 			add_dpattern(optarg, EXCL_PAT);
 			break;
+		case THREADS_OPT:
+			errno = 0;
+			l = strtoull(optarg, &ep, 10);
+			if (errno != 0 || ep[0] != '\0' || l > 64) {
+				errno = EINVAL;
+				err(2, "--threads");
+			}
+			nthreads = l;
+			break;
 		case HELP_OPT:
 		default:
 			usage();
@@ -679,6 +692,13 @@ main(int argc, char *argv[])
 		}
 	}
 
+	prefilter_init();
+	if (nthreads == 0) {
+		/* default to one prescan thread per core, within reason */
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpus > 1 ? MIN(ncpus, 8) : 1;
+	}
+
 	if (lbflag)
 		setlinebuf(stdout);
 
@@ -690,7 +710,12 @@ main(int argc, char *argv[])
 
 	if (dirbehave == DIR_RECURSE)
 		c = grep_tree(aargv);
-	else
+	else if (nthreads > 1 && prefilter_len > 0 && aargc > 1) {
+		for (i = 0, j = 0; j < aargc; ++j)
+			if (!(finclude || fexclude) || file_matching(aargv[j]))
+				aargv[i++] = aargv[j];
+		c = grep_files(aargv, i);
+	} else
 		for (c = 0; aargc--; ++aargv) {
 			if ((finclude || fexclude) && !file_matching(*aargv))
 				continue;
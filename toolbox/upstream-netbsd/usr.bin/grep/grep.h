@@ -84,6 +84,9 @@ extern const char		*errstr[];
 struct file {
 	int		 fd;
 	bool		 binary;
+	unsigned char	*map;		/* whole file, if mapped */
+	size_t		 maplen;
+	off_t		 hint;		/* see prefilter.c */
 };
 
 struct str {
@@ -131,6 +134,7 @@ extern char    **pattern;
 extern struct epat *dpattern, *fpattern;
 extern regex_t	*er_pattern, *r_pattern;
 extern fastgrep_t *fg_pattern;
+extern unsigned int nthreads;
 
 /* For regex errors  */
 #define RE_ERROR_BUF	512
@@ -139,6 +143,7 @@ extern char	 re_error[RE_ERROR_BUF + 1];	/* Seems big enough */
 /* util.c */
 bool	 file_matching(const char *fname);
 int	 procfile(const char *fn);
+int	 procfile_hint(const char *fn, off_t hint, off_t size);
 int	 grep_tree(char **argv);
 void	*grep_malloc(size_t size);
 void	*grep_calloc(size_t nmemb, size_t size);
@@ -155,8 +160,17 @@ void	 clearqueue(void);
 void		 grep_close(struct file *f);
 struct file	*grep_open(const char *path);
 char		*grep_fgetln(struct file *f, size_t *len);
+bool		 grep_fskip(struct file *f, off_t *bytes, int *lines);
 
 /* fastgrep.c */
 int		 fastcomp(fastgrep_t *, const char *);
 void		 fgrepcomp(fastgrep_t *, const char *);
 int		 grep_search(fastgrep_t *, const unsigned char *, size_t, regmatch_t *);
+
+/* prefilter.c */
+#define HINT_UNKNOWN	((off_t)-2)	/* no prescan result */
+#define HINT_NONE	((off_t)-1)	/* prescan found no candidate */
+extern size_t	 prefilter_len;
+void		 prefilter_init(void);
+const unsigned char *prefilter_find(const unsigned char *, size_t);
+int		 grep_files(char **paths, size_t n);
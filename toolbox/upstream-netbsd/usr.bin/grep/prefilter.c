@@ -0,0 +1,288 @@
+/*-
+ * Copyright (C) 2017 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Literal prefilter.  When every line that can match must contain a fixed
+ * string, mapped files are searched for that string with memchr(), which
+ * libc vectorizes, and only the lines holding it reach fastgrep or
+ * regexec().  With several files, worker threads prescan them for the
+ * first candidate while the main thread matches and prints them in order.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "grep.h"
+
+static unsigned char	*prefilter;	/* the literal */
+size_t			 prefilter_len;	/* 0 if there is none */
+
+/*
+ * Returns the length of the bracket expression at p, which starts with '['.
+ */
+static size_t
+bracket_len(const char *p)
+{
+	const char *q = p + 1;
+
+	if (*q == '^')
+		q++;
+	if (*q == ']')
+		q++;
+	while (*q != '\0' && *q != ']') {
+		if (q[0] == '[' && (q[1] == ':' || q[1] == '.' || q[1] == '=')) {
+			const char *close = strchr(q + 2, q[1]);
+
+			while (close != NULL && close[1] != ']')
+				close = strchr(close + 1, q[1]);
+			if (close == NULL)
+				return (strlen(p));
+			q = close + 2;
+		} else
+			q++;
+	}
+	return (*q == ']' ? (size_t)(q - p + 1) : strlen(p));
+}
+
+/*
+ * Finds the longest string every match of the regular expression pat must
+ * contain.  Anything not obviously literal ends a run, so the result may be
+ * shorter than possible but is never wrong.  Alternation and groups, which
+ * can make any part optional, give up.
+ */
+static void
+regex_literal(const char *pat, bool extended, const char **lit, size_t *len)
+{
+	const char *p, *run = pat;
+	size_t runlen = 0;
+	bool quantifier;
+
+	*lit = NULL;
+	*len = 0;
+	if (extended ? strpbrk(pat, "|()") != NULL :
+	    strstr(pat, "\\|") != NULL || strstr(pat, "\\(") != NULL)
+		return;
+
+	for (p = pat; *p != '\0'; ) {
+		if (strchr(".[*^$\\+?{}", *p) == NULL) {
+			if (runlen == 0)
+				run = p;
+			runlen++;
+			p++;
+			continue;
+		}
+
+		/* a quantifier makes the previous character optional */
+		quantifier = *p == '*' || *p == '?' || *p == '{' ||
+		    (*p == '\\' && (p[1] == '{' || p[1] == '?'));
+		/* drop the whole last character, not just its last byte */
+		while (quantifier && runlen > 0 &&
+		    ((unsigned char)run[--runlen] & 0xc0) == 0x80)
+			;
+		if (runlen > *len) {
+			*lit = run;
+			*len = runlen;
+		}
+		runlen = 0;
+
+		if (*p == '[')
+			p += bracket_len(p);
+		else if (*p == '\\' && p[1] != '\0')
+			p += 2;
+		else
+			p++;
+	}
+	if (runlen > *len) {
+		*lit = run;
+		*len = runlen;
+	}
+}
+
+/*
+ * Chooses the prefilter literal, if the options allow one.  Inverted
+ * matches and context need every line, and case folding makes the bytes
+ * of a match unknown.
+ */
+void
+prefilter_init(void)
+{
+	const char *lit;
+	size_t len;
+
+	if (patterns != 1 || vflag || iflag || Aflag || Bflag ||
+	    filebehave != FILE_STDIO)
+		return;
+
+	if (grepbehave == GREP_FIXED) {
+		lit = pattern[0];
+		len = strlen(lit);
+	} else
+		regex_literal(pattern[0], grepbehave == GREP_EXTENDED, &lit,
+		    &len);
+	if (len == 0 || memchr(lit, line_sep, len) != NULL)
+		return;
+
+	prefilter = grep_malloc(len);
+	memcpy(prefilter, lit, len);
+	prefilter_len = len;
+}
+
+/*
+ * Returns the first occurrence of the prefilter literal in buf, or NULL.
+ */
+const unsigned char *
+prefilter_find(const unsigned char *buf, size_t len)
+{
+	const unsigned char *p, *end;
+
+	if (len < prefilter_len)
+		return (NULL);
+	end = buf + len - prefilter_len + 1;
+	for (p = buf; (p = memchr(p, prefilter[0], end - p)) != NULL; p++) {
+		if (memcmp(p + 1, prefilter + 1, prefilter_len - 1) == 0)
+			return (p);
+	}
+	return (NULL);
+}
+
+struct prescan {
+	off_t		 hint;
+	off_t		 size;
+	bool		 done;
+};
+
+static pthread_mutex_t	 prescan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	 prescan_cond = PTHREAD_COND_INITIALIZER;
+static char		**prescan_paths;
+static struct prescan	*prescan_results;
+static size_t		 prescan_next, prescan_count;
+
+static void
+prescan_file(const char *path, struct prescan *r)
+{
+	const unsigned char *p;
+	struct stat sb;
+	void *map;
+	int fd;
+
+	r->hint = HINT_UNKNOWN;
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return;
+	if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0 &&
+	    (uintmax_t)sb.st_size <= SIZE_MAX) {
+		map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			madvise(map, sb.st_size, MADV_SEQUENTIAL);
+			p = prefilter_find(map, sb.st_size);
+			r->hint = p != NULL ? p - (unsigned char *)map :
+			    HINT_NONE;
+			r->size = sb.st_size;
+			munmap(map, sb.st_size);
+		}
+	}
+	close(fd);
+}
+
+static void *
+prescan_thread(void *arg)
+{
+	struct prescan r;
+	size_t i;
+
+	(void)arg;
+	pthread_mutex_lock(&prescan_lock);
+	while (prescan_next < prescan_count) {
+		i = prescan_next++;
+		pthread_mutex_unlock(&prescan_lock);
+
+		memset(&r, 0, sizeof(r));
+		prescan_file(prescan_paths[i], &r);
+		r.done = true;
+
+		pthread_mutex_lock(&prescan_lock);
+		prescan_results[i] = r;
+		pthread_cond_broadcast(&prescan_cond);
+	}
+	pthread_mutex_unlock(&prescan_lock);
+	return (NULL);
+}
+
+/*
+ * Processes the files in order, as procfile() would, while up to nthreads
+ * workers prescan them for the prefilter literal.  Files without a
+ * candidate line are then only opened to report them, and the others are
+ * matched from their first candidate on.
+ */
+int
+grep_files(char **paths, size_t n)
+{
+	pthread_t *threads;
+	struct prescan r;
+	size_t i, nstarted;
+	int c;
+
+	if (n == 0)
+		return (0);
+	prescan_paths = paths;
+	prescan_results = grep_calloc(n, sizeof(*prescan_results));
+	prescan_next = 0;
+	prescan_count = n;
+
+	threads = grep_calloc(nthreads, sizeof(*threads));
+	for (nstarted = 0; nstarted < nthreads && nstarted < n; nstarted++)
+		if (pthread_create(&threads[nstarted], NULL, prescan_thread,
+		    NULL) != 0)
+			break;
+
+	for (c = 0, i = 0; i < n; i++) {
+		r.hint = HINT_UNKNOWN;
+		r.size = 0;
+		if (nstarted > 0) {
+			pthread_mutex_lock(&prescan_lock);
+			while (!prescan_results[i].done)
+				pthread_cond_wait(&prescan_cond, &prescan_lock);
+			r = prescan_results[i];
+			pthread_mutex_unlock(&prescan_lock);
+		}
+		c += procfile_hint(paths[i], r.hint, r.size);
+	}
+
+	for (i = 0; i < nstarted; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	free(prescan_results);
+	prescan_results = NULL;
+	return (c);
+}
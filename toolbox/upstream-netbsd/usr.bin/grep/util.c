@@ -115,10 +115,14 @@ grep_tree(char **argv)
 	FTS *fts;
 	FTSENT *p;
 	char *d, *dir = NULL;
+	char **paths = NULL;
+	size_t npaths = 0, paths_sz = 0;
 	int c, fts_flags;
-	bool ok;
+	bool ok, parallel;
 
 	c = fts_flags = 0;
+	/* with a prefilter, files are collected and prescanned in parallel */
+	parallel = nthreads > 1 && prefilter_len > 0;
 
 	switch(linkbehave) {
 	case LINK_EXPLICIT:
@@ -170,13 +174,26 @@ grep_tree(char **argv)
 			if (fexclude || finclude)
 				ok &= file_matching(p->fts_path);
 
-			if (ok)
+			if (ok && parallel) {
+				if (npaths == paths_sz) {
+					paths_sz = paths_sz * 2 + 64;
+					paths = grep_realloc(paths,
+					    paths_sz * sizeof(*paths));
+				}
+				paths[npaths++] = grep_strdup(p->fts_path);
+			} else if (ok)
 				c += procfile(p->fts_path);
 			break;
 		}
 	}
 
 	fts_close(fts);
+	if (parallel) {
+		c += grep_files(paths, npaths);
+		while (npaths > 0)
+			free(paths[--npaths]);
+		free(paths);
+	}
 	return (c);
 }
 
@@ -186,12 +203,24 @@ grep_tree(char **argv)
  */
 int
 procfile(const char *fn)
+{
+
+	return (procfile_hint(fn, HINT_UNKNOWN, 0));
+}
+
+/*
+ * As procfile(), given where a prescan of the first size bytes of the file
+ * found the first candidate line, see grep_files().
+ */
+int
+procfile_hint(const char *fn, off_t hint, off_t size)
 {
 	struct file *f;
 	struct stat sb;
 	struct str ln;
 	mode_t s;
-	int c, t;
+	int c, t, lines;
+	off_t skipped;
 
 	if (mflag && (mcount <= 0))
 		return (0);
@@ -219,6 +248,17 @@ procfile(const char *fn)
 		return (0);
 	}
 
+	/* Return if we need to skip a binary file */
+	if (f->binary && binbehave == BINFILE_SKIP) {
+		grep_close(f);
+		free(f);
+		return (0);
+	}
+
+	/* the prescan result only holds if the file did not change size */
+	if (f->map != NULL && (off_t)f->maplen == size)
+		f->hint = hint;
+
 	ln.file = grep_malloc(strlen(fn) + 1);
 	strcpy(ln.file, fn);
 	ln.line_no = 0;
@@ -228,19 +268,16 @@ procfile(const char *fn)
 
 	for (first = true, c = 0;  c == 0 || !(lflag || qflag); ) {
 		ln.off += ln.len + 1;
+		if (!grep_fskip(f, &skipped, &lines))
+			break;
+		ln.off += skipped;
+		ln.line_no += lines;
 		if ((ln.dat = grep_fgetln(f, &ln.len)) == NULL || ln.len == 0)
 			break;
 		if (ln.len > 0 && ln.dat[ln.len - 1] == line_sep)
 			--ln.len;
 		ln.line_no++;
 
-		/* Return if we need to skip a binary file */
-		if (f->binary && binbehave == BINFILE_SKIP) {
-			grep_close(f);
-			free(ln.file);
-			free(f);
-			return (0);
-		}
 		/* Process the file line-by-line */
 		t = procline(&ln, f->binary);
 		c += t;
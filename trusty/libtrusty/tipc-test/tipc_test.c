@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/uio.h>
 
 #include <trusty/tipc.h>
@@ -40,7 +42,7 @@ static const char *closer2_name = "com.android.ipc-unittest.srv.closer2";
 static const char *closer3_name = "com.android.ipc-unittest.srv.closer3";
 static const char *main_ctrl_name = "com.android.ipc-unittest.ctrl";
 
-static const char *_sopts = "hsvD:t:r:m:b:";
+static const char *_sopts = "hsvD:t:r:m:b:c:S:";
 static const struct option _lopts[] =  {
 	{"help",    no_argument,       0, 'h'},
 	{"silent",  no_argument,       0, 's'},
@@ -49,6 +51,8 @@ static const struct option _lopts[] =  {
 	{"repeat",  required_argument, 0, 'r'},
 	{"burst",   required_argument, 0, 'b'},
 	{"msgsize", required_argument, 0, 'm'},
+	{"concurrency", required_argument, 0, 'c'},
+	{"srv",     required_argument, 0, 'S'},
 	{0, 0, 0, 0}
 };
 
@@ -62,6 +66,8 @@ static const char *usage =
 "  -r, --repeat cnt      repeat count\n"
 "  -m, --msgsize size    max message size\n"
 "  -v, --variable        variable message size\n"
+"  -c, --concurrency cnt parallel connections for echo_bench\n"
+"  -S, --srv name        service for connect_bench (default echo)\n"
 "  -s, --silent          silent\n"
 "\n"
 ;
@@ -83,6 +89,9 @@ static const char *usage_long =
 "   ta-access    - test ta-access flags\n"
 "   writev       - writev test\n"
 "   readv        - readv test\n"
+"   echo_bench   - echo round trip latency percentiles and throughput\n"
+"                  for message sizes up to msgsize\n"
+"   connect_bench - connect/close latency percentiles\n"
 "\n"
 ;
 
@@ -91,6 +100,8 @@ static uint opt_msgsize = 32;
 static uint opt_msgburst = 32;
 static bool opt_variable = false;
 static bool opt_silent = false;
+static uint opt_concurrency = 1;
+static const char *opt_srv_name = NULL;
 
 static void print_usage_and_exit(const char *prog, int code, bool verbose)
 {
@@ -137,6 +148,14 @@ static void parse_options(int argc, char **argv)
 			opt_msgburst = atoi(optarg);
 		break;
 
+		case 'c':
+			opt_concurrency = atoi(optarg);
+		break;
+
+		case 'S':
+			opt_srv_name = strdup(optarg);
+		break;
+
 		case 's':
 			opt_silent = true;
 		break;
@@ -860,6 +879,216 @@ static int readv_test(uint repeat, uint msgsz, bool var)
 }
 
 
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* sorts samples in place and prints min/percentiles/max in usec */
+static void print_latency(const char *what, uint64_t *samples, size_t cnt)
+{
+	if (!cnt) {
+		printf("%s: no samples\n", what);
+		return;
+	}
+
+	qsort(samples, cnt, sizeof(samples[0]), cmp_u64);
+	printf("%s: samples %zu: usec min %.1f p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+	       what, cnt,
+	       samples[0] / 1000.0,
+	       samples[cnt * 50 / 100] / 1000.0,
+	       samples[cnt * 90 / 100] / 1000.0,
+	       samples[cnt * 99 / 100] / 1000.0,
+	       samples[cnt - 1] / 1000.0);
+}
+
+struct echo_bench_worker {
+	pthread_t thread;
+	uint repeat;
+	uint msgsz;
+	uint64_t *samples;	/* one round trip time per message, nsec */
+	size_t cnt;
+	int rc;
+};
+
+static void *echo_bench_thread(void *arg)
+{
+	struct echo_bench_worker *w = arg;
+	char tx_buf[w->msgsz ? w->msgsz : 1];
+	char rx_buf[w->msgsz ? w->msgsz : 1];
+	uint64_t start;
+	ssize_t rc;
+	uint i;
+	int fd;
+
+	fd = tipc_connect(dev_name, echo_name);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to connect to service\n");
+		w->rc = fd;
+		return NULL;
+	}
+
+	memset(tx_buf, 0x5a, w->msgsz);
+	for (i = 0; i < w->repeat; i++) {
+		start = now_ns();
+		rc = write(fd, tx_buf, w->msgsz);
+		if ((size_t)rc != w->msgsz) {
+			perror("echo_bench: write");
+			w->rc = -1;
+			break;
+		}
+		rc = read(fd, rx_buf, w->msgsz);
+		if ((size_t)rc != w->msgsz) {
+			perror("echo_bench: read");
+			w->rc = -1;
+			break;
+		}
+		w->samples[w->cnt++] = now_ns() - start;
+	}
+
+	tipc_close(fd);
+	return NULL;
+}
+
+static int echo_bench_size(uint repeat, uint msgsz, uint threads)
+{
+	struct echo_bench_worker workers[threads];
+	uint64_t *samples;
+	uint64_t start, elapsed;
+	size_t total = 0;
+	char what[64];
+	uint i;
+	int rc = 0;
+
+	samples = calloc((size_t)repeat * threads, sizeof(*samples));
+	if (!samples) {
+		fprintf(stderr, "out of memory\n");
+		return -1;
+	}
+
+	start = now_ns();
+	for (i = 0; i < threads; i++) {
+		workers[i].repeat = repeat;
+		workers[i].msgsz = msgsz;
+		workers[i].samples = samples + (size_t)i * repeat;
+		workers[i].cnt = 0;
+		workers[i].rc = 0;
+		if (pthread_create(&workers[i].thread, NULL,
+				   echo_bench_thread, &workers[i])) {
+			fprintf(stderr, "failed to start thread %u\n", i);
+			threads = i;
+			rc = -1;
+			break;
+		}
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (workers[i].rc)
+			rc = workers[i].rc;
+		/* compact so percentiles cover all threads */
+		memmove(samples + total, workers[i].samples,
+			workers[i].cnt * sizeof(*samples));
+		total += workers[i].cnt;
+	}
+	elapsed = now_ns() - start;
+
+	snprintf(what, sizeof(what), "echo msgsz %u threads %u", msgsz, threads);
+	print_latency(what, samples, total);
+	if (elapsed) {
+		double secs = elapsed / 1e9;
+		printf("%s: %.0f msgs/sec, %.2f MB/sec (both directions)\n",
+		       what, total / secs, 2.0 * total * msgsz / secs / (1024 * 1024));
+	}
+
+	free(samples);
+	return rc;
+}
+
+static int echo_bench(uint repeat, uint msgsz, uint threads)
+{
+	uint sz;
+	int rc;
+
+	if (!threads)
+		threads = 1;
+
+	if (!opt_silent) {
+		printf("%s: repeat %u: max msgsz %u: threads %u\n",
+			__func__, repeat, msgsz, threads);
+	}
+
+	/* sweep powers of two up to the max message size, then the max itself */
+	for (sz = 8; sz < msgsz; sz *= 2) {
+		rc = echo_bench_size(repeat, sz, threads);
+		if (rc)
+			return rc;
+	}
+	return echo_bench_size(repeat, msgsz, threads);
+}
+
+static int connect_bench(uint repeat, const char *srv_name)
+{
+	uint64_t *connect_ns;
+	uint64_t *close_ns;
+	uint64_t start;
+	size_t cnt = 0;
+	char what[128];
+	uint i;
+	int fd;
+	int rc = 0;
+
+	if (!opt_silent) {
+		printf("%s: repeat %u: srv %s\n", __func__, repeat, srv_name);
+	}
+
+	connect_ns = calloc(repeat, sizeof(*connect_ns));
+	close_ns = calloc(repeat, sizeof(*close_ns));
+	if (!connect_ns || !close_ns) {
+		fprintf(stderr, "out of memory\n");
+		free(connect_ns);
+		free(close_ns);
+		return -1;
+	}
+
+	for (i = 0; i < repeat; i++) {
+		start = now_ns();
+		fd = tipc_connect(dev_name, srv_name);
+		if (fd < 0) {
+			fprintf(stderr, "Failed to connect to '%s' service\n",
+				srv_name);
+			rc = fd;
+			break;
+		}
+		connect_ns[cnt] = now_ns() - start;
+
+		start = now_ns();
+		tipc_close(fd);
+		close_ns[cnt] = now_ns() - start;
+		cnt++;
+	}
+
+	snprintf(what, sizeof(what), "connect %s", srv_name);
+	print_latency(what, connect_ns, cnt);
+	snprintf(what, sizeof(what), "close %s", srv_name);
+	print_latency(what, close_ns, cnt);
+
+	free(connect_ns);
+	free(close_ns);
+	return rc;
+}
+
+
 int main(int argc, char **argv)
 {
 	int rc = 0;
@@ -907,6 +1136,11 @@ int main(int argc, char **argv)
 		rc = writev_test(opt_repeat, opt_msgsize, opt_variable);
 	} else if (strcmp(test_name, "readv") == 0) {
 		rc = readv_test(opt_repeat, opt_msgsize, opt_variable);
+	} else if (strcmp(test_name, "echo_bench") == 0) {
+		rc = echo_bench(opt_repeat, opt_msgsize, opt_concurrency);
+	} else if (strcmp(test_name, "connect_bench") == 0) {
+		rc = connect_bench(opt_repeat,
+				   opt_srv_name ? opt_srv_name : echo_name);
 	} else {
 		fprintf(stderr, "Unrecognized test name '%s'\n", test_name);
 		print_usage_and_exit(argv[0], EXIT_FAILURE, true);
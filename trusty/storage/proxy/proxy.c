@@ -15,6 +15,7 @@
  */
 #include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
@@ -22,6 +23,7 @@
 #include <sys/capability.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cutils/android_filesystem_config.h>
@@ -39,6 +41,31 @@ static const char *trusty_devname;
 static const char *rpmb_devname;
 static const char *ss_srv_name = STORAGE_DISK_PROXY_PORT;
 
+/* per command latency, logged every STATS_LOG_INTERVAL requests */
+#define STATS_LOG_INTERVAL 1024
+#define STATS_CMD_COUNT ((STORAGE_END_TRANSACTION >> STORAGE_REQ_SHIFT) + 1)
+
+struct op_stats {
+    uint64_t count;
+    uint64_t total_us;
+    uint64_t max_us;
+};
+
+static struct op_stats op_stats[STATS_CMD_COUNT];
+static uint32_t stats_req_count;
+
+static const char *op_names[STATS_CMD_COUNT] = {
+    [STORAGE_FILE_DELETE >> STORAGE_REQ_SHIFT] = "delete",
+    [STORAGE_FILE_OPEN >> STORAGE_REQ_SHIFT] = "open",
+    [STORAGE_FILE_CLOSE >> STORAGE_REQ_SHIFT] = "close",
+    [STORAGE_FILE_READ >> STORAGE_REQ_SHIFT] = "read",
+    [STORAGE_FILE_WRITE >> STORAGE_REQ_SHIFT] = "write",
+    [STORAGE_FILE_GET_SIZE >> STORAGE_REQ_SHIFT] = "get_size",
+    [STORAGE_FILE_SET_SIZE >> STORAGE_REQ_SHIFT] = "set_size",
+    [STORAGE_RPMB_SEND >> STORAGE_REQ_SHIFT] = "rpmb_send",
+    [STORAGE_END_TRANSACTION >> STORAGE_REQ_SHIFT] = "end_transaction",
+};
+
 static const char *_sopts = "hp:d:r:";
 static const struct option _lopts[] =  {
     {"help",       no_argument,       NULL, 'h'},
@@ -164,10 +191,44 @@ static int handle_req(struct storage_msg *msg, const void *req, size_t req_len)
     return rc;
 }
 
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void record_op(uint32_t cmd, uint64_t elapsed_us)
+{
+    uint32_t idx = cmd >> STORAGE_REQ_SHIFT;
+
+    if (idx >= STATS_CMD_COUNT || op_names[idx] == NULL)
+        return;
+
+    op_stats[idx].count++;
+    op_stats[idx].total_us += elapsed_us;
+    if (elapsed_us > op_stats[idx].max_us)
+        op_stats[idx].max_us = elapsed_us;
+
+    if (++stats_req_count < STATS_LOG_INTERVAL)
+        return;
+    stats_req_count = 0;
+
+    for (idx = 0; idx < STATS_CMD_COUNT; idx++) {
+        if (op_stats[idx].count == 0)
+            continue;
+        ALOGD("%s: %" PRIu64 " ops, avg %" PRIu64 " us, max %" PRIu64 " us\n",
+              op_names[idx], op_stats[idx].count,
+              op_stats[idx].total_us / op_stats[idx].count, op_stats[idx].max_us);
+    }
+}
+
 static int proxy_loop(void)
 {
     ssize_t rc;
     struct storage_msg msg;
+    uint32_t cmd;
+    uint64_t start_us;
 
     /* enter main message handling loop */
     while (true) {
@@ -179,9 +240,12 @@ static int proxy_loop(void)
 
         /* handle request */
         req_buffer[rc] = 0; /* force zero termination */
+        cmd = msg.cmd;
+        start_us = now_us();
         rc = handle_req(&msg, req_buffer, rc);
         if (rc)
             return rc;
+        record_op(cmd, now_us() - start_us);
     }
 
     return 0;
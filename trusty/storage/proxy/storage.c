@@ -30,6 +30,7 @@
 
 #define FD_TBL_SIZE 64
 #define MAX_READ_SIZE 4096
+#define MAX_DEFERRED_CLOSE 16
 
 enum sync_state {
     SS_UNUSED = -1,
@@ -43,13 +44,23 @@ static const char *ssdir_name;
 static enum sync_state fs_state;
 static enum sync_state dir_state;
 static enum sync_state fd_state[FD_TBL_SIZE];
+static char *fd_path[FD_TBL_SIZE];
+
+/*
+ * Dirty files closed by the secure side are not fsync'ed and closed right
+ * away; they stay open and dirty until the next sync checkpoint, which syncs
+ * all of them at once. Until then, reopening the same file hands back the
+ * deferred fd instead of going through open(2) again.
+ */
+static int deferred_close[MAX_DEFERRED_CLOSE];
+static uint deferred_close_cnt;
 
 static struct {
    struct storage_file_read_resp hdr;
    uint8_t data[MAX_READ_SIZE];
 }  read_rsp;
 
-static uint32_t insert_fd(int open_flags, int fd)
+static uint32_t insert_fd(int open_flags, int fd, char *path)
 {
     uint32_t handle = fd;
 
@@ -62,11 +73,13 @@ static uint32_t insert_fd(int open_flags, int fd)
             if (open_flags & O_TRUNC) {
                 fd_state[fd] = SS_DIRTY;  /* set fd dirty */
             }
+            fd_path[fd] = path;
     } else {
             ALOGW("%s: untracked fd %u\n", __func__, fd);
             if (open_flags & (O_TRUNC | O_CREAT)) {
                 fs_state = SS_DIRTY;
             }
+            free(path);
     }
     return handle;
 }
@@ -87,10 +100,48 @@ static int remove_fd(uint32_t handle)
 {
     if (handle < FD_TBL_SIZE) {
         fd_state[handle] = SS_UNUSED; /* set to uninstalled */
+        free(fd_path[handle]);
+        fd_path[handle] = NULL;
     }
     return handle;
 }
 
+/* Returns a deferred fd for path, taking it back off the deferred list. */
+static int reclaim_deferred_fd(const char *path)
+{
+    for (uint i = 0; i < deferred_close_cnt; i++) {
+        int fd = deferred_close[i];
+        if (fd_path[fd] && !strcmp(fd_path[fd], path)) {
+            deferred_close[i] = deferred_close[--deferred_close_cnt];
+            return fd;
+        }
+    }
+    return -1;
+}
+
+/* A deleted file must not be handed out again under its old name. */
+static void forget_path(const char *path)
+{
+    for (uint fd = 0; fd < FD_TBL_SIZE; fd++) {
+        if (fd_path[fd] && !strcmp(fd_path[fd], path)) {
+            free(fd_path[fd]);
+            fd_path[fd] = NULL;
+        }
+    }
+}
+
+static void close_deferred_fds(void)
+{
+    for (uint i = 0; i < deferred_close_cnt; i++) {
+        int fd = remove_fd(deferred_close[i]);
+        if (close(fd) < 0) {
+            ALOGE("%s: close failed for fd=%u: %s\n",
+                  __func__, fd, strerror(errno));
+        }
+    }
+    deferred_close_cnt = 0;
+}
+
 static enum storage_err translate_errno(int error)
 {
     enum storage_err result;
@@ -188,6 +239,7 @@ int storage_file_delete(struct storage_msg *msg,
     }
 
     dir_state = SS_DIRTY;
+    forget_path(path);
     rc = unlink(path);
     if (rc < 0) {
         rc = errno;
@@ -243,6 +295,18 @@ int storage_file_open(struct storage_msg *msg,
 
     int open_flags = O_RDWR;
 
+    if (!(req->flags & (STORAGE_FILE_OPEN_TRUNCATE | STORAGE_FILE_OPEN_CREATE_EXCLUSIVE))) {
+        rc = reclaim_deferred_fd(path);
+        if (rc >= 0) {
+            /* still open and dirty from before, the next checkpoint syncs it */
+            ALOGV("%s: \"%s\": reusing fd = %d\n", __func__, path, rc);
+            free(path);
+            msg->result = STORAGE_NO_ERROR;
+            resp.handle = rc;
+            return ipc_respond(msg, &resp, sizeof(resp));
+        }
+    }
+
     if (req->flags & STORAGE_FILE_OPEN_TRUNCATE)
         open_flags |= O_TRUNC;
 
@@ -279,13 +343,10 @@ int storage_file_open(struct storage_msg *msg,
         msg->result = translate_errno(rc);
         goto err_response;
     }
-    free(path);
-
     /* at this point rc contains storage file fd */
+    ALOGV("%s: \"%s\": fd = %u\n", __func__, path, rc);
     msg->result = STORAGE_NO_ERROR;
-    resp.handle = insert_fd(open_flags, rc);
-    ALOGV("%s: \"%s\": fd = %u: handle = %d\n",
-          __func__, path, rc, resp.handle);
+    resp.handle = insert_fd(open_flags, rc, path);
 
     return ipc_respond(msg, &resp, sizeof(resp));
 
@@ -307,10 +368,22 @@ int storage_file_close(struct storage_msg *msg,
         goto err_response;
     }
 
-    int fd = remove_fd(req->handle);
+    int fd = req->handle;
     ALOGV("%s: handle = %u: fd = %u\n", __func__, req->handle, fd);
 
-    int rc = fsync(fd);
+    if (req->handle < FD_TBL_SIZE && fd_state[fd] == SS_DIRTY &&
+        deferred_close_cnt < MAX_DEFERRED_CLOSE) {
+        /* leave it to the next checkpoint */
+        deferred_close[deferred_close_cnt++] = fd;
+        msg->result = STORAGE_NO_ERROR;
+        goto err_response;
+    }
+
+    /* a clean fd has nothing left to sync */
+    bool need_sync = req->handle >= FD_TBL_SIZE || fd_state[fd] != SS_CLEAN;
+    remove_fd(req->handle);
+
+    int rc = need_sync ? fsync(fd) : 0;
     if (rc < 0) {
         rc = errno;
         ALOGE("%s: fsync failed for fd=%u: %s\n",
@@ -524,6 +597,9 @@ int storage_sync_checkpoint(void)
         fs_state = SS_CLEAN;
     }
 
+    /* everything is on disk now, so deferred closes can go through */
+    close_deferred_fds();
+
     return 0;
 }
 